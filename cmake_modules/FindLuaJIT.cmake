@@ -0,0 +1,44 @@
+# - Try to find LuaJIT
+#
+# This module defines the following variables
+#
+# LUAJIT_FOUND - Was LuaJIT found
+# LUAJIT_INCLUDE_DIRS - the LuaJIT include directories
+# LUAJIT_LIBRARIES - Link to this
+#
+# This module accepts the following variables
+#
+# LUAJIT_ROOT - Can be set to the LuaJIT install path
+#
+
+if(NOT LUAJIT_ROOT)
+    set(LUAJIT_ROOT $ENV{LUAJIT_ROOT})
+endif()
+
+find_path(LUAJIT_INCLUDE_DIR NAMES luajit.h
+    PATHS
+        ${LUAJIT_ROOT}/include
+        ${LUAJIT_ROOT}/src
+    PATH_SUFFIXES luajit-2.1 luajit-2.0
+)
+
+find_library(LUAJIT_LIBRARY
+    NAMES luajit-5.1 luajit lua51
+    PATHS
+        ${LUAJIT_ROOT}
+        ${LUAJIT_ROOT}/src
+    PATH_SUFFIXES lib
+)
+
+mark_as_advanced(LUAJIT_INCLUDE_DIR LUAJIT_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LuaJIT DEFAULT_MSG
+    LUAJIT_LIBRARY
+    LUAJIT_INCLUDE_DIR
+)
+
+if(LUAJIT_FOUND)
+    set(LUAJIT_INCLUDE_DIRS ${LUAJIT_INCLUDE_DIR})
+    set(LUAJIT_LIBRARIES ${LUAJIT_LIBRARY})
+endif()
@@ -0,0 +1,19 @@
+-- Settings for builds with THRIVE_TRACK_ALLOCATIONS, see AllocationTracker
+
+-- Systems that must not allocate once the game has settled
+ALLOCATION_FREE_SYSTEMS = {
+    "AgentAbsorberSystem",
+    "AgentMovementSystem",
+    "OgreUpdateSceneNodeSystem",
+    "PhysicsPipeline"
+}
+
+-- Whether to warn about allocations in those systems
+ALLOCATION_STRICT_MODE = true
+
+for _, name in ipairs(ALLOCATION_FREE_SYSTEMS) do
+    Engine.allocationTracker:setHot(name, true)
+end
+if AllocationTracker.isAvailable() then
+    Engine.allocationTracker:setStrict(ALLOCATION_STRICT_MODE)
+end
@@ -5,3 +5,15 @@ PLAYER_NAME = "player"
 
 -- Name of the main camera entity
 CAMERA_NAME = "camera"
+
+-- Scene nodes farther than this from the camera are dropped until they
+-- come closer than the load distance again
+STREAMING_LOAD_DISTANCE = 28
+STREAMING_UNLOAD_DISTANCE = 36
+
+-- Edge length of the world sectors. Entities more than two sectors away
+-- from the player's sector are stored until it comes closer again.
+WORLD_SECTOR_SIZE = 25
+
+-- Hexes covering fewer pixels than this on screen are not rendered
+HEX_MIN_PIXEL_SIZE = 3
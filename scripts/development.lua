@@ -0,0 +1,37 @@
+-- Settings for working on the scripts
+
+-- Reload the scripts whenever one of them is saved. F5 reloads them
+-- regardless.
+SCRIPT_WATCHING = false
+
+Engine:setScriptWatching(SCRIPT_WATCHING)
+
+-- VM instructions between two samples of the Lua profiler, which is
+-- toggled with F6
+PROFILER_INSTRUCTION_INTERVAL = 1000
+
+-- Number of systems and functions shown while profiling
+PROFILER_REPORT_LENGTH = 8
+
+-- Where the profile is written when profiling stops, as input for
+-- flamegraph.pl
+PROFILER_OUTPUT_FILE = "lua_profile.folded"
+
+-- Number of systems shown in the system timings, which are toggled with F7
+SYSTEM_PROFILE_LENGTH = 25
+
+-- Whether the system timings include hardware counters, like instructions
+-- per cycle and cache misses per entity. Linux only.
+SYSTEM_PROFILE_HARDWARE_COUNTERS = false
+
+-- Whether the system timings include the GPU time of the viewports and
+-- render queue groups. OpenGL only.
+SYSTEM_PROFILE_GPU = false
+
+-- Whether the system timings split rendering into updating the scene graph,
+-- culling and submission
+SYSTEM_PROFILE_FRAME_STAGES = false
+
+-- Number of component types shown in the memory statistics, which are
+-- toggled with F9
+MEMORY_STATS_LENGTH = 12
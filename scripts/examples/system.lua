@@ -17,6 +17,8 @@ function MySystem:__init()
         -- removed entities
         true 
     )
+    -- Optional. Detaches the EntityFilter while the system is disabled
+    self:registerFilter(self.entities)
 end
 
 -- Called once before the first call to update()
@@ -0,0 +1,16 @@
+-- Settings for the Lua garbage collector, see LuaGarbageCollector
+
+-- Time per frame spent collecting, in microseconds. With 0, Lua collects
+-- whenever scripts allocate, which can cause hitches.
+GC_STEP_BUDGET = 1000
+
+-- Work per incremental step, in kilobytes
+GC_STEP_SIZE = 4
+
+-- How far the heap may grow beyond its size after the last collection
+-- before the budget is ignored
+GC_MAX_HEAP_GROWTH = 2.0
+
+Engine.garbageCollector:setStepSize(GC_STEP_SIZE)
+Engine.garbageCollector:setMaxHeapGrowth(GC_MAX_HEAP_GROWTH)
+Engine.garbageCollector:setStepBudget(GC_STEP_BUDGET)
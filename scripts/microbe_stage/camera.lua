@@ -6,16 +6,24 @@ local OFFSET = Vector3(0, 0, 30)
 
 function MicrobeCameraSystem:__init()
     System.__init(self)
+    self.cameraPosition = Vector3(0, 0, 0)
+end
+
+
+function MicrobeCameraSystem:init(gameState)
+    System.init(self, gameState)
+    self.entities = EntityCache(gameState)
 end
 
 
 function MicrobeCameraSystem:update(milliseconds)
-    local camera = Entity(CAMERA_NAME)
-    local player = Entity(PLAYER_NAME)
+    local camera = self.entities:named(CAMERA_NAME)
+    local player = self.entities:named(PLAYER_NAME)
     local playerNode = player:getComponent(OgreSceneNodeComponent.TYPE_ID)
-    local cameraNode = camera:getComponent(OgreSceneNodeComponent.TYPE_ID)
-    cameraNode.transform.position = playerNode.transform.position + OFFSET
-    cameraNode.transform:touch()
+    self.cameraPosition:setSum(playerNode.transform.position, OFFSET)
+    -- Applied by the scene node system along with the other staged writes
+    local writes = Engine:currentGameState():entityManager():stagedWrites()
+    writes:stageVector3(camera.id, OgreSceneNodeComponent.POSITION_FIELD, self.cameraPosition)
 end
 
 
@@ -3,35 +3,181 @@ class 'HudSystem' (System)
 
 function HudSystem:__init()
     System.__init(self)
+    self.showScriptStats = false
+    self.showMemoryStats = false
+    self.memoryStatsRefreshTime = 0
+    self.showStatistics = false
+    self.statisticsRefreshTime = 0
+    self.profileRefreshTime = 0
+    self.systemProfileRefreshTime = 0
+end
+
+
+function HudSystem:init(gameState)
+    System.init(self, gameState)
+    self.entities = EntityCache(gameState)
 end
 
 
 function HudSystem:update(milliseconds)
-    local player = Entity("player")
+    local player = self.entities:named(PLAYER_NAME)
     local playerMicrobe = Microbe(player)
 
     local energy = playerMicrobe:getAgentAmount(1)
-    local energyTextOverlay = Entity("hud.energyCount"):getComponent(TextOverlayComponent.TYPE_ID)
+    local energyTextOverlay = self.entities:named("hud.energyCount"):getComponent(TextOverlayComponent.TYPE_ID)
     energyTextOverlay.properties.text = string.format("Energy: %d", energy)
     energyTextOverlay.properties:touch()
 
     local FONT_HEIGHT = 18 -- Not sure how to determine this correctly
     local agentsString =  "Agents: "
     local agentCountsString =  ""
-    for agentID in pairs(playerMicrobe.microbe.vacuoles) do
+    local agentCount = 0
+    for agentID in playerMicrobe.microbe:vacuoleAgents() do
+        agentCount = agentCount + 1
         --Following string.format doesn't quite allign text as desired for unknown reasons. (Could be a non-monospace font problem)
         agentsString = agentsString .. string.format("\n%-10s", AgentRegistry.getAgentDisplayName(agentID))
         agentCountsString = agentCountsString .. string.format("\n -  %d", playerMicrobe:getAgentAmount(agentID)) 
     end
-    local agentsTextOverlay = Entity("hud.playerAgents"):getComponent(TextOverlayComponent.TYPE_ID)
+    local agentsTextOverlay = self.entities:named("hud.playerAgents"):getComponent(TextOverlayComponent.TYPE_ID)
     agentsTextOverlay.properties.text = agentsString
-    agentsTextOverlay.properties.height = FONT_HEIGHT  + FONT_HEIGHT * #playerMicrobe.microbe.vacuoles
-    agentsTextOverlay.properties.top = -2*FONT_HEIGHT -FONT_HEIGHT * #playerMicrobe.microbe.vacuoles
+    agentsTextOverlay.properties.height = FONT_HEIGHT  + FONT_HEIGHT * agentCount
+    agentsTextOverlay.properties.top = -2*FONT_HEIGHT -FONT_HEIGHT * agentCount
     agentsTextOverlay.properties:touch()
-    local agentCountsTextOverlay = Entity("hud.playerAgentCounts"):getComponent(TextOverlayComponent.TYPE_ID)
+    local agentCountsTextOverlay = self.entities:named("hud.playerAgentCounts"):getComponent(TextOverlayComponent.TYPE_ID)
     agentCountsTextOverlay.properties.text = agentCountsString
-    agentCountsTextOverlay.properties.height = FONT_HEIGHT  + FONT_HEIGHT * #playerMicrobe.microbe.vacuoles
-    agentCountsTextOverlay.properties.top = -2*FONT_HEIGHT -FONT_HEIGHT * #playerMicrobe.microbe.vacuoles
+    agentCountsTextOverlay.properties.height = FONT_HEIGHT  + FONT_HEIGHT * agentCount
+    agentCountsTextOverlay.properties.top = -2*FONT_HEIGHT -FONT_HEIGHT * agentCount
     agentCountsTextOverlay.properties:touch()
+    self:updateScriptStats()
+    self:updateProfile(milliseconds)
+    self:updateSystemProfile(milliseconds)
+    self:updateMemoryStats(milliseconds)
+    self:updateStatistics(milliseconds)
+end
+
+
+function HudSystem:updateProfile(milliseconds)
+    local profiler = Engine.profiler
+    local profileOverlay = self.entities:named("hud.luaProfile"):getComponent(TextOverlayComponent.TYPE_ID)
+    if Engine.keyboard:wasKeyPressed(Keyboard.KC_F6) then
+        if profiler:isRunning() then
+            profiler:stop()
+            profiler:writeFlameGraph(PROFILER_OUTPUT_FILE)
+            profileOverlay.properties.text = ""
+            profileOverlay.properties:touch()
+        else
+            profiler:reset()
+            profiler:start(PROFILER_INSTRUCTION_INTERVAL)
+            self.profileRefreshTime = 0
+        end
+    end
+    if not profiler:isRunning() then
+        return
+    end
+    -- Building the report every frame would show up in the profile
+    self.profileRefreshTime = self.profileRefreshTime - milliseconds
+    if self.profileRefreshTime <= 0 then
+        self.profileRefreshTime = 500
+        profileOverlay.properties.text = profiler:report(PROFILER_REPORT_LENGTH)
+        profileOverlay.properties:touch()
+    end
+end
+
+
+function HudSystem:updateSystemProfile(milliseconds)
+    local profiler = Engine:currentGameState().systemProfiler
+    local profileOverlay = self.entities:named("hud.systemProfile"):getComponent(TextOverlayComponent.TYPE_ID)
+    if Engine.keyboard:wasKeyPressed(Keyboard.KC_F7) then
+        profiler:setEnabled(not profiler:isEnabled())
+        profiler:setCountingHardware(SYSTEM_PROFILE_HARDWARE_COUNTERS)
+        local renderSystem = RenderSystem.find(Engine:currentGameState())
+        if renderSystem then
+            renderSystem:setTimingGpu(SYSTEM_PROFILE_GPU)
+            renderSystem:setTimingFrameStages(SYSTEM_PROFILE_FRAME_STAGES)
+        end
+        profiler:reset()
+        self.systemProfileRefreshTime = 0
+        if not profiler:isEnabled() then
+            profileOverlay.properties.text = ""
+            profileOverlay.properties:touch()
+        end
+    end
+    if not profiler:isEnabled() then
+        return
+    end
+    self.systemProfileRefreshTime = self.systemProfileRefreshTime - milliseconds
+    if self.systemProfileRefreshTime <= 0 then
+        self.systemProfileRefreshTime = 500
+        profileOverlay.properties.text = profiler:report(SYSTEM_PROFILE_LENGTH)
+        profileOverlay.properties:touch()
+    end
+end
+
+
+function HudSystem:updateScriptStats()
+    local wasShown = self.showScriptStats
+    if Engine.keyboard:wasKeyPressed(Keyboard.KC_F3) then
+        self.showScriptStats = not self.showScriptStats
+    end
+    if not self.showScriptStats and not wasShown then
+        return
+    end
+    local text = ""
+    if self.showScriptStats then
+        local gc = Engine.garbageCollector
+        text = string.format(
+            "Lua heap: %.0f KB\nGC step: %.2f ms\nGC cycles: %d",
+            gc:heapSize(),
+            gc:lastStepTime() / 1000,
+            gc:cycleCount()
+        )
+    end
+    local scriptStatsOverlay = self.entities:named("hud.scriptStats"):getComponent(TextOverlayComponent.TYPE_ID)
+    scriptStatsOverlay.properties.text = text
+    scriptStatsOverlay.properties:touch()
+end
+
+
+function HudSystem:updateMemoryStats(milliseconds)
+    local statsOverlay = self.entities:named("hud.memoryStats"):getComponent(TextOverlayComponent.TYPE_ID)
+    if Engine.keyboard:wasKeyPressed(Keyboard.KC_F9) then
+        self.showMemoryStats = not self.showMemoryStats
+        self.memoryStatsRefreshTime = 0
+        if not self.showMemoryStats then
+            statsOverlay.properties.text = ""
+            statsOverlay.properties:touch()
+        end
+    end
+    if not self.showMemoryStats then
+        return
+    end
+    -- Counting walks all collections and scene nodes
+    self.memoryStatsRefreshTime = self.memoryStatsRefreshTime - milliseconds
+    if self.memoryStatsRefreshTime <= 0 then
+        self.memoryStatsRefreshTime = 1000
+        statsOverlay.properties.text = Engine:memoryStats():report(MEMORY_STATS_LENGTH)
+        statsOverlay.properties:touch()
+    end
 end
 
+
+function HudSystem:updateStatistics(milliseconds)
+    local statisticsOverlay = self.entities:named("hud.statistics"):getComponent(TextOverlayComponent.TYPE_ID)
+    if Engine.keyboard:wasKeyPressed(Keyboard.KC_F2) then
+        self.showStatistics = not self.showStatistics
+        self.statisticsRefreshTime = 0
+        if not self.showStatistics then
+            statisticsOverlay.properties.text = ""
+            statisticsOverlay.properties:touch()
+        end
+    end
+    if not self.showStatistics then
+        return
+    end
+    self.statisticsRefreshTime = self.statisticsRefreshTime - milliseconds
+    if self.statisticsRefreshTime <= 0 then
+        self.statisticsRefreshTime = 500
+        statisticsOverlay.properties.text = Engine.statistics:report()
+        statisticsOverlay.properties:touch()
+    end
+end
@@ -1,53 +1,3 @@
---------------------------------------------------------------------------------
--- MicrobeComponent
---
--- Holds data common to all microbes. You probably shouldn't use this directly,
--- use the Microbe class (below) instead.
---------------------------------------------------------------------------------
-class 'MicrobeComponent' (Component)
-
-COMPOUND_DISTRIBUTION_INTERVAL = 100 -- quantity of physics time between each loop distributing agents to organelles. TODO: Modify to reflect microbe size.
-
-function MicrobeComponent:__init()
-    Component.__init(self)
-    self.organelles = {}
-    self.vacuoles = {}
-    self.processOrganelles = {}
-    self.movementDirection = Vector3(0, 0, 0)
-    self.facingTargetPoint = Vector3(0, 0, 0)
-    self.initialized = false
-end
-
-
-function MicrobeComponent:load(storage)
-    Component.load(self, storage)
-    local organelles = storage:get("organelles", {})
-    for i = 1,organelles:size() do
-        local organelleStorage = organelles:get(i)
-        local organelle = Organelle.loadOrganelle(organelleStorage)
-        local q = organelle.position.q
-        local r = organelle.position.r
-        local s = encodeAxial(q, r)
-        self.organelles[s] = organelle
-    end
-end
-
-
-function MicrobeComponent:storage()
-    local storage = Component.storage(self)
-    -- Organelles
-    local organelles = StorageList()
-    for _, organelle in pairs(self.organelles) do
-        local organelleStorage = organelle:storage()
-        organelles:append(organelleStorage)
-    end
-    storage:set("organelles", organelles)
-    return storage
-end
-
-REGISTER_COMPONENT("MicrobeComponent", MicrobeComponent)
-
-
 --------------------------------------------------------------------------------
 -- Microbe class
 --
@@ -88,6 +38,9 @@ function Microbe.createMicrobeEntity(name, aiControlled)
         AgentAbsorberComponent(),
         OgreSceneNodeComponent(),
         MicrobeComponent(),
+        MovementComponent(),
+        ProcessComponent(),
+        VacuoleComponent(),
         reactionHandler,
         rigidBody,
         compoundEmitter
@@ -95,6 +48,10 @@ function Microbe.createMicrobeEntity(name, aiControlled)
     if aiControlled then
         local aiController = MicrobeAIControllerComponent()
         table.insert(components, aiController)
+        -- Distant AI microbes are simulated less often and stored with
+        -- their sector when out of range
+        table.insert(components, SimulationLodComponent())
+        table.insert(components, WorldSectorComponent())
     end
     for _, component in ipairs(components) do
         entity:addComponent(component)
@@ -123,11 +80,24 @@ Microbe.COMPONENTS = {
 --  The entity this microbe wraps
 function Microbe:__init(entity)
     self.entity = entity
-    self.residuePhysicsTime = 0
-    for key, typeId in pairs(Microbe.COMPONENTS) do
-        local component = entity:getComponent(typeId)
-        assert(component ~= nil, "Can't create microbe from this entity, it's missing " .. key)
-        self[key] = entity:getComponent(typeId)
+    entity:getComponents(Microbe.COMPONENTS, self)
+    for key in pairs(Microbe.COMPONENTS) do
+        assert(self[key] ~= nil, "Can't create microbe from this entity, it's missing " .. key)
+    end
+    -- Microbes from older savegames don't have these yet
+    self.processes = entity:getOrCreate(ProcessComponent)
+    self.vacuoles = entity:getOrCreate(VacuoleComponent)
+    -- Driven by the movement organelles' thrusters
+    self.movement = entity:getOrCreate(MovementComponent)
+    self.movement.energyAgent = AgentRegistry.getAgentId("atp")
+    -- The organelles' hexes, drawn as one mesh
+    self.meshBake = entity:getOrCreate(OgreMeshBakeComponent)
+    -- Distant microbes shrink to a few pixels
+    self.meshBake.minPixelSize = HEX_MIN_PIXEL_SIZE
+    -- Only AI controlled microbes have these
+    self.aiController = entity:getComponent(MicrobeAIControllerComponent.TYPE_ID)
+    if self.aiController ~= nil then
+        self.simulationLod = entity:getOrCreate(SimulationLodComponent)
     end
     if not self.microbe.initialized then
         self:_initialize()
@@ -147,12 +117,12 @@ end
 --  The organelle to add
 function Microbe:addOrganelle(q, r, organelle)
     local s = encodeAxial(q, r)
-    if self.microbe.organelles[s] then
+    if not self.microbe:addOrganelle(q, r, organelle) then
         assert(false)
         return false
     end
-    self.microbe.organelles[s] = organelle
     organelle.microbe = self
+    self:_placeOrganelle(s, organelle, q, r)
     local x, y = axialToCartesian(q, r)
     local translation = Vector3(x, y, 0)
     -- Collision shape
@@ -161,11 +131,15 @@ function Microbe:addOrganelle(q, r, organelle)
         Quaternion(Radian(0), Vector3(1,0,0)),
         organelle.collisionShape
     )
+    -- Update the shape and mass properties. Several organelles added in the
+    -- same frame only cost one rigid body update.
+    self.rigidBody.properties:touchFields(RigidBodyComponent.Properties.SHAPE)
     -- Scene node
     organelle.sceneNode.parent = self.entity
     organelle.sceneNode.transform.position = translation
     organelle.sceneNode.transform:touch()
     organelle:onAddedToMicrobe(self, q, r)
+    self.microbe:setOrganelleStorage(q, r, organelle:storage())
     self:_updateAllHexColours()
     return true
 end
@@ -180,24 +154,18 @@ function Microbe:addVacuole(vacuole)
     assert(vacuole.capacity ~= nil)
     assert(vacuole.amount ~= nil)
     local agentId = vacuole.agentId
-    if not self.microbe.vacuoles[agentId] then
-        self.microbe.vacuoles[agentId] = {}
+    self.microbe:addVacuole(agentId, vacuole.capacity)
+    self.vacuoles:addCapacity(agentId, vacuole.capacity)
+    -- The amounts are kept by the VacuoleComponent, vacuoles from older
+    -- savegames still carry their own
+    if vacuole.amount > 0 then
+        self.vacuoles:storeAgent(agentId, vacuole.amount)
+        vacuole.amount = 0
     end
-    local vacuoleList = self.microbe.vacuoles[agentId]
-    table.insert(vacuoleList, vacuole)
     self:_updateAgentAbsorber(vacuole.agentId)
 end
 
 
--- Adds a process organelle
---
--- @param processOrganelle
---  An object of type ProcessOrganelle
-function Microbe:addProcessOrganelle(processOrganelle)
-    table.insert(self.microbe.processOrganelles, processOrganelle)
-end
-
-
 -- Queries the currently stored amount of an agent
 --
 -- @param agentId
@@ -206,14 +174,7 @@ end
 -- @returns amount
 --  The amount stored in the microbe's vacuoles
 function Microbe:getAgentAmount(agentId)
-    local vacuoleList = self.microbe.vacuoles[agentId]
-    local totalAmount = 0.0
-    if vacuoleList then
-        for _, vacuole in ipairs(vacuoleList) do
-            totalAmount = totalAmount + vacuole.amount
-        end
-    end
-    return totalAmount
+    return self.vacuoles:agentAmount(agentId)
 end
 
 
@@ -225,14 +186,11 @@ end
 -- @returns organelle
 --  The organelle at (q,r) or nil if the hex is unoccupied
 function Microbe:getOrganelleAt(q, r)
-    for _, organelle in pairs(self.microbe.organelles) do
-        local localQ = q - organelle.position.q
-        local localR = r - organelle.position.r
-        if organelle:getHex(localQ, localR) ~= nil then
-            return organelle
-        end
+    local s = self.microbe.hexGrid:get(q, r)
+    if s == 0 then
+        return nil
     end
-    return nil
+    return self.microbe:getOrganelle(decodeAxial(s))
 end
 
 
@@ -245,14 +203,13 @@ end
 --  True if an organelle has been removed, false if there was no organelle
 --  at (q,r)
 function Microbe:removeOrganelle(q, r)
-    local index = nil
-    local s = encodeAxial(q, r)
-    local organelle = table.remove(self.microbe.organelles, index)
+    local organelle = self.microbe:getOrganelle(q, r)
     if not organelle then
         return false
     end
-    organelle.position.q = 0
-    organelle.position.r = 0
+    self.microbe:removeOrganelle(q, r)
+    self:_placeOrganelle(0, organelle, q, r)
+    -- Resets the organelle's position
     organelle:onRemovedFromMicrobe(self)
     self:_updateAllHexColours()
     return true
@@ -264,16 +221,9 @@ end
 -- @param vacuole
 --  The vacuole to remove
 function Microbe:removeVacuole(vacuole)
-    local vacuoleList = self.microbe.vacuoles[vacuole.agentId]
-    local indexToRemove = 0
-    for i, v in ipairs(self.microbe.vacuoles) do
-        if v == vacuole then
-            indexToRemove = i
-            break
-        end
-    end
-    assert(indexToRemove > 0, "Vacuole not found")
-    table.remove(self.microbe.vacuoles, indexToRemove)
+    local removed = self.microbe:removeVacuole(vacuole.agentId, vacuole.capacity)
+    assert(removed, "Vacuole not found")
+    self.vacuoles:removeCapacity(vacuole.agentId, vacuole.capacity)
     self:_updateAgentAbsorber(vacuole.agentId)
 end
 
@@ -289,39 +239,14 @@ end
 --  The amount to store
 --
 function Microbe:storeAgent(agentId, amount)
-    local vacuoleList = self.microbe.vacuoles[agentId]
-    local remainingAmount = amount
-    if vacuoleList then
-        for _, vacuole in ipairs(vacuoleList) do
-            local storedAmount = math.min(remainingAmount, vacuole.capacity - vacuole.amount)
-            vacuole.amount = vacuole.amount + storedAmount
-            remainingAmount = remainingAmount - storedAmount
-            if remainingAmount <= 0.0 then
-                break
-            end
-        end
-    end
+    local remainingAmount = self.vacuoles:storeAgent(agentId, amount)
     self:_updateAgentAbsorber(agentId)
     if remainingAmount > 0 then -- If there is excess compounds, we will eject them
-        local yAxis = self.sceneNode.transform.orientation:yAxis()
-
-        local particleCount = 1
-        if remainingAmount >= 3  then
-            particleCount = 3
-        end
-        local i
-        for i = 1, particleCount do
-            local angle = math.atan2(-yAxis.x, -yAxis.y)
-            if (angle < 0) then 
-                angle = angle + 2*math.pi 
-            end
-            angle = angle * 180/math.pi
-            local minAngle = angle - 30 -- over and underflow of angles are handled automatically
-            local maxAngle = angle + 30    
-            self.compoundEmitter.minEmissionAngle = Degree(minAngle)
-            self.compoundEmitter.maxEmissionAngle = Degree(maxAngle)
-            self.compoundEmitter:emitAgent(agentId, remainingAmount/particleCount)
-        end
+        self.compoundEmitter:ejectAgent(
+            agentId,
+            remainingAmount,
+            self.sceneNode.transform.orientation
+        )
     end
 end
 
@@ -337,67 +262,52 @@ end
 -- @returns amount
 --  The amount that was actually taken, between 0.0 and maxAmount.
 function Microbe:takeAgent(agentId, maxAmount)
-    local vacuoleList = self.microbe.vacuoles[agentId]
-    local totalTaken = 0.0
-    if vacuoleList then
-        for _, vacuole in ipairs(vacuoleList) do
-            local amountTaken = math.min(maxAmount - totalTaken, vacuole.amount)
-            vacuole.amount = math.max(vacuole.amount - amountTaken, 0.0)
-            totalTaken = totalTaken + amountTaken
-            if totalTaken >= maxAmount then
-                break
-            end
-        end
-    end
+    local totalTaken = self.vacuoles:takeAgent(agentId, maxAmount)
     self:_updateAgentAbsorber(agentId)
     return totalTaken
 end
 
 
 -- Updates the microbe's state
+--
+-- Absorbing, storing and processing agents is done by the ProcessSystem.
 function Microbe:update(milliseconds)
-    -- Vacuoles
-    for agentId, vacuoleList in pairs(self.microbe.vacuoles) do
-        -- Check for agents to store
-        local amount = self.agentAbsorber:absorbedAgentAmount(agentId)
-        if amount > 0.0 then
-            self:storeAgent(agentId, amount)
-        end
+    if self.aiController ~= nil and self.aiController:takeDecision() then
+        self.microbe.facingTargetPoint = self.aiController.facingTargetPoint
+        self.microbe.movementDirection = self.aiController.movementDirection
     end
-    -- Distribute agents to StorageOrganelles
-    self.residuePhysicsTime = self.residuePhysicsTime + milliseconds
-    while self.residuePhysicsTime > COMPOUND_DISTRIBUTION_INTERVAL do -- For every COMPOUND_DISTRIBUTION_INTERVAL passed
-        for agentId, vacuoleList in pairs(self.microbe.vacuoles) do -- Foreach agent type.
-            if self:getAgentAmount(agentId) > 0 then -- If microbe contains the compound
-                local candidateIndices = {} -- Indices of organelles that want the agent
-                for i, processOrg in ipairs(self.microbe.processOrganelles) do  
-                    if processOrg:wantsInputAgent(agentId) then   
-                        table.insert(candidateIndices, i) -- Organelle has determined that it is interrested in obtaining the agnet
-                    end
-                end
-                if #candidateIndices > 0 then -- If there were any candidates, pick a random winner.
-                    local chosenProcessOrg = self.microbe.processOrganelles[candidateIndices[rng:getInt(1,#candidateIndices)]]
-                    chosenProcessOrg:storeAgent(agentId, self:takeAgent(agentId, 1))
-                end
-            end
-        end
-        self.residuePhysicsTime = self.residuePhysicsTime - COMPOUND_DISTRIBUTION_INTERVAL
-    end
-    -- Other organelles
-    for _, organelle in pairs(self.microbe.organelles) do
+    for organelle in self.microbe:organelles() do
         organelle:update(self, milliseconds)
+        if organelle.storageChanged then
+            organelle.storageChanged = false
+            self.microbe:setOrganelleStorage(
+                organelle.position.q,
+                organelle.position.r,
+                organelle:storage()
+            )
+        end
     end
 end
 
 
 -- Private function for initializing a microbe's components
 function Microbe:_initialize()
+    -- Rebuild the collision shape once instead of after every organelle
+    self.rigidBody.properties.shape:beginChanges()
     self.rigidBody.properties.shape:clear()
+    self.microbe.hexGrid:clear()
+    -- Loaded organelles only have their storage
+    local loadedOrganelles = self.microbe:takeLoadedOrganelles()
+    for i = 1,loadedOrganelles:size() do
+        local organelle = Organelle.loadOrganelle(loadedOrganelles:get(i))
+        self.microbe:addOrganelle(organelle.position.q, organelle.position.r, organelle)
+    end
     -- Organelles
-    for s, organelle in pairs(self.microbe.organelles) do
+    for organelle in self.microbe:organelles() do
         organelle.microbe = self
         local q = organelle.position.q
         local r = organelle.position.r
+        self:_placeOrganelle(encodeAxial(q, r), organelle, q, r)
         local x, y = axialToCartesian(q, r)
         local translation = Vector3(x, y, 0)
         -- Collision shape
@@ -411,25 +321,37 @@ function Microbe:_initialize()
         organelle.sceneNode.transform.position = translation
         organelle.sceneNode.transform:touch()
         organelle:onAddedToMicrobe(self, q, r)
+        self.microbe:setOrganelleStorage(q, r, organelle:storage())
     end
+    self.rigidBody.properties.shape:commitChanges()
+    self.rigidBody.properties:touchFields(RigidBodyComponent.Properties.SHAPE)
     self:_updateAllHexColours()
     self.microbe.initialized = true
 end
 
 
+-- Private function for marking the hex cells of an organelle
+--
+-- @param s
+--  The organelle's key, encodeAxial() of its center, 0 to clear the cells
+--
+-- @param organelle
+--
+-- @param q, r
+--  Axial coordinates of the organelle's center
+function Microbe:_placeOrganelle(s, organelle, q, r)
+    for hexQ, hexR in organelle:iterateHexes() do
+        self.microbe.hexGrid:set(q + hexQ, r + hexR, s)
+    end
+end
+
+
 -- Private function for updating the agent absorber
 --
 -- Toggles the absorber on and off depending on the remaining storage
 -- capacity of the vacuoles.
 function Microbe:_updateAgentAbsorber(agentId)
-    local vacuoleList = self.microbe.vacuoles[agentId]
-    local canAbsorb = false
-    if vacuoleList then
-        for _, vacuole in ipairs(vacuoleList) do
-            canAbsorb = canAbsorb or vacuole.amount < vacuole.capacity
-        end
-    end
-    self.agentAbsorber:setCanAbsorbAgent(agentId, canAbsorb)
+    self.agentAbsorber:setCanAbsorbAgent(agentId, self.vacuoles:canStoreAgent(agentId))
 end
 
 
@@ -437,7 +359,7 @@ end
 --
 -- The simple coloured hexes are a placeholder for proper models.
 function Microbe:_updateAllHexColours()
-    for s, organelle in pairs(self.microbe.organelles) do
+    for organelle in self.microbe:organelles() do
         organelle:updateHexColours()
     end
 end
@@ -496,7 +418,13 @@ function MicrobeSystem:update(milliseconds)
     end
     self.entities:clearChanges()
     for _, microbe in pairs(self.microbes) do
-        microbe:update(milliseconds)
+        local lod = microbe.simulationLod
+        if lod == nil then
+            microbe:update(milliseconds)
+        elseif lod.isDue then
+            -- Covers the frames the microbe was skipped in
+            microbe:update(lod.dueMilliseconds)
+        end
     end
 end
 
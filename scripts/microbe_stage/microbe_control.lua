@@ -6,43 +6,57 @@ function MicrobeControlSystem:__init()
 end
 
 
+-- The plane the microbes move in
+local MOVEMENT_PLANE = Plane(Vector3(0, 0, 1), 0)
+
+-- Reused by getMovementDirection()
+local movementDirection = Vector3(0, 0, 0)
+
+
 -- Computes the point the mouse cursor is at
-local function getTargetPoint()
+local function getTargetPoint(entities)
     local mousePosition = Engine.mouse:normalizedPosition() 
-    local playerCam = Entity(CAMERA_NAME)
+    local playerCam = entities:named(CAMERA_NAME)
     local cameraComponent = playerCam:getComponent(OgreCameraComponent.TYPE_ID)
     local ray = cameraComponent:getCameraToViewportRay(mousePosition.x, mousePosition.y)
-    local plane = Plane(Vector3(0, 0, 1), 0)
-    local intersects, t = ray:intersects(plane)
+    local intersects, t = ray:intersects(MOVEMENT_PLANE)
     return ray:getPoint(t)
 end
 
 
 -- Sums up the directional input from the keyboard
+--
+-- The returned vector is overwritten by the next call
 local function getMovementDirection()
-    local direction = Vector3(0, 0, 0)
+    local x = 0
+    local y = 0
     if (Engine.keyboard:isKeyDown(Keyboard.KC_W)) then
-        direction = direction + Vector3(0, 1, 0)
+        y = y + 1
     end
     if (Engine.keyboard:isKeyDown(Keyboard.KC_S)) then
-        direction = direction + Vector3(0, -1, 0)
+        y = y - 1
     end
     if (Engine.keyboard:isKeyDown(Keyboard.KC_A)) then
-        direction = direction + Vector3(-1, 0, 0)
+        x = x - 1
     end
     if (Engine.keyboard:isKeyDown(Keyboard.KC_D)) then
-        direction = direction + Vector3(1, 0, 0)
+        x = x + 1
     end
-    direction:normalise()
-    return direction
+    movementDirection:set(x, y, 0)
+    movementDirection:normalise()
+    return movementDirection
+end
+
+
+function MicrobeControlSystem:init(gameState)
+    System.init(self, gameState)
+    self.entities = EntityCache(gameState)
 end
 
 
 function MicrobeControlSystem:update(milliseconds)
-    local player = Entity("player")
+    local player = self.entities:named(PLAYER_NAME)
     local microbe = player:getComponent(MicrobeComponent.TYPE_ID)
-    local targetPoint = getTargetPoint()
-    local movementDirection = getMovementDirection()
-    microbe.facingTargetPoint = getTargetPoint()
+    microbe.facingTargetPoint = getTargetPoint(self.entities)
     microbe.movementDirection = getMovementDirection()
 end
@@ -19,7 +19,7 @@ function MovementOrganelle:load(storage)
     Organelle.load(self, storage)
     self.energyMultiplier = storage:get("energyMultiplier", 0.025)
     self.force = storage:get("force", Vector3(0,0,0))
-    self.torque = storage:get("torque", Vector3(0,0,0))
+    self.torque = storage:get("torque", 0)
 end
 
 function MovementOrganelle:storage()
@@ -30,55 +30,18 @@ function MovementOrganelle:storage()
     return storage
 end
 
-function MovementOrganelle:_moveMicrobe(microbe, milliseconds)
-    local direction = microbe.microbe.movementDirection
-    if direction:isZeroLength() then
-        return
-    end 
-    if self.force:isZeroLength() then
-        return
-    end
-    local forceMagnitude = self.force:dotProduct(direction)
-    local energy = math.abs(self.energyMultiplier * forceMagnitude * milliseconds / 1000)
-    local availableEnergy = microbe:takeAgent(1, energy)
-    if availableEnergy < energy then
-        forceMagnitude = sign(forceMagnitude) * availableEnergy * 1000 / milliseconds
-    end
-    if forceMagnitude > 0 then
-        local impulseMagnitude = milliseconds * forceMagnitude / 1000
-        local impulse = impulseMagnitude * direction
-        local a = microbe.sceneNode.transform.orientation * impulse
-        microbe.rigidBody:applyCentralImpulse(
-            microbe.sceneNode.transform.orientation * impulse
-        )
-    end
-end
-
-
-function MovementOrganelle:_turnMicrobe(microbe)
-    if self.torque == 0 then
-        return
-    end
-    local transform = microbe.sceneNode.transform
-    local targetDirection = microbe.microbe.facingTargetPoint - transform.position
-    local localTargetDirection = transform.orientation:Inverse() * targetDirection
-    localTargetDirection.z = 0 -- improper fix. facingTargetPoint somehow gets a non-zero z value.
-    assert(localTargetDirection.z < 0.01, "Microbes should only move in the 2D plane with z = 0")
-    local alpha = math.atan2(
-        -localTargetDirection.x,
-        localTargetDirection.y
-    )
-    if math.abs(math.deg(alpha)) > 1 then
-        microbe.rigidBody:applyTorque(
-            Vector3(0, 0, self.torque * alpha  )
-        )
-    end
+-- Overridded from Organelle:onAddedToMicrobe
+--
+-- Adds a thruster to the microbe's MovementComponent, which the
+-- MovementSystem moves and turns the microbe with from then on
+function MovementOrganelle:onAddedToMicrobe(microbe, q, r)
+    Organelle.onAddedToMicrobe(self, microbe, q, r)
+    microbe.movement:addThruster(q, r, self.force, self.torque, self.energyMultiplier)
 end
 
 
-function MovementOrganelle:update(microbe, milliseconds)
-    Organelle.update(self, microbe, milliseconds)
-    self:_turnMicrobe(microbe)
-    self:_moveMicrobe(microbe, milliseconds)
+-- Overridded from Organelle:onRemovedFromMicrobe
+function MovementOrganelle:onRemovedFromMicrobe(microbe)
+    microbe.movement:removeThruster(self.position.q, self.position.r)
+    Organelle.onRemovedFromMicrobe(self, microbe)
 end
-
@@ -1,6 +1,18 @@
 -- Base class for microbe organelles
 class 'Organelle'
 
+-- The fields of Organelle:storage(), converted in one go
+ORGANELLE_SCHEMA = StorageSchema{
+    className = "string",
+    -- Pairs of q and r
+    hexCoordinates = "intArray",
+    q = "integer",
+    r = "integer",
+    colour = "ColourValue",
+    internalEdgeColour = "ColourValue",
+    externalEdgeColour = "ColourValue"
+}
+
 -- Factory function for organelles
 function Organelle.loadOrganelle(storage)
     local className = storage:get("className", "")
@@ -26,6 +38,9 @@ function Organelle:__init()
     self._internalEdgeColour = ColourValue(0.5, 0.5, 0.5, 1)
     self._externalEdgeColour = ColourValue(0, 0, 0, 1)
     self._needsColourUpdate = false
+    -- Set when the organelle's storage needs to be saved again, see
+    -- Microbe:update
+    self.storageChanged = false
 end
 
 
@@ -42,22 +57,15 @@ function Organelle:addHex(q, r)
     if self._hexes[s] then
         return false
     end
+    -- The hex meshes are parts of the microbe's baked mesh, see
+    -- Organelle:onAddedToMicrobe
     local hex = {
         q = q,
         r = r,
-        entity = Entity(),
-        collisionShape = SphereShape(HEX_SIZE),
-        sceneNode = OgreSceneNodeComponent()
+        collisionShape = SphereShape(HEX_SIZE)
     }
     local x, y = axialToCartesian(q, r)
     local translation = Vector3(x, y, 0)
-    hex.entity:setVolatile(true)
-    -- Scene node
-    hex.sceneNode.parent = self.entity
-    hex.sceneNode.transform.position = translation
-    hex.sceneNode.transform:touch()
-    hex.sceneNode.meshName = "hex.mesh"
-    hex.entity:addComponent(hex.sceneNode)
     -- Collision shape
     self.collisionShape:addChildShape(
         translation,
@@ -82,19 +90,48 @@ function Organelle:getHex(q, r)
 end
 
 
+-- Returns an iterator over the coordinates of the organelle's hexes
+--
+-- Example:
+--
+--  for q, r in organelle:iterateHexes() do
+--      ...
+--  end
+function Organelle:iterateHexes()
+    local key = nil
+    local function nextHex()
+        local hex
+        key, hex = next(self._hexes, key)
+        if hex == nil then
+            return nil
+        end
+        return hex.q, hex.r
+    end
+    return nextHex
+end
+
+
 function Organelle:load(storage)
-    local hexes = storage:get("hexes", {})
+    local data = storage:toTable(ORGANELLE_SCHEMA)
+    self.collisionShape:beginChanges()
+    local hexCoordinates = data.hexCoordinates or {}
+    for i = 1,#hexCoordinates,2 do
+        self:addHex(hexCoordinates[i], hexCoordinates[i + 1])
+    end
+    -- Savegames from before hexes were stored as an array
+    local hexes = storage:get("hexes", StorageList())
     for i = 1,hexes:size() do
         local hexStorage = hexes:get(i)
         local q = hexStorage:get("q", 0)
         local r = hexStorage:get("r", 0)
         self:addHex(q, r)
     end
-    self.position.q = storage:get("q", 0)
-    self.position.r = storage:get("r", 0)
-    self._colour = storage:get("colour", ColourValue.White)
-    self._internalEdgeColour = storage:get("internalEdgeColour", ColourValue.Grey)
-    self._externalEdgeColour = storage:get("externalEdgeColour", ColourValue.Black)
+    self.collisionShape:commitChanges()
+    self.position.q = data.q or 0
+    self.position.r = data.r or 0
+    self._colour = data.colour or ColourValue.White
+    self._internalEdgeColour = data.internalEdgeColour or ColourValue.Grey
+    self._externalEdgeColour = data.externalEdgeColour or ColourValue.Black
 end
 
 
@@ -109,6 +146,11 @@ function Organelle:onAddedToMicrobe(microbe, q, r)
     self.microbe = microbe
     self.position.q = q
     self.position.r = r
+    for _, hex in pairs(self._hexes) do
+        local x, y = axialToCartesian(q + hex.q, r + hex.r)
+        microbe.meshBake:setPart(self:_partKey(hex), "hex.mesh", Vector3(x, y, 0))
+    end
+    self._needsColourUpdate = true
 end
 
 
@@ -118,6 +160,9 @@ end
 --  The organelle's previous owner
 function Organelle:onRemovedFromMicrobe(microbe)
     assert(microbe == self.microbe, "Can't remove organelle, wrong microbe")
+    for _, hex in pairs(self._hexes) do
+        microbe.meshBake:removePart(self:_partKey(hex))
+    end
     self.microbe = nil
     self.position.q = 0
     self.position.r = 0
@@ -136,7 +181,6 @@ function Organelle:removeHex(q, r)
     local s = encodeAxial(q, r)
     local hex = table.remove(self._hexes, s)
     if hex then
-        hex.entity:destroy()
         self.collisionShape:removeChildShape(hex.collisionShape)
         return true
     else
@@ -151,26 +195,25 @@ end
 function Organelle:setColour(colour)
     self._colour = colour
     self._needsColourUpdate = true
+    self.storageChanged = true
 end
 
 
 function Organelle:storage()
-    storage = StorageContainer()
-    storage:set("className", class_info(self).name)
-    hexes = StorageList()
+    local hexCoordinates = {}
     for _, hex in pairs(self._hexes) do
-        hexStorage = StorageContainer()
-        hexStorage:set("q", hex.q)
-        hexStorage:set("r", hex.r)
-        hexes:append(hexStorage)
+        table.insert(hexCoordinates, hex.q)
+        table.insert(hexCoordinates, hex.r)
     end
-    storage:set("hexes", hexes)
-    storage:set("q", self.position.q)
-    storage:set("r", self.position.r)
-    storage:set("colour", self._colour)
-    storage:set("internalEdgeColour", self._internalEdgeColour)
-    storage:set("externalEdgeColour", self._externalEdgeColour)
-    return storage
+    return StorageContainer.fromTable({
+        className = class_info(self).name,
+        hexCoordinates = hexCoordinates,
+        q = self.position.q,
+        r = self.position.r,
+        colour = self._colour,
+        internalEdgeColour = self._internalEdgeColour,
+        externalEdgeColour = self._externalEdgeColour
+    }, ORGANELLE_SCHEMA)
 end
 
 
@@ -181,30 +224,43 @@ end
 -- @param milliseconds
 --  The time since the last call to update()
 function Organelle:update(microbe, milliseconds)
-    if self._needsColourUpdate then
+    -- Colours of microbes out of view can wait until they are in view
+    if self._needsColourUpdate and microbe.sceneNode.onScreen then
         self:_updateHexColours()
     end
     -- Nothing
 end
 
 
+-- Private function for the key of a hex in the microbe's baked mesh
+function Organelle:_partKey(hex)
+    return encodeAxial(self.position.q + hex.q, self.position.r + hex.r)
+end
+
+
 -- Private function for updating the organelle's colour
+--
+-- Hexes are only drawn as part of a microbe
 function Organelle:_updateHexColours()
+    if not self.microbe then
+        return
+    end
+    local meshBake = self.microbe.meshBake
+    local hexGrid = self.microbe.microbe.hexGrid
+    local key = encodeAxial(self.position.q, self.position.r)
     for _, hex in pairs(self._hexes) do
-        if not hex.sceneNode.entity then
-            self._needsColourUpdate = true
-            return
-        end
-        local center = hex.sceneNode.entity:getSubEntity("center")
-        center:setColour(self._colour)
-        for i, qs, rs in iterateNeighbours(hex.q, hex.r) do
-            local neighbourHex = self:getHex(qs, rs)
-            local neighbourOrganelle = self.microbe and self.microbe:getOrganelleAt(
-                self.position.q + qs,
-                self.position.r + rs
+        local partKey = self:_partKey(hex)
+        meshBake:setPartColour(partKey, "center", self._colour)
+        for i in iterateNeighbours(hex.q, hex.r) do
+            -- One array lookup answers both
+            local neighbour = hexGrid:neighbour(
+                self.position.q + hex.q,
+                self.position.r + hex.r,
+                i
             )
+            local neighbourHex = neighbour == key
+            local neighbourOrganelle = neighbour ~= 0
             local sideName = HEX_SIDE_NAME[i]
-            local subEntity = hex.sceneNode.entity:getSubEntity(sideName)
             local edgeColour = nil
             if neighbourHex then
                 edgeColour = self._colour
@@ -213,7 +269,7 @@ function Organelle:_updateHexColours()
             else
                 edgeColour = self._externalEdgeColour
             end
-            subEntity:setColour(edgeColour)
+            meshBake:setPartColour(partKey, sideName, edgeColour)
         end
     end
     self._needsColourUpdate = false
@@ -222,8 +278,9 @@ end
 
 -- Queues a colour update for this organelle
 --
--- We can't actually update the colour right away because the required objects, 
--- in particular the Ogre scene nodes may not have been created yet.
+-- The colours are computed with the organelle's next update, so several
+-- changes in one frame only compute them once. The OgreMeshBakeSystem then
+-- writes them into the microbe's baked mesh.
 function Organelle:updateHexColours()
     self._needsColourUpdate = true
 end
@@ -3,6 +3,23 @@
 --------------------------------------------------------------------------------
 class 'ProcessOrganelle' (Organelle)
 
+-- An entry of the input agents, output agents and buffers in storage
+AGENT_AMOUNT_SCHEMA = StorageSchema{
+    agentId = "integer",
+    amount = "number"
+}
+
+
+-- Turns a table of agent ids to amounts into an array of entries
+local function agentAmountArray(amounts)
+    local array = {}
+    for agentId, amount in pairs(amounts) do
+        table.insert(array, {agentId = agentId, amount = amount})
+    end
+    return array
+end
+
+
 -- Constructor
 function ProcessOrganelle:__init(processCooldown)
     Organelle.__init(self)
@@ -14,13 +31,50 @@ function ProcessOrganelle:__init(processCooldown)
     self.buffers = {}
     self.inputAgents = {}
     self.outputAgents = {}
+    self._hasBufferChanges = false
 end
 
 
 -- Overridded from Organelle:onAddedToMicrobe
+--
+-- Registers the recipe with the microbe's ProcessComponent, which does the
+-- actual processing from then on
 function ProcessOrganelle:onAddedToMicrobe(microbe, q, r)
     Organelle.onAddedToMicrobe(self, microbe, q, r)
-    microbe:addProcessOrganelle(self)
+    local processes = microbe.processes
+    self.processIndex = processes:addProcess(self.processCooldown)
+    for agentId, amount in pairs(self.inputAgents) do
+        processes:addInput(self.processIndex, agentId, amount)
+    end
+    for agentId, amount in pairs(self.outputAgents) do
+        processes:addOutput(self.processIndex, agentId, amount)
+    end
+    processes:setRemainingCooldown(self.processIndex, self.remainingCooldown)
+    -- The component holds the buffers from now on
+    for agentId, amount in pairs(self.buffers) do
+        if amount > 0 then
+            processes:storeAgent(self.processIndex, agentId, amount)
+        end
+        self.buffers[agentId] = 0
+    end
+    self.bufferSum = 0
+end
+
+
+-- Overridded from Organelle:onRemovedFromMicrobe
+function ProcessOrganelle:onRemovedFromMicrobe(microbe)
+    local processes = microbe.processes
+    self.remainingCooldown = processes:remainingCooldown(self.processIndex)
+    -- Keeps the buffers until the process is added again
+    self.bufferSum = 0
+    for agentId in pairs(self.inputAgents) do
+        local amount = processes:bufferedAmount(self.processIndex, agentId)
+        self.buffers[agentId] = amount
+        self.bufferSum = self.bufferSum + amount
+    end
+    processes:removeProcess(self.processIndex)
+    self.processIndex = nil
+    Organelle.onRemovedFromMicrobe(self, microbe)
 end
 
 
@@ -44,6 +98,9 @@ function ProcessOrganelle:addRecipyInput(agentId, amount)
     self.inputAgents[agentId] = amount
     self.buffers[agentId] = 0
     self.inputSum = self.inputSum + amount;
+    if self.processIndex then
+        self.microbe.processes:addInput(self.processIndex, agentId, amount)
+    end
     self:updateColourDynamic()
 end
 
@@ -57,6 +114,9 @@ end
 --  The amount of the agent produced
 function ProcessOrganelle:addRecipyOutput(agentId, amount)
     self.outputAgents[agentId] = amount 
+    if self.processIndex then
+        self.microbe.processes:addOutput(self.processIndex, agentId, amount)
+    end
 end
 
 
@@ -70,8 +130,12 @@ end
 -- @param amount
 --  The amount to be stored
 function ProcessOrganelle:storeAgent(agentId, amount)
-    self.buffers[agentId] = self.buffers[agentId] + amount
-    self.bufferSum = self.bufferSum + amount
+    if self.processIndex then
+        self.microbe.processes:storeAgent(self.processIndex, agentId, amount)
+    else
+        self.buffers[agentId] = self.buffers[agentId] + amount
+        self.bufferSum = self.bufferSum + amount
+    end
     self:updateColourDynamic()
     self._needsColourUpdate = true
 end
@@ -79,7 +143,12 @@ end
 
 -- Private function used to update colour of organelle based on how full it is
 function ProcessOrganelle:updateColourDynamic()
-    local rt = self.bufferSum/self.inputSum -- Ratio: how close to required input
+    local rt -- Ratio: how close to required input
+    if self.processIndex then
+        rt = self.microbe.processes:fillRatio(self.processIndex)
+    else
+        rt = self.bufferSum/self.inputSum
+    end
     if rt > 1 then rt = 1 end
     self._colour = ColourValue(0.6 + (self.originalColour.r-0.6)*rt, 
                                0.6 + (self.originalColour.g-0.6)*rt,                              
@@ -96,6 +165,9 @@ end
 -- @returns wantsAgent
 --  true if the agent wants the agent, false if it can't use or doesn't want the agent
 function ProcessOrganelle:wantsInputAgent(agentId)
+    if self.processIndex then
+        return self.microbe.processes:wantsAgent(self.processIndex, agentId)
+    end
     return (self.inputAgents[agentId] ~= nil and 
           self.remainingCooldown / (self.inputAgents[agentId] - self.buffers[agentId]) < (self.processCooldown / self.inputAgents[agentId])) -- calculate if it has enough buffered relative the amount of time left.
 end
@@ -103,7 +175,8 @@ end
 
 -- Called by Microbe:update
 --
--- Add output agent to the recipy of the organelle
+-- The production itself is done by the ProcessSystem, this only updates the
+-- colour when the buffers have changed and the microbe is in view
 --
 -- @param microbe
 --  The microbe containing the organelle
@@ -111,29 +184,17 @@ end
 -- @param milliseconds
 --  The time since the last call to update()
 function ProcessOrganelle:update(microbe, milliseconds)
-    Organelle.update(self, microbe, milliseconds)
-    self.remainingCooldown = self.remainingCooldown - milliseconds -- update process cooldown
-    if self.remainingCooldown < 0 then self.remainingCooldown = 0 end
-    if self.remainingCooldown <= 0 then
-        -- Attempt to produce
-        for agentId,amount in pairs(self.inputAgents) do 
-            if self.buffers[agentId] < self.inputAgents[agentId] then
-                return -- not enough agent material for some agent type. Cannot produce.
-            end
-        end
-        -- Sufficient agent material is available for production
-        self.remainingCooldown = self.processCooldown -- Restart cooldown
-        
-        for agentId,amount in pairs(self.inputAgents) do -- Foreach input agent, take it out of the buffer
-            self.buffers[agentId] = self.buffers[agentId] - amount
-            self.bufferSum = self.bufferSum - amount
-        end
-        self._needsColourUpdate = true  -- Update colours for displaying completeness of organelle production
+    if self.processIndex and microbe.processes:takeChanges(self.processIndex) then
+        self._hasBufferChanges = true
+        -- So savegames get the current buffers, see storage()
+        self.storageChanged = true
+    end
+    if self._hasBufferChanges and microbe.sceneNode.onScreen then
+        self._hasBufferChanges = false
         self:updateColourDynamic()
-        for agentId,amount in pairs(self.outputAgents) do 
-            microbe:storeAgent(agentId, amount)
-        end
+        self._needsColourUpdate = true
     end
+    Organelle.update(self, microbe, milliseconds)
 end
 
 
@@ -146,26 +207,30 @@ function ProcessOrganelle:setColour(colour)
     self._needsColourUpdate = true
 end
 
--- Buffer amounts aren't stored, could be added fairly easily
+-- Saves the process' state as well, the ProcessComponent doesn't
 function ProcessOrganelle:storage()
     local storage = Organelle.storage(self)
-    storage:set("remainingCooldown", self.remainingCooldown)
-    local inputAgentsSt = StorageList()
-    for agentId, amount in pairs(self.inputAgents) do
-        inputStorage = StorageContainer()
-        inputStorage:set("agentId", agentId)
-        inputStorage:set("amount", amount)
-        inputAgentsSt:append(inputStorage)
-    end
-    storage:set("inputAgents", inputAgentsSt)
-    local outputAgentsSt = StorageList()
-    for agentId, amount in pairs(self.outputAgents) do
-        outputStorage = StorageContainer()
-        outputStorage:set("agentId", agentId)
-        outputStorage:set("amount", amount)
-        outputAgentsSt:append(outputStorage)
+    local remainingCooldown = self.remainingCooldown
+    local buffers = self.buffers
+    if self.processIndex then
+        local processes = self.microbe.processes
+        remainingCooldown = processes:remainingCooldown(self.processIndex)
+        buffers = {}
+        for agentId in pairs(self.inputAgents) do
+            buffers[agentId] = processes:bufferedAmount(self.processIndex, agentId)
+        end
     end
-    storage:set("outputAgents", outputAgentsSt)
+    storage:set("processCooldown", self.processCooldown)
+    storage:set("remainingCooldown", remainingCooldown)
+    storage:set("buffers", StorageList.fromTable(
+        agentAmountArray(buffers), AGENT_AMOUNT_SCHEMA
+    ))
+    storage:set("inputAgents", StorageList.fromTable(
+        agentAmountArray(self.inputAgents), AGENT_AMOUNT_SCHEMA
+    ))
+    storage:set("outputAgents", StorageList.fromTable(
+        agentAmountArray(self.outputAgents), AGENT_AMOUNT_SCHEMA
+    ))
     return storage
 end
 
@@ -173,15 +238,21 @@ end
 function ProcessOrganelle:load(storage)
     Organelle.load(self, storage)
     self.originalColour = self._colour
+    self.processCooldown = storage:get("processCooldown", 0)
     self.remainingCooldown = storage:get("remainingCooldown", 0)
-    local inputAgentsSt = storage:get("inputAgents", {})
-    for i = 1,inputAgentsSt:size() do
-        local inputStorage = inputAgentsSt:get(i)
-        self:addRecipyInput(inputStorage:get("agentId", 0), inputStorage:get("amount", 0))
-    end
-    local outputAgentsSt = storage:get("outputAgents", {})
-    for i = 1,outputAgentsSt:size() do
-        local outputStorage = outputAgentsSt:get(i)
-        self:addRecipyOutput(outputStorage:get("agentId", 0), outputStorage:get("amount", 0))
+    local inputAgents = storage:get("inputAgents", StorageList()):toTable(AGENT_AMOUNT_SCHEMA)
+    for _, input in ipairs(inputAgents) do
+        self:addRecipyInput(input.agentId or 0, input.amount or 0)
+    end
+    local outputAgents = storage:get("outputAgents", StorageList()):toTable(AGENT_AMOUNT_SCHEMA)
+    for _, output in ipairs(outputAgents) do
+        self:addRecipyOutput(output.agentId or 0, output.amount or 0)
+    end
+    local buffers = storage:get("buffers", StorageList()):toTable(AGENT_AMOUNT_SCHEMA)
+    for _, buffer in ipairs(buffers) do
+        if buffer.agentId and self.inputAgents[buffer.agentId] then
+            self.buffers[buffer.agentId] = buffer.amount or 0
+            self.bufferSum = self.bufferSum + (buffer.amount or 0)
+        end
     end
 end
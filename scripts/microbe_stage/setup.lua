@@ -33,6 +33,30 @@ local function setupCamera()
 end
 
 local function setupAgents()
+
+-- The agents' meshes are warmed up by the engine. Organelles are coloured
+-- hexes, so their materials are the colour materials of the colours in
+-- use.
+local function setupMaterialWarmup()
+    local warmup = Engine.materialWarmup
+    warmup:addMesh("hex.mesh")
+    local colours = {
+        -- Edges
+        ColourValue(0.5, 0.5, 0.5, 1),
+        ColourValue(0, 0, 0, 1),
+        -- The player's organelles
+        ColourValue(1, 0, 0, 1),
+        ColourValue(0, 1, 0, 1),
+        ColourValue(0, 1, 0.5, 1),
+        ColourValue(0.5, 1, 0, 1),
+        ColourValue(1, 0, 1, 0)
+    }
+    for _, colour in ipairs(colours) do
+        warmup:addColour(colour)
+    end
+end
+
+setupMaterialWarmup()
     AgentRegistry.registerAgentType("atp", "ATP", "molecule.mesh")
     AgentRegistry.registerAgentType("oxygen", "Oxygen", "molecule.mesh")    
     AgentRegistry.registerAgentType("nitrate", "Nitrate", "molecule.mesh")
@@ -43,7 +67,13 @@ end
 
 local function createSpawnSystem()
     local spawnSystem = SpawnSystem()
-    
+    spawnSystem:setCenterEntity(PLAYER_NAME)
+    return spawnSystem
+end
+
+-- Registers the spawned entity types. The prototypes are created at the 
+-- origin, copied by the spawn system and removed again.
+local function setupSpawnTypes(spawnSystem)
     local testFunction = function(pos)
         -- Setting up an emitter for oxygen
         local entity = Entity()
@@ -58,7 +88,7 @@ local function createSpawnSystem()
         )
         rigidBody:setDynamicProperties(
             pos,
-            Quaternion(Radian(Degree(math.random()*360)), Vector3(0, 0, 1)),
+            Quaternion(Radian(Degree(0)), Vector3(0, 0, 1)),
             Vector3(0, 0, 0),
             Vector3(0, 0, 0)
         )
@@ -83,6 +113,8 @@ local function createSpawnSystem()
         timedEmitter.potencyPerParticle = 2.0
         timedEmitter.emitInterval = 1000
         entity:addComponent(timedEmitter)
+        -- Kept with its sector when out of range
+        entity:addComponent(WorldSectorComponent())
         return entity
     end
     local testFunction2 = function(pos)
@@ -99,7 +131,7 @@ local function createSpawnSystem()
         )
         rigidBody:setDynamicProperties(
             pos,
-            Quaternion(Radian(Degree(math.random()*360)), Vector3(0, 0, 1)),
+            Quaternion(Radian(Degree(0)), Vector3(0, 0, 1)),
             Vector3(0, 0, 0),
             Vector3(0, 0, 0)
         )
@@ -124,6 +156,8 @@ local function createSpawnSystem()
         timedEmitter.potencyPerParticle = 1.0
         timedEmitter.emitInterval = 2000
         entity:addComponent(timedEmitter)
+        -- Kept with its sector when out of range
+        entity:addComponent(WorldSectorComponent())
         return entity
     end
     
@@ -184,12 +218,32 @@ local function createSpawnSystem()
         return microbe
     end
     
+    -- Engines using the same shared data (see --shared-data) build each
+    -- prototype only once
+    local addSpawnType = function(name, createEntity, density, radius, randomOrientation)
+        local prototype = EntityPrototype()
+        if not Engine:loadSharedPrototype(name, prototype) then
+            local entity = createEntity(Vector3(0, 0, 0))
+            prototype = EntityPrototype(entity.id)
+            entity:destroy()
+            Engine:sharePrototype(name, prototype)
+        end
+        spawnSystem:addSpawnPrototype(prototype, density, radius, randomOrientation)
+    end
+    -- Soak runs scale the populations, see soak_bot.lua
+    local emitterDensity = SOAK and SOAK.emitterDensity or 1
+    local microbeDensity = SOAK and SOAK.microbeDensity or 1
     --Spawn one emitter on average once in every square of sidelength 10
     -- (square dekaunit?)
-    spawnSystem:addSpawnType(testFunction, 1/20^2, 30)
-    spawnSystem:addSpawnType(testFunction2, 1/20^2, 30)
-    spawnSystem:addSpawnType(microbeSpawnFunction, 1/60^2, 40)
-    return spawnSystem
+    addSpawnType("microbe_stage/oxygen_emitter", testFunction, emitterDensity/20^2, 30, true)
+    addSpawnType("microbe_stage/glucose_emitter", testFunction2, emitterDensity/20^2, 30, true)
+    addSpawnType(
+        "microbe_stage/microbe",
+        function(pos) return microbeSpawnFunction(pos).entity end,
+        microbeDensity/60^2,
+        40,
+        false
+    )
 end
 
 local function setupEmitter()
@@ -274,6 +328,56 @@ local function setupHud()
     playerAgentCountText.properties.left = -80
     playerAgentCountText.properties.top = -AGENTS_HEIGHT
     playerAgentCountText.properties:touch()
+    -- Script statistics, toggled with F3
+    local scriptStats = Entity("hud.scriptStats")
+    local scriptStatsText = TextOverlayComponent("hud.scriptStats")
+    scriptStats:addComponent(scriptStatsText)
+    scriptStatsText.properties.horizontalAlignment = TextOverlayComponent.Left
+    scriptStatsText.properties.verticalAlignment = TextOverlayComponent.Top
+    scriptStatsText.properties.width = 300
+    scriptStatsText.properties.height = 60
+    scriptStatsText.properties:touch()
+    -- Lua profile, toggled with F6
+    local luaProfile = Entity("hud.luaProfile")
+    local luaProfileText = TextOverlayComponent("hud.luaProfile")
+    luaProfile:addComponent(luaProfileText)
+    luaProfileText.properties.horizontalAlignment = TextOverlayComponent.Right
+    luaProfileText.properties.verticalAlignment = TextOverlayComponent.Top
+    luaProfileText.properties.left = -500
+    luaProfileText.properties.width = 500
+    luaProfileText.properties.height = 360
+    luaProfileText.properties:touch()
+    -- System timings, toggled with F7
+    local systemProfile = Entity("hud.systemProfile")
+    local systemProfileText = TextOverlayComponent("hud.systemProfile")
+    systemProfile:addComponent(systemProfileText)
+    systemProfileText.properties.horizontalAlignment = TextOverlayComponent.Left
+    systemProfileText.properties.verticalAlignment = TextOverlayComponent.Top
+    systemProfileText.properties.top = 60
+    systemProfileText.properties.width = 500
+    systemProfileText.properties.height = 480
+    systemProfileText.properties:touch()
+    -- Memory statistics, toggled with F9
+    local memoryStats = Entity("hud.memoryStats")
+    local memoryStatsText = TextOverlayComponent("hud.memoryStats")
+    memoryStats:addComponent(memoryStatsText)
+    memoryStatsText.properties.horizontalAlignment = TextOverlayComponent.Right
+    memoryStatsText.properties.verticalAlignment = TextOverlayComponent.Top
+    memoryStatsText.properties.left = -500
+    memoryStatsText.properties.top = 360
+    memoryStatsText.properties.width = 500
+    memoryStatsText.properties.height = 300
+    memoryStatsText.properties:touch()
+    -- Engine statistics, toggled with F2
+    local statistics = Entity("hud.statistics")
+    local statisticsText = TextOverlayComponent("hud.statistics")
+    statistics:addComponent(statisticsText)
+    statisticsText.properties.horizontalAlignment = TextOverlayComponent.Left
+    statisticsText.properties.verticalAlignment = TextOverlayComponent.Top
+    statisticsText.properties.top = 540
+    statisticsText.properties.width = 500
+    statisticsText.properties.height = 300
+    statisticsText.properties:touch()
 end
 
 local function setupPlayer()
@@ -327,34 +431,128 @@ end
 
 setupAgents()
 
+local AGENT_POOL_SIZE = 200
+
+-- Agent particles closer than this are merged into one
+local AGENT_MERGE_RADIUS = 0.5
+
+-- Merged particles stop growing at this potency
+local AGENT_MAX_MERGED_POTENCY = 50
+
+-- Simulate the plentiful agents on the GPU instead of as entities. Needs
+-- OpenGL 3.3, otherwise they stay entity particles.
+local AGENT_GPU_PARTICLES = false
+
+local function createAgentGpuSystem()
+    local gpuSystem = AgentGpuSystem()
+    if AGENT_GPU_PARTICLES then
+        gpuSystem:addAgent(AgentRegistry.getAgentId("oxygen"), ColourValue(0.6, 0.8, 1, 0.8))
+        gpuSystem:addAgent(AgentRegistry.getAgentId("glucose"), ColourValue(1, 0.9, 0.4, 0.8))
+    end
+    return gpuSystem
+end
+
+-- Hashes what replays and parallel runs must agree on, see --state-hashes
+local function createStateHashSystem()
+    local stateHashSystem = StateHashSystem()
+    stateHashSystem:addComponentType("Agent")
+    stateHashSystem:addComponentType("OgreSceneNode")
+    stateHashSystem:addComponentType("RigidBody")
+    -- Costs time every tick, so only when asked for
+    stateHashSystem:setEnabled(Engine:stateHashFile() ~= "")
+    return stateHashSystem
+end
+
+-- Microbes beyond the streaming distance aren't visible, so they are
+-- updated less often and collide as simple shapes, and the farthest ones
+-- sleep
+local function createSimulationLodSystem()
+    local lodSystem = SimulationLodSystem()
+    lodSystem:setCenterEntity(PLAYER_NAME)
+    lodSystem:addTier(STREAMING_LOAD_DISTANCE, 1, false, false, false)
+    lodSystem:addTier(STREAMING_UNLOAD_DISTANCE, 2, false, true, true)
+    lodSystem:addTier(2 * STREAMING_UNLOAD_DISTANCE, 4, true, true, true)
+    return lodSystem
+end
+
+-- Entities that leave the surroundings of the player are stored with their
+-- sector instead of being despawned
+local function createWorldSectorSystem()
+    local worldSectorSystem = WorldSectorSystem(WORLD_SECTOR_SIZE)
+    worldSectorSystem:setCenterEntity(PLAYER_NAME)
+    return worldSectorSystem
+end
+
+local function createMicrobeStageOptions()
+    local options = {
+        -- Everything in the microbe stage moves in the x/y plane
+        planarPhysics = true,
+        -- Culls the many scene nodes of a crowded stage by region
+        sceneManager = "octree",
+        -- Text doesn't need to change every frame
+        updateRates = {
+            HudSystem = 10
+        },
+        -- Switching between the microbe states is instant
+        keepResident = true
+    }
+    -- Replay benchmarks compare the stage under other options
+    if BENCHMARK then
+        for key, value in pairs(BENCHMARK.gameStateOptions) do
+            options[key] = value
+        end
+    end
+    return options
+end
+
 local function createMicrobeStage(name)
-    return Engine:createGameState(
+    local spawnSystem = createSpawnSystem()
+    -- Recycle expired agent particles instead of recreating their scene
+    -- nodes
+    local agentLifetimeSystem = AgentLifetimeSystem()
+    agentLifetimeSystem:setDefaultPoolSize(AGENT_POOL_SIZE)
+    local gameState = Engine:createGameState(
         name,
         {
             SwitchGameStateSystem(),
             QuickSaveSystem(),
             -- Microbe specific
+            createSimulationLodSystem(),
             MicrobeSystem(),
             MicrobeCameraSystem(),
-            MicrobeAISystem(),
-            MicrobeControlSystem(),
+            createMicrobeAISystem(),
+            -- Soak runs have a bot at the controls
+            SOAK and SoakBotSystem() or MicrobeControlSystem(),
             HudSystem(),
-            AgentLifetimeSystem(),
+            agentLifetimeSystem,
             AgentMovementSystem(),
+            AgentCoalescingSystem(AGENT_MERGE_RADIUS, AGENT_MAX_MERGED_POTENCY),
             AgentEmitterSystem(),
             AgentAbsorberSystem(),
-            createSpawnSystem(),
-            -- Physics
-            RigidBodyInputSystem(),
-            UpdatePhysicsSystem(),
-            RigidBodyOutputSystem(),
-            BulletToOgreSystem(),
+            createAgentGpuSystem(),
+            ProcessSystem(),
+            MovementSystem(),
+            createWorldSectorSystem(),
+            spawnSystem,
+            -- Physics, the rigid body systems and the step in one pass
+            PhysicsPipeline(),
             CollisionSystem(),
+            PhysicsQuerySystem(),
+            SpatialIndexSystem(),
+            -- After everything that changes the simulation in a tick
+            createStateHashSystem(),
             -- Graphics
             OgreAddSceneNodeSystem(),
             OgreUpdateSceneNodeSystem(),
+            OgreLodSystem(),
+            OgreColourSystem(),
+            OgreMeshBakeSystem(),
             OgreCameraSystem(),
             OgreLightSystem(),
+            SceneStreamingSystem(STREAMING_LOAD_DISTANCE, STREAMING_UNLOAD_DISTANCE),
+            OgreStaticGeometrySystem(),
+            -- One billboard set per agent instead of a mesh per particle
+            AgentRenderSystem(),
             SkySystem(),
             TextOverlaySystem(),
             OgreViewportSystem(),
@@ -367,11 +565,20 @@ local function createMicrobeStage(name)
             setupEmitter()
             setupHud()
             setupPlayer()
-        end
+            setupSpawnTypes(spawnSystem)
+        end,
+        createMicrobeStageOptions()
     )
+    -- Agents and physics run at a fixed rate
+    gameState:setTickRate(60)
+    return gameState
 end
 
 GameState.MICROBE = createMicrobeStage("microbe")
 GameState.MICROBE_ALTERNATE = createMicrobeStage("microbe_alternate")
 
 Engine:setCurrentGameState(GameState.MICROBE)
+
+-- Switching to the alternate stage should be instant as well, without
+-- building it during startup
+Engine:prewarmGameState(GameState.MICROBE_ALTERNATE)
@@ -0,0 +1,72 @@
+--------------------------------------------------------------------------------
+-- SoakBotSystem
+--
+-- Steers the player instead of MicrobeControlSystem during soak runs, see
+-- the "soak" suite of RunBenchmarks. The player swims laps of a fixed
+-- polygon around the origin, so every run passes the same sectors.
+--
+-- The benchmark passes its settings in the global SOAK table, the bot
+-- reports back in it:
+-- - SOAK.pathRadius: Distance of the waypoints from the origin
+-- - SOAK.distance: How far the player has swum so far
+-- - SOAK.laps: How many laps the player has finished
+--------------------------------------------------------------------------------
+
+class 'SoakBotSystem' (System)
+
+local DEFAULT_PATH_RADIUS = 60
+
+-- Corners of the polygon the player swims along
+local WAYPOINT_COUNT = 8
+
+-- A waypoint counts as reached within this distance
+local WAYPOINT_RADIUS = 5
+
+-- Straight ahead, in the microbe's own frame
+local FORWARD = Vector3(0, 1, 0)
+
+
+function SoakBotSystem:__init()
+    System.__init(self)
+    self.waypoints = {}
+    self.nextWaypoint = 1
+    self.lastPosition = nil
+end
+
+
+function SoakBotSystem:init(gameState)
+    System.init(self, gameState)
+    self.entities = EntityCache(gameState)
+    local radius = SOAK.pathRadius or DEFAULT_PATH_RADIUS
+    for i = 1, WAYPOINT_COUNT do
+        local angle = 2 * math.pi * i / WAYPOINT_COUNT
+        self.waypoints[i] = Vector3(radius * math.cos(angle), radius * math.sin(angle), 0)
+    end
+    SOAK.distance = SOAK.distance or 0
+    SOAK.laps = SOAK.laps or 0
+end
+
+
+function SoakBotSystem:update(milliseconds)
+    local player = self.entities:named(PLAYER_NAME)
+    local position = player:getComponent(OgreSceneNodeComponent.TYPE_ID).transform.position
+    if self.lastPosition then
+        SOAK.distance = SOAK.distance + position:distance(self.lastPosition)
+    else
+        self.lastPosition = Vector3(0, 0, 0)
+    end
+    self.lastPosition:assign(position)
+    local waypoint = self.waypoints[self.nextWaypoint]
+    if position:distance(waypoint) < WAYPOINT_RADIUS then
+        if self.nextWaypoint == WAYPOINT_COUNT then
+            self.nextWaypoint = 1
+            SOAK.laps = SOAK.laps + 1
+        else
+            self.nextWaypoint = self.nextWaypoint + 1
+        end
+        waypoint = self.waypoints[self.nextWaypoint]
+    end
+    local microbe = player:getComponent(MicrobeComponent.TYPE_ID)
+    microbe.facingTargetPoint = waypoint
+    microbe.movementDirection = FORWARD
+end
@@ -12,7 +12,13 @@ function QuickSaveSystem:update(milliseconds)
     local loadDown = Engine.keyboard:isKeyDown(Keyboard.KC_F10)
     if saveDown and not self.saveDown then
         print("Saving")
-        Engine:save("quick.sav")
+        Engine:saveIncremental("quick.sav", function(success, errorMessage)
+            if success then
+                print("Saved")
+            else
+                print("Saving failed: " .. errorMessage)
+            end
+        end)
     end
     if loadDown and not self.loadDown then
         Engine:load("quick.sav")
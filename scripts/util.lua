@@ -51,3 +51,109 @@ function sign(x)
     end
 end
 
+
+
+-- Views on native component data through the LuaJIT FFI
+--
+-- Only defined when running on LuaJIT, check FFI_VIEWS_AVAILABLE. A view
+-- reads the native data directly instead of going through luabind, which
+-- matters in loops over many entities. Don't keep a view around for
+-- longer than its component.
+FFI_VIEWS_AVAILABLE = (jit ~= nil)
+
+if FFI_VIEWS_AVAILABLE then
+    local ffi = require("ffi")
+    ffi.cdef[[
+        typedef struct { float x, y, z; } ThriveVector3;
+    ]]
+
+    -- Read-only view on an OgreSceneNodeComponent's position
+    --
+    -- @returns view
+    --  Has x, y and z fields
+    function positionView(sceneNode)
+        return ffi.cast("const ThriveVector3*", sceneNode:positionData())
+    end
+
+    -- View on an AgentComponent's velocity
+    --
+    -- @returns view
+    --  Has x, y and z fields
+    function velocityView(agent)
+        return ffi.cast("ThriveVector3*", agent:velocityData())
+    end
+
+    -- Read-only view on a VacuoleComponent's stored agent amounts
+    --
+    -- Invalidated when an agent with an id beyond count is stored.
+    --
+    -- @returns view, count
+    --  The amounts indexed by agent id and the number of entries
+    function agentAmountView(vacuole)
+        return ffi.cast("const float*", vacuole:agentAmountData()), vacuole:agentAmountCount()
+    end
+
+    -- Read-only views on the ids and positions of a ScriptEntityFilter's
+    -- entities, filled in one call
+    --
+    -- Invalidated by the next call for the same filter.
+    --
+    -- @returns ids, positions, count
+    --  The zero-based arrays of entity ids and of x, y, z coordinates, three
+    --  per entity, and the number of entities
+    function positionBufferView(filter)
+        local count = filter:fillPositionBuffer()
+        return ffi.cast("const uint32_t*", filter:entityBufferData()),
+            ffi.cast("const float*", filter:positionBufferData()),
+            count
+    end
+end
+
+
+-- Caches the Entity handles of one game state
+--
+-- Entity(name) hashes the name in C++ and every Entity(...) call creates
+-- a new wrapper. Systems that look up the same entities in each update
+-- create an EntityCache in init() and ask it instead:
+--
+--  self.entities = EntityCache(gameState)
+--  local player = self.entities:named(PLAYER_NAME)
+--
+-- Named handles are dropped when the named entities may have new ids,
+-- e.g. after loading a savegame. Handles by id are weak.
+class 'EntityCache'
+
+function EntityCache:__init(gameState)
+    self.gameState = gameState
+    self.entityManager = gameState:entityManager()
+    self.namesRevision = self.entityManager:namesRevision()
+    self.byId = setmetatable({}, { __mode = "v" })
+    self.byName = {}
+end
+
+
+-- Returns the entity with an id
+function EntityCache:get(entityId)
+    local entity = self.byId[entityId]
+    if entity == nil then
+        entity = Entity(entityId, self.gameState)
+        self.byId[entityId] = entity
+    end
+    return entity
+end
+
+
+-- Returns a named entity
+function EntityCache:named(name)
+    local revision = self.entityManager:namesRevision()
+    if revision ~= self.namesRevision then
+        self.byName = {}
+        self.namesRevision = revision
+    end
+    local entity = self.byName[name]
+    if entity == nil then
+        entity = Entity(name, self.gameState)
+        self.byName[name] = entity
+    end
+    return entity
+end
@@ -0,0 +1,260 @@
+#include "engine/asset_pack.h"
+#include "engine/texture_compression.h"
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <OgreDataStream.h>
+#include <OgreImage.h>
+#include <OgreLogManager.h>
+#include <OgrePixelFormat.h>
+#include <OgreRoot.h>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+const std::set<std::string> IMAGE_EXTENSIONS = {
+    ".jpeg",
+    ".jpg",
+    ".png",
+    ".tga"
+};
+
+
+std::string
+readFile(
+    const fs::path& path
+) {
+    std::ifstream stream(path.string(), std::ios::binary);
+    if (not stream) {
+        throw std::runtime_error("Can't read " + path.string());
+    }
+    return std::string(
+        std::istreambuf_iterator<char>(stream),
+        std::istreambuf_iterator<char>()
+    );
+}
+
+
+// The regular files directly in a directory, sorted by name
+std::vector<fs::path>
+listFiles(
+    const fs::path& directory
+) {
+    std::vector<fs::path> files;
+    if (not fs::is_directory(directory)) {
+        return files;
+    }
+    for (fs::directory_iterator iter(directory), end; iter != end; ++iter) {
+        if (fs::is_regular_file(iter->status())) {
+            files.push_back(iter->path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+
+std::string
+lowerExtension(
+    const fs::path& path
+) {
+    return boost::algorithm::to_lower_copy(path.extension().string());
+}
+
+
+// Decodes an image, builds its mip chain with a box filter and compresses
+// each level
+thrive::CompressedTexture
+compressImage(
+    const std::string& data,
+    const std::string& extension
+) {
+    Ogre::DataStreamPtr stream(OGRE_NEW Ogre::MemoryDataStream(
+        const_cast<char*>(data.data()),
+        data.size(),
+        false,
+        true
+    ));
+    Ogre::Image image;
+    image.load(stream, extension.substr(1));
+    thrive::CompressedTexture texture;
+    texture.width = static_cast<uint32_t>(image.getWidth());
+    texture.height = static_cast<uint32_t>(image.getHeight());
+    std::vector<uint8_t> pixels(4 * texture.width * texture.height);
+    Ogre::PixelBox level(
+        texture.width,
+        texture.height,
+        1,
+        Ogre::PF_BYTE_RGBA,
+        pixels.data()
+    );
+    Ogre::PixelUtil::bulkPixelConversion(image.getPixelBox(), level);
+    if (Ogre::PixelUtil::hasAlpha(image.getFormat())) {
+        for (size_t i = 3; i < pixels.size(); i += 4) {
+            if (pixels[i] != 255) {
+                texture.hasAlpha = true;
+                break;
+            }
+        }
+    }
+    uint32_t width = texture.width;
+    uint32_t height = texture.height;
+    while (true) {
+        texture.mipLevels.push_back(thrive::compressDxt(
+            pixels.data(),
+            width,
+            height,
+            texture.hasAlpha
+        ));
+        if (width == 1 and height == 1) {
+            break;
+        }
+        uint32_t nextWidth = std::max(1u, width / 2);
+        uint32_t nextHeight = std::max(1u, height / 2);
+        std::vector<uint8_t> nextPixels(4 * nextWidth * nextHeight);
+        Ogre::PixelBox source(width, height, 1, Ogre::PF_BYTE_RGBA, pixels.data());
+        Ogre::PixelBox destination(nextWidth, nextHeight, 1, Ogre::PF_BYTE_RGBA, nextPixels.data());
+        Ogre::Image::scale(source, destination, Ogre::Image::FILTER_BOX);
+        pixels.swap(nextPixels);
+        width = nextWidth;
+        height = nextHeight;
+    }
+    return texture;
+}
+
+
+// Points a material script's texture references at the compressed
+// textures
+std::string
+rewriteMaterial(
+    const std::string& script,
+    const std::map<std::string, std::string>& renamedTextures
+) {
+    std::vector<std::string> lines;
+    boost::algorithm::split(lines, script, boost::algorithm::is_any_of("\n"));
+    for (auto& line : lines) {
+        std::vector<std::string> tokens;
+        std::string trimmed = boost::algorithm::trim_copy(line);
+        boost::algorithm::split(
+            tokens,
+            trimmed,
+            boost::algorithm::is_space(),
+            boost::algorithm::token_compress_on
+        );
+        if (tokens.size() < 2 or (tokens[0] != "texture" and tokens[0] != "cubic_texture")) {
+            continue;
+        }
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            auto iter = renamedTextures.find(tokens[i]);
+            if (iter != renamedTextures.end()) {
+                boost::algorithm::replace_first(line, tokens[i], iter->second);
+            }
+        }
+    }
+    return boost::algorithm::join(lines, "\n");
+}
+
+
+// Adds a file under its base name, like the flat resource locations of
+// resources.cfg would find it
+void
+addFile(
+    thrive::AssetPackWriter& pack,
+    std::set<std::string>& names,
+    const std::string& name,
+    std::string data
+) {
+    if (not names.insert(name).second) {
+        std::cerr << "Skipping duplicate asset " << name << std::endl;
+        return;
+    }
+    pack.add(name, std::move(data));
+}
+
+}
+
+// Packs the meshes, materials and textures that are installed with
+// release builds. Textures are compressed to DXT and get a full mip chain.
+//
+// Usage: BuildAssets <asset directory> <output directory>
+int main(int argc, char *argv[])
+{
+    using namespace thrive;
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <asset directory> <output directory>" << std::endl;
+        return 2;
+    }
+    fs::path assetDirectory(argv[1]);
+    fs::path outputDirectory(argv[2]);
+    // Ogre's image codecs are registered by the root
+    Ogre::LogManager logManager;
+    logManager.createLog("BuildAssets.log", true, false, true);
+    Ogre::Root root("", "", "");
+    int failures = 0;
+    try {
+        fs::create_directories(outputDirectory);
+        // Meshes
+        AssetPackWriter models;
+        std::set<std::string> modelNames;
+        for (const auto& path : listFiles(assetDirectory / "models")) {
+            if (lowerExtension(path) == ".mesh") {
+                addFile(models, modelNames, path.filename().string(), readFile(path));
+            }
+        }
+        models.write(outputDirectory / "models.pack");
+        // Textures
+        AssetPackWriter textures;
+        std::set<std::string> textureNames;
+        std::map<std::string, std::string> renamedTextures;
+        std::vector<fs::path> materialFiles;
+        for (const auto& directory : {assetDirectory / "materials", assetDirectory / "materials" / "textures"}) {
+            for (const auto& path : listFiles(directory)) {
+                std::string extension = lowerExtension(path);
+                if (extension == ".dds") {
+                    addFile(textures, textureNames, path.filename().string(), readFile(path));
+                }
+                else if (IMAGE_EXTENSIONS.count(extension) > 0) {
+                    std::string name = path.stem().string() + ".dds";
+                    try {
+                        CompressedTexture texture = compressImage(readFile(path), extension);
+                        addFile(textures, textureNames, name, writeDds(texture));
+                        renamedTextures[path.filename().string()] = name;
+                    }
+                    catch (const std::exception& e) {
+                        std::cerr << "Can't compress " << path.string() << ": " << e.what() << std::endl;
+                        failures += 1;
+                    }
+                }
+                else {
+                    materialFiles.push_back(path);
+                }
+            }
+        }
+        textures.write(outputDirectory / "textures.pack");
+        // Materials, shaders and everything else next to them
+        AssetPackWriter materials;
+        std::set<std::string> materialNames;
+        for (const auto& path : materialFiles) {
+            std::string data = readFile(path);
+            if (lowerExtension(path) == ".material") {
+                data = rewriteMaterial(data, renamedTextures);
+            }
+            addFile(materials, materialNames, path.filename().string(), std::move(data));
+        }
+        materials.write(outputDirectory / "materials.pack");
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        failures += 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,8 +1,15 @@
 #include <OgreRoot.h>
 
+#include "engine/engine.h"
+#include "engine/statistics.h"
+#include "engine/telemetry_server.h"
 #include "game.h"
 
 #include <boost/thread.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
 
 #if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -20,8 +27,99 @@ extern "C" {
 #endif
     {
         using namespace thrive;
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        int argc = __argc;
+        char** argv = __argv;
+#endif
+        // thrive [--headless TICKS] [--record FILE | --replay FILE]
+        //     [--statistics FILE] [--telemetry ENDPOINT] [--mip-bias LEVELS]
+        //     [--state-hashes FILE | --verify-state-hashes FILE]
+        //     [--shared-data FILE]
+        //
+        // --headless runs TICKS ticks without graphics or input, as fast
+        // as possible. --record writes the session's seed and input to
+        // FILE, --replay plays such a recording back. --statistics appends
+        // the engine statistics to FILE once per second. --mip-bias loads
+        // packed textures without their LEVELS largest mip levels.
+        // --telemetry streams statistics to clients connecting to
+        // ENDPOINT, a port on the loopback interface or ADDRESS:PORT.
+        // --state-hashes writes a hash of the simulation state per tick to
+        // FILE, --verify-state-hashes compares a later run, usually the
+        // replay of a recording, with them. --shared-data shares compiled
+        // scripts and prototypes with other engines using the same FILE,
+        // which is written if it is missing or stale.
         Game& game = Game::instance();
-        game.run();
+        unsigned long long headlessTicks = 0;
+        for (int i = 1; i < argc; ++i) {
+            bool hasValue = i + 1 < argc;
+            if (hasValue and std::strcmp(argv[i], "--headless") == 0) {
+                char* end = nullptr;
+                headlessTicks = std::strtoull(argv[++i], &end, 10);
+                if (headlessTicks == 0 or *end != '\0') {
+                    hasValue = false;
+                }
+            }
+            else if (hasValue and std::strcmp(argv[i], "--record") == 0) {
+                game.engine().recordInput(argv[++i]);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--replay") == 0) {
+                game.engine().replayInput(argv[++i]);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--mip-bias") == 0) {
+                char* end = nullptr;
+                unsigned long levels = std::strtoul(argv[++i], &end, 10);
+                if (*end != '\0') {
+                    hasValue = false;
+                }
+                game.engine().setTextureMipBias(levels);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--state-hashes") == 0) {
+                game.engine().recordStateHashes(argv[++i]);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--verify-state-hashes") == 0) {
+                game.engine().verifyStateHashes(argv[++i]);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--shared-data") == 0) {
+                game.engine().useSharedData(argv[++i]);
+            }
+            else if (hasValue and std::strcmp(argv[i], "--statistics") == 0) {
+                try {
+                    game.engine().statistics().setDumpFile(argv[++i], 1000);
+                }
+                catch (const std::runtime_error& e) {
+                    std::cerr << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            else if (hasValue and std::strcmp(argv[i], "--telemetry") == 0) {
+                try {
+                    game.engine().telemetry().start(argv[++i]);
+                }
+                catch (const std::runtime_error& e) {
+                    std::cerr << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            else {
+                hasValue = false;
+            }
+            if (not hasValue) {
+                std::cerr << "Usage: " << argv[0] 
+                    << " [--headless TICKS] [--record FILE | --replay FILE]" 
+                    << " [--statistics FILE] [--telemetry ENDPOINT]"
+                    << " [--mip-bias LEVELS]"
+                    << " [--state-hashes FILE | --verify-state-hashes FILE]"
+                    << " [--shared-data FILE]"
+                    << std::endl;
+                return 1;
+            }
+        }
+        if (headlessTicks > 0) {
+            game.runHeadless(headlessTicks);
+        }
+        else {
+            game.run();
+        }
         return 0;
     }
  
@@ -0,0 +1,48 @@
+#include "engine/shared_data.h"
+#include "scripting/lua_include.h"
+#include "scripting/script_cache.h"
+
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <stdexcept>
+
+// Compiles all scripts listed in the manifests into a script cache and,
+// optionally, into shared data (see Engine::useSharedData)
+//
+// Usage: PrecompileScripts <script directory> <cache directory> [<shared data file>]
+int main(int argc, char *argv[])
+{
+    using namespace thrive;
+    if (argc != 3 and argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <script directory> <cache directory> [<shared data file>]" << std::endl;
+        return 2;
+    }
+    boost::filesystem::path scriptDirectory(argv[1]);
+    ScriptCache cache(scriptDirectory, argv[2]);
+    SharedDataWriter sharedData;
+    lua_State* L = luaL_newstate();
+    int failures = 0;
+    try {
+        for (const auto& script : ScriptCache::manifestScripts(scriptDirectory)) {
+            if (cache.compile(L, script) != 0) {
+                std::cerr << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1);
+                failures += 1;
+                continue;
+            }
+            std::string cacheFile;
+            if (cache.compiledScript(script, cacheFile)) {
+                sharedData.addCompiledScript(script, std::move(cacheFile));
+            }
+        }
+        if (argc == 4 and failures == 0) {
+            sharedData.write(argv[3]);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        failures += 1;
+    }
+    lua_close(L);
+    return failures == 0 ? 0 : 1;
+}
@@ -1,9 +1,11 @@
 #include "bullet/bullet_to_ogre_system.h"
 
 #include "bullet/rigid_body_system.h"
-#include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
 #include "ogre/scene_node_system.h"
+#include "ogre/transform_buffer.h"
 #include "scripting/luabind.h"
 
 using namespace thrive;
@@ -20,16 +22,40 @@ BulletToOgreSystem::luaBindings() {
 
 struct BulletToOgreSystem::Implementation {
 
+    void
+    unlink(
+        EntityManager& entityManager,
+        EntityId entityId
+    ) {
+        auto rigidBodyComponent = entityManager.getComponent<RigidBodyComponent>(entityId);
+        if (rigidBodyComponent) {
+            rigidBodyComponent->m_transformBuffer = nullptr;
+        }
+        auto sceneNodeComponent = entityManager.getComponent<OgreSceneNodeComponent>(entityId);
+        if (sceneNodeComponent and sceneNodeComponent->m_transformSlot != TransformBuffer::NO_SLOT) {
+            m_transformBuffer->remove(sceneNodeComponent->m_transformSlot);
+            // Back to the regular path
+            sceneNodeComponent->m_transform.touch();
+        }
+    }
+
     EntityFilter<
         RigidBodyComponent,
         OgreSceneNodeComponent
-    > m_entities;
+    > m_entities = {true};
+
+    // Used if there is no OgreUpdateSceneNodeSystem, so that the
+    // components are still updated
+    TransformBuffer m_ownTransformBuffer;
+
+    TransformBuffer* m_transformBuffer = nullptr;
 };
 
 
 BulletToOgreSystem::BulletToOgreSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -42,27 +68,52 @@ BulletToOgreSystem::init(
 ) {
     System::init(gameState);
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    auto updateSystem = gameState->findSystem<OgreUpdateSceneNodeSystem>();
+    if (updateSystem) {
+        m_impl->m_transformBuffer = &updateSystem->transformBuffer();
+    }
+    else {
+        m_impl->m_transformBuffer = &m_impl->m_ownTransformBuffer;
+    }
 }
 
 
 void
 BulletToOgreSystem::shutdown() {
+    for (const auto& value : m_impl->m_entities) {
+        m_impl->unlink(*this->entityManager(), value.first);
+    }
     m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_ownTransformBuffer.clear();
+    m_impl->m_transformBuffer = nullptr;
     System::shutdown();
 }
 
 
 void
 BulletToOgreSystem::update(int) {
-    for (auto& value : m_impl->m_entities) {
-        RigidBodyComponent* rigidBodyComponent = std::get<0>(value.second);
-        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(value.second);
-        auto& sceneNodeTransform = sceneNodeComponent->m_transform;
-        auto& rigidBodyProperties = rigidBodyComponent->m_dynamicProperties;
-        sceneNodeTransform.orientation = rigidBodyProperties.rotation;
-        sceneNodeTransform.position = rigidBodyProperties.position;
-        sceneNodeTransform.touch();
-    }
+    EntityManager& entityManager = *this->entityManager();
+    m_impl->m_entities.takeChanges(
+        [&] (EntityId entityId, const std::tuple<RigidBodyComponent*, OgreSceneNodeComponent*>& group) {
+            RigidBodyComponent* rigidBodyComponent = std::get<0>(group);
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(group);
+            if (sceneNodeComponent->m_transformSlot != TransformBuffer::NO_SLOT) {
+                // Re-added in the same tick
+                m_impl->m_transformBuffer->remove(sceneNodeComponent->m_transformSlot);
+            }
+            auto& transform = sceneNodeComponent->m_transform;
+            transform.orientation = rigidBodyComponent->m_dynamicProperties.rotation;
+            transform.position = rigidBodyComponent->m_dynamicProperties.position;
+            // The buffer applies it, others may still want to know
+            transform.bumpVersion();
+            sceneNodeComponent->m_isInterpolated = false;
+            rigidBodyComponent->m_transformBuffer = m_impl->m_transformBuffer;
+            rigidBodyComponent->m_transformSlot = m_impl->m_transformBuffer->add(sceneNodeComponent);
+        },
+        [&] (EntityId entityId) {
+            m_impl->unlink(entityManager, entityId);
+        }
+    );
+    // The physics has written this tick's transforms into the buffer
+    m_impl->m_transformBuffer->endTick();
 }
-
-
@@ -11,6 +11,14 @@ namespace thrive {
 /**
 * @brief Updates OgreSceneNodeComponents with physics data
 *
+* Links each entity with both a RigidBodyComponent and an 
+* OgreSceneNodeComponent to a slot in the TransformBuffer of the game 
+* state's OgreUpdateSceneNodeSystem. The rigid body's motion state then
+* writes its transform straight into that slot, and the scene node system
+* applies all moving slots in one pass. Sleeping bodies cost nothing.
+*
+* At the end of each tick, the system tells the buffer which bodies have
+* stopped moving.
 */
 class BulletToOgreSystem : public System {
 
@@ -3,10 +3,25 @@
 #include "engine/game_state.h"
 #include "scripting/luabind.h"
 
+#include <algorithm>
+
 
 
 using namespace thrive;
 
+namespace {
+
+// The same for both orders of the entities
+CollisionFilter::CollisionId
+collisionId(
+    const Collision& collision
+) {
+    return std::minmax(collision.entityId1, collision.entityId2);
+}
+
+} // namespace
+
+
 struct CollisionFilter::Implementation {
 
     Implementation(
@@ -16,7 +31,43 @@ struct CollisionFilter::Implementation {
     {
     }
 
-    CollisionMap m_collisions;
+    // If collisions were added since the last call, sorts them and merges
+    // those of the same entities
+    void
+    mergeCollisions() {
+        if (m_mergedCount == m_collisions.size()) {
+            return;
+        }
+        std::sort(
+            m_collisions.begin(),
+            m_collisions.end(),
+            [] (const Collision& lhs, const Collision& rhs) {
+                return collisionId(lhs) < collisionId(rhs);
+            }
+        );
+        auto merged = m_collisions.begin();
+        for (auto iter = m_collisions.begin() + 1; iter < m_collisions.end(); ++iter) {
+            if (collisionId(*iter) == collisionId(*merged)) {
+                merged->addedCollisionDuration += iter->addedCollisionDuration;
+                if (iter->event == Collision::Begin) {
+                    merged->event = Collision::Begin;
+                }
+            }
+            else {
+                ++merged;
+                *merged = *iter;
+            }
+        }
+        m_collisions.erase(merged + 1, m_collisions.end());
+        m_mergedCount = m_collisions.size();
+    }
+
+    CollisionList m_collisions;
+
+    // The size after the last merge, collisions were added if it differs
+    size_t m_mergedCount = 0;
+
+    std::vector<Collision> m_endedCollisions;
 
     Signature m_signature;
 
@@ -25,6 +76,20 @@ struct CollisionFilter::Implementation {
 };
 
 
+static luabind::object
+CollisionFilter_collisionList(
+    CollisionFilter* self,
+    lua_State* L
+) {
+    const CollisionFilter::CollisionList& collisions = self->collisions();
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < collisions.size(); ++i) {
+        table[i + 1] = collisions[i];
+    }
+    return table;
+}
+
+
 luabind::scope
 CollisionFilter::luaBindings() {
     using namespace luabind;
@@ -33,6 +98,8 @@ CollisionFilter::luaBindings() {
         .def("init", &CollisionFilter::init)
         .def("shutdown", &CollisionFilter::shutdown)
         .def("collisions", &CollisionFilter::collisions, return_stl_iterator)
+        .def("collisionList", &CollisionFilter_collisionList)
+        .def("endedCollisions", &CollisionFilter::endedCollisions, return_stl_iterator)
         .def("clearCollisions", &CollisionFilter::clearCollisions)
     ;
 }
@@ -61,9 +128,10 @@ CollisionFilter::shutdown() {
     m_impl->m_collisionSystem = nullptr;
 }
 
-const CollisionFilter::CollisionIterator
+const CollisionFilter::CollisionList&
 CollisionFilter::collisions() {
-    return m_impl->m_collisions | boost::adaptors::map_values;
+    m_impl->mergeCollisions();
+    return m_impl->m_collisions;
 }
 
 
@@ -71,59 +139,44 @@ void
 CollisionFilter::addCollision(
     Collision collision
 ) {
-    CollisionMap::iterator foundCollision = m_impl->m_collisions.find(CollisionId(collision.entityId1, collision.entityId2));
-    if (foundCollision != m_impl->m_collisions.end())
-         foundCollision->second.addedCollisionDuration += collision.addedCollisionDuration; //Add collision time.
-    else
-    {
-        CollisionId key(collision.entityId1, collision.entityId2);
-        m_impl->m_collisions.emplace(key, collision);
+    if (collision.event == Collision::End) {
+        m_impl->m_endedCollisions.push_back(collision);
+        return;
     }
-
+    // Duplicates are merged when the collisions are read
+    m_impl->m_collisions.push_back(collision);
 }
 
 
-typename CollisionFilter::CollisionIterator::iterator
+CollisionFilter::CollisionList::const_iterator
 CollisionFilter::begin() const {
-    return (m_impl->m_collisions | boost::adaptors::map_values).begin();
+    m_impl->mergeCollisions();
+    return m_impl->m_collisions.cbegin();
 }
 
 
-typename CollisionFilter::CollisionIterator::iterator
+CollisionFilter::CollisionList::const_iterator
 CollisionFilter::end() const {
-    return (m_impl->m_collisions | boost::adaptors::map_values).end();
+    m_impl->mergeCollisions();
+    return m_impl->m_collisions.cend();
 }
 
 
 void
 CollisionFilter::clearCollisions() {
     m_impl->m_collisions.clear();
+    m_impl->m_mergedCount = 0;
+    m_impl->m_endedCollisions.clear();
 }
 
 
-const CollisionFilter::Signature&
-CollisionFilter::getCollisionSignature() const {
-    return m_impl->m_signature;
+const std::vector<Collision>&
+CollisionFilter::endedCollisions() const {
+    return m_impl->m_endedCollisions;
 }
 
 
-size_t
-CollisionFilter::IdHash::operator() (
-    const CollisionId& collisionId
-) const {
-    std::size_t hash1 = std::hash<EntityId>()(collisionId.first);
-    std::size_t hash2 = std::hash<EntityId>()(collisionId.second);
-    // Hash needs to be symmetric so that hash(entityId1, entityId2) == hash(entityId2, entityId1)
-    return hash1 ^ hash2;
-}
-
-
-bool
-CollisionFilter::IdEquals::operator() (
-    const CollisionId& lhs,
-    const CollisionId& rhs
-) const{
-    // Equality needs to be symmetric for collisions
-    return (lhs.first == rhs.first && lhs.second == rhs.second) ||
-           (lhs.first == rhs.second && lhs.second == rhs.first);
+const CollisionFilter::Signature&
+CollisionFilter::getCollisionSignature() const {
+    return m_impl->m_signature;
 }
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <boost/range/adaptor/map.hpp>
-
 #include "bullet/collision_system.h"
 
 #include <iostream>
@@ -9,6 +7,7 @@
 
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 
 namespace luabind {
@@ -26,6 +25,10 @@ class CollisionSystem;
 * Collision filter makes it easy for systems and other peices of code to get easy
 *  access to the right collisions
 *
+* Collisions are kept in a flat buffer that is sorted by entity pair and 
+* merged before it is read. Clearing it keeps its capacity, so a filter 
+* that is cleared every frame stops allocating once it has seen its 
+* busiest frame.
 */
 
 class CollisionFilter {
@@ -36,23 +39,7 @@ public:
 
     using Signature = std::pair<std::string, std::string>;
 
-    struct IdHash {
-        std::size_t
-        operator() (
-            const CollisionId& collisionId
-        ) const;
-    };
-
-    struct IdEquals {
-        bool
-        operator() (
-            const CollisionId& lhs,
-            const CollisionId& rhs
-        ) const;
-    };
-
-    using CollisionMap = std::unordered_map<CollisionId, Collision, IdHash, IdEquals>;
-    using CollisionIterator = boost::range_detail::select_second_mutable_range<CollisionMap>;
+    using CollisionList = std::vector<Collision>;
 
     /**
     * @brief Constructor
@@ -99,6 +86,9 @@ public:
     * - CollisionFilter::init(GameState*)
     * - CollisionFilter::shutdown()
     * - CollisionFilter::collisions()
+    * - CollisionFilter::collisions() (as <tt>collisionList()</tt>, 
+    *   returns a table)
+    * - CollisionFilter::endedCollisions()
     * - CollisionFilter::clearCollisions()
     */
     static luabind::scope
@@ -107,13 +97,17 @@ public:
     /**
     * @brief Returns the collisions that has occoured
     *
-    * Is only reset when clearCollisions() is called
+    * Each pair of entities occurs once, with the durations of all its
+    * collisions added up. Is only reset when clearCollisions() is called.
+    * Adding collisions invalidates the returned reference.
     */
-    const CollisionIterator
+    const CollisionList&
     collisions();
 
     /**
-    * @brief Clears the collisions
+    * @brief Clears the collisions and ended collisions
+    *
+    * The buffers keep their capacity.
     */
     void
     clearCollisions();
@@ -121,12 +115,26 @@ public:
     /**
     * @brief Adds a collision
     *
+    * Collisions that ended go to endedCollisions(), the others are merged
+    * into collisions(). A merged collision keeps the Collision::Begin event
+    * until it is cleared.
+    *
     * @param collision
     *   Collision to add
     */
     void
     addCollision(Collision collision);
 
+    /**
+    * @brief Returns the collisions that ended
+    *
+    * Only event driven collision systems report ended collisions, see
+    * CollisionSystem::setEventDriven(). Is only reset when 
+    * clearCollisions() is called.
+    */
+    const std::vector<Collision>&
+    endedCollisions() const;
+
     /**
     * @brief Iterator
     *
@@ -137,7 +145,7 @@ public:
     *
     * @return An iterator to the first collision
     */
-    typename CollisionIterator::iterator
+    CollisionList::const_iterator
     begin() const;
 
     /**
@@ -150,7 +158,7 @@ public:
     *
     * @return An iterator to the end of the collisions
     */
-    typename CollisionIterator::iterator
+    CollisionList::const_iterator
     end() const;
 
     /**
@@ -5,8 +5,69 @@
 #include "scripting/luabind.h"
 #include "util/make_unique.h"
 
+#include <algorithm>
+#include <atomic>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
 using namespace thrive;
 
+namespace {
+
+// How much longer than wide a shape has to be for createBoundingShape() to
+// pick a capsule over a sphere
+const btScalar CAPSULE_ELONGATION = 1.5f;
+
+// Shape type, axis and up to three scalar parameters
+using ShapeKey = std::tuple<uint8_t, uint8_t, btScalar, btScalar, btScalar>;
+
+/**
+* @brief Returns the Bullet shape for a key, creating it if necessary
+*
+* The cache only holds weak references, so a Bullet shape is destroyed as
+* soon as the last CollisionShape using it is gone. Shapes may be created
+* and destroyed from any thread.
+*/
+std::shared_ptr<btCollisionShape>
+findOrCreateBulletShape(
+    const ShapeKey& key,
+    const std::function<btCollisionShape*()>& create
+) {
+    static boost::mutex mutex;
+    static std::map<ShapeKey, std::weak_ptr<btCollisionShape>> cache;
+    boost::lock_guard<boost::mutex> lock(mutex);
+    std::weak_ptr<btCollisionShape>& cached = cache[key];
+    std::shared_ptr<btCollisionShape> shape = cached.lock();
+    if (not shape) {
+        shape.reset(create());
+        cached = shape;
+    }
+    return shape;
+}
+
+
+template<typename BulletShape>
+std::shared_ptr<BulletShape>
+sharedBulletShape(
+    const ShapeKey& key,
+    const std::function<btCollisionShape*()>& create
+) {
+    // The key's shape type and axis determine the Bullet class, so the cast
+    // is safe
+    return std::static_pointer_cast<BulletShape>(
+        findOrCreateBulletShape(key, create)
+    );
+}
+
+} // namespace
+
 ////////////////////////////////////////////////////////////////////////////////
 // CollisionShape
 ////////////////////////////////////////////////////////////////////////////////
@@ -53,6 +114,39 @@ CollisionShape::luaBindings() {
 CollisionShape::~CollisionShape() {}
 
 
+std::unique_ptr<btCollisionShape>
+CollisionShape::createBoundingShape() const {
+    btTransform identity;
+    identity.setIdentity();
+    btVector3 aabbMin;
+    btVector3 aabbMax;
+    this->bulletShape()->getAabb(identity, aabbMin, aabbMax);
+    btVector3 center = (aabbMin + aabbMax) * 0.5f;
+    btVector3 halfExtents = (aabbMax - aabbMin) * 0.5f;
+    int longAxis = halfExtents.maxAxis();
+    btScalar width = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (axis != longAxis) {
+            width = std::max(width, halfExtents[axis]);
+        }
+    }
+    // A multi-sphere shape of two spheres is a capsule, and unlike
+    // btCapsuleShape it can be off the origin
+    btVector3 positions[2] = {center, center};
+    btScalar radii[2] = {halfExtents[longAxis], width};
+    int count = 1;
+    if (halfExtents[longAxis] > CAPSULE_ELONGATION * width) {
+        btVector3 offset(0.0f, 0.0f, 0.0f);
+        offset[longAxis] = halfExtents[longAxis] - width;
+        positions[0] -= offset;
+        positions[1] += offset;
+        radii[0] = width;
+        count = 2;
+    }
+    return make_unique<btMultiSphereShape>(positions, radii, count);
+}
+
+
 StorageContainer
 CollisionShape::storage() const {
     StorageContainer storage;
@@ -103,7 +197,12 @@ BoxShape::luaBindings() {
 
 BoxShape::BoxShape(
     const Ogre::Vector3& extents
-) : m_bulletShape(new btBoxShape(ogreToBullet(extents))),
+) : m_bulletShape(sharedBulletShape<btBoxShape>(
+        ShapeKey(BOX_SHAPE, AXIS_X, extents.x, extents.y, extents.z),
+        [&extents]() {
+            return new btBoxShape(ogreToBullet(extents));
+        }
+    )),
     m_extents(extents)
 {
 }
@@ -174,18 +273,20 @@ CapsuleShape::CapsuleShape(
     m_height(height),
     m_radius(radius)
 {
-    switch(axis) {
-        case CollisionShape::AXIS_X:
-            m_bulletShape.reset(new btCapsuleShapeX(radius, height));
-            break;
-        default:
-        case CollisionShape::AXIS_Y:
-            m_bulletShape.reset(new btCapsuleShape(radius, height));
-            break;
-        case CollisionShape::AXIS_Z:
-            m_bulletShape.reset(new btCapsuleShapeZ(radius, height));
-            break;
-    }
+    m_bulletShape = sharedBulletShape<btCapsuleShape>(
+        ShapeKey(CAPSULE_SHAPE, axis, radius, height, 0.0f),
+        [axis, radius, height]() -> btCollisionShape* {
+            switch(axis) {
+                case CollisionShape::AXIS_X:
+                    return new btCapsuleShapeX(radius, height);
+                default:
+                case CollisionShape::AXIS_Y:
+                    return new btCapsuleShape(radius, height);
+                case CollisionShape::AXIS_Z:
+                    return new btCapsuleShapeZ(radius, height);
+            }
+        }
+    );
 }
 
 
@@ -222,11 +323,25 @@ CompoundShape::load(
 ) {
     auto shape = make_unique<CompoundShape>();
     StorageList childShapes = storage.get<StorageList>("childShapes", StorageList());
-    for (const StorageContainer& childStorage : childShapes) {
-        Ogre::Vector3 translation = childStorage.get<Ogre::Vector3>(
-            "compoundTranslation",
-            Ogre::Vector3::ZERO
-        );
+    std::vector<Ogre::Vector3> translations = storage.get<std::vector<Ogre::Vector3>>(
+        "childTranslations"
+    );
+    shape->beginChanges();
+    for (size_t i = 0; i < childShapes.size(); ++i) {
+        // The rotation is stored with the child, also in the shape table
+        const StorageContainer& childStorage =
+            CollisionShapeTable::dereference(childShapes[i]);
+        Ogre::Vector3 translation;
+        if (i < translations.size()) {
+            translation = translations[i];
+        }
+        else {
+            // Older savegames store the translation with the child
+            translation = childStorage.get<Ogre::Vector3>(
+                "compoundTranslation",
+                Ogre::Vector3::ZERO
+            );
+        }
         Ogre::Quaternion rotation = childStorage.get<Ogre::Quaternion>(
             "compoundRotation",
             Ogre::Quaternion::IDENTITY
@@ -234,9 +349,10 @@ CompoundShape::load(
         shape->addChildShape(
             translation,
             rotation,
-            CollisionShape::load(childStorage)
+            CollisionShapeTable::load(childShapes[i])
         );
     }
+    shape->commitChanges();
     return shape;
 }
 
@@ -246,7 +362,9 @@ CompoundShape::load(
 *
 * - CompoundShape::CompoundShape()
 * - CompoundShape::addChildShape()
+* - CompoundShape::beginChanges()
 * - CompoundShape::clear()
+* - CompoundShape::commitChanges()
 * - CompoundShape::removeChildShape()
 *
 * @return 
@@ -257,7 +375,9 @@ CompoundShape::luaBindings() {
     return class_<CompoundShape, CollisionShape, std::shared_ptr<CollisionShape>>("CompoundShape")
         .def(constructor<>())
         .def("addChildShape", &CompoundShape::addChildShape)
+        .def("beginChanges", &CompoundShape::beginChanges)
         .def("clear", &CompoundShape::clear)
+        .def("commitChanges", &CompoundShape::commitChanges)
         .def("removeChildShape", &CompoundShape::removeChildShape)
     ;
 }
@@ -275,11 +395,16 @@ CompoundShape::addChildShape(
     const Ogre::Quaternion& rotation,
     std::shared_ptr<CollisionShape> shape
 ) {
-    btTransform transform(
-        ogreToBullet(rotation),
-        ogreToBullet(translation)
-    );
-    m_bulletShape->addChildShape(transform, shape->bulletShape());
+    if (m_batchDepth == 0) {
+        btTransform transform(
+            ogreToBullet(rotation),
+            ogreToBullet(translation)
+        );
+        m_bulletShape->addChildShape(transform, shape->bulletShape());
+    }
+    else {
+        m_needsRebuild = true;
+    }
     m_childShapes.emplace_back(ChildShape{
         translation,
         rotation,
@@ -288,14 +413,49 @@ CompoundShape::addChildShape(
 }
 
 
+void
+CompoundShape::beginChanges() {
+    m_batchDepth += 1;
+}
+
+
 void
 CompoundShape::clear() {
+    if (m_batchDepth > 0) {
+        m_childShapes.clear();
+        m_needsRebuild = true;
+        return;
+    }
+    while (not m_childShapes.empty()) {
+        m_bulletShape->removeChildShapeByIndex(m_childShapes.size() - 1);
+        m_childShapes.pop_back();
+    }
+    m_bulletShape->recalculateLocalAabb();
+}
+
+
+void
+CompoundShape::commitChanges() {
+    if (m_batchDepth == 0) {
+        throw std::logic_error("CompoundShape::commitChanges() without beginChanges()");
+    }
+    m_batchDepth -= 1;
+    if (m_batchDepth > 0 or not m_needsRebuild) {
+        return;
+    }
+    for (int i = m_bulletShape->getNumChildShapes(); i > 0; --i) {
+        m_bulletShape->removeChildShapeByIndex(i - 1);
+    }
     for (const auto& childShape : m_childShapes) {
-        m_bulletShape->removeChildShape(
-            childShape.shape->bulletShape()
+        btTransform transform(
+            ogreToBullet(childShape.rotation),
+            ogreToBullet(childShape.translation)
         );
+        m_bulletShape->addChildShape(transform, childShape.shape->bulletShape());
     }
-    m_childShapes.clear();
+    // Removing and adding children never shrinks the AABB
+    m_bulletShape->recalculateLocalAabb();
+    m_needsRebuild = false;
 }
 
 
@@ -303,17 +463,32 @@ void
 CompoundShape::removeChildShape(
     const CollisionShape::Ptr& shape
 ) {
-    m_bulletShape->removeChildShape(shape->bulletShape());
-    auto iter = m_childShapes.begin();
-    while (iter != m_childShapes.end()) {
-        if (iter->shape == shape) {
-            iter = m_childShapes.erase(iter);
-        }
-        else {
-            ++iter;
+    if (m_batchDepth > 0) {
+        auto newEnd = std::remove_if(
+            m_childShapes.begin(),
+            m_childShapes.end(),
+            [&shape](const ChildShape& childShape) {
+                return childShape.shape == shape;
+            }
+        );
+        m_needsRebuild = m_needsRebuild or newEnd != m_childShapes.end();
+        m_childShapes.erase(newEnd, m_childShapes.end());
+        return;
+    }
+    // Other children may share the same Bullet shape, so children are
+    // removed by index. Bullet moves the last child into the removed slot,
+    // which is mirrored here to keep the indices in sync.
+    for (size_t i = m_childShapes.size(); i > 0; --i) {
+        size_t index = i - 1;
+        if (m_childShapes[index].shape == shape) {
+            m_bulletShape->removeChildShapeByIndex(index);
+            if (index + 1 < m_childShapes.size()) {
+                m_childShapes[index] = std::move(m_childShapes.back());
+            }
+            m_childShapes.pop_back();
         }
     }
-
+    m_bulletShape->recalculateLocalAabb();
 }
 
 
@@ -327,12 +502,11 @@ CompoundShape::storage() const {
     StorageContainer storage = CollisionShape::storage();
     StorageList childShapes;
     childShapes.reserve(m_childShapes.size());
+    std::vector<Ogre::Vector3> translations;
+    translations.reserve(m_childShapes.size());
     for (const auto& childShape : m_childShapes) {
         StorageContainer childStorage = childShape.shape->storage();
-        childStorage.set<Ogre::Vector3>(
-            "compoundTranslation", 
-            childShape.translation
-        );
+        translations.push_back(childShape.translation);
         childStorage.set<Ogre::Quaternion>(
             "compoundRotation", 
             childShape.rotation
@@ -340,6 +514,7 @@ CompoundShape::storage() const {
         childShapes.push_back(childStorage);
     }
     storage.set<StorageList>("childShapes", childShapes);
+    storage.set<std::vector<Ogre::Vector3>>("childTranslations", std::move(translations));
     return storage;
 }
 
@@ -396,18 +571,20 @@ ConeShape::ConeShape(
     m_height(height),
     m_radius(radius)
 {
-    switch(axis) {
-        case CollisionShape::AXIS_X:
-            m_bulletShape.reset(new btConeShapeX(radius, height));
-            break;
-        default:
-        case CollisionShape::AXIS_Y:
-            m_bulletShape.reset(new btConeShape(radius, height));
-            break;
-        case CollisionShape::AXIS_Z:
-            m_bulletShape.reset(new btConeShapeZ(radius, height));
-            break;
-    }
+    m_bulletShape = sharedBulletShape<btConeShape>(
+        ShapeKey(CONE_SHAPE, axis, radius, height, 0.0f),
+        [axis, radius, height]() -> btCollisionShape* {
+            switch(axis) {
+                case CollisionShape::AXIS_X:
+                    return new btConeShapeX(radius, height);
+                default:
+                case CollisionShape::AXIS_Y:
+                    return new btConeShape(radius, height);
+                case CollisionShape::AXIS_Z:
+                    return new btConeShapeZ(radius, height);
+            }
+        }
+    );
 }
 
 
@@ -478,24 +655,20 @@ CylinderShape::CylinderShape(
     m_height(height),
     m_radius(radius)
 {
-    switch(axis) {
-        case CollisionShape::AXIS_X:
-            m_bulletShape.reset(
-                new btCylinderShapeX(btVector3(height*0.5, radius, radius))
-            );
-            break;
-        default:
-        case CollisionShape::AXIS_Y:
-            m_bulletShape.reset(
-                new btCylinderShape(btVector3(radius, height*0.5, radius))
-            );
-            break;
-        case CollisionShape::AXIS_Z:
-            m_bulletShape.reset(
-                new btCylinderShapeZ(btVector3(radius, radius, height*0.5))
-            );
-            break;
-    }
+    m_bulletShape = sharedBulletShape<btCylinderShape>(
+        ShapeKey(CYLINDER_SHAPE, axis, radius, height, 0.0f),
+        [axis, radius, height]() -> btCollisionShape* {
+            switch(axis) {
+                case CollisionShape::AXIS_X:
+                    return new btCylinderShapeX(btVector3(height*0.5, radius, radius));
+                default:
+                case CollisionShape::AXIS_Y:
+                    return new btCylinderShape(btVector3(radius, height*0.5, radius));
+                case CollisionShape::AXIS_Z:
+                    return new btCylinderShapeZ(btVector3(radius, radius, height*0.5));
+            }
+        }
+    );
 }
 
 
@@ -549,7 +722,12 @@ EmptyShape::luaBindings() {
 
 
 EmptyShape::EmptyShape() 
-  : m_bulletShape(new btEmptyShape())
+  : m_bulletShape(sharedBulletShape<btEmptyShape>(
+        ShapeKey(EMPTY_SHAPE, AXIS_X, 0.0f, 0.0f, 0.0f),
+        []() {
+            return new btEmptyShape();
+        }
+    ))
 {
 }
 
@@ -604,7 +782,12 @@ SphereShape::luaBindings() {
 
 SphereShape::SphereShape(
     btScalar radius
-) : m_bulletShape(new btSphereShape(radius)),
+) : m_bulletShape(sharedBulletShape<btSphereShape>(
+        ShapeKey(SPHERE_SHAPE, AXIS_X, radius, 0.0f, 0.0f),
+        [radius]() {
+            return new btSphereShape(radius);
+        }
+    )),
     m_radius(radius)
 {
 }
@@ -623,3 +806,178 @@ SphereShape::storage() const {
 }
 
 
+
+////////////////////////////////////////////////////////////////////////////////
+// CollisionShapeTable
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const StorageKey CHILD_SHAPES_KEY("childShapes");
+const StorageKey SHAPE_REFERENCE_KEY("shapeReference");
+const StorageKey SHAPE_TYPE_KEY("shapeType");
+
+std::atomic<const CollisionShapeTable*> currentTable = {nullptr};
+
+// FNV-1a
+uint64_t
+hashContent(
+    const std::string& content
+) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : content) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+bool
+isCompound(
+    const StorageContainer& storage
+) {
+    return storage.get<uint8_t>(SHAPE_TYPE_KEY, CollisionShape::EMPTY_SHAPE) == CollisionShape::COMPOUND_SHAPE;
+}
+
+} // namespace
+
+
+struct CollisionShapeTable::Implementation {
+
+    const StorageContainer&
+    find(
+        const std::string& key
+    ) const {
+        auto iter = m_shapes.find(key);
+        if (iter == m_shapes.end()) {
+            throw std::runtime_error("Unknown collision shape reference " + key);
+        }
+        return iter->second;
+    }
+
+    // Loaded shapes, without compound shapes
+    std::unordered_map<std::string, CollisionShape::Ptr> m_loaded;
+
+    // Serialized content to key, only filled while saving
+    std::unordered_map<std::string, std::string> m_keys;
+
+    std::map<std::string, StorageContainer> m_shapes;
+
+};
+
+
+CollisionShapeTable::Scope::Scope(
+    const CollisionShapeTable* table
+) : m_previous(currentTable.exchange(table))
+{
+}
+
+
+CollisionShapeTable::Scope::~Scope() {
+    currentTable.store(m_previous);
+}
+
+
+const CollisionShapeTable*
+CollisionShapeTable::current() {
+    return currentTable.load();
+}
+
+
+const StorageContainer&
+CollisionShapeTable::dereference(
+    const StorageContainer& storage
+) {
+    if (not storage.contains<std::string>(SHAPE_REFERENCE_KEY)) {
+        return storage;
+    }
+    const CollisionShapeTable* table = current();
+    if (not table) {
+        throw std::runtime_error("Collision shape reference without a shape table");
+    }
+    return table->m_impl->find(storage.get<std::string>(SHAPE_REFERENCE_KEY));
+}
+
+
+CollisionShape::Ptr
+CollisionShapeTable::load(
+    const StorageContainer& storage
+) {
+    if (not storage.contains<std::string>(SHAPE_REFERENCE_KEY)) {
+        return CollisionShape::load(storage);
+    }
+    const StorageContainer& shapeStorage = dereference(storage);
+    const auto& loaded = current()->m_impl->m_loaded;
+    auto iter = loaded.find(storage.get<std::string>(SHAPE_REFERENCE_KEY));
+    if (iter != loaded.end()) {
+        return iter->second;
+    }
+    return CollisionShape::load(shapeStorage);
+}
+
+
+CollisionShapeTable::CollisionShapeTable()
+  : m_impl(new Implementation())
+{
+}
+
+
+CollisionShapeTable::CollisionShapeTable(
+    const StorageContainer& storage
+) : CollisionShapeTable()
+{
+    for (const std::string& key : storage.keys()) {
+        StorageContainer shapeStorage = storage.get<StorageContainer>(key);
+        if (not isCompound(shapeStorage)) {
+            m_impl->m_loaded.emplace(key, CollisionShape::load(shapeStorage));
+        }
+        m_impl->m_shapes.emplace(key, std::move(shapeStorage));
+    }
+}
+
+
+CollisionShapeTable::~CollisionShapeTable() {}
+
+
+StorageContainer
+CollisionShapeTable::reference(
+    const StorageContainer& storage
+) {
+    StorageContainer shapeStorage = storage;
+    if (isCompound(storage)) {
+        StorageList childShapes = storage.get<StorageList>(CHILD_SHAPES_KEY, StorageList());
+        for (StorageContainer& childShape : childShapes) {
+            childShape = this->reference(childShape);
+        }
+        shapeStorage.set<StorageList>(CHILD_SHAPES_KEY, std::move(childShapes));
+    }
+    std::ostringstream stream;
+    saveStorage(stream, shapeStorage);
+    std::string content = stream.str();
+    std::string& key = m_impl->m_keys[content];
+    if (key.empty()) {
+        uint64_t hash = hashContent(content);
+        char hexHash[17];
+        // A different shape with the same hash takes the next free one
+        do {
+            std::snprintf(hexHash, sizeof(hexHash), "%016llx", static_cast<unsigned long long>(hash));
+            hash += 1;
+        } while (m_impl->m_shapes.count(hexHash) > 0);
+        key = hexHash;
+        m_impl->m_shapes.emplace(key, std::move(shapeStorage));
+    }
+    StorageContainer reference;
+    reference.set<std::string>(SHAPE_REFERENCE_KEY, key);
+    return reference;
+}
+
+
+StorageContainer
+CollisionShapeTable::storage() const {
+    StorageContainer storage;
+    for (const auto& pair : m_impl->m_shapes) {
+        storage.set<StorageContainer>(pair.first, pair.second);
+    }
+    return storage;
+}
@@ -93,6 +93,21 @@ public:
     virtual btCollisionShape*
     bulletShape() const = 0;
 
+    /**
+    * @brief Creates a single convex shape that bounds the shape's AABB
+    *
+    * A sphere, or a capsule along the AABB's longest axis if the shape is
+    * clearly elongated. Colliding with it is much cheaper than with a
+    * compound shape of many children, but only roughly matches them.
+    *
+    * The bounding shape doesn't follow later changes to this shape.
+    *
+    * @return
+    *   A new Bullet shape
+    */
+    std::unique_ptr<btCollisionShape>
+    createBoundingShape() const;
+
     /**
     * @brief The shape's type
     *
@@ -114,6 +129,10 @@ public:
 /**
 * @brief Macro for defining and declaring the basic content of a shape class
 *
+* The Bullet shape is held through a shared pointer. Shapes that are fully
+* defined by their constructor arguments share one Bullet shape with all
+* other instances constructed from the same arguments.
+*
 * @param cls
 *   The name of the shape class
 * @param type
@@ -153,7 +172,7 @@ public:
         \
     private: \
         \
-        std::unique_ptr<bulletShapeClass> m_bulletShape;
+        std::shared_ptr<bulletShapeClass> m_bulletShape;
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -232,6 +251,11 @@ private:
 
 /**
 * @brief A shape compounded of multiple other shapes
+*
+* Unlike the other shapes, a compound shape can be modified after
+* construction, so each compound shape owns its Bullet shape. Its children
+* are shared as usual, so identical child shapes only cost one Bullet shape
+* no matter how often they are added.
 */
 class CompoundShape : public CollisionShape {
 
@@ -261,12 +285,36 @@ public:
         CollisionShape::Ptr shape
     );
 
+    /**
+    * @brief Starts a batch of child shape changes
+    *
+    * Until the matching commitChanges(), adding and removing children only
+    * updates the list of children. The Bullet shape is rebuilt once when
+    * the batch is committed instead of after every change.
+    *
+    * Batches can be nested. Only the outermost commit rebuilds the shape.
+    */
+    void
+    beginChanges();
+
     /**
     * @brief Removes all child shapes
     */
     void
     clear();
 
+    /**
+    * @brief Ends a batch of child shape changes
+    *
+    * Rigid bodies using this shape don't notice the change on their own.
+    * Touch their properties afterwards to update their mass properties.
+    *
+    * @throw std::logic_error
+    *   If there is no batch to commit
+    */
+    void
+    commitChanges();
+
     /**
     * @brief Removes a child shape
     *
@@ -286,8 +334,12 @@ private:
         CollisionShape::Ptr shape;
     };
 
+    unsigned int m_batchDepth = 0;
+
     std::vector<ChildShape> m_childShapes;
 
+    bool m_needsRebuild = false;
+
 };
 
 
@@ -425,6 +477,160 @@ private:
 };
 
 
-}
+////////////////////////////////////////////////////////////////////////////////
+// CollisionShapeTable
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+* @brief Stores each distinct collision shape of a savegame only once
+*
+* Bodies usually share a handful of shapes, but each of them would store
+* its whole shape tree. When saving, reference() replaces a shape's storage
+* by a small reference keyed by a hash of its content and adds the content
+* to the table, storage() then holds each distinct shape once. Compound
+* shapes reference their children the same way.
+*
+* A table constructed from that storage loads each shape once. While it is
+* installed with a Scope, CollisionShapeTable::load() resolves references,
+* so all bodies referencing the same shape get the same CollisionShape.
+* Compound shapes can be modified, so each reference to one loads a new
+* instance, but its children are shared. Storage without a reference, like
+* that of older savegames, is loaded as before.
+*/
+class CollisionShapeTable {
+
+public:
+
+    /**
+    * @brief Installs a table for loading
+    *
+    * Main thread only. The table is used by all threads until the scope
+    * ends, so loading jobs must be done by then.
+    */
+    class Scope {
+
+    public:
+
+        /**
+        * @brief Constructor
+        *
+        * @param table
+        *   The table to install
+        */
+        explicit Scope(
+            const CollisionShapeTable* table
+        );
 
+        /**
+        * @brief Destructor
+        *
+        * Reinstalls the previous table
+        */
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+
+        Scope& operator= (const Scope&) = delete;
+
+    private:
+
+        const CollisionShapeTable* m_previous;
+
+    };
 
+    /**
+    * @brief The installed table, or \c nullptr
+    */
+    static const CollisionShapeTable*
+    current();
+
+    /**
+    * @brief The full storage of a shape that may be a reference
+    *
+    * @param storage
+    *   A shape's storage
+    *
+    * @return
+    *   The storage the reference points to in the current table, or
+    *   \a storage itself if it isn't a reference
+    *
+    * @throws std::runtime_error
+    *   If the reference can't be resolved
+    */
+    static const StorageContainer&
+    dereference(
+        const StorageContainer& storage
+    );
+
+    /**
+    * @brief Loads a shape that may be a reference into the current table
+    *
+    * Thread safe.
+    *
+    * @param storage
+    *   A shape's storage
+    *
+    * @throws std::runtime_error
+    *   If the reference can't be resolved
+    */
+    static CollisionShape::Ptr
+    load(
+        const StorageContainer& storage
+    );
+
+    /**
+    * @brief Constructs an empty table for saving
+    */
+    CollisionShapeTable();
+
+    /**
+    * @brief Constructs a table for loading
+    *
+    * Loads all shapes except compound shapes right away.
+    *
+    * @param storage
+    *   The storage() of a table
+    */
+    explicit CollisionShapeTable(
+        const StorageContainer& storage
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~CollisionShapeTable();
+
+    CollisionShapeTable(const CollisionShapeTable&) = delete;
+
+    CollisionShapeTable& operator= (const CollisionShapeTable&) = delete;
+
+    /**
+    * @brief Adds a shape to the table
+    *
+    * Not thread safe.
+    *
+    * @param storage
+    *   The shape's storage, as from CollisionShape::storage()
+    *
+    * @return
+    *   A reference to store instead of \a storage
+    */
+    StorageContainer
+    reference(
+        const StorageContainer& storage
+    );
+
+    /**
+    * @brief The distinct shapes, keyed by their reference
+    */
+    StorageContainer
+    storage() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
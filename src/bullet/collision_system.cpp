@@ -6,9 +6,15 @@
 #include "engine/component_factory.h"
 #include "engine/engine.h"
 #include "engine/entity.h"
+#include "engine/entity_filter.h"
 #include "engine/entity_manager.h"
 #include "engine/serialization.h"
+#include "engine/statistics.h"
 #include "bullet/rigid_body_system.h"
+
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <btBulletDynamicsCommon.h>
 #include <unordered_map>
 
 #include "util/pair_hash.h"
@@ -16,6 +22,103 @@
 
 using namespace thrive;
 
+namespace {
+
+// Interns collision group names, shared by all game states
+class CollisionGroupRegistry {
+
+public:
+
+    static CollisionGroupRegistry&
+    instance() {
+        static CollisionGroupRegistry registry;
+        return registry;
+    }
+
+    CollisionGroupId
+    id(
+        const std::string& group
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        auto iter = m_ids.find(group);
+        if (iter != m_ids.end()) {
+            return iter->second;
+        }
+        CollisionGroupId id = m_ids.size();
+        m_ids.emplace(group, id);
+        return id;
+    }
+
+private:
+
+    std::unordered_map<std::string, CollisionGroupId> m_ids;
+
+    boost::mutex m_mutex;
+
+};
+
+
+// Rejects pairs in the broadphase that neither collide physically nor are
+// listened to by a collision filter, so they never reach the narrowphase.
+//
+// Bullet calls it during the physics step, possibly from several threads
+// at once. Its tables are only changed by the CollisionSystem between 
+// steps.
+class GroupOverlapFilter : public btOverlapFilterCallback {
+
+public:
+
+    bool
+    needBroadphaseCollision(
+        btBroadphaseProxy* proxy0,
+        btBroadphaseProxy* proxy1
+    ) const override {
+        // Bullet's own test, which the callback replaces
+        bool collides =
+            (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0 and
+            (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask) != 0;
+        if (not collides) {
+            return false;
+        }
+        auto object0 = static_cast<const btCollisionObject*>(proxy0->m_clientObject);
+        auto object1 = static_cast<const btCollisionObject*>(proxy1->m_clientObject);
+        if (object0->hasContactResponse() and object1->hasContactResponse()) {
+            return true;
+        }
+        auto groups0 = m_groups.find(reinterpret_cast<uintptr_t>(object0->getUserPointer()));
+        auto groups1 = m_groups.find(reinterpret_cast<uintptr_t>(object1->getUserPointer()));
+        if (groups0 == m_groups.end() or groups1 == m_groups.end()) {
+            // Not known yet, the CollisionSystem refreshes the proxy once
+            // it is
+            return true;
+        }
+        for (CollisionGroupId group0 : groups0->second) {
+            for (CollisionGroupId group1 : groups1->second) {
+                if (group0 < m_groupCount and group1 < m_groupCount and m_isListened[group0 * m_groupCount + group1]) {
+                    return true;
+                }
+            }
+        }
+        if (m_rejectedPairs) {
+            m_rejectedPairs->add();
+        }
+        return false;
+    }
+
+    // The collision groups of each entity with a CollisionComponent
+    std::unordered_map<EntityId, std::vector<CollisionGroupId>> m_groups;
+
+    size_t m_groupCount = 0;
+
+    // Whether any filter listens to a pair of groups, in either order
+    std::vector<char> m_isListened;
+
+    Statistics::Counter* m_rejectedPairs = nullptr;
+
+};
+
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CollisionComponent
 ////////////////////////////////////////////////////////////////////////////////
@@ -25,7 +128,8 @@ CollisionComponent::CollisionComponent(){}
 
 CollisionComponent::CollisionComponent(
     const std::string& collisionGroup
-) : m_collisionGroups({collisionGroup})
+) : m_collisionGroupIds({CollisionGroupRegistry::instance().id(collisionGroup)}),
+    m_collisionGroups({collisionGroup})
 {
 }
 
@@ -49,6 +153,7 @@ void
 CollisionComponent::addCollisionGroup(
     const std::string& group
 ) {
+    m_collisionGroupIds.push_back(CollisionGroupRegistry::instance().id(group));
     m_collisionGroups.push_back(group);
 }
 
@@ -56,6 +161,8 @@ void
 CollisionComponent::removeCollisionGroup(
     const std::string& group
 ) {
+    CollisionGroupId id = CollisionGroupRegistry::instance().id(group);
+    m_collisionGroupIds.erase(std::remove(m_collisionGroupIds.begin(), m_collisionGroupIds.end(), id), m_collisionGroupIds.end());
     m_collisionGroups.erase(std::remove(m_collisionGroups.begin(), m_collisionGroups.end(), group), m_collisionGroups.end());
 }
 
@@ -64,16 +171,22 @@ CollisionComponent::getCollisionGroups() {
     return m_collisionGroups;
 }
 
+const std::vector<CollisionGroupId>&
+CollisionComponent::getCollisionGroupIds() const {
+    return m_collisionGroupIds;
+}
+
 void
 CollisionComponent::load(
     const StorageContainer& storage
 ) {
     Component::load(storage);
     StorageList collisionGroups = storage.get<StorageList>("collisionGroups");
+    m_collisionGroupIds.reserve(collisionGroups.size());
     m_collisionGroups.reserve(collisionGroups.size());
     for (const StorageContainer& container : collisionGroups) {
         std::string collisionGroup = container.get<std::string>("collisionGroup");
-        m_collisionGroups.push_back(collisionGroup);
+        this->addCollisionGroup(collisionGroup);
     }
 }
 
@@ -104,10 +217,12 @@ REGISTER_COMPONENT(CollisionComponent)
 Collision::Collision(
     EntityId entityId1,
     EntityId entityId2,
-    int addedCollisionDuration
+    int addedCollisionDuration,
+    Event event
 ) : entityId1(entityId1),
     entityId2(entityId2),
-    addedCollisionDuration(addedCollisionDuration)
+    addedCollisionDuration(addedCollisionDuration),
+    event(event)
 {
 }
 
@@ -115,10 +230,16 @@ luabind::scope
 Collision::luaBindings() {
     using namespace luabind;
     return class_<Collision>("Collision")
+        .enum_("Event") [
+            value("Begin", Collision::Begin),
+            value("Persist", Collision::Persist),
+            value("End", Collision::End)
+        ]
         .def(constructor<EntityId, EntityId, int>())
         .def_readonly("entityId1", &Collision::entityId1)
         .def_readonly("entityId2", &Collision::entityId2)
         .def_readonly("addedCollisionDuration", &Collision::addedCollisionDuration)
+        .def_readonly("event", &Collision::event)
     ;
 }
 
@@ -130,9 +251,236 @@ Collision::luaBindings() {
 
 struct CollisionSystem::Implementation {
 
-    btDiscreteDynamicsWorld* m_world = nullptr;
+    // A pair of touching objects, tracked in event driven mode
+    struct Contact {
+
+        EntityId entityId1;
+
+        EntityId entityId2;
+
+        // Looked up when the contact begins
+        std::vector<CollisionFilter*> filters;
+
+        // The last update that saw the contact
+        unsigned int lastUpdate = 0;
 
-    std::unordered_multimap<CollisionFilter::Signature, CollisionFilter&>  m_collisionFilterMap;
+    };
+
+    void
+    dispatch(
+        const Contact& contact,
+        int milliseconds,
+        Collision::Event event
+    ) {
+        for (CollisionFilter* filter : contact.filters) {
+            filter->addCollision(Collision(contact.entityId1, contact.entityId2, milliseconds, event));
+        }
+        m_filterCallbacks += contact.filters.size();
+    }
+
+    void
+    resolveFilters(
+        Contact& contact
+    ) {
+        contact.filters.clear();
+        EntityManager& entityManager = m_gameState->entityManager();
+        auto collisionComponent1 = static_cast<CollisionComponent*>(
+            entityManager.getComponent(contact.entityId1, CollisionComponent::TYPE_ID)
+        );
+        auto collisionComponent2 = static_cast<CollisionComponent*>(
+            entityManager.getComponent(contact.entityId2, CollisionComponent::TYPE_ID)
+        );
+        if (not collisionComponent1 or not collisionComponent2) {
+            return;
+        }
+        for (CollisionGroupId group1 : collisionComponent1->getCollisionGroupIds()) {
+            for (CollisionGroupId group2 : collisionComponent2->getCollisionGroupIds()) {
+                if (group1 < m_routeGroupCount and group2 < m_routeGroupCount) {
+                    const auto& filters = this->route(group1, group2);
+                    contact.filters.insert(contact.filters.end(), filters.begin(), filters.end());
+                }
+            }
+        }
+    }
+
+    std::vector<CollisionFilter*>&
+    route(
+        CollisionGroupId group1,
+        CollisionGroupId group2
+    ) {
+        return m_routes[group1 * m_routeGroupCount + group2];
+    }
+
+    // Grows the route table so that it covers both groups
+    void
+    reserveRoutes(
+        CollisionGroupId group1,
+        CollisionGroupId group2
+    ) {
+        size_t groupCount = std::max(group1, group2) + 1;
+        if (groupCount <= m_routeGroupCount) {
+            return;
+        }
+        std::vector<std::vector<CollisionFilter*>> routes(groupCount * groupCount);
+        for (size_t i = 0; i < m_routeGroupCount; ++i) {
+            for (size_t j = 0; j < m_routeGroupCount; ++j) {
+                routes[i * groupCount + j] = std::move(m_routes[i * m_routeGroupCount + j]);
+            }
+        }
+        m_routes = std::move(routes);
+        m_routeGroupCount = groupCount;
+    }
+
+    // Registered filters per ordered pair of collision groups. Groups that
+    // were interned after the last registration have no filters.
+    std::vector<std::vector<CollisionFilter*>> m_routes;
+
+    size_t m_routeGroupCount = 0;
+
+    // Lets the broadphase reject a body's pairs again, after what the 
+    // overlap filter knows about it changed
+    void
+    refreshProxy(
+        EntityId entityId
+    ) {
+        auto rigidBody = m_gameState->entityManager().getComponent<RigidBodyComponent>(entityId);
+        if (rigidBody and rigidBody->m_body and rigidBody->m_body->getBroadphaseHandle()) {
+            m_world->refreshBroadphaseProxy(rigidBody->m_body);
+        }
+    }
+
+    // Brings the overlap filter up to date with the collision components
+    // and the registered filters
+    void
+    updateOverlapFilter() {
+        bool isRefreshNeeded = false;
+        if (m_areRoutesChanged) {
+            m_overlapFilter.m_groupCount = m_routeGroupCount;
+            m_overlapFilter.m_isListened.assign(m_routeGroupCount * m_routeGroupCount, 0);
+            for (size_t i = 0; i < m_routeGroupCount; ++i) {
+                for (size_t j = 0; j < m_routeGroupCount; ++j) {
+                    bool isListened =
+                        not this->route(i, j).empty() or
+                        not this->route(j, i).empty();
+                    m_overlapFilter.m_isListened[i * m_routeGroupCount + j] = isListened;
+                }
+            }
+            m_areRoutesChanged = false;
+            // Pairs rejected before may be listened to now
+            isRefreshNeeded = true;
+        }
+        m_entities.takeChanges(
+            [] (EntityId, const std::tuple<CollisionComponent*>&) {},
+            [this] (EntityId entityId) {
+                m_overlapFilter.m_groups.erase(entityId);
+            }
+        );
+        for (const auto& value : m_entities) {
+            EntityId entityId = value.first;
+            const auto& groups = std::get<0>(value.second)->getCollisionGroupIds();
+            auto iter = m_overlapFilter.m_groups.find(entityId);
+            if (iter == m_overlapFilter.m_groups.end()) {
+                m_overlapFilter.m_groups.emplace(entityId, groups);
+                this->refreshProxy(entityId);
+            }
+            else if (iter->second != groups) {
+                iter->second = groups;
+                this->refreshProxy(entityId);
+            }
+            else if (isRefreshNeeded) {
+                this->refreshProxy(entityId);
+            }
+        }
+    }
+
+    bool m_areRoutesChanged = false;
+
+    EntityFilter<
+        CollisionComponent
+    > m_entities = {true};
+
+    GroupOverlapFilter m_overlapFilter;
+
+    // Leaves the manifolds intact, so Bullet keeps their contact points
+    // cached between steps
+    void
+    updateContacts(
+        int milliseconds
+    ) {
+        m_updateCount += 1;
+        btDispatcher* dispatcher = m_world->getDispatcher();
+        int numManifolds = dispatcher->getNumManifolds();
+        size_t pairCount = 0;
+        for (int i = 0; i < numManifolds; ++i) {
+            btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+            if (manifold->getNumContacts() == 0) {
+                continue;
+            }
+            pairCount += 1;
+            EntityId entityId1 = reinterpret_cast<uintptr_t>(manifold->getBody0()->getUserPointer());
+            EntityId entityId2 = reinterpret_cast<uintptr_t>(manifold->getBody1()->getUserPointer());
+            auto iter = m_contacts.find(manifold);
+            if (
+                iter != m_contacts.end() and
+                (iter->second.entityId1 != entityId1 or iter->second.entityId2 != entityId2)
+            ) {
+                // Bullet reused the manifold for another pair
+                this->dispatch(iter->second, 0, Collision::End);
+                m_contacts.erase(iter);
+                iter = m_contacts.end();
+            }
+            if (iter == m_contacts.end()) {
+                Contact& contact = m_contacts[manifold];
+                contact.entityId1 = entityId1;
+                contact.entityId2 = entityId2;
+                contact.lastUpdate = m_updateCount;
+                this->resolveFilters(contact);
+                this->dispatch(contact, milliseconds, Collision::Begin);
+            }
+            else {
+                iter->second.lastUpdate = m_updateCount;
+                this->dispatch(iter->second, milliseconds, Collision::Persist);
+            }
+        }
+        for (auto iter = m_contacts.begin(); iter != m_contacts.end(); ) {
+            if (iter->second.lastUpdate != m_updateCount) {
+                this->dispatch(iter->second, 0, Collision::End);
+                iter = m_contacts.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+        this->publishStatistics(pairCount);
+    }
+
+    void
+    publishStatistics(
+        size_t pairCount
+    ) {
+        if (m_pairsPerUpdate) {
+            m_pairsPerUpdate->record(pairCount);
+            m_filterCallbackCounter->add(m_filterCallbacks);
+        }
+        m_filterCallbacks = 0;
+    }
+
+    std::unordered_map<const btPersistentManifold*, Contact> m_contacts;
+
+    bool m_eventDriven = false;
+
+    // Filter callbacks since the last publishStatistics()
+    size_t m_filterCallbacks = 0;
+
+    Statistics::Counter* m_filterCallbackCounter = nullptr;
+
+    Statistics::Histogram* m_pairsPerUpdate = nullptr;
+
+    GameState* m_gameState = nullptr;
+
+    unsigned int m_updateCount = 0;
+
+    btDiscreteDynamicsWorld* m_world = nullptr;
 
 };
 
@@ -140,6 +488,7 @@ struct CollisionSystem::Implementation {
 CollisionSystem::CollisionSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -151,6 +500,7 @@ CollisionSystem::luaBindings() {
     using namespace luabind;
     return class_<CollisionSystem, System>("CollisionSystem")
         .def(constructor<>())
+        .def("setEventDriven", &CollisionSystem::setEventDriven)
     ;
 }
 
@@ -160,18 +510,46 @@ CollisionSystem::init(
     GameState* gameState
 ) {
     System::init(gameState);
+    m_impl->m_gameState = gameState;
     m_impl->m_world = gameState->physicsWorld();
+    Statistics& statistics = gameState->engine().statistics();
+    m_impl->m_filterCallbackCounter = &statistics.counter("collision.filterCallbacks");
+    m_impl->m_pairsPerUpdate = &statistics.histogram("collision.pairs");
+    m_impl->m_overlapFilter.m_rejectedPairs = &statistics.counter("collision.rejectedPairs");
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_world->getPairCache()->setOverlapFilterCallback(&m_impl->m_overlapFilter);
+}
+
+
+bool
+CollisionSystem::isEventDriven() const {
+    return m_impl->m_eventDriven;
 }
 
 
 void
 CollisionSystem::shutdown() {
     System::shutdown();
+    m_impl->m_world->getPairCache()->setOverlapFilterCallback(nullptr);
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_overlapFilter.m_groups.clear();
+    m_impl->m_overlapFilter.m_rejectedPairs = nullptr;
+    m_impl->m_areRoutesChanged = true;
+    m_impl->m_contacts.clear();
+    m_impl->m_filterCallbackCounter = nullptr;
+    m_impl->m_gameState = nullptr;
+    m_impl->m_pairsPerUpdate = nullptr;
     m_impl->m_world = nullptr;
 }
 
 void
 CollisionSystem::update(int milliseconds) {
+    // The next step runs with what the groups are now
+    m_impl->updateOverlapFilter();
+    if (m_impl->m_eventDriven) {
+        m_impl->updateContacts(milliseconds);
+        return;
+    }
     auto dispatcher = m_impl->m_world->getDispatcher();
     int numManifolds = dispatcher->getNumManifolds();
 
@@ -191,31 +569,29 @@ CollisionSystem::update(int milliseconds) {
                                         );
         if (collisionComponent1 && collisionComponent2)
         {
-            std::vector<std::string> collisionGroups1 = collisionComponent1->getCollisionGroups();
-            std::vector<std::string> collisionGroups2 = collisionComponent2->getCollisionGroups();
-            std::vector<CollisionFilter::Signature> collisionGroupCombinations(collisionGroups1.size() * collisionGroups2.size());
-            for(std::string collisionGroup1 : collisionGroups1)
+            const size_t groupCount = m_impl->m_routeGroupCount;
+            for (CollisionGroupId group1 : collisionComponent1->getCollisionGroupIds())
             {
-                for(std::string collisionGroup2 : collisionGroups2)
-                {
-                    collisionGroupCombinations.emplace_back(
-                        collisionGroup1,
-                        collisionGroup2
-                    );
+                if (group1 >= groupCount) {
+                    continue;
                 }
-            }
-            for(CollisionFilter::Signature collisionSignature : collisionGroupCombinations)
-            {
-                auto filterIterators = m_impl->m_collisionFilterMap.equal_range(collisionSignature);//Get iterators for group of relevant CollisionFilters
-                for(auto it = filterIterators.first; it != filterIterators.second; ++it)        // Foreach CollisionFilter object
+                for (CollisionGroupId group2 : collisionComponent2->getCollisionGroupIds())
                 {
-                    Collision collision = Collision(entityId1, entityId2, milliseconds);
-                    it->second.addCollision(collision);
+                    if (group2 >= groupCount) {
+                        continue;
+                    }
+                    const auto& filters = m_impl->route(group1, group2);
+                    for (CollisionFilter* filter : filters)
+                    {
+                        filter->addCollision(Collision(entityId1, entityId2, milliseconds));
+                    }
+                    m_impl->m_filterCallbacks += filters.size();
                 }
             }
         }
         contactManifold->clearManifold();
     }
+    m_impl->publishStatistics(numManifolds);
 }
 
 
@@ -223,15 +599,45 @@ void
 CollisionSystem::registerCollisionFilter(
     CollisionFilter& collisionFilter
 ) {
-    m_impl->m_collisionFilterMap.emplace(
-        collisionFilter.getCollisionSignature(),
-        collisionFilter
-    );
+    const CollisionFilter::Signature& signature = collisionFilter.getCollisionSignature();
+    CollisionGroupRegistry& registry = CollisionGroupRegistry::instance();
+    CollisionGroupId group1 = registry.id(signature.first);
+    CollisionGroupId group2 = registry.id(signature.second);
+    m_impl->reserveRoutes(group1, group2);
+    m_impl->route(group1, group2).push_back(&collisionFilter);
+    m_impl->m_areRoutesChanged = true;
 }
 
 void
 CollisionSystem::unregisterCollisionFilter(
     CollisionFilter& collisionFilter
 ) {
-    m_impl->m_collisionFilterMap.erase(collisionFilter.getCollisionSignature());
+    const CollisionFilter::Signature& signature = collisionFilter.getCollisionSignature();
+    CollisionGroupRegistry& registry = CollisionGroupRegistry::instance();
+    CollisionGroupId group1 = registry.id(signature.first);
+    CollisionGroupId group2 = registry.id(signature.second);
+    if (std::max(group1, group2) >= m_impl->m_routeGroupCount) {
+        return;
+    }
+    auto& filters = m_impl->route(group1, group2);
+    filters.erase(std::remove(filters.begin(), filters.end(), &collisionFilter), filters.end());
+    m_impl->m_areRoutesChanged = true;
+    auto removeFilter = [&collisionFilter] (Implementation::Contact& contact) {
+        contact.filters.erase(
+            std::remove(contact.filters.begin(), contact.filters.end(), &collisionFilter),
+            contact.filters.end()
+        );
+    };
+    for (auto& pair : m_impl->m_contacts) {
+        removeFilter(pair.second);
+    }
+}
+
+
+void
+CollisionSystem::setEventDriven(
+    bool eventDriven
+) {
+    m_impl->m_eventDriven = eventDriven;
+    m_impl->m_contacts.clear();
 }
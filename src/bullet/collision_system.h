@@ -16,6 +16,14 @@ namespace thrive {
 
 class CollisionFilter;
 
+/**
+* @brief Interned collision group name
+*
+* Ids are assigned on first use and are only valid for the current process.
+* They are never stored, savegames keep the group names.
+*/
+using CollisionGroupId = uint32_t;
+
 /**
 * @brief A component for a collision reactive entity
 */
@@ -81,6 +89,12 @@ public:
     const std::vector<std::string>&
     getCollisionGroups();
 
+    /**
+    * @brief The interned ids of getCollisionGroups(), in the same order
+    */
+    const std::vector<CollisionGroupId>&
+    getCollisionGroupIds() const;
+
     /**
     * @brief Loads the component
     *
@@ -102,6 +116,8 @@ public:
 
 private:
 
+    std::vector<CollisionGroupId> m_collisionGroupIds;
+
     std::vector<std::string> m_collisionGroups;
 
 };
@@ -109,13 +125,32 @@ private:
 
 struct Collision {
 
+    /**
+    * @brief What happened to the contact, see CollisionSystem::setEventDriven()
+    */
+    enum Event {
+        /**
+        * @brief The entities started touching since the last update
+        */
+        Begin,
+        /**
+        * @brief The entities are still touching
+        */
+        Persist,
+        /**
+        * @brief The entities stopped touching since the last update
+        */
+        End
+    };
+
     /**
     * @brief Constructor
     */
     Collision(
         EntityId entityId1,
         EntityId entityId2,
-        int addedCollisionDuration
+        int addedCollisionDuration,
+        Event event = Persist
     );
 
 
@@ -125,6 +160,9 @@ struct Collision {
     * Exposes:
     * - Collision::entityId1
     * - Collision::entityId2
+    * - Collision::addedCollisionDuration
+    * - Collision::event
+    * - Collision::Begin, Collision::Persist, Collision::End
     *
     * @return
     */
@@ -152,6 +190,13 @@ struct Collision {
     */
     int addedCollisionDuration;
 
+    /**
+    * @brief What happened to the contact
+    *
+    * Without event driven collisions, this is always Persist.
+    */
+    Event event;
+
 };
 
 }//namespace thrive
@@ -181,6 +226,16 @@ namespace std {
 namespace thrive{
 
 
+/**
+* @brief Passes the contacts of colliding entities on to the collision 
+* filters listening to their collision groups
+*
+* Pairs of bodies that don't collide physically, because one of them has
+* no contact response, are rejected in Bullet's broadphase unless a 
+* registered filter listens to their groups. The broadphase learns about
+* changed groups and filters with the next update, and the rejections are
+* counted in the \c collision.rejectedPairs statistic.
+*/
 class CollisionSystem : public System {
 
 public:
@@ -200,6 +255,7 @@ public:
     *
     * Exposes:
     * - CollisionSystem()
+    * - CollisionSystem::setEventDriven()
     *
     * @return
     */
@@ -229,6 +285,12 @@ public:
         int milliSeconds
     ) override;
 
+    /**
+    * @brief Whether contact manifolds are kept and tracked between updates
+    */
+    bool
+    isEventDriven() const;
+
     /**
     * @brief Register a collision filter.
     *
@@ -242,6 +304,26 @@ public:
         CollisionFilter& collisionFilter
     );
 
+    /**
+    * @brief Switches between scanning and event driven collisions
+    *
+    * By default, each update scans all contact manifolds of the physics
+    * world and clears them afterwards. That discards Bullet's persistent
+    * contacts, so the narrowphase has to rebuild them every step.
+    *
+    * Event driven collisions leave the manifolds intact and only track 
+    * the ones with contact points. Each update passes the touching pairs 
+    * on to their filters as Collision::Begin, then Collision::Persist, and
+    * once as Collision::End after they stopped touching. The filters of a
+    * pair are looked up when it starts touching.
+    *
+    * @param eventDriven
+    */
+    void
+    setEventDriven(
+        bool eventDriven
+    );
+
     /**
     * @brief Unregisters a collision filter.
     *
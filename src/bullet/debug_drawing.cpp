@@ -4,11 +4,12 @@
 #include "engine/game_state.h"
 #include "scripting/luabind.h"
 
+#include <algorithm>
 #include <OgreColourValue.h>
-#include <OgreFrameListener.h>
 #include <OgreManualObject.h>
 #include <OgreRoot.h>
 #include <OgreVector3.h>
+#include <vector>
 
 using namespace thrive;
 
@@ -29,7 +30,7 @@ toOgreColour(
     return ogreColour;
 }
 
-struct BulletDebugDrawer::Implementation : public Ogre::FrameListener {
+struct BulletDebugDrawer::Implementation {
 
     struct ContactPoint{
         Ogre::Vector3 from;
@@ -38,6 +39,11 @@ struct BulletDebugDrawer::Implementation : public Ogre::FrameListener {
         size_t dieTime;
     };
 
+    struct Vertex {
+        Ogre::Vector3 position;
+        Ogre::ColourValue colour;
+    };
+
     Implementation()
       : m_lines(new Ogre::ManualObject("physics lines")),
         m_triangles(new Ogre::ManualObject("physics triangles"))
@@ -45,58 +51,35 @@ struct BulletDebugDrawer::Implementation : public Ogre::FrameListener {
         m_lines->setDynamic(true);
         m_triangles->setDynamic(true);
         this->setupMaterial();
-        this->setupLines();
-        this->setupTriangles();
-        Ogre::Root::getSingleton().addFrameListener(this);
-    }
-
-    ~Implementation() {
-        Ogre::Root::getSingleton().removeFrameListener(this);
-    }
-
-    bool
-    frameStarted(
-        const Ogre::FrameEvent&
-    ) override {
-        size_t now = Ogre::Root::getSingleton().getTimer()->getMilliseconds();
-        auto iter = m_contactPoints.begin();
-        while (iter != m_contactPoints.end()) {
-            const ContactPoint& contactPoint = *iter;
-            m_lines->position(contactPoint.from);
-            m_lines->colour(contactPoint.colour);
-            m_lines->position(contactPoint.to);
-            m_lines->colour(contactPoint.colour);
-            if (contactPoint.dieTime <= now) {
-                iter = m_contactPoints.erase(iter);
-            }
-            else {
-                ++iter;
-            }
-        }
-        m_lines->end();
-        m_triangles->end();
-        return true;
-    }
-
-    bool
-    frameEnded(
-        const Ogre::FrameEvent&
-    ) override {
-        m_lines->beginUpdate(0);
-        m_triangles->beginUpdate(0);
-        return true;
-    }
-
-    void
-    setupLines() {
         m_lines->begin(
             MATERIAL_NAME,
             Ogre::RenderOperation::OT_LINE_LIST
         );
-        for (int i = 0; i < 2; ++i) {
-            m_lines->position(Ogre::Vector3::ZERO);
-            m_lines->colour(Ogre::ColourValue::Blue);
+        this->writeVertices(*m_lines, m_lineVertices, 2, m_lineCapacity);
+        m_triangles->begin(
+            MATERIAL_NAME,
+            Ogre::RenderOperation::OT_TRIANGLE_LIST
+        );
+        this->writeVertices(*m_triangles, m_triangleVertices, 3, m_triangleCapacity);
+    }
+
+    void
+    addContactLines() {
+        size_t now = Ogre::Root::getSingleton().getTimer()->getMilliseconds();
+        for (const ContactPoint& contactPoint : m_contactPoints) {
+            m_lineVertices.push_back(Vertex{contactPoint.from, contactPoint.colour});
+            m_lineVertices.push_back(Vertex{contactPoint.to, contactPoint.colour});
         }
+        m_contactPoints.erase(
+            std::remove_if(
+                m_contactPoints.begin(),
+                m_contactPoints.end(),
+                [now] (const ContactPoint& contactPoint) {
+                    return contactPoint.dieTime <= now;
+                }
+            ),
+            m_contactPoints.end()
+        );
     }
 
     void
@@ -115,25 +98,48 @@ struct BulletDebugDrawer::Implementation : public Ogre::FrameListener {
         material->getTechnique(0)->setLightingEnabled(false);
     }
 
+    // Writes the buffered vertices into the manual object's section,
+    // which has to be in begin() or beginUpdate(). The hardware buffer
+    // grows by doubling, so it is only recreated when a frame draws more
+    // than ever before.
     void
-    setupTriangles() {
-        m_triangles->begin(
-            MATERIAL_NAME,
-            Ogre::RenderOperation::OT_TRIANGLE_LIST
-        );
-        for (int i=0; i < 3; ++i) {
-            m_triangles->position(Ogre::Vector3::ZERO);
-            m_triangles->colour(Ogre::ColourValue::Blue);
+    writeVertices(
+        Ogre::ManualObject& object,
+        std::vector<Vertex>& vertices,
+        size_t primitiveSize,
+        size_t& capacity
+    ) {
+        if (vertices.empty()) {
+            // Ogre drops empty sections, keep one degenerate primitive
+            vertices.resize(primitiveSize, Vertex{Ogre::Vector3::ZERO, Ogre::ColourValue::Blue});
+        }
+        if (vertices.size() > capacity) {
+            capacity = std::max(vertices.size(), 2 * capacity);
         }
+        object.estimateVertexCount(capacity);
+        for (const Vertex& vertex : vertices) {
+            object.position(vertex.position);
+            object.colour(vertex.colour);
+        }
+        object.end();
+        vertices.clear();
     }
 
+    std::vector<ContactPoint> m_contactPoints;
+
     DebugDrawModes m_debugModes = DBG_DrawWireframe;
 
+    size_t m_lineCapacity = 0;
+
+    std::vector<Vertex> m_lineVertices;
+
     std::unique_ptr<Ogre::ManualObject> m_lines;
 
-    std::unique_ptr<Ogre::ManualObject> m_triangles;
+    size_t m_triangleCapacity = 0;
 
-    std::list<ContactPoint> m_contactPoints;
+    std::vector<Vertex> m_triangleVertices;
+
+    std::unique_ptr<Ogre::ManualObject> m_triangles;
 };
 
 
@@ -160,10 +166,9 @@ BulletDebugDrawer::drawLine(
     const btVector3& fromColour,
     const btVector3& toColour
 ) {
-    m_impl->m_lines->position(bulletToOgre(from));
-    m_impl->m_lines->colour(toOgreColour(fromColour));
-    m_impl->m_lines->position(bulletToOgre(to));
-    m_impl->m_lines->colour(toOgreColour(toColour));
+    auto& vertices = m_impl->m_lineVertices;
+    vertices.push_back(Implementation::Vertex{bulletToOgre(from), toOgreColour(fromColour)});
+    vertices.push_back(Implementation::Vertex{bulletToOgre(to), toOgreColour(toColour)});
 }
 
 
@@ -187,8 +192,9 @@ BulletDebugDrawer::drawTriangle(
 ) {
     Ogre::ColourValue ogreColour = toOgreColour(colour, alpha);
     for (const btVector3& vertex : {v0, v1, v2}) {
-        m_impl->m_triangles->position(bulletToOgre(vertex));
-        m_impl->m_triangles->colour(ogreColour);
+        m_impl->m_triangleVertices.push_back(
+            Implementation::Vertex{bulletToOgre(vertex), ogreColour}
+        );
     }
 }
 
@@ -228,6 +234,26 @@ BulletDebugDrawer::drawContactPoint(
 }
 
 
+void
+BulletDebugDrawer::flush() {
+    m_impl->addContactLines();
+    m_impl->m_lines->beginUpdate(0);
+    m_impl->writeVertices(
+        *m_impl->m_lines,
+        m_impl->m_lineVertices,
+        2,
+        m_impl->m_lineCapacity
+    );
+    m_impl->m_triangles->beginUpdate(0);
+    m_impl->writeVertices(
+        *m_impl->m_triangles,
+        m_impl->m_triangleVertices,
+        3,
+        m_impl->m_triangleCapacity
+    );
+}
+
+
 void
 BulletDebugDrawer::reportErrorWarning(
     const char *warningString
@@ -269,7 +295,20 @@ luabind::scope
 BulletDebugDrawSystem::luaBindings() {
     using namespace luabind;
     return class_<BulletDebugDrawSystem, System>("BulletDebugDrawSystem")
+        .enum_("DebugMode") [
+            value("NONE", btIDebugDraw::DBG_NoDebug),
+            value("WIREFRAME", btIDebugDraw::DBG_DrawWireframe),
+            value("AABB", btIDebugDraw::DBG_DrawAabb),
+            value("CONTACT_POINTS", btIDebugDraw::DBG_DrawContactPoints),
+            value("CONSTRAINTS", btIDebugDraw::DBG_DrawConstraints),
+            value("CONSTRAINT_LIMITS", btIDebugDraw::DBG_DrawConstraintLimits),
+            value("NORMALS", btIDebugDraw::DBG_DrawNormals),
+            value("FRAMES", btIDebugDraw::DBG_DrawFrames)
+        ]
         .def(constructor<>())
+        .def("debugMode", &BulletDebugDrawSystem::debugMode)
+        .def("setDebugMode", &BulletDebugDrawSystem::setDebugMode)
+        .def("setDebugModeEnabled", &BulletDebugDrawSystem::setDebugModeEnabled)
     ;
 }
 
@@ -278,6 +317,8 @@ struct BulletDebugDrawSystem::Implementation {
 
     std::unique_ptr<BulletDebugDrawer> m_debugDrawer;
 
+    int m_debugMode = btIDebugDraw::DBG_DrawWireframe;
+
     btDynamicsWorld* m_physicsWorld = nullptr;
 
 };
@@ -286,12 +327,19 @@ struct BulletDebugDrawSystem::Implementation {
 BulletDebugDrawSystem::BulletDebugDrawSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
 BulletDebugDrawSystem::~BulletDebugDrawSystem() {}
 
 
+int
+BulletDebugDrawSystem::debugMode() const {
+    return m_impl->m_debugMode;
+}
+
+
 void
 BulletDebugDrawSystem::init(
     GameState* gameState
@@ -301,6 +349,7 @@ BulletDebugDrawSystem::init(
     m_impl->m_debugDrawer.reset(new BulletDebugDrawer(
             gameState->sceneManager()
     ));
+    m_impl->m_debugDrawer->setDebugMode(m_impl->m_debugMode);
     m_impl->m_physicsWorld = gameState->physicsWorld();
     m_impl->m_physicsWorld->setDebugDrawer(
         m_impl->m_debugDrawer.get()
@@ -308,6 +357,31 @@ BulletDebugDrawSystem::init(
 }
 
 
+void
+BulletDebugDrawSystem::setDebugMode(
+    int debugMode
+) {
+    m_impl->m_debugMode = debugMode;
+    if (m_impl->m_debugDrawer) {
+        m_impl->m_debugDrawer->setDebugMode(debugMode);
+    }
+}
+
+
+void
+BulletDebugDrawSystem::setDebugModeEnabled(
+    int debugMode,
+    bool enabled
+) {
+    if (enabled) {
+        this->setDebugMode(m_impl->m_debugMode | debugMode);
+    }
+    else {
+        this->setDebugMode(m_impl->m_debugMode & ~debugMode);
+    }
+}
+
+
 void
 BulletDebugDrawSystem::shutdown() {
     m_impl->m_physicsWorld->setDebugDrawer(nullptr);
@@ -319,6 +393,9 @@ BulletDebugDrawSystem::shutdown() {
 
 void
 BulletDebugDrawSystem::update(int) {
-    m_impl->m_physicsWorld->debugDrawWorld();
+    if (m_impl->m_debugMode != btIDebugDraw::DBG_NoDebug) {
+        m_impl->m_physicsWorld->debugDrawWorld();
+    }
+    m_impl->m_debugDrawer->flush();
 }
 
@@ -13,6 +13,11 @@ namespace thrive {
  
 /**
 * @brief Implementation of Bullet's debug drawing interface
+*
+* Lines and triangles are collected in plain buffers while Bullet draws
+* and copied into two dynamic manual objects once per frame, see flush().
+* The manual objects' hardware buffers are kept between frames and only
+* grow.
 */
 class BulletDebugDrawer: public btIDebugDraw {
 public:
@@ -125,6 +130,15 @@ public:
         const btVector3& colour
     ) override;
 
+    /**
+    * @brief Uploads everything drawn since the last call
+    *
+    * Contact points stay visible for their lifetime, the other lines and
+    * triangles only until the next call.
+    */
+    void
+    flush();
+
     /**
     * @brief Overridden from btIDebugDraw::reportErrorWarning
     *
@@ -183,6 +197,12 @@ public:
     *
     * Exposes:
     * - BulletDebugDrawSystem()
+    * - BulletDebugDrawSystem::debugMode()
+    * - BulletDebugDrawSystem::setDebugMode()
+    * - BulletDebugDrawSystem::setDebugModeEnabled()
+    * - The debug mode flags as \c BulletDebugDrawSystem.NONE, \c WIREFRAME,
+    *   \c AABB, \c CONTACT_POINTS, \c CONSTRAINTS, \c CONSTRAINT_LIMITS,
+    *   \c NORMALS and \c FRAMES
     *
     * @return 
     */
@@ -199,12 +219,50 @@ public:
     */
     ~BulletDebugDrawSystem();
 
+    /**
+    * @brief The categories that are drawn
+    *
+    * A combination of btIDebugDraw::DebugDrawModes flags
+    */
+    int
+    debugMode() const;
+
     /**
     * @brief Initializes the system
     *
     */
     void init(GameState* gameState) override;
 
+    /**
+    * @brief Sets the categories to draw
+    *
+    * Wireframes of all bodies are by far the most lines. For performance
+    * investigations, \c DBG_DrawAabb or \c DBG_DrawContactPoints alone 
+    * stay cheap. With \c DBG_NoDebug, the world isn't traversed at all.
+    *
+    * @param debugMode
+    *   A combination of btIDebugDraw::DebugDrawModes flags. The default is
+    *   \c DBG_DrawWireframe.
+    */
+    void
+    setDebugMode(
+        int debugMode
+    );
+
+    /**
+    * @brief Toggles categories
+    *
+    * @param debugMode
+    *   The btIDebugDraw::DebugDrawModes flags to toggle
+    * @param enabled
+    *   Whether to draw them
+    */
+    void
+    setDebugModeEnabled(
+        int debugMode,
+        bool enabled
+    );
+
     /**
     * @brief Shuts the system down
     */
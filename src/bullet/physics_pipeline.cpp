@@ -0,0 +1,14 @@
+#include "bullet/physics_pipeline.h"
+
+#include "scripting/luabind.h"
+
+using namespace thrive;
+
+
+luabind::scope
+PhysicsPipeline::luaBindings() {
+    using namespace luabind;
+    return class_<PhysicsPipeline, System>("PhysicsPipeline")
+        .def(constructor<>())
+    ;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "bullet/bullet_to_ogre_system.h"
+#include "bullet/rigid_body_system.h"
+#include "bullet/update_physics_system.h"
+#include "engine/system_pipeline.h"
+
+namespace luabind {
+    class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief The rigid body systems and the physics step as one system
+*
+* Replaces a RigidBodyInputSystem, UpdatePhysicsSystem,
+* RigidBodyOutputSystem and BulletToOgreSystem in a row of the system 
+* list, see SystemPipeline. Without GameState::Options::asyncPhysics, 
+* they would run back to back anyway.
+*/
+class PhysicsPipeline : public SystemPipeline<
+    RigidBodyInputSystem,
+    UpdatePhysicsSystem,
+    RigidBodyOutputSystem,
+    BulletToOgreSystem
+> {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - PhysicsPipeline()
+    *
+    * @return 
+    */
+    static luabind::scope
+    luaBindings();
+
+};
+
+}
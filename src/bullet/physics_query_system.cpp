@@ -0,0 +1,428 @@
+#include "bullet/physics_query_system.h"
+
+#include "bullet/bullet_ogre_conversion.h"
+#include "engine/engine.h"
+#include "engine/game_state.h"
+#include "engine/thread_pool.h"
+#include "scripting/luabind.h"
+
+#include <btBulletDynamicsCommon.h>
+#include <cstdint>
+#include <LinearMath/btAabbUtil2.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Queries per job, each tests against all bodies
+const size_t QUERY_GRAIN_SIZE = 16;
+
+} // namespace
+
+
+static unsigned int
+PhysicsQuerySystem_addRay(
+    PhysicsQuerySystem* self,
+    const Ogre::Vector3& from,
+    const Ogre::Vector3& to
+) {
+    return self->addRay(from, to);
+}
+
+
+static unsigned int
+PhysicsQuerySystem_addRays(
+    PhysicsQuerySystem* self,
+    luabind::object froms,
+    luabind::object tos
+) {
+    unsigned int first = 0;
+    for (int i = 1; luabind::type(froms[i]) != LUA_TNIL; ++i) {
+        luabind::object to = tos[i];
+        if (luabind::type(to) == LUA_TNIL) {
+            throw std::invalid_argument("Missing end point for ray");
+        }
+        unsigned int index = self->addRay(
+            luabind::object_cast<Ogre::Vector3>(froms[i]),
+            luabind::object_cast<Ogre::Vector3>(to)
+        );
+        if (i == 1) {
+            first = index;
+        }
+    }
+    return first;
+}
+
+
+static unsigned int
+PhysicsQuerySystem_addSphereOverlaps(
+    PhysicsQuerySystem* self,
+    luabind::object centers,
+    Ogre::Real radius
+) {
+    unsigned int first = 0;
+    bool isFirst = true;
+    for (luabind::iterator iter(centers), end; iter != end; ++iter) {
+        unsigned int index = self->addSphereOverlap(
+            luabind::object_cast<Ogre::Vector3>(*iter),
+            radius
+        );
+        if (isFirst) {
+            first = index;
+            isFirst = false;
+        }
+    }
+    return first;
+}
+
+
+static luabind::object
+PhysicsQuerySystem_overlapEntities(
+    PhysicsQuerySystem* self,
+    unsigned int query,
+    lua_State* L
+) {
+    const auto& results = self->overlapResults();
+    if (query >= results.size()) {
+        throw std::out_of_range("Unknown sphere overlap query");
+    }
+    const auto& entities = self->overlapEntities();
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < results[query].count; ++i) {
+        table[i + 1] = entities[results[query].first + i];
+    }
+    return table;
+}
+
+
+static luabind::object
+PhysicsQuerySystem_rayHits(
+    PhysicsQuerySystem* self,
+    lua_State* L
+) {
+    const auto& results = self->rayResults();
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < results.size(); ++i) {
+        table[i + 1] = results[i].entityId;
+    }
+    return table;
+}
+
+
+static luabind::object
+PhysicsQuerySystem_rayPoints(
+    PhysicsQuerySystem* self,
+    lua_State* L
+) {
+    const auto& results = self->rayResults();
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < results.size(); ++i) {
+        table[i + 1] = results[i].point;
+    }
+    return table;
+}
+
+
+luabind::scope
+PhysicsQuerySystem::luaBindings() {
+    using namespace luabind;
+    return class_<PhysicsQuerySystem, System>("PhysicsQuerySystem")
+        .scope [
+            def("find", &PhysicsQuerySystem::find)
+        ]
+        .def(constructor<>())
+        .def("addRay", &PhysicsQuerySystem::addRay)
+        .def("addRay", &PhysicsQuerySystem_addRay)
+        .def("addRays", &PhysicsQuerySystem_addRays)
+        .def("addSphereOverlap", &PhysicsQuerySystem::addSphereOverlap)
+        .def("addSphereOverlaps", &PhysicsQuerySystem_addSphereOverlaps)
+        .def("overlapEntities", &PhysicsQuerySystem_overlapEntities)
+        .def("rayHits", &PhysicsQuerySystem_rayHits)
+        .def("rayPoints", &PhysicsQuerySystem_rayPoints)
+    ;
+}
+
+
+struct PhysicsQuerySystem::Implementation {
+
+    // A collision object as seen by the queries of one update
+    struct Body {
+
+        btVector3 m_aabbMin;
+
+        btVector3 m_aabbMax;
+
+        btCollisionObject* m_object;
+
+        EntityId m_entityId;
+
+    };
+
+    struct Ray {
+
+        btVector3 m_from;
+
+        btVector3 m_to;
+
+        EntityId m_ignoredEntity;
+
+    };
+
+    struct Sphere {
+
+        btVector3 m_center;
+
+        btScalar m_radius;
+
+    };
+
+    // Copies the bounding boxes of all bodies from the broadphase, so the
+    // queries only read memory that nothing else writes
+    void
+    collectBodies() {
+        m_bodies.clear();
+        const btCollisionObjectArray& objects = m_world->getCollisionObjectArray();
+        for (int i = 0; i < objects.size(); ++i) {
+            btCollisionObject* object = objects[i];
+            const btBroadphaseProxy* proxy = object->getBroadphaseHandle();
+            Body body;
+            if (proxy) {
+                body.m_aabbMin = proxy->m_aabbMin;
+                body.m_aabbMax = proxy->m_aabbMax;
+            }
+            else {
+                object->getCollisionShape()->getAabb(
+                    object->getWorldTransform(),
+                    body.m_aabbMin,
+                    body.m_aabbMax
+                );
+            }
+            body.m_object = object;
+            body.m_entityId = reinterpret_cast<uintptr_t>(object->getUserPointer());
+            m_bodies.push_back(body);
+        }
+    }
+
+    void
+    castRay(
+        const Ray& ray,
+        RayResult& result
+    ) const {
+        btTransform from(btQuaternion::getIdentity(), ray.m_from);
+        btTransform to(btQuaternion::getIdentity(), ray.m_to);
+        btCollisionWorld::ClosestRayResultCallback callback(ray.m_from, ray.m_to);
+        for (const Body& body : m_bodies) {
+            if (body.m_entityId == ray.m_ignoredEntity and ray.m_ignoredEntity != NULL_ENTITY) {
+                continue;
+            }
+            // Only bodies whose box is hit before the closest hit so far
+            btScalar fraction = callback.m_closestHitFraction;
+            btVector3 normal;
+            if (not btRayAabb(ray.m_from, ray.m_to, body.m_aabbMin, body.m_aabbMax, fraction, normal)) {
+                continue;
+            }
+            btCollisionWorld::rayTestSingle(
+                from,
+                to,
+                body.m_object,
+                body.m_object->getCollisionShape(),
+                body.m_object->getWorldTransform(),
+                callback
+            );
+        }
+        result = RayResult();
+        if (callback.hasHit()) {
+            result.entityId = reinterpret_cast<uintptr_t>(
+                callback.m_collisionObject->getUserPointer()
+            );
+            result.fraction = callback.m_closestHitFraction;
+            result.point = bulletToOgre(callback.m_hitPointWorld);
+            result.normal = bulletToOgre(callback.m_hitNormalWorld);
+        }
+    }
+
+    void
+    overlapSphere(
+        const Sphere& sphere,
+        std::vector<EntityId>& entities
+    ) const {
+        entities.clear();
+        btScalar radiusSquared = sphere.m_radius * sphere.m_radius;
+        for (const Body& body : m_bodies) {
+            // Distance from the center to the nearest point of the box
+            btVector3 nearest = sphere.m_center;
+            nearest.setMax(body.m_aabbMin);
+            nearest.setMin(body.m_aabbMax);
+            if (nearest.distance2(sphere.m_center) <= radiusSquared) {
+                entities.push_back(body.m_entityId);
+            }
+        }
+    }
+
+    std::vector<Body> m_bodies;
+
+    std::vector<EntityId> m_overlapEntities;
+
+    std::vector<OverlapResult> m_overlapResults;
+
+    // The entities of each query, reused between updates
+    std::vector<std::vector<EntityId>> m_overlapScratch;
+
+    std::vector<Ray> m_pendingRays;
+
+    std::vector<Sphere> m_pendingSpheres;
+
+    std::vector<Ray> m_rays;
+
+    std::vector<RayResult> m_rayResults;
+
+    std::vector<Sphere> m_spheres;
+
+    btDiscreteDynamicsWorld* m_world = nullptr;
+
+};
+
+
+PhysicsQuerySystem*
+PhysicsQuerySystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<PhysicsQuerySystem>();
+}
+
+
+PhysicsQuerySystem::PhysicsQuerySystem()
+  : m_impl(new Implementation())
+{
+}
+
+
+PhysicsQuerySystem::~PhysicsQuerySystem() {}
+
+
+unsigned int
+PhysicsQuerySystem::addRay(
+    const Ogre::Vector3& from,
+    const Ogre::Vector3& to,
+    EntityId ignoredEntity
+) {
+    Implementation::Ray ray;
+    ray.m_from = ogreToBullet(from);
+    ray.m_to = ogreToBullet(to);
+    ray.m_ignoredEntity = ignoredEntity;
+    m_impl->m_pendingRays.push_back(ray);
+    return m_impl->m_pendingRays.size() - 1;
+}
+
+
+unsigned int
+PhysicsQuerySystem::addSphereOverlap(
+    const Ogre::Vector3& center,
+    Ogre::Real radius
+) {
+    if (radius < 0.0f) {
+        throw std::invalid_argument("Sphere overlap radius must not be negative");
+    }
+    Implementation::Sphere sphere;
+    sphere.m_center = ogreToBullet(center);
+    sphere.m_radius = radius;
+    m_impl->m_pendingSpheres.push_back(sphere);
+    return m_impl->m_pendingSpheres.size() - 1;
+}
+
+
+void
+PhysicsQuerySystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_world = gameState->physicsWorld();
+    if (not m_impl->m_world) {
+        throw std::runtime_error("PhysicsQuerySystem needs a physics world");
+    }
+}
+
+
+const std::vector<EntityId>&
+PhysicsQuerySystem::overlapEntities() const {
+    return m_impl->m_overlapEntities;
+}
+
+
+const std::vector<PhysicsQuerySystem::OverlapResult>&
+PhysicsQuerySystem::overlapResults() const {
+    return m_impl->m_overlapResults;
+}
+
+
+const std::vector<PhysicsQuerySystem::RayResult>&
+PhysicsQuerySystem::rayResults() const {
+    return m_impl->m_rayResults;
+}
+
+
+void
+PhysicsQuerySystem::shutdown() {
+    m_impl->m_bodies.clear();
+    m_impl->m_pendingRays.clear();
+    m_impl->m_pendingSpheres.clear();
+    m_impl->m_rayResults.clear();
+    m_impl->m_overlapResults.clear();
+    m_impl->m_overlapEntities.clear();
+    m_impl->m_world = nullptr;
+    System::shutdown();
+}
+
+
+void
+PhysicsQuerySystem::update(int) {
+    // Queries added from here on go to the next update
+    m_impl->m_rays.swap(m_impl->m_pendingRays);
+    m_impl->m_pendingRays.clear();
+    m_impl->m_spheres.swap(m_impl->m_pendingSpheres);
+    m_impl->m_pendingSpheres.clear();
+    const auto& rays = m_impl->m_rays;
+    const auto& spheres = m_impl->m_spheres;
+    m_impl->m_rayResults.resize(rays.size());
+    if (m_impl->m_overlapScratch.size() < spheres.size()) {
+        m_impl->m_overlapScratch.resize(spheres.size());
+    }
+    if (rays.empty() and spheres.empty()) {
+        m_impl->m_overlapResults.clear();
+        m_impl->m_overlapEntities.clear();
+        return;
+    }
+    m_impl->collectBodies();
+    // Rays and spheres share one index range, rays first
+    Implementation* impl = m_impl.get();
+    this->engine()->threadPool().parallelFor(
+        rays.size() + spheres.size(),
+        QUERY_GRAIN_SIZE,
+        [impl, &rays, &spheres] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (i < rays.size()) {
+                    impl->castRay(rays[i], impl->m_rayResults[i]);
+                }
+                else {
+                    size_t sphere = i - rays.size();
+                    impl->overlapSphere(spheres[sphere], impl->m_overlapScratch[sphere]);
+                }
+            }
+        }
+    );
+    // Flatten the overlaps in query order
+    m_impl->m_overlapResults.resize(spheres.size());
+    m_impl->m_overlapEntities.clear();
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        const std::vector<EntityId>& entities = m_impl->m_overlapScratch[i];
+        OverlapResult& result = m_impl->m_overlapResults[i];
+        result.first = m_impl->m_overlapEntities.size();
+        result.count = entities.size();
+        m_impl->m_overlapEntities.insert(
+            m_impl->m_overlapEntities.end(),
+            entities.begin(),
+            entities.end()
+        );
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <OgreVector3.h>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Runs batches of ray casts and sphere overlap queries
+*
+* Systems and scripts submit queries with addRay() and addSphereOverlap()
+* (or addRays() and addSphereOverlaps() from Lua) at any time during a
+* frame. The next update runs all of them in parallel against the physics
+* world and keeps the results until the update after. So systems after this
+* one read results in the same frame, and those before it, such as the AI,
+* in the next frame.
+*
+* The system should come after UpdatePhysicsSystem, so that queries see
+* the simulation's latest state.
+*
+* Sphere overlaps test against the bounding boxes of the bodies, which is
+* exact enough for perception. Rays test against the actual shapes.
+*/
+class PhysicsQuerySystem : public System {
+
+public:
+
+    /**
+    * @brief The result of a ray cast
+    */
+    struct RayResult {
+
+        /**
+        * @brief The first entity hit, or \c NULL_ENTITY
+        */
+        EntityId entityId = NULL_ENTITY;
+
+        /**
+        * @brief How far along the ray the hit is, from 0 to 1
+        */
+        Ogre::Real fraction = 1.0f;
+
+        /**
+        * @brief The hit point
+        */
+        Ogre::Vector3 point = Ogre::Vector3::ZERO;
+
+        /**
+        * @brief The surface normal at the hit point
+        */
+        Ogre::Vector3 normal = Ogre::Vector3::ZERO;
+
+    };
+
+    /**
+    * @brief The range of a sphere overlap's entities in overlapEntities()
+    */
+    struct OverlapResult {
+
+        size_t first = 0;
+
+        size_t count = 0;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - PhysicsQuerySystem()
+    * - PhysicsQuerySystem::find
+    * - PhysicsQuerySystem::addRay
+    * - PhysicsQuerySystem::addSphereOverlap
+    * - <tt>addRays(froms, tos)</tt>: Adds a ray per pair of the tables'
+    *   Vector3, returns the index of the first
+    * - <tt>addSphereOverlaps(centers, radius)</tt>: Adds a sphere per
+    *   Vector3 of the table, returns the index of the first
+    * - PhysicsQuerySystem::rayResults() (as <tt>rayHits()</tt>): Returns a
+    *   table of the hit entity ids, \c 0 for those that didn't hit
+    * - <tt>rayPoints()</tt>: Returns a table of the hit points
+    * - <tt>overlapEntities(query)</tt>: Returns a table of the entity ids
+    *   of one sphere overlap
+    *
+    * Query indices start at 0 in C++ and at 1 in the returned tables.
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Finds the physics query system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's query system or \c nullptr if it has none
+    */
+    static PhysicsQuerySystem*
+    find(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Constructor
+    */
+    PhysicsQuerySystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~PhysicsQuerySystem();
+
+    /**
+    * @brief Adds a ray cast for the next update
+    *
+    * @param from
+    *   The start of the ray
+    * @param to
+    *   The end of the ray
+    * @param ignoredEntity
+    *   An entity the ray passes through, usually the one casting it
+    *
+    * @return
+    *   The ray's index into rayResults() after the next update
+    */
+    unsigned int
+    addRay(
+        const Ogre::Vector3& from,
+        const Ogre::Vector3& to,
+        EntityId ignoredEntity = NULL_ENTITY
+    );
+
+    /**
+    * @brief Adds a sphere overlap query for the next update
+    *
+    * @param center
+    *   The center of the sphere
+    * @param radius
+    *   The radius of the sphere
+    *
+    * @return
+    *   The query's index into overlapResults() after the next update
+    */
+    unsigned int
+    addSphereOverlap(
+        const Ogre::Vector3& center,
+        Ogre::Real radius
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief The entities of all sphere overlaps of the last update
+    *
+    * Use overlapResults() to find those of a query.
+    */
+    const std::vector<EntityId>&
+    overlapEntities() const;
+
+    /**
+    * @brief The sphere overlaps of the last update, by query index
+    */
+    const std::vector<OverlapResult>&
+    overlapResults() const;
+
+    /**
+    * @brief The ray casts of the last update, by query index
+    */
+    const std::vector<RayResult>&
+    rayResults() const;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Runs the queries added since the last update
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -1,13 +1,21 @@
 #include "bullet/rigid_body_system.h"
 
 #include "bullet/bullet_ogre_conversion.h"
+#include "bullet/update_physics_system.h"
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "ogre/transform_buffer.h"
 #include "scripting/luabind.h"
 #include "engine/serialization.h"
+#include "engine/state_hash.h"
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <unordered_set>
 
 using namespace thrive;
 
@@ -30,21 +38,48 @@ RigidBodyComponent::setDynamicProperties(
     m_dynamicProperties.touch();
 }
 
+void
+RigidBodyComponent::applyCentralForce(
+    const Ogre::Vector3& force
+) {
+    m_force += force;
+}
+
+
 void
 RigidBodyComponent::applyCentralImpulse(
     const Ogre::Vector3& impulse
 ) {
-    this->applyImpulse(impulse, Ogre::Vector3::ZERO);
+    m_impulse += impulse;
+}
+
+
+void
+RigidBodyComponent::applyForce(
+    const Ogre::Vector3& force,
+    const Ogre::Vector3& relativePosition
+) {
+    m_force += force;
+    m_torque += relativePosition.crossProduct(force * this->linearFactor());
 }
 
+
 void
 RigidBodyComponent::applyImpulse(
     const Ogre::Vector3& impulse,
     const Ogre::Vector3& relativePosition
 ) {
-    m_impulseQueue.push_back(
-        std::make_pair(impulse, relativePosition)
-    );
+    m_impulse += impulse;
+    m_torqueImpulse += relativePosition.crossProduct(impulse * this->linearFactor());
+}
+
+
+Ogre::Vector3
+RigidBodyComponent::linearFactor() const {
+    if (m_body) {
+        return bulletToOgre(m_body->getLinearFactor());
+    }
+    return m_properties->linearFactor;
 }
 
 
@@ -55,6 +90,48 @@ RigidBodyComponent::applyTorque(
     m_torque += torque;
 }
 
+namespace {
+
+void
+RigidBodyComponent_applyCentralImpulses(
+    RigidBodyComponent* self,
+    luabind::object impulses
+) {
+    for (luabind::iterator iter(impulses), end; iter != end; ++iter) {
+        self->applyCentralImpulse(luabind::object_cast<Ogre::Vector3>(*iter));
+    }
+}
+
+
+RigidBodyComponent::Properties&
+RigidBodyComponent_getProperties(
+    RigidBodyComponent* self
+) {
+    return *self->m_properties;
+}
+
+
+void
+RigidBodyComponent_applyImpulses(
+    RigidBodyComponent* self,
+    luabind::object impulses,
+    luabind::object relativePositions
+) {
+    for (int i = 1; luabind::type(impulses[i]) != LUA_TNIL; ++i) {
+        luabind::object relativePosition = relativePositions[i];
+        if (luabind::type(relativePosition) == LUA_TNIL) {
+            throw std::invalid_argument("Missing relative position for impulse");
+        }
+        self->applyImpulse(
+            luabind::object_cast<Ogre::Vector3>(impulses[i]),
+            luabind::object_cast<Ogre::Vector3>(relativePosition)
+        );
+    }
+}
+
+}
+
+
 luabind::scope
 RigidBodyComponent::luaBindings() {
     using namespace luabind;
@@ -62,9 +139,33 @@ RigidBodyComponent::luaBindings() {
         .enum_("ID") [
             value("TYPE_ID", RigidBodyComponent::TYPE_ID)
         ]
+        .enum_("StagedField") [
+            value("ANGULAR_DAMPING_FIELD", RigidBodyComponent::ANGULAR_DAMPING_FIELD),
+            value("ANGULAR_FACTOR_FIELD", RigidBodyComponent::ANGULAR_FACTOR_FIELD),
+            value("ANGULAR_VELOCITY_FIELD", RigidBodyComponent::ANGULAR_VELOCITY_FIELD),
+            value("FRICTION_FIELD", RigidBodyComponent::FRICTION_FIELD),
+            value("LINEAR_DAMPING_FIELD", RigidBodyComponent::LINEAR_DAMPING_FIELD),
+            value("LINEAR_FACTOR_FIELD", RigidBodyComponent::LINEAR_FACTOR_FIELD),
+            value("LINEAR_VELOCITY_FIELD", RigidBodyComponent::LINEAR_VELOCITY_FIELD),
+            value("MASS_FIELD", RigidBodyComponent::MASS_FIELD),
+            value("RESTITUTION_FIELD", RigidBodyComponent::RESTITUTION_FIELD)
+        ]
         .scope [
             def("TYPE_NAME", &RigidBodyComponent::TYPE_NAME),
             class_<Properties, Touchable>("Properties")
+                .enum_("Field") [
+                    value("SHAPE", Properties::SHAPE),
+                    value("RESTITUTION", Properties::RESTITUTION),
+                    value("LINEAR_FACTOR", Properties::LINEAR_FACTOR),
+                    value("ANGULAR_FACTOR", Properties::ANGULAR_FACTOR),
+                    value("MASS", Properties::MASS),
+                    value("FRICTION", Properties::FRICTION),
+                    value("DAMPING", Properties::DAMPING),
+                    value("ROLLING_FRICTION", Properties::ROLLING_FRICTION),
+                    value("CONTACT_RESPONSE", Properties::CONTACT_RESPONSE),
+                    value("KINEMATIC", Properties::KINEMATIC),
+                    value("SIMPLIFIED_SHAPE", Properties::SIMPLIFIED_SHAPE)
+                ]
                 .def_readwrite("shape", &Properties::shape)
                 .def_readwrite("restitution", &Properties::restitution)
                 .def_readwrite("linearFactor", &Properties::linearFactor)
@@ -76,13 +177,18 @@ RigidBodyComponent::luaBindings() {
                 .def_readwrite("rollingFriction", &Properties::rollingFriction)
                 .def_readwrite("hasContactResponse", &Properties::hasContactResponse)
                 .def_readwrite("kinematic", &Properties::kinematic)
+                .def_readwrite("isShapeSimplified", &Properties::isShapeSimplified)
         ]
         .def(constructor<>())
         .def("setDynamicProperties", &RigidBodyComponent::setDynamicProperties)
-        .def("applyImpulse", &RigidBodyComponent::applyImpulse)
+        .def("applyCentralForce", &RigidBodyComponent::applyCentralForce)
         .def("applyCentralImpulse", &RigidBodyComponent::applyCentralImpulse)
+        .def("applyCentralImpulses", RigidBodyComponent_applyCentralImpulses)
+        .def("applyForce", &RigidBodyComponent::applyForce)
+        .def("applyImpulse", &RigidBodyComponent::applyImpulse)
+        .def("applyImpulses", RigidBodyComponent_applyImpulses)
         .def("applyTorque", &RigidBodyComponent::applyTorque)
-        .def_readonly("properties", &RigidBodyComponent::m_properties)
+        .property("properties", RigidBodyComponent_getProperties)
     ;
 }
 
@@ -101,29 +207,85 @@ RigidBodyComponent::getWorldTransform(
 }
 
 
+namespace {
+
+const StorageKey ACTIVATION_STATE_KEY("activationState");
+const StorageKey ANGULAR_DAMPING_KEY("angularDamping");
+const StorageKey ANGULAR_FACTOR_KEY("angularFactor");
+const StorageKey ANGULAR_VELOCITY_KEY("angularVelocity");
+const StorageKey DEACTIVATION_TIME_KEY("deactivationTime");
+const StorageKey FRICTION_KEY("friction");
+const StorageKey HAS_CONTACT_RESPONSE_KEY("hasContactResponse");
+const StorageKey KINEMATIC_KEY("kinematic");
+const StorageKey LINEAR_DAMPING_KEY("linearDamping");
+const StorageKey LINEAR_FACTOR_KEY("linearFactor");
+const StorageKey LINEAR_VELOCITY_KEY("linearVelocity");
+const StorageKey LOCAL_INERTIA_KEY("localInertia");
+const StorageKey MASS_KEY("mass");
+const StorageKey POSITION_KEY("position");
+const StorageKey RESTITUTION_KEY("restitution");
+const StorageKey ROLLING_FRICTION_KEY("rollingFriction");
+const StorageKey ROTATION_KEY("rotation");
+const StorageKey SHAPE_KEY("shape");
+
+}
+
+
+void
+RigidBodyComponent::digest(
+    StateDigest& digest
+) const {
+    digest.add(m_dynamicProperties.position)
+        .add(m_dynamicProperties.rotation);
+}
+
+
 void
 RigidBodyComponent::load(
     const StorageContainer& storage
 ) {
     Component::load(storage);
     // Static
-    m_properties.shape = CollisionShape::load(storage.get<StorageContainer>("shape", StorageContainer()));
-    m_properties.restitution = storage.get<btScalar>("restitution", 0.0f);
-    m_properties.linearFactor = storage.get<Ogre::Vector3>("linearFactor", Ogre::Vector3(1,1,1));
-    m_properties.angularFactor = storage.get<Ogre::Vector3>("angularFactor", Ogre::Vector3(1,1,1));
-    m_properties.mass = storage.get<btScalar>("mass", 1.0f);
-    m_properties.friction = storage.get<btScalar>("friction", 0.0f);
-    m_properties.linearDamping = storage.get<btScalar>("linearDamping", 0.0f);
-    m_properties.angularDamping = storage.get<btScalar>("angularDamping", 0.0f);
-    m_properties.rollingFriction = storage.get<btScalar>("rollingFriction", 0.0f);
-    m_properties.hasContactResponse = storage.get<bool>("hasContactResponse", true);
-    m_properties.kinematic = storage.get<bool>("kinematic", false);
-    m_properties.touch();
+    m_properties->shape = CollisionShapeTable::load(storage.get<StorageContainer>(SHAPE_KEY, StorageContainer()));
+    m_properties->restitution = storage.get<btScalar>(RESTITUTION_KEY, 0.0f);
+    m_properties->linearFactor = storage.get<Ogre::Vector3>(LINEAR_FACTOR_KEY, Ogre::Vector3(1,1,1));
+    m_properties->angularFactor = storage.get<Ogre::Vector3>(ANGULAR_FACTOR_KEY, Ogre::Vector3(1,1,1));
+    m_properties->mass = storage.get<btScalar>(MASS_KEY, 1.0f);
+    m_properties->friction = storage.get<btScalar>(FRICTION_KEY, 0.0f);
+    m_properties->linearDamping = storage.get<btScalar>(LINEAR_DAMPING_KEY, 0.0f);
+    m_properties->angularDamping = storage.get<btScalar>(ANGULAR_DAMPING_KEY, 0.0f);
+    m_properties->rollingFriction = storage.get<btScalar>(ROLLING_FRICTION_KEY, 0.0f);
+    m_properties->hasContactResponse = storage.get<bool>(HAS_CONTACT_RESPONSE_KEY, true);
+    m_properties->kinematic = storage.get<bool>(KINEMATIC_KEY, false);
+    m_properties->touch();
     // Dynamic
-    m_dynamicProperties.position = storage.get<Ogre::Vector3>("position", Ogre::Vector3::ZERO);
-    m_dynamicProperties.rotation = storage.get<Ogre::Quaternion>("rotation", Ogre::Quaternion::IDENTITY);
-    m_dynamicProperties.linearVelocity = storage.get<Ogre::Vector3>("linearVelocity", Ogre::Vector3::ZERO);
-    m_dynamicProperties.angularVelocity = storage.get<Ogre::Vector3>("angularVelocity", Ogre::Vector3::ZERO);
+    m_dynamicProperties.position = storage.get<Ogre::Vector3>(POSITION_KEY, Ogre::Vector3::ZERO);
+    m_dynamicProperties.rotation = storage.get<Ogre::Quaternion>(ROTATION_KEY, Ogre::Quaternion::IDENTITY);
+    m_dynamicProperties.linearVelocity = storage.get<Ogre::Vector3>(LINEAR_VELOCITY_KEY, Ogre::Vector3::ZERO);
+    m_dynamicProperties.angularVelocity = storage.get<Ogre::Vector3>(ANGULAR_VELOCITY_KEY, Ogre::Vector3::ZERO);
+    // Bullet's own state, missing in older savegames
+    m_savedBodyState.isValid = storage.contains<int32_t>(ACTIVATION_STATE_KEY);
+    if (m_savedBodyState.isValid) {
+        m_savedBodyState.activationState = storage.get<int32_t>(ACTIVATION_STATE_KEY);
+        m_savedBodyState.deactivationTime = storage.get<btScalar>(DEACTIVATION_TIME_KEY, 0.0f);
+        m_savedBodyState.localInertia = storage.get<Ogre::Vector3>(LOCAL_INERTIA_KEY, Ogre::Vector3::ZERO);
+    }
+}
+
+
+void
+RigidBodyComponent::referenceShapes(
+    StorageList& rows,
+    CollisionShapeTable& shapes
+) {
+    for (StorageContainer& row : rows) {
+        if (row.contains<StorageContainer>(SHAPE_KEY)) {
+            row.set<StorageContainer>(
+                SHAPE_KEY,
+                shapes.reference(row.get<StorageContainer>(SHAPE_KEY))
+            );
+        }
+    }
 }
 
 
@@ -131,8 +293,40 @@ void
 RigidBodyComponent::setWorldTransform(
     const btTransform& transform
 ) {
-    m_dynamicProperties.position = bulletToOgre(transform.getOrigin());
-    m_dynamicProperties.rotation = bulletToOgre(transform.getRotation());
+    Ogre::Quaternion rotation = bulletToOgre(transform.getRotation());
+    Ogre::Vector3 position = bulletToOgre(transform.getOrigin());
+    if (m_stepTransforms) {
+        // Scripts may read the dynamic properties while the step runs
+        m_stepTransforms->push_back(StepTransform{this, rotation, position});
+    }
+    else {
+        this->applyWorldTransform(rotation, position);
+    }
+}
+
+
+void
+RigidBodyComponent::applyWorldTransform(
+    const Ogre::Quaternion& rotation,
+    const Ogre::Vector3& position
+) {
+    m_dynamicProperties.position = position;
+    m_dynamicProperties.rotation = rotation;
+    if (m_movedEntities) {
+        m_movedEntities->push_back(this->owner());
+    }
+    if (m_transformBuffer) {
+        bool isValid = m_transformBuffer->set(
+            m_transformSlot,
+            this->owner(),
+            m_dynamicProperties.rotation,
+            m_dynamicProperties.position
+        );
+        if (not isValid) {
+            // The scene node is gone
+            m_transformBuffer = nullptr;
+        }
+    }
 }
 
 
@@ -140,26 +334,126 @@ StorageContainer
 RigidBodyComponent::storage() const {
     StorageContainer storage = Component::storage();
     // Static
-    storage.set<StorageContainer>("shape", m_properties.shape->storage());
-    storage.set<Ogre::Vector3>("linearFactor", m_properties.linearFactor);
-    storage.set<Ogre::Vector3>("angularFactor", m_properties.angularFactor);
-    storage.set<btScalar>("mass", m_properties.mass);
-    storage.set<btScalar>("friction", m_properties.friction);
-    storage.set<btScalar>("linearDamping", m_properties.linearDamping);
-    storage.set<btScalar>("angularDamping", m_properties.angularDamping);
-    storage.set<btScalar>("rollingFriction", m_properties.rollingFriction);
-    storage.set<bool>("hasContactResponse", m_properties.hasContactResponse);
-    storage.set<bool>("kinematic", m_properties.kinematic);
+    storage.set<StorageContainer>(SHAPE_KEY, m_properties->shape->storage());
+    storage.set<Ogre::Vector3>(LINEAR_FACTOR_KEY, m_properties->linearFactor);
+    storage.set<Ogre::Vector3>(ANGULAR_FACTOR_KEY, m_properties->angularFactor);
+    storage.set<btScalar>(MASS_KEY, m_properties->mass);
+    storage.set<btScalar>(FRICTION_KEY, m_properties->friction);
+    storage.set<btScalar>(LINEAR_DAMPING_KEY, m_properties->linearDamping);
+    storage.set<btScalar>(ANGULAR_DAMPING_KEY, m_properties->angularDamping);
+    storage.set<btScalar>(ROLLING_FRICTION_KEY, m_properties->rollingFriction);
+    storage.set<bool>(HAS_CONTACT_RESPONSE_KEY, m_properties->hasContactResponse);
+    storage.set<bool>(KINEMATIC_KEY, m_properties->kinematic);
     // Dynamic
-    storage.set<Ogre::Vector3>("position", m_dynamicProperties.position);
-    storage.set<Ogre::Quaternion>("rotation", m_dynamicProperties.rotation);
-    storage.set<Ogre::Vector3>("linearVelocity", m_dynamicProperties.linearVelocity);
-    storage.set<Ogre::Vector3>("angularVelocity", m_dynamicProperties.angularVelocity);
+    storage.set<Ogre::Vector3>(POSITION_KEY, m_dynamicProperties.position);
+    storage.set<Ogre::Quaternion>(ROTATION_KEY, m_dynamicProperties.rotation);
+    storage.set<Ogre::Vector3>(LINEAR_VELOCITY_KEY, m_dynamicProperties.linearVelocity);
+    storage.set<Ogre::Vector3>(ANGULAR_VELOCITY_KEY, m_dynamicProperties.angularVelocity);
+    if (m_body) {
+        storage.set<int32_t>(ACTIVATION_STATE_KEY, m_body->getActivationState());
+        storage.set<btScalar>(DEACTIVATION_TIME_KEY, m_body->getDeactivationTime());
+        const btVector3& inverseInertia = m_body->getInvInertiaDiagLocal();
+        Ogre::Vector3 localInertia;
+        for (int i = 0; i < 3; ++i) {
+            localInertia[i] = inverseInertia[i] != 0.0f ? 1.0f / inverseInertia[i] : 0.0f;
+        }
+        storage.set<Ogre::Vector3>(LOCAL_INERTIA_KEY, localInertia);
+    }
     return storage;
 }
 
 REGISTER_COMPONENT(RigidBodyComponent)
 
+const StagedWrites::FieldId RigidBodyComponent::ANGULAR_DAMPING_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Real>(
+        "RigidBody.angularDamping",
+        [] (RigidBodyComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_properties->angularDamping = value;
+            return *component.m_properties;
+        },
+        Properties::DAMPING
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::ANGULAR_FACTOR_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Vector3>(
+        "RigidBody.angularFactor",
+        [] (RigidBodyComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_properties->angularFactor = value;
+            return *component.m_properties;
+        },
+        Properties::ANGULAR_FACTOR
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::ANGULAR_VELOCITY_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Vector3>(
+        "RigidBody.angularVelocity",
+        [] (RigidBodyComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_dynamicProperties.angularVelocity = value;
+            return component.m_dynamicProperties;
+        },
+        DynamicProperties::ANGULAR_VELOCITY
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::FRICTION_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Real>(
+        "RigidBody.friction",
+        [] (RigidBodyComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_properties->friction = value;
+            return *component.m_properties;
+        },
+        Properties::FRICTION
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::LINEAR_DAMPING_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Real>(
+        "RigidBody.linearDamping",
+        [] (RigidBodyComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_properties->linearDamping = value;
+            return *component.m_properties;
+        },
+        Properties::DAMPING
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::LINEAR_FACTOR_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Vector3>(
+        "RigidBody.linearFactor",
+        [] (RigidBodyComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_properties->linearFactor = value;
+            return *component.m_properties;
+        },
+        Properties::LINEAR_FACTOR
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::LINEAR_VELOCITY_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Vector3>(
+        "RigidBody.linearVelocity",
+        [] (RigidBodyComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_dynamicProperties.linearVelocity = value;
+            return component.m_dynamicProperties;
+        },
+        DynamicProperties::LINEAR_VELOCITY
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::MASS_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Real>(
+        "RigidBody.mass",
+        [] (RigidBodyComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_properties->mass = value;
+            return *component.m_properties;
+        },
+        Properties::MASS
+    );
+
+const StagedWrites::FieldId RigidBodyComponent::RESTITUTION_FIELD =
+    StagedWrites::registerField<RigidBodyComponent, Ogre::Real>(
+        "RigidBody.restitution",
+        [] (RigidBodyComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_properties->restitution = value;
+            return *component.m_properties;
+        },
+        Properties::RESTITUTION
+    );
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // RigidBodyInputSystem
@@ -176,12 +470,53 @@ RigidBodyInputSystem::luaBindings() {
 
 struct RigidBodyInputSystem::Implementation {
 
+    // The shape the body collides with, see Properties::isShapeSimplified
+    btCollisionShape*
+    collisionShape(
+        RigidBodyComponent* rigidBodyComponent
+    ) {
+        const auto& properties = *rigidBodyComponent->m_properties;
+        btCollisionShape* shape = properties.shape->bulletShape();
+        bool isSimplifiable = shape->isCompound() and
+            static_cast<btCompoundShape*>(shape)->getNumChildShapes() > 1;
+        if (not properties.isShapeSimplified or not isSimplifiable) {
+            rigidBodyComponent->m_boundingShape.reset();
+            return shape;
+        }
+        if (not rigidBodyComponent->m_boundingShape) {
+            rigidBodyComponent->m_boundingShape = properties.shape->createBoundingShape();
+        }
+        return rigidBodyComponent->m_boundingShape.get();
+    }
+
     EntityFilter<
         RigidBodyComponent
     > m_entities = {true};
 
     std::unordered_map<EntityId, std::unique_ptr<btRigidBody>> m_bodies;
 
+    ComponentCollection* m_collection = nullptr;
+
+    // Entities whose bodies were created in the current update
+    std::unordered_set<EntityId> m_createdEntities;
+
+    std::vector<EntityId> m_movedEntities;
+
+    // Size of m_movedEntities when duplicates were last removed
+    size_t m_uniqueMovedEntities = 0;
+
+    // Whether bodies are locked to the x/y plane, see 
+    // GameState::Options::planarPhysics
+    bool m_isPlanar = false;
+
+    // Only set with GameState::Options::asyncPhysics
+    UpdatePhysicsSystem* m_physicsSystem = nullptr;
+
+    // Transforms reported by the last asynchronous step
+    std::vector<RigidBodyComponent::StepTransform> m_stepTransforms;
+
+    std::vector<Component*> m_touched;
+
     btDiscreteDynamicsWorld* m_world = nullptr;
 
 };
@@ -190,6 +525,7 @@ struct RigidBodyInputSystem::Implementation {
 RigidBodyInputSystem::RigidBodyInputSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -203,12 +539,50 @@ RigidBodyInputSystem::init(
     System::init(gameState);
     assert(m_impl->m_world == nullptr && "Double init of system");
     m_impl->m_world = gameState->physicsWorld();
+    m_impl->m_isPlanar = gameState->isPhysicsPlanar();
+    if (gameState->isPhysicsAsync()) {
+        m_impl->m_physicsSystem = gameState->findSystem<UpdatePhysicsSystem>();
+    }
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        RigidBodyComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
+}
+
+
+const std::vector<EntityId>&
+RigidBodyInputSystem::movedEntities() {
+    auto& movedEntities = m_impl->m_movedEntities;
+    if (movedEntities.size() != m_impl->m_uniqueMovedEntities) {
+        // A body teleported by a script is reported again by the simulation
+        std::sort(movedEntities.begin(), movedEntities.end());
+        movedEntities.erase(
+            std::unique(movedEntities.begin(), movedEntities.end()),
+            movedEntities.end()
+        );
+        m_impl->m_uniqueMovedEntities = movedEntities.size();
+    }
+    return movedEntities;
 }
 
 
 void
 RigidBodyInputSystem::shutdown() {
+    try {
+        this->synchronize();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error in physics step during shutdown: " << e.what() << std::endl;
+    }
+    for (const auto& value : m_impl->m_entities) {
+        std::get<0>(value.second)->m_movedEntities = nullptr;
+        std::get<0>(value.second)->m_stepTransforms = nullptr;
+    }
+    m_impl->m_physicsSystem = nullptr;
+    m_impl->m_movedEntities.clear();
+    m_impl->m_uniqueMovedEntities = 0;
+    m_impl->m_collection = nullptr;
     m_impl->m_entities.setEntityManager(nullptr);
     m_impl->m_world = nullptr;
     System::shutdown();
@@ -216,45 +590,113 @@ RigidBodyInputSystem::shutdown() {
 
 
 void
-RigidBodyInputSystem::update(int milliseconds) {
-    for (EntityId entityId : m_impl->m_entities.removedEntities()) {
-        btRigidBody* body = m_impl->m_bodies[entityId].get();
-        if (body) {
-            m_impl->m_world->removeRigidBody(body);
-        }
-        m_impl->m_bodies.erase(entityId);
+RigidBodyInputSystem::synchronize() {
+    if (not m_impl->m_physicsSystem) {
+        return;
     }
-    for (const auto& added : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = added.first;
-        RigidBodyComponent* rigidBodyComponent = std::get<0>(added.second);
-        auto& properties = rigidBodyComponent->m_properties;
-        btVector3 localInertia;
-        properties.shape->bulletShape()->calculateLocalInertia(
-            properties.mass,
-            localInertia
-        );
-        btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(
-            properties.mass,
-            rigidBodyComponent,
-            properties.shape->bulletShape(),
-            localInertia
+    m_impl->m_physicsSystem->waitForStep();
+    for (const auto& stepTransform : m_impl->m_stepTransforms) {
+        stepTransform.component->applyWorldTransform(
+            stepTransform.rotation,
+            stepTransform.position
         );
-        std::unique_ptr<btRigidBody> rigidBody(new btRigidBody(rigidBodyCI));
-        rigidBody->setUserPointer(reinterpret_cast<void*>(entityId));
-        rigidBodyComponent->m_body = rigidBody.get();
-        m_impl->m_world->addRigidBody(
-            rigidBody.get(),
-            rigidBodyComponent->m_collisionFilterGroup,
-            rigidBodyComponent->m_collisionFilterMask
-        );
-        m_impl->m_bodies[entityId] = std::move(rigidBody);
     }
-    m_impl->m_entities.clearChanges();
-    for (const auto& value : m_impl->m_entities) {
-        RigidBodyComponent* rigidBodyComponent = std::get<0>(value.second);
+    m_impl->m_stepTransforms.clear();
+}
+
+
+void
+RigidBodyInputSystem::update(int milliseconds) {
+    // The world can't change while a step runs
+    this->synchronize();
+    this->entityManager()->stagedWrites().flush(
+        *this->entityManager(),
+        RigidBodyComponent::TYPE_ID
+    );
+    m_impl->m_createdEntities.clear();
+    m_impl->m_movedEntities.clear();
+    m_impl->m_uniqueMovedEntities = 0;
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<RigidBodyComponent*>& group) {
+            RigidBodyComponent* rigidBodyComponent = std::get<0>(group);
+            auto& properties = *rigidBodyComponent->m_properties;
+            btVector3 localInertia;
+            if (rigidBodyComponent->m_savedBodyState.isValid) {
+                // Compound shapes are expensive to integrate
+                localInertia = ogreToBullet(rigidBodyComponent->m_savedBodyState.localInertia);
+            }
+            else {
+                properties.shape->bulletShape()->calculateLocalInertia(
+                    properties.mass,
+                    localInertia
+                );
+            }
+            btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(
+                properties.mass,
+                rigidBodyComponent,
+                m_impl->collisionShape(rigidBodyComponent),
+                localInertia
+            );
+            std::unique_ptr<btRigidBody> rigidBody(new btRigidBody(rigidBodyCI));
+            rigidBody->setUserPointer(reinterpret_cast<void*>(entityId));
+            if (m_impl->m_isPlanar) {
+                rigidBody->setLinearFactor(btVector3(1, 1, 0));
+                rigidBody->setAngularFactor(btVector3(0, 0, 1));
+            }
+            rigidBodyComponent->m_body = rigidBody.get();
+            rigidBodyComponent->m_movedEntities = &m_impl->m_movedEntities;
+            if (m_impl->m_physicsSystem) {
+                rigidBodyComponent->m_stepTransforms = &m_impl->m_stepTransforms;
+            }
+            m_impl->m_world->addRigidBody(
+                rigidBody.get(),
+                rigidBodyComponent->m_collisionFilterGroup,
+                rigidBodyComponent->m_collisionFilterMask
+            );
+            m_impl->m_bodies[entityId] = std::move(rigidBody);
+            m_impl->m_createdEntities.insert(entityId);
+        },
+        [this] (EntityId entityId) {
+            btRigidBody* body = m_impl->m_bodies[entityId].get();
+            if (body) {
+                m_impl->m_world->removeRigidBody(body);
+            }
+            m_impl->m_bodies.erase(entityId);
+        }
+    );
+    // The properties rarely change, only visit the touched ones
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* component : m_impl->m_touched) {
+        RigidBodyComponent* rigidBodyComponent = static_cast<RigidBodyComponent*>(component);
         btRigidBody* body = rigidBodyComponent->m_body;
-        auto& properties = rigidBodyComponent->m_properties;
-        if (properties.hasChanges()) {
+        if (not body) {
+            continue;
+        }
+        auto& properties = *rigidBodyComponent->m_properties;
+        Touchable::FieldMask changed = properties.changedFields();
+        if (m_impl->m_createdEntities.count(component->owner()) > 0) {
+            // The body was just built with this shape and mass
+            changed &= ~(
+                RigidBodyComponent::Properties::SHAPE |
+                RigidBodyComponent::Properties::MASS |
+                RigidBodyComponent::Properties::SIMPLIFIED_SHAPE
+            );
+        }
+        if (changed & (RigidBodyComponent::Properties::SHAPE | RigidBodyComponent::Properties::SIMPLIFIED_SHAPE)) {
+            // The old bounding shape is no longer up to date, but the body
+            // holds on to it until it has the new one
+            std::unique_ptr<btCollisionShape> oldBoundingShape = std::move(
+                rigidBodyComponent->m_boundingShape
+            );
+            body->setCollisionShape(m_impl->collisionShape(rigidBodyComponent));
+            // Cached pairs and the bounding box still belong to the old shape
+            m_impl->m_world->getBroadphase()->getOverlappingPairCache()->cleanProxyFromPairs(
+                body->getBroadphaseHandle(),
+                m_impl->m_world->getDispatcher()
+            );
+            m_impl->m_world->updateSingleAabb(body);
+        }
+        if (changed & (RigidBodyComponent::Properties::SHAPE | RigidBodyComponent::Properties::MASS)) {
             btVector3 localInertia;
             properties.shape->bulletShape()->calculateLocalInertia(
                 properties.mass,
@@ -264,19 +706,42 @@ RigidBodyInputSystem::update(int milliseconds) {
                 properties.mass,
                 localInertia
             );
-            body->setLinearFactor(ogreToBullet(properties.linearFactor));
-            body->setAngularFactor(ogreToBullet(properties.angularFactor));
+            body->updateInertiaTensor();
+        }
+        if (changed & RigidBodyComponent::Properties::LINEAR_FACTOR) {
+            btVector3 linearFactor = ogreToBullet(properties.linearFactor);
+            if (m_impl->m_isPlanar) {
+                linearFactor.setZ(0);
+            }
+            body->setLinearFactor(linearFactor);
+        }
+        if (changed & RigidBodyComponent::Properties::ANGULAR_FACTOR) {
+            btVector3 angularFactor = ogreToBullet(properties.angularFactor);
+            if (m_impl->m_isPlanar) {
+                angularFactor.setX(0);
+                angularFactor.setY(0);
+            }
+            body->setAngularFactor(angularFactor);
+        }
+        if (changed & RigidBodyComponent::Properties::DAMPING) {
             body->setDamping(
                 properties.linearDamping,
                 properties.angularDamping
             );
+        }
+        if (changed & RigidBodyComponent::Properties::RESTITUTION) {
             body->setRestitution(properties.restitution);
-            body->setCollisionShape(properties.shape->bulletShape());
+        }
+        if (changed & RigidBodyComponent::Properties::FRICTION) {
             body->setFriction(properties.friction);
+        }
+        if (changed & RigidBodyComponent::Properties::ROLLING_FRICTION) {
             body->setRollingFriction(properties.rollingFriction);
+        }
+        if (changed & RigidBodyComponent::Properties::CONTACT_RESPONSE) {
             if (properties.hasContactResponse) {
                 body->setCollisionFlags(
-                    body->getCollisionFlags() & not btCollisionObject::CF_NO_CONTACT_RESPONSE
+                    body->getCollisionFlags() & ~btCollisionObject::CF_NO_CONTACT_RESPONSE
                 );
             }
             else {
@@ -284,6 +749,8 @@ RigidBodyInputSystem::update(int milliseconds) {
                     body->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE
                 );
             }
+        }
+        if (changed & RigidBodyComponent::Properties::KINEMATIC) {
             if (properties.kinematic) {
                 body->setCollisionFlags(
                     body->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT
@@ -291,36 +758,84 @@ RigidBodyInputSystem::update(int milliseconds) {
             }
             else {
                 body->setCollisionFlags(
-                    body->getCollisionFlags() & not btCollisionObject::CF_KINEMATIC_OBJECT
+                    body->getCollisionFlags() & ~btCollisionObject::CF_KINEMATIC_OBJECT
                 );
             }
-            properties.untouch();
         }
+        properties.untouch();
+    }
+    for (const auto& value : m_impl->m_entities) {
+        RigidBodyComponent* rigidBodyComponent = std::get<0>(value.second);
+        btRigidBody* body = rigidBodyComponent->m_body;
+        bool isCreated = m_impl->m_createdEntities.count(value.first) > 0;
         auto& dynamicProperties = rigidBodyComponent->m_dynamicProperties;
         if (dynamicProperties.hasChanges()) {
-            btTransform transform;
-            rigidBodyComponent->getWorldTransform(transform);
-            body->setWorldTransform(transform);
-            body->setLinearVelocity(ogreToBullet(dynamicProperties.linearVelocity));
-            body->setAngularVelocity(ogreToBullet(dynamicProperties.angularVelocity));
+            using DynamicProperties = RigidBodyComponent::DynamicProperties;
+            Touchable::FieldMask changed = dynamicProperties.changedFields();
+            if (changed & (DynamicProperties::POSITION | DynamicProperties::ROTATION)) {
+                btTransform transform;
+                rigidBodyComponent->getWorldTransform(transform);
+                body->setWorldTransform(transform);
+                // Bullet doesn't report teleports to the motion state
+                rigidBodyComponent->setWorldTransform(transform);
+            }
+            // The factors only scale forces and impulses, velocities 
+            // have to be projected onto the plane as well
+            if (changed & DynamicProperties::LINEAR_VELOCITY) {
+                btVector3 linearVelocity = ogreToBullet(dynamicProperties.linearVelocity);
+                if (m_impl->m_isPlanar) {
+                    linearVelocity.setZ(0);
+                }
+                body->setLinearVelocity(linearVelocity);
+            }
+            if (changed & DynamicProperties::ANGULAR_VELOCITY) {
+                btVector3 angularVelocity = ogreToBullet(dynamicProperties.angularVelocity);
+                if (m_impl->m_isPlanar) {
+                    angularVelocity.setX(0);
+                    angularVelocity.setY(0);
+                }
+                body->setAngularVelocity(angularVelocity);
+            }
             dynamicProperties.untouch();
             body->activate();
         }
-        for (const auto& impulsePair : rigidBodyComponent->m_impulseQueue) {
-            body->applyImpulse(
-                ogreToBullet(impulsePair.first),
-                ogreToBullet(impulsePair.second)
+        auto& savedBodyState = rigidBodyComponent->m_savedBodyState;
+        if (isCreated and savedBodyState.isValid) {
+            // Loaded bodies continue as they were saved, asleep or not
+            body->forceActivationState(savedBodyState.activationState);
+            body->setDeactivationTime(savedBodyState.deactivationTime);
+            savedBodyState.isValid = false;
+        }
+        if (not rigidBodyComponent->m_impulse.isZeroLength()) {
+            body->applyCentralImpulse(
+                ogreToBullet(rigidBodyComponent->m_impulse)
+            );
+            body->activate();
+            rigidBodyComponent->m_impulse = Ogre::Vector3::ZERO;
+        }
+        if (not rigidBodyComponent->m_torqueImpulse.isZeroLength()) {
+            body->applyTorqueImpulse(
+                ogreToBullet(rigidBodyComponent->m_torqueImpulse)
+            );
+            body->activate();
+            rigidBodyComponent->m_torqueImpulse = Ogre::Vector3::ZERO;
+        }
+        if (not rigidBodyComponent->m_force.isZeroLength()) {
+            body->applyCentralForce(
+                ogreToBullet(rigidBodyComponent->m_force)
             );
             body->activate();
+            rigidBodyComponent->m_force = Ogre::Vector3::ZERO;
         }
-        rigidBodyComponent->m_impulseQueue.clear();
         if (not rigidBodyComponent->m_torque.isZeroLength()) {
             body->applyTorque(
                 ogreToBullet(rigidBodyComponent->m_torque)
             );
             rigidBodyComponent->m_torque = Ogre::Vector3::ZERO;
         }
-        body->applyDamping(milliseconds / 1000.0f);
+        if (body->isActive()) {
+            body->applyDamping(milliseconds / 1000.0f);
+        }
     }
 }
 
@@ -339,15 +854,43 @@ RigidBodyOutputSystem::luaBindings() {
 
 struct RigidBodyOutputSystem::Implementation {
 
+    void
+    updateVelocities(
+        RigidBodyComponent* rigidBodyComponent
+    ) {
+        btRigidBody* rigidBody = rigidBodyComponent->m_body;
+        auto& dynamicProperties = rigidBodyComponent->m_dynamicProperties;
+        // Position and orientation are handled by RigidBodyComponent::setWorldTransform
+        if (rigidBody->isActive()) {
+            dynamicProperties.linearVelocity = bulletToOgre(rigidBody->getLinearVelocity());
+            dynamicProperties.angularVelocity = bulletToOgre(rigidBody->getAngularVelocity());
+        }
+        else if (
+            not dynamicProperties.linearVelocity.isZeroLength()
+            or not dynamicProperties.angularVelocity.isZeroLength()
+        ) {
+            dynamicProperties.linearVelocity = Ogre::Vector3::ZERO;
+            dynamicProperties.angularVelocity = Ogre::Vector3::ZERO;
+        }
+    }
+
     EntityFilter<
         RigidBodyComponent
     > m_entities;
+
+    RigidBodyInputSystem* m_inputSystem = nullptr;
+
+    // Entities moved in the current and the previous tick
+    std::unordered_set<EntityId> m_movedEntities;
+
+    std::unordered_set<EntityId> m_previouslyMovedEntities;
 };
 
 
 RigidBodyOutputSystem::RigidBodyOutputSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -360,33 +903,50 @@ RigidBodyOutputSystem::init(
 ) {
     System::init(gameState);
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_inputSystem = gameState->findSystem<RigidBodyInputSystem>();
 }
 
 
 void
 RigidBodyOutputSystem::shutdown() {
     m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_inputSystem = nullptr;
+    m_impl->m_movedEntities.clear();
+    m_impl->m_previouslyMovedEntities.clear();
     System::shutdown();
 }
 
 
 void
 RigidBodyOutputSystem::update(int) {
-    for (auto& value : m_impl->m_entities.entities()) {
-        RigidBodyComponent* rigidBodyComponent = std::get<0>(value.second);
-        btRigidBody* rigidBody = rigidBodyComponent->m_body;
-        auto& dynamicProperties = rigidBodyComponent->m_dynamicProperties;
-        // Position and orientation are handled by RigidBodyComponent::setWorldTransform
-        if (rigidBody->isActive()) {
-            dynamicProperties.linearVelocity = bulletToOgre(rigidBody->getLinearVelocity());
-            dynamicProperties.angularVelocity = bulletToOgre(rigidBody->getAngularVelocity());
+    if (m_impl->m_inputSystem) {
+        // The sync point of asynchronous physics
+        m_impl->m_inputSystem->synchronize();
+    }
+    const auto& entities = m_impl->m_entities.entities();
+    if (not m_impl->m_inputSystem) {
+        for (auto& value : entities) {
+            m_impl->updateVelocities(std::get<0>(value.second));
         }
-        else if (
-            not dynamicProperties.linearVelocity.isZeroLength()
-            or not dynamicProperties.angularVelocity.isZeroLength()
-        ) {
-            dynamicProperties.linearVelocity = Ogre::Vector3::ZERO;
-            dynamicProperties.angularVelocity = Ogre::Vector3::ZERO;
+        return;
+    }
+    std::swap(m_impl->m_movedEntities, m_impl->m_previouslyMovedEntities);
+    m_impl->m_movedEntities.clear();
+    for (EntityId entityId : m_impl->m_inputSystem->movedEntities()) {
+        auto iter = entities.find(entityId);
+        if (iter != entities.end()) {
+            m_impl->updateVelocities(std::get<0>(iter->second));
+            m_impl->m_movedEntities.insert(entityId);
+        }
+    }
+    // Bodies that stopped moving have fallen asleep and need their
+    // velocities reset once
+    for (EntityId entityId : m_impl->m_previouslyMovedEntities) {
+        if (m_impl->m_movedEntities.count(entityId) == 0) {
+            auto iter = entities.find(entityId);
+            if (iter != entities.end()) {
+                m_impl->updateVelocities(std::get<0>(iter->second));
+            }
         }
     }
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "bullet/collision_shape.h"
+#include "engine/cold_data.h"
 #include "engine/component.h"
+#include "engine/staged_writes.h"
 #include "engine/system.h"
 #include "engine/touchable.h"
 
@@ -10,6 +12,7 @@
 #include <memory>
 #include <OgreQuaternion.h>
 #include <OgreVector3.h>
+#include <vector>
 
 #include <iostream>
 
@@ -19,8 +22,16 @@ class scope;
 
 namespace thrive {
 
+class StorageList;
+class TransformBuffer;
+
 /**
 * @brief A component for a rigid body
+*
+* The Properties rarely change and are kept apart from the component (see
+* ColdData), so that the RigidBodyInputSystem's pass over all bodies each
+* tick only reads the forces, impulses and dynamic properties. Touching the
+* properties queues the component for the system instead.
 */
 class RigidBodyComponent : public Component, public btMotionState {
     COMPONENT(RigidBody)
@@ -30,9 +41,30 @@ public:
 
     /**
     * @brief Properties
+    *
+    * Touch only the changed fields with Touchable::touchFields() where
+    * possible. Applying the mass or the shape is expensive. Changes that
+    * aren't touched are not applied.
     */
     struct Properties : public Touchable {
 
+        /**
+        * @brief Field bits for Touchable::touchFields()
+        */
+        enum Field : FieldMask {
+            SHAPE = 1 << 0,
+            RESTITUTION = 1 << 1,
+            LINEAR_FACTOR = 1 << 2,
+            ANGULAR_FACTOR = 1 << 3,
+            MASS = 1 << 4,
+            FRICTION = 1 << 5,
+            DAMPING = 1 << 6,
+            ROLLING_FRICTION = 1 << 7,
+            CONTACT_RESPONSE = 1 << 8,
+            KINEMATIC = 1 << 9,
+            SIMPLIFIED_SHAPE = 1 << 10
+        };
+
         /**
         * @brief The body's shape .
         */
@@ -92,6 +124,17 @@ public:
         */
         bool kinematic = false;
 
+        /**
+        * @brief Whether the body collides with a bounding shape instead
+        *
+        * Only applies to compound shapes with more than one child. They
+        * are replaced by CollisionShape::createBoundingShape() for
+        * collisions, while the mass properties stay those of the full
+        * shape. Set by the SimulationLodSystem for distant bodies. Not
+        * saved.
+        */
+        bool isShapeSimplified = false;
+
     };
 
     /**
@@ -99,6 +142,18 @@ public:
     */
     struct DynamicProperties : public Touchable {
 
+        /**
+        * @brief Field bits for Touchable::touchFields()
+        *
+        * Position and rotation are applied together.
+        */
+        enum Field : FieldMask {
+            POSITION = 1 << 0,
+            ROTATION = 1 << 1,
+            LINEAR_VELOCITY = 1 << 2,
+            ANGULAR_VELOCITY = 1 << 3
+        };
+
         /**
         * @brief The position
         */
@@ -124,11 +179,64 @@ public:
         Ogre::Vector3 angularVelocity {0,0,0};
     };
 
+    /**
+    * @brief Bullet's state of a body as it was saved
+    *
+    * Restored by the RigidBodyInputSystem when it creates the body, so
+    * that sleeping bodies stay asleep and the inertia isn't recomputed.
+    */
+    struct SavedBodyState {
+
+        bool isValid = false;
+
+        int activationState = 0;
+
+        btScalar deactivationTime = 0.0f;
+
+        Ogre::Vector3 localInertia {0,0,0};
+
+    };
+
+    /**
+    * @brief A transform reported by an asynchronous physics step
+    *
+    * See GameState::Options::asyncPhysics
+    */
+    struct StepTransform {
+
+        RigidBodyComponent* component;
+
+        Ogre::Quaternion rotation;
+
+        Ogre::Vector3 position;
+
+    };
+
     /**
     * @brief Lua bindings
     *
     * Exposes:
     * - RigidBodyComponent()
+    * - RigidBodyComponent::applyCentralForce
+    * - RigidBodyComponent::applyCentralImpulse
+    * - RigidBodyComponent::applyForce
+    * - RigidBodyComponent::applyImpulse
+    * - RigidBodyComponent::applyImpulses(impulses, relativePositions):
+    *   Applies each impulse in the array \a impulses at the position with
+    *   the same index in \a relativePositions
+    * - RigidBodyComponent::applyCentralImpulses(impulses): Applies each
+    *   impulse in the array \a impulses to the center of mass
+    * - RigidBodyComponent::applyTorque
+    * - RigidBodyComponent.StagedField
+    *   - ANGULAR_DAMPING_FIELD
+    *   - ANGULAR_FACTOR_FIELD
+    *   - ANGULAR_VELOCITY_FIELD
+    *   - FRICTION_FIELD
+    *   - LINEAR_DAMPING_FIELD
+    *   - LINEAR_FACTOR_FIELD
+    *   - LINEAR_VELOCITY_FIELD
+    *   - MASS_FIELD
+    *   - RESTITUTION_FIELD
     * - @link m_properties properties @endlink
     * - Properties
     *   - Properties::shape
@@ -142,6 +250,7 @@ public:
     *   - Properties::mass
     *   - Properties::friction
     *   - Properties::rollingFriction
+    *   - Properties::isShapeSimplified
     *   - Properties::hasContactResponse
     *   - Properties::kinematic
     *
@@ -150,6 +259,71 @@ public:
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Replaces the shapes of stored rigid bodies by references into
+    * a shape table
+    *
+    * load() resolves the references while the table is installed, see
+    * CollisionShapeTable::Scope.
+    *
+    * @param rows
+    *   Storage of rigid body components, as from storage()
+    * @param shapes
+    *   Receives the shapes
+    */
+    static void
+    referenceShapes(
+        StorageList& rows,
+        CollisionShapeTable& shapes
+    );
+
+    /**
+    * @brief The StagedWrites field for Properties::angularDamping
+    *
+    * Staged writes are applied by the RigidBodyInputSystem.
+    */
+    static const StagedWrites::FieldId ANGULAR_DAMPING_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::angularFactor
+    */
+    static const StagedWrites::FieldId ANGULAR_FACTOR_FIELD;
+
+    /**
+    * @brief The StagedWrites field for DynamicProperties::angularVelocity
+    */
+    static const StagedWrites::FieldId ANGULAR_VELOCITY_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::friction
+    */
+    static const StagedWrites::FieldId FRICTION_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::linearDamping
+    */
+    static const StagedWrites::FieldId LINEAR_DAMPING_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::linearFactor
+    */
+    static const StagedWrites::FieldId LINEAR_FACTOR_FIELD;
+
+    /**
+    * @brief The StagedWrites field for DynamicProperties::linearVelocity
+    */
+    static const StagedWrites::FieldId LINEAR_VELOCITY_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::mass
+    */
+    static const StagedWrites::FieldId MASS_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Properties::restitution
+    */
+    static const StagedWrites::FieldId RESTITUTION_FIELD;
+
     /**
     * @brief Constructor
     *
@@ -164,11 +338,27 @@ public:
     ) : m_collisionFilterGroup(collisionFilterGroup),
         m_collisionFilterMask(collisionFilterMask)
     {
+        m_properties->setComponent(this);
     }
 
+    /**
+    * @brief Applies a force to the center of mass
+    *
+    * Forces are summed up and applied during the next physics tick.
+    *
+    * @param force
+    *   The force
+    */
+    void
+    applyCentralForce(
+        const Ogre::Vector3& force
+    );
+
     /**
     * @brief Applies an impulse to the center of mass
     *
+    * Cheaper than applyImpulse(), as there's no torque to compute.
+    *
     * @param impulse
     *   The impulse
     */
@@ -177,9 +367,26 @@ public:
         const Ogre::Vector3& impulse
     );
 
+    /**
+    * @brief Applies a force
+    *
+    * @param force
+    *   The force
+    * @param relativePosition
+    *   The attack point, relative to the center of mass
+    */
+    void
+    applyForce(
+        const Ogre::Vector3& force,
+        const Ogre::Vector3& relativePosition
+    );
+
     /**
     * @brief Applies an impulse
     *
+    * Impulses are not queued, but summed up into a central impulse and a
+    * torque impulse, which are applied during the next physics tick.
+    *
     * @param impulse
     *   The impulse
     * @param relativePosition
@@ -213,6 +420,34 @@ public:
         btTransform& transform
     ) const override;
 
+    /**
+    * @brief Internal function, dont use this directly
+    *
+    * Applies a transform reported by the physics step, see 
+    * setWorldTransform()
+    *
+    * @param rotation
+    * @param position
+    */
+    void
+    applyWorldTransform(
+        const Ogre::Quaternion& rotation,
+        const Ogre::Vector3& position
+    );
+
+    /**
+    * @brief Adds the body's position and rotation to a state digest
+    *
+    * Taken from the dynamic properties, which an asynchronous step only
+    * changes between ticks.
+    *
+    * @param digest
+    */
+    void
+    digest(
+        StateDigest& digest
+    ) const override;
+
     /**
     * @brief Loads the component
     *
@@ -226,6 +461,14 @@ public:
     /**
     * @brief Reimplemented from btMotionState
     *
+    * Bullet only calls this for bodies that are awake, so it also reports
+    * the body as moved to the RigidBodyInputSystem. If the entity has a
+    * scene node, the transform also goes straight into its slot in the
+    * TransformBuffer.
+    *
+    * During an asynchronous step, the transform is only buffered in 
+    * m_stepTransforms and applied by RigidBodyInputSystem::synchronize().
+    *
     * @param transform
     *   The rigid body's position and orientation
     */
@@ -271,6 +514,50 @@ public:
     */
     btRigidBody* m_body = nullptr;
 
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * See RigidBodyInputSystem::movedEntities()
+    */
+    std::vector<EntityId>* m_movedEntities = nullptr;
+
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * Where setWorldTransform() buffers transforms during asynchronous
+    * steps, see RigidBodyInputSystem::synchronize()
+    */
+    std::vector<StepTransform>* m_stepTransforms = nullptr;
+
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * Set by load(), consumed by the RigidBodyInputSystem
+    */
+    SavedBodyState m_savedBodyState;
+
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * The body's bounding shape while Properties::isShapeSimplified is in
+    * effect
+    */
+    std::unique_ptr<btCollisionShape> m_boundingShape;
+
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * The buffer that setWorldTransform() writes to, see BulletToOgreSystem
+    */
+    TransformBuffer* m_transformBuffer = nullptr;
+
+    /**
+    * @brief Internal object, dont use this directly
+    *
+    * The slot in m_transformBuffer
+    */
+    size_t m_transformSlot = 0;
+
     /**
     * @brief The body's collision group
     */
@@ -288,11 +575,14 @@ public:
     m_dynamicProperties;
 
     /**
-    * @brief Queue of impulses since the last frame
+    * @brief The force that has been applied in this timestep
+    */
+    Ogre::Vector3 m_force = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief The sum of the impulses since the last timestep
     */
-    std::list<
-        std::pair<Ogre::Vector3, Ogre::Vector3>
-    > m_impulseQueue;
+    Ogre::Vector3 m_impulse = Ogre::Vector3::ZERO;
 
     /**
     * @brief The torque that has been applied in this timestep
@@ -300,15 +590,37 @@ public:
     Ogre::Vector3 m_torque = Ogre::Vector3::ZERO;
 
     /**
-    * @brief Properties
+    * @brief The torque caused by the impulses since the last timestep
+    */
+    Ogre::Vector3 m_torqueImpulse = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief Properties, stored apart from the component
     */
-    Properties
+    ColdData<Properties>
     m_properties;
+
+private:
+
+    /**
+    * @brief The factor Bullet scales off-center forces and impulses with
+    *   before computing their torque
+    */
+    Ogre::Vector3
+    linearFactor() const;
 };
 
 
 /**
 * @brief Creates rigid bodies and updates its properties
+*
+* In a game state with planar physics (see GameState::isPhysicsPlanar()),
+* all bodies are locked to the x/y plane.
+*
+* The system also keeps track of which bodies moved during the current
+* tick, so that later systems can skip the bodies Bullet has put to sleep.
+* The properties staged in the entity manager's StagedWrites are applied
+* first.
 */
 class RigidBodyInputSystem : public System {
 
@@ -341,11 +653,38 @@ public:
     */
     void init(GameState* gameState) override;
 
+    /**
+    * @brief The entities whose bodies moved in the current tick
+    *
+    * These are the bodies that the simulation moved and the bodies
+    * whose dynamic properties were set from outside. Sleeping bodies are
+    * not included.
+    *
+    * The list is reset at the beginning of each update of this system, so
+    * it is only complete for systems running after the physics step.
+    *
+    * @return
+    *   The entities, without duplicates and in no particular order
+    */
+    const std::vector<EntityId>&
+    movedEntities();
+
     /**
     * @brief Shuts the system down
     */
     void shutdown() override;
 
+    /**
+    * @brief Waits for an asynchronous physics step and applies its results
+    *
+    * Called by this system before it touches the physics world and by the
+    * RigidBodyOutputSystem. Does nothing without 
+    * GameState::Options::asyncPhysics or if the results have already been
+    * applied.
+    */
+    void
+    synchronize();
+
     /**
     * @brief Updates the sky components
     */
@@ -368,6 +707,8 @@ private:
 * Copies the data from the simulation into
 * RigidBodyComponent::m_dynamicOutputProperties.
 *
+* If the game state has a RigidBodyInputSystem, only the bodies it reports
+* as moved are visited, plus those that have just fallen asleep.
 */
 class RigidBodyOutputSystem : public System {
 
@@ -6,6 +6,8 @@
 #include "bullet/collision_shape.h"
 #include "bullet/collision_system.h"
 #include "bullet/debug_drawing.h"
+#include "bullet/physics_pipeline.h"
+#include "bullet/physics_query_system.h"
 #include "bullet/rigid_body_system.h"
 #include "bullet/update_physics_system.h"
 #include "scripting/luabind.h"
@@ -41,6 +43,8 @@ thrive::BulletBindings::luaBindings() {
         BulletDebugDrawSystem::luaBindings(),
         UpdatePhysicsSystem::luaBindings(),
         CollisionSystem::luaBindings(),
+        PhysicsPipeline::luaBindings(),
+        PhysicsQuerySystem::luaBindings(),
         // Other
         CollisionFilter::luaBindings(),
         Collision::luaBindings()
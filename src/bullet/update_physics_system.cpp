@@ -1,10 +1,21 @@
 #include "bullet/update_physics_system.h"
 
+#include "bullet/rigid_body_system.h"
+#include "engine/engine.h"
 #include "engine/game_state.h"
+#include "engine/perf_counters.h"
+#include "engine/statistics.h"
+#include "engine/system_profiler.h"
+#include "engine/thread_pool.h"
+#include "engine/tracer.h"
 #include "scripting/luabind.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <boost/chrono.hpp>
 #include <btBulletDynamicsCommon.h>
+#include <exception>
+#include <iostream>
 
 
 using namespace thrive;
@@ -14,13 +25,102 @@ UpdatePhysicsSystem::luaBindings() {
     using namespace luabind;
     return class_<UpdatePhysicsSystem, System>("UpdatePhysicsSystem")
         .def(constructor<>())
+        .def("droppedSteps", &UpdatePhysicsSystem::droppedSteps)
+        .def("droppedTime", &UpdatePhysicsSystem::droppedTime)
+        .def("stepCap", &UpdatePhysicsSystem::stepCap)
     ;
 }
 
 
 struct UpdatePhysicsSystem::Implementation {
 
-    btDiscreteDynamicsWorld* m_world;
+    void
+    step(
+        Tracer& tracer,
+        btScalar timeStep,
+        int maxSubSteps,
+        int expectedSteps
+    ) {
+        Tracer::Zone zone(&tracer, "stepSimulation");
+        // Profiled on its own, as it may run on a worker
+        bool isProfiled = m_profiler->isEnabled();
+        PerfCounters::Values countersBefore;
+        bool isCounting = isProfiled and m_profiler->isCountingHardware() and
+            PerfCounters::read(countersBefore);
+        auto start = boost::chrono::steady_clock::now();
+        m_world->stepSimulation(timeStep, maxSubSteps, m_stepSize);
+        if (isProfiled) {
+            uint32_t elapsed = static_cast<uint32_t>(
+                boost::chrono::duration_cast<boost::chrono::microseconds>(
+                    boost::chrono::steady_clock::now() - start
+                ).count()
+            );
+            PerfCounters::Values countersAfter;
+            if (isCounting and PerfCounters::read(countersAfter)) {
+                m_profiler->record(m_profilerSlot, elapsed, countersAfter - countersBefore);
+            }
+            else {
+                m_profiler->record(m_profilerSlot, elapsed);
+            }
+        }
+        // Pairs the broadphase found against the narrowphase's contacts
+        m_overlappingPairsGauge->set(
+            m_world->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs()
+        );
+        m_contactManifoldsGauge->set(m_world->getDispatcher()->getNumManifolds());
+        if (expectedSteps > 0) {
+            boost::chrono::duration<double, boost::milli> duration =
+                boost::chrono::steady_clock::now() - start;
+            double cost = duration.count() / expectedSteps;
+            // Smoothed, so that a single slow step doesn't halve the cap
+            m_stepCost = m_stepCost > 0.0 ? 0.9 * m_stepCost + 0.1 * cost : cost;
+        }
+    }
+
+    unsigned int
+    stepCap() const {
+        unsigned int cap = m_maxSubSteps;
+        if (m_budget > 0 and m_stepCost > 0.0) {
+            unsigned int affordable = static_cast<unsigned int>(m_budget / m_stepCost);
+            cap = std::min(cap, std::max(1u, affordable));
+        }
+        return cap;
+    }
+
+    unsigned int m_budget = 0;
+
+    Statistics::Gauge* m_contactManifoldsGauge = nullptr;
+
+    uint64_t m_droppedSteps = 0;
+
+    Statistics::Counter* m_droppedStepsCounter = nullptr;
+
+    bool m_isAsync = false;
+
+    // Mirrors the time Bullet hasn't simulated yet, to count what it drops
+    btScalar m_localTime = 0.0f;
+
+    unsigned int m_maxSubSteps = 10;
+
+    Statistics::Gauge* m_overlappingPairsGauge = nullptr;
+
+    SystemProfiler* m_profiler = nullptr;
+
+    size_t m_profilerSlot = 0;
+
+    // Milliseconds per internal step, averaged over recent updates
+    double m_stepCost = 0.0;
+
+    // Set by an asynchronous step that threw
+    std::exception_ptr m_stepError;
+
+    JobCounter m_stepDone;
+
+    btScalar m_stepSize = 1.0f / 60.0f;
+
+    ThreadPool* m_threadPool = nullptr;
+
+    btDiscreteDynamicsWorld* m_world = nullptr;
 
 };
 
@@ -28,6 +128,7 @@ struct UpdatePhysicsSystem::Implementation {
 UpdatePhysicsSystem::UpdatePhysicsSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -41,21 +142,125 @@ UpdatePhysicsSystem::init(
     System::init(gameState);
     m_impl->m_world = gameState->physicsWorld();
     assert(m_impl->m_world != nullptr && "World object is null. Initialize the Engine first.");
+    m_impl->m_isAsync = gameState->isPhysicsAsync();
+    if (m_impl->m_isAsync and not gameState->findSystem<RigidBodyOutputSystem>()) {
+        // Nothing would wait for the step before entities are removed
+        std::cerr << "Warning: game state " << gameState->name() << " has no "
+            "RigidBodyOutputSystem, physics steps run synchronously" << std::endl;
+        m_impl->m_isAsync = false;
+    }
+    m_impl->m_threadPool = &gameState->engine().threadPool();
+    const GameState::Options& options = gameState->options();
+    m_impl->m_budget = options.physicsBudget;
+    m_impl->m_maxSubSteps = std::max(1u, options.physicsMaxSubSteps);
+    m_impl->m_stepSize = 1.0f / std::max(1u, options.physicsStepRate);
+    Statistics& statistics = gameState->engine().statistics();
+    m_impl->m_contactManifoldsGauge = &statistics.gauge("physics.contactManifolds");
+    m_impl->m_droppedStepsCounter = &statistics.counter("physics.droppedSteps");
+    m_impl->m_overlappingPairsGauge = &statistics.gauge("physics.overlappingPairs");
+    m_impl->m_profiler = &gameState->systemProfiler();
+    m_impl->m_profilerSlot = m_impl->m_profiler->addScope("stepSimulation");
+}
+
+
+uint64_t
+UpdatePhysicsSystem::droppedSteps() const {
+    return m_impl->m_droppedSteps;
+}
+
+
+double
+UpdatePhysicsSystem::droppedTime() const {
+    return m_impl->m_droppedSteps * m_impl->m_stepSize * 1000.0;
 }
 
 
 void
 UpdatePhysicsSystem::shutdown() {
+    try {
+        this->waitForStep();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error in physics step during shutdown: " << e.what() << std::endl;
+    }
+    m_impl->m_contactManifoldsGauge = nullptr;
+    m_impl->m_droppedStepsCounter = nullptr;
+    m_impl->m_overlappingPairsGauge = nullptr;
+    m_impl->m_localTime = 0.0f;
+    m_impl->m_stepCost = 0.0;
+    m_impl->m_threadPool = nullptr;
     m_impl->m_world = nullptr;
     System::shutdown();
 }
 
 
+unsigned int
+UpdatePhysicsSystem::stepCap() const {
+    return m_impl->stepCap();
+}
+
+
 void
 UpdatePhysicsSystem::update(
     int milliSeconds
 ) {
     assert(m_impl->m_world != nullptr && "UpdatePhysicsSystem not initialized");
-    m_impl->m_world->stepSimulation(milliSeconds/1000.f,10);
+    // Without an output system, the last step may still be running
+    this->waitForStep();
+    unsigned int tickRate = this->gameState()->tickRate();
+    btScalar timeStep = milliSeconds / 1000.f;
+    int maxSubSteps = 0;
+    int expectedSteps = 1;
+    if (this->isFixedRate() and tickRate > 0) {
+        // The game state already steps at a fixed rate, so let Bullet take
+        // exactly one step per tick instead of interpolating on its own
+        timeStep = 1.0f / tickRate;
+    }
+    else {
+        maxSubSteps = static_cast<int>(m_impl->stepCap());
+        // Same bookkeeping as btDiscreteDynamicsWorld::stepSimulation(),
+        // which silently drops the steps beyond maxSubSteps
+        m_impl->m_localTime += timeStep;
+        int neededSteps = static_cast<int>(m_impl->m_localTime / m_impl->m_stepSize);
+        m_impl->m_localTime -= neededSteps * m_impl->m_stepSize;
+        expectedSteps = std::min(neededSteps, maxSubSteps);
+        if (neededSteps > maxSubSteps) {
+            unsigned int dropped = neededSteps - maxSubSteps;
+            m_impl->m_droppedSteps += dropped;
+            m_impl->m_droppedStepsCounter->add(dropped);
+        }
+    }
+    Tracer& tracer = this->engine()->tracer();
+    if (not m_impl->m_isAsync) {
+        m_impl->step(tracer, timeStep, maxSubSteps, expectedSteps);
+        return;
+    }
+    Implementation* impl = m_impl.get();
+    m_impl->m_threadPool->submit(
+        [impl, &tracer, timeStep, maxSubSteps, expectedSteps] () {
+            try {
+                impl->step(tracer, timeStep, maxSubSteps, expectedSteps);
+            }
+            catch (...) {
+                impl->m_stepError = std::current_exception();
+            }
+        },
+        &m_impl->m_stepDone
+    );
 }
 
+
+void
+UpdatePhysicsSystem::waitForStep() {
+    if (not m_impl->m_threadPool or m_impl->m_stepDone.isDone()) {
+        return;
+    }
+    Tracer::Zone zone(&this->engine()->tracer(), "waitForPhysics");
+    // Without worker threads, the step runs here
+    m_impl->m_threadPool->wait(m_impl->m_stepDone);
+    std::exception_ptr error = m_impl->m_stepError;
+    m_impl->m_stepError = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -2,12 +2,33 @@
 
 #include "engine/system.h"
 
+#include <cstdint>
+
 namespace thrive {
 
 /**
 * @brief Steps the physics simulation
 *
 * Requires a BulletEngine
+*
+* With GameState::Options::asyncPhysics, update() starts the step on the
+* engine's thread pool and returns. The step must be finished with 
+* waitForStep() before anything else touches the physics world, which the
+* RigidBodyOutputSystem and RigidBodyInputSystem do.
+*
+* Without a tick rate, each update takes as many internal steps as fit the
+* frame time, up to a cap from GameState::Options::physicsMaxSubSteps and 
+* GameState::Options::physicsBudget. Time beyond the cap is dropped and 
+* counted in droppedSteps() and the \c physics.droppedSteps statistic.
+*
+* After each step, the \c physics.overlappingPairs gauge holds the number
+* of pairs in the broadphase's pair cache and \c physics.contactManifolds
+* the number of those the narrowphase kept a contact manifold for. The 
+* closer they are, the better the broadphase fits the world, see 
+* GameState::Options::broadphase.
+*
+* The game state's SystemProfiler reports the step itself as
+* \c stepSimulation, wherever it runs.
 */
 class UpdatePhysicsSystem : public System {
 
@@ -18,6 +39,9 @@ public:
     *
     * Exposes:
     * - UpdatePhysicsSystem()
+    * - UpdatePhysicsSystem::droppedSteps()
+    * - UpdatePhysicsSystem::droppedTime()
+    * - UpdatePhysicsSystem::stepCap()
     *
     * @return 
     */
@@ -34,6 +58,18 @@ public:
     */
     ~UpdatePhysicsSystem();
 
+    /**
+    * @brief The number of internal steps dropped since init()
+    */
+    uint64_t
+    droppedSteps() const;
+
+    /**
+    * @brief The simulation time dropped since init(), in milliseconds
+    */
+    double
+    droppedTime() const;
+
     /**
     * @brief Initializes the system
     *
@@ -49,6 +85,15 @@ public:
     void
     shutdown() override;
 
+    /**
+    * @brief The most internal steps the next update takes
+    *
+    * GameState::Options::physicsMaxSubSteps, lowered to what fits 
+    * GameState::Options::physicsBudget at the recent step cost
+    */
+    unsigned int
+    stepCap() const;
+
     /**
     * @brief Updates the system
     *
@@ -59,6 +104,18 @@ public:
         int milliSeconds
     ) override;
 
+    /**
+    * @brief Waits until the step started by update() is done
+    *
+    * Returns immediately if there is no step in flight, so it's safe to 
+    * call more than once per frame.
+    *
+    * @throw
+    *   Rethrows an exception thrown by the step
+    */
+    void
+    waitForStep();
+
 private:
 
     struct Implementation;
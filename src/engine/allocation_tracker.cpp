@@ -0,0 +1,415 @@
+#include "engine/allocation_tracker.h"
+
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#ifdef THRIVE_TRACK_ALLOCATIONS
+#include <LinearMath/btAlignedAllocator.h>
+#endif
+
+using namespace thrive;
+
+namespace {
+
+// Minimum time between two warnings for the same system
+const boost::chrono::seconds WARNING_INTERVAL(1);
+
+// Totals of the current frame, over all threads
+std::atomic<uint64_t> g_frameAllocations(0);
+
+std::atomic<uint64_t> g_frameBytes(0);
+
+}
+
+#ifdef THRIVE_TRACK_ALLOCATIONS
+
+static void*
+trackedMalloc(
+    size_t size
+) {
+    AllocationTracker::record(size);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+
+void*
+operator new(
+    size_t size
+) {
+    void* pointer = trackedMalloc(size);
+    if (not pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+
+void*
+operator new[](
+    size_t size
+) {
+    void* pointer = trackedMalloc(size);
+    if (not pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+
+void*
+operator new(
+    size_t size,
+    const std::nothrow_t&
+) noexcept {
+    return trackedMalloc(size);
+}
+
+
+void*
+operator new[](
+    size_t size,
+    const std::nothrow_t&
+) noexcept {
+    return trackedMalloc(size);
+}
+
+
+void
+operator delete(
+    void* pointer
+) noexcept {
+    std::free(pointer);
+}
+
+
+void
+operator delete[](
+    void* pointer
+) noexcept {
+    std::free(pointer);
+}
+
+
+void
+operator delete(
+    void* pointer,
+    const std::nothrow_t&
+) noexcept {
+    std::free(pointer);
+}
+
+
+void
+operator delete[](
+    void* pointer,
+    const std::nothrow_t&
+) noexcept {
+    std::free(pointer);
+}
+
+
+static void*
+bulletAlloc(
+    size_t size
+) {
+    return trackedMalloc(size);
+}
+
+
+static void
+bulletFree(
+    void* pointer
+) {
+    std::free(pointer);
+}
+
+#endif
+
+
+static uint64_t
+AllocationTracker_frameAllocations(
+    const AllocationTracker* self
+) {
+    return self->frameCounts().allocations;
+}
+
+
+static uint64_t
+AllocationTracker_frameBytes(
+    const AllocationTracker* self
+) {
+    return self->frameCounts().bytes;
+}
+
+
+static uint64_t
+AllocationTracker_systemAllocations(
+    const AllocationTracker* self,
+    const std::string& name
+) {
+    return self->systemCounts(name).allocations;
+}
+
+
+static uint64_t
+AllocationTracker_systemBytes(
+    const AllocationTracker* self,
+    const std::string& name
+) {
+    return self->systemCounts(name).bytes;
+}
+
+
+luabind::scope
+AllocationTracker::luaBindings() {
+    using namespace luabind;
+    return class_<AllocationTracker>("AllocationTracker")
+        .scope [
+            def("isAvailable", &AllocationTracker::isAvailable)
+        ]
+        .def("frameAllocations", &AllocationTracker_frameAllocations)
+        .def("frameBytes", &AllocationTracker_frameBytes)
+        .def("isHot", &AllocationTracker::isHot)
+        .def("isStrict", &AllocationTracker::isStrict)
+        .def("report", &AllocationTracker::report)
+        .def("setHot", &AllocationTracker::setHot)
+        .def("setStrict", &AllocationTracker::setStrict)
+        .def("systemAllocations", &AllocationTracker_systemAllocations)
+        .def("systemBytes", &AllocationTracker_systemBytes)
+        .def("violationCount", &AllocationTracker::violationCount)
+    ;
+}
+
+
+thread_local AllocationTracker::Slot* AllocationTracker::t_currentSlot = nullptr;
+
+
+bool
+AllocationTracker::isAvailable() {
+#ifdef THRIVE_TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void
+AllocationTracker::record(
+    size_t bytes
+) {
+    g_frameAllocations.fetch_add(1, std::memory_order_relaxed);
+    g_frameBytes.fetch_add(bytes, std::memory_order_relaxed);
+    Slot* slot = t_currentSlot;
+    if (slot) {
+        slot->allocations.fetch_add(1, std::memory_order_relaxed);
+        slot->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+
+AllocationTracker::AllocationTracker() {
+#ifdef THRIVE_TRACK_ALLOCATIONS
+    // Both default to malloc and free, so blocks allocated before this
+    // are still freed correctly
+    btAlignedAllocSetCustom(&bulletAlloc, &bulletFree);
+#endif
+}
+
+
+AllocationTracker::~AllocationTracker() {
+#ifdef THRIVE_TRACK_ALLOCATIONS
+    btAlignedAllocSetCustom(nullptr, nullptr);
+#endif
+}
+
+
+size_t
+AllocationTracker::addScope(
+    const std::string& name
+) {
+    auto iter = m_slotIndices.find(name);
+    if (iter != m_slotIndices.end()) {
+        return iter->second;
+    }
+    size_t index = m_slots.size();
+    m_slots.emplace_back();
+    Slot& slot = m_slots.back();
+    slot.isHot = m_hotNames.count(name) > 0;
+    slot.name = name;
+    m_slotIndices.emplace(name, index);
+    return index;
+}
+
+
+void
+AllocationTracker::endFrame() {
+    m_frameCounts.allocations = g_frameAllocations.exchange(0, std::memory_order_relaxed);
+    m_frameCounts.bytes = g_frameBytes.exchange(0, std::memory_order_relaxed);
+    bool isChecked = m_isStrict and m_steadyFrames >= STEADY_STATE_FRAMES;
+    if (m_steadyFrames < STEADY_STATE_FRAMES) {
+        m_steadyFrames += 1;
+    }
+    auto now = boost::chrono::steady_clock::now();
+    for (Slot& slot : m_slots) {
+        slot.lastFrame.allocations = slot.allocations.exchange(0, std::memory_order_relaxed);
+        slot.lastFrame.bytes = slot.bytes.exchange(0, std::memory_order_relaxed);
+        if (not isChecked or not slot.isHot or slot.lastFrame.allocations == 0) {
+            continue;
+        }
+        m_violationCount += 1;
+        if (now - slot.lastWarning < WARNING_INTERVAL) {
+            slot.suppressed += 1;
+            continue;
+        }
+        std::cerr << "Allocation in hot system: name=" << slot.name
+            << " allocations=" << slot.lastFrame.allocations
+            << " bytes=" << slot.lastFrame.bytes;
+        if (slot.suppressed > 0) {
+            std::cerr << " suppressed=" << slot.suppressed;
+        }
+        std::cerr << std::endl;
+        slot.lastWarning = now;
+        slot.suppressed = 0;
+    }
+}
+
+
+AllocationTracker::Counts
+AllocationTracker::frameCounts() const {
+    return m_frameCounts;
+}
+
+
+bool
+AllocationTracker::isHot(
+    const std::string& name
+) const {
+    return m_hotNames.count(name) > 0;
+}
+
+
+bool
+AllocationTracker::isStrict() const {
+    return m_isStrict;
+}
+
+
+std::string
+AllocationTracker::report(
+    unsigned int count
+) const {
+    if (not isAvailable()) {
+        return "Allocation tracking needs a build with THRIVE_TRACK_ALLOCATIONS\n";
+    }
+    std::vector<const Slot*> rows;
+    for (const Slot& slot : m_slots) {
+        if (slot.lastFrame.allocations > 0) {
+            rows.push_back(&slot);
+        }
+    }
+    count = std::min<size_t>(count, rows.size());
+    std::partial_sort(
+        rows.begin(),
+        rows.begin() + count,
+        rows.end(),
+        [] (const Slot* a, const Slot* b) {
+            return a->lastFrame.allocations > b->lastFrame.allocations;
+        }
+    );
+    std::ostringstream stream;
+    stream << "Frame: " << m_frameCounts.allocations << " allocations, "
+        << m_frameCounts.bytes << " bytes\n";
+    stream << " allocs      bytes\n";
+    for (unsigned int i = 0; i < count; ++i) {
+        const Slot& slot = *rows[i];
+        stream
+            << std::setw(7) << slot.lastFrame.allocations << " "
+            << std::setw(10) << slot.lastFrame.bytes << "  "
+            << slot.name << (slot.isHot ? " (hot)" : "") << "\n";
+    }
+    return stream.str();
+}
+
+
+void
+AllocationTracker::resetSteadyState() {
+    m_steadyFrames = 0;
+}
+
+
+void
+AllocationTracker::setHot(
+    const std::string& name,
+    bool hot
+) {
+    if (hot) {
+        m_hotNames.insert(name);
+    }
+    else {
+        m_hotNames.erase(name);
+    }
+    auto iter = m_slotIndices.find(name);
+    if (iter != m_slotIndices.end()) {
+        m_slots[iter->second].isHot = hot;
+    }
+}
+
+
+void
+AllocationTracker::setStrict(
+    bool strict
+) {
+    if (strict and not m_isStrict) {
+        m_steadyFrames = 0;
+    }
+    m_isStrict = strict;
+}
+
+
+AllocationTracker::Counts
+AllocationTracker::systemCounts(
+    const std::string& name
+) const {
+    auto iter = m_slotIndices.find(name);
+    if (iter == m_slotIndices.end()) {
+        return Counts();
+    }
+    return m_slots[iter->second].lastFrame;
+}
+
+
+unsigned long long
+AllocationTracker::violationCount() const {
+    return m_violationCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// AllocationTracker::Scope
+////////////////////////////////////////////////////////////////////////////////
+
+AllocationTracker::Scope::Scope(
+    AllocationTracker* tracker,
+    size_t slot
+) {
+    if (tracker) {
+        m_isOpen = true;
+        m_previous = t_currentSlot;
+        t_currentSlot = &tracker->m_slots[slot];
+    }
+}
+
+
+AllocationTracker::Scope::~Scope() {
+    if (m_isOpen) {
+        t_currentSlot = m_previous;
+    }
+}
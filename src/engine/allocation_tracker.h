@@ -0,0 +1,333 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Counts heap allocations per frame and per system
+*
+* Only builds configured with \c THRIVE_TRACK_ALLOCATIONS count anything.
+* They replace the global <tt>operator new</tt> and <tt>operator
+* delete</tt> and Bullet's allocator with counting wrappers, and the
+* LuaAllocator counts as well, except on LuaJIT. Other builds keep all counts at zero, see
+* isAvailable(). Ogre's own allocator and the component pools (see
+* Component::operator new()) are not counted.
+*
+* The SystemScheduler opens a Scope around each system update, so that
+* allocations are also counted for the system that made them. Jobs a
+* system hands to the thread pool only count for the frame. The Engine
+* calls endFrame() at the end of each update.
+*
+* Systems can be designated as hot, e.g. the agent, physics and scene node
+* systems, which shouldn't allocate once the game has settled. In strict
+* mode, each frame a hot system allocates in steady state, that is after
+* STEADY_STATE_FRAMES, counts as a violation and writes a warning to
+* \c std::cerr. Warnings for the same system are limited to one per
+* second, with a count of the suppressed ones.
+*
+* Except for record(), all methods must be called from the main thread.
+*/
+class AllocationTracker {
+
+    struct Slot;
+
+public:
+
+    /**
+    * @brief Allocations and their bytes
+    */
+    struct Counts {
+
+        /**
+        * @brief Number of allocations, including reallocations that grow
+        */
+        uint64_t allocations = 0;
+
+        /**
+        * @brief Requested bytes, the growth for reallocations
+        */
+        uint64_t bytes = 0;
+
+    };
+
+    /**
+    * @brief Counts the allocations of the current thread for a system
+    *
+    * Scopes nest, the innermost one counts.
+    */
+    class Scope {
+
+    public:
+
+        /**
+        * @brief Constructor
+        *
+        * @param tracker
+        *   If \c null, the scope does nothing
+        * @param slot
+        *   A slot returned by addScope()
+        */
+        Scope(
+            AllocationTracker* tracker,
+            size_t slot
+        );
+
+        /**
+        * @brief Destructor
+        *
+        * Restores the enclosing scope.
+        */
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+
+        Scope& operator= (const Scope&) = delete;
+
+    private:
+
+        bool m_isOpen = false;
+
+        Slot* m_previous = nullptr;
+
+    };
+
+    /**
+    * @brief Frames after setStrict() or resetSteadyState() before hot systems
+    * must stop allocating
+    */
+    static const unsigned int STEADY_STATE_FRAMES = 120;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - AllocationTracker::isAvailable (static)
+    * - AllocationTracker::frameAllocations
+    * - AllocationTracker::frameBytes
+    * - AllocationTracker::isHot
+    * - AllocationTracker::isStrict
+    * - AllocationTracker::report
+    * - AllocationTracker::setHot
+    * - AllocationTracker::setStrict
+    * - AllocationTracker::systemAllocations
+    * - AllocationTracker::systemBytes
+    * - AllocationTracker::violationCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Whether this build counts allocations
+    */
+    static bool
+    isAvailable();
+
+    /**
+    * @brief Counts an allocation
+    *
+    * Called by the allocation hooks, from any thread. Doesn't allocate.
+    *
+    * @param bytes
+    */
+    static void
+    record(
+        size_t bytes
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * Installs the Bullet allocator hook in tracking builds. Only one
+    * tracker should exist at a time.
+    */
+    AllocationTracker();
+
+    /**
+    * @brief Destructor
+    */
+    ~AllocationTracker();
+
+    AllocationTracker(const AllocationTracker&) = delete;
+
+    AllocationTracker& operator= (const AllocationTracker&) = delete;
+
+    /**
+    * @brief Adds a scope to count allocations for
+    *
+    * @param name
+    *   Usually a System::name(). Adding a name again returns the slot it
+    *   already has, so systems of the same name in different game states
+    *   share their counts.
+    *
+    * @return
+    *   The slot to open Scope objects with
+    */
+    size_t
+    addScope(
+        const std::string& name
+    );
+
+    /**
+    * @brief Ends a frame
+    *
+    * Keeps this frame's counts for frameCounts() and systemCounts() and
+    * checks the hot systems in strict mode.
+    */
+    void
+    endFrame();
+
+    /**
+    * @brief The counts of the last frame, all threads
+    */
+    Counts
+    frameCounts() const;
+
+    /**
+    * @brief Whether a system is hot
+    *
+    * @param name
+    */
+    bool
+    isHot(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Whether strict mode is enabled
+    */
+    bool
+    isStrict() const;
+
+    /**
+    * @brief Summarizes the last frame as text
+    *
+    * The frame's totals, then one line per system that allocated, most
+    * allocations first. Hot systems are marked.
+    *
+    * @param count
+    *   The maximum number of systems to list
+    */
+    std::string
+    report(
+        unsigned int count
+    ) const;
+
+    /**
+    * @brief Starts the wait for the steady state again
+    *
+    * The Engine calls this when it switches game states, which sets up
+    * new systems.
+    */
+    void
+    resetSteadyState();
+
+    /**
+    * @brief Designates a system as hot or not
+    *
+    * @param name
+    *   The System::name()
+    * @param hot
+    */
+    void
+    setHot(
+        const std::string& name,
+        bool hot
+    );
+
+    /**
+    * @brief Enables or disables strict mode
+    *
+    * Enabling it resets the steady state. Disabled by default.
+    *
+    * @param strict
+    */
+    void
+    setStrict(
+        bool strict
+    );
+
+    /**
+    * @brief The counts of a system in the last frame
+    *
+    * @param name
+    *   The System::name()
+    *
+    * @return
+    *   The counts, empty if there is no such scope
+    */
+    Counts
+    systemCounts(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Frames in which hot systems allocated in strict mode, since
+    * construction
+    */
+    unsigned long long
+    violationCount() const;
+
+private:
+
+    struct Slot {
+
+        Slot()
+          : allocations(0),
+            bytes(0)
+        {
+        }
+
+        std::atomic<uint64_t> allocations;
+
+        std::atomic<uint64_t> bytes;
+
+        bool isHot = false;
+
+        Counts lastFrame;
+
+        boost::chrono::steady_clock::time_point lastWarning;
+
+        std::string name;
+
+        // Violations since the last warning that were not logged
+        unsigned int suppressed = 0;
+
+    };
+
+    // The innermost open scope of the thread, if any
+    static thread_local Slot* t_currentSlot;
+
+    Counts m_frameCounts;
+
+    // Names of the hot systems, including those without a slot yet
+    std::unordered_set<std::string> m_hotNames;
+
+    bool m_isStrict = false;
+
+    // Never shrinks, Scope objects and the hooks point into it
+    std::deque<Slot> m_slots;
+
+    std::unordered_map<std::string, size_t> m_slotIndices;
+
+    // Frames since the steady state was reset
+    unsigned int m_steadyFrames = 0;
+
+    unsigned long long m_violationCount = 0;
+
+};
+
+}
@@ -0,0 +1,179 @@
+#include "engine/archetype.h"
+
+#include <algorithm>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// Archetype
+////////////////////////////////////////////////////////////////////////////////
+
+Archetype::Archetype(
+    Signature signature,
+    Signature componentTypes
+) : m_columns(componentTypes.size()),
+    m_componentTypes(std::move(componentTypes)),
+    m_mask(signature),
+    m_signature(std::move(signature))
+{
+}
+
+
+int
+Archetype::column(
+    ComponentTypeId typeId
+) const {
+    auto iter = std::lower_bound(m_componentTypes.begin(), m_componentTypes.end(), typeId);
+    if (iter == m_componentTypes.end() or *iter != typeId) {
+        return -1;
+    }
+    return iter - m_componentTypes.begin();
+}
+
+
+Component*
+Archetype::component(
+    ComponentTypeId typeId,
+    size_t row
+) const {
+    int index = this->column(typeId);
+    if (index < 0) {
+        return nullptr;
+    }
+    return m_columns[index][row];
+}
+
+
+const std::vector<Component*>*
+Archetype::componentColumn(
+    ComponentTypeId typeId
+) const {
+    int index = this->column(typeId);
+    if (index < 0) {
+        return nullptr;
+    }
+    return &m_columns[index];
+}
+
+
+const Archetype::Signature&
+Archetype::componentTypes() const {
+    return m_componentTypes;
+}
+
+
+bool
+Archetype::contains(
+    ComponentTypeId typeId
+) const {
+    return std::binary_search(m_signature.begin(), m_signature.end(), typeId);
+}
+
+
+const std::vector<EntityId>&
+Archetype::entities() const {
+    return m_entities;
+}
+
+
+const ComponentMask&
+Archetype::mask() const {
+    return m_mask;
+}
+
+
+EntityId
+Archetype::removeRow(
+    size_t row
+) {
+    size_t lastRow = m_entities.size() - 1;
+    EntityId movedEntity = NULL_ENTITY;
+    if (row != lastRow) {
+        movedEntity = m_entities[lastRow];
+        m_entities[row] = movedEntity;
+        for (auto& column : m_columns) {
+            column[row] = column[lastRow];
+        }
+    }
+    m_entities.pop_back();
+    for (auto& column : m_columns) {
+        column.pop_back();
+    }
+    m_sortedRows = std::min(m_sortedRows, row);
+    return movedEntity;
+}
+
+
+const Archetype::Signature&
+Archetype::signature() const {
+    return m_signature;
+}
+
+
+size_t
+Archetype::size() const {
+    return m_entities.size();
+}
+
+
+bool
+Archetype::sortStep(
+    size_t& budget,
+    size_t& firstMoved,
+    size_t& endMoved
+) {
+    auto isBefore = [] (EntityId left, EntityId right) {
+        return entityIndex(left) < entityIndex(right);
+    };
+    firstMoved = m_sortedRows;
+    endMoved = m_sortedRows;
+    while (m_sortedRows < m_entities.size() and budget > 0) {
+        size_t row = m_sortedRows;
+        size_t target = std::upper_bound(
+            m_entities.begin(),
+            m_entities.begin() + row,
+            m_entities[row],
+            isBefore
+        ) - m_entities.begin();
+        if (target != row) {
+            std::rotate(
+                m_entities.begin() + target,
+                m_entities.begin() + row,
+                m_entities.begin() + row + 1
+            );
+            for (auto& column : m_columns) {
+                std::rotate(
+                    column.begin() + target,
+                    column.begin() + row,
+                    column.begin() + row + 1
+                );
+            }
+            if (firstMoved == endMoved) {
+                firstMoved = target;
+            }
+            firstMoved = std::min(firstMoved, target);
+            endMoved = row + 1;
+        }
+        budget -= std::min(budget, row - target + 1);
+        m_sortedRows += 1;
+    }
+    return m_sortedRows < m_entities.size();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ArchetypeListener
+////////////////////////////////////////////////////////////////////////////////
+
+void
+ArchetypeListener::onEntitiesAdded(
+    const Archetype& archetype,
+    size_t firstRow,
+    size_t count
+) {
+    const auto& entities = archetype.entities();
+    for (size_t row = firstRow; row < firstRow + count; ++row) {
+        this->onEntityAdded(entities[row], archetype, row);
+    }
+}
+
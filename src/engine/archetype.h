@@ -0,0 +1,323 @@
+#pragma once
+
+#include "engine/component_mask.h"
+#include "engine/typedefs.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace thrive {
+
+class ArchetypeListener;
+class Component;
+
+/**
+* @brief A group of entities that have exactly the same component types
+*
+* The EntityManager sorts every entity with at least one component into the
+* archetype matching its set of component types. An archetype keeps
+* non-owning pointers to its entities' components, one column per component
+* type. This lets entity filters look up all relevant components of an
+* entity by index instead of querying one ComponentCollection per type.
+*
+* Tags (see EntityManager::addTag()) are part of the signature like 
+* component types, but have no column.
+*
+* When a component is added to or removed from an entity, the entity moves
+* to a neighbouring archetype. The archetypes cache these transitions, so a
+* move is a constant time operation once the transition has been seen.
+*
+* Archetypes are created on demand and live as long as their EntityManager.
+* Removing an entity moves the last row into its place, in idle time
+* EntityManager::compactStep() sorts the rows back into entity order.
+*/
+class Archetype {
+
+public:
+
+    /**
+    * @brief The sorted component type and tag ids of an archetype
+    */
+    using Signature = std::vector<ComponentTypeId>;
+
+    /**
+    * @brief Retrieves a component of an entity in this archetype
+    *
+    * @param typeId
+    *   The component type
+    * @param row
+    *   The entity's row in this archetype
+    *
+    * @return
+    *   A non-owning pointer to the component or \c nullptr if this
+    *   archetype does not contain \a typeId
+    */
+    Component*
+    component(
+        ComponentTypeId typeId,
+        size_t row
+    ) const;
+
+    /**
+    * @brief Retrieves all components of one type in this archetype
+    *
+    * For systems that process whole columns at once instead of one entity
+    * at a time. The column is invalidated by any change to the archetype.
+    *
+    * @param typeId
+    *   The component type
+    *
+    * @return
+    *   Non-owning pointers to the components, indexed by row, or \c nullptr
+    *   if this archetype does not contain \a typeId
+    */
+    const std::vector<Component*>*
+    componentColumn(
+        ComponentTypeId typeId
+    ) const;
+
+    /**
+    * @brief The component types of this archetype that have a column
+    *
+    * Like signature(), but without tags.
+    */
+    const Signature&
+    componentTypes() const;
+
+    /**
+    * @brief Checks whether this archetype contains a component type or tag
+    *
+    * @param typeId
+    *   The component type or tag to check for
+    */
+    bool
+    contains(
+        ComponentTypeId typeId
+    ) const;
+
+    /**
+    * @brief The entities in this archetype, indexed by row
+    */
+    const std::vector<EntityId>&
+    entities() const;
+
+    /**
+    * @brief The component types and tags of this archetype as a mask
+    *
+    * For cheap checks of several component types at once, e.g. by
+    * ArchetypeListener::listensTo().
+    */
+    const ComponentMask&
+    mask() const;
+
+    /**
+    * @brief The component types and tags of this archetype
+    */
+    const Signature&
+    signature() const;
+
+    /**
+    * @brief The number of entities in this archetype
+    */
+    size_t
+    size() const;
+
+private:
+
+    friend class EntityManager;
+
+    /**
+    * @brief Constructor
+    *
+    * @param signature
+    *   The sorted component types and tags of this archetype
+    * @param componentTypes
+    *   The entries of \a signature that are component types
+    */
+    Archetype(
+        Signature signature,
+        Signature componentTypes
+    );
+
+    /**
+    * @brief Returns the column index of a component type
+    *
+    * @return The index or -1 if \a typeId is not a component type of this
+    *   archetype
+    */
+    int
+    column(
+        ComponentTypeId typeId
+    ) const;
+
+    /**
+    * @brief Removes a row by moving the last row into its place
+    *
+    * @return
+    *   The entity now occupying \a row or NULL_ENTITY if \a row was the
+    *   last row
+    */
+    EntityId
+    removeRow(
+        size_t row
+    );
+
+    /**
+    * @brief Moves rows towards entity order
+    *
+    * Works like ComponentCollection::sortStep().
+    *
+    * @param budget
+    *   The number of rows that may be visited or moved, reduced by the
+    *   number used
+    * @param firstMoved
+    *   Receives the first row whose entity changed
+    * @param endMoved
+    *   Receives the row after the last one whose entity changed, equal to
+    *   \a firstMoved if none did
+    *
+    * @return
+    *   \c true if the rows are not sorted yet
+    */
+    bool
+    sortStep(
+        size_t& budget,
+        size_t& firstMoved,
+        size_t& endMoved
+    );
+
+    std::unordered_map<ComponentTypeId, Archetype*> m_addEdges;
+
+    std::vector<std::vector<Component*>> m_columns;
+
+    // The types of m_columns, in the same order
+    Signature m_componentTypes;
+
+    std::vector<EntityId> m_entities;
+
+    // Sorted by address
+    std::vector<ArchetypeListener*> m_listeners;
+
+    ComponentMask m_mask;
+
+    std::unordered_map<ComponentTypeId, Archetype*> m_removeEdges;
+
+    Signature m_signature;
+
+    // The rows before this one are sorted by entity slot
+    size_t m_sortedRows = 0;
+
+};
+
+
+/**
+* @brief Interface for objects that track entities moving between archetypes
+*
+* Register a listener with EntityManager::addArchetypeListener. The manager
+* only notifies a listener about entities entering, changing within or
+* leaving the archetypes the listener is interested in.
+*/
+class ArchetypeListener {
+
+public:
+
+    /**
+    * @brief What happened to an entity that stays relevant to a listener
+    */
+    enum class Change {
+        Added,
+        Removed,
+        Replaced
+    };
+
+    /**
+    * @brief Destructor
+    */
+    virtual ~ArchetypeListener() = default;
+
+    /**
+    * @brief Whether this listener is interested in an archetype
+    *
+    * Called once for each archetype, the result must not change over time.
+    */
+    virtual bool
+    listensTo(
+        const Archetype& archetype
+    ) const = 0;
+
+    /**
+    * @brief Called when an entity moved into a relevant archetype
+    *
+    * @param entityId
+    *   The entity that moved
+    * @param archetype
+    *   The entity's new archetype
+    * @param row
+    *   The entity's row in \a archetype
+    */
+    virtual void
+    onEntityAdded(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row
+    ) = 0;
+
+    /**
+    * @brief Called when a batch of entities was created in a relevant archetype
+    *
+    * The default implementation calls onEntityAdded() for each entity.
+    *
+    * @param archetype
+    *   The archetype the entities were added to
+    * @param firstRow
+    *   The row of the first new entity in \a archetype
+    * @param count
+    *   The number of new entities, occupying consecutive rows
+    *
+    * @see EntityManager::createEntities
+    */
+    virtual void
+    onEntitiesAdded(
+        const Archetype& archetype,
+        size_t firstRow,
+        size_t count
+    );
+
+    /**
+    * @brief Called when a relevant entity changed but stays relevant
+    *
+    * @param entityId
+    *   The entity that changed
+    * @param archetype
+    *   The entity's (possibly new) archetype
+    * @param row
+    *   The entity's row in \a archetype
+    * @param typeId
+    *   The component type that was added, removed or replaced
+    * @param change
+    *   What happened to the component
+    */
+    virtual void
+    onEntityChanged(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row,
+        ComponentTypeId typeId,
+        Change change
+    ) = 0;
+
+    /**
+    * @brief Called when an entity left the relevant archetypes
+    *
+    * @param entityId
+    *   The entity that moved
+    */
+    virtual void
+    onEntityRemoved(
+        EntityId entityId
+    ) = 0;
+
+};
+
+}
@@ -0,0 +1,213 @@
+#include "engine/asset_pack.h"
+
+#include <algorithm>
+#include <array>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+const std::array<char, 8> MAGIC = {{
+    'T', 'H', 'R', 'I', 'V', 'E', 'P', 'K'
+}};
+
+const uint32_t VERSION = 1;
+
+
+void
+writeUint(
+    std::string& buffer,
+    uint64_t value,
+    size_t bytes
+) {
+    for (size_t i = 0; i < bytes; ++i) {
+        buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+
+// Reads a little endian integer from the mapped pack
+uint64_t
+readUint(
+    const char* data,
+    size_t size,
+    size_t& offset,
+    size_t bytes
+) {
+    if (offset > size or size - offset < bytes) {
+        throw std::runtime_error("Corrupt asset pack: unexpected end of index");
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[offset + i])) << (8 * i);
+    }
+    offset += bytes;
+    return value;
+}
+
+
+size_t
+aligned(
+    size_t offset
+) {
+    return (offset + AssetPack::ALIGNMENT - 1) / AssetPack::ALIGNMENT * AssetPack::ALIGNMENT;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AssetPack
+////////////////////////////////////////////////////////////////////////////////
+
+const size_t AssetPack::ALIGNMENT;
+
+
+struct AssetPack::Implementation {
+
+    std::vector<File> m_files;
+
+    boost::iostreams::mapped_file_source m_mapping;
+
+    boost::filesystem::path m_path;
+
+};
+
+
+AssetPack::AssetPack(
+    const boost::filesystem::path& path
+) : m_impl(new Implementation())
+{
+    m_impl->m_path = path;
+    try {
+        m_impl->m_mapping.open(path.string());
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error("Can't map asset pack " + path.string() + ": " + e.what());
+    }
+    const char* data = m_impl->m_mapping.data();
+    size_t size = m_impl->m_mapping.size();
+    if (size < MAGIC.size() or not std::equal(MAGIC.begin(), MAGIC.end(), data)) {
+        throw std::runtime_error("Not an asset pack: " + path.string());
+    }
+    size_t offset = MAGIC.size();
+    if (readUint(data, size, offset, 4) != VERSION) {
+        throw std::runtime_error("Unsupported asset pack version: " + path.string());
+    }
+    uint64_t fileCount = readUint(data, size, offset, 4);
+    m_impl->m_files.reserve(fileCount);
+    for (uint64_t i = 0; i < fileCount; ++i) {
+        size_t nameLength = readUint(data, size, offset, 2);
+        if (size - offset < nameLength) {
+            throw std::runtime_error("Corrupt asset pack: unexpected end of index");
+        }
+        File file;
+        file.name.assign(data + offset, nameLength);
+        offset += nameLength;
+        uint64_t fileOffset = readUint(data, size, offset, 8);
+        file.size = readUint(data, size, offset, 8);
+        if (fileOffset > size or size - fileOffset < file.size) {
+            throw std::runtime_error("Corrupt asset pack: file out of bounds: " + file.name);
+        }
+        file.data = data + fileOffset;
+        m_impl->m_files.push_back(std::move(file));
+    }
+    if (not std::is_sorted(m_impl->m_files.begin(), m_impl->m_files.end(),
+        [] (const File& left, const File& right) {
+            return left.name < right.name;
+        }
+    )) {
+        throw std::runtime_error("Corrupt asset pack: index not sorted");
+    }
+}
+
+
+AssetPack::~AssetPack() {}
+
+
+const std::vector<AssetPack::File>&
+AssetPack::files() const {
+    return m_impl->m_files;
+}
+
+
+const AssetPack::File*
+AssetPack::find(
+    const std::string& name
+) const {
+    const auto& files = m_impl->m_files;
+    auto iter = std::lower_bound(files.begin(), files.end(), name,
+        [] (const File& file, const std::string& name) {
+            return file.name < name;
+        }
+    );
+    if (iter == files.end() or iter->name != name) {
+        return nullptr;
+    }
+    return &*iter;
+}
+
+
+const boost::filesystem::path&
+AssetPack::path() const {
+    return m_impl->m_path;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// AssetPackWriter
+////////////////////////////////////////////////////////////////////////////////
+
+void
+AssetPackWriter::add(
+    const std::string& name,
+    std::string data
+) {
+    m_files[name] = std::move(data);
+}
+
+
+void
+AssetPackWriter::write(
+    const boost::filesystem::path& path
+) const {
+    std::string index(MAGIC.begin(), MAGIC.end());
+    writeUint(index, VERSION, 4);
+    writeUint(index, m_files.size(), 4);
+    size_t indexSize = index.size();
+    for (const auto& pair : m_files) {
+        if (pair.first.size() > 0xFFFF) {
+            throw std::runtime_error("Asset name too long: " + pair.first);
+        }
+        indexSize += 2 + pair.first.size() + 8 + 8;
+    }
+    // The files are sorted by name, since the map is
+    size_t offset = aligned(indexSize);
+    for (const auto& pair : m_files) {
+        writeUint(index, pair.first.size(), 2);
+        index += pair.first;
+        writeUint(index, offset, 8);
+        writeUint(index, pair.second.size(), 8);
+        offset = aligned(offset + pair.second.size());
+    }
+    std::ofstream stream(path.string(), std::ios::binary | std::ios::trunc);
+    if (not stream) {
+        throw std::runtime_error("Can't write asset pack " + path.string());
+    }
+    stream.write(index.data(), index.size());
+    size_t written = index.size();
+    const char padding[AssetPack::ALIGNMENT] = {};
+    for (const auto& pair : m_files) {
+        stream.write(padding, aligned(written) - written);
+        written = aligned(written);
+        stream.write(pair.second.data(), pair.second.size());
+        written += pair.second.size();
+    }
+    if (not stream) {
+        throw std::runtime_error("Can't write asset pack " + path.string());
+    }
+}
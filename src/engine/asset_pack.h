@@ -0,0 +1,154 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A read-only archive of asset files, mapped into memory
+*
+* Packs are written by AssetPackWriter during the asset build (see the
+* \c build_assets target). The pack starts with a magic number, a version
+* and the number of files, followed by an index of the files' names,
+* offsets and sizes. The files' contents follow the index, each aligned to
+* ALIGNMENT bytes.
+*
+* The whole pack is mapped into memory when it is opened. Opening a file
+* only looks it up in the index, its contents are paged in by the OS when
+* they are first read. The memory stays valid as long as the pack exists.
+*/
+class AssetPack {
+
+public:
+
+    /**
+    * @brief Alignment of the files' contents within the pack
+    *
+    * Large enough for any data that is read in place, like DXT blocks.
+    */
+    static const size_t ALIGNMENT = 16;
+
+    /**
+    * @brief A file in the pack
+    */
+    struct File {
+
+        /**
+        * @brief The file's contents, in the mapped memory
+        */
+        const char* data = nullptr;
+
+        /**
+        * @brief The file's name, relative to the packed directory
+        */
+        std::string name;
+
+        /**
+        * @brief The file's size in bytes
+        */
+        size_t size = 0;
+
+    };
+
+    /**
+    * @brief Opens a pack
+    *
+    * @param path
+    *   The pack file
+    *
+    * @throw std::runtime_error
+    *   If the file can't be mapped or is not a valid pack
+    */
+    explicit AssetPack(
+        const boost::filesystem::path& path
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~AssetPack();
+
+    /**
+    * @brief The packed files, sorted by name
+    */
+    const std::vector<File>&
+    files() const;
+
+    /**
+    * @brief Looks up a file
+    *
+    * @param name
+    *   The file's name, relative to the packed directory
+    *
+    * @return
+    *   The file or \c null if the pack doesn't have it
+    */
+    const File*
+    find(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief The pack's path
+    */
+    const boost::filesystem::path&
+    path() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
+/**
+* @brief Builds an AssetPack
+*/
+class AssetPackWriter {
+
+public:
+
+    /**
+    * @brief Adds a file
+    *
+    * A file with the same name is replaced.
+    *
+    * @param name
+    *   The file's name, relative to the packed directory. Use \c / to
+    *   separate directories.
+    * @param data
+    *   The file's contents
+    */
+    void
+    add(
+        const std::string& name,
+        std::string data
+    );
+
+    /**
+    * @brief Writes the pack
+    *
+    * @param path
+    *   The pack file, overwritten if it exists
+    *
+    * @throw std::runtime_error
+    *   If the file can't be written
+    */
+    void
+    write(
+        const boost::filesystem::path& path
+    ) const;
+
+private:
+
+    std::map<std::string, std::string> m_files;
+
+};
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+namespace thrive {
+
+// Entry points of the benchmark suites run by RunBenchmarks, see main.cpp.
+//
+// Each suite gets the command line without the suite's name, so argv[0]
+// is still the program name. Returns the process exit code.
+
+int
+runBindingsBenchmark(
+    int argc,
+    char* argv[]
+);
+
+int
+runEcsBenchmark(
+    int argc,
+    char* argv[]
+);
+
+int
+runPhysicsBenchmark(
+    int argc,
+    char* argv[]
+);
+
+int
+runReplayBenchmark(
+    int argc,
+    char* argv[]
+);
+
+int
+runSavegameBenchmark(
+    int argc,
+    char* argv[]
+);
+
+int
+runSoakBenchmark(
+    int argc,
+    char* argv[]
+);
+
+}
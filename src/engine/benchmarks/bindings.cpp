@@ -0,0 +1,364 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "engine/system.h"
+#include "game.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/lua_include.h"
+#include "scripting/lua_profiler.h"
+#include "scripting/luabind.h"
+#include "scripting/script_initializer.h"
+#include "util/make_unique.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace thrive;
+
+// Benchmarks the Lua bindings that the microbe stage scripts call the most,
+// in the game's own Lua state.
+//
+// Each case runs a Lua loop over one operation and prints one line of JSON
+// with the nanoseconds per operation of its fastest run:
+//
+//     RunBenchmarks bindings --case get_component --iterations 1000000
+//
+// The "loop" and "native_call" cases are baselines: an empty Lua loop and
+// a call of a plain lua_CFunction. What a binding costs beyond the latter
+// is luabind's overload resolution and argument conversion. Each case also
+// reports its Lua to C++ calls per operation, as counted by LuaProfiler.
+//
+// Without --case, all of them run.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Case {
+
+    const char* name;
+
+    // Defines a Lua function running an operation n times and returning
+    // how many operations it ran
+    const char* chunk;
+
+};
+
+const std::vector<Case> CASES = {
+    {"loop",
+        "return function(n)\n"
+        "    for i = 1, n do end\n"
+        "    return n\n"
+        "end\n"
+    },
+    {"native_call",
+        "return function(n)\n"
+        "    local f = benchmarkNoop\n"
+        "    for i = 1, n do f(i) end\n"
+        "    return n\n"
+        "end\n"
+    },
+    {"get_component",
+        "return function(n)\n"
+        "    local entity = Entity(benchmarkEntityId, benchmarkGameState)\n"
+        "    local typeId = OgreSceneNodeComponent.TYPE_ID\n"
+        "    for i = 1, n do entity:getComponent(typeId) end\n"
+        "    return n\n"
+        "end\n"
+    },
+    {"vector3",
+        "return function(n)\n"
+        "    for i = 1, n do Vector3(i, 0, 0) end\n"
+        "    return n\n"
+        "end\n"
+    },
+    {"transform_position",
+        "return function(n)\n"
+        "    local entity = Entity(benchmarkEntityId, benchmarkGameState)\n"
+        "    local transform = entity:getComponent(OgreSceneNodeComponent.TYPE_ID).transform\n"
+        "    for i = 1, n do local position = transform.position end\n"
+        "    return n\n"
+        "end\n"
+    },
+    // One operation per iterated entity
+    {"entity_filter",
+        "return function(n)\n"
+        "    local filter = EntityFilter({OgreSceneNodeComponent})\n"
+        "    filter:init(benchmarkGameState)\n"
+        "    local count = 0\n"
+        "    while count < n do\n"
+        "        for entityId in filter:entities() do count = count + 1 end\n"
+        "    end\n"
+        "    filter:shutdown()\n"
+        "    return count\n"
+        "end\n"
+    },
+    {"storage_get",
+        "return function(n)\n"
+        "    local storage = StorageContainer()\n"
+        "    storage:set(\"value\", 1.0)\n"
+        "    for i = 1, n do storage:get(\"value\", 0) end\n"
+        "    return n\n"
+        "end\n"
+    }
+};
+
+
+struct Options {
+
+    std::vector<const Case*> cases;
+
+    uint32_t entityCount = 1000;
+
+    uint32_t iterations = 1000000;
+
+    std::string label;
+
+    std::string outputFile;
+
+    unsigned int runs = 3;
+
+};
+
+
+struct Result {
+
+    double nativeCallsPerOp = 0.0;
+
+    double nsPerOp = 0.0;
+
+};
+
+
+int
+benchmarkNoop(
+    lua_State*
+) {
+    return 0;
+}
+
+
+// Leaves the case's function on the stack
+void
+loadCase(
+    lua_State* L,
+    const Case& benchmarkCase
+) {
+    if (luaL_loadstring(L, benchmarkCase.chunk) != 0 or lua_pcall(L, 0, 1, 0) != 0) {
+        std::string message = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw std::runtime_error(std::string(benchmarkCase.name) + ": " + message);
+    }
+}
+
+
+// Calls the case's function at the top of the stack, leaving it there,
+// and returns the number of operations
+double
+callCase(
+    lua_State* L,
+    const Case& benchmarkCase,
+    uint32_t iterations
+) {
+    lua_pushvalue(L, -1);
+    lua_pushnumber(L, iterations);
+    if (lua_pcall(L, 1, 1, 0) != 0) {
+        std::string message = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw std::runtime_error(std::string(benchmarkCase.name) + ": " + message);
+    }
+    double operations = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    return operations;
+}
+
+
+Result
+runCase(
+    lua_State* L,
+    const Case& benchmarkCase,
+    const Options& options
+) {
+    Result result;
+    loadCase(L, benchmarkCase);
+    // Warm up, and count the calls of a short run
+    LuaProfiler& profiler = Game::instance().engine().profiler();
+    profiler.reset();
+    profiler.setCountingCalls(true);
+    profiler.start(std::numeric_limits<int>::max());
+    double operations = 0.0;
+    std::string systemName = benchmarkCase.name;
+    {
+        LuaProfiler::SystemScope scope(&profiler, systemName);
+        operations = callCase(L, benchmarkCase, std::max<uint32_t>(options.iterations / 100, 1));
+    }
+    profiler.stop();
+    profiler.setCountingCalls(false);
+    result.nativeCallsPerOp = profiler.callCounts(systemName).nativeCalls / operations;
+    profiler.reset();
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    auto start = Clock::now();
+    operations = callCase(L, benchmarkCase, options.iterations);
+    result.nsPerOp = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / operations;
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    return result;
+}
+
+
+void
+printResult(
+    std::ostream& output,
+    const Case& benchmarkCase,
+    const Options& options,
+    const Result& best
+) {
+    output << "{\"benchmark\": \"bindings\""
+        << ", \"case\": \"" << benchmarkCase.name << "\""
+        << ", \"label\": \"" << options.label << "\""
+        << ", \"iterations\": " << options.iterations
+        << ", \"entities\": " << options.entityCount
+        << ", \"runs\": " << options.runs
+        << ", \"ns_per_op\": " << best.nsPerOp
+        << ", \"native_calls_per_op\": " << best.nativeCallsPerOp
+        << "}" << std::endl;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options
+) {
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--case") == 0 and hasValue) {
+            const char* name = argv[++i];
+            auto iter = std::find_if(CASES.begin(), CASES.end(),
+                [name] (const Case& benchmarkCase) {
+                    return std::strcmp(benchmarkCase.name, name) == 0;
+                }
+            );
+            if (iter == CASES.end()) {
+                return false;
+            }
+            options.cases.push_back(&*iter);
+        }
+        else if (std::strcmp(argv[i], "--entities") == 0 and hasValue) {
+            options.entityCount = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--iterations") == 0 and hasValue) {
+            options.iterations = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--label") == 0 and hasValue) {
+            options.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 and hasValue) {
+            options.runs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.cases.empty()) {
+        for (const Case& benchmarkCase : CASES) {
+            options.cases.push_back(&benchmarkCase);
+        }
+    }
+    return true;
+}
+
+
+// Sets up the Lua state like the game does, with a headless game state
+// of entities that have a scene node
+GameState*
+setupLua(
+    lua_State* L,
+    uint32_t entityCount
+) {
+    Engine& engine = Game::instance().engine();
+    GameState::Options gameStateOptions;
+    gameStateOptions.headless = true;
+    GameState* gameState = engine.createGameState(
+        "bindings",
+        std::vector<std::unique_ptr<System>>(),
+        [] () {},
+        gameStateOptions
+    );
+    engine.initGameState(gameState);
+    EntityManager& entityManager = gameState->entityManager();
+    EntityId firstId = NULL_ENTITY;
+    for (uint32_t i = 0; i < entityCount; ++i) {
+        EntityId id = entityManager.generateNewId();
+        entityManager.addComponent(id, make_unique<OgreSceneNodeComponent>());
+        if (firstId == NULL_ENTITY) {
+            firstId = id;
+        }
+    }
+    entityManager.processCommands();
+    initializeLua(L);
+    lua_register(L, "benchmarkNoop", &benchmarkNoop);
+    luabind::object globals = luabind::globals(L);
+    globals["benchmarkEntityId"] = firstId;
+    globals["benchmarkGameState"] = gameState;
+    return gameState;
+}
+
+}
+
+
+int
+thrive::runBindingsBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    if (not parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+            << " bindings [--case NAME]... [--iterations ITERATIONS] [--entities COUNT]"
+            << " [--runs RUNS] [--label LABEL] [--output FILE]\n\nCases:\n";
+        for (const Case& benchmarkCase : CASES) {
+            std::cerr << "    " << benchmarkCase.name << "\n";
+        }
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (not options.outputFile.empty()) {
+        outputFile.open(options.outputFile, std::ofstream::trunc);
+    }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    try {
+        Engine& engine = Game::instance().engine();
+        lua_State* L = engine.luaState();
+        setupLua(L, options.entityCount);
+        for (const Case* benchmarkCase : options.cases) {
+            // Keep the fastest run
+            Result best = runCase(L, *benchmarkCase, options);
+            for (unsigned int run = 1; run < options.runs; ++run) {
+                Result result = runCase(L, *benchmarkCase, options);
+                best.nsPerOp = std::min(best.nsPerOp, result.nsPerOp);
+            }
+            printResult(output, *benchmarkCase, options, best);
+        }
+        engine.shutdown();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,474 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "engine/component.h"
+#include "engine/component_collection.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/serialization.h"
+#include "engine/typedefs.h"
+#include "scripting/lua_state.h"
+#include "scripting/luabind.h"
+#include "scripting/script_entity_filter.h"
+#include "util/make_unique.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <luabind/object.hpp>
+#include <string>
+#include <vector>
+
+using namespace thrive;
+
+// Benchmarks the hot paths of the entity component system.
+//
+// Each case prints one line of JSON with the nanoseconds per operation of
+// its fastest run. Label the output with the commit to compare results
+// across commits:
+//
+//     RunBenchmarks ecs --label $(git rev-parse --short HEAD) --output ecs.jsonl
+//
+// Without --entities, each case runs with 1k, 10k and 100k entities. With
+// --case, only the named cases run.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template<int ID>
+class BenchmarkComponent : public Component {
+
+public:
+
+    static const ComponentTypeId TYPE_ID = ID + 20000;
+
+    ComponentTypeId
+    typeId() const override {
+        return TYPE_ID;
+    }
+
+    static const std::string&
+    TYPE_NAME() {
+        static std::string string = "BenchmarkComponent" + std::to_string(ID);
+        return string;
+    }
+
+    std::string
+    typeName() const override {
+        return TYPE_NAME();
+    }
+
+};
+
+using ComponentA = BenchmarkComponent<0>;
+using ComponentB = BenchmarkComponent<1>;
+
+
+// Times the part of a case that is measured
+class Timer {
+
+public:
+
+    void
+    start() {
+        m_start = Clock::now();
+    }
+
+    void
+    stop() {
+        m_elapsed += Clock::now() - m_start;
+    }
+
+    double
+    nanoseconds() const {
+        return std::chrono::duration<double, std::nano>(m_elapsed).count();
+    }
+
+private:
+
+    Clock::duration m_elapsed = Clock::duration::zero();
+
+    Clock::time_point m_start;
+
+};
+
+// Sets up a world of the given size and returns the number of operations
+// in the timed part
+using Case = std::function<size_t(uint32_t, Timer&)>;
+
+// Keeps the compiler from optimizing away the visited data
+volatile size_t g_sink = 0;
+
+
+struct Options {
+
+    std::vector<std::string> cases;
+
+    std::vector<uint32_t> entityCounts;
+
+    std::string label;
+
+    std::string outputFile;
+
+    unsigned int runs = 5;
+
+};
+
+
+std::vector<EntityId>
+createEntities(
+    EntityManager& entityManager,
+    uint32_t count,
+    bool withB
+) {
+    std::vector<EntityId> ids;
+    ids.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        EntityId id = entityManager.generateNewId();
+        entityManager.addComponent(id, make_unique<ComponentA>());
+        if (withB) {
+            entityManager.addComponent(id, make_unique<ComponentB>());
+        }
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cases
+////////////////////////////////////////////////////////////////////////////////
+
+size_t
+addComponent(
+    uint32_t count,
+    Timer& timer
+) {
+    EntityManager entityManager;
+    std::vector<EntityId> ids;
+    std::vector<std::unique_ptr<Component>> components;
+    for (uint32_t i = 0; i < count; ++i) {
+        ids.push_back(entityManager.generateNewId());
+        components.push_back(make_unique<ComponentA>());
+    }
+    timer.start();
+    for (uint32_t i = 0; i < count; ++i) {
+        entityManager.addComponent(ids[i], std::move(components[i]));
+    }
+    timer.stop();
+    return count;
+}
+
+
+size_t
+removeComponent(
+    uint32_t count,
+    Timer& timer
+) {
+    EntityManager entityManager;
+    std::vector<EntityId> ids = createEntities(entityManager, count, true);
+    timer.start();
+    for (EntityId id : ids) {
+        entityManager.removeComponent(id, ComponentB::TYPE_ID);
+    }
+    timer.stop();
+    return count;
+}
+
+
+size_t
+processCommands(
+    uint32_t count,
+    Timer& timer
+) {
+    EntityManager entityManager;
+    std::vector<EntityId> ids = createEntities(entityManager, count, true);
+    for (EntityId id : ids) {
+        entityManager.removeComponent(id, ComponentB::TYPE_ID);
+    }
+    timer.start();
+    entityManager.processCommands();
+    timer.stop();
+    return count;
+}
+
+
+size_t
+entityFilterIteration(
+    uint32_t count,
+    Timer& timer
+) {
+    const unsigned int PASSES = 10;
+    EntityManager entityManager;
+    createEntities(entityManager, count, true);
+    EntityFilter<ComponentA, ComponentB> filter;
+    filter.setEntityManager(&entityManager);
+    size_t sum = 0;
+    timer.start();
+    for (unsigned int pass = 0; pass < PASSES; ++pass) {
+        for (const auto& item : filter) {
+            sum += item.first + (std::get<1>(item.second) != nullptr);
+        }
+    }
+    timer.stop();
+    g_sink = sum;
+    filter.setEntityManager(nullptr);
+    return PASSES * count;
+}
+
+
+size_t
+entityFilterChurn(
+    uint32_t count,
+    Timer& timer
+) {
+    EntityManager entityManager;
+    std::vector<EntityId> ids = createEntities(entityManager, count, true);
+    EntityFilter<ComponentA, ComponentB> filter(true);
+    filter.setEntityManager(&entityManager);
+    timer.start();
+    for (EntityId id : ids) {
+        entityManager.removeComponent(id, ComponentB::TYPE_ID);
+    }
+    entityManager.processCommands();
+    for (EntityId id : ids) {
+        entityManager.addComponent(id, make_unique<ComponentB>());
+    }
+    filter.clearChanges();
+    timer.stop();
+    filter.setEntityManager(nullptr);
+    return 2 * count;
+}
+
+
+// Adding components with several observers of the collection's change log,
+// which replaced the change callbacks. Keeps the old name for comparison.
+size_t
+callbackDispatch(
+    uint32_t count,
+    Timer& timer
+) {
+    const unsigned int OBSERVERS = 8;
+    EntityManager entityManager;
+    ComponentCollection& collection = entityManager.getComponentCollection(
+        ComponentA::TYPE_ID
+    );
+    std::vector<unsigned int> observers;
+    for (unsigned int i = 0; i < OBSERVERS; ++i) {
+        observers.push_back(collection.registerObserver());
+    }
+    std::vector<EntityId> ids;
+    std::vector<std::unique_ptr<Component>> components;
+    for (uint32_t i = 0; i < count; ++i) {
+        ids.push_back(entityManager.generateNewId());
+        components.push_back(make_unique<ComponentA>());
+    }
+    timer.start();
+    for (uint32_t i = 0; i < count; ++i) {
+        entityManager.addComponent(ids[i], std::move(components[i]));
+    }
+    std::vector<ComponentCollection::Change> changes;
+    size_t calls = 0;
+    for (unsigned int observer : observers) {
+        collection.takeChanges(observer, changes);
+        calls += changes.size();
+    }
+    timer.stop();
+    g_sink = calls;
+    return count;
+}
+
+
+size_t
+scriptEntityFilterChurn(
+    uint32_t count,
+    Timer& timer
+) {
+    LuaState L;
+    luabind::open(L);
+    // Component classes only need their type id here
+    luabind::object componentTypes = luabind::newtable(L);
+    luabind::object typeA = luabind::newtable(L);
+    typeA["TYPE_ID"] = ComponentA::TYPE_ID;
+    luabind::object typeB = luabind::newtable(L);
+    typeB["TYPE_ID"] = ComponentB::TYPE_ID;
+    componentTypes[1] = typeA;
+    componentTypes[2] = typeB;
+    EntityManager entityManager;
+    std::vector<EntityId> ids = createEntities(entityManager, count, true);
+    ScriptEntityFilter filter(componentTypes, true);
+    filter.setEntityManager(&entityManager);
+    timer.start();
+    for (EntityId id : ids) {
+        entityManager.removeComponent(id, ComponentB::TYPE_ID);
+    }
+    entityManager.processCommands();
+    for (EntityId id : ids) {
+        entityManager.addComponent(id, make_unique<ComponentB>());
+    }
+    filter.clearChanges();
+    timer.stop();
+    filter.setEntityManager(nullptr);
+    return 2 * count;
+}
+
+
+const std::vector<std::string>&
+storageKeys() {
+    static const std::vector<std::string> keys = {
+        "angularDamping", "angularFactor", "friction", "hasContactResponse",
+        "kinematic", "linearDamping", "linearFactor", "mass",
+        "meshName", "orientation", "owner", "parentId",
+        "position", "rollingFriction", "rotation", "scale"
+    };
+    return keys;
+}
+
+
+size_t
+storageSet(
+    uint32_t count,
+    Timer& timer
+) {
+    const auto& keys = storageKeys();
+    StorageContainer storage;
+    timer.start();
+    for (uint32_t i = 0; i < count; ++i) {
+        storage.set<float>(keys[i % keys.size()], static_cast<float>(i));
+    }
+    timer.stop();
+    return count;
+}
+
+
+size_t
+storageGet(
+    uint32_t count,
+    Timer& timer
+) {
+    const auto& keys = storageKeys();
+    StorageContainer storage;
+    for (const std::string& key : keys) {
+        storage.set<float>(key, 1.0f);
+    }
+    float sum = 0.0f;
+    timer.start();
+    for (uint32_t i = 0; i < count; ++i) {
+        sum += storage.get<float>(keys[i % keys.size()]);
+    }
+    timer.stop();
+    g_sink = static_cast<size_t>(sum);
+    return count;
+}
+
+
+const std::vector<std::pair<const char*, Case>>&
+cases() {
+    static const std::vector<std::pair<const char*, Case>> cases = {
+        {"addComponent", &addComponent},
+        {"removeComponent", &removeComponent},
+        {"processCommands", &processCommands},
+        {"entityFilterIteration", &entityFilterIteration},
+        {"entityFilterChurn", &entityFilterChurn},
+        {"callbackDispatch", &callbackDispatch},
+        {"scriptEntityFilterChurn", &scriptEntityFilterChurn},
+        {"storageSet", &storageSet},
+        {"storageGet", &storageGet}
+    };
+    return cases;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options
+) {
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--case") == 0 and hasValue) {
+            options.cases.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--entities") == 0 and hasValue) {
+            options.entityCounts.push_back(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--label") == 0 and hasValue) {
+            options.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 and hasValue) {
+            options.runs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.entityCounts.empty()) {
+        options.entityCounts = {1000, 10000, 100000};
+    }
+    return true;
+}
+
+}
+
+
+int
+thrive::runEcsBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    if (not parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+            << " ecs [--case NAME]... [--entities COUNT]... [--label LABEL]"
+            << " [--output FILE] [--runs RUNS]" << std::endl;
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (not options.outputFile.empty()) {
+        outputFile.open(options.outputFile, std::ofstream::trunc);
+    }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    try {
+        for (const auto& pair : cases()) {
+            const std::string name = pair.first;
+            if (
+                not options.cases.empty() and
+                std::find(options.cases.begin(), options.cases.end(), name) == options.cases.end()
+            ) {
+                continue;
+            }
+            for (uint32_t entityCount : options.entityCounts) {
+                // Keep the fastest run
+                double best = 0.0;
+                size_t operations = 0;
+                for (unsigned int run = 0; run < options.runs; ++run) {
+                    Timer timer;
+                    operations = pair.second(entityCount, timer);
+                    double nanoseconds = timer.nanoseconds() / std::max<size_t>(operations, 1);
+                    best = run == 0 ? nanoseconds : std::min(best, nanoseconds);
+                }
+                output << "{\"benchmark\": \"ecs\""
+                    << ", \"case\": \"" << name << "\""
+                    << ", \"label\": \"" << options.label << "\""
+                    << ", \"entities\": " << entityCount
+                    << ", \"operations\": " << operations
+                    << ", \"runs\": " << options.runs
+                    << ", \"ns_per_op\": " << best
+                    << "}" << std::endl;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace thrive;
+
+// Runs one benchmark suite:
+//
+//     RunBenchmarks SUITE [OPTIONS]
+//
+// See the suites' sources for their options.
+
+namespace {
+
+struct Suite {
+
+    const char* name;
+
+    int (*run)(int, char*[]);
+
+};
+
+const Suite SUITES[] = {
+    {"bindings", &runBindingsBenchmark},
+    {"ecs", &runEcsBenchmark},
+    {"physics", &runPhysicsBenchmark},
+    {"replay", &runReplayBenchmark},
+    {"savegame", &runSavegameBenchmark},
+    {"soak", &runSoakBenchmark}
+};
+
+}
+
+
+int
+main(
+    int argc,
+    char* argv[]
+) {
+    if (argc >= 2) {
+        for (const Suite& suite : SUITES) {
+            if (std::strcmp(argv[1], suite.name) == 0) {
+                // Drop the suite's name, but keep the program's
+                std::vector<char*> arguments(argv, argv + argc);
+                arguments.erase(arguments.begin() + 1);
+                arguments.push_back(nullptr);
+                return suite.run(argc - 1, arguments.data());
+            }
+        }
+    }
+    std::cerr << "Usage: " << argv[0] << " SUITE [OPTIONS]\n\nSuites:\n";
+    for (const Suite& suite : SUITES) {
+        std::cerr << "    " << suite.name << "\n";
+    }
+    return 2;
+}
@@ -0,0 +1,596 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "bullet/bullet_to_ogre_system.h"
+#include "bullet/collision_shape.h"
+#include "bullet/collision_system.h"
+#include "bullet/rigid_body_system.h"
+#include "bullet/update_physics_system.h"
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/event_bus.h"
+#include "engine/game_state.h"
+#include "engine/system.h"
+#include "microbe_stage/agent.h"
+#include "ogre/scene_node_system.h"
+#include "util/make_unique.h"
+
+#include <algorithm>
+#include <btBulletDynamicsCommon.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace thrive;
+
+// Benchmarks the physics of reproducible microbe stage scenes, through
+// the same systems and components as the game, in a headless game state.
+//
+// Each case prints one line of JSON with the mean microseconds per tick of
+// every system, measured separately, for its fastest run:
+//
+//     RunBenchmarks physics --scenario sensors --microbes 1000 --broadphase axis-sweep
+//
+// The scenarios are:
+// - sensors: Microbes with compound shapes among kinematic agent bodies,
+//   which are absorbed through collision filters
+// - particles: The same, but the agents are particles without a body
+// - pile: Microbes pushed into each other at the world's center
+// - sparse: Microbes spread over the whole world, rarely touching
+//
+// Without --scenario, all of them run. Without --microbes, each runs with
+// 100 and 1000 microbes. Sensor scenarios have --agents agents around
+// each microbe. Absorbed agents come back after each tick, so the load
+// stays the same over the run.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Agents are absorbed by the microbes' collision shapes
+const AgentId AGENT_ID = 1;
+
+// Long enough to not matter, absorbed agents are reset to it
+const Milliseconds AGENT_TIME_TO_LIVE = 1000000;
+
+const int TICK_MILLISECONDS = 16;
+
+const unsigned int TICK_RATE = 60;
+
+enum class Scenario {
+    Sensors,
+    Particles,
+    Pile,
+    Sparse
+};
+
+const std::vector<std::pair<const char*, Scenario>> SCENARIOS = {
+    {"sensors", Scenario::Sensors},
+    {"particles", Scenario::Particles},
+    {"pile", Scenario::Pile},
+    {"sparse", Scenario::Sparse}
+};
+
+
+struct Options {
+
+    unsigned int agentsPerMicrobe = 10;
+
+    GameState::Options::Broadphase broadphase = GameState::Options::Broadphase::Dbvt;
+
+    std::string label;
+
+    std::vector<uint32_t> microbeCounts;
+
+    bool multithreaded = false;
+
+    std::string outputFile;
+
+    unsigned int runs = 3;
+
+    std::vector<Scenario> scenarios;
+
+    unsigned int ticks = 300;
+
+    // Not measured, the first ticks create the bodies
+    unsigned int warmupTicks = 30;
+
+};
+
+
+// Microseconds per tick, by system
+struct Result {
+
+    double agentAbsorber = 0.0;
+
+    double bulletToOgre = 0.0;
+
+    double collision = 0.0;
+
+    double rigidBodyInput = 0.0;
+
+    double rigidBodyOutput = 0.0;
+
+    double stepSimulation = 0.0;
+
+    // Last tick's, not timed
+    size_t absorbed = 0;
+
+    size_t contactManifolds = 0;
+
+    size_t overlappingPairs = 0;
+
+    double
+    total() const {
+        return agentAbsorber + bulletToOgre + collision + rigidBodyInput +
+            rigidBodyOutput + stepSimulation;
+    }
+
+};
+
+
+// Times one system's updates
+class SystemTimer {
+
+public:
+
+    SystemTimer(
+        System* system
+    ) : m_system(system)
+    {
+    }
+
+    void
+    update(
+        bool isMeasured
+    ) {
+        auto start = Clock::now();
+        m_system->update(TICK_MILLISECONDS);
+        if (isMeasured) {
+            m_elapsed += Clock::now() - start;
+        }
+    }
+
+    double
+    microsecondsPerTick(
+        unsigned int ticks
+    ) const {
+        return std::chrono::duration<double, std::micro>(m_elapsed).count() / std::max(1u, ticks);
+    }
+
+private:
+
+    Clock::duration m_elapsed = Clock::duration::zero();
+
+    System* m_system;
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene
+////////////////////////////////////////////////////////////////////////////////
+
+// Creates the entities of a scenario, like Microbe.createMicrobeEntity
+// and the agent emitters would
+class SceneBuilder {
+
+public:
+
+    SceneBuilder(
+        EntityManager& entityManager
+    ) : m_entityManager(entityManager),
+        m_random(42),
+        m_microbeShape(microbeShape())
+    {
+    }
+
+    // Agents in a ring around a microbe, within reach of its movement
+    void
+    addAgents(
+        const Ogre::Vector3& center,
+        unsigned int count,
+        bool withBody
+    ) {
+        for (unsigned int i = 0; i < count; ++i) {
+            Ogre::Radian angle(this->real(0, 6.28f));
+            Ogre::Real distance = this->real(1.5f, 6.0f);
+            Ogre::Vector3 position = center + Ogre::Vector3(
+                distance * Ogre::Math::Cos(angle),
+                distance * Ogre::Math::Sin(angle),
+                0
+            );
+            EntityId id = m_entityManager.generateNewId();
+            auto agent = make_unique<AgentComponent>();
+            agent->m_agentId = AGENT_ID;
+            agent->m_potency = 1.0f;
+            agent->m_timeToLive = AGENT_TIME_TO_LIVE;
+            m_agents.push_back(agent.get());
+            m_entityManager.addComponent(id, std::move(agent));
+            auto sceneNode = make_unique<OgreSceneNodeComponent>();
+            sceneNode->m_transform.position = position;
+            sceneNode->m_transform.touch();
+            m_entityManager.addComponent(id, std::move(sceneNode));
+            if (not withBody) {
+                continue;
+            }
+            // Like agents in savegames from before agent particles
+            auto rigidBody = make_unique<RigidBodyComponent>();
+            rigidBody->m_properties->shape = std::make_shared<SphereShape>(0.2f);
+            rigidBody->m_properties->hasContactResponse = false;
+            rigidBody->m_properties->kinematic = true;
+            rigidBody->m_properties->touch();
+            rigidBody->m_dynamicProperties.position = position;
+            rigidBody->m_dynamicProperties.touch();
+            m_entityManager.addComponent(id, std::move(rigidBody));
+            m_entityManager.addComponent(id, make_unique<CollisionComponent>("agent"));
+        }
+    }
+
+    Ogre::Vector3
+    addMicrobe(
+        const Ogre::Vector3& position,
+        const Ogre::Vector3& velocity
+    ) {
+        EntityId id = m_entityManager.generateNewId();
+        auto rigidBody = make_unique<RigidBodyComponent>();
+        rigidBody->m_properties->shape = m_microbeShape;
+        rigidBody->m_properties->linearFactor = Ogre::Vector3(1, 1, 0);
+        rigidBody->m_properties->angularFactor = Ogre::Vector3(0, 0, 1);
+        rigidBody->m_properties->friction = 0.2f;
+        rigidBody->m_properties->linearDamping = 0.0f;
+        rigidBody->m_properties->touch();
+        rigidBody->m_dynamicProperties.position = position;
+        rigidBody->m_dynamicProperties.rotation.FromAngleAxis(
+            Ogre::Radian(this->real(0, 6.28f)),
+            Ogre::Vector3::UNIT_Z
+        );
+        rigidBody->m_dynamicProperties.linearVelocity = velocity;
+        rigidBody->m_dynamicProperties.angularVelocity = Ogre::Vector3(0, 0, this->real(-1, 1));
+        rigidBody->m_dynamicProperties.touch();
+        m_entityManager.addComponent(id, std::move(rigidBody));
+        m_entityManager.addComponent(id, make_unique<CollisionComponent>("microbe"));
+        auto absorber = make_unique<AgentAbsorberComponent>();
+        absorber->setCanAbsorbAgent(AGENT_ID, true);
+        m_entityManager.addComponent(id, std::move(absorber));
+        m_entityManager.addComponent(id, make_unique<OgreSceneNodeComponent>());
+        return position;
+    }
+
+    void
+    build(
+        Scenario scenario,
+        uint32_t microbeCount,
+        unsigned int agentsPerMicrobe
+    ) {
+        // About 25 square units per microbe, as in a crowded patch of the
+        // stage
+        Ogre::Real extent = 5.0f * std::sqrt(static_cast<Ogre::Real>(microbeCount));
+        for (uint32_t i = 0; i < microbeCount; ++i) {
+            switch (scenario) {
+                case Scenario::Sensors:
+                case Scenario::Particles:
+                {
+                    Ogre::Vector3 position = this->addMicrobe(
+                        this->vector(extent / 2),
+                        this->vector(1.0f)
+                    );
+                    this->addAgents(position, agentsPerMicrobe, scenario == Scenario::Sensors);
+                    break;
+                }
+                case Scenario::Pile:
+                {
+                    // A quarter of the space, all heading for the center
+                    Ogre::Vector3 position = this->vector(extent / 4);
+                    this->addMicrobe(position, -0.5f * position.normalisedCopy());
+                    break;
+                }
+                case Scenario::Sparse:
+                    this->addMicrobe(this->vector(900.0f), this->vector(1.0f));
+                    break;
+            }
+        }
+    }
+
+    // Brings back the agents absorbed in the last tick
+    size_t
+    resetAbsorbedAgents() {
+        size_t absorbed = 0;
+        for (AgentComponent* agent : m_agents) {
+            if (agent->m_timeToLive <= 0) {
+                agent->m_timeToLive = AGENT_TIME_TO_LIVE;
+                absorbed += 1;
+            }
+        }
+        return absorbed;
+    }
+
+private:
+
+    // A membrane with two organelles sticking out
+    static CollisionShape::Ptr
+    microbeShape() {
+        auto shape = std::make_shared<CompoundShape>();
+        shape->addChildShape(
+            Ogre::Vector3::ZERO,
+            Ogre::Quaternion::IDENTITY,
+            std::make_shared<SphereShape>(1.0f)
+        );
+        shape->addChildShape(
+            Ogre::Vector3(1.2f, 0, 0),
+            Ogre::Quaternion::IDENTITY,
+            std::make_shared<BoxShape>(Ogre::Vector3(0.4f, 0.4f, 0.4f))
+        );
+        shape->addChildShape(
+            Ogre::Vector3(-0.6f, 0.9f, 0),
+            Ogre::Quaternion::IDENTITY,
+            std::make_shared<CapsuleShape>(CollisionShape::AXIS_X, 0.3f, 0.6f)
+        );
+        return shape;
+    }
+
+    float
+    real(
+        float min,
+        float max
+    ) {
+        return std::uniform_real_distribution<float>(min, max)(m_random);
+    }
+
+    Ogre::Vector3
+    vector(
+        Ogre::Real extent
+    ) {
+        return Ogre::Vector3(this->real(-extent, extent), this->real(-extent, extent), 0);
+    }
+
+    std::vector<AgentComponent*> m_agents;
+
+    EntityManager& m_entityManager;
+
+    std::mt19937 m_random;
+
+    CollisionShape::Ptr m_microbeShape;
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cases
+////////////////////////////////////////////////////////////////////////////////
+
+Result
+runCase(
+    Scenario scenario,
+    uint32_t microbeCount,
+    const Options& options
+) {
+    Engine engine;
+    std::vector<std::unique_ptr<System>> systems;
+    // In the order of the microbe stage, see microbe_stage/setup.lua
+    auto agentAbsorber = make_unique<AgentAbsorberSystem>();
+    auto rigidBodyInput = make_unique<RigidBodyInputSystem>();
+    auto updatePhysics = make_unique<UpdatePhysicsSystem>();
+    auto rigidBodyOutput = make_unique<RigidBodyOutputSystem>();
+    auto bulletToOgre = make_unique<BulletToOgreSystem>();
+    auto collision = make_unique<CollisionSystem>();
+    SystemTimer agentAbsorberTimer(agentAbsorber.get());
+    SystemTimer rigidBodyInputTimer(rigidBodyInput.get());
+    SystemTimer updatePhysicsTimer(updatePhysics.get());
+    SystemTimer rigidBodyOutputTimer(rigidBodyOutput.get());
+    SystemTimer bulletToOgreTimer(bulletToOgre.get());
+    SystemTimer collisionTimer(collision.get());
+    systems.push_back(std::move(agentAbsorber));
+    systems.push_back(std::move(rigidBodyInput));
+    systems.push_back(std::move(updatePhysics));
+    systems.push_back(std::move(rigidBodyOutput));
+    systems.push_back(std::move(bulletToOgre));
+    systems.push_back(std::move(collision));
+    GameState::Options gameStateOptions;
+    gameStateOptions.broadphase = options.broadphase;
+    gameStateOptions.headless = true;
+    gameStateOptions.multithreadedPhysics = options.multithreaded;
+    gameStateOptions.planarPhysics = true;
+    GameState* gameState = engine.createGameState(
+        "physics",
+        std::move(systems),
+        [] () {},
+        gameStateOptions
+    );
+    gameState->setTickRate(TICK_RATE);
+    engine.initGameState(gameState);
+    EntityManager& entityManager = gameState->entityManager();
+    SceneBuilder builder(entityManager);
+    builder.build(scenario, microbeCount, options.agentsPerMicrobe);
+    Result result;
+    for (unsigned int tick = 0; tick < options.warmupTicks + options.ticks; ++tick) {
+        bool isMeasured = tick >= options.warmupTicks;
+        agentAbsorberTimer.update(isMeasured);
+        rigidBodyInputTimer.update(isMeasured);
+        updatePhysicsTimer.update(isMeasured);
+        rigidBodyOutputTimer.update(isMeasured);
+        bulletToOgreTimer.update(isMeasured);
+        collisionTimer.update(isMeasured);
+        entityManager.processCommands();
+        gameState->events().endFrame();
+        result.absorbed = builder.resetAbsorbedAgents();
+    }
+    result.agentAbsorber = agentAbsorberTimer.microsecondsPerTick(options.ticks);
+    result.bulletToOgre = bulletToOgreTimer.microsecondsPerTick(options.ticks);
+    result.collision = collisionTimer.microsecondsPerTick(options.ticks);
+    result.rigidBodyInput = rigidBodyInputTimer.microsecondsPerTick(options.ticks);
+    result.rigidBodyOutput = rigidBodyOutputTimer.microsecondsPerTick(options.ticks);
+    result.stepSimulation = updatePhysicsTimer.microsecondsPerTick(options.ticks);
+    btDiscreteDynamicsWorld* world = gameState->physicsWorld();
+    result.contactManifolds = world->getDispatcher()->getNumManifolds();
+    result.overlappingPairs = world->getPairCache()->getNumOverlappingPairs();
+    engine.shutdown();
+    return result;
+}
+
+
+const char*
+scenarioName(
+    Scenario scenario
+) {
+    for (const auto& pair : SCENARIOS) {
+        if (pair.second == scenario) {
+            return pair.first;
+        }
+    }
+    return "unknown";
+}
+
+
+void
+printResult(
+    std::ostream& output,
+    Scenario scenario,
+    uint32_t microbeCount,
+    const Options& options,
+    const Result& best
+) {
+    bool hasAgents = scenario == Scenario::Sensors or scenario == Scenario::Particles;
+    output << "{\"benchmark\": \"physics\""
+        << ", \"scenario\": \"" << scenarioName(scenario) << "\""
+        << ", \"label\": \"" << options.label << "\""
+        << ", \"microbes\": " << microbeCount
+        << ", \"agents\": " << (hasAgents ? microbeCount * options.agentsPerMicrobe : 0)
+        << ", \"broadphase\": \""
+        << (options.broadphase == GameState::Options::Broadphase::Dbvt ? "dbvt" : "axis-sweep")
+        << "\""
+        << ", \"multithreaded\": " << (options.multithreaded ? "true" : "false")
+        << ", \"ticks\": " << options.ticks
+        << ", \"runs\": " << options.runs
+        << ", \"agent_absorber_us\": " << best.agentAbsorber
+        << ", \"rigid_body_input_us\": " << best.rigidBodyInput
+        << ", \"step_simulation_us\": " << best.stepSimulation
+        << ", \"rigid_body_output_us\": " << best.rigidBodyOutput
+        << ", \"bullet_to_ogre_us\": " << best.bulletToOgre
+        << ", \"collision_us\": " << best.collision
+        << ", \"total_us\": " << best.total()
+        << ", \"absorbed_per_tick\": " << best.absorbed
+        << ", \"overlapping_pairs\": " << best.overlappingPairs
+        << ", \"contact_manifolds\": " << best.contactManifolds
+        << "}" << std::endl;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options
+) {
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--agents") == 0 and hasValue) {
+            options.agentsPerMicrobe = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--broadphase") == 0 and hasValue) {
+            std::string name = argv[++i];
+            if (name == "dbvt") {
+                options.broadphase = GameState::Options::Broadphase::Dbvt;
+            }
+            else if (name == "axis-sweep") {
+                options.broadphase = GameState::Options::Broadphase::AxisSweep;
+            }
+            else {
+                return false;
+            }
+        }
+        else if (std::strcmp(argv[i], "--label") == 0 and hasValue) {
+            options.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--microbes") == 0 and hasValue) {
+            options.microbeCounts.push_back(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--multithreaded") == 0) {
+            options.multithreaded = true;
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 and hasValue) {
+            options.runs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--scenario") == 0 and hasValue) {
+            const char* name = argv[++i];
+            auto iter = std::find_if(SCENARIOS.begin(), SCENARIOS.end(),
+                [name] (const std::pair<const char*, Scenario>& pair) {
+                    return std::strcmp(pair.first, name) == 0;
+                }
+            );
+            if (iter == SCENARIOS.end()) {
+                return false;
+            }
+            options.scenarios.push_back(iter->second);
+        }
+        else if (std::strcmp(argv[i], "--ticks") == 0 and hasValue) {
+            options.ticks = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.microbeCounts.empty()) {
+        options.microbeCounts = {100, 1000};
+    }
+    if (options.scenarios.empty()) {
+        for (const auto& pair : SCENARIOS) {
+            options.scenarios.push_back(pair.second);
+        }
+    }
+    return true;
+}
+
+}
+
+
+int
+thrive::runPhysicsBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    if (not parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+            << " physics [--scenario sensors|particles|pile|sparse]... [--microbes COUNT]..."
+            << " [--agents PER_MICROBE] [--broadphase dbvt|axis-sweep] [--multithreaded]"
+            << " [--ticks TICKS] [--runs RUNS] [--label LABEL] [--output FILE]" << std::endl;
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (not options.outputFile.empty()) {
+        outputFile.open(options.outputFile, std::ofstream::trunc);
+    }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    try {
+        for (Scenario scenario : options.scenarios) {
+            for (uint32_t microbeCount : options.microbeCounts) {
+                // Keep the fastest run of each system
+                Result best = runCase(scenario, microbeCount, options);
+                for (unsigned int run = 1; run < options.runs; ++run) {
+                    Result result = runCase(scenario, microbeCount, options);
+                    best.agentAbsorber = std::min(best.agentAbsorber, result.agentAbsorber);
+                    best.bulletToOgre = std::min(best.bulletToOgre, result.bulletToOgre);
+                    best.collision = std::min(best.collision, result.collision);
+                    best.rigidBodyInput = std::min(best.rigidBodyInput, result.rigidBodyInput);
+                    best.rigidBodyOutput = std::min(best.rigidBodyOutput, result.rigidBodyOutput);
+                    best.stepSimulation = std::min(best.stepSimulation, result.stepSimulation);
+                }
+                printResult(output, scenario, microbeCount, options, best);
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,665 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "engine/allocation_tracker.h"
+#include "engine/engine.h"
+#include "engine/game_state.h"
+#include "engine/input_recording.h"
+#include "engine/system_profiler.h"
+#include "game.h"
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+// Plays the same input recording (see Engine::recordInput()) under two
+// configurations and compares them:
+//
+//     RunBenchmarks replay --recording session.input
+//         --b broadphase=axisSweep --label-a dbvt --label-b axisSweep
+//
+// Each configuration runs headless in its own process, as the engine can
+// only be initialized once per process. --a and --b set the options
+// of the microbe game states (see Engine::createGameState(), the keys of
+// its options table), --option sets them for both. Different builds, like
+// one with LuaJIT and one without, are compared with --program-a and
+// --program-b.
+//
+// Both runs replay the recorded frame durations, so their game time
+// advances identically and the fixed-rate systems run the same ticks.
+// Prints a table of both runs' frame time percentiles, allocation counts
+// (only in builds with THRIVE_TRACK_ALLOCATIONS) and per-system update
+// times from the SystemProfiler, and whether their state hashes agree.
+// --output writes the same as JSON. Like the game, this has to run from
+// the directory with the scripts and resources.
+//
+// With --single, runs a configuration in this process and writes its
+// metrics to the --metrics file. This is what the comparison runs.
+
+namespace {
+
+using Clock = boost::chrono::steady_clock;
+
+using Metrics = std::vector<std::pair<std::string, std::string>>;
+
+struct Run {
+
+    std::string label;
+
+    std::vector<std::string> options;
+
+    std::string program;
+
+};
+
+
+struct Options {
+
+    Run a;
+
+    Run b;
+
+    std::string metricsFile;
+
+    std::string outputFile;
+
+    std::string prefix = "replay";
+
+    std::string recording;
+
+    bool single = false;
+
+    std::string stateHashFile;
+
+};
+
+
+// The value of --option KEY=VALUE, as the Lua type it looks like
+void
+pushOptionValue(
+    lua_State* L,
+    const std::string& value
+) {
+    if (value == "true" or value == "false") {
+        lua_pushboolean(L, value == "true");
+        return;
+    }
+    const char* begin = value.c_str();
+    char* end = nullptr;
+    double number = std::strtod(begin, &end);
+    if (end != begin and *end == '\0') {
+        lua_pushnumber(L, number);
+    }
+    else {
+        lua_pushstring(L, begin);
+    }
+}
+
+
+// Must be set before the scripts run, they read it while setting up
+void
+setBenchmarkTable(
+    lua_State* L,
+    const std::vector<std::string>& options
+) {
+    lua_newtable(L);
+    lua_newtable(L);
+    for (const std::string& option : options) {
+        size_t separator = option.find('=');
+        if (separator == std::string::npos or separator == 0) {
+            throw std::invalid_argument("Expected KEY=VALUE, not " + option);
+        }
+        pushOptionValue(L, option.substr(separator + 1));
+        lua_setfield(L, -2, option.substr(0, separator).c_str());
+    }
+    lua_setfield(L, -2, "gameStateOptions");
+    lua_setglobal(L, "BENCHMARK");
+}
+
+
+double
+percentile(
+    const std::vector<double>& sorted,
+    double fraction
+) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+
+std::string
+formatNumber(
+    double value
+) {
+    std::ostringstream stream;
+    stream << std::setprecision(10) << value;
+    return stream.str();
+}
+
+
+void
+writeMetrics(
+    const std::string& filename,
+    const Metrics& metrics
+) {
+    std::ofstream stream(filename, std::ofstream::trunc);
+    if (not stream) {
+        throw std::runtime_error("Could not write " + filename);
+    }
+    for (const auto& metric : metrics) {
+        stream << metric.first << " " << metric.second << "\n";
+    }
+}
+
+
+Metrics
+readMetrics(
+    const std::string& filename
+) {
+    std::ifstream stream(filename);
+    if (not stream) {
+        throw std::runtime_error("Could not read " + filename);
+    }
+    Metrics metrics;
+    std::string key;
+    std::string value;
+    while (stream >> key >> value) {
+        metrics.emplace_back(key, value);
+    }
+    return metrics;
+}
+
+
+const std::string*
+findMetric(
+    const Metrics& metrics,
+    const std::string& key
+) {
+    for (const auto& metric : metrics) {
+        if (metric.first == key) {
+            return &metric.second;
+        }
+    }
+    return nullptr;
+}
+
+
+unsigned long long
+countFrames(
+    const std::string& recording
+) {
+    InputPlayer player(recording);
+    InputFrame frame;
+    unsigned long long frames = 0;
+    while (player.next(frame)) {
+        frames += 1;
+    }
+    return frames;
+}
+
+
+int
+runSingle(
+    const Options& options
+) {
+    Game& game = Game::instance();
+    Engine& engine = game.engine();
+    try {
+        unsigned long long frames = countFrames(options.recording);
+        setBenchmarkTable(engine.luaState(), options.a.options);
+        engine.replayInput(options.recording);
+        if (not options.stateHashFile.empty()) {
+            engine.recordStateHashes(options.stateHashFile);
+        }
+        engine.init(true);
+        GameState* gameState = engine.currentGameState();
+        SystemProfiler& profiler = gameState->systemProfiler();
+        profiler.reset();
+        profiler.setEnabled(true);
+        AllocationTracker& allocationTracker = engine.allocationTracker();
+        std::vector<double> frameMs;
+        frameMs.reserve(frames);
+        AllocationTracker::Counts frameAllocations;
+        std::map<std::string, AllocationTracker::Counts> systemAllocations;
+        for (unsigned long long i = 0; i < frames; ++i) {
+            auto frameStart = Clock::now();
+            // The frame duration comes from the recording
+            engine.update(0);
+            frameMs.push_back(
+                boost::chrono::duration<double, boost::milli>(Clock::now() - frameStart).count()
+            );
+            if (AllocationTracker::isAvailable()) {
+                AllocationTracker::Counts counts = allocationTracker.frameCounts();
+                frameAllocations.allocations += counts.allocations;
+                frameAllocations.bytes += counts.bytes;
+                for (const std::string& name : profiler.names()) {
+                    counts = allocationTracker.systemCounts(name);
+                    AllocationTracker::Counts& total = systemAllocations[name];
+                    total.allocations += counts.allocations;
+                    total.bytes += counts.bytes;
+                }
+            }
+        }
+        Metrics metrics;
+        metrics.emplace_back("game_state", gameState->name());
+        metrics.emplace_back("frames", formatNumber(frames));
+        std::sort(frameMs.begin(), frameMs.end());
+        double totalMs = 0.0;
+        for (double ms : frameMs) {
+            totalMs += ms;
+        }
+        metrics.emplace_back("frame_ms.total", formatNumber(totalMs));
+        metrics.emplace_back("frame_ms.mean", formatNumber(frameMs.empty() ? 0.0 : totalMs / frameMs.size()));
+        metrics.emplace_back("frame_ms.p50", formatNumber(percentile(frameMs, 0.5)));
+        metrics.emplace_back("frame_ms.p90", formatNumber(percentile(frameMs, 0.9)));
+        metrics.emplace_back("frame_ms.p99", formatNumber(percentile(frameMs, 0.99)));
+        metrics.emplace_back("frame_ms.max", formatNumber(frameMs.empty() ? 0.0 : frameMs.back()));
+        if (AllocationTracker::isAvailable()) {
+            metrics.emplace_back("allocations.count", formatNumber(frameAllocations.allocations));
+            metrics.emplace_back("allocations.bytes", formatNumber(frameAllocations.bytes));
+        }
+        for (const std::string& name : profiler.names()) {
+            SystemProfiler::Statistics statistics = profiler.statistics(name);
+            if (statistics.totalSamples == 0) {
+                continue;
+            }
+            metrics.emplace_back("system_ms." + name, formatNumber(statistics.total / 1000.0));
+            metrics.emplace_back(
+                "system_us_per_update." + name,
+                formatNumber(static_cast<double>(statistics.total) / statistics.totalSamples)
+            );
+            auto iter = systemAllocations.find(name);
+            if (iter != systemAllocations.end() and iter->second.allocations > 0) {
+                metrics.emplace_back("system_allocations." + name, formatNumber(iter->second.allocations));
+            }
+        }
+        writeMetrics(options.metricsFile, metrics);
+        engine.shutdown();
+    }
+    catch (const luabind::error& e) {
+        printLuaError(e);
+        return 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+std::string
+quoted(
+    const std::string& argument
+) {
+#ifdef _WIN32
+    return "\"" + argument + "\"";
+#else
+    std::string result = "'";
+    for (char c : argument) {
+        if (c == '\'') {
+            result += "'\\''";
+        }
+        else {
+            result += c;
+        }
+    }
+    return result + "'";
+#endif
+}
+
+
+// Runs one configuration in a child process
+bool
+runChild(
+    const Options& options,
+    const Run& run,
+    const std::vector<std::string>& sharedOptions,
+    const std::string& metricsFile,
+    const std::string& stateHashFile
+) {
+    std::string command = quoted(run.program) + " replay --single";
+    command += " --recording " + quoted(options.recording);
+    command += " --metrics " + quoted(metricsFile);
+    command += " --state-hashes " + quoted(stateHashFile);
+    for (const std::string& option : sharedOptions) {
+        command += " --option " + quoted(option);
+    }
+    for (const std::string& option : run.options) {
+        command += " --option " + quoted(option);
+    }
+    std::cerr << "Running " << run.label << ": " << command << std::endl;
+    int status = std::system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Run " << run.label << " failed with status " << status << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+struct HashComparison {
+
+    // The first tick whose hashes differ, 0 if none
+    unsigned long long divergedTick = 0;
+
+    std::string error;
+
+    unsigned long long ticks = 0;
+
+};
+
+
+HashComparison
+compareStateHashes(
+    const std::string& fileA,
+    const std::string& fileB
+) {
+    HashComparison comparison;
+    std::ifstream streamA(fileA);
+    std::ifstream streamB(fileB);
+    if (not streamA or not streamB) {
+        comparison.error = "no state hashes recorded";
+        return comparison;
+    }
+    std::string lineA;
+    std::string lineB;
+    // Header and hashed types
+    for (int i = 0; i < 2; ++i) {
+        std::getline(streamA, lineA);
+        std::getline(streamB, lineB);
+        if (lineA != lineB) {
+            comparison.error = "the runs hash different component types";
+            return comparison;
+        }
+    }
+    while (true) {
+        bool hasA = static_cast<bool>(std::getline(streamA, lineA));
+        bool hasB = static_cast<bool>(std::getline(streamB, lineB));
+        if (not hasA or not hasB) {
+            if (hasA != hasB) {
+                comparison.error = "the runs hashed a different number of ticks";
+            }
+            return comparison;
+        }
+        comparison.ticks += 1;
+        if (comparison.divergedTick == 0 and lineA != lineB) {
+            comparison.divergedTick = comparison.ticks;
+        }
+    }
+}
+
+
+// The keys of both, in the order of a, then those only in b
+std::vector<std::string>
+mergedKeys(
+    const Metrics& a,
+    const Metrics& b
+) {
+    std::vector<std::string> keys;
+    for (const auto& metric : a) {
+        keys.push_back(metric.first);
+    }
+    for (const auto& metric : b) {
+        if (not findMetric(a, metric.first)) {
+            keys.push_back(metric.first);
+        }
+    }
+    keys.erase(std::remove(keys.begin(), keys.end(), "game_state"), keys.end());
+    return keys;
+}
+
+
+void
+printTable(
+    std::ostream& output,
+    const Options& options,
+    const Metrics& a,
+    const Metrics& b,
+    const HashComparison& hashes
+) {
+    size_t width = 12;
+    for (const std::string& key : mergedKeys(a, b)) {
+        width = std::max(width, key.size() + 2);
+    }
+    output << std::left << std::setw(width) << "metric"
+        << std::right << std::setw(14) << options.a.label
+        << std::setw(14) << options.b.label
+        << std::setw(10) << "delta" << "\n";
+    for (const std::string& key : mergedKeys(a, b)) {
+        const std::string* valueA = findMetric(a, key);
+        const std::string* valueB = findMetric(b, key);
+        output << std::left << std::setw(width) << key << std::right
+            << std::setw(14) << (valueA ? *valueA : "-")
+            << std::setw(14) << (valueB ? *valueB : "-");
+        if (valueA and valueB) {
+            double numberA = std::strtod(valueA->c_str(), nullptr);
+            double numberB = std::strtod(valueB->c_str(), nullptr);
+            if (numberA != 0.0) {
+                std::ostringstream delta;
+                delta << std::showpos << std::fixed << std::setprecision(1)
+                    << (numberB - numberA) / std::fabs(numberA) * 100.0 << "%";
+                output << std::setw(10) << delta.str();
+            }
+        }
+        output << "\n";
+    }
+    output << "\nState hashes: ";
+    if (not hashes.error.empty()) {
+        output << hashes.error;
+        if (hashes.divergedTick != 0) {
+            output << ", first difference in tick " << hashes.divergedTick;
+        }
+    }
+    else if (hashes.divergedTick != 0) {
+        output << "diverge in tick " << hashes.divergedTick << " of " << hashes.ticks;
+    }
+    else {
+        output << "agree in all " << hashes.ticks << " ticks";
+    }
+    output << std::endl;
+}
+
+
+void
+writeRunJson(
+    JsonWriter& writer,
+    const Run& run,
+    const Metrics& metrics
+) {
+    writer.beginObject();
+    writer.key("label").value(run.label);
+    writer.key("program").value(run.program);
+    writer.key("options").beginArray();
+    for (const std::string& option : run.options) {
+        writer.value(option);
+    }
+    writer.endArray();
+    writer.key("metrics").beginObject();
+    for (const auto& metric : metrics) {
+        if (metric.first == "game_state") {
+            writer.key(metric.first).value(metric.second);
+        }
+        else {
+            writer.key(metric.first).value(std::strtod(metric.second.c_str(), nullptr));
+        }
+    }
+    writer.endObject();
+    writer.endObject();
+}
+
+
+void
+writeJson(
+    std::ostream& output,
+    const Options& options,
+    const Metrics& a,
+    const Metrics& b,
+    const HashComparison& hashes
+) {
+    JsonWriter writer(output);
+    writer.beginObject();
+    writer.key("benchmark").value("replay");
+    writer.key("recording").value(options.recording);
+    writer.key("a");
+    writeRunJson(writer, options.a, a);
+    writer.key("b");
+    writeRunJson(writer, options.b, b);
+    writer.key("state_hashes").beginObject();
+    writer.key("agree").value(hashes.error.empty() and hashes.divergedTick == 0);
+    writer.key("ticks").value(static_cast<uint64_t>(hashes.ticks));
+    writer.key("diverged_tick").value(static_cast<uint64_t>(hashes.divergedTick));
+    writer.key("error").value(hashes.error);
+    writer.endObject();
+    writer.endObject();
+    output << std::endl;
+}
+
+
+int
+runComparison(
+    const Options& options,
+    const std::vector<std::string>& sharedOptions
+) {
+    std::string metricsA = options.prefix + "-a.metrics";
+    std::string metricsB = options.prefix + "-b.metrics";
+    std::string hashesA = options.prefix + "-a.hashes";
+    std::string hashesB = options.prefix + "-b.hashes";
+    if (
+        not runChild(options, options.a, sharedOptions, metricsA, hashesA) or
+        not runChild(options, options.b, sharedOptions, metricsB, hashesB)
+    ) {
+        return 1;
+    }
+    try {
+        Metrics a = readMetrics(metricsA);
+        Metrics b = readMetrics(metricsB);
+        // Hash files are named after the game state, see
+        // Engine::recordStateHashes()
+        const std::string* gameState = findMetric(a, "game_state");
+        HashComparison hashes = compareStateHashes(
+            hashesA + "." + (gameState ? *gameState : ""),
+            hashesB + "." + (gameState ? *gameState : "")
+        );
+        printTable(std::cout, options, a, b, hashes);
+        if (not options.outputFile.empty()) {
+            std::ofstream outputFile(options.outputFile, std::ofstream::trunc);
+            writeJson(outputFile, options, a, b, hashes);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options,
+    std::vector<std::string>& sharedOptions
+) {
+    options.a.label = "a";
+    options.b.label = "b";
+    options.a.program = argv[0];
+    options.b.program = argv[0];
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--a") == 0 and hasValue) {
+            options.a.options.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--b") == 0 and hasValue) {
+            options.b.options.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--label-a") == 0 and hasValue) {
+            options.a.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--label-b") == 0 and hasValue) {
+            options.b.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--metrics") == 0 and hasValue) {
+            options.metricsFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--option") == 0 and hasValue) {
+            sharedOptions.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--prefix") == 0 and hasValue) {
+            options.prefix = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--program-a") == 0 and hasValue) {
+            options.a.program = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--program-b") == 0 and hasValue) {
+            options.b.program = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--recording") == 0 and hasValue) {
+            options.recording = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--single") == 0) {
+            options.single = true;
+        }
+        else if (std::strcmp(argv[i], "--state-hashes") == 0 and hasValue) {
+            options.stateHashFile = argv[++i];
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.single) {
+        // A single run only has shared options
+        options.a.options = sharedOptions;
+        return not options.metricsFile.empty() and not options.recording.empty();
+    }
+    return not options.recording.empty();
+}
+
+}
+
+
+int
+thrive::runReplayBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    std::vector<std::string> sharedOptions;
+    if (not parseOptions(argc, argv, options, sharedOptions)) {
+        std::cerr << "Usage: " << argv[0]
+            << " replay --recording FILE [--option KEY=VALUE]..."
+            << " [--a KEY=VALUE]... [--b KEY=VALUE]..."
+            << " [--label-a LABEL] [--label-b LABEL]"
+            << " [--program-a PROGRAM] [--program-b PROGRAM]"
+            << " [--prefix PREFIX] [--output FILE]\n"
+            << "       " << argv[0]
+            << " replay --single --recording FILE --metrics FILE"
+            << " [--state-hashes FILE] [--option KEY=VALUE]..." << std::endl;
+        return 2;
+    }
+    if (options.single) {
+        return runSingle(options);
+    }
+    return runComparison(options, sharedOptions);
+}
@@ -0,0 +1,532 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "engine/compression.h"
+#include "engine/serialization.h"
+#include "engine/typedefs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+using namespace thrive;
+
+// Benchmarks savegame round trips of synthetic microbe stage worlds.
+//
+// Each case prints one line of JSON to stdout (or the file given with
+// --output), so results can be compared between serializer changes:
+//
+//     RunBenchmarks savegame --entities 100000 --runs 5 --output results.jsonl
+//
+// Without --entities, worlds of 1k, 10k, 100k and 1M entities are run. The
+// peak RSS is that of the whole process so far. Cases run in increasing
+// size, but for exact numbers, run one size per process.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* SAVEGAME_FILE = "savegame_benchmark.sav";
+
+struct Options {
+
+    std::vector<uint32_t> entityCounts;
+
+    std::string outputFile;
+
+    unsigned int runs = 3;
+
+};
+
+
+struct Result {
+
+    double buildMs = 0.0;
+
+    double loadMs = 0.0;
+
+    double mapMs = 0.0;
+
+    double saveMs = 0.0;
+
+    size_t fileBytes = 0;
+
+    size_t rawBytes = 0;
+
+};
+
+
+double
+elapsedMs(
+    Clock::time_point start
+) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+long
+peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    #ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+    #else
+        return usage.ru_maxrss;
+    #endif
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Synthetic world
+////////////////////////////////////////////////////////////////////////////////
+
+// Mirrors what the microbe stage components store, see
+// Microbe.createMicrobeEntity
+class WorldGenerator {
+
+public:
+
+    WorldGenerator(
+        uint32_t entityCount
+    ) : m_entityCount(entityCount),
+        m_random(42)
+    {
+    }
+
+    StorageContainer
+    generate(
+        bool columns
+    ) {
+        std::vector<std::pair<const char*, StorageList>> lists = {
+            {"AgentAbsorberComponent", StorageList()},
+            {"AgentEmitterComponent", StorageList()},
+            {"CollisionComponent", StorageList()},
+            {"MicrobeAIControllerComponent", StorageList()},
+            {"MicrobeComponent", StorageList()},
+            {"OgreSceneNodeComponent", StorageList()},
+            {"RigidBodyComponent", StorageList()}
+        };
+        for (auto& pair : lists) {
+            pair.second.reserve(m_entityCount);
+        }
+        for (EntityId owner = 1; owner <= m_entityCount; ++owner) {
+            lists[0].second.append(this->agentAbsorber(owner));
+            lists[1].second.append(this->agentEmitter(owner));
+            lists[2].second.append(this->collision(owner));
+            if (owner % 2 == 0) {
+                lists[3].second.append(this->aiController(owner));
+            }
+            lists[4].second.append(this->microbe(owner));
+            lists[5].second.append(this->sceneNode(owner));
+            lists[6].second.append(this->rigidBody(owner));
+        }
+        StorageContainer collections;
+        for (auto& pair : lists) {
+            if (columns) {
+                collections.set(pair.first, storageColumns(pair.second));
+            }
+            else {
+                collections.set(pair.first, std::move(pair.second));
+            }
+        }
+        StorageContainer entities;
+        entities.set<EntityId>("slotCount", m_entityCount + 1);
+        entities.set("collections", std::move(collections));
+        for (const char* key : {"componentsToRemove", "entitiesToRemove", "freeSlots", "namedIds"}) {
+            entities.set(key, StorageList());
+        }
+        StorageContainer gameState;
+        gameState.set("entities", std::move(entities));
+        StorageContainer gameStates;
+        gameStates.set("microbe", std::move(gameState));
+        StorageContainer savegame;
+        savegame.set("gameStates", std::move(gameStates));
+        savegame.set<std::string>("currentGameState", "microbe");
+        return savegame;
+    }
+
+private:
+
+    StorageContainer
+    agentAbsorber(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        StorageList agents;
+        for (uint16_t agentId = 1; agentId <= 3; ++agentId) {
+            StorageContainer agent;
+            agent.set<uint16_t>("agentId", agentId);
+            agent.set<float>("amount", this->real(0, 10));
+            agents.append(std::move(agent));
+        }
+        storage.set("agents", std::move(agents));
+        return storage;
+    }
+
+    StorageContainer
+    agentEmitter(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        storage.set<Ogre::Real>("emissionRadius", 5);
+        storage.set<Ogre::Real>("maxInitialSpeed", 3);
+        storage.set<Ogre::Real>("minInitialSpeed", 1);
+        storage.set<Ogre::Degree>("maxEmissionAngle", Ogre::Degree(360));
+        storage.set<Ogre::Degree>("minEmissionAngle", Ogre::Degree(0));
+        storage.set<Milliseconds>("particleLifetime", 5000);
+        return storage;
+    }
+
+    StorageContainer
+    aiController(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        storage.set<float>("movementRadius", 20);
+        storage.set<int32_t>("reevalutationInterval", 1000);
+        storage.set<int32_t>("intervalRemaining", m_random() % 1000);
+        storage.set<Ogre::Vector3>("direction", this->vector());
+        storage.set<Ogre::Vector3>("targetEmitterPosition", this->vector());
+        storage.set<int32_t>("searchedAgentId", 1);
+        return storage;
+    }
+
+    StorageContainer
+    collision(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        StorageList collisionGroups;
+        StorageContainer group;
+        group.set<std::string>("collisionGroup", "microbe");
+        collisionGroups.append(std::move(group));
+        storage.set("collisionGroups", std::move(collisionGroups));
+        return storage;
+    }
+
+    StorageContainer
+    component(
+        EntityId owner
+    ) {
+        StorageContainer storage;
+        storage.set<EntityId>("owner", owner);
+        return storage;
+    }
+
+    StorageContainer
+    microbe(
+        EntityId owner
+    ) {
+        static const char* CLASS_NAMES[] = {
+            "MovementOrganelle",
+            "ProcessOrganelle",
+            "StorageOrganelle"
+        };
+        StorageContainer storage = this->component(owner);
+        StorageList organelles;
+        unsigned int organelleCount = 2 + m_random() % 5;
+        for (unsigned int i = 0; i < organelleCount; ++i) {
+            int32_t q = static_cast<int32_t>(i);
+            int32_t r = -static_cast<int32_t>(i);
+            StorageContainer organelle;
+            organelle.set<std::string>("className", CLASS_NAMES[i % 3]);
+            organelle.set<std::vector<int32_t>>("hexCoordinates", {0, 0, 1, 0, 0, 1});
+            organelle.set<int32_t>("q", q);
+            organelle.set<int32_t>("r", r);
+            organelle.set<Ogre::ColourValue>("colour", Ogre::ColourValue(0.8, 0.4, 0.5));
+            organelle.set<Ogre::ColourValue>("internalEdgeColour", Ogre::ColourValue(0.6, 0.2, 0.3));
+            organelle.set<Ogre::ColourValue>("externalEdgeColour", Ogre::ColourValue(0.2, 0.1, 0.1));
+            organelles.append(std::move(organelle));
+        }
+        storage.set("organelles", std::move(organelles));
+        return storage;
+    }
+
+    Ogre::Quaternion
+    orientation() {
+        Ogre::Quaternion orientation;
+        orientation.FromAngleAxis(Ogre::Radian(this->real(0, 6.28f)), Ogre::Vector3::UNIT_Z);
+        return orientation;
+    }
+
+    float
+    real(
+        float min,
+        float max
+    ) {
+        return std::uniform_real_distribution<float>(min, max)(m_random);
+    }
+
+    StorageContainer
+    rigidBody(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        StorageContainer childShape;
+        childShape.set<uint8_t>("shapeType", 5);
+        childShape.set<uint8_t>("axis", 2);
+        childShape.set<float>("height", 1);
+        childShape.set<float>("radius", 1);
+        StorageContainer child;
+        child.set("shape", std::move(childShape));
+        child.set<Ogre::Quaternion>("compoundOrientation", Ogre::Quaternion::IDENTITY);
+        StorageList childShapes;
+        childShapes.append(child);
+        childShapes.append(child);
+        StorageContainer shape;
+        shape.set<uint8_t>("shapeType", 2);
+        shape.set("childShapes", std::move(childShapes));
+        shape.set<std::vector<Ogre::Vector3>>("childTranslations", {
+            Ogre::Vector3(0, 0, 0),
+            Ogre::Vector3(1.5, 0.8, 0)
+        });
+        storage.set("shape", std::move(shape));
+        storage.set<Ogre::Vector3>("linearFactor", Ogre::Vector3(1, 1, 0));
+        storage.set<Ogre::Vector3>("angularFactor", Ogre::Vector3(0, 0, 1));
+        storage.set<float>("mass", 1);
+        storage.set<float>("friction", 0.2f);
+        storage.set<float>("linearDamping", 0.5f);
+        storage.set<float>("angularDamping", 0);
+        storage.set<float>("rollingFriction", 0);
+        storage.set<bool>("hasContactResponse", true);
+        storage.set<bool>("kinematic", false);
+        storage.set<Ogre::Vector3>("position", this->vector());
+        storage.set<Ogre::Quaternion>("rotation", this->orientation());
+        storage.set<Ogre::Vector3>("linearVelocity", this->vector());
+        storage.set<Ogre::Vector3>("angularVelocity", Ogre::Vector3(0, 0, this->real(-1, 1)));
+        return storage;
+    }
+
+    StorageContainer
+    sceneNode(
+        EntityId owner
+    ) {
+        StorageContainer storage = this->component(owner);
+        storage.set<Ogre::Quaternion>("orientation", this->orientation());
+        storage.set<Ogre::Vector3>("position", this->vector());
+        storage.set<Ogre::Vector3>("scale", Ogre::Vector3(1, 1, 1));
+        storage.set<Ogre::String>("meshName", "");
+        storage.set<EntityId>("parentId", NULL_ENTITY);
+        return storage;
+    }
+
+    Ogre::Vector3
+    vector() {
+        return Ogre::Vector3(this->real(-500, 500), this->real(-500, 500), 0);
+    }
+
+    uint32_t m_entityCount;
+
+    std::mt19937 m_random;
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cases
+////////////////////////////////////////////////////////////////////////////////
+
+// Reads every stored component, like EntityManager::restore would
+size_t
+visitComponents(
+    const StorageContainer& savegame
+) {
+    StorageContainer collections = savegame.get<StorageContainer>(
+        "gameStates"
+    ).get<StorageContainer>(
+        "microbe"
+    ).get<StorageContainer>(
+        "entities"
+    ).get<StorageContainer>("collections");
+    size_t components = 0;
+    for (const std::string& typeName : collections.keys()) {
+        StorageList rows = collections.contains<StorageContainer>(typeName) ?
+            storageRows(collections.get<StorageContainer>(typeName)) :
+            collections.get<StorageList>(typeName);
+        for (const StorageContainer& row : rows) {
+            components += row.get<EntityId>("owner") != NULL_ENTITY;
+        }
+    }
+    return components;
+}
+
+
+Result
+runCase(
+    uint32_t entityCount,
+    bool columns,
+    CompressionLevel level
+) {
+    Result result;
+    auto start = Clock::now();
+    StorageContainer savegame = WorldGenerator(entityCount).generate(columns);
+    result.buildMs = elapsedMs(start);
+    // Save, as Engine does for baselines
+    start = Clock::now();
+    {
+        std::ostringstream data;
+        saveStorage(data, savegame);
+        result.rawBytes = data.str().size();
+        std::ofstream file(SAVEGAME_FILE, std::ofstream::trunc | std::ofstream::binary);
+        writeCompressed(file, data.str(), level);
+        result.fileBytes = static_cast<size_t>(file.tellp());
+    }
+    result.saveMs = elapsedMs(start);
+    savegame = StorageContainer();
+    // Load everything up front
+    start = Clock::now();
+    size_t components = 0;
+    {
+        std::ifstream file(SAVEGAME_FILE, std::ifstream::binary);
+        CompressedInputStream stream(file);
+        StorageContainer loaded;
+        loadStorage(stream, loaded);
+        components = visitComponents(loaded);
+    }
+    result.loadMs = elapsedMs(start);
+    // Load through a lazily parsed view
+    start = Clock::now();
+    if (visitComponents(mapStorage(SAVEGAME_FILE)) != components) {
+        throw std::runtime_error("Mapped savegame differs from loaded savegame");
+    }
+    result.mapMs = elapsedMs(start);
+    std::remove(SAVEGAME_FILE);
+    return result;
+}
+
+
+const char*
+levelName(
+    CompressionLevel level
+) {
+    switch (level) {
+        case CompressionLevel::None:
+            return "none";
+        case CompressionLevel::Fast:
+            return "fast";
+        case CompressionLevel::High:
+            return "high";
+    }
+    return "unknown";
+}
+
+
+void
+printResult(
+    std::ostream& output,
+    uint32_t entityCount,
+    bool columns,
+    CompressionLevel level,
+    unsigned int runs,
+    const Result& best
+) {
+    output << "{\"benchmark\": \"savegame\""
+        << ", \"entities\": " << entityCount
+        << ", \"layout\": \"" << (columns ? "columns" : "rows") << "\""
+        << ", \"compression\": \"" << levelName(level) << "\""
+        << ", \"runs\": " << runs
+        << ", \"build_ms\": " << best.buildMs
+        << ", \"save_ms\": " << best.saveMs
+        << ", \"load_ms\": " << best.loadMs
+        << ", \"map_ms\": " << best.mapMs
+        << ", \"raw_bytes\": " << best.rawBytes
+        << ", \"file_bytes\": " << best.fileBytes
+        << ", \"peak_rss_kb\": " << peakRssKb()
+        << "}" << std::endl;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options
+) {
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--entities") == 0 and hasValue) {
+            options.entityCounts.push_back(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 and hasValue) {
+            options.runs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.entityCounts.empty()) {
+        options.entityCounts = {1000, 10000, 100000, 1000000};
+    }
+    return true;
+}
+
+}
+
+
+int
+thrive::runSavegameBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    if (not parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+            << " savegame [--entities COUNT]... [--runs RUNS] [--output FILE]" << std::endl;
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (not options.outputFile.empty()) {
+        outputFile.open(options.outputFile, std::ofstream::trunc);
+    }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    try {
+        for (uint32_t entityCount : options.entityCounts) {
+            for (bool columns : {false, true}) {
+                for (CompressionLevel level : {CompressionLevel::Fast, CompressionLevel::High}) {
+                    // Keep the fastest run of each measurement
+                    Result best = runCase(entityCount, columns, level);
+                    for (unsigned int run = 1; run < options.runs; ++run) {
+                        Result result = runCase(entityCount, columns, level);
+                        best.buildMs = std::min(best.buildMs, result.buildMs);
+                        best.saveMs = std::min(best.saveMs, result.saveMs);
+                        best.loadMs = std::min(best.loadMs, result.loadMs);
+                        best.mapMs = std::min(best.mapMs, result.mapMs);
+                    }
+                    printResult(output, entityCount, columns, level, options.runs, best);
+                }
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        std::remove(SAVEGAME_FILE);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include "engine/benchmarks/benchmarks.h"
+
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "engine/rng.h"
+#include "game.h"
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+
+using namespace thrive;
+
+// Soaks the real microbe stage, as set up by microbe_stage/setup.lua, in a
+// headless engine. Instead of the player's input, SoakBotSystem (see
+// microbe_stage/soak_bot.lua) swims the player along a fixed path.
+//
+// Frames advance the game by the target frame duration, as fast as
+// possible. The RNG is seeded with --seed, so runs with the same options
+// and scripts spawn the same world:
+//
+//     RunBenchmarks soak --seconds 600 --microbe-density 4 --label release
+//
+// Prints one line of JSON with the frame time percentiles and, every
+// --sample-interval seconds of game time, the entity count, the Lua heap
+// and the resident set size. Like the game, this has to run from the
+// directory with the scripts and resources.
+
+namespace {
+
+using Clock = boost::chrono::steady_clock;
+
+struct Options {
+
+    double emitterDensity = 1.0;
+
+    std::string label;
+
+    double microbeDensity = 1.0;
+
+    std::string outputFile;
+
+    double pathRadius = 60.0;
+
+    unsigned int sampleInterval = 10;
+
+    RNG::Seed seed = 42;
+
+    unsigned int seconds = 300;
+
+};
+
+
+struct Sample {
+
+    double seconds = 0.0;
+
+    size_t entities = 0;
+
+    double luaHeapKb = 0.0;
+
+    long rssKb = 0;
+
+};
+
+
+long
+currentRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return static_cast<long>(counters.WorkingSetSize / 1024);
+#elif defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long residentPages = 0;
+    if (not (statm >> pages >> residentPages)) {
+        return -1;
+    }
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+
+long
+peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    #ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+    #else
+        return usage.ru_maxrss;
+    #endif
+#endif
+}
+
+
+double
+luaHeapKb(
+    lua_State* L
+) {
+    return lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0;
+}
+
+
+// Must be set before the scripts run, they read it while setting up
+void
+setSoakTable(
+    lua_State* L,
+    const Options& options
+) {
+    lua_newtable(L);
+    lua_pushnumber(L, options.emitterDensity);
+    lua_setfield(L, -2, "emitterDensity");
+    lua_pushnumber(L, options.microbeDensity);
+    lua_setfield(L, -2, "microbeDensity");
+    lua_pushnumber(L, options.pathRadius);
+    lua_setfield(L, -2, "pathRadius");
+    lua_setglobal(L, "SOAK");
+}
+
+
+double
+soakField(
+    lua_State* L,
+    const char* name
+) {
+    lua_getglobal(L, "SOAK");
+    lua_getfield(L, -1, name);
+    double value = lua_tonumber(L, -1);
+    lua_pop(L, 2);
+    return value;
+}
+
+
+Sample
+takeSample(
+    Engine& engine,
+    double seconds
+) {
+    Sample sample;
+    sample.seconds = seconds;
+    GameState* gameState = engine.currentGameState();
+    sample.entities = gameState ? gameState->entityManager().entityCount() : 0;
+    sample.luaHeapKb = luaHeapKb(engine.luaState());
+    sample.rssKb = currentRssKb();
+    return sample;
+}
+
+
+double
+percentile(
+    const std::vector<double>& sorted,
+    double fraction
+) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+
+void
+printResult(
+    std::ostream& output,
+    const Options& options,
+    std::vector<double> frameMs,
+    const std::vector<Sample>& samples,
+    double distance,
+    double laps
+) {
+    std::sort(frameMs.begin(), frameMs.end());
+    double totalMs = 0.0;
+    for (double ms : frameMs) {
+        totalMs += ms;
+    }
+    JsonWriter writer(output);
+    writer.beginObject();
+    writer.key("benchmark").value("soak");
+    writer.key("label").value(options.label);
+    writer.key("seed").value(options.seed);
+    writer.key("seconds").value(options.seconds);
+    writer.key("microbe_density").value(options.microbeDensity);
+    writer.key("emitter_density").value(options.emitterDensity);
+    writer.key("frames").value(static_cast<uint64_t>(frameMs.size()));
+    writer.key("frame_ms").beginObject();
+    writer.key("mean").value(frameMs.empty() ? 0.0 : totalMs / frameMs.size());
+    writer.key("p50").value(percentile(frameMs, 0.5));
+    writer.key("p90").value(percentile(frameMs, 0.9));
+    writer.key("p99").value(percentile(frameMs, 0.99));
+    writer.key("p999").value(percentile(frameMs, 0.999));
+    writer.key("max").value(frameMs.empty() ? 0.0 : frameMs.back());
+    writer.endObject();
+    writer.key("player_distance").value(distance);
+    writer.key("player_laps").value(laps);
+    // The first sample is taken right after startup
+    writer.key("lua_heap_growth_kb").value(samples.back().luaHeapKb - samples.front().luaHeapKb);
+    writer.key("rss_growth_kb").value(static_cast<int64_t>(samples.back().rssKb - samples.front().rssKb));
+    writer.key("peak_rss_kb").value(static_cast<int64_t>(peakRssKb()));
+    writer.key("samples").beginArray();
+    for (const Sample& sample : samples) {
+        writer.beginObject();
+        writer.key("seconds").value(sample.seconds);
+        writer.key("entities").value(static_cast<uint64_t>(sample.entities));
+        writer.key("lua_heap_kb").value(sample.luaHeapKb);
+        writer.key("rss_kb").value(static_cast<int64_t>(sample.rssKb));
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+    output << std::endl;
+}
+
+
+bool
+parseOptions(
+    int argc,
+    char* argv[],
+    Options& options
+) {
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--emitter-density") == 0 and hasValue) {
+            options.emitterDensity = std::max(0.0, std::strtod(argv[++i], nullptr));
+        }
+        else if (std::strcmp(argv[i], "--label") == 0 and hasValue) {
+            options.label = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--microbe-density") == 0 and hasValue) {
+            options.microbeDensity = std::max(0.0, std::strtod(argv[++i], nullptr));
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 and hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--path-radius") == 0 and hasValue) {
+            options.pathRadius = std::max(1.0, std::strtod(argv[++i], nullptr));
+        }
+        else if (std::strcmp(argv[i], "--sample-interval") == 0 and hasValue) {
+            options.sampleInterval = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--seconds") == 0 and hasValue) {
+            options.seconds = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 and hasValue) {
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+
+int
+thrive::runSoakBenchmark(
+    int argc,
+    char* argv[]
+) {
+    Options options;
+    if (not parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+            << " soak [--seconds SECONDS] [--seed SEED] [--microbe-density SCALE]"
+            << " [--emitter-density SCALE] [--path-radius RADIUS]"
+            << " [--sample-interval SECONDS] [--label LABEL] [--output FILE]" << std::endl;
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (not options.outputFile.empty()) {
+        outputFile.open(options.outputFile, std::ofstream::trunc);
+    }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    Game& game = Game::instance();
+    Engine& engine = game.engine();
+    try {
+        lua_State* L = engine.luaState();
+        setSoakTable(L, options);
+        engine.rng().setSeed(options.seed);
+        engine.init(true);
+        int frameMilliseconds = std::max<int>(
+            1,
+            boost::chrono::duration_cast<boost::chrono::milliseconds>(
+                game.targetFrameDuration()
+            ).count()
+        );
+        unsigned long long duration = options.seconds * 1000ull;
+        unsigned long long sampleInterval = options.sampleInterval * 1000ull;
+        std::vector<double> frameMs;
+        frameMs.reserve(duration / frameMilliseconds + 1);
+        std::vector<Sample> samples;
+        samples.push_back(takeSample(engine, 0.0));
+        unsigned long long elapsed = 0;
+        unsigned long long nextSample = sampleInterval;
+        while (elapsed < duration) {
+            auto frameStart = Clock::now();
+            engine.update(frameMilliseconds);
+            frameMs.push_back(
+                boost::chrono::duration<double, boost::milli>(Clock::now() - frameStart).count()
+            );
+            elapsed += frameMilliseconds;
+            if (elapsed >= nextSample or elapsed >= duration) {
+                samples.push_back(takeSample(engine, elapsed / 1000.0));
+                nextSample += sampleInterval;
+            }
+        }
+        printResult(
+            output,
+            options,
+            std::move(frameMs),
+            samples,
+            soakField(L, "distance"),
+            soakField(L, "laps")
+        );
+        engine.shutdown();
+    }
+    catch (const luabind::error& e) {
+        printLuaError(e);
+        return 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "engine/component.h"
+
+#include <new>
+
+namespace thrive {
+
+/**
+* @brief The rarely used part of a component, stored apart from it
+*
+* Systems that run every frame usually read only a few members of each
+* component, like a transform or the forces on a body, while settings such
+* as shapes, materials or mesh names only change now and then. Keeping
+* those settings in the component makes it larger, so that iterating over
+* many components drags the settings through the cache as well.
+*
+* A ColdData member keeps its value in a block from
+* Component::allocateColdData() instead, leaving a pointer in the
+* component. Components then stay small and pack densely into the
+* component pools. Touchables in the value keep their change tracking; a
+* component that registers them with Touchable::setComponent() lets its
+* system find the changed settings through
+* ComponentCollection::takeTouched() without reading them every frame.
+*
+* Usage:
+* \code
+* class MyComponent : public Component {
+*     COMPONENT(My)
+* public:
+*     struct Settings : public Touchable {
+*         std::string meshName;
+*     };
+*     // Hot
+*     Ogre::Vector3 m_position;
+*     // Cold
+*     ColdData<Settings> m_settings;
+* };
+* // ...
+* component->m_settings->meshName = "cell.mesh";
+* \endcode
+*
+* @tparam T
+*   A default constructible type
+*/
+template<typename T>
+class ColdData {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * Default constructs the value.
+    */
+    ColdData() {
+        void* block = Component::allocateColdData(sizeof(T));
+        try {
+            m_value = new (block) T();
+        }
+        catch (...) {
+            Component::deallocateColdData(block, sizeof(T));
+            throw;
+        }
+    }
+
+    /**
+    * @brief Destructor
+    */
+    ~ColdData() {
+        m_value->~T();
+        Component::deallocateColdData(m_value, sizeof(T));
+    }
+
+    ColdData(const ColdData&) = delete;
+
+    ColdData& operator= (const ColdData&) = delete;
+
+    T&
+    operator* () const {
+        return *m_value;
+    }
+
+    T*
+    operator-> () const {
+        return m_value;
+    }
+
+    /**
+    * @brief The value
+    */
+    T*
+    get() const {
+        return m_value;
+    }
+
+private:
+
+    T* m_value = nullptr;
+
+};
+
+}
@@ -1,12 +1,18 @@
 #include "engine/component.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/engine.h"
+#include "engine/pool_allocator.h"
 #include "engine/serialization.h"
+#include "engine/state_hash.h"
 #include "game.h"
+#include "scripting/lua_profiler.h"
 #include "scripting/luabind.h"
 
 #include <luabind/class_info.hpp>
+#include <sstream>
+#include <vector>
 
 using namespace thrive;
 
@@ -41,6 +47,7 @@ struct ComponentWrapper : Component, luabind::wrap_base {
     load(
         const StorageContainer& storage
     ) override {
+        LuaProfiler::countScriptCall(m_luaState, "Component:load");
         call<void>("load", storage);
     }
 
@@ -65,6 +72,7 @@ struct ComponentWrapper : Component, luabind::wrap_base {
 
     StorageContainer
     storage() const override {
+        LuaProfiler::countScriptCall(m_luaState, "Component:storage");
         return call<StorageContainer>("storage");
     }
 
@@ -98,20 +106,170 @@ Component::luaBindings() {
 }
 
 
+namespace {
+
+const size_t POOL_SIZE_STEP = 16;
+
+const size_t POOL_MAX_SIZE = 512;
+
+const size_t POOL_BLOCKS_PER_CHUNK = 128;
+
+std::vector<PoolAllocator*>*
+createPools() {
+    auto pools = new std::vector<PoolAllocator*>();
+    for (size_t size = POOL_SIZE_STEP; size <= POOL_MAX_SIZE; size += POOL_SIZE_STEP) {
+        pools->push_back(new PoolAllocator(size, POOL_BLOCKS_PER_CHUNK));
+    }
+    return pools;
+}
+
+
+std::vector<PoolAllocator*>&
+componentPools() {
+    // Never destroyed, components may outlive any other static object,
+    // e.g. when they are owned by the Game singleton
+    static std::vector<PoolAllocator*>* pools = createPools();
+    return *pools;
+}
+
+
+std::vector<PoolAllocator*>&
+coldDataPools() {
+    static std::vector<PoolAllocator*>* pools = createPools();
+    return *pools;
+}
+
+
+PoolAllocator*
+poolForSize(
+    std::vector<PoolAllocator*>& pools,
+    size_t size
+) {
+    if (size == 0 or size > POOL_MAX_SIZE) {
+        return nullptr;
+    }
+    return pools[(size - 1) / POOL_SIZE_STEP];
+}
+
+}
+
+
+void*
+Component::allocateColdData(
+    size_t size
+) {
+    PoolAllocator* pool = poolForSize(coldDataPools(), size);
+    if (pool) {
+        return pool->allocate();
+    }
+    return ::operator new(size);
+}
+
+
+void
+Component::deallocateColdData(
+    void* pointer,
+    size_t size
+) {
+    PoolAllocator* pool = poolForSize(coldDataPools(), size);
+    if (pool) {
+        pool->deallocate(pointer);
+    }
+    else {
+        ::operator delete(pointer);
+    }
+}
+
+
+void*
+Component::operator new(
+    size_t size
+) {
+    PoolAllocator* pool = poolForSize(componentPools(), size);
+    if (pool) {
+        return pool->allocate();
+    }
+    return ::operator new(size);
+}
+
+
+void
+Component::operator delete(
+    void* pointer,
+    size_t size
+) {
+    PoolAllocator* pool = poolForSize(componentPools(), size);
+    if (pool) {
+        pool->deallocate(pointer);
+    }
+    else {
+        ::operator delete(pointer);
+    }
+}
+
+
+size_t
+Component::poolAllocatedBytes() {
+    size_t bytes = 0;
+    for (auto* pools : {&componentPools(), &coldDataPools()}) {
+        for (const PoolAllocator* pool : *pools) {
+            bytes += pool->allocatedBlocks() * pool->blockSize();
+        }
+    }
+    return bytes;
+}
+
+
+size_t
+Component::poolReservedBytes() {
+    size_t bytes = 0;
+    for (auto* pools : {&componentPools(), &coldDataPools()}) {
+        for (const PoolAllocator* pool : *pools) {
+            bytes += pool->reservedBytes();
+        }
+    }
+    return bytes;
+}
+
+
 Component::~Component() {}
 
 
+void
+Component::digest(
+    StateDigest& digest
+) const {
+    std::ostringstream stream;
+    stream << this->storage();
+    const std::string bytes = stream.str();
+    digest.addBytes(bytes.data(), bytes.size());
+}
+
+
+bool
+Component::isChangeTracked() const {
+    return false;
+}
+
+
 bool
 Component::isVolatile() const {
     return m_isVolatile;
 }
 
 
+namespace {
+
+const StorageKey OWNER_KEY("owner");
+
+}
+
+
 void
 Component::load(
     const StorageContainer& storage
 ) {
-    m_owner = storage.get<EntityId>("owner");
+    m_owner = storage.get<EntityId>(OWNER_KEY);
 }
 
 
@@ -126,8 +284,20 @@ Component::setVolatile(
 StorageContainer
 Component::storage() const {
     StorageContainer storage;
-    storage.set<EntityId>("owner", m_owner);
+    storage.set<EntityId>(OWNER_KEY, m_owner);
     return storage;
 }
 
 
+void
+Component::touched() {
+    if (m_collection) {
+        m_collection->queueTouched(*this);
+    }
+}
+
+
+uint32_t
+Component::version() const {
+    return m_version;
+}
@@ -5,6 +5,7 @@
 
 #include "engine/typedefs.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -15,6 +16,8 @@ class scope;
 
 namespace thrive {
 
+class ComponentCollection;
+class StateDigest;
 class StorageContainer;
 
 /**
@@ -46,11 +49,113 @@ public:
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Allocates memory for the cold data of a component
+    *
+    * Like operator new(), but from a separate set of pools, so that the
+    * rarely used parts of components (see ColdData) don't sit between the
+    * frequently used ones.
+    *
+    * @param size
+    *
+    * @throw std::bad_alloc
+    */
+    static void*
+    allocateColdData(
+        size_t size
+    );
+
+    /**
+    * @brief Returns memory from allocateColdData()
+    *
+    * @param pointer
+    * @param size
+    *   The size passed to allocateColdData()
+    */
+    static void
+    deallocateColdData(
+        void* pointer,
+        size_t size
+    );
+
+    /**
+    * @brief Allocates memory for a component
+    *
+    * Components of up to a few hundred bytes are allocated from pools,
+    * one for each size class, so that creating and destroying many small
+    * components does not put pressure on the general-purpose heap. Larger
+    * components fall back to the global operator new.
+    *
+    * @param size
+    *   The size of the most derived type
+    */
+    static void*
+    operator new(
+        size_t size
+    );
+
+    /**
+    * @brief Returns a component's memory to its pool
+    *
+    * @param pointer
+    * @param size
+    *   The size of the most derived type, as passed by the virtual
+    *   destructor
+    */
+    static void
+    operator delete(
+        void* pointer,
+        size_t size
+    );
+
+    /**
+    * @brief Bytes of component pool blocks that are currently in use
+    *
+    * Includes the pools of allocateColdData().
+    */
+    static size_t
+    poolAllocatedBytes();
+
+    /**
+    * @brief Bytes reserved by the component pools, including those of
+    * allocateColdData()
+    */
+    static size_t
+    poolReservedBytes();
+
     /**
     * @brief Destructor
     */
     virtual ~Component() = 0;
 
+    /**
+    * @brief Adds the component's simulation state to a digest
+    *
+    * Used by StateHashSystem to compare runs that should be deterministic.
+    * Overrides add the values the simulation depends on, bit for bit. The
+    * default adds the serialized storage(), which works for every type,
+    * including script components, but is slow. Its order of keys also
+    * follows the order in which the names were first used, which may
+    * differ between sessions that ran different scripts.
+    *
+    * @param digest
+    */
+    virtual void
+    digest(
+        StateDigest& digest
+    ) const;
+
+    /**
+    * @brief Whether every change to the component touches it
+    *
+    * EntityManager::snapshot() keeps reusing the stored copy of such a
+    * component until it is touched (see touched()). Components that also
+    * change without being touched, e.g. through plain members, the physics
+    * world or Lua, must return \c false, which is the default.
+    */
+    virtual bool
+    isChangeTracked() const;
+
     /**
     * @brief A volatile component is not serialized during a save
     *
@@ -116,6 +221,16 @@ public:
     virtual StorageContainer
     storage() const = 0;
 
+    /**
+    * @brief Queues the component in its collection's touched list
+    *
+    * Called by the component's touchables (see Touchable::setComponent()).
+    * Does nothing if the component is not in a collection or has already
+    * been queued since the last ComponentCollection::takeTouched().
+    */
+    void
+    touched();
+
     /**
     * @brief The component's type id
     */
@@ -128,14 +243,38 @@ public:
     virtual std::string
     typeName() const = 0;
 
+    /**
+    * @brief Counts the touches so far
+    *
+    * Increases whenever one of the registered touchables is touched while
+    * the component is in a collection. Unlike the touched list, any number
+    * of consumers can compare versions. Only compare versions of the same
+    * component, and only of change tracked ones (see isChangeTracked()),
+    * other components also change without being touched.
+    */
+    uint32_t
+    version() const;
+
 protected:
 
 private:
 
+    friend class ComponentCollection;
+
+    ComponentCollection* m_collection = nullptr;
+
+    // Whether the component changed since EntityManager::snapshot() last
+    // stored it
+    bool m_hasSnapshotChanges = true;
+
+    bool m_isTouched = false;
+
     bool m_isVolatile = false;
 
     EntityId m_owner = NULL_ENTITY;
 
+    uint32_t m_version = 1;
+
 };
 
 }
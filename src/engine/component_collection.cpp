@@ -1,29 +1,202 @@
 #include "engine/component_collection.h"
 
+#include "engine/component_factory.h"
 #include "util/contains.h"
 
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <limits>
 #include <unordered_set>
 
 #include <iostream>
 
 using namespace thrive;
 
+static const size_t NO_INDEX = std::numeric_limits<size_t>::max();
+
 struct ComponentCollection::Implementation {
 
     Implementation(
-        ComponentTypeId type
-    ) : m_type(type)
+        ComponentTypeId type,
+        Storage storage
+    ) : m_storage(storage),
+        m_type(type)
     {
     }
 
-    std::unordered_map<
-        unsigned int, 
-        std::pair<ChangeCallback, ChangeCallback>
-    > m_changeCallbacks;
+    size_t
+    indexOf(
+        EntityId entityId
+    ) const {
+        if (m_storage == Storage::SparseSet) {
+            EntityId slot = entityIndex(entityId);
+            if (slot < m_sparseIndex.size()) {
+                size_t index = m_sparseIndex[slot];
+                // The slot may be occupied by a different generation
+                if (index != NO_INDEX and m_entities[index] == entityId) {
+                    return index;
+                }
+            }
+            return NO_INDEX;
+        }
+        auto iter = m_hashedIndex.find(entityId);
+        if (iter != m_hashedIndex.end()) {
+            return iter->second;
+        }
+        return NO_INDEX;
+    }
+
+    void
+    setIndex(
+        EntityId entityId,
+        size_t index
+    ) {
+        if (m_storage == Storage::SparseSet) {
+            EntityId slot = entityIndex(entityId);
+            if (slot >= m_sparseIndex.size()) {
+                m_sparseIndex.resize(slot + 1, NO_INDEX);
+            }
+            m_sparseIndex[slot] = index;
+        }
+        else if (index == NO_INDEX) {
+            m_hashedIndex.erase(entityId);
+        }
+        else {
+            m_hashedIndex[entityId] = index;
+        }
+    }
+
+    // The version after the newest logged change
+    uint64_t
+    changesEnd() const {
+        return m_changesBegin + m_changes.size();
+    }
+
+    void
+    logAdded(
+        EntityId entityId,
+        Component& component
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_changesMutex);
+        if (m_observers.empty()) {
+            return;
+        }
+        LoggedChange loggedChange;
+        loggedChange.m_change = Change{&component, entityId, true};
+        m_changes.push_back(std::move(loggedChange));
+    }
+
+    void
+    logRemoved(
+        EntityId entityId,
+        std::unique_ptr<Component> component
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_changesMutex);
+        if (m_observers.empty()) {
+            // Nobody needs the component anymore
+            return;
+        }
+        LoggedChange loggedChange;
+        loggedChange.m_change = Change{component.get(), entityId, false};
+        loggedChange.m_removed = std::move(component);
+        m_changes.push_back(std::move(loggedChange));
+    }
+
+    // Drops the changes that no observer holds anymore. Expects the changes
+    // mutex to be locked.
+    void
+    trimChanges() {
+        uint64_t keep = this->changesEnd();
+        for (const auto& pair : m_observers) {
+            keep = std::min(keep, pair.second.m_held);
+        }
+        while (m_changesBegin < keep) {
+            m_changes.pop_front();
+            m_changesBegin += 1;
+        }
+    }
+
+    void
+    release(
+        Component& component
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_touchedMutex);
+        component.setOwner(NULL_ENTITY);
+        component.m_collection = nullptr;
+        component.m_isTouched = false;
+    }
+
+    std::unique_ptr<Component>
+    removeAt(
+        size_t index
+    ) {
+        std::unique_ptr<Component> component = std::move(m_components[index]);
+        EntityId entityId = m_entities[index];
+        size_t lastIndex = m_components.size() - 1;
+        if (index != lastIndex) {
+            m_components[index] = std::move(m_components[lastIndex]);
+            m_entities[index] = m_entities[lastIndex];
+            this->setIndex(m_entities[index], index);
+        }
+        m_sortedCount = std::min(m_sortedCount, index);
+        m_components.pop_back();
+        m_entities.pop_back();
+        this->setIndex(entityId, NO_INDEX);
+        return component;
+    }
+
+    struct LoggedChange {
+
+        Change m_change;
 
-    std::unordered_map<EntityId, std::unique_ptr<Component>> m_components;
+        // Keeps a removed component alive for the observers
+        std::unique_ptr<Component> m_removed;
 
-    unsigned int m_nextChangeCallbackId = 0;
+    };
+
+    struct Observer {
+
+        // Version of the first change not taken yet
+        uint64_t m_cursor = 0;
+
+        // Version of the first change of the batch taken last, which the
+        // observer may still be using
+        uint64_t m_held = 0;
+
+    };
+
+    std::deque<LoggedChange> m_changes;
+
+    // Version of the oldest change in m_changes
+    uint64_t m_changesBegin = 0;
+
+    boost::mutex m_changesMutex;
+
+    std::vector<std::unique_ptr<Component>> m_components;
+
+    std::vector<EntityId> m_entities;
+
+    std::unordered_map<EntityId, size_t> m_hashedIndex;
+
+    unsigned int m_nextObserverId = 0;
+
+    std::unordered_map<unsigned int, Observer> m_observers;
+
+    // The components before this index are sorted by entity slot
+    size_t m_sortedCount = 0;
+
+    std::vector<size_t> m_sparseIndex;
+
+    Storage m_storage = Storage::Hashed;
+
+    // Owners of the touched components, see takeTouched()
+    std::vector<EntityId> m_touched;
+
+    bool m_tracksTouched = false;
+
+    boost::mutex m_touchedMutex;
 
     ComponentTypeId m_type = NULL_COMPONENT_TYPE;
 
@@ -31,8 +204,9 @@ struct ComponentCollection::Implementation {
 
 
 ComponentCollection::ComponentCollection(
-    ComponentTypeId type
-) : m_impl(new Implementation(type))
+    ComponentTypeId type,
+    Storage storage
+) : m_impl(new Implementation(type, storage))
 {
 }
 
@@ -54,43 +228,44 @@ ComponentCollection::addComponent(
     std::unique_ptr<Component> component
 ) {
     bool isNew = true;
+    Component* rawComponent = component.get();
+    size_t index = m_impl->indexOf(entityId);
     // Check if we are overwriting an old component
-    if (m_impl->m_components.erase(entityId) > 0) {
+    if (index != NO_INDEX) {
         isNew = false;
-        for (auto& value : m_impl->m_changeCallbacks) {
-            value.second.second(entityId, *component);
-        }
+        std::unique_ptr<Component> oldComponent = std::move(
+            m_impl->m_components[index]
+        );
+        m_impl->m_components[index] = std::move(component);
+        m_impl->release(*oldComponent);
+        m_impl->logRemoved(entityId, std::move(oldComponent));
     }
-    // Insert new component
-    Component* rawComponent = component.get();
-    m_impl->m_components.insert(std::make_pair(
-        entityId, 
-        std::move(component)
-    ));
-    for (auto& value : m_impl->m_changeCallbacks) {
-        value.second.first(entityId, *rawComponent);
+    else {
+        m_impl->setIndex(entityId, m_impl->m_components.size());
+        m_impl->m_components.push_back(std::move(component));
+        m_impl->m_entities.push_back(entityId);
     }
     rawComponent->setOwner(entityId);
+    rawComponent->m_collection = this;
+    m_impl->logAdded(entityId, *rawComponent);
+    // New touchables start out with changes
+    this->queueTouched(*rawComponent);
     return isNew;
 }
 
 
 void
 ComponentCollection::clear() {
-    auto iter = m_impl->m_components.begin();
-    while (iter != m_impl->m_components.end()) {
-        EntityId entityId = iter->first;
-        std::unique_ptr<Component>& component = iter->second;
-        for (auto& value : m_impl->m_changeCallbacks) {
-            value.second.second(entityId, *component);
-        }
-        component->setOwner(NULL_ENTITY);
-        iter = m_impl->m_components.erase(iter);
+    while (not m_impl->m_components.empty()) {
+        size_t lastIndex = m_impl->m_components.size() - 1;
+        EntityId entityId = m_impl->m_entities[lastIndex];
+        m_impl->release(*m_impl->m_components[lastIndex]);
+        m_impl->logRemoved(entityId, m_impl->removeAt(lastIndex));
     }
 }
 
 
-const std::unordered_map<EntityId, std::unique_ptr<Component>>&
+const std::vector<std::unique_ptr<Component>>&
 ComponentCollection::components() const {
     return m_impl->m_components;
 }
@@ -102,13 +277,19 @@ ComponentCollection::empty() const {
 }
 
 
+const std::vector<EntityId>&
+ComponentCollection::entities() const {
+    return m_impl->m_entities;
+}
+
+
 Component*
 ComponentCollection::get(
     EntityId entityId
 ) const {
-    auto iter = m_impl->m_components.find(entityId);
-    if (iter != m_impl->m_components.end()) {
-        return iter->second.get();
+    size_t index = m_impl->indexOf(entityId);
+    if (index != NO_INDEX) {
+        return m_impl->m_components[index].get();
     }
     else {
         return nullptr;
@@ -117,15 +298,12 @@ ComponentCollection::get(
 
 
 unsigned int
-ComponentCollection::registerChangeCallbacks(
-    ChangeCallback onComponentAdded,
-    ChangeCallback onComponentRemoved
-) {
-    unsigned int id = m_impl->m_nextChangeCallbackId++;
-    m_impl->m_changeCallbacks.insert(std::make_pair(
-        id,
-        std::make_pair(onComponentAdded, onComponentRemoved)
-    ));
+ComponentCollection::registerObserver() {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_changesMutex);
+    unsigned int id = m_impl->m_nextObserverId++;
+    Implementation::Observer& observer = m_impl->m_observers[id];
+    observer.m_cursor = m_impl->changesEnd();
+    observer.m_held = observer.m_cursor;
     return id;
 }
 
@@ -134,19 +312,185 @@ bool
 ComponentCollection::removeComponent(
     EntityId entityId
 ) {
-    auto iter = m_impl->m_components.find(entityId);
-    if (iter != m_impl->m_components.end()) {
-        for (auto& value : m_impl->m_changeCallbacks) {
-            value.second.second(entityId, *iter->second);
-        }
-        iter->second->setOwner(NULL_ENTITY);
-        m_impl->m_components.erase(iter);
+    size_t index = m_impl->indexOf(entityId);
+    if (index != NO_INDEX) {
+        m_impl->release(*m_impl->m_components[index]);
+        m_impl->logRemoved(entityId, m_impl->removeAt(index));
         return true;
     }
     return false;
 }
 
 
+void
+ComponentCollection::reserve(
+    size_t count
+) {
+    m_impl->m_components.reserve(count);
+    m_impl->m_entities.reserve(count);
+    if (m_impl->m_storage == Storage::Hashed) {
+        m_impl->m_hashedIndex.reserve(count);
+    }
+}
+
+
+size_t
+ComponentCollection::memoryUsage() const {
+    const Implementation& impl = *m_impl;
+    // Each hash map node holds its value and a link to the next node
+    size_t hashedIndexBytes = 
+        impl.m_hashedIndex.bucket_count() * sizeof(void*) +
+        impl.m_hashedIndex.size() * (
+            sizeof(std::pair<const EntityId, size_t>) + sizeof(void*)
+        );
+    return 
+        impl.m_components.capacity() * sizeof(std::unique_ptr<Component>) +
+        impl.m_components.size() * ComponentFactory::getComponentSize(impl.m_type) +
+        impl.m_entities.capacity() * sizeof(EntityId) +
+        hashedIndexBytes +
+        impl.m_sparseIndex.capacity() * sizeof(size_t) +
+        impl.m_changes.size() * sizeof(Implementation::LoggedChange) +
+        impl.m_touched.capacity() * sizeof(EntityId)
+    ;
+}
+
+
+size_t
+ComponentCollection::size() const {
+    return m_impl->m_components.size();
+}
+
+
+void
+ComponentCollection::queueTouched(
+    Component& component
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_touchedMutex);
+    component.m_hasSnapshotChanges = true;
+    ++component.m_version;
+    if (m_impl->m_tracksTouched and not component.m_isTouched) {
+        component.m_isTouched = true;
+        m_impl->m_touched.push_back(component.owner());
+    }
+}
+
+
+ComponentCollection::Storage
+ComponentCollection::storage() const {
+    return m_impl->m_storage;
+}
+
+
+void
+ComponentCollection::takeChanges(
+    unsigned int observerId,
+    std::vector<Change>& changes
+) {
+    changes.clear();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_changesMutex);
+    auto iter = m_impl->m_observers.find(observerId);
+    if (iter == m_impl->m_observers.end()) {
+        return;
+    }
+    Implementation::Observer& observer = iter->second;
+    uint64_t end = m_impl->changesEnd();
+    for (uint64_t version = observer.m_cursor; version < end; ++version) {
+        changes.push_back(
+            m_impl->m_changes[version - m_impl->m_changesBegin].m_change
+        );
+    }
+    observer.m_held = observer.m_cursor;
+    observer.m_cursor = end;
+    m_impl->trimChanges();
+}
+
+
+bool
+ComponentCollection::sortStep(
+    size_t& budget
+) {
+    Implementation& impl = *m_impl;
+    auto isBefore = [] (EntityId left, EntityId right) {
+        return entityIndex(left) < entityIndex(right);
+    };
+    while (impl.m_sortedCount < impl.m_entities.size() and budget > 0) {
+        size_t index = impl.m_sortedCount;
+        size_t target = std::upper_bound(
+            impl.m_entities.begin(),
+            impl.m_entities.begin() + index,
+            impl.m_entities[index],
+            isBefore
+        ) - impl.m_entities.begin();
+        if (target != index) {
+            std::rotate(
+                impl.m_entities.begin() + target,
+                impl.m_entities.begin() + index,
+                impl.m_entities.begin() + index + 1
+            );
+            std::rotate(
+                impl.m_components.begin() + target,
+                impl.m_components.begin() + index,
+                impl.m_components.begin() + index + 1
+            );
+            for (size_t i = target; i <= index; ++i) {
+                impl.setIndex(impl.m_entities[i], i);
+            }
+        }
+        budget -= std::min(budget, index - target + 1);
+        impl.m_sortedCount += 1;
+    }
+    return impl.m_sortedCount < impl.m_entities.size();
+}
+
+
+bool
+ComponentCollection::takeSnapshotChanges(
+    size_t begin,
+    size_t end
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_touchedMutex);
+    bool hasChanges = false;
+    for (size_t i = begin; i < end; ++i) {
+        Component& component = *m_impl->m_components[i];
+        if (component.m_hasSnapshotChanges or not component.isChangeTracked()) {
+            hasChanges = true;
+        }
+        component.m_hasSnapshotChanges = false;
+    }
+    return hasChanges;
+}
+
+
+void
+ComponentCollection::takeTouched(
+    std::vector<Component*>& components
+) {
+    components.clear();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_touchedMutex);
+    for (EntityId entityId : m_impl->m_touched) {
+        Component* component = this->get(entityId);
+        // A replaced component may have left its entity id behind
+        if (component and component->m_isTouched) {
+            component->m_isTouched = false;
+            components.push_back(component);
+        }
+    }
+    m_impl->m_touched.clear();
+}
+
+
+void
+ComponentCollection::trackTouched() {
+    if (m_impl->m_tracksTouched) {
+        return;
+    }
+    m_impl->m_tracksTouched = true;
+    for (const auto& component : m_impl->m_components) {
+        this->queueTouched(*component);
+    }
+}
+
+
 ComponentTypeId
 ComponentCollection::type() const {
     return m_impl->m_type;
@@ -154,9 +498,10 @@ ComponentCollection::type() const {
 
 
 void
-ComponentCollection::unregisterChangeCallbacks(
-    unsigned int id
+ComponentCollection::unregisterObserver(
+    unsigned int observer
 ) {
-    m_impl->m_changeCallbacks.erase(id);
+    boost::lock_guard<boost::mutex> lock(m_impl->m_changesMutex);
+    m_impl->m_observers.erase(observer);
+    m_impl->trimChanges();
 }
-
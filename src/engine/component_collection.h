@@ -3,7 +3,9 @@
 #include "engine/component.h"
 #include "engine/typedefs.h"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace thrive {
 
@@ -14,20 +16,75 @@ class EntityManager;
 *
 * A component collection handles components of one specific type. It offers
 * functions to retrieve the component (if any) of a specific entity and
-* callbacks for when a component has been added or removed (mainly used by
-* the EntityFilter).
+* a log of the components that have been added or removed, for systems that
+* keep their own data about the components.
 *
 * Component collections are pretty much read-only for anything but the 
 * EntityManager. Use the manager to actually add or remove components.
+*
+* Components are kept in a dense array, with a parallel array holding the 
+* owning entity ids, so that iterating over all components of a type walks
+* contiguous memory. Removing a component moves the last component into the
+* freed slot, so the order of components is not stable. In idle time,
+* EntityManager::compactStep() sorts the arrays back into entity order bit
+* by bit.
+*
+* While at least one observer is registered, every add and remove is
+* appended to a change log. Each observer has its own position in the log
+* and takes the changes since its last takeChanges() in one batch. Removed
+* components are kept alive in the log until every observer has taken them
+* and moved on, so that observers can still read their data.
 */
 class ComponentCollection {
 
 public:
 
     /**
-    * @brief Callback for when a component has been added or removed
+    * @brief How a collection maps entity ids to indices in its dense array
     */
-    using ChangeCallback = std::function<void(EntityId, Component&)>;
+    enum class Storage {
+        /**
+        * @brief Entity ids are looked up in a hash map
+        *
+        * Memory usage is proportional to the number of components. This is
+        * the default for all component types.
+        */
+        Hashed,
+
+        /**
+        * @brief Entity slot indices index a flat sparse table directly
+        *
+        * Lookups don't need to hash, but the sparse table grows with the 
+        * largest entity slot index seen. Meant for component types with 
+        * many instances, like agent particles.
+        */
+        SparseSet
+    };
+
+    /**
+    * @brief An added or removed component, see takeChanges()
+    */
+    struct Change {
+
+        /**
+        * @brief The added or removed component
+        *
+        * A removed component is no longer owned by its entity, but stays
+        * valid until the observer's next takeChanges().
+        */
+        Component* component;
+
+        /**
+        * @brief The entity the component was added to or removed from
+        */
+        EntityId entityId;
+
+        /**
+        * @brief \c true if the component was added, \c false if removed
+        */
+        bool isAdded;
+
+    };
 
     /**
     * @brief Destructor
@@ -49,10 +106,12 @@ public:
     clear();
 
     /**
-    * @brief Returns a reference to the internal component map
+    * @brief Returns a reference to the dense component array
     *
+    * The component at index \a i belongs to the entity at index \a i of 
+    * entities().
     */
-    const std::unordered_map<EntityId, std::unique_ptr<Component>>&
+    const std::vector<std::unique_ptr<Component>>&
     components() const;
 
     /**
@@ -63,6 +122,15 @@ public:
     bool
     empty() const;
 
+    /**
+    * @brief Returns a reference to the dense entity id array
+    *
+    * The entity at index \a i owns the component at index \a i of 
+    * components().
+    */
+    const std::vector<EntityId>&
+    entities() const;
+
     /**
     * @brief Retrieves a component from the collection
     *
@@ -79,24 +147,97 @@ public:
     ) const;
 
     /**
-    * @brief Registers callbacks for when components are added or removed
+    * @brief Registers an observer of the change log
     *
-    * @param onComponentAdded
-    *   Called when a component has been added
-    * @param onComponentRemoved
-    *   Called when a component has been removed
+    * The observer starts at the end of the log, so it is up to the caller
+    * to handle the components already in the collection.
     *
     * @return 
-    *   An identifier with which you can remove the callbacks.
-    *
-    * @see unregisterChangeCallbacks
+    *   An identifier for takeChanges() and unregisterObserver()
     */
     unsigned int
-    registerChangeCallbacks(
-        ChangeCallback onComponentAdded,
-        ChangeCallback onComponentRemoved
+    registerObserver();
+
+    /**
+    * @brief Estimates the bytes used by the collection and its components
+    *
+    * Counts the capacity of the collection's arrays and index, and the
+    * components' objects as registered with 
+    * ComponentFactory::registerGlobalComponentType().
+    */
+    size_t
+    memoryUsage() const;
+
+    /**
+    * @brief The number of components in this collection
+    */
+    size_t
+    size() const;
+
+    /**
+    * @brief The storage mode chosen for this collection
+    */
+    Storage
+    storage() const;
+
+    /**
+    * @brief Takes the changes since the observer's last call
+    *
+    * The changes are in the order they happened. Replacing a component
+    * lists the old one as removed and the new one as added. A component 
+    * may appear as added and removed in the same batch.
+    *
+    * The components of the previous batch, removed ones in particular, 
+    * must not be used after this call. 
+    *
+    * Thread safe.
+    *
+    * @param observer
+    *   The id returned by registerObserver()
+    * @param changes
+    *   Receives the changes. Cleared first.
+    */
+    void
+    takeChanges(
+        unsigned int observer,
+        std::vector<Change>& changes
+    );
+
+    /**
+    * @brief Takes the components touched since the last call
+    *
+    * Only available after trackTouched(). A component is queued when it is
+    * added and whenever one of its registered touchables is touched (see
+    * Touchable::setComponent()). Each component is listed once, no matter
+    * how often it was touched. Components that have been removed in the
+    * meantime are skipped.
+    *
+    * Touching a component after this call queues it again, so a system can
+    * postpone a change to the next frame by touching it again while 
+    * processing the list.
+    *
+    * Only one system should take the touched components of a collection.
+    *
+    * @param components
+    *   Receives the touched components. Cleared first.
+    */
+    void
+    takeTouched(
+        std::vector<Component*>& components
     );
 
+    /**
+    * @brief Starts keeping a list of touched components
+    *
+    * Until this is called, touching a component is not recorded, so that
+    * collections nobody takes from don't pile up entries. All components
+    * already in the collection are queued.
+    *
+    * @see takeTouched
+    */
+    void
+    trackTouched();
+
     /**
     * @brief The type id of the collection's components
     */
@@ -104,16 +245,17 @@ public:
     type() const;
 
     /**
-    * @brief Unregisters change callbacks
+    * @brief Unregisters an observer
     *
-    * If the id could not be found, does nothing.
+    * Removed components that no other observer needs anymore are 
+    * destroyed. If the id could not be found, does nothing.
     *
-    * @param id
-    *   The id returned by registerChangeCallbacks
+    * @param observer
+    *   The id returned by registerObserver()
     */
     void
-    unregisterChangeCallbacks(
-        unsigned int id
+    unregisterObserver(
+        unsigned int observer
     );
 
 private:
@@ -123,19 +265,27 @@ private:
     */
     friend class EntityManager;
 
+    /**
+    * @brief For Component::touched()
+    */
+    friend class Component;
+
     /**
     * @brief Constructor
     *
     * @param type The type id of the components held by this collection.
+    * @param storage How entity ids are mapped to components
     */
     ComponentCollection(
-        ComponentTypeId type
+        ComponentTypeId type,
+        Storage storage = Storage::Hashed
     );
 
     /**
     * @brief Adds a component
     *
-    * Also calls any callbacks registered for added components.
+    * Logs the addition, and the removal of a replaced component, if there
+    * are observers.
     *
     * @param entityId
     *   The entity the component belongs to
@@ -155,7 +305,7 @@ private:
     /**
     * @brief Removes a component
     *
-    * Also calls any callbacks registered for removed components.
+    * Logs the removal if there are observers.
     *
     * @param entityId
     *   The entity the component belongs to
@@ -169,6 +319,72 @@ private:
         EntityId entityId
     );
 
+    /**
+    * @brief Reserves memory for a number of components
+    *
+    * Used by EntityManager::restore(), which knows the final size upfront.
+    *
+    * @param count
+    *   The total number of components to make room for
+    */
+    void
+    reserve(
+        size_t count
+    );
+
+    /**
+    * @brief Moves components towards entity order
+    *
+    * Used by EntityManager::compactStep(). The components before a cursor
+    * are sorted by entity slot, each step inserts the components after it
+    * into place. Removing a component moves the cursor back to the freed
+    * index, added components are appended after it.
+    *
+    * @param budget
+    *   The number of components that may be visited or moved, reduced by
+    *   the number used. A single insertion may overrun it.
+    *
+    * @return
+    *   \c true if the components are not sorted yet
+    */
+    bool
+    sortStep(
+        size_t& budget
+    );
+
+    /**
+    * @brief Checks and resets whether a range of components changed
+    *
+    * Used by EntityManager::snapshot(). Components that are not change
+    * tracked (see Component::isChangeTracked()) always count as changed.
+    *
+    * @param begin
+    *   The index of the first component in components()
+    * @param end
+    *   The index after the last component
+    *
+    * @return
+    *   \c true if any component in the range was added, replaced or
+    *   touched since the last call that included it
+    */
+    bool
+    takeSnapshotChanges(
+        size_t begin,
+        size_t end
+    );
+
+    /**
+    * @brief Adds a component to the touched list, unless already listed
+    *
+    * Thread safe.
+    *
+    * @param component
+    */
+    void
+    queueTouched(
+        Component& component
+    );
+
     struct Implementation;
     std::unique_ptr<Implementation> m_impl;
     
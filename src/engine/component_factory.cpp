@@ -34,6 +34,34 @@ globalRegistry() {
 }
 
 
+static std::unordered_map<ComponentTypeId, ComponentCollection::Storage>&
+globalStorageRegistry() {
+    static std::unordered_map<ComponentTypeId, ComponentCollection::Storage> registry;
+    return registry;
+}
+
+
+static std::unordered_map<ComponentTypeId, size_t>&
+globalSizeRegistry() {
+    static std::unordered_map<ComponentTypeId, size_t> registry;
+    return registry;
+}
+
+
+static std::unordered_map<std::string, ComponentTypeId>&
+globalTagRegistry() {
+    static std::unordered_map<std::string, ComponentTypeId> registry;
+    return registry;
+}
+
+
+static std::unordered_map<ComponentTypeId, std::string>&
+globalTagNames() {
+    static std::unordered_map<ComponentTypeId, std::string> names;
+    return names;
+}
+
+
 static ComponentTypeId
 ComponentFactory_registerComponentType(
     ComponentFactory* self,
@@ -77,7 +105,9 @@ ComponentFactory::luaBindings() {
 ComponentTypeId
 ComponentFactory::registerGlobalComponentType(
     const std::string& name,
-    ComponentLoader loader
+    ComponentLoader loader,
+    ComponentCollection::Storage storage,
+    size_t componentSize
 ) {
     bool isNew = false;
     ComponentTypeId typeId = generateTypeId();
@@ -85,13 +115,39 @@ ComponentFactory::registerGlobalComponentType(
         name,
         std::make_pair(typeId, loader)
     });
-    if (not isNew) {
+    if (not isNew or globalTagRegistry().count(name)) {
         throw std::runtime_error("Duplicate component name: " + name);
     }
+    globalStorageRegistry()[typeId] = storage;
+    globalSizeRegistry()[typeId] = componentSize;
     return typeId;
 }
 
 
+size_t
+ComponentFactory::getComponentSize(
+    ComponentTypeId typeId
+) {
+    auto iter = globalSizeRegistry().find(typeId);
+    if (iter == globalSizeRegistry().end()) {
+        return 0;
+    }
+    return iter->second;
+}
+
+
+ComponentCollection::Storage
+ComponentFactory::getStorage(
+    ComponentTypeId typeId
+) {
+    auto iter = globalStorageRegistry().find(typeId);
+    if (iter == globalStorageRegistry().end()) {
+        return ComponentCollection::Storage::Hashed;
+    }
+    return iter->second;
+}
+
+
 ComponentFactory::ComponentFactory() 
   : m_impl(new Implementation())
 {
@@ -116,6 +172,18 @@ ComponentFactory::getTypeId(
 }
 
 
+std::string
+ComponentFactory::getTagName(
+    ComponentTypeId tagId
+) {
+    auto iter = globalTagNames().find(tagId);
+    if (iter == globalTagNames().end()) {
+        return "";
+    }
+    return iter->second;
+}
+
+
 std::string
 ComponentFactory::getTypeName(
     ComponentTypeId typeId
@@ -134,6 +202,22 @@ ComponentFactory::getTypeName(
 }
 
 
+bool
+ComponentFactory::isGlobalComponentType(
+    const std::string& name
+) {
+    return globalRegistry().count(name) > 0;
+}
+
+
+bool
+ComponentFactory::isTag(
+    ComponentTypeId typeId
+) {
+    return globalTagNames().count(typeId) > 0;
+}
+
+
 std::unique_ptr<Component>
 ComponentFactory::load(
     const std::string& typeName,
@@ -169,6 +253,24 @@ ComponentFactory::registerComponentType(
 }
 
 
+ComponentTypeId
+ComponentFactory::registerTag(
+    const std::string& name
+) {
+    auto iter = globalTagRegistry().find(name);
+    if (iter != globalTagRegistry().end()) {
+        return iter->second;
+    }
+    if (globalRegistry().count(name)) {
+        throw std::runtime_error("Tag name is a component type: " + name);
+    }
+    ComponentTypeId tagId = generateTypeId();
+    globalTagRegistry().emplace(name, tagId);
+    globalTagNames().emplace(tagId, name);
+    return tagId;
+}
+
+
 void
 ComponentFactory::unregisterComponentType(
     const std::string& name
@@ -177,3 +279,9 @@ ComponentFactory::unregisterComponentType(
 }
 
 
+void
+ComponentFactory::unregisterComponentTypes() {
+    m_impl->m_registry.clear();
+}
+
+
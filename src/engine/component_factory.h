@@ -1,8 +1,11 @@
 #pragma once
 
 #include "engine/component.h"
+#include "engine/component_collection.h"
 #include "util/make_unique.h"
 
+#include <functional>
+
 namespace luabind {
     class scope;
 }
@@ -57,6 +60,9 @@ public:
     * @tparam C
     *   The subclass of Component.
     *
+    * @param storage
+    *   The storage mode for the type's component collections
+    *
     * @return The type's unique id
     *
     * @note
@@ -66,17 +72,66 @@ public:
     */
     template<typename C>
     static ComponentTypeId
-    registerGlobalComponentType() {
+    registerGlobalComponentType(
+        ComponentCollection::Storage storage = ComponentCollection::Storage::Hashed
+    ) {
         return ComponentFactory::registerGlobalComponentType(
             C::TYPE_NAME(),
             [](const StorageContainer& storage) {
                 std::unique_ptr<Component> component = make_unique<C>();
                 component->load(storage);
                 return component;
-            }
+            },
+            storage,
+            sizeof(C)
         );
     }
 
+    /**
+    * @brief Looks up the size of a component type's objects
+    *
+    * @param typeId
+    *   The component type id
+    *
+    * @return
+    *   \c sizeof the type registered with registerGlobalComponentType or 
+    *   \c 0 for unknown types and types registered at runtime.
+    */
+    static size_t
+    getComponentSize(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Looks up the storage mode a component type was registered with
+    *
+    * @param typeId
+    *   The component type id
+    *
+    * @return 
+    *   The storage mode passed to registerGlobalComponentType or 
+    *   ComponentCollection::Storage::Hashed for unknown types and types 
+    *   registered at runtime.
+    */
+    static ComponentCollection::Storage
+    getStorage(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Looks up a tag id and returns its name
+    *
+    * @param tagId
+    *   The tag id returned by registerTag()
+    *
+    * @return
+    *   The tag name or an empty string if \a tagId is not a tag
+    */
+    static std::string
+    getTagName(
+        ComponentTypeId tagId
+    );
+
     /**
     * @brief Looks up a component type name and returns its id
     *
@@ -107,6 +162,38 @@ public:
         ComponentTypeId typeId
     ) const;
 
+    /**
+    * @brief Checks whether a component type was registered globally
+    *
+    * Global types are the C++ components registered with
+    * REGISTER_COMPONENT. Their loaders don't run Lua, so they can load
+    * components on any thread, see EntityManager::restore().
+    *
+    * @param name
+    *   The component type name
+    *
+    * @return
+    *   \c true if \a name was registered with registerGlobalComponentType()
+    */
+    static bool
+    isGlobalComponentType(
+        const std::string& name
+    );
+
+    /**
+    * @brief Checks whether a type id belongs to a tag
+    *
+    * @param typeId
+    *   The type id to check
+    *
+    * @return 
+    *   \c true if \a typeId was returned by registerTag()
+    */
+    static bool
+    isTag(
+        ComponentTypeId typeId
+    );
+
     /**
     * @brief Loads a component from storage
     *
@@ -142,6 +229,25 @@ public:
         ComponentLoader loader
     );
 
+    /**
+    * @brief Returns the id of a tag, registering it on first use
+    *
+    * Tags are component types without component objects, see 
+    * EntityManager::addTag(). They share the id space of the component
+    * types, so they can be used in component masks and archetype 
+    * signatures.
+    *
+    * @param name
+    *   The tag name. Must not be the name of a component type.
+    *
+    * @return
+    *   The tag's unique id. The same name always returns the same id.
+    */
+    static ComponentTypeId
+    registerTag(
+        const std::string& name
+    );
+
     /**
     * @brief Unregisters a component type
     *
@@ -153,12 +259,22 @@ public:
         const std::string& name
     );
 
+    /**
+    * @brief Unregisters all types added with registerComponentType()
+    *
+    * Global component types stay registered.
+    */
+    void
+    unregisterComponentTypes();
+
 private:
 
     static ComponentTypeId
     registerGlobalComponentType(
         const std::string& name,
-        ComponentLoader loader
+        ComponentLoader loader,
+        ComponentCollection::Storage storage,
+        size_t componentSize
     );
 
     struct Implementation;
@@ -174,4 +290,14 @@ private:
 #define REGISTER_COMPONENT(cls) \
     const ComponentTypeId cls::TYPE_ID = thrive::ComponentFactory::registerGlobalComponentType<cls>();
 
+/**
+ * @brief Registers a component class with a non-default storage mode
+ *
+ * Use this in the component's source file instead of REGISTER_COMPONENT.
+ *
+ * @see ComponentCollection::Storage
+ */
+#define REGISTER_COMPONENT_WITH_STORAGE(cls, storage) \
+    const ComponentTypeId cls::TYPE_ID = thrive::ComponentFactory::registerGlobalComponentType<cls>(storage);
+
 }
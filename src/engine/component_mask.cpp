@@ -0,0 +1,134 @@
+#include "engine/component_mask.h"
+
+#include <algorithm>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <limits>
+#include <unordered_map>
+
+using namespace thrive;
+
+namespace {
+
+const size_t NO_BIT = std::numeric_limits<size_t>::max();
+
+const size_t WORD_BITS = 64;
+
+// Returns the bit of a component type, or NO_BIT if it has none yet and
+// assign is false
+size_t
+bitOf(
+    ComponentTypeId typeId,
+    bool assign
+) {
+    static boost::mutex mutex;
+    static std::unordered_map<ComponentTypeId, size_t> bits;
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (assign) {
+        return bits.emplace(typeId, bits.size()).first->second;
+    }
+    auto iter = bits.find(typeId);
+    return iter == bits.end() ? NO_BIT : iter->second;
+}
+
+}
+
+
+ComponentMask::ComponentMask(
+    const std::vector<ComponentTypeId>& typeIds
+) {
+    for (ComponentTypeId typeId : typeIds) {
+        this->set(typeId);
+    }
+}
+
+
+bool
+ComponentMask::containsAll(
+    const ComponentMask& other
+) const {
+    if (other.m_words.size() > m_words.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < other.m_words.size(); ++i) {
+        if ((m_words[i] & other.m_words[i]) != other.m_words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool
+ComponentMask::containsAny(
+    const ComponentMask& other
+) const {
+    size_t size = std::min(m_words.size(), other.m_words.size());
+    for (size_t i = 0; i < size; ++i) {
+        if (m_words[i] & other.m_words[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool
+ComponentMask::empty() const {
+    return m_words.empty();
+}
+
+
+void
+ComponentMask::reset(
+    ComponentTypeId typeId
+) {
+    size_t bit = bitOf(typeId, false);
+    if (bit == NO_BIT or bit / WORD_BITS >= m_words.size()) {
+        return;
+    }
+    m_words[bit / WORD_BITS] &= ~(uint64_t(1) << (bit % WORD_BITS));
+    while (not m_words.empty() and m_words.back() == 0) {
+        m_words.pop_back();
+    }
+}
+
+
+void
+ComponentMask::set(
+    ComponentTypeId typeId
+) {
+    size_t bit = bitOf(typeId, true);
+    if (bit / WORD_BITS >= m_words.size()) {
+        m_words.resize(bit / WORD_BITS + 1, 0);
+    }
+    m_words[bit / WORD_BITS] |= uint64_t(1) << (bit % WORD_BITS);
+}
+
+
+bool
+ComponentMask::test(
+    ComponentTypeId typeId
+) const {
+    size_t bit = bitOf(typeId, false);
+    if (bit == NO_BIT or bit / WORD_BITS >= m_words.size()) {
+        return false;
+    }
+    return (m_words[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+
+bool
+ComponentMask::operator== (
+    const ComponentMask& other
+) const {
+    return m_words == other.m_words;
+}
+
+
+bool
+ComponentMask::operator!= (
+    const ComponentMask& other
+) const {
+    return m_words != other.m_words;
+}
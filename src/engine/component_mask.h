@@ -0,0 +1,108 @@
+#pragma once
+
+#include "engine/typedefs.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A set of component types as a bitmask
+*
+* Each component type id gets a bit the first time it is put into any mask.
+* Bits are handed out consecutively, so masks grow with the number of
+* component types in use and not with the values of their type ids.
+*
+* Comparing two masks is a loop over a few machine words, which makes masks
+* suitable for checks that run for every entity or archetype, like whether
+* an entity has all components an EntityFilter requires. Setting and
+* testing single types has to look up their bit and is slower.
+*/
+class ComponentMask {
+
+public:
+
+    /**
+    * @brief Constructs an empty mask
+    */
+    ComponentMask() = default;
+
+    /**
+    * @brief Constructs a mask with some component types
+    *
+    * @param typeIds
+    *   The component types to set
+    */
+    explicit ComponentMask(
+        const std::vector<ComponentTypeId>& typeIds
+    );
+
+    /**
+    * @brief Whether every type in \a other is also in this mask
+    *
+    * Always \c true if \a other is empty.
+    */
+    bool
+    containsAll(
+        const ComponentMask& other
+    ) const;
+
+    /**
+    * @brief Whether at least one type in \a other is also in this mask
+    *
+    * Always \c false if \a other is empty.
+    */
+    bool
+    containsAny(
+        const ComponentMask& other
+    ) const;
+
+    /**
+    * @brief Whether no type is set
+    */
+    bool
+    empty() const;
+
+    /**
+    * @brief Removes a component type
+    */
+    void
+    reset(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Adds a component type
+    */
+    void
+    set(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Whether a component type is in this mask
+    */
+    bool
+    test(
+        ComponentTypeId typeId
+    ) const;
+
+    bool
+    operator== (
+        const ComponentMask& other
+    ) const;
+
+    bool
+    operator!= (
+        const ComponentMask& other
+    ) const;
+
+private:
+
+    // Trailing words are never zero, so that equal sets compare equal
+    std::vector<uint64_t> m_words;
+
+};
+
+}
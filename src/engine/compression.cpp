@@ -0,0 +1,552 @@
+#include "engine/compression.h"
+
+#include "engine/thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+const std::array<char, 8> MAGIC = {{
+    'T', 'H', 'R', 'I', 'V', 'E', 'C', 'Z'
+}};
+
+const uint64_t VERSION = 1;
+
+// Frames are compressed independently, so seeking only has to decompress
+// the frame it lands in
+const size_t FRAME_SIZE = 256 * 1024;
+
+// Frames keep the id of the codec they were compressed with. New codecs get
+// a new id, and readers keep decoding the old ones.
+enum Codec : uint8_t {
+    Stored = 0,
+    Lz77 = 1
+};
+
+
+void
+writeVarint(
+    std::ostream& stream,
+    uint64_t value
+) {
+    while (value >= 0x80) {
+        stream.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    stream.put(static_cast<char>(value));
+}
+
+
+uint64_t
+readVarint(
+    std::istream& stream
+) {
+    uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        int byte = stream.get();
+        if (byte == std::istream::traits_type::eof()) {
+            throw std::runtime_error("Corrupt compressed stream: unexpected end of data");
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt compressed stream: varint too long");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// LZ77 codec
+//
+// A block is a series of sequences. Each sequence starts with a token byte
+// whose high nibble is the number of literals and whose low nibble is the
+// match length minus MIN_MATCH. A nibble of 15 is continued by bytes that
+// are added to it, as long as they are 255. The literals follow, then the
+// match offset as two bytes, little endian, and the continued match length.
+// The last sequence has literals only.
+////////////////////////////////////////////////////////////////////////////////
+
+const size_t MIN_MATCH = 4;
+
+const size_t MAX_OFFSET = 0xFFFF;
+
+const unsigned int HASH_BITS = 16;
+
+
+uint32_t
+read32(
+    const unsigned char* data
+) {
+    uint32_t value = 0;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+uint32_t
+hash32(
+    const unsigned char* data
+) {
+    return (read32(data) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+void
+writeLength(
+    std::string& output,
+    size_t length
+) {
+    while (length >= 255) {
+        output.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    output.push_back(static_cast<char>(length));
+}
+
+
+void
+writeSequence(
+    std::string& output,
+    const unsigned char* literals,
+    size_t literalCount,
+    size_t offset,
+    size_t matchLength
+) {
+    size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+    unsigned char token = static_cast<unsigned char>(
+        (std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)
+    );
+    output.push_back(static_cast<char>(token));
+    if (literalCount >= 15) {
+        writeLength(output, literalCount - 15);
+    }
+    output.append(reinterpret_cast<const char*>(literals), literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    output.push_back(static_cast<char>(offset & 0xFF));
+    output.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) {
+        writeLength(output, matchCode - 15);
+    }
+}
+
+
+size_t
+matchLength(
+    const unsigned char* data,
+    size_t size,
+    size_t candidate,
+    size_t position
+) {
+    size_t length = 0;
+    while (position + length < size and data[candidate + length] == data[position + length]) {
+        ++length;
+    }
+    return length;
+}
+
+
+// Greedy matching with a single candidate per hash
+std::string
+compressFast(
+    const unsigned char* data,
+    size_t size
+) {
+    std::string output;
+    output.reserve(size / 2 + 16);
+    std::vector<int32_t> table(1 << HASH_BITS, -1);
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + MIN_MATCH <= size) {
+        uint32_t hash = hash32(data + position);
+        int32_t candidate = table[hash];
+        table[hash] = static_cast<int32_t>(position);
+        if (
+            candidate >= 0 and
+            position - candidate <= MAX_OFFSET and
+            read32(data + candidate) == read32(data + position)
+        ) {
+            size_t length = matchLength(data, size, candidate, position);
+            writeSequence(output, data + anchor, position - anchor, position - candidate, length);
+            position += length;
+            anchor = position;
+        }
+        else {
+            ++position;
+        }
+    }
+    writeSequence(output, data + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+
+// Keeps a chain of earlier positions per hash and picks the longest match
+// among the most recent ones
+std::string
+compressHigh(
+    const unsigned char* data,
+    size_t size
+) {
+    const unsigned int MAX_CANDIDATES = 64;
+    std::string output;
+    output.reserve(size / 2 + 16);
+    std::vector<int32_t> heads(1 << HASH_BITS, -1);
+    std::vector<int32_t> previous(MAX_OFFSET + 1, -1);
+    auto insert = [&] (size_t position) {
+        uint32_t hash = hash32(data + position);
+        previous[position & MAX_OFFSET] = heads[hash];
+        heads[hash] = static_cast<int32_t>(position);
+    };
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + MIN_MATCH <= size) {
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        int32_t candidate = heads[hash32(data + position)];
+        for (
+            unsigned int i = 0;
+            i < MAX_CANDIDATES and candidate >= 0 and position - candidate <= MAX_OFFSET;
+            ++i
+        ) {
+            size_t length = matchLength(data, size, candidate, position);
+            if (length > bestLength) {
+                bestLength = length;
+                bestOffset = position - candidate;
+            }
+            candidate = previous[candidate & MAX_OFFSET];
+        }
+        if (bestLength < MIN_MATCH) {
+            insert(position);
+            ++position;
+            continue;
+        }
+        writeSequence(output, data + anchor, position - anchor, bestOffset, bestLength);
+        size_t end = position + bestLength;
+        for (; position < end; ++position) {
+            if (position + MIN_MATCH <= size) {
+                insert(position);
+            }
+        }
+        anchor = position;
+    }
+    writeSequence(output, data + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+
+size_t
+readLength(
+    const unsigned char*& input,
+    const unsigned char* end,
+    size_t length
+) {
+    if (length < 15) {
+        return length;
+    }
+    unsigned char byte = 255;
+    while (byte == 255) {
+        if (input == end) {
+            throw std::runtime_error("Corrupt compressed stream: truncated length");
+        }
+        byte = *input++;
+        length += byte;
+    }
+    return length;
+}
+
+
+void
+decompressLz77(
+    const std::string& compressed,
+    std::string& output,
+    size_t size
+) {
+    output.resize(size);
+    auto input = reinterpret_cast<const unsigned char*>(compressed.data());
+    const unsigned char* end = input + compressed.size();
+    size_t position = 0;
+    while (input < end) {
+        unsigned char token = *input++;
+        size_t literalCount = readLength(input, end, token >> 4);
+        if (literalCount > size_t(end - input) or literalCount > size - position) {
+            throw std::runtime_error("Corrupt compressed stream: literals out of bounds");
+        }
+        std::memcpy(&output[position], input, literalCount);
+        input += literalCount;
+        position += literalCount;
+        if (input == end) {
+            break;
+        }
+        if (end - input < 2) {
+            throw std::runtime_error("Corrupt compressed stream: truncated offset");
+        }
+        size_t offset = input[0] | (size_t(input[1]) << 8);
+        input += 2;
+        size_t length = readLength(input, end, token & 0x0F) + MIN_MATCH;
+        if (offset == 0 or offset > position or length > size - position) {
+            throw std::runtime_error("Corrupt compressed stream: match out of bounds");
+        }
+        // Matches may overlap with their own output
+        for (size_t i = 0; i < length; ++i, ++position) {
+            output[position] = output[position - offset];
+        }
+    }
+    if (position != size) {
+        throw std::runtime_error("Corrupt compressed stream: wrong frame size");
+    }
+}
+
+}
+
+
+void
+thrive::writeCompressed(
+    std::ostream& stream,
+    const std::string& data,
+    CompressionLevel level,
+    ThreadPool* threadPool
+) {
+    stream.write(MAGIC.data(), MAGIC.size());
+    writeVarint(stream, VERSION);
+    writeVarint(stream, data.size());
+    auto bytes = reinterpret_cast<const unsigned char*>(data.data());
+    auto compressFrame = [bytes, level] (size_t start, size_t size) {
+        if (level == CompressionLevel::Fast) {
+            return compressFast(bytes + start, size);
+        }
+        else if (level == CompressionLevel::High) {
+            return compressHigh(bytes + start, size);
+        }
+        return std::string();
+    };
+    // Compressed ahead of writing when there is a thread pool
+    std::vector<std::string> frames;
+    if (threadPool and level != CompressionLevel::None) {
+        frames.resize((data.size() + FRAME_SIZE - 1) / FRAME_SIZE);
+        threadPool->parallelFor(frames.size(), 1,
+            [&] (size_t begin, size_t end) {
+                for (size_t frame = begin; frame < end; ++frame) {
+                    size_t start = frame * FRAME_SIZE;
+                    frames[frame] = compressFrame(
+                        start,
+                        std::min(FRAME_SIZE, data.size() - start)
+                    );
+                }
+            }
+        );
+    }
+    for (size_t start = 0; start < data.size(); start += FRAME_SIZE) {
+        size_t size = std::min(FRAME_SIZE, data.size() - start);
+        std::string compressed;
+        if (frames.empty()) {
+            compressed = compressFrame(start, size);
+        }
+        else {
+            compressed = std::move(frames[start / FRAME_SIZE]);
+        }
+        writeVarint(stream, size);
+        if (level == CompressionLevel::None or compressed.size() >= size) {
+            writeVarint(stream, size);
+            stream.put(Codec::Stored);
+            stream.write(data.data() + start, size);
+        }
+        else {
+            writeVarint(stream, compressed.size());
+            stream.put(Codec::Lz77);
+            stream.write(compressed.data(), compressed.size());
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CompressedInputStream
+////////////////////////////////////////////////////////////////////////////////
+
+class CompressedInputStream::Buffer : public std::streambuf {
+
+public:
+
+    Buffer(
+        std::istream& source
+    ) : m_source(source)
+    {
+        std::array<char, 8> magic {{}};
+        source.read(magic.data(), magic.size());
+        if (source.gcount() != static_cast<std::streamsize>(magic.size()) or magic != MAGIC) {
+            throw std::runtime_error("Not a compressed stream");
+        }
+        uint64_t version = readVarint(source);
+        if (version > VERSION) {
+            throw std::runtime_error(
+                "Compressed stream version " + std::to_string(version) + " is not supported"
+            );
+        }
+        m_totalSize = readVarint(source);
+        m_firstFrame = source.tellg();
+    }
+
+protected:
+
+    pos_type
+    seekoff(
+        off_type offset,
+        std::ios_base::seekdir direction,
+        std::ios_base::openmode
+    ) override {
+        off_type target = offset;
+        if (direction == std::ios_base::cur) {
+            target += this->position();
+        }
+        else if (direction == std::ios_base::end) {
+            target += m_totalSize;
+        }
+        if (target < 0 or uint64_t(target) > m_totalSize) {
+            return pos_type(off_type(-1));
+        }
+        uint64_t frameEnd = m_frameStart + m_frame.size();
+        if (uint64_t(target) >= m_frameStart and uint64_t(target) <= frameEnd and not m_frame.empty()) {
+            char* begin = &m_frame[0];
+            this->setg(begin, begin + (target - m_frameStart), begin + m_frame.size());
+        }
+        else {
+            // Found in underflow()
+            m_pendingPosition = target;
+            this->setg(nullptr, nullptr, nullptr);
+        }
+        return pos_type(target);
+    }
+
+    pos_type
+    seekpos(
+        pos_type position,
+        std::ios_base::openmode mode
+    ) override {
+        return this->seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+
+    int_type
+    underflow() override {
+        uint64_t target = this->position();
+        if (target >= m_totalSize) {
+            return traits_type::eof();
+        }
+        if (target < m_frameStart) {
+            // Frames can only be found from the start
+            m_source.clear();
+            m_source.seekg(m_firstFrame);
+            m_nextFrameStart = 0;
+        }
+        while (true) {
+            uint64_t rawSize = readVarint(m_source);
+            uint64_t storedSize = readVarint(m_source);
+            int codec = m_source.get();
+            if (rawSize == 0 or rawSize > FRAME_SIZE or storedSize > FRAME_SIZE) {
+                throw std::runtime_error("Corrupt compressed stream: invalid frame size");
+            }
+            uint64_t frameStart = m_nextFrameStart;
+            m_nextFrameStart += rawSize;
+            if (m_nextFrameStart <= target) {
+                m_source.seekg(storedSize, std::ios_base::cur);
+                continue;
+            }
+            this->readFrame(codec, rawSize, storedSize);
+            m_frameStart = frameStart;
+            char* begin = &m_frame[0];
+            this->setg(begin, begin + (target - frameStart), begin + m_frame.size());
+            return traits_type::to_int_type(*this->gptr());
+        }
+    }
+
+private:
+
+    // The uncompressed position
+    uint64_t
+    position() const {
+        if (this->eback()) {
+            return m_frameStart + (this->gptr() - this->eback());
+        }
+        return m_pendingPosition;
+    }
+
+    void
+    readFrame(
+        int codec,
+        uint64_t rawSize,
+        uint64_t storedSize
+    ) {
+        std::string& stored = codec == Codec::Stored ? m_frame : m_compressed;
+        stored.resize(storedSize);
+        m_source.read(&stored[0], storedSize);
+        if (static_cast<uint64_t>(m_source.gcount()) != storedSize) {
+            throw std::runtime_error("Corrupt compressed stream: unexpected end of data");
+        }
+        if (codec == Codec::Stored) {
+            if (rawSize != storedSize) {
+                throw std::runtime_error("Corrupt compressed stream: invalid frame size");
+            }
+        }
+        else if (codec == Codec::Lz77) {
+            decompressLz77(m_compressed, m_frame, rawSize);
+        }
+        else {
+            throw std::runtime_error("Corrupt compressed stream: unknown codec");
+        }
+    }
+
+    std::string m_compressed;
+
+    std::streampos m_firstFrame;
+
+    // The current frame, uncompressed
+    std::string m_frame;
+
+    uint64_t m_frameStart = 0;
+
+    uint64_t m_nextFrameStart = 0;
+
+    uint64_t m_pendingPosition = 0;
+
+    std::istream& m_source;
+
+    uint64_t m_totalSize = 0;
+
+};
+
+
+bool
+CompressedInputStream::isCompressed(
+    std::istream& source
+) {
+    std::streampos start = source.tellg();
+    std::array<char, 8> magic {{}};
+    source.read(magic.data(), magic.size());
+    bool isCompressed = (
+        source.gcount() == static_cast<std::streamsize>(magic.size()) and
+        magic == MAGIC
+    );
+    source.clear();
+    source.seekg(start);
+    return isCompressed;
+}
+
+
+CompressedInputStream::CompressedInputStream(
+    std::istream& source
+) : std::istream(nullptr),
+    m_buffer(new Buffer(source))
+{
+    this->rdbuf(m_buffer.get());
+}
+
+
+CompressedInputStream::~CompressedInputStream() {}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace thrive {
+
+class ThreadPool;
+
+/**
+* @brief How hard writeCompressed() tries to compress
+*
+* Both levels produce the same LZ77 block format and are read by the same
+* decoder. They only differ in how long the encoder searches for matches.
+*/
+enum class CompressionLevel {
+    /**
+    * @brief Stores the data uncompressed
+    */
+    None,
+    /**
+    * @brief Takes the first match found, for frequent saves
+    */
+    Fast,
+    /**
+    * @brief Searches several candidates for the longest match, for saves
+    *   that are kept around
+    */
+    High
+};
+
+/**
+* @brief Writes data as a compressed stream
+*
+* The data is split into frames that are compressed independently. The
+* stream starts with a magic number and the total uncompressed size, each
+* frame with its uncompressed and compressed size and the codec it uses.
+* Frames that don't get smaller are stored as they are.
+*
+* With a thread pool, the frames are compressed in parallel and then 
+* written in order, so the output is the same as without one.
+*
+* @param stream
+*   The stream to write to
+* @param data
+*   The data to compress
+* @param level
+*   The compression level
+* @param threadPool
+*   The thread pool for compressing frames, may be null
+*/
+void
+writeCompressed(
+    std::ostream& stream,
+    const std::string& data,
+    CompressionLevel level,
+    ThreadPool* threadPool = nullptr
+);
+
+
+/**
+* @brief Reads a stream written by writeCompressed()
+*
+* Frames are decompressed on demand. The stream is seekable: seeking
+* forward skips frames without decompressing them, seeking backward
+* restarts at the first frame. The source stream must be seekable, too, and
+* must outlive this stream.
+*
+* Usage:
+* \code
+* std::ifstream file(filename, std::ifstream::binary);
+* if (CompressedInputStream::isCompressed(file)) {
+*     CompressedInputStream stream(file);
+*     loadStorage(stream, storage);
+* }
+* else {
+*     loadStorage(file, storage);
+* }
+* \endcode
+*/
+class CompressedInputStream : public std::istream {
+
+public:
+
+    /**
+    * @brief Checks whether a stream holds compressed data
+    *
+    * @param source
+    *   The stream to check. Its position is left unchanged.
+    */
+    static bool
+    isCompressed(
+        std::istream& source
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param source
+    *   The stream to decompress, positioned at the magic number
+    *
+    * @throws std::runtime_error if \a source holds no compressed data
+    */
+    CompressedInputStream(
+        std::istream& source
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~CompressedInputStream();
+
+private:
+
+    class Buffer;
+    std::unique_ptr<Buffer> m_buffer;
+
+};
+
+}
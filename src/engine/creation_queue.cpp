@@ -0,0 +1,179 @@
+#include "engine/creation_queue.h"
+
+#include "scripting/lua_profiler.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <vector>
+
+using namespace thrive;
+
+
+static void
+CreationQueue_push(
+    CreationQueue* self,
+    luabind::object job,
+    float priority
+) {
+    self->push([job] () {
+        LuaProfiler::countScriptCall(job.interpreter(), "CreationQueue job");
+        luabind::call_function<void>(job);
+    }, priority);
+}
+
+
+luabind::scope
+CreationQueue::luaBindings() {
+    using namespace luabind;
+    return class_<CreationQueue>("CreationQueue")
+        .def("push", &CreationQueue_push)
+        .def("size", &CreationQueue::size)
+    ;
+}
+
+
+struct CreationQueue::Implementation {
+
+    struct Entry {
+
+        Job job;
+
+        float priority;
+
+        uint64_t sequence;
+
+    };
+
+    // Heap order, so that the front is the lowest priority pushed first
+    static bool
+    runsLater(
+        const Entry& a,
+        const Entry& b
+    ) {
+        if (a.priority != b.priority) {
+            return a.priority > b.priority;
+        }
+        return a.sequence > b.sequence;
+    }
+
+    // Moves the jobs pushed during drain() into the heap
+    void
+    pushIncoming() {
+        for (Entry& entry : m_incoming) {
+            this->pushEntry(std::move(entry));
+        }
+        m_incoming.clear();
+    }
+
+    void
+    pushEntry(
+        Entry entry
+    ) {
+        m_entries.push_back(std::move(entry));
+        std::push_heap(m_entries.begin(), m_entries.end(), &Implementation::runsLater);
+    }
+
+    Entry
+    pop() {
+        std::pop_heap(m_entries.begin(), m_entries.end(), &Implementation::runsLater);
+        Entry entry = std::move(m_entries.back());
+        m_entries.pop_back();
+        return entry;
+    }
+
+    std::vector<Entry> m_entries;
+
+    std::vector<Entry> m_incoming;
+
+    bool m_isDraining = false;
+
+    unsigned int m_maxJobs = 0;
+
+    Milliseconds m_milliseconds = 0;
+
+    uint64_t m_nextSequence = 0;
+
+};
+
+
+CreationQueue::CreationQueue()
+  : m_impl(new Implementation())
+{
+}
+
+
+CreationQueue::~CreationQueue() {}
+
+
+void
+CreationQueue::clear() {
+    m_impl->m_entries.clear();
+    m_impl->m_incoming.clear();
+}
+
+
+unsigned int
+CreationQueue::drain() {
+    using Clock = boost::chrono::steady_clock;
+    Implementation& impl = *m_impl;
+    Clock::time_point deadline = Clock::now() + boost::chrono::milliseconds(
+        impl.m_milliseconds
+    );
+    unsigned int count = 0;
+    impl.m_isDraining = true;
+    try {
+        while (not impl.m_entries.empty()) {
+            if (impl.m_maxJobs > 0 and count >= impl.m_maxJobs) {
+                break;
+            }
+            if (count > 0 and impl.m_milliseconds > 0 and Clock::now() >= deadline) {
+                break;
+            }
+            Implementation::Entry entry = impl.pop();
+            count += 1;
+            entry.job();
+        }
+    }
+    catch (...) {
+        impl.m_isDraining = false;
+        impl.pushIncoming();
+        throw;
+    }
+    impl.m_isDraining = false;
+    impl.pushIncoming();
+    return count;
+}
+
+
+void
+CreationQueue::push(
+    Job job,
+    float priority
+) {
+    Implementation::Entry entry{std::move(job), priority, m_impl->m_nextSequence++};
+    // Jobs pushed by a running job wait for the next drain()
+    if (m_impl->m_isDraining) {
+        m_impl->m_incoming.push_back(std::move(entry));
+    }
+    else {
+        m_impl->pushEntry(std::move(entry));
+    }
+}
+
+
+void
+CreationQueue::setBudget(
+    Milliseconds milliseconds,
+    unsigned int maxJobs
+) {
+    m_impl->m_maxJobs = maxJobs;
+    m_impl->m_milliseconds = std::max(milliseconds, 0);
+}
+
+
+size_t
+CreationQueue::size() const {
+    return m_impl->m_entries.size() + m_impl->m_incoming.size();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "engine/typedefs.h"
+
+#include <functional>
+#include <memory>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Spreads expensive entity creation over several frames
+*
+* A spawn wave or a restored world sector would otherwise create all of
+* its entities in one frame. Instead, each creation is queued as a job,
+* and the game state runs as many jobs per frame as its budget allows
+* (see GameState::Options::creationBudget), right before the frame's
+* first sync point. Entities created with
+* EntityManager::deferCreateEntity() from a job are therefore batched
+* with the other jobs of the same frame.
+*
+* Jobs with a lower priority value run first, jobs of equal priority in
+* the order they were pushed. Use the squared distance to the player as
+* priority to fill the player's surroundings first.
+*
+* Jobs are dropped without running when the game state shuts down or is
+* loaded, so they may refer to the systems that pushed them.
+*/
+class CreationQueue {
+
+public:
+
+    /**
+    * @brief A job, usually creating one entity
+    */
+    using Job = std::function<void()>;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - CreationQueue::push
+    * - CreationQueue::size
+    *
+    * The jobs are Lua functions without parameters.
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    CreationQueue();
+
+    /**
+    * @brief Destructor
+    */
+    ~CreationQueue();
+
+    /**
+    * @brief Drops all queued jobs
+    */
+    void
+    clear();
+
+    /**
+    * @brief Runs jobs until the queue is empty or the budget is used up
+    *
+    * At least one job is run, so the queue makes progress even if single
+    * jobs exceed the time budget.
+    *
+    * @return
+    *   The number of jobs run
+    */
+    unsigned int
+    drain();
+
+    /**
+    * @brief Queues a job
+    *
+    * Jobs may push further jobs. Those run in a later drain() at the
+    * earliest.
+    *
+    * @param job
+    * @param priority
+    *   Lower values run first
+    */
+    void
+    push(
+        Job job,
+        float priority = 0.0f
+    );
+
+    /**
+    * @brief Sets how much work drain() does
+    *
+    * @param milliseconds
+    *   The time drain() may take. \c 0 for no time limit.
+    * @param maxJobs
+    *   The most jobs drain() runs. \c 0 for no limit.
+    */
+    void
+    setBudget(
+        Milliseconds milliseconds,
+        unsigned int maxJobs
+    );
+
+    /**
+    * @brief The number of queued jobs
+    */
+    size_t
+    size() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
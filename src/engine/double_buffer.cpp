@@ -0,0 +1,53 @@
+#include "engine/double_buffer.h"
+
+#include "engine/component_collection.h"
+#include "engine/entity_manager.h"
+
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+
+static std::vector<std::pair<ComponentTypeId, std::function<void(Component&)>>>&
+registeredTypes() {
+    // Filled by static initializers, so it must exist before them
+    static std::vector<std::pair<ComponentTypeId, std::function<void(Component&)>>> types;
+    return types;
+}
+
+
+void
+DoubleBuffers::flip(
+    EntityManager& entityManager
+) {
+    for (const auto& registered : registeredTypes()) {
+        const auto& collection = entityManager.getComponentCollection(registered.first);
+        for (const auto& component : collection.components()) {
+            registered.second(*component);
+        }
+    }
+}
+
+
+bool
+DoubleBuffers::isRegistered(
+    ComponentTypeId typeId
+) {
+    for (const auto& registered : registeredTypes()) {
+        if (registered.first == typeId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool
+DoubleBuffers::registerComponentImpl(
+    ComponentTypeId typeId,
+    FlipFunction flip
+) {
+    registeredTypes().emplace_back(typeId, std::move(flip));
+    return true;
+}
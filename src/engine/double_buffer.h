@@ -0,0 +1,160 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/typedefs.h"
+
+#include <functional>
+
+namespace thrive {
+
+class EntityManager;
+
+/**
+* @brief Last frame's value of a component field
+*
+* Many systems, like AI, the camera or the HUD, are fine with reading
+* where things were in the last frame. As long as they read the field
+* itself, they conflict with every system writing it (see
+* System::conflictsWith()) and never run in parallel with them.
+*
+* A DoubleBuffer member keeps a second copy of the field that only changes
+* between frames. Writers keep writing the field, while readers on any
+* thread read previous(), which is consistent for the whole frame.
+* GameState::update() flips the buffers of the component types registered
+* with DoubleBuffers at its first sync point, before any system runs.
+* Readers declare System::declareBufferedRead() for the type.
+*
+* Usage:
+* \code
+* class MyComponent : public Component {
+*     COMPONENT(My)
+* public:
+*     Ogre::Vector3 m_position;
+*     DoubleBuffer<Ogre::Vector3> m_lastFramePosition;
+* };
+* // Next to REGISTER_COMPONENT(MyComponent)
+* static const bool isDoubleBuffered = DoubleBuffers::registerComponent<MyComponent>(
+*     [] (MyComponent& component) {
+*         component.m_lastFramePosition.flip(component.m_position);
+*     }
+* );
+* \endcode
+*
+* @tparam T
+*   A copyable type
+*/
+template<typename T>
+class DoubleBuffer {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param value
+    *   The value until the first flip, which should be the field's
+    */
+    explicit DoubleBuffer(
+        const T& value = T()
+    ) : m_previous(value)
+    {
+    }
+
+    /**
+    * @brief Takes over the field's current value
+    *
+    * Only call this while no systems are updated.
+    *
+    * @param current
+    */
+    void
+    flip(
+        const T& current
+    ) {
+        m_previous = current;
+    }
+
+    /**
+    * @brief The field's value as of the last flip
+    */
+    const T&
+    previous() const {
+        return m_previous;
+    }
+
+private:
+
+    T m_previous;
+
+};
+
+
+/**
+* @brief Flips the DoubleBuffer members of registered component types
+*/
+class DoubleBuffers final {
+
+public:
+
+    /**
+    * @brief Flips the buffers of all registered types
+    *
+    * Called by GameState::update().
+    *
+    * @param entityManager
+    */
+    static void
+    flip(
+        EntityManager& entityManager
+    );
+
+    /**
+    * @brief Whether a component type has been registered
+    *
+    * @param typeId
+    */
+    static bool
+    isRegistered(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Registers the buffers of a component type
+    *
+    * Must run after the component's TYPE_ID is initialised, so put it
+    * after the REGISTER_COMPONENT in the same file.
+    *
+    * @tparam ComponentType
+    *   The component class
+    * @param flip
+    *   Flips all DoubleBuffer members of a component
+    *
+    * @return
+    *   \c true, for initializing a static variable
+    */
+    template<typename ComponentType>
+    static bool
+    registerComponent(
+        void (*flip)(ComponentType&)
+    ) {
+        return registerComponentImpl(
+            ComponentType::TYPE_ID,
+            [flip] (Component& component) {
+                flip(static_cast<ComponentType&>(component));
+            }
+        );
+    }
+
+private:
+
+    using FlipFunction = std::function<void(Component&)>;
+
+    static bool
+    registerComponentImpl(
+        ComponentTypeId typeId,
+        FlipFunction flip
+    );
+
+};
+
+}
@@ -1,12 +1,27 @@
 #include "engine/engine.h"
 
+#include "engine/allocation_tracker.h"
 #include "engine/component_collection.h"
 #include "engine/component_factory.h"
+#include "engine/compression.h"
 #include "engine/entity_manager.h"
+#include "engine/frame_arena.h"
+#include "engine/frame_budgets.h"
 #include "engine/game_state.h"
+#include "engine/idle_tasks.h"
+#include "engine/input_recording.h"
+#include "engine/logger.h"
+#include "engine/memory_stats.h"
+#include "engine/perf_counters.h"
 #include "engine/serialization.h"
+#include "engine/shared_data.h"
+#include "engine/statistics.h"
 #include "engine/system.h"
+#include "engine/system_profiler.h"
+#include "engine/telemetry_server.h"
+#include "engine/tracer.h"
 #include "engine/rng.h"
+#include "engine/thread_pool.h"
 #include "game.h"
 
 // Bullet
@@ -17,9 +32,12 @@
 
 // Ogre
 #include "ogre/camera_system.h"
+#include "ogre/colour_material.h"
 #include "ogre/keyboard.h"
 #include "ogre/light_system.h"
+#include "ogre/material_cache.h"
 #include "ogre/mouse.h"
+#include "ogre/pack_archive.h"
 #include "ogre/render_system.h"
 #include "ogre/scene_node_system.h"
 #include "ogre/sky_system.h"
@@ -27,7 +45,12 @@
 
 // Scripting
 #include "scripting/luabind.h"
+#include "scripting/lua_allocator.h"
+#include "scripting/lua_garbage_collector.h"
+#include "scripting/lua_profiler.h"
 #include "scripting/lua_state.h"
+#include "scripting/lua_tasks.h"
+#include "scripting/script_cache.h"
 #include "scripting/script_initializer.h"
 
 
@@ -35,28 +58,43 @@
 #include "microbe_stage/agent.h"
 
 #include "util/contains.h"
+#include "util/json_writer.h"
 #include "util/pair_hash.h"
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <boost/chrono.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <btBulletDynamicsCommon.h>
 #include <chrono>
 #include <ctime>
+#include <deque>
+#include <exception>
 #include <forward_list>
 #include <fstream>
 #include <iostream>
 #include <luabind/adopt_policy.hpp>
+#include <luabind/class_info.hpp>
+#include <map>
+#include <OgreArchiveManager.h>
 #include <OgreConfigFile.h>
+#include <OgreEntity.h>
 #include <OgreLogManager.h>
 #include <OgreRenderWindow.h>
+#include <OgreResourceBackgroundQueue.h>
 #include <OgreRoot.h>
+#include <OgreSceneManager.h>
 #include <OgreWindowEventUtilities.h>
 #include <OISInputManager.h>
 #include <OISMouse.h>
 #include <random>
 #include <set>
+#include <sstream>
+#include <stdexcept>
 #include <stdlib.h>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <iostream>
 
@@ -65,83 +103,487 @@ using namespace thrive;
 static const char* RESOURCES_CFG = "resources.cfg";
 static const char* PLUGINS_CFG   = "plugins.cfg";
 
+// Resource groups the first frame needs. They are initialised before the
+// first frame, all other groups in the background. Spelled out because
+// Ogre's constants for them may not be initialised yet.
+static const std::set<std::string> STARTUP_RESOURCE_GROUPS = {
+    "Autodetect",
+    "General",
+    "Internal"
+};
+
+static const char* SCRIPT_DIRECTORY = "../scripts";
+static const char* SCRIPT_CACHE_DIRECTORY = "../script_cache";
+
+// Where compiled GPU programs are kept between runs
+static const char* SHADER_CACHE_DIRECTORY = "../shader_cache";
+
+// Where F8 writes the trace when tracing stops
+static const char* TRACE_FILE = "trace.json";
+
+// Where the Logger writes, including Ogre's log
+static const char* LOG_FILE = "thrive.log";
+
+
+// Minimum time between two trace snapshots of frames over budget
+static const boost::chrono::seconds BUDGET_SNAPSHOT_INTERVAL(10);
+
+
+// How often the scripts are checked for changes while watching them
+static const Milliseconds SCRIPT_WATCH_INTERVAL = 500;
+
+
+// After this many incremental saves, the next one is a full save again
+static const unsigned int MAX_DELTA_COUNT = 10;
+
+
+namespace {
+
+// Checks the time from construction to destruction against the budget of
+// a frame phase
+class PhaseTimer {
+
+public:
+
+    PhaseTimer(
+        FrameBudgets& budgets,
+        const char* phase
+    ) : m_budgets(budgets),
+        m_phase(phase),
+        m_start(boost::chrono::steady_clock::now())
+    {
+    }
+
+    ~PhaseTimer() {
+        using namespace boost::chrono;
+        auto elapsed = duration_cast<microseconds>(steady_clock::now() - m_start);
+        m_budgets.check(m_phase, static_cast<uint32_t>(elapsed.count()));
+    }
+
+private:
+
+    FrameBudgets& m_budgets;
+
+    std::string m_phase;
+
+    boost::chrono::steady_clock::time_point m_start;
+
+};
+
+
+// Times a phase of Engine::init() from construction to destruction
+class StartupTimer {
+
+public:
+
+    StartupTimer(
+        Engine::StartupPhase& phase,
+        std::string name,
+        boost::chrono::steady_clock::time_point initStart,
+        Tracer& tracer
+    ) : m_initStart(initStart),
+        m_phase(phase),
+        m_start(boost::chrono::steady_clock::now()),
+        m_zone(&tracer, name)
+    {
+        using namespace boost::chrono;
+        m_phase.name = std::move(name);
+        m_phase.start = duration<double, boost::milli>(m_start - m_initStart).count();
+    }
+
+    ~StartupTimer() {
+        using namespace boost::chrono;
+        m_phase.duration = duration<double, boost::milli>(steady_clock::now() - m_start).count();
+    }
+
+private:
+
+    boost::chrono::steady_clock::time_point m_initStart;
+
+    Engine::StartupPhase& m_phase;
+
+    boost::chrono::steady_clock::time_point m_start;
+
+    Tracer::Zone m_zone;
+
+};
+
+}
+
+
+// The file of the index-th incremental save on top of a savegame
+static std::string
+deltaFilename(
+    const std::string& filename,
+    unsigned int index
+) {
+    return filename + ".delta" + std::to_string(index);
+}
+
+
+// Applies the changes of an incremental save to a stored game state
+static void
+applyGameStateDelta(
+    const std::string& name,
+    const StorageContainer& delta,
+    StorageContainer& gameState
+) {
+    StorageContainer gameStateDeltas = delta.get<StorageContainer>("gameStateDeltas");
+    if (not gameStateDeltas.contains<StorageContainer>(name)) {
+        return;
+    }
+    StorageContainer entities = gameState.get<StorageContainer>("entities");
+    EntityManager::applyStorageDelta(
+        entities,
+        gameStateDeltas.get<StorageContainer>(name).get<StorageContainer>("entities")
+    );
+    gameState.set("entities", std::move(entities));
+}
+
+
+// Opens a savegame for reading. Savegames written before they were
+// compressed are read as they are.
+namespace {
+
+class SavegameFile {
+
+public:
+
+    SavegameFile(
+        const std::string& filename
+    ) : m_file(filename, std::ifstream::binary)
+    {
+        if (m_file and CompressedInputStream::isCompressed(m_file)) {
+            m_decompressed.reset(new CompressedInputStream(m_file));
+            m_decompressed->exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        }
+        m_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    }
+
+    std::istream&
+    stream() {
+        if (m_decompressed) {
+            return *m_decompressed;
+        }
+        return m_file;
+    }
+
+private:
+
+    std::unique_ptr<CompressedInputStream> m_decompressed;
+
+    std::ifstream m_file;
+
+};
+
+}
+
+
+// Reads the incremental saves on top of a savegame, oldest first
+static std::vector<StorageContainer>
+readDeltas(
+    const std::string& filename
+) {
+    std::vector<StorageContainer> deltas;
+    for (unsigned int index = 1; ; ++index) {
+        std::string deltaFile = deltaFilename(filename, index);
+        if (not boost::filesystem::exists(deltaFile)) {
+            break;
+        }
+        SavegameFile file(deltaFile);
+        StorageContainer delta;
+        loadStorage(file.stream(), delta);
+        deltas.push_back(std::move(delta));
+    }
+    return deltas;
+}
+
+
+// Computes what changed in each game state since the baseline. Runs on a
+// worker thread.
+static StorageContainer
+savegameDelta(
+    const StorageContainer& baseline,
+    const StorageContainer& savegame
+) {
+    StorageContainer delta;
+    delta.set("currentGameState", savegame.get<std::string>("currentGameState"));
+    StorageContainer baselineGameStates = baseline.get<StorageContainer>("gameStates");
+    StorageContainer gameStates = savegame.get<StorageContainer>("gameStates");
+    StorageContainer gameStateDeltas;
+    for (const std::string& name : gameStates.keys()) {
+        // Game states only store their entities
+        StorageContainer gameStateDelta;
+        gameStateDelta.set("entities", EntityManager::storageDelta(
+            baselineGameStates.get<StorageContainer>(name).get<StorageContainer>("entities"),
+            gameStates.get<StorageContainer>(name).get<StorageContainer>("entities")
+        ));
+        gameStateDeltas.set(name, std::move(gameStateDelta));
+    }
+    delta.set("gameStateDeltas", std::move(gameStateDeltas));
+    return delta;
+}
+
+
+// Runs on a worker thread, so it must not touch anything but its arguments
+// and the thread pool, which compresses the frames in parallel.
+// Writing a new baseline removes the incremental saves of the old one.
+// Baselines are kept around and get the slower, stronger compression.
+static bool
+writeSavegame(
+    const StorageContainer& savegame,
+    const std::string& filename,
+    bool isBaseline,
+    ThreadPool* threadPool,
+    std::string& errorMessage
+) {
+    std::string temporaryFilename = filename + ".tmp";
+    try {
+        std::ofstream stream(
+            temporaryFilename,
+            std::ofstream::trunc | std::ofstream::binary
+        );
+        if (not stream) {
+            errorMessage = "Could not open file " + temporaryFilename;
+            return false;
+        }
+        stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        std::ostringstream data;
+        saveStorage(data, savegame);
+        writeCompressed(
+            stream,
+            data.str(),
+            isBaseline ? CompressionLevel::High : CompressionLevel::Fast,
+            threadPool
+        );
+        stream.close();
+        if (isBaseline) {
+            // If renaming fails, the old baseline without its deltas is 
+            // still consistent
+            unsigned int index = 1;
+            while (boost::filesystem::remove(deltaFilename(filename, index))) {
+                index += 1;
+            }
+        }
+        boost::filesystem::rename(temporaryFilename, filename);
+    }
+    catch (const std::exception& e) {
+        errorMessage = e.what();
+        return false;
+    }
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Engine
 ////////////////////////////////////////////////////////////////////////////////
 
-struct Engine::Implementation : public Ogre::WindowEventListener {
+struct Engine::Implementation : public Ogre::WindowEventListener, public Ogre::LogListener {
 
     Implementation(
         Engine& engine
-    ) : m_engine(engine),
+    ) : m_garbageCollector(m_luaState),
+        m_luaTasks(m_luaState),
+        m_profiler(m_luaState),
+        m_engine(engine),
         m_rng()
     {
     }
 
     ~Implementation() {
-        Ogre::WindowEventUtilities::removeWindowEventListener(
-            m_graphics.renderWindow,
-            this
-        );
+        if (m_defaultOgreLog) {
+            m_defaultOgreLog->removeListener(this);
+        }
+        if (m_graphics.renderWindow) {
+            Ogre::WindowEventUtilities::removeWindowEventListener(
+                m_graphics.renderWindow,
+                this
+            );
+        }
     }
 
     void
     activateGameState(
         GameState* gameState
     ) {
+        auto background = std::find(
+            m_backgroundGameStates.begin(),
+            m_backgroundGameStates.end(),
+            gameState
+        );
+        if (gameState and background != m_backgroundGameStates.end()) {
+            // Activated again below, as the current game state
+            m_backgroundGameStates.erase(background);
+            gameState->deactivate();
+        }
         if (m_currentGameState) {
-            m_currentGameState->deactivate();
+            if (gameState) {
+                m_currentGameState->suspend();
+            }
+            else {
+                m_currentGameState->deactivate();
+            }
+        }
+        if (not gameState) {
+            for (GameState* backgroundGameState : m_backgroundGameStates) {
+                backgroundGameState->deactivate();
+            }
+            m_backgroundGameStates.clear();
+            // Reloads and savegames replace what suspended game states 
+            // keep resident
+            for (const auto& pair : m_gameStates) {
+                if (pair.second->isSuspended()) {
+                    pair.second->deactivate();
+                }
+            }
         }
         m_currentGameState = gameState;
+        // The new game state's systems allocate while they settle
+        m_allocationTracker.resetSteadyState();
         if (gameState) {
+            // Game states are initialized on first use
+            if (not gameState->isInitialized()) {
+                this->initGameState(gameState);
+            }
             gameState->activate();
         }
     }
 
+    // Updates the current game state and the background game states
+    void
+    updateGameStates(
+        int milliseconds
+    ) {
+        JobCounter jobs;
+        std::vector<std::exception_ptr> jobErrors(m_backgroundGameStates.size());
+        for (size_t i = 0; i < m_backgroundGameStates.size(); ++i) {
+            GameState* gameState = m_backgroundGameStates[i];
+            if (gameState->isMainThreadOnly()) {
+                continue;
+            }
+            std::exception_ptr* error = &jobErrors[i];
+            Tracer* tracer = &m_tracer;
+            m_threadPool.submit([gameState, milliseconds, error, tracer] () {
+                Tracer::Zone zone(tracer, "backgroundGameState " + gameState->name());
+                try {
+                    gameState->update(milliseconds);
+                }
+                catch (...) {
+                    *error = std::current_exception();
+                }
+            }, &jobs);
+        }
+        // The jobs refer to jobErrors, wait for them before rethrowing
+        std::exception_ptr error;
+        try {
+            m_currentGameState->update(milliseconds);
+            for (GameState* gameState : m_backgroundGameStates) {
+                if (gameState->isMainThreadOnly()) {
+                    Tracer::Zone zone(&m_tracer, "backgroundGameState " + gameState->name());
+                    gameState->update(milliseconds);
+                }
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        m_threadPool.wait(jobs);
+        for (const std::exception_ptr& jobError : jobErrors) {
+            if (jobError and not error) {
+                error = jobError;
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Initializes a game state on the main thread. Its initializer sees it
+    // as the current game state.
+    void
+    initGameState(
+        GameState* gameState
+    ) {
+        this->finishPrewarm(gameState);
+        Tracer::Zone zone(&m_tracer, "initGameState " + gameState->name());
+        GameState* previousGameState = m_currentGameState;
+        m_currentGameState = gameState;
+        gameState->init();
+        m_currentGameState = previousGameState;
+    }
+
     void
     loadSavegame() {
-        std::ifstream stream(
-            m_serialization.loadFile,
-            std::ifstream::binary
-        );
+        Tracer::Zone zone(&m_tracer, "loadSavegame");
+        Statistics::Timer timer(&m_statistics.histogram("savegame.load"));
+        // The file may still be in the works
+        this->finishSaves(true);
+        std::string filename = m_serialization.loadFile;
         m_serialization.loadFile = "";
-        stream.clear();
-        stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-        StorageContainer savegame;
         try {
-            stream >> savegame;
+            SavegameFile file(filename);
+            std::vector<StorageContainer> deltas = readDeltas(filename);
+            StorageReader reader(file.stream());
+            this->restoreSavegame(filename, reader, deltas);
         }
         catch(const std::ofstream::failure& e) {
-            std::cerr << "Error loading file: " << e.what() << std::endl;
+            m_savegameLog.error("Error loading file: " + std::string(e.what()));
             throw;
         }
-        // Load game states
-        GameState* previousGameState = m_currentGameState;
-        this->activateGameState(nullptr);
-        StorageContainer gameStates = savegame.get<StorageContainer>("gameStates");
-        for (const auto& pair : m_gameStates) {
-            if (gameStates.contains(pair.first)) {
-                // In case anything relies on the current game state
-                // during loading, temporarily switch it
-                m_currentGameState = pair.second.get();
-                pair.second->load(
-                    gameStates.get<StorageContainer>(pair.first)
-                );
-            }
-            else {
-                pair.second->entityManager().clear();
+    }
+
+    // Waits for a game state's prewarm job, if it has one, and drops it
+    // from the queue
+    void
+    finishPrewarm(
+        GameState* gameState
+    ) {
+        for (auto iter = m_prewarms.begin(); iter != m_prewarms.end(); ++iter) {
+            if ((*iter)->gameState == gameState) {
+                m_threadPool.wait((*iter)->physics);
+                m_prewarms.erase(iter);
+                return;
             }
         }
-        m_currentGameState = nullptr;
-        // Switch gamestate
-        std::string gameStateName = savegame.get<std::string>("currentGameState");
-        auto iter = m_gameStates.find(gameStateName);
-        if (iter != m_gameStates.end()) {
-            this->activateGameState(iter->second.get());
+    }
+
+    // Waits for all prewarm jobs, without initializing their game states
+    void
+    finishPrewarms() {
+        for (const auto& prewarm : m_prewarms) {
+            m_threadPool.wait(prewarm->physics);
         }
-        else {
-            this->activateGameState(previousGameState);
-            // TODO: Log error
+        m_prewarms.clear();
+    }
+
+    // Runs the callbacks of finished saves. With wait set, waits for all
+    // pending saves first.
+    void
+    finishSaves(
+        bool wait
+    ) {
+        auto& pendingSaves = m_serialization.pendingSaves;
+        while (not pendingSaves.empty()) {
+            PendingSave& save = *pendingSaves.front();
+            if (wait) {
+                m_threadPool.wait(save.job);
+            }
+            else if (not save.job.isDone()) {
+                // Later saves can't have finished either
+                break;
+            }
+            if (not save.success) {
+                m_savegameLog.error("Error saving file: " + save.errorMessage);
+                // Incremental saves need an intact chain
+                m_serialization.baseline.reset();
+            }
+            // Remove the save before calling back, in case the callback
+            // throws or saves again
+            std::unique_ptr<PendingSave> finished = std::move(pendingSaves.front());
+            pendingSaves.pop_front();
+            if (finished->callback) {
+                finished->callback(finished->success, finished->errorMessage);
+            }
         }
     }
 
@@ -174,48 +616,205 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
         }
     }
 
+    // Initialises the startup groups and queues the rest of the resources
+    // for the background queue
     void
-    loadScripts(
-        const boost::filesystem::path& directory
-    ) {
-        namespace fs = boost::filesystem;
-        fs::path manifestPath = directory / "manifest.txt";
-        if (not fs::exists(manifestPath)) {
-            return;
+    startResourceLoading() {
+        auto& resourceManager = Ogre::ResourceGroupManager::getSingleton();
+        auto& resourceLoading = m_resourceLoading;
+        for (const auto& groupName : resourceManager.getResourceGroups()) {
+            ResourceLoading::Group group;
+            group.name = groupName;
+            if (STARTUP_RESOURCE_GROUPS.count(groupName) > 0) {
+                // Parses the group's scripts. The resources themselves
+                // are loaded on first use or by the background queue.
+                resourceManager.initialiseResourceGroup(groupName);
+                group.isInitialised = true;
+                resourceLoading.totalSteps += 1;
+            }
+            else {
+                resourceLoading.totalSteps += 2;
+            }
+            resourceLoading.groups.push_back(std::move(group));
         }
-        std::ifstream manifest(manifestPath.string());
-        if (not manifest.is_open()) {
-            throw std::runtime_error("Could not open manifest file: " + manifestPath.string());
+        // The material warm-up
+        resourceLoading.totalSteps += 1;
+        resourceLoading.isWarmedUp = false;
+        this->updateResourceLoading();
+    }
+
+    // Materials queued after the background loading are warmed up in
+    // idle time, or at the start of the next frame if there is none
+    void
+    addIdleTasks() {
+        m_idleTasks.add([this] () {
+            return m_garbageCollector.idleStep();
+        });
+        m_idleTasks.add([this] () {
+            if (not m_currentGameState) {
+                return false;
+            }
+            Tracer::Zone zone(&m_tracer, "compaction.step");
+            return m_currentGameState->entityManager().compactStep();
+        });
+        if (m_isHeadless) {
+            return;
         }
-        std::string line;
-        while(not manifest.eof()) {
-            std::getline(manifest, line);
-            boost::algorithm::trim(line);
-            if (line.empty() or line.find("//") == 0) {
-                continue;
+        m_idleTasks.add([this] () {
+            if (not m_resourceLoading.groups.empty() or not m_resourceLoading.isWarmedUp) {
+                return false;
             }
-            fs::path manifestEntryPath = directory / line;
-            if (not fs::exists(manifestEntryPath)) {
-                std::cerr << "Warning: Could not find file " << manifestEntryPath.string() << std::endl;
-                continue;
+            Tracer::Zone zone(&m_tracer, "materialWarmup.step");
+            return m_materialWarmup.step();
+        });
+    }
+
+    // Polls the background tickets and queues the next step of each group
+    void
+    updateResourceLoading() {
+        auto& backgroundQueue = Ogre::ResourceBackgroundQueue::getSingleton();
+        auto& groups = m_resourceLoading.groups;
+        for (auto iter = groups.begin(); iter != groups.end();) {
+            ResourceLoading::Group& group = *iter;
+            if (group.ticket != 0) {
+                if (not backgroundQueue.isProcessComplete(group.ticket)) {
+                    ++iter;
+                    continue;
+                }
+                group.ticket = 0;
+                m_resourceLoading.finishedSteps += 1;
+                if (group.isInitialised) {
+                    m_resourceLoading.loadedGroups.insert(group.name);
+                    iter = groups.erase(iter);
+                    continue;
+                }
+                group.isInitialised = true;
             }
-            else if (fs::is_directory(manifestEntryPath)) {
-                this->loadScripts(manifestEntryPath);
+            // A group has to be initialised before it can be loaded, so
+            // the load is only queued once the initialisation is done
+            if (group.isInitialised) {
+                group.ticket = backgroundQueue.loadResourceGroup(group.name);
             }
             else {
-                int error = 0;
-                error = luaL_loadfile(
-                    m_luaState,
-                    manifestEntryPath.string().c_str()
-                );
-                error = error or luabind::detail::pcall(m_luaState, 0, LUA_MULTRET);
-                if (error) {
-                    std::string errorMessage = lua_tostring(m_luaState, -1);
-                    lua_pop(m_luaState, 1);
-                    std::cerr << errorMessage << std::endl;
+                group.ticket = backgroundQueue.initialiseResourceGroup(group.name);
+            }
+            ++iter;
+        }
+        if (not groups.empty()) {
+            return;
+        }
+        // The warmed up materials may live in any group
+        Tracer::Zone zone(&m_tracer, "materialWarmup");
+        m_materialWarmup.run();
+        // Agent particles get their meshes without a lookup by name
+        AgentRegistry::resolveResources();
+        if (not m_resourceLoading.isWarmedUp) {
+            m_resourceLoading.isWarmedUp = true;
+            m_resourceLoading.finishedSteps += 1;
+        }
+    }
+
+    // Reading and compiling stale scripts doesn't touch the main Lua
+    // state, so it can run in parallel and alongside the rest of the
+    // startup. Errors are reported by runScripts().
+    void
+    compileScripts(
+        const boost::filesystem::path& directory,
+        const boost::filesystem::path& cacheDirectory
+    ) {
+        Tracer::Zone zone(&m_tracer, "compileScripts");
+        ScriptCache cache(directory, cacheDirectory);
+        cache.setSharedData(m_dataSharing.data.get());
+        const auto scripts = ScriptCache::manifestScripts(directory);
+        m_threadPool.parallelFor(scripts.size(), 1,
+            [&](size_t begin, size_t end) {
+                lua_State* L = luaL_newstate();
+                for (size_t i = begin; i < end; ++i) {
+                    if (not cache.isUpToDate(scripts[i]) and cache.compile(L, scripts[i])) {
+                        lua_pop(L, 1);
+                    }
                 }
+                lua_close(L);
+            }
+        );
+    }
+
+    void
+    loadScripts(
+        const boost::filesystem::path& directory,
+        const boost::filesystem::path& cacheDirectory
+    ) {
+        Tracer::Zone zone(&m_tracer, "loadScripts");
+        this->compileScripts(directory, cacheDirectory);
+        this->runScripts(directory, cacheDirectory);
+    }
+
+    // Maps the shared data before the scripts are compiled
+    void
+    openSharedData() {
+        auto& dataSharing = m_dataSharing;
+        if (dataSharing.file.empty()) {
+            return;
+        }
+        dataSharing.isStale = false;
+        if (boost::filesystem::exists(dataSharing.file)) {
+            try {
+                dataSharing.data.reset(new SharedData(dataSharing.file));
+                return;
+            }
+            catch (const std::runtime_error& e) {
+                m_engineLog.warning(e.what());
             }
         }
+        dataSharing.isStale = true;
+    }
+
+    // Writes the shared data if it lacks current scripts or prototypes
+    void
+    writeSharedData(
+        const boost::filesystem::path& directory,
+        const boost::filesystem::path& cacheDirectory
+    ) {
+        auto& dataSharing = m_dataSharing;
+        if (dataSharing.file.empty() or not dataSharing.isStale) {
+            return;
+        }
+        Tracer::Zone zone(&m_tracer, "writeSharedData");
+        ScriptCache cache(directory, cacheDirectory);
+        cache.setSharedData(dataSharing.data.get());
+        for (const auto& script : ScriptCache::manifestScripts(directory)) {
+            std::string cacheFile;
+            if (cache.compiledScript(script, cacheFile)) {
+                dataSharing.writer.addCompiledScript(script, std::move(cacheFile));
+            }
+        }
+        if (dataSharing.data) {
+            dataSharing.writer.addPrototypes(*dataSharing.data);
+        }
+        try {
+            dataSharing.writer.write(dataSharing.file);
+            m_engineLog.info("Shared data written to " + dataSharing.file);
+        }
+        catch (const std::runtime_error& e) {
+            m_engineLog.error("Error writing shared data: " + std::string(e.what()));
+        }
+        // Doesn't retry failed writes either, the next engine will
+        dataSharing.isStale = false;
+    }
+
+    bool
+    haveScriptsChanged() const {
+        for (const auto& pair : m_scriptWatch.modificationTimes) {
+            boost::system::error_code error;
+            std::time_t modificationTime = boost::filesystem::last_write_time(
+                pair.first,
+                error
+            );
+            if (error or modificationTime != pair.second) {
+                return true;
+            }
+        }
+        return false;
     }
 
     bool
@@ -225,43 +824,529 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
         );
     }
 
+    // Loads the scripts from the cache into the main Lua state and runs
+    // them, compiling any that compileScripts() hasn't
+    void
+    runScripts(
+        const boost::filesystem::path& directory,
+        const boost::filesystem::path& cacheDirectory
+    ) {
+        Tracer::Zone zone(&m_tracer, "runScripts");
+        ScriptCache cache(directory, cacheDirectory);
+        cache.setSharedData(m_dataSharing.data.get());
+        for (const auto& script : ScriptCache::manifestScripts(directory)) {
+            if (not m_dataSharing.file.empty() and not cache.isShared(script)) {
+                m_dataSharing.isStale = true;
+            }
+            boost::filesystem::path scriptPath = directory / script;
+            boost::system::error_code timeError;
+            m_scriptWatch.modificationTimes[scriptPath.string()] =
+                boost::filesystem::last_write_time(scriptPath, timeError);
+            int error = 0;
+            error = cache.load(
+                m_luaState,
+                script
+            );
+            error = error or luabind::detail::pcall(m_luaState, 0, LUA_MULTRET);
+            if (error) {
+                std::string errorMessage = lua_tostring(m_luaState, -1);
+                lua_pop(m_luaState, 1);
+                m_scriptLog.error(errorMessage);
+            }
+        }
+    }
+
+    // Restores the game states one by one. While one game state is being
+    // restored on the main thread, the next one is parsed on a worker, so
+    // at most two of them are in memory as StorageContainers, unless
+    // baseline is not null and receives them.
+    void
+    restoreGameStates(
+        StorageReader& reader,
+        const std::vector<StorageContainer>& deltas,
+        std::set<GameState*>& restoredGameStates,
+        StorageContainer* baseline
+    ) {
+        struct ParsedGameState {
+
+            std::exception_ptr error;
+
+            bool isValid = false;
+
+            std::string name;
+
+            StorageContainer storage;
+
+        };
+        auto parseNext = [&reader] (ParsedGameState& parsed) {
+            try {
+                while (reader.nextEntry()) {
+                    if (reader.isContainer()) {
+                        parsed.isValid = true;
+                        parsed.name = reader.key();
+                        parsed.storage = reader.readContainer();
+                        return;
+                    }
+                }
+            }
+            catch (...) {
+                parsed.error = std::current_exception();
+            }
+        };
+        ParsedGameState current;
+        parseNext(current);
+        while (true) {
+            if (current.error) {
+                std::rethrow_exception(current.error);
+            }
+            if (not current.isValid) {
+                break;
+            }
+            float progress = reader.progress();
+            ParsedGameState next;
+            JobCounter parsing;
+            m_threadPool.submit(
+                [&parseNext, &next] () {
+                    parseNext(next);
+                },
+                &parsing
+            );
+            try {
+                auto iter = m_gameStates.find(current.name);
+                if (iter != m_gameStates.end()) {
+                    if (not iter->second->isInitialized()) {
+                        this->initGameState(iter->second.get());
+                    }
+                    for (const auto& delta : deltas) {
+                        applyGameStateDelta(current.name, delta, current.storage);
+                    }
+                    // In case anything relies on the current game state
+                    // during loading, temporarily switch it
+                    m_currentGameState = iter->second.get();
+                    iter->second->load(current.storage);
+                    restoredGameStates.insert(iter->second.get());
+                    if (baseline) {
+                        baseline->set(current.name, std::move(current.storage));
+                    }
+                }
+                if (m_serialization.loadProgressCallback) {
+                    m_serialization.loadProgressCallback(progress);
+                }
+            }
+            catch (...) {
+                // The parsing job refers to locals
+                m_threadPool.wait(parsing);
+                throw;
+            }
+            m_threadPool.wait(parsing);
+            current = std::move(next);
+        }
+    }
+
+    // Reruns all scripts and recreates the game states they define. The
+    // entities are kept through a storage round-trip, like saving and
+    // loading, so they pick up changed component classes.
+    void
+    reloadScripts() {
+        this->finishSaves(true);
+        this->finishPrewarms();
+        std::string currentName = m_currentGameState ? m_currentGameState->name() : "";
+        // Game states that were never used have nothing to keep
+        std::map<std::string, StorageContainer> snapshots;
+        for (const auto& pair : m_gameStates) {
+            if (pair.second->isInitialized()) {
+                snapshots[pair.first] = pair.second->storage();
+            }
+        }
+        this->activateGameState(nullptr);
+        m_nextGameState = nullptr;
+        for (const auto& pair : m_gameStates) {
+            pair.second->shutdown();
+        }
+        m_gameStates.clear();
+        // Tasks run functions of the old scripts
+        m_luaTasks.clear();
+        // Incremental saves refer to the replaced game states
+        m_serialization.baseline.reset();
+        // The scripts register their component types again
+        m_componentFactory.unregisterComponentTypes();
+        m_scriptWatch.modificationTimes.clear();
+        this->loadScripts(SCRIPT_DIRECTORY, SCRIPT_CACHE_DIRECTORY);
+        for (const auto& pair : m_gameStates) {
+            auto iter = snapshots.find(pair.first);
+            if (iter != snapshots.end()) {
+                this->initGameState(pair.second.get());
+                m_currentGameState = pair.second.get();
+                pair.second->load(iter->second);
+            }
+        }
+        m_currentGameState = nullptr;
+        // Stay in the same game state, whatever the scripts selected
+        m_nextGameState = nullptr;
+        if (m_gameStates.empty()) {
+            throw std::runtime_error("No game state left after reloading scripts");
+        }
+        auto iter = m_gameStates.find(currentName);
+        if (iter == m_gameStates.end()) {
+            m_scriptLog.warning("Game state " + currentName + " is gone after reloading scripts");
+            iter = m_gameStates.begin();
+        }
+        this->activateGameState(iter->second.get());
+    }
+
+    void
+    restoreSavegame(
+        const std::string& filename,
+        StorageReader& reader,
+        const std::vector<StorageContainer>& deltas
+    ) {
+        GameState* previousGameState = m_currentGameState;
+        this->activateGameState(nullptr);
+        // Top level entries other than the game states
+        StorageContainer savegame;
+        std::set<GameState*> restoredGameStates;
+        // Further incremental saves need the loaded state
+        bool keepsBaseline = m_serialization.keepsBaseline or not deltas.empty();
+        StorageContainer baselineGameStates;
+        while (reader.nextEntry()) {
+            if (reader.key() == "gameStates" and reader.isContainer()) {
+                reader.enterContainer();
+                this->restoreGameStates(
+                    reader,
+                    deltas,
+                    restoredGameStates,
+                    keepsBaseline ? &baselineGameStates : nullptr
+                );
+            }
+            else {
+                reader.readEntry(savegame);
+            }
+        }
+        for (const auto& pair : m_gameStates) {
+            if (restoredGameStates.count(pair.second.get()) == 0) {
+                this->resetGameState(pair.second.get());
+            }
+        }
+        m_currentGameState = nullptr;
+        if (m_serialization.loadProgressCallback) {
+            m_serialization.loadProgressCallback(1.0f);
+        }
+        if (not deltas.empty()) {
+            savegame.set(
+                "currentGameState",
+                deltas.back().get<std::string>("currentGameState")
+            );
+        }
+        m_serialization.baseline.reset();
+        // The game states missing from the savegame have been reset, so
+        // the savegame covers all initialized ones
+        if (keepsBaseline) {
+            auto baseline = std::make_shared<StorageContainer>(savegame);
+            baseline->set("gameStates", std::move(baselineGameStates));
+            m_serialization.baseline = baseline;
+            m_serialization.baselineFile = filename;
+            m_serialization.baselineGameStateCount = restoredGameStates.size();
+            m_serialization.deltaCount = deltas.size();
+            m_serialization.keepsBaseline = true;
+        }
+        // Switch gamestate
+        std::string gameStateName = savegame.get<std::string>("currentGameState");
+        auto iter = m_gameStates.find(gameStateName);
+        if (iter != m_gameStates.end()) {
+            this->activateGameState(iter->second.get());
+        }
+        else {
+            this->activateGameState(previousGameState);
+            // TODO: Log error
+        }
+    }
+
+    // Shuts down an initialized game state and drops its entities, so its
+    // initializer runs again when it is next used
+    void
+    resetGameState(
+        GameState* gameState
+    ) {
+        if (not gameState->isInitialized()) {
+            return;
+        }
+        gameState->entityManager().clear();
+        gameState->shutdown();
+    }
+
+    void
+    toggleTracing() {
+        if (not m_isTracingManually) {
+            m_isTracingManually = true;
+            m_tracer.clear();
+            m_tracer.start();
+            return;
+        }
+        m_isTracingManually = false;
+        m_tracer.stop();
+        try {
+            m_tracer.writeChromeTrace(TRACE_FILE);
+            m_engineLog.info("Trace written to " + std::string(TRACE_FILE));
+        }
+        catch (const std::runtime_error& e) {
+            m_engineLog.error("Error writing trace: " + std::string(e.what()));
+        }
+    }
+
+    // The engine's part of a telemetry sample
+    void
+    writeTelemetry(
+        JsonWriter& writer
+    ) {
+        writer.key("statistics");
+        m_statistics.writeJson(writer);
+        writer.key("gameStates").beginObject();
+        for (const auto& pair : m_gameStates) {
+            GameState& gameState = *pair.second;
+            if (not gameState.isInitialized()) {
+                continue;
+            }
+            writer.key(pair.first).beginObject();
+            writer.key("entities").value(
+                static_cast<uint64_t>(gameState.entityManager().entityCount())
+            );
+            writer.key("systems");
+            gameState.systemProfiler().writeJson(writer);
+            writer.endObject();
+        }
+        writer.endObject();
+        writer.key("memory");
+        m_engine.memoryStats().writeJson(writer);
+    }
+
+    // Commands for telemetry clients, on top of the server's own
+    void
+    addTelemetryCommands() {
+        m_telemetry.addCommand(
+            "profiler",
+            "on, counters, off or reset: Controls the system profilers of all "
+            "game states, counters also reads the hardware counters",
+            [this] (const std::string& arguments) {
+                if (
+                    arguments != "on" and arguments != "counters" and
+                    arguments != "off" and arguments != "reset"
+                ) {
+                    throw std::invalid_argument("Expected on, counters, off or reset");
+                }
+                if (arguments == "counters" and not PerfCounters::isAvailable()) {
+                    throw std::runtime_error("Hardware counters are not available");
+                }
+                for (const auto& pair : m_gameStates) {
+                    SystemProfiler& profiler = pair.second->systemProfiler();
+                    if (arguments == "reset") {
+                        profiler.reset();
+                    }
+                    else {
+                        profiler.setEnabled(arguments != "off");
+                        profiler.setCountingHardware(arguments == "counters");
+                    }
+                }
+                return "Profilers " + arguments;
+            }
+        );
+        m_telemetry.addCommand(
+            "trace",
+            "start or stop: Records a trace, like F8",
+            [this] (const std::string& arguments) {
+                if (arguments != "start" and arguments != "stop") {
+                    throw std::invalid_argument("Expected start or stop");
+                }
+                bool start = arguments == "start";
+                if (start == m_isTracingManually) {
+                    throw std::runtime_error(
+                        start ? "Already tracing" : "Not tracing"
+                    );
+                }
+                this->toggleTracing();
+                return start ?
+                    std::string("Tracing") :
+                    "Trace written to " + std::string(TRACE_FILE);
+            }
+        );
+    }
+
+    // Initializes the oldest prewarmed game state once its physics world
+    // is done. One per frame keeps the hitch small.
+    void
+    updatePrewarms() {
+        if (m_prewarms.empty() or not m_prewarms.front()->physics.isDone()) {
+            return;
+        }
+        GameState* gameState = m_prewarms.front()->gameState;
+        m_prewarms.pop_front();
+        this->initGameState(gameState);
+    }
+
+    void
+    beginBudgetFrame() {
+        m_frameCount += 1;
+        m_budgets.beginFrame(m_frameCount);
+        if (m_budgets.traceSnapshots() and not m_isTracingManually) {
+            m_tracer.clear();
+            m_tracer.start();
+        }
+    }
+
+    // Writes a trace snapshot if the frame went over budget
+    void
+    endBudgetFrame(
+        boost::chrono::steady_clock::time_point frameStart
+    ) {
+        using namespace boost::chrono;
+        auto now = steady_clock::now();
+        m_budgets.check(
+            "frame",
+            static_cast<uint32_t>(duration_cast<microseconds>(now - frameStart).count())
+        );
+        std::vector<FrameBudgets::Violation> violations = m_budgets.endFrame();
+        m_statistics.add("budgets.exceeded", violations.size());
+        if (m_isTracingManually or not m_tracer.isRunning()) {
+            return;
+        }
+        m_tracer.stop();
+        bool isSnapshotDue = 
+            m_lastBudgetSnapshot == steady_clock::time_point() or
+            now - m_lastBudgetSnapshot >= BUDGET_SNAPSHOT_INTERVAL;
+        if (violations.empty() or not m_budgets.traceSnapshots() or not isSnapshotDue) {
+            return;
+        }
+        m_lastBudgetSnapshot = now;
+        std::string filename = "budget_trace_" + std::to_string(m_frameCount) + ".json";
+        try {
+            m_tracer.writeChromeTrace(filename);
+            m_engineLog.warning("Budget trace written to " + filename);
+        }
+        catch (const std::runtime_error& e) {
+            m_engineLog.error("Error writing budget trace: " + std::string(e.what()));
+        }
+    }
+
     void
     saveSavegame() {
-        StorageContainer savegame;
-        savegame.set("currentGameState", m_currentGameState->name());
-        StorageContainer gameStates;
+        Tracer::Zone zone(&m_tracer, "saveSavegame");
+        Statistics::Timer timer(&m_statistics.histogram("savegame.snapshot"));
+        // The snapshots have to be taken on the main thread, while no
+        // system is running. The savegame is built from them by the write
+        // job.
+        std::vector<std::pair<std::string, EntityManager::Snapshot>> snapshots;
+        snapshots.reserve(m_gameStates.size());
         for (const auto& pair : m_gameStates) {
-            gameStates.set(pair.first, pair.second->storage());
+            // Unused game states start over from their initializer anyway
+            if (pair.second->isInitialized()) {
+                snapshots.emplace_back(pair.first, pair.second->snapshot());
+            }
         }
-        savegame.set("gameStates", std::move(gameStates));
-        std::ofstream stream(
-            m_serialization.saveFile,
-            std::ofstream::trunc | std::ofstream::binary
-        );
+        auto savegame = std::make_shared<StorageContainer>();
+        savegame->set("currentGameState", m_currentGameState->name());
+        std::unique_ptr<PendingSave> save(new PendingSave());
+        save->callback = std::move(m_serialization.saveCallback);
+        m_serialization.saveCallback = nullptr;
+        PendingSave* rawSave = save.get();
+        std::string filename = m_serialization.saveFile;
         m_serialization.saveFile = "";
-        stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-        if (stream) {
-            try {
-                stream << savegame;
-                stream.flush();
-                stream.close();
+        // Incremental saves store the changes since the baseline, which is
+        // the previous save or the loaded savegame
+        auto& serialization = m_serialization;
+        std::shared_ptr<const StorageContainer> baseline;
+        std::string targetFile = filename;
+        if (
+            serialization.isIncrementalSave and
+            serialization.baseline and
+            serialization.baselineFile == filename and
+            serialization.baselineGameStateCount == snapshots.size() and
+            serialization.deltaCount < MAX_DELTA_COUNT
+        ) {
+            baseline = serialization.baseline;
+            serialization.deltaCount += 1;
+            targetFile = deltaFilename(filename, serialization.deltaCount);
+        }
+        else {
+            serialization.deltaCount = 0;
+        }
+        serialization.keepsBaseline = serialization.keepsBaseline or serialization.isIncrementalSave;
+        serialization.isIncrementalSave = false;
+        if (serialization.keepsBaseline) {
+            serialization.baseline = savegame;
+            serialization.baselineFile = filename;
+            serialization.baselineGameStateCount = snapshots.size();
+        }
+        Tracer* tracer = &m_tracer;
+        Statistics::Histogram* writeTimes = &m_statistics.histogram("savegame.write");
+        ThreadPool* threadPool = &m_threadPool;
+        auto write = [rawSave, snapshots, savegame, baseline, targetFile, tracer, writeTimes, threadPool] () {
+            Tracer::Zone zone(tracer, "writeSavegame");
+            Statistics::Timer timer(writeTimes);
+            // Later saves only read the savegame as their baseline once
+            // this job is done
+            StorageContainer gameStates;
+            for (const auto& pair : snapshots) {
+                // Game states only store their entities and the shapes
+                // their rigid bodies share
+                CollisionShapeTable shapes;
+                StorageContainer gameState;
+                gameState.set("entities", pair.second.storage(
+                    [&shapes] (const std::string& typeName, StorageList& rows) {
+                        if (typeName == RigidBodyComponent::TYPE_NAME()) {
+                            RigidBodyComponent::referenceShapes(rows, shapes);
+                        }
+                    }
+                ));
+                gameState.set("collisionShapes", shapes.storage());
+                gameStates.set(pair.first, std::move(gameState));
             }
-            catch (const std::ofstream::failure& e) {
-                std::cerr << "Error saving file: " << e.what() << std::endl;
-                throw;
+            savegame->set("gameStates", std::move(gameStates));
+            if (baseline) {
+                rawSave->success = writeSavegame(
+                    savegameDelta(*baseline, *savegame),
+                    targetFile,
+                    false,
+                    threadPool,
+                    rawSave->errorMessage
+                );
             }
+            else {
+                rawSave->success = writeSavegame(
+                    *savegame,
+                    targetFile,
+                    true,
+                    threadPool,
+                    rawSave->errorMessage
+                );
+            }
+        };
+        auto& pendingSaves = m_serialization.pendingSaves;
+        if (m_threadPool.threadCount() == 0) {
+            write();
+        }
+        else if (pendingSaves.empty()) {
+            m_threadPool.submit(write, &save->job);
         }
         else {
-            std::perror("Could not open file for saving");
+            // Writes to the same file must not overlap
+            m_threadPool.submitAfter(
+                pendingSaves.back()->job,
+                write,
+                &save->job
+            );
         }
+        pendingSaves.push_back(std::move(save));
     }
 
     void
     setupGraphics() {
         m_graphics.root.reset(new Ogre::Root(PLUGINS_CFG));
+        Ogre::ArchiveManager::getSingleton().addArchiveFactory(
+            &m_graphics.packArchiveFactory
+        );
         this->loadResources();
         this->loadOgreConfig();
         m_graphics.renderWindow = m_graphics.root->initialise(true, "Thrive");
+        loadGpuProgramCache(SHADER_CACHE_DIRECTORY);
         m_input.mouse.setWindowSize(
             m_graphics.renderWindow->getWidth(),
             m_graphics.renderWindow->getHeight()
@@ -272,8 +1357,7 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
         );
         // Set default mipmap level (NB some APIs ignore this)
         Ogre::TextureManager::getSingleton().setDefaultNumMipmaps(5);
-        // initialise all resource groups
-        Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
+        this->startResourceLoading();
     }
 
     void
@@ -302,10 +1386,85 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
         m_input.mouse.init(m_input.inputManager);
     }
 
+    // Ogre's log keeps nothing itself, its messages go to the "ogre"
+    // channel. Its trivial and normal messages are mostly resource
+    // loading, so they only make it into the log file.
+    void
+    messageLogged(
+        const Ogre::String& message,
+        Ogre::LogMessageLevel level,
+        bool,
+        const Ogre::String&,
+        bool& skipThisMessage
+    ) override {
+        m_ogreLog.write(
+            level == Ogre::LML_CRITICAL ? LogLevel::Error : LogLevel::Debug,
+            message
+        );
+        skipThisMessage = true;
+    }
+
     void
     setupLog() {
         static Ogre::LogManager logManager;
-        logManager.createLog("default", true, false, false);
+        if (not m_defaultOgreLog) {
+            m_defaultOgreLog = logManager.createLog("default", true, false, true);
+            m_defaultOgreLog->addListener(this);
+        }
+        Logger& logger = Logger::instance();
+        if (not logger.isRunning()) {
+            logger.setFile(LOG_FILE);
+            logger.channel("ogre").setLevel(LogLevel::Debug);
+            logger.start();
+        }
+    }
+
+    // Adds a shape and, for compound shapes, its children
+    static void
+    collectShapes(
+        const btCollisionShape* shape,
+        std::unordered_set<const btCollisionShape*>& shapes
+    ) {
+        if (not shape or not shapes.insert(shape).second) {
+            return;
+        }
+        if (shape->isCompound()) {
+            auto compound = static_cast<const btCompoundShape*>(shape);
+            for (int i = 0; i < compound->getNumChildShapes(); ++i) {
+                collectShapes(compound->getChildShape(i), shapes);
+            }
+        }
+    }
+
+    // Counts a scene node and all its descendants
+    static size_t
+    countSceneNodes(
+        Ogre::Node* node
+    ) {
+        size_t count = 1;
+        auto children = node->getChildIterator();
+        while (children.hasMoreElements()) {
+            count += countSceneNodes(children.getNext());
+        }
+        return count;
+    }
+
+    void
+    setupInputRecording() {
+        auto& inputRecording = m_inputRecording;
+        if (not inputRecording.playerFile.empty()) {
+            inputRecording.player.reset(
+                new InputPlayer(inputRecording.playerFile)
+            );
+            m_rng.setSeed(inputRecording.player->seed());
+        }
+        else if (not inputRecording.recorderFile.empty()) {
+            RNG::Seed seed = m_rng.generateRandomSeed();
+            m_rng.setSeed(seed);
+            inputRecording.recorder.reset(
+                new InputRecorder(inputRecording.recorderFile, seed)
+            );
+        }
     }
 
     void
@@ -344,6 +1503,10 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
         }
     }
 
+    // Hooks into Bullet's allocator, so it's created before and destroyed
+    // after everything else
+    AllocationTracker m_allocationTracker;
+
     // Lua state must be one of the last to be destroyed, so keep it at top.
     // The reason for that is that some components keep luabind::object
     // instances around that rely on the lua state to still exist when they
@@ -351,18 +1514,75 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
     // manager, the lua state has to live longer than the manager.
     LuaState m_luaState;
 
+    LuaGarbageCollector m_garbageCollector;
+
+    // May hold Lua functions
+    IdleTasks m_idleTasks;
+
+    LuaTasks m_luaTasks;
+
+    LuaProfiler m_profiler;
+
+    // Tasks in the pool publish statistics, check budgets and trace zones
+    // as well
+    FrameBudgets m_budgets;
+
+    MaterialWarmup m_materialWarmup;
+
+    Statistics m_statistics;
+
+    TelemetryServer m_telemetry;
+
+    Tracer m_tracer;
+
+    Ogre::Log* m_defaultOgreLog = nullptr;
+
+    LogChannel& m_engineLog = Logger::instance().channel("engine");
+
+    LogChannel& m_ogreLog = Logger::instance().channel("ogre");
+
+    LogChannel& m_savegameLog = Logger::instance().channel("savegame");
+
+    LogChannel& m_scriptLog = Logger::instance().channel("scripts");
+
+    // Game states submit work to the pool, so it has to outlive them
+    ThreadPool m_threadPool;
+
+    // Entity managers allocate from the arena, so it has to outlive the
+    // game states
+    FrameArena m_frameArena;
+
     GameState* m_currentGameState = nullptr;
 
+    // See addBackgroundGameState()
+    std::vector<GameState*> m_backgroundGameStates;
+
     ComponentFactory m_componentFactory;
 
     Engine& m_engine;
 
     std::map<std::string, std::unique_ptr<GameState>> m_gameStates;
 
+    // A game state whose physics world is built in the background, see
+    // Engine::prewarmGameState()
+    struct Prewarm {
+
+        GameState* gameState = nullptr;
+
+        JobCounter physics;
+
+    };
+
+    // Oldest first
+    std::deque<std::unique_ptr<Prewarm>> m_prewarms;
+
     RNG m_rng;
 
     struct Graphics {
 
+        // Outlives the root, which destroys its archives
+        PackArchiveFactory packArchiveFactory;
+
         std::unique_ptr<Ogre::Root> root;
 
         Ogre::RenderWindow* renderWindow = nullptr;
@@ -379,12 +1599,138 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
 
     } m_input;
 
+    struct InputRecording {
+
+        std::unique_ptr<InputPlayer> player;
+
+        std::string playerFile;
+
+        std::unique_ptr<InputRecorder> recorder;
+
+        std::string recorderFile;
+
+    } m_inputRecording;
+
+    struct StateHashing {
+
+        std::string file;
+
+        bool isVerifying = false;
+
+    } m_stateHashing;
+
+    struct DataSharing {
+
+        // Mapped by openSharedData(), null if the file was missing
+        std::unique_ptr<SharedData> data;
+
+        std::string file;
+
+        // Whether the file lacks current scripts or shared prototypes
+        bool isStale = false;
+
+        // Collects the shared prototypes until the next write
+        SharedDataWriter writer;
+
+    } m_dataSharing;
+
+    unsigned long long m_frameCount = 0;
+
+    std::vector<StartupPhase> m_startupPhases;
+
+    bool m_isHeadless = false;
+
+    // Whether the tracer was started with F8, as opposed to tracing for
+    // budget snapshots
+    bool m_isTracingManually = false;
+
+    boost::chrono::steady_clock::time_point m_lastBudgetSnapshot;
+
     GameState* m_nextGameState = nullptr;
 
+    struct ResourceLoading {
+
+        struct Group {
+
+            // Whether the group's scripts have been parsed
+            bool isInitialised = false;
+
+            std::string name;
+
+            // The pending background request, or 0
+            Ogre::BackgroundProcessTicket ticket = 0;
+
+        };
+
+        size_t finishedSteps = 0;
+
+        // Groups whose background requests are not all done yet
+        std::vector<Group> groups;
+
+        std::set<std::string> loadedGroups;
+
+        // Whether the material warm-up has run after the groups were
+        // loaded
+        bool isWarmedUp = true;
+
+        // One step for every initialisation and load, plus the warm-up
+        size_t totalSteps = 0;
+
+    } m_resourceLoading;
+
+    struct ScriptWatch {
+
+        // Time since the scripts were last checked for changes
+        Milliseconds elapsed = 0;
+
+        bool isEnabled = false;
+
+        // Of each script loaded, by path
+        std::map<std::string, std::time_t> modificationTimes;
+
+        bool reloadRequested = false;
+
+    } m_scriptWatch;
+
+    struct PendingSave {
+
+        Engine::SaveCallback callback;
+
+        std::string errorMessage;
+
+        JobCounter job;
+
+        bool success = false;
+
+    };
+
     struct Serialization {
 
+        // The last savegame written or loaded, which incremental saves are
+        // relative to. Only kept once incremental saves are used.
+        std::shared_ptr<const StorageContainer> baseline;
+
+        std::string baselineFile;
+
+        size_t baselineGameStateCount = 0;
+
+        // Incremental saves written on top of the baseline file
+        unsigned int deltaCount = 0;
+
+        // Whether the requested save is incremental
+        bool isIncrementalSave = false;
+
+        bool keepsBaseline = false;
+
         std::string loadFile;
 
+        Engine::LoadProgressCallback loadProgressCallback;
+
+        // Saves that are being written, oldest first
+        std::deque<std::unique_ptr<PendingSave>> pendingSaves;
+
+        Engine::SaveCallback saveCallback;
+
         std::string saveFile;
 
     } m_serialization;
@@ -392,18 +1738,28 @@ struct Engine::Implementation : public Ogre::WindowEventListener {
 
 
 static GameState*
-Engine_createGameState(
+Engine_createGameStateWithOptions(
     Engine* self,
     std::string name,
     luabind::object luaSystems,
-    luabind::object luaInitializer
+    luabind::object luaInitializer,
+    luabind::object luaOptions
 ) {
     std::vector<std::unique_ptr<System>> systems;
     for (luabind::iterator iter(luaSystems), end; iter != end; ++iter) {
+        luabind::object luaSystem = *iter;
+        // Named after their class, for the system profiler
+        lua_State* L = luaSystem.interpreter();
+        luaSystem.push(L);
+        std::string className = luabind::get_class_info(
+            luabind::argument(luabind::from_stack(L, -1))
+        ).name;
+        lua_pop(L, 1);
         System* system = luabind::object_cast<System*>(
-            *iter,
+            luaSystem,
             luabind::adopt(luabind::result)
         );
+        system->setName(className);
         systems.emplace_back(system);
     }
     // We can't just capture the luaInitializer in the lambda here, because
@@ -414,81 +1770,385 @@ Engine_createGameState(
         },
         luaInitializer
     );
+    GameState::Options options;
+    if (luabind::type(luaOptions) == LUA_TTABLE) {
+        luabind::object multithreadedPhysics = luaOptions["multithreadedPhysics"];
+        if (multithreadedPhysics) {
+            options.multithreadedPhysics = luabind::object_cast<bool>(multithreadedPhysics);
+        }
+        luabind::object physicsSolverPoolSize = luaOptions["physicsSolverPoolSize"];
+        if (physicsSolverPoolSize) {
+            options.physicsSolverPoolSize = luabind::object_cast<unsigned int>(physicsSolverPoolSize);
+        }
+        luabind::object planarPhysics = luaOptions["planarPhysics"];
+        if (planarPhysics) {
+            options.planarPhysics = luabind::object_cast<bool>(planarPhysics);
+        }
+        luabind::object asyncPhysics = luaOptions["asyncPhysics"];
+        if (asyncPhysics) {
+            options.asyncPhysics = luabind::object_cast<bool>(asyncPhysics);
+        }
+        luabind::object physicsSolverIterations = luaOptions["physicsSolverIterations"];
+        if (physicsSolverIterations) {
+            options.physicsSolverIterations = luabind::object_cast<unsigned int>(physicsSolverIterations);
+        }
+        luabind::object physicsStepRate = luaOptions["physicsStepRate"];
+        if (physicsStepRate) {
+            options.physicsStepRate = luabind::object_cast<unsigned int>(physicsStepRate);
+        }
+        luabind::object physicsMaxSubSteps = luaOptions["physicsMaxSubSteps"];
+        if (physicsMaxSubSteps) {
+            options.physicsMaxSubSteps = luabind::object_cast<unsigned int>(physicsMaxSubSteps);
+        }
+        luabind::object physicsBudget = luaOptions["physicsBudget"];
+        if (physicsBudget) {
+            options.physicsBudget = luabind::object_cast<unsigned int>(physicsBudget);
+        }
+        luabind::object broadphase = luaOptions["broadphase"];
+        if (broadphase) {
+            std::string type = luabind::object_cast<std::string>(broadphase);
+            if (type == "dbvt") {
+                options.broadphase = GameState::Options::Broadphase::Dbvt;
+            }
+            else if (type == "axisSweep") {
+                options.broadphase = GameState::Options::Broadphase::AxisSweep;
+            }
+            else {
+                throw std::invalid_argument("Unknown broadphase: " + type);
+            }
+        }
+        luabind::object maxBroadphaseProxies = luaOptions["maxBroadphaseProxies"];
+        if (maxBroadphaseProxies) {
+            options.maxBroadphaseProxies = luabind::object_cast<unsigned int>(maxBroadphaseProxies);
+        }
+        luabind::object worldMin = luaOptions["worldMin"];
+        if (worldMin) {
+            options.worldMin = luabind::object_cast<Ogre::Vector3>(worldMin);
+        }
+        luabind::object worldMax = luaOptions["worldMax"];
+        if (worldMax) {
+            options.worldMax = luabind::object_cast<Ogre::Vector3>(worldMax);
+        }
+        luabind::object sceneManager = luaOptions["sceneManager"];
+        if (sceneManager) {
+            std::string type = luabind::object_cast<std::string>(sceneManager);
+            if (type == "generic") {
+                options.sceneManager = GameState::Options::SceneManagerType::Generic;
+            }
+            else if (type == "octree") {
+                options.sceneManager = GameState::Options::SceneManagerType::Octree;
+            }
+            else {
+                throw std::invalid_argument("Unknown scene manager: " + type);
+            }
+        }
+        luabind::object sceneDepth = luaOptions["sceneDepth"];
+        if (sceneDepth) {
+            options.sceneDepth = luabind::object_cast<unsigned int>(sceneDepth);
+        }
+        luabind::object updateRates = luaOptions["updateRates"];
+        if (luabind::type(updateRates) == LUA_TTABLE) {
+            for (luabind::iterator iter(updateRates), end; iter != end; ++iter) {
+                options.updateRates[luabind::object_cast<std::string>(iter.key())] =
+                    luabind::object_cast<unsigned int>(*iter);
+            }
+        }
+        luabind::object creationBudget = luaOptions["creationBudget"];
+        if (creationBudget) {
+            options.creationBudget = luabind::object_cast<unsigned int>(creationBudget);
+        }
+        luabind::object maxCreationsPerFrame = luaOptions["maxCreationsPerFrame"];
+        if (maxCreationsPerFrame) {
+            options.maxCreationsPerFrame = luabind::object_cast<unsigned int>(maxCreationsPerFrame);
+        }
+        luabind::object headless = luaOptions["headless"];
+        if (headless) {
+            options.headless = luabind::object_cast<bool>(headless);
+        }
+        luabind::object keepResident = luaOptions["keepResident"];
+        if (keepResident) {
+            options.keepResident = luabind::object_cast<bool>(keepResident);
+        }
+        luabind::object pipelinedRendering = luaOptions["pipelinedRendering"];
+        if (pipelinedRendering) {
+            options.pipelinedRendering = luabind::object_cast<bool>(pipelinedRendering);
+        }
+    }
     return self->createGameState(
         name,
         std::move(systems),
-        initializer
+        initializer,
+        options
+    );
+}
+
+
+static GameState*
+Engine_createGameState(
+    Engine* self,
+    std::string name,
+    luabind::object luaSystems,
+    luabind::object luaInitializer
+) {
+    return Engine_createGameStateWithOptions(
+        self,
+        name,
+        luaSystems,
+        luaInitializer,
+        luabind::object()
+    );
+}
+
+
+static void
+Engine_save(
+    Engine* self,
+    std::string filename
+) {
+    self->save(filename);
+}
+
+
+static Engine::SaveCallback
+luaSaveCallback(
+    luabind::object luaCallback
+) {
+    // Same as for the game state initializer, luabind::object's call
+    // operator is not const
+    return std::bind<void>(
+        [](luabind::object luaCallback, bool success, const std::string& errorMessage) {
+            luaCallback(success, errorMessage);
+        },
+        luaCallback,
+        std::placeholders::_1,
+        std::placeholders::_2
     );
 }
 
 
+static void
+Engine_saveWithCallback(
+    Engine* self,
+    std::string filename,
+    luabind::object luaCallback
+) {
+    self->save(filename, luaSaveCallback(luaCallback));
+}
+
+
+static void
+Engine_saveIncremental(
+    Engine* self,
+    std::string filename
+) {
+    self->saveIncremental(filename);
+}
+
+
+static void
+Engine_saveIncrementalWithCallback(
+    Engine* self,
+    std::string filename,
+    luabind::object luaCallback
+) {
+    self->saveIncremental(filename, luaSaveCallback(luaCallback));
+}
+
+
 luabind::scope
 Engine::luaBindings() {
     using namespace luabind;
     return class_<Engine>("__Engine")
+        .def("addBackgroundGameState", &Engine::addBackgroundGameState)
         .def("createGameState", Engine_createGameState)
+        .def("createGameState", Engine_createGameStateWithOptions)
         .def("currentGameState", &Engine::currentGameState)
+        .def("isBackgroundGameState", &Engine::isBackgroundGameState)
+        .def("removeBackgroundGameState", &Engine::removeBackgroundGameState)
         .def("getGameState", &Engine::getGameState)
         .def("setCurrentGameState", &Engine::setCurrentGameState)
+        .def("prewarmGameState", &Engine::prewarmGameState)
         .def("load", &Engine::load)
-        .def("save", &Engine::save)
+        .def("loadSharedPrototype", &Engine::loadSharedPrototype)
+        .def("reloadScripts", &Engine::reloadScripts)
+        .def("save", Engine_save)
+        .def("save", Engine_saveWithCallback)
+        .def("saveIncremental", Engine_saveIncremental)
+        .def("saveIncremental", Engine_saveIncrementalWithCallback)
+        .def("setScriptWatching", &Engine::setScriptWatching)
+        .def("sharePrototype", &Engine::sharePrototype)
+        .def("isHeadless", &Engine::isHeadless)
+        .def("isLoadingResources", &Engine::isLoadingResources)
+        .def("isResourceGroupLoaded", &Engine::isResourceGroupLoaded)
+        .def("resourceLoadProgress", &Engine::resourceLoadProgress)
+        .def("stateHashFile", &Engine::stateHashFile)
+        .def("memoryStats", &Engine::memoryStats)
+        .property("allocationTracker", &Engine::allocationTracker)
+        .property("budgets", &Engine::budgets)
         .property("componentFactory", &Engine::componentFactory)
+        .property("garbageCollector", &Engine::garbageCollector)
+        .property("idleTasks", &Engine::idleTasks)
         .property("keyboard", &Engine::keyboard)
+        .property("luaTasks", &Engine::luaTasks)
+        .property("materialWarmup", &Engine::materialWarmup)
         .property("mouse", &Engine::mouse)
+        .property("profiler", &Engine::profiler)
+        .property("statistics", &Engine::statistics)
+        .property("telemetry", &Engine::telemetry)
+        .property("tracer", &Engine::tracer)
     ;
 }
 
 
 
 
-Engine::Engine()
-  : m_impl(new Implementation(*this))
-{
+Engine::Engine()
+  : m_impl(new Implementation(*this))
+{
+}
+
+
+Engine::~Engine() { }
+
+
+ComponentFactory&
+Engine::componentFactory() {
+    return m_impl->m_componentFactory;
+}
+
+
+GameState*
+Engine::createGameState(
+    std::string name,
+    std::vector<std::unique_ptr<System>> systems,
+    GameState::Initializer initializer,
+    const GameState::Options& options
+) {
+    assert(m_impl->m_gameStates.find(name) == m_impl->m_gameStates.end() && "Duplicate GameState name");
+    std::unique_ptr<GameState> gameState(new GameState(
+        *this,
+        name,
+        std::move(systems),
+        initializer,
+        options
+    ));
+    GameState* rawGameState = gameState.get();
+    m_impl->m_gameStates.insert(std::make_pair(
+        name,
+        std::move(gameState)
+    ));
+    return rawGameState;
+}
+
+
+GameState*
+Engine::currentGameState() const {
+    return m_impl->m_currentGameState;
+}
+
+
+void
+Engine::addBackgroundGameState(
+    GameState* gameState
+) {
+    if (not gameState) {
+        throw std::invalid_argument("Background game state must not be null");
+    }
+    if (gameState == m_impl->m_currentGameState) {
+        throw std::invalid_argument("The current game state can't run in the background: " + gameState->name());
+    }
+    if (not gameState->isHeadless()) {
+        throw std::invalid_argument("Background game states must be headless: " + gameState->name());
+    }
+    if (this->isBackgroundGameState(gameState)) {
+        return;
+    }
+    if (not gameState->isInitialized()) {
+        m_impl->initGameState(gameState);
+    }
+    // Neither current nor in the background, so suspended or deactivated
+    gameState->activate();
+    m_impl->m_backgroundGameStates.push_back(gameState);
+}
+
+
+const std::vector<GameState*>&
+Engine::backgroundGameStates() const {
+    return m_impl->m_backgroundGameStates;
+}
+
+
+bool
+Engine::isBackgroundGameState(
+    GameState* gameState
+) const {
+    const auto& gameStates = m_impl->m_backgroundGameStates;
+    return std::find(gameStates.begin(), gameStates.end(), gameState) != gameStates.end();
+}
+
+
+void
+Engine::removeBackgroundGameState(
+    GameState* gameState
+) {
+    auto& gameStates = m_impl->m_backgroundGameStates;
+    auto iter = std::find(gameStates.begin(), gameStates.end(), gameState);
+    if (iter == gameStates.end()) {
+        return;
+    }
+    gameStates.erase(iter);
+    gameState->deactivate();
 }
 
 
-Engine::~Engine() { }
+AllocationTracker&
+Engine::allocationTracker() {
+    return m_impl->m_allocationTracker;
+}
 
 
-ComponentFactory&
-Engine::componentFactory() {
-    return m_impl->m_componentFactory;
+FrameBudgets&
+Engine::budgets() {
+    return m_impl->m_budgets;
 }
 
 
-GameState*
-Engine::createGameState(
-    std::string name,
-    std::vector<std::unique_ptr<System>> systems,
-    GameState::Initializer initializer
-) {
-    assert(m_impl->m_gameStates.find(name) == m_impl->m_gameStates.end() && "Duplicate GameState name");
-    std::unique_ptr<GameState> gameState(new GameState(
-        *this,
-        name,
-        std::move(systems),
-        initializer
-    ));
-    GameState* rawGameState = gameState.get();
-    m_impl->m_gameStates.insert(std::make_pair(
-        name,
-        std::move(gameState)
-    ));
-    return rawGameState;
+FrameArena&
+Engine::frameArena() {
+    return m_impl->m_frameArena;
 }
 
 
-GameState*
-Engine::currentGameState() const {
-    return m_impl->m_currentGameState;
+LuaGarbageCollector&
+Engine::garbageCollector() {
+    return m_impl->m_garbageCollector;
+}
+
+
+LuaProfiler&
+Engine::profiler() {
+    return m_impl->m_profiler;
 }
 
+
 RNG&
 Engine::rng() {
     return m_impl->m_rng;
 }
 
 
+std::string
+Engine::scriptCacheDirectory() const {
+    return SCRIPT_CACHE_DIRECTORY;
+}
+
+
+std::string
+Engine::scriptDirectory() const {
+    return SCRIPT_DIRECTORY;
+}
+
+
 GameState*
 Engine::getGameState(
     const std::string& name
@@ -504,21 +2164,119 @@ Engine::getGameState(
 
 
 void
-Engine::init() {
+Engine::init(
+    bool headless
+) {
     assert(m_impl->m_currentGameState == nullptr);
+    auto initStart = boost::chrono::steady_clock::now();
     std::srand(unsigned(time(0)));
+    m_impl->m_isHeadless = headless;
+    m_impl->m_startupPhases.clear();
     m_impl->setupLog();
-    m_impl->setupScripts();
-    m_impl->setupGraphics();
-    m_impl->setupInputManager();
-    m_impl->loadScripts("../scripts");
-    GameState* previousGameState = m_impl->m_currentGameState;
-    for (const auto& pair : m_impl->m_gameStates) {
-        const auto& gameState = pair.second;
-        m_impl->m_currentGameState = gameState.get();
-        gameState->init();
+    ThreadPool& threadPool = m_impl->m_threadPool;
+    Tracer& tracer = m_impl->m_tracer;
+    m_impl->openSharedData();
+    // Neither the main Lua state's bindings nor compiling the scripts
+    // touch Ogre, so they run on the pool while the main thread sets up
+    // Ogre. The root, its config dialog and the render window stay on the
+    // main thread, which renders later on.
+    StartupPhase luaPhase;
+    StartupPhase compilePhase;
+    std::exception_ptr luaError;
+    std::exception_ptr compileError;
+    JobCounter scripting;
+    threadPool.submit(
+        [&] () {
+            StartupTimer timer(luaPhase, "Lua state", initStart, tracer);
+            try {
+                m_impl->setupScripts();
+            }
+            catch (...) {
+                luaError = std::current_exception();
+            }
+        },
+        &scripting
+    );
+    threadPool.submit(
+        [&] () {
+            StartupTimer timer(compilePhase, "script compilation", initStart, tracer);
+            try {
+                m_impl->compileScripts(SCRIPT_DIRECTORY, SCRIPT_CACHE_DIRECTORY);
+            }
+            catch (...) {
+                compileError = std::current_exception();
+            }
+        },
+        &scripting
+    );
+    StartupPhase graphicsPhase;
+    if (not headless) {
+        StartupTimer timer(graphicsPhase, "Ogre setup", initStart, tracer);
+        m_impl->setupGraphics();
+        m_impl->setupInputManager();
+    }
+    threadPool.wait(scripting);
+    if (luaError) {
+        std::rethrow_exception(luaError);
+    }
+    if (compileError) {
+        std::rethrow_exception(compileError);
+    }
+    m_impl->m_startupPhases.push_back(luaPhase);
+    m_impl->m_startupPhases.push_back(compilePhase);
+    if (not headless) {
+        m_impl->m_startupPhases.push_back(graphicsPhase);
     }
-    m_impl->m_currentGameState = previousGameState;
+    m_impl->setupInputRecording();
+    {
+        StartupPhase phase;
+        {
+            StartupTimer timer(phase, "scripts", initStart, tracer);
+            m_impl->runScripts(SCRIPT_DIRECTORY, SCRIPT_CACHE_DIRECTORY);
+        }
+        m_impl->m_startupPhases.push_back(std::move(phase));
+    }
+    for (AgentId id = 1; static_cast<size_t>(id) <= AgentRegistry::getAgentCount(); ++id) {
+        m_impl->m_materialWarmup.addMesh(AgentRegistry::getAgentMeshName(id));
+    }
+    // The scripts have created the game states by now and picked the
+    // first one. Only that one is initialized here, the others wait until
+    // they are used or prewarmed.
+    GameState* firstGameState = m_impl->m_nextGameState;
+    if (firstGameState) {
+        m_impl->finishPrewarm(firstGameState);
+        StartupPhase physicsPhase;
+        {
+            StartupTimer timer(physicsPhase, "physics " + firstGameState->name(), initStart, tracer);
+            firstGameState->initPhysics();
+        }
+        m_impl->m_startupPhases.push_back(std::move(physicsPhase));
+        StartupPhase phase;
+        {
+            StartupTimer timer(phase, "game state " + firstGameState->name(), initStart, tracer);
+            m_impl->initGameState(firstGameState);
+        }
+        m_impl->m_startupPhases.push_back(std::move(phase));
+    }
+    // After the first game state's setup has shared its prototypes
+    m_impl->writeSharedData(SCRIPT_DIRECTORY, SCRIPT_CACHE_DIRECTORY);
+    m_impl->addIdleTasks();
+    m_impl->addTelemetryCommands();
+    for (const StartupPhase& phase : m_impl->m_startupPhases) {
+        std::ostringstream message;
+        message << "Startup: " << phase.name << " at " << phase.start
+            << " ms took " << phase.duration << " ms";
+        m_impl->m_engineLog.info(message.str());
+    }
+}
+
+
+void
+Engine::initGameState(
+    GameState* gameState
+) {
+    assert(gameState != nullptr && "GameState must not be null");
+    m_impl->initGameState(gameState);
 }
 
 
@@ -534,6 +2292,90 @@ Engine::keyboard() const {
 }
 
 
+IdleTasks&
+Engine::idleTasks() {
+    return m_impl->m_idleTasks;
+}
+
+
+LuaTasks&
+Engine::luaTasks() {
+    return m_impl->m_luaTasks;
+}
+
+
+MaterialWarmup&
+Engine::materialWarmup() {
+    return m_impl->m_materialWarmup;
+}
+
+
+MemoryStats
+Engine::memoryStats() const {
+    MemoryStats stats;
+    std::map<std::string, MemoryStats::Components> components;
+    std::unordered_set<const btCollisionShape*> shapes;
+    for (const auto& pair : m_impl->m_gameStates) {
+        GameState& gameState = *pair.second;
+        for (const ComponentCollection* collection : gameState.entityManager().componentCollections()) {
+            std::string typeName = m_impl->m_componentFactory.getTypeName(
+                collection->type()
+            );
+            MemoryStats::Components& entry = components[typeName];
+            entry.bytes += collection->memoryUsage();
+            entry.count += collection->size();
+        }
+        // Prewarm jobs may still be building the world
+        const btDiscreteDynamicsWorld* world = gameState.isInitialized() ?
+            gameState.physicsWorld() : nullptr;
+        if (world) {
+            const btCollisionObjectArray& objects = world->getCollisionObjectArray();
+            stats.collisionObjects += objects.size();
+            for (int i = 0; i < objects.size(); ++i) {
+                if (btRigidBody::upcast(objects[i])) {
+                    stats.rigidBodies += 1;
+                }
+                m_impl->collectShapes(objects[i]->getCollisionShape(), shapes);
+            }
+        }
+        Ogre::SceneManager* sceneManager = gameState.sceneManager();
+        if (sceneManager) {
+            stats.sceneNodes += m_impl->countSceneNodes(sceneManager->getRootSceneNode());
+            auto entities = sceneManager->getMovableObjectIterator(
+                Ogre::EntityFactory::FACTORY_TYPE_NAME
+            );
+            while (entities.hasMoreElements()) {
+                entities.getNext();
+                stats.ogreEntities += 1;
+            }
+        }
+    }
+    stats.collisionShapes = shapes.size();
+    for (auto& pair : components) {
+        pair.second.typeName = pair.first;
+        stats.components.push_back(std::move(pair.second));
+    }
+    std::sort(
+        stats.components.begin(),
+        stats.components.end(),
+        [] (const MemoryStats::Components& a, const MemoryStats::Components& b) {
+            return a.bytes > b.bytes;
+        }
+    );
+    stats.componentPoolAllocatedBytes = Component::poolAllocatedBytes();
+    stats.componentPoolReservedBytes = Component::poolReservedBytes();
+    lua_State* L = m_impl->m_luaState;
+    stats.luaHeapBytes = 
+        size_t(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+    LuaAllocator::Statistics luaAllocator = LuaAllocator::instance().statistics();
+    stats.luaAllocatorLargeBytes = luaAllocator.largeBytes;
+    stats.luaAllocatorPooledBytes = luaAllocator.pooledBytes;
+    stats.luaAllocatorRequestedBytes = luaAllocator.requestedBytes;
+    stats.luaAllocatorReservedBytes = luaAllocator.reservedBytes;
+    return stats;
+}
+
+
 void
 Engine::load(
     std::string filename
@@ -542,6 +2384,43 @@ Engine::load(
 }
 
 
+bool
+Engine::loadSharedPrototype(
+    const std::string& name,
+    EntityPrototype& prototype
+) const {
+    const auto& data = m_impl->m_dataSharing.data;
+    return data and data->loadPrototype(name, prototype);
+}
+
+
+bool
+Engine::isHeadless() const {
+    return m_impl->m_isHeadless;
+}
+
+
+bool
+Engine::isLoadingResources() const {
+    const auto& resourceLoading = m_impl->m_resourceLoading;
+    return not resourceLoading.groups.empty() or not resourceLoading.isWarmedUp;
+}
+
+
+bool
+Engine::isResourceGroupLoaded(
+    const std::string& groupName
+) const {
+    return m_impl->m_resourceLoading.loadedGroups.count(groupName) > 0;
+}
+
+
+bool
+Engine::isVerifyingStateHashes() const {
+    return m_impl->m_stateHashing.isVerifying;
+}
+
+
 const Mouse&
 Engine::mouse() const {
     return m_impl->m_input.mouse;
@@ -554,6 +2433,43 @@ Engine::ogreRoot() const {
 }
 
 
+void
+Engine::pollInput() {
+    if (m_impl->m_inputRecording.player) {
+        return;
+    }
+    m_impl->m_input.keyboard.poll();
+}
+
+
+void
+Engine::prewarmGameState(
+    GameState* gameState
+) {
+    assert(gameState != nullptr && "GameState must not be null");
+    auto& prewarms = m_impl->m_prewarms;
+    bool isQueued = std::any_of(prewarms.begin(), prewarms.end(),
+        [gameState] (const std::unique_ptr<Implementation::Prewarm>& prewarm) {
+            return prewarm->gameState == gameState;
+        }
+    );
+    if (isQueued or gameState->isInitialized()) {
+        return;
+    }
+    std::unique_ptr<Implementation::Prewarm> prewarm(new Implementation::Prewarm());
+    prewarm->gameState = gameState;
+    Tracer* tracer = &m_impl->m_tracer;
+    m_impl->m_threadPool.submit(
+        [gameState, tracer] () {
+            Tracer::Zone zone(tracer, "prewarm " + gameState->name());
+            gameState->initPhysics();
+        },
+        &prewarm->physics
+    );
+    prewarms.push_back(std::move(prewarm));
+}
+
+
 Ogre::RenderWindow*
 Engine::renderWindow() const {
     return m_impl->m_graphics.renderWindow;
@@ -561,10 +2477,73 @@ Engine::renderWindow() const {
 
 
 void
-Engine::save(
+Engine::recordInput(
+    std::string filename
+) {
+    m_impl->m_inputRecording.recorderFile = std::move(filename);
+}
+
+
+void
+Engine::recordStateHashes(
+    std::string filename
+) {
+    m_impl->m_stateHashing.file = std::move(filename);
+    m_impl->m_stateHashing.isVerifying = false;
+}
+
+
+void
+Engine::reloadScripts() {
+    m_impl->m_scriptWatch.reloadRequested = true;
+}
+
+
+void
+Engine::replayInput(
     std::string filename
 ) {
+    m_impl->m_inputRecording.playerFile = std::move(filename);
+}
+
+
+float
+Engine::resourceLoadProgress() const {
+    const auto& resourceLoading = m_impl->m_resourceLoading;
+    if (resourceLoading.totalSteps == 0) {
+        return 1.0f;
+    }
+    return float(resourceLoading.finishedSteps) / resourceLoading.totalSteps;
+}
+
+
+void
+Engine::setLoadProgressCallback(
+    LoadProgressCallback callback
+) {
+    m_impl->m_serialization.loadProgressCallback = std::move(callback);
+}
+
+
+void
+Engine::save(
+    std::string filename,
+    SaveCallback callback
+) {
+    m_impl->m_serialization.isIncrementalSave = false;
+    m_impl->m_serialization.saveFile = filename;
+    m_impl->m_serialization.saveCallback = std::move(callback);
+}
+
+
+void
+Engine::saveIncremental(
+    std::string filename,
+    SaveCallback callback
+) {
+    m_impl->m_serialization.isIncrementalSave = true;
     m_impl->m_serialization.saveFile = filename;
+    m_impl->m_serialization.saveCallback = std::move(callback);
 }
 
 
@@ -577,15 +2556,105 @@ Engine::setCurrentGameState(
 }
 
 
+void
+Engine::setScriptWatching(
+    bool enabled
+) {
+    m_impl->m_scriptWatch.isEnabled = enabled;
+    m_impl->m_scriptWatch.elapsed = 0;
+}
+
+
+void
+Engine::setTextureMipBias(
+    unsigned int levels
+) {
+    m_impl->m_graphics.packArchiveFactory.setMipBias(levels);
+}
+
+
+void
+Engine::sharePrototype(
+    const std::string& name,
+    const EntityPrototype& prototype
+) {
+    auto& dataSharing = m_impl->m_dataSharing;
+    if (dataSharing.file.empty()) {
+        return;
+    }
+    dataSharing.writer.addPrototype(name, prototype);
+    if (not dataSharing.data or not dataSharing.data->hasPrototype(name)) {
+        dataSharing.isStale = true;
+    }
+}
+
+
+const SharedData*
+Engine::sharedData() const {
+    return m_impl->m_dataSharing.data.get();
+}
+
+
 void
 Engine::shutdown() {
+    m_impl->finishSaves(true);
+    m_impl->finishPrewarms();
+    m_impl->writeSharedData(SCRIPT_DIRECTORY, SCRIPT_CACHE_DIRECTORY);
+    m_impl->m_backgroundGameStates.clear();
     for (const auto& pair : m_impl->m_gameStates) {
         const auto& gameState = pair.second;
         gameState->shutdown();
     }
+    m_impl->m_idleTasks.clear();
+    m_impl->m_luaTasks.clear();
     m_impl->shutdownInputManager();
-    m_impl->m_graphics.renderWindow->destroy();
-    m_impl->m_graphics.root.reset();
+    m_impl->m_inputRecording.player.reset();
+    m_impl->m_inputRecording.recorder.reset();
+    m_impl->m_telemetry.stop();
+    if (m_impl->m_graphics.root) {
+        saveGpuProgramCache(SHADER_CACHE_DIRECTORY);
+        releaseColourMaterials();
+        m_impl->m_graphics.renderWindow->destroy();
+        m_impl->m_graphics.root.reset();
+    }
+    // Later messages, e.g. from destructors, are written right away
+    Logger::instance().stop();
+}
+
+
+const std::vector<Engine::StartupPhase>&
+Engine::startupPhases() const {
+    return m_impl->m_startupPhases;
+}
+
+
+const std::string&
+Engine::stateHashFile() const {
+    return m_impl->m_stateHashing.file;
+}
+
+
+Statistics&
+Engine::statistics() {
+    return m_impl->m_statistics;
+}
+
+
+ThreadPool&
+Engine::threadPool() {
+    return m_impl->m_threadPool;
+}
+
+
+TelemetryServer&
+Engine::telemetry() {
+    return m_impl->m_telemetry;
+}
+
+
+Tracer&
+Engine::tracer() {
+    return m_impl->m_tracer;
 }
 
 
@@ -593,23 +2662,136 @@ void
 Engine::update(
     int milliseconds
 ) {
+    Tracer::Zone zone(&m_impl->m_tracer, "Engine::update");
+    auto frameStart = boost::chrono::steady_clock::now();
+    m_impl->beginBudgetFrame();
+    FrameBudgets& budgets = m_impl->m_budgets;
+    m_impl->finishSaves(false);
     if (not m_impl->m_serialization.saveFile.empty()) {
         m_impl->saveSavegame();
     }
-    Ogre::WindowEventUtilities::messagePump();
+    if (not m_impl->m_isHeadless) {
+        Ogre::WindowEventUtilities::messagePump();
+    }
+    const auto& resourceLoading = m_impl->m_resourceLoading;
+    if (
+        not resourceLoading.groups.empty() or
+        not resourceLoading.isWarmedUp or
+        (not m_impl->m_isHeadless and m_impl->m_materialWarmup.hasPending())
+    ) {
+        m_impl->updateResourceLoading();
+    }
     if (m_impl->quitRequested()) {
         Game::instance().quit();
     }
-    m_impl->m_input.keyboard.update();
-    m_impl->m_input.mouse.update();
+    auto& inputRecording = m_impl->m_inputRecording;
+    if (inputRecording.player) {
+        PhaseTimer inputTimer(budgets, "input");
+        InputFrame frame;
+        if (not inputRecording.player->next(frame)) {
+            Game::instance().quit();
+            return;
+        }
+        milliseconds = frame.milliseconds;
+        m_impl->m_input.keyboard.replayFrame(frame);
+        m_impl->m_input.mouse.replayFrame(frame);
+    }
+    else {
+        PhaseTimer inputTimer(budgets, "input");
+        m_impl->m_input.keyboard.update();
+        m_impl->m_input.mouse.update();
+        if (inputRecording.recorder) {
+            InputFrame frame;
+            frame.milliseconds = milliseconds;
+            m_impl->m_input.keyboard.recordFrame(frame);
+            m_impl->m_input.mouse.recordFrame(frame);
+            inputRecording.recorder->write(frame);
+        }
+    }
+    auto& scriptWatch = m_impl->m_scriptWatch;
+    if (m_impl->m_input.keyboard.wasKeyPressed(OIS::KC_F5)) {
+        scriptWatch.reloadRequested = true;
+    }
+    if (m_impl->m_input.keyboard.wasKeyPressed(OIS::KC_F8)) {
+        m_impl->toggleTracing();
+    }
+    if (scriptWatch.isEnabled and not scriptWatch.reloadRequested) {
+        scriptWatch.elapsed += milliseconds;
+        if (scriptWatch.elapsed >= SCRIPT_WATCH_INTERVAL) {
+            scriptWatch.elapsed = 0;
+            scriptWatch.reloadRequested = m_impl->haveScriptsChanged();
+        }
+    }
+    if (scriptWatch.reloadRequested) {
+        scriptWatch.reloadRequested = false;
+        m_impl->reloadScripts();
+    }
     if (m_impl->m_nextGameState) {
         m_impl->activateGameState(m_impl->m_nextGameState);
         m_impl->m_nextGameState = nullptr;
     }
+    m_impl->updatePrewarms();
     assert(m_impl->m_currentGameState != nullptr);
-    m_impl->m_currentGameState->update(milliseconds);
+    {
+        PhaseTimer gameStateTimer(budgets, "gameState");
+        m_impl->updateGameStates(milliseconds);
+    }
+    {
+        Tracer::Zone tasksZone(&m_impl->m_tracer, "luaTasks.update");
+        PhaseTimer tasksTimer(budgets, "luaTasks");
+        m_impl->m_luaTasks.update();
+    }
+    // Collect the garbage of this frame's scripts before the next one
+    {
+        Tracer::Zone gcZone(&m_impl->m_tracer, "garbageCollector.step");
+        PhaseTimer gcTimer(budgets, "garbageCollector");
+        m_impl->m_garbageCollector.step();
+    }
+    Statistics& statistics = m_impl->m_statistics;
+    statistics.record("lua.gcStep", m_impl->m_garbageCollector.lastStepTime() / 1000.0);
+    statistics.set("lua.tasks", m_impl->m_luaTasks.count());
+    statistics.set("gameStates.background", m_impl->m_backgroundGameStates.size());
     if (not m_impl->m_serialization.loadFile.empty()) {
         m_impl->loadSavegame();
     }
+    statistics.set(
+        "entities.alive",
+        m_impl->m_currentGameState->entityManager().entityCount()
+    );
+    m_impl->m_allocationTracker.endFrame();
+    if (AllocationTracker::isAvailable()) {
+        AllocationTracker::Counts allocations = m_impl->m_allocationTracker.frameCounts();
+        statistics.set("allocations.frame", allocations.allocations);
+        statistics.set("allocations.frameBytes", allocations.bytes);
+    }
+    statistics.update(milliseconds);
+    if (m_impl->m_telemetry.isRunning()) {
+        Tracer::Zone telemetryZone(&m_impl->m_tracer, "telemetry.update");
+        m_impl->m_telemetry.update(
+            milliseconds,
+            [this] (JsonWriter& writer) {
+                m_impl->writeTelemetry(writer);
+            }
+        );
+    }
+    m_impl->endBudgetFrame(frameStart);
+    m_impl->m_frameArena.reset();
+}
+
+
+
+void
+Engine::useSharedData(
+    std::string filename
+) {
+    m_impl->m_dataSharing.file = filename;
 }
 
+
+void
+Engine::verifyStateHashes(
+    std::string filename
+) {
+    m_impl->m_stateHashing.file = std::move(filename);
+    m_impl->m_stateHashing.isVerifying = true;
+}
@@ -3,7 +3,9 @@
 #include "engine/game_state.h"
 #include "engine/typedefs.h"
 
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 class btDiscreteDynamicsWorld;
@@ -26,14 +28,29 @@ namespace OIS {
 
 namespace thrive {
 
+class AllocationTracker;
 class ComponentFactory;
 class EntityManager;
+class EntityPrototype;
+class FrameArena;
+class FrameBudgets;
+class IdleTasks;
 class Keyboard;
+class LuaGarbageCollector;
+class LuaProfiler;
+class LuaTasks;
+class MaterialWarmup;
+struct MemoryStats;
 class Mouse;
 class OgreViewportSystem;
 class CollisionSystem;
+class Statistics;
 class System;
+class TelemetryServer;
+class Tracer;
 class RNG;
+class SharedData;
+class ThreadPool;
 
 /**
 * @brief The heart of the game
@@ -46,19 +63,84 @@ class Engine {
 
 public:
 
+    /**
+    * @brief Called when a savegame has been written
+    *
+    * Receives whether saving succeeded and, if not, an error message.
+    */
+    using SaveCallback = std::function<void(bool, const std::string&)>;
+
+    /**
+    * @brief Called while a savegame is being loaded
+    *
+    * Receives the approximate fraction of the savegame loaded so far.
+    */
+    using LoadProgressCallback = std::function<void(float)>;
+
+    /**
+    * @brief How long a phase of init() took
+    *
+    * See startupPhases().
+    */
+    struct StartupPhase {
+
+        /**
+        * @brief The phase's name
+        */
+        std::string name;
+
+        /**
+        * @brief When the phase started, in milliseconds after init() was 
+        * called
+        */
+        double start = 0.0;
+
+        /**
+        * @brief How long the phase took, in milliseconds
+        */
+        double duration = 0.0;
+
+    };
+
     /**
     * @brief Lua bindings
     *
     * Exposes:
-    * - Engine::createGameState()
+    * - Engine::addBackgroundGameState()
+    * - Engine::createGameState() (with an optional table of 
+    *   GameState::Options, e.g. <tt>{multithreadedPhysics = true}</tt>)
     * - Engine::currentGameState()
+    * - Engine::isBackgroundGameState()
+    * - Engine::removeBackgroundGameState()
     * - Engine::getGameState()
     * - Engine::setCurrentGameState()
+    * - Engine::prewarmGameState()
     * - Engine::load()
-    * - Engine::save()
+    * - Engine::loadSharedPrototype()
+    * - Engine::sharePrototype()
+    * - Engine::save() (with an optional Lua function as callback)
+    * - Engine::saveIncremental() (with an optional Lua function as callback)
+    * - Engine::reloadScripts()
+    * - Engine::setScriptWatching()
+    * - Engine::isHeadless()
+    * - Engine::isLoadingResources()
+    * - Engine::isResourceGroupLoaded()
+    * - Engine::resourceLoadProgress()
+    * - Engine::stateHashFile()
+    * - Engine::memoryStats()
+    * - Engine::allocationTracker() (as property)
+    * - Engine::budgets() (as property)
     * - Engine::componentFactory() (as property)
+    * - Engine::garbageCollector() (as property)
+    * - Engine::idleTasks() (as property)
     * - Engine::keyboard() (as property)
+    * - Engine::luaTasks() (as property)
+    * - Engine::materialWarmup() (as property)
     * - Engine::mouse() (as property)
+    * - Engine::profiler() (as property)
+    * - Engine::statistics() (as property)
+    * - Engine::telemetry() (as property)
+    * - Engine::tracer() (as property)
     *
     * @return
     */
@@ -101,6 +183,9 @@ public:
     * @param initializer
     *   The initialization function for the game state
     *
+    * @param options
+    *   Creation options, like the physics world's configuration
+    *
     * @return
     *   The new game state. Will never be \c null. It is returned as a pointer
     *   as a convenience for Lua bindings, which don't handle references well.
@@ -109,7 +194,8 @@ public:
     createGameState(
         std::string name,
         std::vector<std::unique_ptr<System>> systems,
-        GameState::Initializer initializer
+        GameState::Initializer initializer,
+        const GameState::Options& options = GameState::Options()
     );
 
     /**
@@ -121,6 +207,95 @@ public:
     GameState*
     currentGameState() const;
 
+    /**
+    * @brief Updates a game state every frame, besides the current one
+    *
+    * For extra simulated environments or lookahead worlds. Background 
+    * game states are updated with the same frame time as the current 
+    * game state. Each one that has no main thread only system (see 
+    * System::isMainThreadOnly()) is updated as a job on the thread pool,
+    * in parallel with the current game state and the other background 
+    * game states. The others, like game states with Lua systems, are 
+    * updated on the main thread after the current game state. Creation 
+    * jobs and event handlers of a game state updated on the thread pool
+    * must not call into Lua.
+    *
+    * The game state is initialized and activated unless it already is.
+    * Reloading the scripts or loading a savegame removes all background
+    * game states.
+    *
+    * @param gameState
+    *   The game state to update. Must be headless (see 
+    *   GameState::isHeadless()) and not current.
+    *
+    * @throws std::invalid_argument
+    *   If \a gameState is \c null, current or not headless
+    */
+    void
+    addBackgroundGameState(
+        GameState* gameState
+    );
+
+    /**
+    * @brief The game states added with addBackgroundGameState()
+    */
+    const std::vector<GameState*>&
+    backgroundGameStates() const;
+
+    /**
+    * @brief Whether a game state is updated in the background
+    *
+    * @param gameState
+    */
+    bool
+    isBackgroundGameState(
+        GameState* gameState
+    ) const;
+
+    /**
+    * @brief Stops updating a background game state and deactivates it
+    *
+    * Does nothing if \a gameState isn't a background game state.
+    *
+    * @param gameState
+    */
+    void
+    removeBackgroundGameState(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Counts the allocations of each frame and system
+    *
+    * Only counts in builds with \c THRIVE_TRACK_ALLOCATIONS, see 
+    * AllocationTracker.
+    */
+    AllocationTracker&
+    allocationTracker();
+
+    /**
+    * @brief Time budgets for systems and frame phases
+    */
+    FrameBudgets&
+    budgets();
+
+    /**
+    * @brief Scratch memory for the current frame
+    *
+    * Reset at the end of each update().
+    */
+    FrameArena&
+    frameArena();
+
+
+    /**
+    * @brief Controls the Lua garbage collector
+    *
+    * The engine calls LuaGarbageCollector::step() at the end of each frame
+    * and LuaGarbageCollector::idleStep() between frames.
+    */
+    LuaGarbageCollector&
+    garbageCollector();
 
     /**
     * @brief The engine's RNG
@@ -129,6 +304,18 @@ public:
     RNG&
     rng();
 
+    /**
+    * @brief The directory compiled scripts are cached in, see ScriptCache
+    */
+    std::string
+    scriptCacheDirectory() const;
+
+    /**
+    * @brief The directory the scripts are loaded from
+    */
+    std::string
+    scriptDirectory() const;
+
     /**
     * @brief Retrieves a game state
     *
@@ -144,15 +331,110 @@ public:
         const std::string& name
     ) const;
 
+    /**
+    * @brief Low-priority work for the time left over between frames
+    *
+    * Game::run() runs the tasks while it waits for the next frame. The
+    * engine registers incremental Lua garbage collection (see 
+    * LuaGarbageCollector::idleStep()), the sorting of the current game
+    * state's component storage (see EntityManager::compactStep()) and the
+    * warm-up of materials queued after the background resource loading 
+    * (see materialWarmup()).
+    */
+    IdleTasks&
+    idleTasks();
+
+    /**
+    * @brief Lua coroutines that span several frames
+    *
+    * The engine resumes them after the current game state's update and
+    * cancels them when the scripts are reloaded.
+    */
+    LuaTasks&
+    luaTasks();
+
     /**
     * @brief Initializes the engine
     *
     * This sets up basic data structures for the different engine parts
     * (input, graphics, physics, etc.) and then calls System::init() on
     * all systems.
+    *
+    * Of the resource groups in \c resources.cfg, only the \c General 
+    * group's scripts are parsed before the game states are initialised. 
+    * All resources are then loaded by Ogre's background resource queue, 
+    * see resourceLoadProgress().
+    *
+    * Independent phases run concurrently on the thread pool: the Lua
+    * state is set up and the scripts are compiled while the main thread
+    * sets up Ogre. The scripts then run on the main thread. Of the game 
+    * states they create, only the one they make current is initialised, 
+    * the others are initialised when they first become current or are 
+    * prewarmed, see prewarmGameState(). How long each phase took is 
+    * printed at the end and kept in startupPhases().
+    *
+    * @param headless
+    *   If \c true, no display is needed: the engine creates no Ogre root,
+    *   render window or input devices, loads no resources and leaves the
+    *   graphical systems out of its game states (see 
+    *   System::declareGraphical()). No keys or mouse buttons are ever 
+    *   pressed.
     */
     void
-    init();
+    init(
+        bool headless = false
+    );
+
+    /**
+    * @brief Initializes a game state without making it current
+    *
+    * The engine does this itself when a game state first becomes current
+    * or is prewarmed. Tools that update a game state's systems on their
+    * own, like the physics benchmark, call this instead of init(), which
+    * needs the scripts. Does nothing if the game state is already
+    * initialized.
+    */
+    void
+    initGameState(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Whether the engine was initialized without graphics and input
+    *
+    * See init().
+    */
+    bool
+    isHeadless() const;
+
+    /**
+    * @brief Whether resource groups are still loading in the background
+    *
+    * See resourceLoadProgress().
+    */
+    bool
+    isLoadingResources() const;
+
+    /**
+    * @brief Whether a resource group has been loaded completely
+    *
+    * Resources that are used before their group has been loaded are 
+    * loaded on first use as usual, which may stall a frame.
+    *
+    * @param groupName
+    *   The group's name, as in \c resources.cfg
+    */
+    bool
+    isResourceGroupLoaded(
+        const std::string& groupName
+    ) const;
+
+    /**
+    * @brief Whether stateHashFile() is compared with, see
+    * verifyStateHashes()
+    */
+    bool
+    isVerifyingStateHashes() const;
 
     /**
     * @brief The engine's input manager
@@ -170,6 +452,11 @@ public:
     /**
     * @brief Loads a savegame
     *
+    * The savegame is loaded at the end of the current frame. Game states
+    * are parsed and restored one at a time, see setLoadProgressCallback().
+    * Incremental saves on top of the file are applied, see 
+    * saveIncremental().
+    *
     * @param filename
     *   The file to load
     */
@@ -178,12 +465,56 @@ public:
         std::string filename
     );
 
+    /**
+    * @brief Loads a prototype from the shared data
+    *
+    * For setups that would otherwise build the prototype, see
+    * sharePrototype().
+    *
+    * @param name
+    *   The name the prototype was shared under
+    * @param prototype
+    *   Receives the prototype's components
+    *
+    * @return
+    *   \c false if there is no shared data or it lacks the prototype
+    */
+    bool
+    loadSharedPrototype(
+        const std::string& name,
+        EntityPrototype& prototype
+    ) const;
+
     /**
     * @brief The script engine's Lua state
     */
     lua_State*
     luaState();
 
+    /**
+    * @brief The materials compiled before they are first rendered
+    *
+    * The warm-up runs as the last step of the background resource 
+    * loading, see resourceLoadProgress(). After that, whatever is queued
+    * is warmed up in idle time (see idleTasks()), or at the start of the
+    * next frame if there was none. The meshes of all 
+    * agent types registered by the scripts are queued by init().
+    *
+    * Compiled GPU programs are cached across runs in 
+    * <tt>../shader_cache</tt>, see loadGpuProgramCache().
+    */
+    MaterialWarmup&
+    materialWarmup();
+
+    /**
+    * @brief Counts the memory used by components, Bullet, Ogre and Lua
+    *
+    * Walks all game states' component collections, physics worlds and
+    * scene managers, so it is too slow to call every frame.
+    */
+    MemoryStats
+    memoryStats() const;
+
     /**
     * @brief Returns the mouse interface
     *
@@ -193,25 +524,200 @@ public:
 
     /**
     * @brief The Ogre root object
+    *
+    * \c nullptr in headless engines
     */
     Ogre::Root*
     ogreRoot() const;
 
+    /**
+    * @brief Takes pending input events between frames
+    *
+    * Called by Game::run() while waiting for the next frame, so key 
+    * events carry when they arrived (see Keyboard::KeyEvent::delay). Does
+    * nothing while replaying an input recording.
+    */
+    void
+    pollInput();
+
+    /**
+    * @brief Initializes a game state ahead of its first use
+    *
+    * Its physics world is built on the thread pool right away. The rest
+    * of the initialization runs on the main thread, at the start of a 
+    * later frame, as it creates the scene manager and calls into the 
+    * scripts. Prewarmed game states are initialized one per frame.
+    *
+    * Does nothing if the game state is already initialized or prewarming.
+    *
+    * @param gameState
+    *   The game state to initialize
+    */
+    void
+    prewarmGameState(
+        GameState* gameState
+    );
+
+    /**
+    * @brief The profiler for the engine's Lua state
+    */
+    LuaProfiler&
+    profiler();
+
+    /**
+    * @brief Records the session's input to a file
+    *
+    * Must be called before init(). The RNG is then seeded with a fresh
+    * seed, and the seed and each frame's keyboard and mouse input and
+    * duration are written to \a filename, see InputRecorder. 
+    * replayInput() plays the session back.
+    *
+    * @param filename
+    */
+    void
+    recordInput(
+        std::string filename
+    );
+
+    /**
+    * @brief Records the state hashes of each tick to files
+    *
+    * Each game state with a StateHashSystem writes the hashes of its ticks
+    * to \a filename with a dot and the game state's name appended.
+    * verifyStateHashes() compares a later session with them.
+    *
+    * Must be called before the game states are initialized.
+    *
+    * @param filename
+    */
+    void
+    recordStateHashes(
+        std::string filename
+    );
+
+    /**
+    * @brief How much of the background resource loading is done
+    *
+    * Suitable for a splash screen's progress bar. As the background queue
+    * works through whole resource groups, the progress advances in steps.
+    * Background requests are polled once per frame in update(). The last
+    * step is the material warm-up, see materialWarmup().
+    *
+    * @return
+    *   A value between \c 0 and \c 1, which is \c 1 when all resource 
+    *   groups have been loaded
+    */
+    float
+    resourceLoadProgress() const;
+
+    /**
+    * @brief Reruns all scripts
+    *
+    * At the beginning of the next frame, all game states are shut down and
+    * the scripts are loaded again, which recreates the game states. The
+    * entities of each game state are restored from a snapshot, as if the
+    * game had been saved and loaded, so they pick up the changed component
+    * classes. The game state that was current stays current.
+    *
+    * Pressing F5 has the same effect.
+    */
+    void
+    reloadScripts();
+
+    /**
+    * @brief Replays the input of a recorded session
+    *
+    * Must be called before init(). The RNG is seeded with the recorded
+    * seed, and each update() takes its keyboard and mouse input and frame
+    * duration from the recording instead of the devices and its argument.
+    * When the recording ends, the game quits.
+    *
+    * Replays are deterministic as long as the session's outcome only 
+    * depends on the RNG, the input and the frame durations. Script 
+    * watching (see setScriptWatching()) and real-time callbacks like 
+    * those of savegames can still make a replay diverge.
+    *
+    * @param filename
+    *   A file written after recordInput()
+    *
+    * @throw std::runtime_error
+    *   From init(), if the file is not an input recording
+    */
+    void
+    replayInput(
+        std::string filename
+    );
+
     /**
     * @brief Creates a savegame
     *
+    * At the beginning of the next frame, the engine takes a snapshot of all
+    * game states. Encoding the snapshot and writing the file happen in the
+    * background, while the game continues. Saves are written in the order
+    * they were requested, and loading a savegame waits for pending saves.
+    *
+    * The file is first written under a temporary name and then renamed, so
+    * a failed save leaves an existing file intact. Savegames are compressed,
+    * see writeCompressed(). load() also reads uncompressed ones.
+    *
     * @param filename
     *   The file to save
+    * @param callback
+    *   If not empty, called on the main thread at the beginning of the
+    *   first frame after the file has been written
     */
     void
     save(
-        std::string filename
+        std::string filename,
+        SaveCallback callback = SaveCallback()
+    );
+
+    /**
+    * @brief Creates a small savegame holding only the changes since the last one
+    *
+    * Like save(), but if the last savegame written or loaded was \a filename,
+    * only the components and properties that changed since then are written,
+    * into \a filename followed by \c ".delta" and a running number. 
+    * Otherwise, and after every tenth incremental save, this writes a full
+    * savegame, which removes the old incremental saves.
+    *
+    * To find the changes, the engine keeps the last snapshot in memory from
+    * the first incremental save on. Incremental saves use a faster
+    * compression level than full savegames.
+    *
+    * load() applies the incremental saves of \a filename in order.
+    *
+    * @param filename
+    *   The file of the full savegame
+    * @param callback
+    *   See save()
+    */
+    void
+    saveIncremental(
+        std::string filename,
+        SaveCallback callback = SaveCallback()
+    );
+
+    /**
+    * @brief Sets a function to report loading progress to
+    *
+    * The function is called on the main thread after each restored game
+    * state and once more with \c 1 when loading is done. It may render a 
+    * frame of a loading screen.
+    *
+    * @param callback
+    *   The function to call, or an empty function for none
+    */
+    void
+    setLoadProgressCallback(
+        LoadProgressCallback callback
     );
 
     /**
     * @brief Sets the current game state
     *
     * The game state will be activated at the beginning of the next frame.
+    * If it hasn't been initialized yet, that happens first.
     *
     * \a gameState must not be \c null. It's passed by pointer as a 
     * convenience for the Lua bindings (which can't handle references well).
@@ -224,6 +730,63 @@ public:
         GameState* gameState
     );
 
+    /**
+    * @brief Whether to reload the scripts when one of them changes
+    *
+    * While enabled, the engine checks the modification times of the loaded
+    * scripts twice per second and calls reloadScripts() if any of them
+    * changed. Scripts newly added to a manifest are only picked up by a
+    * reload.
+    *
+    * @param enabled
+    */
+    void
+    setScriptWatching(
+        bool enabled
+    );
+
+    /**
+    * @brief Loads packed textures at a lower resolution
+    *
+    * Must be called before init(). DDS textures in ThrivePack resource
+    * locations (see PackArchive) are loaded without their \a levels
+    * largest mip levels, each of which quarters their memory. Textures
+    * from plain directories are not affected.
+    *
+    * @param levels
+    *   The number of mip levels to drop
+    */
+    void
+    setTextureMipBias(
+        unsigned int levels
+    );
+
+    /**
+    * @brief Adds a prototype to the shared data
+    *
+    * The prototype is written with the next shared data file, so later
+    * engines load it with loadSharedPrototype() instead of building it.
+    * Does nothing without useSharedData().
+    *
+    * @param name
+    *   A name unique among all game states
+    * @param prototype
+    */
+    void
+    sharePrototype(
+        const std::string& name,
+        const EntityPrototype& prototype
+    );
+
+    /**
+    * @brief The shared data opened by init()
+    *
+    * @return
+    *   \c null if there is none, see useSharedData()
+    */
+    const SharedData*
+    sharedData() const;
+
     /**
     * @brief Shuts the engine down
     *
@@ -233,6 +796,60 @@ public:
     void
     shutdown();
 
+    /**
+    * @brief The phases of the last init(), in the order they were 
+    * recorded
+    *
+    * Phases that ran concurrently overlap, compare their 
+    * StartupPhase::start.
+    */
+    const std::vector<StartupPhase>&
+    startupPhases() const;
+
+    /**
+    * @brief The file set with recordStateHashes() or verifyStateHashes()
+    *
+    * Empty if there is none
+    */
+    const std::string&
+    stateHashFile() const;
+
+    /**
+    * @brief Runtime statistics that any subsystem can publish into
+    *
+    * The engine publishes the number of live entities, Lua garbage
+    * collector steps and savegame timings and updates the statistics at the
+    * end of each frame.
+    */
+    Statistics&
+    statistics();
+
+    /**
+    * @brief Streams the statistics, system timings, entity counts and
+    * memory usage to clients on a socket
+    *
+    * Not running unless started, e.g. with \c --telemetry. Besides the
+    * server's own commands, clients can send <tt>trace start</tt>,
+    * <tt>trace stop</tt> and <tt>profiler on|counters|off|reset</tt>.
+    */
+    TelemetryServer&
+    telemetry();
+
+    /**
+    * @brief The thread pool shared by all game states
+    */
+    ThreadPool&
+    threadPool();
+
+    /**
+    * @brief Records a timeline of the engine's work
+    *
+    * F8 starts tracing and, when pressed again, writes the trace to
+    * \c trace.json in the working directory.
+    */
+    Tracer&
+    tracer();
+
     /**
     * @brief Renders a single frame
     *
@@ -247,8 +864,48 @@ public:
         int milliseconds
     );
 
+    /**
+    * @brief Shares compiled scripts and prototypes with other engines
+    *
+    * Must be called before init(), which maps \a filename read-only if it
+    * exists, see SharedData. Scripts are then loaded from it and the
+    * scripts' setup can load prototypes with loadSharedPrototype(). Engine
+    * processes on the same machine share the file's pages.
+    *
+    * If the file is missing, or lacks the current version of a script or a
+    * prototype passed to sharePrototype(), init() writes a new one. So
+    * does shutdown() for prototypes shared after init(). Processes that
+    * have the previous file mapped keep using it. The scripts can also be
+    * packed offline, see the \c PrecompileScripts tool.
+    *
+    * @param filename
+    */
+    void
+    useSharedData(
+        std::string filename
+    );
+
+    /**
+    * @brief Compares the state hashes of each tick with recorded ones
+    *
+    * Each game state with a StateHashSystem compares the hashes of its
+    * ticks with a file written after recordStateHashes(), and warns about
+    * the first tick that differs. Meant for replays, see replayInput().
+    *
+    * Must be called before the game states are initialized.
+    *
+    * @param filename
+    *   The file passed to recordStateHashes()
+    */
+    void
+    verifyStateHashes(
+        std::string filename
+    );
+
     /**
     * @brief The render window
+    *
+    * \c nullptr in headless engines
     */
     Ogre::RenderWindow*
     renderWindow() const;
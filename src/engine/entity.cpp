@@ -1,5 +1,6 @@
 #include "engine/entity.h"
 
+#include "engine/component_factory.h"
 #include "engine/engine.h"
 #include "engine/entity_manager.h"
 #include "engine/game_state.h"
@@ -8,38 +9,90 @@
 
 #include <luabind/operator.hpp>
 #include <luabind/adopt_policy.hpp>
+#include <luabind/iterator_policy.hpp>
 
 using namespace thrive;
 
 
-struct Entity::Implementation {
-
-    Implementation(
-        EntityId id,
-        EntityManager* manager
-    ) : m_id(id),
-        m_entityManager(manager)
-    {
-    }
-
-    EntityId m_id = NULL_ENTITY;
+static void
+Entity_addComponent(
+    Entity* self,
+    Component* nakedComponent
+) {
+    self->addComponent(
+        std::unique_ptr<Component>(nakedComponent)
+    );
+}
 
-    EntityManager* m_entityManager = nullptr;
 
-};
+static void
+Entity_addTag(
+    Entity* self,
+    const std::string& tag
+) {
+    self->addTag(ComponentFactory::registerTag(tag));
+}
 
 
 static void
-Entity_addComponent(
+Entity_deferAddComponent(
     Entity* self,
     Component* nakedComponent
 ) {
-    self->addComponent(
+    self->deferAddComponent(
         std::unique_ptr<Component>(nakedComponent)
     );
 }
 
 
+static luabind::object
+Entity_getComponentsInto(
+    Entity* self,
+    const luabind::object& typeIds,
+    luabind::object components
+) {
+    for (luabind::iterator iter(typeIds), end; iter != end; ++iter) {
+        ComponentTypeId typeId = luabind::object_cast<ComponentTypeId>(*iter);
+        Component* component = self->getComponent(typeId);
+        if (component) {
+            components[iter.key()] = component;
+        }
+    }
+    return components;
+}
+
+
+static luabind::object
+Entity_getComponents(
+    Entity* self,
+    const luabind::object& typeIds
+) {
+    return Entity_getComponentsInto(
+        self,
+        typeIds,
+        luabind::newtable(typeIds.interpreter())
+    );
+}
+
+
+static bool
+Entity_hasTag(
+    Entity* self,
+    const std::string& tag
+) {
+    return self->hasTag(ComponentFactory::registerTag(tag));
+}
+
+
+static void
+Entity_removeTag(
+    Entity* self,
+    const std::string& tag
+) {
+    self->removeTag(ComponentFactory::registerTag(tag));
+}
+
+
 luabind::scope
 Entity::luaBindings() {
     using namespace luabind;
@@ -52,11 +105,17 @@ Entity::luaBindings() {
         .def(constructor<const std::string&, GameState*>())
         .def(const_self == other<Entity>())
         .def("addComponent", &Entity_addComponent, adopt(_2))
+        .def("addTag", &Entity_addTag)
+        .def("deferAddComponent", &Entity_deferAddComponent, adopt(_2))
         .def("destroy", &Entity::destroy)
         .def("exists", &Entity::exists)
         .def("getComponent", &Entity::getComponent)
+        .def("getComponents", &Entity_getComponents)
+        .def("getComponents", &Entity_getComponentsInto)
+        .def("hasTag", &Entity_hasTag)
         .def("isVolatile", &Entity::isVolatile)
         .def("removeComponent", &Entity::removeComponent)
+        .def("removeTag", &Entity_removeTag)
         .def("setVolatile", &Entity::setVolatile)
         .property("id", &Entity::id)
     ;
@@ -86,7 +145,8 @@ Entity::Entity(
 Entity::Entity(
     EntityId id,
     GameState* gameState
-) : m_impl(new Implementation(id, &getEntityManager(gameState)))
+) : m_id(id),
+    m_entityManager(&getEntityManager(gameState))
 {
 }
 
@@ -101,7 +161,8 @@ Entity::Entity(
 
 Entity::Entity(
     const Entity& other
-) : m_impl(new Implementation(other.m_impl->m_id, other.m_impl->m_entityManager))
+) : m_id(other.m_id),
+    m_entityManager(other.m_entityManager)
 {
 }
 
@@ -114,8 +175,8 @@ Entity::operator == (
     const Entity& other
 ) const {
     return
-        (m_impl->m_entityManager == other.m_impl->m_entityManager) and
-        (m_impl->m_id == other.m_impl->m_id)
+        (m_entityManager == other.m_entityManager) and
+        (m_id == other.m_id)
     ;
 }
 
@@ -125,8 +186,8 @@ Entity::operator = (
     const Entity& other
 ) {
     if (this != &other) {
-        m_impl->m_id = other.m_impl->m_id;
-        m_impl->m_entityManager = other.m_impl->m_entityManager;
+        m_id = other.m_id;
+        m_entityManager = other.m_entityManager;
     }
     return *this;
 }
@@ -136,8 +197,27 @@ void
 Entity::addComponent(
     std::unique_ptr<Component> component
 ) {
-    m_impl->m_entityManager->addComponent(
-        m_impl->m_id,
+    m_entityManager->addComponent(
+        m_id,
+        std::move(component)
+    );
+}
+
+
+void
+Entity::addTag(
+    ComponentTypeId tagId
+) {
+    m_entityManager->addTag(m_id, tagId);
+}
+
+
+void
+Entity::deferAddComponent(
+    std::unique_ptr<Component> component
+) {
+    m_entityManager->deferAddComponent(
+        m_id,
         std::move(component)
     );
 }
@@ -145,13 +225,13 @@ Entity::addComponent(
 
 void
 Entity::destroy() {
-    m_impl->m_entityManager->removeEntity(m_impl->m_id);
+    m_entityManager->removeEntity(m_id);
 }
 
 
 bool
 Entity::exists() const {
-    return m_impl->m_entityManager->exists(m_impl->m_id);
+    return m_entityManager->exists(m_id);
 }
 
 
@@ -159,8 +239,8 @@ Component*
 Entity::getComponent(
     ComponentTypeId typeId
 ) {
-    return m_impl->m_entityManager->getComponent(
-        m_impl->m_id,
+    return m_entityManager->getComponent(
+        m_id,
         typeId
     );
 }
@@ -170,23 +250,31 @@ bool
 Entity::hasComponent(
     ComponentTypeId typeId
 ) {
-    Component* component = m_impl->m_entityManager->getComponent(
-        m_impl->m_id,
+    Component* component = m_entityManager->getComponent(
+        m_id,
         typeId
     );
     return component != nullptr;
 }
 
 
+bool
+Entity::hasTag(
+    ComponentTypeId tagId
+) const {
+    return m_entityManager->hasTag(m_id, tagId);
+}
+
+
 EntityId
 Entity::id() const {
-    return m_impl->m_id;
+    return m_id;
 }
 
 
 bool
 Entity::isVolatile() const {
-    return m_impl->m_entityManager->isVolatile(m_impl->m_id);
+    return m_entityManager->isVolatile(m_id);
 }
 
 
@@ -194,16 +282,24 @@ void
 Entity::removeComponent(
     ComponentTypeId typeId
 ) {
-    m_impl->m_entityManager->removeComponent(
-        m_impl->m_id,
+    m_entityManager->removeComponent(
+        m_id,
         typeId
     );
 }
 
 
+void
+Entity::removeTag(
+    ComponentTypeId tagId
+) {
+    m_entityManager->removeTag(m_id, tagId);
+}
+
+
 void
 Entity::setVolatile(
     bool isVolatile
 ) {
-    m_impl->m_entityManager->setVolatile(m_impl->m_id, isVolatile);
+    m_entityManager->setVolatile(m_id, isVolatile);
 }
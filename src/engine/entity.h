@@ -11,6 +11,7 @@ class scope;
 
 namespace thrive {
 
+class EntityManager;
 class GameState;
 
 /**
@@ -38,8 +39,17 @@ public:
     *
     * Exposes the following \b functions:
     * - \c addComponent(Component): addComponent(std::unique_ptr<Component>)
+    * - \c addTag(string): addTag(ComponentTypeId) with the tag's name
+    * - \c deferAddComponent(Component): deferAddComponent(std::unique_ptr<Component>)
     * - \c getComponent(number): getComponent(ComponentTypeId)
+    * - \c getComponents(table): Fetches several components at once. Takes
+    *   a table of type ids and returns a table with the components under
+    *   the same keys. Keys of missing components are left out.
+    * - \c getComponents(table, table): Like \c getComponents(table), but
+    *   stores the components into the second table and returns it
+    * - \c hasTag(string): hasTag(ComponentTypeId) with the tag's name
     * - \c removeComponent(number): removeComponent(ComponentTypeId)
+    * - \c removeTag(string): removeTag(ComponentTypeId) with the tag's name
     *
     * Exposes the following \b operators:
     * - \c ==: operator==(const Entity&)
@@ -150,6 +160,34 @@ public:
         std::unique_ptr<Component> component
     );
 
+    /**
+    * @brief Tags this entity
+    *
+    * @param tagId
+    *   The tag, see ComponentFactory::registerTag()
+    *
+    * @see EntityManager::addTag()
+    */
+    void
+    addTag(
+        ComponentTypeId tagId
+    );
+
+    /**
+    * @brief Adds a component to this entity at the next sync point
+    *
+    * Use this instead of addComponent() while other systems may be 
+    * iterating over the affected entity filters.
+    *
+    * @param component
+    *
+    * @see EntityManager::deferAddComponent()
+    */
+    void
+    deferAddComponent(
+        std::unique_ptr<Component> component
+    );
+
     /**
     * @brief Removes all components of this entity
     */
@@ -198,6 +236,17 @@ public:
         ComponentTypeId typeId
     );
 
+    /**
+    * @brief Checks whether this entity has a tag
+    *
+    * @param tagId
+    *   The tag, see ComponentFactory::registerTag()
+    */
+    bool
+    hasTag(
+        ComponentTypeId tagId
+    ) const;
+
     /**
     * @brief The entity's id
     */
@@ -221,7 +270,7 @@ public:
     *
     * @note
     *   The component is only actually removed after the entity manager's
-    *   EntityManager::processRemovals() function is called.
+    *   EntityManager::processCommands() function is called.
     *
     * @param typeId
     *   The component's type id
@@ -231,6 +280,19 @@ public:
         ComponentTypeId typeId
     );
 
+    /**
+    * @brief Removes a tag at the next sync point
+    *
+    * @param tagId
+    *   The tag to remove
+    *
+    * @see EntityManager::removeTag()
+    */
+    void
+    removeTag(
+        ComponentTypeId tagId
+    );
+
     /**
     * @brief Sets the volatile flag
     *
@@ -245,8 +307,11 @@ public:
 
 private:
 
-    struct Implementation;
-    std::unique_ptr<Implementation> m_impl;
+    // Held directly, so that scripts creating entities in every update
+    // don't need a heap allocation besides the Lua object
+    EntityId m_id = NULL_ENTITY;
+
+    EntityManager* m_entityManager = nullptr;
 
 };
 
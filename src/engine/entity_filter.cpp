@@ -24,21 +24,18 @@ struct ComponentGroupBuilder {
         typename ExtractComponentType<ComponentTypes>::PointerType...
     >;
 
-    static bool 
+    static void
     build(
-        EntityManager* entityManager,
-        EntityId entityId,
+        const Archetype& archetype,
+        size_t row,
         ComponentGroup& group
     ) {
         using ComponentType = typename std::tuple_element<index, std::tuple<ComponentTypes...>>::type;
         using RawType = typename ExtractComponentType<ComponentType>::Type;
-        bool isRequired = IsRequired<ComponentType>::value;
-        RawType* component = entityManager->getComponent<RawType>(entityId);
-        if (isRequired and not component) {
-            return false;
-        }
-        std::get<index>(group) = component;
-        return ComponentGroupBuilder<index-1, ComponentTypes...>::build(entityManager, entityId, group);
+        std::get<index>(group) = static_cast<RawType*>(
+            archetype.component(RawType::TYPE_ID, row)
+        );
+        ComponentGroupBuilder<index-1, ComponentTypes...>::build(archetype, row, group);
     }
         
 };
@@ -47,183 +44,387 @@ struct ComponentGroupBuilder {
 template<typename... ComponentTypes>
 struct ComponentGroupBuilder<0, ComponentTypes...> {
 
-    static bool 
+    static void
     build(
-        EntityManager* entityManager,
-        EntityId entityId,
+        const Archetype& archetype,
+        size_t row,
         std::tuple<typename ExtractComponentType<ComponentTypes>::PointerType...>& group
     ) {
         using ComponentType = typename std::tuple_element<0, std::tuple<ComponentTypes...>>::type;
         using RawType = typename ExtractComponentType<ComponentType>::Type;
-        bool isRequired = IsRequired<ComponentType>::value;
-        RawType* component = entityManager->getComponent<RawType>(entityId);
-        if (isRequired and not component) {
-            return false;
-        }
-        std::get<0>(group) = component;
-        return true;
+        std::get<0>(group) = static_cast<RawType*>(
+            archetype.component(RawType::TYPE_ID, row)
+        );
     }
         
 };
 
-template<size_t tupleIndex>
-struct RegisterNextCallback {
-    
-    template<typename Filter>
-    static void registerNextCallback(
-        Filter& filter
+
+// Compares two component groups, telling apart required and optional
+// components
+template<size_t index, typename... ComponentTypes>
+struct ComponentGroupComparer {
+
+    using ComponentGroup = std::tuple<
+        typename ExtractComponentType<ComponentTypes>::PointerType...
+    >;
+
+    static void
+    compare(
+        const ComponentGroup& a,
+        const ComponentGroup& b,
+        bool& requiredChanged,
+        bool& optionalChanged
     ) {
-        // May the programming gods have mercy for the poor souls
-        // who will have to read this.
-        //
-        // This calls a template function called registerCallback
-        // on the filter object.
-        filter.template registerCallback<tupleIndex-1>();
+        using ComponentType = typename std::tuple_element<index, std::tuple<ComponentTypes...>>::type;
+        if (std::get<index>(a) != std::get<index>(b)) {
+            if (IsRequired<ComponentType>::value) {
+                requiredChanged = true;
+            }
+            else {
+                optionalChanged = true;
+            }
+        }
+        ComponentGroupComparer<index-1, ComponentTypes...>::compare(a, b, requiredChanged, optionalChanged);
     }
+
 };
 
-template<>
-struct RegisterNextCallback<0> {
 
-    template<typename Filter>
-    static void registerNextCallback(Filter&) {}
+template<typename... ComponentTypes>
+struct ComponentGroupComparer<0, ComponentTypes...> {
+
+    static void
+    compare(
+        const std::tuple<typename ExtractComponentType<ComponentTypes>::PointerType...>& a,
+        const std::tuple<typename ExtractComponentType<ComponentTypes>::PointerType...>& b,
+        bool& requiredChanged,
+        bool& optionalChanged
+    ) {
+        using ComponentType = typename std::tuple_element<0, std::tuple<ComponentTypes...>>::type;
+        if (std::get<0>(a) != std::get<0>(b)) {
+            if (IsRequired<ComponentType>::value) {
+                requiredChanged = true;
+            }
+            else {
+                optionalChanged = true;
+            }
+        }
+    }
+
 };
 
 } // namespace detail
 
 
 template<typename... ComponentTypes>
-struct EntityFilter<ComponentTypes...>::Implementation {
+struct EntityFilter<ComponentTypes...>::Implementation : public ArchetypeListener {
 
     Implementation(
         bool recordChanges
-    ) : m_recordChanges(recordChanges)
+    ) : m_isRequired{{detail::IsRequired<ComponentTypes>::value...}},
+        m_recordChanges(recordChanges),
+        m_typeIds{{detail::ExtractComponentType<ComponentTypes>::Type::TYPE_ID...}}
     {
+        for (size_t i = 0; i < sizeof...(ComponentTypes); ++i) {
+            if (m_isRequired[i]) {
+                m_requiredMask.set(m_typeIds[i]);
+            }
+            else {
+                m_optionalMask.set(m_typeIds[i]);
+            }
+        }
+    }
+
+    // What happened to an entity since the last takeChanges()
+    struct MoveState {
+
+        // Whether the entity was relevant before its first move
+        bool m_wasRelevant = false;
+
+        // Left the filter or had a required component replaced, so it has
+        // to be reported as removed and added again if it is relevant now
+        bool m_isReadded = false;
+
+        // Got an optional component or one replaced
+        bool m_isChanged = false;
+
+    };
+
+    ComponentGroup
+    buildGroup(
+        const Archetype& archetype,
+        size_t row
+    ) const {
+        ComponentGroup group;
+        detail::ComponentGroupBuilder<sizeof...(ComponentTypes) - 1, ComponentTypes...>::build(
+            archetype,
+            row,
+            group
+        );
+        return group;
     }
 
+    // Starts listening to m_entityManager
     void
-    initEntities() {
-        for (EntityId id : m_entityManager->entities()) {
-            this->initEntity(id);
-        }
+    attach() {
+        m_entityManager->addArchetypeListener(this);
+        this->initEntities();
     }
 
+    // Reduces the logged moves to m_moveStates, see takeChanges()
     void
-    initEntity(
-        EntityId id
+    coalesceMoves() {
+        m_entityManager->takeMoves(m_moveObserver, m_moves);
+        this->coalesce(m_moves);
+    }
+
+    // Reduces moves to m_moveStates. Also called by the entity manager 
+    // when its move log grows too long, which bounds the moves kept for a
+    // filter that isn't read to one state per entity.
+    void
+    coalesce(
+        const std::vector<EntityManager::ArchetypeMove>& moves
     ) {
-        ComponentGroup group;
-        bool isComplete = detail::ComponentGroupBuilder<sizeof...(ComponentTypes) - 1, ComponentTypes...>::build(
-            m_entityManager,
-            id,
-            group
-        );
-        if (isComplete) {
-            m_entities[id] = group;
-            m_entities.insert(std::make_pair(id, group));
-            if (m_recordChanges) {
-                m_addedEntities[id] = group;
+        if (m_reportAll) {
+            return;
+        }
+        for (const auto& move : moves) {
+            bool fromRelevant = move.from and this->listensTo(*move.from);
+            bool toRelevant = move.to and this->listensTo(*move.to);
+            MoveState& state = this->moveState(move.entityId, fromRelevant);
+            if (fromRelevant and not toRelevant) {
+                state.m_isReadded = true;
+            }
+            int index = this->typeIndex(move.typeId);
+            if (not toRelevant or index < 0) {
+                continue;
+            }
+            if (move.from == move.to) {
+                // Replaced
+                if (m_isRequired[index]) {
+                    state.m_isReadded = true;
+                }
+                else {
+                    state.m_isChanged = true;
+                }
+            }
+            else if (fromRelevant and move.to->componentColumn(move.typeId)) {
+                // Added an optional component
+                state.m_isChanged = true;
             }
         }
     }
 
     void
-    onComponentAdded(
-        EntityId entityId
-    ) {
-        this->initEntity(entityId);
+    initEntities() {
+        for (const auto& archetype : m_entityManager->archetypes()) {
+            if (not this->listensTo(*archetype)) {
+                continue;
+            }
+            const auto& entities = archetype->entities();
+            for (size_t row = 0; row < entities.size(); ++row) {
+                this->onEntityAdded(entities[row], *archetype, row);
+            }
+        }
     }
 
-    template<int tupleIndex>
+    // Turns the differences between the entities before suspend() and 
+    // now into move states
     void
-    onOptionalComponentRemoved(
-        EntityId entityId
-    ) {
-        auto iter = m_entities.find(entityId);
-        if (iter != m_entities.end()) {
-            std::get<tupleIndex>(iter->second) = nullptr;
-            if (iter->second == ComponentGroup()) {
-                m_entities.erase(entityId);
-                if (m_recordChanges) {
-                    m_removedEntities.insert(entityId);
-                }
+    compareSuspendedEntities() {
+        for (const auto& pair : m_suspendedEntities) {
+            auto iter = m_entities.find(pair.first);
+            if (iter == m_entities.end()) {
+                this->moveState(pair.first, true);
+                continue;
+            }
+            bool requiredChanged = false;
+            bool optionalChanged = false;
+            detail::ComponentGroupComparer<sizeof...(ComponentTypes) - 1, ComponentTypes...>::compare(
+                pair.second,
+                iter->second,
+                requiredChanged,
+                optionalChanged
+            );
+            if (requiredChanged or optionalChanged) {
+                MoveState& state = this->moveState(pair.first, true);
+                state.m_isReadded = state.m_isReadded or requiredChanged;
+                state.m_isChanged = state.m_isChanged or optionalChanged;
             }
         }
+        for (const auto& pair : m_entities) {
+            if (m_suspendedEntities.count(pair.first) == 0) {
+                this->moveState(pair.first, false).m_isReadded = true;
+            }
+        }
+    }
+
+    bool
+    listensTo(
+        const Archetype& archetype
+    ) const override {
+        if (m_requiredMask.empty()) {
+            // Filters with only optional components need at least one of them
+            return archetype.mask().containsAny(m_optionalMask);
+        }
+        return archetype.mask().containsAll(m_requiredMask);
+    }
+
+    void
+    onEntityAdded(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row
+    ) override {
+        m_entities[entityId] = this->buildGroup(archetype, row);
+    }
+
+    void
+    onEntitiesAdded(
+        const Archetype& archetype,
+        size_t firstRow,
+        size_t count
+    ) override {
+        m_entities.reserve(m_entities.size() + count);
+        ArchetypeListener::onEntitiesAdded(archetype, firstRow, count);
     }
 
     void
-    onRequiredComponentRemoved(
+    onEntityChanged(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row,
+        ComponentTypeId,
+        Change
+    ) override {
+        m_entities[entityId] = this->buildGroup(archetype, row);
+    }
+
+    void
+    onEntityRemoved(
         EntityId entityId
-    ) {
-        
-        if (m_entities.erase(entityId) > 0 and m_recordChanges) {
-            if (m_addedEntities.erase(entityId) == 0) {
-                // If entityId already was in addedEntities, the entity
-                // was added, then removed in the same frame.
-                m_removedEntities.insert(entityId);
+    ) override {
+        m_entities.erase(entityId);
+    }
+
+    void
+    resume() {
+        if (m_entityManager) {
+            this->attach();
+            if (m_recordChanges) {
+                this->registerMoveObserver();
+                if (not m_reportAll) {
+                    this->compareSuspendedEntities();
+                }
             }
         }
+        m_suspendedEntities.clear();
     }
 
-    template<int tupleIndex>
     void
-    registerCallback() {
-        using ComponentType = typename std::tuple_element<
-            tupleIndex, 
-            std::tuple<ComponentTypes...>
-        >::type;
-        using RawType = typename detail::ExtractComponentType<ComponentType>::Type;
-        bool isRequired = detail::IsRequired<ComponentType>::value;
-        auto& collection = m_entityManager->getComponentCollection(
-            RawType::TYPE_ID
-        );
-        // Callbacks
-        auto onAdded = [this] (EntityId id, Component&) {
-            this->onComponentAdded(id);
-        };
-        ComponentCollection::ChangeCallback onRemoved;
-        if (isRequired) {
-            onRemoved = [this] (EntityId id, Component&) {
-                this->onRequiredComponentRemoved(id);
-            };
+    suspend() {
+        if (not m_entityManager) {
+            return;
         }
-        else {
-            onRemoved = [this] (EntityId id, Component&) {
-                this->onOptionalComponentRemoved<tupleIndex>(id);
-            };
+        if (m_recordChanges) {
+            // Moves that weren't taken yet are reported after resuming
+            this->coalesceMoves();
+            m_moves.clear();
+            m_entityManager->unregisterMoveObserver(m_moveObserver);
         }
-        unsigned int id = collection.registerChangeCallbacks(
-            onAdded,
-            onRemoved
-        );
-        m_registeredCallbacks.push_front(
-            std::make_pair(std::ref(collection), id)
+        m_entityManager->removeArchetypeListener(this);
+        m_suspendedEntities.swap(m_entities);
+        m_entities.clear();
+    }
+
+    // Index of a component type in the template arguments, or -1
+    int
+    typeIndex(
+        ComponentTypeId typeId
+    ) const {
+        for (size_t i = 0; i < sizeof...(ComponentTypes); ++i) {
+            if (m_typeIds[i] == typeId) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // The move state of an entity, added if it has none yet
+    MoveState&
+    moveState(
+        EntityId entityId,
+        bool wasRelevant
+    ) {
+        auto inserted = m_moveStates.emplace(entityId, MoveState());
+        MoveState& state = inserted.first->second;
+        if (inserted.second) {
+            state.m_wasRelevant = wasRelevant;
+            m_movedEntities.push_back(entityId);
+        }
+        return state;
+    }
+
+    void
+    registerMoveObserver() {
+        m_moveObserver = m_entityManager->registerMoveObserver(
+            [this](const std::vector<EntityManager::ArchetypeMove>& moves) {
+                this->coalesce(moves);
+            }
         );
-        detail::RegisterNextCallback<tupleIndex>::registerNextCallback(*this);
     }
 
     void
-    unregisterCallbacks() {
-        for(auto& pair : m_registeredCallbacks) {
-            pair.first.get().unregisterChangeCallbacks(pair.second);
+    observeMoves() {
+        if (m_recordChanges and m_entityManager) {
+            this->registerMoveObserver();
+            // The entities found by initEntities() are new to the caller
+            m_reportAll = true;
         }
-        m_registeredCallbacks.clear();
     }
 
-    EntityMap m_addedEntities;
+    void
+    unobserveMoves() {
+        if (m_recordChanges and m_entityManager and not m_isSuspended) {
+            m_entityManager->unregisterMoveObserver(m_moveObserver);
+        }
+        m_moveStates.clear();
+        m_movedEntities.clear();
+        m_moves.clear();
+        m_reportAll = false;
+    }
 
     EntityMap m_entities;
 
     EntityManager* m_entityManager = nullptr;
 
+    const std::array<bool, sizeof...(ComponentTypes)> m_isRequired;
+
+    // Scratch buffers of takeChanges()
+    std::unordered_map<EntityId, MoveState> m_moveStates;
+
+    std::vector<EntityId> m_movedEntities;
+
+    unsigned int m_moveObserver = 0;
+
+    std::vector<EntityManager::ArchetypeMove> m_moves;
+
+    ComponentMask m_optionalMask;
+
     bool m_recordChanges;
 
-    std::forward_list<std::pair<
-        std::reference_wrapper<ComponentCollection>, 
-        unsigned int
-    >> m_registeredCallbacks;
+    bool m_isSuspended = false;
+
+    // Whether the next takeChanges() reports all entities as added
+    bool m_reportAll = false;
+
+    ComponentMask m_requiredMask;
+
+    // The entities when the filter was suspended
+    EntityMap m_suspendedEntities;
 
-    std::unordered_set<EntityId> m_removedEntities;
+    const std::array<ComponentTypeId, sizeof...(ComponentTypes)> m_typeIds;
 
 };
 
@@ -235,14 +436,6 @@ EntityFilter<ComponentTypes...>::EntityFilter(
 }
 
 
-template<typename... ComponentTypes>
-typename EntityFilter<ComponentTypes...>::EntityMap&
-EntityFilter<ComponentTypes...>::addedEntities() {
-    assert(m_impl->m_recordChanges && "Added entities are not recorded by this filter");
-    return m_impl->m_addedEntities;
-}
-
-
 template<typename... ComponentTypes>
 typename EntityFilter<ComponentTypes...>::EntityMap::const_iterator
 EntityFilter<ComponentTypes...>::begin() const {
@@ -253,8 +446,10 @@ EntityFilter<ComponentTypes...>::begin() const {
 template<typename... ComponentTypes>
 void
 EntityFilter<ComponentTypes...>::clearChanges() {
-    m_impl->m_addedEntities.clear();
-    m_impl->m_removedEntities.clear();
+    this->takeChanges(
+        [] (EntityId, const ComponentGroup&) {},
+        [] (EntityId) {}
+    );
 }
 
 
@@ -282,10 +477,93 @@ EntityFilter<ComponentTypes...>::entities() const {
 
 
 template<typename... ComponentTypes>
-std::unordered_set<EntityId>&
-EntityFilter<ComponentTypes...>::removedEntities() {
-    assert(m_impl->m_recordChanges && "Removed entities are not recorded by this filter");
-    return m_impl->m_removedEntities;
+template<typename Function>
+void
+EntityFilter<ComponentTypes...>::forEachChunk(
+    Function function
+) const {
+    if (not m_impl->m_entityManager or m_impl->m_isSuspended) {
+        return;
+    }
+    Chunk chunk;
+    for (const auto& archetype : m_impl->m_entityManager->archetypes()) {
+        if (archetype->size() == 0 or not m_impl->listensTo(*archetype)) {
+            continue;
+        }
+        for (size_t i = 0; i < sizeof...(ComponentTypes); ++i) {
+            const std::vector<Component*>* column = archetype->componentColumn(
+                m_impl->m_typeIds[i]
+            );
+            chunk.m_columns[i] = column ? column->data() : nullptr;
+        }
+        chunk.m_entities = archetype->entities().data();
+        chunk.m_size = archetype->size();
+        function(static_cast<const Chunk&>(chunk));
+    }
+}
+
+
+template<typename... ComponentTypes>
+bool
+EntityFilter<ComponentTypes...>::isSuspended() const {
+    return m_impl->m_isSuspended;
+}
+
+
+template<typename... ComponentTypes>
+template<typename Function>
+void
+EntityFilter<ComponentTypes...>::parallelForEach(
+    ThreadPool& threadPool,
+    Function function,
+    size_t grainSize
+) const {
+    if (not m_impl->m_entityManager or m_impl->m_isSuspended) {
+        return;
+    }
+    // Iterate over the archetypes instead of the entity map, their rows 
+    // can be split into chunks. rowOffsets[i] is the first global index
+    // of archetypes[i].
+    std::vector<const Archetype*> archetypes;
+    std::vector<size_t> rowOffsets;
+    size_t count = 0;
+    for (const auto& archetype : m_impl->m_entityManager->archetypes()) {
+        if (archetype->size() > 0 and m_impl->listensTo(*archetype)) {
+            archetypes.push_back(archetype.get());
+            rowOffsets.push_back(count);
+            count += archetype->size();
+        }
+    }
+    threadPool.parallelFor(count, grainSize, 
+        [&] (size_t begin, size_t end) {
+            size_t index = std::upper_bound(
+                rowOffsets.begin(),
+                rowOffsets.end(),
+                begin
+            ) - rowOffsets.begin() - 1;
+            for (size_t i = begin; i < end; ++i) {
+                while (i - rowOffsets[index] >= archetypes[index]->size()) {
+                    index += 1;
+                }
+                const Archetype& archetype = *archetypes[index];
+                size_t row = i - rowOffsets[index];
+                function(
+                    archetype.entities()[row],
+                    m_impl->buildGroup(archetype, row)
+                );
+            }
+        }
+    );
+}
+
+
+template<typename... ComponentTypes>
+void
+EntityFilter<ComponentTypes...>::requireTag(
+    ComponentTypeId tagId
+) {
+    assert(not m_impl->m_entityManager && "Tags must be required before setting the entity manager");
+    m_impl->m_requiredMask.set(tagId);
 }
 
 
@@ -294,15 +572,88 @@ void
 EntityFilter<ComponentTypes...>::setEntityManager(
     EntityManager* entityManager
 ) {
-    m_impl->unregisterCallbacks();
-    m_impl->m_entities.clear();
-    m_impl->m_addedEntities.clear();
-    m_impl->m_removedEntities.clear();
-    m_impl->m_entityManager = entityManager;
-    if (entityManager) {
-        detail::RegisterNextCallback<sizeof...(ComponentTypes)>::registerNextCallback(*m_impl);
-        m_impl->initEntities();
+    Implementation& impl = *m_impl;
+    if (impl.m_entityManager and not impl.m_isSuspended) {
+        impl.m_entityManager->removeArchetypeListener(&impl);
+    }
+    impl.unobserveMoves();
+    impl.m_entities.clear();
+    impl.m_suspendedEntities.clear();
+    impl.m_entityManager = entityManager;
+    if (not entityManager) {
+        return;
+    }
+    if (impl.m_isSuspended) {
+        // Everything is new once resumed
+        impl.m_reportAll = impl.m_recordChanges;
+    }
+    else {
+        impl.attach();
+        impl.observeMoves();
+    }
+}
+
+
+template<typename... ComponentTypes>
+void
+EntityFilter<ComponentTypes...>::setSuspended(
+    bool suspended
+) {
+    if (suspended == m_impl->m_isSuspended) {
+        return;
+    }
+    if (suspended) {
+        m_impl->suspend();
+        m_impl->m_isSuspended = true;
+    }
+    else {
+        m_impl->m_isSuspended = false;
+        m_impl->resume();
+    }
+}
+
+
+template<typename... ComponentTypes>
+template<typename AddedFunction, typename RemovedFunction>
+void
+EntityFilter<ComponentTypes...>::takeChanges(
+    AddedFunction added,
+    RemovedFunction removed
+) {
+    assert(m_impl->m_recordChanges && "Changes are not recorded by this filter");
+    Implementation& impl = *m_impl;
+    if (not impl.m_entityManager or impl.m_isSuspended) {
+        return;
+    }
+    impl.coalesceMoves();
+    if (impl.m_reportAll) {
+        impl.m_reportAll = false;
+        for (const auto& pair : impl.m_entities) {
+            added(pair.first, pair.second);
+        }
+        return;
+    }
+    // Report removals before additions, so that callers can handle a 
+    // re-added entity as a new one
+    for (EntityId entityId : impl.m_movedEntities) {
+        const auto& state = impl.m_moveStates[entityId];
+        bool isRelevant = impl.m_entities.count(entityId) > 0;
+        if (state.m_wasRelevant and (state.m_isReadded or not isRelevant)) {
+            removed(entityId);
+        }
+    }
+    for (EntityId entityId : impl.m_movedEntities) {
+        const auto& state = impl.m_moveStates[entityId];
+        auto iter = impl.m_entities.find(entityId);
+        if (iter == impl.m_entities.end()) {
+            continue;
+        }
+        if (not state.m_wasRelevant or state.m_isReadded or state.m_isChanged) {
+            added(entityId, iter->second);
+        }
     }
+    impl.m_moveStates.clear();
+    impl.m_movedEntities.clear();
 }
 
 } // namespace thrive
@@ -1,10 +1,13 @@
 #pragma once
 
+#include "engine/archetype.h"
 #include "engine/entity_manager.h"
-#include "engine/component_collection.h"
+#include "engine/suspendable_filter.h"
+#include "engine/thread_pool.h"
 
+#include <algorithm>
+#include <array>
 #include <assert.h>
-#include <forward_list>
 #include <functional>
 #include <tuple>
 #include <unordered_map>
@@ -50,6 +53,16 @@ struct ExtractComponentType<Optional<ComponentType>> {
 * An entity filter helps a system in finding the entities that have exactly
 * the right components to be relevant for the system. 
 *
+* The filter listens to the EntityManager's archetypes, so it is only
+* notified about entities entering or leaving archetypes that contain its
+* required components.
+*
+* While suspended (see SuspendableFilter), the filter is empty and doesn't
+* listen at all. takeChanges() reports the entities that changed while it
+* was suspended after it is resumed. They are found by comparing the 
+* entities and their components before and after, so a component that was
+* replaced by one at the same address goes unnoticed.
+*
 * @tparam ComponentTypes
 *   The component classes to watch for. You can wrap a class with the 
 *   Optional template if you want to know if it's there, but it's not
@@ -94,7 +107,7 @@ struct ExtractComponentType<Optional<ComponentType>> {
 * \endcode
 */
 template<typename... ComponentTypes>
-class EntityFilter {
+class EntityFilter : public SuspendableFilter {
 
 public:
 
@@ -113,18 +126,89 @@ public:
     */
     using EntityMap = std::unordered_map<EntityId, ComponentGroup>;
 
+    /**
+    * @brief The relevant entities of one archetype, see forEachChunk()
+    *
+    * A chunk holds one contiguous column of component pointers per 
+    * component type of the filter. All columns and the entity ids share
+    * their indices, so row \a i of every column belongs to entities()[i].
+    */
+    class Chunk {
+
+    public:
+
+        /**
+        * @brief The component pointers of one component type
+        *
+        * @tparam index
+        *   The component type's position in the filter's template arguments
+        *
+        * @return 
+        *   An array of size() pointers, or \c nullptr for an optional
+        *   component type that the chunk's entities don't have
+        */
+        template<size_t index>
+        Component* const*
+        column() const {
+            return m_columns[index];
+        }
+
+        /**
+        * @brief A component of one entity
+        *
+        * @tparam index
+        *   The component type's position in the filter's template arguments
+        *
+        * @param row
+        *   The entity's index in the chunk
+        *
+        * @return 
+        *   The component, or \c nullptr for an optional component that is
+        *   not present
+        */
+        template<size_t index>
+        typename std::tuple_element<index, ComponentGroup>::type
+        component(
+            size_t row
+        ) const {
+            using PointerType = typename std::tuple_element<index, ComponentGroup>::type;
+            return m_columns[index] ? static_cast<PointerType>(m_columns[index][row]) : nullptr;
+        }
+
+        /**
+        * @brief The ids of the chunk's entities
+        */
+        const EntityId*
+        entities() const {
+            return m_entities;
+        }
+
+        /**
+        * @brief The number of entities in the chunk
+        */
+        size_t
+        size() const {
+            return m_size;
+        }
+
+    private:
+
+        friend class EntityFilter;
+
+        std::array<Component* const*, sizeof...(ComponentTypes)> m_columns;
+
+        const EntityId* m_entities = nullptr;
+
+        size_t m_size = 0;
+
+    };
+
     /**
     * @brief Constructor
     *
     * @param recordChanges
-    *   If \c true, you can query the added and removed entities through
-    *   this filter.
-    *
-    * @warning
-    *   If \a recordChanges is true, you are responsible for clearing the
-    *   collections returned by addedEntities() and removedEntities().
-    *   If you don't clear them regularly, it's a memory leak.
-    *   You can use EntityFilter::clearChanges() to clear both collections.
+    *   If \c true, you can query the added and removed entities with 
+    *   takeChanges().
     */
     EntityFilter(
         bool recordChanges = false
@@ -135,16 +219,6 @@ public:
     */
     ~EntityFilter() {}
 
-    /**
-    * @brief Returns the entities added to this filter
-    *
-    * When you have processed the collection, please call clear() on
-    * it.
-    *
-    */
-    EntityMap&
-    addedEntities();
-
     /**
     * @brief Iterator
     *
@@ -159,7 +233,7 @@ public:
     begin() const;
 
     /**
-    * @brief Clears the lists for added and removed entities
+    * @brief Discards the changes since the last takeChanges()
     */
     void
     clearChanges();
@@ -202,18 +276,100 @@ public:
     entities() const;
 
     /**
-    * @brief Returns the entities removed from this filter
+    * @brief Calls a function for each chunk of relevant entities
+    *
+    * There is one chunk per archetype with relevant entities. Iterating 
+    * over a chunk's columns walks contiguous arrays instead of the nodes of
+    * entities(), which suits systems that process many entities with the 
+    * same code. For example:
+    * \code
+    * m_entities.forEachChunk([] (const Filter::Chunk& chunk) {
+    *     for (size_t row = 0; row < chunk.size(); ++row) {
+    *         MyComponent* myComponent = chunk.component<0>(row);
+    *         // Do something with myComponent
+    *     }
+    * });
+    * \endcode
+    *
+    * The chunks are only valid during the call. The entity structure must
+    * not be changed directly from within \a function, structural changes
+    * have to be deferred.
+    *
+    * @tparam Function
+    *   Callable as <tt>function(const Chunk&)</tt>
+    *
+    * @param function
+    *   The function to call for each chunk
+    */
+    template<typename Function>
+    void
+    forEachChunk(
+        Function function
+    ) const;
+
+    bool
+    isSuspended() const override;
+
+    /**
+    * @brief Calls a function for each relevant entity, in parallel
+    *
+    * The entities are split into chunks of \a grainSize which are processed
+    * by the thread pool's workers and the calling thread. Returns after all
+    * entities have been processed.
+    *
+    * Within \a function, it is safe to
+    * - read and modify the components passed in for the current entity,
+    * - read components that no other thread modifies during the loop,
+    * - record structural changes with the thread safe EntityManager 
+    *   functions, such as EntityManager::removeEntity().
+    *
+    * It is not safe to modify the components of other entities, to change
+    * the entity structure directly (e.g. with EntityManager::addComponent())
+    * or to use shared state that is not thread safe, such as the Lua state
+    * or the engine's RNG.
+    *
+    * @tparam Function
+    *   Callable as <tt>function(EntityId, const ComponentGroup&)</tt>
+    *
+    * @param threadPool
+    *   The thread pool to use, usually Engine::threadPool()
+    * @param function
+    *   The function to call for each entity. If it throws, the first 
+    *   exception is rethrown after all other entities have been processed.
+    * @param grainSize
+    *   The number of entities per chunk. Choose a larger number for cheap
+    *   functions.
+    */
+    template<typename Function>
+    void
+    parallelForEach(
+        ThreadPool& threadPool,
+        Function function,
+        size_t grainSize = 256
+    ) const;
+
+    /**
+    * @brief Restricts the filter to entities with a tag
+    *
+    * Tags don't show up in the ComponentGroup, they only narrow down the
+    * relevant entities. A filter of only optional components that 
+    * requires a tag matches all entities with the tag.
     *
-    * When you have processed the collection, please call clear() on
-    * it.
+    * Must be called before setEntityManager().
     *
+    * @param tagId
+    *   The tag, see ComponentFactory::registerTag()
     */
-    std::unordered_set<EntityId>&
-    removedEntities();
+    void
+    requireTag(
+        ComponentTypeId tagId
+    );
 
     /**
     * @brief Sets the entity manager this filter applies to
     *
+    * A suspended filter only starts listening once it is resumed.
+    *
     * @param entityManager
     *   The new entity manager to listen to. If \c nullptr, the filter stays
     *   empty.
@@ -223,6 +379,53 @@ public:
         EntityManager* entityManager
     );
 
+    void
+    setSuspended(
+        bool suspended
+    ) override;
+
+    /**
+    * @brief Reports the entities added and removed since the last call
+    *
+    * Only available if the filter was constructed with \a recordChanges.
+    * The filter doesn't keep its own lists of changes, it reads the 
+    * EntityManager's shared log of archetype moves (see 
+    * EntityManager::takeMoves()) and reduces the moves of each entity to
+    * what the caller needs to know:
+    * - An entity that entered the filter is reported as added.
+    * - An entity that left the filter is reported as removed.
+    * - An entity that left and came back, or had a required component
+    *   replaced, is reported as removed and then added.
+    * - An entity that got an optional component or had one replaced is 
+    *   reported as added.
+    * - An entity that entered and left again is not reported at all.
+    *
+    * All removals are reported before the additions. The first call after
+    * setEntityManager() reports all relevant entities as added.
+    *
+    * Logged moves are dropped once every observer has taken them, so there
+    * is nothing to clear. A filter that isn't read for a long time keeps at
+    * most one pending change per entity, see 
+    * EntityManager::registerMoveObserver(). Changing the entity structure
+    * directly from within the callbacks is not allowed, defer such changes.
+    *
+    * @tparam AddedFunction
+    *   Callable as <tt>added(EntityId, const ComponentGroup&)</tt>
+    * @tparam RemovedFunction
+    *   Callable as <tt>removed(EntityId)</tt>
+    *
+    * @param added
+    *   Called for each added entity with its current components
+    * @param removed
+    *   Called for each removed entity
+    */
+    template<typename AddedFunction, typename RemovedFunction>
+    void
+    takeChanges(
+        AddedFunction added,
+        RemovedFunction removed
+    );
+
 private:
 
     struct Implementation;
@@ -1,11 +1,27 @@
 #include "engine/entity_manager.h"
 
+#include "engine/archetype.h"
 #include "engine/component_collection.h"
 #include "engine/component_factory.h"
+#include "engine/component_mask.h"
+#include "engine/entity_query.h"
+#include "engine/frame_arena.h"
 #include "engine/serialization.h"
+#include "engine/staged_writes.h"
+#include "engine/thread_pool.h"
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <boost/thread.hpp>
+#include <deque>
+#include <exception>
+#include <luabind/iterator_policy.hpp>
+#include <map>
+#include <set>
+#include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -14,101 +30,1420 @@
 
 using namespace thrive;
 
+/**
+* @brief Number of free slots kept back before any of them is recycled
+*
+* Recycling slots in FIFO order from a large enough pool spreads the 
+* generation increments over many slots, which pushes back the point where a
+* generation wraps around and a stale id becomes valid again.
+*/
+static const size_t MIN_FREE_SLOTS = 1024;
+
+/**
+* @brief Number of ids a thread reserves at once, see generateNewId()
+*/
+static const size_t ID_BLOCK_SIZE = 64;
+
+/**
+* @brief Number of entity managers a thread keeps id blocks for
+*/
+static const size_t ID_BLOCK_CACHE_SIZE = 4;
+
+/**
+* @brief Number of components loaded per job by restore()
+*/
+static const size_t RESTORE_GRAIN_SIZE = 256;
+
+/**
+* @brief Number of consecutive components per snapshot page
+*/
+static const size_t SNAPSHOT_PAGE_SIZE = 64;
+
+/**
+* @brief Number of archetype moves logged before they are passed to the 
+* observers' overflow handlers, see registerMoveObserver()
+*/
+static const size_t MAX_LOGGED_MOVES = 1 << 16;
+
+// Interned entity names, shared by all entity managers. Function-local
+// statics, so systems may intern names in static initializers.
+static std::vector<std::string>&
+internedNames() {
+    static std::vector<std::string> names;
+    return names;
+}
+
+
+static std::unordered_map<std::string, EntityManager::NameId>&
+internedNameIds() {
+    static std::unordered_map<std::string, EntityManager::NameId> nameIds;
+    return nameIds;
+}
+
+
+const EntityManager::NameId EntityManager::NULL_NAME;
+
+
+namespace {
+
+// Ids a thread has reserved from one entity manager, see generateNewId()
+struct IdBlock {
+
+    // Handed out from the back
+    std::vector<EntityId> m_ids;
+
+    // The id epoch of the entity manager, 0 if unused
+    uint64_t m_epoch = 0;
+
+    // Whether m_ids are recycled slots rather than fresh ones
+    bool m_isRecycled = false;
+
+};
+
+}
+
+// Identifies an entity manager's ids until its next clear() or restore(),
+// so that blocks of a destroyed or cleared manager are never used again
+static std::atomic<uint64_t> s_nextIdEpoch(1);
+
+static thread_local std::array<IdBlock, ID_BLOCK_CACHE_SIZE> t_idBlocks;
+
+
+static IdBlock&
+threadIdBlock(
+    uint64_t epoch
+) {
+    for (IdBlock& block : t_idBlocks) {
+        if (block.m_epoch == epoch) {
+            return block;
+        }
+    }
+    // Replace the block of the oldest manager, its ids are left unused
+    auto oldest = std::min_element(
+        t_idBlocks.begin(),
+        t_idBlocks.end(),
+        [] (const IdBlock& lhs, const IdBlock& rhs) {
+            return lhs.m_epoch < rhs.m_epoch;
+        }
+    );
+    oldest->m_ids.clear();
+    oldest->m_epoch = epoch;
+    oldest->m_isRecycled = false;
+    return *oldest;
+}
+
+
 struct EntityManager::Implementation {
 
+    struct Slot {
+
+        // Archetype of the entity, nullptr if it has no components or tags
+        Archetype* m_archetype = nullptr;
+
+        // Row of the entity in m_archetype
+        size_t m_archetypeRow = 0;
+
+        // Generation of the id currently using this slot
+        EntityId m_generation = 0;
+
+        // Freed and not used since. The slot is queued in m_freeSlots or
+        // its new id has been handed out by generateNewId().
+        bool m_isFree = false;
+
+        // Named slots are never recycled
+        bool m_isNamed = false;
+
+        bool m_isVolatile = false;
+
+    };
+
+    // Links of an entity in the hierarchy, see setParent()
+    struct HierarchyNode {
+
+        std::vector<EntityId> m_children;
+
+        EntityId m_parent = NULL_ENTITY;
+
+    };
+
+    // A structural change recorded for the next processCommands()
+    struct Command {
+
+        enum class Type {
+            AddComponent,
+            CreateEntity,
+            RemoveComponent,
+            RemoveEntity,
+            RemoveTag
+        };
+
+        Command(
+            Type type,
+            EntityId entityId,
+            ComponentTypeId typeId = NULL_COMPONENT_TYPE
+        ) : m_entityId(entityId),
+            m_type(type),
+            m_typeId(typeId)
+        {
+        }
+
+        // One component for AddComponent, all of them for CreateEntity
+        ComponentList m_components;
+
+        EntityId m_entityId;
+
+        Type m_type;
+
+        // Only used by RemoveComponent and RemoveTag
+        ComponentTypeId m_typeId;
+
+    };
+
+    // Consecutive components of a collection, as stored by snapshot()
+    struct SnapshotPage {
+
+        std::vector<EntityId> m_entities;
+
+        // Whether each entity's component is in m_rows, i.e. not volatile
+        std::vector<bool> m_isStored;
+
+        StorageList m_rows;
+
+    };
+
+    Implementation() 
+      : m_idEpoch(s_nextIdEpoch++),
+        m_slots(1) // Slot 0 is reserved for NULL_ENTITY
+    {
+    }
+
+    Slot*
+    findSlot(
+        EntityId entityId
+    ) {
+        EntityId index = entityIndex(entityId);
+        if (index == entityIndex(NULL_ENTITY) or index >= m_slots.size()) {
+            return nullptr;
+        }
+        Slot& slot = m_slots[index];
+        if (slot.m_isFree or slot.m_generation != entityGeneration(entityId)) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    const Slot*
+    findSlot(
+        EntityId entityId
+    ) const {
+        return const_cast<Implementation*>(this)->findSlot(entityId);
+    }
+
+    // Like findSlot(), but also accepts an id that generateNewId() handed
+    // out and that hasn't been used yet
+    Slot*
+    useSlot(
+        EntityId entityId
+    ) {
+        EntityId index = entityIndex(entityId);
+        EntityId endIndex = std::min<EntityId>(m_nextIndex.load(), ENTITY_INDEX_MASK + 1);
+        if (index == entityIndex(NULL_ENTITY) or index >= endIndex) {
+            return nullptr;
+        }
+        if (index >= m_slots.size()) {
+            m_slots.resize(index + 1);
+        }
+        Slot& slot = m_slots[index];
+        if (slot.m_generation != entityGeneration(entityId)) {
+            return nullptr;
+        }
+        slot.m_isFree = false;
+        return &slot;
+    }
+
+    void
+    freeSlot(
+        EntityId index
+    ) {
+        Slot& slot = m_slots[index];
+        assert(not slot.m_archetype && "Freeing slot of entity with components");
+        slot.m_generation = (slot.m_generation + 1) & ENTITY_GENERATION_MASK;
+        slot.m_isFree = true;
+        slot.m_isNamed = false;
+        slot.m_isVolatile = false;
+        boost::lock_guard<boost::mutex> lock(m_idMutex);
+        m_freeSlots.push_back(makeEntityId(index, slot.m_generation));
+        m_freeSlotCount.store(m_freeSlots.size(), std::memory_order_relaxed);
+    }
+
+    // Occupies the slot of a known id, used when restoring
+    Slot&
+    claimSlot(
+        EntityId entityId
+    ) {
+        EntityId index = entityIndex(entityId);
+        if (index >= m_slots.size()) {
+            m_slots.resize(index + 1);
+        }
+        if (index >= m_nextIndex.load()) {
+            m_nextIndex.store(index + 1);
+        }
+        Slot& slot = m_slots[index];
+        slot.m_generation = entityGeneration(entityId);
+        slot.m_isFree = false;
+        return slot;
+    }
+
+    // Refills a thread's block of ids, see generateNewId()
+    void
+    refillIdBlock(
+        IdBlock& block
+    ) {
+        if (m_freeSlotCount.load(std::memory_order_relaxed) <= MIN_FREE_SLOTS) {
+            if (not block.m_ids.empty()) {
+                // Another thread recycled the free slots first
+                return;
+            }
+            // Fresh indices don't need the lock
+            if (this->reserveFreshIds(block)) {
+                return;
+            }
+        }
+        boost::lock_guard<boost::mutex> lock(m_idMutex);
+        size_t count = 0;
+        if (m_freeSlots.size() > MIN_FREE_SLOTS) {
+            count = std::min(ID_BLOCK_SIZE, m_freeSlots.size() - MIN_FREE_SLOTS);
+        }
+        else if (m_nextIndex.load() > ENTITY_INDEX_MASK) {
+            count = std::min(ID_BLOCK_SIZE, m_freeSlots.size());
+        }
+        if (count > 0) {
+            // Unused fresh ids go back to the pool
+            m_freeSlots.insert(m_freeSlots.end(), block.m_ids.begin(), block.m_ids.end());
+            block.m_ids.resize(count);
+            for (size_t i = count; i > 0; --i) {
+                block.m_ids[i - 1] = m_freeSlots.front();
+                m_freeSlots.pop_front();
+            }
+            block.m_isRecycled = true;
+            m_freeSlotCount.store(m_freeSlots.size(), std::memory_order_relaxed);
+        }
+        else if (block.m_ids.empty() and not this->reserveFreshIds(block)) {
+            throw std::runtime_error("Out of entity ids");
+        }
+    }
+
+    // Fills an empty block with never used indices, false if there are
+    // none left
+    bool
+    reserveFreshIds(
+        IdBlock& block
+    ) {
+        EntityId first = ENTITY_INDEX_MASK + 1;
+        if (m_nextIndex.load() <= ENTITY_INDEX_MASK) {
+            first = m_nextIndex.fetch_add(ID_BLOCK_SIZE);
+        }
+        EntityId end = std::min<EntityId>(first + ID_BLOCK_SIZE, ENTITY_INDEX_MASK + 1);
+        for (EntityId index = end; index > first; --index) {
+            block.m_ids.push_back(makeEntityId(index - 1, 0));
+        }
+        block.m_isRecycled = false;
+        return first < end;
+    }
+
+    // Everything storage() holds besides the collections
+    void
+    saveBookkeeping(
+        const ComponentFactory& factory,
+        StorageContainer& storage
+    ) const {
+        // Slots
+        // Ids reserved by threads but not used yet are left out
+        storage.set<EntityId>(
+            "slotCount",
+            std::min<EntityId>(m_nextIndex.load(), ENTITY_INDEX_MASK + 1)
+        );
+        StorageList freeSlots;
+        freeSlots.reserve(m_freeSlots.size());
+        for (EntityId entityId : m_freeSlots) {
+            StorageContainer slotStorage;
+            slotStorage.set("index", entityIndex(entityId));
+            slotStorage.set("generation", entityGeneration(entityId));
+            freeSlots.append(std::move(slotStorage));
+        }
+        storage.set("freeSlots", std::move(freeSlots));
+        // Tags, one entry per tagged entity and tag
+        StorageList tags;
+        for (const auto& archetype : m_archetypes) {
+            const auto& signature = archetype->signature();
+            if (archetype->size() == 0 or signature.size() == archetype->componentTypes().size()) {
+                continue;
+            }
+            for (ComponentTypeId typeId : signature) {
+                if (archetype->componentColumn(typeId)) {
+                    continue;
+                }
+                std::string tagName = ComponentFactory::getTagName(typeId);
+                for (EntityId entityId : archetype->entities()) {
+                    const Slot* slot = this->findSlot(entityId);
+                    if (slot and slot->m_isVolatile) {
+                        continue;
+                    }
+                    StorageContainer tagStorage;
+                    tagStorage.set("entityId", entityId);
+                    tagStorage.set("tag", tagName);
+                    tags.append(std::move(tagStorage));
+                }
+            }
+        }
+        storage.set("tags", std::move(tags));
+        // Pending removals. Pending additions are lost, their components don't 
+        // have an owner yet.
+        StorageList componentsToRemove;
+        StorageList entitiesToRemove;
+        StorageList tagsToRemove;
+        for (const auto& command : m_commands) {
+            if (command.m_type == Implementation::Command::Type::RemoveComponent) {
+                StorageContainer pairStorage;
+                pairStorage.set("entityId", command.m_entityId);
+                std::string typeName = factory.getTypeName(command.m_typeId);
+                pairStorage.set("componentTypeName", typeName);
+                componentsToRemove.append(std::move(pairStorage));
+            }
+            else if (command.m_type == Implementation::Command::Type::RemoveEntity) {
+                StorageContainer idStorage;
+                idStorage.set("id", command.m_entityId);
+                entitiesToRemove.append(std::move(idStorage));
+            }
+            else if (command.m_type == Implementation::Command::Type::RemoveTag) {
+                StorageContainer tagStorage;
+                tagStorage.set("entityId", command.m_entityId);
+                tagStorage.set("tag", ComponentFactory::getTagName(command.m_typeId));
+                tagsToRemove.append(std::move(tagStorage));
+            }
+        }
+        storage.set("componentsToRemove", std::move(componentsToRemove));
+        storage.set("entitiesToRemove", std::move(entitiesToRemove));
+        storage.set("tagsToRemove", std::move(tagsToRemove));
+        // Named entities
+        StorageList namedIds;
+        namedIds.reserve(m_namedIds.size());
+        for (const auto& item : m_namedIds) {
+            StorageContainer itemStorage;
+            itemStorage.set("name", item.first);
+            itemStorage.set("entityId", item.second);
+            namedIds.append(std::move(itemStorage));
+        }
+        storage.set("namedIds", std::move(namedIds));
+    }
+
+    Archetype*
+    getArchetype(
+        Archetype::Signature signature
+    ) {
+        if (signature.empty()) {
+            return nullptr;
+        }
+        auto iter = m_archetypeIndex.find(signature);
+        if (iter != m_archetypeIndex.end()) {
+            return iter->second;
+        }
+        Archetype::Signature componentTypes;
+        for (ComponentTypeId typeId : signature) {
+            if (not ComponentFactory::isTag(typeId)) {
+                componentTypes.push_back(typeId);
+            }
+        }
+        std::unique_ptr<Archetype> archetype(new Archetype(
+            signature,
+            std::move(componentTypes)
+        ));
+        for (ArchetypeListener* listener : m_archetypeListeners) {
+            if (listener->listensTo(*archetype)) {
+                insertListener(*archetype, listener);
+            }
+        }
+        Archetype* rawArchetype = archetype.get();
+        m_archetypeIndex.emplace(std::move(signature), rawArchetype);
+        m_archetypes.push_back(std::move(archetype));
+        return rawArchetype;
+    }
+
+    Archetype*
+    archetypeWith(
+        Archetype* from,
+        ComponentTypeId typeId
+    ) {
+        auto& edges = from ? from->m_addEdges : m_rootEdges;
+        auto iter = edges.find(typeId);
+        if (iter != edges.end()) {
+            return iter->second;
+        }
+        Archetype::Signature signature;
+        if (from) {
+            signature = from->m_signature;
+        }
+        signature.insert(
+            std::lower_bound(signature.begin(), signature.end(), typeId),
+            typeId
+        );
+        Archetype* to = this->getArchetype(std::move(signature));
+        edges[typeId] = to;
+        if (from) {
+            to->m_removeEdges[typeId] = from;
+        }
+        return to;
+    }
+
+    Archetype*
+    archetypeWithout(
+        Archetype* from,
+        ComponentTypeId typeId
+    ) {
+        auto iter = from->m_removeEdges.find(typeId);
+        if (iter != from->m_removeEdges.end()) {
+            return iter->second;
+        }
+        Archetype::Signature signature = from->m_signature;
+        signature.erase(
+            std::lower_bound(signature.begin(), signature.end(), typeId)
+        );
+        Archetype* to = this->getArchetype(std::move(signature));
+        from->m_removeEdges[typeId] = to;
+        if (to) {
+            to->m_addEdges[typeId] = from;
+        }
+        return to;
+    }
+
+    // Removes an entity from its parent's children. Erases nodes that have
+    // no links left.
+    void
+    unlinkParent(
+        EntityId child
+    ) {
+        auto iter = m_hierarchy.find(child);
+        if (iter == m_hierarchy.end() or iter->second.m_parent == NULL_ENTITY) {
+            return;
+        }
+        EntityId parent = iter->second.m_parent;
+        iter->second.m_parent = NULL_ENTITY;
+        if (iter->second.m_children.empty()) {
+            m_hierarchy.erase(iter);
+        }
+        auto parentIter = m_hierarchy.find(parent);
+        if (parentIter == m_hierarchy.end()) {
+            // Parent is being removed
+            return;
+        }
+        auto& siblings = parentIter->second.m_children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), child));
+        if (siblings.empty() and parentIter->second.m_parent == NULL_ENTITY) {
+            m_hierarchy.erase(parentIter);
+        }
+    }
+
+    void
+    logMove(
+        const ArchetypeMove& move
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_movesMutex);
+        if (m_moveObservers.empty()) {
+            return;
+        }
+        m_moves.push_back(move);
+        if (m_moves.size() > MAX_LOGGED_MOVES) {
+            this->overflowMoves();
+        }
+    }
+
+    // Passes the moves not taken yet to the observers' overflow handlers
+    // and empties the log. Expects the moves mutex to be locked.
+    void
+    overflowMoves() {
+        uint64_t end = m_movesBegin + m_moves.size();
+        std::vector<ArchetypeMove> moves;
+        for (auto& pair : m_moveObservers) {
+            MoveObserver& observer = pair.second;
+            if (observer.m_position == end) {
+                continue;
+            }
+            moves.assign(
+                m_moves.begin() + (observer.m_position - m_movesBegin),
+                m_moves.end()
+            );
+            observer.m_position = end;
+            observer.m_onOverflow(moves);
+        }
+        this->trimMoves();
+    }
+
+    // Drops the moves that every observer has taken. Expects the moves 
+    // mutex to be locked.
+    void
+    trimMoves() {
+        uint64_t keep = m_movesBegin + m_moves.size();
+        for (const auto& pair : m_moveObservers) {
+            keep = std::min(keep, pair.second.m_position);
+        }
+        while (m_movesBegin < keep) {
+            m_moves.pop_front();
+            m_movesBegin += 1;
+        }
+    }
+
+    static void
+    insertListener(
+        Archetype& archetype,
+        ArchetypeListener* listener
+    ) {
+        auto& listeners = archetype.m_listeners;
+        listeners.insert(
+            std::lower_bound(listeners.begin(), listeners.end(), listener),
+            listener
+        );
+    }
+
+    // Moves an entity to another archetype, with component being the new 
+    // component of type typeId (if any).
+    void
+    moveEntity(
+        EntityId entityId,
+        Slot& slot,
+        Archetype* to,
+        ComponentTypeId typeId,
+        Component* component,
+        ArchetypeListener::Change change
+    ) {
+        Archetype* from = slot.m_archetype;
+        size_t fromRow = slot.m_archetypeRow;
+        size_t toRow = 0;
+        if (from == to) {
+            // Replaced a component in place
+            toRow = fromRow;
+            to->m_columns[to->column(typeId)][toRow] = component;
+        }
+        else {
+            if (to) {
+                toRow = to->m_entities.size();
+                to->m_entities.push_back(entityId);
+                for (size_t i = 0; i < to->m_columns.size(); ++i) {
+                    ComponentTypeId columnType = to->m_componentTypes[i];
+                    to->m_columns[i].push_back(
+                        columnType == typeId ? 
+                            component : from->component(columnType, fromRow)
+                    );
+                }
+            }
+            if (from) {
+                EntityId movedEntity = from->removeRow(fromRow);
+                if (movedEntity != NULL_ENTITY) {
+                    m_slots[entityIndex(movedEntity)].m_archetypeRow = fromRow;
+                }
+            }
+            slot.m_archetype = to;
+            slot.m_archetypeRow = toRow;
+        }
+        this->logMove(ArchetypeMove{entityId, from, to, typeId});
+        // Notify listeners, both lists are sorted by address
+        static const std::vector<ArchetypeListener*> NO_LISTENERS;
+        const auto& fromListeners = from ? from->m_listeners : NO_LISTENERS;
+        const auto& toListeners = to ? to->m_listeners : NO_LISTENERS;
+        auto fromIter = fromListeners.begin();
+        auto toIter = toListeners.begin();
+        while (fromIter != fromListeners.end() or toIter != toListeners.end()) {
+            if (toIter == toListeners.end() or 
+                (fromIter != fromListeners.end() and *fromIter < *toIter)
+            ) {
+                (*fromIter)->onEntityRemoved(entityId);
+                ++fromIter;
+            }
+            else if (fromIter == fromListeners.end() or *toIter < *fromIter) {
+                (*toIter)->onEntityAdded(entityId, *to, toRow);
+                ++toIter;
+            }
+            else {
+                (*toIter)->onEntityChanged(entityId, *to, toRow, typeId, change);
+                ++fromIter;
+                ++toIter;
+            }
+        }
+    }
+
     ComponentCollection&
     getComponentCollection(
         ComponentTypeId typeId
     ) {
+        // Called for every added component, so avoid hashing when possible
+        ComponentCollection* existing = this->findComponentCollection(typeId);
+        if (existing) {
+            return *existing;
+        }
         std::unique_ptr<ComponentCollection>& collection = m_collections[typeId];
         if (not collection) {
-            collection.reset(new ComponentCollection(typeId));
+            collection.reset(new ComponentCollection(
+                typeId,
+                ComponentFactory::getStorage(typeId)
+            ));
+            if (typeId >= m_collectionsByType.size()) {
+                m_collectionsByType.resize(typeId + 1, nullptr);
+            }
+            m_collectionsByType[typeId] = collection.get();
         }
         return *collection;
     }
 
+    // The collection of a type, or null if it doesn't exist yet. Cheaper
+    // than a lookup in m_collections.
+    ComponentCollection*
+    findComponentCollection(
+        ComponentTypeId typeId
+    ) const {
+        if (typeId < m_collectionsByType.size()) {
+            return m_collectionsByType[typeId];
+        }
+        return nullptr;
+    }
+
+    // Puts new entities into their archetypes, see createEntities()
+    void
+    insertEntities(
+        const EntityId* entityIds,
+        ComponentList* entities,
+        size_t count
+    ) {
+        struct Batch {
+            Archetype* archetype;
+            size_t firstRow;
+            size_t count;
+        };
+        FrameVector<Batch> batches{FrameAllocator<Batch>(m_frameArena)};
+        Archetype::Signature signature;
+        FrameVector<Component*> columns{FrameAllocator<Component*>(m_frameArena)};
+        for (size_t i = 0; i < count; ++i) {
+            EntityId entityId = entityIds[i];
+            ComponentList& components = entities[i];
+            if (components.empty()) {
+                continue;
+            }
+            // Sort by type to match the archetype's column order. The stable
+            // sort keeps the last duplicate last, so it overwrites the others.
+            std::stable_sort(
+                components.begin(),
+                components.end(),
+                [] (const std::unique_ptr<Component>& a, const std::unique_ptr<Component>& b) {
+                    return a->typeId() < b->typeId();
+                }
+            );
+            signature.clear();
+            columns.clear();
+            for (auto& component : components) {
+                ComponentTypeId typeId = component->typeId();
+                Component* rawComponent = component.get();
+                this->getComponentCollection(typeId).addComponent(
+                    entityId,
+                    std::move(component)
+                );
+                if (not signature.empty() and signature.back() == typeId) {
+                    columns.back() = rawComponent;
+                }
+                else {
+                    signature.push_back(typeId);
+                    columns.push_back(rawComponent);
+                }
+            }
+            // Entities of one batch usually share their archetype
+            auto batch = std::find_if(
+                batches.rbegin(),
+                batches.rend(),
+                [&signature] (const Batch& batch) {
+                    return batch.archetype->signature() == signature;
+                }
+            );
+            Archetype* archetype = nullptr;
+            if (batch != batches.rend()) {
+                archetype = batch->archetype;
+                batch->count += 1;
+            }
+            else {
+                archetype = this->getArchetype(signature);
+                batches.push_back(Batch{archetype, archetype->m_entities.size(), 1});
+            }
+            auto& slot = *this->useSlot(entityId);
+            slot.m_archetype = archetype;
+            slot.m_archetypeRow = archetype->m_entities.size();
+            archetype->m_entities.push_back(entityId);
+            for (size_t column = 0; column < columns.size(); ++column) {
+                archetype->m_columns[column].push_back(columns[column]);
+            }
+            this->logMove(ArchetypeMove{entityId, nullptr, archetype, NULL_COMPONENT_TYPE});
+        }
+        for (const Batch& batch : batches) {
+            for (ArchetypeListener* listener : batch.archetype->m_listeners) {
+                listener->onEntitiesAdded(*batch.archetype, batch.firstRow, batch.count);
+            }
+        }
+    }
+
+    void
+    removeComponent(
+        EntityId entityId,
+        ComponentTypeId typeId
+    ) {
+        auto& componentCollection = this->getComponentCollection(typeId);
+        bool removed = componentCollection.removeComponent(entityId);
+        if (removed) {
+            auto slot = this->findSlot(entityId);
+            assert(slot and slot->m_archetype && "Removed component from non-existent entity");
+            this->moveEntity(
+                entityId,
+                *slot,
+                this->archetypeWithout(slot->m_archetype, typeId),
+                typeId,
+                nullptr,
+                ArchetypeListener::Change::Removed
+            );
+        }
+    }
+
+    void
+    removeTag(
+        EntityId entityId,
+        ComponentTypeId tagId
+    ) {
+        auto slot = this->findSlot(entityId);
+        if (slot and slot->m_archetype and slot->m_archetype->contains(tagId)) {
+            this->moveEntity(
+                entityId,
+                *slot,
+                this->archetypeWithout(slot->m_archetype, tagId),
+                tagId,
+                nullptr,
+                ArchetypeListener::Change::Removed
+            );
+        }
+    }
+
+    void
+    removeEntity(
+        EntityId entityId
+    ) {
+        auto slot = this->useSlot(entityId);
+        if (not slot) {
+            // Already removed or stale
+            return;
+        }
+        if (slot->m_archetype) {
+            for (ComponentTypeId typeId : slot->m_archetype->componentTypes()) {
+                m_collectionsByType[typeId]->removeComponent(entityId);
+            }
+            this->moveEntity(
+                entityId,
+                *slot,
+                nullptr,
+                NULL_COMPONENT_TYPE,
+                nullptr,
+                ArchetypeListener::Change::Removed
+            );
+        }
+        auto node = m_hierarchy.find(entityId);
+        if (node != m_hierarchy.end()) {
+            // Children are removed with their parent
+            std::vector<EntityId> children = std::move(node->second.m_children);
+            node->second.m_children.clear();
+            this->unlinkParent(entityId);
+            m_hierarchy.erase(entityId);
+            for (EntityId child : children) {
+                this->removeEntity(child);
+            }
+        }
+        // Named ids stay valid, the entity is just empty now
+        if (not slot->m_isNamed) {
+            this->freeSlot(entityIndex(entityId));
+        }
+    }
+
+    std::map<Archetype::Signature, Archetype*> m_archetypeIndex;
+
+    std::vector<ArchetypeListener*> m_archetypeListeners;
+
+    std::vector<std::unique_ptr<Archetype>> m_archetypes;
+
     std::unordered_map<
         ComponentTypeId, 
         std::unique_ptr<ComponentCollection>
     > m_collections;
 
-    std::list<std::pair<EntityId, ComponentTypeId>> m_componentsToRemove;
+    // The collections of m_collections, indexed by type id. Component type
+    // ids are handed out sequentially, so this stays small.
+    std::vector<ComponentCollection*> m_collectionsByType;
+
+    // The next collection to sort in compactStep(), followed by the 
+    // archetypes
+    size_t m_compactCursor = 0;
+
+    // Recorded structural changes, in order
+    std::vector<Command> m_commands;
+
+    // Guards m_commands while systems are updated in parallel
+    boost::mutex m_commandsMutex;
+
+    // Ids of free slots, oldest first
+    std::deque<EntityId> m_freeSlots;
+
+    // Size of m_freeSlots, readable without m_idMutex
+    std::atomic<size_t> m_freeSlotCount = {0};
+
+    // Parent and children of each entity that has either
+    std::unordered_map<EntityId, HierarchyNode> m_hierarchy;
+
+    // Cached results of query(), by sorted type ids
+    std::map<std::vector<ComponentTypeId>, std::unique_ptr<EntityQuery>> m_queries;
+
+    // Scratch memory for processing commands, may be null
+    FrameArena* m_frameArena = nullptr;
+
+    // Changed by clear() and restore(), see threadIdBlock()
+    uint64_t m_idEpoch;
+
+    // Guards m_freeSlots while systems are updated in parallel
+    boost::mutex m_idMutex;
+
+    struct MoveObserver {
+
+        // Version of the first move not taken yet
+        uint64_t m_position;
+
+        EntityManager::MoveHandler m_onOverflow;
+
+    };
+
+    std::unordered_map<unsigned int, MoveObserver> m_moveObservers;
+
+    std::deque<ArchetypeMove> m_moves;
+
+    // Version of the oldest move in m_moves
+    uint64_t m_movesBegin = 0;
+
+    boost::mutex m_movesMutex;
+
+    std::unordered_map<std::string, EntityId> m_namedIds;
+
+    // Bumped by clear(), see namesRevision()
+    uint32_t m_namesRevision = 0;
+
+    // Named entity ids by NameId, NULL_ENTITY if not looked up yet
+    std::vector<EntityId> m_internedIds;
+
+    // The first slot index that generateNewId() hasn't handed out, may be
+    // past ENTITY_INDEX_MASK. Slots up to it are added to m_slots when
+    // their ids are used.
+    std::atomic<EntityId> m_nextIndex = {1};
+
+    unsigned int m_nextMoveObserverId = 0;
+
+    // Commands being executed by processCommands(), swapped with m_commands
+    // so that both buffers keep their capacity across frames
+    std::vector<Command> m_processedCommands;
+
+    // Edges for entities without components
+    std::unordered_map<ComponentTypeId, Archetype*> m_rootEdges;
+
+    std::vector<Slot> m_slots;
+
+    // The pages of the last snapshot, by component type
+    std::unordered_map<
+        ComponentTypeId,
+        std::vector<std::shared_ptr<const SnapshotPage>>
+    > m_snapshotPages;
+
+    StagedWrites m_stagedWrites;
+
+    StorageLayout m_storageLayout = StorageLayout::Rows;
+
+};
+
+
+struct EntityManager::Snapshot::Data {
+
+    struct Collection {
+
+        std::vector<std::shared_ptr<const Implementation::SnapshotPage>> m_pages;
+
+        std::string m_typeName;
+
+    };
+
+    // Everything but the collections, see Implementation::saveBookkeeping()
+    StorageContainer m_bookkeeping;
+
+    std::vector<Collection> m_collections;
+
+};
+
+
+static const EntityQuery&
+EntityManager_query(
+    EntityManager* self,
+    const luabind::object& types
+) {
+    std::vector<ComponentTypeId> typeIds;
+    for (luabind::iterator iter(types), end; iter != end; ++iter) {
+        luabind::object type = *iter;
+        if (luabind::type(type) == LUA_TSTRING) {
+            typeIds.push_back(ComponentFactory::registerTag(
+                luabind::object_cast<std::string>(type)
+            ));
+        }
+        else {
+            typeIds.push_back(luabind::object_cast<ComponentTypeId>(type["TYPE_ID"]));
+        }
+    }
+    return self->query(std::move(typeIds));
+}
+
+
+EntityManager::Snapshot::Snapshot() {}
+
+
+bool
+EntityManager::Snapshot::isValid() const {
+    return static_cast<bool>(m_data);
+}
+
+
+StorageContainer
+EntityManager::Snapshot::storage(
+    const RowTransform& transform
+) const {
+    if (not m_data) {
+        throw std::logic_error("Snapshot is empty");
+    }
+    StorageContainer storage = m_data->m_bookkeeping;
+    StorageContainer collections;
+    for (const auto& collection : m_data->m_collections) {
+        size_t rowCount = 0;
+        for (const auto& page : collection.m_pages) {
+            rowCount += page->m_rows.size();
+        }
+        StorageList rows;
+        rows.reserve(rowCount);
+        for (const auto& page : collection.m_pages) {
+            for (const StorageContainer& row : page->m_rows) {
+                rows.append(row);
+            }
+        }
+        if (transform) {
+            transform(collection.m_typeName, rows);
+        }
+        collections.set(collection.m_typeName, std::move(rows));
+    }
+    storage.set("collections", std::move(collections));
+    return storage;
+}
+
+
+luabind::scope
+EntityManager::luaBindings() {
+    using namespace luabind;
+    return class_<EntityManager>("EntityManager")
+        .def("namesRevision", &EntityManager::namesRevision)
+        .def("query", &EntityManager_query, return_stl_iterator)
+        .def("stagedWrites", &EntityManager::stagedWrites)
+    ;
+}
+
+
+EntityManager::EntityManager() 
+  : m_impl(new Implementation())
+{
+}
+
+EntityManager::~EntityManager() {
+}
+
+Component*
+EntityManager::addComponent(
+    EntityId entityId,
+    std::unique_ptr<Component> component
+) {
+    assert(entityId != NULL_ENTITY);
+    auto slot = m_impl->useSlot(entityId);
+    if (not slot) {
+        throw std::runtime_error("Can't add component to stale entity id");
+    }
+    ComponentTypeId typeId = component->typeId();
+    auto& componentCollection = m_impl->getComponentCollection(typeId);
+    Component* rawComponent = component.get();
+    bool isNew = componentCollection.addComponent(
+        entityId, 
+        std::move(component)
+    );
+    if (isNew) {
+        m_impl->moveEntity(
+            entityId,
+            *slot,
+            m_impl->archetypeWith(slot->m_archetype, typeId),
+            typeId,
+            rawComponent,
+            ArchetypeListener::Change::Added
+        );
+    }
+    else {
+        m_impl->moveEntity(
+            entityId,
+            *slot,
+            slot->m_archetype,
+            typeId,
+            rawComponent,
+            ArchetypeListener::Change::Replaced
+        );
+    }
+    return rawComponent;
+}
+
+
+void
+EntityManager::addArchetypeListener(
+    ArchetypeListener* listener
+) {
+    m_impl->m_archetypeListeners.push_back(listener);
+    for (const auto& archetype : m_impl->m_archetypes) {
+        if (listener->listensTo(*archetype)) {
+            m_impl->insertListener(*archetype, listener);
+        }
+    }
+}
+
+
+void
+EntityManager::addTag(
+    EntityId entityId,
+    ComponentTypeId tagId
+) {
+    if (not ComponentFactory::isTag(tagId)) {
+        throw std::invalid_argument("Type id is not a tag");
+    }
+    auto slot = m_impl->useSlot(entityId);
+    if (not slot) {
+        throw std::runtime_error("Can't add tag to stale entity id");
+    }
+    if (slot->m_archetype and slot->m_archetype->contains(tagId)) {
+        return;
+    }
+    m_impl->moveEntity(
+        entityId,
+        *slot,
+        m_impl->archetypeWith(slot->m_archetype, tagId),
+        tagId,
+        nullptr,
+        ArchetypeListener::Change::Added
+    );
+}
+
+
+// The stored components of a collection, in either storage layout
+static StorageList
+collectionRows(
+    const StorageContainer& collections,
+    const std::string& typeName
+) {
+    if (collections.contains<StorageContainer>(typeName)) {
+        return storageRows(collections.get<StorageContainer>(typeName));
+    }
+    return collections.get<StorageList>(typeName);
+}
+
+
+// Parts of the stored bookkeeping that deltas copy as a whole
+static const std::array<const char*, 6> BOOKKEEPING_LISTS = {{
+    "componentsToRemove",
+    "entitiesToRemove",
+    "freeSlots",
+    "namedIds",
+    "tags",
+    "tagsToRemove"
+}};
+
+
+void
+EntityManager::applyStorageDelta(
+    StorageContainer& storage,
+    const StorageContainer& delta
+) {
+    storage.set<EntityId>("slotCount", delta.get<EntityId>("slotCount"));
+    for (const char* key : BOOKKEEPING_LISTS) {
+        storage.set(key, delta.get<StorageList>(key));
+    }
+    StorageContainer collections = storage.get<StorageContainer>("collections");
+    StorageContainer collectionChanges = delta.get<StorageContainer>("collectionChanges");
+    for (const std::string& typeName : collectionChanges.keys()) {
+        StorageContainer typeChanges = collectionChanges.get<StorageContainer>(typeName);
+        bool isColumnLayout = collections.contains<StorageContainer>(typeName);
+        StorageList components = collectionRows(collections, typeName);
+        std::unordered_map<EntityId, size_t> indices;
+        for (size_t i = 0; i < components.size(); ++i) {
+            indices[components[i].get<EntityId>("owner")] = i;
+        }
+        std::vector<bool> isReplaced(components.size(), false);
+        for (const auto& changes : typeChanges.get<StorageList>("changes")) {
+            auto iter = indices.find(changes.get<EntityId>("owner"));
+            if (iter != indices.end()) {
+                components[iter->second].merge(changes);
+            }
+        }
+        StorageList addedComponents = typeChanges.get<StorageList>("components");
+        StorageList removedComponents = typeChanges.get<StorageList>("removed");
+        for (const StorageList* list : {&addedComponents, &removedComponents}) {
+            for (const auto& entry : *list) {
+                auto iter = indices.find(entry.get<EntityId>("owner"));
+                if (iter != indices.end()) {
+                    isReplaced[iter->second] = true;
+                }
+            }
+        }
+        StorageList result;
+        result.reserve(components.size() + addedComponents.size());
+        for (size_t i = 0; i < components.size(); ++i) {
+            if (not isReplaced[i]) {
+                result.append(std::move(components[i]));
+            }
+        }
+        for (auto& component : addedComponents) {
+            result.append(std::move(component));
+        }
+        if (isColumnLayout) {
+            collections.set(typeName, storageColumns(result));
+        }
+        else {
+            collections.set(typeName, std::move(result));
+        }
+    }
+    storage.set("collections", std::move(collections));
+}
+
+
+const std::vector<std::unique_ptr<Archetype>>&
+EntityManager::archetypes() const {
+    return m_impl->m_archetypes;
+}
+
+
+const std::vector<EntityId>&
+EntityManager::children(
+    EntityId entityId
+) const {
+    static const std::vector<EntityId> NO_CHILDREN;
+    auto iter = m_impl->m_hierarchy.find(entityId);
+    if (iter == m_impl->m_hierarchy.end()) {
+        return NO_CHILDREN;
+    }
+    return iter->second.m_children;
+}
 
-    EntityId m_currentId = NULL_ENTITY + 1;
 
-    std::unordered_map<EntityId, uint16_t> m_entities;
+void
+EntityManager::clear() {
+    m_impl->m_stagedWrites.clear();
+    for (auto& pair : m_impl->m_collections) {
+        pair.second->clear();
+    }
+    for (EntityId index = 1; index < m_impl->m_slots.size(); ++index) {
+        auto& slot = m_impl->m_slots[index];
+        if (slot.m_archetype) {
+            m_impl->moveEntity(
+                makeEntityId(index, slot.m_generation),
+                slot,
+                nullptr,
+                NULL_COMPONENT_TYPE,
+                nullptr,
+                ArchetypeListener::Change::Removed
+            );
+        }
+    }
+    m_impl->m_commands.clear();
+    m_impl->m_hierarchy.clear();
+    m_impl->m_namedIds.clear();
+    m_impl->m_internedIds.clear();
+    m_impl->m_namesRevision += 1;
+    m_impl->m_snapshotPages.clear();
+    // Retire all ids handed out so far, including those that threads
+    // have reserved
+    m_impl->m_idEpoch = s_nextIdEpoch++;
+    auto& slots = m_impl->m_slots;
+    slots.resize(std::min<EntityId>(m_impl->m_nextIndex.load(), ENTITY_INDEX_MASK + 1));
+    std::vector<bool> isQueued(slots.size(), false);
+    for (EntityId entityId : m_impl->m_freeSlots) {
+        isQueued[entityIndex(entityId)] = true;
+    }
+    for (EntityId index = 1; index < slots.size(); ++index) {
+        if (not isQueued[index]) {
+            m_impl->freeSlot(index);
+        }
+    }
+}
+
+
+bool
+EntityManager::compactStep(
+    size_t budget
+) {
+    Implementation& impl = *m_impl;
+    const auto& collections = impl.m_collectionsByType;
+    size_t count = collections.size() + impl.m_archetypes.size();
+    for (size_t visited = 0; visited < count; ++visited) {
+        size_t index = impl.m_compactCursor % count;
+        bool isUnsorted = false;
+        if (index < collections.size()) {
+            isUnsorted = collections[index] and collections[index]->sortStep(budget);
+        }
+        else {
+            Archetype& archetype = *impl.m_archetypes[index - collections.size()];
+            size_t firstMoved = 0;
+            size_t endMoved = 0;
+            isUnsorted = archetype.sortStep(budget, firstMoved, endMoved);
+            for (size_t row = firstMoved; row < endMoved; ++row) {
+                impl.m_slots[entityIndex(archetype.m_entities[row])].m_archetypeRow = row;
+            }
+        }
+        if (isUnsorted) {
+            // Out of budget, continue here next time
+            impl.m_compactCursor = index;
+            return true;
+        }
+        impl.m_compactCursor = index + 1;
+    }
+    return false;
+}
+
+
+std::vector<const ComponentCollection*>
+EntityManager::componentCollections() const {
+    std::vector<const ComponentCollection*> collections;
+    for (ComponentCollection* collection : m_impl->m_collectionsByType) {
+        if (collection) {
+            collections.push_back(collection);
+        }
+    }
+    return collections;
+}
 
-    std::list<EntityId> m_entitiesToRemove;
 
-    std::unordered_map<std::string, EntityId> m_namedIds;
+const ComponentMask&
+EntityManager::componentMask(
+    EntityId entityId
+) const {
+    static const ComponentMask NO_COMPONENTS;
+    auto slot = m_impl->findSlot(entityId);
+    if (not slot or not slot->m_archetype) {
+        return NO_COMPONENTS;
+    }
+    return slot->m_archetype->mask();
+}
 
-    std::unordered_set<EntityId> m_volatileEntities;
 
-};
+EntityId
+EntityManager::createEntity(
+    ComponentList components
+) {
+    std::vector<ComponentList> entities;
+    entities.push_back(std::move(components));
+    return this->createEntities(std::move(entities)).front();
+}
 
 
-EntityManager::EntityManager() 
-  : m_impl(new Implementation())
-{
+std::vector<EntityId>
+EntityManager::createEntities(
+    std::vector<ComponentList> entities
+) {
+    std::vector<EntityId> entityIds;
+    entityIds.reserve(entities.size());
+    for (size_t i = 0; i < entities.size(); ++i) {
+        entityIds.push_back(this->generateNewId());
+    }
+    m_impl->insertEntities(entityIds.data(), entities.data(), entities.size());
+    return entityIds;
 }
 
-EntityManager::~EntityManager() {
-}
 
-Component*
-EntityManager::addComponent(
+void
+EntityManager::deferAddComponent(
     EntityId entityId,
     std::unique_ptr<Component> component
 ) {
     assert(entityId != NULL_ENTITY);
-    ComponentTypeId typeId = component->typeId();
-    auto& componentCollection = m_impl->getComponentCollection(typeId);
-    Component* rawComponent = component.get();
-    bool isNew = componentCollection.addComponent(
-        entityId, 
-        std::move(component)
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    m_impl->m_commands.emplace_back(
+        Implementation::Command::Type::AddComponent,
+        entityId
     );
-    if (isNew) {
-        m_impl->m_entities[entityId] += 1;
-    }
-    return rawComponent;
+    m_impl->m_commands.back().m_components.push_back(std::move(component));
 }
 
 
-void
-EntityManager::clear() {
-    for (auto& pair : m_impl->m_collections) {
-        pair.second->clear();
-    }
-    m_impl->m_componentsToRemove.clear();
-    m_impl->m_entities.clear();
-    m_impl->m_entitiesToRemove.clear();
-    m_impl->m_namedIds.clear();
-    m_impl->m_volatileEntities.clear();
+EntityId
+EntityManager::deferCreateEntity(
+    ComponentList components
+) {
+    EntityId entityId = this->generateNewId();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    m_impl->m_commands.emplace_back(
+        Implementation::Command::Type::CreateEntity,
+        entityId
+    );
+    m_impl->m_commands.back().m_components = std::move(components);
+    return entityId;
 }
 
 
 std::unordered_set<EntityId>
 EntityManager::entities() {
     std::unordered_set<EntityId> entities;
-    for (const auto& pair : m_impl->m_entities) {
-        entities.insert(pair.first);
+    for (EntityId index = 1; index < m_impl->m_slots.size(); ++index) {
+        const auto& slot = m_impl->m_slots[index];
+        if (not slot.m_isFree and slot.m_archetype) {
+            entities.insert(makeEntityId(index, slot.m_generation));
+        }
     }
     return entities;
 }
 
 
+size_t
+EntityManager::entityCount() const {
+    size_t count = 0;
+    for (const auto& archetype : m_impl->m_archetypes) {
+        count += archetype->entities().size();
+    }
+    return count;
+}
+
+
 bool
 EntityManager::exists(
     EntityId entityId
 ) const {
-    return m_impl->m_entities.find(entityId) != m_impl->m_entities.end();
+    auto slot = m_impl->findSlot(entityId);
+    return slot and slot->m_archetype;
 }
 
 
 EntityId
 EntityManager::generateNewId() {
-    return m_impl->m_currentId++;
+    Implementation& impl = *m_impl;
+    IdBlock& block = threadIdBlock(impl.m_idEpoch);
+    // Recycle rather than hand out more fresh ids once enough slots are free
+    if (
+        block.m_ids.empty() or (
+            not block.m_isRecycled and
+            impl.m_freeSlotCount.load(std::memory_order_relaxed) > MIN_FREE_SLOTS
+        )
+    ) {
+        impl.refillIdBlock(block);
+    }
+    EntityId entityId = block.m_ids.back();
+    block.m_ids.pop_back();
+    return entityId;
 }
 
 
@@ -117,8 +1452,12 @@ EntityManager::getComponent(
     EntityId entityId,
     ComponentTypeId typeId
 ) {
-    auto& componentCollection = m_impl->getComponentCollection(typeId);
-    return componentCollection[entityId];
+    // Don't create missing collections, lookups may happen concurrently
+    ComponentCollection* collection = m_impl->findComponentCollection(typeId);
+    if (not collection) {
+        return nullptr;
+    }
+    return collection->get(entityId);
 }
 
 
@@ -140,17 +1479,87 @@ EntityManager::getNamedId(
     }
     else {
         EntityId newId = this->generateNewId();
+        m_impl->useSlot(newId)->m_isNamed = true;
         m_impl->m_namedIds.insert(iter, std::make_pair(name, newId));
         return newId;
     }
 }
 
 
+
+EntityId
+EntityManager::getNamedId(
+    NameId nameId
+) {
+    if (nameId == NULL_NAME) {
+        return NULL_ENTITY;
+    }
+    auto& internedIds = m_impl->m_internedIds;
+    if (nameId >= internedIds.size()) {
+        internedIds.resize(nameId + 1, NULL_ENTITY);
+    }
+    EntityId& entityId = internedIds[nameId];
+    if (entityId == NULL_ENTITY) {
+        entityId = this->getNamedId(internedNames()[nameId - 1]);
+    }
+    return entityId;
+}
+
+
+EntityManager::NameId
+EntityManager::internName(
+    const std::string& name
+) {
+    if (name.empty()) {
+        return NULL_NAME;
+    }
+    auto inserted = internedNameIds().emplace(name, NULL_NAME);
+    if (inserted.second) {
+        internedNames().push_back(name);
+        inserted.first->second = static_cast<NameId>(internedNames().size());
+    }
+    return inserted.first->second;
+}
+
+
 bool
 EntityManager::isVolatile(
     EntityId id
 ) const {
-    return m_impl->m_volatileEntities.count(id) > 0;
+    auto slot = m_impl->findSlot(id);
+    return slot and slot->m_isVolatile;
+}
+
+
+bool
+EntityManager::hasTag(
+    EntityId entityId,
+    ComponentTypeId tagId
+) const {
+    auto slot = m_impl->findSlot(entityId);
+    return slot and slot->m_archetype and slot->m_archetype->contains(tagId);
+}
+
+
+unsigned int
+EntityManager::hierarchyDepth(
+    EntityId entityId
+) const {
+    unsigned int depth = 0;
+    for (
+        EntityId ancestor = this->parent(entityId);
+        ancestor != NULL_ENTITY;
+        ancestor = this->parent(ancestor)
+    ) {
+        ++depth;
+    }
+    return depth;
+}
+
+
+uint32_t
+EntityManager::namesRevision() const {
+    return m_impl->m_namesRevision;
 }
 
 
@@ -166,31 +1575,143 @@ EntityManager::nonEmptyCollections() const {
 }
 
 
+EntityId
+EntityManager::parent(
+    EntityId entityId
+) const {
+    auto iter = m_impl->m_hierarchy.find(entityId);
+    if (iter == m_impl->m_hierarchy.end()) {
+        return NULL_ENTITY;
+    }
+    return iter->second.m_parent;
+}
+
+
 void
-EntityManager::processRemovals() {
-    for (const auto& pair : m_impl->m_componentsToRemove) {
-        EntityId entityId = pair.first;
-        ComponentTypeId typeId = pair.second;
-        auto& componentCollection = m_impl->getComponentCollection(typeId);
-        bool removed = componentCollection.removeComponent(entityId);
-        if (removed) {
-            auto iter = m_impl->m_entities.find(entityId);
-            iter->second -= 1;
-            if (iter->second == 0) {
-                m_impl->m_entities.erase(iter);
-            }
-            else {
-                assert(iter->second > 0 && "Removed component from non-existent entity");
+EntityManager::processCommands() {
+    using Command = Implementation::Command;
+    auto& commands = m_impl->m_processedCommands;
+    assert(commands.empty() && "Recursive call to processCommands()");
+    // Commands recorded while executing, e.g. by a component's destructor,
+    // are executed in another round
+    while (not m_impl->m_commands.empty()) {
+        commands.swap(m_impl->m_commands);
+        size_t index = 0;
+        while (index < commands.size()) {
+            Command& command = commands[index];
+            switch (command.m_type) {
+                case Command::Type::AddComponent:
+                    // The entity may have been removed by an earlier command
+                    if (m_impl->useSlot(command.m_entityId)) {
+                        this->addComponent(
+                            command.m_entityId,
+                            std::move(command.m_components.front())
+                        );
+                    }
+                    ++index;
+                    break;
+                case Command::Type::CreateEntity:
+                {
+                    // Consecutive creations are batched like createEntities()
+                    FrameVector<EntityId> entityIds{
+                        FrameAllocator<EntityId>(m_impl->m_frameArena)
+                    };
+                    FrameVector<ComponentList> entities{
+                        FrameAllocator<ComponentList>(m_impl->m_frameArena)
+                    };
+                    for (;
+                        index < commands.size() and 
+                            commands[index].m_type == Command::Type::CreateEntity;
+                        ++index
+                    ) {
+                        EntityId entityId = commands[index].m_entityId;
+                        ComponentList& components = commands[index].m_components;
+                        auto slot = m_impl->useSlot(entityId);
+                        if (not slot) {
+                            continue;
+                        }
+                        else if (slot->m_archetype) {
+                            // Components have been added to the id directly
+                            for (auto& component : components) {
+                                this->addComponent(entityId, std::move(component));
+                            }
+                        }
+                        else {
+                            entityIds.push_back(entityId);
+                            entities.push_back(std::move(components));
+                        }
+                    }
+                    m_impl->insertEntities(entityIds.data(), entities.data(), entities.size());
+                    break;
+                }
+                case Command::Type::RemoveComponent:
+                    m_impl->removeComponent(command.m_entityId, command.m_typeId);
+                    ++index;
+                    break;
+                case Command::Type::RemoveEntity:
+                    m_impl->removeEntity(command.m_entityId);
+                    ++index;
+                    break;
+                case Command::Type::RemoveTag:
+                    m_impl->removeTag(command.m_entityId, command.m_typeId);
+                    ++index;
+                    break;
             }
         }
+        commands.clear();
+    }
+}
+
+
+const EntityQuery&
+EntityManager::query(
+    std::vector<ComponentTypeId> typeIds
+) {
+    std::sort(typeIds.begin(), typeIds.end());
+    typeIds.erase(std::unique(typeIds.begin(), typeIds.end()), typeIds.end());
+    std::unique_ptr<EntityQuery>& query = m_impl->m_queries[typeIds];
+    if (not query) {
+        query.reset(new EntityQuery(typeIds));
     }
-    m_impl->m_componentsToRemove.clear();
-    for (EntityId entityId : m_impl->m_entitiesToRemove) {
-        for (const auto& pair : m_impl->m_collections) {
-            pair.second->removeComponent(entityId);
+    query->update(m_impl->m_archetypes);
+    return *query;
+}
+
+
+unsigned int
+EntityManager::registerMoveObserver(
+    MoveHandler onOverflow
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_movesMutex);
+    unsigned int id = m_impl->m_nextMoveObserverId++;
+    m_impl->m_moveObservers[id] = Implementation::MoveObserver{
+        m_impl->m_movesBegin + m_impl->m_moves.size(),
+        std::move(onOverflow)
+    };
+    return id;
+}
+
+
+void
+EntityManager::removeArchetypeListener(
+    ArchetypeListener* listener
+) {
+    auto& listeners = m_impl->m_archetypeListeners;
+    listeners.erase(
+        std::remove(listeners.begin(), listeners.end(), listener),
+        listeners.end()
+    );
+    for (const auto& archetype : m_impl->m_archetypes) {
+        auto& archetypeListeners = archetype->m_listeners;
+        auto iter = std::lower_bound(
+            archetypeListeners.begin(), 
+            archetypeListeners.end(), 
+            listener
+        );
+        if (iter != archetypeListeners.end() and *iter == listener) {
+            archetypeListeners.erase(iter);
         }
     }
-    m_impl->m_entitiesToRemove.clear();
 }
 
 
@@ -199,46 +1720,205 @@ EntityManager::removeComponent(
     EntityId entityId,
     ComponentTypeId typeId
 ) {
-    m_impl->m_componentsToRemove.emplace_back(entityId, typeId);
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    m_impl->m_commands.emplace_back(
+        Implementation::Command::Type::RemoveComponent,
+        entityId,
+        typeId
+    );
 }
 
+
 void
 EntityManager::removeEntity(
     EntityId entityId
 ) {
-    m_impl->m_entitiesToRemove.push_back(entityId);
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    m_impl->m_commands.emplace_back(
+        Implementation::Command::Type::RemoveEntity,
+        entityId
+    );
+}
+
+
+void
+EntityManager::removeEntities(
+    const std::vector<EntityId>& entityIds
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    auto& commands = m_impl->m_commands;
+    size_t size = commands.size() + entityIds.size();
+    if (size > commands.capacity()) {
+        commands.reserve(std::max(size, 2 * commands.capacity()));
+    }
+    for (EntityId entityId : entityIds) {
+        commands.emplace_back(
+            Implementation::Command::Type::RemoveEntity,
+            entityId
+        );
+    }
+}
+
+
+void
+EntityManager::removeTag(
+    EntityId entityId,
+    ComponentTypeId tagId
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_commandsMutex);
+    m_impl->m_commands.emplace_back(
+        Implementation::Command::Type::RemoveTag,
+        entityId,
+        tagId
+    );
 }
 
 
 void
 EntityManager::restore(
     const StorageContainer& storage,
-    const ComponentFactory& factory
+    const ComponentFactory& factory,
+    ThreadPool* threadPool
 ) {
     this->clear();
-    // Current Id
-    m_impl->m_currentId = storage.get<EntityId>("currentId");
+    // Slots
+    m_impl->m_slots.assign(
+        std::max<EntityId>(storage.get<EntityId>("slotCount"), 1),
+        Implementation::Slot()
+    );
+    m_impl->m_nextIndex.store(m_impl->m_slots.size());
+    m_impl->m_freeSlots.clear();
+    StorageList freeSlots = storage.get<StorageList>("freeSlots");
+    for (const auto& entry : freeSlots) {
+        EntityId index = entry.get<EntityId>("index");
+        auto& slot = m_impl->claimSlot(makeEntityId(index, 0));
+        slot.m_generation = entry.get<EntityId>("generation");
+        slot.m_isFree = true;
+        m_impl->m_freeSlots.push_back(makeEntityId(index, slot.m_generation));
+    }
+    m_impl->m_freeSlotCount.store(m_impl->m_freeSlots.size());
     // Named entities
     StorageList namedIds = storage.get<StorageList>("namedIds");
+    m_impl->m_namedIds.reserve(namedIds.size());
     for (const auto& entry : namedIds) {
         std::string name = entry.get<std::string>("name");
         EntityId id = entry.get<EntityId>("entityId");
+        m_impl->claimSlot(id).m_isNamed = true;
         m_impl->m_namedIds[name] = id;
     }
-    // Collections
+    // Collections. Each collection's components are loaded into its 
+    // LoadedCollection first.
+    struct LoadedCollection {
+        std::string typeName;
+        ComponentTypeId typeId;
+        StorageList rows;
+        std::vector<std::unique_ptr<Component>> components;
+    };
+    // A deque, because StorageList can't be moved without copying
+    std::deque<LoadedCollection> loadedCollections;
     StorageContainer collections = storage.get<StorageContainer>("collections");
     auto typeNames = collections.keys();
     for (const std::string& typeName : typeNames) {
-        StorageList componentList = collections.get<StorageList>(typeName);
-        for (const StorageContainer& componentStorage : componentList) {
-            auto component = factory.load(typeName, componentStorage);
+        ComponentTypeId typeId = factory.getTypeId(typeName);
+        if (typeId == NULL_COMPONENT_TYPE) {
+            // Don't even parse components that can't be loaded
+            std::cerr << "Unknown component type: " << typeName << std::endl;
+            continue;
+        }
+        StorageList rows = collectionRows(collections, typeName);
+        size_t rowCount = rows.size();
+        loadedCollections.push_back(LoadedCollection{
+            typeName,
+            typeId,
+            std::move(rows),
+            std::vector<std::unique_ptr<Component>>(rowCount)
+        });
+    }
+    auto loadRows = [&factory] (LoadedCollection& collection, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            collection.components[i] = factory.load(collection.typeName, collection.rows[i]);
+        }
+    };
+    auto isParallel = [threadPool] (const LoadedCollection& collection) {
+        return threadPool and ComponentFactory::isGlobalComponentType(collection.typeName);
+    };
+    JobCounter parallelLoads;
+    std::exception_ptr parallelError;
+    boost::mutex parallelErrorMutex;
+    for (LoadedCollection& collection : loadedCollections) {
+        if (not isParallel(collection)) {
+            continue;
+        }
+        for (size_t begin = 0; begin < collection.rows.size(); begin += RESTORE_GRAIN_SIZE) {
+            size_t end = std::min(begin + RESTORE_GRAIN_SIZE, collection.rows.size());
+            threadPool->submit(
+                [&, begin, end] () {
+                    try {
+                        loadRows(collection, begin, end);
+                    }
+                    catch (...) {
+                        boost::lock_guard<boost::mutex> lock(parallelErrorMutex);
+                        if (not parallelError) {
+                            parallelError = std::current_exception();
+                        }
+                    }
+                },
+                &parallelLoads
+            );
+        }
+    }
+    try {
+        for (LoadedCollection& collection : loadedCollections) {
+            if (not isParallel(collection)) {
+                loadRows(collection, 0, collection.rows.size());
+            }
+        }
+    }
+    catch (...) {
+        // The jobs still reference the collections
+        if (threadPool) {
+            threadPool->wait(parallelLoads);
+        }
+        throw;
+    }
+    if (threadPool) {
+        threadPool->wait(parallelLoads);
+    }
+    if (parallelError) {
+        std::rethrow_exception(parallelError);
+    }
+    // The components are gathered per entity, so that each entity is 
+    // inserted into its final archetype once and listeners are notified 
+    // once per archetype, instead of once per component.
+    std::vector<ComponentList> entityComponents(m_impl->m_slots.size());
+    for (LoadedCollection& collection : loadedCollections) {
+        m_impl->getComponentCollection(collection.typeId).reserve(
+            collection.components.size()
+        );
+        for (auto& component : collection.components) {
             EntityId owner = component->owner();
             if (owner == NULL_ENTITY) {
-                std::cerr << "Component with no entity: " << typeName << std::endl;
+                std::cerr << "Component with no entity: " << collection.typeName << std::endl;
+                continue;
+            }
+            m_impl->claimSlot(owner);
+            EntityId index = entityIndex(owner);
+            if (index >= entityComponents.size()) {
+                entityComponents.resize(index + 1);
             }
-            this->addComponent(owner, std::move(component));
+            entityComponents[index].push_back(std::move(component));
+        }
+    }
+    std::vector<EntityId> entityIds;
+    size_t entityCount = 0;
+    for (EntityId index = 1; index < entityComponents.size(); ++index) {
+        if (not entityComponents[index].empty()) {
+            entityIds.push_back(makeEntityId(index, m_impl->m_slots[index].m_generation));
+            entityComponents[entityCount] = std::move(entityComponents[index]);
+            entityCount += 1;
         }
     }
+    m_impl->insertEntities(entityIds.data(), entityComponents.data(), entityCount);
     // Components to remove
     StorageList componentsToRemove = storage.get<StorageList>("componentsToRemove");
     for (const StorageContainer& entry : componentsToRemove) {
@@ -247,6 +1927,20 @@ EntityManager::restore(
         ComponentTypeId typeId = factory.getTypeId(typeName);
         this->removeComponent(entityId, typeId);
     }
+    // Tags
+    StorageList tags = storage.get<StorageList>("tags");
+    for (const StorageContainer& entry : tags) {
+        EntityId entityId = entry.get<EntityId>("entityId");
+        m_impl->claimSlot(entityId);
+        this->addTag(entityId, ComponentFactory::registerTag(entry.get<std::string>("tag")));
+    }
+    StorageList tagsToRemove = storage.get<StorageList>("tagsToRemove");
+    for (const StorageContainer& entry : tagsToRemove) {
+        this->removeTag(
+            entry.get<EntityId>("entityId"),
+            ComponentFactory::registerTag(entry.get<std::string>("tag"))
+        );
+    }
     // Entities to remove
     StorageList entitiesToRemove = storage.get<StorageList>("entitiesToRemove");
     for (const auto& entry : entitiesToRemove) {
@@ -256,80 +1950,436 @@ EntityManager::restore(
 }
 
 
+void
+EntityManager::rollback(
+    const Snapshot& snapshot,
+    const ComponentFactory& factory,
+    ThreadPool* threadPool
+) {
+    this->restore(snapshot.storage(), factory, threadPool);
+}
+
+
+void
+EntityManager::setFrameArena(
+    FrameArena* arena
+) {
+    m_impl->m_frameArena = arena;
+}
+
+
+bool
+EntityManager::setParent(
+    EntityId child,
+    EntityId parent
+) {
+    if (not m_impl->useSlot(child)) {
+        return false;
+    }
+    if (parent != NULL_ENTITY) {
+        if (not m_impl->useSlot(parent)) {
+            return false;
+        }
+        for (
+            EntityId ancestor = parent;
+            ancestor != NULL_ENTITY;
+            ancestor = this->parent(ancestor)
+        ) {
+            if (ancestor == child) {
+                return false;
+            }
+        }
+    }
+    if (this->parent(child) == parent) {
+        return true;
+    }
+    m_impl->unlinkParent(child);
+    if (parent != NULL_ENTITY) {
+        m_impl->m_hierarchy[child].m_parent = parent;
+        m_impl->m_hierarchy[parent].m_children.push_back(child);
+    }
+    return true;
+}
+
+
+void
+EntityManager::setStorageLayout(
+    StorageLayout layout
+) {
+    m_impl->m_storageLayout = layout;
+}
+
+
 void
 EntityManager::setVolatile(
     EntityId id,
     bool isVolatile
 ) {
-    if (isVolatile) {
-        m_impl->m_volatileEntities.insert(id);
+    auto slot = m_impl->useSlot(id);
+    if (slot) {
+        slot->m_isVolatile = isVolatile;
     }
-    else {
-        m_impl->m_volatileEntities.erase(id);
+}
+
+
+EntityManager::Snapshot
+EntityManager::snapshot(
+    const ComponentFactory& factory,
+    ThreadPool* threadPool
+) {
+    using SnapshotPage = Implementation::SnapshotPage;
+    auto data = std::make_shared<Snapshot::Data>();
+    m_impl->saveBookkeeping(factory, data->m_bookkeeping);
+    // A page that can't be reused, stored anew below
+    struct PageRebuild {
+        const ComponentCollection* collection;
+        size_t begin;
+        std::shared_ptr<SnapshotPage> page;
+        std::shared_ptr<const SnapshotPage>* target;
+        bool isParallel;
+    };
+    std::vector<PageRebuild> rebuilds;
+    std::vector<ComponentTypeId> typeIds;
+    for (const auto& item : m_impl->m_collections) {
+        ComponentCollection& collection = *item.second;
+        const auto& components = collection.components();
+        const auto& entities = collection.entities();
+        auto& pages = m_impl->m_snapshotPages[item.first];
+        pages.resize((components.size() + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE);
+        // Like in storage(), only global component types don't run Lua
+        bool isParallel = threadPool and
+            ComponentFactory::isGlobalComponentType(factory.getTypeName(item.first));
+        for (size_t page = 0; page < pages.size(); ++page) {
+            size_t begin = page * SNAPSHOT_PAGE_SIZE;
+            size_t end = std::min(begin + SNAPSHOT_PAGE_SIZE, components.size());
+            std::vector<bool> isStored(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                isStored[i - begin] = not (
+                    components[i]->isVolatile() or this->isVolatile(entities[i])
+                );
+            }
+            bool hasChanges = collection.takeSnapshotChanges(begin, end);
+            // Removals move components between pages, so the page must
+            // still hold the same entities
+            const auto& cached = pages[page];
+            bool isReusable = not hasChanges and cached and
+                cached->m_isStored == isStored and
+                std::equal(
+                    entities.begin() + begin,
+                    entities.begin() + end,
+                    cached->m_entities.begin()
+                );
+            if (not isReusable) {
+                // Rebuilt by the next snapshot if storing fails
+                pages[page].reset();
+                auto newPage = std::make_shared<SnapshotPage>();
+                newPage->m_entities.assign(entities.begin() + begin, entities.begin() + end);
+                newPage->m_isStored = std::move(isStored);
+                rebuilds.push_back(PageRebuild{
+                    &collection,
+                    begin,
+                    std::move(newPage),
+                    &pages[page],
+                    isParallel
+                });
+            }
+        }
+        typeIds.push_back(item.first);
+    }
+    auto rebuildPage = [] (PageRebuild& rebuild) {
+        const auto& components = rebuild.collection->components();
+        SnapshotPage& page = *rebuild.page;
+        for (size_t i = 0; i < page.m_entities.size(); ++i) {
+            if (page.m_isStored[i]) {
+                page.m_rows.append(components[rebuild.begin + i]->storage());
+            }
+        }
+    };
+    JobCounter parallelRebuilds;
+    std::exception_ptr parallelError;
+    boost::mutex parallelErrorMutex;
+    for (PageRebuild& rebuild : rebuilds) {
+        if (not rebuild.isParallel) {
+            continue;
+        }
+        threadPool->submit(
+            [&] () {
+                try {
+                    rebuildPage(rebuild);
+                }
+                catch (...) {
+                    boost::lock_guard<boost::mutex> lock(parallelErrorMutex);
+                    if (not parallelError) {
+                        parallelError = std::current_exception();
+                    }
+                }
+            },
+            &parallelRebuilds
+        );
+    }
+    try {
+        for (PageRebuild& rebuild : rebuilds) {
+            if (not rebuild.isParallel) {
+                rebuildPage(rebuild);
+            }
+        }
+    }
+    catch (...) {
+        // The jobs still reference the pages
+        if (threadPool) {
+            threadPool->wait(parallelRebuilds);
+        }
+        throw;
     }
+    if (threadPool) {
+        threadPool->wait(parallelRebuilds);
+    }
+    if (parallelError) {
+        std::rethrow_exception(parallelError);
+    }
+    for (PageRebuild& rebuild : rebuilds) {
+        *rebuild.target = std::move(rebuild.page);
+    }
+    for (ComponentTypeId typeId : typeIds) {
+        const auto& pages = m_impl->m_snapshotPages[typeId];
+        bool hasRows = std::any_of(pages.begin(), pages.end(),
+            [] (const std::shared_ptr<const SnapshotPage>& page) {
+                return not page->m_rows.empty();
+            }
+        );
+        if (hasRows) {
+            data->m_collections.push_back(Snapshot::Data::Collection{
+                pages,
+                factory.getTypeName(typeId)
+            });
+        }
+    }
+    Snapshot snapshot;
+    snapshot.m_data = std::move(data);
+    return snapshot;
+}
+
+
+StagedWrites&
+EntityManager::stagedWrites() {
+    return m_impl->m_stagedWrites;
 }
 
 
 StorageContainer
 EntityManager::storage(
-    const ComponentFactory& factory
+    const ComponentFactory& factory,
+    ThreadPool* threadPool
 ) const {
     StorageContainer storage;
-    // Current Id
-    storage.set("currentId", m_impl->m_currentId);
-    // Collections
-    StorageContainer collections;
+    m_impl->saveBookkeeping(factory, storage);
+    // Collections. Each one is serialized into its SavedCollection first.
+    struct SavedCollection {
+        const ComponentCollection* collection;
+        std::string typeName;
+        StorageList rows;
+        StorageContainer columns;
+    };
+    // A deque, because StorageList can't be moved without copying
+    std::deque<SavedCollection> savedCollections;
     for (const auto& item : m_impl->m_collections) {
-        const auto& components = item.second->components();
-        StorageList componentList;
-        componentList.reserve(components.size());
-        for (const auto& pair : components) {
-            EntityId entityId = pair.first;
-            const std::unique_ptr<Component>& component = pair.second;
-            if (component->isVolatile() or 
-                m_impl->m_volatileEntities.count(entityId) > 0
-            ) {
+        if (not item.second->empty()) {
+            savedCollections.push_back(SavedCollection{
+                item.second.get(),
+                factory.getTypeName(item.first),
+                StorageList(),
+                StorageContainer()
+            });
+        }
+    }
+    auto saveCollection = [this] (SavedCollection& saved) {
+        const auto& components = saved.collection->components();
+        const auto& entities = saved.collection->entities();
+        saved.rows.reserve(components.size());
+        for (size_t i = 0; i < components.size(); ++i) {
+            EntityId entityId = entities[i];
+            const std::unique_ptr<Component>& component = components[i];
+            if (component->isVolatile() or this->isVolatile(entityId)) {
                 continue;
             }
-            componentList.append(component->storage());
+            saved.rows.append(component->storage());
+        }
+        if (m_impl->m_storageLayout == StorageLayout::Columns and not saved.rows.empty()) {
+            saved.columns = storageColumns(saved.rows);
+        }
+    };
+    auto isParallel = [threadPool] (const SavedCollection& saved) {
+        return threadPool and ComponentFactory::isGlobalComponentType(saved.typeName);
+    };
+    JobCounter parallelSaves;
+    std::exception_ptr parallelError;
+    boost::mutex parallelErrorMutex;
+    for (SavedCollection& saved : savedCollections) {
+        if (not isParallel(saved)) {
+            continue;
+        }
+        threadPool->submit(
+            [&] () {
+                try {
+                    saveCollection(saved);
+                }
+                catch (...) {
+                    boost::lock_guard<boost::mutex> lock(parallelErrorMutex);
+                    if (not parallelError) {
+                        parallelError = std::current_exception();
+                    }
+                }
+            },
+            &parallelSaves
+        );
+    }
+    try {
+        for (SavedCollection& saved : savedCollections) {
+            if (not isParallel(saved)) {
+                saveCollection(saved);
+            }
+        }
+    }
+    catch (...) {
+        // The jobs still reference the collections
+        if (threadPool) {
+            threadPool->wait(parallelSaves);
+        }
+        throw;
+    }
+    if (threadPool) {
+        threadPool->wait(parallelSaves);
+    }
+    if (parallelError) {
+        std::rethrow_exception(parallelError);
+    }
+    StorageContainer collections;
+    for (SavedCollection& saved : savedCollections) {
+        if (saved.rows.empty()) {
+            continue;
+        }
+        if (m_impl->m_storageLayout == StorageLayout::Columns) {
+            collections.set(saved.typeName, std::move(saved.columns));
         }
-        if (not componentList.empty()) {
-            std::string typeName = factory.getTypeName(item.first);
-            collections.set(typeName, std::move(componentList));
+        else {
+            collections.set(saved.typeName, std::move(saved.rows));
         }
     }
     storage.set("collections", std::move(collections));
-    // Components to remove
-    StorageList componentsToRemove;
-    componentsToRemove.reserve(m_impl->m_componentsToRemove.size());
-    for (const auto& pair : m_impl->m_componentsToRemove) {
-        StorageContainer pairStorage;
-        pairStorage.set("entityId", pair.first);
-        std::string typeName = factory.getTypeName(pair.second);
-        pairStorage.set("componentTypeName", typeName);
-        componentsToRemove.append(std::move(pairStorage));
-    }
-    storage.set("componentsToRemove", std::move(componentsToRemove));
-    // Entities to remove
-    StorageList entitiesToRemove;
-    entitiesToRemove.reserve(m_impl->m_entitiesToRemove.size());
-    for (EntityId entityId : m_impl->m_entitiesToRemove) {
-        StorageContainer idStorage;
-        idStorage.set("id", entityId);
-        entitiesToRemove.append(std::move(idStorage));
-    }
-    storage.set("entitiesToRemove", std::move(entitiesToRemove));
-    // Named entities
-    StorageList namedIds;
-    namedIds.reserve(m_impl->m_namedIds.size());
-    for (const auto& item : m_impl->m_namedIds) {
-        StorageContainer itemStorage;
-        itemStorage.set("name", item.first);
-        itemStorage.set("entityId", item.second);
-        namedIds.append(std::move(itemStorage));
-    }
-    storage.set("namedIds", std::move(namedIds));
     return storage;
 }
 
 
+StorageContainer
+EntityManager::storageDelta(
+    const StorageContainer& previous,
+    const StorageContainer& current
+) {
+    StorageContainer delta;
+    delta.set<EntityId>("slotCount", current.get<EntityId>("slotCount"));
+    for (const char* key : BOOKKEEPING_LISTS) {
+        delta.set(key, current.get<StorageList>(key));
+    }
+    StorageContainer previousCollections = previous.get<StorageContainer>("collections");
+    StorageContainer currentCollections = current.get<StorageContainer>("collections");
+    std::set<std::string> typeNames;
+    for (const std::string& typeName : previousCollections.keys()) {
+        typeNames.insert(typeName);
+    }
+    for (const std::string& typeName : currentCollections.keys()) {
+        typeNames.insert(typeName);
+    }
+    StorageContainer collectionChanges;
+    for (const std::string& typeName : typeNames) {
+        StorageList previousComponents = collectionRows(previousCollections, typeName);
+        StorageList currentComponents = collectionRows(currentCollections, typeName);
+        std::unordered_map<EntityId, const StorageContainer*> previousByOwner;
+        for (const auto& component : previousComponents) {
+            previousByOwner[component.get<EntityId>("owner")] = &component;
+        }
+        // Added components, or ones that lost properties, are stored whole
+        StorageList components;
+        StorageList changes;
+        StorageList removed;
+        for (const auto& component : currentComponents) {
+            EntityId owner = component.get<EntityId>("owner");
+            auto iter = previousByOwner.find(owner);
+            if (iter == previousByOwner.end()) {
+                components.append(component);
+                continue;
+            }
+            const StorageContainer& previousComponent = *iter->second;
+            previousByOwner.erase(iter);
+            StorageContainer componentChanges = component.difference(previousComponent);
+            if (componentChanges.keys().empty()) {
+                continue;
+            }
+            bool hasLostKeys = false;
+            for (const std::string& key : previousComponent.keys()) {
+                if (not component.contains(key)) {
+                    hasLostKeys = true;
+                    break;
+                }
+            }
+            if (hasLostKeys) {
+                components.append(component);
+            }
+            else {
+                componentChanges.set<EntityId>("owner", owner);
+                changes.append(std::move(componentChanges));
+            }
+        }
+        for (const auto& pair : previousByOwner) {
+            StorageContainer entry;
+            entry.set<EntityId>("owner", pair.first);
+            removed.append(std::move(entry));
+        }
+        if (components.empty() and changes.empty() and removed.empty()) {
+            continue;
+        }
+        StorageContainer typeChanges;
+        typeChanges.set("components", std::move(components));
+        typeChanges.set("changes", std::move(changes));
+        typeChanges.set("removed", std::move(removed));
+        collectionChanges.set(typeName, std::move(typeChanges));
+    }
+    delta.set("collectionChanges", std::move(collectionChanges));
+    return delta;
+}
+
+
+EntityManager::StorageLayout
+EntityManager::storageLayout() const {
+    return m_impl->m_storageLayout;
+}
+
+
+void
+EntityManager::takeMoves(
+    unsigned int observer,
+    std::vector<ArchetypeMove>& moves
+) {
+    moves.clear();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_movesMutex);
+    auto iter = m_impl->m_moveObservers.find(observer);
+    if (iter == m_impl->m_moveObservers.end()) {
+        return;
+    }
+    uint64_t end = m_impl->m_movesBegin + m_impl->m_moves.size();
+    moves.assign(
+        m_impl->m_moves.begin() + (iter->second.m_position - m_impl->m_movesBegin),
+        m_impl->m_moves.end()
+    );
+    iter->second.m_position = end;
+    m_impl->trimMoves();
+}
+
+
+void
+EntityManager::unregisterMoveObserver(
+    unsigned int observer
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_movesMutex);
+    m_impl->m_moveObservers.erase(observer);
+    m_impl->trimMoves();
+}
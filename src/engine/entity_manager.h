@@ -3,26 +3,210 @@
 #include "engine/typedefs.h"
 #include "util/make_unique.h"
 
+#include <functional>
 #include <memory>
+#include <string>
 #include <unordered_set>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
 
 namespace thrive {
 
+class Archetype;
+class ArchetypeListener;
 class Component;
 class ComponentCollection;
 class ComponentFactory;
+class ComponentMask;
+class EntityQuery;
+class FrameArena;
+class StagedWrites;
 class StorageContainer;
+class StorageList;
+class ThreadPool;
 
 /**
 * @brief Manages entities and their components
 *
 * The entity manager holds a collection of Component objects, sorted by type
 * and entity.
+*
+* Entity ids are generational: the low ENTITY_INDEX_BITS of an id are a slot 
+* index and the remaining bits are the slot's generation. Slots of removed 
+* entities are recycled with an incremented generation, so stale ids (e.g. 
+* held by scripts) can be detected.
+*
+* Additionally, entities are grouped into archetypes by their exact set of
+* component types (see Archetype). Entity filters use the archetypes to find
+* relevant entities instead of listening to each component collection.
+*
+* Structural changes can be recorded in a command buffer instead of being
+* applied right away. Removals are always deferred, additions and entity 
+* creation can be deferred with deferAddComponent() and deferCreateEntity().
+* The recorded commands are executed in order by processCommands(), which 
+* the GameState calls at its sync points. This keeps entity filters and 
+* component collections stable while systems iterate over them.
+*
+* Entities can also be tagged, see addTag(). Tags are component types 
+* without component objects, so they cost nothing per entity but still 
+* take part in archetypes and entity filters.
+*
+* Entities can be arranged in a parent / child hierarchy with setParent().
+* Removing a parent removes its children as well.
+*
+* Recording commands and generateNewId() are thread safe, so systems updated 
+* in parallel (see System) can use them. Everything else is not. A spawn
+* command recorded on a worker thread can thus be given a real id right
+* away, which the system may pass on to other commands.
 */
 class EntityManager {
 
 public:
 
+    /**
+    * @brief The components of a single entity, used for batched creation
+    */
+    using ComponentList = std::vector<std::unique_ptr<Component>>;
+
+    /**
+    * @brief Identifies a name interned with internName()
+    */
+    using NameId = uint32_t;
+
+    /**
+    * @brief Stands for the empty name
+    */
+    static const NameId NULL_NAME = 0;
+
+    /**
+    * @brief How storage() lays out the components of each collection
+    */
+    enum class StorageLayout {
+        /**
+        * @brief A StorageList with one container per component
+        */
+        Rows,
+        /**
+        * @brief One array per numeric property, see storageColumns()
+        *
+        * Smaller and faster to read for large collections of simple 
+        * components. Components are still loaded through the factory.
+        */
+        Columns
+    };
+
+    /**
+    * @brief An entity that moved between archetypes, see takeMoves()
+    */
+    struct ArchetypeMove {
+
+        /**
+        * @brief The entity that moved
+        */
+        EntityId entityId;
+
+        /**
+        * @brief The entity's previous archetype
+        *
+        * \c nullptr for entities that had no components before.
+        */
+        const Archetype* from;
+
+        /**
+        * @brief The entity's new archetype
+        *
+        * \c nullptr for entities that have no components anymore. Equal to
+        * \a from if a component was replaced.
+        */
+        const Archetype* to;
+
+        /**
+        * @brief The component type that was added, removed or replaced
+        *
+        * NULL_COMPONENT_TYPE for entities that were created with all their
+        * components or removed as a whole.
+        */
+        ComponentTypeId typeId;
+
+    };
+
+    /**
+    * @brief Receives an observer's moves when the log grows too long, see
+    * registerMoveObserver()
+    */
+    using MoveHandler = std::function<void(const std::vector<ArchetypeMove>& moves)>;
+
+    /**
+    * @brief A copy of an entity manager's state, see snapshot()
+    *
+    * Snapshots are immutable, copies share their data. They can be read
+    * from any thread, e.g. to serialize them in the background.
+    */
+    class Snapshot {
+
+    public:
+
+        /**
+        * @brief Rewrites the rows of one component type while they are
+        * assembled, see storage()
+        */
+        using RowTransform = std::function<void(const std::string& typeName, StorageList& rows)>;
+
+        /**
+        * @brief Constructs an empty snapshot
+        */
+        Snapshot();
+
+        /**
+        * @brief Whether this snapshot holds any state
+        *
+        * Only default constructed snapshots don't.
+        */
+        bool
+        isValid() const;
+
+        /**
+        * @brief The snapshot in the format of EntityManager::storage()
+        *
+        * The result uses the Rows layout and can be passed to restore(),
+        * storageDelta() or saved like any other storage.
+        *
+        * @param transform
+        *   If set, called with each component type's rows before they are
+        *   added. The snapshot itself is not changed.
+        *
+        * @throws std::logic_error if the snapshot is not valid
+        */
+        StorageContainer
+        storage(
+            const RowTransform& transform = nullptr
+        ) const;
+
+    private:
+
+        friend class EntityManager;
+
+        struct Data;
+        std::shared_ptr<const Data> m_data;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - EntityManager::query(table): Takes a table of component classes and
+    *   tag names and returns an iterator over the matching entity ids
+    * - EntityManager::namesRevision()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
     /**
     * @brief Constructor
     */
@@ -44,6 +228,9 @@ public:
     * @return
     *   The component as a non-owning pointer
     *
+    * @throws std::runtime_error
+    *   If \a entityId is stale, i.e. its entity has been removed
+    *
     * @note:
     *   Use the templated version to receive the proper type back
     */
@@ -82,24 +269,226 @@ public:
         );
     }
 
+    /**
+    * @brief Registers a listener for entities moving between archetypes
+    *
+    * The listener is immediately attached to all existing archetypes it 
+    * listens to and will be attached to matching archetypes created later.
+    * The entities already in those archetypes are \b not reported, use 
+    * archetypes() to process them.
+    *
+    * @param listener
+    *   The listener to add. Must be removed with removeArchetypeListener()
+    *   before it is destroyed.
+    */
+    void
+    addArchetypeListener(
+        ArchetypeListener* listener
+    );
+
+    /**
+    * @brief Tags an entity
+    *
+    * The entity moves to the archetype with the tag, like it does for a 
+    * new component. Entity filters that require the tag (see 
+    * EntityFilter::requireTag()) pick it up right away. If the entity 
+    * already has the tag, this function does nothing.
+    *
+    * @param entityId
+    *   The entity to tag
+    * @param tagId
+    *   The tag, see ComponentFactory::registerTag()
+    *
+    * @throws std::invalid_argument
+    *   If \a tagId is not a tag
+    * @throws std::runtime_error
+    *   If \a entityId is stale
+    */
+    void
+    addTag(
+        EntityId entityId,
+        ComponentTypeId tagId
+    );
+
+    /**
+    * @brief Applies a delta from storageDelta() to a stored entity manager
+    *
+    * @param storage
+    *   The storage that the delta was computed against. Receives the
+    *   storage that the delta was computed from.
+    * @param delta
+    *   The delta to apply
+    */
+    static void
+    applyStorageDelta(
+        StorageContainer& storage,
+        const StorageContainer& delta
+    );
+
+    /**
+    * @brief All archetypes created so far
+    *
+    * Archetypes are never destroyed, but may be empty.
+    */
+    const std::vector<std::unique_ptr<Archetype>>&
+    archetypes() const;
+
+    /**
+    * @brief The children of an entity, see setParent()
+    *
+    * @param entityId
+    *   The parent
+    *
+    * @return 
+    *   The children in the order they were attached. Empty for entities
+    *   without children and for unknown ids. Invalidated by any change to
+    *   the hierarchy.
+    */
+    const std::vector<EntityId>&
+    children(
+        EntityId entityId
+    ) const;
+
     /**
     * @brief Removes all components
     *
+    * All previously generated ids become stale.
+    *
     * Usually only used in testing.
     */
     void
     clear();
 
+    /**
+    * @brief Sorts component storage back into entity order, a bit at a time
+    *
+    * Removing entities fills the gaps with the last component of each
+    * collection and the last row of each archetype, so after a lot of
+    * churn, iterating over components no longer follows the order of the
+    * entities, and each collection and archetype is in a different order.
+    * Each step continues sorting the dense arrays of the collections and
+    * the rows of the archetypes by entity slot, where the last step left
+    * off. Systems that look up the components of the same entities in
+    * several collections then walk all of them in the same direction.
+    *
+    * The engine runs this in idle time (see IdleTasks). Must not be
+    * called while iterating over a collection or an archetype.
+    *
+    * @param budget
+    *   The number of components or rows to visit or move at most. May
+    *   be overrun by one insertion.
+    *
+    * @return
+    *   \c true if there is more to sort
+    */
+    bool
+    compactStep(
+        size_t budget = 256
+    );
+
+    /**
+    * @brief Creates a new entity with the given components
+    *
+    * Faster than adding each component separately, because the entity is
+    * put into its final archetype right away.
+    *
+    * @param components
+    *   The entity's components
+    *
+    * @return The new entity's id
+    */
+    EntityId
+    createEntity(
+        ComponentList components
+    );
+
+    /**
+    * @brief Creates many entities in one pass
+    *
+    * Each component list becomes a new entity. Entities going into the same
+    * archetype occupy consecutive rows and each interested ArchetypeListener 
+    * (e.g. an EntityFilter) is notified once per archetype with 
+    * ArchetypeListener::onEntitiesAdded instead of once per component.
+    *
+    * The change logs of the component collections still get one entry per
+    * component.
+    *
+    * @param entities
+    *   One component list per new entity. If a list contains several 
+    *   components of the same type, the last one wins.
+    *
+    * @return 
+    *   The ids of the new entities, in the same order as \a entities
+    */
+    std::vector<EntityId>
+    createEntities(
+        std::vector<ComponentList> entities
+    );
+
+    /**
+    * @brief Adds a component with the next call to processCommands()
+    *
+    * Unlike addComponent(), this doesn't change any component collection or
+    * entity filter until the commands are processed. If the entity has been
+    * removed by then, the component is discarded.
+    *
+    * @param entityId
+    *   The entity to add to
+    * @param component
+    *   The component to add
+    */
+    void
+    deferAddComponent(
+        EntityId entityId,
+        std::unique_ptr<Component> component
+    );
+
+    /**
+    * @brief Creates an entity with the next call to processCommands()
+    *
+    * The id is reserved immediately, but the entity only exists after the 
+    * commands have been processed. Consecutive deferred creations are 
+    * batched like createEntities().
+    *
+    * @param components
+    *   The entity's components
+    *
+    * @return The new entity's id
+    */
+    EntityId
+    deferCreateEntity(
+        ComponentList components
+    );
+
     /**
     * @brief Returns a set of entity ids that have at least one components
     */
     std::unordered_set<EntityId>
     entities();
 
+    /**
+    * @brief The number of entities that have at least one component
+    *
+    * Cheaper than entities().size(), only the archetypes are visited.
+    */
+    size_t
+    entityCount() const;
+
     /**
     * @brief Generates a new, unique entity id
     *
-    * This function is safe.
+    * Recycles the slot of a removed entity if enough of them are available.
+    * The returned id is still different from any id handed out before, 
+    * because the recycled slot's generation has been incremented.
+    *
+    * Each thread reserves ids in blocks, fresh ones from an atomic counter
+    * and recycled ones from the shared free list, so most calls take no
+    * lock. Which ids a thread gets thus depends on the other threads. Ids
+    * reserved but not handed out before the next clear() or storage() are
+    * skipped.
+    *
+    * @throws std::runtime_error
+    *   If all slots are in use
     *
     * @return A new entity id
     */
@@ -155,9 +544,44 @@ public:
         return static_cast<ComponentType*>(component);
     }
 
+    /**
+    * @brief The component collections created so far, in no particular 
+    * order
+    */
+    std::vector<const ComponentCollection*>
+    componentCollections() const;
+
+    /**
+    * @brief The component types of an entity
+    *
+    * Tests for several component types at once are a few bitwise 
+    * operations on the result, e.g.
+    * \code
+    * entityManager.componentMask(entityId).containsAny(ComponentMask({
+    *     SomeComponent::TYPE_ID,
+    *     OtherComponent::TYPE_ID
+    * }));
+    * \endcode
+    * Build such masks once and keep them, setting their types is the 
+    * expensive part.
+    *
+    * @return
+    *   The mask of the entity's archetype, or an empty mask if the entity
+    *   doesn't exist or has no components. Valid until the entity's 
+    *   components change.
+    */
+    const ComponentMask&
+    componentMask(
+        EntityId entityId
+    ) const;
+
     /**
     * @brief Returns a component collection
     *
+    * Creates the collection if necessary. Existing collections are found by
+    * indexing an array with the type id, which is as cheap as a lookup by a
+    * compile-time index would be.
+    *
     * @param typeId
     *   The component type the collection is holding
     *
@@ -185,6 +609,23 @@ public:
         const std::string& name
     );
 
+    /**
+    * @brief Returns the id of a named entity by its interned name
+    *
+    * Like getNamedId(const std::string&), but after the first call for
+    * a name this is an array lookup.
+    *
+    * @param nameId
+    *   The interned name, see internName()
+    *
+    * @return
+    *   The named entity's id or NULL_ENTITY for NULL_NAME
+    */
+    EntityId
+    getNamedId(
+        NameId nameId
+    );
+
     /**
     * @brief Retrieves a component, creating it if necessary
     *
@@ -224,13 +665,55 @@ public:
     * @param entityId
     *   The id to check for
     *
-    * @return \c true if the entity has at least one component, false otherwise
+    * @return 
+    *   \c true if the entity has at least one component or tag, false
+    *   otherwise. Always \c false for stale ids.
     */
     bool
     exists(
         EntityId entityId
     ) const;
 
+    /**
+    * @brief Checks whether an entity has a tag
+    *
+    * @param entityId
+    *   The entity to check
+    * @param tagId
+    *   The tag, see ComponentFactory::registerTag()
+    */
+    bool
+    hasTag(
+        EntityId entityId,
+        ComponentTypeId tagId
+    ) const;
+
+    /**
+    * @brief The number of ancestors of an entity, see setParent()
+    *
+    * Updating entities sorted by their depth guarantees that each parent
+    * is handled before its children.
+    *
+    * @param entityId
+    *   The entity to check
+    *
+    * @return 
+    *   0 for entities without parent
+    */
+    unsigned int
+    hierarchyDepth(
+        EntityId entityId
+    ) const;
+
+    /**
+    * @brief Changes whenever named entities may have new ids
+    *
+    * That is after clear() and restore(). Caches of named entity ids,
+    * like the Lua EntityCache, are invalid when this changes.
+    */
+    uint32_t
+    namesRevision() const;
+
     /**
     * @brief Returns the set of non-empty collection ids
     *
@@ -239,6 +722,24 @@ public:
     std::unordered_set<ComponentTypeId>
     nonEmptyCollections() const;
 
+    /**
+    * @brief Interns an entity name
+    *
+    * Interned names are shared by all entity managers. Look the name up
+    * once, e.g. when a system is configured, and pass the NameId to
+    * getNamedId(NameId) on every update. Not thread safe.
+    *
+    * @param name
+    *   The entity's name
+    *
+    * @return
+    *   The same id for the same name, NULL_NAME for the empty name
+    */
+    static NameId
+    internName(
+        const std::string& name
+    );
+
     /**
     * @brief Returns the volatile flag for an entity
     *
@@ -254,10 +755,98 @@ public:
     ) const;
 
     /**
-    * @brief Removes all components queued for removal
+    * @brief The parent of an entity, see setParent()
+    *
+    * @param entityId
+    *   The child
+    *
+    * @return 
+    *   The parent or NULL_ENTITY if the entity has none
+    */
+    EntityId
+    parent(
+        EntityId entityId
+    ) const;
+
+    /**
+    * @brief Executes all recorded structural changes in recording order
+    *
+    * This includes the removals queued by removeComponent() and 
+    * removeEntity() as well as deferAddComponent() and deferCreateEntity().
+    * Commands recorded while processing are executed as well before 
+    * returning.
+    */
+    void
+    processCommands();
+
+    /**
+    * @brief Finds the entities that have all of a set of component types
+    *
+    * For one-off lookups that don't justify a long-lived EntityFilter.
+    * Queries are cached per set of types for the lifetime of the entity 
+    * manager, so repeating a query only checks the archetypes created since
+    * the last call.
+    *
+    * Usage example in Lua:
+    * \code
+    * local query = {AgentEmitterComponent, OgreSceneNodeComponent}
+    * for entityId in gameState:entityManager():query(query) do
+    *     -- ...
+    * end
+    * \endcode
+    *
+    * @param typeIds
+    *   The component types and tags the entities need. Order and 
+    *   duplicates don't matter. An empty list matches all entities.
+    *
+    * @return
+    *   The cached query, valid as long as the entity manager
+    */
+    const EntityQuery&
+    query(
+        std::vector<ComponentTypeId> typeIds
+    );
+
+    /**
+    * @brief Registers an observer of the archetype move log
+    *
+    * While at least one observer is registered, every move of an entity 
+    * between archetypes is appended to a log shared by all observers. Each
+    * observer has its own position in the log and takes the moves since 
+    * its last takeMoves() in one batch. Moves are dropped once every 
+    * observer has taken them.
+    *
+    * An observer that stops taking its moves, e.g. the filter of a system
+    * that isn't updated anymore, would keep the log growing. Once the log 
+    * grows too long, the moves each observer hasn't taken yet are passed
+    * to its \a onOverflow handler instead and dropped from the log. The 
+    * handler runs on the thread that moved an entity, with the log locked,
+    * so it must not call takeMoves() or register observers.
+    *
+    * The observer starts at the end of the log, so it is up to the caller
+    * to handle the entities that already exist.
+    *
+    * @param onOverflow
+    *   Receives the moves the observer hasn't taken yet, oldest first
+    *
+    * @return 
+    *   An identifier for takeMoves() and unregisterMoveObserver()
+    */
+    unsigned int
+    registerMoveObserver(
+        MoveHandler onOverflow
+    );
+
+    /**
+    * @brief Unregisters a listener added with addArchetypeListener()
+    *
+    * @param listener
+    *   The listener to remove
     */
     void
-    processRemovals();
+    removeArchetypeListener(
+        ArchetypeListener* listener
+    );
 
     /**
     * @brief Removes a component
@@ -265,7 +854,7 @@ public:
     * If the component doesn't exist, this function does nothing.
     *
     * To allow self-removing components such as script handles, the component
-    * is only removed with the next call to EntityManager::processRemovals().
+    * is only removed with the next call to EntityManager::processCommands().
     *
     * @param entityId
     *   The component's owner
@@ -284,7 +873,9 @@ public:
     * If the entity has no components, this function does nothing.
     *
     * To allow self-removing components such as script handles, the component
-    * is only removed with the next call to EntityManager::processRemovals().
+    * is only removed with the next call to EntityManager::processCommands().
+    * After that, \a entityId is stale and its slot may be recycled. Named 
+    * entities keep their id.
     *
     * @param entityId
     *   The entity to remove
@@ -294,18 +885,128 @@ public:
         EntityId entityId
     );
 
+    /**
+    * @brief Removes all components of several entities
+    *
+    * Like calling removeEntity() for each of them, but the command buffer
+    * is locked and grown only once. For systems that despawn many 
+    * entities per update.
+    *
+    * @param entityIds
+    *   The entities to remove
+    */
+    void
+    removeEntities(
+        const std::vector<EntityId>& entityIds
+    );
+
+    /**
+    * @brief Removes a tag from an entity
+    *
+    * Like components, the tag is only removed with the next call to
+    * processCommands().
+    *
+    * @param entityId
+    *   The tagged entity
+    * @param tagId
+    *   The tag to remove
+    */
+    void
+    removeTag(
+        EntityId entityId,
+        ComponentTypeId tagId
+    );
+
     /**
     * @brief Restores the entity manager from a storage container
     *
+    * With a thread pool, components of global component types are loaded
+    * on the pool while the calling thread loads the others, which may run
+    * Lua. The loaded components are then inserted on the calling thread.
+    *
     * @param storage
     *   The storage container to restore from
     * @param factory
     *   The component factory to use
+    * @param threadPool
+    *   The thread pool for loading components, may be null
     */
     void
     restore(
         const StorageContainer& storage,
-        const ComponentFactory& factory
+        const ComponentFactory& factory,
+        ThreadPool* threadPool = nullptr
+    );
+
+    /**
+    * @brief Returns the entity manager to the state of a snapshot
+    *
+    * Like restore(), so all current entities are replaced and systems see
+    * the restored ones as new. Call only while no system is running.
+    *
+    * @param snapshot
+    *   A valid snapshot, not necessarily of this entity manager
+    * @param factory
+    *   The component factory to use
+    * @param threadPool
+    *   The thread pool for loading components, may be null
+    */
+    void
+    rollback(
+        const Snapshot& snapshot,
+        const ComponentFactory& factory,
+        ThreadPool* threadPool = nullptr
+    );
+
+    /**
+    * @brief Sets the arena that processCommands() takes scratch memory from
+    *
+    * @param arena
+    *   The arena, usually Engine::frameArena(), or \c nullptr to use the
+    *   global heap. Must outlive the entity manager.
+    */
+    void
+    setFrameArena(
+        FrameArena* arena
+    );
+
+    /**
+    * @brief Makes an entity the child of another
+    *
+    * The hierarchy is independent of components. Each entity has at most 
+    * one parent, setting a new one detaches it from the previous. When 
+    * the parent is removed, its children are removed with it during the 
+    * same processCommands().
+    *
+    * The hierarchy is not part of storage(). Systems that use it restore
+    * the links from their components, e.g. OgreSceneNodeComponent::Configuration::parentId.
+    *
+    * @param child
+    *   The child entity
+    * @param parent
+    *   The new parent or NULL_ENTITY to detach the child
+    *
+    * @return 
+    *   \c false if either id is stale or the link would make the child 
+    *   its own ancestor. The hierarchy is unchanged in that case.
+    */
+    bool
+    setParent(
+        EntityId child,
+        EntityId parent
+    );
+
+    /**
+    * @brief Sets the layout that storage() uses for component collections
+    *
+    * restore() and the delta functions accept either layout, independent 
+    * of this setting.
+    *
+    * @param layout
+    */
+    void
+    setStorageLayout(
+        StorageLayout layout
     );
 
     /**
@@ -320,19 +1021,115 @@ public:
         bool isVolatile
     );
 
+    /**
+    * @brief Takes a snapshot of the current non-volatile components
+    *
+    * Unlike storage(), consecutive snapshots share what hasn't changed in
+    * between. Each collection is split into pages of consecutive
+    * components. A page is stored anew only if one of its components was
+    * added, removed, replaced or touched since the previous snapshot, or
+    * is not change tracked (see Component::isChangeTracked()). Otherwise
+    * the snapshot shares the previous one's copy of the page. For change
+    * tracked components, taking a snapshot is therefore proportional to
+    * what changed, not to the number of entities.
+    *
+    * Must be called on the main thread while no system is running, as
+    * components may run Lua to store themselves. With a thread pool, the
+    * pages of global component types are stored by jobs, like the
+    * collections in storage().
+    *
+    * @param factory
+    *   The component factory to use for type name lookup
+    * @param threadPool
+    *   The thread pool for storing pages, may be null
+    *
+    * @return
+    *   The snapshot, see Snapshot::storage()
+    */
+    Snapshot
+    snapshot(
+        const ComponentFactory& factory,
+        ThreadPool* threadPool = nullptr
+    );
+
+    /**
+    * @brief The buffered script writes to this manager's components
+    *
+    * Cleared by clear().
+    */
+    StagedWrites&
+    stagedWrites();
+
     /**
     * @brief Serializes the current non-volatile components into a storage container
     *
+    * With a thread pool, each collection of a global component type is 
+    * serialized by its own job, while the calling thread serializes the
+    * others, which may run Lua.
+    *
     * @param factory
     *   The component factory to use for type name lookup
+    * @param threadPool
+    *   The thread pool for serializing collections, may be null
     *
     * @return 
     */
     StorageContainer
     storage(
-        const ComponentFactory& factory
+        const ComponentFactory& factory,
+        ThreadPool* threadPool = nullptr
     ) const;
 
+    /**
+    * @brief Computes the changes between two results of storage()
+    *
+    * The delta holds components that were added or removed, and only the 
+    * changed properties of the other components. Components are matched by
+    * their owner. The bookkeeping of ids is small and copied as a whole.
+    *
+    * @param previous
+    *   The older storage
+    * @param current
+    *   The newer storage
+    *
+    * @return 
+    *   A delta to pass to applyStorageDelta()
+    */
+    static StorageContainer
+    storageDelta(
+        const StorageContainer& previous,
+        const StorageContainer& current
+    );
+
+    /**
+    * @brief The layout used by storage()
+    */
+    StorageLayout
+    storageLayout() const;
+
+    /**
+    * @brief Takes the archetype moves since an observer's last call
+    *
+    * @param observer
+    *   An identifier from registerMoveObserver()
+    * @param moves
+    *   Receives the moves, oldest first. Cleared before. Moves that were 
+    *   already passed to the observer's overflow handler are not repeated.
+    */
+    void
+    takeMoves(
+        unsigned int observer,
+        std::vector<ArchetypeMove>& moves
+    );
+
+    /**
+    * @brief Unregisters an observer added with registerMoveObserver()
+    */
+    void
+    unregisterMoveObserver(
+        unsigned int observer
+    );
+
 private:
 
     struct Implementation;
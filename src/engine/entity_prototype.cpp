@@ -0,0 +1,233 @@
+#include "engine/entity_prototype.h"
+
+#include "engine/component.h"
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "game.h"
+#include "scripting/luabind.h"
+
+#include <utility>
+
+using namespace thrive;
+
+
+struct EntityPrototype::Implementation {
+
+    // Type name and storage of each component
+    std::vector<std::pair<std::string, StorageContainer>> m_components;
+
+};
+
+
+static GameState&
+getGameState(
+    GameState* gameState
+) {
+    if (gameState) {
+        return *gameState;
+    }
+    else {
+        return *Game::instance().engine().currentGameState();
+    }
+}
+
+
+static EntityId
+EntityPrototype_deferInstantiate(
+    const EntityPrototype* self,
+    GameState* gameState
+) {
+    GameState& state = getGameState(gameState);
+    return self->deferInstantiate(
+        state.entityManager(),
+        state.engine().componentFactory()
+    );
+}
+
+
+static EntityId
+EntityPrototype_deferInstantiateCurrent(
+    const EntityPrototype* self
+) {
+    return EntityPrototype_deferInstantiate(self, nullptr);
+}
+
+
+static EntityId
+EntityPrototype_instantiate(
+    const EntityPrototype* self,
+    GameState* gameState
+) {
+    GameState& state = getGameState(gameState);
+    return self->instantiate(
+        state.entityManager(),
+        state.engine().componentFactory()
+    ).front();
+}
+
+
+static EntityId
+EntityPrototype_instantiateCurrent(
+    const EntityPrototype* self
+) {
+    return EntityPrototype_instantiate(self, nullptr);
+}
+
+
+luabind::scope
+EntityPrototype::luaBindings() {
+    using namespace luabind;
+    return class_<EntityPrototype>("EntityPrototype")
+        .def(constructor<>())
+        .def(constructor<EntityId>())
+        .def(constructor<EntityId, GameState*>())
+        .def("addComponent", static_cast<void(EntityPrototype::*)(const Component&)>(&EntityPrototype::addComponent))
+        .def("clear", &EntityPrototype::clear)
+        .def("componentCount", &EntityPrototype::componentCount)
+        .def("deferInstantiate", &EntityPrototype_deferInstantiateCurrent)
+        .def("deferInstantiate", &EntityPrototype_deferInstantiate)
+        .def("instantiate", &EntityPrototype_instantiateCurrent)
+        .def("instantiate", &EntityPrototype_instantiate)
+        .def("load", &EntityPrototype::load)
+        .def("storage", &EntityPrototype::storage)
+    ;
+}
+
+
+EntityPrototype::EntityPrototype()
+  : m_impl(new Implementation())
+{
+}
+
+
+EntityPrototype::EntityPrototype(
+    EntityManager& entityManager,
+    EntityId entityId
+) : EntityPrototype()
+{
+    for (ComponentTypeId typeId : entityManager.nonEmptyCollections()) {
+        Component* component = entityManager.getComponent(entityId, typeId);
+        if (component) {
+            this->addComponent(*component);
+        }
+    }
+}
+
+
+EntityPrototype::EntityPrototype(
+    EntityId entityId,
+    GameState* gameState
+) : EntityPrototype(getGameState(gameState).entityManager(), entityId)
+{
+}
+
+
+EntityPrototype::~EntityPrototype() {}
+
+
+void
+EntityPrototype::addComponent(
+    const Component& component
+) {
+    this->addComponent(component.typeName(), component.storage());
+}
+
+
+void
+EntityPrototype::addComponent(
+    const std::string& typeName,
+    StorageContainer storage
+) {
+    for (auto& pair : m_impl->m_components) {
+        if (pair.first == typeName) {
+            pair.second = std::move(storage);
+            return;
+        }
+    }
+    m_impl->m_components.emplace_back(typeName, std::move(storage));
+}
+
+
+void
+EntityPrototype::clear() {
+    m_impl->m_components.clear();
+}
+
+
+size_t
+EntityPrototype::componentCount() const {
+    return m_impl->m_components.size();
+}
+
+
+EntityManager::ComponentList
+EntityPrototype::createComponents(
+    const ComponentFactory& factory
+) const {
+    EntityManager::ComponentList components;
+    components.reserve(m_impl->m_components.size());
+    for (const auto& pair : m_impl->m_components) {
+        std::unique_ptr<Component> component = factory.load(pair.first, pair.second);
+        if (component) {
+            components.push_back(std::move(component));
+        }
+    }
+    return components;
+}
+
+
+EntityId
+EntityPrototype::deferInstantiate(
+    EntityManager& entityManager,
+    const ComponentFactory& factory
+) const {
+    return entityManager.deferCreateEntity(this->createComponents(factory));
+}
+
+
+std::vector<EntityId>
+EntityPrototype::instantiate(
+    EntityManager& entityManager,
+    const ComponentFactory& factory,
+    size_t count
+) const {
+    std::vector<EntityManager::ComponentList> entities;
+    entities.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        entities.push_back(this->createComponents(factory));
+    }
+    return entityManager.createEntities(std::move(entities));
+}
+
+
+void
+EntityPrototype::load(
+    const StorageContainer& storage
+) {
+    m_impl->m_components.clear();
+    StorageList components = storage.get<StorageList>("components");
+    for (const StorageContainer& entry : components) {
+        this->addComponent(
+            entry.get<std::string>("typeName"),
+            entry.get<StorageContainer>("storage")
+        );
+    }
+}
+
+
+StorageContainer
+EntityPrototype::storage() const {
+    StorageList components;
+    components.reserve(m_impl->m_components.size());
+    for (const auto& pair : m_impl->m_components) {
+        StorageContainer entry;
+        entry.set<std::string>("typeName", pair.first);
+        entry.set<StorageContainer>("storage", pair.second);
+        components.append(std::move(entry));
+    }
+    StorageContainer storage;
+    storage.set<StorageList>("components", std::move(components));
+    return storage;
+}
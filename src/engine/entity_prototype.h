@@ -0,0 +1,233 @@
+#pragma once
+
+#include "engine/entity_manager.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class Component;
+class ComponentFactory;
+class GameState;
+class StorageContainer;
+
+/**
+* @brief A set of components to create new entities from
+*
+* A prototype is set up once, e.g. from an existing entity, from
+* components configured in Lua or from a StorageContainer. Instantiating
+* it creates all components of a new entity from their stored properties
+* in C++, so a script needs one call per entity instead of creating and
+* configuring each component through the bindings.
+*
+* Components are copied through their storage, like savegames do, so
+* anything that survives a savegame survives instantiation.
+*
+* Usage example in Lua:
+* \code
+* local prototype = EntityPrototype()
+* local sceneNode = OgreSceneNodeComponent()
+* sceneNode.transform.scale = Vector3(2, 2, 2)
+* prototype:addComponent(sceneNode)
+* prototype:addComponent(SomeOtherComponent())
+* for i = 1, 100 do
+*     local entityId = prototype:instantiate()
+* end
+* \endcode
+*/
+class EntityPrototype {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - EntityPrototype()
+    * - EntityPrototype(EntityId): Copies an entity of the current game state
+    * - EntityPrototype(EntityId, GameState*): Copies an entity
+    * - EntityPrototype::addComponent(Component)
+    * - EntityPrototype::clear
+    * - EntityPrototype::componentCount
+    * - EntityPrototype::deferInstantiate(): Deferred instance in the
+    *   current game state, see EntityManager::deferCreateEntity()
+    * - EntityPrototype::deferInstantiate(GameState*)
+    * - EntityPrototype::instantiate(): New entity in the current game state
+    * - EntityPrototype::instantiate(GameState*)
+    * - EntityPrototype::load
+    * - EntityPrototype::storage
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructs an empty prototype
+    */
+    EntityPrototype();
+
+    /**
+    * @brief Constructs a prototype from an existing entity
+    *
+    * @param entityManager
+    *   The entity's manager
+    * @param entityId
+    *   The entity to copy. The entity itself is left alone.
+    */
+    EntityPrototype(
+        EntityManager& entityManager,
+        EntityId entityId
+    );
+
+    /**
+    * @brief Constructs a prototype from an existing entity of a game state
+    *
+    * @param entityId
+    *   The entity to copy
+    * @param gameState
+    *   The game state the entity belongs to. If \c null, the current game
+    *   state of the global engine object is used.
+    */
+    EntityPrototype(
+        EntityId entityId,
+        GameState* gameState = nullptr
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~EntityPrototype();
+
+    /**
+    * @brief Adds a copy of a component
+    *
+    * The component is copied through Component::storage(), later changes to
+    * it don't affect the prototype. A component of the same type replaces
+    * the previous one.
+    *
+    * @param component
+    *   The component to copy
+    */
+    void
+    addComponent(
+        const Component& component
+    );
+
+    /**
+    * @brief Adds a component by its stored properties
+    *
+    * @param typeName
+    *   The component type
+    * @param storage
+    *   The properties to load the component from, see Component::load()
+    */
+    void
+    addComponent(
+        const std::string& typeName,
+        StorageContainer storage
+    );
+
+    /**
+    * @brief Removes all components
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of components of each instance
+    */
+    size_t
+    componentCount() const;
+
+    /**
+    * @brief Creates the components of one instance
+    *
+    * For callers that adjust some properties (e.g. the position) before
+    * creating the entity.
+    *
+    * @param factory
+    *   The factory to load the components through
+    *
+    * @return
+    *   The new components. Types the factory doesn't know are skipped.
+    */
+    EntityManager::ComponentList
+    createComponents(
+        const ComponentFactory& factory
+    ) const;
+
+    /**
+    * @brief Creates an instance with the next call to
+    * EntityManager::processCommands()
+    *
+    * @param entityManager
+    *   The entity manager to create the instance in
+    * @param factory
+    *   The factory to load the components through
+    *
+    * @return
+    *   The new entity's id
+    */
+    EntityId
+    deferInstantiate(
+        EntityManager& entityManager,
+        const ComponentFactory& factory
+    ) const;
+
+    /**
+    * @brief Creates new entities with the prototype's components
+    *
+    * All instances are created in one pass, see
+    * EntityManager::createEntities().
+    *
+    * @param entityManager
+    *   The entity manager to create the instances in
+    * @param factory
+    *   The factory to load the components through
+    * @param count
+    *   The number of instances
+    *
+    * @return
+    *   The ids of the new entities
+    */
+    std::vector<EntityId>
+    instantiate(
+        EntityManager& entityManager,
+        const ComponentFactory& factory,
+        size_t count = 1
+    ) const;
+
+    /**
+    * @brief Loads the prototype from a container returned by storage()
+    *
+    * Replaces all current components.
+    */
+    void
+    load(
+        const StorageContainer& storage
+    );
+
+    /**
+    * @brief Serializes the prototype
+    *
+    * The container holds a \c components list with one entry per
+    * component, each with its \c typeName and \c storage.
+    */
+    StorageContainer
+    storage() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
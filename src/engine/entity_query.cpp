@@ -0,0 +1,120 @@
+#include "engine/entity_query.h"
+
+#include "engine/archetype.h"
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// EntityQuery::Iterator
+////////////////////////////////////////////////////////////////////////////////
+
+EntityQuery::Iterator::Iterator(
+    const std::vector<const Archetype*>& archetypes,
+    size_t archetype
+) : m_archetype(archetype),
+    m_archetypes(&archetypes)
+{
+    this->skipEmpty();
+}
+
+
+void
+EntityQuery::Iterator::skipEmpty() {
+    while (
+        m_archetype < m_archetypes->size() and
+        m_row >= (*m_archetypes)[m_archetype]->size()
+    ) {
+        m_archetype += 1;
+        m_row = 0;
+    }
+}
+
+
+EntityId
+EntityQuery::Iterator::operator* () const {
+    return (*m_archetypes)[m_archetype]->entities()[m_row];
+}
+
+
+EntityQuery::Iterator&
+EntityQuery::Iterator::operator++ () {
+    m_row += 1;
+    this->skipEmpty();
+    return *this;
+}
+
+
+EntityQuery::Iterator
+EntityQuery::Iterator::operator++ (int) {
+    Iterator previous = *this;
+    ++(*this);
+    return previous;
+}
+
+
+bool
+EntityQuery::Iterator::operator== (
+    const Iterator& other
+) const {
+    return m_archetype == other.m_archetype and m_row == other.m_row;
+}
+
+
+bool
+EntityQuery::Iterator::operator!= (
+    const Iterator& other
+) const {
+    return not (*this == other);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// EntityQuery
+////////////////////////////////////////////////////////////////////////////////
+
+EntityQuery::EntityQuery(
+    const std::vector<ComponentTypeId>& typeIds
+) : m_mask(typeIds)
+{
+}
+
+
+const std::vector<const Archetype*>&
+EntityQuery::archetypes() const {
+    return m_archetypes;
+}
+
+
+EntityQuery::Iterator
+EntityQuery::begin() const {
+    return Iterator(m_archetypes, 0);
+}
+
+
+EntityQuery::Iterator
+EntityQuery::end() const {
+    return Iterator(m_archetypes, m_archetypes.size());
+}
+
+
+size_t
+EntityQuery::size() const {
+    size_t size = 0;
+    for (const Archetype* archetype : m_archetypes) {
+        size += archetype->size();
+    }
+    return size;
+}
+
+
+void
+EntityQuery::update(
+    const std::vector<std::unique_ptr<Archetype>>& archetypes
+) {
+    for (; m_checkedCount < archetypes.size(); ++m_checkedCount) {
+        const Archetype* archetype = archetypes[m_checkedCount].get();
+        if (archetype->mask().containsAll(m_mask)) {
+            m_archetypes.push_back(archetype);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "engine/component_mask.h"
+#include "engine/typedefs.h"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace thrive {
+
+class Archetype;
+
+/**
+* @brief The entities with a set of component types, see EntityManager::query()
+*
+* A query caches which archetypes match its component types. Archetypes
+* are never destroyed and entities moving between them don't change which
+* archetypes match, so the cache only has to check archetypes created
+* since the last EntityManager::query() call.
+*
+* Iterating doesn't copy any ids, it walks the rows of the matching
+* archetypes. Any structural change directly applied to the entity manager
+* invalidates running iterations. Removals are deferred until
+* EntityManager::processCommands(), so those are safe.
+*/
+class EntityQuery {
+
+public:
+
+    /**
+    * @brief Forward iterator over the entity ids of a query
+    */
+    class Iterator : public std::iterator<std::forward_iterator_tag, EntityId> {
+
+    public:
+
+        /**
+        * @brief The current entity id
+        */
+        EntityId
+        operator* () const;
+
+        /**
+        * @brief Advances to the next entity id
+        */
+        Iterator&
+        operator++ ();
+
+        /**
+        * @brief Advances to the next entity id
+        */
+        Iterator
+        operator++ (int);
+
+        /**
+        * @brief Compares positions
+        */
+        bool
+        operator== (
+            const Iterator& other
+        ) const;
+
+        /**
+        * @brief Compares positions
+        */
+        bool
+        operator!= (
+            const Iterator& other
+        ) const;
+
+    private:
+
+        friend class EntityQuery;
+
+        Iterator(
+            const std::vector<const Archetype*>& archetypes,
+            size_t archetype
+        );
+
+        // Moves past empty archetypes
+        void
+        skipEmpty();
+
+        size_t m_archetype = 0;
+
+        const std::vector<const Archetype*>* m_archetypes = nullptr;
+
+        size_t m_row = 0;
+
+    };
+
+    /**
+    * @brief The archetypes that contain all component types of the query
+    */
+    const std::vector<const Archetype*>&
+    archetypes() const;
+
+    /**
+    * @brief Iterator to the first entity id
+    */
+    Iterator
+    begin() const;
+
+    /**
+    * @brief Iterator past the last entity id
+    */
+    Iterator
+    end() const;
+
+    /**
+    * @brief The number of matching entities
+    *
+    * Sums up the sizes of the matching archetypes.
+    */
+    size_t
+    size() const;
+
+private:
+
+    friend class EntityManager;
+
+    /**
+    * @brief Constructor
+    *
+    * @param typeIds
+    *   The component types that the entities need. Tags may be included.
+    */
+    EntityQuery(
+        const std::vector<ComponentTypeId>& typeIds
+    );
+
+    /**
+    * @brief Checks the archetypes created since the last call
+    *
+    * @param archetypes
+    *   All archetypes of the entity manager, see EntityManager::archetypes()
+    */
+    void
+    update(
+        const std::vector<std::unique_ptr<Archetype>>& archetypes
+    );
+
+    std::vector<const Archetype*> m_archetypes;
+
+    // The number of archetypes checked by update()
+    size_t m_checkedCount = 0;
+
+    ComponentMask m_mask;
+
+};
+
+}
@@ -0,0 +1,42 @@
+#include "engine/event_bus.h"
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// EventCursor
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+EventCursor::luaBindings() {
+    using namespace luabind;
+    return class_<EventCursor>("EventCursor")
+        .def(constructor<>())
+        .def("missed", &EventCursor::missed)
+    ;
+}
+
+
+unsigned int
+EventCursor::missed() const {
+    return m_missed;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// EventBus
+////////////////////////////////////////////////////////////////////////////////
+
+void
+EventBus::clear() {
+    for (auto& pair : m_channels) {
+        pair.second->clear();
+    }
+}
+
+
+void
+EventBus::endFrame() {
+    for (auto& pair : m_channels) {
+        pair.second->endFrame();
+    }
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A reader's position in an EventChannel
+*
+* Each reader keeps its own cursor, so any number of systems can read the
+* same events.
+*/
+class EventCursor {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - EventCursor()
+    * - EventCursor::missed
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief The number of events dropped before this cursor got to them
+    *
+    * Events are only kept for two frames, see EventChannel.
+    */
+    unsigned int
+    missed() const;
+
+private:
+
+    template<typename Event>
+    friend class EventChannel;
+
+    uint64_t m_missed = 0;
+
+    uint64_t m_sequence = 0;
+
+};
+
+
+/**
+* @brief Type independent part of an EventChannel, for the EventBus
+*/
+class EventChannelBase {
+
+public:
+
+    /**
+    * @brief Destructor
+    */
+    virtual ~EventChannelBase() = default;
+
+    /**
+    * @brief Drops all events
+    */
+    virtual void
+    clear() = 0;
+
+    /**
+    * @brief Drops the events published before the current frame
+    */
+    virtual void
+    endFrame() = 0;
+
+};
+
+
+/**
+* @brief Events of one type that happened in the last two frames
+*
+* Systems publish what happened, e.g. that an absorber took up an agent,
+* and other systems read just those events instead of polling the state
+* of every component. The events are kept in a ring buffer that grows to
+* the busiest frame and then stops allocating.
+*
+* Events published in a frame stay readable through the end of the next
+* frame, so a reader that reads once per frame sees every event, whether
+* it is updated before or after the publisher. Readers updated less often
+* may miss events, see EventCursor::missed().
+*
+* Channels aren't thread safe. Systems that publish or read events must
+* not be updated in parallel with each other, e.g. by not declaring their
+* component access.
+*
+* @tparam Event
+*   A copyable, default constructible type
+*/
+template<typename Event>
+class EventChannel : public EventChannelBase {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - EventChannel::read (with an EventCursor, returns a table of the
+    *   events since the cursor)
+    * - EventChannel::size
+    *
+    * \a Event needs Lua bindings of its own.
+    *
+    * @param name
+    *   The Lua class name, e.g. \c "AgentAbsorbedChannel". Must outlive
+    *   the registration.
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings(
+        const char* name
+    ) {
+        using namespace luabind;
+        return class_<EventChannel<Event>>(name)
+            .def("read", &EventChannel<Event>::readTable)
+            .def("size", &EventChannel<Event>::size)
+        ;
+    }
+
+    void
+    clear() override {
+        m_firstSequence += m_size;
+        m_frameStart = m_firstSequence;
+        m_head = 0;
+        m_size = 0;
+    }
+
+    void
+    endFrame() override {
+        size_t dropped = m_frameStart - m_firstSequence;
+        m_head = (m_head + dropped) & (m_buffer.size() - 1);
+        m_size -= dropped;
+        m_firstSequence = m_frameStart;
+        m_frameStart = m_firstSequence + m_size;
+    }
+
+    /**
+    * @brief Adds an event
+    *
+    * @param event
+    */
+    void
+    publish(
+        Event event
+    ) {
+        if (m_size == m_buffer.size()) {
+            this->grow();
+        }
+        m_buffer[(m_head + m_size) & (m_buffer.size() - 1)] = std::move(event);
+        m_size += 1;
+    }
+
+    /**
+    * @brief Calls \a callback with each event the cursor hasn't seen yet
+    *
+    * The cursor is moved past the last event.
+    *
+    * @param cursor
+    * @param callback
+    *   Called with a <tt>const Event&</tt>, in the order the events were
+    *   published. Must not publish to this channel.
+    *
+    * @return
+    *   The number of events read
+    */
+    template<typename Callback>
+    size_t
+    read(
+        EventCursor& cursor,
+        Callback&& callback
+    ) const {
+        if (cursor.m_sequence < m_firstSequence) {
+            cursor.m_missed += m_firstSequence - cursor.m_sequence;
+            cursor.m_sequence = m_firstSequence;
+        }
+        uint64_t end = m_firstSequence + m_size;
+        size_t count = 0;
+        const size_t mask = m_buffer.size() - 1;
+        for (; cursor.m_sequence < end; ++cursor.m_sequence) {
+            size_t offset = cursor.m_sequence - m_firstSequence;
+            callback(m_buffer[(m_head + offset) & mask]);
+            count += 1;
+        }
+        return count;
+    }
+
+    /**
+    * @brief The number of events kept
+    */
+    size_t
+    size() const {
+        return m_size;
+    }
+
+private:
+
+    // Doubles the capacity, which stays a power of two, and moves the
+    // oldest event to the front
+    void
+    grow() {
+        std::vector<Event> buffer(std::max<size_t>(16, m_buffer.size() * 2));
+        for (size_t i = 0; i < m_size; ++i) {
+            buffer[i] = std::move(m_buffer[(m_head + i) & (m_buffer.size() - 1)]);
+        }
+        m_buffer.swap(buffer);
+        m_head = 0;
+    }
+
+    static luabind::object
+    readTable(
+        const EventChannel<Event>* self,
+        EventCursor& cursor,
+        lua_State* L
+    ) {
+        luabind::object table = luabind::newtable(L);
+        int index = 1;
+        self->read(cursor, [&] (const Event& event) {
+            table[index++] = event;
+        });
+        return table;
+    }
+
+    std::vector<Event> m_buffer;
+
+    uint64_t m_firstSequence = 0;
+
+    // The sequence number of the first event of the current frame
+    uint64_t m_frameStart = 0;
+
+    // The index of the oldest event in m_buffer
+    size_t m_head = 0;
+
+    size_t m_size = 0;
+
+};
+
+
+/**
+* @brief The event channels of a game state, one per event type
+*
+* The game state ends the frame for all channels at the end of its
+* update and drops all events when it is shut down or loaded.
+*
+* Usage:
+* \code
+* // Publisher
+* gameState->events().channel<AgentAbsorbedEvent>().publish(event);
+* // Reader, with an EventCursor member
+* gameState->events().channel<AgentAbsorbedEvent>().read(m_cursor,
+*     [] (const AgentAbsorbedEvent& event) {
+*         ...
+*     }
+* );
+* \endcode
+*/
+class EventBus {
+
+public:
+
+    /**
+    * @brief The channel of an event type, created on first use
+    *
+    * The reference stays valid for the bus' lifetime.
+    *
+    * @tparam Event
+    */
+    template<typename Event>
+    EventChannel<Event>&
+    channel() {
+        std::unique_ptr<EventChannelBase>& channel = m_channels[
+            std::type_index(typeid(Event))
+        ];
+        if (not channel) {
+            channel.reset(new EventChannel<Event>());
+        }
+        return static_cast<EventChannel<Event>&>(*channel);
+    }
+
+    /**
+    * @brief Drops the events of all channels
+    */
+    void
+    clear();
+
+    /**
+    * @brief Ends the frame for all channels
+    *
+    * See EventChannel::endFrame().
+    */
+    void
+    endFrame();
+
+private:
+
+    std::unordered_map<std::type_index, std::unique_ptr<EventChannelBase>> m_channels;
+
+};
+
+}
@@ -0,0 +1,78 @@
+#include "engine/frame_arena.h"
+
+#include <algorithm>
+#include <boost/thread/lock_guard.hpp>
+#include <cstdint>
+
+using namespace thrive;
+
+
+FrameArena::FrameArena(
+    size_t blockSize
+) : m_blockSize(blockSize)
+{
+}
+
+
+void*
+FrameArena::allocate(
+    size_t size,
+    size_t alignment
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (not m_blocks.empty()) {
+        Block& block = m_blocks.back();
+        uintptr_t address = reinterpret_cast<uintptr_t>(block.data.get()) + m_offset;
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (m_offset + padding + size <= block.size) {
+            m_offset += padding + size;
+            m_bytesUsed += padding + size;
+            return block.data.get() + m_offset - size;
+        }
+    }
+    // The array form of operator new aligns for any type
+    Block block;
+    block.size = std::max(size, m_blockSize);
+    block.data.reset(new char[block.size]);
+    m_blocks.push_back(std::move(block));
+    m_offset = size;
+    m_bytesUsed += size;
+    return m_blocks.back().data.get();
+}
+
+
+size_t
+FrameArena::bytesUsed() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bytesUsed;
+}
+
+
+size_t
+FrameArena::capacity() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    size_t capacity = 0;
+    for (const Block& block : m_blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+
+void
+FrameArena::reset() {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_blocks.size() > 1) {
+        size_t capacity = 0;
+        for (const Block& block : m_blocks) {
+            capacity += block.size;
+        }
+        m_blocks.clear();
+        Block block;
+        block.size = capacity;
+        block.data.reset(new char[capacity]);
+        m_blocks.push_back(std::move(block));
+    }
+    m_bytesUsed = 0;
+    m_offset = 0;
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A bump allocator for memory that lives for at most one frame
+*
+* Allocating advances an offset into a block, freeing does nothing. All
+* memory is released at once by reset(), which the Engine calls at the end
+* of each Engine::update(). After the first few frames the arena has a
+* single block large enough for a whole frame, and scratch memory no longer
+* touches the general-purpose heap.
+*
+* Nothing allocated from the arena may be kept beyond the frame it was
+* allocated in. Use FrameAllocator to back standard containers with it.
+*
+* Allocations are thread safe, reset() must not run concurrently with them.
+*/
+class FrameArena {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param blockSize
+    *   The minimum size of each block. Blocks are allocated on demand.
+    */
+    explicit FrameArena(
+        size_t blockSize = 64 * 1024
+    );
+
+    FrameArena(const FrameArena&) = delete;
+
+    FrameArena& operator= (const FrameArena&) = delete;
+
+    /**
+    * @brief Allocates memory until the next reset()
+    *
+    * @param size
+    * @param alignment
+    *   Must be a power of two, at most \c alignof(std::max_align_t)
+    *
+    * @throw std::bad_alloc
+    */
+    void*
+    allocate(
+        size_t size,
+        size_t alignment = alignof(std::max_align_t)
+    );
+
+    /**
+    * @brief Bytes allocated since the last reset, including padding
+    */
+    size_t
+    bytesUsed() const;
+
+    /**
+    * @brief Total size of the arena's blocks
+    */
+    size_t
+    capacity() const;
+
+    /**
+    * @brief Releases all allocations
+    *
+    * If the last frame needed more than one block, the blocks are replaced
+    * by a single one of their combined size.
+    */
+    void
+    reset();
+
+private:
+
+    struct Block {
+
+        std::unique_ptr<char[]> data;
+
+        size_t size;
+
+    };
+
+    std::vector<Block> m_blocks;
+
+    size_t m_blockSize;
+
+    size_t m_bytesUsed = 0;
+
+    mutable boost::mutex m_mutex;
+
+    // Offset into the last block
+    size_t m_offset = 0;
+
+};
+
+
+/**
+* @brief Adapts a FrameArena for standard containers
+*
+* Without an arena, the allocator falls back to the global heap, so that
+* code can use it whether or not it runs inside an engine.
+*
+* Example:
+* \code
+* FrameVector<EntityId> ids{FrameAllocator<EntityId>(&engine.frameArena())};
+* \endcode
+*/
+template<typename T>
+class FrameAllocator {
+
+public:
+
+    using value_type = T;
+
+    /**
+    * @brief Constructor
+    *
+    * @param arena
+    *   The arena to allocate from or \c nullptr to use the global heap
+    */
+    FrameAllocator(
+        FrameArena* arena = nullptr
+    ) noexcept : m_arena(arena)
+    {
+    }
+
+    /**
+    * @brief Rebinding constructor
+    */
+    template<typename U>
+    FrameAllocator(
+        const FrameAllocator<U>& other
+    ) noexcept : m_arena(other.arena())
+    {
+    }
+
+    T*
+    allocate(
+        size_t count
+    ) {
+        if (m_arena) {
+            return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    /**
+    * @brief The arena or \c nullptr
+    */
+    FrameArena*
+    arena() const noexcept {
+        return m_arena;
+    }
+
+    void
+    deallocate(
+        T* pointer,
+        size_t
+    ) noexcept {
+        // Arena memory is released by FrameArena::reset()
+        if (not m_arena) {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+
+    FrameArena* m_arena;
+
+};
+
+
+template<typename T, typename U>
+bool
+operator== (
+    const FrameAllocator<T>& lhs,
+    const FrameAllocator<U>& rhs
+) noexcept {
+    return lhs.arena() == rhs.arena();
+}
+
+
+template<typename T, typename U>
+bool
+operator!= (
+    const FrameAllocator<T>& lhs,
+    const FrameAllocator<U>& rhs
+) noexcept {
+    return lhs.arena() != rhs.arena();
+}
+
+
+/**
+* @brief A vector for scratch data of the current frame
+*/
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+}
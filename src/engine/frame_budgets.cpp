@@ -0,0 +1,177 @@
+#include "engine/frame_budgets.h"
+
+#include "scripting/luabind.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <iostream>
+
+using namespace thrive;
+
+namespace {
+
+const char* const PHASES[] = {
+    "input",
+    "gameState",
+    "luaTasks",
+    "garbageCollector",
+    "frame"
+};
+
+bool
+isPhase(
+    const std::string& name
+) {
+    for (const char* phase : PHASES) {
+        if (name == phase) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Minimum time between two warnings for the same name
+const boost::chrono::seconds WARNING_INTERVAL(1);
+
+}
+
+
+luabind::scope
+FrameBudgets::luaBindings() {
+    using namespace luabind;
+    return class_<FrameBudgets>("FrameBudgets")
+        .def("budget", &FrameBudgets::budget)
+        .def("setBudget", &FrameBudgets::setBudget)
+        .def("setTraceSnapshots", &FrameBudgets::setTraceSnapshots)
+        .def("traceSnapshots", &FrameBudgets::traceSnapshots)
+        .def("violationCount", &FrameBudgets::violationCount)
+    ;
+}
+
+
+FrameBudgets::FrameBudgets()
+  : m_frame(0),
+    m_systemBudgetCount(0),
+    m_traceSnapshots(false),
+    m_violationCount(0)
+{
+}
+
+
+void
+FrameBudgets::beginFrame(
+    unsigned long long frame
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_frame = frame;
+    m_frameViolations.clear();
+}
+
+
+uint32_t
+FrameBudgets::budget(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto iter = m_entries.find(name);
+    return iter == m_entries.end() ? 0 : iter->second.budget;
+}
+
+
+void
+FrameBudgets::check(
+    const std::string& name,
+    uint32_t microseconds
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto iter = m_entries.find(name);
+    if (iter == m_entries.end() or microseconds <= iter->second.budget) {
+        return;
+    }
+    Entry& entry = iter->second;
+    Violation violation;
+    violation.budget = entry.budget;
+    violation.frame = m_frame;
+    violation.microseconds = microseconds;
+    violation.name = name;
+    m_frameViolations.push_back(violation);
+    m_violationCount += 1;
+    auto now = boost::chrono::steady_clock::now();
+    if (now - entry.lastWarning < WARNING_INTERVAL) {
+        entry.suppressed += 1;
+        return;
+    }
+    std::cerr << "Budget exceeded: frame=" << violation.frame
+        << " name=" << name
+        << " kind=" << (isPhase(name) ? "phase" : "system")
+        << " time_us=" << microseconds
+        << " budget_us=" << entry.budget;
+    if (entry.suppressed > 0) {
+        std::cerr << " suppressed=" << entry.suppressed;
+    }
+    std::cerr << std::endl;
+    entry.lastWarning = now;
+    entry.suppressed = 0;
+}
+
+
+std::vector<FrameBudgets::Violation>
+FrameBudgets::endFrame() {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::vector<Violation> violations;
+    violations.swap(m_frameViolations);
+    return violations;
+}
+
+
+bool
+FrameBudgets::hasSystemBudgets() const {
+    return m_systemBudgetCount.load(std::memory_order_relaxed) > 0;
+}
+
+
+void
+FrameBudgets::setBudget(
+    const std::string& name,
+    uint32_t microseconds
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto iter = m_entries.find(name);
+    bool existed = iter != m_entries.end();
+    if (microseconds == 0) {
+        if (existed) {
+            m_entries.erase(iter);
+        }
+    }
+    else if (existed) {
+        iter->second.budget = microseconds;
+    }
+    else {
+        m_entries[name].budget = microseconds;
+    }
+    if (not isPhase(name) and existed and microseconds == 0) {
+        m_systemBudgetCount -= 1;
+    }
+    else if (not isPhase(name) and not existed and microseconds > 0) {
+        m_systemBudgetCount += 1;
+    }
+}
+
+
+void
+FrameBudgets::setTraceSnapshots(
+    bool enabled
+) {
+    m_traceSnapshots = enabled;
+}
+
+
+bool
+FrameBudgets::traceSnapshots() const {
+    return m_traceSnapshots;
+}
+
+
+unsigned long long
+FrameBudgets::violationCount() const {
+    return m_violationCount;
+}
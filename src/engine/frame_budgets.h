@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Time budgets for systems and frame phases
+*
+* A budget is set by name, which is either a System::name() or one of the
+* phases that the Engine times each frame:
+* - \c input: Reading or replaying keyboard and mouse
+* - \c gameState: Updating the current game state's systems, including
+*   the fixed-rate ticks and rendering
+* - \c luaTasks: Resuming the Lua tasks, see LuaTasks
+* - \c garbageCollector: The Lua garbage collector's step
+* - \c frame: All of Engine::update()
+*
+* Physics, scene node synchronisation and rendering run as systems, their
+* budgets are set by system name.
+*
+* Each time a budget is exceeded, a structured warning with the name and
+* the frame number is written to \c std::cerr. Warnings for the same name
+* are limited to one per second, with a count of the suppressed ones.
+*
+* While budgets for systems are set, the SystemScheduler times every
+* system update, like it does for an enabled SystemProfiler.
+*
+* All methods are thread safe.
+*/
+class FrameBudgets {
+
+public:
+
+    /**
+    * @brief An exceeded budget
+    */
+    struct Violation {
+
+        /**
+        * @brief The budget in microseconds
+        */
+        uint32_t budget = 0;
+
+        /**
+        * @brief The frame it happened in, see beginFrame()
+        */
+        unsigned long long frame = 0;
+
+        /**
+        * @brief The measured time in microseconds
+        */
+        uint32_t microseconds = 0;
+
+        /**
+        * @brief The system or phase
+        */
+        std::string name;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - FrameBudgets::budget
+    * - FrameBudgets::setBudget
+    * - FrameBudgets::setTraceSnapshots
+    * - FrameBudgets::traceSnapshots
+    * - FrameBudgets::violationCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    FrameBudgets();
+
+    FrameBudgets(const FrameBudgets&) = delete;
+
+    FrameBudgets& operator= (const FrameBudgets&) = delete;
+
+    /**
+    * @brief Starts a frame
+    *
+    * @param frame
+    *   The frame number reported in warnings
+    */
+    void
+    beginFrame(
+        unsigned long long frame
+    );
+
+    /**
+    * @brief The budget of a system or phase
+    *
+    * @return
+    *   The budget in microseconds, or \c 0 if there is none
+    */
+    uint32_t
+    budget(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Compares a measured time to its budget
+    *
+    * Does nothing if there is no budget for \a name.
+    *
+    * @param name
+    *   The system or phase
+    * @param microseconds
+    *   The measured time
+    */
+    void
+    check(
+        const std::string& name,
+        uint32_t microseconds
+    );
+
+    /**
+    * @brief Ends a frame
+    *
+    * @return
+    *   The budgets exceeded since beginFrame()
+    */
+    std::vector<Violation>
+    endFrame();
+
+    /**
+    * @brief Whether any budget is set for a system
+    *
+    * Cheap enough to call for every system update.
+    */
+    bool
+    hasSystemBudgets() const;
+
+    /**
+    * @brief Sets or removes a budget
+    *
+    * @param name
+    *   A System::name() or a phase, see the class description
+    * @param microseconds
+    *   The budget, or \c 0 to remove it
+    */
+    void
+    setBudget(
+        const std::string& name,
+        uint32_t microseconds
+    );
+
+    /**
+    * @brief Enables or disables trace snapshots
+    *
+    * With snapshots enabled, the Engine traces every frame and writes the
+    * trace of a frame that exceeded a budget to
+    * <tt>budget_trace_FRAME.json</tt>, at most once every few seconds.
+    * Frames traced with F8 are not snapshotted.
+    *
+    * Disabled by default.
+    */
+    void
+    setTraceSnapshots(
+        bool enabled
+    );
+
+    /**
+    * @brief Whether trace snapshots are enabled
+    */
+    bool
+    traceSnapshots() const;
+
+    /**
+    * @brief The number of budgets exceeded since construction
+    */
+    unsigned long long
+    violationCount() const;
+
+private:
+
+    struct Entry {
+
+        uint32_t budget = 0;
+
+        boost::chrono::steady_clock::time_point lastWarning;
+
+        // Violations since the last warning that were not logged
+        unsigned int suppressed = 0;
+
+    };
+
+    std::unordered_map<std::string, Entry> m_entries;
+
+    std::atomic<unsigned long long> m_frame;
+
+    // Violations since beginFrame()
+    std::vector<Violation> m_frameViolations;
+
+    mutable boost::mutex m_mutex;
+
+    // Budgets for names that aren't phases
+    std::atomic<size_t> m_systemBudgetCount;
+
+    std::atomic<bool> m_traceSnapshots;
+
+    std::atomic<unsigned long long> m_violationCount;
+
+};
+
+}
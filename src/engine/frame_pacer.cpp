@@ -0,0 +1,263 @@
+#include "engine/frame_pacer.h"
+
+#include <algorithm>
+#include <array>
+#include <boost/thread.hpp>
+#include <iomanip>
+#include <ostream>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameTimeHistogram
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const boost::chrono::microseconds::rep BUCKET_WIDTH = 250;
+
+// The last bucket collects everything above 100 ms
+const size_t BUCKET_COUNT = 400 + 1;
+
+double
+toMilliseconds(
+    boost::chrono::microseconds duration
+) {
+    return duration.count() / 1000.0;
+}
+
+}
+
+
+struct FrameTimeHistogram::Implementation {
+
+    std::array<size_t, BUCKET_COUNT> m_buckets;
+
+    size_t m_count = 0;
+
+    boost::chrono::microseconds m_maximum{0};
+
+    boost::chrono::microseconds m_totalTime{0};
+
+};
+
+
+FrameTimeHistogram::FrameTimeHistogram()
+  : m_impl(new Implementation())
+{
+    this->clear();
+}
+
+
+FrameTimeHistogram::~FrameTimeHistogram() {}
+
+
+void
+FrameTimeHistogram::addSample(
+    boost::chrono::microseconds frameTime
+) {
+    size_t bucket = std::min<size_t>(
+        std::max<boost::chrono::microseconds::rep>(frameTime.count(), 0) / BUCKET_WIDTH,
+        BUCKET_COUNT - 1
+    );
+    m_impl->m_buckets[bucket] += 1;
+    m_impl->m_count += 1;
+    m_impl->m_maximum = std::max(m_impl->m_maximum, frameTime);
+    m_impl->m_totalTime += frameTime;
+}
+
+
+void
+FrameTimeHistogram::clear() {
+    m_impl->m_buckets.fill(0);
+    m_impl->m_count = 0;
+    m_impl->m_maximum = boost::chrono::microseconds::zero();
+    m_impl->m_totalTime = boost::chrono::microseconds::zero();
+}
+
+
+size_t
+FrameTimeHistogram::count() const {
+    return m_impl->m_count;
+}
+
+
+boost::chrono::microseconds
+FrameTimeHistogram::maximum() const {
+    return m_impl->m_maximum;
+}
+
+
+boost::chrono::microseconds
+FrameTimeHistogram::mean() const {
+    if (m_impl->m_count == 0) {
+        return boost::chrono::microseconds::zero();
+    }
+    return m_impl->m_totalTime / m_impl->m_count;
+}
+
+
+boost::chrono::microseconds
+FrameTimeHistogram::percentile(
+    double fraction
+) const {
+    size_t rank = std::max<size_t>(1, fraction * m_impl->m_count + 0.5);
+    size_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT - 1; ++i) {
+        seen += m_impl->m_buckets[i];
+        if (seen >= rank) {
+            return std::min(
+                boost::chrono::microseconds((i + 1) * BUCKET_WIDTH),
+                m_impl->m_maximum
+            );
+        }
+    }
+    return m_impl->m_maximum;
+}
+
+
+void
+FrameTimeHistogram::print(
+    std::ostream& stream
+) const {
+    boost::chrono::microseconds mean = this->mean();
+    double fps = mean.count() > 0 ? 1000000.0 / mean.count() : 0.0;
+    stream << std::fixed << std::setprecision(2)
+        << "Frame times (ms) over " << m_impl->m_count << " frames: "
+        << "mean " << toMilliseconds(mean)
+        << " (" << std::setprecision(1) << fps << " FPS)" << std::setprecision(2)
+        << ", p50 " << toMilliseconds(this->percentile(0.5))
+        << ", p90 " << toMilliseconds(this->percentile(0.9))
+        << ", p99 " << toMilliseconds(this->percentile(0.99))
+        << ", max " << toMilliseconds(m_impl->m_maximum)
+    ;
+}
+
+
+boost::chrono::microseconds
+FrameTimeHistogram::totalTime() const {
+    return m_impl->m_totalTime;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FramePacer
+////////////////////////////////////////////////////////////////////////////////
+
+const boost::chrono::microseconds FramePacer::IDLE_INTERVAL(1000);
+
+
+struct FramePacer::Implementation {
+
+    Implementation(
+        boost::chrono::microseconds targetFrameDuration
+    ) : m_targetFrameDuration(targetFrameDuration)
+    {
+    }
+
+    FrameTimeHistogram m_histogram;
+
+    IdleCallback m_idleCallback;
+
+    bool m_isFirstFrame = true;
+
+    bool m_isVSyncEnabled = false;
+
+    Clock::time_point m_lastFrameStart;
+
+    Clock::time_point m_nextDeadline;
+
+    boost::chrono::microseconds m_spinDuration{2000};
+
+    boost::chrono::microseconds m_targetFrameDuration;
+
+};
+
+
+FramePacer::FramePacer(
+    boost::chrono::microseconds targetFrameDuration
+) : m_impl(new Implementation(targetFrameDuration))
+{
+}
+
+
+FramePacer::~FramePacer() {}
+
+
+boost::chrono::microseconds
+FramePacer::beginFrame() {
+    Clock::time_point now = Clock::now();
+    boost::chrono::microseconds elapsed = boost::chrono::microseconds::zero();
+    if (m_impl->m_isFirstFrame) {
+        m_impl->m_isFirstFrame = false;
+        m_impl->m_lastFrameStart = now;
+        m_impl->m_nextDeadline = now;
+    }
+    else {
+        elapsed = boost::chrono::duration_cast<boost::chrono::microseconds>(
+            now - m_impl->m_lastFrameStart
+        );
+        m_impl->m_histogram.addSample(elapsed);
+        // Keeps the truncated fraction for the next frame
+        m_impl->m_lastFrameStart += elapsed;
+    }
+    m_impl->m_nextDeadline += m_impl->m_targetFrameDuration;
+    if (m_impl->m_nextDeadline < now) {
+        // Too far behind, catching up would only cause a burst of frames
+        m_impl->m_nextDeadline = now + m_impl->m_targetFrameDuration;
+    }
+    return elapsed;
+}
+
+
+FrameTimeHistogram&
+FramePacer::histogram() {
+    return m_impl->m_histogram;
+}
+
+
+void
+FramePacer::setIdleCallback(
+    IdleCallback callback
+) {
+    m_impl->m_idleCallback = std::move(callback);
+}
+
+
+void
+FramePacer::setSpinDuration(
+    boost::chrono::microseconds spinDuration
+) {
+    m_impl->m_spinDuration = spinDuration;
+}
+
+
+void
+FramePacer::setVSyncEnabled(
+    bool enabled
+) {
+    m_impl->m_isVSyncEnabled = enabled;
+}
+
+
+void
+FramePacer::waitForNextFrame() {
+    if (m_impl->m_isVSyncEnabled or m_impl->m_targetFrameDuration.count() <= 0) {
+        return;
+    }
+    Clock::time_point deadline = m_impl->m_nextDeadline;
+    Clock::time_point sleepUntil = deadline - m_impl->m_spinDuration;
+    if (m_impl->m_idleCallback) {
+        for (Clock::time_point now = Clock::now(); now < sleepUntil; now = Clock::now()) {
+            Clock::time_point idleUntil = std::min(sleepUntil, now + IDLE_INTERVAL);
+            m_impl->m_idleCallback(idleUntil);
+            boost::this_thread::sleep_until(idleUntil);
+        }
+    }
+    else if (Clock::now() < sleepUntil) {
+        boost::this_thread::sleep_until(sleepUntil);
+    }
+    while (Clock::now() < deadline) {
+        boost::this_thread::yield();
+    }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+
+namespace thrive {
+
+/**
+* @brief Collects frame times for reporting
+*
+* Frame times are sorted into buckets of a quarter millisecond up to
+* 100 milliseconds. Longer frames go into a single overflow bucket, but
+* still count towards maximum() and mean().
+*/
+class FrameTimeHistogram {
+
+public:
+
+    /**
+    * @brief Constructor
+    */
+    FrameTimeHistogram();
+
+    /**
+    * @brief Destructor
+    */
+    ~FrameTimeHistogram();
+
+    /**
+    * @brief Records a frame time
+    *
+    * @param frameTime
+    */
+    void
+    addSample(
+        boost::chrono::microseconds frameTime
+    );
+
+    /**
+    * @brief Removes all samples
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of samples
+    */
+    size_t
+    count() const;
+
+    /**
+    * @brief The longest frame time
+    */
+    boost::chrono::microseconds
+    maximum() const;
+
+    /**
+    * @brief The average frame time
+    */
+    boost::chrono::microseconds
+    mean() const;
+
+    /**
+    * @brief Estimates a percentile of the frame times
+    *
+    * @param fraction
+    *   The percentile as a fraction in <tt>[0, 1]</tt>, e.g. \c 0.99 for
+    *   the 99th percentile
+    *
+    * @return
+    *   The upper bound of the bucket containing the percentile, or the
+    *   maximum if it falls into the overflow bucket
+    */
+    boost::chrono::microseconds
+    percentile(
+        double fraction
+    ) const;
+
+    /**
+    * @brief Writes a one line summary
+    *
+    * @param stream
+    */
+    void
+    print(
+        std::ostream& stream
+    ) const;
+
+    /**
+    * @brief The sum of all frame times
+    */
+    boost::chrono::microseconds
+    totalTime() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
+/**
+* @brief Keeps the game loop at a target frame rate
+*
+* Frames are scheduled on a fixed grid of deadlines instead of sleeping
+* for the remaining frame time, so oversleeping in one frame doesn't delay
+* all the following ones. When a frame is late by more than a whole frame,
+* the grid restarts from the current time.
+*
+* The operating system's sleep is too coarse to hit a deadline precisely,
+* so the pacer sleeps until shortly before the deadline and yields for the
+* rest of the time.
+*
+* Usage:
+* \code
+* FramePacer pacer(boost::chrono::microseconds(16667));
+* while (running) {
+*     auto elapsed = pacer.beginFrame();
+*     update(elapsed);
+*     pacer.waitForNextFrame();
+* }
+* \endcode
+*/
+class FramePacer {
+
+public:
+
+    using Clock = boost::chrono::steady_clock;
+
+    /**
+    * @brief Called while waiting for the next frame
+    *
+    * Receives the time until which it may run. The pacer sleeps for
+    * whatever is left of it afterwards.
+    */
+    using IdleCallback = std::function<void(Clock::time_point)>;
+
+    /**
+    * @brief The longest sleep between two idle callbacks
+    */
+    static const boost::chrono::microseconds IDLE_INTERVAL;
+
+    /**
+    * @brief Constructor
+    *
+    * @param targetFrameDuration
+    *   The time between the start of two frames. With \c 0, the pacer
+    *   never waits.
+    */
+    FramePacer(
+        boost::chrono::microseconds targetFrameDuration
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~FramePacer();
+
+    /**
+    * @brief Starts a new frame
+    *
+    * Adds the duration of the previous frame to histogram().
+    *
+    * @return
+    *   The time since the previous call, or \c 0 on the first call
+    */
+    boost::chrono::microseconds
+    beginFrame();
+
+    /**
+    * @brief The durations of the frames so far
+    *
+    * Each frame is measured from one call to beginFrame() to the next.
+    */
+    FrameTimeHistogram&
+    histogram();
+
+    /**
+    * @brief Sets a function to call while waiting for the next frame
+    *
+    * Instead of sleeping through the whole wait, the pacer then calls 
+    * \a callback at least every IDLE_INTERVAL until it starts spinning,
+    * e.g. to take input events as they arrive or to run IdleTasks. The
+    * callback should return by the time it receives, it delays the next 
+    * frame otherwise.
+    *
+    * @param callback
+    *   The function to call, or an empty function for none
+    */
+    void
+    setIdleCallback(
+        IdleCallback callback
+    );
+
+    /**
+    * @brief Sets how long before a deadline sleeping turns into spinning
+    *
+    * Longer times hit the deadline more reliably, but burn more CPU time.
+    * Defaults to 2 milliseconds.
+    *
+    * @param spinDuration
+    */
+    void
+    setSpinDuration(
+        boost::chrono::microseconds spinDuration
+    );
+
+    /**
+    * @brief Sets whether the frame rate is already limited by vertical sync
+    *
+    * With vertical sync, the buffer swap blocks until the display is
+    * ready and waitForNextFrame() returns immediately.
+    *
+    * @param enabled
+    */
+    void
+    setVSyncEnabled(
+        bool enabled
+    );
+
+    /**
+    * @brief Blocks until the next frame is due
+    */
+    void
+    waitForNextFrame();
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
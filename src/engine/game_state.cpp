@@ -1,65 +1,407 @@
 #include "engine/game_state.h"
 
+#include "bullet/bullet_ogre_conversion.h"
+#include "bullet/collision_shape.h"
+#include "engine/creation_queue.h"
+#include "engine/double_buffer.h"
 #include "engine/engine.h"
 #include "engine/entity_manager.h"
+#include "engine/event_bus.h"
+#include "engine/logger.h"
 #include "engine/serialization.h"
 #include "engine/system.h"
-
+#include "engine/system_profiler.h"
+#include "engine/system_scheduler.h"
+#include "engine/thread_pool.h"
+#include "engine/tracer.h"
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
 #include <btBulletDynamicsCommon.h>
+#include <OgreException.h>
 #include <OgreRoot.h>
 
+// The multithreaded world only exists in Bullet 2.87 and newer, and only 
+// works if Bullet and everything using it are built with BT_THREADSAFE
+#if BT_BULLET_VERSION >= 287 && defined(BT_THREADSAFE)
+#define THRIVE_MULTITHREADED_PHYSICS
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <LinearMath/btThreads.h>
+#endif
+
 using namespace thrive;
 
+#ifdef THRIVE_MULTITHREADED_PHYSICS
+namespace {
+
+// Runs Bullet's parallel loops on the engine's thread pool
+class ThreadPoolTaskScheduler : public btITaskScheduler {
+
+public:
+
+    ThreadPoolTaskScheduler(
+        ThreadPool& threadPool
+    ) : btITaskScheduler("ThreadPool"),
+        m_threadPool(threadPool)
+    {
+    }
+
+    int
+    getMaxNumThreads() const override {
+        return this->getNumThreads();
+    }
+
+    int
+    getNumThreads() const override {
+        // The workers and the thread calling stepSimulation()
+        return m_threadPool.threadCount() + 1;
+    }
+
+    void
+    setNumThreads(
+        int
+    ) override {
+        // The thread pool's size is fixed by the engine
+    }
+
+    void
+    parallelFor(
+        int iBegin,
+        int iEnd,
+        int grainSize,
+        const btIParallelForBody& body
+    ) override {
+        if (iEnd <= iBegin) {
+            return;
+        }
+        m_threadPool.parallelFor(
+            iEnd - iBegin,
+            std::max(grainSize, 1),
+            [iBegin, &body](size_t begin, size_t end) {
+                body.forLoop(iBegin + int(begin), iBegin + int(end));
+            }
+        );
+    }
+
+#if BT_BULLET_VERSION >= 288
+    btScalar
+    parallelSum(
+        int iBegin,
+        int iEnd,
+        int grainSize,
+        const btIParallelSumBody& body
+    ) override {
+        if (iEnd <= iBegin) {
+            return btScalar(0);
+        }
+        boost::mutex mutex;
+        btScalar sum = 0;
+        m_threadPool.parallelFor(
+            iEnd - iBegin,
+            std::max(grainSize, 1),
+            [iBegin, &body, &mutex, &sum](size_t begin, size_t end) {
+                btScalar partialSum = body.sumLoop(iBegin + int(begin), iBegin + int(end));
+                boost::lock_guard<boost::mutex> lock(mutex);
+                sum += partialSum;
+            }
+        );
+        return sum;
+    }
+#endif
+
+private:
+
+    ThreadPool& m_threadPool;
+
+};
+
+
+// Bullet has a single global task scheduler, so all game states share it
+void
+useThreadPoolTaskScheduler(
+    ThreadPool& threadPool
+) {
+    // Game states may build their physics worlds in parallel, the static's
+    // initialization is thread safe
+    static ThreadPoolTaskScheduler* scheduler = [&threadPool] () {
+        auto instance = new ThreadPoolTaskScheduler(threadPool);
+        btSetTaskScheduler(instance);
+        return instance;
+    }();
+    (void) scheduler;
+}
+
+}
+#endif
+
+namespace {
+
+// Logs the message a failed Lua call left on the stack
+void
+logLuaError(
+    const luabind::error& error
+) {
+    static LogChannel& log = Logger::instance().channel("scripts");
+    std::ostringstream message;
+    message << luabind::object(luabind::from_stack(error.state(), -1));
+    log.error(message.str());
+}
+
+}
+
 struct GameState::Implementation {
 
     Implementation(
         Engine& engine,
         std::string name,
         std::vector<std::unique_ptr<System>> systems,
-        Initializer initializer
+        Initializer initializer,
+        const Options& options
     ) : m_engine(engine),
         m_initializer(initializer),
         m_name(name),
+        m_options(options),
         m_systems(std::move(systems))
     {
+        m_entityManager.setFrameArena(&engine.frameArena());
+        m_creationQueue.setBudget(
+            static_cast<Milliseconds>(options.creationBudget),
+            options.maxCreationsPerFrame
+        );
+    }
+
+    std::unique_ptr<btBroadphaseInterface>
+    createBroadphase() const {
+        if (m_options.broadphase == Options::Broadphase::Dbvt) {
+            return std::unique_ptr<btBroadphaseInterface>(new btDbvtBroadphase());
+        }
+        btVector3 worldMin = ogreToBullet(m_options.worldMin);
+        btVector3 worldMax = ogreToBullet(m_options.worldMax);
+        // The 16 bit variant stores proxy handles in unsigned shorts, the
+        // largest of which is reserved
+        if (m_options.maxBroadphaseProxies < 16384) {
+            return std::unique_ptr<btBroadphaseInterface>(new btAxisSweep3(
+                worldMin,
+                worldMax,
+                static_cast<unsigned short>(m_options.maxBroadphaseProxies)
+            ));
+        }
+        return std::unique_ptr<btBroadphaseInterface>(new bt32BitAxisSweep3(
+            worldMin,
+            worldMax,
+            m_options.maxBroadphaseProxies
+        ));
     }
 
     void
     setupPhysics() {
         m_physics.collisionConfiguration.reset(new btDefaultCollisionConfiguration());
-        m_physics.dispatcher.reset(new btCollisionDispatcher(
-            m_physics.collisionConfiguration.get()
-        ));
-        m_physics.broadphase.reset(new btDbvtBroadphase());
-        m_physics.solver.reset(new btSequentialImpulseConstraintSolver());
-        m_physics.world.reset(new btDiscreteDynamicsWorld(
-            m_physics.dispatcher.get(),
-            m_physics.broadphase.get(),
-            m_physics.solver.get(),
-            m_physics.collisionConfiguration.get()
-        ));
+        m_physics.broadphase = this->createBroadphase();
+        m_physics.isMultithreaded = false;
+        if (m_options.multithreadedPhysics) {
+#ifdef THRIVE_MULTITHREADED_PHYSICS
+            ThreadPool& threadPool = m_engine.threadPool();
+            useThreadPoolTaskScheduler(threadPool);
+            unsigned int solverCount = m_options.physicsSolverPoolSize;
+            if (solverCount == 0) {
+                solverCount = threadPool.threadCount() + 1;
+            }
+            m_physics.dispatcher.reset(new btCollisionDispatcherMt(
+                m_physics.collisionConfiguration.get()
+            ));
+            std::unique_ptr<btConstraintSolverPoolMt> solverPool(
+                new btConstraintSolverPoolMt(solverCount)
+            );
+            m_physics.world.reset(new btDiscreteDynamicsWorldMt(
+                m_physics.dispatcher.get(),
+                m_physics.broadphase.get(),
+                solverPool.get(),
+#if BT_BULLET_VERSION >= 288
+                nullptr,
+#endif
+                m_physics.collisionConfiguration.get()
+            ));
+            m_physics.solver = std::move(solverPool);
+            m_physics.isMultithreaded = true;
+#else
+            std::cerr << "Warning: Bullet was built without multithreading "
+                "support, game state " << m_name << " uses a single "
+                "threaded physics world" << std::endl;
+#endif
+        }
+        if (not m_physics.isMultithreaded) {
+            m_physics.dispatcher.reset(new btCollisionDispatcher(
+                m_physics.collisionConfiguration.get()
+            ));
+            m_physics.solver.reset(new btSequentialImpulseConstraintSolver());
+            m_physics.world.reset(new btDiscreteDynamicsWorld(
+                m_physics.dispatcher.get(),
+                m_physics.broadphase.get(),
+                m_physics.solver.get(),
+                m_physics.collisionConfiguration.get()
+            ));
+        }
         m_physics.world->setGravity(btVector3(0,0,0));
+        btContactSolverInfo& solverInfo = m_physics.world->getSolverInfo();
+        if (m_options.physicsSolverIterations > 0) {
+            solverInfo.m_numIterations = m_options.physicsSolverIterations;
+        }
+        else if (m_options.planarPhysics) {
+            solverInfo.m_numIterations = PLANAR_SOLVER_ITERATIONS;
+        }
     }
 
     void
     setupSceneManager() {
-        m_sceneManager = m_engine.ogreRoot()->createSceneManager(
-            Ogre::ST_GENERIC,
-            m_name
-        );
+        Ogre::Root* root = m_engine.ogreRoot();
+        if (m_options.sceneManager == Options::SceneManagerType::Octree) {
+            try {
+                m_sceneManager = root->createSceneManager(
+                    "OctreeSceneManager",
+                    m_name
+                );
+            }
+            catch (const Ogre::Exception& e) {
+                std::cerr << "Warning: The octree scene manager is not available, using the generic one: "
+                          << e.getDescription() << std::endl;
+            }
+        }
+        if (m_sceneManager) {
+            Ogre::AxisAlignedBox bounds(m_options.worldMin, m_options.worldMax);
+            int depth = static_cast<int>(m_options.sceneDepth);
+            m_sceneManager->setOption("Size", &bounds);
+            m_sceneManager->setOption("Depth", &depth);
+        }
+        else {
+            m_sceneManager = root->createSceneManager(
+                Ogre::ST_GENERIC,
+                m_name
+            );
+        }
         m_sceneManager->setAmbientLight(
             Ogre::ColourValue(0.5, 0.5, 0.5)
         );
     }
 
+    bool
+    isHeadless() const {
+        return m_options.headless or m_engine.isHeadless();
+    }
+
+    // Graphical systems are left out of headless game states
+    bool
+    isIncluded(
+        const System& system
+    ) const {
+        return not (system.isGraphical() and this->isHeadless());
+    }
+
+    // Duration of the next tick, rounded such that the ticks of each second
+    // add up to 1000 milliseconds
+    int
+    nextTickDuration() const {
+        unsigned int tick = m_tickCount % m_tickRate;
+        return ((tick + 1) * 1000) / m_tickRate - (tick * 1000) / m_tickRate;
+    }
+
+    // Runs the ticks that the frame's time is worth
+    void
+    runTicks(
+        int milliseconds
+    ) {
+        // One tick is worth 1000 units of accumulated time
+        m_accumulatedTime += 
+            static_cast<unsigned long long>(milliseconds) * m_tickRate;
+        unsigned int ticks = 0;
+        while (m_accumulatedTime >= 1000) {
+            if (ticks == m_maxTicksPerFrame) {
+                // Give up on catching up
+                m_accumulatedTime %= 1000;
+                break;
+            }
+            m_fixedRateScheduler->update(
+                this->nextTickDuration()
+            );
+            // Sync point for changes recorded during the tick
+            m_entityManager.processCommands();
+            m_accumulatedTime -= 1000;
+            m_tickCount += 1;
+            ticks += 1;
+        }
+    }
+
+    // Renders the Ogre scene while a worker runs the next frame's ticks
+    void
+    runTicksWhileRendering(
+        int milliseconds
+    ) {
+        ThreadPool& threadPool = m_engine.threadPool();
+        JobCounter ticksDone;
+        std::exception_ptr tickError;
+        threadPool.submit(
+            [this, milliseconds, &tickError] () {
+                try {
+                    this->runTicks(milliseconds);
+                }
+                catch (...) {
+                    tickError = std::current_exception();
+                }
+            },
+            &ticksDone
+        );
+        std::exception_ptr renderError;
+        try {
+            m_renderScheduler->update(milliseconds);
+        }
+        catch (...) {
+            renderError = std::current_exception();
+        }
+        // Without worker threads, the ticks run here, after rendering
+        threadPool.wait(ticksDone);
+        if (renderError) {
+            std::rethrow_exception(renderError);
+        }
+        if (tickError) {
+            std::rethrow_exception(tickError);
+        }
+    }
+
+    // Elapsed time not yet consumed by ticks, in 1/m_tickRate milliseconds
+    unsigned long long m_accumulatedTime = 0;
+
     Engine& m_engine;
 
     EntityManager m_entityManager;
 
+    EventBus m_events;
+
+    // Updates the fixed-rate systems
+    std::unique_ptr<SystemScheduler> m_fixedRateScheduler;
+
+    // Updates the other systems if there is a tick rate
+    std::unique_ptr<SystemScheduler> m_frameScheduler;
+
     Initializer m_initializer;
 
     std::string m_name;
 
+    Options m_options;
+
+    // Updates the rendering systems with pipelined rendering
+    std::unique_ptr<SystemScheduler> m_renderScheduler;
+
+    bool m_isInitialized = false;
+
+    // Whether an included system is main thread only
+    bool m_isMainThreadOnly = false;
+
+    // Whether the systems are suspended instead of deactivated
+    bool m_isSuspended = false;
+
     Ogre::SceneManager* m_sceneManager = nullptr;
 
     struct Physics {
@@ -70,14 +412,30 @@ struct GameState::Implementation {
 
         std::unique_ptr<btDispatcher> dispatcher;
 
+        bool isMultithreaded = false;
+
         std::unique_ptr<btConstraintSolver> solver;
 
         std::unique_ptr<btDiscreteDynamicsWorld> world;
 
     } m_physics;
 
+    CreationQueue m_creationQueue;
+
+    // Upper bound for the catch-up after a slow frame
+    unsigned int m_maxTicksPerFrame = 5;
+
+    // Updates all systems if there is no tick rate
+    std::unique_ptr<SystemScheduler> m_scheduler;
+
+    SystemProfiler m_systemProfiler;
+
     std::vector<std::unique_ptr<System>> m_systems;
 
+    unsigned long long m_tickCount = 0;
+
+    unsigned int m_tickRate = 0;
+
 };
 
 
@@ -85,7 +443,19 @@ luabind::scope
 GameState::luaBindings() {
     using namespace luabind;
     return class_<GameState>("GameState")
+        .property("creationQueue", &GameState::creationQueue)
+        .def("entityManager", &GameState::entityManager)
+        .def("isHeadless", &GameState::isHeadless)
+        .def("isInitialized", &GameState::isInitialized)
+        .def("isPhysicsAsync", &GameState::isPhysicsAsync)
+        .def("isPhysicsMultithreaded", &GameState::isPhysicsMultithreaded)
+        .def("isPhysicsPlanar", &GameState::isPhysicsPlanar)
+        .def("isSuspended", &GameState::isSuspended)
         .def("name", &GameState::name)
+        .def("setTickRate", &GameState::setTickRate)
+        .property("systemProfiler", &GameState::systemProfiler)
+        .def("tickCount", &GameState::tickCount)
+        .def("tickRate", &GameState::tickRate)
     ;
 }
 
@@ -94,8 +464,9 @@ GameState::GameState(
     Engine& engine,
     std::string name,
     std::vector<std::unique_ptr<System>> systems,
-    Initializer initializer
-) : m_impl(new Implementation(engine, name, std::move(systems), initializer))
+    Initializer initializer,
+    const Options& options
+) : m_impl(new Implementation(engine, name, std::move(systems), initializer, options))
 {
 }
 
@@ -103,19 +474,37 @@ GameState::GameState(
 GameState::~GameState() {}
 
 
+CreationQueue&
+GameState::creationQueue() {
+    return m_impl->m_creationQueue;
+}
+
+
 void
 GameState::activate() {
     for (const auto& system : m_impl->m_systems) {
-        system->activate();
+        if (not m_impl->isIncluded(*system)) {
+            continue;
+        }
+        if (m_impl->m_isSuspended) {
+            system->resume();
+        }
+        else {
+            system->activate();
+        }
     }
+    m_impl->m_isSuspended = false;
 }
 
 
 void
 GameState::deactivate() {
     for (const auto& system : m_impl->m_systems) {
-        system->deactivate();
+        if (m_impl->isIncluded(*system)) {
+            system->deactivate();
+        }
     }
+    m_impl->m_isSuspended = false;
 }
 
 
@@ -137,16 +526,114 @@ GameState::entityManager() {
 }
 
 
+EventBus&
+GameState::events() {
+    return m_impl->m_events;
+}
+
+
 void
 GameState::init() {
-    m_impl->setupPhysics();
-    m_impl->setupSceneManager();
+    if (m_impl->m_isInitialized) {
+        return;
+    }
+    this->initPhysics();
+    if (not m_impl->isHeadless()) {
+        m_impl->setupSceneManager();
+    }
+    m_impl->m_isMainThreadOnly = false;
+    std::vector<System*> systems;
+    std::vector<System*> fixedRateSystems;
+    std::vector<System*> frameSystems;
+    std::vector<System*> renderSystems;
+    std::vector<System*> rateLimitedSystems;
     for (const auto& system : m_impl->m_systems) {
+        if (not m_impl->isIncluded(*system)) {
+            continue;
+        }
+        auto rate = m_impl->m_options.updateRates.find(system->name());
+        if (rate != m_impl->m_options.updateRates.end()) {
+            system->setUpdateRate(rate->second);
+        }
+        if (system->updateRate() > 0 and not system->hasUpdatePhase()) {
+            rateLimitedSystems.push_back(system.get());
+        }
         system->init(this);
+        systems.push_back(system.get());
+        if (system->isMainThreadOnly()) {
+            m_impl->m_isMainThreadOnly = true;
+        }
+        if (system->isFixedRate()) {
+            fixedRateSystems.push_back(system.get());
+        }
+        else if (m_impl->m_options.pipelinedRendering and system->isRendering()) {
+            renderSystems.push_back(system.get());
+        }
+        else {
+            frameSystems.push_back(system.get());
+        }
+    }
+    // Spread over the frames instead of all updating in the same one
+    for (size_t i = 0; i < rateLimitedSystems.size(); ++i) {
+        System* system = rateLimitedSystems[i];
+        system->setUpdatePhase(
+            static_cast<int>(i * system->updateInterval() / rateLimitedSystems.size())
+        );
+    }
+    ThreadPool& threadPool = m_impl->m_engine.threadPool();
+    m_impl->m_scheduler.reset(new SystemScheduler(
+        std::move(systems),
+        threadPool,
+        &m_impl->m_systemProfiler,
+        &m_impl->m_engine.tracer(),
+        &m_impl->m_engine.budgets(),
+        &m_impl->m_engine.allocationTracker()
+    ));
+    m_impl->m_fixedRateScheduler.reset(new SystemScheduler(
+        std::move(fixedRateSystems),
+        threadPool,
+        &m_impl->m_systemProfiler,
+        &m_impl->m_engine.tracer(),
+        &m_impl->m_engine.budgets(),
+        &m_impl->m_engine.allocationTracker()
+    ));
+    m_impl->m_frameScheduler.reset(new SystemScheduler(
+        std::move(frameSystems),
+        threadPool,
+        &m_impl->m_systemProfiler,
+        &m_impl->m_engine.tracer(),
+        &m_impl->m_engine.budgets(),
+        &m_impl->m_engine.allocationTracker()
+    ));
+    if (m_impl->m_options.pipelinedRendering) {
+        m_impl->m_renderScheduler.reset(new SystemScheduler(
+            std::move(renderSystems),
+            threadPool,
+            &m_impl->m_systemProfiler,
+            &m_impl->m_engine.tracer(),
+            &m_impl->m_engine.budgets(),
+            &m_impl->m_engine.allocationTracker()
+        ));
     }
+    m_impl->m_isInitialized = true;
     m_impl->m_initializer();
 }
 
+
+void
+GameState::initPhysics() {
+    if (not m_impl->m_physics.world) {
+        m_impl->setupPhysics();
+    }
+}
+
+
+bool
+GameState::isMainThreadOnly() const {
+    return m_impl->m_isMainThreadOnly;
+}
+
+
 const std::vector<std::unique_ptr<System>>&
 GameState::systems() const {
     return m_impl->m_systems;
@@ -157,11 +644,21 @@ GameState::load(
     const StorageContainer& storage
 ) {
     StorageContainer entities = storage.get<StorageContainer>("entities");
+    // Missing in older savegames and in storage(), whose shapes are stored
+    // in full
+    CollisionShapeTable shapes(
+        storage.get<StorageContainer>("collisionShapes", StorageContainer())
+    );
+    CollisionShapeTable::Scope shapeScope(&shapes);
+    // Queued jobs belong to the replaced world
+    m_impl->m_creationQueue.clear();
     m_impl->m_entityManager.clear();
+    m_impl->m_events.clear();
     try {
         m_impl->m_entityManager.restore(
             entities,
-            m_impl->m_engine.componentFactory()
+            m_impl->m_engine.componentFactory(),
+            &m_impl->m_engine.threadPool()
         );
     }
     catch (const luabind::error& e) {
@@ -176,33 +673,136 @@ GameState::load(
 }
 
 
+bool
+GameState::isHeadless() const {
+    return m_impl->isHeadless();
+}
+
+
+bool
+GameState::isInitialized() const {
+    return m_impl->m_isInitialized;
+}
+
+
+bool
+GameState::isPhysicsAsync() const {
+    return m_impl->m_options.asyncPhysics;
+}
+
+
+bool
+GameState::isPhysicsMultithreaded() const {
+    return m_impl->m_physics.isMultithreaded;
+}
+
+
+bool
+GameState::isPhysicsPlanar() const {
+    return m_impl->m_options.planarPhysics;
+}
+
+
+bool
+GameState::isSuspended() const {
+    return m_impl->m_isSuspended;
+}
+
+
 std::string
 GameState::name() const {
     return m_impl->m_name;
 }
 
 
+const GameState::Options&
+GameState::options() const {
+    return m_impl->m_options;
+}
+
+
 btDiscreteDynamicsWorld*
 GameState::physicsWorld() const {
     return m_impl->m_physics.world.get();
 }
 
 
+void
+GameState::rollback(
+    const EntityManager::Snapshot& snapshot
+) {
+    try {
+        m_impl->m_entityManager.rollback(
+            snapshot,
+            m_impl->m_engine.componentFactory(),
+            &m_impl->m_engine.threadPool()
+        );
+    }
+    catch (const luabind::error& e) {
+        logLuaError(e);
+        throw;
+    }
+}
+
+
 Ogre::SceneManager*
 GameState::sceneManager() const {
     return m_impl->m_sceneManager;
 }
 
 
+void
+GameState::setTickRate(
+    unsigned int ticksPerSecond
+) {
+    m_impl->m_tickRate = ticksPerSecond;
+    m_impl->m_accumulatedTime = 0;
+    m_impl->m_tickCount = 0;
+}
+
+
 void
 GameState::shutdown() {
-    for (const auto& system : m_impl->m_systems) {
-        system->shutdown();
+    // Jobs may refer to the systems
+    m_impl->m_creationQueue.clear();
+    m_impl->m_scheduler.reset();
+    m_impl->m_fixedRateScheduler.reset();
+    m_impl->m_frameScheduler.reset();
+    m_impl->m_renderScheduler.reset();
+    if (m_impl->m_isInitialized) {
+        for (const auto& system : m_impl->m_systems) {
+            if (m_impl->isIncluded(*system)) {
+                system->shutdown();
+            }
+        }
+        m_impl->m_isInitialized = false;
+        m_impl->m_isSuspended = false;
     }
+    m_impl->m_events.clear();
+    // Prewarmed game states may have a physics world without being
+    // initialized
     m_impl->m_physics.world.reset();
-    m_impl->m_engine.ogreRoot()->destroySceneManager(
-        m_impl->m_sceneManager
-    );
+    if (m_impl->m_sceneManager) {
+        m_impl->m_engine.ogreRoot()->destroySceneManager(
+            m_impl->m_sceneManager
+        );
+        m_impl->m_sceneManager = nullptr;
+    }
+}
+
+
+EntityManager::Snapshot
+GameState::snapshot() {
+    try {
+        return m_impl->m_entityManager.snapshot(
+            m_impl->m_engine.componentFactory(),
+            &m_impl->m_engine.threadPool()
+        );
+    }
+    catch (const luabind::error& e) {
+        logLuaError(e);
+        throw;
+    }
 }
 
 
@@ -212,7 +812,8 @@ GameState::storage() const {
     StorageContainer entities;
     try {
         entities = m_impl->m_entityManager.storage(
-            m_impl->m_engine.componentFactory()
+            m_impl->m_engine.componentFactory(),
+            &m_impl->m_engine.threadPool()
         );
     }
     catch (const luabind::error& e) {
@@ -229,14 +830,78 @@ GameState::storage() const {
 }
 
 
+void
+GameState::suspend() {
+    if (not m_impl->m_options.keepResident) {
+        this->deactivate();
+        return;
+    }
+    for (const auto& system : m_impl->m_systems) {
+        if (m_impl->isIncluded(*system)) {
+            system->suspend();
+        }
+    }
+    m_impl->m_isSuspended = true;
+}
+
+
+SystemProfiler&
+GameState::systemProfiler() {
+    return m_impl->m_systemProfiler;
+}
+
+
+unsigned long long
+GameState::tickCount() const {
+    return m_impl->m_tickCount;
+}
+
+
+float
+GameState::tickInterpolation() const {
+    if (m_impl->m_tickRate == 0) {
+        return 1.0f;
+    }
+    return float(m_impl->m_accumulatedTime) / 1000.0f;
+}
+
+
+unsigned int
+GameState::tickRate() const {
+    return m_impl->m_tickRate;
+}
+
+
 void
 GameState::update(
     int milliseconds
 ) {
-    for(auto& system : m_impl->m_systems) {
-        if (system->enabled()) {
-            system->update(milliseconds);
-        }
+    Tracer::Zone zone(&m_impl->m_engine.tracer(), "GameState::update");
+    if (m_impl->m_creationQueue.size() > 0) {
+        Tracer::Zone creationZone(&m_impl->m_engine.tracer(), "CreationQueue::drain");
+        m_impl->m_creationQueue.drain();
+    }
+    // Sync point for changes recorded between frames, e.g. by input 
+    // handlers, the initializer or the creation queue
+    m_impl->m_entityManager.processCommands();
+    // Last frame's values, including the entities created since
+    DoubleBuffers::flip(m_impl->m_entityManager);
+    if (m_impl->m_systemProfiler.isCountingHardware()) {
+        m_impl->m_systemProfiler.setEntityCount(m_impl->m_entityManager.entityCount());
+    }
+    if (m_impl->m_tickRate == 0) {
+        m_impl->m_scheduler->update(milliseconds);
+    }
+    else if (m_impl->m_renderScheduler) {
+        // The frame systems show the results of the last frame's ticks
+        m_impl->m_frameScheduler->update(milliseconds);
+        m_impl->runTicksWhileRendering(milliseconds);
+    }
+    else {
+        m_impl->runTicks(milliseconds);
+        m_impl->m_frameScheduler->update(milliseconds);
     }
-    m_impl->m_entityManager.processRemovals();
+    // Sync point for changes recorded by the systems
+    m_impl->m_entityManager.processCommands();
+    m_impl->m_events.endFrame();
 }
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "engine/entity_manager.h"
+
+#include <map>
 #include <memory>
+#include <OgreVector3.h>
 #include <vector>
 #include <iostream>
 class btDiscreteDynamicsWorld;
@@ -15,10 +19,12 @@ namespace Ogre {
 
 namespace thrive {
 
+class CreationQueue;
 class Engine;
-class EntityManager;
+class EventBus;
 class StorageContainer;
 class System;
+class SystemProfiler;
 
 /**
 * @brief Represents a distinct set of active systems and entities
@@ -45,11 +51,266 @@ public:
     */
     using Initializer = std::function<void()>;
 
+    /**
+    * @brief Creation options, see Engine::createGameState()
+    */
+    struct Options {
+
+        /**
+        * @brief The broadphases a physics world can use
+        */
+        enum class Broadphase {
+            /**
+            * @brief Bullet's dynamic AABB tree, for unbounded worlds
+            */
+            Dbvt,
+            /**
+            * @brief Sweep and prune over the world's bounds
+            *
+            * Faster with many bodies of similar size that mostly stay 
+            * inside Options::worldMin and Options::worldMax. Bodies 
+            * outside are clamped to the bounds and collide less 
+            * efficiently.
+            */
+            AxisSweep
+        };
+
+        /**
+        * @brief The physics world's broadphase
+        *
+        * In Lua, \c "dbvt" or \c "axisSweep". Compare them with the 
+        * \c physics.overlappingPairs and \c physics.contactManifolds 
+        * statistics, see UpdatePhysicsSystem.
+        */
+        Broadphase broadphase = Broadphase::Dbvt;
+
+        /**
+        * @brief The most bodies an Broadphase::AxisSweep broadphase holds
+        *
+        * Up to 16383 proxies use 16 bit sweep and prune, more use 32 bit.
+        */
+        unsigned int maxBroadphaseProxies = 16383;
+
+        /**
+        * @brief The lower corner of the world for Broadphase::AxisSweep 
+        * and SceneManagerType::Octree
+        */
+        Ogre::Vector3 worldMin = Ogre::Vector3(-1000, -1000, -1000);
+
+        /**
+        * @brief The upper corner of the world for Broadphase::AxisSweep 
+        * and SceneManagerType::Octree
+        */
+        Ogre::Vector3 worldMax = Ogre::Vector3(1000, 1000, 1000);
+
+        /**
+        * @brief The scene managers a game state can use
+        */
+        enum class SceneManagerType {
+            /**
+            * @brief Whichever scene manager Ogre picks for \c ST_GENERIC
+            */
+            Generic,
+            /**
+            * @brief The octree of \c Plugin_OctreeSceneManager
+            *
+            * Culls whole octants of the world at once, which scales to 
+            * many more scene nodes. The octree covers the box between 
+            * worldMin and worldMax. Nodes outside of it are kept in the 
+            * root octant.
+            *
+            * For a planar world, keep the box as deep in z as it is wide.
+            * The scene nodes then all fall into the middle layer of each
+            * octant, so the octree subdivides the plane like a quadtree.
+            */
+            Octree
+        };
+
+        /**
+        * @brief The game state's scene manager
+        *
+        * In Lua, \c "generic" or \c "octree". Falls back to 
+        * SceneManagerType::Generic if the plugin isn't loaded.
+        */
+        SceneManagerType sceneManager = SceneManagerType::Generic;
+
+        /**
+        * @brief The most levels of a SceneManagerType::Octree
+        *
+        * Each level halves the size of the octants.
+        */
+        unsigned int sceneDepth = 8;
+
+        /**
+        * @brief Whether the physics world runs its steps on the engine's 
+        * thread pool
+        *
+        * Uses btDiscreteDynamicsWorldMt with a pool of constraint solvers 
+        * and a parallel collision dispatcher. This requires Bullet 2.87 or 
+        * newer, built with \c BT_THREADSAFE. Other builds fall back to the 
+        * single threaded world, see isPhysicsMultithreaded().
+        */
+        bool multithreadedPhysics = false;
+
+        /**
+        * @brief The number of constraint solvers of a multithreaded world
+        *
+        * With \c 0, the default, there is one solver per thread that can 
+        * take part in a step.
+        */
+        unsigned int physicsSolverPoolSize = 0;
+
+        /**
+        * @brief Whether all rigid bodies live in the x/y plane
+        *
+        * RigidBodyInputSystem then locks every body's z translation and
+        * its rotation around x and y, regardless of the factors in 
+        * RigidBodyComponent::Properties. With the motion reduced to three
+        * degrees of freedom, the solver converges in fewer iterations.
+        */
+        bool planarPhysics = false;
+
+        /**
+        * @brief Whether physics steps overlap with the systems after them
+        *
+        * UpdatePhysicsSystem then starts each step on the engine's thread 
+        * pool and returns. The systems between it and the 
+        * RigidBodyOutputSystem run on the results of the previous step 
+        * while the next one is simulated, the output system waits for it.
+        * Order the systems as RigidBodyInputSystem, UpdatePhysicsSystem, 
+        * the systems that don't touch the physics world, and then 
+        * RigidBodyOutputSystem to hide the step's time behind theirs.
+        *
+        * Until the step is done, bodies keep their previous transform.
+        */
+        bool asyncPhysics = false;
+
+        /**
+        * @brief The number of constraint solver iterations per step
+        *
+        * With \c 0, the default, planar worlds use 
+        * GameState::PLANAR_SOLVER_ITERATIONS and other worlds Bullet's 
+        * default.
+        */
+        unsigned int physicsSolverIterations = 0;
+
+        /**
+        * @brief The rate of Bullet's internal steps, in steps per second
+        *
+        * Without a tick rate, UpdatePhysicsSystem advances the world by 
+        * the frame time in steps of this size and interpolates the 
+        * remainder. With a tick rate, each tick takes one step of the 
+        * tick's length instead.
+        */
+        unsigned int physicsStepRate = 60;
+
+        /**
+        * @brief The most steps the physics world takes per update
+        *
+        * After a long frame, the time the world is behind by beyond this
+        * many steps is dropped. The simulation then runs slower than real 
+        * time instead of making the next frame slow as well. See 
+        * UpdatePhysicsSystem::droppedSteps().
+        */
+        unsigned int physicsMaxSubSteps = 10;
+
+        /**
+        * @brief The time the physics steps of one update may take, in 
+        * milliseconds
+        *
+        * Lowers the step cap below physicsMaxSubSteps when steps are 
+        * expensive, based on how long the recent steps took. At least one
+        * step is always taken. With \c 0, the default, only 
+        * physicsMaxSubSteps applies.
+        */
+        unsigned int physicsBudget = 0;
+
+        /**
+        * @brief Whether rendering overlaps with the next frame's ticks
+        *
+        * Only has an effect with a tick rate (see setTickRate()). Each 
+        * frame then first updates the per-frame systems, which copy the 
+        * results of the last ticks into the Ogre scene. The rendering 
+        * systems (see System::declareRendering()) then render that scene 
+        * on the main thread while a worker runs the ticks of the next 
+        * frame. The Ogre scene is the snapshot that is rendered, and the
+        * components are the state the simulation works on. What is 
+        * rendered lags one frame of ticks behind.
+        *
+        * Fixed-rate systems must not call into Ogre. They may run on a 
+        * worker thread even if they are main thread only.
+        */
+        bool pipelinedRendering = false;
+
+        /**
+        * @brief Whether the game state stays resident when the engine 
+        * switches away from it
+        *
+        * The engine then suspends the game state instead of deactivating 
+        * it, see suspend(). Its scene, physics world and the resources its
+        * systems keep hidden survive until it is current again, so 
+        * switching back doesn't recreate them.
+        */
+        bool keepResident = false;
+
+        /**
+        * @brief Whether the game state runs without Ogre
+        *
+        * Like in a headless engine (see Engine::isHeadless()), the game 
+        * state then has no scene manager and leaves out its graphical 
+        * systems, so it only costs CPU time. Required for background game
+        * states, see Engine::addBackgroundGameState().
+        */
+        bool headless = false;
+
+        /**
+        * @brief Update rates of systems by name, see 
+        * System::setUpdateRate()
+        *
+        * Applied when the game state is initialized. In Lua, a table 
+        * like <tt>{HudSystem = 10}</tt>, keyed by the systems' class names.
+        */
+        std::map<std::string, unsigned int> updateRates;
+
+        /**
+        * @brief The time the creation queue may take per frame, in 
+        * milliseconds
+        *
+        * \c 0 for no time limit. See creationQueue().
+        */
+        unsigned int creationBudget = 2;
+
+        /**
+        * @brief The most creation jobs per frame
+        *
+        * \c 0, the default, for no limit. See creationQueue().
+        */
+        unsigned int maxCreationsPerFrame = 0;
+
+    };
+
+    /**
+    * @brief Default solver iterations of a planar physics world
+    */
+    static const unsigned int PLANAR_SOLVER_ITERATIONS = 4;
+
     /**
     * @brief Lua bindings
     *
     * Exposes:
+    * - GameState::creationQueue() (as property)
+    * - GameState::entityManager()
+    * - GameState::isHeadless()
+    * - GameState::isInitialized()
+    * - GameState::isPhysicsAsync()
+    * - GameState::isPhysicsMultithreaded()
+    * - GameState::isPhysicsPlanar()
+    * - GameState::isSuspended()
     * - GameState::name()
+    * - GameState::setTickRate()
+    * - GameState::systemProfiler() (as property)
+    * - GameState::tickCount()
+    * - GameState::tickRate()
     *
     * @return
     */
@@ -73,6 +334,15 @@ public:
     */
     GameState& operator=(const GameState&) = delete;
 
+    /**
+    * @brief Jobs that create entities, spread over the frames
+    *
+    * Drained at the start of each update within Options::creationBudget
+    * and Options::maxCreationsPerFrame.
+    */
+    CreationQueue&
+    creationQueue();
+
     /**
     * @brief Returns the engine this game state belongs to
     *
@@ -105,6 +375,68 @@ public:
     const EntityManager&
     entityManager() const;
 
+    /**
+    * @brief The game state's event channels
+    *
+    * Each frame ends for the channels at the end of update(). Shutting
+    * down or loading the game state drops all events.
+    */
+    EventBus&
+    events();
+
+    /**
+    * @brief Whether the game state runs without Ogre
+    *
+    * @return
+    *   \c true if it was created with Options::headless or the engine is
+    *   headless
+    */
+    bool
+    isHeadless() const;
+
+    /**
+    * @brief Whether the game state's systems have been initialized
+    *
+    * The engine initializes a game state when it first becomes current
+    * or when it is prewarmed, see Engine::prewarmGameState(). Until then,
+    * it has no scene manager, no running systems and no entities.
+    */
+    bool
+    isInitialized() const;
+
+    /**
+    * @brief Whether physics steps run asynchronously
+    *
+    * @see Options::asyncPhysics
+    */
+    bool
+    isPhysicsAsync() const;
+
+    /**
+    * @brief Whether the physics world steps on the engine's thread pool
+    *
+    * Only \c true if Options::multithreadedPhysics was set and the Bullet
+    * build supports it.
+    */
+    bool
+    isPhysicsMultithreaded() const;
+
+    /**
+    * @brief Whether the physics world is restricted to the x/y plane
+    *
+    * @see Options::planarPhysics
+    */
+    bool
+    isPhysicsPlanar() const;
+
+    /**
+    * @brief Whether the game state is suspended
+    *
+    * @see Options::keepResident
+    */
+    bool
+    isSuspended() const;
+
     /**
     * @brief The game state's name
     *
@@ -113,6 +445,12 @@ public:
     std::string
     name() const;
 
+    /**
+    * @brief The options the game state was created with
+    */
+    const Options&
+    options() const;
+
     /**
     * @brief The physics world
     */
@@ -121,10 +459,67 @@ public:
 
     /**
     * @brief The Ogre scene manager
+    *
+    * \c nullptr in headless game states, see isHeadless()
     */
     Ogre::SceneManager*
     sceneManager() const;
 
+    /**
+    * @brief Sets the rate of the fixed-rate simulation
+    *
+    * With a tick rate, the game state accumulates the elapsed frame time
+    * and updates the fixed-rate systems (see System::setFixedRate()) once
+    * for each full tick. Each tick is passed the same duration, rounded to
+    * whole milliseconds such that the ticks of one second add up to exactly
+    * 1000 milliseconds. To keep a slow frame from causing even slower 
+    * frames, at most a few ticks are run per frame and the remaining time
+    * is dropped.
+    *
+    * @param ticksPerSecond
+    *   The tick rate. With \c 0, the default, all systems are updated once
+    *   per frame in their original order.
+    */
+    void
+    setTickRate(
+        unsigned int ticksPerSecond
+    );
+
+    /**
+    * @brief Times the updates of the game state's systems
+    *
+    * Disabled by default, see SystemProfiler::setEnabled().
+    */
+    SystemProfiler&
+    systemProfiler();
+
+    /**
+    * @brief The number of ticks run since the tick rate was last set
+    */
+    unsigned long long
+    tickCount() const;
+
+    /**
+    * @brief How far the game state is between the last and the next tick
+    *
+    * Renderers can use this to interpolate between the results of the last
+    * two ticks.
+    *
+    * @return
+    *   A value in <tt>[0, 1)</tt>, or \c 1 without a tick rate
+    */
+    float
+    tickInterpolation() const;
+
+    /**
+    * @brief The tick rate of the fixed-rate simulation
+    *
+    * @return
+    *   The ticks per second, or \c 0 if all systems are updated per frame
+    */
+    unsigned int
+    tickRate() const;
+
     template<typename S>
     S*
     findSystem() {
@@ -133,6 +528,13 @@ public:
             if (foundSystem) {
                 return foundSystem;
             }
+            // Stages of a SystemPipeline
+            for (System* stage : system->stages()) {
+                foundSystem = dynamic_cast<S*>(stage);
+                if (foundSystem) {
+                    return foundSystem;
+                }
+            }
         }
         return nullptr;
     }
@@ -158,22 +560,30 @@ private:
     * @param initializer
     *   A function that is called after initializing the game
     *   state. You can set up basic entities in this callback.
+    *
+    * @param options
+    *   Creation options
     */
     GameState(
         Engine& engine,
         std::string name,
         std::vector<std::unique_ptr<System>> systems,
-        Initializer initializer
+        Initializer initializer,
+        const Options& options
     );
 
     /**
     * @brief Called by the engine when the game state is activated
+    *
+    * A suspended game state resumes its systems, see System::resume().
     */
     void
     activate();
 
     /**
     * @brief Called by the engine when the game state is deactivated
+    *
+    * Also releases what a suspended game state kept resident.
     */
     void
     deactivate();
@@ -181,11 +591,38 @@ private:
     /**
     * @brief Called by the engine to initialize the game state
     *
-    * Initializes all the systems in turn
+    * Initializes all the systems in turn. In headless game states (see 
+    * isHeadless()), graphical systems (see System::declareGraphical()) are
+    * left out, and so is the scene manager.
+    *
+    * Builds the physics world first, unless initPhysics() already did.
+    * Does nothing if the game state is already initialized.
     */
     void
     init();
 
+    /**
+    * @brief Called by the engine to build the physics world ahead of init()
+    *
+    * Touches nothing but the game state's own physics world, so the
+    * engine builds the worlds of several game states in parallel during
+    * startup. Does nothing if the world already exists.
+    */
+    void
+    initPhysics();
+
+    /**
+    * @brief Whether one of the game state's systems has to be updated on
+    * the main thread
+    *
+    * Only known after init(). Such game states are not updated on the 
+    * thread pool when they run in the background.
+    *
+    * @see System::isMainThreadOnly()
+    */
+    bool
+    isMainThreadOnly() const;
+
     const std::vector<std::unique_ptr<System>>&
     systems() const;
 
@@ -201,14 +638,44 @@ private:
         const StorageContainer& storage
     );
 
+    /**
+    * @brief Returns the entities to the state of a snapshot
+    *
+    * Call only between frames, e.g. from the engine or a replay, while no
+    * system is running.
+    *
+    * @param snapshot
+    *   A snapshot taken with snapshot()
+    *
+    * @see EntityManager::rollback()
+    */
+    void
+    rollback(
+        const EntityManager::Snapshot& snapshot
+    );
+
     /**
     * @brief Called by the engine to shut the game state down
     *
-    * Shuts down all the systems in turn
+    * Shuts down all the systems in turn. The game state can be
+    * initialized again afterwards.
     */
     void
     shutdown();
 
+    /**
+    * @brief Takes a snapshot of the entities
+    *
+    * Cheaper than storage() for repeated snapshots, see
+    * EntityManager::snapshot(). The engine builds savegames from
+    * snapshots in the background.
+    *
+    * @return
+    *   The snapshot, for rollback() or EntityManager::Snapshot::storage()
+    */
+    EntityManager::Snapshot
+    snapshot();
+
     /**
     * @brief Called by the engine during savegame creation
     *
@@ -219,10 +686,27 @@ private:
     StorageContainer
     storage() const;
 
+    /**
+    * @brief Called by the engine when it switches to another game state
+    *
+    * With Options::keepResident, suspends the systems (see 
+    * System::suspend()), otherwise deactivates the game state.
+    */
+    void
+    suspend();
+
     /**
     * @brief Called by the engine to update the game state
     *
-    * Updates all the systems in turn
+    * Updates all the systems. Systems that declared their component access
+    * may run in parallel, see SystemScheduler. The entity manager's recorded
+    * structural changes are processed before the first and after the last
+    * system (see EntityManager::processCommands()). After the first, the
+    * DoubleBuffer members of the components are flipped.
+    *
+    * With a tick rate (see setTickRate()), the fixed-rate systems are 
+    * updated for each due tick first, with the recorded changes processed
+    * after each tick. The other systems are updated once afterwards.
     *
     * @param milliseconds
     *   The number of milliseconds of game time elapsed since the
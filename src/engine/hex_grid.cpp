@@ -0,0 +1,250 @@
+#include "engine/hex_grid.h"
+
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Cells added around the bounding box when the array grows, so that
+// growing one cell at a time doesn't copy each time
+const int32_t GROWTH_MARGIN = 4;
+
+// Same order as HEX_SIDE in hex.lua
+const int32_t NEIGHBOUR_OFFSETS[HexGrid::SIDE_COUNT][2] = {
+    { 0,  1},
+    { 1,  0},
+    { 1, -1},
+    { 0, -1},
+    {-1,  0},
+    {-1,  1}
+};
+
+} // namespace
+
+
+luabind::scope
+HexGrid::luaBindings() {
+    using namespace luabind;
+    return class_<HexGrid>("HexGrid")
+        .def(constructor<>())
+        .def("clear", &HexGrid::clear)
+        .def("get", &HexGrid::get)
+        .def("maxQ", &HexGrid::maxQ)
+        .def("maxR", &HexGrid::maxR)
+        .def("minQ", &HexGrid::minQ)
+        .def("minR", &HexGrid::minR)
+        .def("neighbour", &HexGrid::neighbour)
+        .def("remove", &HexGrid::remove)
+        .def("set", &HexGrid::set)
+        .def("size", &HexGrid::size)
+    ;
+}
+
+
+void
+HexGrid::neighbourOffset(
+    unsigned int side,
+    int32_t& q,
+    int32_t& r
+) {
+    if (side < 1 or side > SIDE_COUNT) {
+        throw std::out_of_range("Hex side must be between 1 and 6");
+    }
+    q = NEIGHBOUR_OFFSETS[side - 1][0];
+    r = NEIGHBOUR_OFFSETS[side - 1][1];
+}
+
+
+int64_t
+HexGrid::cellIndex(
+    int32_t q,
+    int32_t r
+) const {
+    int64_t column = static_cast<int64_t>(q) - m_originQ;
+    int64_t row = static_cast<int64_t>(r) - m_originR;
+    if (column < 0 or column >= m_width or row < 0 or row >= m_height) {
+        return -1;
+    }
+    return row * m_width + column;
+}
+
+
+void
+HexGrid::clear() {
+    std::vector<int32_t>().swap(m_cells);
+    m_height = 0;
+    m_width = 0;
+    m_originQ = 0;
+    m_originR = 0;
+    m_minQ = m_maxQ = m_minR = m_maxR = 0;
+    m_size = 0;
+}
+
+
+int32_t
+HexGrid::get(
+    int32_t q,
+    int32_t r
+) const {
+    int64_t index = this->cellIndex(q, r);
+    return index < 0 ? 0 : m_cells[index];
+}
+
+
+void
+HexGrid::include(
+    int32_t q,
+    int32_t r
+) {
+    if (this->cellIndex(q, r) >= 0) {
+        return;
+    }
+    int32_t minQ = q - GROWTH_MARGIN;
+    int32_t maxQ = q + GROWTH_MARGIN;
+    int32_t minR = r - GROWTH_MARGIN;
+    int32_t maxR = r + GROWTH_MARGIN;
+    if (m_width > 0) {
+        minQ = std::min(minQ, m_originQ);
+        maxQ = std::max(maxQ, m_originQ + m_width - 1);
+        minR = std::min(minR, m_originR);
+        maxR = std::max(maxR, m_originR + m_height - 1);
+    }
+    int32_t width = maxQ - minQ + 1;
+    int32_t height = maxR - minR + 1;
+    std::vector<int32_t> cells(static_cast<size_t>(width) * height, 0);
+    for (int32_t row = 0; row < m_height; ++row) {
+        std::copy_n(
+            m_cells.begin() + static_cast<size_t>(row) * m_width,
+            m_width,
+            cells.begin() + static_cast<size_t>(row + m_originR - minR) * width + (m_originQ - minQ)
+        );
+    }
+    m_cells.swap(cells);
+    m_originQ = minQ;
+    m_originR = minR;
+    m_width = width;
+    m_height = height;
+}
+
+
+int32_t
+HexGrid::maxQ() const {
+    return m_maxQ;
+}
+
+
+int32_t
+HexGrid::maxR() const {
+    return m_maxR;
+}
+
+
+int32_t
+HexGrid::minQ() const {
+    return m_minQ;
+}
+
+
+int32_t
+HexGrid::minR() const {
+    return m_minR;
+}
+
+
+int32_t
+HexGrid::neighbour(
+    int32_t q,
+    int32_t r,
+    unsigned int side
+) const {
+    int32_t offsetQ = 0;
+    int32_t offsetR = 0;
+    neighbourOffset(side, offsetQ, offsetR);
+    return this->get(q + offsetQ, r + offsetR);
+}
+
+
+bool
+HexGrid::remove(
+    int32_t q,
+    int32_t r
+) {
+    int64_t index = this->cellIndex(q, r);
+    if (index < 0 or m_cells[index] == 0) {
+        return false;
+    }
+    m_cells[index] = 0;
+    m_size -= 1;
+    if (q == m_minQ or q == m_maxQ or r == m_minR or r == m_maxR) {
+        this->updateBounds();
+    }
+    return true;
+}
+
+
+void
+HexGrid::set(
+    int32_t q,
+    int32_t r,
+    int32_t value
+) {
+    if (value == 0) {
+        this->remove(q, r);
+        return;
+    }
+    this->include(q, r);
+    int32_t& cell = m_cells[this->cellIndex(q, r)];
+    if (cell == 0) {
+        if (m_size == 0) {
+            m_minQ = m_maxQ = q;
+            m_minR = m_maxR = r;
+        }
+        else {
+            m_minQ = std::min(m_minQ, q);
+            m_maxQ = std::max(m_maxQ, q);
+            m_minR = std::min(m_minR, r);
+            m_maxR = std::max(m_maxR, r);
+        }
+        m_size += 1;
+    }
+    cell = value;
+}
+
+
+size_t
+HexGrid::size() const {
+    return m_size;
+}
+
+
+void
+HexGrid::updateBounds() {
+    bool found = false;
+    for (int32_t row = 0; row < m_height; ++row) {
+        for (int32_t column = 0; column < m_width; ++column) {
+            if (m_cells[static_cast<size_t>(row) * m_width + column] == 0) {
+                continue;
+            }
+            int32_t q = m_originQ + column;
+            int32_t r = m_originR + row;
+            if (not found) {
+                m_minQ = m_maxQ = q;
+                m_minR = m_maxR = r;
+                found = true;
+            }
+            else {
+                m_minQ = std::min(m_minQ, q);
+                m_maxQ = std::max(m_maxQ, q);
+                m_minR = std::min(m_minR, r);
+                m_maxR = std::max(m_maxR, r);
+            }
+        }
+    }
+    if (not found) {
+        m_minQ = m_maxQ = m_minR = m_maxR = 0;
+    }
+}
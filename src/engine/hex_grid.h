@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Dense grid of integer values on flat-topped hexes
+*
+* Cells are addressed by axial coordinates, like in \c hex.lua. The cells
+* are stored in an array covering the bounding box of all cells set so
+* far, so lookups are a bounds check and an index, without hashing. The
+* array grows as needed and is meant for small, compact layouts like the
+* organelles of a microbe.
+*
+* A value of \c 0 marks an empty cell.
+*/
+class HexGrid {
+
+public:
+
+    /**
+    * @brief The number of neighbours of a hex
+    */
+    static const unsigned int SIDE_COUNT = 6;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - HexGrid()
+    * - HexGrid::clear
+    * - HexGrid::get
+    * - HexGrid::maxQ
+    * - HexGrid::maxR
+    * - HexGrid::minQ
+    * - HexGrid::minR
+    * - HexGrid::neighbour
+    * - HexGrid::remove
+    * - HexGrid::set
+    * - HexGrid::size
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief The axial offset of the neighbour at a side
+    *
+    * @param side
+    *   The side, numbered clock-wise from \c 1 for the top like \c HEX_SIDE
+    *   in \c hex.lua
+    * @param q
+    * @param r
+    *   Receive the offset
+    *
+    * @throw std::out_of_range
+    *   If \a side is not between \c 1 and \c 6
+    */
+    static void
+    neighbourOffset(
+        unsigned int side,
+        int32_t& q,
+        int32_t& r
+    );
+
+    /**
+    * @brief Empties the grid and frees its cells
+    */
+    void
+    clear();
+
+    /**
+    * @brief Calls a function for each neighbour of a hex
+    *
+    * @param q
+    * @param r
+    *   The hex's axial coordinates
+    * @param function
+    *   Called with the side, the neighbour's coordinates and its value,
+    *   also for empty neighbours
+    */
+    template<typename Function>
+    void
+    forEachNeighbour(
+        int32_t q,
+        int32_t r,
+        Function function
+    ) const {
+        for (unsigned int side = 1; side <= SIDE_COUNT; ++side) {
+            int32_t offsetQ = 0;
+            int32_t offsetR = 0;
+            neighbourOffset(side, offsetQ, offsetR);
+            function(side, q + offsetQ, r + offsetR, this->get(q + offsetQ, r + offsetR));
+        }
+    }
+
+    /**
+    * @brief The value of a cell
+    *
+    * @return
+    *   The value or \c 0 if the cell is empty
+    */
+    int32_t
+    get(
+        int32_t q,
+        int32_t r
+    ) const;
+
+    /**
+    * @brief The largest q of a non-empty cell
+    *
+    * The bounding box is all \c 0 for an empty grid.
+    */
+    int32_t
+    maxQ() const;
+
+    /**
+    * @brief The largest r of a non-empty cell
+    */
+    int32_t
+    maxR() const;
+
+    /**
+    * @brief The smallest q of a non-empty cell
+    */
+    int32_t
+    minQ() const;
+
+    /**
+    * @brief The smallest r of a non-empty cell
+    */
+    int32_t
+    minR() const;
+
+    /**
+    * @brief The value of the neighbour at a side of a hex
+    *
+    * @param q
+    * @param r
+    *   The hex's axial coordinates
+    * @param side
+    *   The side, see neighbourOffset()
+    *
+    * @return
+    *   The neighbour's value or \c 0 if it's empty
+    */
+    int32_t
+    neighbour(
+        int32_t q,
+        int32_t r,
+        unsigned int side
+    ) const;
+
+    /**
+    * @brief Empties a cell
+    *
+    * @return
+    *   \c true if the cell was not empty
+    */
+    bool
+    remove(
+        int32_t q,
+        int32_t r
+    );
+
+    /**
+    * @brief Sets the value of a cell
+    *
+    * @param q
+    * @param r
+    *   The cell's axial coordinates
+    * @param value
+    *   The new value, \c 0 empties the cell
+    */
+    void
+    set(
+        int32_t q,
+        int32_t r,
+        int32_t value
+    );
+
+    /**
+    * @brief The number of non-empty cells
+    */
+    size_t
+    size() const;
+
+private:
+
+    // Index into m_cells or -1 if outside of the allocated box
+    int64_t
+    cellIndex(
+        int32_t q,
+        int32_t r
+    ) const;
+
+    // Grows the allocated box to include a cell
+    void
+    include(
+        int32_t q,
+        int32_t r
+    );
+
+    // After removing a cell on the border of the bounding box
+    void
+    updateBounds();
+
+    // The allocated box, m_width * m_height cells starting at
+    // (m_originQ, m_originR), in rows of equal r
+    std::vector<int32_t> m_cells;
+
+    int32_t m_height = 0;
+
+    int32_t m_maxQ = 0;
+
+    int32_t m_maxR = 0;
+
+    int32_t m_minQ = 0;
+
+    int32_t m_minR = 0;
+
+    int32_t m_originQ = 0;
+
+    int32_t m_originR = 0;
+
+    size_t m_size = 0;
+
+    int32_t m_width = 0;
+
+};
+
+}
@@ -0,0 +1,196 @@
+#include "engine/idle_tasks.h"
+
+#include "scripting/lua_profiler.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace thrive;
+
+
+static IdleTasks::TaskId
+IdleTasks_add(
+    IdleTasks* self,
+    luabind::object task
+) {
+    return self->add([task] () {
+        LuaProfiler::countScriptCall(task.interpreter(), "IdleTasks task");
+        return luabind::call_function<bool>(task);
+    });
+}
+
+
+luabind::scope
+IdleTasks::luaBindings() {
+    using namespace luabind;
+    return class_<IdleTasks>("IdleTasks")
+        .def("add", &IdleTasks_add)
+        .def("count", &IdleTasks::count)
+        .def("remove", &IdleTasks::remove)
+    ;
+}
+
+
+struct IdleTasks::Implementation {
+
+    struct Entry {
+
+        TaskId id;
+
+        Task task;
+
+        bool isRemoved;
+
+    };
+
+    // Drops removed tasks and appends the ones added during run()
+    void
+    compact() {
+        size_t next = 0;
+        for (size_t i = 0; i < m_tasks.size() and i < m_next; ++i) {
+            if (not m_tasks[i].isRemoved) {
+                next += 1;
+            }
+        }
+        m_tasks.erase(
+            std::remove_if(m_tasks.begin(), m_tasks.end(), [] (const Entry& entry) {
+                return entry.isRemoved;
+            }),
+            m_tasks.end()
+        );
+        for (Entry& entry : m_incoming) {
+            m_tasks.push_back(std::move(entry));
+        }
+        m_incoming.clear();
+        m_next = next;
+    }
+
+    std::vector<Entry> m_incoming;
+
+    // Per task, whether it ran out of work in the current run()
+    std::vector<char> m_isDone;
+
+    bool m_isRunning = false;
+
+    TaskId m_nextId = 1;
+
+    // The task to step first
+    size_t m_next = 0;
+
+    std::vector<Entry> m_tasks;
+
+};
+
+
+IdleTasks::IdleTasks()
+  : m_impl(new Implementation())
+{
+}
+
+
+IdleTasks::~IdleTasks() {}
+
+
+IdleTasks::TaskId
+IdleTasks::add(
+    Task task
+) {
+    Implementation::Entry entry{m_impl->m_nextId++, std::move(task), false};
+    TaskId id = entry.id;
+    if (m_impl->m_isRunning) {
+        m_impl->m_incoming.push_back(std::move(entry));
+    }
+    else {
+        m_impl->m_tasks.push_back(std::move(entry));
+    }
+    return id;
+}
+
+
+void
+IdleTasks::clear() {
+    m_impl->m_incoming.clear();
+    for (Implementation::Entry& entry : m_impl->m_tasks) {
+        entry.isRemoved = true;
+    }
+    if (not m_impl->m_isRunning) {
+        m_impl->compact();
+    }
+}
+
+
+size_t
+IdleTasks::count() const {
+    size_t count = m_impl->m_incoming.size();
+    for (const Implementation::Entry& entry : m_impl->m_tasks) {
+        if (not entry.isRemoved) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+
+void
+IdleTasks::remove(
+    TaskId id
+) {
+    auto isTask = [id] (const Implementation::Entry& entry) {
+        return entry.id == id;
+    };
+    auto& incoming = m_impl->m_incoming;
+    incoming.erase(std::remove_if(incoming.begin(), incoming.end(), isTask), incoming.end());
+    auto iter = std::find_if(m_impl->m_tasks.begin(), m_impl->m_tasks.end(), isTask);
+    if (iter == m_impl->m_tasks.end()) {
+        return;
+    }
+    // A running task may be removing itself, so it is only erased after
+    // run() is done with it
+    iter->isRemoved = true;
+    if (not m_impl->m_isRunning) {
+        m_impl->compact();
+    }
+}
+
+
+unsigned int
+IdleTasks::run(
+    Clock::time_point deadline
+) {
+    Implementation& impl = *m_impl;
+    const size_t taskCount = impl.m_tasks.size();
+    impl.m_isDone.assign(taskCount, 0);
+    size_t remaining = taskCount;
+    unsigned int steps = 0;
+    impl.m_isRunning = true;
+    try {
+        while (remaining > 0 and Clock::now() < deadline) {
+            if (impl.m_next >= taskCount) {
+                impl.m_next = 0;
+            }
+            size_t index = impl.m_next++;
+            if (impl.m_isDone[index]) {
+                continue;
+            }
+            Implementation::Entry& entry = impl.m_tasks[index];
+            bool hasMoreWork = false;
+            if (not entry.isRemoved) {
+                steps += 1;
+                hasMoreWork = entry.task();
+            }
+            if (not hasMoreWork) {
+                impl.m_isDone[index] = 1;
+                remaining -= 1;
+            }
+        }
+    }
+    catch (...) {
+        impl.m_isRunning = false;
+        impl.compact();
+        throw;
+    }
+    impl.m_isRunning = false;
+    impl.compact();
+    return steps;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <functional>
+#include <memory>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Runs low-priority work in the time left over between frames
+*
+* Instead of sleeping until the next frame is due, Game::run() hands the
+* remaining time to run() (see FramePacer::setIdleCallback()). Tasks do
+* their work in small steps, so run() can stop close to the deadline:
+* collecting Lua garbage, warming up materials or compressing stored
+* world sectors. Frames that use up their time budget, and frames
+* limited by vertical sync, leave no idle time, so tasks may not run at
+* all for a while. Work that must be done eventually needs another way to
+* get done, too.
+*
+* Tasks stay registered until they are removed. Each call to run() takes
+* steps of all tasks in turn, so a busy task doesn't starve the others,
+* and continues with the task after the last one it stepped.
+*/
+class IdleTasks {
+
+public:
+
+    using Clock = boost::chrono::steady_clock;
+
+    /**
+    * @brief Does one small step of work
+    *
+    * Returns whether there is more work to do. A task that returns \c
+    * false is asked again in the next run().
+    */
+    using Task = std::function<bool()>;
+
+    /**
+    * @brief Identifies a task for remove()
+    */
+    using TaskId = unsigned int;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - IdleTasks::add
+    * - IdleTasks::count
+    * - IdleTasks::remove
+    *
+    * The tasks are Lua functions without parameters, returning whether
+    * they have more work to do.
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    IdleTasks();
+
+    /**
+    * @brief Destructor
+    */
+    ~IdleTasks();
+
+    /**
+    * @brief Registers a task
+    *
+    * May be called from a running task, the new task is stepped from the
+    * next run() on.
+    *
+    * @param task
+    *
+    * @return
+    *   The task's id
+    */
+    TaskId
+    add(
+        Task task
+    );
+
+    /**
+    * @brief Removes all tasks
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of registered tasks
+    */
+    size_t
+    count() const;
+
+    /**
+    * @brief Removes a task
+    *
+    * May be called from a running task, also for the task itself. Does
+    * nothing if there is no task with \a id.
+    *
+    * @param id
+    */
+    void
+    remove(
+        TaskId id
+    );
+
+    /**
+    * @brief Steps the tasks until none has work left or \a deadline passes
+    *
+    * The deadline is checked before each step, so it is overrun by at
+    * most one step.
+    *
+    * @param deadline
+    *
+    * @return
+    *   The number of steps taken
+    */
+    unsigned int
+    run(
+        Clock::time_point deadline
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
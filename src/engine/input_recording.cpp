@@ -0,0 +1,138 @@
+#include "engine/input_recording.h"
+
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Recordings are text, one frame per line:
+//
+// frame MS BUTTONS WIDTH HEIGHT X Y Z KEY_COUNT KEY... EVENT_COUNT EVENT...
+//
+// where each EVENT is "KEY PRESSED ALT CTRL SHIFT DELAY".
+const std::string HEADER = "thrive-input";
+
+// Version 3 added the event delays. Version 2 replays with the 
+// xoshiro256** RNG, version 1 replayed with std::mt19937.
+const int VERSION = 3;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// InputRecorder
+////////////////////////////////////////////////////////////////////////////////
+
+InputRecorder::InputRecorder(
+    const std::string& filename,
+    RNG::Seed seed
+) : m_filename(filename),
+    m_stream(filename)
+{
+    if (not m_stream) {
+        throw std::runtime_error("Could not open input recording " + filename);
+    }
+    m_stream << HEADER << " " << VERSION << "\n";
+    m_stream << "seed " << seed << "\n";
+}
+
+
+void
+InputRecorder::write(
+    const InputFrame& frame
+) {
+    const InputFrame::MouseState& mouse = frame.mouse;
+    m_stream << "frame " << frame.milliseconds
+        << " " << mouse.buttons
+        << " " << mouse.width << " " << mouse.height
+        << " " << mouse.x << " " << mouse.y << " " << mouse.z
+        << " " << frame.keysDown.size();
+    for (uint8_t key : frame.keysDown) {
+        m_stream << " " << int(key);
+    }
+    m_stream << " " << frame.keyEvents.size();
+    for (const InputFrame::KeyEvent& event : frame.keyEvents) {
+        m_stream << " " << int(event.key)
+            << " " << event.pressed
+            << " " << event.alt
+            << " " << event.ctrl
+            << " " << event.shift
+            << " " << event.delay;
+    }
+    m_stream << std::endl;
+    if (not m_stream) {
+        throw std::runtime_error("Could not write input recording " + m_filename);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// InputPlayer
+////////////////////////////////////////////////////////////////////////////////
+
+InputPlayer::InputPlayer(
+    const std::string& filename
+) : m_filename(filename),
+    m_stream(filename)
+{
+    if (not m_stream) {
+        throw std::runtime_error("Could not open input recording " + filename);
+    }
+    std::string header;
+    int version = 0;
+    std::string seedTag;
+    m_stream >> header >> version >> seedTag >> m_seed;
+    if (not m_stream or header != HEADER or seedTag != "seed") {
+        throw std::runtime_error(filename + " is not an input recording");
+    }
+    if (version != VERSION) {
+        throw std::runtime_error(
+            "Unsupported version " + std::to_string(version) +
+            " of input recording " + filename
+        );
+    }
+}
+
+
+bool
+InputPlayer::next(
+    InputFrame& frame
+) {
+    std::string tag;
+    if (not (m_stream >> tag)) {
+        return false;
+    }
+    InputFrame::MouseState& mouse = frame.mouse;
+    size_t keyCount = 0;
+    m_stream >> frame.milliseconds
+        >> mouse.buttons
+        >> mouse.width >> mouse.height
+        >> mouse.x >> mouse.y >> mouse.z
+        >> keyCount;
+    bool isValid = tag == "frame" and keyCount <= 256;
+    frame.keysDown.clear();
+    for (size_t i = 0; isValid and i < keyCount; ++i) {
+        int key = 0;
+        m_stream >> key;
+        frame.keysDown.push_back(static_cast<uint8_t>(key));
+    }
+    size_t eventCount = 0;
+    m_stream >> eventCount;
+    frame.keyEvents.clear();
+    for (size_t i = 0; m_stream and isValid and i < eventCount; ++i) {
+        int key = 0;
+        InputFrame::KeyEvent event;
+        m_stream >> key >> event.pressed >> event.alt >> event.ctrl >> event.shift >> event.delay;
+        event.key = static_cast<uint8_t>(key);
+        frame.keyEvents.push_back(event);
+    }
+    if (not isValid or not m_stream) {
+        throw std::runtime_error("Malformed frame in input recording " + m_filename);
+    }
+    return true;
+}
+
+
+RNG::Seed
+InputPlayer::seed() const {
+    return m_seed;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "engine/rng.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief The input of a single frame
+*
+* Filled in by Keyboard::recordFrame() and Mouse::recordFrame() and fed
+* back by Keyboard::replayFrame() and Mouse::replayFrame().
+*/
+struct InputFrame {
+
+    /**
+    * @brief A key press or release, see Keyboard::KeyEvent
+    */
+    struct KeyEvent {
+
+        uint8_t key = 0;
+
+        bool pressed = false;
+
+        bool alt = false;
+
+        bool ctrl = false;
+
+        bool shift = false;
+
+        /**
+        * @brief Microseconds between the event and the frame that 
+        * delivered it
+        */
+        uint32_t delay = 0;
+
+    };
+
+    /**
+    * @brief The mouse state at the end of the frame
+    */
+    struct MouseState {
+
+        /**
+        * @brief Bit mask of the pressed buttons, by OIS::MouseButtonID
+        */
+        int buttons = 0;
+
+        /**
+        * @brief The window size the position relates to
+        */
+        int height = 0;
+
+        int width = 0;
+
+        int x = 0;
+
+        int y = 0;
+
+        /**
+        * @brief Absolute scroll wheel position
+        */
+        int z = 0;
+
+    };
+
+    /**
+    * @brief The frame's key events, in order
+    */
+    std::vector<KeyEvent> keyEvents;
+
+    /**
+    * @brief The key codes of all keys down at the end of the frame
+    */
+    std::vector<uint8_t> keysDown;
+
+    /**
+    * @brief The frame's duration as passed to Engine::update()
+    */
+    int milliseconds = 0;
+
+    MouseState mouse;
+
+};
+
+
+/**
+* @brief Writes a seed and the input of each frame to a file
+*
+* Together with the seed of the engine's RNG, the frames make a session
+* replayable with an InputPlayer. Each frame is flushed as it is written,
+* so that the recording survives a crash.
+*/
+class InputRecorder {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param filename
+    *   The file to write, replaced if it exists
+    * @param seed
+    *   The seed the engine's RNG starts the session with
+    *
+    * @throw std::runtime_error
+    *   If the file can't be opened
+    */
+    InputRecorder(
+        const std::string& filename,
+        RNG::Seed seed
+    );
+
+    /**
+    * @brief Appends a frame
+    *
+    * @param frame
+    *
+    * @throw std::runtime_error
+    *   If the file can't be written
+    */
+    void
+    write(
+        const InputFrame& frame
+    );
+
+private:
+
+    std::string m_filename;
+
+    std::ofstream m_stream;
+
+};
+
+
+/**
+* @brief Reads a recording of an InputRecorder
+*/
+class InputPlayer {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param filename
+    *   The recording to read
+    *
+    * @throw std::runtime_error
+    *   If the file can't be opened or is not a recording
+    */
+    explicit InputPlayer(
+        const std::string& filename
+    );
+
+    /**
+    * @brief Reads the next frame
+    *
+    * @param frame
+    *   Receives the frame
+    *
+    * @return
+    *   \c false if all frames have been read
+    *
+    * @throw std::runtime_error
+    *   If the frame is malformed
+    */
+    bool
+    next(
+        InputFrame& frame
+    );
+
+    /**
+    * @brief The seed the recorded session started with
+    */
+    RNG::Seed
+    seed() const;
+
+private:
+
+    std::string m_filename;
+
+    RNG::Seed m_seed = 0;
+
+    std::ifstream m_stream;
+
+};
+
+}
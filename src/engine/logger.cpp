@@ -0,0 +1,527 @@
+#include "engine/logger.h"
+
+#include "scripting/luabind.h"
+#include "util/mpsc_queue.h"
+
+#include <boost/thread.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace thrive;
+
+namespace {
+
+// Length of a rate limit window
+const boost::chrono::seconds RATE_WINDOW(1);
+
+// How long the writer thread sleeps when the queue is empty
+const boost::chrono::milliseconds WRITER_SLEEP(2);
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LogChannel
+////////////////////////////////////////////////////////////////////////////////
+
+LogChannel::LogChannel(
+    Logger& logger,
+    std::string name
+) : m_logger(logger),
+    m_name(std::move(name)),
+    m_level(static_cast<int>(LogLevel::Info))
+{
+}
+
+
+void
+LogChannel::debug(
+    std::string message
+) {
+    this->write(LogLevel::Debug, std::move(message));
+}
+
+
+void
+LogChannel::error(
+    std::string message
+) {
+    this->write(LogLevel::Error, std::move(message));
+}
+
+
+void
+LogChannel::info(
+    std::string message
+) {
+    this->write(LogLevel::Info, std::move(message));
+}
+
+
+bool
+LogChannel::isEnabled(
+    LogLevel level
+) const {
+    return static_cast<int>(level) >= m_level.load(std::memory_order_relaxed);
+}
+
+
+LogLevel
+LogChannel::level() const {
+    return static_cast<LogLevel>(m_level.load(std::memory_order_relaxed));
+}
+
+
+const std::string&
+LogChannel::name() const {
+    return m_name;
+}
+
+
+unsigned int
+LogChannel::rateLimit() const {
+    return m_rateLimit.load(std::memory_order_relaxed);
+}
+
+
+void
+LogChannel::setLevel(
+    LogLevel level
+) {
+    m_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+
+void
+LogChannel::setRateLimit(
+    unsigned int messagesPerSecond
+) {
+    m_rateLimit.store(messagesPerSecond, std::memory_order_relaxed);
+}
+
+
+void
+LogChannel::warning(
+    std::string message
+) {
+    this->write(LogLevel::Warning, std::move(message));
+}
+
+
+void
+LogChannel::write(
+    LogLevel level,
+    std::string message
+) {
+    if (this->isEnabled(level)) {
+        m_logger.write(*this, level, std::move(message));
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Logger
+////////////////////////////////////////////////////////////////////////////////
+
+struct Logger::Implementation {
+
+    Implementation(
+        size_t capacity
+    ) : m_consoleLevel(static_cast<int>(LogLevel::Info)),
+        m_created(boost::chrono::steady_clock::now()),
+        m_queue(capacity)
+    {
+    }
+
+    // Writes all queued messages. Only one thread at a time takes them
+    // out of the queue.
+    void
+    drain() {
+        boost::lock_guard<boost::mutex> lock(m_drainMutex);
+        uint64_t count = 0;
+        Entry entry;
+        while (m_queue.tryPop(entry)) {
+            this->process(entry);
+            count += 1;
+        }
+        this->reportSuppressed(boost::chrono::steady_clock::now());
+        if (count > 0) {
+            std::cout.flush();
+            if (m_file.is_open()) {
+                m_file.flush();
+            }
+            m_written.fetch_add(count, std::memory_order_release);
+        }
+    }
+
+    void
+    output(
+        const Entry& entry
+    ) {
+        std::ostringstream line;
+        boost::chrono::duration<double> time = entry.time - m_created;
+        line << std::fixed << std::setprecision(3) << time.count() << " "
+            << Logger::levelName(entry.level) << " "
+            << entry.channel->name() << ": " << entry.message << "\n";
+        std::string text = line.str();
+        if (static_cast<int>(entry.level) >= m_consoleLevel.load(std::memory_order_relaxed)) {
+            std::ostream& console = entry.level >= LogLevel::Warning ? std::cerr : std::cout;
+            console << text;
+        }
+        if (m_file.is_open()) {
+            m_file << text;
+        }
+        if (m_listener) {
+            m_listener(entry);
+        }
+    }
+
+    // Applies the channel's rate limit and writes the message
+    void
+    process(
+        const Entry& entry
+    ) {
+        LogChannel& channel = *entry.channel;
+        unsigned int rateLimit = channel.rateLimit();
+        if (rateLimit > 0) {
+            if (entry.time - channel.m_windowStart >= RATE_WINDOW) {
+                this->reportSuppressed(channel, entry.time);
+                channel.m_windowStart = entry.time;
+                channel.m_windowCount = 0;
+            }
+            if (channel.m_windowCount >= rateLimit) {
+                channel.m_windowSuppressed += 1;
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            channel.m_windowCount += 1;
+        }
+        this->output(entry);
+    }
+
+    // Writes a summary line for a channel whose window has messages
+    // suppressed
+    void
+    reportSuppressed(
+        LogChannel& channel,
+        boost::chrono::steady_clock::time_point now
+    ) {
+        if (channel.m_windowSuppressed == 0) {
+            return;
+        }
+        Entry summary;
+        summary.channel = &channel;
+        summary.level = LogLevel::Warning;
+        summary.message = std::to_string(channel.m_windowSuppressed) +
+            " messages suppressed by the rate limit";
+        summary.time = now;
+        channel.m_windowSuppressed = 0;
+        this->output(summary);
+    }
+
+    // Reports the channels whose window has ended without another message
+    void
+    reportSuppressed(
+        boost::chrono::steady_clock::time_point now
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_channelsMutex);
+        for (const auto& pair : m_channels) {
+            LogChannel& channel = *pair.second;
+            if (channel.m_windowSuppressed > 0 and now - channel.m_windowStart >= RATE_WINDOW) {
+                this->reportSuppressed(channel, now);
+            }
+        }
+    }
+
+    void
+    run() {
+        while (not m_stopRequested.load(std::memory_order_acquire)) {
+            this->drain();
+            if (m_written.load(std::memory_order_relaxed) >= m_pushed.load(std::memory_order_relaxed)) {
+                boost::this_thread::sleep_for(WRITER_SLEEP);
+            }
+        }
+        this->drain();
+    }
+
+    std::unordered_map<std::string, std::unique_ptr<LogChannel>> m_channels;
+
+    boost::mutex m_channelsMutex;
+
+    std::atomic<int> m_consoleLevel;
+
+    const boost::chrono::steady_clock::time_point m_created;
+
+    std::atomic<uint64_t> m_dropped = {0};
+
+    boost::mutex m_drainMutex;
+
+    std::ofstream m_file;
+
+    std::atomic<bool> m_isRunning = {false};
+
+    Listener m_listener;
+
+    // Messages pushed into and taken out of the queue, for flush()
+    std::atomic<uint64_t> m_pushed = {0};
+
+    std::atomic<uint64_t> m_written = {0};
+
+    MpscQueue<Entry> m_queue;
+
+    std::atomic<bool> m_stopRequested = {false};
+
+    std::atomic<uint64_t> m_suppressed = {0};
+
+    boost::thread m_thread;
+
+};
+
+
+static void
+Logger_setConsoleLevel(
+    Logger* self,
+    const std::string& level
+) {
+    self->setConsoleLevel(Logger::levelFromName(level));
+}
+
+
+static void
+Logger_setLevel(
+    Logger* self,
+    const std::string& channel,
+    const std::string& level
+) {
+    self->channel(channel).setLevel(Logger::levelFromName(level));
+}
+
+
+static void
+Logger_setRateLimit(
+    Logger* self,
+    const std::string& channel,
+    unsigned int messagesPerSecond
+) {
+    self->channel(channel).setRateLimit(messagesPerSecond);
+}
+
+
+static void
+Logger_write(
+    Logger* self,
+    const std::string& channel,
+    const std::string& level,
+    const std::string& message
+) {
+    self->channel(channel).write(Logger::levelFromName(level), message);
+}
+
+
+luabind::scope
+Logger::luaBindings() {
+    using namespace luabind;
+    return class_<Logger>("Logger")
+        .def("droppedCount", &Logger::droppedCount)
+        .def("flush", &Logger::flush)
+        .def("setConsoleLevel", Logger_setConsoleLevel)
+        .def("setLevel", Logger_setLevel)
+        .def("setRateLimit", Logger_setRateLimit)
+        .def("suppressedCount", &Logger::suppressedCount)
+        .def("write", Logger_write)
+    ;
+}
+
+
+Logger&
+Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+
+LogLevel
+Logger::levelFromName(
+    const std::string& name
+) {
+    for (LogLevel level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error}) {
+        if (name == levelName(level)) {
+            return level;
+        }
+    }
+    throw std::invalid_argument("Unknown log level: " + name);
+}
+
+
+const char*
+Logger::levelName(
+    LogLevel level
+) {
+    switch (level) {
+        case LogLevel::Debug:
+            return "debug";
+        case LogLevel::Info:
+            return "info";
+        case LogLevel::Warning:
+            return "warning";
+        case LogLevel::Error:
+            return "error";
+    }
+    return "unknown";
+}
+
+
+Logger::Logger(
+    size_t capacity
+) : m_impl(new Implementation(capacity))
+{
+}
+
+
+Logger::~Logger() {
+    this->stop();
+}
+
+
+LogChannel&
+Logger::channel(
+    const std::string& name
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_channelsMutex);
+    std::unique_ptr<LogChannel>& channel = m_impl->m_channels[name];
+    if (not channel) {
+        channel.reset(new LogChannel(*this, name));
+    }
+    return *channel;
+}
+
+
+LogLevel
+Logger::consoleLevel() const {
+    return static_cast<LogLevel>(m_impl->m_consoleLevel.load(std::memory_order_relaxed));
+}
+
+
+uint64_t
+Logger::droppedCount() const {
+    return m_impl->m_dropped.load(std::memory_order_relaxed);
+}
+
+
+void
+Logger::flush() {
+    if (not m_impl->m_isRunning.load(std::memory_order_acquire)) {
+        m_impl->drain();
+        return;
+    }
+    uint64_t target = m_impl->m_pushed.load(std::memory_order_acquire);
+    while (m_impl->m_written.load(std::memory_order_acquire) < target) {
+        boost::this_thread::sleep_for(WRITER_SLEEP);
+    }
+}
+
+
+bool
+Logger::isRunning() const {
+    return m_impl->m_isRunning.load(std::memory_order_acquire);
+}
+
+
+void
+Logger::setConsoleLevel(
+    LogLevel level
+) {
+    m_impl->m_consoleLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+
+void
+Logger::setFile(
+    const std::string& path
+) {
+    if (m_impl->m_file.is_open()) {
+        m_impl->m_file.close();
+    }
+    if (path.empty()) {
+        return;
+    }
+    m_impl->m_file.clear();
+    m_impl->m_file.open(path, std::ios::out | std::ios::app);
+    if (not m_impl->m_file) {
+        throw std::runtime_error("Could not open log file " + path);
+    }
+}
+
+
+void
+Logger::setListener(
+    Listener listener
+) {
+    m_impl->m_listener = std::move(listener);
+}
+
+
+void
+Logger::start() {
+    if (m_impl->m_isRunning) {
+        return;
+    }
+    m_impl->m_stopRequested = false;
+    m_impl->m_thread = boost::thread([this] () {
+        m_impl->run();
+    });
+    m_impl->m_isRunning = true;
+}
+
+
+void
+Logger::stop() {
+    if (not m_impl->m_isRunning) {
+        return;
+    }
+    m_impl->m_stopRequested = true;
+    m_impl->m_thread.join();
+    m_impl->m_isRunning = false;
+    // Messages pushed while the thread was finishing
+    m_impl->drain();
+}
+
+
+uint64_t
+Logger::suppressedCount() const {
+    return m_impl->m_suppressed.load(std::memory_order_relaxed);
+}
+
+
+void
+Logger::write(
+    LogChannel& channel,
+    LogLevel level,
+    std::string message
+) {
+    Entry entry;
+    entry.channel = &channel;
+    entry.level = level;
+    entry.message = std::move(message);
+    entry.time = boost::chrono::steady_clock::now();
+    bool isRunning = m_impl->m_isRunning.load(std::memory_order_acquire);
+    if (not m_impl->m_queue.tryPush(std::move(entry))) {
+        if (isRunning) {
+            m_impl->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Nobody takes messages out without the writer thread
+        m_impl->drain();
+        if (not m_impl->m_queue.tryPush(std::move(entry))) {
+            m_impl->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    m_impl->m_pushed.fetch_add(1, std::memory_order_release);
+    if (not isRunning) {
+        m_impl->drain();
+    }
+}
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class Logger;
+
+/**
+* @brief How important a log message is
+*/
+enum class LogLevel {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+
+/**
+* @brief A named source of log messages, like "scripts" or "savegame"
+*
+* Get one with Logger::channel() and keep the reference, it stays valid
+* for the lifetime of the logger. Each channel has its own level, below
+* which messages are dropped before they are formatted or queued, and its
+* own rate limit.
+*
+* All methods are thread safe.
+*/
+class LogChannel {
+
+public:
+
+    LogChannel(const LogChannel&) = delete;
+
+    LogChannel& operator= (const LogChannel&) = delete;
+
+    /**
+    * @brief Writes a message of level LogLevel::Debug
+    */
+    void
+    debug(
+        std::string message
+    );
+
+    /**
+    * @brief Writes a message of level LogLevel::Error
+    */
+    void
+    error(
+        std::string message
+    );
+
+    /**
+    * @brief Writes a message of level LogLevel::Info
+    */
+    void
+    info(
+        std::string message
+    );
+
+    /**
+    * @brief Whether messages of \a level pass the channel's level
+    *
+    * Check this before formatting expensive messages.
+    */
+    bool
+    isEnabled(
+        LogLevel level
+    ) const;
+
+    /**
+    * @brief The lowest level that is written
+    *
+    * Defaults to LogLevel::Info.
+    */
+    LogLevel
+    level() const;
+
+    /**
+    * @brief The channel's name
+    */
+    const std::string&
+    name() const;
+
+    /**
+    * @brief The most messages written per second
+    *
+    * Further messages within the same second are dropped and reported as
+    * one summary line once the second is over. \c 0 means no limit, the
+    * default.
+    */
+    unsigned int
+    rateLimit() const;
+
+    /**
+    * @brief Sets the lowest level that is written
+    *
+    * @param level
+    */
+    void
+    setLevel(
+        LogLevel level
+    );
+
+    /**
+    * @brief Sets the most messages written per second
+    *
+    * @param messagesPerSecond
+    *   \c 0 for no limit
+    */
+    void
+    setRateLimit(
+        unsigned int messagesPerSecond
+    );
+
+    /**
+    * @brief Writes a message of level LogLevel::Warning
+    */
+    void
+    warning(
+        std::string message
+    );
+
+    /**
+    * @brief Writes a message, if its level is enabled
+    *
+    * @param level
+    * @param message
+    *
+    * @see Logger::write()
+    */
+    void
+    write(
+        LogLevel level,
+        std::string message
+    );
+
+private:
+
+    friend class Logger;
+
+    LogChannel(
+        Logger& logger,
+        std::string name
+    );
+
+    Logger& m_logger;
+
+    const std::string m_name;
+
+    std::atomic<int> m_level;
+
+    std::atomic<unsigned int> m_rateLimit = {0};
+
+    // Only used by the thread writing the messages, see Logger
+
+    boost::chrono::steady_clock::time_point m_windowStart;
+
+    unsigned int m_windowCount = 0;
+
+    uint64_t m_windowSuppressed = 0;
+
+};
+
+
+/**
+* @brief Writes log messages on a background thread
+*
+* Writing to the console or a file can take milliseconds when the
+* terminal or disk is busy, which shouldn't happen inside a frame. Writers
+* only format their message and push it into a lock-free queue (see
+* MpscQueue), a background thread started with start() takes the messages
+* out and writes them. If the queue is full, the message is dropped and
+* counted, the writer never waits.
+*
+* Messages are written as
+* \code
+* 12.345 warning scripts: The message
+* \endcode
+* with the seconds since the logger was created. The console gets messages
+* from the console level on (see setConsoleLevel()), warnings and errors go
+* to \c std::cerr, the rest to \c std::cout. The log file, if set, gets all
+* messages that pass their channel's level.
+*
+* Before start() and after stop(), messages are written right away on the
+* thread that writes them, so that startup and shutdown messages appear in
+* order with a crash.
+*
+* The Engine routes Ogre's log into the "ogre" channel.
+*
+* Unless noted otherwise, methods are thread safe.
+*/
+class Logger {
+
+public:
+
+    /**
+    * @brief A message waiting to be written
+    */
+    struct Entry {
+
+        /**
+        * @brief The channel that wrote the message
+        */
+        LogChannel* channel = nullptr;
+
+        /**
+        * @brief The message's level
+        */
+        LogLevel level = LogLevel::Info;
+
+        /**
+        * @brief The message
+        */
+        std::string message;
+
+        /**
+        * @brief When the message was written
+        */
+        boost::chrono::steady_clock::time_point time;
+
+    };
+
+    /**
+    * @brief Called for each message after it's written
+    */
+    using Listener = std::function<void(const Entry&)>;
+
+    /**
+    * @brief The queue size of the engine's logger
+    */
+    static const size_t DEFAULT_CAPACITY = 4096;
+
+    /**
+    * @brief The logger used by the engine
+    */
+    static Logger&
+    instance();
+
+    /**
+    * @brief Parses a level name
+    *
+    * @param name
+    *   One of "debug", "info", "warning" and "error"
+    *
+    * @throws std::invalid_argument
+    *   If \a name is none of these
+    */
+    static LogLevel
+    levelFromName(
+        const std::string& name
+    );
+
+    /**
+    * @brief The lower case name of a level
+    */
+    static const char*
+    levelName(
+        LogLevel level
+    );
+
+    /**
+    * @brief Lua bindings
+    *
+    * Levels are passed as names, see levelFromName().
+    *
+    * Exposes:
+    * - Logger::droppedCount
+    * - Logger::flush
+    * - Logger::setConsoleLevel
+    * - Logger::setLevel(channel, level)
+    * - Logger::setRateLimit(channel, messagesPerSecond)
+    * - Logger::suppressedCount
+    * - Logger::write(channel, level, message)
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param capacity
+    *   The most messages waiting to be written
+    */
+    explicit Logger(
+        size_t capacity = DEFAULT_CAPACITY
+    );
+
+    /**
+    * @brief Destructor
+    *
+    * Stops the writer thread, writing the remaining messages.
+    */
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+
+    Logger& operator= (const Logger&) = delete;
+
+    /**
+    * @brief Gets or creates a channel
+    *
+    * Takes a lock, so callers should look up their channel once and keep
+    * the reference.
+    *
+    * @param name
+    *   The channel's name
+    */
+    LogChannel&
+    channel(
+        const std::string& name
+    );
+
+    /**
+    * @brief The lowest level written to the console
+    *
+    * Defaults to LogLevel::Info.
+    */
+    LogLevel
+    consoleLevel() const;
+
+    /**
+    * @brief Messages dropped because the queue was full
+    */
+    uint64_t
+    droppedCount() const;
+
+    /**
+    * @brief Waits until all messages written before the call are written
+    * out
+    *
+    * Don't call this during a frame. Useful before a crash report or when
+    * the output is read right after.
+    */
+    void
+    flush();
+
+    /**
+    * @brief Whether the writer thread is running
+    */
+    bool
+    isRunning() const;
+
+    /**
+    * @brief Sets the lowest level written to the console
+    *
+    * @param level
+    */
+    void
+    setConsoleLevel(
+        LogLevel level
+    );
+
+    /**
+    * @brief Sets the file that messages are appended to
+    *
+    * Not thread safe, call while the writer thread is stopped.
+    *
+    * @param path
+    *   The file's path, or empty to close the current file
+    *
+    * @throws std::runtime_error
+    *   If the file can't be opened
+    */
+    void
+    setFile(
+        const std::string& path
+    );
+
+    /**
+    * @brief Sets a function to call for each message that is written
+    *
+    * The listener is called on the writer thread, or on the thread that
+    * wrote the message while the writer thread isn't running. Not thread
+    * safe, call while the writer thread is stopped.
+    *
+    * @param listener
+    *   The listener, or empty to remove it
+    */
+    void
+    setListener(
+        Listener listener
+    );
+
+    /**
+    * @brief Starts the writer thread
+    *
+    * Main thread only. Does nothing if it's already running.
+    */
+    void
+    start();
+
+    /**
+    * @brief Writes the remaining messages and stops the writer thread
+    *
+    * Main thread only. Does nothing if it isn't running.
+    */
+    void
+    stop();
+
+    /**
+    * @brief Messages dropped by rate limits
+    */
+    uint64_t
+    suppressedCount() const;
+
+    /**
+    * @brief Queues a message for writing
+    *
+    * Never waits for the writer thread. Doesn't check the channel's
+    * level, see LogChannel::write() for that.
+    *
+    * @param channel
+    *   A channel of this logger
+    * @param level
+    * @param message
+    */
+    void
+    write(
+        LogChannel& channel,
+        LogLevel level,
+        std::string message
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,132 @@
+#include "engine/memory_stats.h"
+
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace thrive;
+
+
+luabind::scope
+MemoryStats::luaBindings() {
+    using namespace luabind;
+    return class_<MemoryStats>("MemoryStats")
+        .def("componentBytes", &MemoryStats::componentBytes)
+        .def("componentCount", &MemoryStats::componentCount)
+        .def("report", &MemoryStats::report)
+        .def("totalComponentBytes", &MemoryStats::totalComponentBytes)
+        .def_readonly("collisionObjects", &MemoryStats::collisionObjects)
+        .def_readonly("collisionShapes", &MemoryStats::collisionShapes)
+        .def_readonly("componentPoolAllocatedBytes", &MemoryStats::componentPoolAllocatedBytes)
+        .def_readonly("componentPoolReservedBytes", &MemoryStats::componentPoolReservedBytes)
+        .def_readonly("luaAllocatorLargeBytes", &MemoryStats::luaAllocatorLargeBytes)
+        .def_readonly("luaAllocatorPooledBytes", &MemoryStats::luaAllocatorPooledBytes)
+        .def_readonly("luaAllocatorRequestedBytes", &MemoryStats::luaAllocatorRequestedBytes)
+        .def_readonly("luaAllocatorReservedBytes", &MemoryStats::luaAllocatorReservedBytes)
+        .def_readonly("luaHeapBytes", &MemoryStats::luaHeapBytes)
+        .def_readonly("ogreEntities", &MemoryStats::ogreEntities)
+        .def_readonly("rigidBodies", &MemoryStats::rigidBodies)
+        .def_readonly("sceneNodes", &MemoryStats::sceneNodes)
+    ;
+}
+
+
+size_t
+MemoryStats::componentBytes(
+    const std::string& typeName
+) const {
+    for (const Components& entry : this->components) {
+        if (entry.typeName == typeName) {
+            return entry.bytes;
+        }
+    }
+    return 0;
+}
+
+
+size_t
+MemoryStats::componentCount(
+    const std::string& typeName
+) const {
+    for (const Components& entry : this->components) {
+        if (entry.typeName == typeName) {
+            return entry.count;
+        }
+    }
+    return 0;
+}
+
+
+std::string
+MemoryStats::report(
+    unsigned int count
+) const {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    stream << "Lua heap: " << this->luaHeapBytes / 1024.0 << " KB\n";
+    stream << "Lua allocator: "
+        << this->luaAllocatorRequestedBytes / 1024.0 << " KB requested, "
+        << this->luaAllocatorPooledBytes / 1024.0 << " of "
+        << this->luaAllocatorReservedBytes / 1024.0 << " KB pooled, "
+        << this->luaAllocatorLargeBytes / 1024.0 << " KB large\n";
+    stream << "Components: " << this->totalComponentBytes() / 1024.0 << " KB\n";
+    stream << "Component pools: "
+        << this->componentPoolAllocatedBytes / 1024.0 << " of "
+        << this->componentPoolReservedBytes / 1024.0 << " KB used\n";
+    stream << "Bullet: " << this->rigidBodies << " bodies, "
+        << this->collisionObjects << " objects, "
+        << this->collisionShapes << " shapes\n";
+    stream << "Ogre: " << this->sceneNodes << " scene nodes, "
+        << this->ogreEntities << " entities\n";
+    count = std::min<size_t>(count, this->components.size());
+    for (unsigned int i = 0; i < count; ++i) {
+        const Components& entry = this->components[i];
+        stream << std::setw(9) << entry.bytes / 1024.0 << " KB "
+            << std::setw(7) << entry.count << "  "
+            << entry.typeName << "\n";
+    }
+    return stream.str();
+}
+
+
+size_t
+MemoryStats::totalComponentBytes() const {
+    size_t total = 0;
+    for (const Components& entry : this->components) {
+        total += entry.bytes;
+    }
+    return total;
+}
+
+
+void
+MemoryStats::writeJson(
+    JsonWriter& writer
+) const {
+    writer.beginObject();
+    writer.key("collisionObjects").value(static_cast<uint64_t>(this->collisionObjects));
+    writer.key("collisionShapes").value(static_cast<uint64_t>(this->collisionShapes));
+    writer.key("componentPoolAllocatedBytes").value(static_cast<uint64_t>(this->componentPoolAllocatedBytes));
+    writer.key("componentPoolReservedBytes").value(static_cast<uint64_t>(this->componentPoolReservedBytes));
+    writer.key("components").beginObject();
+    for (const Components& entry : this->components) {
+        writer.key(entry.typeName).beginObject();
+        writer.key("bytes").value(static_cast<uint64_t>(entry.bytes));
+        writer.key("count").value(static_cast<uint64_t>(entry.count));
+        writer.endObject();
+    }
+    writer.endObject();
+    writer.key("luaAllocatorLargeBytes").value(static_cast<uint64_t>(this->luaAllocatorLargeBytes));
+    writer.key("luaAllocatorPooledBytes").value(static_cast<uint64_t>(this->luaAllocatorPooledBytes));
+    writer.key("luaAllocatorRequestedBytes").value(static_cast<uint64_t>(this->luaAllocatorRequestedBytes));
+    writer.key("luaAllocatorReservedBytes").value(static_cast<uint64_t>(this->luaAllocatorReservedBytes));
+    writer.key("luaHeapBytes").value(static_cast<uint64_t>(this->luaHeapBytes));
+    writer.key("ogreEntities").value(static_cast<uint64_t>(this->ogreEntities));
+    writer.key("rigidBodies").value(static_cast<uint64_t>(this->rigidBodies));
+    writer.key("sceneNodes").value(static_cast<uint64_t>(this->sceneNodes));
+    writer.key("totalComponentBytes").value(static_cast<uint64_t>(this->totalComponentBytes()));
+    writer.endObject();
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class JsonWriter;
+
+/**
+* @brief A snapshot of how much memory the engine's parts use
+*
+* Created by Engine::memoryStats(). Counts are summed over all game states.
+* Byte counts are estimates from container capacities and object sizes;
+* allocator overhead and memory that components own indirectly, like
+* strings, are not included.
+*/
+struct MemoryStats {
+
+    /**
+    * @brief Memory of the components of one type
+    */
+    struct Components {
+
+        /**
+        * @brief Estimated bytes of the components and their collections
+        *
+        * Components of types registered from Lua only count their
+        * collection's bookkeeping, the rest lives on the Lua heap.
+        */
+        size_t bytes = 0;
+
+        /**
+        * @brief Number of components
+        */
+        size_t count = 0;
+
+        /**
+        * @brief The component type name
+        */
+        std::string typeName;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MemoryStats::componentBytes()
+    * - MemoryStats::componentCount()
+    * - MemoryStats::collisionObjects
+    * - MemoryStats::collisionShapes
+    * - MemoryStats::componentPoolAllocatedBytes
+    * - MemoryStats::componentPoolReservedBytes
+    * - MemoryStats::luaAllocatorLargeBytes
+    * - MemoryStats::luaAllocatorPooledBytes
+    * - MemoryStats::luaAllocatorRequestedBytes
+    * - MemoryStats::luaAllocatorReservedBytes
+    * - MemoryStats::luaHeapBytes
+    * - MemoryStats::ogreEntities
+    * - MemoryStats::report()
+    * - MemoryStats::rigidBodies
+    * - MemoryStats::sceneNodes
+    * - MemoryStats::totalComponentBytes()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Estimated bytes of all components of a type
+    *
+    * @param typeName
+    *
+    * @return
+    *   The bytes or \c 0 if there are no such components
+    */
+    size_t
+    componentBytes(
+        const std::string& typeName
+    ) const;
+
+    /**
+    * @brief The number of components of a type
+    *
+    * @param typeName
+    */
+    size_t
+    componentCount(
+        const std::string& typeName
+    ) const;
+
+    /**
+    * @brief Summarizes the statistics as text
+    *
+    * Lists the totals of each subsystem, then the component types using
+    * the most memory.
+    *
+    * @param count
+    *   The maximum number of component types to list
+    */
+    std::string
+    report(
+        unsigned int count
+    ) const;
+
+    /**
+    * @brief Estimated bytes of all components
+    */
+    size_t
+    totalComponentBytes() const;
+
+    /**
+    * @brief Writes the statistics as a JSON object
+    *
+    * With one field per member, named like it, and "components" keyed by
+    * type name, each with a "bytes" and "count".
+    */
+    void
+    writeJson(
+        JsonWriter& writer
+    ) const;
+
+    /**
+    * @brief Bullet collision objects, including rigid bodies
+    */
+    size_t collisionObjects = 0;
+
+    /**
+    * @brief Distinct Bullet collision shapes, including the children of
+    * compound shapes
+    */
+    size_t collisionShapes = 0;
+
+    /**
+    * @brief Bytes of the component pools that are in use
+    *
+    * @see Component::operator new()
+    */
+    size_t componentPoolAllocatedBytes = 0;
+
+    /**
+    * @brief Bytes reserved by the component pools
+    */
+    size_t componentPoolReservedBytes = 0;
+
+    /**
+    * @brief Per component type, most bytes first
+    */
+    std::vector<Components> components;
+
+    /**
+    * @brief Bytes of the Lua blocks too large for the LuaAllocator's pools
+    */
+    size_t luaAllocatorLargeBytes = 0;
+
+    /**
+    * @brief Bytes of the LuaAllocator's pool blocks in use or cached
+    */
+    size_t luaAllocatorPooledBytes = 0;
+
+    /**
+    * @brief Bytes all Lua states have allocated, including the script
+    * workers' states
+    */
+    size_t luaAllocatorRequestedBytes = 0;
+
+    /**
+    * @brief Bytes reserved by the LuaAllocator's pools
+    */
+    size_t luaAllocatorReservedBytes = 0;
+
+    /**
+    * @brief Size of the Lua heap as reported by the Lua garbage collector
+    */
+    size_t luaHeapBytes = 0;
+
+    /**
+    * @brief Ogre entities in the scene managers
+    */
+    size_t ogreEntities = 0;
+
+    /**
+    * @brief Bullet rigid bodies
+    */
+    size_t rigidBodies = 0;
+
+    /**
+    * @brief Ogre scene nodes, including the root nodes
+    */
+    size_t sceneNodes = 0;
+
+};
+
+}
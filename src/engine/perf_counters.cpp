@@ -0,0 +1,152 @@
+#include "engine/perf_counters.h"
+
+#include <atomic>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace thrive;
+
+#ifdef __linux__
+
+namespace {
+
+// In the order of PerfCounters::Values' reads below
+const uint64_t EVENTS[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+const size_t EVENT_COUNT = sizeof(EVENTS) / sizeof(EVENTS[0]);
+
+// Whether opening counters worked on any thread, or failed on the first
+enum class Availability {
+    Unknown,
+    Available,
+    Unavailable
+};
+
+std::atomic<Availability> g_availability(Availability::Unknown);
+
+
+// The counters of one thread, opened as a group so that the kernel
+// schedules them together
+class ThreadCounters {
+
+public:
+
+    ~ThreadCounters() {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool
+    read(
+        PerfCounters::Values& values
+    ) {
+        if (not m_isOpen and not this->open()) {
+            return false;
+        }
+        // PERF_FORMAT_GROUP: the number of counters, then their values
+        uint64_t buffer[1 + EVENT_COUNT];
+        ssize_t size = ::read(m_fds[0], buffer, sizeof(buffer));
+        if (size != static_cast<ssize_t>(sizeof(buffer)) or buffer[0] != EVENT_COUNT) {
+            return false;
+        }
+        values.cycles = buffer[1];
+        values.instructions = buffer[2];
+        values.cacheMisses = buffer[3];
+        values.branchMisses = buffer[4];
+        return true;
+    }
+
+private:
+
+    bool
+    open() {
+        if (m_hasFailed or g_availability.load() == Availability::Unavailable) {
+            return false;
+        }
+        for (size_t i = 0; i < EVENT_COUNT; ++i) {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = EVENTS[i];
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP;
+            // This thread on any CPU, in the group of the first counter
+            int groupFd = i == 0 ? -1 : m_fds[0];
+            m_fds[i] = static_cast<int>(
+                syscall(__NR_perf_event_open, &attributes, 0, -1, groupFd, 0)
+            );
+            if (m_fds[i] < 0) {
+                m_hasFailed = true;
+                // Only the first attempt decides, later failures may be
+                // from running out of file descriptors
+                Availability unknown = Availability::Unknown;
+                g_availability.compare_exchange_strong(unknown, Availability::Unavailable);
+                return false;
+            }
+        }
+        g_availability.store(Availability::Available);
+        m_isOpen = true;
+        return true;
+    }
+
+    int m_fds[EVENT_COUNT] = {-1, -1, -1, -1};
+
+    bool m_hasFailed = false;
+
+    bool m_isOpen = false;
+
+};
+
+thread_local ThreadCounters t_counters;
+
+}
+
+
+bool
+PerfCounters::isAvailable() {
+    if (g_availability.load() == Availability::Unknown) {
+        Values values;
+        read(values);
+    }
+    return g_availability.load() == Availability::Available;
+}
+
+
+bool
+PerfCounters::read(
+    Values& values
+) {
+    return t_counters.read(values);
+}
+
+#else
+
+bool
+PerfCounters::isAvailable() {
+    return false;
+}
+
+
+bool
+PerfCounters::read(
+    Values&
+) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+namespace thrive {
+
+/**
+* @brief Reads the hardware performance counters of the calling thread
+*
+* Wall time alone doesn't tell whether code waits for memory. The
+* counters do: few instructions per cycle and many last level cache
+* misses point to a memory-bound system.
+*
+* On Linux, each thread opens its own group of counters through
+* \c perf_event_open on its first read() and keeps it until it exits. The
+* counters only count user space code of the thread that reads them, not
+* work the thread hands to others. If other tools use the hardware
+* counters at the same time, the kernel multiplexes them and the counts
+* come out too low.
+*
+* Other platforms, and kernels that don't permit counting (see
+* \c /proc/sys/kernel/perf_event_paranoid), have no counters, see
+* isAvailable().
+*/
+class PerfCounters {
+
+public:
+
+    /**
+    * @brief Counts since an arbitrary point in time
+    *
+    * Only differences between two reads of the same thread mean anything.
+    */
+    struct Values {
+
+        /**
+        * @brief Mispredicted branches
+        */
+        uint64_t branchMisses = 0;
+
+        /**
+        * @brief Last level cache misses
+        */
+        uint64_t cacheMisses = 0;
+
+        /**
+        * @brief CPU cycles
+        */
+        uint64_t cycles = 0;
+
+        /**
+        * @brief Retired instructions
+        */
+        uint64_t instructions = 0;
+
+        Values&
+        operator+= (
+            const Values& other
+        ) {
+            branchMisses += other.branchMisses;
+            cacheMisses += other.cacheMisses;
+            cycles += other.cycles;
+            instructions += other.instructions;
+            return *this;
+        }
+
+        Values
+        operator- (
+            const Values& other
+        ) const {
+            Values difference;
+            difference.branchMisses = branchMisses - other.branchMisses;
+            difference.cacheMisses = cacheMisses - other.cacheMisses;
+            difference.cycles = cycles - other.cycles;
+            difference.instructions = instructions - other.instructions;
+            return difference;
+        }
+
+    };
+
+    /**
+    * @brief Whether the counters can be read
+    *
+    * Tries to open the calling thread's counters the first time.
+    */
+    static bool
+    isAvailable();
+
+    /**
+    * @brief Reads the calling thread's counters
+    *
+    * @param values
+    *   Left alone if the counters can't be read
+    *
+    * @return
+    *   \c false if the counters are not available
+    */
+    static bool
+    read(
+        Values& values
+    );
+
+};
+
+}
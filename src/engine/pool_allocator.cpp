@@ -0,0 +1,131 @@
+#include "engine/pool_allocator.h"
+
+#include <algorithm>
+#include <boost/thread/lock_guard.hpp>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Alignment suitable for any type, as guaranteed by operator new
+const size_t MAX_ALIGNMENT = alignof(std::max_align_t);
+
+size_t
+roundUpBlockSize(
+    size_t size
+) {
+    size = std::max(size, sizeof(void*));
+    return (size + MAX_ALIGNMENT - 1) / MAX_ALIGNMENT * MAX_ALIGNMENT;
+}
+
+}
+
+
+PoolAllocator::PoolAllocator(
+    size_t blockSize,
+    size_t blocksPerChunk
+) : m_blocksPerChunk(blocksPerChunk),
+    m_blockSize(roundUpBlockSize(blockSize))
+{
+    if (blocksPerChunk == 0) {
+        throw std::invalid_argument("Pool chunks must hold at least one block");
+    }
+}
+
+
+void
+PoolAllocator::addChunk() {
+    // The array form of operator new aligns for any type as well
+    std::unique_ptr<char[]> chunk(new char[m_blockSize * m_blocksPerChunk]);
+    // Link the new blocks back to front, so that they are handed out
+    // in address order
+    for (size_t i = m_blocksPerChunk; i > 0; --i) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(
+            chunk.get() + (i - 1) * m_blockSize
+        );
+        block->next = m_freeList;
+        m_freeList = block;
+    }
+    m_chunks.push_back(std::move(chunk));
+}
+
+
+void*
+PoolAllocator::allocate() {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (not m_freeList) {
+        this->addChunk();
+    }
+    FreeBlock* block = m_freeList;
+    m_freeList = block->next;
+    m_allocatedBlocks += 1;
+    return block;
+}
+
+
+void
+PoolAllocator::allocateBatch(
+    void** blocks,
+    size_t count
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (size_t i = 0; i < count; ++i) {
+        if (not m_freeList) {
+            this->addChunk();
+        }
+        blocks[i] = m_freeList;
+        m_freeList = m_freeList->next;
+        m_allocatedBlocks += 1;
+    }
+}
+
+
+size_t
+PoolAllocator::allocatedBlocks() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_allocatedBlocks;
+}
+
+
+size_t
+PoolAllocator::blockSize() const {
+    return m_blockSize;
+}
+
+
+void
+PoolAllocator::deallocate(
+    void* pointer
+) {
+    if (not pointer) {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    FreeBlock* block = static_cast<FreeBlock*>(pointer);
+    block->next = m_freeList;
+    m_freeList = block;
+    m_allocatedBlocks -= 1;
+}
+
+
+void
+PoolAllocator::deallocateBatch(
+    void* const* blocks,
+    size_t count
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (size_t i = 0; i < count; ++i) {
+        FreeBlock* block = static_cast<FreeBlock*>(blocks[i]);
+        block->next = m_freeList;
+        m_freeList = block;
+    }
+    m_allocatedBlocks -= count;
+}
+
+
+size_t
+PoolAllocator::reservedBytes() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_chunks.size() * m_blocksPerChunk * m_blockSize;
+}
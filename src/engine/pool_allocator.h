@@ -0,0 +1,140 @@
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief Hands out memory blocks of a fixed size
+*
+* Blocks are carved from chunks of many blocks each and recycled through a
+* free list, so that allocating and freeing a block is a few pointer
+* operations instead of a trip through the general-purpose heap, and
+* objects of the same kind end up next to each other. Chunks are only
+* released when the pool is destroyed.
+*
+* All methods are thread safe.
+*/
+class PoolAllocator {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param blockSize
+    *   The size of each block. Rounded up so that all blocks are aligned
+    *   for any type.
+    * @param blocksPerChunk
+    *   How many blocks are allocated at once when the pool runs out
+    *
+    * @throw std::invalid_argument
+    *   If \a blocksPerChunk is 0
+    */
+    explicit PoolAllocator(
+        size_t blockSize,
+        size_t blocksPerChunk = 256
+    );
+
+    PoolAllocator(const PoolAllocator&) = delete;
+
+    PoolAllocator& operator= (const PoolAllocator&) = delete;
+
+    /**
+    * @brief Returns an unused block
+    *
+    * @throw std::bad_alloc
+    */
+    void*
+    allocate();
+
+    /**
+    * @brief Returns several unused blocks under a single lock
+    *
+    * @param blocks
+    *   Receives the blocks
+    * @param count
+    *   The number of blocks
+    *
+    * @throw std::bad_alloc
+    */
+    void
+    allocateBatch(
+        void** blocks,
+        size_t count
+    );
+
+    /**
+    * @brief The number of blocks currently handed out
+    */
+    size_t
+    allocatedBlocks() const;
+
+    /**
+    * @brief The size of each block, after rounding
+    */
+    size_t
+    blockSize() const;
+
+    /**
+    * @brief Returns a block to the pool
+    *
+    * @param block
+    *   A block returned by allocate() of this pool
+    */
+    void
+    deallocate(
+        void* block
+    );
+
+    /**
+    * @brief Returns several blocks to the pool under a single lock
+    *
+    * @param blocks
+    *   Blocks returned by allocate() or allocateBatch() of this pool
+    * @param count
+    *   The number of blocks
+    */
+    void
+    deallocateBatch(
+        void* const* blocks,
+        size_t count
+    );
+
+    /**
+    * @brief The bytes of all chunks
+    */
+    size_t
+    reservedBytes() const;
+
+private:
+
+    // An unused block, linking to the next one
+    struct FreeBlock {
+
+        FreeBlock* next;
+
+    };
+
+    // Must be called with m_mutex locked
+    void
+    addChunk();
+
+    size_t m_allocatedBlocks = 0;
+
+    size_t m_blocksPerChunk;
+
+    size_t m_blockSize;
+
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+
+    FreeBlock* m_freeList = nullptr;
+
+    mutable boost::mutex m_mutex;
+
+};
+
+}
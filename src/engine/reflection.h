@@ -0,0 +1,675 @@
+#pragma once
+
+#include "engine/serialization.h"
+#include "engine/touchable.h"
+
+#include <cstdint>
+#include <cstring>
+#include <OgreColourValue.h>
+#include <OgreMath.h>
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace thrive {
+
+/**
+* @brief Declares a field of a class for a FieldList
+*
+* Use field() or storedField() to create one.
+*
+* @tparam Class
+*   The class the field is a member of
+* @tparam T
+*   The field's type
+* @tparam Stored
+*   The type the field is saved and serialized as, like a fixed size
+*   integer for an enum
+*/
+template<typename Class, typename T, typename Stored = T>
+struct Field {
+
+    using ClassType = Class;
+
+    using StoredType = Stored;
+
+    using ValueType = T;
+
+    /**
+    * @brief The key the field is saved under and its name in Lua
+    */
+    const char* name;
+
+    /**
+    * @brief The field
+    */
+    T Class::* member;
+
+};
+
+/**
+* @brief Declares a field saved as its own type
+*
+* @param name
+*   The key the field is saved under
+* @param member
+*   The field
+*/
+template<typename Class, typename T>
+Field<Class, T>
+field(
+    const char* name,
+    T Class::* member
+) {
+    return Field<Class, T>{name, member};
+}
+
+/**
+* @brief Declares a field saved as another type
+*
+* @tparam Stored
+*   The saved type, must be convertible to and from the field's type with
+*   \c static_cast
+* @param name
+*   The key the field is saved under
+* @param member
+*   The field
+*/
+template<typename Stored, typename Class, typename T>
+Field<Class, T, Stored>
+storedField(
+    const char* name,
+    T Class::* member
+) {
+    return Field<Class, T, Stored>{name, member};
+}
+
+
+namespace detail {
+
+template<size_t Index, size_t Count>
+struct ForEachField {
+
+    template<typename Tuple, typename Function>
+    static void
+    apply(
+        const Tuple& fields,
+        Function& function
+    ) {
+        function(Index, std::get<Index>(fields));
+        ForEachField<Index + 1, Count>::apply(fields, function);
+    }
+
+};
+
+template<size_t Count>
+struct ForEachField<Count, Count> {
+
+    template<typename Tuple, typename Function>
+    static void
+    apply(
+        const Tuple&,
+        Function&
+    ) {}
+
+};
+
+// Little endian, like the binary format of StorageContainer
+template<typename T>
+void
+writeBits(
+    std::string& buffer,
+    T bits
+) {
+    for (size_t byte = 0; byte < sizeof(T); ++byte) {
+        buffer.push_back(static_cast<char>(bits >> (8 * byte)));
+    }
+}
+
+template<typename T>
+T
+readBits(
+    const std::string& buffer,
+    size_t& offset
+) {
+    if (offset > buffer.size() or buffer.size() - offset < sizeof(T)) {
+        throw std::out_of_range("Binary fields are truncated");
+    }
+    T bits = 0;
+    for (size_t byte = 0; byte < sizeof(T); ++byte) {
+        bits |= static_cast<T>(static_cast<uint8_t>(buffer[offset + byte])) << (8 * byte);
+    }
+    offset += sizeof(T);
+    return bits;
+}
+
+// Unsigned integer of the same size, for writing the bits of scalars
+template<size_t Size>
+struct BitsOfSize;
+
+template<>
+struct BitsOfSize<1> { using Type = uint8_t; };
+
+template<>
+struct BitsOfSize<2> { using Type = uint16_t; };
+
+template<>
+struct BitsOfSize<4> { using Type = uint32_t; };
+
+template<>
+struct BitsOfSize<8> { using Type = uint64_t; };
+
+} // namespace detail
+
+
+/**
+* @brief Writes and reads a stored type in the binary field format
+*
+* The primary template handles arithmetic types and enums. Specialize it
+* for other types that fields are stored as.
+*/
+template<typename T>
+struct BinaryField {
+
+    static_assert(
+        std::is_arithmetic<T>::value or std::is_enum<T>::value,
+        "No binary format for this type, specialize BinaryField"
+    );
+
+    using Bits = typename detail::BitsOfSize<sizeof(T)>::Type;
+
+    static void
+    write(
+        std::string& buffer,
+        const T& value
+    ) {
+        Bits bits = 0;
+        std::memcpy(&bits, &value, sizeof(T));
+        detail::writeBits(buffer, bits);
+    }
+
+    static T
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        Bits bits = detail::readBits<Bits>(buffer, offset);
+        T value;
+        std::memcpy(&value, &bits, sizeof(T));
+        return value;
+    }
+
+};
+
+template<>
+struct BinaryField<std::string> {
+
+    static void
+    write(
+        std::string& buffer,
+        const std::string& value
+    ) {
+        detail::writeBits<uint32_t>(buffer, value.size());
+        buffer.append(value);
+    }
+
+    static std::string
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        uint32_t size = detail::readBits<uint32_t>(buffer, offset);
+        if (buffer.size() - offset < size) {
+            throw std::out_of_range("Binary fields are truncated");
+        }
+        std::string value = buffer.substr(offset, size);
+        offset += size;
+        return value;
+    }
+
+};
+
+template<>
+struct BinaryField<Ogre::Degree> {
+
+    static void
+    write(
+        std::string& buffer,
+        const Ogre::Degree& value
+    ) {
+        BinaryField<float>::write(buffer, value.valueDegrees());
+    }
+
+    static Ogre::Degree
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        return Ogre::Degree(BinaryField<float>::read(buffer, offset));
+    }
+
+};
+
+template<>
+struct BinaryField<Ogre::Vector3> {
+
+    static void
+    write(
+        std::string& buffer,
+        const Ogre::Vector3& value
+    ) {
+        for (size_t i = 0; i < 3; ++i) {
+            BinaryField<float>::write(buffer, value[i]);
+        }
+    }
+
+    static Ogre::Vector3
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        Ogre::Vector3 value;
+        for (size_t i = 0; i < 3; ++i) {
+            value[i] = BinaryField<float>::read(buffer, offset);
+        }
+        return value;
+    }
+
+};
+
+template<>
+struct BinaryField<Ogre::Quaternion> {
+
+    static void
+    write(
+        std::string& buffer,
+        const Ogre::Quaternion& value
+    ) {
+        BinaryField<float>::write(buffer, value.w);
+        BinaryField<float>::write(buffer, value.x);
+        BinaryField<float>::write(buffer, value.y);
+        BinaryField<float>::write(buffer, value.z);
+    }
+
+    static Ogre::Quaternion
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        Ogre::Quaternion value;
+        value.w = BinaryField<float>::read(buffer, offset);
+        value.x = BinaryField<float>::read(buffer, offset);
+        value.y = BinaryField<float>::read(buffer, offset);
+        value.z = BinaryField<float>::read(buffer, offset);
+        return value;
+    }
+
+};
+
+template<>
+struct BinaryField<Ogre::ColourValue> {
+
+    static void
+    write(
+        std::string& buffer,
+        const Ogre::ColourValue& value
+    ) {
+        BinaryField<uint32_t>::write(buffer, value.getAsRGBA());
+    }
+
+    static Ogre::ColourValue
+    read(
+        const std::string& buffer,
+        size_t& offset
+    ) {
+        Ogre::ColourValue value;
+        value.setAsRGBA(BinaryField<uint32_t>::read(buffer, offset));
+        return value;
+    }
+
+};
+
+
+/**
+* @brief Declares the fields of a class once for saving, binary
+* serialization, Lua bindings and change masks
+*
+* Create one with fieldList() next to the class's implementation:
+*
+* \code
+* static const auto PROPERTY_FIELDS = fieldList<Properties>(
+*     field("fovY", &Properties::fovY),
+*     storedField<int16_t>("polygonMode", &Properties::polygonMode)
+* );
+* \endcode
+*
+* The list is a tuple of member pointers, so all operations are unrolled
+* at compile time without looking up anything by name. Field \a i has
+* the change mask bit <tt>1 << i</tt>, see mask().
+*
+* @tparam Class
+*   The class the fields belong to
+* @tparam Fields
+*   Field instantiations
+*/
+template<typename Class, typename... Fields>
+class FieldList {
+
+public:
+
+    /**
+    * @brief The number of fields
+    */
+    static const size_t SIZE = sizeof...(Fields);
+
+    static_assert(
+        SIZE <= 8 * sizeof(Touchable::FieldMask),
+        "Too many fields for a change mask"
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param fields
+    */
+    FieldList(
+        Fields... fields
+    ) : m_fields(fields...)
+    {
+    }
+
+    /**
+    * @brief Adds the fields as read-write properties to a Lua class
+    *
+    * @param luaClass
+    *   The \c luabind::class_ being defined
+    *
+    * @return
+    *   \a luaClass, for chaining more definitions
+    */
+    template<typename LuaClass>
+    LuaClass&
+    bind(
+        LuaClass&& luaClass
+    ) const {
+        Binder<LuaClass> binder{luaClass};
+        this->forEach(binder);
+        return luaClass;
+    }
+
+    /**
+    * @brief Calls a function with the index and the Field of each field
+    *
+    * @param function
+    *   A function object with a call operator template
+    */
+    template<typename Function>
+    void
+    forEach(
+        Function& function
+    ) const {
+        detail::ForEachField<0, SIZE>::apply(m_fields, function);
+    }
+
+    /**
+    * @brief Loads the fields saved by store()
+    *
+    * Fields missing from \a storage keep their current value, so the
+    * defaults are the ones the class initializes its fields with.
+    *
+    * @param object
+    *   The object to load into
+    * @param storage
+    *   The saved fields
+    */
+    void
+    load(
+        Class& object,
+        const StorageContainer& storage
+    ) const {
+        Loader loader{object, storage};
+        this->forEach(loader);
+    }
+
+    /**
+    * @brief The change mask bit of a field
+    *
+    * @param member
+    *   The field
+    *
+    * @throw std::invalid_argument
+    *   If \a member is not in the list
+    */
+    template<typename T>
+    Touchable::FieldMask
+    mask(
+        T Class::* member
+    ) const {
+        MaskFinder<T> finder{member, 0};
+        this->forEach(finder);
+        if (not finder.mask) {
+            throw std::invalid_argument("Member is not a declared field");
+        }
+        return finder.mask;
+    }
+
+    /**
+    * @brief Reads the fields written by writeBinary()
+    *
+    * @param object
+    *   The object to read into
+    * @param buffer
+    *   The buffer to read from
+    * @param offset
+    *   Where to start reading, advanced past the fields
+    *
+    * @throw std::out_of_range
+    *   If the buffer ends before the fields
+    */
+    void
+    readBinary(
+        Class& object,
+        const std::string& buffer,
+        size_t& offset
+    ) const {
+        BinaryReader reader{object, buffer, offset};
+        this->forEach(reader);
+    }
+
+    /**
+    * @brief Saves the fields by their names
+    *
+    * @param object
+    *   The object to save
+    * @param storage
+    *   Receives the fields
+    */
+    void
+    store(
+        const Class& object,
+        StorageContainer& storage
+    ) const {
+        Storer storer{object, storage};
+        this->forEach(storer);
+    }
+
+    /**
+    * @brief Appends the fields in declaration order, without names
+    *
+    * Each field takes the fixed size of its stored type, strings are
+    * prefixed with their length. Reading them back requires the same
+    * list of fields.
+    *
+    * @param object
+    *   The object to write
+    * @param buffer
+    *   Receives the fields
+    */
+    void
+    writeBinary(
+        const Class& object,
+        std::string& buffer
+    ) const {
+        BinaryWriter writer{object, buffer};
+        this->forEach(writer);
+    }
+
+private:
+
+    template<typename LuaClass>
+    struct Binder {
+
+        template<typename F>
+        void
+        operator() (
+            size_t,
+            const F& field
+        ) {
+            luaClass.def_readwrite(field.name, field.member);
+        }
+
+        LuaClass& luaClass;
+
+    };
+
+    struct BinaryReader {
+
+        template<typename F>
+        void
+        operator() (
+            size_t,
+            const F& field
+        ) {
+            using Stored = typename F::StoredType;
+            object.*field.member = static_cast<typename F::ValueType>(
+                BinaryField<Stored>::read(buffer, offset)
+            );
+        }
+
+        Class& object;
+
+        const std::string& buffer;
+
+        size_t& offset;
+
+    };
+
+    struct BinaryWriter {
+
+        template<typename F>
+        void
+        operator() (
+            size_t,
+            const F& field
+        ) {
+            using Stored = typename F::StoredType;
+            BinaryField<Stored>::write(buffer, static_cast<Stored>(object.*field.member));
+        }
+
+        const Class& object;
+
+        std::string& buffer;
+
+    };
+
+    struct Loader {
+
+        template<typename F>
+        void
+        operator() (
+            size_t,
+            const F& field
+        ) {
+            using Stored = typename F::StoredType;
+            object.*field.member = static_cast<typename F::ValueType>(
+                storage.get<Stored>(field.name, static_cast<Stored>(object.*field.member))
+            );
+        }
+
+        Class& object;
+
+        const StorageContainer& storage;
+
+    };
+
+    template<typename T>
+    struct MaskFinder {
+
+        template<typename F>
+        void
+        operator() (
+            size_t index,
+            const F& field
+        ) {
+            if (isSameMember(field.member)) {
+                mask = Touchable::FieldMask(1) << index;
+            }
+        }
+
+        bool
+        isSameMember(
+            T Class::* other
+        ) const {
+            return other == member;
+        }
+
+        template<typename Other>
+        bool
+        isSameMember(
+            Other
+        ) const {
+            return false;
+        }
+
+        T Class::* member;
+
+        Touchable::FieldMask mask;
+
+    };
+
+    struct Storer {
+
+        template<typename F>
+        void
+        operator() (
+            size_t,
+            const F& field
+        ) {
+            using Stored = typename F::StoredType;
+            storage.set<Stored>(field.name, static_cast<Stored>(object.*field.member));
+        }
+
+        const Class& object;
+
+        StorageContainer& storage;
+
+    };
+
+    std::tuple<Fields...> m_fields;
+
+};
+
+template<typename Class, typename... Fields>
+const size_t FieldList<Class, Fields...>::SIZE;
+
+
+/**
+* @brief Creates a FieldList
+*
+* @tparam Class
+*   The class the fields belong to
+* @param fields
+*   The fields, created with field() or storedField()
+*/
+template<typename Class, typename... Fields>
+FieldList<Class, Fields...>
+fieldList(
+    Fields... fields
+) {
+    return FieldList<Class, Fields...>(fields...);
+}
+
+}
@@ -2,73 +2,271 @@
 
 #include "scripting/luabind.h"
 
+#include <vector>
+
 using namespace thrive;
 
-struct RNG::Implementation {
-    Implementation(
-        Seed seed
-    ) : m_seed(seed),
-        m_mt(seed)
-    {
+static RNG::Seed
+randomDeviceSeed() {
+    std::random_device randomDevice;
+    return randomDevice();
+}
+
+
+// Uniform value in [0, 1) from the upper 53 bits
+static double
+toUnitDouble(
+    uint64_t bits
+) {
+    return (bits >> 11) * (1.0 / (UINT64_C(1) << 53));
+}
+
+
+// Uniform value in [0, 1) from the upper 24 bits
+static float
+toUnitFloat(
+    uint64_t bits
+) {
+    return (bits >> 40) * (1.0f / (UINT64_C(1) << 24));
+}
+
+
+// Uniform value in [0, span) by Lemire's multiply-and-reject
+static uint64_t
+uniformBelow(
+    RNG::Generator& generator,
+    uint64_t span
+) {
+    // Rejecting the lowest (2^32 mod span) products removes the bias
+    const uint64_t threshold = ((UINT64_C(1) << 32) - span) % span;
+    uint64_t product = 0;
+    do {
+        product = (generator() >> 32) * span;
+    } while ((product & UINT32_MAX) < threshold);
+    return product >> 32;
+}
+
+
+static luabind::object
+RNG_getAngles(
+    RNG* self,
+    int count,
+    lua_State* L
+) {
+    std::vector<float> values(std::max(count, 0));
+    self->fillAngles(values.data(), values.size());
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < values.size(); ++i) {
+        table[i + 1] = values[i];
+    }
+    return table;
+}
+
+
+static luabind::object
+RNG_getInts(
+    RNG* self,
+    int count,
+    int min,
+    int max,
+    lua_State* L
+) {
+    std::vector<int> values(std::max(count, 0));
+    self->fillInts(values.data(), values.size(), min, max);
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < values.size(); ++i) {
+        table[i + 1] = values[i];
     }
-    Implementation()
-    {
-        m_seed = m_rd();
-        m_mt = std::mt19937(m_seed);
+    return table;
+}
+
+
+static luabind::object
+RNG_getReals(
+    RNG* self,
+    int count,
+    double min,
+    double max,
+    lua_State* L
+) {
+    std::vector<double> values(std::max(count, 0));
+    self->fillDoubles(values.data(), values.size(), min, max);
+    luabind::object table = luabind::newtable(L);
+    for (size_t i = 0; i < values.size(); ++i) {
+        table[i + 1] = values[i];
     }
+    return table;
+}
 
-    Seed m_seed;
-    std::random_device m_rd;
-    std::mt19937 m_mt;
-};
 
+////////////////////////////////////////////////////////////////////////////////
+// RNG::Generator
+////////////////////////////////////////////////////////////////////////////////
+
+RNG::Generator::Generator(
+    Seed seed
+) {
+    this->seed(seed);
+}
+
+
+void
+RNG::Generator::jump() {
+    static const uint64_t JUMP[] = {
+        0x180ec6d33cfd0aba,
+        0xd5a61266f0c9392c,
+        0xa9582618e03fc9aa,
+        0x39abdc4529b1661c
+    };
+    uint64_t state[4] = {0, 0, 0, 0};
+    for (uint64_t jump : JUMP) {
+        for (int bit = 0; bit < 64; ++bit) {
+            if (jump & (UINT64_C(1) << bit)) {
+                for (int i = 0; i < 4; ++i) {
+                    state[i] ^= m_state[i];
+                }
+            }
+            (*this)();
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        m_state[i] = state[i];
+    }
+}
+
+
+void
+RNG::Generator::seed(
+    Seed seed
+) {
+    // splitmix64, so that similar seeds still give unrelated states
+    uint64_t x = seed;
+    for (uint64_t& word : m_state) {
+        x += 0x9e3779b97f4a7c15;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        word = z ^ (z >> 31);
+    }
+}
+
+
+std::array<uint64_t, 4>
+RNG::Generator::state() const {
+    return {{m_state[0], m_state[1], m_state[2], m_state[3]}};
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// RNG
+////////////////////////////////////////////////////////////////////////////////
 
 luabind::scope
 RNG::luaBindings(){
     using namespace luabind;
     return class_<RNG>("RNG")
         .def("getInt", &RNG::getInt)
+        .def("getInts", &RNG_getInts)
         .def("getReal", &RNG::getDouble)
+        .def("getReals", &RNG_getReals)
+        .def("getAngles", &RNG_getAngles)
         .def("generateRandomSeed", &RNG::generateRandomSeed)
         .def("setSeed", &RNG::setSeed)
         .def("getSeed", &RNG::getSeed)
+        .def("split", &RNG::split)
     ;
 }
 
 RNG::RNG()
-  : m_impl(new Implementation())
+  : RNG(randomDeviceSeed())
 {
 }
 
 
 RNG::RNG(
     Seed seed
-) : m_impl(new Implementation(seed))
+) : m_generator(seed),
+    m_seed(seed)
 {
 }
 
 
-RNG::~RNG(){}
-
-
 void
 RNG::setSeed(
     Seed seed
 ) {
-    m_impl->m_seed = seed;
-    m_impl->m_mt.seed(seed);
+    m_seed = seed;
+    m_generator.seed(seed);
 }
 
 
 RNG::Seed
 RNG::getSeed() const {
-    return m_impl->m_seed;
+    return m_seed;
 }
 
 
 RNG::Seed
 RNG::generateRandomSeed() {
-    return m_impl->m_rd();
+    return randomDeviceSeed();
+}
+
+
+void
+RNG::fillAngles(
+    float* values,
+    size_t count
+) {
+    const float TWO_PI = 6.28318530717958647692f;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = toUnitFloat(m_generator()) * TWO_PI;
+    }
+}
+
+
+void
+RNG::fillDoubles(
+    double* values,
+    size_t count,
+    double min,
+    double max
+) {
+    const double range = max - min;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = min + toUnitDouble(m_generator()) * range;
+    }
+}
+
+
+void
+RNG::fillFloats(
+    float* values,
+    size_t count,
+    float min,
+    float max
+) {
+    const float range = max - min;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = min + toUnitFloat(m_generator()) * range;
+    }
+}
+
+
+void
+RNG::fillInts(
+    int* values,
+    size_t count,
+    int min,
+    int max
+) {
+    const uint64_t span = static_cast<uint64_t>(
+        static_cast<int64_t>(max) - static_cast<int64_t>(min)
+    ) + 1;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<int>(
+            static_cast<int64_t>(min) + uniformBelow(m_generator, span)
+        );
+    }
 }
 
 
@@ -77,8 +275,7 @@ RNG::getDouble(
     double min,
     double max
 ) {
-    std::uniform_real_distribution<double> dis(min, max);
-    return dis(m_impl->m_mt);
+    return min + toUnitDouble(m_generator()) * (max - min);
 }
 
 
@@ -87,15 +284,21 @@ RNG::getInt(
     int min,
     int max
 ) {
-    std::uniform_int_distribution<int> dis(min, max);
-    return dis(m_impl->m_mt);
+    int value = 0;
+    this->fillInts(&value, 1, min, max);
+    return value;
 }
 
 
-std::mt19937&
-RNG::mersenneTwister()
-{
-    return m_impl->m_mt;
+RNG
+RNG::split() {
+    RNG stream(*this);
+    m_generator.jump();
+    return stream;
 }
 
 
+std::array<uint64_t, 4>
+RNG::state() const {
+    return m_generator.state();
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
-#include <memory>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 
 
@@ -14,7 +16,13 @@ namespace thrive {
 /**
 * @brief Random Number Generator
 *
-* Uses C++11 RNG features for optimal quality RNG.
+* Backed by xoshiro256**, which is much cheaper per value than
+* std::mt19937 and has a state of only 32 bytes. The fill functions
+* generate a whole buffer of values per call, for hot loops that need
+* several values per entity.
+*
+* The same seed always produces the same sequence, which replays of input
+* recordings rely on. Parallel jobs should not share an RNG, see split().
 */
 class RNG final {
 
@@ -25,6 +33,88 @@ public:
     */
     using Seed = unsigned int; // parts of <random> uses unsigned int
 
+    /**
+    * @brief The xoshiro256** generator
+    *
+    * Satisfies the requirements of a uniform random bit generator, so it
+    * works with the distributions of \<random\> and std::shuffle.
+    */
+    class Generator {
+
+    public:
+
+        using result_type = uint64_t;
+
+        static constexpr result_type
+        min() {
+            return 0;
+        }
+
+        static constexpr result_type
+        max() {
+            return UINT64_MAX;
+        }
+
+        /**
+        * @brief Constructor
+        *
+        * @param seed
+        *   Expanded to the full state with splitmix64
+        */
+        explicit Generator(
+            Seed seed = 0
+        );
+
+        /**
+        * @brief Generates the next 64 random bits
+        */
+        result_type
+        operator() () {
+            const uint64_t result = rotateLeft(m_state[1] * 5, 7) * 9;
+            const uint64_t t = m_state[1] << 17;
+            m_state[2] ^= m_state[0];
+            m_state[3] ^= m_state[1];
+            m_state[1] ^= m_state[2];
+            m_state[0] ^= m_state[3];
+            m_state[2] ^= t;
+            m_state[3] = rotateLeft(m_state[3], 45);
+            return result;
+        }
+
+        /**
+        * @brief Advances the state by 2^128 values
+        */
+        void
+        jump();
+
+        /**
+        * @brief Restarts the sequence
+        */
+        void
+        seed(
+            Seed seed
+        );
+
+        /**
+        * @brief The current state, which determines all following values
+        */
+        std::array<uint64_t, 4>
+        state() const;
+
+    private:
+
+        static uint64_t
+        rotateLeft(
+            uint64_t x,
+            int k
+        ) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t m_state[4];
+
+    };
+
     /**
     * @brief Lua bindings
     *
@@ -32,9 +122,15 @@ public:
     *
     * - RNG::getInt()
     * - RNG::getDouble() (as <tt>getReal()</tt>)
+    * - RNG::fillInts() (as <tt>getInts(count, min, max)</tt>, returns a
+    *   table)
+    * - RNG::fillDoubles() (as <tt>getReals(count, min, max)</tt>, returns
+    *   a table)
+    * - RNG::fillAngles() (as <tt>getAngles(count)</tt>, returns a table)
     * - RNG::generateRandomSeed
     * - RNG::setSeed(seed)
     * - RNG::getSeed()
+    * - RNG::split()
     */
     static luabind::scope
     luaBindings();
@@ -52,11 +148,6 @@ public:
     */
     RNG(Seed seed);
 
-    /**
-    * @brief Destructor
-    */
-    ~RNG();
-
     /**
     * @brief Restarts the RNG with provided seed
     *
@@ -85,6 +176,82 @@ public:
     Seed
     generateRandomSeed();
 
+    /**
+    * @brief Fills a buffer with random angles
+    *
+    * Angles are in radians, in range [0, 2 pi).
+    *
+    * @param values
+    *   The buffer to fill
+    * @param count
+    *   The number of values
+    */
+    void
+    fillAngles(
+        float* values,
+        size_t count
+    );
+
+    /**
+    * @brief Fills a buffer with random doubles between min and max
+    *
+    * Doubles are in range [min, max].
+    *
+    * @param values
+    *   The buffer to fill
+    * @param count
+    *   The number of values
+    * @param min
+    * @param max
+    */
+    void
+    fillDoubles(
+        double* values,
+        size_t count,
+        double min,
+        double max
+    );
+
+    /**
+    * @brief Fills a buffer with random floats between min and max
+    *
+    * Floats are in range [min, max].
+    *
+    * @param values
+    *   The buffer to fill
+    * @param count
+    *   The number of values
+    * @param min
+    * @param max
+    */
+    void
+    fillFloats(
+        float* values,
+        size_t count,
+        float min,
+        float max
+    );
+
+    /**
+    * @brief Fills a buffer with random integers between min and max
+    *
+    * Integers are in range [min, max] inclusive, without modulo bias.
+    *
+    * @param values
+    *   The buffer to fill
+    * @param count
+    *   The number of values
+    * @param min
+    * @param max
+    */
+    void
+    fillInts(
+        int* values,
+        size_t count,
+        int min,
+        int max
+    );
+
     /**
     * @brief Generates a random double between min and max
     *
@@ -93,7 +260,7 @@ public:
     */
     double
     getDouble(
-        double min, 
+        double min,
         double max
     );
 
@@ -105,7 +272,7 @@ public:
     */
     int
     getInt(
-        int min, 
+        int min,
         int max
     );
 
@@ -119,22 +286,43 @@ public:
     *  int in range [min, max] inclusive
     */
     template<typename iterType>
-    void 
+    void
     shuffle(
         iterType first,
         iterType last
     ) {
-        std::shuffle(first, last, mersenneTwister());
+        std::shuffle(first, last, m_generator);
     }
 
+    /**
+    * @brief Splits off an independent stream
+    *
+    * The returned RNG continues this RNG's sequence, and this RNG jumps
+    * 2^128 values ahead, so the two never overlap. For parallel jobs,
+    * split one stream per chunk, in chunk order, before starting them.
+    * The results then don't depend on which thread runs which chunk.
+    *
+    * @return
+    *   An RNG with the same seed, see getSeed()
+    */
+    RNG
+    split();
+
+    /**
+    * @brief The generator's current state
+    *
+    * Two RNGs with the same state produce the same values from here on,
+    * whatever their seeds. Used by StateHashSystem to detect runs that
+    * drew different numbers.
+    */
+    std::array<uint64_t, 4>
+    state() const;
 
 private:
 
-    std::mt19937&
-    mersenneTwister();
+    Generator m_generator;
 
-    struct Implementation;
-    std::unique_ptr<Implementation> m_impl;
+    Seed m_seed;
 
 };
 
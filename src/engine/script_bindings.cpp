@@ -1,12 +1,29 @@
 #include "engine/script_bindings.h"
 
+#include "engine/allocation_tracker.h"
 #include "engine/component.h"
 #include "engine/component_factory.h"
+#include "engine/creation_queue.h"
 #include "engine/engine.h"
 #include "engine/entity.h"
+#include "engine/entity_manager.h"
+#include "engine/entity_prototype.h"
+#include "engine/event_bus.h"
+#include "engine/frame_budgets.h"
 #include "engine/game_state.h"
+#include "engine/hex_grid.h"
+#include "engine/idle_tasks.h"
+#include "engine/logger.h"
+#include "engine/memory_stats.h"
 #include "engine/serialization.h"
+#include "engine/staged_writes.h"
+#include "engine/state_hash.h"
+#include "engine/statistics.h"
 #include "engine/system.h"
+#include "engine/system_profiler.h"
+#include "engine/telemetry_server.h"
+#include "engine/timer_wheel.h"
+#include "engine/tracer.h"
 #include "engine/touchable.h"
 #include "engine/rng.h"
 #include "scripting/luabind.h"
@@ -15,15 +32,33 @@
 luabind::scope
 thrive::EngineBindings::luaBindings() {
     return (
+        AllocationTracker::luaBindings(),
         StorageContainer::luaBindings(),
         StorageList::luaBindings(),
+        StorageSchema::luaBindings(),
         System::luaBindings(),
+        SystemProfiler::luaBindings(),
         Component::luaBindings(),
         ComponentFactory::luaBindings(),
+        CreationQueue::luaBindings(),
         Entity::luaBindings(),
+        EntityManager::luaBindings(),
+        EntityPrototype::luaBindings(),
+        EventCursor::luaBindings(),
+        FrameBudgets::luaBindings(),
         Touchable::luaBindings(),
         GameState::luaBindings(),
         Engine::luaBindings(),
-        RNG::luaBindings()
+        HexGrid::luaBindings(),
+        IdleTasks::luaBindings(),
+        Logger::luaBindings(),
+        MemoryStats::luaBindings(),
+        RNG::luaBindings(),
+        StagedWrites::luaBindings(),
+        StateHashSystem::luaBindings(),
+        Statistics::luaBindings(),
+        TelemetryServer::luaBindings(),
+        TimerWheel::luaBindings(),
+        Tracer::luaBindings()
     );
 }
@@ -1,11 +1,24 @@
 #include "engine/serialization.h"
 
+#include "engine/compression.h"
 #include "scripting/luabind.h"
+#include "util/memory_buffer.h"
 
+#include <algorithm>
+#include <array>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/variant.hpp>
 #include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <limits>
 #include <luabind/iterator_policy.hpp>
+#include <sstream>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -16,6 +29,20 @@ namespace {
 
 using TypeId = uint16_t;
 
+struct MappedSavegame;
+
+// A nested container or list of a memory mapped savegame that hasn't been
+// parsed yet
+struct LazyValue {
+
+    const char* m_begin;
+
+    const char* m_end;
+
+    std::shared_ptr<const MappedSavegame> m_file;
+
+};
+
 using Variant = boost::variant<
     bool,
     char,
@@ -31,14 +58,37 @@ using Variant = boost::variant<
     double,
     std::string,
     StorageContainer,
-    StorageList
+    StorageList,
+    std::vector<float>,
+    std::vector<int32_t>,
+    std::vector<uint32_t>,
+    LazyValue
 >;
 
 struct StoredValue {
     TypeId typeId;
-    Variant value;
+    // Mutable so that lazy values can be parsed on access, see resolve()
+    mutable Variant value;
 };
 
+Variant
+parseLazyValue(
+    const LazyValue& lazyValue,
+    TypeId typeId
+);
+
+// Returns the value, parsing it first if it's still lazy
+const Variant&
+resolve(
+    const StoredValue& storedValue
+) {
+    if (const LazyValue* lazyValue = boost::get<LazyValue>(&storedValue.value)) {
+        Variant parsed = parseLazyValue(*lazyValue, storedValue.typeId);
+        storedValue.value = std::move(parsed);
+    }
+    return storedValue.value;
+}
+
 /**
 * @brief Information about a storable type
 *
@@ -143,17 +193,62 @@ TYPE_INFO(Ogre::Plane, StorageContainer, 288)
 TYPE_INFO(Ogre::Vector3, StorageContainer, 304)
 TYPE_INFO(Ogre::Quaternion, StorageContainer, 320)
 TYPE_INFO(Ogre::ColourValue, uint32_t, 336)
+
+// Array types
+TYPE_INFO(std::vector<float>, std::vector<float>, 352)
+TYPE_INFO(std::vector<int32_t>, std::vector<int32_t>, 368)
+TYPE_INFO(std::vector<Ogre::Vector3>, std::vector<float>, 384)
+TYPE_INFO(std::vector<uint32_t>, std::vector<uint32_t>, 400)
+TYPE_INFO(std::vector<Ogre::Quaternion>, std::vector<float>, 416)
+
+// The keys of the compound types, in the order of the packed format
+struct CompoundKeys {
+
+    StorageKey d {"d"};
+
+    StorageKey normal {"normal"};
+
+    std::array<StorageKey, 4> quaternion {{
+        StorageKey("w"), StorageKey("x"), StorageKey("y"), StorageKey("z")
+    }};
+
+    std::array<StorageKey, 3> vector3 {{
+        StorageKey("x"), StorageKey("y"), StorageKey("z")
+    }};
+
+};
+
+const CompoundKeys&
+compoundKeys() {
+    static const CompoundKeys keys;
+    return keys;
+}
+
 } // namespace
 
 #define TO_LUA_CASE(typeName) \
     case TypeInfo<typeName>::Id: \
     { \
         using Info = TypeInfo<typeName>; \
-        auto storedValue = boost::get<Info::StoredType>(value.value); \
+        auto storedValue = boost::get<Info::StoredType>(resolve(value)); \
         auto value = Info::convertFromStoredType(storedValue); \
         return luabind::object(L, value); \
     }
 
+// Arrays become Lua tables, starting at index 1
+#define TO_LUA_ARRAY_CASE(typeName) \
+    case TypeInfo<typeName>::Id: \
+    { \
+        using Info = TypeInfo<typeName>; \
+        auto storedValue = boost::get<Info::StoredType>(resolve(value)); \
+        auto values = Info::convertFromStoredType(storedValue); \
+        luabind::object table = luabind::newtable(L); \
+        for (size_t i = 0; i < values.size(); ++i) { \
+            table[i + 1] = values[i]; \
+        } \
+        return table; \
+    }
+
 static luabind::object
 toLua(
     lua_State* L,
@@ -181,817 +276,3510 @@ toLua(
         TO_LUA_CASE(Ogre::Vector3);
         TO_LUA_CASE(Ogre::Quaternion);
         TO_LUA_CASE(Ogre::ColourValue);
+        // Array types
+        TO_LUA_ARRAY_CASE(std::vector<float>);
+        TO_LUA_ARRAY_CASE(std::vector<int32_t>);
+        TO_LUA_ARRAY_CASE(std::vector<Ogre::Vector3>);
+        TO_LUA_ARRAY_CASE(std::vector<uint32_t>);
+        TO_LUA_ARRAY_CASE(std::vector<Ogre::Quaternion>);
         default:
             return luabind::object();
     }
 }
 
-struct StorageContainer::Implementation {
+////////////////////////////////////////////////////////////////////////////////
+// StorageKey
+////////////////////////////////////////////////////////////////////////////////
 
-    template<typename T>
-    bool
-    rawContains(
-        const std::string& key
-    ) const {
-        auto iter = m_content.find(key);
-        return (
-            iter != m_content.end() and
-            iter->second.typeId == TypeInfo<T>::Id
-        );
-    }
+namespace {
 
-    template<typename T>
-    typename TypeInfo<T>::StoredType
-    rawGet(
-        const std::string& key,
-        const typename TypeInfo<T>::StoredType& defaultValue = typename TypeInfo<T>::StoredType()
-    ) const {
-        auto iter = m_content.find(key);
-        if (iter == m_content.end()) {
-            return defaultValue;
-        }
-        else if (iter->second.typeId != TypeInfo<T>::Id){
-            return defaultValue;
-        }
-        else {
-            return boost::get<typename TypeInfo<T>::StoredType>(iter->second.value);
-        }
-    }
+// Interned key names. Names are never removed, so keys can keep pointers
+// to them.
+struct KeyRegistry {
 
-    template<typename T>
-    void
-    rawSet(
-        const std::string& key,
-        typename TypeInfo<T>::StoredType value
-    ) {
-        m_content[key] = StoredValue{
-            TypeInfo<T>::Id, 
-            std::move(value)
-        };
+    static KeyRegistry&
+    instance() {
+        static KeyRegistry registry;
+        return registry;
     }
 
-    std::unordered_map<std::string, StoredValue> m_content;
+    boost::mutex m_mutex;
 
-};
+    std::deque<std::string> m_names;
 
-#define GET_SET_CONTAINS(type) \
-    \
-    template<> \
-    bool \
-    StorageContainer::contains<type>( \
-        const std::string& key \
-    ) const { \
-        return m_impl->rawContains<type>(key); \
-    } \
-    \
-    template<> \
-    type \
-    StorageContainer::get<type>( \
-        const std::string& key, \
-        const type& defaultValue \
-    ) const { \
-        if (not this->contains<type>(key)) { \
-            return defaultValue; \
-        } \
-        auto storedValue = m_impl->rawGet<type>(key); \
-        return TypeInfo<type>::convertFromStoredType(storedValue); \
-    } \
-    \
-    template <> \
-    void \
-    StorageContainer::set<type>( \
-        const std::string& key, \
-        type value \
-    ) { \
-        auto storedValue = TypeInfo<type>::convertToStoredType(value); \
-        m_impl->rawSet<type>(key, std::move(storedValue)); \
-    }
+    std::unordered_map<std::string, uint32_t> m_ids;
 
-GET_SET_CONTAINS(bool)
-GET_SET_CONTAINS(char)
-GET_SET_CONTAINS(int8_t)
-GET_SET_CONTAINS(int16_t)
-GET_SET_CONTAINS(int32_t)
-GET_SET_CONTAINS(int64_t)
-GET_SET_CONTAINS(uint8_t)
-GET_SET_CONTAINS(uint16_t)
-GET_SET_CONTAINS(uint32_t)
-GET_SET_CONTAINS(uint64_t)
-GET_SET_CONTAINS(float)
-GET_SET_CONTAINS(double)
-GET_SET_CONTAINS(std::string)
-GET_SET_CONTAINS(StorageContainer)
-GET_SET_CONTAINS(StorageList)
-// Compound types
-GET_SET_CONTAINS(Ogre::Degree)
-GET_SET_CONTAINS(Ogre::Plane)
-GET_SET_CONTAINS(Ogre::Vector3)
-GET_SET_CONTAINS(Ogre::Quaternion)
-GET_SET_CONTAINS(Ogre::ColourValue)
+};
 
-luabind::scope
-StorageContainer::luaBindings() {
-    using namespace luabind;
-    return 
-        class_<StorageContainer>("StorageContainer")
-            .def(constructor<>())
-            .def("contains", static_cast<bool(StorageContainer::*)(const std::string&) const>(&StorageContainer::contains))
-            .def("get", &StorageContainer::luaGet)
-            .def("set", &StorageContainer::set<bool>)
-            .def("set", &StorageContainer::set<double>)
-            .def("set", &StorageContainer::set<std::string>)
-            .def("set", &StorageContainer::set<StorageContainer>)
-            .def("set", &StorageContainer::set<StorageList>)
-            // Compound types
-            .def("set", &StorageContainer::set<Ogre::Degree>)
-            .def("set", &StorageContainer::set<Ogre::Plane>)
-            .def("set", &StorageContainer::set<Ogre::Vector3>)
-            .def("set", &StorageContainer::set<Ogre::Quaternion>)
-            .def("set", &StorageContainer::set<Ogre::ColourValue>)
-    ;
 }
 
 
-StorageContainer::StorageContainer()
-  : m_impl(new Implementation())
+StorageKey::StorageKey()
+  : StorageKey(std::string())
 {
 }
 
 
-StorageContainer::StorageContainer(
-    const StorageContainer& other
-) : m_impl(new Implementation())
-{
-    *this = other;
+StorageKey::StorageKey(
+    const std::string& name
+) {
+    KeyRegistry& registry = KeyRegistry::instance();
+    boost::lock_guard<boost::mutex> lock(registry.m_mutex);
+    auto result = registry.m_ids.emplace(name, registry.m_names.size());
+    if (result.second) {
+        registry.m_names.push_back(name);
+    }
+    m_id = result.first->second;
+    m_name = &registry.m_names[m_id];
 }
 
 
-StorageContainer::StorageContainer(
-    StorageContainer&& other
-) : m_impl(std::move(other.m_impl))
+StorageKey::StorageKey(
+    const char* name
+) : StorageKey(std::string(name))
 {
 }
 
 
-StorageContainer::~StorageContainer() {}
-
-
-StorageContainer&
-StorageContainer::operator = (
-    const StorageContainer& other
+bool
+StorageKey::find(
+    const std::string& name,
+    StorageKey& key
 ) {
-    if (this != &other) {
-        m_impl->m_content = other.m_impl->m_content;
+    KeyRegistry& registry = KeyRegistry::instance();
+    boost::lock_guard<boost::mutex> lock(registry.m_mutex);
+    auto iter = registry.m_ids.find(name);
+    if (iter == registry.m_ids.end()) {
+        return false;
     }
-    return *this;
+    key.m_id = iter->second;
+    key.m_name = &registry.m_names[key.m_id];
+    return true;
 }
 
 
-StorageContainer&
-StorageContainer::operator = (
-    StorageContainer&& other
-) {
-    assert(this != &other);
-    m_impl = std::move(other.m_impl);
-    return *this;
+uint32_t
+StorageKey::id() const {
+    return m_id;
+}
+
+
+const std::string&
+StorageKey::name() const {
+    return *m_name;
 }
 
 
 bool
-StorageContainer::contains(
-    const std::string& key
+StorageKey::operator == (
+    const StorageKey& other
 ) const {
-    return m_impl->m_content.find(key) != m_impl->m_content.cend();
+    return m_id == other.m_id;
 }
 
 
-luabind::object
-StorageContainer::luaGet(
-    const std::string& key,
-    luabind::object defaultValue
+bool
+StorageKey::operator != (
+    const StorageKey& other
 ) const {
-    auto iter = m_impl->m_content.find(key);
-    if (iter == m_impl->m_content.end()) {
-        return defaultValue;
+    return m_id != other.m_id;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StorageSchema
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const std::pair<const char*, StorageSchema::Type> SCHEMA_TYPE_NAMES[] = {
+    {"any", StorageSchema::Type::Any},
+    {"boolean", StorageSchema::Type::Boolean},
+    {"number", StorageSchema::Type::Number},
+    {"integer", StorageSchema::Type::Integer},
+    {"string", StorageSchema::Type::String},
+    {"ColourValue", StorageSchema::Type::ColourValue},
+    {"Degree", StorageSchema::Type::Degree},
+    {"Plane", StorageSchema::Type::Plane},
+    {"Quaternion", StorageSchema::Type::Quaternion},
+    {"Vector3", StorageSchema::Type::Vector3},
+    {"floatArray", StorageSchema::Type::FloatArray},
+    {"intArray", StorageSchema::Type::IntArray},
+    {"vector3Array", StorageSchema::Type::Vector3Array}
+};
+
+// A schema given as a table or a StorageSchema. Empty schemas allow any
+// fields.
+std::shared_ptr<const StorageSchema>
+nestedSchema(
+    const luabind::object& object
+) {
+    std::shared_ptr<const StorageSchema> schema;
+    if (luabind::type(object) == LUA_TUSERDATA) {
+        schema = std::make_shared<StorageSchema>(
+            luabind::object_cast<const StorageSchema&>(object)
+        );
     }
     else {
-        luabind::object obj = toLua(defaultValue.interpreter(), iter->second);
-        if (obj) {
-            return obj;
-        }
-        else {
-            return defaultValue;
-        }
+        schema = std::make_shared<StorageSchema>(object);
+    }
+    if (schema->fields().empty()) {
+        return nullptr;
     }
+    return schema;
 }
 
+}
 
-std::list<std::string>
-StorageContainer::keys() const {
-    std::list<std::string> keys;
-    for (const auto& pair : m_impl->m_content) {
-        keys.push_back(pair.first);
-    }
-    return keys;
+
+luabind::scope
+StorageSchema::luaBindings() {
+    using namespace luabind;
+    return class_<StorageSchema>("StorageSchema")
+        .def(constructor<const luabind::object&>())
+    ;
 }
 
 
-#define NATIVE_TYPE(typeName) \
-    typeName \
-    TypeInfo<typeName>::convertFromStoredType( \
-        const typeName& storedValue \
-    ) { \
-        return storedValue; \
-    } \
-    \
-    typeName \
-    TypeInfo<typeName>::convertToStoredType( \
-        const typeName& value \
-    ) { \
-        return value; \
+StorageSchema::Type
+StorageSchema::typeFromName(
+    const std::string& name
+) {
+    for (const auto& pair : SCHEMA_TYPE_NAMES) {
+        if (name == pair.first) {
+            return pair.second;
+        }
     }
+    throw std::invalid_argument("Unknown storage type: " + name);
+}
 
-NATIVE_TYPE(bool)
-NATIVE_TYPE(char)
-NATIVE_TYPE(int8_t)
-NATIVE_TYPE(int16_t)
-NATIVE_TYPE(int32_t)
-NATIVE_TYPE(int64_t)
-NATIVE_TYPE(uint8_t)
-NATIVE_TYPE(uint16_t)
-NATIVE_TYPE(uint32_t)
-NATIVE_TYPE(uint64_t)
-NATIVE_TYPE(float)
-NATIVE_TYPE(double)
-NATIVE_TYPE(std::string)
-NATIVE_TYPE(StorageContainer)
-NATIVE_TYPE(StorageList)
 
+StorageSchema::StorageSchema() {}
 
-////////////////////////////////////////////////////////////////////////////////
-// Ogre::Degree
-////////////////////////////////////////////////////////////////////////////////
 
-Ogre::Degree
-TypeInfo<Ogre::Degree>::convertFromStoredType(
-    const float& value
+StorageSchema::StorageSchema(
+    const luabind::object& table
 ) {
-    return Ogre::Degree(value);
+    for (luabind::iterator iter(table), end; iter != end; ++iter) {
+        std::string name = luabind::object_cast<std::string>(iter.key());
+        luabind::object value = *iter;
+        int valueType = luabind::type(value);
+        if (valueType == LUA_TSTRING) {
+            this->addField(name, typeFromName(luabind::object_cast<std::string>(value)));
+        }
+        else if (valueType == LUA_TUSERDATA) {
+            this->addField(name, Type::Container, nestedSchema(value));
+        }
+        else if (valueType == LUA_TTABLE) {
+            luabind::object first = value[1];
+            int firstType = luabind::type(first);
+            if (firstType == LUA_TTABLE or firstType == LUA_TUSERDATA) {
+                this->addField(name, Type::List, nestedSchema(first));
+            }
+            else {
+                this->addField(name, Type::Container, nestedSchema(value));
+            }
+        }
+        else {
+            throw std::invalid_argument("Invalid storage type for field " + name);
+        }
+    }
 }
 
 
-float
-TypeInfo<Ogre::Degree>::convertToStoredType(
-    const Ogre::Degree& value
+void
+StorageSchema::addField(
+    const std::string& name,
+    Type type,
+    std::shared_ptr<const StorageSchema> schema
 ) {
-    return value.valueDegrees();
+    Field field{StorageKey(name), type, std::move(schema)};
+    // In key order, so that containers append the fields
+    auto iter = std::lower_bound(m_fields.begin(), m_fields.end(), field.key.id(),
+        [] (const Field& field, uint32_t id) {
+            return field.key.id() < id;
+        }
+    );
+    if (iter != m_fields.end() and iter->key == field.key) {
+        *iter = std::move(field);
+    }
+    else {
+        m_fields.insert(iter, std::move(field));
+    }
 }
 
 
-////////////////////////////////////////////////////////////////////////////////
-// Ogre::Plane
-////////////////////////////////////////////////////////////////////////////////
-
-Ogre::Plane
-TypeInfo<Ogre::Plane>::convertFromStoredType(
-    const StorageContainer& storage
-) {
-    Ogre::Vector3 normal = storage.get<Ogre::Vector3>("normal");
-    Ogre::Real d = storage.get<Ogre::Real>("d");
-    Ogre::Plane plane(normal, -d); // See the constructor definition in OgrePlane.cpp for the minus sign
-    return plane;
+const std::vector<StorageSchema::Field>&
+StorageSchema::fields() const {
+    return m_fields;
 }
 
 
-StorageContainer
-TypeInfo<Ogre::Plane>::convertToStoredType(
-    const Ogre::Plane& value
-) {
-    StorageContainer storage;
-    storage.set<Ogre::Vector3>("normal", value.normal);
-    storage.set<Ogre::Real>("d", value.d);
-    return storage;
-}
-
-
-
 ////////////////////////////////////////////////////////////////////////////////
-// Ogre::Vector3
+// Lua tables
 ////////////////////////////////////////////////////////////////////////////////
 
-Ogre::Vector3
-TypeInfo<Ogre::Vector3>::convertFromStoredType(
-    const StorageContainer& storage
-) {
-    std::array<Ogre::Real, 3> elements {{
-        storage.get<Ogre::Real>("x"),
-        storage.get<Ogre::Real>("y"),
-        storage.get<Ogre::Real>("z")
-    }};
-    return Ogre::Vector3(elements.data());
-}
+namespace {
 
+// Guards against tables that contain themselves
+const int MAX_TABLE_DEPTH = 32;
 
-StorageContainer
-TypeInfo<Ogre::Vector3>::convertToStoredType(
-    const Ogre::Vector3& value
+int
+absoluteIndex(
+    lua_State* L,
+    int index
 ) {
-    StorageContainer storage;
-    storage.set<Ogre::Real>("x", value.x);
-    storage.set<Ogre::Real>("y", value.y);
-    storage.set<Ogre::Real>("z", value.z);
-    return storage;
+    // No lua_absindex on LuaJIT
+    if (index > 0 or index <= LUA_REGISTRYINDEX) {
+        return index;
+    }
+    return lua_gettop(L) + index + 1;
 }
 
 
-
-////////////////////////////////////////////////////////////////////////////////
-// Ogre::Quaternion
-////////////////////////////////////////////////////////////////////////////////
-
-Ogre::Quaternion
-TypeInfo<Ogre::Quaternion>::convertFromStoredType(
-    const StorageContainer& storage
+std::invalid_argument
+tableError(
+    const StorageKey& key,
+    const std::string& problem
 ) {
-    std::array<Ogre::Real, 4> elements {{
-        storage.get<Ogre::Real>("w"),
-        storage.get<Ogre::Real>("x"),
-        storage.get<Ogre::Real>("y"),
-        storage.get<Ogre::Real>("z")
-    }};
-    return Ogre::Quaternion(elements.data());
+    std::string name = key.name().empty() ? "table" : "\"" + key.name() + "\"";
+    return std::invalid_argument("Can't store " + name + ": " + problem);
 }
 
 
-StorageContainer
-TypeInfo<Ogre::Quaternion>::convertToStoredType(
-    const Ogre::Quaternion& value
+double
+checkNumber(
+    lua_State* L,
+    int index,
+    const StorageKey& key
 ) {
-    StorageContainer storage;
-    storage.set<Ogre::Real>("w", value.w);
-    storage.set<Ogre::Real>("x", value.x);
-    storage.set<Ogre::Real>("y", value.y);
-    storage.set<Ogre::Real>("z", value.z);
-    return storage;
+    if (lua_type(L, index) != LUA_TNUMBER) {
+        throw tableError(key, std::string("expected a number, got a ") + luaL_typename(L, index));
+    }
+    return lua_tonumber(L, index);
 }
 
 
+bool
+isInt32(
+    double number
+) {
+    return
+        number == std::floor(number) and
+        number >= std::numeric_limits<int32_t>::min() and
+        number <= std::numeric_limits<int32_t>::max();
+}
 
-////////////////////////////////////////////////////////////////////////////////
-// Ogre::ColourValue
-////////////////////////////////////////////////////////////////////////////////
 
-Ogre::ColourValue
-TypeInfo<Ogre::ColourValue>::convertFromStoredType(
-    const uint32_t& rgba
+// Casts an instance of a bound class
+template<typename T>
+T
+castUserdata(
+    lua_State* L,
+    int index,
+    const StorageKey& key,
+    const char* typeName
 ) {
-    Ogre::ColourValue value;
-    value.setAsRGBA(rgba);
-    return value;
+    luabind::object object(luabind::from_stack(L, index));
+    boost::optional<T> value = luabind::object_cast_nothrow<T>(object);
+    if (not value) {
+        throw tableError(key, std::string("expected a ") + typeName);
+    }
+    return *value;
 }
 
 
-uint32_t
-TypeInfo<Ogre::ColourValue>::convertToStoredType(
-    const Ogre::ColourValue& value
+// Reads array elements up to the first nil
+template<typename T, typename Read>
+std::vector<T>
+readArray(
+    lua_State* L,
+    int index,
+    Read read
 ) {
-    return value.getAsRGBA();
+    std::vector<T> values;
+    for (int i = 1; ; ++i) {
+        lua_rawgeti(L, index, i);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        values.push_back(read(lua_gettop(L)));
+        lua_pop(L, 1);
+    }
+    return values;
 }
 
 
-////////////////////////////////////////////////////////////////////////////////
-// StorageList
-////////////////////////////////////////////////////////////////////////////////
+StorageContainer
+readContainer(
+    lua_State* L,
+    int index,
+    const StorageSchema* schema,
+    const StorageKey& key,
+    int depth
+);
 
-luabind::scope
-StorageList::luaBindings() {
-    using namespace luabind;
-    return class_<StorageList>("StorageList")
-        .def(constructor<>())
-        .def("append", &StorageList::append)
-        .def("get", &StorageList::get)
-        .def("size", &StorageList::size)
-    ;
-}
 
+StorageList
+readList(
+    lua_State* L,
+    int index,
+    const StorageSchema* schema,
+    const StorageKey& key,
+    int depth
+) {
+    if (lua_type(L, index) != LUA_TTABLE) {
+        throw tableError(key, "expected an array of tables");
+    }
+    StorageList list;
+    for (int i = 1; ; ++i) {
+        lua_rawgeti(L, index, i);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        list.push_back(readContainer(L, lua_gettop(L), schema, key, depth + 1));
+        lua_pop(L, 1);
+    }
+    return list;
+}
 
-StorageList::StorageList() {}
 
-StorageList::StorageList(
-    const StorageList& other
-) : std::vector<StorageContainer>(other)
-{
+// Stores a table without a schema, arrays by the type of their first
+// element
+void
+storeTable(
+    lua_State* L,
+    int index,
+    const StorageKey& key,
+    int depth,
+    StorageContainer& storage
+) {
+    lua_rawgeti(L, index, 1);
+    int firstType = lua_type(L, -1);
+    lua_pop(L, 1);
+    if (firstType == LUA_TNIL) {
+        storage.set(key, readContainer(L, index, nullptr, key, depth + 1));
+    }
+    else if (firstType == LUA_TNUMBER) {
+        std::vector<double> numbers = readArray<double>(L, index,
+            [L, &key] (int element) {
+                return checkNumber(L, element, key);
+            }
+        );
+        if (std::all_of(numbers.begin(), numbers.end(), isInt32)) {
+            storage.set(key, std::vector<int32_t>(numbers.begin(), numbers.end()));
+        }
+        else {
+            storage.set(key, std::vector<float>(numbers.begin(), numbers.end()));
+        }
+    }
+    else if (firstType == LUA_TTABLE) {
+        storage.set(key, readList(L, index, nullptr, key, depth));
+    }
+    else {
+        throw tableError(key, "only arrays of numbers or tables can be stored");
+    }
 }
 
 
-StorageList::StorageList(
-    StorageList&& other
-) : std::vector<StorageContainer>(other)
-{
+// Stores a value of any type that has a natural storage type
+void
+storeAny(
+    lua_State* L,
+    int index,
+    const StorageKey& key,
+    int depth,
+    StorageContainer& storage
+) {
+    switch (lua_type(L, index)) {
+        case LUA_TBOOLEAN:
+            storage.set<bool>(key, lua_toboolean(L, index));
+            return;
+        case LUA_TNUMBER:
+            storage.set<double>(key, lua_tonumber(L, index));
+            return;
+        case LUA_TSTRING:
+        {
+            size_t length = 0;
+            const char* string = lua_tolstring(L, index, &length);
+            storage.set(key, std::string(string, length));
+            return;
+        }
+        case LUA_TTABLE:
+            storeTable(L, index, key, depth, storage);
+            return;
+        case LUA_TUSERDATA:
+        {
+            luabind::object object(luabind::from_stack(L, index));
+            if (auto value = luabind::object_cast_nothrow<StorageContainer>(object)) {
+                storage.set(key, std::move(*value));
+            }
+            else if (auto value = luabind::object_cast_nothrow<StorageList>(object)) {
+                storage.set(key, std::move(*value));
+            }
+            else if (auto value = luabind::object_cast_nothrow<Ogre::Vector3>(object)) {
+                storage.set(key, *value);
+            }
+            else if (auto value = luabind::object_cast_nothrow<Ogre::Quaternion>(object)) {
+                storage.set(key, *value);
+            }
+            else if (auto value = luabind::object_cast_nothrow<Ogre::ColourValue>(object)) {
+                storage.set(key, *value);
+            }
+            else if (auto value = luabind::object_cast_nothrow<Ogre::Degree>(object)) {
+                storage.set(key, *value);
+            }
+            else if (auto value = luabind::object_cast_nothrow<Ogre::Plane>(object)) {
+                storage.set(key, *value);
+            }
+            else {
+                throw tableError(key, "the object's class can't be stored");
+            }
+            return;
+        }
+        default:
+            throw tableError(key, std::string("a ") + luaL_typename(L, index) + " can't be stored");
+    }
 }
 
 
-StorageList&
-StorageList::operator = (
-    const StorageList& other
+void
+storeValue(
+    lua_State* L,
+    int index,
+    const StorageSchema::Field& field,
+    int depth,
+    StorageContainer& storage
 ) {
-    std::vector<StorageContainer>::operator=(other);
-    return *this;
+    using Type = StorageSchema::Type;
+    const StorageKey& key = field.key;
+    switch (field.type) {
+        case Type::Any:
+            storeAny(L, index, key, depth, storage);
+            return;
+        case Type::Boolean:
+            storage.set<bool>(key, lua_toboolean(L, index));
+            return;
+        case Type::Number:
+            storage.set<double>(key, checkNumber(L, index, key));
+            return;
+        case Type::Integer:
+            storage.set<int32_t>(key, static_cast<int32_t>(checkNumber(L, index, key)));
+            return;
+        case Type::String:
+        {
+            if (lua_type(L, index) != LUA_TSTRING) {
+                throw tableError(key, std::string("expected a string, got a ") + luaL_typename(L, index));
+            }
+            size_t length = 0;
+            const char* string = lua_tolstring(L, index, &length);
+            storage.set(key, std::string(string, length));
+            return;
+        }
+        case Type::ColourValue:
+            storage.set(key, castUserdata<Ogre::ColourValue>(L, index, key, "ColourValue"));
+            return;
+        case Type::Degree:
+            storage.set(key, castUserdata<Ogre::Degree>(L, index, key, "Degree"));
+            return;
+        case Type::Plane:
+            storage.set(key, castUserdata<Ogre::Plane>(L, index, key, "Plane"));
+            return;
+        case Type::Quaternion:
+            storage.set(key, castUserdata<Ogre::Quaternion>(L, index, key, "Quaternion"));
+            return;
+        case Type::Vector3:
+            storage.set(key, castUserdata<Ogre::Vector3>(L, index, key, "Vector3"));
+            return;
+        case Type::FloatArray:
+        case Type::IntArray:
+        case Type::Vector3Array:
+            if (lua_type(L, index) != LUA_TTABLE) {
+                throw tableError(key, "expected an array");
+            }
+            if (field.type == Type::FloatArray) {
+                storage.set(key, readArray<float>(L, index,
+                    [L, &key] (int element) {
+                        return static_cast<float>(checkNumber(L, element, key));
+                    }
+                ));
+            }
+            else if (field.type == Type::IntArray) {
+                storage.set(key, readArray<int32_t>(L, index,
+                    [L, &key] (int element) {
+                        return static_cast<int32_t>(checkNumber(L, element, key));
+                    }
+                ));
+            }
+            else {
+                storage.set(key, readArray<Ogre::Vector3>(L, index,
+                    [L, &key] (int element) {
+                        return castUserdata<Ogre::Vector3>(L, element, key, "Vector3");
+                    }
+                ));
+            }
+            return;
+        case Type::Container:
+            storage.set(key, readContainer(L, index, field.schema.get(), key, depth + 1));
+            return;
+        case Type::List:
+            storage.set(key, readList(L, index, field.schema.get(), key, depth));
+            return;
+    }
 }
 
 
-StorageList&
-StorageList::operator = (
-    StorageList&& other
+StorageContainer
+readContainer(
+    lua_State* L,
+    int index,
+    const StorageSchema* schema,
+    const StorageKey& key,
+    int depth
 ) {
-    std::vector<StorageContainer>::operator=(other);
-    return *this;
+    if (lua_type(L, index) != LUA_TTABLE) {
+        throw tableError(key, std::string("expected a table, got a ") + luaL_typename(L, index));
+    }
+    if (depth > MAX_TABLE_DEPTH) {
+        throw tableError(key, "tables are nested too deeply");
+    }
+    if (not lua_checkstack(L, 4)) {
+        throw std::runtime_error("Lua stack overflow while storing a table");
+    }
+    StorageContainer storage;
+    if (schema) {
+        for (const StorageSchema::Field& field : schema->fields()) {
+            lua_getfield(L, index, field.key.name().c_str());
+            if (not lua_isnil(L, -1)) {
+                storeValue(L, lua_gettop(L), field, depth, storage);
+            }
+            lua_pop(L, 1);
+        }
+        return storage;
+    }
+    lua_pushnil(L);
+    while (lua_next(L, index)) {
+        // lua_tolstring would turn a number key into a string and confuse
+        // lua_next
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            lua_pop(L, 2);
+            throw tableError(key, "only string keys can be stored");
+        }
+        size_t length = 0;
+        const char* name = lua_tolstring(L, -2, &length);
+        storeAny(L, lua_gettop(L), StorageKey(std::string(name, length)), depth, storage);
+        lua_pop(L, 1);
+    }
+    return storage;
 }
 
 
+template<typename T>
 void
-StorageList::append(
-    StorageContainer element
+pushNumberArray(
+    lua_State* L,
+    const std::vector<T>& values
 ) {
-    this->emplace_back(std::move(element));
+    lua_createtable(L, static_cast<int>(values.size()), 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        lua_pushnumber(L, static_cast<lua_Number>(values[i]));
+        lua_rawseti(L, -2, static_cast<int>(i + 1));
+    }
 }
 
 
-StorageContainer&
-StorageList::get(
-    size_t index
+#define PUSH_NUMBER_CASE(typeName) \
+    case TypeInfo<typeName>::Id: \
+        lua_pushnumber(L, static_cast<lua_Number>(boost::get<typeName>(resolve(value)))); \
+        return;
+
+void
+pushStoredValue(
+    lua_State* L,
+    const StoredValue& value,
+    const StorageSchema* schema
 ) {
-    assert(index > 0);
-    return this->at(index - 1);
+    switch (value.typeId) {
+        case TypeInfo<bool>::Id:
+            lua_pushboolean(L, boost::get<bool>(resolve(value)));
+            return;
+        PUSH_NUMBER_CASE(char);
+        PUSH_NUMBER_CASE(int8_t);
+        PUSH_NUMBER_CASE(int16_t);
+        PUSH_NUMBER_CASE(int32_t);
+        PUSH_NUMBER_CASE(int64_t);
+        PUSH_NUMBER_CASE(uint8_t);
+        PUSH_NUMBER_CASE(uint16_t);
+        PUSH_NUMBER_CASE(uint32_t);
+        PUSH_NUMBER_CASE(uint64_t);
+        PUSH_NUMBER_CASE(float);
+        PUSH_NUMBER_CASE(double);
+        case TypeInfo<std::string>::Id:
+        {
+            const std::string& string = boost::get<std::string>(resolve(value));
+            lua_pushlstring(L, string.data(), string.size());
+            return;
+        }
+        case TypeInfo<StorageContainer>::Id:
+            boost::get<StorageContainer>(resolve(value)).pushTable(L, schema);
+            return;
+        case TypeInfo<StorageList>::Id:
+            boost::get<StorageList>(resolve(value)).pushTable(L, schema);
+            return;
+        case TypeInfo<std::vector<float>>::Id:
+            pushNumberArray(L, boost::get<std::vector<float>>(resolve(value)));
+            return;
+        case TypeInfo<std::vector<int32_t>>::Id:
+            pushNumberArray(L, boost::get<std::vector<int32_t>>(resolve(value)));
+            return;
+        case TypeInfo<std::vector<uint32_t>>::Id:
+            pushNumberArray(L, boost::get<std::vector<uint32_t>>(resolve(value)));
+            return;
+        default:
+        {
+            // Compound types are pushed as their bound classes
+            luabind::object object = toLua(L, value);
+            if (object) {
+                object.push(L);
+            }
+            else {
+                lua_pushnil(L);
+            }
+            return;
+        }
+    }
+}
+
+#undef PUSH_NUMBER_CASE
+
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Serialization
+// StorageContainer
 ////////////////////////////////////////////////////////////////////////////////
 
-namespace {
+struct StorageContainer::Implementation {
 
-template<typename T>
-struct TypeHandler {
+    struct Entry {
 
-    static T
-    deserialize(
-        std::istream& stream
-    );
+        StorageKey key;
 
-    static void
-    serialize(
-        std::ostream& stream,
-        const T& value
-    );
+        StoredValue value;
 
-};
+    };
 
+    // Replaces the content with unsorted entries. Of entries with the same
+    // key, the last one wins.
+    void
+    assign(
+        std::vector<Entry> entries
+    ) {
+        std::stable_sort(entries.begin(), entries.end(),
+            [] (const Entry& lhs, const Entry& rhs) {
+                return lhs.key.id() < rhs.key.id();
+            }
+        );
+        m_content.clear();
+        m_content.reserve(entries.size());
+        for (Entry& entry : entries) {
+            if (not m_content.empty() and m_content.back().key == entry.key) {
+                m_content.back() = std::move(entry);
+            }
+            else {
+                m_content.push_back(std::move(entry));
+            }
+        }
+    }
 
-////////////////////////////////////////////////////////////////////////////////
-// Integrals
-////////////////////////////////////////////////////////////////////////////////
+    const StoredValue*
+    find(
+        const StorageKey& key
+    ) const {
+        auto iter = this->lowerBound(key);
+        if (iter == m_content.end() or iter->key != key) {
+            return nullptr;
+        }
+        return &iter->value;
+    }
 
-template<typename T>
-struct IntegralTypeHandler {
+    const StoredValue*
+    find(
+        const std::string& key
+    ) const {
+        StorageKey storageKey;
+        if (not StorageKey::find(key, storageKey)) {
+            // Never used as a key, so no container can have it
+            return nullptr;
+        }
+        return this->find(storageKey);
+    }
 
-    static T
-    deserialize(
-        std::istream& stream
-    ) {
-        T value = 0;
-        stream.read(
-            reinterpret_cast<char*>(&value),
-            sizeof(T)
+    std::vector<Entry>::const_iterator
+    lowerBound(
+        const StorageKey& key
+    ) const {
+        // Entries are often set in order, so check the end first
+        if (m_content.empty() or m_content.back().key.id() < key.id()) {
+            return m_content.end();
+        }
+        return std::lower_bound(m_content.begin(), m_content.end(), key,
+            [] (const Entry& entry, const StorageKey& key) {
+                return entry.key.id() < key.id();
+            }
         );
-        assert(not stream.fail());
-        return value;
     }
 
-    static void
-    serialize(
-        std::ostream& stream,
-        T value
+    template<typename T, typename Key>
+    bool
+    rawContains(
+        const Key& key
+    ) const {
+        const StoredValue* value = this->find(key);
+        return value and value->typeId == TypeInfo<T>::Id;
+    }
+
+    template<typename T>
+    void
+    rawSet(
+        const StorageKey& key,
+        typename TypeInfo<T>::StoredType value
     ) {
-        stream.write(
-            reinterpret_cast<char*>(&value), 
-            sizeof(T)
-        );
+        this->set(key, StoredValue{
+            TypeInfo<T>::Id,
+            std::move(value)
+        });
     }
-};
 
-#define INTEGRAL_TYPE_HANDLER(typeName) \
-    template<> struct TypeHandler<typeName> : public IntegralTypeHandler<typeName> {};
+    void
+    set(
+        const StorageKey& key,
+        StoredValue value
+    ) {
+        auto iter = m_content.begin() + (this->lowerBound(key) - m_content.cbegin());
+        if (iter != m_content.end() and iter->key == key) {
+            iter->value = std::move(value);
+        }
+        else {
+            m_content.insert(iter, Entry{key, std::move(value)});
+        }
+    }
 
-INTEGRAL_TYPE_HANDLER(int8_t)
-INTEGRAL_TYPE_HANDLER(int16_t)
-INTEGRAL_TYPE_HANDLER(int32_t)
-INTEGRAL_TYPE_HANDLER(int64_t)
-INTEGRAL_TYPE_HANDLER(uint8_t)
-INTEGRAL_TYPE_HANDLER(uint16_t)
-INTEGRAL_TYPE_HANDLER(uint32_t)
-INTEGRAL_TYPE_HANDLER(uint64_t)
+    // Sorted by key id
+    std::vector<Entry> m_content;
 
+};
 
-////////////////////////////////////////////////////////////////////////////////
-// Bool
-////////////////////////////////////////////////////////////////////////////////
+// Compares two values of the same type id
+struct EqualityVisitor : public boost::static_visitor<bool> {
 
-template<>
-struct TypeHandler<bool> {
+    template<typename T, typename U>
+    bool
+    operator() (
+        const T&,
+        const U&
+    ) const {
+        return false;
+    }
 
-    static bool
+    template<typename T>
+    bool
+    operator() (
+        const T& lhs,
+        const T& rhs
+    ) const {
+        return lhs == rhs;
+    }
+
+    bool
+    operator() (
+        const StorageContainer& lhs,
+        const StorageContainer& rhs
+    ) const;
+
+    bool
+    operator() (
+        const StorageList& lhs,
+        const StorageList& rhs
+    ) const {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (not (*this)(lhs[i], rhs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool
+    operator() (
+        const LazyValue&,
+        const LazyValue&
+    ) const {
+        assert(false && "Lazy values are resolved before comparison");
+        return false;
+    }
+
+};
+
+
+static bool
+equalValues(
+    const StoredValue& lhs,
+    const StoredValue& rhs
+) {
+    if (lhs.typeId != rhs.typeId) {
+        return false;
+    }
+    return boost::apply_visitor(EqualityVisitor(), resolve(lhs), resolve(rhs));
+}
+
+
+bool
+EqualityVisitor::operator() (
+    const StorageContainer& lhs,
+    const StorageContainer& rhs
+) const {
+    return (
+        lhs.keys().size() == rhs.keys().size() and
+        lhs.difference(rhs).keys().empty()
+    );
+}
+
+
+#define GET_SET_CONTAINS_KEY(type, keyType) \
+    \
+    template<> \
+    bool \
+    StorageContainer::contains<type>( \
+        const keyType& key \
+    ) const { \
+        return m_impl->rawContains<type>(key); \
+    } \
+    \
+    template<> \
+    type \
+    StorageContainer::get<type>( \
+        const keyType& key, \
+        const type& defaultValue \
+    ) const { \
+        using Info = TypeInfo<type>; \
+        const StoredValue* storedValue = m_impl->find(key); \
+        if (not storedValue or storedValue->typeId != Info::Id) { \
+            return defaultValue; \
+        } \
+        return Info::convertFromStoredType( \
+            boost::get<Info::StoredType>(resolve(*storedValue)) \
+        ); \
+    }
+
+#define GET_SET_CONTAINS(type) \
+    GET_SET_CONTAINS_KEY(type, std::string) \
+    GET_SET_CONTAINS_KEY(type, StorageKey) \
+    \
+    template <> \
+    void \
+    StorageContainer::set<type>( \
+        const StorageKey& key, \
+        type value \
+    ) { \
+        auto storedValue = TypeInfo<type>::convertToStoredType(value); \
+        m_impl->rawSet<type>(key, std::move(storedValue)); \
+    } \
+    \
+    template <> \
+    void \
+    StorageContainer::set<type>( \
+        const std::string& key, \
+        type value \
+    ) { \
+        this->set<type>(StorageKey(key), std::move(value)); \
+    }
+
+GET_SET_CONTAINS(bool)
+GET_SET_CONTAINS(char)
+GET_SET_CONTAINS(int8_t)
+GET_SET_CONTAINS(int16_t)
+GET_SET_CONTAINS(int32_t)
+GET_SET_CONTAINS(int64_t)
+GET_SET_CONTAINS(uint8_t)
+GET_SET_CONTAINS(uint16_t)
+GET_SET_CONTAINS(uint32_t)
+GET_SET_CONTAINS(uint64_t)
+GET_SET_CONTAINS(float)
+GET_SET_CONTAINS(double)
+GET_SET_CONTAINS(std::string)
+GET_SET_CONTAINS(StorageContainer)
+GET_SET_CONTAINS(StorageList)
+// Compound types
+GET_SET_CONTAINS(Ogre::Degree)
+GET_SET_CONTAINS(Ogre::Plane)
+GET_SET_CONTAINS(Ogre::Vector3)
+GET_SET_CONTAINS(Ogre::Quaternion)
+GET_SET_CONTAINS(Ogre::ColourValue)
+// Array types
+GET_SET_CONTAINS(std::vector<float>)
+GET_SET_CONTAINS(std::vector<int32_t>)
+GET_SET_CONTAINS(std::vector<Ogre::Vector3>)
+GET_SET_CONTAINS(std::vector<uint32_t>)
+GET_SET_CONTAINS(std::vector<Ogre::Quaternion>)
+
+// Lua only uses string keys
+template<typename T>
+using LuaSetter = void (StorageContainer::*)(const std::string&, T);
+
+
+// Reads a Lua array, up to the first nil
+template<typename T>
+static std::vector<T>
+luaArray(
+    luabind::object table
+) {
+    std::vector<T> values;
+    for (int i = 1; luabind::type(table[i]) != LUA_TNIL; ++i) {
+        values.push_back(luabind::object_cast<T>(table[i]));
+    }
+    return values;
+}
+
+
+static void
+StorageContainer_setFloatArray(
+    StorageContainer* self,
+    const std::string& key,
+    luabind::object table
+) {
+    self->set<std::vector<float>>(key, luaArray<float>(table));
+}
+
+
+static void
+StorageContainer_setIntArray(
+    StorageContainer* self,
+    const std::string& key,
+    luabind::object table
+) {
+    self->set<std::vector<int32_t>>(key, luaArray<int32_t>(table));
+}
+
+
+static StorageContainer
+StorageContainer_fromTable(
+    const luabind::object& table
+) {
+    lua_State* L = table.interpreter();
+    int top = lua_gettop(L);
+    table.push(L);
+    try {
+        StorageContainer storage = StorageContainer::fromTable(L, -1);
+        lua_settop(L, top);
+        return storage;
+    }
+    catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+
+static StorageContainer
+StorageContainer_fromTableWithSchema(
+    const luabind::object& table,
+    const StorageSchema& schema
+) {
+    lua_State* L = table.interpreter();
+    int top = lua_gettop(L);
+    table.push(L);
+    try {
+        StorageContainer storage = StorageContainer::fromTable(L, -1, &schema);
+        lua_settop(L, top);
+        return storage;
+    }
+    catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+
+static luabind::object
+StorageContainer_toTable(
+    const StorageContainer* self,
+    lua_State* L
+) {
+    self->pushTable(L);
+    luabind::object table(luabind::from_stack(L, -1));
+    lua_pop(L, 1);
+    return table;
+}
+
+
+static luabind::object
+StorageContainer_toTableWithSchema(
+    const StorageContainer* self,
+    lua_State* L,
+    const StorageSchema& schema
+) {
+    self->pushTable(L, &schema);
+    luabind::object table(luabind::from_stack(L, -1));
+    lua_pop(L, 1);
+    return table;
+}
+
+
+static void
+StorageContainer_setVector3Array(
+    StorageContainer* self,
+    const std::string& key,
+    luabind::object table
+) {
+    self->set<std::vector<Ogre::Vector3>>(key, luaArray<Ogre::Vector3>(table));
+}
+
+
+luabind::scope
+StorageContainer::luaBindings() {
+    using namespace luabind;
+    return 
+        class_<StorageContainer>("StorageContainer")
+            .scope [
+                def("fromTable", &StorageContainer_fromTable),
+                def("fromTable", &StorageContainer_fromTableWithSchema)
+            ]
+            .def(constructor<>())
+            .def("contains", static_cast<bool(StorageContainer::*)(const std::string&) const>(&StorageContainer::contains))
+            .def("get", &StorageContainer::luaGet)
+            .def("set", static_cast<LuaSetter<bool>>(&StorageContainer::set<bool>))
+            .def("set", static_cast<LuaSetter<double>>(&StorageContainer::set<double>))
+            .def("set", static_cast<LuaSetter<std::string>>(&StorageContainer::set<std::string>))
+            .def("set", static_cast<LuaSetter<StorageContainer>>(&StorageContainer::set<StorageContainer>))
+            .def("set", static_cast<LuaSetter<StorageList>>(&StorageContainer::set<StorageList>))
+            // Compound types
+            .def("set", static_cast<LuaSetter<Ogre::Degree>>(&StorageContainer::set<Ogre::Degree>))
+            .def("set", static_cast<LuaSetter<Ogre::Plane>>(&StorageContainer::set<Ogre::Plane>))
+            .def("set", static_cast<LuaSetter<Ogre::Vector3>>(&StorageContainer::set<Ogre::Vector3>))
+            .def("set", static_cast<LuaSetter<Ogre::Quaternion>>(&StorageContainer::set<Ogre::Quaternion>))
+            .def("set", static_cast<LuaSetter<Ogre::ColourValue>>(&StorageContainer::set<Ogre::ColourValue>))
+            // Array types
+            .def("setFloatArray", &StorageContainer_setFloatArray)
+            .def("setIntArray", &StorageContainer_setIntArray)
+            .def("setVector3Array", &StorageContainer_setVector3Array)
+            .def("toTable", &StorageContainer_toTable)
+            .def("toTable", &StorageContainer_toTableWithSchema)
+    ;
+}
+
+
+StorageContainer
+StorageContainer::fromTable(
+    lua_State* L,
+    int index,
+    const StorageSchema* schema
+) {
+    return readContainer(L, absoluteIndex(L, index), schema, StorageKey(), 0);
+}
+
+
+StorageContainer::StorageContainer()
+  : m_impl(new Implementation())
+{
+}
+
+
+StorageContainer::StorageContainer(
+    const StorageContainer& other
+) : m_impl(new Implementation())
+{
+    *this = other;
+}
+
+
+StorageContainer::StorageContainer(
+    StorageContainer&& other
+) : m_impl(std::move(other.m_impl))
+{
+}
+
+
+StorageContainer::~StorageContainer() {}
+
+
+StorageContainer&
+StorageContainer::operator = (
+    const StorageContainer& other
+) {
+    if (this != &other) {
+        m_impl->m_content = other.m_impl->m_content;
+    }
+    return *this;
+}
+
+
+StorageContainer&
+StorageContainer::operator = (
+    StorageContainer&& other
+) {
+    assert(this != &other);
+    m_impl = std::move(other.m_impl);
+    return *this;
+}
+
+
+bool
+StorageContainer::contains(
+    const std::string& key
+) const {
+    return m_impl->find(key) != nullptr;
+}
+
+
+bool
+StorageContainer::contains(
+    const StorageKey& key
+) const {
+    return m_impl->find(key) != nullptr;
+}
+
+
+luabind::object
+StorageContainer::luaGet(
+    const std::string& key,
+    luabind::object defaultValue
+) const {
+    const StoredValue* value = m_impl->find(key);
+    if (not value) {
+        return defaultValue;
+    }
+    else {
+        luabind::object obj = toLua(defaultValue.interpreter(), *value);
+        if (obj) {
+            return obj;
+        }
+        else {
+            return defaultValue;
+        }
+    }
+}
+
+
+void
+StorageContainer::pushTable(
+    lua_State* L,
+    const StorageSchema* schema
+) const {
+    if (not lua_checkstack(L, 4)) {
+        throw std::runtime_error("Lua stack overflow while loading a table");
+    }
+    if (schema) {
+        lua_createtable(L, 0, static_cast<int>(schema->fields().size()));
+        for (const StorageSchema::Field& field : schema->fields()) {
+            const StoredValue* value = m_impl->find(field.key);
+            if (value) {
+                pushStoredValue(L, *value, field.schema.get());
+                lua_setfield(L, -2, field.key.name().c_str());
+            }
+        }
+        return;
+    }
+    lua_createtable(L, 0, static_cast<int>(m_impl->m_content.size()));
+    for (const auto& entry : m_impl->m_content) {
+        pushStoredValue(L, entry.value, nullptr);
+        lua_setfield(L, -2, entry.key.name().c_str());
+    }
+}
+
+
+StorageContainer
+StorageContainer::difference(
+    const StorageContainer& previous
+) const {
+    StorageContainer changes;
+    for (const auto& entry : m_impl->m_content) {
+        const StoredValue* previousValue = previous.m_impl->find(entry.key);
+        if (not previousValue or not equalValues(entry.value, *previousValue)) {
+            // Keeps the entries sorted
+            changes.m_impl->m_content.push_back(entry);
+        }
+    }
+    return changes;
+}
+
+
+std::list<std::string>
+StorageContainer::keys() const {
+    std::list<std::string> keys;
+    for (const auto& entry : m_impl->m_content) {
+        keys.push_back(entry.key.name());
+    }
+    return keys;
+}
+
+
+void
+StorageContainer::merge(
+    const StorageContainer& other
+) {
+    for (const auto& entry : other.m_impl->m_content) {
+        m_impl->set(entry.key, entry.value);
+    }
+}
+
+
+#define NATIVE_TYPE(typeName) \
+    typeName \
+    TypeInfo<typeName>::convertFromStoredType( \
+        const typeName& storedValue \
+    ) { \
+        return storedValue; \
+    } \
+    \
+    typeName \
+    TypeInfo<typeName>::convertToStoredType( \
+        const typeName& value \
+    ) { \
+        return value; \
+    }
+
+NATIVE_TYPE(bool)
+NATIVE_TYPE(char)
+NATIVE_TYPE(int8_t)
+NATIVE_TYPE(int16_t)
+NATIVE_TYPE(int32_t)
+NATIVE_TYPE(int64_t)
+NATIVE_TYPE(uint8_t)
+NATIVE_TYPE(uint16_t)
+NATIVE_TYPE(uint32_t)
+NATIVE_TYPE(uint64_t)
+NATIVE_TYPE(float)
+NATIVE_TYPE(double)
+NATIVE_TYPE(std::string)
+NATIVE_TYPE(StorageContainer)
+NATIVE_TYPE(StorageList)
+NATIVE_TYPE(std::vector<float>)
+NATIVE_TYPE(std::vector<int32_t>)
+NATIVE_TYPE(std::vector<uint32_t>)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ogre::Degree
+////////////////////////////////////////////////////////////////////////////////
+
+Ogre::Degree
+TypeInfo<Ogre::Degree>::convertFromStoredType(
+    const float& value
+) {
+    return Ogre::Degree(value);
+}
+
+
+float
+TypeInfo<Ogre::Degree>::convertToStoredType(
+    const Ogre::Degree& value
+) {
+    return value.valueDegrees();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ogre::Plane
+////////////////////////////////////////////////////////////////////////////////
+
+Ogre::Plane
+TypeInfo<Ogre::Plane>::convertFromStoredType(
+    const StorageContainer& storage
+) {
+    const CompoundKeys& keys = compoundKeys();
+    Ogre::Vector3 normal = storage.get<Ogre::Vector3>(keys.normal);
+    Ogre::Real d = storage.get<Ogre::Real>(keys.d);
+    Ogre::Plane plane(normal, -d); // See the constructor definition in OgrePlane.cpp for the minus sign
+    return plane;
+}
+
+
+StorageContainer
+TypeInfo<Ogre::Plane>::convertToStoredType(
+    const Ogre::Plane& value
+) {
+    const CompoundKeys& keys = compoundKeys();
+    StorageContainer storage;
+    storage.set<Ogre::Vector3>(keys.normal, value.normal);
+    storage.set<Ogre::Real>(keys.d, value.d);
+    return storage;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ogre::Vector3
+////////////////////////////////////////////////////////////////////////////////
+
+Ogre::Vector3
+TypeInfo<Ogre::Vector3>::convertFromStoredType(
+    const StorageContainer& storage
+) {
+    const auto& keys = compoundKeys().vector3;
+    std::array<Ogre::Real, 3> elements {{
+        storage.get<Ogre::Real>(keys[0]),
+        storage.get<Ogre::Real>(keys[1]),
+        storage.get<Ogre::Real>(keys[2])
+    }};
+    return Ogre::Vector3(elements.data());
+}
+
+
+StorageContainer
+TypeInfo<Ogre::Vector3>::convertToStoredType(
+    const Ogre::Vector3& value
+) {
+    const auto& keys = compoundKeys().vector3;
+    StorageContainer storage;
+    storage.set<Ogre::Real>(keys[0], value.x);
+    storage.set<Ogre::Real>(keys[1], value.y);
+    storage.set<Ogre::Real>(keys[2], value.z);
+    return storage;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ogre::Quaternion
+////////////////////////////////////////////////////////////////////////////////
+
+Ogre::Quaternion
+TypeInfo<Ogre::Quaternion>::convertFromStoredType(
+    const StorageContainer& storage
+) {
+    const auto& keys = compoundKeys().quaternion;
+    std::array<Ogre::Real, 4> elements {{
+        storage.get<Ogre::Real>(keys[0]),
+        storage.get<Ogre::Real>(keys[1]),
+        storage.get<Ogre::Real>(keys[2]),
+        storage.get<Ogre::Real>(keys[3])
+    }};
+    return Ogre::Quaternion(elements.data());
+}
+
+
+StorageContainer
+TypeInfo<Ogre::Quaternion>::convertToStoredType(
+    const Ogre::Quaternion& value
+) {
+    const auto& keys = compoundKeys().quaternion;
+    StorageContainer storage;
+    storage.set<Ogre::Real>(keys[0], value.w);
+    storage.set<Ogre::Real>(keys[1], value.x);
+    storage.set<Ogre::Real>(keys[2], value.y);
+    storage.set<Ogre::Real>(keys[3], value.z);
+    return storage;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ogre::ColourValue
+////////////////////////////////////////////////////////////////////////////////
+
+Ogre::ColourValue
+TypeInfo<Ogre::ColourValue>::convertFromStoredType(
+    const uint32_t& rgba
+) {
+    Ogre::ColourValue value;
+    value.setAsRGBA(rgba);
+    return value;
+}
+
+
+uint32_t
+TypeInfo<Ogre::ColourValue>::convertToStoredType(
+    const Ogre::ColourValue& value
+) {
+    return value.getAsRGBA();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// std::vector<Ogre::Vector3>
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<Ogre::Vector3>
+TypeInfo<std::vector<Ogre::Vector3>>::convertFromStoredType(
+    const std::vector<float>& coordinates
+) {
+    std::vector<Ogre::Vector3> vectors;
+    vectors.reserve(coordinates.size() / 3);
+    for (size_t i = 0; i + 2 < coordinates.size(); i += 3) {
+        vectors.emplace_back(coordinates[i], coordinates[i + 1], coordinates[i + 2]);
+    }
+    return vectors;
+}
+
+
+std::vector<float>
+TypeInfo<std::vector<Ogre::Vector3>>::convertToStoredType(
+    const std::vector<Ogre::Vector3>& vectors
+) {
+    std::vector<float> coordinates;
+    coordinates.reserve(3 * vectors.size());
+    for (const Ogre::Vector3& vector : vectors) {
+        coordinates.push_back(vector.x);
+        coordinates.push_back(vector.y);
+        coordinates.push_back(vector.z);
+    }
+    return coordinates;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// std::vector<Ogre::Quaternion>
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<Ogre::Quaternion>
+TypeInfo<std::vector<Ogre::Quaternion>>::convertFromStoredType(
+    const std::vector<float>& coordinates
+) {
+    std::vector<Ogre::Quaternion> quaternions;
+    quaternions.reserve(coordinates.size() / 4);
+    for (size_t i = 0; i + 3 < coordinates.size(); i += 4) {
+        quaternions.emplace_back(
+            coordinates[i], coordinates[i + 1], coordinates[i + 2], coordinates[i + 3]
+        );
+    }
+    return quaternions;
+}
+
+
+std::vector<float>
+TypeInfo<std::vector<Ogre::Quaternion>>::convertToStoredType(
+    const std::vector<Ogre::Quaternion>& quaternions
+) {
+    std::vector<float> coordinates;
+    coordinates.reserve(4 * quaternions.size());
+    for (const Ogre::Quaternion& quaternion : quaternions) {
+        coordinates.push_back(quaternion.w);
+        coordinates.push_back(quaternion.x);
+        coordinates.push_back(quaternion.y);
+        coordinates.push_back(quaternion.z);
+    }
+    return coordinates;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StorageList
+////////////////////////////////////////////////////////////////////////////////
+
+static StorageList
+StorageList_fromTable(
+    const luabind::object& table
+) {
+    lua_State* L = table.interpreter();
+    int top = lua_gettop(L);
+    table.push(L);
+    try {
+        StorageList list = StorageList::fromTable(L, -1);
+        lua_settop(L, top);
+        return list;
+    }
+    catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+
+static StorageList
+StorageList_fromTableWithSchema(
+    const luabind::object& table,
+    const StorageSchema& schema
+) {
+    lua_State* L = table.interpreter();
+    int top = lua_gettop(L);
+    table.push(L);
+    try {
+        StorageList list = StorageList::fromTable(L, -1, &schema);
+        lua_settop(L, top);
+        return list;
+    }
+    catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+
+static luabind::object
+StorageList_toTable(
+    const StorageList* self,
+    lua_State* L
+) {
+    self->pushTable(L);
+    luabind::object table(luabind::from_stack(L, -1));
+    lua_pop(L, 1);
+    return table;
+}
+
+
+static luabind::object
+StorageList_toTableWithSchema(
+    const StorageList* self,
+    lua_State* L,
+    const StorageSchema& schema
+) {
+    self->pushTable(L, &schema);
+    luabind::object table(luabind::from_stack(L, -1));
+    lua_pop(L, 1);
+    return table;
+}
+
+
+luabind::scope
+StorageList::luaBindings() {
+    using namespace luabind;
+    return class_<StorageList>("StorageList")
+        .scope [
+            def("fromTable", &StorageList_fromTable),
+            def("fromTable", &StorageList_fromTableWithSchema)
+        ]
+        .def(constructor<>())
+        .def("append", &StorageList::append)
+        .def("get", &StorageList::get)
+        .def("size", &StorageList::size)
+        .def("toTable", &StorageList_toTable)
+        .def("toTable", &StorageList_toTableWithSchema)
+    ;
+}
+
+
+StorageList
+StorageList::fromTable(
+    lua_State* L,
+    int index,
+    const StorageSchema* schema
+) {
+    return readList(L, absoluteIndex(L, index), schema, StorageKey(), 0);
+}
+
+
+StorageList::StorageList() {}
+
+StorageList::StorageList(
+    const StorageList& other
+) : std::vector<StorageContainer>(other)
+{
+}
+
+
+StorageList::StorageList(
+    StorageList&& other
+) : std::vector<StorageContainer>(other)
+{
+}
+
+
+StorageList&
+StorageList::operator = (
+    const StorageList& other
+) {
+    std::vector<StorageContainer>::operator=(other);
+    return *this;
+}
+
+
+StorageList&
+StorageList::operator = (
+    StorageList&& other
+) {
+    std::vector<StorageContainer>::operator=(other);
+    return *this;
+}
+
+
+void
+StorageList::append(
+    StorageContainer element
+) {
+    this->emplace_back(std::move(element));
+}
+
+
+StorageContainer&
+StorageList::get(
+    size_t index
+) {
+    assert(index > 0);
+    return this->at(index - 1);
+}
+
+
+void
+StorageList::pushTable(
+    lua_State* L,
+    const StorageSchema* schema
+) const {
+    if (not lua_checkstack(L, 4)) {
+        throw std::runtime_error("Lua stack overflow while loading a table");
+    }
+    lua_createtable(L, static_cast<int>(this->size()), 0);
+    for (size_t i = 0; i < this->size(); ++i) {
+        (*this)[i].pushTable(L, schema);
+        lua_rawseti(L, -2, static_cast<int>(i + 1));
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Columns
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const StorageKey COLUMNS_KEY("columns");
+const StorageKey COUNT_KEY("count");
+const StorageKey ROWS_KEY("rows");
+
+bool
+isColumnType(
+    TypeId typeId
+) {
+    switch (typeId) {
+        case TypeInfo<float>::Id:
+        case TypeInfo<int32_t>::Id:
+        case TypeInfo<uint32_t>::Id:
+        case TypeInfo<Ogre::Vector3>::Id:
+        case TypeInfo<Ogre::Quaternion>::Id:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+template<typename T>
+void
+addColumn(
+    const StorageList& rows,
+    const StorageKey& key,
+    StorageContainer& columns
+) {
+    std::vector<T> values;
+    values.reserve(rows.size());
+    for (const StorageContainer& row : rows) {
+        values.push_back(row.get<T>(key));
+    }
+    columns.set<std::vector<T>>(key, std::move(values));
+}
+
+
+template<typename T>
+void
+restoreColumn(
+    const StorageContainer& columns,
+    const StorageKey& key,
+    StorageList& rows
+) {
+    std::vector<T> values = columns.get<std::vector<T>>(key);
+    if (values.size() != rows.size()) {
+        throw std::runtime_error("Corrupt savegame: column " + key.name() + " has the wrong size");
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        rows[i].set<T>(key, values[i]);
+    }
+}
+
+}
+
+
+StorageContainer
+thrive::storageColumns(
+    const StorageList& rows
+) {
+    using Entry = StorageContainer::Implementation::Entry;
+    // Entries of the first row that all other rows have with the same type,
+    // sorted by key id
+    std::vector<std::pair<StorageKey, TypeId>> columnFields;
+    if (not rows.empty()) {
+        for (const Entry& entry : rows.front().m_impl->m_content) {
+            if (isColumnType(entry.value.typeId)) {
+                columnFields.emplace_back(entry.key, entry.value.typeId);
+            }
+        }
+    }
+    for (const StorageContainer& row : rows) {
+        columnFields.erase(std::remove_if(columnFields.begin(), columnFields.end(),
+            [&row] (const std::pair<StorageKey, TypeId>& field) {
+                const StoredValue* value = row.m_impl->find(field.first);
+                return not value or value->typeId != field.second;
+            }
+        ), columnFields.end());
+    }
+    StorageContainer columns;
+    for (const auto& field : columnFields) {
+        switch (field.second) {
+            case TypeInfo<float>::Id:
+                addColumn<float>(rows, field.first, columns);
+                break;
+            case TypeInfo<int32_t>::Id:
+                addColumn<int32_t>(rows, field.first, columns);
+                break;
+            case TypeInfo<uint32_t>::Id:
+                addColumn<uint32_t>(rows, field.first, columns);
+                break;
+            case TypeInfo<Ogre::Vector3>::Id:
+                addColumn<Ogre::Vector3>(rows, field.first, columns);
+                break;
+            case TypeInfo<Ogre::Quaternion>::Id:
+                addColumn<Ogre::Quaternion>(rows, field.first, columns);
+                break;
+        }
+    }
+    // The remaining entries of each row
+    StorageList remainingRows;
+    remainingRows.reserve(rows.size());
+    bool hasRemainingEntries = false;
+    for (const StorageContainer& row : rows) {
+        StorageContainer remaining;
+        auto field = columnFields.begin();
+        for (const Entry& entry : row.m_impl->m_content) {
+            // Both are sorted by key id
+            while (field != columnFields.end() and field->first.id() < entry.key.id()) {
+                ++field;
+            }
+            if (field == columnFields.end() or field->first != entry.key) {
+                remaining.m_impl->m_content.push_back(entry);
+            }
+        }
+        hasRemainingEntries = hasRemainingEntries or not remaining.m_impl->m_content.empty();
+        remainingRows.append(std::move(remaining));
+    }
+    StorageContainer result;
+    result.set<uint64_t>(COUNT_KEY, rows.size());
+    result.set(COLUMNS_KEY, std::move(columns));
+    if (hasRemainingEntries) {
+        result.set(ROWS_KEY, std::move(remainingRows));
+    }
+    return result;
+}
+
+
+StorageList
+thrive::storageRows(
+    const StorageContainer& storage
+) {
+    uint64_t count = storage.get<uint64_t>(COUNT_KEY);
+    StorageList rows = storage.get<StorageList>(ROWS_KEY);
+    if (rows.empty()) {
+        if (count > UINT32_MAX) {
+            throw std::runtime_error("Corrupt savegame: invalid row count");
+        }
+        rows.resize(count);
+    }
+    else if (rows.size() != count) {
+        throw std::runtime_error("Corrupt savegame: wrong number of rows");
+    }
+    StorageContainer columns = storage.get<StorageContainer>(COLUMNS_KEY);
+    for (const auto& entry : columns.m_impl->m_content) {
+        switch (entry.value.typeId) {
+            case TypeInfo<std::vector<float>>::Id:
+                restoreColumn<float>(columns, entry.key, rows);
+                break;
+            case TypeInfo<std::vector<int32_t>>::Id:
+                restoreColumn<int32_t>(columns, entry.key, rows);
+                break;
+            case TypeInfo<std::vector<uint32_t>>::Id:
+                restoreColumn<uint32_t>(columns, entry.key, rows);
+                break;
+            case TypeInfo<std::vector<Ogre::Vector3>>::Id:
+                restoreColumn<Ogre::Vector3>(columns, entry.key, rows);
+                break;
+            case TypeInfo<std::vector<Ogre::Quaternion>>::Id:
+                restoreColumn<Ogre::Quaternion>(columns, entry.key, rows);
+                break;
+            default:
+                throw std::runtime_error("Corrupt savegame: invalid column " + entry.key.name());
+        }
+    }
+    return rows;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Serialization
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template<typename T>
+struct TypeHandler {
+
+    static T
+    deserialize(
+        std::istream& stream
+    );
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const T& value
+    );
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Integrals
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+struct IntegralTypeHandler {
+
+    static T
+    deserialize(
+        std::istream& stream
+    ) {
+        T value = 0;
+        stream.read(
+            reinterpret_cast<char*>(&value),
+            sizeof(T)
+        );
+        assert(not stream.fail());
+        return value;
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        T value
+    ) {
+        stream.write(
+            reinterpret_cast<char*>(&value), 
+            sizeof(T)
+        );
+    }
+};
+
+#define INTEGRAL_TYPE_HANDLER(typeName) \
+    template<> struct TypeHandler<typeName> : public IntegralTypeHandler<typeName> {};
+
+INTEGRAL_TYPE_HANDLER(int8_t)
+INTEGRAL_TYPE_HANDLER(int16_t)
+INTEGRAL_TYPE_HANDLER(int32_t)
+INTEGRAL_TYPE_HANDLER(int64_t)
+INTEGRAL_TYPE_HANDLER(uint8_t)
+INTEGRAL_TYPE_HANDLER(uint16_t)
+INTEGRAL_TYPE_HANDLER(uint32_t)
+INTEGRAL_TYPE_HANDLER(uint64_t)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Bool
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<bool> {
+
+    static bool
+    deserialize(
+        std::istream& stream
+    ) {
+        auto value = TypeHandler<uint8_t>::deserialize(stream);
+        return value > 0;
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const bool& value
+    ) {
+        uint8_t encoded = value ? 1 : 0;
+        TypeHandler<uint8_t>::serialize(stream, encoded);
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Char
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<char> {
+
+    static char
+    deserialize(
+        std::istream& stream
+    ) {
+        char value = 0;
+        stream.read(&value, 1);
+        assert(not stream.fail());
+        return value;
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const char& value
+    ) {
+        stream.write(&value, 1);
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// String
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<std::string> {
+
+    static std::string
+    deserialize(
+        std::istream& stream
+    ) {
+        uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
+        std::vector<char> buffer(size, '\0');
+        stream.read(&buffer[0], size);
+        assert(not stream.fail());
+        return std::string(buffer.begin(), buffer.end());
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const std::string& string
+    ) {
+        uint64_t size = string.size();
+        TypeHandler<uint64_t>::serialize(stream, size);
+        stream.write(string.data(), size);
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Float
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<float> {
+
+    static float
+    deserialize(
+        std::istream& stream
+    ) {
+        std::string asString = TypeHandler<std::string>::deserialize(stream);
+        return boost::lexical_cast<float>(asString);
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const float& value
+    ) {
+        std::string asString = boost::lexical_cast<std::string>(value);
+        TypeHandler<std::string>::serialize(stream, asString);
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Double
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<double> {
+
+    static double
+    deserialize(
+        std::istream& stream
+    ) {
+        std::string asString = TypeHandler<std::string>::deserialize(stream);
+        return boost::lexical_cast<double>(asString);
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const double& value
+    ) {
+        std::string asString = boost::lexical_cast<std::string>(value);
+        TypeHandler<std::string>::serialize(stream, asString);
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StorageContainer
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<StorageContainer> {
+
+    static StorageContainer
+    deserialize(
+        std::istream& stream
+    ) {
+        StorageContainer value;
+        stream >> value;
+        return value;
+    }
+
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const StorageContainer& value
+    ) {
+        stream << value;
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StorageList
+////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct TypeHandler<StorageList> {
+
+    static StorageList
+    deserialize(
+        std::istream& stream
+    ) {
+        StorageList list;
+        uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
+        // Corrupt sizes run out of data before they run out of memory
+        list.reserve(std::min<uint64_t>(size, 1 << 16));
+        for (size_t i=0; i < size; ++i) {
+            list.append(TypeHandler<StorageContainer>::deserialize(stream));
+        }
+        return list;
+    }
+
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const StorageList& list
+    ) {
+        uint64_t size = list.size();
+        TypeHandler<uint64_t>::serialize(stream, size);
+        for (const auto& storageContainer : list) {
+            TypeHandler<StorageContainer>::serialize(stream, storageContainer);
+        }
+    }
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Arrays
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+struct TypeHandler<std::vector<T>> {
+
+    static std::vector<T>
     deserialize(
         std::istream& stream
     ) {
-        auto value = TypeHandler<uint8_t>::deserialize(stream);
-        return value > 0;
+        std::vector<T> values;
+        uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
+        for (size_t i = 0; i < size; ++i) {
+            values.push_back(TypeHandler<T>::deserialize(stream));
+        }
+        return values;
+    }
+
+    static void
+    serialize(
+        std::ostream& stream,
+        const std::vector<T>& values
+    ) {
+        uint64_t size = values.size();
+        TypeHandler<uint64_t>::serialize(stream, size);
+        for (const T& value : values) {
+            TypeHandler<T>::serialize(stream, value);
+        }
+    }
+
+};
+
+
+struct SerializationVisitor : public boost::static_visitor<> {
+
+    SerializationVisitor(
+        std::ostream& stream
+    ) : m_stream(stream)
+    {
+    }
+
+    template<typename T>
+    void
+    operator () (
+        const T& value
+    ) const {
+        TypeHandler<T>::serialize(m_stream, value);
+    }
+
+    void
+    operator () (
+        const LazyValue&
+    ) const {
+        assert(false && "Lazy values are resolved before serialization");
+    }
+
+    std::ostream& m_stream;
+};
+
+#define DESERIALIZE_CASE(typeName) \
+    case TypeInfo<typeName>::Id: \
+        return TypeHandler<TypeInfo<typeName>::StoredType>::deserialize(stream)
+
+static Variant
+deserialize(
+    TypeId typeId,
+    std::istream& stream
+) {
+    switch (typeId) {
+        DESERIALIZE_CASE(bool);
+        DESERIALIZE_CASE(char);
+        DESERIALIZE_CASE(int8_t);
+        DESERIALIZE_CASE(int16_t);
+        DESERIALIZE_CASE(int32_t);
+        DESERIALIZE_CASE(int64_t);
+        DESERIALIZE_CASE(uint8_t);
+        DESERIALIZE_CASE(uint16_t);
+        DESERIALIZE_CASE(uint32_t);
+        DESERIALIZE_CASE(uint64_t);
+        DESERIALIZE_CASE(float);
+        DESERIALIZE_CASE(double);
+        DESERIALIZE_CASE(std::string);
+        DESERIALIZE_CASE(StorageContainer);
+        DESERIALIZE_CASE(StorageList);
+        // Compound types
+        DESERIALIZE_CASE(Ogre::Degree);
+        DESERIALIZE_CASE(Ogre::Plane);
+        DESERIALIZE_CASE(Ogre::Vector3);
+        DESERIALIZE_CASE(Ogre::Quaternion);
+        DESERIALIZE_CASE(Ogre::ColourValue);
+        // Array types
+        DESERIALIZE_CASE(std::vector<float>);
+        DESERIALIZE_CASE(std::vector<int32_t>);
+        DESERIALIZE_CASE(std::vector<Ogre::Vector3>);
+        DESERIALIZE_CASE(std::vector<uint32_t>);
+        DESERIALIZE_CASE(std::vector<Ogre::Quaternion>);
+        default:
+            assert(false && "Unknown type id. Did you add a new STORABLE_TYPE, but forgot the DESERIALIZE_CASE?");
+    }
+    return Variant(); // Should never be reached, but mingw complains without it
+}
+
+
+} // namespace
+
+std::ostream&
+thrive::operator << (
+    std::ostream& stream,
+    const StorageContainer& storage
+) {
+    SerializationVisitor visitor(stream);
+    const auto& content = storage.m_impl->m_content;
+    TypeHandler<uint64_t>::serialize(stream, content.size());
+    for (const auto& entry : content) {
+        TypeHandler<std::string>::serialize(stream, entry.key.name());    
+        TypeHandler<TypeId>::serialize(stream, entry.value.typeId);    
+        boost::apply_visitor(visitor, resolve(entry.value));
+    }
+    return stream;
+}
+
+
+std::istream&
+thrive::operator >> (
+    std::istream& stream,
+    StorageContainer& storage
+) {
+    uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
+    std::vector<StorageContainer::Implementation::Entry> entries;
+    for (size_t i = 0; i < size; ++i) {
+        StorageKey key(TypeHandler<std::string>::deserialize(stream));
+        TypeId typeId = TypeHandler<TypeId>::deserialize(stream);
+        entries.push_back({key, StoredValue {
+            typeId,
+            deserialize(typeId, stream)
+        }});
+    }
+    storage.m_impl->assign(std::move(entries));
+    return stream;
+}
+
+
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compact format
+////////////////////////////////////////////////////////////////////////////////
+
+namespace thrive {
+
+struct CompactStorageFormat {
+
+    static const std::array<char, 8> MAGIC;
+
+    // Increment on incompatible changes and keep reading older versions.
+    // Version 2 prefixes nested containers and lists with their size.
+    // Version 3 adds arrays.
+    static const uint64_t VERSION = 3;
+
+    // Reads magic number and version. Returns false and rewinds the stream
+    // for the older format without header.
+    static bool
+    readHeader(
+        std::istream& stream,
+        uint64_t& version
+    );
+
+    // Copies one entry from a container into another
+    static void
+    copyEntry(
+        const StorageContainer& source,
+        const std::string& key,
+        StorageContainer& target
+    ) {
+        const StoredValue* value = source.m_impl->find(key);
+        assert(value && "Copied entry must exist");
+        target.m_impl->set(StorageKey(key), *value);
     }
 
+    // A key together with the type of its value
+    using Field = std::pair<uint64_t, TypeId>;
+
+    // Keys and string values, and the fields they make up
+    struct Dictionary {
+
+        std::vector<Field> m_fields;
+
+        // Interned keys of the fields, by index into m_strings. Empty for 
+        // strings that are only used as values.
+        std::vector<StorageKey> m_keys;
+
+        std::vector<std::string> m_strings;
+
+    };
+
+    struct FieldHash {
+
+        std::size_t
+        operator() (
+            const Field& field
+        ) const {
+            return std::hash<uint64_t>()(field.first * 1031 + field.second);
+        }
+
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Primitives
+    ////////////////////////////////////////////////////////////////////////////
+
     static void
-    serialize(
+    writeVarint(
         std::ostream& stream,
-        const bool& value
+        uint64_t value
     ) {
-        uint8_t encoded = value ? 1 : 0;
-        TypeHandler<uint8_t>::serialize(stream, encoded);
+        char buffer[10];
+        size_t size = 0;
+        while (value >= 0x80) {
+            buffer[size++] = static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        buffer[size++] = static_cast<char>(value);
+        stream.write(buffer, size);
     }
 
-};
+    static uint64_t
+    readVarint(
+        std::istream& stream
+    ) {
+        uint64_t value = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            int byte = stream.get();
+            if (byte == std::istream::traits_type::eof()) {
+                throw std::runtime_error("Corrupt savegame: unexpected end of data");
+            }
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Corrupt savegame: varint too long");
+    }
 
+    static void
+    writeSigned(
+        std::ostream& stream,
+        int64_t value
+    ) {
+        // Zigzag encoding keeps small negative values short
+        writeVarint(
+            stream, 
+            (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)
+        );
+    }
 
-////////////////////////////////////////////////////////////////////////////////
-// Char
-////////////////////////////////////////////////////////////////////////////////
+    static int64_t
+    readSigned(
+        std::istream& stream
+    ) {
+        uint64_t value = readVarint(stream);
+        return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+    }
 
-template<>
-struct TypeHandler<char> {
+    template<typename Unsigned>
+    static void
+    writeFixed(
+        std::ostream& stream,
+        Unsigned value
+    ) {
+        // Little endian, independent of the platform
+        char buffer[sizeof(Unsigned)];
+        for (size_t i = 0; i < sizeof(Unsigned); ++i) {
+            buffer[i] = static_cast<char>(value >> (8 * i));
+        }
+        stream.write(buffer, sizeof(Unsigned));
+    }
 
-    static char
-    deserialize(
+    template<typename Unsigned>
+    static Unsigned
+    readFixed(
         std::istream& stream
     ) {
-        char value = 0;
-        stream.read(&value, 1);
-        assert(not stream.fail());
+        unsigned char buffer[sizeof(Unsigned)];
+        stream.read(reinterpret_cast<char*>(buffer), sizeof(Unsigned));
+        if (stream.gcount() != sizeof(Unsigned)) {
+            throw std::runtime_error("Corrupt savegame: unexpected end of data");
+        }
+        Unsigned value = 0;
+        for (size_t i = 0; i < sizeof(Unsigned); ++i) {
+            value |= static_cast<Unsigned>(buffer[i]) << (8 * i);
+        }
         return value;
     }
 
     static void
-    serialize(
+    writeFloat(
         std::ostream& stream,
-        const char& value
+        float value
     ) {
-        stream.write(&value, 1);
+        static_assert(sizeof(float) == 4, "float must be 32 bit");
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        writeFixed(stream, bits);
     }
-};
 
+    static float
+    readFloat(
+        std::istream& stream
+    ) {
+        uint32_t bits = readFixed<uint32_t>(stream);
+        float value = 0.0f;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
 
-////////////////////////////////////////////////////////////////////////////////
-// String
-////////////////////////////////////////////////////////////////////////////////
-
-template<>
-struct TypeHandler<std::string> {
+    static void
+    writeDouble(
+        std::ostream& stream,
+        double value
+    ) {
+        static_assert(sizeof(double) == 8, "double must be 64 bit");
+        uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        writeFixed(stream, bits);
+    }
 
-    static std::string
-    deserialize(
+    static double
+    readDouble(
         std::istream& stream
     ) {
-        uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
-        std::vector<char> buffer(size, '\0');
-        stream.read(&buffer[0], size);
-        assert(not stream.fail());
-        return std::string(buffer.begin(), buffer.end());
+        uint64_t bits = readFixed<uint64_t>(stream);
+        double value = 0.0;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
     }
 
+    // Arrays of 32 bit values are written as their size and a single block
+    // of little endian words
+    template<typename T>
     static void
-    serialize(
+    writeArray(
         std::ostream& stream,
-        const std::string& string
+        const std::vector<T>& values
     ) {
-        uint64_t size = string.size();
-        TypeHandler<uint64_t>::serialize(stream, size);
-        stream.write(string.data(), size);
+        static_assert(sizeof(T) == 4, "Array elements must be 32 bit");
+        writeVarint(stream, values.size());
+        std::string block(4 * values.size(), '\0');
+        for (size_t i = 0; i < values.size(); ++i) {
+            uint32_t bits = 0;
+            std::memcpy(&bits, &values[i], sizeof(bits));
+            for (size_t byte = 0; byte < 4; ++byte) {
+                block[4 * i + byte] = static_cast<char>(bits >> (8 * byte));
+            }
+        }
+        stream.write(block.data(), block.size());
     }
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Writer
+    ////////////////////////////////////////////////////////////////////////////
+
+    class Writer : public boost::static_visitor<> {
+
+    public:
+
+        Writer(
+            std::ostream& body
+        ) : m_body(body)
+        {
+        }
+
+        void
+        operator() (
+            bool value
+        ) const {
+            m_body.put(value ? 1 : 0);
+        }
+
+        void
+        operator() (
+            char value
+        ) const {
+            m_body.put(value);
+        }
+
+        void
+        operator() (
+            int8_t value
+        ) const {
+            m_body.put(static_cast<char>(value));
+        }
+
+        void
+        operator() (
+            uint8_t value
+        ) const {
+            m_body.put(static_cast<char>(value));
+        }
+
+        void
+        operator() (
+            int16_t value
+        ) const {
+            writeSigned(m_body, value);
+        }
+
+        void
+        operator() (
+            int32_t value
+        ) const {
+            writeSigned(m_body, value);
+        }
+
+        void
+        operator() (
+            int64_t value
+        ) const {
+            writeSigned(m_body, value);
+        }
+
+        void
+        operator() (
+            uint16_t value
+        ) const {
+            writeVarint(m_body, value);
+        }
+
+        void
+        operator() (
+            uint32_t value
+        ) const {
+            writeVarint(m_body, value);
+        }
+
+        void
+        operator() (
+            uint64_t value
+        ) const {
+            writeVarint(m_body, value);
+        }
+
+        void
+        operator() (
+            float value
+        ) const {
+            writeFloat(m_body, value);
+        }
+
+        void
+        operator() (
+            double value
+        ) const {
+            writeDouble(m_body, value);
+        }
+
+        void
+        operator() (
+            const std::string& value
+        ) const {
+            writeVarint(m_body, m_strings.intern(value));
+        }
+
+        void
+        operator() (
+            const StorageContainer& value
+        ) const {
+            this->writeSized([this, &value] () {
+                this->writeContainer(value);
+            });
+        }
+
+        void
+        operator() (
+            const std::vector<float>& values
+        ) const {
+            writeArray(m_body, values);
+        }
+
+        void
+        operator() (
+            const std::vector<int32_t>& values
+        ) const {
+            writeArray(m_body, values);
+        }
+
+        void
+        operator() (
+            const std::vector<uint32_t>& values
+        ) const {
+            writeArray(m_body, values);
+        }
+
+        void
+        operator() (
+            const StorageList& list
+        ) const {
+            this->writeSized([this, &list] () {
+                writeVarint(m_body, list.size());
+                for (const auto& element : list) {
+                    this->writeContainer(element);
+                }
+            });
+        }
+
+        void
+        operator() (
+            const LazyValue&
+        ) const {
+            assert(false && "Lazy values are resolved before writing");
+        }
+
+        void
+        writeContainer(
+            const StorageContainer& storage
+        ) const {
+            const auto& content = storage.m_impl->m_content;
+            writeVarint(m_body, content.size());
+            for (const auto& entry : content) {
+                TypeId typeId = entry.value.typeId;
+                writeVarint(m_body, this->fieldIndex(entry.key, typeId));
+                const Variant& value = resolve(entry.value);
+                if (not this->writePacked(typeId, value)) {
+                    boost::apply_visitor(*this, value);
+                }
+            }
+        }
+
+        void
+        writeDictionary(
+            std::ostream& stream
+        ) const {
+            writeVarint(stream, m_strings.m_values.size());
+            for (const std::string* string : m_strings.m_values) {
+                writeVarint(stream, string->size());
+                stream.write(string->data(), string->size());
+            }
+            writeVarint(stream, m_fields.size());
+            for (const Field& field : m_fields) {
+                writeVarint(stream, field.first);
+                writeVarint(stream, field.second);
+            }
+        }
+
+    private:
+
+        struct StringTable {
+
+            uint64_t
+            intern(
+                const std::string& string
+            ) {
+                auto result = m_indices.emplace(string, m_values.size());
+                if (result.second) {
+                    m_values.push_back(&result.first->first);
+                }
+                return result.first->second;
+            }
+
+            std::unordered_map<std::string, uint64_t> m_indices;
+
+            std::vector<const std::string*> m_values;
+
+        };
+
+        uint64_t
+        fieldIndex(
+            const StorageKey& key,
+            TypeId typeId
+        ) const {
+            // Looks up interned keys without hashing their names
+            uint64_t keyField = (uint64_t(key.id()) << 16) | typeId;
+            auto iter = m_keyFieldIndices.find(keyField);
+            if (iter != m_keyFieldIndices.end()) {
+                return iter->second;
+            }
+            uint64_t index = this->fieldIndex(key.name(), typeId);
+            m_keyFieldIndices.emplace(keyField, index);
+            return index;
+        }
+
+        uint64_t
+        fieldIndex(
+            const std::string& key,
+            TypeId typeId
+        ) const {
+            Field field(m_strings.intern(key), typeId);
+            auto result = m_fieldIndices.emplace(field, m_fields.size());
+            if (result.second) {
+                m_fields.push_back(field);
+            }
+            return result.first->second;
+        }
+
+        // Compound types of fixed layout are written as plain floats
+        bool
+        writePacked(
+            TypeId typeId,
+            const Variant& value
+        ) const {
+            const CompoundKeys& compound = compoundKeys();
+            const StorageKey* keys = nullptr;
+            size_t keyCount = 0;
+            switch (typeId) {
+                case TypeInfo<Ogre::Vector3>::Id:
+                    keys = compound.vector3.data();
+                    keyCount = compound.vector3.size();
+                    break;
+                case TypeInfo<Ogre::Quaternion>::Id:
+                    keys = compound.quaternion.data();
+                    keyCount = compound.quaternion.size();
+                    break;
+                case TypeInfo<Ogre::Plane>::Id:
+                {
+                    const auto& plane = boost::get<StorageContainer>(value);
+                    Ogre::Vector3 normal = plane.get<Ogre::Vector3>(compound.normal);
+                    writeFloat(m_body, normal.x);
+                    writeFloat(m_body, normal.y);
+                    writeFloat(m_body, normal.z);
+                    writeFloat(m_body, plane.get<Ogre::Real>(compound.d));
+                    return true;
+                }
+                default:
+                    return false;
+            }
+            const auto& storage = boost::get<StorageContainer>(value);
+            for (size_t i = 0; i < keyCount; ++i) {
+                writeFloat(m_body, storage.get<Ogre::Real>(keys[i]));
+            }
+            return true;
+        }
+
+        // Prefixes whatever write() writes with its size, so that readers
+        // can skip it
+        template<typename Function>
+        void
+        writeSized(
+            Function write
+        ) const {
+            std::streampos start = m_body.tellp();
+            writeFixed<uint32_t>(m_body, 0);
+            write();
+            std::streampos end = m_body.tellp();
+            std::streamoff size = end - start - std::streamoff(sizeof(uint32_t));
+            if (size > std::streamoff(UINT32_MAX)) {
+                throw std::runtime_error("Savegame value too large");
+            }
+            m_body.seekp(start);
+            writeFixed<uint32_t>(m_body, static_cast<uint32_t>(size));
+            m_body.seekp(end);
+        }
+
+        std::ostream& m_body;
+
+        mutable std::unordered_map<Field, uint64_t, FieldHash> m_fieldIndices;
+
+        mutable std::vector<Field> m_fields;
+
+        mutable std::unordered_map<uint64_t, uint64_t> m_keyFieldIndices;
+
+        mutable StringTable m_strings;
+
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Reader
+    ////////////////////////////////////////////////////////////////////////////
+
+    class Reader {
+
+    public:
+
+        Reader(
+            std::istream& stream,
+            uint64_t version
+        ) : m_dictionary(std::make_shared<Dictionary>()),
+            m_stream(stream),
+            m_version(version)
+        {
+        }
+
+        // Reads from a memory mapped savegame, leaving nested containers
+        // and lists to be parsed on access. The stream reads the memory
+        // from begin to end.
+        Reader(
+            std::istream& stream,
+            std::shared_ptr<const MappedSavegame> file,
+            const char* begin,
+            const char* end
+        );
+
+        void
+        readDictionary() {
+            uint64_t stringCount = readVarint(m_stream);
+            m_dictionary->m_strings.reserve(reservedSize(this->checkedSize(stringCount)));
+            for (uint64_t i = 0; i < stringCount; ++i) {
+                uint64_t size = this->checkedSize(readVarint(m_stream));
+                std::string string(size, '\0');
+                m_stream.read(&string[0], size);
+                if (static_cast<uint64_t>(m_stream.gcount()) != size) {
+                    throw std::runtime_error("Corrupt savegame: unexpected end of data");
+                }
+                m_dictionary->m_strings.push_back(std::move(string));
+            }
+            uint64_t fieldCount = readVarint(m_stream);
+            m_dictionary->m_fields.reserve(reservedSize(this->checkedSize(fieldCount)));
+            for (uint64_t i = 0; i < fieldCount; ++i) {
+                uint64_t keyIndex = readVarint(m_stream);
+                uint64_t typeId = readVarint(m_stream);
+                if (keyIndex >= m_dictionary->m_strings.size() or typeId > 0xFFFF) {
+                    throw std::runtime_error("Corrupt savegame: invalid field");
+                }
+                m_dictionary->m_fields.emplace_back(keyIndex, static_cast<TypeId>(typeId));
+            }
+            m_dictionary->m_keys.resize(m_dictionary->m_strings.size());
+            for (const Field& field : m_dictionary->m_fields) {
+                m_dictionary->m_keys[field.first] = StorageKey(
+                    m_dictionary->m_strings[field.first]
+                );
+            }
+        }
+
+        void
+        readContainer(
+            StorageContainer& storage
+        ) {
+            uint64_t size = this->readSize();
+            std::vector<StorageContainer::Implementation::Entry> entries;
+            entries.reserve(reservedSize(size));
+            for (uint64_t i = 0; i < size; ++i) {
+                Field field = this->readField();
+                entries.push_back({
+                    m_dictionary->m_keys[field.first],
+                    StoredValue{field.second, this->readVariant(field.second)}
+                });
+            }
+            storage.m_impl->assign(std::move(entries));
+        }
+
+        // Reads the field of a container entry
+        Field
+        readField() {
+            uint64_t fieldIndex = readVarint(m_stream);
+            if (fieldIndex >= m_dictionary->m_fields.size()) {
+                throw std::runtime_error("Corrupt savegame: invalid field index");
+            }
+            return m_dictionary->m_fields[fieldIndex];
+        }
+
+        // Reads the number of entries of a container
+        uint64_t
+        readSize() {
+            return this->checkedSize(readVarint(m_stream));
+        }
+
+        // Starts reading a nested container and returns its number of
+        // entries
+        uint64_t
+        enterContainer() {
+            if (m_version >= 2) {
+                readFixed<uint32_t>(m_stream);
+            }
+            return this->readSize();
+        }
+
+        // Reads a nested container
+        void
+        readNestedContainer(
+            StorageContainer& storage
+        ) {
+            if (m_version >= 2) {
+                readFixed<uint32_t>(m_stream);
+            }
+            this->readContainer(storage);
+        }
+
+        // Skips the value of a container entry without parsing it if
+        // possible
+        void
+        skipValue(
+            const Field& field
+        ) {
+            if (m_version >= 2 and isSized(field.second)) {
+                uint32_t size = readFixed<uint32_t>(m_stream);
+                m_stream.seekg(size, std::ios_base::cur);
+                return;
+            }
+            StorageContainer discarded;
+            this->readValue(field, discarded);
+        }
+
+        // Reads the value of a container entry and stores it in storage
+        void
+        readValue(
+            const Field& field,
+            StorageContainer& storage
+        ) {
+            storage.m_impl->set(m_dictionary->m_keys[field.first], StoredValue{
+                field.second,
+                this->readVariant(field.second)
+            });
+        }
+
+        const std::string&
+        key(
+            const Field& field
+        ) const {
+            return m_dictionary->m_strings[field.first];
+        }
+
+        std::istream&
+        stream() {
+            return m_stream;
+        }
+
+        // Reads the value of a LazyValue, which has no size prefix
+        Variant
+        readLazyValue(
+            TypeId typeId
+        ) {
+            return this->parseVariant(typeId);
+        }
+
+    private:
+
+        static bool
+        isSized(
+            TypeId typeId
+        ) {
+            return (
+                typeId == TypeInfo<StorageContainer>::Id or
+                typeId == TypeInfo<StorageList>::Id
+            );
+        }
+
+        // Guards reservations against corrupt sizes
+        uint64_t
+        checkedSize(
+            uint64_t size
+        ) const {
+            if (size > (1ull << 32)) {
+                throw std::runtime_error("Corrupt savegame: invalid size");
+            }
+            return size;
+        }
+
+        // Corrupt sizes run out of data before they run out of memory, so
+        // reservations are capped and vectors grow beyond that as needed
+        static uint64_t
+        reservedSize(
+            uint64_t size
+        ) {
+            return std::min<uint64_t>(size, 1 << 16);
+        }
+
+        template<typename T>
+        std::vector<T>
+        readArray() {
+            uint64_t size = this->checkedSize(readVarint(m_stream));
+            std::vector<T> values;
+            values.reserve(reservedSize(size));
+            std::array<unsigned char, 4096> block;
+            while (values.size() < size) {
+                size_t count = std::min<uint64_t>(size - values.size(), block.size() / 4);
+                m_stream.read(reinterpret_cast<char*>(block.data()), 4 * count);
+                if (static_cast<size_t>(m_stream.gcount()) != 4 * count) {
+                    throw std::runtime_error("Corrupt savegame: unexpected end of data");
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    uint32_t bits = 0;
+                    for (size_t byte = 0; byte < 4; ++byte) {
+                        bits |= static_cast<uint32_t>(block[4 * i + byte]) << (8 * byte);
+                    }
+                    T value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    values.push_back(value);
+                }
+            }
+            return values;
+        }
+
+        template<size_t Count>
+        StorageContainer
+        readPacked(
+            const std::array<StorageKey, Count>& keys
+        ) {
+            StorageContainer storage;
+            for (const StorageKey& key : keys) {
+                storage.set<Ogre::Real>(key, readFloat(m_stream));
+            }
+            return storage;
+        }
+
+        const std::string&
+        readString() {
+            uint64_t index = readVarint(m_stream);
+            if (index >= m_dictionary->m_strings.size()) {
+                throw std::runtime_error("Corrupt savegame: invalid string index");
+            }
+            return m_dictionary->m_strings[index];
+        }
+
+        Variant
+        readVariant(
+            TypeId typeId
+        ) {
+            if (m_version < 2 or not isSized(typeId)) {
+                return this->parseVariant(typeId);
+            }
+            uint32_t size = readFixed<uint32_t>(m_stream);
+            if (not m_file) {
+                return this->parseVariant(typeId);
+            }
+            std::streamoff offset = m_stream.tellg();
+            if (offset < 0 or offset + size > m_end - m_begin) {
+                throw std::runtime_error("Corrupt savegame: invalid value size");
+            }
+            m_stream.seekg(size, std::ios_base::cur);
+            const char* begin = m_begin + offset;
+            return LazyValue{begin, begin + size, m_file};
+        }
+
+        Variant
+        parseVariant(
+            TypeId typeId
+        ) {
+            switch (typeId) {
+                case TypeInfo<bool>::Id:
+                    return readFixed<uint8_t>(m_stream) > 0;
+                case TypeInfo<char>::Id:
+                    return static_cast<char>(readFixed<uint8_t>(m_stream));
+                case TypeInfo<int8_t>::Id:
+                    return static_cast<int8_t>(readFixed<uint8_t>(m_stream));
+                case TypeInfo<uint8_t>::Id:
+                    return readFixed<uint8_t>(m_stream);
+                case TypeInfo<int16_t>::Id:
+                    return static_cast<int16_t>(readSigned(m_stream));
+                case TypeInfo<int32_t>::Id:
+                    return static_cast<int32_t>(readSigned(m_stream));
+                case TypeInfo<int64_t>::Id:
+                    return readSigned(m_stream);
+                case TypeInfo<uint16_t>::Id:
+                    return static_cast<uint16_t>(readVarint(m_stream));
+                case TypeInfo<uint32_t>::Id:
+                case TypeInfo<Ogre::ColourValue>::Id:
+                    return static_cast<uint32_t>(readVarint(m_stream));
+                case TypeInfo<uint64_t>::Id:
+                    return readVarint(m_stream);
+                case TypeInfo<float>::Id:
+                case TypeInfo<Ogre::Degree>::Id:
+                    return readFloat(m_stream);
+                case TypeInfo<double>::Id:
+                    return readDouble(m_stream);
+                case TypeInfo<std::string>::Id:
+                    return this->readString();
+                case TypeInfo<StorageContainer>::Id:
+                {
+                    StorageContainer storage;
+                    this->readContainer(storage);
+                    return storage;
+                }
+                case TypeInfo<StorageList>::Id:
+                {
+                    StorageList list;
+                    uint64_t size = this->checkedSize(readVarint(m_stream));
+                    list.reserve(reservedSize(size));
+                    for (uint64_t i = 0; i < size; ++i) {
+                        StorageContainer element;
+                        this->readContainer(element);
+                        list.append(std::move(element));
+                    }
+                    return list;
+                }
+                case TypeInfo<std::vector<float>>::Id:
+                case TypeInfo<std::vector<Ogre::Vector3>>::Id:
+                case TypeInfo<std::vector<Ogre::Quaternion>>::Id:
+                    return this->readArray<float>();
+                case TypeInfo<std::vector<int32_t>>::Id:
+                    return this->readArray<int32_t>();
+                case TypeInfo<std::vector<uint32_t>>::Id:
+                    return this->readArray<uint32_t>();
+                case TypeInfo<Ogre::Vector3>::Id:
+                    return this->readPacked(compoundKeys().vector3);
+                case TypeInfo<Ogre::Quaternion>::Id:
+                    return this->readPacked(compoundKeys().quaternion);
+                case TypeInfo<Ogre::Plane>::Id:
+                {
+                    Ogre::Vector3 normal;
+                    normal.x = readFloat(m_stream);
+                    normal.y = readFloat(m_stream);
+                    normal.z = readFloat(m_stream);
+                    StorageContainer plane;
+                    plane.set<Ogre::Vector3>(compoundKeys().normal, normal);
+                    plane.set<Ogre::Real>(compoundKeys().d, readFloat(m_stream));
+                    return plane;
+                }
+                default:
+                    throw std::runtime_error("Corrupt savegame: unknown type id");
+            }
+        }
+
+        const char* m_begin = nullptr;
+
+        std::shared_ptr<Dictionary> m_dictionary;
+
+        const char* m_end = nullptr;
+
+        // Null unless nested values are parsed lazily
+        std::shared_ptr<const MappedSavegame> m_file;
+
+        std::istream& m_stream;
+
+        uint64_t m_version;
+
+    };
+
 };
 
+bool
+CompactStorageFormat::readHeader(
+    std::istream& stream,
+    uint64_t& version
+) {
+    std::streampos start = stream.tellg();
+    std::array<char, 8> magic {{}};
+    stream.read(magic.data(), magic.size());
+    if (stream.gcount() != static_cast<std::streamsize>(magic.size()) or magic != MAGIC) {
+        // Older savegames have no header
+        stream.clear();
+        stream.seekg(start);
+        return false;
+    }
+    version = readVarint(stream);
+    if (version > VERSION) {
+        throw std::runtime_error(
+            "Savegame format version " + std::to_string(version) + " is not supported"
+        );
+    }
+    return true;
+}
 
-////////////////////////////////////////////////////////////////////////////////
-// Float
-////////////////////////////////////////////////////////////////////////////////
 
-template<>
-struct TypeHandler<float> {
+const std::array<char, 8> CompactStorageFormat::MAGIC = {{
+    'T', 'H', 'R', 'I', 'V', 'E', 'S', 'G'
+}};
 
-    static float
-    deserialize(
-        std::istream& stream
-    ) {
-        std::string asString = TypeHandler<std::string>::deserialize(stream);
-        return boost::lexical_cast<float>(asString);
-    }
+}
 
-    static void
-    serialize(
-        std::ostream& stream,
-        const float& value
-    ) {
-        std::string asString = boost::lexical_cast<std::string>(value);
-        TypeHandler<std::string>::serialize(stream, asString);
+
+void
+thrive::loadStorage(
+    std::istream& stream,
+    StorageContainer& storage
+) {
+    using Format = CompactStorageFormat;
+    uint64_t version = 0;
+    if (not Format::readHeader(stream, version)) {
+        stream >> storage;
+        return;
     }
+    Format::Reader reader(stream, version);
+    reader.readDictionary();
+    reader.readContainer(storage);
+}
 
-};
+
+void
+thrive::saveStorage(
+    std::ostream& stream,
+    const StorageContainer& storage
+) {
+    using Format = CompactStorageFormat;
+    // The dictionary is only complete after the body has been written
+    std::ostringstream body(std::ios_base::out | std::ios_base::binary);
+    Format::Writer writer(body);
+    writer.writeContainer(storage);
+    stream.write(Format::MAGIC.data(), Format::MAGIC.size());
+    Format::writeVarint(stream, Format::VERSION);
+    writer.writeDictionary(stream);
+    std::string data = body.str();
+    stream.write(data.data(), data.size());
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Double
+// Memory mapped savegames
 ////////////////////////////////////////////////////////////////////////////////
 
-template<>
-struct TypeHandler<double> {
+namespace {
 
-    static double
-    deserialize(
-        std::istream& stream
-    ) {
-        std::string asString = TypeHandler<std::string>::deserialize(stream);
-        return boost::lexical_cast<double>(asString);
+struct MappedSavegame {
+
+    MappedSavegame(
+        const std::string& filename
+    ) : m_dictionary(std::make_shared<CompactStorageFormat::Dictionary>()),
+        m_file(filename.c_str(), boost::interprocess::read_only),
+        m_region(m_file, boost::interprocess::read_only)
+    {
     }
 
-    static void
-    serialize(
-        std::ostream& stream,
-        const double& value
-    ) {
-        std::string asString = boost::lexical_cast<std::string>(value);
-        TypeHandler<std::string>::serialize(stream, asString);
+    const char*
+    begin() const {
+        return static_cast<const char*>(m_region.get_address());
+    }
+
+    const char*
+    end() const {
+        return this->begin() + m_region.get_size();
     }
 
+    std::shared_ptr<CompactStorageFormat::Dictionary> m_dictionary;
+
+    boost::interprocess::file_mapping m_file;
+
+    boost::interprocess::mapped_region m_region;
+
+    uint64_t m_version = 0;
+
 };
 
 
-////////////////////////////////////////////////////////////////////////////////
-// StorageContainer
-////////////////////////////////////////////////////////////////////////////////
+Variant
+parseLazyValue(
+    const LazyValue& lazyValue,
+    TypeId typeId
+) {
+    MemoryBuffer buffer(lazyValue.m_begin, lazyValue.m_end);
+    std::istream stream(&buffer);
+    CompactStorageFormat::Reader reader(
+        stream,
+        lazyValue.m_file,
+        lazyValue.m_begin,
+        lazyValue.m_end
+    );
+    return reader.readLazyValue(typeId);
+}
 
-template<>
-struct TypeHandler<StorageContainer> {
+}
 
-    static StorageContainer
-    deserialize(
-        std::istream& stream
-    ) {
-        StorageContainer value;
-        stream >> value;
-        return value;
-    }
 
+CompactStorageFormat::Reader::Reader(
+    std::istream& stream,
+    std::shared_ptr<const MappedSavegame> file,
+    const char* begin,
+    const char* end
+) : m_begin(begin),
+    m_dictionary(file->m_dictionary),
+    m_end(end),
+    m_file(std::move(file)),
+    m_stream(stream),
+    m_version(m_file->m_version)
+{
+}
 
-    static void
-    serialize(
-        std::ostream& stream,
-        const StorageContainer& value
-    ) {
-        stream << value;
-    }
 
-};
+StorageContainer
+thrive::mapStorage(
+    const std::string& filename
+) {
+    using Format = CompactStorageFormat;
+    auto file = std::make_shared<MappedSavegame>(filename);
+    MemoryBuffer buffer(file->begin(), file->end());
+    std::istream stream(&buffer);
+    StorageContainer storage;
+    uint64_t version = 0;
+    if (CompressedInputStream::isCompressed(stream)) {
+        // Compressed values can't be parsed in place
+        CompressedInputStream decompressed(stream);
+        loadStorage(decompressed, storage);
+    }
+    else if (not Format::readHeader(stream, version)) {
+        stream >> storage;
+    }
+    else if (version < 2) {
+        // Nested values can't be skipped without a size prefix
+        Format::Reader reader(stream, version);
+        reader.readDictionary();
+        reader.readContainer(storage);
+    }
+    else {
+        file->m_version = version;
+        Format::Reader reader(stream, file, file->begin(), file->end());
+        reader.readDictionary();
+        reader.readContainer(storage);
+    }
+    return storage;
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// StorageList
+// StorageReader
 ////////////////////////////////////////////////////////////////////////////////
 
-template<>
-struct TypeHandler<StorageList> {
+struct StorageReader::Implementation {
 
-    static StorageList
-    deserialize(
+    // An open container of the older format, already in memory
+    struct LegacyFrame {
+
+        std::vector<std::string> m_keys;
+
+        size_t m_nextKey = 0;
+
+        StorageContainer m_storage;
+
+    };
+
+    Implementation(
         std::istream& stream
-    ) {
-        StorageList list;
-        uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
-        list.reserve(size);
-        for (size_t i=0; i < size; ++i) {
-            list.append(TypeHandler<StorageContainer>::deserialize(stream));
+    ) : m_stream(stream)
+    {
+        m_start = stream.tellg();
+        stream.seekg(0, std::ios_base::end);
+        m_size = stream.tellg() - m_start;
+        stream.seekg(m_start);
+        uint64_t version = 0;
+        if (CompactStorageFormat::readHeader(stream, version)) {
+            m_reader.reset(new CompactStorageFormat::Reader(stream, version));
+            m_reader->readDictionary();
+            m_remainingEntries.push_back(m_reader->readSize());
+        }
+        else {
+            StorageContainer root;
+            stream >> root;
+            this->pushLegacyFrame(std::move(root));
         }
-        return list;
     }
 
+    const std::string&
+    legacyKey() const {
+        const LegacyFrame& frame = m_legacyFrames.back();
+        return frame.m_keys[frame.m_nextKey - 1];
+    }
 
-    static void
-    serialize(
-        std::ostream& stream,
-        const StorageList& list
+    void
+    pushLegacyFrame(
+        StorageContainer storage
     ) {
-        uint64_t size = list.size();
-        TypeHandler<uint64_t>::serialize(stream, size);
-        for (const auto& storageContainer : list) {
-            TypeHandler<StorageContainer>::serialize(stream, storageContainer);
-        }
+        LegacyFrame frame;
+        auto keys = storage.keys();
+        frame.m_keys.assign(keys.begin(), keys.end());
+        frame.m_storage = std::move(storage);
+        m_legacyFrames.push_back(std::move(frame));
     }
 
-};
+    // The field of the current entry in the compact format
+    CompactStorageFormat::Field m_field;
 
+    // Whether there is a current entry whose value hasn't been read yet
+    bool m_hasEntry = false;
 
-struct SerializationVisitor : public boost::static_visitor<> {
+    std::vector<LegacyFrame> m_legacyFrames;
 
-    SerializationVisitor(
-        std::ostream& stream
-    ) : m_stream(stream)
-    {
-    }
+    // Null for the older format
+    std::unique_ptr<CompactStorageFormat::Reader> m_reader;
 
-    template<typename T>
-    void
-    operator () (
-        const T& value
-    ) const {
-        TypeHandler<T>::serialize(m_stream, value);
-    }
+    // Entries left in each open container of the compact format
+    std::vector<uint64_t> m_remainingEntries;
+
+    std::streamoff m_size = 0;
+
+    std::streampos m_start;
+
+    std::istream& m_stream;
 
-    std::ostream& m_stream;
 };
 
-#define DESERIALIZE_CASE(typeName) \
-    case TypeInfo<typeName>::Id: \
-        return TypeHandler<TypeInfo<typeName>::StoredType>::deserialize(stream)
 
-static Variant
-deserialize(
-    TypeId typeId,
+StorageReader::StorageReader(
     std::istream& stream
-) {
-    switch (typeId) {
-        DESERIALIZE_CASE(bool);
-        DESERIALIZE_CASE(char);
-        DESERIALIZE_CASE(int8_t);
-        DESERIALIZE_CASE(int16_t);
-        DESERIALIZE_CASE(int32_t);
-        DESERIALIZE_CASE(int64_t);
-        DESERIALIZE_CASE(uint8_t);
-        DESERIALIZE_CASE(uint16_t);
-        DESERIALIZE_CASE(uint32_t);
-        DESERIALIZE_CASE(uint64_t);
-        DESERIALIZE_CASE(float);
-        DESERIALIZE_CASE(double);
-        DESERIALIZE_CASE(std::string);
-        DESERIALIZE_CASE(StorageContainer);
-        DESERIALIZE_CASE(StorageList);
-        // Compound types
-        DESERIALIZE_CASE(Ogre::Degree);
-        DESERIALIZE_CASE(Ogre::Plane);
-        DESERIALIZE_CASE(Ogre::Vector3);
-        DESERIALIZE_CASE(Ogre::Quaternion);
-        DESERIALIZE_CASE(Ogre::ColourValue);
-        default:
-            assert(false && "Unknown type id. Did you add a new STORABLE_TYPE, but forgot the DESERIALIZE_CASE?");
+) : m_impl(new Implementation(stream))
+{
+}
+
+
+StorageReader::~StorageReader() {}
+
+
+void
+StorageReader::enterContainer() {
+    assert(m_impl->m_hasEntry and this->isContainer() && "Current entry is not a container");
+    m_impl->m_hasEntry = false;
+    if (m_impl->m_reader) {
+        m_impl->m_remainingEntries.push_back(m_impl->m_reader->enterContainer());
+    }
+    else {
+        StorageContainer storage = m_impl->m_legacyFrames.back().m_storage.get<StorageContainer>(
+            m_impl->legacyKey()
+        );
+        m_impl->pushLegacyFrame(std::move(storage));
     }
-    return Variant(); // Should never be reached, but mingw complains without it
 }
 
 
-} // namespace
+bool
+StorageReader::isContainer() const {
+    if (m_impl->m_reader) {
+        return m_impl->m_field.second == TypeInfo<StorageContainer>::Id;
+    }
+    else {
+        return m_impl->m_legacyFrames.back().m_storage.contains<StorageContainer>(
+            m_impl->legacyKey()
+        );
+    }
+}
 
-std::ostream&
-thrive::operator << (
-    std::ostream& stream,
-    const StorageContainer& storage
-) {
-    SerializationVisitor visitor(stream);
-    const auto& content = storage.m_impl->m_content;
-    TypeHandler<uint64_t>::serialize(stream, content.size());
-    for (const auto& pair : content) {
-        TypeHandler<std::string>::serialize(stream, pair.first);    
-        TypeHandler<TypeId>::serialize(stream, pair.second.typeId);    
-        boost::apply_visitor(visitor, pair.second.value);
+
+const std::string&
+StorageReader::key() const {
+    if (m_impl->m_reader) {
+        return m_impl->m_reader->key(m_impl->m_field);
+    }
+    else {
+        return m_impl->legacyKey();
     }
-    return stream;
 }
 
 
-std::istream&
-thrive::operator >> (
-    std::istream& stream,
-    StorageContainer& storage
-) {
-    uint64_t size = TypeHandler<uint64_t>::deserialize(stream);
-    storage.m_impl->m_content.clear();
-    for (size_t i = 0; i < size; ++i) {
-        std::string key = TypeHandler<std::string>::deserialize(stream);
-        TypeId typeId = TypeHandler<TypeId>::deserialize(stream);
-        storage.m_impl->m_content[key] = StoredValue {
-            typeId,
-            deserialize(typeId, stream)
-        };
+bool
+StorageReader::nextEntry() {
+    if (m_impl->m_reader) {
+        if (m_impl->m_hasEntry) {
+            m_impl->m_reader->skipValue(m_impl->m_field);
+            m_impl->m_hasEntry = false;
+        }
+        auto& remainingEntries = m_impl->m_remainingEntries;
+        if (remainingEntries.empty()) {
+            return false;
+        }
+        if (remainingEntries.back() == 0) {
+            remainingEntries.pop_back();
+            return false;
+        }
+        remainingEntries.back() -= 1;
+        m_impl->m_field = m_impl->m_reader->readField();
+        m_impl->m_hasEntry = true;
+        return true;
+    }
+    else {
+        m_impl->m_hasEntry = false;
+        auto& frames = m_impl->m_legacyFrames;
+        if (frames.empty()) {
+            return false;
+        }
+        auto& frame = frames.back();
+        if (frame.m_nextKey == frame.m_keys.size()) {
+            frames.pop_back();
+            return false;
+        }
+        frame.m_nextKey += 1;
+        m_impl->m_hasEntry = true;
+        return true;
     }
-    return stream;
 }
 
 
+float
+StorageReader::progress() const {
+    if (not m_impl->m_reader or m_impl->m_size <= 0) {
+        return 1.0f;
+    }
+    std::streampos position = m_impl->m_stream.tellg();
+    if (position < m_impl->m_start) {
+        return 1.0f;
+    }
+    return float(position - m_impl->m_start) / float(m_impl->m_size);
+}
+
 
+StorageContainer
+StorageReader::readContainer() {
+    assert(m_impl->m_hasEntry and this->isContainer() && "Current entry is not a container");
+    m_impl->m_hasEntry = false;
+    StorageContainer storage;
+    if (m_impl->m_reader) {
+        m_impl->m_reader->readNestedContainer(storage);
+    }
+    else {
+        storage = m_impl->m_legacyFrames.back().m_storage.get<StorageContainer>(
+            m_impl->legacyKey()
+        );
+    }
+    return storage;
+}
 
 
+void
+StorageReader::readEntry(
+    StorageContainer& storage
+) {
+    assert(m_impl->m_hasEntry && "No current entry");
+    m_impl->m_hasEntry = false;
+    if (m_impl->m_reader) {
+        m_impl->m_reader->readValue(m_impl->m_field, storage);
+    }
+    else {
+        CompactStorageFormat::copyEntry(
+            m_impl->m_legacyFrames.back().m_storage,
+            m_impl->legacyKey(),
+            storage
+        );
+    }
+}
@@ -3,6 +3,7 @@
 #include "scripting/luabind.h"
 
 #include <cstdint>
+#include <memory>
 #include <OgreColourValue.h>
 #include <OgreMath.h>
 #include <OgrePlane.h>
@@ -29,9 +30,259 @@ namespace Ogre {
 
 namespace thrive {
 
+class StorageList;
+
+/**
+* @brief A precomputed key for StorageContainer
+*
+* Keys are interned: each distinct name gets a small id once per process,
+* and containers look up their entries by that id. Creating a key from a 
+* name hashes the name, so code that accesses the same keys over and over,
+* like the load() and storage() functions of components, should keep its 
+* keys around:
+*
+* \code
+* static const StorageKey POSITION("position");
+* m_position = storage.get<Ogre::Vector3>(POSITION);
+* \endcode
+*
+* Keys can be created and used from any thread.
+*/
+class StorageKey {
+
+public:
+
+    /**
+    * @brief Creates the key for the empty name
+    */
+    StorageKey();
+
+    /**
+    * @brief Creates or looks up the key for a name
+    *
+    * @param name
+    */
+    explicit StorageKey(
+        const std::string& name
+    );
+
+    /**
+    * @brief Creates or looks up the key for a name
+    *
+    * @param name
+    */
+    explicit StorageKey(
+        const char* name
+    );
+
+    /**
+    * @brief The key's id
+    *
+    * Ids are only valid within the running process. Savegames store names.
+    */
+    uint32_t
+    id() const;
+
+    /**
+    * @brief The key's name
+    */
+    const std::string&
+    name() const;
+
+    bool
+    operator == (
+        const StorageKey& other
+    ) const;
+
+    bool
+    operator != (
+        const StorageKey& other
+    ) const;
+
+private:
+
+    friend class StorageContainer;
+
+    // Looks up the key for an existing name without creating a new one
+    static bool
+    find(
+        const std::string& name,
+        StorageKey& key
+    );
+
+    uint32_t m_id;
+
+    // Interned, so it lives as long as the process
+    const std::string* m_name;
+
+};
+
+
+/**
+* @brief Declares the fields of a Lua table to store
+*
+* Lua components usually build their storage with one
+* StorageContainer::set() call per field, each a luabind call with overload
+* resolution. StorageContainer::fromTable() instead reads a whole table
+* through the Lua C API. Without a schema, it stores every entry with its
+* natural type. A schema restricts it to the declared fields, converts them
+* to the declared types, e.g. numbers to \c int32_t, and precomputes their
+* keys.
+*
+* In Lua, a schema is made from a table of field names and types:
+* \code
+* AGENT_SCHEMA = StorageSchema{
+*     agentId = "integer",
+*     amount = "number"
+* }
+* ORGANELLE_SCHEMA = StorageSchema{
+*     className = "string",
+*     colour = "ColourValue",
+*     hexCoordinates = "intArray",
+*     -- A nested container
+*     position = { q = "integer", r = "integer" },
+*     -- A list of containers
+*     inputAgents = { { agentId = "integer", amount = "number" } }
+* }
+* \endcode
+*
+* Type names are "any", "boolean", "number", "integer", "string",
+* "ColourValue", "Degree", "Plane", "Quaternion", "Vector3", "floatArray",
+* "intArray" and "vector3Array". A table declares a nested container with its
+* own schema, or, if its first element is a table, a list of containers
+* with that schema. An empty table is a container of any fields.
+*/
+class StorageSchema {
+
+public:
+
+    /**
+    * @brief How a field is stored
+    */
+    enum class Type {
+        Any,
+        Boolean,
+        Number,
+        Integer,
+        String,
+        ColourValue,
+        Degree,
+        Plane,
+        Quaternion,
+        Vector3,
+        FloatArray,
+        IntArray,
+        Vector3Array,
+        Container,
+        List
+    };
+
+    /**
+    * @brief A declared field
+    */
+    struct Field {
+
+        /**
+        * @brief The field's key, also its name in the Lua table
+        */
+        StorageKey key;
+
+        /**
+        * @brief The field's type
+        */
+        Type type;
+
+        /**
+        * @brief For containers and lists, the schema of the nested
+        * containers, or \c null for any fields
+        */
+        std::shared_ptr<const StorageSchema> schema;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - StorageSchema(table)
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Parses a type name
+    *
+    * @param name
+    *
+    * @throws std::invalid_argument
+    *   If \a name is not a type name, see above
+    */
+    static Type
+    typeFromName(
+        const std::string& name
+    );
+
+    /**
+    * @brief Creates an empty schema
+    */
+    StorageSchema();
+
+    /**
+    * @brief Creates a schema from a Lua table
+    *
+    * @param table
+    *   Field names and types, see above
+    *
+    * @throws std::invalid_argument
+    *   If a type is unknown
+    */
+    explicit StorageSchema(
+        const luabind::object& table
+    );
+
+    /**
+    * @brief Declares a field
+    *
+    * @param name
+    *   The field's name
+    * @param type
+    *   The field's type
+    * @param schema
+    *   For containers and lists, the schema of the nested containers
+    */
+    void
+    addField(
+        const std::string& name,
+        Type type,
+        std::shared_ptr<const StorageSchema> schema = nullptr
+    );
+
+    /**
+    * @brief The declared fields
+    */
+    const std::vector<Field>&
+    fields() const;
+
+private:
+
+    std::vector<Field> m_fields;
+
+};
+
 
 /**
 * @brief A key-value storage for serialization
+*
+* Entries are kept in a vector sorted by key id. Every function taking a
+* key as a string also takes a StorageKey, which saves hashing the string.
+*
+* Besides scalars, strings, nested containers and lists, a container holds
+* arrays of numbers: \c std::vector<float>, \c std::vector<int32_t> and 
+* \c std::vector<Ogre::Vector3>. They are saved as a single block, which
+* is much smaller and faster than a StorageList with one container per 
+* element.
 */
 class StorageContainer {
 
@@ -41,13 +292,48 @@ public:
     * @brief Lua bindings
     *
     * - StorageContainer::contains
-    * - StorageContainer::get
+    * - StorageContainer::fromTable(table, schema) (static, schema optional)
+    * - StorageContainer::get (arrays are returned as tables)
     * - StorageContainer::set
+    * - StorageContainer::toTable(schema) (schema optional)
+    * - setFloatArray(key, table)
+    * - setIntArray(key, table)
+    * - setVector3Array(key, table)
     *
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Converts a Lua table into a container
+    *
+    * Walks the table through the Lua C API. Without a schema, string keys
+    * are stored with the type of their value: booleans, numbers as
+    * \c double, strings, stored types like Ogre::Vector3 or
+    * StorageContainer, and nested tables. A nested table with an element at
+    * index 1 is an array: an array of numbers becomes a \c
+    * std::vector<int32_t> if all of them are integers, a \c
+    * std::vector<float> otherwise, and an array of tables a StorageList.
+    *
+    * @param L
+    *   The Lua state
+    * @param index
+    *   The table's stack index
+    * @param schema
+    *   The fields to store, or \c null for all of them. Declared fields
+    *   that are \c nil are left out.
+    *
+    * @throws std::invalid_argument
+    *   If a value can't be stored, like a function, or doesn't match the
+    *   schema
+    */
+    static StorageContainer
+    fromTable(
+        lua_State* L,
+        int index,
+        const StorageSchema* schema = nullptr
+    );
+
     /**
     * @brief Constructor
     */
@@ -111,6 +397,19 @@ public:
         const std::string& key
     ) const;
 
+    /**
+    * @brief Checks for a key
+    *
+    * @param key
+    *   The key to check for
+    *
+    * @return \c true if the key is present in this container, \c false otherwise
+    */
+    bool
+    contains(
+        const StorageKey& key
+    ) const;
+
     /**
     * @brief Checks for a key together with type
     *
@@ -129,6 +428,20 @@ public:
         const std::string& key
     ) const;
 
+    /**
+    * @brief Checks for a key together with type
+    *
+    * @tparam T
+    *   The expected type of the key's associated value
+    * @param key
+    *   The key to check for
+    */
+    template<typename T>
+    bool
+    contains(
+        const StorageKey& key
+    ) const;
+
     /**
     * @brief Retrieves a value from the container
     *
@@ -151,6 +464,41 @@ public:
         const T& defaultValue = T()
     ) const;
 
+    /**
+    * @brief Retrieves a value from the container
+    *
+    * @tparam T
+    *   The value's type
+    * @param key
+    *   The key to retrieve
+    * @param defaultValue
+    *   The value to return when the key is not present (or the value has the
+    *   wrong type)
+    */
+    template<typename T>
+    T
+    get(
+        const StorageKey& key,
+        const T& defaultValue = T()
+    ) const;
+
+    /**
+    * @brief Collects the entries that changed compared to another container
+    *
+    * Nested containers and lists are compared by value.
+    *
+    * @param previous
+    *   The container to compare with
+    *
+    * @return 
+    *   The entries of this container that are missing in \a previous or
+    *   differ from it. Entries only found in \a previous are not included.
+    */
+    StorageContainer
+    difference(
+        const StorageContainer& previous
+    ) const;
+
     /**
     * @brief Returns a list of all keys in this container
     *
@@ -172,6 +520,39 @@ public:
         luabind::object defaultValue
     ) const;
 
+    /**
+    * @brief Pushes the container onto the Lua stack as a plain table
+    *
+    * The reverse of fromTable(). Nested containers become tables, lists
+    * and arrays become arrays. Other stored types are pushed as their
+    * bound classes, like Ogre::ColourValue.
+    *
+    * @param L
+    *   The Lua state
+    * @param schema
+    *   The fields to push, or \c null for all of them
+    */
+    void
+    pushTable(
+        lua_State* L,
+        const StorageSchema* schema = nullptr
+    ) const;
+
+    /**
+    * @brief Copies all entries of another container into this one
+    *
+    * Entries with the same key are overwritten. merge() undoes difference():
+    * \c previous.merge(current.difference(previous)) yields \c current if
+    * \c current has all keys of \c previous.
+    *
+    * @param other
+    *   The container to copy from
+    */
+    void
+    merge(
+        const StorageContainer& other
+    );
+
     /**
     * @brief Sets a value in this container
     *
@@ -191,6 +572,23 @@ public:
         T value
     );
 
+    /**
+    * @brief Sets a value in this container
+    *
+    * @tparam T
+    *   The type of \a value
+    * @param key
+    *   The key to associate with the value
+    * @param value
+    *   The value to insert
+    */
+    template<typename T>
+    void
+    set(
+        const StorageKey& key,
+        T value
+    );
+
     friend std::ostream& 
     operator << (
         std::ostream& stream,
@@ -203,8 +601,32 @@ public:
         StorageContainer& storage
     );
 
+    friend void
+    loadStorage(
+        std::istream& stream,
+        StorageContainer& storage
+    );
+
+    friend void
+    saveStorage(
+        std::ostream& stream,
+        const StorageContainer& storage
+    );
+
+    friend StorageContainer
+    storageColumns(
+        const StorageList& rows
+    );
+
+    friend StorageList
+    storageRows(
+        const StorageContainer& storage
+    );
+
 private:
 
+    friend struct CompactStorageFormat;
+
     struct Implementation;
     std::unique_ptr<Implementation> m_impl;
 };
@@ -238,6 +660,190 @@ operator >> (
 );
 
 
+/**
+* @brief Reads a StorageContainer saved with saveStorage()
+*
+* Also reads the older format written by the stream operator, which has no
+* header.
+*
+* @param stream
+*   The stream to read from. Must be seekable to detect the older format.
+* @param storage
+*   Receives the stored content
+*
+* @throws std::runtime_error if the data is corrupt or was written by a
+*   newer version of the format
+*/
+void
+loadStorage(
+    std::istream& stream,
+    StorageContainer& storage
+);
+
+/**
+* @brief Writes a StorageContainer in the compact savegame format
+*
+* The format starts with a magic number and a version. A dictionary follows
+* that holds every key and string value once, and every combination of key
+* and type once as a field. Entries then only refer to their field by index.
+* Integers are stored as varints, floating point numbers in binary and 
+* vectors and quaternions as packed arrays of floats. Nested containers and
+* lists are prefixed with their size so that readers can skip them.
+*
+* @param stream
+*   The stream to write to
+* @param storage
+*   The storage to write
+*/
+void
+saveStorage(
+    std::ostream& stream,
+    const StorageContainer& storage
+);
+
+/**
+* @brief Opens a savegame as a view into a memory mapped file
+*
+* Only the top-level container is parsed right away. Nested containers and
+* lists are parsed when they are first accessed, so loading a part of a 
+* savegame only touches the bytes of that part. The file stays mapped until
+* the last container referring to it is destroyed. Modifying the returned
+* containers only affects the copy in memory.
+*
+* Parsing on access modifies the container, so containers from the same 
+* file must not be accessed concurrently. Savegames written before nested 
+* values were prefixed with their size, those in the older format, and 
+* compressed ones are parsed completely.
+*
+* @param filename
+*   The savegame to open
+*
+* @throws std::runtime_error if the data is corrupt, and 
+*   boost::interprocess::interprocess_exception if the file can't be mapped
+*/
+StorageContainer
+mapStorage(
+    const std::string& filename
+);
+
+
+/**
+* @brief Reads a savegame one entry at a time
+*
+* Unlike loadStorage(), the reader doesn't build the whole tree of 
+* containers at once. A caller walks the entries of the top-level 
+* container with nextEntry(), reads the ones it needs with readEntry() or
+* readContainer() and descends into nested containers with 
+* enterContainer(). Only the entries read are kept in memory.
+*
+* Savegames in the older format are read completely on construction and
+* then walked the same way.
+*
+* Usage:
+* \code
+* StorageReader reader(stream);
+* while (reader.nextEntry()) {
+*     if (reader.key() == "gameStates") {
+*         reader.enterContainer();
+*         while (reader.nextEntry()) {
+*             StorageContainer gameState = reader.readContainer();
+*             // ...
+*         }
+*     }
+* }
+* \endcode
+*/
+class StorageReader {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param stream
+    *   The stream to read from. Must be seekable and outlive the reader.
+    *
+    * @throws std::runtime_error if the data is corrupt or was written by a
+    *   newer version of the format
+    */
+    StorageReader(
+        std::istream& stream
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~StorageReader();
+
+    /**
+    * @brief Descends into the current entry
+    *
+    * The following calls to nextEntry() walk the nested container. Once it
+    * has no entries left, nextEntry() continues in the parent container.
+    *
+    * The current entry must be a StorageContainer.
+    */
+    void
+    enterContainer();
+
+    /**
+    * @brief Whether the current entry is a StorageContainer
+    */
+    bool
+    isContainer() const;
+
+    /**
+    * @brief The key of the current entry
+    */
+    const std::string&
+    key() const;
+
+    /**
+    * @brief Moves to the next entry
+    *
+    * Unread entries are skipped.
+    *
+    * @return
+    *   \c false if the current container has no more entries. The reader
+    *   then has left the container.
+    */
+    bool
+    nextEntry();
+
+    /**
+    * @brief Approximately how much of the data has been read
+    *
+    * @return
+    *   A value in <tt>[0, 1]</tt>
+    */
+    float
+    progress() const;
+
+    /**
+    * @brief Reads the current entry, which must be a StorageContainer
+    */
+    StorageContainer
+    readContainer();
+
+    /**
+    * @brief Reads the current entry into a container
+    *
+    * @param storage
+    *   Receives the entry under its key
+    */
+    void
+    readEntry(
+        StorageContainer& storage
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
 /**
 * @brief A list of StorageContainers
 */
@@ -249,14 +855,36 @@ public:
     * @brief Lua bindings
     *
     * - StorageList::append
+    * - StorageList::fromTable(table, schema) (static, schema optional)
     * - StorageList::get
     * - StorageList::size
+    * - StorageList::toTable(schema) (schema optional)
     *
     * @return 
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Converts a Lua array of tables into a list
+    *
+    * @param L
+    *   The Lua state
+    * @param index
+    *   The array's stack index
+    * @param schema
+    *   The schema of the elements, see StorageContainer::fromTable()
+    *
+    * @throws std::invalid_argument
+    *   If an element isn't a table or can't be stored
+    */
+    static StorageList
+    fromTable(
+        lua_State* L,
+        int index,
+        const StorageSchema* schema = nullptr
+    );
+
     /**
     * @brief Constructor
     */
@@ -328,8 +956,65 @@ public:
         size_t index
     );
 
+    /**
+    * @brief Pushes the list onto the Lua stack as an array of tables
+    *
+    * @param L
+    *   The Lua state
+    * @param schema
+    *   The schema of the elements, see StorageContainer::pushTable()
+    */
+    void
+    pushTable(
+        lua_State* L,
+        const StorageSchema* schema = nullptr
+    ) const;
+
 };
 
+/**
+* @brief Transposes a list of similar containers into columns
+*
+* Entries that every container has with the same numeric type become one
+* array each, see StorageContainer. Columns of similar numbers compress 
+* far better than interleaved rows and are read in one block. All other
+* entries stay in a list of rows.
+*
+* Usage:
+* \code
+* StorageList components = ...;
+* StorageContainer columns = storageColumns(components);
+* StorageList copy = storageRows(columns);
+* \endcode
+*
+* @param rows
+*   The containers to transpose
+*
+* @return
+*   The columns, to be restored with storageRows()
+*/
+StorageContainer
+storageColumns(
+    const StorageList& rows
+);
+
+/**
+* @brief Restores the list of containers from storageColumns()
+*
+* @param storage
+*   The result of storageColumns()
+*
+* @return 
+*   The original containers, in their original order
+*
+* @throws std::runtime_error if the columns don't fit together
+*/
+StorageList
+storageRows(
+    const StorageContainer& storage
+);
+
+
 /**
 * @brief Macro for declaring a new storable type
 *
@@ -356,6 +1041,26 @@ public:
     StorageContainer::set<typeName>( \
         const std::string& key, \
         typeName value \
+    ); \
+    \
+    template<> \
+    bool \
+    StorageContainer::contains<typeName>( \
+        const StorageKey& key \
+    ) const; \
+    \
+    template<> \
+    typeName \
+    StorageContainer::get<typeName>( \
+        const StorageKey& key, \
+        const typeName& defaultValue \
+    ) const; \
+    \
+    template<> \
+    void \
+    StorageContainer::set<typeName>( \
+        const StorageKey& key, \
+        typeName value \
     );
 
 // Native types
@@ -381,4 +1086,12 @@ STORABLE_TYPE(Ogre::Plane)
 STORABLE_TYPE(Ogre::Vector3)
 STORABLE_TYPE(Ogre::Quaternion)
 STORABLE_TYPE(Ogre::ColourValue)
+
+// Array types
+STORABLE_TYPE(std::vector<float>)
+STORABLE_TYPE(std::vector<int32_t>)
+STORABLE_TYPE(std::vector<uint32_t>)
+STORABLE_TYPE(std::vector<Ogre::Vector3>)
+STORABLE_TYPE(std::vector<Ogre::Quaternion>)
+
 }
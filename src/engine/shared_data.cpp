@@ -0,0 +1,163 @@
+#include "engine/shared_data.h"
+
+#include "engine/entity_prototype.h"
+#include "engine/serialization.h"
+#include "util/memory_buffer.h"
+
+#include <boost/filesystem.hpp>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Increment when the names or contents of the entries change
+const std::string VERSION = "thrive-shared-data 1";
+
+const std::string VERSION_ENTRY = "version";
+
+const std::string PROTOTYPE_PREFIX = "prototypes/";
+
+const std::string SCRIPT_PREFIX = "scripts/";
+
+
+std::string
+scriptEntry(
+    const fs::path& script
+) {
+    return SCRIPT_PREFIX + script.generic_string() + ".luac";
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SharedData
+////////////////////////////////////////////////////////////////////////////////
+
+SharedData::SharedData(
+    const fs::path& path
+) : m_pack(path)
+{
+    const AssetPack::File* version = m_pack.find(VERSION_ENTRY);
+    if (not version or std::string(version->data, version->size) != VERSION) {
+        throw std::runtime_error(path.string() + " is not shared data of this version");
+    }
+}
+
+
+const AssetPack::File*
+SharedData::compiledScript(
+    const fs::path& script
+) const {
+    return m_pack.find(scriptEntry(script));
+}
+
+
+bool
+SharedData::hasPrototype(
+    const std::string& name
+) const {
+    return m_pack.find(PROTOTYPE_PREFIX + name) != nullptr;
+}
+
+
+bool
+SharedData::loadPrototype(
+    const std::string& name,
+    EntityPrototype& prototype
+) const {
+    const AssetPack::File* file = m_pack.find(PROTOTYPE_PREFIX + name);
+    if (not file) {
+        return false;
+    }
+    MemoryBuffer buffer(file->data, file->data + file->size);
+    std::istream stream(&buffer);
+    StorageContainer storage;
+    loadStorage(stream, storage);
+    prototype.load(storage);
+    return true;
+}
+
+
+const AssetPack&
+SharedData::pack() const {
+    return m_pack;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SharedDataWriter
+////////////////////////////////////////////////////////////////////////////////
+
+void
+SharedDataWriter::addCompiledScript(
+    const fs::path& script,
+    std::string cacheFile
+) {
+    m_compiledScripts[scriptEntry(script)] = std::move(cacheFile);
+}
+
+
+void
+SharedDataWriter::addPrototype(
+    const std::string& name,
+    const EntityPrototype& prototype
+) {
+    std::ostringstream stream;
+    saveStorage(stream, prototype.storage());
+    m_prototypes[PROTOTYPE_PREFIX + name] = stream.str();
+}
+
+
+void
+SharedDataWriter::addPrototypes(
+    const SharedData& sharedData
+) {
+    for (const AssetPack::File& file : sharedData.pack().files()) {
+        if (file.name.compare(0, PROTOTYPE_PREFIX.size(), PROTOTYPE_PREFIX) == 0) {
+            // Doesn't replace existing ones
+            m_prototypes.emplace(file.name, std::string(file.data, file.size));
+        }
+    }
+}
+
+
+bool
+SharedDataWriter::hasPrototype(
+    const std::string& name
+) const {
+    return m_prototypes.count(PROTOTYPE_PREFIX + name) > 0;
+}
+
+
+void
+SharedDataWriter::write(
+    const fs::path& path
+) const {
+    AssetPackWriter pack;
+    pack.add(VERSION_ENTRY, VERSION);
+    for (const auto& pair : m_compiledScripts) {
+        pack.add(pair.first, pair.second);
+    }
+    for (const auto& pair : m_prototypes) {
+        pack.add(pair.first, pair.second);
+    }
+    // Unique, as several processes may write at once
+    fs::path temporaryPath = path.string() + "." + fs::unique_path().string() + ".tmp";
+    boost::system::error_code error;
+    try {
+        pack.write(temporaryPath);
+    }
+    catch (const std::runtime_error&) {
+        fs::remove(temporaryPath, error);
+        throw;
+    }
+    fs::rename(temporaryPath, path, error);
+    if (error) {
+        fs::remove(temporaryPath, error);
+        throw std::runtime_error("Can't replace shared data " + path.string());
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "engine/asset_pack.h"
+
+#include <boost/filesystem/path.hpp>
+#include <map>
+#include <string>
+
+namespace thrive {
+
+class EntityPrototype;
+
+/**
+* @brief Read-only startup data that engine processes on one machine share
+*
+* Several headless engines on one node, like the shards of a simulation
+* (see ShardSystem), would otherwise each compile the same scripts and
+* build the same prototypes. The shared data is an AssetPack with:
+*
+* - The compiled scripts, as the files of the ScriptCache. They are loaded
+*   in place from the mapped memory, see ScriptCache::setSharedData().
+* - Named EntityPrototype storages, including their collision shapes
+*
+* As the pack is mapped read-only, all processes that open the same file
+* share its pages. SharedDataWriter produces the pack, either offline or
+* at startup by the first engine that finds it missing or stale, see
+* Engine::useSharedData().
+*/
+class SharedData {
+
+public:
+
+    /**
+    * @brief Opens shared data
+    *
+    * @param path
+    *   A file written by SharedDataWriter
+    *
+    * @throw std::runtime_error
+    *   If the file can't be mapped or isn't shared data of this version
+    */
+    explicit SharedData(
+        const boost::filesystem::path& path
+    );
+
+    /**
+    * @brief Looks up a compiled script
+    *
+    * @param script
+    *   The script's path, relative to the script directory
+    *
+    * @return
+    *   The script's cache file, or \c null if there is none
+    */
+    const AssetPack::File*
+    compiledScript(
+        const boost::filesystem::path& script
+    ) const;
+
+    /**
+    * @brief Whether there is a prototype with this name
+    *
+    * @param name
+    */
+    bool
+    hasPrototype(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Loads a prototype
+    *
+    * @param name
+    *   The name the prototype was added under
+    * @param prototype
+    *   Receives the prototype's components
+    *
+    * @return
+    *   \c false if there is no such prototype, then \a prototype is left
+    *   alone
+    */
+    bool
+    loadPrototype(
+        const std::string& name,
+        EntityPrototype& prototype
+    ) const;
+
+    /**
+    * @brief The underlying pack
+    */
+    const AssetPack&
+    pack() const;
+
+private:
+
+    AssetPack m_pack;
+
+};
+
+
+/**
+* @brief Builds SharedData
+*/
+class SharedDataWriter {
+
+public:
+
+    /**
+    * @brief Adds a compiled script
+    *
+    * @param script
+    *   The script's path, relative to the script directory
+    * @param cacheFile
+    *   The contents of its ScriptCache file, see
+    *   ScriptCache::compiledScript()
+    */
+    void
+    addCompiledScript(
+        const boost::filesystem::path& script,
+        std::string cacheFile
+    );
+
+    /**
+    * @brief Adds a prototype
+    *
+    * A prototype with the same name is replaced.
+    *
+    * @param name
+    * @param prototype
+    */
+    void
+    addPrototype(
+        const std::string& name,
+        const EntityPrototype& prototype
+    );
+
+    /**
+    * @brief Adds the prototypes of existing shared data
+    *
+    * Prototypes that were already added are kept.
+    *
+    * @param sharedData
+    */
+    void
+    addPrototypes(
+        const SharedData& sharedData
+    );
+
+    /**
+    * @brief Whether there is a prototype with this name
+    *
+    * @param name
+    */
+    bool
+    hasPrototype(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Writes the shared data
+    *
+    * The file is written under a temporary name first and then renamed,
+    * so processes that have the previous file mapped keep reading it.
+    *
+    * @param path
+    *   The file, replaced if it exists
+    *
+    * @throw std::runtime_error
+    *   If the file can't be written
+    */
+    void
+    write(
+        const boost::filesystem::path& path
+    ) const;
+
+private:
+
+    std::map<std::string, std::string> m_compiledScripts;
+
+    std::map<std::string, std::string> m_prototypes;
+
+};
+
+}
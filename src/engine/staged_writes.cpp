@@ -0,0 +1,225 @@
+#include "engine/staged_writes.h"
+
+#include "engine/component.h"
+#include "engine/entity_manager.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace thrive;
+
+struct StagedWrites::RegisteredField {
+
+    ApplyFunction apply;
+
+    ComponentTypeId componentType;
+
+    Touchable::FieldMask mask;
+
+    std::string name;
+
+    ValueType valueType;
+
+};
+
+
+luabind::scope
+StagedWrites::luaBindings() {
+    using namespace luabind;
+    return class_<StagedWrites>("StagedWrites")
+        .scope [
+            def("field", &StagedWrites::field)
+        ]
+        .def("pendingCount", &StagedWrites::pendingCount)
+        .def("stageQuaternion", &StagedWrites::stageQuaternion)
+        .def("stageReal", &StagedWrites::stageReal)
+        .def("stageVector3", &StagedWrites::stageVector3)
+    ;
+}
+
+
+std::vector<StagedWrites::RegisteredField>&
+StagedWrites::registeredFields() {
+    // Filled by static initializers, so it must exist before them
+    static std::vector<RegisteredField> fields;
+    return fields;
+}
+
+
+StagedWrites::FieldId
+StagedWrites::field(
+    const std::string& name
+) {
+    const auto& fields = registeredFields();
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i].name == name) {
+            return static_cast<FieldId>(i);
+        }
+    }
+    throw std::invalid_argument("Unknown staged field: " + name);
+}
+
+
+StagedWrites::FieldId
+StagedWrites::registerFieldImpl(
+    const std::string& name,
+    ComponentTypeId componentType,
+    ValueType valueType,
+    ApplyFunction apply,
+    Touchable::FieldMask mask
+) {
+    auto& fields = registeredFields();
+    if (fields.size() > std::numeric_limits<FieldId>::max()) {
+        throw std::length_error("Too many staged fields");
+    }
+    RegisteredField registered;
+    registered.apply = std::move(apply);
+    registered.componentType = componentType;
+    registered.mask = mask;
+    registered.name = name;
+    registered.valueType = valueType;
+    fields.push_back(std::move(registered));
+    return static_cast<FieldId>(fields.size() - 1);
+}
+
+
+void
+StagedWrites::clear() {
+    m_index.clear();
+    m_writes.clear();
+}
+
+
+size_t
+StagedWrites::flush(
+    EntityManager& entityManager,
+    ComponentTypeId componentType
+) {
+    const auto& fields = registeredFields();
+    // Take out the component type's writes, keep the others for their
+    // own systems
+    m_flushed.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < m_writes.size(); ++i) {
+        const Write& write = m_writes[i];
+        if (fields[write.field].componentType == componentType) {
+            m_flushed.push_back(write);
+        }
+        else {
+            m_writes[kept] = write;
+            kept += 1;
+        }
+    }
+    if (m_flushed.empty()) {
+        return 0;
+    }
+    m_writes.resize(kept);
+    m_index.clear();
+    for (size_t i = 0; i < m_writes.size(); ++i) {
+        uint64_t key = (uint64_t(m_writes[i].entityId) << 32) | m_writes[i].field;
+        m_index[key] = i;
+    }
+    // One component lookup and one touch per touchable for each entity
+    std::stable_sort(m_flushed.begin(), m_flushed.end(),
+        [] (const Write& left, const Write& right) {
+            return left.entityId < right.entityId;
+        }
+    );
+    size_t applied = 0;
+    size_t begin = 0;
+    while (begin < m_flushed.size()) {
+        EntityId entityId = m_flushed[begin].entityId;
+        size_t end = begin;
+        while (end < m_flushed.size() and m_flushed[end].entityId == entityId) {
+            end += 1;
+        }
+        Component* component = entityManager.getComponent(entityId, componentType);
+        if (component) {
+            m_touched.clear();
+            for (size_t i = begin; i < end; ++i) {
+                const auto& field = fields[m_flushed[i].field];
+                Touchable* touchable = &field.apply(*component, m_flushed[i].value);
+                auto iter = std::find_if(m_touched.begin(), m_touched.end(),
+                    [touchable] (const std::pair<Touchable*, Touchable::FieldMask>& item) {
+                        return item.first == touchable;
+                    }
+                );
+                if (iter == m_touched.end()) {
+                    m_touched.emplace_back(touchable, field.mask);
+                }
+                else {
+                    iter->second |= field.mask;
+                }
+            }
+            for (const auto& item : m_touched) {
+                item.first->touchFields(item.second);
+            }
+            applied += end - begin;
+        }
+        begin = end;
+    }
+    return applied;
+}
+
+
+size_t
+StagedWrites::pendingCount() const {
+    return m_writes.size();
+}
+
+
+void
+StagedWrites::stage(
+    EntityId entityId,
+    FieldId field,
+    ValueType valueType,
+    const Value& value
+) {
+    const auto& fields = registeredFields();
+    if (field >= fields.size() or fields[field].valueType != valueType) {
+        throw std::invalid_argument("Staged value doesn't match the field's type");
+    }
+    uint64_t key = (uint64_t(entityId) << 32) | field;
+    auto inserted = m_index.insert(std::make_pair(key, m_writes.size()));
+    if (inserted.second) {
+        m_writes.push_back(Write{entityId, field, value});
+    }
+    else {
+        m_writes[inserted.first->second].value = value;
+    }
+}
+
+
+void
+StagedWrites::stageQuaternion(
+    EntityId entityId,
+    FieldId field,
+    const Ogre::Quaternion& value
+) {
+    Value packed = {{value.w, value.x, value.y, value.z}};
+    this->stage(entityId, field, ValueType::Quaternion, packed);
+}
+
+
+void
+StagedWrites::stageReal(
+    EntityId entityId,
+    FieldId field,
+    Ogre::Real value
+) {
+    Value packed = {{value, 0.0f, 0.0f, 0.0f}};
+    this->stage(entityId, field, ValueType::Real, packed);
+}
+
+
+void
+StagedWrites::stageVector3(
+    EntityId entityId,
+    FieldId field,
+    const Ogre::Vector3& value
+) {
+    Value packed = {{value.x, value.y, value.z, 0.0f}};
+    this->stage(entityId, field, ValueType::Vector3, packed);
+}
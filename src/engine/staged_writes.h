@@ -0,0 +1,323 @@
+#pragma once
+
+#include "engine/touchable.h"
+#include "engine/typedefs.h"
+
+#include <cstdint>
+#include <functional>
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class Component;
+class EntityManager;
+
+/**
+* @brief Collects field writes from scripts and applies them in one batch
+*
+* Setting a component field from Lua, like
+* \code
+* sceneNode.transform.position = translation
+* sceneNode.transform:touch()
+* \endcode
+* takes a luabind call for each step of the path and another one for the
+* touch. Staging the write instead takes one call:
+* \code
+* writes:stageVector3(entity.id, OgreSceneNodeComponent.POSITION_FIELD, translation)
+* \endcode
+* The write is buffered by entity and field. Writing the same field of the
+* same entity again in the same frame replaces the value, so only the last
+* write is applied. The system consuming the component calls flush() before
+* it looks at the components. flush() applies all buffered writes of the
+* component type and touches each changed Touchable once, with the combined
+* field mask.
+*
+* Until then, reading the field returns the old value. Writes for entities
+* that don't have the component when they are flushed are dropped, so a
+* component may be added after its fields have been staged.
+*
+* Fields are registered once for the whole program with registerField(),
+* usually next to the REGISTER_COMPONENT of their component. Each entity
+* manager has its own StagedWrites (see EntityManager::stagedWrites()).
+*
+* Not thread safe. Scripts and the consuming systems run on the main
+* thread.
+*/
+class StagedWrites {
+
+public:
+
+    /**
+    * @brief Identifies a registered field
+    */
+    using FieldId = uint16_t;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - StagedWrites::field()
+    * - StagedWrites::pendingCount()
+    * - StagedWrites::stageReal()
+    * - StagedWrites::stageQuaternion()
+    * - StagedWrites::stageVector3()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Looks up a field by the name it was registered with
+    *
+    * @param name
+    *
+    * @throw std::invalid_argument
+    *   If there is no such field
+    */
+    static FieldId
+    field(
+        const std::string& name
+    );
+
+    /**
+    * @brief Registers a field
+    *
+    * Must run after the component's TYPE_ID is initialised, so put it
+    * after the REGISTER_COMPONENT in the same file.
+    *
+    * @tparam ComponentType
+    *   The component class
+    * @tparam T
+    *   The field's type, \c Ogre::Real, \c Ogre::Vector3 or
+    *   \c Ogre::Quaternion
+    * @param name
+    *   The name for field()
+    * @param apply
+    *   Sets the field and returns the Touchable to touch
+    * @param mask
+    *   The fields to touch, see Touchable::touchFields()
+    *
+    * @return
+    *   The field's id
+    */
+    template<typename ComponentType, typename T>
+    static FieldId
+    registerField(
+        const std::string& name,
+        Touchable& (*apply)(ComponentType&, const T&),
+        Touchable::FieldMask mask = Touchable::ALL_FIELDS
+    ) {
+        return registerFieldImpl(
+            name,
+            ComponentType::TYPE_ID,
+            ValueTraits<T>::TYPE,
+            [apply] (Component& component, const Value& value) -> Touchable& {
+                return apply(
+                    static_cast<ComponentType&>(component),
+                    ValueTraits<T>::unpack(value)
+                );
+            },
+            mask
+        );
+    }
+
+    /**
+    * @brief Discards all buffered writes
+    */
+    void
+    clear();
+
+    /**
+    * @brief Applies the buffered writes of one component type
+    *
+    * @param entityManager
+    *   The entity manager owning the components
+    * @param componentType
+    *   The component type to apply the writes of
+    *
+    * @return
+    *   The number of writes applied
+    */
+    size_t
+    flush(
+        EntityManager& entityManager,
+        ComponentTypeId componentType
+    );
+
+    /**
+    * @brief The number of buffered writes
+    */
+    size_t
+    pendingCount() const;
+
+    /**
+    * @brief Buffers a write to a quaternion field
+    *
+    * @param entityId
+    * @param field
+    * @param value
+    *
+    * @throw std::invalid_argument
+    *   If \a field is not a registered quaternion field
+    */
+    void
+    stageQuaternion(
+        EntityId entityId,
+        FieldId field,
+        const Ogre::Quaternion& value
+    );
+
+    /**
+    * @brief Buffers a write to a scalar field
+    *
+    * @param entityId
+    * @param field
+    * @param value
+    *
+    * @throw std::invalid_argument
+    *   If \a field is not a registered scalar field
+    */
+    void
+    stageReal(
+        EntityId entityId,
+        FieldId field,
+        Ogre::Real value
+    );
+
+    /**
+    * @brief Buffers a write to a vector field
+    *
+    * @param entityId
+    * @param field
+    * @param value
+    *
+    * @throw std::invalid_argument
+    *   If \a field is not a registered vector field
+    */
+    void
+    stageVector3(
+        EntityId entityId,
+        FieldId field,
+        const Ogre::Vector3& value
+    );
+
+private:
+
+    enum class ValueType {
+        Quaternion,
+        Real,
+        Vector3
+    };
+
+    struct Value {
+
+        Ogre::Real data[4];
+
+    };
+
+    template<typename T>
+    struct ValueTraits;
+
+    using ApplyFunction = std::function<Touchable&(Component&, const Value&)>;
+
+    struct RegisteredField;
+
+    struct Write {
+
+        EntityId entityId;
+
+        FieldId field;
+
+        Value value;
+
+    };
+
+    static std::vector<RegisteredField>&
+    registeredFields();
+
+    static FieldId
+    registerFieldImpl(
+        const std::string& name,
+        ComponentTypeId componentType,
+        ValueType valueType,
+        ApplyFunction apply,
+        Touchable::FieldMask mask
+    );
+
+    void
+    stage(
+        EntityId entityId,
+        FieldId field,
+        ValueType valueType,
+        const Value& value
+    );
+
+    // Index of each (entity, field) in m_writes
+    std::unordered_map<uint64_t, size_t> m_index;
+
+    // Scratch space for flush()
+    std::vector<Write> m_flushed;
+
+    // Scratch space for flush(), the touchables of one entity
+    std::vector<std::pair<Touchable*, Touchable::FieldMask>> m_touched;
+
+    std::vector<Write> m_writes;
+
+};
+
+
+template<>
+struct StagedWrites::ValueTraits<Ogre::Real> {
+
+    static const ValueType TYPE = ValueType::Real;
+
+    static Ogre::Real
+    unpack(
+        const Value& value
+    ) {
+        return value.data[0];
+    }
+
+};
+
+
+template<>
+struct StagedWrites::ValueTraits<Ogre::Vector3> {
+
+    static const ValueType TYPE = ValueType::Vector3;
+
+    static Ogre::Vector3
+    unpack(
+        const Value& value
+    ) {
+        return Ogre::Vector3(value.data[0], value.data[1], value.data[2]);
+    }
+
+};
+
+
+template<>
+struct StagedWrites::ValueTraits<Ogre::Quaternion> {
+
+    static const ValueType TYPE = ValueType::Quaternion;
+
+    static Ogre::Quaternion
+    unpack(
+        const Value& value
+    ) {
+        return Ogre::Quaternion(value.data[0], value.data[1], value.data[2], value.data[3]);
+    }
+
+};
+
+}
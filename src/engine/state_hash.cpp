@@ -0,0 +1,511 @@
+#include "engine/state_hash.h"
+
+#include "engine/component_collection.h"
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "engine/rng.h"
+#include "scripting/luabind.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+// splitmix64's finalizer, so that similar digests and entity ids still
+// give unrelated contributions
+uint64_t
+mix(
+    uint64_t x
+) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+
+std::string
+toHex(
+    uint64_t value
+) {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+}
+
+
+// Hash files are text, after a header and the names of the hashed types:
+//
+// tick TICK TOTAL RNG TYPE_HASH...
+//
+// with all hashes in hexadecimal.
+const std::string HEADER = "thrive-state-hashes";
+
+const int VERSION = 1;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// StateDigest
+////////////////////////////////////////////////////////////////////////////////
+
+void
+StateDigest::addBytes(
+    const void* data,
+    size_t size
+) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        m_value ^= bytes[i];
+        m_value *= 0x100000001b3;
+    }
+}
+
+
+uint64_t
+StateDigest::value() const {
+    return m_value;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StateHash
+////////////////////////////////////////////////////////////////////////////////
+
+struct StateHash::Implementation {
+
+    // The digest of a change tracked component, valid while its version
+    // stays the same
+    struct CachedDigest {
+
+        const Component* m_component;
+
+        uint64_t m_contribution;
+
+        uint32_t m_version;
+
+    };
+
+    struct Type {
+
+        std::unordered_map<EntityId, CachedDigest> m_cached;
+
+        std::vector<ComponentCollection::Change> m_changes;
+
+        ComponentCollection* m_collection = nullptr;
+
+        uint64_t m_hash = 0;
+
+        unsigned int m_observer = 0;
+
+        ComponentTypeId m_typeId;
+
+    };
+
+    void
+    attach(
+        Type& type
+    ) {
+        type.m_collection = &m_entityManager->getComponentCollection(type.m_typeId);
+        type.m_observer = type.m_collection->registerObserver();
+    }
+
+    void
+    detach(
+        Type& type
+    ) {
+        type.m_collection->unregisterObserver(type.m_observer);
+        type.m_collection = nullptr;
+        type.m_cached.clear();
+        type.m_hash = 0;
+    }
+
+    void
+    updateType(
+        Type& type
+    ) {
+        // Only removals matter, added components are found below
+        type.m_collection->takeChanges(type.m_observer, type.m_changes);
+        for (const auto& change : type.m_changes) {
+            if (not change.isAdded) {
+                auto iter = type.m_cached.find(change.entityId);
+                if (iter != type.m_cached.end() and iter->second.m_component == change.component) {
+                    type.m_cached.erase(iter);
+                }
+            }
+        }
+        type.m_changes.clear();
+        const auto& components = type.m_collection->components();
+        const auto& entities = type.m_collection->entities();
+        uint64_t hash = 0;
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& component = *components[i];
+            CachedDigest* cached = nullptr;
+            if (component.isChangeTracked()) {
+                cached = &type.m_cached[entities[i]];
+                if (cached->m_component == &component and cached->m_version == component.version()) {
+                    hash += cached->m_contribution;
+                    continue;
+                }
+            }
+            StateDigest digest;
+            component.digest(digest);
+            uint64_t contribution = mix(digest.value() + mix(entities[i]));
+            if (cached) {
+                *cached = CachedDigest{&component, contribution, component.version()};
+            }
+            hash += contribution;
+        }
+        type.m_hash = hash;
+    }
+
+    EntityManager* m_entityManager = nullptr;
+
+    std::vector<Type> m_types;
+
+};
+
+
+StateHash::StateHash()
+  : m_impl(new Implementation())
+{
+}
+
+
+StateHash::~StateHash() {
+    this->setEntityManager(nullptr);
+}
+
+
+void
+StateHash::addComponentType(
+    ComponentTypeId typeId
+) {
+    Implementation::Type type;
+    type.m_typeId = typeId;
+    if (m_impl->m_entityManager) {
+        m_impl->attach(type);
+    }
+    m_impl->m_types.push_back(std::move(type));
+}
+
+
+uint64_t
+StateHash::hash() const {
+    StateDigest digest;
+    for (const auto& type : m_impl->m_types) {
+        digest.add<uint64_t>(type.m_hash);
+    }
+    return digest.value();
+}
+
+
+void
+StateHash::setEntityManager(
+    EntityManager* entityManager
+) {
+    if (m_impl->m_entityManager) {
+        for (auto& type : m_impl->m_types) {
+            m_impl->detach(type);
+        }
+    }
+    m_impl->m_entityManager = entityManager;
+    if (entityManager) {
+        for (auto& type : m_impl->m_types) {
+            m_impl->attach(type);
+        }
+    }
+}
+
+
+size_t
+StateHash::typeCount() const {
+    return m_impl->m_types.size();
+}
+
+
+uint64_t
+StateHash::typeHash(
+    size_t index
+) const {
+    return m_impl->m_types.at(index).m_hash;
+}
+
+
+void
+StateHash::update() {
+    if (not m_impl->m_entityManager) {
+        return;
+    }
+    for (auto& type : m_impl->m_types) {
+        m_impl->updateType(type);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StateHashSystem
+////////////////////////////////////////////////////////////////////////////////
+
+static std::string
+StateHashSystem_hash(
+    const StateHashSystem* self
+) {
+    return toHex(self->hash());
+}
+
+
+luabind::scope
+StateHashSystem::luaBindings() {
+    using namespace luabind;
+    return class_<StateHashSystem, System>("StateHashSystem")
+        .def(constructor<>())
+        .def("addComponentType", &StateHashSystem::addComponentType)
+        .def("divergedTick", &StateHashSystem::divergedTick)
+        .def("hash", &StateHashSystem_hash)
+        .def("record", &StateHashSystem::record)
+        .def("verify", &StateHashSystem::verify)
+    ;
+}
+
+
+struct StateHashSystem::Implementation {
+
+    // Compares a tick with the next line of the verified file
+    void
+    verifyTick(
+        const std::vector<uint64_t>& parts
+    ) {
+        std::string line;
+        if (not std::getline(m_verifyStream, line)) {
+            std::cerr << "Warning: " << m_openFilename << " ends before tick "
+                << m_tick << ", state hashes are no longer verified" << std::endl;
+            m_verifyStream.close();
+            return;
+        }
+        std::istringstream stream(line);
+        std::string tag;
+        unsigned long long tick = 0;
+        stream >> tag >> tick;
+        std::vector<std::string> mismatches;
+        if (tag != "tick" or tick != m_tick) {
+            mismatches.push_back("tick");
+        }
+        for (size_t i = 0; i < parts.size(); ++i) {
+            std::string expected;
+            stream >> expected;
+            if (expected != toHex(parts[i])) {
+                mismatches.push_back(m_partNames[i]);
+            }
+        }
+        if (not mismatches.empty()) {
+            m_divergedTick = m_tick;
+            std::cerr << "Warning: State diverged from " << m_openFilename
+                << " in tick " << m_tick << ":";
+            for (const std::string& name : mismatches) {
+                std::cerr << " " << name;
+            }
+            std::cerr << std::endl;
+            // Everything after diverges as well
+            m_verifyStream.close();
+        }
+    }
+
+    unsigned long long m_divergedTick = 0;
+
+    // Set by record() or verify()
+    std::string m_filename;
+
+    std::unique_ptr<StateHash> m_hash;
+
+    bool m_isVerifying = false;
+
+    uint64_t m_lastHash = 0;
+
+    // The file actually recorded or verified, for warnings
+    std::string m_openFilename;
+
+    // "total", "rng" and the type names, in the column order of the file
+    std::vector<std::string> m_partNames;
+
+    std::ofstream m_recordStream;
+
+    const RNG* m_rng = nullptr;
+
+    unsigned long long m_tick = 0;
+
+    std::vector<std::string> m_typeNames;
+
+    std::ifstream m_verifyStream;
+
+};
+
+
+StateHashSystem::StateHashSystem()
+  : m_impl(new Implementation())
+{
+    this->setFixedRate(true);
+}
+
+
+StateHashSystem::~StateHashSystem() {}
+
+
+void
+StateHashSystem::addComponentType(
+    const std::string& typeName
+) {
+    m_impl->m_typeNames.push_back(typeName);
+}
+
+
+unsigned long long
+StateHashSystem::divergedTick() const {
+    return m_impl->m_divergedTick;
+}
+
+
+uint64_t
+StateHashSystem::hash() const {
+    return m_impl->m_lastHash;
+}
+
+
+void
+StateHashSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    Engine& engine = gameState->engine();
+    const ComponentFactory& factory = engine.componentFactory();
+    m_impl->m_hash.reset(new StateHash());
+    m_impl->m_partNames = {"total", "rng"};
+    for (const std::string& typeName : m_impl->m_typeNames) {
+        ComponentTypeId typeId = factory.getTypeId(typeName);
+        if (typeId == NULL_COMPONENT_TYPE) {
+            std::cerr << "Warning: Unknown component type " << typeName
+                << " is not state hashed" << std::endl;
+            continue;
+        }
+        m_impl->m_hash->addComponentType(typeId);
+        m_impl->m_partNames.push_back(typeName);
+    }
+    m_impl->m_hash->setEntityManager(&gameState->entityManager());
+    m_impl->m_rng = &engine.rng();
+    m_impl->m_tick = 0;
+    m_impl->m_divergedTick = 0;
+    std::string filename = m_impl->m_filename;
+    bool isVerifying = m_impl->m_isVerifying;
+    if (filename.empty() and not engine.stateHashFile().empty()) {
+        filename = engine.stateHashFile() + "." + gameState->name();
+        isVerifying = engine.isVerifyingStateHashes();
+    }
+    if (filename.empty()) {
+        return;
+    }
+    if (isVerifying) {
+        m_impl->m_verifyStream.open(filename);
+        std::string header;
+        int version = 0;
+        if (not (m_impl->m_verifyStream >> header >> version)) {
+            throw std::runtime_error("Could not open state hashes " + filename);
+        }
+        if (header != HEADER or version != VERSION) {
+            throw std::runtime_error(filename + " is not a state hash file");
+        }
+        std::string types;
+        std::string line;
+        std::getline(m_impl->m_verifyStream, line);
+        std::getline(m_impl->m_verifyStream, types);
+        std::string expectedTypes = "types";
+        for (size_t i = 2; i < m_impl->m_partNames.size(); ++i) {
+            expectedTypes += " " + m_impl->m_partNames[i];
+        }
+        if (types != expectedTypes) {
+            throw std::runtime_error(
+                filename + " hashes other component types than the " +
+                "StateHashSystem of " + gameState->name()
+            );
+        }
+    }
+    else {
+        m_impl->m_recordStream.open(filename);
+        if (not m_impl->m_recordStream) {
+            throw std::runtime_error("Could not open state hashes " + filename);
+        }
+        m_impl->m_recordStream << HEADER << " " << VERSION << "\n" << "types";
+        for (size_t i = 2; i < m_impl->m_partNames.size(); ++i) {
+            m_impl->m_recordStream << " " << m_impl->m_partNames[i];
+        }
+        m_impl->m_recordStream << "\n";
+    }
+    m_impl->m_openFilename = filename;
+}
+
+
+void
+StateHashSystem::record(
+    const std::string& filename
+) {
+    m_impl->m_filename = filename;
+    m_impl->m_isVerifying = false;
+}
+
+
+void
+StateHashSystem::shutdown() {
+    m_impl->m_hash.reset();
+    m_impl->m_recordStream.close();
+    m_impl->m_verifyStream.close();
+    m_impl->m_rng = nullptr;
+    System::shutdown();
+}
+
+
+void
+StateHashSystem::update(int) {
+    m_impl->m_tick += 1;
+    m_impl->m_hash->update();
+    StateDigest rngDigest;
+    for (uint64_t word : m_impl->m_rng->state()) {
+        rngDigest.add<uint64_t>(word);
+    }
+    std::vector<uint64_t> parts = {0, rngDigest.value()};
+    StateDigest total;
+    total.add<uint64_t>(m_impl->m_tick);
+    total.add<uint64_t>(rngDigest.value());
+    total.add<uint64_t>(m_impl->m_hash->hash());
+    for (size_t i = 0; i < m_impl->m_hash->typeCount(); ++i) {
+        parts.push_back(m_impl->m_hash->typeHash(i));
+    }
+    parts[0] = total.value();
+    m_impl->m_lastHash = total.value();
+    if (m_impl->m_recordStream.is_open()) {
+        m_impl->m_recordStream << "tick " << m_impl->m_tick;
+        for (uint64_t part : parts) {
+            m_impl->m_recordStream << " " << toHex(part);
+        }
+        // Flushed, so that a crash keeps the hashes up to it
+        m_impl->m_recordStream << std::endl;
+    }
+    else if (m_impl->m_verifyStream.is_open()) {
+        m_impl->verifyTick(parts);
+    }
+}
+
+
+void
+StateHashSystem::verify(
+    const std::string& filename
+) {
+    m_impl->m_filename = filename;
+    m_impl->m_isVerifying = true;
+}
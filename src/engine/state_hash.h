@@ -0,0 +1,304 @@
+#pragma once
+
+#include "engine/reflection.h"
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class EntityManager;
+
+/**
+* @brief A 64 bit FNV-1a hash of values added one after another
+*
+* Values are added in their binary field format (see BinaryField), so the
+* digest is the same on every platform and only depends on the bits of
+* the values, not on padding or byte order.
+*/
+class StateDigest {
+
+public:
+
+    /**
+    * @brief Adds a value
+    *
+    * @tparam T
+    *   A type with a BinaryField specialization
+    * @param value
+    *
+    * @return
+    *   This digest, for chaining
+    */
+    template<typename T>
+    StateDigest&
+    add(
+        const T& value
+    ) {
+        m_buffer.clear();
+        BinaryField<T>::write(m_buffer, value);
+        this->addBytes(m_buffer.data(), m_buffer.size());
+        return *this;
+    }
+
+    /**
+    * @brief Adds raw bytes
+    *
+    * @param data
+    * @param size
+    */
+    void
+    addBytes(
+        const void* data,
+        size_t size
+    );
+
+    /**
+    * @brief The hash of everything added so far
+    */
+    uint64_t
+    value() const;
+
+private:
+
+    std::string m_buffer;
+
+    uint64_t m_value = 0xcbf29ce484222325;
+
+};
+
+
+/**
+* @brief Keeps a hash of the components of some types up to date
+*
+* Each component contributes the digest of its state (see
+* Component::digest()), mixed with its owner's id. The contributions are
+* summed up, so the hash doesn't depend on the order of the components in
+* their collection, which changes with removals and compaction, nor on
+* which thread created or changed them.
+*
+* update() reuses the digest of a change tracked component (see
+* Component::isChangeTracked()) until its version changes. Other
+* components are digested again on every update.
+*/
+class StateHash {
+
+public:
+
+    /**
+    * @brief Constructor
+    */
+    StateHash();
+
+    /**
+    * @brief Destructor
+    */
+    ~StateHash();
+
+    /**
+    * @brief Hashes the components of a type as well
+    *
+    * @param typeId
+    */
+    void
+    addComponentType(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief The combined hash of all types, as of the last update()
+    */
+    uint64_t
+    hash() const;
+
+    /**
+    * @brief Sets the entity manager to hash
+    *
+    * @param entityManager
+    *   The entity manager, or \c nullptr to detach from the current one
+    */
+    void
+    setEntityManager(
+        EntityManager* entityManager
+    );
+
+    /**
+    * @brief The number of component types added
+    */
+    size_t
+    typeCount() const;
+
+    /**
+    * @brief The hash of one type, as of the last update()
+    *
+    * @param index
+    *   The index of the type, in the order they were added
+    */
+    uint64_t
+    typeHash(
+        size_t index
+    ) const;
+
+    /**
+    * @brief Brings the hashes up to date
+    */
+    void
+    update();
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
+/**
+* @brief Hashes the simulation state each tick to detect nondeterminism
+*
+* Each tick, the system hashes the components of the added types with a
+* StateHash and the state of the engine's RNG. Two runs that should be
+* deterministic, like a recorded session and its replay, or the same
+* replay with a different number of threads, must produce the same hash
+* for every tick. The hashes are comparable across sessions and
+* platforms as long as the entity ids and the values are the same.
+*
+* record() writes the hashes of every tick to a file and verify() compares
+* them to such a file. On the first tick that differs, a warning lists
+* which of the hashed parts diverged. Without a file of its own, the
+* system uses the one set with Engine::recordStateHashes() or
+* Engine::verifyStateHashes(), with the game state's name appended, like
+* \c hashes.txt.microbe.
+*
+* The system reads everything, so it doesn't run in parallel with any
+* other system. Add it as the last fixed-rate system.
+*/
+class StateHashSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - StateHashSystem()
+    * - StateHashSystem::addComponentType
+    * - StateHashSystem::divergedTick
+    * - StateHashSystem::hash (as hexadecimal string)
+    * - StateHashSystem::record
+    * - StateHashSystem::verify
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    StateHashSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~StateHashSystem();
+
+    /**
+    * @brief Hashes the components of a type as well
+    *
+    * @param typeName
+    *   The component type name, as registered with the ComponentFactory
+    */
+    void
+    addComponentType(
+        const std::string& typeName
+    );
+
+    /**
+    * @brief The first tick whose hash differed from the verified file
+    *
+    * @return
+    *   \c 0 if no tick differed so far
+    */
+    unsigned long long
+    divergedTick() const;
+
+    /**
+    * @brief The hash of the last tick
+    */
+    uint64_t
+    hash() const;
+
+    /**
+    * @brief Initializes the system
+    *
+    * Opens the file to record or verify, if any.
+    *
+    * @param gameState
+    *
+    * @throw std::runtime_error
+    *   If the file can't be opened
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Writes the hash of each tick to a file
+    *
+    * Takes effect on the next init().
+    *
+    * @param filename
+    *   The file to write, replaced if it exists
+    */
+    void
+    record(
+        const std::string& filename
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Hashes the current tick
+    *
+    * @param milliseconds
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+    /**
+    * @brief Compares the hash of each tick to a file written by record()
+    *
+    * Takes effect on the next init().
+    *
+    * @param filename
+    *   The file to compare with
+    */
+    void
+    verify(
+        const std::string& filename
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,436 @@
+#include "engine/statistics.h"
+
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <boost/thread/lock_guard.hpp>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Recent samples kept per histogram
+const size_t HISTOGRAM_SAMPLES = 256;
+
+// Milliseconds over which the counter rates are measured
+const unsigned int RATE_INTERVAL = 1000;
+
+template<typename T>
+T*
+find(
+    const std::map<std::string, std::unique_ptr<T>>& map,
+    const std::string& name
+) {
+    auto iter = map.find(name);
+    return iter == map.end() ? nullptr : iter->second.get();
+}
+
+template<typename T>
+T&
+findOrCreate(
+    std::map<std::string, std::unique_ptr<T>>& map,
+    const std::string& name
+) {
+    std::unique_ptr<T>& entry = map[name];
+    if (not entry) {
+        entry.reset(new T());
+    }
+    return *entry;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics::Counter
+////////////////////////////////////////////////////////////////////////////////
+
+double
+Statistics::Counter::rate() const {
+    return m_rate.load(std::memory_order_relaxed);
+}
+
+
+uint64_t
+Statistics::Counter::total() const {
+    return m_total.load(std::memory_order_relaxed);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics::Gauge
+////////////////////////////////////////////////////////////////////////////////
+
+double
+Statistics::Gauge::value() const {
+    return m_value.load(std::memory_order_relaxed);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics::Histogram
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t
+Statistics::Histogram::count() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_count;
+}
+
+
+double
+Statistics::Histogram::max() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_max;
+}
+
+
+double
+Statistics::Histogram::mean() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_count == 0 ? 0.0 : m_sum / m_count;
+}
+
+
+double
+Statistics::Histogram::percentile(
+    double percentile
+) const {
+    std::vector<double> samples;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        samples = m_samples;
+    }
+    if (samples.empty()) {
+        return 0.0;
+    }
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    size_t index = static_cast<size_t>(percentile / 100.0 * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+
+void
+Statistics::Histogram::record(
+    double value
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_count == 0 or value > m_max) {
+        m_max = value;
+    }
+    m_count += 1;
+    m_sum += value;
+    if (m_samples.size() < HISTOGRAM_SAMPLES) {
+        m_samples.push_back(value);
+    }
+    else {
+        m_samples[m_nextSample] = value;
+        m_nextSample = (m_nextSample + 1) % HISTOGRAM_SAMPLES;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics::Timer
+////////////////////////////////////////////////////////////////////////////////
+
+Statistics::Timer::Timer(
+    Histogram* histogram
+) : m_histogram(histogram),
+    m_start(boost::chrono::steady_clock::now())
+{
+}
+
+
+Statistics::Timer::~Timer() {
+    if (m_histogram) {
+        using namespace boost::chrono;
+        m_histogram->record(
+            duration_cast<duration<double, boost::milli>>(steady_clock::now() - m_start).count()
+        );
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+Statistics::luaBindings() {
+    using namespace luabind;
+    return class_<Statistics>("Statistics")
+        .def("add", &Statistics::add)
+        .def("counterRate", &Statistics::counterRate)
+        .def("counterTotal", &Statistics::counterTotal)
+        .def("gaugeValue", &Statistics::gaugeValue)
+        .def("histogramMax", &Statistics::histogramMax)
+        .def("histogramMean", &Statistics::histogramMean)
+        .def("histogramPercentile", &Statistics::histogramPercentile)
+        .def("record", &Statistics::record)
+        .def("report", &Statistics::report)
+        .def("set", &Statistics::set)
+        .def("setDumpFile", &Statistics::setDumpFile)
+    ;
+}
+
+
+Statistics::Statistics() {}
+
+
+Statistics::~Statistics() {}
+
+
+void
+Statistics::add(
+    const std::string& name,
+    uint64_t amount
+) {
+    this->counter(name).add(amount);
+}
+
+
+Statistics::Counter&
+Statistics::counter(
+    const std::string& name
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return findOrCreate(m_counters, name);
+}
+
+
+double
+Statistics::counterRate(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Counter* counter = find(m_counters, name);
+    return counter ? counter->rate() : 0.0;
+}
+
+
+uint64_t
+Statistics::counterTotal(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Counter* counter = find(m_counters, name);
+    return counter ? counter->total() : 0;
+}
+
+
+void
+Statistics::dump() {
+    for (const auto& pair : m_counters) {
+        m_dumpFile << m_elapsed << "\tcounter\t" << pair.first << "\t"
+            << pair.second->total() << "\t" << pair.second->rate() << "\n";
+    }
+    for (const auto& pair : m_gauges) {
+        m_dumpFile << m_elapsed << "\tgauge\t" << pair.first << "\t"
+            << pair.second->value() << "\n";
+    }
+    for (const auto& pair : m_histograms) {
+        const Histogram& histogram = *pair.second;
+        m_dumpFile << m_elapsed << "\thistogram\t" << pair.first << "\t"
+            << histogram.count() << "\t"
+            << histogram.mean() << "\t"
+            << histogram.percentile(50) << "\t"
+            << histogram.percentile(95) << "\t"
+            << histogram.max() << "\n";
+    }
+    m_dumpFile.flush();
+}
+
+
+Statistics::Gauge&
+Statistics::gauge(
+    const std::string& name
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return findOrCreate(m_gauges, name);
+}
+
+
+double
+Statistics::gaugeValue(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Gauge* gauge = find(m_gauges, name);
+    return gauge ? gauge->value() : 0.0;
+}
+
+
+Statistics::Histogram&
+Statistics::histogram(
+    const std::string& name
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return findOrCreate(m_histograms, name);
+}
+
+
+double
+Statistics::histogramMax(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Histogram* histogram = find(m_histograms, name);
+    return histogram ? histogram->max() : 0.0;
+}
+
+
+double
+Statistics::histogramMean(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Histogram* histogram = find(m_histograms, name);
+    return histogram ? histogram->mean() : 0.0;
+}
+
+
+double
+Statistics::histogramPercentile(
+    const std::string& name,
+    double percentile
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const Histogram* histogram = find(m_histograms, name);
+    return histogram ? histogram->percentile(percentile) : 0.0;
+}
+
+
+void
+Statistics::record(
+    const std::string& name,
+    double value
+) {
+    this->histogram(name).record(value);
+}
+
+
+std::string
+Statistics::report() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    for (const auto& pair : m_counters) {
+        stream << pair.first << ": " << pair.second->total()
+            << " (" << pair.second->rate() << "/s)\n";
+    }
+    for (const auto& pair : m_gauges) {
+        stream << pair.first << ": " << pair.second->value() << "\n";
+    }
+    stream << std::setprecision(2);
+    for (const auto& pair : m_histograms) {
+        const Histogram& histogram = *pair.second;
+        stream << pair.first << ": mean " << histogram.mean()
+            << ", p95 " << histogram.percentile(95)
+            << ", max " << histogram.max()
+            << " (" << histogram.count() << ")\n";
+    }
+    return stream.str();
+}
+
+
+void
+Statistics::set(
+    const std::string& name,
+    double value
+) {
+    this->gauge(name).set(value);
+}
+
+
+void
+Statistics::setDumpFile(
+    const std::string& filename,
+    unsigned int interval
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_dumpFile.is_open()) {
+        m_dumpFile.close();
+    }
+    m_dumpInterval = 0;
+    if (filename.empty()) {
+        return;
+    }
+    m_dumpFile.clear();
+    m_dumpFile.open(filename, std::ios::app);
+    if (not m_dumpFile) {
+        throw std::runtime_error("Could not open statistics file " + filename);
+    }
+    m_dumpInterval = std::max(interval, 1u);
+    m_dumpTime = 0;
+    m_elapsed = 0;
+}
+
+
+void
+Statistics::update(
+    int milliseconds
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    milliseconds = std::max(milliseconds, 0);
+    m_rateTime += milliseconds;
+    if (m_rateTime >= RATE_INTERVAL) {
+        for (const auto& pair : m_counters) {
+            Counter& counter = *pair.second;
+            uint64_t total = counter.total();
+            counter.m_rate.store(
+                (total - counter.m_lastTotal) * 1000.0 / m_rateTime,
+                std::memory_order_relaxed
+            );
+            counter.m_lastTotal = total;
+        }
+        m_rateTime = 0;
+    }
+    if (m_dumpInterval > 0) {
+        m_elapsed += milliseconds;
+        m_dumpTime += milliseconds;
+        if (m_dumpTime >= m_dumpInterval) {
+            m_dumpTime = 0;
+            this->dump();
+        }
+    }
+}
+
+
+void
+Statistics::writeJson(
+    JsonWriter& writer
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    writer.beginObject();
+    writer.key("counters").beginObject();
+    for (const auto& pair : m_counters) {
+        writer.key(pair.first).beginObject();
+        writer.key("total").value(pair.second->total());
+        writer.key("rate").value(pair.second->rate());
+        writer.endObject();
+    }
+    writer.endObject();
+    writer.key("gauges").beginObject();
+    for (const auto& pair : m_gauges) {
+        writer.key(pair.first).value(pair.second->value());
+    }
+    writer.endObject();
+    writer.key("histograms").beginObject();
+    for (const auto& pair : m_histograms) {
+        const Histogram& histogram = *pair.second;
+        writer.key(pair.first).beginObject();
+        writer.key("count").value(histogram.count());
+        writer.key("mean").value(histogram.mean());
+        writer.key("p50").value(histogram.percentile(50));
+        writer.key("p95").value(histogram.percentile(95));
+        writer.key("max").value(histogram.max());
+        writer.endObject();
+    }
+    writer.endObject();
+    writer.endObject();
+}
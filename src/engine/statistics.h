@@ -0,0 +1,437 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class JsonWriter;
+
+/**
+* @brief A registry of named runtime statistics
+*
+* Subsystems publish into three kinds of statistics:
+* - \b Counters count events, like emitted agents. Their rate per second is
+*   updated once per second.
+* - \b Gauges hold the latest value of a quantity, like the number of live
+*   entities.
+* - \b Histograms collect samples, like the duration of garbage collector
+*   steps, and summarize the most recent ones.
+*
+* C++ code should look a statistic up once and keep the reference, which
+* stays valid for the registry's lifetime. Updating a counter or gauge is
+* then a single atomic operation.
+*
+* The Engine calls update() once per frame. With a dump file set, the
+* statistics are appended to it periodically, so that they can be
+* correlated with frame drops after the fact.
+*
+* All methods are thread safe.
+*/
+class Statistics {
+
+public:
+
+    /**
+    * @brief Counts events
+    */
+    class Counter {
+
+    public:
+
+        /**
+        * @brief Counts \a amount events
+        */
+        void
+        add(
+            uint64_t amount = 1
+        ) {
+            m_total.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        /**
+        * @brief Events per second during the last full second
+        */
+        double
+        rate() const;
+
+        /**
+        * @brief Events counted since the registry was created
+        */
+        uint64_t
+        total() const;
+
+    private:
+
+        friend class Statistics;
+
+        // Guarded by the registry's mutex
+        uint64_t m_lastTotal = 0;
+
+        std::atomic<double> m_rate{0.0};
+
+        std::atomic<uint64_t> m_total{0};
+
+    };
+
+    /**
+    * @brief Holds the latest value of a quantity
+    */
+    class Gauge {
+
+    public:
+
+        /**
+        * @brief Sets the value
+        */
+        void
+        set(
+            double value
+        ) {
+            m_value.store(value, std::memory_order_relaxed);
+        }
+
+        /**
+        * @brief The latest value
+        */
+        double
+        value() const;
+
+    private:
+
+        std::atomic<double> m_value{0.0};
+
+    };
+
+    /**
+    * @brief Collects samples
+    *
+    * Keeps the count, sum and maximum of all samples and the most recent
+    * samples for percentiles.
+    */
+    class Histogram {
+
+    public:
+
+        /**
+        * @brief Adds a sample
+        */
+        void
+        record(
+            double value
+        );
+
+        /**
+        * @brief Number of samples since the registry was created
+        */
+        uint64_t
+        count() const;
+
+        /**
+        * @brief The largest sample, or \c 0 without samples
+        */
+        double
+        max() const;
+
+        /**
+        * @brief The mean of all samples, or \c 0 without samples
+        */
+        double
+        mean() const;
+
+        /**
+        * @brief A percentile of the recent samples
+        *
+        * @param percentile
+        *   Between \c 0 and \c 100
+        *
+        * @return
+        *   The sample below which \a percentile percent of the recent samples
+        *   lie, or \c 0 without samples
+        */
+        double
+        percentile(
+            double percentile
+        ) const;
+
+    private:
+
+        uint64_t m_count = 0;
+
+        double m_max = 0.0;
+
+        mutable boost::mutex m_mutex;
+
+        size_t m_nextSample = 0;
+
+        // Ring buffer of the most recent samples
+        std::vector<double> m_samples;
+
+        double m_sum = 0.0;
+
+    };
+
+    /**
+    * @brief Records the time from its construction to its destruction in a
+    * histogram, in milliseconds
+    */
+    class Timer {
+
+    public:
+
+        /**
+        * @brief Constructor
+        *
+        * @param histogram
+        *   The histogram to record into. Does nothing if \c null.
+        */
+        explicit Timer(
+            Histogram* histogram
+        );
+
+        /**
+        * @brief Destructor
+        *
+        * Records the elapsed time
+        */
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+
+        Timer& operator= (const Timer&) = delete;
+
+    private:
+
+        Histogram* m_histogram;
+
+        boost::chrono::steady_clock::time_point m_start;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - Statistics::add(name, amount)
+    * - Statistics::set(name, value)
+    * - Statistics::record(name, value)
+    * - Statistics::counterTotal(name)
+    * - Statistics::counterRate(name)
+    * - Statistics::gaugeValue(name)
+    * - Statistics::histogramMean(name)
+    * - Statistics::histogramMax(name)
+    * - Statistics::histogramPercentile(name, percentile)
+    * - Statistics::report()
+    * - Statistics::setDumpFile()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    Statistics();
+
+    /**
+    * @brief Destructor
+    */
+    ~Statistics();
+
+    Statistics(const Statistics&) = delete;
+
+    Statistics& operator= (const Statistics&) = delete;
+
+    /**
+    * @brief Adds to a counter, creating it if necessary
+    */
+    void
+    add(
+        const std::string& name,
+        uint64_t amount
+    );
+
+    /**
+    * @brief Returns a counter, creating it if necessary
+    */
+    Counter&
+    counter(
+        const std::string& name
+    );
+
+    /**
+    * @brief The rate of a counter, or \c 0 if there is no such counter
+    */
+    double
+    counterRate(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief The total of a counter, or \c 0 if there is no such counter
+    */
+    uint64_t
+    counterTotal(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Returns a gauge, creating it if necessary
+    */
+    Gauge&
+    gauge(
+        const std::string& name
+    );
+
+    /**
+    * @brief The value of a gauge, or \c 0 if there is no such gauge
+    */
+    double
+    gaugeValue(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Returns a histogram, creating it if necessary
+    */
+    Histogram&
+    histogram(
+        const std::string& name
+    );
+
+    /**
+    * @brief The largest sample of a histogram, or \c 0 if there is no such
+    * histogram
+    */
+    double
+    histogramMax(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief The mean of a histogram, or \c 0 if there is no such histogram
+    */
+    double
+    histogramMean(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief A percentile of a histogram's recent samples, or \c 0 if there
+    * is no such histogram
+    */
+    double
+    histogramPercentile(
+        const std::string& name,
+        double percentile
+    ) const;
+
+    /**
+    * @brief Adds a sample to a histogram, creating it if necessary
+    */
+    void
+    record(
+        const std::string& name,
+        double value
+    );
+
+    /**
+    * @brief Summarizes all statistics as text, one per line, sorted by name
+    */
+    std::string
+    report() const;
+
+    /**
+    * @brief Sets a gauge, creating it if necessary
+    */
+    void
+    set(
+        const std::string& name,
+        double value
+    );
+
+    /**
+    * @brief Starts or stops dumping the statistics to a file
+    *
+    * Each dump appends one tab separated line per statistic: the time in
+    * milliseconds since the dump file was set, the kind, the name and its
+    * values (total and rate for counters, the value for gauges, count,
+    * mean, median, 95th percentile and maximum for histograms).
+    *
+    * @param filename
+    *   The file to append to, or empty to stop dumping
+    * @param interval
+    *   Milliseconds between dumps
+    *
+    * @throw std::runtime_error
+    *   If the file can't be opened
+    */
+    void
+    setDumpFile(
+        const std::string& filename,
+        unsigned int interval
+    );
+
+    /**
+    * @brief Updates the counter rates and writes due dumps
+    *
+    * @param milliseconds
+    *   The time since the last update
+    */
+    void
+    update(
+        int milliseconds
+    );
+
+    /**
+    * @brief Writes all statistics as a JSON object
+    *
+    * The object holds a "counters", "gauges" and "histograms" object, each
+    * keyed by the statistics' names. Counters have a "total" and "rate",
+    * histograms a "count", "mean", "p50", "p95" and "max", like in the
+    * dump file.
+    */
+    void
+    writeJson(
+        JsonWriter& writer
+    ) const;
+
+private:
+
+    void
+    dump();
+
+    std::map<std::string, std::unique_ptr<Counter>> m_counters;
+
+    std::ofstream m_dumpFile;
+
+    unsigned int m_dumpInterval = 0;
+
+    unsigned int m_dumpTime = 0;
+
+    uint64_t m_elapsed = 0;
+
+    std::map<std::string, std::unique_ptr<Gauge>> m_gauges;
+
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+
+    mutable boost::mutex m_mutex;
+
+    unsigned int m_rateTime = 0;
+
+};
+
+}
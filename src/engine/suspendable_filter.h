@@ -0,0 +1,45 @@
+#pragma once
+
+namespace thrive {
+
+/**
+* @brief Interface of entity filters that can stop listening for a while
+*
+* A suspended filter is detached from the entity manager. It is empty and
+* costs nothing when entities are added, removed or changed. Once it is
+* resumed, it rebuilds its entities and reports the difference to what it
+* had before as changes, as if it had never been suspended.
+*
+* Systems suspend their filters while they are disabled, see
+* System::registerFilter().
+*/
+class SuspendableFilter {
+
+public:
+
+    /**
+    * @brief Destructor
+    */
+    virtual ~SuspendableFilter() = default;
+
+    /**
+    * @brief Whether the filter is suspended
+    */
+    virtual bool
+    isSuspended() const = 0;
+
+    /**
+    * @brief Suspends or resumes the filter
+    *
+    * Does nothing if the filter already is in the requested state.
+    *
+    * @param suspended
+    */
+    virtual void
+    setSuspended(
+        bool suspended
+    ) = 0;
+
+};
+
+}
@@ -2,9 +2,15 @@
 
 #include "engine/engine.h"
 #include "engine/game_state.h"
+#include "engine/suspendable_filter.h"
+#include "scripting/lua_include.h"
+#include "scripting/lua_profiler.h"
 #include "scripting/luabind.h"
+#include "scripting/script_entity_filter.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <luabind/class_info.hpp>
 
 using namespace thrive;
 
@@ -45,6 +51,12 @@ struct SystemWrapper : System, luabind::wrap_base {
     update(
         int milliseconds
     ) override {
+        lua_State* L = luabind::detail::wrap_access::ref(*this).state();
+        LuaProfiler* profiler = LuaProfiler::running(L);
+        if (profiler and m_className.empty()) {
+            m_className = this->className(L);
+        }
+        LuaProfiler::SystemScope profilerScope(profiler, m_className);
         this->call<void>("update", milliseconds);
     }
 
@@ -55,6 +67,22 @@ struct SystemWrapper : System, luabind::wrap_base {
         throw std::runtime_error("System::update has no default implementation");
     }
 
+    // The name of the Lua class, for the profiler
+    std::string
+    className(
+        lua_State* L
+    ) const {
+        const luabind::detail::weak_ref& ref = luabind::detail::wrap_access::ref(*this);
+        ref.get(L);
+        std::string name = luabind::get_class_info(
+            luabind::argument(luabind::from_stack(L, -1))
+        ).name;
+        lua_pop(L, 1);
+        return name;
+    }
+
+    std::string m_className;
+
 };
 
 /**
@@ -62,6 +90,15 @@ struct SystemWrapper : System, luabind::wrap_base {
 */
 
 
+static void
+System_registerFilter(
+    System* self,
+    ScriptEntityFilter* filter
+) {
+    self->registerFilter(filter);
+}
+
+
 luabind::scope
 System::luaBindings() {
     using namespace luabind;
@@ -69,19 +106,91 @@ System::luaBindings() {
         .def(constructor<>())
         .def("enabled", &System::enabled)
         .def("init", &System::init, &SystemWrapper::default_init)
+        .def("isFixedRate", &System::isFixedRate)
+        .def("registerFilter", &System_registerFilter)
         .def("setEnabled", &System::setEnabled)
+        .def("setFixedRate", &System::setFixedRate)
+        .def("setUpdatePhase", &System::setUpdatePhase)
+        .def("setUpdateRate", &System::setUpdateRate)
         .def("shutdown", &System::shutdown, &SystemWrapper::default_shutdown)
         .def("update", &System::update, &SystemWrapper::default_update)
+        .def("updateRate", &System::updateRate)
     ;
 }
 
 
 struct System::Implementation {
 
+    static void
+    insertType(
+        std::vector<ComponentTypeId>& types,
+        ComponentTypeId typeId
+    ) {
+        auto iter = std::lower_bound(types.begin(), types.end(), typeId);
+        if (iter == types.end() or *iter != typeId) {
+            types.insert(iter, typeId);
+        }
+    }
+
+    static bool
+    intersects(
+        const std::vector<ComponentTypeId>& a,
+        const std::vector<ComponentTypeId>& b
+    ) {
+        auto iterA = a.begin();
+        auto iterB = b.begin();
+        while (iterA != a.end() and iterB != b.end()) {
+            if (*iterA < *iterB) {
+                ++iterA;
+            }
+            else if (*iterB < *iterA) {
+                ++iterB;
+            }
+            else {
+                return true;
+            }
+        }
+        return false;
+    }
+
     bool m_enabled = true;
 
+    std::vector<SuspendableFilter*> m_filters;
+
+    std::vector<ComponentTypeId> m_bufferedReadSet;
+
     GameState* m_gameState = nullptr;
 
+    bool m_hasDeclaredAccess = false;
+
+    bool m_hasUpdatePhase = false;
+
+    bool m_isFixedRate = false;
+
+    bool m_isGraphical = false;
+
+    bool m_isIsolated = false;
+
+    bool m_isMainThreadOnly = true;
+
+    bool m_isRendering = false;
+
+    std::string m_name;
+
+    std::vector<ComponentTypeId> m_readSet;
+
+    // Time skipped since the last update
+    int m_timeSinceUpdate = 0;
+
+    // Time until the next update of a rate limited system
+    int m_timeUntilUpdate = 0;
+
+    int m_updateInterval = 0;
+
+    unsigned int m_updateRate = 0;
+
+    std::vector<ComponentTypeId> m_writeSet;
+
 };
 
 
@@ -94,6 +203,30 @@ System::System()
 System::~System() { }
 
 
+const std::vector<ComponentTypeId>&
+System::bufferedReadSet() const {
+    return m_impl->m_bufferedReadSet;
+}
+
+
+bool
+System::conflictsWith(
+    const System& other
+) const {
+    if (m_impl->m_isIsolated or other.m_impl->m_isIsolated) {
+        return false;
+    }
+    if (not m_impl->m_hasDeclaredAccess or not other.m_impl->m_hasDeclaredAccess) {
+        return true;
+    }
+    return 
+        Implementation::intersects(m_impl->m_writeSet, other.m_impl->m_writeSet) or
+        Implementation::intersects(m_impl->m_writeSet, other.m_impl->m_readSet) or
+        Implementation::intersects(m_impl->m_readSet, other.m_impl->m_writeSet)
+    ;
+}
+
+
 void
 System::activate() {
     // Nothing
@@ -106,6 +239,63 @@ System::deactivate() {
 }
 
 
+void
+System::declareGraphical() {
+    m_impl->m_isGraphical = true;
+}
+
+
+void
+System::declareIsolated() {
+    m_impl->m_hasDeclaredAccess = true;
+    m_impl->m_isIsolated = true;
+    m_impl->m_isMainThreadOnly = false;
+}
+
+
+void
+System::declareBufferedRead(
+    ComponentTypeId typeId
+) {
+    if (not m_impl->m_hasDeclaredAccess) {
+        m_impl->m_hasDeclaredAccess = true;
+        m_impl->m_isMainThreadOnly = false;
+    }
+    Implementation::insertType(m_impl->m_bufferedReadSet, typeId);
+}
+
+
+void
+System::declareRead(
+    ComponentTypeId typeId
+) {
+    if (not m_impl->m_hasDeclaredAccess) {
+        m_impl->m_hasDeclaredAccess = true;
+        m_impl->m_isMainThreadOnly = false;
+    }
+    Implementation::insertType(m_impl->m_readSet, typeId);
+}
+
+
+void
+System::declareRendering() {
+    m_impl->m_isGraphical = true;
+    m_impl->m_isRendering = true;
+}
+
+
+void
+System::declareWrite(
+    ComponentTypeId typeId
+) {
+    if (not m_impl->m_hasDeclaredAccess) {
+        m_impl->m_hasDeclaredAccess = true;
+        m_impl->m_isMainThreadOnly = false;
+    }
+    Implementation::insertType(m_impl->m_writeSet, typeId);
+}
+
+
 bool
 System::enabled() const {
     return m_impl->m_enabled;
@@ -140,6 +330,18 @@ System::gameState() const {
 }
 
 
+bool
+System::hasDeclaredAccess() const {
+    return m_impl->m_hasDeclaredAccess;
+}
+
+
+bool
+System::hasUpdatePhase() const {
+    return m_impl->m_hasUpdatePhase;
+}
+
+
 void
 System::init(
     GameState* gameState
@@ -149,17 +351,168 @@ System::init(
 }
 
 
+bool
+System::isFixedRate() const {
+    return m_impl->m_isFixedRate;
+}
+
+
+bool
+System::isGraphical() const {
+    return m_impl->m_isGraphical;
+}
+
+
+bool
+System::isMainThreadOnly() const {
+    return m_impl->m_isMainThreadOnly;
+}
+
+
+bool
+System::isRendering() const {
+    return m_impl->m_isRendering;
+}
+
+
+const std::string&
+System::name() const {
+    return m_impl->m_name;
+}
+
+
+const std::vector<ComponentTypeId>&
+System::readSet() const {
+    return m_impl->m_readSet;
+}
+
+
+void
+System::registerFilter(
+    SuspendableFilter* filter
+) {
+    m_impl->m_filters.push_back(filter);
+    filter->setSuspended(not m_impl->m_enabled);
+}
+
+
+void
+System::resume() {
+    this->activate();
+}
+
+
 void
 System::setEnabled(
     bool enabled
 ) {
     m_impl->m_enabled = enabled;
+    for (SuspendableFilter* filter : m_impl->m_filters) {
+        filter->setSuspended(not enabled);
+    }
+}
+
+
+void
+System::setFixedRate(
+    bool isFixedRate
+) {
+    m_impl->m_isFixedRate = isFixedRate;
+}
+
+
+void
+System::setName(
+    std::string name
+) {
+    m_impl->m_name = std::move(name);
+}
+
+
+void
+System::setMainThreadOnly() {
+    m_impl->m_hasDeclaredAccess = true;
+    m_impl->m_isMainThreadOnly = true;
+}
+
+
+void
+System::setUpdatePhase(
+    int phase
+) {
+    m_impl->m_hasUpdatePhase = true;
+    m_impl->m_timeUntilUpdate = std::max(0, std::min(phase, m_impl->m_updateInterval));
 }
 
 
+void
+System::setUpdateRate(
+    unsigned int rate
+) {
+    m_impl->m_updateRate = rate;
+    m_impl->m_updateInterval = rate > 0 ? std::max(1u, 1000 / rate) : 0;
+    m_impl->m_timeUntilUpdate = 0;
+    m_impl->m_hasUpdatePhase = false;
+}
+
 
 void
 System::shutdown() {
     m_impl->m_gameState = nullptr;
 }
 
+
+std::vector<System*>
+System::stages() const {
+    return std::vector<System*>();
+}
+
+
+void
+System::suspend() {
+    this->deactivate();
+}
+
+
+bool
+System::takeUpdateTime(
+    int milliseconds,
+    int& elapsed
+) {
+    if (m_impl->m_updateInterval == 0) {
+        elapsed = milliseconds;
+        return true;
+    }
+    m_impl->m_timeSinceUpdate += milliseconds;
+    m_impl->m_timeUntilUpdate -= milliseconds;
+    if (m_impl->m_timeUntilUpdate > 0) {
+        return false;
+    }
+    elapsed = m_impl->m_timeSinceUpdate;
+    m_impl->m_timeSinceUpdate = 0;
+    m_impl->m_timeUntilUpdate += m_impl->m_updateInterval;
+    if (m_impl->m_timeUntilUpdate <= 0) {
+        // Missed updates are not caught up
+        m_impl->m_timeUntilUpdate = m_impl->m_updateInterval;
+    }
+    return true;
+}
+
+
+int
+System::updateInterval() const {
+    return m_impl->m_updateInterval;
+}
+
+
+unsigned int
+System::updateRate() const {
+    return m_impl->m_updateRate;
+}
+
+
+const std::vector<ComponentTypeId>&
+System::writeSet() const {
+    return m_impl->m_writeSet;
+}
+
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "engine/typedefs.h"
+
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace luabind {
 class scope;
@@ -11,6 +15,7 @@ namespace thrive {
 class Engine;
 class EntityManager;
 class GameState;
+class SuspendableFilter;
 
 /**
 * @brief A system handles one specific part of the game
@@ -18,6 +23,24 @@ class GameState;
 * Systems can operate on entities and their components, but they can also 
 * handle tasks that don't require components at all, such as issuing a render
 * call to the graphics engine.
+*
+* By default, a system is updated exclusively on the main thread. A system 
+* that declares which component types its update() reads and writes (see 
+* declareRead() and declareWrite()) may instead run in parallel with other 
+* systems that don't touch the same components. Such a system must not:
+* - touch any component type it hasn't declared,
+* - change the entity structure directly, use EntityManager::removeEntity(),
+*   EntityManager::deferAddComponent() etc. instead,
+* - use other shared state such as the Lua state or the random number 
+*   generator, unless it also calls setMainThreadOnly() and the state is 
+*   only used from the main thread.
+*
+* A system that touches neither components nor shared state can call
+* declareIsolated() to run in parallel with any other system.
+*
+* A system that only reads last frame's values of a component type, kept
+* in DoubleBuffer members, declares that with declareBufferedRead() and
+* runs in parallel with the systems writing the type.
 */
 class System {
 
@@ -29,6 +52,12 @@ public:
     * Exposes:
     * - System::active
     * - System::setActive
+    * - System::isFixedRate
+    * - System::registerFilter (for script entity filters)
+    * - System::setFixedRate
+    * - System::setUpdatePhase
+    * - System::setUpdateRate
+    * - System::updateRate
     *
     * @return 
     */
@@ -45,6 +74,21 @@ public:
     */
     virtual ~System() = 0;
 
+    /**
+    * @brief Checks whether two systems can't be updated at the same time
+    *
+    * Two systems conflict if either of them hasn't declared its component 
+    * access or if one of them writes a component type the other one reads 
+    * or writes. Isolated systems (see declareIsolated()) never conflict.
+    *
+    * @param other
+    *   The system to check against
+    */
+    bool
+    conflictsWith(
+        const System& other
+    ) const;
+
     /**
     * @brief Called by GameState::activate()
     *
@@ -63,6 +107,36 @@ public:
     virtual void
     deactivate();
 
+    /**
+    * @brief Called by GameState::activate() instead of activate() when the 
+    * game state was suspended
+    *
+    * The default calls activate().
+    */
+    virtual void
+    resume();
+
+    /**
+    * @brief Called by GameState::suspend() for game states that stay 
+    * resident
+    *
+    * Override this to hide resources that are expensive to recreate 
+    * instead of releasing them. A suspended system is later either resumed
+    * or deactivated. The default calls deactivate(), so deactivate() must 
+    * cope with being called twice in a row.
+    */
+    virtual void
+    suspend();
+
+    /**
+    * @brief Whether this system has declared its component access
+    *
+    * Systems without declarations are never run in parallel with other
+    * systems.
+    */
+    bool
+    hasDeclaredAccess() const;
+
     /**
     * @brief Whether this system is enabled
     *
@@ -113,10 +187,92 @@ public:
         GameState* gameState
     );
 
+    /**
+    * @brief Whether this system needs Ogre
+    *
+    * @see declareGraphical()
+    */
+    bool
+    isGraphical() const;
+
+    /**
+    * @brief Whether this system is updated at the game state's tick rate
+    *
+    * @see setFixedRate()
+    */
+    bool
+    isFixedRate() const;
+
+    /**
+    * @brief Whether update() has to be called on the main thread
+    *
+    * This is always \c true for systems without declared component access.
+    */
+    bool
+    isMainThreadOnly() const;
+
+    /**
+    * @brief Whether this system renders the frame
+    *
+    * @see declareRendering()
+    */
+    bool
+    isRendering() const;
+
+    /**
+    * @brief The name the system is reported under, e.g. by the
+    * SystemProfiler
+    *
+    * Systems created from Lua are named after their class. Empty by
+    * default.
+    */
+    const std::string&
+    name() const;
+
+    /**
+    * @brief The component types whose DoubleBuffer members this system
+    * reads, sorted
+    */
+    const std::vector<ComponentTypeId>&
+    bufferedReadSet() const;
+
+    /**
+    * @brief The component types this system reads, sorted
+    */
+    const std::vector<ComponentTypeId>&
+    readSet() const;
+
+    /**
+    * @brief The systems updated as part of this one
+    *
+    * GameState::findSystem() searches them, too. Empty except for a
+    * SystemPipeline.
+    */
+    virtual std::vector<System*>
+    stages() const;
+
+    /**
+    * @brief Suspends an entity filter while this system is disabled
+    *
+    * Without this, a disabled system's filters keep following every 
+    * change to the entities and pile up changes that are never taken. 
+    * A registered filter is detached while the system is disabled and 
+    * catches up once it is enabled again.
+    *
+    * @param filter
+    *   The filter, usually a member of the system. It must not be 
+    *   destroyed before the system.
+    */
+    void
+    registerFilter(
+        SuspendableFilter* filter
+    );
+
     /**
     * @brief Sets the enabled status of this system
     *
-    * Disabled systems are not updated
+    * Disabled systems are not updated and their registered filters are
+    * suspended, see registerFilter().
     *
     * @param enabled
     */
@@ -125,6 +281,70 @@ public:
         bool enabled
     );
 
+    /**
+    * @brief Sets whether this system is part of the fixed-rate simulation
+    *
+    * If the game state has a tick rate (see GameState::setTickRate()), 
+    * fixed-rate systems are updated zero or more times per frame, each time
+    * with the fixed tick duration. All other systems are updated once per 
+    * frame afterwards. Without a tick rate, this flag has no effect.
+    *
+    * Systems are not fixed-rate by default.
+    *
+    * @param isFixedRate
+    */
+    void
+    setFixedRate(
+        bool isFixedRate
+    );
+
+    /**
+    * @brief Sets the system's name
+    *
+    * @param name
+    *
+    * @see name()
+    */
+    void
+    setName(
+        std::string name
+    );
+
+    /**
+    * @brief Delays the system's updates
+    *
+    * Systems with the same update rate would otherwise all be updated in
+    * the same frames. Unless set, GameState::init() spreads the phases of
+    * all rate limited systems over their interval.
+    *
+    * Call it after setUpdateRate(), which resets the phase.
+    *
+    * @param phase
+    *   Milliseconds the first update is delayed by, clamped to the 
+    *   update interval
+    */
+    void
+    setUpdatePhase(
+        int phase
+    );
+
+    /**
+    * @brief Limits how often the system is updated
+    *
+    * A rate limited system skips updates until its interval has passed.
+    * When it is updated, it gets all the time skipped since its last 
+    * update. After a long frame, the time is delivered in one update, the
+    * missed ones are not caught up.
+    *
+    * @param rate
+    *   Updates per second, \c 0 to update the system every time, which is
+    *   the default
+    */
+    void
+    setUpdateRate(
+        unsigned int rate
+    );
+
     /**
     * @brief Shuts the system down
     *
@@ -135,6 +355,23 @@ public:
     virtual void
     shutdown();
 
+    /**
+    * @brief Accumulates time and decides whether to update the system
+    *
+    * Called by the SystemScheduler for each enabled system, which updates
+    * it with \a elapsed if this returns \c true.
+    *
+    * @param milliseconds
+    *   The time to advance by
+    * @param elapsed
+    *   Set to the time since the last update
+    */
+    bool
+    takeUpdateTime(
+        int milliseconds,
+        int& elapsed
+    );
+
     /**
     * @brief Updates the system
     *
@@ -152,6 +389,124 @@ public:
         int milliSeconds
     ) = 0;
 
+    /**
+    * @brief Whether setUpdatePhase() was called
+    */
+    bool
+    hasUpdatePhase() const;
+
+    /**
+    * @brief Milliseconds between two updates, \c 0 if not rate limited
+    */
+    int
+    updateInterval() const;
+
+    /**
+    * @brief Updates per second, \c 0 if not rate limited
+    *
+    * @see setUpdateRate()
+    */
+    unsigned int
+    updateRate() const;
+
+    /**
+    * @brief The component types this system writes, sorted
+    */
+    const std::vector<ComponentTypeId>&
+    writeSet() const;
+
+protected:
+
+    /**
+    * @brief Declares that update() reads only the DoubleBuffer members of
+    * a component type
+    *
+    * The buffers don't change while systems are updated, so this doesn't
+    * conflict with systems that write the type. Declare a regular read as
+    * well if update() reads other members.
+    *
+    * @param typeId
+    *   The component type, registered with DoubleBuffers
+    */
+    void
+    declareBufferedRead(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Declares that update() reads components of a type
+    *
+    * Call this in the constructor for each relevant component type. 
+    *
+    * @param typeId
+    *   The component type
+    */
+    void
+    declareRead(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Declares that update() modifies components of a type
+    *
+    * Writing a component type implies reading it.
+    *
+    * @param typeId
+    *   The component type
+    */
+    void
+    declareWrite(
+        ComponentTypeId typeId
+    );
+
+    /**
+    * @brief Declares that update() touches no components or shared state
+    *
+    * The system then never conflicts with other systems, not even those
+    * without declared component access, and runs on any thread. It must
+    * only exchange data with other systems through thread safe channels.
+    */
+    void
+    declareIsolated();
+
+    /**
+    * @brief Declares that the system needs the Ogre scene or render window
+    *
+    * Graphical systems are neither initialized nor updated in headless
+    * engines (see Engine::isHeadless()). The simulation must not depend on
+    * them. Rendering systems (see declareRendering()) are graphical.
+    */
+    void
+    declareGraphical();
+
+    /**
+    * @brief Declares that update() renders the frame from the Ogre scene
+    *
+    * In game states with pipelined rendering (see 
+    * GameState::Options::pipelinedRendering), rendering systems are 
+    * updated after all other per-frame systems, while the fixed-rate
+    * systems simulate the ticks of the next frame. Rendering systems must 
+    * only read the Ogre scene, not components.
+    *
+    * Rendering systems should not declare any component access, so that 
+    * they run on the main thread and after all systems before them.
+    *
+    * Implies declareGraphical().
+    */
+    void
+    declareRendering();
+
+    /**
+    * @brief Keeps this system on the main thread
+    *
+    * Needed for systems that call into Ogre, Bullet or other libraries that
+    * are not thread safe. The system may still run while a worker thread 
+    * updates a non-conflicting system. Implies declared component access,
+    * so call declareRead() and declareWrite() as well.
+    */
+    void
+    setMainThreadOnly();
+
 private:
 
     struct Implementation;
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "engine/engine.h"
+#include "engine/game_state.h"
+#include "engine/system.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace thrive {
+
+namespace detail {
+
+/**
+* @brief Holds the stages of a SystemPipeline by value
+*
+* Each operation calls the first stage's member function by its qualified
+* name, so it's dispatched statically, and recurses into the rest.
+*/
+template<typename... Stages>
+class PipelineStages;
+
+
+template<>
+class PipelineStages<> {
+
+public:
+
+    void activate() {}
+
+    void collect(std::vector<System*>&) {}
+
+    void deactivate() {}
+
+    void init(GameState*, bool) {}
+
+    void resume() {}
+
+    void shutdown() {}
+
+    void suspend() {}
+
+    void update(int) {}
+
+};
+
+
+template<typename First, typename... Rest>
+class PipelineStages<First, Rest...> {
+
+public:
+
+    void
+    activate() {
+        if (m_isActive) {
+            m_first.First::activate();
+        }
+        m_rest.activate();
+    }
+
+    void
+    collect(
+        std::vector<System*>& stages
+    ) {
+        stages.push_back(&m_first);
+        m_rest.collect(stages);
+    }
+
+    void
+    deactivate() {
+        m_rest.deactivate();
+        if (m_isActive) {
+            m_first.First::deactivate();
+        }
+    }
+
+    void
+    init(
+        GameState* gameState,
+        bool isHeadless
+    ) {
+        m_isActive = not (m_first.isGraphical() and isHeadless);
+        if (m_isActive) {
+            m_first.First::init(gameState);
+        }
+        m_rest.init(gameState, isHeadless);
+    }
+
+    void
+    resume() {
+        if (m_isActive) {
+            m_first.First::resume();
+        }
+        m_rest.resume();
+    }
+
+    void
+    shutdown() {
+        m_rest.shutdown();
+        if (m_isActive) {
+            m_first.First::shutdown();
+        }
+        m_isActive = false;
+    }
+
+    void
+    suspend() {
+        m_rest.suspend();
+        if (m_isActive) {
+            m_first.First::suspend();
+        }
+    }
+
+    void
+    update(
+        int milliseconds
+    ) {
+        if (m_isActive and m_first.enabled()) {
+            m_first.First::update(milliseconds);
+        }
+        m_rest.update(milliseconds);
+    }
+
+    First m_first;
+
+    // Graphical stages are left out of headless engines
+    bool m_isActive = true;
+
+    PipelineStages<Rest...> m_rest;
+
+};
+
+}
+
+
+/**
+* @brief Updates a fixed chain of C++ systems as a single system
+*
+* The game state updates its systems one by one through virtual calls,
+* scheduling and profiling each of them. Systems that always run back to
+* back, like the rigid body input, physics step, rigid body output and
+* transform copy, can instead be composed at compile time:
+* \code
+* using PhysicsPipeline = SystemPipeline<
+*     RigidBodyInputSystem,
+*     UpdatePhysicsSystem,
+*     RigidBodyOutputSystem,
+*     BulletToOgreSystem
+* >;
+* \endcode
+* The pipeline owns its stages, default constructs them and forwards
+* init(), update() and the other calls to them in order, shutdown() and
+* deactivation in reverse order. The scheduler and the SystemProfiler see
+* only the pipeline.
+*
+* The pipeline declares the union of its stages' component access, or no
+* access if one of them hasn't declared any. It keeps to the main thread
+* if any stage does. It is fixed-rate if its stages are, mixing rates
+* isn't supported. Update rates and phases of the stages are ignored, set
+* them on the pipeline. Stages that are disabled are skipped. Graphical
+* stages are left out in headless engines.
+*
+* GameState::findSystem() finds the stages, so they can still find each
+* other. Stages that hand work to the systems after them, like the
+* UpdatePhysicsSystem with GameState::Options::asyncPhysics, lose the
+* overlap, as nothing runs between the stages.
+*
+* @tparam Stages
+*   The systems, in update order. Rendering systems are not allowed.
+*/
+template<typename... Stages>
+class SystemPipeline : public System {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @throw std::invalid_argument
+    *   If the stages have different fixed-rate settings or one of them
+    *   renders
+    */
+    SystemPipeline() {
+        std::vector<System*> stages = this->stages();
+        bool hasDeclaredAccess = true;
+        bool isFixedRate = stages.front()->isFixedRate();
+        bool isGraphical = true;
+        bool isMainThreadOnly = false;
+        for (const System* stage : stages) {
+            if (stage->isRendering()) {
+                throw std::invalid_argument("Rendering systems can't be pipeline stages");
+            }
+            if (stage->isFixedRate() != isFixedRate) {
+                throw std::invalid_argument("Pipeline stages must all be fixed-rate or none");
+            }
+            hasDeclaredAccess = hasDeclaredAccess and stage->hasDeclaredAccess();
+            isGraphical = isGraphical and stage->isGraphical();
+            isMainThreadOnly = isMainThreadOnly or stage->isMainThreadOnly();
+        }
+        if (hasDeclaredAccess) {
+            for (const System* stage : stages) {
+                for (ComponentTypeId typeId : stage->bufferedReadSet()) {
+                    this->declareBufferedRead(typeId);
+                }
+                for (ComponentTypeId typeId : stage->readSet()) {
+                    this->declareRead(typeId);
+                }
+                for (ComponentTypeId typeId : stage->writeSet()) {
+                    this->declareWrite(typeId);
+                }
+            }
+            if (isMainThreadOnly) {
+                this->setMainThreadOnly();
+            }
+        }
+        if (isGraphical) {
+            this->declareGraphical();
+        }
+        this->setFixedRate(isFixedRate);
+    }
+
+    void
+    activate() override {
+        m_stages.activate();
+    }
+
+    void
+    deactivate() override {
+        m_stages.deactivate();
+    }
+
+    void
+    init(
+        GameState* gameState
+    ) override {
+        System::init(gameState);
+        m_stages.init(gameState, gameState->engine().isHeadless());
+    }
+
+    void
+    resume() override {
+        m_stages.resume();
+    }
+
+    void
+    shutdown() override {
+        m_stages.shutdown();
+        System::shutdown();
+    }
+
+    /**
+    * @brief The stages, in update order
+    */
+    std::vector<System*>
+    stages() const override {
+        std::vector<System*> stages;
+        stages.reserve(sizeof...(Stages));
+        const_cast<detail::PipelineStages<Stages...>&>(m_stages).collect(stages);
+        return stages;
+    }
+
+    void
+    suspend() override {
+        m_stages.suspend();
+    }
+
+    void
+    update(
+        int milliseconds
+    ) override {
+        m_stages.update(milliseconds);
+    }
+
+private:
+
+    static_assert(sizeof...(Stages) > 0, "A pipeline needs at least one stage");
+
+    detail::PipelineStages<Stages...> m_stages;
+
+};
+
+}
@@ -0,0 +1,381 @@
+#include "engine/system_profiler.h"
+
+#include "engine/system.h"
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// Index of a percentile in sorted durations, rounded up
+size_t
+percentileIndex(
+    size_t size,
+    unsigned int percent
+) {
+    size_t rank = (size * percent + 99) / 100;
+    return rank == 0 ? 0 : rank - 1;
+}
+
+}
+
+
+luabind::scope
+SystemProfiler::luaBindings() {
+    using namespace luabind;
+    return class_<SystemProfiler>("SystemProfiler")
+        .scope [
+            class_<CounterStatistics>("CounterStatistics")
+                .def_readonly("branchMissesPerEntity", &CounterStatistics::branchMissesPerEntity)
+                .def_readonly("cacheMissesPerEntity", &CounterStatistics::cacheMissesPerEntity)
+                .def_readonly("cyclesPerUpdate", &CounterStatistics::cyclesPerUpdate)
+                .def_readonly("instructionsPerCycle", &CounterStatistics::instructionsPerCycle)
+                .def_readonly("samples", &CounterStatistics::samples),
+            class_<Statistics>("Statistics")
+                .def_readonly("average", &Statistics::average)
+                .def_readonly("max", &Statistics::max)
+                .def_readonly("p95", &Statistics::p95)
+                .def_readonly("p99", &Statistics::p99)
+                .def_readonly("samples", &Statistics::samples)
+                .def_readonly("total", &Statistics::total)
+                .def_readonly("totalSamples", &Statistics::totalSamples)
+        ]
+        .def("counterStatistics", &SystemProfiler::counterStatistics)
+        .def("isCountingHardware", &SystemProfiler::isCountingHardware)
+        .def("isEnabled", &SystemProfiler::isEnabled)
+        .def("report", &SystemProfiler::report)
+        .def("reset", &SystemProfiler::reset)
+        .def("setCountingHardware", &SystemProfiler::setCountingHardware)
+        .def("setEnabled", &SystemProfiler::setEnabled)
+        .def("statistics", &SystemProfiler::statistics)
+    ;
+}
+
+
+SystemProfiler::SystemProfiler(
+    size_t windowSize
+) : m_entityCount(0),
+    m_isCountingHardware(false),
+    m_isEnabled(false),
+    m_windowSize(windowSize)
+{
+    if (windowSize == 0) {
+        throw std::invalid_argument("System profiler window must not be empty");
+    }
+}
+
+
+size_t
+SystemProfiler::addEntry(
+    std::string name
+) {
+    size_t slot = m_entries.size();
+    m_entries.emplace_back();
+    Entry& entry = m_entries.back();
+    entry.name = name.empty() ? "System " + std::to_string(slot) : std::move(name);
+    entry.durations.reserve(m_windowSize);
+    return slot;
+}
+
+
+size_t
+SystemProfiler::addScope(
+    const std::string& name
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto iter = m_scopeSlots.find(name);
+    if (iter != m_scopeSlots.end()) {
+        return iter->second;
+    }
+    size_t slot = this->addEntry(name);
+    m_scopeSlots.emplace(name, slot);
+    return slot;
+}
+
+
+size_t
+SystemProfiler::addSystem(
+    const System& system
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto iter = m_slots.find(&system);
+    if (iter != m_slots.end()) {
+        return iter->second;
+    }
+    size_t slot = this->addEntry(system.name());
+    m_slots.emplace(&system, slot);
+    return slot;
+}
+
+
+SystemProfiler::CounterStatistics
+SystemProfiler::computeCounterStatistics(
+    const Entry& entry
+) const {
+    CounterStatistics statistics;
+    if (entry.counterSamples == 0) {
+        return statistics;
+    }
+    const PerfCounters::Values& counters = entry.counters;
+    double entities = static_cast<double>(entry.counterEntities);
+    if (entities > 0.0) {
+        statistics.branchMissesPerEntity = counters.branchMisses / entities;
+        statistics.cacheMissesPerEntity = counters.cacheMisses / entities;
+    }
+    statistics.cyclesPerUpdate = static_cast<double>(counters.cycles) / entry.counterSamples;
+    if (counters.cycles > 0) {
+        statistics.instructionsPerCycle = static_cast<double>(counters.instructions) / counters.cycles;
+    }
+    statistics.samples = entry.counterSamples;
+    return statistics;
+}
+
+
+SystemProfiler::Statistics
+SystemProfiler::computeStatistics(
+    const Entry& entry
+) const {
+    Statistics statistics;
+    statistics.total = entry.total;
+    statistics.totalSamples = entry.totalSamples;
+    if (entry.durations.empty()) {
+        return statistics;
+    }
+    m_sorted.assign(entry.durations.begin(), entry.durations.end());
+    std::sort(m_sorted.begin(), m_sorted.end());
+    uint64_t total = std::accumulate(m_sorted.begin(), m_sorted.end(), uint64_t(0));
+    statistics.average = static_cast<double>(total) / m_sorted.size();
+    statistics.max = m_sorted.back();
+    statistics.p95 = m_sorted[percentileIndex(m_sorted.size(), 95)];
+    statistics.p99 = m_sorted[percentileIndex(m_sorted.size(), 99)];
+    statistics.samples = m_sorted.size();
+    return statistics;
+}
+
+
+SystemProfiler::CounterStatistics
+SystemProfiler::counterStatistics(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (const Entry& entry : m_entries) {
+        if (entry.name == name) {
+            return this->computeCounterStatistics(entry);
+        }
+    }
+    return CounterStatistics();
+}
+
+
+bool
+SystemProfiler::isCountingHardware() const {
+    return m_isCountingHardware.load(std::memory_order_relaxed);
+}
+
+
+bool
+SystemProfiler::isEnabled() const {
+    return m_isEnabled.load(std::memory_order_relaxed);
+}
+
+
+std::vector<std::string>
+SystemProfiler::names() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::vector<std::string> names;
+    names.reserve(m_entries.size());
+    for (const Entry& entry : m_entries) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+
+void
+SystemProfiler::record(
+    size_t slot,
+    uint32_t microseconds
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    this->recordDuration(m_entries.at(slot), microseconds);
+}
+
+
+void
+SystemProfiler::record(
+    size_t slot,
+    uint32_t microseconds,
+    const PerfCounters::Values& counters
+) {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    Entry& entry = m_entries.at(slot);
+    this->recordDuration(entry, microseconds);
+    entry.counters += counters;
+    entry.counterEntities += m_entityCount.load(std::memory_order_relaxed);
+    entry.counterSamples += 1;
+}
+
+
+void
+SystemProfiler::recordDuration(
+    Entry& entry,
+    uint32_t microseconds
+) {
+    if (entry.durations.size() < m_windowSize) {
+        entry.durations.push_back(microseconds);
+    }
+    else {
+        entry.durations[entry.next] = microseconds;
+    }
+    entry.next = (entry.next + 1) % m_windowSize;
+    entry.total += microseconds;
+    entry.totalSamples += 1;
+}
+
+
+std::string
+SystemProfiler::report(
+    unsigned int count
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    using Row = std::pair<Statistics, const Entry*>;
+    std::vector<Row> rows;
+    rows.reserve(m_entries.size());
+    bool hasCounters = false;
+    for (const Entry& entry : m_entries) {
+        rows.emplace_back(this->computeStatistics(entry), &entry);
+        hasCounters = hasCounters or entry.counterSamples > 0;
+    }
+    count = std::min<size_t>(count, rows.size());
+    std::partial_sort(
+        rows.begin(),
+        rows.begin() + count,
+        rows.end(),
+        [] (const Row& a, const Row& b) {
+            return a.first.average > b.first.average;
+        }
+    );
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(2);
+    stream << "    avg     p95     p99     max  (ms)\n";
+    for (unsigned int i = 0; i < count; ++i) {
+        const Statistics& statistics = rows[i].first;
+        stream
+            << std::setw(7) << statistics.average / 1000.0 << " "
+            << std::setw(7) << statistics.p95 / 1000.0 << " "
+            << std::setw(7) << statistics.p99 / 1000.0 << " "
+            << std::setw(7) << statistics.max / 1000.0 << "  "
+            << rows[i].second->name << "\n";
+    }
+    if (not hasCounters) {
+        return stream.str();
+    }
+    // In the same order, misses are per entity
+    stream << "    IPC  LLC/ent   br/ent  Mcycles\n";
+    for (unsigned int i = 0; i < count; ++i) {
+        CounterStatistics statistics = this->computeCounterStatistics(*rows[i].second);
+        if (statistics.samples == 0) {
+            continue;
+        }
+        stream
+            << std::setw(7) << statistics.instructionsPerCycle << " "
+            << std::setw(8) << statistics.cacheMissesPerEntity << " "
+            << std::setw(8) << statistics.branchMissesPerEntity << " "
+            << std::setw(8) << statistics.cyclesPerUpdate / 1e6 << "  "
+            << rows[i].second->name << "\n";
+    }
+    return stream.str();
+}
+
+
+void
+SystemProfiler::reset() {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (Entry& entry : m_entries) {
+        entry.counters = PerfCounters::Values();
+        entry.counterEntities = 0;
+        entry.counterSamples = 0;
+        entry.durations.clear();
+        entry.next = 0;
+        entry.total = 0;
+        entry.totalSamples = 0;
+    }
+}
+
+
+void
+SystemProfiler::setCountingHardware(
+    bool counting
+) {
+    m_isCountingHardware.store(
+        counting and PerfCounters::isAvailable(),
+        std::memory_order_relaxed
+    );
+}
+
+
+void
+SystemProfiler::setEnabled(
+    bool enabled
+) {
+    m_isEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+
+void
+SystemProfiler::setEntityCount(
+    size_t count
+) {
+    m_entityCount.store(count, std::memory_order_relaxed);
+}
+
+
+SystemProfiler::Statistics
+SystemProfiler::statistics(
+    const std::string& name
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (const Entry& entry : m_entries) {
+        if (entry.name == name) {
+            return this->computeStatistics(entry);
+        }
+    }
+    return Statistics();
+}
+
+
+void
+SystemProfiler::writeJson(
+    JsonWriter& writer
+) const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    writer.beginObject();
+    for (const Entry& entry : m_entries) {
+        if (entry.durations.empty()) {
+            continue;
+        }
+        Statistics statistics = this->computeStatistics(entry);
+        writer.key(entry.name).beginObject();
+        writer.key("average").value(statistics.average);
+        writer.key("max").value(statistics.max);
+        writer.key("p95").value(statistics.p95);
+        writer.key("p99").value(statistics.p99);
+        writer.key("samples").value(static_cast<uint64_t>(statistics.samples));
+        if (entry.counterSamples > 0) {
+            CounterStatistics counters = this->computeCounterStatistics(entry);
+            writer.key("branchMissesPerEntity").value(counters.branchMissesPerEntity);
+            writer.key("cacheMissesPerEntity").value(counters.cacheMissesPerEntity);
+            writer.key("cyclesPerUpdate").value(counters.cyclesPerUpdate);
+            writer.key("instructionsPerCycle").value(counters.instructionsPerCycle);
+        }
+        writer.endObject();
+    }
+    writer.endObject();
+}
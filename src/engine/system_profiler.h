@@ -0,0 +1,429 @@
+#pragma once
+
+#include "engine/perf_counters.h"
+
+#include <atomic>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class JsonWriter;
+class System;
+
+/**
+* @brief Measures how long each system's update takes
+*
+* The SystemScheduler times every System::update() call of a game state's
+* systems while the profiler is enabled. For each system, the profiler
+* keeps the durations of its most recent updates and summarizes them as
+* Statistics. Fixed-rate systems contribute one duration per tick.
+*
+* Disabled profilers cost one flag check per system update.
+*
+* Optionally, the profiler also reads the hardware performance counters
+* around each update, see setCountingHardware() and PerfCounters. Their
+* CounterStatistics tell memory-bound systems apart: low instructions per
+* cycle and many cache misses per entity. The counts are divided by the
+* game state's entity count, see setEntityCount().
+*
+* Work outside of the systems, like the physics step, can be recorded in
+* named slots as well, see addScope().
+*
+* Durations are recorded from worker threads as well, all public methods
+* are thread safe.
+*/
+class SystemProfiler {
+
+public:
+
+    /**
+    * @brief Summary of a system's recent update durations
+    *
+    * All durations are in microseconds.
+    */
+    struct Statistics {
+
+        /**
+        * @brief Mean duration
+        */
+        double average = 0.0;
+
+        /**
+        * @brief Longest duration
+        */
+        uint32_t max = 0;
+
+        /**
+        * @brief 95th percentile
+        */
+        uint32_t p95 = 0;
+
+        /**
+        * @brief 99th percentile
+        */
+        uint32_t p99 = 0;
+
+        /**
+        * @brief Number of durations that went into the statistics
+        */
+        size_t samples = 0;
+
+        /**
+        * @brief Sum of all durations since the last reset, not just the
+        * recent ones
+        */
+        size_t total = 0;
+
+        /**
+        * @brief Number of all durations since the last reset
+        */
+        size_t totalSamples = 0;
+
+    };
+
+    /**
+    * @brief Summary of a system's hardware counters since the last reset
+    */
+    struct CounterStatistics {
+
+        /**
+        * @brief Mispredicted branches per entity and update
+        */
+        double branchMissesPerEntity = 0.0;
+
+        /**
+        * @brief Last level cache misses per entity and update
+        */
+        double cacheMissesPerEntity = 0.0;
+
+        /**
+        * @brief Mean CPU cycles per update
+        */
+        double cyclesPerUpdate = 0.0;
+
+        /**
+        * @brief Retired instructions per CPU cycle
+        */
+        double instructionsPerCycle = 0.0;
+
+        /**
+        * @brief Number of updates that went into the statistics
+        */
+        size_t samples = 0;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SystemProfiler::counterStatistics
+    * - SystemProfiler::isCountingHardware
+    * - SystemProfiler::isEnabled
+    * - SystemProfiler::report
+    * - SystemProfiler::reset
+    * - SystemProfiler::setCountingHardware
+    * - SystemProfiler::setEnabled
+    * - SystemProfiler::statistics
+    * - CounterStatistics
+    *   - CounterStatistics::branchMissesPerEntity
+    *   - CounterStatistics::cacheMissesPerEntity
+    *   - CounterStatistics::cyclesPerUpdate
+    *   - CounterStatistics::instructionsPerCycle
+    *   - CounterStatistics::samples
+    * - Statistics
+    *   - Statistics::average
+    *   - Statistics::max
+    *   - Statistics::p95
+    *   - Statistics::p99
+    *   - Statistics::samples
+    *   - Statistics::total
+    *   - Statistics::totalSamples
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param windowSize
+    *   How many of the most recent durations are kept per system
+    *
+    * @throw std::invalid_argument
+    *   If \a windowSize is 0
+    */
+    explicit SystemProfiler(
+        size_t windowSize = 120
+    );
+
+    SystemProfiler(const SystemProfiler&) = delete;
+
+    SystemProfiler& operator= (const SystemProfiler&) = delete;
+
+    /**
+    * @brief Adds a system to profile
+    *
+    * The system is reported under its System::name(). Adding a system
+    * again returns the slot it already has.
+    *
+    * @param system
+    *   Only used as a key after this call, never dereferenced
+    *
+    * @return
+    *   The slot to record() the system's durations in
+    */
+    size_t
+    addSystem(
+        const System& system
+    );
+
+    /**
+    * @brief Adds a named slot for work that isn't a system update
+    *
+    * Adding a name again returns the slot it already has.
+    *
+    * @param name
+    *   Reported like a system's name
+    *
+    * @return
+    *   The slot to record() the durations in
+    */
+    size_t
+    addScope(
+        const std::string& name
+    );
+
+    /**
+    * @brief The hardware counter statistics of a system
+    *
+    * @param name
+    *   As for statistics()
+    *
+    * @return
+    *   The statistics or empty statistics if there is no such system or
+    *   no counters were recorded
+    */
+    CounterStatistics
+    counterStatistics(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Whether the hardware counters should be read around updates
+    *
+    * Only ever \c true if PerfCounters::isAvailable().
+    */
+    bool
+    isCountingHardware() const;
+
+    /**
+    * @brief Whether durations should be recorded
+    *
+    * Cheap enough to call for every system update.
+    */
+    bool
+    isEnabled() const;
+
+    /**
+    * @brief The names of the profiled systems and scopes
+    *
+    * In the order they were added.
+    */
+    std::vector<std::string>
+    names() const;
+
+    /**
+    * @brief Records a duration
+    *
+    * @param slot
+    *   A slot returned by addSystem()
+    * @param microseconds
+    */
+    void
+    record(
+        size_t slot,
+        uint32_t microseconds
+    );
+
+    /**
+    * @brief Records a duration and the hardware counters it took
+    *
+    * @param slot
+    *   A slot returned by addSystem() or addScope()
+    * @param microseconds
+    * @param counters
+    *   The difference of the counters before and after
+    */
+    void
+    record(
+        size_t slot,
+        uint32_t microseconds,
+        const PerfCounters::Values& counters
+    );
+
+    /**
+    * @brief Summarizes the statistics as text
+    *
+    * One line per system, slowest average first, listing the average,
+    * p95, p99 and maximum in milliseconds. If hardware counters were
+    * recorded, they follow in a second table.
+    *
+    * @param count
+    *   The maximum number of systems to list
+    */
+    std::string
+    report(
+        unsigned int count
+    ) const;
+
+    /**
+    * @brief Discards all recorded durations and counters
+    */
+    void
+    reset();
+
+    /**
+    * @brief Enables or disables reading the hardware counters
+    *
+    * Disabled by default. Has no effect unless PerfCounters::isAvailable().
+    * Counters are only read while the profiler is enabled as well.
+    *
+    * @param counting
+    */
+    void
+    setCountingHardware(
+        bool counting
+    );
+
+    /**
+    * @brief Enables or disables recording
+    *
+    * Disabled by default.
+    *
+    * @param enabled
+    */
+    void
+    setEnabled(
+        bool enabled
+    );
+
+    /**
+    * @brief Sets the entity count that the next updates' counters are
+    * divided by
+    *
+    * The GameState sets it before each update.
+    */
+    void
+    setEntityCount(
+        size_t count
+    );
+
+    /**
+    * @brief The statistics of a system
+    *
+    * @param name
+    *   The system's System::name(). If several systems share the name,
+    *   the first one added is used.
+    *
+    * @return
+    *   The statistics or empty statistics if there is no such system
+    */
+    Statistics
+    statistics(
+        const std::string& name
+    ) const;
+
+    /**
+    * @brief Writes the statistics of all systems as a JSON object
+    *
+    * Keyed by system name, each with the fields of Statistics and, if
+    * hardware counters were recorded, those of CounterStatistics. Systems
+    * without recorded durations are left out.
+    */
+    void
+    writeJson(
+        JsonWriter& writer
+    ) const;
+
+private:
+
+    struct Entry {
+
+        // Sums since the last reset
+        PerfCounters::Values counters;
+
+        // Sum of the entity counts of the counted updates
+        uint64_t counterEntities = 0;
+
+        size_t counterSamples = 0;
+
+        // Ring buffer of the most recent durations
+        std::vector<uint32_t> durations;
+
+        std::string name;
+
+        // Where the next duration goes in the ring buffer
+        size_t next = 0;
+
+        // Sums of all durations since the last reset
+        size_t total = 0;
+
+        size_t totalSamples = 0;
+
+    };
+
+    size_t
+    addEntry(
+        std::string name
+    );
+
+    CounterStatistics
+    computeCounterStatistics(
+        const Entry& entry
+    ) const;
+
+    Statistics
+    computeStatistics(
+        const Entry& entry
+    ) const;
+
+    void
+    recordDuration(
+        Entry& entry,
+        uint32_t microseconds
+    );
+
+    std::vector<Entry> m_entries;
+
+    std::atomic<size_t> m_entityCount;
+
+    std::atomic<bool> m_isCountingHardware;
+
+    std::atomic<bool> m_isEnabled;
+
+    mutable boost::mutex m_mutex;
+
+    std::unordered_map<std::string, size_t> m_scopeSlots;
+
+    std::unordered_map<const System*, size_t> m_slots;
+
+    // Scratch space for computeStatistics()
+    mutable std::vector<uint32_t> m_sorted;
+
+    size_t m_windowSize;
+
+};
+
+}
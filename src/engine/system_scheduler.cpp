@@ -0,0 +1,275 @@
+#include "engine/system_scheduler.h"
+
+#include "engine/allocation_tracker.h"
+#include "engine/frame_budgets.h"
+#include "engine/perf_counters.h"
+#include "engine/system.h"
+#include "engine/system_profiler.h"
+#include "engine/thread_pool.h"
+#include "engine/tracer.h"
+
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <exception>
+
+using namespace thrive;
+
+struct SystemScheduler::Implementation {
+
+    struct Node {
+
+        // Slot in m_allocations
+        size_t m_allocationSlot = 0;
+
+        // Systems that have to wait for this one
+        std::vector<size_t> m_dependents;
+
+        // Number of earlier systems this one has to wait for
+        size_t m_dependencyCount = 0;
+
+        // Remaining dependencies during the current update
+        size_t m_pendingDependencies = 0;
+
+        // Slot in m_profiler
+        size_t m_profilerSlot = 0;
+
+        System* m_system = nullptr;
+
+    };
+
+    Implementation(
+        std::vector<System*> systems,
+        ThreadPool& threadPool,
+        SystemProfiler* profiler,
+        Tracer* tracer,
+        FrameBudgets* budgets,
+        AllocationTracker* allocations
+    ) : m_allocations(allocations),
+        m_budgets(budgets),
+        m_nodes(systems.size()),
+        m_profiler(profiler),
+        m_threadPool(threadPool),
+        m_tracer(tracer)
+    {
+        for (size_t i = 0; i < systems.size(); ++i) {
+            Node& node = m_nodes[i];
+            node.m_system = systems[i];
+            if (profiler) {
+                node.m_profilerSlot = profiler->addSystem(*systems[i]);
+            }
+            if (allocations) {
+                node.m_allocationSlot = allocations->addScope(systems[i]->name());
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (systems[i]->conflictsWith(*systems[j])) {
+                    m_nodes[j].m_dependents.push_back(i);
+                    node.m_dependencyCount += 1;
+                }
+            }
+        }
+    }
+
+    // Must be called with m_mutex locked
+    void
+    enqueue(
+        size_t index
+    ) {
+        if (m_nodes[index].m_system->isMainThreadOnly()) {
+            m_mainQueue.push_back(index);
+        }
+        else {
+            m_workerQueue.push_back(index);
+            if (m_threadPool.threadCount() > 0) {
+                // Whoever gets there first, a worker or the main thread, 
+                // takes the system from the queue
+                m_threadPool.submit(
+                    [this] () {
+                        this->runWorkerTask();
+                    },
+                    &m_pendingTasks
+                );
+            }
+        }
+    }
+
+    // Updates a system and releases its dependents. Must be called with
+    // lock held, which is released during the update.
+    void
+    run(
+        size_t index,
+        boost::unique_lock<boost::mutex>& lock
+    ) {
+        System* system = m_nodes[index].m_system;
+        std::exception_ptr error;
+        lock.unlock();
+        try {
+            int milliseconds = 0;
+            if (system->enabled() and system->takeUpdateTime(m_milliseconds, milliseconds)) {
+                Tracer::Zone zone(m_tracer, system->name());
+                AllocationTracker::Scope allocationScope(
+                    m_allocations,
+                    m_nodes[index].m_allocationSlot
+                );
+                bool isProfiled = m_profiler and m_profiler->isEnabled();
+                bool isBudgeted = m_budgets and m_budgets->hasSystemBudgets();
+                if (isProfiled or isBudgeted) {
+                    this->runTimed(m_nodes[index], milliseconds, isProfiled, isBudgeted);
+                }
+                else {
+                    system->update(milliseconds);
+                }
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error and not m_error) {
+            m_error = error;
+        }
+        for (size_t dependent : m_nodes[index].m_dependents) {
+            Node& node = m_nodes[dependent];
+            node.m_pendingDependencies -= 1;
+            if (node.m_pendingDependencies == 0) {
+                this->enqueue(dependent);
+            }
+        }
+        m_remaining -= 1;
+        m_condition.notify_all();
+    }
+
+    void
+    runTimed(
+        const Node& node,
+        int milliseconds,
+        bool isProfiled,
+        bool isBudgeted
+    ) {
+        using namespace boost::chrono;
+        // Counted on this thread only, jobs the system submits are missed
+        PerfCounters::Values countersBefore;
+        bool isCounting = isProfiled and m_profiler->isCountingHardware() and
+            PerfCounters::read(countersBefore);
+        auto start = steady_clock::now();
+        node.m_system->update(milliseconds);
+        auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+        uint32_t elapsedMicroseconds = static_cast<uint32_t>(elapsed.count());
+        PerfCounters::Values countersAfter;
+        if (isCounting and PerfCounters::read(countersAfter)) {
+            m_profiler->record(
+                node.m_profilerSlot,
+                elapsedMicroseconds,
+                countersAfter - countersBefore
+            );
+        }
+        else if (isProfiled) {
+            m_profiler->record(node.m_profilerSlot, elapsedMicroseconds);
+        }
+        if (isBudgeted) {
+            m_budgets->check(node.m_system->name(), elapsedMicroseconds);
+        }
+    }
+
+    void
+    runWorkerTask() {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        if (not m_workerQueue.empty()) {
+            size_t index = m_workerQueue.front();
+            m_workerQueue.pop_front();
+            this->run(index, lock);
+        }
+    }
+
+    AllocationTracker* m_allocations;
+
+    FrameBudgets* m_budgets;
+
+    boost::condition_variable m_condition;
+
+    std::exception_ptr m_error;
+
+    std::deque<size_t> m_mainQueue;
+
+    int m_milliseconds = 0;
+
+    boost::mutex m_mutex;
+
+    std::vector<Node> m_nodes;
+
+    SystemProfiler* m_profiler;
+
+    // Submitted tasks that haven't finished yet
+    JobCounter m_pendingTasks;
+
+    size_t m_remaining = 0;
+
+    ThreadPool& m_threadPool;
+
+    Tracer* m_tracer;
+
+    std::deque<size_t> m_workerQueue;
+
+};
+
+
+SystemScheduler::SystemScheduler(
+    std::vector<System*> systems,
+    ThreadPool& threadPool,
+    SystemProfiler* profiler,
+    Tracer* tracer,
+    FrameBudgets* budgets,
+    AllocationTracker* allocations
+) : m_impl(new Implementation(
+        std::move(systems),
+        threadPool,
+        profiler,
+        tracer,
+        budgets,
+        allocations
+    ))
+{
+}
+
+
+SystemScheduler::~SystemScheduler() {
+    // Tasks of the last update may still wait in the pool's queue
+    m_impl->m_threadPool.wait(m_impl->m_pendingTasks);
+}
+
+
+void
+SystemScheduler::update(
+    int milliseconds
+) {
+    boost::unique_lock<boost::mutex> lock(m_impl->m_mutex);
+    m_impl->m_milliseconds = milliseconds;
+    m_impl->m_remaining = m_impl->m_nodes.size();
+    for (size_t i = 0; i < m_impl->m_nodes.size(); ++i) {
+        auto& node = m_impl->m_nodes[i];
+        node.m_pendingDependencies = node.m_dependencyCount;
+        if (node.m_dependencyCount == 0) {
+            m_impl->enqueue(i);
+        }
+    }
+    m_impl->m_condition.notify_all();
+    while (m_impl->m_remaining > 0) {
+        // Prefer main thread systems, but help out the workers if there
+        // are none
+        auto& queue = m_impl->m_mainQueue.empty() ?
+            m_impl->m_workerQueue : m_impl->m_mainQueue;
+        if (queue.empty()) {
+            m_impl->m_condition.wait(lock);
+            continue;
+        }
+        size_t index = queue.front();
+        queue.pop_front();
+        m_impl->run(index, lock);
+    }
+    std::exception_ptr error = m_impl->m_error;
+    m_impl->m_error = nullptr;
+    lock.unlock();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace thrive {
+
+class AllocationTracker;
+class FrameBudgets;
+class System;
+class SystemProfiler;
+class ThreadPool;
+class Tracer;
+
+/**
+* @brief Updates systems in parallel where their component access allows it
+*
+* The scheduler builds a dependency graph from the systems' declared
+* component access (see System::conflictsWith()). Each system depends on
+* every earlier system it conflicts with, so the result of an update is the
+* same as updating the systems one after another in their original order.
+*
+* Systems that are independent of each other are distributed over the
+* workers of a ThreadPool. The calling thread takes part in the update and 
+* is the only thread that updates systems flagged with 
+* System::setMainThreadOnly() or without any declared component access.
+*/
+class SystemScheduler {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param systems
+    *   The systems to update, in their sequential order. The systems must
+    *   outlive the scheduler.
+    * @param threadPool
+    *   The worker threads to use. With no threads in the pool, all systems 
+    *   are updated on the calling thread.
+    * @param profiler
+    *   If not \c null, times the updates while it is enabled. The systems
+    *   are added to the profiler. Must outlive the scheduler.
+    * @param tracer
+    *   If not \c null, each update is traced as a zone named after the
+    *   system. Must outlive the scheduler.
+    * @param budgets
+    *   If not \c null, times the updates while it has system budgets and
+    *   checks them against the budgets. Must outlive the scheduler.
+    * @param allocations
+    *   If not \c null, counts the allocations of each update for the
+    *   system. Scopes named after the systems are added to the tracker.
+    *   Must outlive the scheduler.
+    */
+    SystemScheduler(
+        std::vector<System*> systems,
+        ThreadPool& threadPool,
+        SystemProfiler* profiler = nullptr,
+        Tracer* tracer = nullptr,
+        FrameBudgets* budgets = nullptr,
+        AllocationTracker* allocations = nullptr
+    );
+
+    /**
+    * @brief Destructor
+    *
+    * Waits for tasks still queued in the thread pool.
+    */
+    ~SystemScheduler();
+
+    /**
+    * @brief Updates all enabled systems
+    *
+    * Rate limited systems (see System::setUpdateRate()) are skipped until
+    * their interval has passed.
+    *
+    * Returns after all systems have been updated. If a system throws, the
+    * remaining systems are still updated and the first exception is
+    * rethrown afterwards.
+    *
+    * @param milliseconds
+    *   Passed on to System::update()
+    */
+    void
+    update(
+        int milliseconds
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
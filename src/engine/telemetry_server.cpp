@@ -0,0 +1,510 @@
+#include "engine/telemetry_server.h"
+
+#include "scripting/luabind.h"
+#include "util/json_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+using boost::asio::ip::tcp;
+
+namespace {
+
+// Clients beyond this are disconnected right away
+const size_t MAX_CLIENTS = 8;
+
+// Longer command lines disconnect the client
+const size_t MAX_LINE_LENGTH = 4096;
+
+// Lines waiting to be sent to a client before further samples are dropped
+const size_t MAX_PENDING_LINES = 16;
+
+}
+
+
+struct TelemetryServer::Implementation {
+
+    struct Client : public std::enable_shared_from_this<Client> {
+
+        explicit Client(
+            Implementation& server
+        ) : m_input(MAX_LINE_LENGTH),
+            m_server(server),
+            m_socket(server.m_ioService)
+        {
+        }
+
+        void
+        close() {
+            boost::system::error_code error;
+            m_socket.close(error);
+        }
+
+        void
+        read() {
+            auto self = this->shared_from_this();
+            boost::asio::async_read_until(m_socket, m_input, '\n',
+                [self] (const boost::system::error_code& error, size_t) {
+                    // A full buffer without a newline fails as well
+                    if (error) {
+                        self->m_server.removeClient(self);
+                        return;
+                    }
+                    std::istream stream(&self->m_input);
+                    std::string line;
+                    std::getline(stream, line);
+                    if (not line.empty() and line.back() == '\r') {
+                        line.pop_back();
+                    }
+                    if (not line.empty()) {
+                        self->m_server.queueCommand(self, std::move(line));
+                    }
+                    self->read();
+                }
+            );
+        }
+
+        void
+        send(
+            std::shared_ptr<const std::string> line,
+            bool isSample
+        ) {
+            if (isSample and m_pending.size() >= MAX_PENDING_LINES) {
+                m_server.m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_pending.push_back(std::move(line));
+            if (m_pending.size() == 1) {
+                this->write();
+            }
+        }
+
+        void
+        write() {
+            auto self = this->shared_from_this();
+            boost::asio::async_write(m_socket, boost::asio::buffer(*m_pending.front()),
+                [self] (const boost::system::error_code& error, size_t) {
+                    if (error) {
+                        self->m_server.removeClient(self);
+                        return;
+                    }
+                    self->m_pending.pop_front();
+                    if (not self->m_pending.empty()) {
+                        self->write();
+                    }
+                }
+            );
+        }
+
+        boost::asio::streambuf m_input;
+
+        // Lines being sent, the front one is being written
+        std::deque<std::shared_ptr<const std::string>> m_pending;
+
+        Implementation& m_server;
+
+        tcp::socket m_socket;
+
+    };
+
+    struct Command {
+
+        CommandHandler handler;
+
+        std::string description;
+
+    };
+
+    struct ReceivedCommand {
+
+        std::weak_ptr<Client> client;
+
+        std::string line;
+
+    };
+
+    Implementation()
+      : m_started(boost::chrono::steady_clock::now())
+    {
+    }
+
+    // The handlers below run on the server thread, except when stop()
+    // cleans up
+
+    void
+    accept() {
+        auto client = std::make_shared<Client>(*this);
+        m_acceptor->async_accept(client->m_socket,
+            [this, client] (const boost::system::error_code& error) {
+                if (error == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (not error) {
+                    if (m_clients.size() >= MAX_CLIENTS) {
+                        client->close();
+                    }
+                    else {
+                        m_clients.insert(client);
+                        m_clientCount.store(m_clients.size(), std::memory_order_relaxed);
+                        client->read();
+                    }
+                }
+                this->accept();
+            }
+        );
+    }
+
+    void
+    queueCommand(
+        const std::shared_ptr<Client>& client,
+        std::string line
+    ) {
+        boost::lock_guard<boost::mutex> lock(m_receivedMutex);
+        m_received.push_back(ReceivedCommand{client, std::move(line)});
+    }
+
+    void
+    removeClient(
+        const std::shared_ptr<Client>& client
+    ) {
+        if (m_clients.erase(client) > 0) {
+            client->close();
+            m_clientCount.store(m_clients.size(), std::memory_order_relaxed);
+        }
+    }
+
+    // Main thread
+
+    void
+    broadcast(
+        std::string line
+    ) {
+        auto sharedLine = std::make_shared<const std::string>(std::move(line));
+        m_ioService.post([this, sharedLine] () {
+            for (const auto& client : m_clients) {
+                client->send(sharedLine, true);
+            }
+        });
+    }
+
+    void
+    reply(
+        const std::weak_ptr<Client>& client,
+        const std::string& command,
+        bool isOk,
+        const std::string& message
+    ) {
+        std::ostringstream stream;
+        {
+            JsonWriter writer(stream);
+            writer.beginObject();
+            writer.key("type").value("reply");
+            writer.key("command").value(command);
+            writer.key("ok").value(isOk);
+            writer.key("message").value(message);
+            writer.endObject();
+        }
+        stream << '\n';
+        auto line = std::make_shared<const std::string>(stream.str());
+        m_ioService.post([client, line] () {
+            if (auto lockedClient = client.lock()) {
+                lockedClient->send(line, false);
+            }
+        });
+    }
+
+    void
+    runCommands() {
+        std::vector<ReceivedCommand> received;
+        {
+            boost::lock_guard<boost::mutex> lock(m_receivedMutex);
+            received.swap(m_received);
+        }
+        for (const ReceivedCommand& command : received) {
+            const std::string& line = command.line;
+            size_t nameEnd = line.find(' ');
+            std::string name = line.substr(0, nameEnd);
+            size_t argumentsBegin = nameEnd == std::string::npos ?
+                std::string::npos : line.find_first_not_of(' ', nameEnd);
+            std::string arguments;
+            if (argumentsBegin != std::string::npos) {
+                arguments = line.substr(argumentsBegin);
+            }
+            auto iter = m_commands.find(name);
+            if (iter == m_commands.end()) {
+                this->reply(command.client, name, false, "Unknown command, try \"commands\"");
+                continue;
+            }
+            // The handler may replace commands
+            CommandHandler handler = iter->second.handler;
+            try {
+                this->reply(command.client, name, true, handler(arguments));
+            }
+            catch (const std::exception& e) {
+                this->reply(command.client, name, false, e.what());
+            }
+        }
+    }
+
+    std::unique_ptr<tcp::acceptor> m_acceptor;
+
+    std::atomic<unsigned int> m_clientCount = {0};
+
+    // Only used by the server thread
+    std::set<std::shared_ptr<Client>> m_clients;
+
+    std::map<std::string, Command> m_commands;
+
+    std::atomic<uint64_t> m_dropped = {0};
+
+    unsigned int m_elapsed = 0;
+
+    std::string m_endpoint;
+
+    unsigned int m_interval = DEFAULT_INTERVAL;
+
+    // Declared before everything holding sockets, so it's destroyed last
+    boost::asio::io_service m_ioService;
+
+    std::vector<ReceivedCommand> m_received;
+
+    boost::mutex m_receivedMutex;
+
+    const boost::chrono::steady_clock::time_point m_started;
+
+    boost::thread m_thread;
+
+    std::unique_ptr<boost::asio::io_service::work> m_work;
+
+};
+
+
+luabind::scope
+TelemetryServer::luaBindings() {
+    using namespace luabind;
+    return class_<TelemetryServer>("TelemetryServer")
+        .def("clientCount", &TelemetryServer::clientCount)
+        .def("droppedCount", &TelemetryServer::droppedCount)
+        .def("endpoint", &TelemetryServer::endpoint)
+        .def("interval", &TelemetryServer::interval)
+        .def("isRunning", &TelemetryServer::isRunning)
+        .def("setInterval", &TelemetryServer::setInterval)
+        .def("start", &TelemetryServer::start)
+        .def("stop", &TelemetryServer::stop)
+    ;
+}
+
+
+TelemetryServer::TelemetryServer()
+  : m_impl(new Implementation())
+{
+    this->addCommand(
+        "commands",
+        "Lists the available commands",
+        [this] (const std::string&) {
+            std::string list;
+            for (const auto& pair : m_impl->m_commands) {
+                if (not list.empty()) {
+                    list += "\n";
+                }
+                list += pair.first + ": " + pair.second.description;
+            }
+            return list;
+        }
+    );
+    this->addCommand(
+        "interval",
+        "MILLISECONDS: Sets the time between samples",
+        [this] (const std::string& arguments) {
+            unsigned long interval = 0;
+            try {
+                interval = std::stoul(arguments);
+            }
+            catch (const std::exception&) {
+                throw std::invalid_argument("Expected milliseconds, got \"" + arguments + "\"");
+            }
+            this->setInterval(static_cast<unsigned int>(std::min(interval, 3600000ul)));
+            return "Interval set to " + std::to_string(m_impl->m_interval) + " ms";
+        }
+    );
+    this->addCommand(
+        "ping",
+        "Replies \"pong\"",
+        [] (const std::string&) {
+            return std::string("pong");
+        }
+    );
+}
+
+
+TelemetryServer::~TelemetryServer() {
+    this->stop();
+}
+
+
+void
+TelemetryServer::addCommand(
+    const std::string& name,
+    const std::string& description,
+    CommandHandler handler
+) {
+    m_impl->m_commands[name] = Implementation::Command{std::move(handler), description};
+}
+
+
+unsigned int
+TelemetryServer::clientCount() const {
+    return m_impl->m_clientCount.load(std::memory_order_relaxed);
+}
+
+
+uint64_t
+TelemetryServer::droppedCount() const {
+    return m_impl->m_dropped.load(std::memory_order_relaxed);
+}
+
+
+std::string
+TelemetryServer::endpoint() const {
+    return m_impl->m_endpoint;
+}
+
+
+unsigned int
+TelemetryServer::interval() const {
+    return m_impl->m_interval;
+}
+
+
+bool
+TelemetryServer::isRunning() const {
+    return m_impl->m_acceptor != nullptr;
+}
+
+
+void
+TelemetryServer::setInterval(
+    unsigned int interval
+) {
+    m_impl->m_interval = std::max(interval, 1u);
+}
+
+
+void
+TelemetryServer::start(
+    const std::string& endpoint
+) {
+    this->stop();
+    size_t colon = endpoint.rfind(':');
+    std::string address = colon == std::string::npos ? "127.0.0.1" : endpoint.substr(0, colon);
+    std::string port = colon == std::string::npos ? endpoint : endpoint.substr(colon + 1);
+    size_t portEnd = 0;
+    unsigned long portNumber = 0;
+    try {
+        portNumber = std::stoul(port, &portEnd);
+    }
+    catch (const std::exception&) {
+        portEnd = 0;
+    }
+    if (port.empty() or portEnd != port.size() or portNumber > 65535) {
+        throw std::runtime_error("Invalid telemetry endpoint " + endpoint);
+    }
+    try {
+        tcp::endpoint listenEndpoint(
+            boost::asio::ip::address::from_string(address),
+            static_cast<unsigned short>(portNumber)
+        );
+        m_impl->m_acceptor.reset(new tcp::acceptor(m_impl->m_ioService));
+        m_impl->m_acceptor->open(listenEndpoint.protocol());
+        m_impl->m_acceptor->set_option(tcp::acceptor::reuse_address(true));
+        m_impl->m_acceptor->bind(listenEndpoint);
+        m_impl->m_acceptor->listen();
+        tcp::endpoint localEndpoint = m_impl->m_acceptor->local_endpoint();
+        m_impl->m_endpoint = localEndpoint.address().to_string() + ":" + std::to_string(localEndpoint.port());
+    }
+    catch (const boost::system::system_error& e) {
+        m_impl->m_acceptor.reset();
+        throw std::runtime_error("Could not start telemetry server on " + endpoint + ": " + e.what());
+    }
+    // New clients get a sample right away
+    m_impl->m_elapsed = m_impl->m_interval;
+    m_impl->m_ioService.reset();
+    m_impl->m_work.reset(new boost::asio::io_service::work(m_impl->m_ioService));
+    m_impl->accept();
+    m_impl->m_thread = boost::thread([this] () {
+        m_impl->m_ioService.run();
+    });
+}
+
+
+void
+TelemetryServer::stop() {
+    if (not m_impl->m_acceptor) {
+        return;
+    }
+    m_impl->m_work.reset();
+    m_impl->m_ioService.stop();
+    m_impl->m_thread.join();
+    // The server thread is gone, so the rest is safe to do here. Closing
+    // the sockets aborts the pending handlers, running them releases the
+    // clients they hold.
+    boost::system::error_code error;
+    m_impl->m_acceptor->close(error);
+    for (const auto& client : m_impl->m_clients) {
+        client->close();
+    }
+    m_impl->m_clients.clear();
+    m_impl->m_ioService.reset();
+    m_impl->m_ioService.poll();
+    m_impl->m_acceptor.reset();
+    m_impl->m_clientCount.store(0, std::memory_order_relaxed);
+    m_impl->m_endpoint.clear();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_receivedMutex);
+    m_impl->m_received.clear();
+}
+
+
+void
+TelemetryServer::update(
+    int milliseconds,
+    const Sampler& sampler
+) {
+    m_impl->m_elapsed = std::min(
+        m_impl->m_elapsed + static_cast<unsigned int>(std::max(milliseconds, 0)),
+        m_impl->m_interval
+    );
+    if (m_impl->m_clientCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    m_impl->runCommands();
+    if (m_impl->m_elapsed < m_impl->m_interval) {
+        return;
+    }
+    m_impl->m_elapsed = 0;
+    std::ostringstream stream;
+    {
+        JsonWriter writer(stream);
+        writer.beginObject();
+        writer.key("type").value("sample");
+        auto uptime = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+            boost::chrono::steady_clock::now() - m_impl->m_started
+        );
+        writer.key("time").value(static_cast<int64_t>(uptime.count()));
+        if (sampler) {
+            sampler(writer);
+        }
+        writer.endObject();
+    }
+    stream << '\n';
+    m_impl->broadcast(stream.str());
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class JsonWriter;
+
+/**
+* @brief Streams the engine's telemetry to clients on a TCP socket
+*
+* Meant for headless nodes, where the statistics can't be watched on
+* screen. Clients connect with anything that speaks lines over TCP, like
+* \c netcat, and receive one JSON object per line:
+* \code
+* {"type":"sample","time":12000, ...}
+* {"type":"reply","command":"trace","ok":true,"message":"..."}
+* \endcode
+* Samples are sent every interval(). Their content comes from the sampler
+* passed to update(), the Engine adds its statistics, system timings,
+* entity counts and memory usage.
+*
+* Clients send commands as lines of a name and optional arguments, like
+* <tt>interval 250</tt>. Commands run on the main thread during update()
+* and each gets a reply. Built in are:
+* - \c commands: Lists the available commands
+* - \c interval \a MILLISECONDS: Sets the sample interval
+* - \c ping: Replies "pong"
+*
+* The sockets are served by a background thread. Without clients, update()
+* returns after checking an atomic counter. Clients that don't keep up with
+* the samples miss some of them instead of holding up the engine.
+*
+* Unless noted otherwise, methods are main thread only.
+*/
+class TelemetryServer {
+
+public:
+
+    /**
+    * @brief Runs a command and returns the message of its reply
+    *
+    * Throw a \c std::exception to reply with an error.
+    */
+    using CommandHandler = std::function<std::string(const std::string& arguments)>;
+
+    /**
+    * @brief Adds the fields of a sample to an open JSON object
+    */
+    using Sampler = std::function<void(JsonWriter& writer)>;
+
+    /**
+    * @brief The default sample interval in milliseconds
+    */
+    static const unsigned int DEFAULT_INTERVAL = 1000;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - TelemetryServer::clientCount
+    * - TelemetryServer::droppedCount
+    * - TelemetryServer::endpoint
+    * - TelemetryServer::interval
+    * - TelemetryServer::isRunning
+    * - TelemetryServer::setInterval
+    * - TelemetryServer::start
+    * - TelemetryServer::stop
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    TelemetryServer();
+
+    /**
+    * @brief Destructor
+    *
+    * Stops the server
+    */
+    ~TelemetryServer();
+
+    TelemetryServer(const TelemetryServer&) = delete;
+
+    TelemetryServer& operator= (const TelemetryServer&) = delete;
+
+    /**
+    * @brief Adds a command, replacing any command of the same name
+    *
+    * @param name
+    *   The first word of the command line
+    * @param description
+    *   Listed by the \c commands command
+    * @param handler
+    *   Called with the rest of the line
+    */
+    void
+    addCommand(
+        const std::string& name,
+        const std::string& description,
+        CommandHandler handler
+    );
+
+    /**
+    * @brief The number of connected clients
+    *
+    * Thread safe.
+    */
+    unsigned int
+    clientCount() const;
+
+    /**
+    * @brief Samples dropped because a client was too slow to receive them
+    *
+    * Thread safe.
+    */
+    uint64_t
+    droppedCount() const;
+
+    /**
+    * @brief The address and port the server listens on, or empty if it
+    * isn't running
+    */
+    std::string
+    endpoint() const;
+
+    /**
+    * @brief Milliseconds between samples
+    */
+    unsigned int
+    interval() const;
+
+    /**
+    * @brief Whether the server is listening
+    */
+    bool
+    isRunning() const;
+
+    /**
+    * @brief Sets the milliseconds between samples
+    *
+    * @param interval
+    *   At least \c 1
+    */
+    void
+    setInterval(
+        unsigned int interval
+    );
+
+    /**
+    * @brief Starts listening
+    *
+    * Restarts the server if it's already running.
+    *
+    * @param endpoint
+    *   A port, listening on the loopback interface only, or
+    *   <tt>ADDRESS:PORT</tt>, e.g. <tt>0.0.0.0:4711</tt> for all interfaces.
+    *   Port \c 0 picks a free port, see endpoint().
+    *
+    * @throws std::runtime_error
+    *   If the endpoint is invalid or can't be listened on
+    */
+    void
+    start(
+        const std::string& endpoint
+    );
+
+    /**
+    * @brief Disconnects all clients and stops listening
+    */
+    void
+    stop();
+
+    /**
+    * @brief Runs the commands received since the last update and sends a
+    * sample if one is due
+    *
+    * @param milliseconds
+    *   The time since the last update
+    * @param sampler
+    *   Adds the fields of a sample, only called if one is due
+    */
+    void
+    update(
+        int milliseconds,
+        const Sampler& sampler
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
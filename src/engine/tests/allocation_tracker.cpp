@@ -0,0 +1,83 @@
+#include "engine/allocation_tracker.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(AllocationTracker, CountsPerScope) {
+    AllocationTracker tracker;
+    size_t first = tracker.addScope("First");
+    size_t second = tracker.addScope("Second");
+    EXPECT_EQ(first, tracker.addScope("First"));
+    {
+        AllocationTracker::Scope scope(&tracker, first);
+        AllocationTracker::record(16);
+        {
+            // The innermost scope counts
+            AllocationTracker::Scope inner(&tracker, second);
+            AllocationTracker::record(100);
+        }
+        AllocationTracker::record(8);
+    }
+    AllocationTracker::record(1000);
+    tracker.endFrame();
+    EXPECT_EQ(2, tracker.systemCounts("First").allocations);
+    EXPECT_EQ(24, tracker.systemCounts("First").bytes);
+    EXPECT_EQ(1, tracker.systemCounts("Second").allocations);
+    EXPECT_EQ(100, tracker.systemCounts("Second").bytes);
+    EXPECT_EQ(0, tracker.systemCounts("Unknown").allocations);
+    // Tracking builds count the test's own allocations as well
+    EXPECT_GE(tracker.frameCounts().allocations, 4);
+    EXPECT_GE(tracker.frameCounts().bytes, 1124);
+    tracker.endFrame();
+    EXPECT_EQ(0, tracker.systemCounts("First").allocations);
+}
+
+
+TEST(AllocationTracker, NullScope) {
+    AllocationTracker tracker;
+    tracker.addScope("System");
+    {
+        AllocationTracker::Scope scope(nullptr, 0);
+        AllocationTracker::record(16);
+    }
+    tracker.endFrame();
+    EXPECT_EQ(0, tracker.systemCounts("System").allocations);
+}
+
+
+TEST(AllocationTracker, StrictModeChecksHotSystemsInSteadyState) {
+    AllocationTracker tracker;
+    // Designated before the scope exists
+    tracker.setHot("Hot", true);
+    size_t hot = tracker.addScope("Hot");
+    size_t cold = tracker.addScope("Cold");
+    EXPECT_TRUE(tracker.isHot("Hot"));
+    EXPECT_FALSE(tracker.isHot("Cold"));
+    tracker.setStrict(true);
+    auto allocateIn = [&tracker] (size_t slot) {
+        AllocationTracker::Scope scope(&tracker, slot);
+        AllocationTracker::record(32);
+    };
+    for (unsigned int i = 0; i < AllocationTracker::STEADY_STATE_FRAMES; ++i) {
+        allocateIn(hot);
+        tracker.endFrame();
+    }
+    EXPECT_EQ(0, tracker.violationCount());
+    allocateIn(cold);
+    tracker.endFrame();
+    EXPECT_EQ(0, tracker.violationCount());
+    allocateIn(hot);
+    tracker.endFrame();
+    allocateIn(hot);
+    tracker.endFrame();
+    EXPECT_EQ(2, tracker.violationCount());
+    tracker.resetSteadyState();
+    allocateIn(hot);
+    tracker.endFrame();
+    EXPECT_EQ(2, tracker.violationCount());
+    tracker.setStrict(false);
+    tracker.setHot("Hot", false);
+    EXPECT_FALSE(tracker.isHot("Hot"));
+}
@@ -0,0 +1,56 @@
+#include "engine/asset_pack.h"
+
+#include "engine/tests/temporary_file.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+
+TEST(AssetPack, RoundTrip) {
+    TemporaryFile file;
+    AssetPackWriter writer;
+    writer.add("models/hex.mesh", "hex");
+    writer.add("materials/textures/sky.dds", std::string(1000, 'x'));
+    writer.add("empty", "");
+    writer.write(file.path);
+    AssetPack pack(file.path);
+    ASSERT_EQ(3u, pack.files().size());
+    // Sorted by name
+    EXPECT_EQ("empty", pack.files()[0].name);
+    EXPECT_EQ("materials/textures/sky.dds", pack.files()[1].name);
+    EXPECT_EQ("models/hex.mesh", pack.files()[2].name);
+    const AssetPack::File* hex = pack.find("models/hex.mesh");
+    ASSERT_NE(nullptr, hex);
+    EXPECT_EQ("hex", std::string(hex->data, hex->size));
+    const AssetPack::File* sky = pack.find("materials/textures/sky.dds");
+    ASSERT_NE(nullptr, sky);
+    EXPECT_EQ(std::string(1000, 'x'), std::string(sky->data, sky->size));
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(sky->data) % AssetPack::ALIGNMENT);
+    EXPECT_EQ(0u, pack.find("empty")->size);
+    EXPECT_EQ(nullptr, pack.find("missing"));
+}
+
+
+TEST(AssetPack, Invalid) {
+    TemporaryFile file;
+    {
+        std::ofstream stream(file.path.string(), std::ios::binary);
+        stream << "THRIVEPK but not really";
+    }
+    EXPECT_THROW(AssetPack pack(file.path), std::runtime_error);
+    TemporaryFile missing;
+    EXPECT_THROW(AssetPack pack(missing.path), std::runtime_error);
+}
+
+
+TEST(AssetPack, Truncated) {
+    TemporaryFile file;
+    AssetPackWriter writer;
+    writer.add("data", std::string(100, 'x'));
+    writer.write(file.path);
+    boost::filesystem::resize_file(file.path, boost::filesystem::file_size(file.path) - 1);
+    EXPECT_THROW(AssetPack pack(file.path), std::runtime_error);
+}
@@ -0,0 +1,46 @@
+#include "engine/cold_data.h"
+
+#include "engine/touchable.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace thrive;
+
+namespace {
+
+struct Settings : public Touchable {
+
+    std::string name = "default";
+
+    double values[8] = {};
+
+};
+
+}
+
+
+TEST(ColdData, ConstructsAndDestroysValue) {
+    size_t before = Component::poolAllocatedBytes();
+    {
+        ColdData<Settings> settings;
+        EXPECT_EQ("default", settings->name);
+        EXPECT_GE(Component::poolAllocatedBytes(), before + sizeof(Settings));
+        settings->name = "changed";
+        (*settings).touch();
+        EXPECT_EQ("changed", settings.get()->name);
+        EXPECT_TRUE(settings->hasChanges());
+    }
+    EXPECT_EQ(before, Component::poolAllocatedBytes());
+}
+
+
+TEST(ColdData, ReusesBlocks) {
+    void* first = nullptr;
+    {
+        ColdData<Settings> settings;
+        first = settings.get();
+    }
+    ColdData<Settings> settings;
+    EXPECT_EQ(first, settings.get());
+}
@@ -0,0 +1,183 @@
+#include "engine/component_collection.h"
+
+#include "engine/entity_manager.h"
+#include "engine/tests/test_component.h"
+#include "engine/touchable.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+TEST(ComponentCollection, DenseArrays) {
+    EntityManager entityManager;
+    EntityId entityIds[3];
+    for (EntityId& entityId : entityIds) {
+        entityId = entityManager.generateNewId();
+        entityManager.addComponent(
+            entityId,
+            make_unique<TestComponent<0>>()
+        );
+    }
+    auto& collection = entityManager.getComponentCollection(
+        TestComponent<0>::TYPE_ID
+    );
+    ASSERT_EQ(3, collection.size());
+    for (size_t i = 0; i < collection.size(); ++i) {
+        EXPECT_EQ(collection.entities()[i], collection.components()[i]->owner());
+    }
+    // Remove first component, the last one should take its place
+    entityManager.removeComponent(entityIds[0], TestComponent<0>::TYPE_ID);
+    entityManager.processCommands();
+    ASSERT_EQ(2, collection.size());
+    EXPECT_EQ(nullptr, collection.get(entityIds[0]));
+    for (size_t i = 0; i < collection.size(); ++i) {
+        EntityId entityId = collection.entities()[i];
+        EXPECT_EQ(entityId, collection.components()[i]->owner());
+        EXPECT_EQ(collection.components()[i].get(), collection.get(entityId));
+    }
+}
+
+
+TEST(ComponentCollection, Overwrite) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    Component* second = entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    auto& collection = entityManager.getComponentCollection(
+        TestComponent<0>::TYPE_ID
+    );
+    EXPECT_EQ(1, collection.size());
+    EXPECT_EQ(second, collection.get(entityId));
+}
+
+
+
+TEST(ComponentCollection, TakeTouched) {
+    EntityManager entityManager;
+    EntityId entityIds[3];
+    for (EntityId& entityId : entityIds) {
+        entityId = entityManager.generateNewId();
+        entityManager.addComponent(
+            entityId,
+            make_unique<TestComponent<0>>()
+        );
+    }
+    auto& collection = entityManager.getComponentCollection(
+        TestComponent<0>::TYPE_ID
+    );
+    std::vector<Component*> touched;
+    // Existing components are queued when tracking starts
+    collection.trackTouched();
+    collection.takeTouched(touched);
+    EXPECT_EQ(3, touched.size());
+    collection.takeTouched(touched);
+    EXPECT_TRUE(touched.empty());
+    // Touching twice lists the component once
+    Touchable touchable;
+    touchable.setComponent(collection.get(entityIds[1]));
+    touchable.touch();
+    touchable.touch();
+    collection.takeTouched(touched);
+    ASSERT_EQ(1, touched.size());
+    EXPECT_EQ(collection.get(entityIds[1]), touched[0]);
+    // New components are queued
+    EntityId newEntity = entityManager.generateNewId();
+    entityManager.addComponent(
+        newEntity,
+        make_unique<TestComponent<0>>()
+    );
+    collection.takeTouched(touched);
+    ASSERT_EQ(1, touched.size());
+    EXPECT_EQ(collection.get(newEntity), touched[0]);
+    // Removed components are skipped
+    touchable.touch();
+    entityManager.removeComponent(entityIds[1], TestComponent<0>::TYPE_ID);
+    entityManager.processCommands();
+    collection.takeTouched(touched);
+    EXPECT_TRUE(touched.empty());
+}
+
+
+TEST(ComponentCollection, TakeChanges) {
+    EntityManager entityManager;
+    auto& collection = entityManager.getComponentCollection(
+        TestComponent<0>::TYPE_ID
+    );
+    // Nothing is logged without observers
+    EntityId before = entityManager.generateNewId();
+    entityManager.addComponent(before, make_unique<TestComponent<0>>());
+    unsigned int first = collection.registerObserver();
+    unsigned int second = collection.registerObserver();
+    std::vector<ComponentCollection::Change> changes;
+    collection.takeChanges(first, changes);
+    EXPECT_TRUE(changes.empty());
+    // Changes arrive in order
+    EntityId entityId = entityManager.generateNewId();
+    Component* added = entityManager.addComponent(
+        entityId, 
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.removeComponent(before, TestComponent<0>::TYPE_ID);
+    entityManager.processCommands();
+    collection.takeChanges(first, changes);
+    ASSERT_EQ(2, changes.size());
+    EXPECT_TRUE(changes[0].isAdded);
+    EXPECT_EQ(entityId, changes[0].entityId);
+    EXPECT_EQ(added, changes[0].component);
+    EXPECT_FALSE(changes[1].isAdded);
+    EXPECT_EQ(before, changes[1].entityId);
+    // The removed component is still alive, but no longer owned
+    EXPECT_EQ(NULL_ENTITY, changes[1].component->owner());
+    collection.takeChanges(first, changes);
+    EXPECT_TRUE(changes.empty());
+    // Each observer takes its own batch
+    collection.takeChanges(second, changes);
+    EXPECT_EQ(2, changes.size());
+    // Replacing a component is a removal and an addition
+    Component* replacement = entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    collection.takeChanges(first, changes);
+    ASSERT_EQ(2, changes.size());
+    EXPECT_FALSE(changes[0].isAdded);
+    EXPECT_EQ(added, changes[0].component);
+    EXPECT_TRUE(changes[1].isAdded);
+    EXPECT_EQ(replacement, changes[1].component);
+    // Unregistered observers take nothing
+    collection.unregisterObserver(first);
+    collection.takeChanges(first, changes);
+    EXPECT_TRUE(changes.empty());
+    collection.unregisterObserver(second);
+}
+
+
+TEST(ComponentCollection, MemoryUsage) {
+    EntityManager entityManager;
+    auto& collection = entityManager.getComponentCollection(
+        TestComponent<0>::TYPE_ID
+    );
+    size_t emptyUsage = collection.memoryUsage();
+    for (int i = 0; i < 10; ++i) {
+        entityManager.addComponent(
+            entityManager.generateNewId(),
+            make_unique<TestComponent<0>>()
+        );
+    }
+    // Test components are not registered with the factory, so only the
+    // collection's own arrays count
+    EXPECT_GE(
+        collection.memoryUsage(), 
+        emptyUsage + 10 * (sizeof(Component*) + sizeof(EntityId))
+    );
+    std::vector<const ComponentCollection*> collections = entityManager.componentCollections();
+    ASSERT_EQ(1u, collections.size());
+    EXPECT_EQ(&collection, collections[0]);
+}
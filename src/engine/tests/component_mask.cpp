@@ -0,0 +1,42 @@
+#include "engine/component_mask.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(ComponentMask, SetAndReset) {
+    ComponentMask mask;
+    EXPECT_TRUE(mask.empty());
+    mask.set(1);
+    // Far apart type ids use neighbouring bits
+    mask.set(50000);
+    EXPECT_TRUE(mask.test(1));
+    EXPECT_TRUE(mask.test(50000));
+    EXPECT_FALSE(mask.test(2));
+    mask.reset(50000);
+    EXPECT_FALSE(mask.test(50000));
+    EXPECT_EQ(ComponentMask({1}), mask);
+    mask.reset(1);
+    EXPECT_TRUE(mask.empty());
+    EXPECT_EQ(ComponentMask(), mask);
+}
+
+
+TEST(ComponentMask, ContainsAllAndAny) {
+    // More types than fit into one word
+    std::vector<ComponentTypeId> typeIds;
+    for (ComponentTypeId typeId = 100; typeId < 200; ++typeId) {
+        typeIds.push_back(typeId);
+    }
+    ComponentMask all(typeIds);
+    ComponentMask some({150, 199});
+    ComponentMask other({150, 300});
+    EXPECT_TRUE(all.containsAll(some));
+    EXPECT_FALSE(some.containsAll(all));
+    EXPECT_FALSE(all.containsAll(other));
+    EXPECT_TRUE(all.containsAny(other));
+    EXPECT_FALSE(all.containsAny(ComponentMask({300})));
+    EXPECT_TRUE(all.containsAll(ComponentMask()));
+    EXPECT_FALSE(all.containsAny(ComponentMask()));
+}
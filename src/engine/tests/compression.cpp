@@ -0,0 +1,97 @@
+#include "engine/compression.h"
+
+#include "engine/thread_pool.h"
+
+#include <gtest/gtest.h>
+#include <iterator>
+#include <random>
+#include <sstream>
+
+using namespace thrive;
+
+namespace {
+
+std::string
+roundTrip(
+    const std::string& data,
+    CompressionLevel level,
+    size_t* compressedSize = nullptr
+) {
+    std::stringstream stream;
+    writeCompressed(stream, data, level);
+    if (compressedSize) {
+        *compressedSize = stream.str().size();
+    }
+    EXPECT_TRUE(CompressedInputStream::isCompressed(stream));
+    CompressedInputStream decompressed(stream);
+    return std::string(
+        std::istreambuf_iterator<char>(decompressed),
+        std::istreambuf_iterator<char>()
+    );
+}
+
+}
+
+
+TEST(Compression, RoundTrip) {
+    std::mt19937 random(42);
+    std::string noise(300000, '\0');
+    for (char& c : noise) {
+        c = static_cast<char>(random());
+    }
+    std::string text;
+    while (text.size() < 600000) {
+        text += "entity " + std::to_string(random() % 100) + " component Transform; ";
+    }
+    for (CompressionLevel level : {CompressionLevel::None, CompressionLevel::Fast, CompressionLevel::High}) {
+        EXPECT_EQ("", roundTrip("", level));
+        EXPECT_EQ("abc", roundTrip("abc", level));
+        EXPECT_EQ(noise, roundTrip(noise, level));
+        size_t compressedSize = 0;
+        EXPECT_EQ(text, roundTrip(text, level, &compressedSize));
+        if (level != CompressionLevel::None) {
+            EXPECT_LT(compressedSize, text.size() / 3);
+        }
+    }
+    std::stringstream plain("uncompressed");
+    EXPECT_FALSE(CompressedInputStream::isCompressed(plain));
+    EXPECT_EQ('u', plain.get());
+}
+
+
+TEST(Compression, Seek) {
+    std::string data;
+    for (unsigned int i = 0; i < 200000; ++i) {
+        data += std::to_string(i % 1000) + ",";
+    }
+    std::stringstream stream;
+    writeCompressed(stream, data, CompressionLevel::Fast);
+    CompressedInputStream decompressed(stream);
+    char buffer[8];
+    for (size_t position : {size_t(600000), size_t(10), size_t(data.size() - 8), size_t(300000)}) {
+        decompressed.seekg(position);
+        decompressed.read(buffer, sizeof(buffer));
+        EXPECT_EQ(data.substr(position, sizeof(buffer)), std::string(buffer, sizeof(buffer)));
+        EXPECT_EQ(std::streampos(position + sizeof(buffer)), decompressed.tellg());
+    }
+    decompressed.seekg(-4, std::ios_base::end);
+    decompressed.read(buffer, 4);
+    EXPECT_EQ(data.substr(data.size() - 4), std::string(buffer, 4));
+    EXPECT_EQ(std::char_traits<char>::eof(), decompressed.get());
+}
+
+
+TEST(Compression, ThreadPool) {
+    std::string data;
+    for (unsigned int i = 0; i < 300000; ++i) {
+        data += std::to_string(i % 777) + ";";
+    }
+    ThreadPool threadPool(3);
+    for (CompressionLevel level : {CompressionLevel::None, CompressionLevel::Fast, CompressionLevel::High}) {
+        std::stringstream serial;
+        writeCompressed(serial, data, level);
+        std::stringstream parallel;
+        writeCompressed(parallel, data, level, &threadPool);
+        EXPECT_EQ(serial.str(), parallel.str());
+    }
+}
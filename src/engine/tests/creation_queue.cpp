@@ -0,0 +1,80 @@
+#include "engine/creation_queue.h"
+
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(CreationQueue, LowestPriorityFirst) {
+    CreationQueue queue;
+    std::vector<int> order;
+    queue.push([&order] () { order.push_back(3); }, 9.0f);
+    queue.push([&order] () { order.push_back(1); }, 1.0f);
+    queue.push([&order] () { order.push_back(2); }, 4.0f);
+    // Ties run in the order they were pushed
+    queue.push([&order] () { order.push_back(4); }, 9.0f);
+    EXPECT_EQ(4, queue.size());
+    EXPECT_EQ(4, queue.drain());
+    EXPECT_EQ(std::vector<int>({1, 2, 3, 4}), order);
+    EXPECT_EQ(0, queue.size());
+}
+
+
+TEST(CreationQueue, MaxJobs) {
+    CreationQueue queue;
+    queue.setBudget(0, 2);
+    int calls = 0;
+    for (int i = 0; i < 5; ++i) {
+        queue.push([&calls] () { calls += 1; });
+    }
+    EXPECT_EQ(2, queue.drain());
+    EXPECT_EQ(2, calls);
+    EXPECT_EQ(3, queue.size());
+    queue.drain();
+    queue.drain();
+    EXPECT_EQ(5, calls);
+    EXPECT_EQ(0, queue.drain());
+}
+
+
+TEST(CreationQueue, TimeBudget) {
+    CreationQueue queue;
+    queue.setBudget(5, 0);
+    for (int i = 0; i < 3; ++i) {
+        queue.push([] () {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        });
+    }
+    // A single job over budget still runs
+    EXPECT_EQ(1, queue.drain());
+    EXPECT_EQ(2, queue.size());
+}
+
+
+TEST(CreationQueue, PushedWhileDraining) {
+    CreationQueue queue;
+    int calls = 0;
+    queue.push([&] () {
+        calls += 1;
+        queue.push([&calls] () { calls += 1; }, -1.0f);
+    });
+    EXPECT_EQ(1, queue.drain());
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(1, queue.size());
+    EXPECT_EQ(1, queue.drain());
+    EXPECT_EQ(2, calls);
+}
+
+
+TEST(CreationQueue, Clear) {
+    CreationQueue queue;
+    int calls = 0;
+    queue.push([&calls] () { calls += 1; });
+    queue.clear();
+    EXPECT_EQ(0, queue.size());
+    EXPECT_EQ(0, queue.drain());
+    EXPECT_EQ(0, calls);
+}
@@ -0,0 +1,52 @@
+#include "engine/double_buffer.h"
+
+#include "engine/entity_manager.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace {
+
+// An id of its own, the registration holds for all tests
+class BufferedComponent : public TestComponent<8> {
+
+public:
+
+    int m_value = 0;
+
+    DoubleBuffer<int> m_lastFrameValue;
+
+};
+
+const bool isBufferedComponentRegistered = DoubleBuffers::registerComponent<BufferedComponent>(
+    [] (BufferedComponent& component) {
+        component.m_lastFrameValue.flip(component.m_value);
+    }
+);
+
+}
+
+
+TEST(DoubleBuffer, FlipsRegisteredComponents) {
+    EXPECT_TRUE(isBufferedComponentRegistered);
+    EXPECT_TRUE(DoubleBuffers::isRegistered(TestComponent<8>::TYPE_ID));
+    EXPECT_FALSE(DoubleBuffers::isRegistered(TestComponent<0>::TYPE_ID));
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    entityManager.addComponent(entityId, make_unique<BufferedComponent>());
+    auto component = static_cast<BufferedComponent*>(
+        entityManager.getComponent(entityId, TestComponent<8>::TYPE_ID)
+    );
+    component->m_value = 1;
+    EXPECT_EQ(0, component->m_lastFrameValue.previous());
+    DoubleBuffers::flip(entityManager);
+    EXPECT_EQ(1, component->m_lastFrameValue.previous());
+    // Writes only show after the next flip
+    component->m_value = 2;
+    EXPECT_EQ(1, component->m_lastFrameValue.previous());
+    DoubleBuffers::flip(entityManager);
+    EXPECT_EQ(2, component->m_lastFrameValue.previous());
+}
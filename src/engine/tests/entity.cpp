@@ -54,7 +54,7 @@ TEST_F(EntityTest, RemoveComponent) {
     entity.addComponent(make_unique<TestComponent<0>>());
     EXPECT_TRUE(entity.hasComponent(TestComponent<0>::TYPE_ID));
     entity.removeComponent(TestComponent<0>::TYPE_ID);
-    gameState->entityManager().processRemovals();
+    gameState->entityManager().processCommands();
     EXPECT_FALSE(entity.hasComponent(TestComponent<0>::TYPE_ID));
 }
 
@@ -1,13 +1,50 @@
 #include "engine/entity_filter.h"
 
+#include "engine/component_factory.h"
 #include "engine/entity_manager.h"
 #include "engine/tests/test_component.h"
 #include "util/make_unique.h"
 
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace thrive;
 
+namespace {
+
+struct Changes {
+
+    std::unordered_set<EntityId> added;
+
+    std::vector<EntityId> order;
+
+    std::unordered_set<EntityId> removed;
+
+};
+
+template<typename Filter>
+Changes
+takeChanges(
+    Filter& filter
+) {
+    Changes changes;
+    filter.takeChanges(
+        [&changes] (EntityId entityId, const typename Filter::ComponentGroup&) {
+            changes.added.insert(entityId);
+            changes.order.push_back(entityId);
+        },
+        [&changes] (EntityId entityId) {
+            changes.removed.insert(entityId);
+            changes.order.push_back(entityId);
+        }
+    );
+    return changes;
+}
+
+}
+
 TEST(EntityFilter, Initialization) {
     EntityManager entityManager;
     // Add component
@@ -46,7 +83,7 @@ TEST(EntityFilter, Single) {
         entityId,
         TestComponent<0>::TYPE_ID
     );
-    entityManager.processRemovals();
+    entityManager.processCommands();
     // Check filter
     filteredEntities = filter.entities();
     EXPECT_EQ(0, filteredEntities.count(entityId));
@@ -88,7 +125,7 @@ TEST(EntityFilter, Multiple) {
         entityId,
         TestComponent<1>::TYPE_ID
     );
-    entityManager.processRemovals();
+    entityManager.processCommands();
     // Check filter
     filteredEntities = filter.entities();
     EXPECT_EQ(0, filteredEntities.count(entityId));
@@ -138,7 +175,7 @@ TEST(EntityFilter, Optional) {
         entityId,
         TestComponent<1>::TYPE_ID
     );
-    entityManager.processRemovals();
+    entityManager.processCommands();
     // Check filter
     filteredEntities = filter.entities();
     EXPECT_EQ(1, filteredEntities.count(entityId));
@@ -176,7 +213,7 @@ TEST(EntityFilter, OptionalOnly) {
         entityId,
         TestComponent<0>::TYPE_ID
     );
-    entityManager.processRemovals();
+    entityManager.processCommands();
     // Check filter
     filteredEntities = filter.entities();
     EXPECT_EQ(0, filteredEntities.count(entityId));
@@ -184,6 +221,35 @@ TEST(EntityFilter, OptionalOnly) {
 }
 
 
+TEST(EntityFilter, RequireTag) {
+    EntityManager entityManager;
+    ComponentTypeId tag = ComponentFactory::registerTag("EntityFilterTest");
+    using TestFilter = EntityFilter<
+        TestComponent<0>
+    >;
+    TestFilter filter(true);
+    filter.requireTag(tag);
+    filter.setEntityManager(&entityManager);
+    EntityId untagged = entityManager.generateNewId();
+    entityManager.addComponent(untagged, make_unique<TestComponent<0>>());
+    EntityId tagged = entityManager.generateNewId();
+    entityManager.addComponent(tagged, make_unique<TestComponent<0>>());
+    entityManager.addTag(tagged, tag);
+    EXPECT_EQ(1, filter.entities().size());
+    EXPECT_TRUE(filter.containsEntity(tagged));
+    Changes changes = takeChanges(filter);
+    EXPECT_EQ(std::vector<EntityId>({tagged}), changes.order);
+    // The tag has no column
+    EXPECT_TRUE(std::get<0>(filter.entities().at(tagged)) != nullptr);
+    entityManager.removeTag(tagged, tag);
+    EXPECT_TRUE(filter.containsEntity(tagged));
+    entityManager.processCommands();
+    EXPECT_FALSE(filter.containsEntity(tagged));
+    changes = takeChanges(filter);
+    EXPECT_EQ(1, changes.removed.count(tagged));
+}
+
+
 TEST(EntityFilter, Record) {
     EntityManager entityManager;
     using TestFilter = EntityFilter<
@@ -200,15 +266,324 @@ TEST(EntityFilter, Record) {
         make_unique<TestComponent<0>>()
     );
     // Check added entities
-    EXPECT_EQ(1, filter.addedEntities().count(entityId));
+    Changes changes = takeChanges(filter);
+    EXPECT_EQ(1, changes.added.count(entityId));
+    EXPECT_EQ(0, changes.removed.size());
     // Remove component
     entityManager.removeComponent(
         entityId,
         TestComponent<0>::TYPE_ID
     );
-    entityManager.processRemovals();
+    entityManager.processCommands();
     // Check removed entities
-    EXPECT_EQ(1, filter.removedEntities().count(entityId));
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.added.size());
+    EXPECT_EQ(1, changes.removed.count(entityId));
+    // Nothing left to take
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.order.size());
+}
+
+
+TEST(EntityFilter, TakeChanges) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>,
+        Optional<TestComponent<1>>
+    >;
+    EntityId existing = entityManager.generateNewId();
+    entityManager.addComponent(
+        existing,
+        make_unique<TestComponent<0>>()
+    );
+    TestFilter filter(true);
+    filter.setEntityManager(&entityManager);
+    // The first take reports the existing entities
+    Changes changes = takeChanges(filter);
+    EXPECT_EQ(1, changes.added.count(existing));
+    EXPECT_EQ(1, changes.order.size());
+    // Entering and leaving in between is not reported
+    EntityId transient = entityManager.generateNewId();
+    entityManager.addComponent(
+        transient,
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.removeEntity(transient);
+    entityManager.processCommands();
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.order.size());
+    // Leaving and coming back is a removal followed by an addition
+    entityManager.removeComponent(
+        existing,
+        TestComponent<0>::TYPE_ID
+    );
+    entityManager.processCommands();
+    entityManager.addComponent(
+        existing,
+        make_unique<TestComponent<0>>()
+    );
+    changes = takeChanges(filter);
+    ASSERT_EQ(2, changes.order.size());
+    EXPECT_EQ(1, changes.removed.count(existing));
+    EXPECT_EQ(1, changes.added.count(existing));
+    // Replacing a required component is reported the same way
+    entityManager.addComponent(
+        existing,
+        make_unique<TestComponent<0>>()
+    );
+    changes = takeChanges(filter);
+    EXPECT_EQ(1, changes.removed.count(existing));
+    EXPECT_EQ(1, changes.added.count(existing));
+    // An added optional component is only an addition
+    entityManager.addComponent(
+        existing,
+        make_unique<TestComponent<1>>()
+    );
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.removed.size());
+    EXPECT_EQ(1, changes.added.count(existing));
+    // Removing it again is not reported
+    entityManager.removeComponent(
+        existing,
+        TestComponent<1>::TYPE_ID
+    );
+    entityManager.processCommands();
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.order.size());
+    filter.setEntityManager(nullptr);
+}
+
+
+TEST(EntityFilter, UnreadFilterSurvivesLongMoveLog) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>
+    >;
+    EntityId existing = entityManager.generateNewId();
+    entityManager.addComponent(
+        existing,
+        make_unique<TestComponent<0>>()
+    );
+    TestFilter filter(true);
+    filter.setEntityManager(&entityManager);
+    takeChanges(filter);
+    entityManager.removeEntity(existing);
+    entityManager.processCommands();
+    // More moves than the entity manager keeps logged
+    EntityId unrelated = entityManager.generateNewId();
+    for (size_t i = 0; i < (1 << 15) + 1; ++i) {
+        entityManager.addComponent(
+            unrelated,
+            make_unique<TestComponent<1>>()
+        );
+        entityManager.removeComponent(
+            unrelated,
+            TestComponent<1>::TYPE_ID
+        );
+        entityManager.processCommands();
+    }
+    EntityId added = entityManager.generateNewId();
+    entityManager.addComponent(
+        added,
+        make_unique<TestComponent<0>>()
+    );
+    // Moves from before and after the overflow are both reported
+    Changes changes = takeChanges(filter);
+    ASSERT_EQ(2, changes.order.size());
+    EXPECT_EQ(1, changes.removed.count(existing));
+    EXPECT_EQ(1, changes.added.count(added));
+    changes = takeChanges(filter);
+    EXPECT_EQ(0, changes.order.size());
+    filter.setEntityManager(nullptr);
 }
 
 
+TEST(EntityFilter, Suspend) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>,
+        Optional<TestComponent<1>>
+    >;
+    EntityId kept = entityManager.generateNewId();
+    EntityId removed = entityManager.generateNewId();
+    EntityId replaced = entityManager.generateNewId();
+    EntityId optional = entityManager.generateNewId();
+    for (EntityId entityId : {kept, removed, replaced, optional}) {
+        entityManager.addComponent(
+            entityId,
+            make_unique<TestComponent<0>>()
+        );
+    }
+    TestFilter filter(true);
+    filter.setEntityManager(&entityManager);
+    takeChanges(filter);
+    // Not taken before suspending
+    EntityId early = entityManager.generateNewId();
+    entityManager.addComponent(
+        early,
+        make_unique<TestComponent<0>>()
+    );
+    filter.setSuspended(true);
+    EXPECT_TRUE(filter.isSuspended());
+    EXPECT_EQ(0, filter.entities().size());
+    // Changes while suspended
+    EntityId added = entityManager.generateNewId();
+    entityManager.addComponent(
+        added,
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.removeEntity(removed);
+    entityManager.addComponent(
+        replaced,
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.addComponent(
+        optional,
+        make_unique<TestComponent<1>>()
+    );
+    entityManager.processCommands();
+    EXPECT_EQ(0, filter.entities().size());
+    EXPECT_EQ(0, takeChanges(filter).order.size());
+    // Catches up when resumed
+    filter.setSuspended(false);
+    EXPECT_FALSE(filter.isSuspended());
+    EXPECT_EQ(5, filter.entities().size());
+    Changes changes = takeChanges(filter);
+    EXPECT_EQ(std::unordered_set<EntityId>({removed, replaced}), changes.removed);
+    EXPECT_EQ(std::unordered_set<EntityId>({early, added, replaced, optional}), changes.added);
+    EXPECT_EQ(6, changes.order.size());
+    // Listens again
+    entityManager.removeEntity(kept);
+    entityManager.processCommands();
+    changes = takeChanges(filter);
+    EXPECT_EQ(1, changes.removed.count(kept));
+    filter.setEntityManager(nullptr);
+}
+
+
+
+
+TEST(EntityFilter, UnrelatedComponent) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>
+    >;
+    TestFilter filter(true);
+    filter.setEntityManager(&entityManager);
+    EntityId entityId = entityManager.generateNewId();
+    auto component = entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    filter.clearChanges();
+    // Adding an unrelated component moves the entity to another archetype
+    entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<1>>()
+    );
+    EXPECT_EQ(0, takeChanges(filter).order.size());
+    ASSERT_EQ(1, filter.entities().count(entityId));
+    EXPECT_EQ(component, std::get<0>(filter.entities().at(entityId)));
+    // Removing it again doesn't affect the filter either
+    entityManager.removeComponent(
+        entityId,
+        TestComponent<1>::TYPE_ID
+    );
+    entityManager.processCommands();
+    EXPECT_EQ(0, takeChanges(filter).order.size());
+    EXPECT_EQ(1, filter.entities().count(entityId));
+}
+
+
+TEST(EntityFilter, CreateEntities) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>,
+        Optional<TestComponent<1>>
+    >;
+    TestFilter filter(true);
+    filter.setEntityManager(&entityManager);
+    std::vector<EntityManager::ComponentList> entities(2);
+    entities[0].push_back(make_unique<TestComponent<0>>());
+    entities[1].push_back(make_unique<TestComponent<0>>());
+    entities[1].push_back(make_unique<TestComponent<1>>());
+    auto entityIds = entityManager.createEntities(std::move(entities));
+    EXPECT_EQ(2, filter.entities().size());
+    EXPECT_EQ(2, takeChanges(filter).added.size());
+    EXPECT_EQ(nullptr, std::get<1>(filter.entities().at(entityIds[0])));
+    EXPECT_NE(nullptr, std::get<1>(filter.entities().at(entityIds[1])));
+}
+
+
+TEST(EntityFilter, ParallelForEach) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>,
+        Optional<TestComponent<1>>
+    >;
+    TestFilter filter;
+    filter.setEntityManager(&entityManager);
+    // Spread the entities over two archetypes
+    std::vector<EntityManager::ComponentList> entities(100);
+    for (size_t i = 0; i < entities.size(); ++i) {
+        entities[i].push_back(make_unique<TestComponent<0>>());
+        if (i % 3 == 0) {
+            entities[i].push_back(make_unique<TestComponent<1>>());
+        }
+    }
+    entityManager.createEntities(std::move(entities));
+    ThreadPool threadPool(3);
+    boost::mutex mutex;
+    std::unordered_map<EntityId, TestFilter::ComponentGroup> visited;
+    filter.parallelForEach(threadPool, 
+        [&] (EntityId entityId, const TestFilter::ComponentGroup& group) {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            EXPECT_TRUE(visited.emplace(entityId, group).second);
+        },
+        7
+    );
+    EXPECT_EQ(filter.entities().size(), visited.size());
+    for (const auto& value : filter) {
+        EXPECT_EQ(value.second, visited.at(value.first));
+    }
+}
+
+
+TEST(EntityFilter, ForEachChunk) {
+    EntityManager entityManager;
+    using TestFilter = EntityFilter<
+        TestComponent<0>,
+        Optional<TestComponent<1>>
+    >;
+    TestFilter filter;
+    filter.setEntityManager(&entityManager);
+    std::vector<EntityManager::ComponentList> entities(10);
+    for (size_t i = 0; i < entities.size(); ++i) {
+        entities[i].push_back(make_unique<TestComponent<0>>());
+        if (i % 2 == 0) {
+            entities[i].push_back(make_unique<TestComponent<1>>());
+        }
+    }
+    entityManager.createEntities(std::move(entities));
+    // Not relevant to the filter
+    entityManager.addComponent(
+        entityManager.generateNewId(),
+        make_unique<TestComponent<1>>()
+    );
+    size_t chunks = 0;
+    size_t rows = 0;
+    filter.forEachChunk([&] (const TestFilter::Chunk& chunk) {
+        chunks += 1;
+        ASSERT_NE(nullptr, chunk.column<0>());
+        for (size_t row = 0; row < chunk.size(); ++row) {
+            rows += 1;
+            const TestFilter::ComponentGroup& group = filter.entities().at(
+                chunk.entities()[row]
+            );
+            EXPECT_EQ(std::get<0>(group), chunk.component<0>(row));
+            EXPECT_EQ(std::get<1>(group), chunk.component<1>(row));
+        }
+    });
+    EXPECT_EQ(2, chunks);
+    EXPECT_EQ(filter.entities().size(), rows);
+}
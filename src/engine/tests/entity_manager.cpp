@@ -0,0 +1,618 @@
+#include "engine/entity_manager.h"
+
+#include "engine/archetype.h"
+#include "engine/component_factory.h"
+#include "engine/component_mask.h"
+#include "engine/entity_query.h"
+#include "engine/thread_pool.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <map>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+using namespace thrive;
+
+TEST(EntityManager, RecycleIds) {
+    EntityManager entityManager;
+    std::vector<EntityId> entityIds;
+    for (int i = 0; i < 2000; ++i) {
+        EntityId entityId = entityManager.generateNewId();
+        entityManager.addComponent(
+            entityId,
+            make_unique<TestComponent<0>>()
+        );
+        entityIds.push_back(entityId);
+    }
+    for (EntityId entityId : entityIds) {
+        entityManager.removeEntity(entityId);
+    }
+    entityManager.processCommands();
+    EntityId staleId = entityIds.front();
+    EXPECT_FALSE(entityManager.exists(staleId));
+    // The first removed slot is recycled with a new generation
+    EntityId recycledId = entityManager.generateNewId();
+    EXPECT_EQ(entityIndex(staleId), entityIndex(recycledId));
+    EXPECT_NE(staleId, recycledId);
+    entityManager.addComponent(
+        recycledId,
+        make_unique<TestComponent<0>>()
+    );
+    EXPECT_TRUE(entityManager.exists(recycledId));
+    EXPECT_FALSE(entityManager.exists(staleId));
+    EXPECT_EQ(nullptr, entityManager.getComponent(staleId, TestComponent<0>::TYPE_ID));
+    EXPECT_THROW(
+        entityManager.addComponent(staleId, make_unique<TestComponent<0>>()),
+        std::runtime_error
+    );
+}
+
+
+TEST(EntityManager, GeneratesUniqueIdsOnThreads) {
+    EntityManager entityManager;
+    std::vector<EntityId> removedIds;
+    for (int i = 0; i < 2000; ++i) {
+        EntityId entityId = entityManager.generateNewId();
+        entityManager.addComponent(entityId, make_unique<TestComponent<0>>());
+        removedIds.push_back(entityId);
+    }
+    for (EntityId entityId : removedIds) {
+        entityManager.removeEntity(entityId);
+    }
+    entityManager.processCommands();
+    // Enough free slots to recycle some of them concurrently
+    std::vector<std::vector<EntityId>> threadIds(4);
+    std::vector<boost::thread> threads;
+    for (auto& ids : threadIds) {
+        threads.emplace_back([&entityManager, &ids] () {
+            for (int i = 0; i < 1000; ++i) {
+                ids.push_back(entityManager.generateNewId());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::unordered_set<EntityId> uniqueIds(removedIds.begin(), removedIds.end());
+    for (const auto& ids : threadIds) {
+        for (EntityId entityId : ids) {
+            EXPECT_TRUE(uniqueIds.insert(entityId).second);
+            // Usable without further ado
+            entityManager.addComponent(entityId, make_unique<TestComponent<0>>());
+        }
+    }
+    EXPECT_EQ(4000, entityManager.entityCount());
+    for (EntityId entityId : removedIds) {
+        EXPECT_FALSE(entityManager.exists(entityId));
+    }
+}
+
+
+TEST(EntityManager, NamedIdsAreNotRecycled) {
+    EntityManager entityManager;
+    EntityId namedId = entityManager.getNamedId("test");
+    entityManager.addComponent(
+        namedId,
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.removeEntity(namedId);
+    entityManager.processCommands();
+    EXPECT_FALSE(entityManager.exists(namedId));
+    EXPECT_EQ(namedId, entityManager.getNamedId("test"));
+    entityManager.addComponent(
+        namedId,
+        make_unique<TestComponent<0>>()
+    );
+    EXPECT_TRUE(entityManager.exists(namedId));
+}
+
+
+TEST(EntityManager, InternedNames) {
+    EntityManager::NameId nameId = EntityManager::internName("interned");
+    EXPECT_NE(EntityManager::NULL_NAME, nameId);
+    EXPECT_EQ(nameId, EntityManager::internName("interned"));
+    EXPECT_EQ(EntityManager::NULL_NAME, EntityManager::internName(""));
+    EntityManager entityManager;
+    EXPECT_EQ(NULL_ENTITY, entityManager.getNamedId(EntityManager::NULL_NAME));
+    EntityId namedId = entityManager.getNamedId(nameId);
+    EXPECT_EQ(namedId, entityManager.getNamedId("interned"));
+    EXPECT_EQ(namedId, entityManager.getNamedId(nameId));
+    // Names may be given new ids by clear()
+    uint32_t revision = entityManager.namesRevision();
+    entityManager.clear();
+    EXPECT_NE(revision, entityManager.namesRevision());
+    EXPECT_EQ(entityManager.getNamedId("interned"), entityManager.getNamedId(nameId));
+}
+
+
+TEST(EntityManager, CreateEntities) {
+    EntityManager entityManager;
+    std::vector<EntityManager::ComponentList> entities(3);
+    for (auto& components : entities) {
+        components.push_back(make_unique<TestComponent<1>>());
+        components.push_back(make_unique<TestComponent<0>>());
+    }
+    auto entityIds = entityManager.createEntities(std::move(entities));
+    ASSERT_EQ(3, entityIds.size());
+    EXPECT_EQ(3u, entityManager.entityCount());
+    for (EntityId entityId : entityIds) {
+        EXPECT_TRUE(entityManager.exists(entityId));
+        EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<0>::TYPE_ID));
+        EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<1>::TYPE_ID));
+    }
+    // Removing one component still works on batch-created entities
+    entityManager.removeComponent(entityIds[1], TestComponent<0>::TYPE_ID);
+    entityManager.processCommands();
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityIds[1], TestComponent<0>::TYPE_ID));
+    EXPECT_TRUE(entityManager.exists(entityIds[1]));
+    entityManager.removeEntity(entityIds[2]);
+    entityManager.processCommands();
+    EXPECT_EQ(2u, entityManager.entityCount());
+}
+
+
+TEST(EntityManager, RemoveEntities) {
+    EntityManager entityManager;
+    std::vector<EntityId> removed;
+    std::vector<EntityId> kept;
+    for (int i = 0; i < 10; ++i) {
+        EntityId entityId = entityManager.generateNewId();
+        entityManager.addComponent(entityId, make_unique<TestComponent<0>>());
+        if (i % 2 == 0) {
+            entityManager.addComponent(entityId, make_unique<TestComponent<1>>());
+            removed.push_back(entityId);
+        }
+        else {
+            kept.push_back(entityId);
+        }
+    }
+    entityManager.removeEntities(removed);
+    // Deferred like removeEntity()
+    EXPECT_TRUE(entityManager.exists(removed[0]));
+    entityManager.processCommands();
+    for (EntityId entityId : removed) {
+        EXPECT_FALSE(entityManager.exists(entityId));
+    }
+    for (EntityId entityId : kept) {
+        EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<0>::TYPE_ID));
+    }
+    EXPECT_EQ(0u, entityManager.getComponentCollection(TestComponent<1>::TYPE_ID).components().size());
+}
+
+
+TEST(EntityManager, GetComponentOfUnusedType) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityId, TestComponent<3>::TYPE_ID));
+    entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityId, TestComponent<3>::TYPE_ID));
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityId, NULL_COMPONENT_TYPE));
+    EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<0>::TYPE_ID));
+}
+
+
+TEST(EntityManager, ComponentMask) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    EXPECT_TRUE(entityManager.componentMask(entityId).empty());
+    entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<0>>()
+    );
+    entityManager.addComponent(
+        entityId,
+        make_unique<TestComponent<1>>()
+    );
+    const ComponentMask& mask = entityManager.componentMask(entityId);
+    EXPECT_TRUE(mask.containsAll(ComponentMask({
+        TestComponent<0>::TYPE_ID,
+        TestComponent<1>::TYPE_ID
+    })));
+    EXPECT_TRUE(mask.containsAny(ComponentMask({
+        TestComponent<1>::TYPE_ID,
+        TestComponent<2>::TYPE_ID
+    })));
+    EXPECT_FALSE(mask.test(TestComponent<2>::TYPE_ID));
+    entityManager.removeEntity(entityId);
+    entityManager.processCommands();
+    EXPECT_TRUE(entityManager.componentMask(entityId).empty());
+}
+
+
+TEST(EntityManager, DeferredCommands) {
+    EntityManager entityManager;
+    EntityId existingId = entityManager.generateNewId();
+    entityManager.addComponent(
+        existingId,
+        make_unique<TestComponent<0>>()
+    );
+    EntityManager::ComponentList components;
+    components.push_back(make_unique<TestComponent<0>>());
+    EntityId createdId = entityManager.deferCreateEntity(std::move(components));
+    entityManager.deferAddComponent(
+        existingId,
+        make_unique<TestComponent<1>>()
+    );
+    // Nothing changes until the commands are processed
+    EXPECT_FALSE(entityManager.exists(createdId));
+    EXPECT_EQ(nullptr, entityManager.getComponent(existingId, TestComponent<1>::TYPE_ID));
+    entityManager.processCommands();
+    EXPECT_TRUE(entityManager.exists(createdId));
+    EXPECT_NE(nullptr, entityManager.getComponent(existingId, TestComponent<1>::TYPE_ID));
+    // Commands are executed in order, so adding to a removed entity is void
+    entityManager.removeEntity(createdId);
+    entityManager.deferAddComponent(
+        createdId,
+        make_unique<TestComponent<1>>()
+    );
+    entityManager.processCommands();
+    EXPECT_FALSE(entityManager.exists(createdId));
+}
+
+
+TEST(EntityManager, Tags) {
+    EntityManager entityManager;
+    ComponentTypeId tag = ComponentFactory::registerTag("EntityManagerTest");
+    EXPECT_EQ(tag, ComponentFactory::registerTag("EntityManagerTest"));
+    EXPECT_TRUE(ComponentFactory::isTag(tag));
+    EXPECT_FALSE(ComponentFactory::isTag(TestComponent<0>::TYPE_ID));
+    EXPECT_THROW(
+        entityManager.addTag(entityManager.generateNewId(), TestComponent<0>::TYPE_ID),
+        std::invalid_argument
+    );
+    EntityId entityId = entityManager.generateNewId();
+    entityManager.addComponent(entityId, make_unique<TestComponent<0>>());
+    entityManager.addTag(entityId, tag);
+    entityManager.addTag(entityId, tag);
+    EXPECT_TRUE(entityManager.hasTag(entityId, tag));
+    EXPECT_TRUE(entityManager.componentMask(entityId).test(tag));
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityId, tag));
+    // Components survive the move to the tagged archetype
+    EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<0>::TYPE_ID));
+    // An entity with only a tag exists
+    EntityId tagOnly = entityManager.generateNewId();
+    entityManager.addTag(tagOnly, tag);
+    EXPECT_TRUE(entityManager.exists(tagOnly));
+    entityManager.removeTag(entityId, tag);
+    EXPECT_TRUE(entityManager.hasTag(entityId, tag));
+    entityManager.removeEntity(tagOnly);
+    entityManager.processCommands();
+    EXPECT_FALSE(entityManager.hasTag(entityId, tag));
+    EXPECT_NE(nullptr, entityManager.getComponent(entityId, TestComponent<0>::TYPE_ID));
+    EXPECT_FALSE(entityManager.exists(tagOnly));
+}
+
+
+TEST(EntityManager, Query) {
+    EntityManager entityManager;
+    EntityId both = entityManager.generateNewId();
+    entityManager.addComponent(both, make_unique<TestComponent<0>>());
+    entityManager.addComponent(both, make_unique<TestComponent<1>>());
+    EntityId single = entityManager.generateNewId();
+    entityManager.addComponent(single, make_unique<TestComponent<0>>());
+    const EntityQuery& query = entityManager.query({
+        TestComponent<1>::TYPE_ID,
+        TestComponent<0>::TYPE_ID
+    });
+    EXPECT_EQ(std::vector<EntityId>({both}), std::vector<EntityId>(query.begin(), query.end()));
+    // Same types, same cached query
+    EXPECT_EQ(&query, &entityManager.query({TestComponent<0>::TYPE_ID, TestComponent<1>::TYPE_ID}));
+    // New archetypes are picked up on the next call
+    EntityId added = entityManager.generateNewId();
+    entityManager.addComponent(added, make_unique<TestComponent<1>>());
+    entityManager.addComponent(added, make_unique<TestComponent<2>>());
+    entityManager.addComponent(added, make_unique<TestComponent<0>>());
+    entityManager.query({TestComponent<0>::TYPE_ID, TestComponent<1>::TYPE_ID});
+    std::vector<EntityId> entities(query.begin(), query.end());
+    std::sort(entities.begin(), entities.end());
+    EXPECT_EQ(std::vector<EntityId>({both, added}), entities);
+    EXPECT_EQ(2, query.size());
+    // Empty archetypes are skipped
+    entityManager.removeEntity(both);
+    entityManager.processCommands();
+    EXPECT_EQ(std::vector<EntityId>({added}), std::vector<EntityId>(query.begin(), query.end()));
+    EXPECT_EQ(2, entityManager.query({}).size());
+}
+
+
+TEST(EntityManager, CompactStep) {
+    EntityManager entityManager;
+    std::vector<EntityId> entityIds;
+    std::map<EntityId, Component*> components;
+    for (int i = 0; i < 40; ++i) {
+        EntityId entityId = entityManager.generateNewId();
+        auto component = make_unique<TestComponent<0>>();
+        components[entityId] = component.get();
+        entityManager.addComponent(entityId, std::move(component));
+        entityManager.addComponent(entityId, make_unique<TestComponent<1>>());
+        entityIds.push_back(entityId);
+    }
+    for (size_t i = 0; i < entityIds.size(); i += 3) {
+        entityManager.removeEntity(entityIds[i]);
+        components.erase(entityIds[i]);
+    }
+    entityManager.processCommands();
+    auto isBefore = [] (EntityId left, EntityId right) {
+        return entityIndex(left) < entityIndex(right);
+    };
+    const auto& collection = entityManager.getComponentCollection(TestComponent<0>::TYPE_ID);
+    EXPECT_FALSE(std::is_sorted(collection.entities().begin(), collection.entities().end(), isBefore));
+    // Small steps, with the budget running out inside a collection
+    int steps = 1;
+    while (entityManager.compactStep(5)) {
+        steps += 1;
+        ASSERT_LT(steps, 1000);
+    }
+    EXPECT_GT(steps, 1);
+    EXPECT_FALSE(entityManager.compactStep());
+    EXPECT_TRUE(std::is_sorted(collection.entities().begin(), collection.entities().end(), isBefore));
+    for (const auto& archetype : entityManager.archetypes()) {
+        EXPECT_TRUE(std::is_sorted(archetype->entities().begin(), archetype->entities().end(), isBefore));
+    }
+    for (const auto& pair : components) {
+        EXPECT_EQ(pair.second, entityManager.getComponent(pair.first, TestComponent<0>::TYPE_ID));
+    }
+    // The archetype rows are still known after sorting
+    entityManager.removeComponent(entityIds[1], TestComponent<1>::TYPE_ID);
+    entityManager.removeEntity(entityIds[2]);
+    entityManager.processCommands();
+    EXPECT_FALSE(entityManager.exists(entityIds[2]));
+    EXPECT_EQ(nullptr, entityManager.getComponent(entityIds[1], TestComponent<1>::TYPE_ID));
+    EXPECT_EQ(components[entityIds[1]], entityManager.getComponent(entityIds[1], TestComponent<0>::TYPE_ID));
+    const EntityQuery& query = entityManager.query({
+        TestComponent<0>::TYPE_ID,
+        TestComponent<1>::TYPE_ID
+    });
+    EXPECT_EQ(components.size() - 2, query.size());
+    for (EntityId entityId : query) {
+        EXPECT_TRUE(components.count(entityId) > 0);
+        EXPECT_NE(entityIds[1], entityId);
+    }
+}
+
+
+TEST(EntityManager, Hierarchy) {
+    EntityManager entityManager;
+    EntityId root = entityManager.generateNewId();
+    EntityId child = entityManager.generateNewId();
+    EntityId grandChild = entityManager.generateNewId();
+    EntityId other = entityManager.generateNewId();
+    for (EntityId id : {root, child, grandChild, other}) {
+        entityManager.addComponent(id, make_unique<TestComponent<0>>());
+    }
+    EXPECT_TRUE(entityManager.setParent(child, root));
+    EXPECT_TRUE(entityManager.setParent(grandChild, child));
+    EXPECT_EQ(root, entityManager.parent(child));
+    EXPECT_EQ(std::vector<EntityId>({child}), entityManager.children(root));
+    EXPECT_EQ(0, entityManager.hierarchyDepth(root));
+    EXPECT_EQ(2, entityManager.hierarchyDepth(grandChild));
+    // Cycles are rejected
+    EXPECT_FALSE(entityManager.setParent(root, grandChild));
+    EXPECT_EQ(NULL_ENTITY, entityManager.parent(root));
+    // Reparenting detaches from the previous parent
+    EXPECT_TRUE(entityManager.setParent(grandChild, other));
+    EXPECT_TRUE(entityManager.children(child).empty());
+    EXPECT_TRUE(entityManager.setParent(grandChild, child));
+    // Removing a parent removes its descendants
+    entityManager.removeEntity(root);
+    entityManager.processCommands();
+    EXPECT_FALSE(entityManager.exists(child));
+    EXPECT_FALSE(entityManager.exists(grandChild));
+    EXPECT_TRUE(entityManager.exists(other));
+    EXPECT_TRUE(entityManager.children(other).empty());
+    EXPECT_EQ(NULL_ENTITY, entityManager.parent(grandChild));
+}
+
+
+static StorageContainer
+componentStorage(
+    EntityId owner,
+    int32_t value
+) {
+    StorageContainer storage;
+    storage.set<EntityId>("owner", owner);
+    storage.set<int32_t>("value", value);
+    storage.set<std::string>("name", "component");
+    return storage;
+}
+
+
+static StorageContainer
+entityStorage(
+    StorageList components
+) {
+    StorageContainer collections;
+    collections.set("TestComponent", std::move(components));
+    StorageContainer storage;
+    storage.set<EntityId>("slotCount", 4);
+    storage.set("collections", std::move(collections));
+    return storage;
+}
+
+
+TEST(EntityManager, StorageDelta) {
+    StorageList previousComponents;
+    previousComponents.append(componentStorage(1, 10));
+    previousComponents.append(componentStorage(2, 20));
+    previousComponents.append(componentStorage(3, 30));
+    StorageContainer previous = entityStorage(previousComponents);
+    StorageList currentComponents;
+    currentComponents.append(componentStorage(1, 10));
+    currentComponents.append(componentStorage(2, 21));
+    currentComponents.append(componentStorage(4, 40));
+    StorageContainer current = entityStorage(currentComponents);
+    StorageContainer delta = EntityManager::storageDelta(previous, current);
+    // Only the changed property of the second component is included
+    StorageContainer typeChanges = delta.get<StorageContainer>(
+        "collectionChanges"
+    ).get<StorageContainer>("TestComponent");
+    StorageList changes = typeChanges.get<StorageList>("changes");
+    ASSERT_EQ(1, changes.size());
+    EXPECT_EQ(21, changes[0].get<int32_t>("value"));
+    EXPECT_FALSE(changes[0].contains("name"));
+    EXPECT_EQ(1, typeChanges.get<StorageList>("components").size());
+    EXPECT_EQ(1, typeChanges.get<StorageList>("removed").size());
+    // Applying the delta yields the current components
+    EntityManager::applyStorageDelta(previous, delta);
+    StorageList result = previous.get<StorageContainer>(
+        "collections"
+    ).get<StorageList>("TestComponent");
+    ASSERT_EQ(3, result.size());
+    std::map<EntityId, int32_t> values;
+    for (const auto& component : result) {
+        values[component.get<EntityId>("owner")] = component.get<int32_t>("value");
+        EXPECT_EQ("component", component.get<std::string>("name"));
+    }
+    std::map<EntityId, int32_t> expected = {{1, 10}, {2, 21}, {4, 40}};
+    EXPECT_EQ(expected, values);
+}
+
+
+TEST(EntityManager, StorageDeltaWithColumns) {
+    StorageList previousComponents;
+    previousComponents.append(componentStorage(1, 10));
+    previousComponents.append(componentStorage(2, 20));
+    StorageContainer previousCollections;
+    previousCollections.set("TestComponent", storageColumns(previousComponents));
+    StorageContainer previous;
+    previous.set<EntityId>("slotCount", 4);
+    previous.set("collections", std::move(previousCollections));
+    StorageList currentComponents;
+    currentComponents.append(componentStorage(1, 11));
+    currentComponents.append(componentStorage(2, 20));
+    StorageContainer current = entityStorage(currentComponents);
+    StorageContainer delta = EntityManager::storageDelta(previous, current);
+    EntityManager::applyStorageDelta(previous, delta);
+    // The column layout is kept
+    StorageList result = storageRows(previous.get<StorageContainer>(
+        "collections"
+    ).get<StorageContainer>("TestComponent"));
+    ASSERT_EQ(2, result.size());
+    EXPECT_EQ(11, result[0].get<int32_t>("value"));
+    EXPECT_EQ(20, result[1].get<int32_t>("value"));
+    EXPECT_EQ("component", result[1].get<std::string>("name"));
+}
+
+
+TEST(EntityManager, Restore) {
+    ComponentFactory factory;
+    factory.registerComponentType(
+        TestComponent<0>::TYPE_NAME(),
+        [] (const StorageContainer& storage) {
+            std::unique_ptr<Component> component = make_unique<TestComponent<0>>();
+            component->load(storage);
+            return component;
+        }
+    );
+    factory.registerComponentType(
+        TestComponent<1>::TYPE_NAME(),
+        [] (const StorageContainer& storage) {
+            std::unique_ptr<Component> component = make_unique<TestComponent<1>>();
+            component->load(storage);
+            return component;
+        }
+    );
+    EntityManager original;
+    std::vector<EntityId> both;
+    std::vector<EntityId> single;
+    for (int i = 0; i < 100; ++i) {
+        EntityId entityId = original.generateNewId();
+        original.addComponent(entityId, make_unique<TestComponent<0>>());
+        if (i % 2) {
+            original.addComponent(entityId, make_unique<TestComponent<1>>());
+            both.push_back(entityId);
+        }
+        else {
+            single.push_back(entityId);
+        }
+    }
+    EntityManager restored;
+    restored.restore(original.storage(factory), factory);
+    EXPECT_EQ(original.entityCount(), restored.entityCount());
+    for (EntityId entityId : both) {
+        EXPECT_TRUE(nullptr != restored.getComponent<TestComponent<0>>(entityId));
+        EXPECT_TRUE(nullptr != restored.getComponent<TestComponent<1>>(entityId));
+    }
+    for (EntityId entityId : single) {
+        EXPECT_TRUE(nullptr != restored.getComponent<TestComponent<0>>(entityId));
+        EXPECT_TRUE(nullptr == restored.getComponent<TestComponent<1>>(entityId));
+    }
+    const EntityQuery& query = restored.query({
+        TestComponent<0>::TYPE_ID,
+        TestComponent<1>::TYPE_ID
+    });
+    EXPECT_EQ(both.size(), query.size());
+    // Ids handed out after restoring don't collide with restored ones
+    EntityId newId = restored.generateNewId();
+    EXPECT_FALSE(restored.exists(newId));
+}
+
+
+TEST(EntityManager, RestoreSnapshot) {
+    ComponentFactory factory;
+    factory.registerComponentType(
+        TestComponent<0>::TYPE_NAME(),
+        [] (const StorageContainer& storage) {
+            std::unique_ptr<Component> component = make_unique<TestComponent<0>>();
+            component->load(storage);
+            return component;
+        }
+    );
+    factory.registerComponentType(
+        TestComponent<1>::TYPE_NAME(),
+        [] (const StorageContainer& storage) {
+            std::unique_ptr<Component> component = make_unique<TestComponent<1>>();
+            component->load(storage);
+            return component;
+        }
+    );
+    EntityManager entityManager;
+    std::vector<EntityId> entityIds;
+    // More than one snapshot page
+    for (int i = 0; i < 200; ++i) {
+        EntityId entityId = entityManager.generateNewId();
+        entityManager.addComponent(entityId, make_unique<TestComponent<0>>());
+        entityIds.push_back(entityId);
+    }
+    EXPECT_FALSE(EntityManager::Snapshot().isValid());
+    EntityManager::Snapshot snapshot = entityManager.snapshot(factory);
+    EXPECT_TRUE(snapshot.isValid());
+    // Removals move components between pages
+    for (size_t i = 0; i < entityIds.size(); i += 3) {
+        entityManager.removeEntity(entityIds[i]);
+    }
+    entityManager.addComponent(entityIds[1], make_unique<TestComponent<1>>());
+    entityManager.processCommands();
+    EntityManager::Snapshot changed = entityManager.snapshot(factory);
+    entityManager.rollback(snapshot, factory);
+    EXPECT_EQ(entityIds.size(), entityManager.entityCount());
+    for (EntityId entityId : entityIds) {
+        EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<0>>(entityId));
+    }
+    EXPECT_TRUE(nullptr == entityManager.getComponent<TestComponent<1>>(entityIds[1]));
+    entityManager.rollback(changed, factory);
+    EXPECT_FALSE(entityManager.exists(entityIds[0]));
+    EXPECT_TRUE(entityManager.exists(entityIds[2]));
+    EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<1>>(entityIds[1]));
+    // Snapshots are the same as regular storage
+    EntityManager copy;
+    copy.restore(entityManager.snapshot(factory).storage(), factory);
+    EXPECT_EQ(entityManager.entityCount(), copy.entityCount());
+    // Also when pages are stored by a thread pool
+    for (size_t i = 2; i < entityIds.size(); i += 3) {
+        entityManager.removeEntity(entityIds[i]);
+    }
+    entityManager.processCommands();
+    ThreadPool threadPool(2);
+    EntityManager pooledCopy;
+    pooledCopy.restore(entityManager.snapshot(factory, &threadPool).storage(), factory);
+    EXPECT_EQ(entityManager.entityCount(), pooledCopy.entityCount());
+}
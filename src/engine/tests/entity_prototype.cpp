@@ -0,0 +1,90 @@
+#include "engine/entity_prototype.h"
+
+#include "engine/component_factory.h"
+#include "engine/entity_manager.h"
+#include "engine/serialization.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+
+
+using namespace thrive;
+
+
+struct EntityPrototypeTest : public ::testing::Test {
+
+    EntityPrototypeTest() {
+        factory.registerComponentType(
+            TestComponent<0>::TYPE_NAME(),
+            [] (const StorageContainer& storage) {
+                std::unique_ptr<Component> component = make_unique<TestComponent<0>>();
+                component->load(storage);
+                return component;
+            }
+        );
+        factory.registerComponentType(
+            TestComponent<1>::TYPE_NAME(),
+            [] (const StorageContainer& storage) {
+                std::unique_ptr<Component> component = make_unique<TestComponent<1>>();
+                component->load(storage);
+                return component;
+            }
+        );
+    }
+
+    EntityManager entityManager;
+
+    ComponentFactory factory;
+
+};
+
+
+TEST_F(EntityPrototypeTest, CopyEntity) {
+    EntityId original = entityManager.generateNewId();
+    entityManager.addComponent(original, make_unique<TestComponent<0>>());
+    entityManager.addComponent(original, make_unique<TestComponent<1>>());
+    EntityPrototype prototype(entityManager, original);
+    EXPECT_EQ(2, prototype.componentCount());
+    std::vector<EntityId> instances = prototype.instantiate(entityManager, factory, 3);
+    ASSERT_EQ(3, instances.size());
+    for (EntityId instance : instances) {
+        EXPECT_NE(original, instance);
+        EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<0>>(instance));
+        EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<1>>(instance));
+    }
+    // The copies are independent of the original
+    EXPECT_NE(
+        entityManager.getComponent<TestComponent<0>>(original),
+        entityManager.getComponent<TestComponent<0>>(instances[0])
+    );
+}
+
+
+TEST_F(EntityPrototypeTest, AddComponent) {
+    EntityPrototype prototype;
+    TestComponent<0> component;
+    prototype.addComponent(component);
+    // Same type replaces
+    prototype.addComponent(component);
+    EXPECT_EQ(1, prototype.componentCount());
+    EntityId instance = prototype.deferInstantiate(entityManager, factory);
+    EXPECT_FALSE(entityManager.exists(instance));
+    entityManager.processCommands();
+    EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<0>>(instance));
+    prototype.clear();
+    EXPECT_EQ(0, prototype.componentCount());
+}
+
+
+TEST_F(EntityPrototypeTest, Storage) {
+    EntityPrototype prototype;
+    prototype.addComponent(TestComponent<0>());
+    prototype.addComponent(TestComponent<1>());
+    EntityPrototype loaded;
+    loaded.load(prototype.storage());
+    EXPECT_EQ(2, loaded.componentCount());
+    EntityId instance = loaded.instantiate(entityManager, factory).front();
+    EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<0>>(instance));
+    EXPECT_TRUE(nullptr != entityManager.getComponent<TestComponent<1>>(instance));
+}
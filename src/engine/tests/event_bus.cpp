@@ -0,0 +1,112 @@
+#include "engine/event_bus.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+struct TestEvent {
+
+    int value = 0;
+
+};
+
+
+std::vector<int>
+readValues(
+    EventChannel<TestEvent>& channel,
+    EventCursor& cursor
+) {
+    std::vector<int> values;
+    channel.read(cursor, [&values] (const TestEvent& event) {
+        values.push_back(event.value);
+    });
+    return values;
+}
+
+
+void
+publish(
+    EventChannel<TestEvent>& channel,
+    int value
+) {
+    TestEvent event;
+    event.value = value;
+    channel.publish(event);
+}
+
+}
+
+
+TEST(EventChannel, ReadersKeepTheirOwnPosition) {
+    EventChannel<TestEvent> channel;
+    EventCursor first;
+    EventCursor second;
+    publish(channel, 1);
+    publish(channel, 2);
+    EXPECT_EQ(std::vector<int>({1, 2}), readValues(channel, first));
+    publish(channel, 3);
+    EXPECT_EQ(std::vector<int>({3}), readValues(channel, first));
+    EXPECT_EQ(std::vector<int>({1, 2, 3}), readValues(channel, second));
+    EXPECT_TRUE(readValues(channel, second).empty());
+}
+
+
+TEST(EventChannel, KeepsEventsForTwoFrames) {
+    EventChannel<TestEvent> channel;
+    EventCursor early;
+    EventCursor late;
+    publish(channel, 1);
+    channel.endFrame();
+    // A reader updated before the publisher sees last frame's events
+    EXPECT_EQ(std::vector<int>({1}), readValues(channel, early));
+    publish(channel, 2);
+    EXPECT_EQ(std::vector<int>({2}), readValues(channel, early));
+    channel.endFrame();
+    EXPECT_EQ(1, channel.size());
+    // Too late for the first event
+    EXPECT_EQ(std::vector<int>({2}), readValues(channel, late));
+    EXPECT_EQ(1, late.missed());
+    EXPECT_EQ(0, early.missed());
+}
+
+
+TEST(EventChannel, Grows) {
+    EventChannel<TestEvent> channel;
+    EventCursor cursor;
+    std::vector<int> expected;
+    // Wraps around before growing
+    for (int frame = 0; frame < 4; ++frame) {
+        for (int i = 0; i < 10 * (frame + 1); ++i) {
+            publish(channel, frame * 100 + i);
+            expected.push_back(frame * 100 + i);
+        }
+        EXPECT_EQ(expected, readValues(channel, cursor));
+        expected.clear();
+        channel.endFrame();
+    }
+    EXPECT_EQ(40, channel.size());
+    EXPECT_EQ(0, cursor.missed());
+}
+
+
+TEST(EventBus, ChannelPerType) {
+    EventBus bus;
+    EventChannel<TestEvent>& channel = bus.channel<TestEvent>();
+    EXPECT_EQ(&channel, &bus.channel<TestEvent>());
+    EXPECT_NE(
+        static_cast<EventChannelBase*>(&channel),
+        static_cast<EventChannelBase*>(&bus.channel<int>())
+    );
+    EventCursor cursor;
+    publish(channel, 1);
+    bus.endFrame();
+    bus.endFrame();
+    EXPECT_EQ(0, channel.size());
+    publish(channel, 2);
+    bus.clear();
+    EXPECT_TRUE(readValues(channel, cursor).empty());
+    EXPECT_EQ(2, cursor.missed());
+}
@@ -0,0 +1,47 @@
+#include "engine/frame_arena.h"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(FrameArena, AlignsAllocations) {
+    FrameArena arena(256);
+    arena.allocate(1, 1);
+    void* pointer = arena.allocate(8, 8);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(pointer) % 8);
+    EXPECT_EQ(16u, arena.bytesUsed());
+    EXPECT_EQ(256u, arena.capacity());
+}
+
+
+TEST(FrameArena, ReusesMemoryAfterReset) {
+    FrameArena arena(64);
+    arena.allocate(48);
+    arena.allocate(48);
+    arena.allocate(100);
+    EXPECT_EQ(64u + 64u + 100u, arena.capacity());
+    arena.reset();
+    EXPECT_EQ(0u, arena.bytesUsed());
+    // The blocks have been merged, so the next frame fits into one
+    EXPECT_EQ(228u, arena.capacity());
+    arena.allocate(200);
+    EXPECT_EQ(228u, arena.capacity());
+}
+
+
+TEST(FrameArena, BacksContainers) {
+    FrameArena arena;
+    FrameVector<int> values{FrameAllocator<int>(&arena)};
+    for (int i = 0; i < 100; ++i) {
+        values.push_back(i);
+    }
+    EXPECT_EQ(99, values.back());
+    EXPECT_GE(arena.bytesUsed(), 100 * sizeof(int));
+    // Without an arena, the global heap is used
+    FrameVector<int> heapValues;
+    heapValues.assign(values.begin(), values.end());
+    EXPECT_EQ(values.size(), heapValues.size());
+    EXPECT_GE(arena.bytesUsed(), 100 * sizeof(int));
+}
@@ -0,0 +1,44 @@
+#include "engine/frame_budgets.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(FrameBudgets, ReportsExceededBudgets) {
+    FrameBudgets budgets;
+    EXPECT_FALSE(budgets.hasSystemBudgets());
+    budgets.setBudget("frame", 16000);
+    EXPECT_FALSE(budgets.hasSystemBudgets());
+    budgets.setBudget("UpdatePhysicsSystem", 4000);
+    EXPECT_TRUE(budgets.hasSystemBudgets());
+    EXPECT_EQ(4000u, budgets.budget("UpdatePhysicsSystem"));
+    budgets.beginFrame(7);
+    budgets.check("UpdatePhysicsSystem", 3000);
+    budgets.check("UpdatePhysicsSystem", 5000);
+    budgets.check("frame", 12000);
+    budgets.check("RenderSystem", 50000);
+    auto violations = budgets.endFrame();
+    ASSERT_EQ(1u, violations.size());
+    EXPECT_EQ("UpdatePhysicsSystem", violations[0].name);
+    EXPECT_EQ(7u, violations[0].frame);
+    EXPECT_EQ(5000u, violations[0].microseconds);
+    EXPECT_EQ(4000u, violations[0].budget);
+    budgets.beginFrame(8);
+    EXPECT_TRUE(budgets.endFrame().empty());
+    EXPECT_EQ(1u, budgets.violationCount());
+}
+
+
+TEST(FrameBudgets, RemovesBudgets) {
+    FrameBudgets budgets;
+    budgets.setBudget("AgentEmitterSystem", 1000);
+    budgets.setBudget("AgentEmitterSystem", 2000);
+    EXPECT_EQ(2000u, budgets.budget("AgentEmitterSystem"));
+    budgets.setBudget("AgentEmitterSystem", 0);
+    EXPECT_EQ(0u, budgets.budget("AgentEmitterSystem"));
+    EXPECT_FALSE(budgets.hasSystemBudgets());
+    budgets.beginFrame(1);
+    budgets.check("AgentEmitterSystem", 5000);
+    EXPECT_TRUE(budgets.endFrame().empty());
+}
@@ -0,0 +1,64 @@
+#include "engine/frame_pacer.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+using boost::chrono::microseconds;
+
+
+TEST(FrameTimeHistogram, Statistics) {
+    FrameTimeHistogram histogram;
+    for (int i = 0; i < 98; ++i) {
+        histogram.addSample(microseconds(16600));
+    }
+    histogram.addSample(microseconds(33400));
+    // Beyond the last regular bucket
+    histogram.addSample(microseconds(250000));
+    EXPECT_EQ(100, histogram.count());
+    EXPECT_EQ(microseconds(250000), histogram.maximum());
+    EXPECT_EQ(microseconds(16750), histogram.percentile(0.5));
+    EXPECT_EQ(microseconds(33500), histogram.percentile(0.99));
+    EXPECT_EQ(microseconds(250000), histogram.percentile(1.0));
+    EXPECT_EQ(microseconds(98 * 16600 + 33400 + 250000), histogram.totalTime());
+    histogram.clear();
+    EXPECT_EQ(0, histogram.count());
+    EXPECT_EQ(microseconds(0), histogram.mean());
+}
+
+
+TEST(FramePacer, KeepsFrameRate) {
+    FramePacer pacer(microseconds(5000));
+    EXPECT_EQ(microseconds(0), pacer.beginFrame());
+    for (int i = 0; i < 10; ++i) {
+        pacer.waitForNextFrame();
+        pacer.beginFrame();
+    }
+    const FrameTimeHistogram& histogram = pacer.histogram();
+    EXPECT_EQ(10, histogram.count());
+    // Deadlines don't drift even if single frames oversleep
+    EXPECT_GE(histogram.totalTime(), microseconds(50000));
+    EXPECT_LT(histogram.totalTime(), microseconds(55000));
+}
+
+
+TEST(FramePacer, IdleCallback) {
+    FramePacer pacer(microseconds(10000));
+    int calls = 0;
+    FramePacer::Clock::time_point lastUntil;
+    pacer.setIdleCallback([&] (FramePacer::Clock::time_point until) {
+        EXPECT_LE(until - FramePacer::Clock::now(), FramePacer::IDLE_INTERVAL);
+        lastUntil = until;
+        calls += 1;
+    });
+    auto start = FramePacer::Clock::now();
+    pacer.beginFrame();
+    pacer.waitForNextFrame();
+    pacer.beginFrame();
+    // The last callback may run until the pacer starts spinning
+    EXPECT_LE(lastUntil - start, microseconds(8000) + microseconds(500));
+    // Sleeping until 2 ms before the deadline, at most 1 ms at a time
+    EXPECT_GE(calls, 4);
+    EXPECT_LE(calls, 9);
+    EXPECT_GE(pacer.histogram().totalTime(), microseconds(10000));
+}
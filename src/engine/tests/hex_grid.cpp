@@ -0,0 +1,76 @@
+#include "engine/hex_grid.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(HexGrid, SetAndGet) {
+    HexGrid grid;
+    EXPECT_EQ(0, grid.get(0, 0));
+    grid.set(0, 0, 1);
+    grid.set(-20, 35, 2);
+    grid.set(3, -1, 3);
+    EXPECT_EQ(1, grid.get(0, 0));
+    EXPECT_EQ(2, grid.get(-20, 35));
+    EXPECT_EQ(3, grid.get(3, -1));
+    EXPECT_EQ(0, grid.get(1, 0));
+    EXPECT_EQ(0, grid.get(1000, -1000));
+    EXPECT_EQ(3u, grid.size());
+    grid.set(0, 0, 4);
+    EXPECT_EQ(4, grid.get(0, 0));
+    EXPECT_EQ(3u, grid.size());
+}
+
+
+TEST(HexGrid, Remove) {
+    HexGrid grid;
+    grid.set(1, 2, 5);
+    EXPECT_TRUE(grid.remove(1, 2));
+    EXPECT_FALSE(grid.remove(1, 2));
+    EXPECT_FALSE(grid.remove(50, 50));
+    EXPECT_EQ(0, grid.get(1, 2));
+    EXPECT_EQ(0u, grid.size());
+    grid.set(1, 2, 5);
+    grid.set(1, 2, 0);
+    EXPECT_EQ(0u, grid.size());
+}
+
+
+TEST(HexGrid, BoundingBox) {
+    HexGrid grid;
+    grid.set(0, 0, 1);
+    grid.set(-3, 2, 1);
+    grid.set(4, -5, 1);
+    EXPECT_EQ(-3, grid.minQ());
+    EXPECT_EQ(4, grid.maxQ());
+    EXPECT_EQ(-5, grid.minR());
+    EXPECT_EQ(2, grid.maxR());
+    grid.remove(4, -5);
+    EXPECT_EQ(0, grid.maxQ());
+    EXPECT_EQ(0, grid.minR());
+    grid.clear();
+    EXPECT_EQ(0, grid.minQ());
+    EXPECT_EQ(0, grid.maxQ());
+    EXPECT_EQ(0u, grid.size());
+}
+
+
+TEST(HexGrid, Neighbours) {
+    HexGrid grid;
+    grid.set(0, 1, 1);
+    grid.set(-1, 1, 6);
+    EXPECT_EQ(1, grid.neighbour(0, 0, 1));
+    EXPECT_EQ(6, grid.neighbour(0, 0, 6));
+    EXPECT_EQ(0, grid.neighbour(0, 0, 4));
+    EXPECT_THROW(grid.neighbour(0, 0, 0), std::out_of_range);
+    EXPECT_THROW(grid.neighbour(0, 0, 7), std::out_of_range);
+    std::vector<int32_t> values;
+    grid.forEachNeighbour(0, 0, [&values] (unsigned int side, int32_t, int32_t, int32_t value) {
+        EXPECT_EQ(values.size() + 1, side);
+        values.push_back(value);
+    });
+    EXPECT_EQ(std::vector<int32_t>({1, 0, 0, 0, 0, 6}), values);
+}
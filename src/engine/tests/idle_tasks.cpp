@@ -0,0 +1,99 @@
+#include "engine/idle_tasks.h"
+
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace thrive;
+
+using Clock = IdleTasks::Clock;
+
+
+static Clock::time_point
+later() {
+    return Clock::now() + boost::chrono::seconds(10);
+}
+
+
+TEST(IdleTasks, TakesTurns) {
+    IdleTasks tasks;
+    std::vector<int> order;
+    int firstSteps = 3;
+    int secondSteps = 1;
+    tasks.add([&] () {
+        order.push_back(1);
+        return --firstSteps > 0;
+    });
+    tasks.add([&] () {
+        order.push_back(2);
+        return --secondSteps > 0;
+    });
+    EXPECT_EQ(4, tasks.run(later()));
+    EXPECT_EQ(std::vector<int>({1, 2, 1, 1}), order);
+    // Out of work, but still registered
+    EXPECT_EQ(2, tasks.count());
+}
+
+
+TEST(IdleTasks, StopsAtDeadline) {
+    IdleTasks tasks;
+    int steps = 0;
+    tasks.add([&steps] () {
+        steps += 1;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        return true;
+    });
+    EXPECT_EQ(0, tasks.run(Clock::now()));
+    unsigned int taken = tasks.run(Clock::now() + boost::chrono::milliseconds(10));
+    EXPECT_GE(taken, 1);
+    EXPECT_LE(taken, 5);
+    EXPECT_EQ(steps, taken);
+}
+
+
+TEST(IdleTasks, ContinuesWithNextTask) {
+    IdleTasks tasks;
+    std::vector<int> order;
+    for (int i = 1; i <= 3; ++i) {
+        tasks.add([&order, i] () {
+            order.push_back(i);
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+            return true;
+        });
+    }
+    tasks.run(Clock::now() + boost::chrono::microseconds(500));
+    ASSERT_EQ(1, order.size());
+    tasks.run(Clock::now() + boost::chrono::microseconds(500));
+    EXPECT_EQ(std::vector<int>({1, 2}), order);
+}
+
+
+TEST(IdleTasks, AddAndRemoveWhileRunning) {
+    IdleTasks tasks;
+    int addedSteps = 0;
+    int otherSteps = 0;
+    IdleTasks::TaskId other = 0;
+    IdleTasks::TaskId self = 0;
+    self = tasks.add([&] () {
+        tasks.add([&addedSteps] () {
+            addedSteps += 1;
+            return false;
+        });
+        tasks.remove(other);
+        tasks.remove(self);
+        return true;
+    });
+    other = tasks.add([&otherSteps] () {
+        otherSteps += 1;
+        return false;
+    });
+    EXPECT_EQ(1, tasks.run(later()));
+    EXPECT_EQ(0, otherSteps);
+    EXPECT_EQ(0, addedSteps);
+    EXPECT_EQ(1, tasks.count());
+    EXPECT_EQ(1, tasks.run(later()));
+    EXPECT_EQ(1, addedSteps);
+    tasks.clear();
+    EXPECT_EQ(0, tasks.count());
+    EXPECT_EQ(0, tasks.run(later()));
+}
@@ -0,0 +1,91 @@
+#include "engine/input_recording.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+
+TEST(InputRecording, RoundTrip) {
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    InputFrame first;
+    first.milliseconds = 16;
+    first.keysDown = {17, 30};
+    InputFrame::KeyEvent event;
+    event.key = 30;
+    event.pressed = true;
+    event.shift = true;
+    event.delay = 4200;
+    first.keyEvents.push_back(event);
+    first.mouse.buttons = 1;
+    first.mouse.width = 800;
+    first.mouse.height = 600;
+    first.mouse.x = 400;
+    first.mouse.y = 300;
+    first.mouse.z = -120;
+    InputFrame second;
+    second.milliseconds = 17;
+    {
+        InputRecorder recorder(path.string(), 1234);
+        recorder.write(first);
+        recorder.write(second);
+    }
+    InputPlayer player(path.string());
+    EXPECT_EQ(1234u, player.seed());
+    InputFrame frame;
+    ASSERT_TRUE(player.next(frame));
+    EXPECT_EQ(16, frame.milliseconds);
+    EXPECT_EQ(first.keysDown, frame.keysDown);
+    ASSERT_EQ(1u, frame.keyEvents.size());
+    EXPECT_EQ(30, frame.keyEvents[0].key);
+    EXPECT_TRUE(frame.keyEvents[0].pressed);
+    EXPECT_FALSE(frame.keyEvents[0].alt);
+    EXPECT_FALSE(frame.keyEvents[0].ctrl);
+    EXPECT_TRUE(frame.keyEvents[0].shift);
+    EXPECT_EQ(4200u, frame.keyEvents[0].delay);
+    EXPECT_EQ(1, frame.mouse.buttons);
+    EXPECT_EQ(800, frame.mouse.width);
+    EXPECT_EQ(600, frame.mouse.height);
+    EXPECT_EQ(400, frame.mouse.x);
+    EXPECT_EQ(300, frame.mouse.y);
+    EXPECT_EQ(-120, frame.mouse.z);
+    ASSERT_TRUE(player.next(frame));
+    EXPECT_EQ(17, frame.milliseconds);
+    EXPECT_TRUE(frame.keysDown.empty());
+    EXPECT_TRUE(frame.keyEvents.empty());
+    EXPECT_FALSE(player.next(frame));
+    boost::filesystem::remove(path);
+}
+
+
+TEST(InputRecording, RejectsOtherFiles) {
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    EXPECT_THROW(InputPlayer(path.string()), std::runtime_error);
+    {
+        std::ofstream stream(path.string());
+        stream << "thrive-input 3\nseed 5\nframe 16 0 800\n";
+    }
+    InputPlayer player(path.string());
+    InputFrame frame;
+    EXPECT_THROW(player.next(frame), std::runtime_error);
+    {
+        // Recorded with a different RNG
+        std::ofstream stream(path.string());
+        stream << "thrive-input 1\nseed 5\n";
+    }
+    EXPECT_THROW(InputPlayer(path.string()), std::runtime_error);
+    {
+        // Recorded without event delays
+        std::ofstream stream(path.string());
+        stream << "thrive-input 2\nseed 5\n";
+    }
+    EXPECT_THROW(InputPlayer(path.string()), std::runtime_error);
+    {
+        std::ofstream stream(path.string());
+        stream << "something else\n";
+    }
+    EXPECT_THROW(InputPlayer(path.string()), std::runtime_error);
+    boost::filesystem::remove(path);
+}
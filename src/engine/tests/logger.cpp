@@ -0,0 +1,84 @@
+#include "engine/logger.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace thrive;
+
+TEST(Logger, ChannelLevel) {
+    Logger logger;
+    logger.setConsoleLevel(LogLevel::Error);
+    std::vector<std::string> messages;
+    logger.setListener([&messages] (const Logger::Entry& entry) {
+        messages.push_back(entry.message);
+    });
+    LogChannel& channel = logger.channel("test");
+    EXPECT_EQ(&channel, &logger.channel("test"));
+    EXPECT_EQ(LogLevel::Info, channel.level());
+    channel.debug("Hidden");
+    channel.info("Shown");
+    channel.setLevel(LogLevel::Warning);
+    EXPECT_FALSE(channel.isEnabled(LogLevel::Info));
+    channel.info("Hidden");
+    channel.warning("Warning");
+    logger.flush();
+    ASSERT_EQ(2u, messages.size());
+    EXPECT_EQ("Shown", messages[0]);
+    EXPECT_EQ("Warning", messages[1]);
+}
+
+
+TEST(Logger, RateLimit) {
+    Logger logger;
+    logger.setConsoleLevel(LogLevel::Error);
+    std::vector<Logger::Entry> entries;
+    logger.setListener([&entries] (const Logger::Entry& entry) {
+        entries.push_back(entry);
+    });
+    LogChannel& channel = logger.channel("test");
+    channel.setRateLimit(3);
+    for (int i = 0; i < 10; ++i) {
+        channel.info("Spam");
+    }
+    logger.flush();
+    EXPECT_EQ(3u, entries.size());
+    EXPECT_EQ(7u, logger.suppressedCount());
+}
+
+
+TEST(Logger, WriterThread) {
+    Logger logger(1 << 16);
+    logger.setConsoleLevel(LogLevel::Error);
+    std::atomic<unsigned int> count(0);
+    logger.setListener([&count] (const Logger::Entry&) {
+        count += 1;
+    });
+    logger.start();
+    EXPECT_TRUE(logger.isRunning());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&logger] () {
+            LogChannel& channel = logger.channel("thread");
+            for (int i = 0; i < 1000; ++i) {
+                channel.info("Message");
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    logger.flush();
+    EXPECT_EQ(4000u, count + logger.droppedCount());
+    logger.stop();
+    EXPECT_FALSE(logger.isRunning());
+}
+
+
+TEST(Logger, LevelNames) {
+    EXPECT_EQ(LogLevel::Warning, Logger::levelFromName("warning"));
+    EXPECT_STREQ("debug", Logger::levelName(LogLevel::Debug));
+    EXPECT_THROW(Logger::levelFromName("loud"), std::invalid_argument);
+}
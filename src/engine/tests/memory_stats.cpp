@@ -0,0 +1,43 @@
+#include "engine/memory_stats.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(MemoryStats, LooksUpComponents) {
+    MemoryStats stats;
+    MemoryStats::Components first;
+    first.bytes = 4096;
+    first.count = 10;
+    first.typeName = "First";
+    MemoryStats::Components second;
+    second.bytes = 1024;
+    second.count = 3;
+    second.typeName = "Second";
+    stats.components = {first, second};
+    EXPECT_EQ(4096u, stats.componentBytes("First"));
+    EXPECT_EQ(3u, stats.componentCount("Second"));
+    EXPECT_EQ(0u, stats.componentBytes("Missing"));
+    EXPECT_EQ(0u, stats.componentCount("Missing"));
+    EXPECT_EQ(5120u, stats.totalComponentBytes());
+}
+
+
+TEST(MemoryStats, ReportListsLargestComponents) {
+    MemoryStats stats;
+    stats.luaHeapBytes = 2048;
+    stats.rigidBodies = 7;
+    MemoryStats::Components first;
+    first.bytes = 4096;
+    first.typeName = "First";
+    MemoryStats::Components second;
+    second.bytes = 1024;
+    second.typeName = "Second";
+    stats.components = {first, second};
+    std::string report = stats.report(1);
+    EXPECT_NE(std::string::npos, report.find("Lua heap: 2.0 KB"));
+    EXPECT_NE(std::string::npos, report.find("7 bodies"));
+    EXPECT_NE(std::string::npos, report.find("First"));
+    EXPECT_EQ(std::string::npos, report.find("Second"));
+}
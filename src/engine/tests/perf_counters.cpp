@@ -0,0 +1,40 @@
+#include "engine/perf_counters.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(PerfCounters, Read) {
+    PerfCounters::Values before;
+    if (not PerfCounters::isAvailable()) {
+        EXPECT_FALSE(PerfCounters::read(before));
+        return;
+    }
+    ASSERT_TRUE(PerfCounters::read(before));
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        sum = sum + i;
+    }
+    PerfCounters::Values after;
+    ASSERT_TRUE(PerfCounters::read(after));
+    PerfCounters::Values difference = after - before;
+    EXPECT_LT(1000000u, difference.instructions);
+    EXPECT_LT(0u, difference.cycles);
+}
+
+
+TEST(PerfCounters, Values) {
+    PerfCounters::Values a;
+    a.branchMisses = 1;
+    a.cacheMisses = 2;
+    a.cycles = 3;
+    a.instructions = 4;
+    PerfCounters::Values b = a;
+    b += a;
+    PerfCounters::Values difference = b - a;
+    EXPECT_EQ(1u, difference.branchMisses);
+    EXPECT_EQ(2u, difference.cacheMisses);
+    EXPECT_EQ(3u, difference.cycles);
+    EXPECT_EQ(4u, difference.instructions);
+}
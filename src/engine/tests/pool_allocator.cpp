@@ -0,0 +1,65 @@
+#include "engine/pool_allocator.h"
+
+#include "engine/tests/test_component.h"
+
+#include <gtest/gtest.h>
+#include <set>
+#include <stdexcept>
+
+using namespace thrive;
+
+
+TEST(PoolAllocator, RoundsUpBlockSize) {
+    PoolAllocator pool(1);
+    EXPECT_GE(pool.blockSize(), sizeof(void*));
+    EXPECT_EQ(0u, pool.blockSize() % alignof(std::max_align_t));
+    EXPECT_THROW(PoolAllocator(16, 0), std::invalid_argument);
+}
+
+
+TEST(PoolAllocator, RecyclesBlocks) {
+    PoolAllocator pool(32, 4);
+    EXPECT_EQ(0u, pool.reservedBytes());
+    std::set<void*> blocks;
+    for (int i = 0; i < 6; ++i) {
+        blocks.insert(pool.allocate());
+    }
+    EXPECT_EQ(6u, blocks.size());
+    EXPECT_EQ(6u, pool.allocatedBlocks());
+    EXPECT_EQ(8 * pool.blockSize(), pool.reservedBytes());
+    void* block = *blocks.begin();
+    pool.deallocate(block);
+    EXPECT_EQ(5u, pool.allocatedBlocks());
+    EXPECT_EQ(block, pool.allocate());
+    for (void* block : blocks) {
+        pool.deallocate(block);
+    }
+    EXPECT_EQ(0u, pool.allocatedBlocks());
+    EXPECT_EQ(8 * pool.blockSize(), pool.reservedBytes());
+}
+
+
+TEST(PoolAllocator, AllocatesComponents) {
+    size_t allocatedBytes = Component::poolAllocatedBytes();
+    std::unique_ptr<Component> component(new TestComponent<0>());
+    EXPECT_GE(Component::poolAllocatedBytes(), allocatedBytes + sizeof(TestComponent<0>));
+    EXPECT_GE(Component::poolReservedBytes(), Component::poolAllocatedBytes());
+    component.reset();
+    EXPECT_EQ(allocatedBytes, Component::poolAllocatedBytes());
+}
+
+
+TEST(PoolAllocator, Batches) {
+    PoolAllocator pool(16, 4);
+    void* blocks[6] = {};
+    pool.allocateBatch(blocks, 6);
+    EXPECT_EQ(6u, pool.allocatedBlocks());
+    EXPECT_EQ(8 * pool.blockSize(), pool.reservedBytes());
+    std::set<void*> distinct(blocks, blocks + 6);
+    EXPECT_EQ(6u, distinct.size());
+    pool.deallocateBatch(blocks, 5);
+    EXPECT_EQ(1u, pool.allocatedBlocks());
+    pool.deallocate(blocks[5]);
+    EXPECT_EQ(0u, pool.allocatedBlocks());
+    EXPECT_EQ(8 * pool.blockSize(), pool.reservedBytes());
+}
@@ -0,0 +1,98 @@
+#include "engine/reflection.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+enum class Mode {
+    First,
+    Second
+};
+
+struct Reflected {
+
+    float number = 1.0f;
+
+    int32_t count = 2;
+
+    Mode mode = Mode::First;
+
+    std::string name = "default";
+
+    Ogre::Vector3 position = Ogre::Vector3::ZERO;
+
+};
+
+const auto FIELDS = fieldList<Reflected>(
+    field("number", &Reflected::number),
+    field("count", &Reflected::count),
+    storedField<int16_t>("mode", &Reflected::mode),
+    field("name", &Reflected::name),
+    field("position", &Reflected::position)
+);
+
+} // namespace
+
+
+TEST(Reflection, Masks) {
+    EXPECT_EQ(5u, FIELDS.SIZE);
+    EXPECT_EQ(1u << 0, FIELDS.mask(&Reflected::number));
+    EXPECT_EQ(1u << 2, FIELDS.mask(&Reflected::mode));
+    EXPECT_EQ(1u << 4, FIELDS.mask(&Reflected::position));
+}
+
+
+TEST(Reflection, Binary) {
+    Reflected original;
+    original.number = 3.5f;
+    original.count = -40;
+    original.mode = Mode::Second;
+    original.name = "reflected";
+    original.position = Ogre::Vector3(1.0f, 2.0f, 3.0f);
+    std::string buffer;
+    FIELDS.writeBinary(original, buffer);
+    // Fixed sizes plus the length prefix of the string
+    EXPECT_EQ(4u + 4u + 2u + 4u + 9u + 12u, buffer.size());
+    Reflected copy;
+    size_t offset = 0;
+    FIELDS.readBinary(copy, buffer, offset);
+    EXPECT_EQ(buffer.size(), offset);
+    EXPECT_EQ(3.5f, copy.number);
+    EXPECT_EQ(-40, copy.count);
+    EXPECT_TRUE(Mode::Second == copy.mode);
+    EXPECT_EQ("reflected", copy.name);
+    EXPECT_TRUE(Ogre::Vector3(1.0f, 2.0f, 3.0f) == copy.position);
+}
+
+
+TEST(Reflection, TruncatedBinary) {
+    std::string buffer;
+    FIELDS.writeBinary(Reflected(), buffer);
+    buffer.resize(buffer.size() - 1);
+    Reflected copy;
+    size_t offset = 0;
+    EXPECT_THROW(FIELDS.readBinary(copy, buffer, offset), std::out_of_range);
+}
+
+
+TEST(Reflection, Storage) {
+    Reflected original;
+    original.count = 7;
+    original.mode = Mode::Second;
+    StorageContainer storage;
+    FIELDS.store(original, storage);
+    EXPECT_EQ(1, storage.get<int16_t>("mode"));
+    Reflected copy;
+    FIELDS.load(copy, storage);
+    EXPECT_EQ(7, copy.count);
+    EXPECT_TRUE(Mode::Second == copy.mode);
+    // Missing keys keep the initial values
+    Reflected defaults;
+    defaults.count = 9;
+    FIELDS.load(defaults, StorageContainer());
+    EXPECT_EQ(9, defaults.count);
+    EXPECT_EQ("default", defaults.name);
+}
@@ -63,3 +63,67 @@ TEST(RNG, shuffle) {
     rng.shuffle(shuffled.begin(), shuffled.end());
     EXPECT_TRUE(shuffled != original);
 }
+
+TEST(RNG, sameSeedSameSequence) {
+    RNG first(42);
+    RNG second(42);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(first.getInt(0, 1000), second.getInt(0, 1000));
+    }
+    // Restarting with the seed repeats the sequence
+    first.setSeed(7);
+    double value = first.getDouble(0.0, 1.0);
+    first.setSeed(7);
+    EXPECT_EQ(value, first.getDouble(0.0, 1.0));
+}
+
+TEST(RNG, fillInts) {
+    RNG rng(1337);
+    std::vector<int> values(1000);
+    rng.fillInts(values.data(), values.size(), -3, 3);
+    std::set<int> distinct(values.begin(), values.end());
+    // All values in range and every value hit
+    EXPECT_EQ(7, distinct.size());
+    EXPECT_EQ(-3, *distinct.begin());
+    EXPECT_EQ(3, *distinct.rbegin());
+}
+
+TEST(RNG, fillDoubles) {
+    RNG rng(1337);
+    std::vector<double> values(1000);
+    rng.fillDoubles(values.data(), values.size(), -1.0, 1.0);
+    for (double value : values) {
+        EXPECT_LE(-1.0, value);
+        EXPECT_GE(1.0, value);
+    }
+    // A batch continues the same sequence as single values
+    RNG single(1337);
+    EXPECT_EQ(values[0], single.getDouble(-1.0, 1.0));
+    EXPECT_EQ(values[1], single.getDouble(-1.0, 1.0));
+}
+
+TEST(RNG, fillAngles) {
+    RNG rng;
+    std::vector<float> values(1000);
+    rng.fillAngles(values.data(), values.size());
+    for (float value : values) {
+        EXPECT_LE(0.0f, value);
+        EXPECT_GT(6.2832f, value);
+    }
+}
+
+TEST(RNG, split) {
+    RNG rng(1337);
+    RNG reference(1337);
+    RNG stream = rng.split();
+    EXPECT_EQ(1337, stream.getSeed());
+    // The stream continues the original sequence, the original jumped ahead
+    EXPECT_EQ(reference.getInt(0, 1000000), stream.getInt(0, 1000000));
+    EXPECT_NE(reference.getInt(0, 1000000), rng.getInt(0, 1000000));
+    // Splitting is deterministic
+    RNG first(1337);
+    RNG second(1337);
+    first.split();
+    second.split();
+    EXPECT_EQ(first.getInt(0, 1000000), second.getInt(0, 1000000));
+}
@@ -1,6 +1,11 @@
 #include "engine/serialization.h"
 
+#include "scripting/lua_include.h"
+
+#include <cstdio>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <stdexcept>
 
 using namespace thrive;
 
@@ -95,6 +100,29 @@ TEST(Serialization, StorageContainer) {
 }
 
 
+TEST(Serialization, StorageKey) {
+    const StorageKey key("storageKeyTest");
+    EXPECT_EQ(key, StorageKey(std::string("storageKeyTest")));
+    EXPECT_NE(key, StorageKey("storageKeyTest2"));
+    EXPECT_EQ("storageKeyTest", key.name());
+    StorageContainer storage;
+    EXPECT_FALSE(storage.contains(key));
+    EXPECT_FALSE(storage.contains("neverUsedAsKey"));
+    // Keys and strings refer to the same entries, in any order of insertion
+    storage.set<int32_t>("storageKeyTest2", 2);
+    storage.set<int32_t>(key, 1);
+    storage.set<int32_t>("a", 3);
+    EXPECT_EQ(1, storage.get<int32_t>("storageKeyTest"));
+    EXPECT_EQ(2, storage.get<int32_t>(StorageKey("storageKeyTest2")));
+    EXPECT_EQ(3, storage.get<int32_t>("a"));
+    EXPECT_TRUE(storage.contains<int32_t>(key));
+    EXPECT_FALSE(storage.contains<float>(key));
+    EXPECT_EQ(3u, storage.keys().size());
+    StorageContainer storageCopy = copy(storage);
+    EXPECT_EQ(1, storageCopy.get<int32_t>(key));
+}
+
+
 TEST(Serialization, ColourValue) {
     Ogre::ColourValue colour = Ogre::ColourValue::White;
     testSerialization(colour);
@@ -109,3 +137,401 @@ TEST(Serialization, Vector3) {
 
 
 
+TEST(Serialization, CompactFormat) {
+    StorageContainer inner;
+    inner.set<std::string>("name", "thrive");
+    inner.set<Ogre::Vector3>("position", Ogre::Vector3(1, -2, 3.5));
+    inner.set<Ogre::Quaternion>("orientation", Ogre::Quaternion(1, 0, 0.5, 0));
+    inner.set<Ogre::Plane>("plane", Ogre::Plane(Ogre::Vector3(0, 1, 0), 4));
+    inner.set<Ogre::ColourValue>("colour", Ogre::ColourValue::White);
+    inner.set<int32_t>("negative", -18000);
+    inner.set<uint64_t>("large", 1ull << 60);
+    inner.set<double>("double", 3.1415);
+    StorageList list;
+    list.append(inner);
+    list.append(inner);
+    StorageContainer outer;
+    outer.set<StorageList>("list", list);
+    outer.set<bool>("flag", true);
+    std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+    saveStorage(outputStream, outer);
+    std::istringstream inputStream(
+        outputStream.str(),
+        std::ios_base::in | std::ios_base::binary
+    );
+    StorageContainer copy;
+    loadStorage(inputStream, copy);
+    EXPECT_TRUE(copy.get<bool>("flag"));
+    StorageList listCopy = copy.get<StorageList>("list");
+    ASSERT_EQ(2, listCopy.size());
+    const StorageContainer& innerCopy = listCopy[1];
+    EXPECT_EQ("thrive", innerCopy.get<std::string>("name"));
+    EXPECT_TRUE(Ogre::Vector3(1, -2, 3.5) == innerCopy.get<Ogre::Vector3>("position"));
+    EXPECT_TRUE(Ogre::Quaternion(1, 0, 0.5, 0) == innerCopy.get<Ogre::Quaternion>("orientation"));
+    EXPECT_TRUE(Ogre::Plane(Ogre::Vector3(0, 1, 0), 4) == innerCopy.get<Ogre::Plane>("plane"));
+    EXPECT_TRUE(Ogre::ColourValue::White == innerCopy.get<Ogre::ColourValue>("colour"));
+    EXPECT_EQ(-18000, innerCopy.get<int32_t>("negative"));
+    EXPECT_EQ(1ull << 60, innerCopy.get<uint64_t>("large"));
+    EXPECT_DOUBLE_EQ(3.1415, innerCopy.get<double>("double"));
+}
+
+
+// Replaces the count at \a offset with 2^32, the largest accepted one
+static std::string
+corruptCount(
+    std::string data,
+    size_t offset
+) {
+    EXPECT_EQ(0, data[offset]);
+    return data.replace(offset, 1, "\x80\x80\x80\x80\x10", 5);
+}
+
+
+TEST(Serialization, CompactFormatRejectsCorruptCounts) {
+    StorageContainer empty;
+    std::ostringstream emptyStream(std::ios_base::out | std::ios_base::binary);
+    saveStorage(emptyStream, empty);
+    StorageContainer withList;
+    withList.set<StorageList>("list", StorageList());
+    std::ostringstream listStream(std::ios_base::out | std::ios_base::binary);
+    saveStorage(listStream, withList);
+    const std::string emptyData = emptyStream.str();
+    const std::string listData = listStream.str();
+    // Magic number and version precede the dictionary's string count. The
+    // last count is the root container's or the list's.
+    std::vector<std::string> corrupted {
+        corruptCount(emptyData, 9),
+        corruptCount(emptyData, emptyData.size() - 1),
+        corruptCount(listData, listData.size() - 1)
+    };
+    for (const std::string& data : corrupted) {
+        std::istringstream inputStream(data, std::ios_base::in | std::ios_base::binary);
+        StorageContainer copy;
+        EXPECT_THROW(loadStorage(inputStream, copy), std::runtime_error);
+    }
+}
+
+
+TEST(Serialization, Arrays) {
+    std::vector<float> floats {0.5f, -1.0f, 1e20f};
+    std::vector<int32_t> integers {-7, 0, 1 << 30};
+    std::vector<Ogre::Vector3> vectors {Ogre::Vector3(1, 2, 3), Ogre::Vector3(-4, 5.5, 0)};
+    testSerialization(floats);
+    testSerialization(integers);
+    testSerialization(vectors);
+    StorageContainer storage;
+    storage.set("floats", floats);
+    storage.set("integers", integers);
+    storage.set("vectors", vectors);
+    std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+    saveStorage(outputStream, storage);
+    std::istringstream inputStream(
+        outputStream.str(),
+        std::ios_base::in | std::ios_base::binary
+    );
+    StorageContainer copy;
+    loadStorage(inputStream, copy);
+    EXPECT_EQ(floats, copy.get<std::vector<float>>("floats"));
+    EXPECT_EQ(integers, copy.get<std::vector<int32_t>>("integers"));
+    EXPECT_TRUE(vectors == copy.get<std::vector<Ogre::Vector3>>("vectors"));
+    // Same layout, but a different type
+    EXPECT_FALSE(copy.contains<std::vector<float>>("vectors"));
+}
+
+
+TEST(Serialization, Columns) {
+    StorageList rows;
+    for (int i = 0; i < 3; ++i) {
+        StorageContainer row;
+        row.set<float>("speed", i * 0.5f);
+        row.set<Ogre::Vector3>("position", Ogre::Vector3(i, 0, -i));
+        row.set<Ogre::Quaternion>("orientation", Ogre::Quaternion(1, 0, i, 0));
+        row.set<std::string>("name", "row" + std::to_string(i));
+        if (i != 1) {
+            row.set<int32_t>("sometimes", i);
+        }
+        rows.append(std::move(row));
+    }
+    StorageContainer columns = storageColumns(rows);
+    std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+    saveStorage(outputStream, columns);
+    std::istringstream inputStream(
+        outputStream.str(),
+        std::ios_base::in | std::ios_base::binary
+    );
+    StorageContainer copy;
+    loadStorage(inputStream, copy);
+    StorageList rowsCopy = storageRows(copy);
+    ASSERT_EQ(3, rowsCopy.size());
+    for (int i = 0; i < 3; ++i) {
+        const StorageContainer& row = rowsCopy[i];
+        EXPECT_FLOAT_EQ(i * 0.5f, row.get<float>("speed"));
+        EXPECT_TRUE(Ogre::Vector3(i, 0, -i) == row.get<Ogre::Vector3>("position"));
+        EXPECT_TRUE(Ogre::Quaternion(1, 0, i, 0) == row.get<Ogre::Quaternion>("orientation"));
+        EXPECT_EQ("row" + std::to_string(i), row.get<std::string>("name"));
+        EXPECT_EQ(i != 1, row.contains("sometimes"));
+    }
+    EXPECT_EQ(0, storageRows(storageColumns(StorageList())).size());
+}
+
+
+TEST(Serialization, CompactFormatReadsLegacyFormat) {
+    StorageContainer storage;
+    storage.set<std::string>("value", "thrive");
+    std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+    outputStream << storage;
+    std::istringstream inputStream(
+        outputStream.str(),
+        std::ios_base::in | std::ios_base::binary
+    );
+    StorageContainer copy;
+    loadStorage(inputStream, copy);
+    EXPECT_EQ("thrive", copy.get<std::string>("value"));
+}
+
+
+TEST(Serialization, CompactFormatIsSmaller) {
+    StorageList entities;
+    for (int i = 0; i < 100; ++i) {
+        StorageContainer entity;
+        entity.set<std::string>("meshName", "agent.mesh");
+        entity.set<Ogre::Vector3>("position", Ogre::Vector3(i, 0, 0));
+        entities.append(std::move(entity));
+    }
+    StorageContainer storage;
+    storage.set<StorageList>("entities", std::move(entities));
+    std::ostringstream legacy(std::ios_base::out | std::ios_base::binary);
+    legacy << storage;
+    std::ostringstream compact(std::ios_base::out | std::ios_base::binary);
+    saveStorage(compact, storage);
+    EXPECT_LT(compact.str().size() * 5, legacy.str().size());
+}
+
+
+static void
+testStorageReader(
+    bool legacy
+) {
+    StorageContainer first;
+    first.set<int32_t>("value", 1);
+    StorageContainer second;
+    second.set<int32_t>("value", 2);
+    StorageContainer children;
+    children.set<StorageContainer>("first", first);
+    children.set<StorageContainer>("second", second);
+    StorageContainer root;
+    root.set<StorageContainer>("children", children);
+    root.set<std::string>("name", "thrive");
+    root.set<StorageContainer>("skipped", first);
+    std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+    if (legacy) {
+        outputStream << root;
+    }
+    else {
+        saveStorage(outputStream, root);
+    }
+    std::istringstream inputStream(
+        outputStream.str(),
+        std::ios_base::in | std::ios_base::binary
+    );
+    StorageReader reader(inputStream);
+    StorageContainer entries;
+    int childSum = 0;
+    while (reader.nextEntry()) {
+        if (reader.key() == "children") {
+            ASSERT_TRUE(reader.isContainer());
+            reader.enterContainer();
+            while (reader.nextEntry()) {
+                childSum += reader.readContainer().get<int32_t>("value");
+            }
+        }
+        else if (reader.key() == "name") {
+            EXPECT_FALSE(reader.isContainer());
+            reader.readEntry(entries);
+        }
+    }
+    EXPECT_EQ(3, childSum);
+    EXPECT_EQ("thrive", entries.get<std::string>("name"));
+    EXPECT_FALSE(entries.contains("skipped"));
+    EXPECT_FLOAT_EQ(1.0f, reader.progress());
+}
+
+
+TEST(Serialization, StorageReader) {
+    testStorageReader(false);
+    testStorageReader(true);
+}
+
+
+TEST(Serialization, MappedStorage) {
+    StorageContainer element;
+    element.set<Ogre::Vector3>("position", Ogre::Vector3(1, 2, 3));
+    StorageList list;
+    list.append(element);
+    StorageContainer inner;
+    inner.set<StorageList>("list", list);
+    inner.set<std::string>("name", "thrive");
+    StorageContainer root;
+    root.set<StorageContainer>("inner", inner);
+    root.set<int32_t>("value", 42);
+    const char* filename = "mapped_storage_test.sav";
+    {
+        std::ofstream file(filename, std::ios_base::out | std::ios_base::binary);
+        saveStorage(file, root);
+    }
+    {
+        StorageContainer mapped = mapStorage(filename);
+        EXPECT_EQ(42, mapped.get<int32_t>("value"));
+        StorageContainer innerCopy = mapped.get<StorageContainer>("inner");
+        EXPECT_EQ("thrive", innerCopy.get<std::string>("name"));
+        StorageList listCopy = innerCopy.get<StorageList>("list");
+        ASSERT_EQ(1, listCopy.size());
+        EXPECT_TRUE(Ogre::Vector3(1, 2, 3) == listCopy[0].get<Ogre::Vector3>("position"));
+        // Unparsed values survive saving again
+        std::ostringstream outputStream(std::ios_base::out | std::ios_base::binary);
+        saveStorage(outputStream, mapped);
+        std::istringstream inputStream(
+            outputStream.str(),
+            std::ios_base::in | std::ios_base::binary
+        );
+        StorageContainer copy;
+        loadStorage(inputStream, copy);
+        EXPECT_EQ(
+            "thrive", 
+            copy.get<StorageContainer>("inner").get<std::string>("name")
+        );
+    }
+    std::remove(filename);
+}
+
+
+namespace {
+
+class LuaTableTest : public ::testing::Test {
+
+protected:
+
+    void
+    SetUp() override {
+        L = luaL_newstate();
+        luaL_openlibs(L);
+    }
+
+    void
+    TearDown() override {
+        lua_close(L);
+    }
+
+    // Leaves the script's return value on the stack
+    void
+    evaluate(
+        const char* script
+    ) {
+        ASSERT_EQ(0, luaL_dostring(L, script)) << lua_tostring(L, -1);
+    }
+
+    lua_State* L = nullptr;
+
+};
+
+}
+
+
+TEST_F(LuaTableTest, FromTable) {
+    evaluate(
+        "return {"
+        "    flag = true,"
+        "    name = 'cell',"
+        "    speed = 1.5,"
+        "    hexes = {1, -2, 3},"
+        "    weights = {0.5, 2},"
+        "    position = {q = 3, r = 4},"
+        "    agents = {{agentId = 1}, {agentId = 2}}"
+        "}"
+    );
+    StorageContainer storage = StorageContainer::fromTable(L, -1);
+    lua_pop(L, 1);
+    EXPECT_EQ(0, lua_gettop(L));
+    EXPECT_TRUE(storage.get<bool>("flag"));
+    EXPECT_EQ("cell", storage.get<std::string>("name"));
+    EXPECT_EQ(1.5, storage.get<double>("speed"));
+    EXPECT_EQ(std::vector<int32_t>({1, -2, 3}), storage.get<std::vector<int32_t>>("hexes"));
+    EXPECT_EQ(std::vector<float>({0.5f, 2.0f}), storage.get<std::vector<float>>("weights"));
+    StorageContainer position = storage.get<StorageContainer>("position");
+    EXPECT_EQ(4.0, position.get<double>("r"));
+    StorageList agents = storage.get<StorageList>("agents");
+    ASSERT_EQ(2u, agents.size());
+    EXPECT_EQ(2.0, agents.get(2).get<double>("agentId"));
+}
+
+
+TEST_F(LuaTableTest, FromTableWithSchema) {
+    StorageSchema agentSchema;
+    agentSchema.addField("agentId", StorageSchema::Type::Integer);
+    StorageSchema schema;
+    schema.addField("q", StorageSchema::Type::Integer);
+    schema.addField("hexes", StorageSchema::Type::FloatArray);
+    schema.addField("missing", StorageSchema::Type::String);
+    schema.addField(
+        "agents",
+        StorageSchema::Type::List,
+        std::make_shared<StorageSchema>(agentSchema)
+    );
+    evaluate(
+        "return {"
+        "    q = 3,"
+        "    hexes = {1, 2},"
+        "    undeclared = print,"
+        "    agents = {{agentId = 7, amount = 2}}"
+        "}"
+    );
+    StorageContainer storage = StorageContainer::fromTable(L, -1, &schema);
+    EXPECT_TRUE(storage.contains<int32_t>("q"));
+    EXPECT_EQ(std::vector<float>({1.0f, 2.0f}), storage.get<std::vector<float>>("hexes"));
+    EXPECT_FALSE(storage.contains("missing"));
+    EXPECT_FALSE(storage.contains("undeclared"));
+    StorageList agents = storage.get<StorageList>("agents");
+    ASSERT_EQ(1u, agents.size());
+    EXPECT_EQ(7, agents.get(1).get<int32_t>("agentId"));
+    EXPECT_FALSE(agents.get(1).contains("amount"));
+}
+
+
+TEST_F(LuaTableTest, FromTableRejectsInvalidValues) {
+    evaluate("return {callback = print}");
+    EXPECT_THROW(StorageContainer::fromTable(L, -1), std::invalid_argument);
+    evaluate("local t = {} t.self = t return t");
+    EXPECT_THROW(StorageContainer::fromTable(L, -1), std::invalid_argument);
+    StorageSchema schema;
+    schema.addField("q", StorageSchema::Type::Integer);
+    evaluate("return {q = 'three'}");
+    EXPECT_THROW(StorageContainer::fromTable(L, -1, &schema), std::invalid_argument);
+}
+
+
+TEST_F(LuaTableTest, PushTable) {
+    evaluate(
+        "return {"
+        "    name = 'cell',"
+        "    hexes = {1, 2, 3},"
+        "    position = {q = 3},"
+        "    agents = {{agentId = 1}, {agentId = 2}}"
+        "}"
+    );
+    StorageContainer storage = StorageContainer::fromTable(L, -1);
+    lua_pop(L, 1);
+    storage.pushTable(L);
+    lua_setglobal(L, "data");
+    evaluate(
+        "return data.name == 'cell' and #data.hexes == 3 and data.hexes[3] == 3 and "
+        "data.position.q == 3 and data.agents[2].agentId == 2"
+    );
+    EXPECT_TRUE(lua_toboolean(L, -1));
+    lua_pop(L, 1);
+    StorageSchema schema;
+    schema.addField("name", StorageSchema::Type::String);
+    storage.pushTable(L, &schema);
+    lua_setglobal(L, "data");
+    evaluate("return data.name == 'cell' and data.hexes == nil");
+    EXPECT_TRUE(lua_toboolean(L, -1));
+}
@@ -0,0 +1,95 @@
+#include "engine/shared_data.h"
+
+#include "engine/entity_manager.h"
+#include "engine/entity_prototype.h"
+#include "engine/tests/temporary_file.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+
+TEST(SharedData, CompiledScripts) {
+    TemporaryFile file;
+    SharedDataWriter writer;
+    writer.addCompiledScript("microbe_stage/setup.lua", "bytecode");
+    writer.write(file.path);
+    SharedData sharedData(file.path);
+    const AssetPack::File* script = sharedData.compiledScript("microbe_stage/setup.lua");
+    ASSERT_NE(nullptr, script);
+    EXPECT_EQ("bytecode", std::string(script->data, script->size));
+    EXPECT_EQ(nullptr, sharedData.compiledScript("microbe_stage/missing.lua"));
+}
+
+
+TEST(SharedData, Prototypes) {
+    EntityManager entityManager;
+    EntityId entity = entityManager.generateNewId();
+    entityManager.addComponent(entity, make_unique<TestComponent<0>>());
+    entityManager.addComponent(entity, make_unique<TestComponent<1>>());
+    TemporaryFile file;
+    SharedDataWriter writer;
+    writer.addPrototype("emitter", EntityPrototype(entityManager, entity));
+    EXPECT_TRUE(writer.hasPrototype("emitter"));
+    writer.write(file.path);
+    SharedData sharedData(file.path);
+    EXPECT_TRUE(sharedData.hasPrototype("emitter"));
+    EXPECT_FALSE(sharedData.hasPrototype("missing"));
+    EntityPrototype prototype;
+    ASSERT_TRUE(sharedData.loadPrototype("emitter", prototype));
+    EXPECT_EQ(2, prototype.componentCount());
+    EntityPrototype untouched;
+    EXPECT_FALSE(sharedData.loadPrototype("missing", untouched));
+    EXPECT_EQ(0, untouched.componentCount());
+}
+
+
+TEST(SharedData, KeepsAddedPrototypes) {
+    EntityManager entityManager;
+    EntityId entity = entityManager.generateNewId();
+    entityManager.addComponent(entity, make_unique<TestComponent<0>>());
+    TemporaryFile file;
+    {
+        SharedDataWriter writer;
+        writer.addPrototype("emitter", EntityPrototype());
+        writer.addPrototype("microbe", EntityPrototype());
+        writer.write(file.path);
+    }
+    SharedData previous(file.path);
+    SharedDataWriter writer;
+    writer.addPrototype("emitter", EntityPrototype(entityManager, entity));
+    writer.addPrototypes(previous);
+    EXPECT_TRUE(writer.hasPrototype("microbe"));
+    // Replaces the mapped file, which stays readable
+    writer.write(file.path);
+    EXPECT_TRUE(previous.hasPrototype("emitter"));
+    SharedData sharedData(file.path);
+    EntityPrototype prototype;
+    ASSERT_TRUE(sharedData.loadPrototype("emitter", prototype));
+    EXPECT_EQ(1, prototype.componentCount());
+    EXPECT_TRUE(sharedData.hasPrototype("microbe"));
+}
+
+
+TEST(SharedData, Invalid) {
+    TemporaryFile file;
+    {
+        AssetPackWriter pack;
+        pack.add("version", "thrive-shared-data 0");
+        pack.write(file.path);
+    }
+    EXPECT_THROW(SharedData sharedData(file.path), std::runtime_error);
+    TemporaryFile unversioned;
+    {
+        AssetPackWriter pack;
+        pack.add("scripts/setup.lua.luac", "bytecode");
+        pack.write(unversioned.path);
+    }
+    EXPECT_THROW(SharedData sharedData(unversioned.path), std::runtime_error);
+    TemporaryFile missing;
+    EXPECT_THROW(SharedData sharedData(missing.path), std::runtime_error);
+}
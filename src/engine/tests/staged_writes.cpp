@@ -0,0 +1,151 @@
+#include "engine/staged_writes.h"
+
+#include "engine/entity_manager.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+class StagedComponent : public TestComponent<0> {
+
+public:
+
+    struct Values : public Touchable {
+
+        enum Field : FieldMask {
+            SPEED = 1 << 0,
+            DIRECTION = 1 << 1
+        };
+
+        Ogre::Vector3 direction = Ogre::Vector3::ZERO;
+
+        Ogre::Real speed = 0.0f;
+
+    };
+
+    static const StagedWrites::FieldId DIRECTION_FIELD;
+
+    static const StagedWrites::FieldId SPEED_FIELD;
+
+    Values m_values;
+
+};
+
+const StagedWrites::FieldId StagedComponent::DIRECTION_FIELD =
+    StagedWrites::registerField<StagedComponent, Ogre::Vector3>(
+        "Test.direction",
+        [] (StagedComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_values.direction = value;
+            return component.m_values;
+        },
+        StagedComponent::Values::DIRECTION
+    );
+
+const StagedWrites::FieldId StagedComponent::SPEED_FIELD =
+    StagedWrites::registerField<StagedComponent, Ogre::Real>(
+        "Test.speed",
+        [] (StagedComponent& component, const Ogre::Real& value) -> Touchable& {
+            component.m_values.speed = value;
+            return component.m_values;
+        },
+        StagedComponent::Values::SPEED
+    );
+
+
+StagedComponent*
+addStagedComponent(
+    EntityManager& entityManager,
+    EntityId entityId
+) {
+    auto component = make_unique<StagedComponent>();
+    StagedComponent* raw = component.get();
+    entityManager.addComponent(entityId, std::move(component));
+    entityManager.processCommands();
+    return raw;
+}
+
+}
+
+
+TEST(StagedWrites, FieldLookup) {
+    EXPECT_EQ(StagedComponent::SPEED_FIELD, StagedWrites::field("Test.speed"));
+    EXPECT_THROW(StagedWrites::field("Test.missing"), std::invalid_argument);
+}
+
+
+TEST(StagedWrites, LastWriteWins) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    StagedComponent* component = addStagedComponent(entityManager, entityId);
+    component->m_values.untouch();
+    StagedWrites writes;
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 1.0f);
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 2.0f);
+    EXPECT_EQ(1u, writes.pendingCount());
+    // Not applied before the flush
+    EXPECT_EQ(0.0f, component->m_values.speed);
+    EXPECT_EQ(1u, writes.flush(entityManager, StagedComponent::TYPE_ID));
+    EXPECT_EQ(2.0f, component->m_values.speed);
+    EXPECT_EQ(0u, writes.pendingCount());
+}
+
+
+TEST(StagedWrites, TouchesCombinedFields) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    StagedComponent* component = addStagedComponent(entityManager, entityId);
+    component->m_values.untouch();
+    StagedWrites writes;
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 3.0f);
+    writes.stageVector3(entityId, StagedComponent::DIRECTION_FIELD, Ogre::Vector3::UNIT_X);
+    EXPECT_EQ(2u, writes.flush(entityManager, StagedComponent::TYPE_ID));
+    EXPECT_EQ(Ogre::Vector3::UNIT_X, component->m_values.direction);
+    EXPECT_TRUE(component->m_values.hasChanges());
+    EXPECT_EQ(
+        StagedComponent::Values::SPEED | StagedComponent::Values::DIRECTION,
+        component->m_values.changedFields()
+    );
+}
+
+
+TEST(StagedWrites, KeepsOtherComponentTypes) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    addStagedComponent(entityManager, entityId);
+    StagedWrites writes;
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 1.0f);
+    EXPECT_EQ(0u, writes.flush(entityManager, TestComponent<1>::TYPE_ID));
+    EXPECT_EQ(1u, writes.pendingCount());
+    // Coalescing still works for the kept writes
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 2.0f);
+    EXPECT_EQ(1u, writes.pendingCount());
+}
+
+
+TEST(StagedWrites, DropsMissingComponents) {
+    EntityManager entityManager;
+    EntityId entityId = entityManager.generateNewId();
+    StagedWrites writes;
+    writes.stageReal(entityId, StagedComponent::SPEED_FIELD, 1.0f);
+    EXPECT_EQ(0u, writes.flush(entityManager, StagedComponent::TYPE_ID));
+    EXPECT_EQ(0u, writes.pendingCount());
+}
+
+
+TEST(StagedWrites, TypeMismatch) {
+    StagedWrites writes;
+    EXPECT_THROW(
+        writes.stageVector3(1, StagedComponent::SPEED_FIELD, Ogre::Vector3::ZERO),
+        std::invalid_argument
+    );
+    EXPECT_THROW(
+        writes.stageReal(1, StagedWrites::FieldId(-1), 1.0f),
+        std::invalid_argument
+    );
+    EXPECT_EQ(0u, writes.pendingCount());
+}
@@ -0,0 +1,164 @@
+#include "engine/state_hash.h"
+
+#include "engine/entity_manager.h"
+#include "engine/tests/test_component.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace {
+
+class HashedComponent : public TestComponent<0> {
+
+public:
+
+    HashedComponent(
+        float value,
+        bool isTracked
+    ) : m_isTracked(isTracked)
+    {
+        m_value.setComponent(this);
+        m_value = value;
+    }
+
+    void
+    digest(
+        StateDigest& digest
+    ) const override {
+        ++s_digestCount;
+        digest.add<float>(m_value);
+    }
+
+    bool
+    isChangeTracked() const override {
+        return m_isTracked;
+    }
+
+    static unsigned int s_digestCount;
+
+    bool m_isTracked;
+
+    TouchableValue<float> m_value;
+
+};
+
+unsigned int HashedComponent::s_digestCount = 0;
+
+
+HashedComponent*
+addHashedComponent(
+    EntityManager& entityManager,
+    EntityId entityId,
+    float value,
+    bool isTracked
+) {
+    auto component = make_unique<HashedComponent>(value, isTracked);
+    HashedComponent* raw = component.get();
+    entityManager.addComponent(entityId, std::move(component));
+    entityManager.processCommands();
+    return raw;
+}
+
+}
+
+
+TEST(StateDigest, DependsOnValuesAndOrder) {
+    StateDigest first;
+    first.add<float>(1.0f).add<int32_t>(2);
+    StateDigest same;
+    same.add<float>(1.0f).add<int32_t>(2);
+    StateDigest swapped;
+    swapped.add<int32_t>(2).add<float>(1.0f);
+    StateDigest negativeZero;
+    negativeZero.add<float>(-0.0f);
+    StateDigest zero;
+    zero.add<float>(0.0f);
+    EXPECT_EQ(first.value(), same.value());
+    EXPECT_NE(first.value(), swapped.value());
+    // Bit for bit, so that runs can't differ unnoticed
+    EXPECT_NE(zero.value(), negativeZero.value());
+}
+
+
+TEST(StateHash, IndependentOfComponentOrder) {
+    EntityManager first;
+    EntityManager second;
+    EntityId firstIds[] = {first.generateNewId(), first.generateNewId(), first.generateNewId()};
+    EntityId secondIds[] = {second.generateNewId(), second.generateNewId(), second.generateNewId()};
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(firstIds[i], secondIds[i]);
+        addHashedComponent(first, firstIds[i], float(i), false);
+    }
+    for (int i = 2; i >= 0; --i) {
+        addHashedComponent(second, secondIds[i], float(i), false);
+    }
+    StateHash firstHash;
+    firstHash.addComponentType(TestComponent<0>::TYPE_ID);
+    firstHash.setEntityManager(&first);
+    firstHash.update();
+    StateHash secondHash;
+    secondHash.addComponentType(TestComponent<0>::TYPE_ID);
+    secondHash.setEntityManager(&second);
+    secondHash.update();
+    EXPECT_EQ(firstHash.hash(), secondHash.hash());
+    // Removing moves the last component, which mustn't matter either
+    first.removeComponent(firstIds[0], TestComponent<0>::TYPE_ID);
+    first.processCommands();
+    second.removeComponent(secondIds[0], TestComponent<0>::TYPE_ID);
+    second.processCommands();
+    firstHash.update();
+    secondHash.update();
+    EXPECT_EQ(firstHash.hash(), secondHash.hash());
+    // Same values on other entities are a different state
+    auto component = static_cast<HashedComponent*>(
+        second.getComponent(secondIds[1], TestComponent<0>::TYPE_ID)
+    );
+    component->m_value = 2.0f;
+    static_cast<HashedComponent*>(
+        second.getComponent(secondIds[2], TestComponent<0>::TYPE_ID)
+    )->m_value = 1.0f;
+    secondHash.update();
+    EXPECT_NE(firstHash.hash(), secondHash.hash());
+}
+
+
+TEST(StateHash, ReusesDigestsOfUnchangedComponents) {
+    EntityManager entityManager;
+    StateHash stateHash;
+    stateHash.addComponentType(TestComponent<0>::TYPE_ID);
+    stateHash.setEntityManager(&entityManager);
+    stateHash.update();
+    uint64_t emptyHash = stateHash.typeHash(0);
+    EntityId tracked = entityManager.generateNewId();
+    EntityId untracked = entityManager.generateNewId();
+    HashedComponent* trackedComponent = addHashedComponent(entityManager, tracked, 1.0f, true);
+    addHashedComponent(entityManager, untracked, 1.0f, false);
+    HashedComponent::s_digestCount = 0;
+    stateHash.update();
+    EXPECT_EQ(2, HashedComponent::s_digestCount);
+    uint64_t hash = stateHash.typeHash(0);
+    // Change tracked components are digested again only when touched
+    stateHash.update();
+    EXPECT_EQ(3, HashedComponent::s_digestCount);
+    EXPECT_EQ(hash, stateHash.typeHash(0));
+    trackedComponent->m_value = 2.0f;
+    stateHash.update();
+    EXPECT_EQ(5, HashedComponent::s_digestCount);
+    EXPECT_NE(hash, stateHash.typeHash(0));
+    trackedComponent->m_value = 1.0f;
+    stateHash.update();
+    EXPECT_EQ(hash, stateHash.typeHash(0));
+    // A replacing component is digested anew
+    entityManager.removeComponent(tracked, TestComponent<0>::TYPE_ID);
+    entityManager.processCommands();
+    addHashedComponent(entityManager, tracked, 3.0f, true);
+    stateHash.update();
+    EXPECT_NE(hash, stateHash.typeHash(0));
+    entityManager.removeEntity(tracked);
+    entityManager.removeEntity(untracked);
+    entityManager.processCommands();
+    stateHash.update();
+    EXPECT_EQ(emptyHash, stateHash.typeHash(0));
+}
@@ -0,0 +1,87 @@
+#include "engine/statistics.h"
+
+#include "util/json_writer.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+using namespace thrive;
+
+
+TEST(Statistics, CountsEventsPerSecond) {
+    Statistics statistics;
+    Statistics::Counter& counter = statistics.counter("agents.emitted");
+    EXPECT_EQ(&counter, &statistics.counter("agents.emitted"));
+    counter.add(30);
+    statistics.add("agents.emitted", 20);
+    statistics.update(500);
+    EXPECT_EQ(50u, statistics.counterTotal("agents.emitted"));
+    EXPECT_EQ(0.0, statistics.counterRate("agents.emitted"));
+    statistics.update(500);
+    EXPECT_DOUBLE_EQ(50.0, statistics.counterRate("agents.emitted"));
+    counter.add(10);
+    statistics.update(2000);
+    EXPECT_DOUBLE_EQ(5.0, counter.rate());
+    EXPECT_EQ(0u, statistics.counterTotal("missing"));
+}
+
+
+TEST(Statistics, SummarizesSamples) {
+    Statistics statistics;
+    statistics.set("entities.alive", 42);
+    EXPECT_EQ(42.0, statistics.gaugeValue("entities.alive"));
+    for (int i = 1; i <= 100; ++i) {
+        statistics.record("lua.gcStep", i);
+    }
+    Statistics::Histogram& histogram = statistics.histogram("lua.gcStep");
+    EXPECT_EQ(100u, histogram.count());
+    EXPECT_DOUBLE_EQ(50.5, histogram.mean());
+    EXPECT_EQ(100.0, histogram.max());
+    EXPECT_NEAR(95.0, histogram.percentile(95), 1.0);
+    EXPECT_EQ(0.0, statistics.histogramMean("missing"));
+    std::string report = statistics.report();
+    EXPECT_NE(std::string::npos, report.find("entities.alive: 42.0"));
+    EXPECT_NE(std::string::npos, report.find("lua.gcStep: mean 50.50"));
+}
+
+
+TEST(Statistics, DumpsPeriodically) {
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        Statistics statistics;
+        statistics.add("collision.filterCallbacks", 3);
+        statistics.setDumpFile(path.string(), 1000);
+        statistics.update(600);
+        statistics.update(600);
+        statistics.update(600);
+        statistics.setDumpFile("", 0);
+        statistics.update(1000);
+    }
+    std::ifstream stream(path.string());
+    std::string line;
+    ASSERT_TRUE(std::getline(stream, line));
+    EXPECT_EQ("1200\tcounter\tcollision.filterCallbacks\t3\t2.5", line);
+    EXPECT_FALSE(std::getline(stream, line));
+    stream.close();
+    boost::filesystem::remove(path);
+}
+
+
+TEST(Statistics, WritesJson) {
+    Statistics statistics;
+    statistics.add("agents.emitted", 3);
+    statistics.set("entities.alive", 12);
+    statistics.record("lua.gcStep", 2.0);
+    std::ostringstream stream;
+    JsonWriter writer(stream);
+    statistics.writeJson(writer);
+    EXPECT_EQ(
+        "{\"counters\":{\"agents.emitted\":{\"total\":3,\"rate\":0}},"
+        "\"gauges\":{\"entities.alive\":12},"
+        "\"histograms\":{\"lua.gcStep\":{\"count\":1,\"mean\":2,\"p50\":2,\"p95\":2,\"max\":2}}}",
+        stream.str()
+    );
+}
@@ -0,0 +1,110 @@
+#include "engine/system_pipeline.h"
+
+#include "engine/tests/test_component.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+std::vector<int> updateLog;
+
+
+template<int ID>
+class LoggingSystem : public System {
+
+public:
+
+    void
+    update(int) override {
+        updateLog.push_back(ID);
+    }
+
+};
+
+
+class ReadingSystem : public LoggingSystem<1> {
+
+public:
+
+    ReadingSystem() {
+        this->declareRead(TestComponent<0>::TYPE_ID);
+        this->declareWrite(TestComponent<1>::TYPE_ID);
+    }
+
+};
+
+
+class WritingSystem : public LoggingSystem<2> {
+
+public:
+
+    WritingSystem() {
+        this->declareWrite(TestComponent<2>::TYPE_ID);
+        this->setMainThreadOnly();
+    }
+
+};
+
+
+class FixedRateSystem : public LoggingSystem<3> {
+
+public:
+
+    FixedRateSystem() {
+        this->setFixedRate(true);
+    }
+
+};
+
+}
+
+
+TEST(SystemPipeline, UpdatesStagesInOrder) {
+    SystemPipeline<ReadingSystem, WritingSystem, ReadingSystem> pipeline;
+    updateLog.clear();
+    pipeline.update(10);
+    EXPECT_EQ(std::vector<int>({1, 2, 1}), updateLog);
+    std::vector<System*> stages = pipeline.stages();
+    ASSERT_EQ(3, stages.size());
+    EXPECT_NE(nullptr, dynamic_cast<WritingSystem*>(stages[1]));
+    // Disabled stages are skipped
+    stages[1]->setEnabled(false);
+    updateLog.clear();
+    pipeline.update(10);
+    EXPECT_EQ(std::vector<int>({1, 1}), updateLog);
+}
+
+
+TEST(SystemPipeline, MergesAccess) {
+    SystemPipeline<ReadingSystem, WritingSystem> pipeline;
+    EXPECT_TRUE(pipeline.hasDeclaredAccess());
+    EXPECT_TRUE(pipeline.isMainThreadOnly());
+    EXPECT_EQ(
+        std::vector<ComponentTypeId>({TestComponent<0>::TYPE_ID}),
+        pipeline.readSet()
+    );
+    EXPECT_EQ(
+        std::vector<ComponentTypeId>({
+            TestComponent<1>::TYPE_ID,
+            TestComponent<2>::TYPE_ID
+        }),
+        pipeline.writeSet()
+    );
+    EXPECT_FALSE(pipeline.isFixedRate());
+    // One stage without declarations makes the whole pipeline undeclared
+    SystemPipeline<ReadingSystem, LoggingSystem<4>> undeclared;
+    EXPECT_FALSE(undeclared.hasDeclaredAccess());
+    EXPECT_TRUE(undeclared.readSet().empty());
+}
+
+
+TEST(SystemPipeline, FixedRate) {
+    SystemPipeline<FixedRateSystem, FixedRateSystem> pipeline;
+    EXPECT_TRUE(pipeline.isFixedRate());
+    using MixedPipeline = SystemPipeline<FixedRateSystem, ReadingSystem>;
+    EXPECT_THROW(MixedPipeline(), std::invalid_argument);
+}
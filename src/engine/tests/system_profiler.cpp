@@ -0,0 +1,157 @@
+#include "engine/system_profiler.h"
+
+#include "engine/system.h"
+#include "engine/system_scheduler.h"
+#include "engine/thread_pool.h"
+#include "util/json_writer.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace thrive;
+
+namespace {
+
+class NamedSystem : public System {
+
+public:
+
+    NamedSystem(
+        std::string name
+    ) {
+        this->setName(std::move(name));
+    }
+
+    void
+    update(int) override {
+        m_updateCount += 1;
+    }
+
+    int m_updateCount = 0;
+
+};
+
+}
+
+
+TEST(SystemProfiler, Statistics) {
+    SystemProfiler profiler(100);
+    NamedSystem system("system");
+    size_t slot = profiler.addSystem(system);
+    EXPECT_EQ(slot, profiler.addSystem(system));
+    for (uint32_t duration = 1; duration <= 100; ++duration) {
+        profiler.record(slot, duration);
+    }
+    SystemProfiler::Statistics statistics = profiler.statistics("system");
+    EXPECT_EQ(100u, statistics.samples);
+    EXPECT_DOUBLE_EQ(50.5, statistics.average);
+    EXPECT_EQ(95u, statistics.p95);
+    EXPECT_EQ(99u, statistics.p99);
+    EXPECT_EQ(100u, statistics.max);
+    EXPECT_EQ(0u, profiler.statistics("unknown").samples);
+    EXPECT_EQ(std::vector<std::string>{"system"}, profiler.names());
+}
+
+
+TEST(SystemProfiler, KeepsRecentDurations) {
+    SystemProfiler profiler(2);
+    NamedSystem system("system");
+    size_t slot = profiler.addSystem(system);
+    profiler.record(slot, 1000);
+    profiler.record(slot, 2);
+    profiler.record(slot, 4);
+    SystemProfiler::Statistics statistics = profiler.statistics("system");
+    EXPECT_EQ(2u, statistics.samples);
+    EXPECT_DOUBLE_EQ(3.0, statistics.average);
+    EXPECT_EQ(4u, statistics.max);
+    // The totals cover all durations
+    EXPECT_EQ(3u, statistics.totalSamples);
+    EXPECT_EQ(1006u, statistics.total);
+    profiler.reset();
+    EXPECT_EQ(0u, profiler.statistics("system").samples);
+    EXPECT_EQ(0u, profiler.statistics("system").totalSamples);
+}
+
+
+TEST(SystemProfiler, RecordsOnlyWhenEnabled) {
+    SystemProfiler profiler;
+    NamedSystem first("first");
+    NamedSystem second("second");
+    ThreadPool threadPool(0);
+    SystemScheduler scheduler({&first, &second}, threadPool, &profiler);
+    scheduler.update(10);
+    EXPECT_EQ(0u, profiler.statistics("first").samples);
+    profiler.setEnabled(true);
+    scheduler.update(10);
+    scheduler.update(10);
+    EXPECT_EQ(2u, profiler.statistics("first").samples);
+    EXPECT_EQ(2u, profiler.statistics("second").samples);
+    EXPECT_EQ(3, first.m_updateCount);
+    EXPECT_NE(std::string::npos, profiler.report(10).find("second"));
+}
+
+
+TEST(SystemProfiler, WritesJson) {
+    SystemProfiler profiler(10);
+    NamedSystem recorded("recorded");
+    NamedSystem idle("idle");
+    size_t slot = profiler.addSystem(recorded);
+    profiler.addSystem(idle);
+    profiler.record(slot, 4);
+    std::ostringstream stream;
+    JsonWriter writer(stream);
+    profiler.writeJson(writer);
+    EXPECT_EQ(
+        "{\"recorded\":{\"average\":4,\"max\":4,\"p95\":4,\"p99\":4,\"samples\":1}}",
+        stream.str()
+    );
+}
+
+
+TEST(SystemProfiler, CounterStatistics) {
+    SystemProfiler profiler(10);
+    NamedSystem system("system");
+    size_t slot = profiler.addSystem(system);
+    size_t scope = profiler.addScope("scope");
+    EXPECT_EQ(scope, profiler.addScope("scope"));
+    EXPECT_NE(slot, scope);
+    PerfCounters::Values counters;
+    counters.branchMisses = 10;
+    counters.cacheMisses = 100;
+    counters.cycles = 1000;
+    counters.instructions = 2000;
+    profiler.setEntityCount(50);
+    profiler.record(slot, 4, counters);
+    profiler.setEntityCount(150);
+    profiler.record(slot, 4, counters);
+    SystemProfiler::CounterStatistics statistics = profiler.counterStatistics("system");
+    EXPECT_EQ(2u, statistics.samples);
+    EXPECT_DOUBLE_EQ(2.0, statistics.instructionsPerCycle);
+    EXPECT_DOUBLE_EQ(1.0, statistics.cacheMissesPerEntity);
+    EXPECT_DOUBLE_EQ(0.1, statistics.branchMissesPerEntity);
+    EXPECT_DOUBLE_EQ(1000.0, statistics.cyclesPerUpdate);
+    EXPECT_EQ(2u, profiler.statistics("system").samples);
+    // Durations without counters
+    profiler.record(scope, 4);
+    EXPECT_EQ(1u, profiler.statistics("scope").samples);
+    EXPECT_EQ(0u, profiler.counterStatistics("scope").samples);
+    EXPECT_NE(std::string::npos, profiler.report(10).find("IPC"));
+    profiler.reset();
+    EXPECT_EQ(0u, profiler.counterStatistics("system").samples);
+    EXPECT_EQ(std::string::npos, profiler.report(10).find("IPC"));
+}
+
+
+TEST(SystemProfiler, CountsHardwareOnlyIfAvailable) {
+    SystemProfiler profiler;
+    NamedSystem system("system");
+    ThreadPool threadPool(0);
+    SystemScheduler scheduler({&system}, threadPool, &profiler);
+    profiler.setEnabled(true);
+    profiler.setCountingHardware(true);
+    EXPECT_EQ(PerfCounters::isAvailable(), profiler.isCountingHardware());
+    scheduler.update(10);
+    size_t expected = PerfCounters::isAvailable() ? 1 : 0;
+    EXPECT_EQ(expected, profiler.counterStatistics("system").samples);
+    EXPECT_EQ(1u, profiler.statistics("system").samples);
+}
@@ -0,0 +1,239 @@
+#include "engine/system_scheduler.h"
+
+#include "engine/frame_budgets.h"
+#include "engine/system.h"
+#include "engine/tests/test_component.h"
+#include "engine/thread_pool.h"
+
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+class RecordingSystem : public System {
+
+public:
+
+    RecordingSystem(
+        int id,
+        std::vector<int>& log,
+        boost::mutex& mutex
+    ) : m_id(id),
+        m_log(log),
+        m_mutex(mutex)
+    {
+    }
+
+    using System::declareBufferedRead;
+    using System::declareIsolated;
+    using System::declareRead;
+    using System::declareWrite;
+    using System::setMainThreadOnly;
+
+    void
+    update(int) override {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_log.push_back(m_id);
+        m_threadId = boost::this_thread::get_id();
+    }
+
+    int m_id;
+
+    std::vector<int>& m_log;
+
+    boost::mutex& m_mutex;
+
+    boost::thread::id m_threadId;
+
+};
+
+
+class TimingSystem : public System {
+
+public:
+
+    TimingSystem() {
+        this->declareIsolated();
+    }
+
+    void
+    update(
+        int milliseconds
+    ) override {
+        m_updates.push_back(milliseconds);
+    }
+
+    std::vector<int> m_updates;
+
+};
+
+
+class SleepingSystem : public System {
+
+public:
+
+    SleepingSystem() {
+        this->declareRead(TestComponent<0>::TYPE_ID);
+        this->setName("SleepingSystem");
+    }
+
+    void
+    update(int) override {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    }
+
+};
+
+
+class ThrowingSystem : public System {
+
+public:
+
+    ThrowingSystem() {
+        this->declareRead(TestComponent<0>::TYPE_ID);
+    }
+
+    void
+    update(int) override {
+        throw std::runtime_error("Test");
+    }
+
+};
+
+}
+
+
+TEST(SystemScheduler, Conflicts) {
+    std::vector<int> log;
+    boost::mutex mutex;
+    RecordingSystem undeclared(0, log, mutex);
+    RecordingSystem reader(1, log, mutex);
+    RecordingSystem otherReader(2, log, mutex);
+    RecordingSystem writer(3, log, mutex);
+    reader.declareRead(TestComponent<0>::TYPE_ID);
+    otherReader.declareRead(TestComponent<0>::TYPE_ID);
+    writer.declareWrite(TestComponent<1>::TYPE_ID);
+    EXPECT_TRUE(undeclared.conflictsWith(reader));
+    EXPECT_FALSE(reader.conflictsWith(otherReader));
+    EXPECT_FALSE(reader.conflictsWith(writer));
+    writer.declareWrite(TestComponent<0>::TYPE_ID);
+    EXPECT_TRUE(reader.conflictsWith(writer));
+    EXPECT_TRUE(writer.conflictsWith(otherReader));
+    RecordingSystem isolated(4, log, mutex);
+    isolated.declareIsolated();
+    EXPECT_FALSE(isolated.conflictsWith(undeclared));
+    EXPECT_FALSE(writer.conflictsWith(isolated));
+    EXPECT_FALSE(isolated.isMainThreadOnly());
+    // Last frame's values don't change while the writer runs
+    RecordingSystem bufferedReader(5, log, mutex);
+    bufferedReader.declareBufferedRead(TestComponent<0>::TYPE_ID);
+    EXPECT_FALSE(bufferedReader.conflictsWith(writer));
+    EXPECT_TRUE(bufferedReader.conflictsWith(undeclared));
+    EXPECT_FALSE(bufferedReader.isMainThreadOnly());
+}
+
+
+TEST(SystemScheduler, KeepsOrderOfConflictingSystems) {
+    std::vector<int> log;
+    boost::mutex mutex;
+    std::vector<std::unique_ptr<RecordingSystem>> systems;
+    for (int i = 0; i < 8; ++i) {
+        systems.emplace_back(new RecordingSystem(i, log, mutex));
+        systems.back()->declareWrite(TestComponent<0>::TYPE_ID);
+    }
+    // Main thread systems take part in the order as well
+    systems[3]->setMainThreadOnly();
+    std::vector<System*> rawSystems;
+    for (const auto& system : systems) {
+        rawSystems.push_back(system.get());
+    }
+    ThreadPool threadPool(4);
+    SystemScheduler scheduler(rawSystems, threadPool);
+    for (int frame = 0; frame < 10; ++frame) {
+        log.clear();
+        scheduler.update(10);
+        ASSERT_EQ(8, log.size());
+        for (int i = 0; i < 8; ++i) {
+            EXPECT_EQ(i, log[i]);
+        }
+    }
+    EXPECT_EQ(boost::this_thread::get_id(), systems[3]->m_threadId);
+}
+
+
+TEST(SystemScheduler, RunsIndependentSystems) {
+    std::vector<int> log;
+    boost::mutex mutex;
+    RecordingSystem first(0, log, mutex);
+    RecordingSystem second(1, log, mutex);
+    RecordingSystem disabled(2, log, mutex);
+    first.declareWrite(TestComponent<0>::TYPE_ID);
+    second.declareWrite(TestComponent<1>::TYPE_ID);
+    disabled.declareWrite(TestComponent<2>::TYPE_ID);
+    disabled.setEnabled(false);
+    ThreadPool threadPool(2);
+    SystemScheduler scheduler({&first, &second, &disabled}, threadPool);
+    scheduler.update(10);
+    ASSERT_EQ(2, log.size());
+    EXPECT_NE(log[0], log[1]);
+}
+
+
+TEST(SystemScheduler, RethrowsExceptions) {
+    std::vector<int> log;
+    boost::mutex mutex;
+    ThrowingSystem throwing;
+    RecordingSystem recording(0, log, mutex);
+    ThreadPool threadPool(1);
+    SystemScheduler scheduler({&throwing, &recording}, threadPool);
+    EXPECT_THROW(scheduler.update(10), std::runtime_error);
+    // The other system was still updated
+    EXPECT_EQ(1, log.size());
+}
+
+
+TEST(SystemScheduler, ChecksBudgets) {
+    SleepingSystem sleeping;
+    FrameBudgets budgets;
+    ThreadPool threadPool(1);
+    SystemScheduler scheduler({&sleeping}, threadPool, nullptr, nullptr, &budgets);
+    budgets.beginFrame(1);
+    scheduler.update(10);
+    EXPECT_TRUE(budgets.endFrame().empty());
+    budgets.setBudget("SleepingSystem", 1000);
+    budgets.beginFrame(2);
+    scheduler.update(10);
+    auto violations = budgets.endFrame();
+    ASSERT_EQ(1u, violations.size());
+    EXPECT_EQ("SleepingSystem", violations[0].name);
+    EXPECT_GE(violations[0].microseconds, 5000u);
+}
+
+
+TEST(SystemScheduler, RateLimitedSystems) {
+    TimingSystem everyUpdate;
+    TimingSystem limited;
+    TimingSystem delayed;
+    limited.setUpdateRate(20);
+    delayed.setUpdateRate(20);
+    delayed.setUpdatePhase(20);
+    EXPECT_EQ(50, limited.updateInterval());
+    ThreadPool threadPool(0);
+    SystemScheduler scheduler({&everyUpdate, &limited, &delayed}, threadPool);
+    for (int frame = 0; frame < 10; ++frame) {
+        scheduler.update(10);
+    }
+    EXPECT_EQ(10u, everyUpdate.m_updates.size());
+    // Right away, then with the accumulated time
+    EXPECT_EQ(std::vector<int>({10, 40, 50}), limited.m_updates);
+    EXPECT_EQ(std::vector<int>({20, 50}), delayed.m_updates);
+    // A long frame doesn't cause a burst of updates
+    scheduler.update(200);
+    scheduler.update(10);
+    EXPECT_EQ(200, limited.m_updates.back());
+    EXPECT_EQ(4u, limited.m_updates.size());
+}
@@ -0,0 +1,162 @@
+#include "engine/telemetry_server.h"
+
+#include "util/json_writer.h"
+
+#include <boost/asio.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace thrive;
+using boost::asio::ip::tcp;
+
+namespace {
+
+class TelemetryClient {
+
+public:
+
+    explicit TelemetryClient(
+        const std::string& endpoint
+    ) : m_socket(m_ioService)
+    {
+        size_t colon = endpoint.rfind(':');
+        m_socket.connect(tcp::endpoint(
+            boost::asio::ip::address::from_string(endpoint.substr(0, colon)),
+            static_cast<unsigned short>(std::stoul(endpoint.substr(colon + 1)))
+        ));
+    }
+
+    // Updates the server until a line arrives
+    std::string
+    readLine(
+        TelemetryServer& server,
+        const TelemetryServer::Sampler& sampler = nullptr
+    ) {
+        auto deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(5);
+        while (m_socket.available() == 0 and boost::chrono::steady_clock::now() < deadline) {
+            server.update(1, sampler);
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+        boost::asio::read_until(m_socket, m_input, '\n');
+        std::istream stream(&m_input);
+        std::string line;
+        std::getline(stream, line);
+        return line;
+    }
+
+    void
+    send(
+        const std::string& line
+    ) {
+        boost::asio::write(m_socket, boost::asio::buffer(line + "\n"));
+    }
+
+private:
+
+    boost::asio::io_service m_ioService;
+
+    boost::asio::streambuf m_input;
+
+    tcp::socket m_socket;
+
+};
+
+
+bool
+waitForClients(
+    const TelemetryServer& server,
+    unsigned int count
+) {
+    auto deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(5);
+    while (server.clientCount() != count and boost::chrono::steady_clock::now() < deadline) {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    return server.clientCount() == count;
+}
+
+}
+
+
+TEST(TelemetryServer, InvalidEndpoint) {
+    TelemetryServer server;
+    EXPECT_THROW(server.start("telemetry"), std::runtime_error);
+    EXPECT_THROW(server.start("127.0.0.1:70000"), std::runtime_error);
+    EXPECT_THROW(server.start("not an address:0"), std::runtime_error);
+    EXPECT_FALSE(server.isRunning());
+}
+
+
+TEST(TelemetryServer, NoSamplesWithoutClients) {
+    TelemetryServer server;
+    server.start("0");
+    EXPECT_TRUE(server.isRunning());
+    bool isSampled = false;
+    for (int i = 0; i < 10; ++i) {
+        server.update(1000, [&isSampled] (JsonWriter&) {
+            isSampled = true;
+        });
+    }
+    EXPECT_FALSE(isSampled);
+    server.stop();
+    EXPECT_FALSE(server.isRunning());
+    EXPECT_EQ("", server.endpoint());
+}
+
+
+TEST(TelemetryServer, StreamsSamples) {
+    TelemetryServer server;
+    server.start("0");
+    TelemetryClient client(server.endpoint());
+    ASSERT_TRUE(waitForClients(server, 1));
+    auto sampler = [] (JsonWriter& writer) {
+        writer.key("answer").value(42);
+    };
+    // The first sample goes out right away
+    std::string sample = client.readLine(server, sampler);
+    EXPECT_NE(std::string::npos, sample.find("\"type\":\"sample\""));
+    EXPECT_NE(std::string::npos, sample.find("\"answer\":42"));
+    server.stop();
+    EXPECT_EQ(0u, server.clientCount());
+}
+
+
+TEST(TelemetryServer, Commands) {
+    TelemetryServer server;
+    server.setInterval(1000000);
+    int toggles = 0;
+    server.addCommand("toggle", "Counts", [&toggles] (const std::string& arguments) {
+        toggles += 1;
+        if (arguments == "fail") {
+            throw std::runtime_error("Failed");
+        }
+        return "Toggled " + arguments;
+    });
+    server.start("0");
+    TelemetryClient client(server.endpoint());
+    ASSERT_TRUE(waitForClients(server, 1));
+    // Skip the first sample
+    client.readLine(server);
+    client.send("ping");
+    EXPECT_EQ(
+        "{\"type\":\"reply\",\"command\":\"ping\",\"ok\":true,\"message\":\"pong\"}",
+        client.readLine(server)
+    );
+    client.send("toggle  on\r");
+    EXPECT_EQ(
+        "{\"type\":\"reply\",\"command\":\"toggle\",\"ok\":true,\"message\":\"Toggled on\"}",
+        client.readLine(server)
+    );
+    client.send("toggle fail");
+    EXPECT_EQ(
+        "{\"type\":\"reply\",\"command\":\"toggle\",\"ok\":false,\"message\":\"Failed\"}",
+        client.readLine(server)
+    );
+    EXPECT_EQ(2, toggles);
+    client.send("unknown");
+    EXPECT_NE(std::string::npos, client.readLine(server).find("\"ok\":false"));
+    client.send("interval 5");
+    EXPECT_NE(std::string::npos, client.readLine(server).find("\"ok\":true"));
+    EXPECT_EQ(5u, server.interval());
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+/**
+* @brief A unique path in the temporary directory, removed when going out
+* of scope
+*/
+struct TemporaryFile {
+
+    TemporaryFile()
+      : path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+    }
+
+    ~TemporaryFile() {
+        boost::system::error_code error;
+        boost::filesystem::remove(path, error);
+    }
+
+    boost::filesystem::path path;
+
+};
@@ -0,0 +1,151 @@
+#include "engine/texture_compression.h"
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace {
+
+// Decodes the colour of one pixel of a DXT1 block
+void
+decodeDxt1Pixel(
+    const char* block,
+    unsigned int pixel,
+    int* rgb
+) {
+    auto readColour = [block] (size_t offset, int* colour) {
+        unsigned int value = uint8_t(block[offset]) | uint8_t(block[offset + 1]) << 8;
+        int r = (value >> 11) & 0x1F;
+        int g = (value >> 5) & 0x3F;
+        int b = value & 0x1F;
+        colour[0] = (r << 3) | (r >> 2);
+        colour[1] = (g << 2) | (g >> 4);
+        colour[2] = (b << 3) | (b >> 2);
+        return value;
+    };
+    int colour0[3];
+    int colour1[3];
+    unsigned int value0 = readColour(0, colour0);
+    unsigned int value1 = readColour(2, colour1);
+    unsigned int indices = uint8_t(block[4]) | uint8_t(block[5]) << 8 |
+        uint8_t(block[6]) << 16 | unsigned(uint8_t(block[7])) << 24;
+    unsigned int index = (indices >> (2 * pixel)) & 3;
+    ASSERT_TRUE(value0 > value1 or index == 0);
+    for (size_t c = 0; c < 3; ++c) {
+        switch (index) {
+            case 0: rgb[c] = colour0[c]; break;
+            case 1: rgb[c] = colour1[c]; break;
+            case 2: rgb[c] = (2 * colour0[c] + colour1[c]) / 3; break;
+            default: rgb[c] = (colour0[c] + 2 * colour1[c]) / 3; break;
+        }
+    }
+}
+
+}
+
+
+TEST(TextureCompression, SolidBlock) {
+    std::vector<uint8_t> pixels(4 * 4 * 4);
+    for (size_t i = 0; i < 16; ++i) {
+        pixels[4 * i + 0] = 255;
+        pixels[4 * i + 1] = 0;
+        pixels[4 * i + 2] = 0;
+        pixels[4 * i + 3] = 255;
+    }
+    std::string block = compressDxt(pixels.data(), 4, 4, false);
+    ASSERT_EQ(8u, block.size());
+    for (unsigned int pixel = 0; pixel < 16; ++pixel) {
+        int rgb[3];
+        decodeDxt1Pixel(block.data(), pixel, rgb);
+        EXPECT_EQ(255, rgb[0]);
+        EXPECT_EQ(0, rgb[1]);
+        EXPECT_EQ(0, rgb[2]);
+    }
+}
+
+
+TEST(TextureCompression, Gradient) {
+    // Not a multiple of four, so the edge blocks are padded
+    const uint32_t width = 6;
+    const uint32_t height = 5;
+    std::vector<uint8_t> pixels(4 * width * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t* pixel = &pixels[4 * (y * width + x)];
+            pixel[0] = static_cast<uint8_t>(40 * x);
+            pixel[1] = static_cast<uint8_t>(40 * x);
+            pixel[2] = 128;
+            pixel[3] = 255;
+        }
+    }
+    std::string blocks = compressDxt(pixels.data(), width, height, false);
+    ASSERT_EQ(dxtLevelSize(width, height, false), blocks.size());
+    ASSERT_EQ(4u * 8u, blocks.size());
+    // The first block spans red and green from 0 to 120
+    for (unsigned int x = 0; x < 4; ++x) {
+        int rgb[3];
+        decodeDxt1Pixel(blocks.data(), x, rgb);
+        EXPECT_NEAR(40 * x, rgb[0], 24);
+        EXPECT_NEAR(40 * x, rgb[1], 24);
+        EXPECT_NEAR(128, rgb[2], 8);
+    }
+}
+
+
+TEST(TextureCompression, Alpha) {
+    std::vector<uint8_t> pixels(4 * 4 * 4, 0);
+    for (size_t i = 0; i < 16; ++i) {
+        pixels[4 * i + 3] = i < 8 ? 0 : 255;
+    }
+    std::string block = compressDxt(pixels.data(), 4, 4, true);
+    ASSERT_EQ(16u, block.size());
+    EXPECT_EQ(255, uint8_t(block[0]));
+    EXPECT_EQ(0, uint8_t(block[1]));
+    // Indices 1 (alpha 0) for the first half, 0 (alpha 255) for the rest
+    uint64_t indices = 0;
+    for (size_t i = 0; i < 6; ++i) {
+        indices |= uint64_t(uint8_t(block[2 + i])) << (8 * i);
+    }
+    for (unsigned int pixel = 0; pixel < 16; ++pixel) {
+        EXPECT_EQ(pixel < 8 ? 1u : 0u, (indices >> (3 * pixel)) & 7);
+    }
+}
+
+
+TEST(TextureCompression, SkipMipLevels) {
+    CompressedTexture texture;
+    texture.width = 16;
+    texture.height = 8;
+    for (uint32_t size = 16; size >= 1; size /= 2) {
+        uint32_t levelHeight = std::max(1u, size / 2);
+        texture.mipLevels.push_back(std::string(
+            dxtLevelSize(size, levelHeight, false),
+            static_cast<char>(size)
+        ));
+    }
+    ASSERT_EQ(5u, texture.mipLevels.size());
+    std::string dds = writeDds(texture);
+    EXPECT_EQ("DDS ", dds.substr(0, 4));
+    std::string skipped = skipDdsMipLevels(dds.data(), dds.size(), 2);
+    ASSERT_FALSE(skipped.empty());
+    size_t remaining = 0;
+    for (size_t level = 2; level < texture.mipLevels.size(); ++level) {
+        remaining += texture.mipLevels[level].size();
+    }
+    EXPECT_EQ(128u + remaining, skipped.size());
+    // The first remaining level is the 4x2 one
+    EXPECT_EQ(char(4), skipped[128]);
+    auto readUint32 = [&skipped] (size_t offset) {
+        return uint8_t(skipped[offset]) | uint8_t(skipped[offset + 1]) << 8 |
+            uint8_t(skipped[offset + 2]) << 16 | unsigned(uint8_t(skipped[offset + 3])) << 24;
+    };
+    EXPECT_EQ(2u, readUint32(12));
+    EXPECT_EQ(4u, readUint32(16));
+    EXPECT_EQ(3u, readUint32(28));
+    // At least one level is kept
+    std::string smallest = skipDdsMipLevels(dds.data(), dds.size(), 10);
+    EXPECT_EQ(128u + texture.mipLevels.back().size(), smallest.size());
+    // Not a DDS file
+    EXPECT_TRUE(skipDdsMipLevels("not a texture", 13, 1).empty());
+}
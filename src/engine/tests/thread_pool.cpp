@@ -0,0 +1,95 @@
+#include "engine/thread_pool.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+TEST(ThreadPool, ParallelFor) {
+    ThreadPool threadPool(3);
+    std::vector<int> visits(1000, 0);
+    threadPool.parallelFor(visits.size(), 7, 
+        [&visits] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                visits[i] += 1;
+            }
+        }
+    );
+    for (int count : visits) {
+        EXPECT_EQ(1, count);
+    }
+}
+
+
+TEST(ThreadPool, NestedParallelFor) {
+    ThreadPool threadPool(2);
+    std::atomic<int> sum{0};
+    threadPool.parallelFor(4, 1, 
+        [&] (size_t, size_t) {
+            threadPool.parallelFor(100, 10,
+                [&sum] (size_t begin, size_t end) {
+                    sum += end - begin;
+                }
+            );
+        }
+    );
+    EXPECT_EQ(400, sum);
+}
+
+
+TEST(ThreadPool, RethrowsExceptions) {
+    ThreadPool threadPool(2);
+    std::atomic<int> chunks{0};
+    EXPECT_THROW(
+        threadPool.parallelFor(10, 1, 
+            [&chunks] (size_t begin, size_t) {
+                chunks += 1;
+                if (begin == 5) {
+                    throw std::runtime_error("Test");
+                }
+            }
+        ),
+        std::runtime_error
+    );
+    EXPECT_EQ(10, chunks);
+}
+
+
+TEST(ThreadPool, Dependencies) {
+    ThreadPool threadPool(3);
+    JobCounter first;
+    JobCounter second;
+    std::atomic<int> firstDone{0};
+    std::atomic<bool> startedEarly{false};
+    for (int i = 0; i < 10; ++i) {
+        threadPool.submit([&firstDone] () { firstDone += 1; }, &first);
+    }
+    for (int i = 0; i < 10; ++i) {
+        threadPool.submitAfter(first, 
+            [&] () {
+                if (firstDone != 10) {
+                    startedEarly = true;
+                }
+            },
+            &second
+        );
+    }
+    threadPool.wait(second);
+    EXPECT_TRUE(first.isDone());
+    EXPECT_TRUE(second.isDone());
+    EXPECT_FALSE(startedEarly);
+}
+
+
+TEST(ThreadPool, WaitWithoutWorkers) {
+    ThreadPool threadPool(0);
+    JobCounter counter;
+    int runs = 0;
+    threadPool.submit([&runs] () { runs += 1; }, &counter);
+    EXPECT_FALSE(counter.isDone());
+    // The waiting thread runs the job itself
+    threadPool.wait(counter);
+    EXPECT_EQ(1, runs);
+}
@@ -0,0 +1,117 @@
+#include "engine/timer_wheel.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(TimerWheel, FiresWhenDue) {
+    TimerWheel wheel(8, 16);
+    int calls = 0;
+    TimerId timerId = wheel.schedule(20, [&calls] () { calls += 1; });
+    EXPECT_TRUE(wheel.isPending(timerId));
+    EXPECT_EQ(20, wheel.remaining(timerId));
+    wheel.advance(19);
+    EXPECT_EQ(0, calls);
+    EXPECT_EQ(1, wheel.remaining(timerId));
+    wheel.advance(1);
+    EXPECT_EQ(1, calls);
+    EXPECT_FALSE(wheel.isPending(timerId));
+    EXPECT_EQ(0, wheel.size());
+    wheel.advance(100);
+    EXPECT_EQ(1, calls);
+}
+
+
+TEST(TimerWheel, ZeroDelayFiresOnNextAdvance) {
+    TimerWheel wheel;
+    int calls = 0;
+    wheel.schedule(0, [&calls] () { calls += 1; });
+    EXPECT_EQ(0, calls);
+    wheel.advance(0);
+    EXPECT_EQ(1, calls);
+}
+
+
+TEST(TimerWheel, BeyondOneRevolution) {
+    // One revolution is 8 * 16 = 128 milliseconds
+    TimerWheel wheel(8, 16);
+    int calls = 0;
+    wheel.schedule(1000, [&calls] () { calls += 1; });
+    for (int i = 0; i < 62; ++i) {
+        wheel.advance(16);
+    }
+    EXPECT_EQ(0, calls);
+    wheel.advance(8);
+    EXPECT_EQ(1, calls);
+}
+
+
+TEST(TimerWheel, Cancel) {
+    TimerWheel wheel(8, 16);
+    int calls = 0;
+    TimerId timerId = wheel.schedule(10, [&calls] () { calls += 1; });
+    EXPECT_TRUE(wheel.cancel(timerId));
+    EXPECT_FALSE(wheel.cancel(timerId));
+    EXPECT_FALSE(wheel.isPending(timerId));
+    // The freed timer is reused, but the old id stays invalid
+    TimerId otherId = wheel.schedule(10, [&calls] () { calls += 10; });
+    EXPECT_NE(timerId, otherId);
+    EXPECT_FALSE(wheel.cancel(timerId));
+    wheel.advance(10);
+    EXPECT_EQ(10, calls);
+}
+
+
+TEST(TimerWheel, Periodic) {
+    TimerWheel wheel(8, 16);
+    int calls = 0;
+    TimerId timerId = wheel.schedulePeriodic(5, 10, [&calls] () { calls += 1; });
+    wheel.advance(5);
+    EXPECT_EQ(1, calls);
+    // Several periods in one advance
+    wheel.advance(30);
+    EXPECT_EQ(4, calls);
+    // Periods are counted from the deadlines, not from the calls
+    EXPECT_EQ(10, wheel.remaining(timerId));
+    EXPECT_TRUE(wheel.isPending(timerId));
+    EXPECT_TRUE(wheel.cancel(timerId));
+    wheel.advance(100);
+    EXPECT_EQ(4, calls);
+}
+
+
+TEST(TimerWheel, CallbacksScheduleAndCancel) {
+    TimerWheel wheel(8, 16);
+    std::vector<int> order;
+    TimerId periodicId = NULL_TIMER;
+    periodicId = wheel.schedulePeriodic(10, 10, [&] () {
+        order.push_back(1);
+        if (order.size() == 4) {
+            wheel.cancel(periodicId);
+        }
+    });
+    wheel.schedule(5, [&] () {
+        order.push_back(2);
+        wheel.schedule(0, [&] () { order.push_back(3); });
+    });
+    wheel.advance(5);
+    EXPECT_EQ(std::vector<int>({2}), order);
+    wheel.advance(5);
+    EXPECT_EQ(std::vector<int>({2, 3, 1}), order);
+    wheel.advance(100);
+    EXPECT_EQ(std::vector<int>({2, 3, 1, 1}), order);
+    EXPECT_EQ(0, wheel.size());
+}
+
+
+TEST(TimerWheel, InvalidArguments) {
+    EXPECT_THROW(TimerWheel(0, 16), std::invalid_argument);
+    EXPECT_THROW(TimerWheel(8, 12), std::invalid_argument);
+    TimerWheel wheel;
+    EXPECT_THROW(wheel.advance(-1), std::invalid_argument);
+    EXPECT_THROW(wheel.schedulePeriodic(0, 0, [] () {}), std::invalid_argument);
+    wheel.schedule(0, [&wheel] () { wheel.advance(1); });
+    EXPECT_THROW(wheel.advance(0), std::logic_error);
+}
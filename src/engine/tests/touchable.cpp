@@ -0,0 +1,38 @@
+#include "engine/touchable.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+TEST(Touchable, Versions) {
+    Touchable touchable;
+    EXPECT_TRUE(touchable.hasChangesSince(0));
+    // Two consumers, one of them applies the changes
+    Touchable::Version seenByFirst = touchable.version();
+    touchable.untouch();
+    Touchable::Version seenBySecond = touchable.version();
+    EXPECT_FALSE(touchable.hasChangesSince(seenByFirst));
+    touchable.touchFields(0x2);
+    touchable.untouch();
+    // Untouching doesn't hide the change from the others
+    EXPECT_TRUE(touchable.hasChangesSince(seenByFirst));
+    EXPECT_TRUE(touchable.hasChangesSince(seenBySecond));
+    seenBySecond = touchable.version();
+    EXPECT_FALSE(touchable.hasChangesSince(seenBySecond));
+    touchable.bumpVersion();
+    EXPECT_FALSE(touchable.hasChanges());
+    EXPECT_TRUE(touchable.hasChangesSince(seenBySecond));
+}
+
+
+TEST(Touchable, CopiesVersion) {
+    Touchable original;
+    original.touch();
+    Touchable copy(original);
+    EXPECT_EQ(original.version(), copy.version());
+    Touchable::Version seen = copy.version();
+    original.untouch();
+    copy = original;
+    EXPECT_FALSE(copy.hasChanges());
+    EXPECT_TRUE(copy.hasChangesSince(seen));
+}
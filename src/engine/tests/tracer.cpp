@@ -0,0 +1,60 @@
+#include "engine/tracer.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+
+using namespace thrive;
+
+
+TEST(Tracer, RecordsOnlyWhileRunning) {
+    Tracer tracer;
+    {
+        Tracer::Zone zone(&tracer, "stopped");
+    }
+    EXPECT_EQ(0u, tracer.eventCount());
+    tracer.start();
+    {
+        Tracer::Zone outer(&tracer, "outer");
+        Tracer::Zone inner(&tracer, "inner");
+    }
+    EXPECT_EQ(2u, tracer.eventCount());
+    {
+        Tracer::Zone zone(&tracer, "interrupted");
+        tracer.stop();
+    }
+    EXPECT_EQ(2u, tracer.eventCount());
+    tracer.clear();
+    EXPECT_EQ(0u, tracer.eventCount());
+    // No tracer at all
+    Tracer::Zone zone(nullptr, "none");
+}
+
+
+TEST(Tracer, DropsEventsBeyondLimit) {
+    Tracer tracer(2);
+    tracer.start();
+    for (int i = 0; i < 5; ++i) {
+        Tracer::Zone zone(&tracer, "zone");
+    }
+    EXPECT_EQ(2u, tracer.eventCount());
+}
+
+
+TEST(Tracer, WritesChromeTrace) {
+    Tracer tracer;
+    tracer.start();
+    {
+        Tracer::Zone zone(&tracer, "quoted \"zone\"");
+    }
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    tracer.writeChromeTrace(path.string());
+    std::ifstream stream(path.string());
+    std::string json((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    stream.close();
+    boost::filesystem::remove(path);
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"quoted \\\"zone\\\"\",\"ph\":\"X\""));
+    EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"main\"}"));
+}
@@ -0,0 +1,371 @@
+#include "engine/texture_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+using namespace thrive;
+
+namespace {
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+const uint32_t DDS_HEADER_SIZE = 124;
+
+const uint32_t DDS_PIXEL_FORMAT_SIZE = 32;
+
+// Magic number and header
+const size_t DDS_FILE_HEADER_SIZE = 4 + DDS_HEADER_SIZE;
+
+const uint32_t DDSD_CAPS = 0x1;
+const uint32_t DDSD_HEIGHT = 0x2;
+const uint32_t DDSD_WIDTH = 0x4;
+const uint32_t DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+
+const uint32_t DDPF_FOURCC = 0x4;
+
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+// Offsets into the file, including the magic number
+const size_t OFFSET_FLAGS = 8;
+const size_t OFFSET_HEIGHT = 12;
+const size_t OFFSET_WIDTH = 16;
+const size_t OFFSET_LINEAR_SIZE = 20;
+const size_t OFFSET_DEPTH = 24;
+const size_t OFFSET_MIP_COUNT = 28;
+const size_t OFFSET_PIXEL_FORMAT = 76;
+const size_t OFFSET_FOUR_CC = OFFSET_PIXEL_FORMAT + 8;
+const size_t OFFSET_CAPS = 108;
+const size_t OFFSET_CAPS2 = 112;
+
+
+uint32_t
+fourCC(
+    char a,
+    char b,
+    char c,
+    char d
+) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 |
+        uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+
+uint32_t
+readUint32(
+    const char* data,
+    size_t offset
+) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        value |= uint32_t(uint8_t(data[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+
+void
+writeUint32(
+    char* data,
+    size_t offset,
+    uint32_t value
+) {
+    for (size_t i = 0; i < 4; ++i) {
+        data[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+
+void
+appendUint16(
+    std::string& buffer,
+    uint16_t value
+) {
+    buffer.push_back(static_cast<char>(value & 0xFF));
+    buffer.push_back(static_cast<char>(value >> 8));
+}
+
+
+void
+appendUint32(
+    std::string& buffer,
+    uint32_t value
+) {
+    for (size_t i = 0; i < 4; ++i) {
+        buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+
+uint16_t
+toRgb565(
+    const std::array<int, 3>& colour
+) {
+    return static_cast<uint16_t>(
+        ((colour[0] >> 3) << 11) | ((colour[1] >> 2) << 5) | (colour[2] >> 3)
+    );
+}
+
+
+std::array<int, 3>
+fromRgb565(
+    uint16_t colour
+) {
+    int r = (colour >> 11) & 0x1F;
+    int g = (colour >> 5) & 0x3F;
+    int b = colour & 0x1F;
+    std::array<int, 3> result = {{
+        (r << 3) | (r >> 2),
+        (g << 2) | (g >> 4),
+        (b << 3) | (b >> 2)
+    }};
+    return result;
+}
+
+
+int
+squaredDistance(
+    const uint8_t* pixel,
+    const std::array<int, 3>& colour
+) {
+    int distance = 0;
+    for (size_t c = 0; c < 3; ++c) {
+        int difference = int(pixel[c]) - colour[c];
+        distance += difference * difference;
+    }
+    return distance;
+}
+
+
+// Appends the 8 byte colour part of a block
+void
+compressColourBlock(
+    const std::array<uint8_t, 64>& block,
+    std::string& output
+) {
+    std::array<int, 3> minColour = {{255, 255, 255}};
+    std::array<int, 3> maxColour = {{0, 0, 0}};
+    for (size_t i = 0; i < 16; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            minColour[c] = std::min(minColour[c], int(block[4 * i + c]));
+            maxColour[c] = std::max(maxColour[c], int(block[4 * i + c]));
+        }
+    }
+    // Insetting the bounding box by 1/16th of its size lowers the error
+    // of the in-between colours
+    for (size_t c = 0; c < 3; ++c) {
+        int inset = (maxColour[c] - minColour[c]) >> 4;
+        minColour[c] = std::min(255, minColour[c] + inset);
+        maxColour[c] = std::max(0, maxColour[c] - inset);
+    }
+    uint16_t colour0 = toRgb565(maxColour);
+    uint16_t colour1 = toRgb565(minColour);
+    if (colour0 < colour1) {
+        std::swap(colour0, colour1);
+    }
+    appendUint16(output, colour0);
+    appendUint16(output, colour1);
+    uint32_t indices = 0;
+    if (colour0 != colour1) {
+        // Four colour mode, as colour0 > colour1
+        std::array<std::array<int, 3>, 4> palette;
+        palette[0] = fromRgb565(colour0);
+        palette[1] = fromRgb565(colour1);
+        for (size_t c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            uint32_t best = 0;
+            int bestDistance = squaredDistance(&block[4 * i], palette[0]);
+            for (uint32_t p = 1; p < 4; ++p) {
+                int distance = squaredDistance(&block[4 * i], palette[p]);
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+    appendUint32(output, indices);
+}
+
+
+// Appends the 8 byte alpha part of a DXT5 block
+void
+compressAlphaBlock(
+    const std::array<uint8_t, 64>& block,
+    std::string& output
+) {
+    int minAlpha = 255;
+    int maxAlpha = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        minAlpha = std::min(minAlpha, int(block[4 * i + 3]));
+        maxAlpha = std::max(maxAlpha, int(block[4 * i + 3]));
+    }
+    output.push_back(static_cast<char>(maxAlpha));
+    output.push_back(static_cast<char>(minAlpha));
+    uint64_t indices = 0;
+    if (maxAlpha != minAlpha) {
+        // Eight alpha mode, as alpha0 > alpha1
+        std::array<int, 8> palette;
+        palette[0] = maxAlpha;
+        palette[1] = minAlpha;
+        for (int p = 1; p < 7; ++p) {
+            palette[p + 1] = ((7 - p) * maxAlpha + p * minAlpha) / 7;
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            int alpha = block[4 * i + 3];
+            uint64_t best = 0;
+            int bestDistance = std::abs(alpha - palette[0]);
+            for (uint64_t p = 1; p < 8; ++p) {
+                int distance = std::abs(alpha - palette[p]);
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        output.push_back(static_cast<char>((indices >> (8 * i)) & 0xFF));
+    }
+}
+
+}
+
+
+std::string
+thrive::compressDxt(
+    const uint8_t* rgba,
+    uint32_t width,
+    uint32_t height,
+    bool hasAlpha
+) {
+    std::string output;
+    output.reserve(dxtLevelSize(width, height, hasAlpha));
+    std::array<uint8_t, 64> block;
+    for (uint32_t blockY = 0; blockY < height; blockY += 4) {
+        for (uint32_t blockX = 0; blockX < width; blockX += 4) {
+            for (uint32_t y = 0; y < 4; ++y) {
+                uint32_t sourceY = std::min(blockY + y, height - 1);
+                for (uint32_t x = 0; x < 4; ++x) {
+                    uint32_t sourceX = std::min(blockX + x, width - 1);
+                    std::memcpy(
+                        &block[4 * (4 * y + x)],
+                        rgba + 4 * (size_t(sourceY) * width + sourceX),
+                        4
+                    );
+                }
+            }
+            if (hasAlpha) {
+                compressAlphaBlock(block, output);
+            }
+            compressColourBlock(block, output);
+        }
+    }
+    return output;
+}
+
+
+size_t
+thrive::dxtLevelSize(
+    uint32_t width,
+    uint32_t height,
+    bool hasAlpha
+) {
+    size_t blocks = size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4);
+    return blocks * (hasAlpha ? 16 : 8);
+}
+
+
+std::string
+thrive::writeDds(
+    const CompressedTexture& texture
+) {
+    std::string file(DDS_FILE_HEADER_SIZE, '\0');
+    char* header = &file[0];
+    writeUint32(header, 0, DDS_MAGIC);
+    writeUint32(header, 4, DDS_HEADER_SIZE);
+    uint32_t flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    uint32_t caps = DDSCAPS_TEXTURE;
+    if (texture.mipLevels.size() > 1) {
+        flags |= DDSD_MIPMAPCOUNT;
+        caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+    writeUint32(header, OFFSET_FLAGS, flags);
+    writeUint32(header, OFFSET_HEIGHT, texture.height);
+    writeUint32(header, OFFSET_WIDTH, texture.width);
+    writeUint32(header, OFFSET_LINEAR_SIZE, static_cast<uint32_t>(
+        texture.mipLevels.empty() ? 0 : texture.mipLevels.front().size()
+    ));
+    writeUint32(header, OFFSET_MIP_COUNT, static_cast<uint32_t>(texture.mipLevels.size()));
+    writeUint32(header, OFFSET_PIXEL_FORMAT, DDS_PIXEL_FORMAT_SIZE);
+    writeUint32(header, OFFSET_PIXEL_FORMAT + 4, DDPF_FOURCC);
+    writeUint32(header, OFFSET_FOUR_CC, texture.hasAlpha ?
+        fourCC('D', 'X', 'T', '5') : fourCC('D', 'X', 'T', '1')
+    );
+    writeUint32(header, OFFSET_CAPS, caps);
+    for (const std::string& level : texture.mipLevels) {
+        file += level;
+    }
+    return file;
+}
+
+
+std::string
+thrive::skipDdsMipLevels(
+    const char* data,
+    size_t size,
+    unsigned int levels
+) {
+    if (
+        size < DDS_FILE_HEADER_SIZE or
+        readUint32(data, 0) != DDS_MAGIC or
+        readUint32(data, 4) != DDS_HEADER_SIZE
+    ) {
+        return "";
+    }
+    uint32_t format = readUint32(data, OFFSET_FOUR_CC);
+    size_t blockSize = 0;
+    if (format == fourCC('D', 'X', 'T', '1')) {
+        blockSize = 8;
+    }
+    else if (format == fourCC('D', 'X', 'T', '3') or format == fourCC('D', 'X', 'T', '5')) {
+        blockSize = 16;
+    }
+    bool isPlain = readUint32(data, OFFSET_CAPS2) == 0 and readUint32(data, OFFSET_DEPTH) <= 1;
+    uint32_t mipCount = readUint32(data, OFFSET_MIP_COUNT);
+    if (blockSize == 0 or not isPlain or levels == 0 or mipCount <= 1) {
+        return "";
+    }
+    levels = std::min(levels, mipCount - 1);
+    uint32_t width = readUint32(data, OFFSET_WIDTH);
+    uint32_t height = readUint32(data, OFFSET_HEIGHT);
+    size_t offset = DDS_FILE_HEADER_SIZE;
+    for (unsigned int level = 0; level < levels; ++level) {
+        offset += size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * blockSize;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+    if (offset > size) {
+        return "";
+    }
+    std::string file(data, DDS_FILE_HEADER_SIZE);
+    file.append(data + offset, size - offset);
+    char* header = &file[0];
+    writeUint32(header, OFFSET_WIDTH, width);
+    writeUint32(header, OFFSET_HEIGHT, height);
+    writeUint32(header, OFFSET_MIP_COUNT, mipCount - levels);
+    writeUint32(header, OFFSET_LINEAR_SIZE, static_cast<uint32_t>(
+        size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * blockSize
+    ));
+    return file;
+}
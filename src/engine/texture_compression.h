@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A block compressed texture with its mip levels
+*
+* Textures without alpha are stored as DXT1 (BC1), textures with alpha as
+* DXT5 (BC3). Both are decoded by the GPU, so the texture takes a quarter
+* or an eighth of the memory of its uncompressed RGBA pixels, in VRAM as
+* well as on disk.
+*/
+struct CompressedTexture {
+
+    /**
+    * @brief Whether the texture is DXT5 instead of DXT1
+    */
+    bool hasAlpha = false;
+
+    /**
+    * @brief The height of the top mip level in pixels
+    */
+    uint32_t height = 0;
+
+    /**
+    * @brief The compressed mip levels, largest first
+    */
+    std::vector<std::string> mipLevels;
+
+    /**
+    * @brief The width of the top mip level in pixels
+    */
+    uint32_t width = 0;
+
+};
+
+/**
+* @brief Compresses RGBA pixels into DXT blocks
+*
+* Each 4x4 block gets the two endpoint colours of its bounding box,
+* slightly inset, which is fast and good enough for the soft textures of
+* the game. Blocks at the edge of textures whose size is not a multiple
+* of four repeat their last row and column.
+*
+* @param rgba
+*   The pixels, four bytes each, row by row
+* @param width
+* @param height
+*   The image's size in pixels
+* @param hasAlpha
+*   Whether to encode the alpha channel (DXT5) or drop it (DXT1)
+*
+* @return
+*   The blocks, row by row
+*/
+std::string
+compressDxt(
+    const uint8_t* rgba,
+    uint32_t width,
+    uint32_t height,
+    bool hasAlpha
+);
+
+/**
+* @brief The size of a DXT compressed mip level in bytes
+*/
+size_t
+dxtLevelSize(
+    uint32_t width,
+    uint32_t height,
+    bool hasAlpha
+);
+
+/**
+* @brief Writes a compressed texture as a DDS file
+*
+* @param texture
+*   The texture, with its mip levels ordered and sized as for a DDS file
+*/
+std::string
+writeDds(
+    const CompressedTexture& texture
+);
+
+/**
+* @brief Drops the largest mip levels of a DDS file
+*
+* Lets textures be loaded at a lower resolution without a separate file.
+* Only DXT1, DXT3 and DXT5 textures that are neither cube maps nor volumes
+* are supported. At least one mip level is kept.
+*
+* @param data
+* @param size
+*   The DDS file
+* @param levels
+*   The number of levels to drop
+*
+* @return
+*   The DDS file without the dropped levels. Empty if the file is not
+*   supported or has too few levels to drop any.
+*/
+std::string
+skipDdsMipLevels(
+    const char* data,
+    size_t size,
+    unsigned int levels
+);
+
+}
@@ -0,0 +1,415 @@
+#include "engine/thread_pool.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <boost/thread.hpp>
+#include <deque>
+#include <exception>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+struct Job {
+
+    std::function<void()> m_function;
+
+    JobCounter* m_counter;
+
+};
+
+
+// Shared state of a single parallelFor() call
+struct ParallelLoop {
+
+    ParallelLoop(
+        size_t count,
+        size_t grainSize,
+        const std::function<void(size_t, size_t)>& body
+    ) : m_body(body),
+        m_chunkCount((count + grainSize - 1) / grainSize),
+        m_count(count),
+        m_grainSize(grainSize)
+    {
+    }
+
+    // Processes chunks until none are left
+    void
+    work() {
+        size_t chunk = m_nextChunk++;
+        while (chunk < m_chunkCount) {
+            size_t begin = chunk * m_grainSize;
+            size_t end = std::min(begin + m_grainSize, m_count);
+            try {
+                m_body(begin, end);
+            }
+            catch (...) {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                if (not m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+            if (++m_finishedChunks == m_chunkCount) {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_finished.notify_all();
+            }
+            chunk = m_nextChunk++;
+        }
+    }
+
+    const std::function<void(size_t, size_t)>& m_body;
+
+    const size_t m_chunkCount;
+
+    const size_t m_count;
+
+    std::exception_ptr m_error;
+
+    boost::condition_variable m_finished;
+
+    std::atomic<size_t> m_finishedChunks{0};
+
+    const size_t m_grainSize;
+
+    boost::mutex m_mutex;
+
+    std::atomic<size_t> m_nextChunk{0};
+
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// JobCounter
+////////////////////////////////////////////////////////////////////////////////
+
+struct JobCounter::Implementation {
+
+    // Jobs queued with ThreadPool::submitAfter()
+    std::vector<Job> m_continuations;
+
+    size_t m_count = 0;
+
+    // Guards all members. Held while the count drops to zero, so a waiting
+    // thread can't destroy the counter before it is released again.
+    mutable boost::mutex m_mutex;
+
+};
+
+
+JobCounter::JobCounter()
+  : m_impl(new Implementation())
+{
+}
+
+
+JobCounter::~JobCounter() {
+    assert(this->isDone() && "Destroying JobCounter with unfinished jobs");
+}
+
+
+bool
+JobCounter::isDone() const {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_mutex);
+    return m_impl->m_count == 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ThreadPool
+////////////////////////////////////////////////////////////////////////////////
+
+struct ThreadPool::Implementation {
+
+    struct Queue {
+
+        std::deque<Job> m_jobs;
+
+        boost::mutex m_mutex;
+
+    };
+
+    Implementation(
+        unsigned int threadCount
+    ) {
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            m_workerQueues.emplace_back(new Queue());
+        }
+    }
+
+    // Index of the calling worker thread or -1 for other threads
+    int
+    currentWorker() const {
+        boost::thread::id threadId = boost::this_thread::get_id();
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            if (m_threads[i].get_id() == threadId) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void
+    execute(
+        Job& job
+    ) {
+        job.m_function();
+        if (not job.m_counter) {
+            return;
+        }
+        auto& counter = *job.m_counter->m_impl;
+        std::vector<Job> continuations;
+        bool isDone = false;
+        {
+            boost::lock_guard<boost::mutex> lock(counter.m_mutex);
+            counter.m_count -= 1;
+            if (counter.m_count == 0) {
+                isDone = true;
+                continuations.swap(counter.m_continuations);
+            }
+        }
+        // The counter may be gone by now
+        for (Job& continuation : continuations) {
+            this->push(std::move(continuation));
+        }
+        if (isDone) {
+            boost::lock_guard<boost::mutex> lock(m_sleepMutex);
+            m_wakeUp.notify_all();
+        }
+    }
+
+    void
+    push(
+        Job job
+    ) {
+        int worker = this->currentWorker();
+        if (worker >= 0) {
+            Queue& queue = *m_workerQueues[worker];
+            boost::lock_guard<boost::mutex> lock(queue.m_mutex);
+            queue.m_jobs.push_front(std::move(job));
+        }
+        else {
+            boost::lock_guard<boost::mutex> lock(m_sharedQueue.m_mutex);
+            m_sharedQueue.m_jobs.push_back(std::move(job));
+        }
+        m_queuedJobs += 1;
+        boost::lock_guard<boost::mutex> lock(m_sleepMutex);
+        m_wakeUp.notify_one();
+    }
+
+    static bool
+    popFrom(
+        Queue& queue,
+        bool newest,
+        Job& job
+    ) {
+        boost::lock_guard<boost::mutex> lock(queue.m_mutex);
+        if (queue.m_jobs.empty()) {
+            return false;
+        }
+        if (newest) {
+            job = std::move(queue.m_jobs.front());
+            queue.m_jobs.pop_front();
+        }
+        else {
+            job = std::move(queue.m_jobs.back());
+            queue.m_jobs.pop_back();
+        }
+        return true;
+    }
+
+    // Own queue first, then the shared queue, then steal from the others
+    bool
+    tryPop(
+        int worker,
+        Job& job
+    ) {
+        if (m_queuedJobs == 0) {
+            return false;
+        }
+        bool found =
+            (worker >= 0 and popFrom(*m_workerQueues[worker], true, job)) or
+            popFrom(m_sharedQueue, true, job);
+        size_t firstVictim = worker + 1;
+        for (size_t i = 0; not found and i < m_workerQueues.size(); ++i) {
+            size_t victim = (firstVictim + i) % m_workerQueues.size();
+            if (int(victim) != worker) {
+                found = popFrom(*m_workerQueues[victim], false, job);
+            }
+        }
+        if (found) {
+            m_queuedJobs -= 1;
+        }
+        return found;
+    }
+
+    void
+    workerLoop(
+        int worker
+    ) {
+        while (true) {
+            Job job;
+            if (this->tryPop(worker, job)) {
+                this->execute(job);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(m_sleepMutex);
+            m_wakeUp.wait(lock, [this] () {
+                return m_isShuttingDown or m_queuedJobs > 0;
+            });
+            if (m_isShuttingDown and m_queuedJobs == 0) {
+                return;
+            }
+        }
+    }
+
+    bool m_isShuttingDown = false;
+
+    std::atomic<size_t> m_queuedJobs{0};
+
+    // Jobs submitted by threads outside the pool
+    Queue m_sharedQueue;
+
+    boost::mutex m_sleepMutex;
+
+    std::vector<boost::thread> m_threads;
+
+    boost::condition_variable m_wakeUp;
+
+    std::vector<std::unique_ptr<Queue>> m_workerQueues;
+
+};
+
+
+unsigned int
+ThreadPool::defaultThreadCount() {
+    unsigned int hardwareThreads = boost::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+
+ThreadPool::ThreadPool(
+    unsigned int threadCount
+) : m_impl(new Implementation(threadCount))
+{
+    m_impl->m_threads.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        m_impl->m_threads.emplace_back(
+            &Implementation::workerLoop,
+            m_impl.get(),
+            i
+        );
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        boost::lock_guard<boost::mutex> lock(m_impl->m_sleepMutex);
+        m_impl->m_isShuttingDown = true;
+    }
+    m_impl->m_wakeUp.notify_all();
+    for (auto& thread : m_impl->m_threads) {
+        thread.join();
+    }
+}
+
+
+void
+ThreadPool::parallelFor(
+    size_t count,
+    size_t grainSize,
+    const std::function<void(size_t, size_t)>& body
+) {
+    assert(grainSize > 0 && "Grain size must be at least 1");
+    if (count == 0) {
+        return;
+    }
+    if (count <= grainSize or m_impl->m_threads.empty()) {
+        body(0, count);
+        return;
+    }
+    auto loop = std::make_shared<ParallelLoop>(count, grainSize, body);
+    size_t helperCount = std::min<size_t>(
+        m_impl->m_threads.size(),
+        loop->m_chunkCount - 1
+    );
+    for (size_t i = 0; i < helperCount; ++i) {
+        // Helpers that start after all chunks are claimed return right
+        // away without touching the (by then dangling) loop body
+        this->submit([loop] () {
+            loop->work();
+        });
+    }
+    loop->work();
+    boost::unique_lock<boost::mutex> lock(loop->m_mutex);
+    loop->m_finished.wait(lock, [&loop] () {
+        return loop->m_finishedChunks == loop->m_chunkCount;
+    });
+    if (loop->m_error) {
+        std::rethrow_exception(loop->m_error);
+    }
+}
+
+
+void
+ThreadPool::submit(
+    std::function<void()> job,
+    JobCounter* counter
+) {
+    if (counter) {
+        boost::lock_guard<boost::mutex> lock(counter->m_impl->m_mutex);
+        counter->m_impl->m_count += 1;
+    }
+    m_impl->push(Job{std::move(job), counter});
+}
+
+
+void
+ThreadPool::submitAfter(
+    JobCounter& dependency,
+    std::function<void()> job,
+    JobCounter* counter
+) {
+    if (counter) {
+        boost::lock_guard<boost::mutex> lock(counter->m_impl->m_mutex);
+        counter->m_impl->m_count += 1;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(dependency.m_impl->m_mutex);
+        if (dependency.m_impl->m_count > 0) {
+            dependency.m_impl->m_continuations.push_back(
+                Job{std::move(job), counter}
+            );
+            return;
+        }
+    }
+    m_impl->push(Job{std::move(job), counter});
+}
+
+
+unsigned int
+ThreadPool::threadCount() const {
+    return m_impl->m_threads.size();
+}
+
+
+void
+ThreadPool::wait(
+    JobCounter& counter
+) {
+    int worker = m_impl->currentWorker();
+    while (not counter.isDone()) {
+        Job job;
+        if (m_impl->tryPop(worker, job)) {
+            m_impl->execute(job);
+            continue;
+        }
+        boost::unique_lock<boost::mutex> lock(m_impl->m_sleepMutex);
+        m_impl->m_wakeUp.wait(lock, [this, &counter] () {
+            return m_impl->m_queuedJobs > 0 or counter.isDone();
+        });
+    }
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace thrive {
+
+/**
+* @brief Counts unfinished jobs of a ThreadPool
+*
+* Pass a counter to ThreadPool::submit() to track a group of jobs. Other
+* jobs can depend on the group with ThreadPool::submitAfter() and any
+* thread can wait for it with ThreadPool::wait().
+*
+* A counter can be reused once it is done. It must not be destroyed while
+* jobs still refer to it.
+*/
+class JobCounter {
+
+public:
+
+    /**
+    * @brief Constructor
+    */
+    JobCounter();
+
+    /**
+    * @brief Non-copyable
+    */
+    JobCounter(const JobCounter& other) = delete;
+
+    /**
+    * @brief Destructor
+    */
+    ~JobCounter();
+
+    /**
+    * @brief Whether all jobs tracked by this counter have finished
+    */
+    bool
+    isDone() const;
+
+private:
+
+    friend class ThreadPool;
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
+/**
+* @brief The engine's job system
+*
+* The engine owns one thread pool (see Engine::threadPool()) that is shared
+* by everything that wants to run work in the background or in parallel,
+* such as the SystemScheduler and EntityFilter::parallelForEach().
+*
+* Each worker thread has its own job queue. Jobs submitted from a worker
+* go to the front of its own queue and are picked up in LIFO order, which
+* keeps nested work on the same core. Jobs submitted from other threads go
+* to a shared queue. An idle worker steals the oldest job from the other
+* queues.
+*
+* A thread waiting for a JobCounter runs queued jobs meanwhile, so waiting
+* inside a job doesn't block a worker.
+*/
+class ThreadPool {
+
+public:
+
+    /**
+    * @brief The number of worker threads used by default
+    *
+    * One less than the number of hardware threads, because the thread
+    * submitting work usually takes part in it.
+    */
+    static unsigned int
+    defaultThreadCount();
+
+    /**
+    * @brief Constructor
+    *
+    * @param threadCount
+    *   The number of worker threads to start. With \c 0, jobs are only run
+    *   by threads calling wait() or parallelFor().
+    */
+    ThreadPool(
+        unsigned int threadCount = defaultThreadCount()
+    );
+
+    /**
+    * @brief Destructor
+    *
+    * Finishes all submitted jobs and stops the worker threads.
+    */
+    ~ThreadPool();
+
+    /**
+    * @brief Runs a loop body over a range of indices in parallel
+    *
+    * The range <tt>[0, count)</tt> is split into chunks of \a grainSize
+    * indices. Idle workers and the calling thread claim chunks one after
+    * another until none are left, so uneven chunks balance out. Returns
+    * after all chunks are done.
+    *
+    * Safe to call from within a job, the caller always works on its own
+    * chunks while waiting.
+    *
+    * @param count
+    *   The number of indices
+    * @param grainSize
+    *   The number of indices per chunk, at least 1
+    * @param body
+    *   Called with the half-open index range of each chunk. If it throws,
+    *   the remaining chunks are still processed and the first exception is
+    *   rethrown to the caller.
+    */
+    void
+    parallelFor(
+        size_t count,
+        size_t grainSize,
+        const std::function<void(size_t, size_t)>& body
+    );
+
+    /**
+    * @brief Queues a job
+    *
+    * @param job
+    *   The job to run. Must not throw.
+    * @param counter
+    *   If not \c null, is incremented now and decremented after \a job has
+    *   run.
+    */
+    void
+    submit(
+        std::function<void()> job,
+        JobCounter* counter = nullptr
+    );
+
+    /**
+    * @brief Queues a job once all jobs of another counter have finished
+    *
+    * @param dependency
+    *   The jobs to wait for. If it is already done, \a job is queued
+    *   immediately.
+    * @param job
+    *   The job to run. Must not throw.
+    * @param counter
+    *   If not \c null, is incremented now and decremented after \a job has
+    *   run.
+    */
+    void
+    submitAfter(
+        JobCounter& dependency,
+        std::function<void()> job,
+        JobCounter* counter = nullptr
+    );
+
+    /**
+    * @brief The number of worker threads
+    */
+    unsigned int
+    threadCount() const;
+
+    /**
+    * @brief Runs queued jobs until all jobs of a counter have finished
+    *
+    * @param counter
+    *   The jobs to wait for
+    */
+    void
+    wait(
+        JobCounter& counter
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,399 @@
+#include "engine/timer_wheel.h"
+
+#include "scripting/lua_profiler.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+// Low bits of a TimerId hold the timer's index plus one, the high bits its
+// generation
+static const unsigned int TIMER_INDEX_BITS = 24;
+
+static const TimerId TIMER_INDEX_MASK = (TimerId(1) << TIMER_INDEX_BITS) - 1;
+
+static const size_t NO_INDEX = size_t(-1);
+
+
+static TimerId
+TimerWheel_schedule(
+    TimerWheel* self,
+    Milliseconds delay,
+    luabind::object callback
+) {
+    return self->schedule(delay, [callback] () {
+        LuaProfiler::countScriptCall(callback.interpreter(), "TimerWheel callback");
+        luabind::call_function<void>(callback);
+    });
+}
+
+
+static TimerId
+TimerWheel_schedulePeriodic(
+    TimerWheel* self,
+    Milliseconds delay,
+    Milliseconds interval,
+    luabind::object callback
+) {
+    return self->schedulePeriodic(delay, interval, [callback] () {
+        LuaProfiler::countScriptCall(callback.interpreter(), "TimerWheel callback");
+        luabind::call_function<void>(callback);
+    });
+}
+
+
+static double
+TimerWheel_now(
+    const TimerWheel* self
+) {
+    return static_cast<double>(self->now());
+}
+
+
+luabind::scope
+TimerWheel::luaBindings() {
+    using namespace luabind;
+    return class_<TimerWheel>("TimerWheel")
+        .def(constructor<>())
+        .def(constructor<Milliseconds, unsigned int>())
+        .def("advance", &TimerWheel::advance)
+        .def("cancel", &TimerWheel::cancel)
+        .def("isPending", &TimerWheel::isPending)
+        .def("now", &TimerWheel_now)
+        .def("remaining", &TimerWheel::remaining)
+        .def("schedule", &TimerWheel_schedule)
+        .def("schedulePeriodic", &TimerWheel_schedulePeriodic)
+        .def("size", &TimerWheel::size)
+    ;
+}
+
+
+struct TimerWheel::Implementation {
+
+    struct Timer {
+
+        Callback callback;
+
+        uint64_t deadline = 0;
+
+        uint8_t generation = 0;
+
+        Milliseconds interval = 0;
+
+        bool isPending = false;
+
+    };
+
+    Implementation(
+        Milliseconds resolution,
+        unsigned int slotCount
+    ) : m_resolution(resolution),
+        m_slotMask(slotCount - 1),
+        m_slots(slotCount)
+    {
+    }
+
+    TimerId
+    add(
+        Milliseconds delay,
+        Milliseconds interval,
+        Callback callback
+    ) {
+        size_t index;
+        if (m_freeIndices.empty()) {
+            if (m_timers.size() >= TIMER_INDEX_MASK) {
+                throw std::length_error("Too many pending timers");
+            }
+            index = m_timers.size();
+            m_timers.emplace_back();
+        }
+        else {
+            index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+        }
+        Timer& timer = m_timers[index];
+        timer.callback = std::move(callback);
+        timer.deadline = m_now + std::max(delay, 0);
+        timer.interval = interval;
+        timer.isPending = true;
+        m_size += 1;
+        TimerId timerId = timerIdOf(index);
+        this->insert(timerId, timer.deadline);
+        return timerId;
+    }
+
+    // Index of a pending timer or NO_INDEX
+    size_t
+    find(
+        TimerId timerId
+    ) const {
+        if (timerId == NULL_TIMER) {
+            return NO_INDEX;
+        }
+        size_t index = (timerId & TIMER_INDEX_MASK) - 1;
+        if (
+            index >= m_timers.size() or
+            not m_timers[index].isPending or
+            m_timers[index].generation != (timerId >> TIMER_INDEX_BITS)
+        ) {
+            return NO_INDEX;
+        }
+        return index;
+    }
+
+    void
+    fire(
+        TimerId timerId,
+        size_t index
+    ) {
+        Timer& timer = m_timers[index];
+        if (timer.interval <= 0) {
+            // Take the callback out first, it may schedule a new timer
+            // into the same index
+            Callback callback = std::move(timer.callback);
+            this->release(index);
+            this->recycle(index);
+            callback();
+            return;
+        }
+        // The deque keeps the timer in place while its callback schedules
+        // others. Cancelling it from within only releases it, it's
+        // recycled once the callback has returned.
+        m_firingIndex = index;
+        while (timer.isPending and timer.deadline <= m_now) {
+            timer.deadline += timer.interval;
+            timer.callback();
+        }
+        m_firingIndex = NO_INDEX;
+        if (timer.isPending) {
+            this->insert(timerId, timer.deadline);
+        }
+        else {
+            this->recycle(index);
+        }
+    }
+
+    void
+    insert(
+        TimerId timerId,
+        uint64_t deadline
+    ) {
+        uint64_t tick = std::max(deadline / m_resolution, m_currentTick);
+        m_slots[tick & m_slotMask].push_back(timerId);
+    }
+
+    void
+    processSlot(
+        size_t slot
+    ) {
+        m_processing.clear();
+        m_processing.swap(m_slots[slot]);
+        for (TimerId timerId : m_processing) {
+            size_t index = this->find(timerId);
+            if (index == NO_INDEX) {
+                // Cancelled, drop the stale entry
+                continue;
+            }
+            if (m_timers[index].deadline > m_now) {
+                // Due in a later revolution
+                m_slots[slot].push_back(timerId);
+                continue;
+            }
+            this->fire(timerId, index);
+        }
+        m_processing.clear();
+    }
+
+    void
+    recycle(
+        size_t index
+    ) {
+        m_timers[index].callback = nullptr;
+        m_freeIndices.push_back(index);
+    }
+
+    void
+    release(
+        size_t index
+    ) {
+        Timer& timer = m_timers[index];
+        timer.isPending = false;
+        timer.generation += 1;
+        m_size -= 1;
+    }
+
+    TimerId
+    timerIdOf(
+        size_t index
+    ) const {
+        return (TimerId(m_timers[index].generation) << TIMER_INDEX_BITS) | TimerId(index + 1);
+    }
+
+    uint64_t m_currentTick = 0;
+
+    size_t m_firingIndex = NO_INDEX;
+
+    std::vector<size_t> m_freeIndices;
+
+    bool m_isAdvancing = false;
+
+    uint64_t m_now = 0;
+
+    // The entries of the slot being processed
+    std::vector<TimerId> m_processing;
+
+    uint64_t m_resolution;
+
+    size_t m_size = 0;
+
+    uint64_t m_slotMask;
+
+    std::vector<std::vector<TimerId>> m_slots;
+
+    std::deque<Timer> m_timers;
+
+};
+
+
+TimerWheel::TimerWheel(
+    Milliseconds resolution,
+    unsigned int slotCount
+) {
+    if (resolution <= 0) {
+        throw std::invalid_argument("Timer wheel resolution must be positive");
+    }
+    if (slotCount == 0 or (slotCount & (slotCount - 1)) != 0) {
+        throw std::invalid_argument("Timer wheel slot count must be a power of two");
+    }
+    m_impl.reset(new Implementation(resolution, slotCount));
+}
+
+
+TimerWheel::~TimerWheel() {}
+
+
+void
+TimerWheel::advance(
+    Milliseconds milliseconds
+) {
+    if (milliseconds < 0) {
+        throw std::invalid_argument("Can't advance a timer wheel backwards");
+    }
+    if (m_impl->m_isAdvancing) {
+        throw std::logic_error("Timer wheel advanced from within a callback");
+    }
+    struct AdvanceGuard {
+        bool& isAdvancing;
+        ~AdvanceGuard() {
+            isAdvancing = false;
+        }
+    } guard{m_impl->m_isAdvancing};
+    m_impl->m_isAdvancing = true;
+    m_impl->m_now += milliseconds;
+    uint64_t lastTick = m_impl->m_now / m_impl->m_resolution;
+    // After a full revolution, every slot has been visited
+    uint64_t tickCount = std::min(
+        lastTick - m_impl->m_currentTick + 1,
+        m_impl->m_slotMask + 1
+    );
+    for (uint64_t i = 0; i < tickCount; ++i) {
+        m_impl->processSlot((m_impl->m_currentTick + i) & m_impl->m_slotMask);
+    }
+    // The last slot may still hold timers due later in its tick, so it's
+    // visited again by the next advance
+    m_impl->m_currentTick = lastTick;
+}
+
+
+bool
+TimerWheel::cancel(
+    TimerId timerId
+) {
+    size_t index = m_impl->find(timerId);
+    if (index == NO_INDEX) {
+        return false;
+    }
+    m_impl->release(index);
+    if (index != m_impl->m_firingIndex) {
+        m_impl->recycle(index);
+    }
+    return true;
+}
+
+
+void
+TimerWheel::clear() {
+    if (m_impl->m_isAdvancing) {
+        throw std::logic_error("Timer wheel cleared from within a callback");
+    }
+    m_impl->m_freeIndices.clear();
+    m_impl->m_timers.clear();
+    for (auto& slot : m_impl->m_slots) {
+        slot.clear();
+    }
+    m_impl->m_currentTick = 0;
+    m_impl->m_now = 0;
+    m_impl->m_size = 0;
+}
+
+
+bool
+TimerWheel::isPending(
+    TimerId timerId
+) const {
+    return m_impl->find(timerId) != NO_INDEX;
+}
+
+
+uint64_t
+TimerWheel::now() const {
+    return m_impl->m_now;
+}
+
+
+Milliseconds
+TimerWheel::remaining(
+    TimerId timerId
+) const {
+    size_t index = m_impl->find(timerId);
+    if (index == NO_INDEX) {
+        return 0;
+    }
+    uint64_t deadline = m_impl->m_timers[index].deadline;
+    if (deadline <= m_impl->m_now) {
+        return 0;
+    }
+    return static_cast<Milliseconds>(deadline - m_impl->m_now);
+}
+
+
+TimerId
+TimerWheel::schedule(
+    Milliseconds delay,
+    Callback callback
+) {
+    return m_impl->add(delay, 0, std::move(callback));
+}
+
+
+TimerId
+TimerWheel::schedulePeriodic(
+    Milliseconds delay,
+    Milliseconds interval,
+    Callback callback
+) {
+    if (interval <= 0) {
+        throw std::invalid_argument("Timer interval must be positive");
+    }
+    return m_impl->add(delay, interval, std::move(callback));
+}
+
+
+size_t
+TimerWheel::size() const {
+    return m_impl->m_size;
+}
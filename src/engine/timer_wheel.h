@@ -0,0 +1,204 @@
+#pragma once
+
+#include "engine/typedefs.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Identifies a timer of a TimerWheel
+*/
+using TimerId = uint32_t;
+
+/**
+* @brief Id that never refers to a timer
+*/
+static const TimerId NULL_TIMER = 0;
+
+/**
+* @brief Schedules callbacks after a delay
+*
+* A hashed timing wheel: timers are sorted into slots by their deadline,
+* and advancing the wheel only visits the slots that time has passed
+* through. The cost of an advance is proportional to the timers that are
+* due, plus those that share their slots, not to the number of pending
+* timers. Timers further away than one revolution of the wheel wait in
+* their slot for the right revolution.
+*
+* Callbacks are called from within advance(). They may schedule and
+* cancel timers, but must not advance the wheel.
+*/
+class TimerWheel {
+
+public:
+
+    /**
+    * @brief A timer's callback
+    */
+    using Callback = std::function<void()>;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - TimerWheel()
+    * - TimerWheel(resolution, slotCount)
+    * - TimerWheel::advance
+    * - TimerWheel::cancel
+    * - TimerWheel::isPending
+    * - TimerWheel::now
+    * - TimerWheel::remaining
+    * - TimerWheel::schedule
+    * - TimerWheel::schedulePeriodic
+    * - TimerWheel::size
+    *
+    * The callbacks are Lua functions without parameters.
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param resolution
+    *   The time span of a slot. Must be positive.
+    * @param slotCount
+    *   The number of slots. Must be a power of two.
+    */
+    TimerWheel(
+        Milliseconds resolution = 8,
+        unsigned int slotCount = 512
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~TimerWheel();
+
+    /**
+    * @brief Advances time and calls the callbacks of all timers that are due
+    *
+    * A periodic timer is called once for each of its periods that has
+    * passed.
+    *
+    * @param milliseconds
+    *   Must not be negative
+    */
+    void
+    advance(
+        Milliseconds milliseconds
+    );
+
+    /**
+    * @brief Cancels a pending timer
+    *
+    * @param timerId
+    *
+    * @return
+    *   \c true if the timer was pending, \c false if it has already fired
+    *   or been cancelled
+    */
+    bool
+    cancel(
+        TimerId timerId
+    );
+
+    /**
+    * @brief Cancels all timers and resets the time to zero
+    */
+    void
+    clear();
+
+    /**
+    * @brief Whether a timer is pending
+    *
+    * Periodic timers stay pending until they are cancelled.
+    *
+    * @param timerId
+    */
+    bool
+    isPending(
+        TimerId timerId
+    ) const;
+
+    /**
+    * @brief The time the wheel has been advanced by
+    */
+    uint64_t
+    now() const;
+
+    /**
+    * @brief Time left until a timer fires next
+    *
+    * @param timerId
+    *
+    * @return
+    *   The time left or 0 if the timer is not pending
+    */
+    Milliseconds
+    remaining(
+        TimerId timerId
+    ) const;
+
+    /**
+    * @brief Schedules a callback to be called once
+    *
+    * @param delay
+    *   Time from now. Timers with a delay of 0 or less fire on the next
+    *   advance.
+    * @param callback
+    *
+    * @return
+    *   The new timer's id
+    */
+    TimerId
+    schedule(
+        Milliseconds delay,
+        Callback callback
+    );
+
+    /**
+    * @brief Schedules a callback to be called repeatedly
+    *
+    * Each period is counted from the previous deadline, not from the time
+    * the callback was called, so the timer doesn't drift.
+    *
+    * @param delay
+    *   Time from now until the first call
+    * @param interval
+    *   Time between calls. Must be positive.
+    * @param callback
+    *
+    * @return
+    *   The new timer's id
+    */
+    TimerId
+    schedulePeriodic(
+        Milliseconds delay,
+        Milliseconds interval,
+        Callback callback
+    );
+
+    /**
+    * @brief The number of pending timers
+    */
+    size_t
+    size() const;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -1,5 +1,6 @@
 #include "engine/touchable.h"
 
+#include "engine/component.h"
 #include "scripting/luabind.h"
 
 using namespace thrive;
@@ -9,26 +10,100 @@ luabind::scope
 Touchable::luaBindings() {
     using namespace luabind;
     return class_<Touchable>("Touchable")
+        .def("bumpVersion", &Touchable::bumpVersion)
+        .def("changedFields", &Touchable::changedFields)
         .def("hasChanges", &Touchable::hasChanges)
+        .def("hasChangesSince", &Touchable::hasChangesSince)
         .def("touch", &Touchable::touch)
+        .def("touchFields", &Touchable::touchFields)
         .def("untouch", &Touchable::untouch)
+        .def("version", &Touchable::version)
     ;
 }
 
 
+Touchable::Touchable(
+    const Touchable& other
+) : m_changedFields(other.m_changedFields),
+    m_version(other.m_version)
+{
+}
+
+
+Touchable&
+Touchable::operator =(
+    const Touchable& other
+) {
+    if (other.m_changedFields) {
+        this->touchFields(other.m_changedFields);
+    }
+    else {
+        m_changedFields = 0;
+        m_version += 1;
+    }
+    return *this;
+}
+
+
+void
+Touchable::bumpVersion() {
+    m_version += 1;
+}
+
+
+Touchable::FieldMask
+Touchable::changedFields() const {
+    return m_changedFields;
+}
+
+
 bool
 Touchable::hasChanges() const {
-    return m_hasChanges;
+    return m_changedFields != 0;
+}
+
+
+bool
+Touchable::hasChangesSince(
+    Version version
+) const {
+    return m_version != version;
+}
+
+
+void
+Touchable::setComponent(
+    Component* component
+) {
+    m_component = component;
 }
 
 
 void
 Touchable::touch() {
-    m_hasChanges = true;
+    this->touchFields(ALL_FIELDS);
+}
+
+
+void
+Touchable::touchFields(
+    FieldMask fields
+) {
+    m_changedFields |= fields;
+    m_version += 1;
+    if (m_component) {
+        m_component->touched();
+    }
 }
 
 
 void
 Touchable::untouch() {
-    m_hasChanges = false;
+    m_changedFields = 0;
+}
+
+
+Touchable::Version
+Touchable::version() const {
+    return m_version;
 }
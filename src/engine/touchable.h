@@ -1,17 +1,40 @@
 #pragma once
 
+#include <cstdint>
+
 namespace luabind {
     class scope;
 }
 
 namespace thrive {
 
+class Component;
+
 /**
 * @brief Helper class for keeping track of changing data
 *
 * Properties of components should be derived from Touchable so that the system
 * that handles the component can quickly check for any changes.
 *
+* A component can register itself with its touchables through setComponent().
+* Touching one of them then notifies the component, which queues itself in
+* its collection's list of touched components (see 
+* ComponentCollection::takeTouched()). Systems can process that list instead
+* of checking every component for changes each frame.
+*
+* Subclasses with several fields that are expensive to apply one by one
+* can number them with bits of a FieldMask. touchFields() then marks only 
+* some fields as changed, and the handling system applies only those (see 
+* changedFields()). touch() always marks all fields.
+*
+* hasChanges(), changedFields() and untouch() are meant for the one system
+* that applies the touchable, untouching hides the changes from everyone
+* else. Other systems and scripts that react to changes remember the
+* version() they last saw instead and check hasChangesSince(). The version
+* counts every touch, so any number of them see the same change, no matter
+* in which order they run. Versions of different touchables are unrelated,
+* compare them only for the same touchable.
+*
 * @note
 *   A Touchable starts out with <tt> Touchable::hasChanges() == true </tt>
 */
@@ -19,41 +42,169 @@ class Touchable {
 
 public:
 
+    /**
+    * @brief Bit mask of fields, see touchFields()
+    */
+    using FieldMask = uint32_t;
+
+    /**
+    * @brief The mask with all fields
+    */
+    static const FieldMask ALL_FIELDS = 0xffffffff;
+
+    /**
+    * @brief Counts the changes of a touchable, see version()
+    */
+    using Version = uint32_t;
+
 
     /**
     * @brief Lua bindings
     *
     * Exposes:
+    * - Touchable::bumpVersion()
+    * - Touchable::changedFields()
     * - Touchable::hasChanges()
+    * - Touchable::hasChangesSince()
     * - Touchable::touch()
+    * - Touchable::touchFields()
     * - Touchable::untouch()
+    * - Touchable::version()
     *
     * @return 
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Constructor
+    */
+    Touchable() = default;
+
+    /**
+    * @brief Copy constructor
+    *
+    * The copy takes over the changed fields and the version, but is not
+    * registered with any component.
+    *
+    * @param other
+    */
+    Touchable(
+        const Touchable& other
+    );
+
+    /**
+    * @brief Copy assignment
+    *
+    * Keeps the component this Touchable is registered with and notifies 
+    * it if the copied value has changes. Counts as a change of the
+    * version either way.
+    *
+    * @param other
+    *
+    * @return 
+    */
+    Touchable&
+    operator =(
+        const Touchable& other
+    );
+
+    /**
+    * @brief Counts a change without marking any fields
+    *
+    * For writes that the applying system takes care of by other means but
+    * others should notice, like the transforms that TransformBuffer blends.
+    * Doesn't notify the registered component.
+    */
+    void
+    bumpVersion();
+
+    /**
+    * @brief The fields with unapplied changes
+    *
+    * @return
+    *   \c 0 if there are no changes
+    */
+    FieldMask
+    changedFields() const;
+
     /**
     * @brief Whether this Touchable has unapplied changes
     */
     bool
     hasChanges() const;
 
+    /**
+    * @brief Whether this Touchable changed after a version was seen
+    *
+    * @param version
+    *   A version() seen before, or \c 0 for one never seen. Touchables
+    *   start out at version 1.
+    */
+    bool
+    hasChangesSince(
+        Version version
+    ) const;
+
+    /**
+    * @brief Registers the component to notify when this is touched
+    *
+    * Usually called by the component's constructor for each of its
+    * touchable members.
+    *
+    * @param component
+    *   The component this Touchable belongs to, or \c nullptr
+    */
+    void
+    setComponent(
+        Component* component
+    );
+
     /**
     * @brief Marks the Touchable as changed
+    *
+    * Also notifies the registered component, if any.
     */
     void
     touch();
 
+    /**
+    * @brief Marks some fields as changed
+    *
+    * Also notifies the registered component, if any.
+    *
+    * @param fields
+    *   The fields to mark, added to those already changed
+    */
+    void
+    touchFields(
+        FieldMask fields
+    );
+
     /**
     * @brief Marks all changes as applied
+    *
+    * Leaves the version() alone.
     */
     void
     untouch();
 
+    /**
+    * @brief The number of changes so far, plus one
+    *
+    * Increases with every touch, bumpVersion() and copy assignment.
+    */
+    Version
+    version() const;
+
 private:
 
-    bool m_hasChanges = true;
+    FieldMask m_changedFields = ALL_FIELDS;
+
+    Component* m_component = nullptr;
+
+    Version m_version = 1;
+
 };
 
 /**
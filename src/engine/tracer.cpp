@@ -0,0 +1,194 @@
+#include "engine/tracer.h"
+
+#include "scripting/luabind.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+void
+writeJsonString(
+    std::ostream& stream,
+    const std::string& string
+) {
+    stream << '"';
+    for (char character : string) {
+        switch (character) {
+            case '"':
+                stream << "\\\"";
+                break;
+            case '\\':
+                stream << "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(character) < 0x20) {
+                    stream << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                        << static_cast<int>(character) << std::dec << std::setfill(' ');
+                }
+                else {
+                    stream << character;
+                }
+        }
+    }
+    stream << '"';
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tracer::Zone
+////////////////////////////////////////////////////////////////////////////////
+
+Tracer::Zone::Zone(
+    Tracer* tracer,
+    const char* name
+) : m_name(name),
+    m_tracer(tracer and tracer->isRunning() ? tracer : nullptr)
+{
+    if (m_tracer) {
+        m_start = boost::chrono::steady_clock::now();
+    }
+}
+
+
+Tracer::Zone::Zone(
+    Tracer* tracer,
+    const std::string& name
+) : Zone(tracer, name.c_str())
+{
+}
+
+
+Tracer::Zone::~Zone() {
+    if (m_tracer) {
+        m_tracer->record(m_name, m_start, boost::chrono::steady_clock::now());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tracer
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+Tracer::luaBindings() {
+    using namespace luabind;
+    return class_<Tracer>("Tracer")
+        .def("clear", &Tracer::clear)
+        .def("eventCount", &Tracer::eventCount)
+        .def("isRunning", &Tracer::isRunning)
+        .def("start", &Tracer::start)
+        .def("stop", &Tracer::stop)
+        .def("writeChromeTrace", &Tracer::writeChromeTrace)
+    ;
+}
+
+
+Tracer::Tracer(
+    size_t maxEvents
+) : m_epoch(boost::chrono::steady_clock::now()),
+    m_isRunning(false),
+    m_mainThread(boost::this_thread::get_id()),
+    m_maxEvents(maxEvents)
+{
+}
+
+
+void
+Tracer::clear() {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_events.clear();
+}
+
+
+size_t
+Tracer::eventCount() const {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_events.size();
+}
+
+
+bool
+Tracer::isRunning() const {
+    return m_isRunning.load(std::memory_order_relaxed);
+}
+
+
+void
+Tracer::record(
+    const char* name,
+    boost::chrono::steady_clock::time_point start,
+    boost::chrono::steady_clock::time_point end
+) {
+    using namespace boost::chrono;
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    // Zones that were open while stopping are dropped
+    if (not this->isRunning() or m_events.size() >= m_maxEvents) {
+        return;
+    }
+    boost::thread::id threadId = boost::this_thread::get_id();
+    auto iter = m_threads.find(threadId);
+    if (iter == m_threads.end()) {
+        unsigned int thread = static_cast<unsigned int>(m_threads.size());
+        iter = m_threads.emplace(threadId, thread).first;
+    }
+    Event event;
+    event.duration = duration_cast<microseconds>(end - start).count();
+    event.name = name;
+    event.start = duration_cast<microseconds>(start - m_epoch).count();
+    event.thread = iter->second;
+    m_events.push_back(std::move(event));
+}
+
+
+void
+Tracer::start() {
+    m_isRunning.store(true, std::memory_order_relaxed);
+}
+
+
+void
+Tracer::stop() {
+    m_isRunning.store(false, std::memory_order_relaxed);
+}
+
+
+void
+Tracer::writeChromeTrace(
+    const std::string& filename
+) const {
+    std::ofstream stream(filename);
+    if (not stream) {
+        throw std::runtime_error("Could not open trace file " + filename);
+    }
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    stream << "{\"traceEvents\":[\n";
+    bool isFirst = true;
+    for (const auto& pair : m_threads) {
+        std::string threadName = pair.first == m_mainThread ?
+            "main" : "worker " + std::to_string(pair.second);
+        stream << (isFirst ? "" : ",\n");
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pair.second
+            << ",\"args\":{\"name\":";
+        writeJsonString(stream, threadName);
+        stream << "}}";
+        isFirst = false;
+    }
+    for (const Event& event : m_events) {
+        stream << (isFirst ? "" : ",\n");
+        stream << "{\"name\":";
+        writeJsonString(stream, event.name);
+        stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration << "}";
+        isFirst = false;
+    }
+    stream << "\n]}\n";
+    if (not stream) {
+        throw std::runtime_error("Could not write trace file " + filename);
+    }
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Records a timeline of what the engine does
+*
+* Code of interest is marked with a Zone. While the tracer is running,
+* each zone is recorded with the thread it ran on and its start and end
+* time. The timeline can then be written as a Chrome trace, which can be
+* viewed in \c chrome://tracing or Perfetto.
+*
+* Zones cost one flag check while the tracer is stopped. All methods are
+* thread safe.
+*/
+class Tracer {
+
+public:
+
+    /**
+    * @brief Marks a zone from its construction to its destruction
+    *
+    * Does nothing if the tracer is \c null or not running.
+    */
+    class Zone {
+
+    public:
+
+        /**
+        * @brief Constructor
+        *
+        * @param tracer
+        * @param name
+        *   The name of the zone. Must outlive the zone.
+        */
+        Zone(
+            Tracer* tracer,
+            const char* name
+        );
+
+        /**
+        * @brief Constructor
+        *
+        * @param tracer
+        * @param name
+        *   The name of the zone. Must outlive the zone.
+        */
+        Zone(
+            Tracer* tracer,
+            const std::string& name
+        );
+
+        /**
+        * @brief Destructor
+        *
+        * Records the zone
+        */
+        ~Zone();
+
+        Zone(const Zone&) = delete;
+
+        Zone& operator= (const Zone&) = delete;
+
+    private:
+
+        const char* m_name;
+
+        boost::chrono::steady_clock::time_point m_start;
+
+        Tracer* m_tracer;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - Tracer::clear
+    * - Tracer::eventCount
+    * - Tracer::isRunning
+    * - Tracer::start
+    * - Tracer::stop
+    * - Tracer::writeChromeTrace
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * The constructing thread is named "main" in the trace.
+    *
+    * @param maxEvents
+    *   Zones beyond this many are dropped, so that a forgotten trace
+    *   can't use up all memory
+    */
+    explicit Tracer(
+        size_t maxEvents = 1000000
+    );
+
+    Tracer(const Tracer&) = delete;
+
+    Tracer& operator= (const Tracer&) = delete;
+
+    /**
+    * @brief Discards all recorded zones
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of recorded zones
+    */
+    size_t
+    eventCount() const;
+
+    /**
+    * @brief Whether zones are being recorded
+    */
+    bool
+    isRunning() const;
+
+    /**
+    * @brief Starts recording
+    *
+    * Keeps the zones of previous runs, see clear().
+    */
+    void
+    start();
+
+    /**
+    * @brief Stops recording
+    */
+    void
+    stop();
+
+    /**
+    * @brief Writes the recorded zones in Chrome's trace event format
+    *
+    * @param filename
+    *
+    * @throw std::runtime_error
+    *   If the file can't be written
+    */
+    void
+    writeChromeTrace(
+        const std::string& filename
+    ) const;
+
+private:
+
+    struct Event {
+
+        // In microseconds
+        uint64_t duration;
+
+        std::string name;
+
+        // In microseconds since m_epoch
+        uint64_t start;
+
+        unsigned int thread;
+
+    };
+
+    void
+    record(
+        const char* name,
+        boost::chrono::steady_clock::time_point start,
+        boost::chrono::steady_clock::time_point end
+    );
+
+    boost::chrono::steady_clock::time_point m_epoch;
+
+    std::vector<Event> m_events;
+
+    std::atomic<bool> m_isRunning;
+
+    boost::thread::id m_mainThread;
+
+    size_t m_maxEvents;
+
+    mutable boost::mutex m_mutex;
+
+    // Small numbers for the threads, in the order they are first seen
+    std::map<boost::thread::id, unsigned int> m_threads;
+
+};
+
+}
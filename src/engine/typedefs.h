@@ -20,4 +20,49 @@ namespace thrive {
 
     static const ComponentTypeId NULL_COMPONENT_TYPE = 0;
 
+    /**
+    * @brief Number of low bits in an EntityId that hold the slot index
+    *
+    * The remaining high bits hold the slot's generation. The generation is
+    * incremented whenever the EntityManager recycles a slot, so an id of a
+    * destroyed entity never equals the id of the entity that reuses its slot
+    * (until the generation wraps around).
+    */
+    static const unsigned int ENTITY_INDEX_BITS = 20;
+
+    static const EntityId ENTITY_INDEX_MASK = (EntityId(1) << ENTITY_INDEX_BITS) - 1;
+
+    static const EntityId ENTITY_GENERATION_MASK = EntityId(-1) >> ENTITY_INDEX_BITS;
+
+    /**
+    * @brief The slot index part of an entity id
+    */
+    inline EntityId
+    entityIndex(
+        EntityId entityId
+    ) {
+        return entityId & ENTITY_INDEX_MASK;
+    }
+
+    /**
+    * @brief The generation part of an entity id
+    */
+    inline EntityId
+    entityGeneration(
+        EntityId entityId
+    ) {
+        return entityId >> ENTITY_INDEX_BITS;
+    }
+
+    /**
+    * @brief Packs a slot index and a generation into an entity id
+    */
+    inline EntityId
+    makeEntityId(
+        EntityId index,
+        EntityId generation
+    ) {
+        return (generation << ENTITY_INDEX_BITS) | (index & ENTITY_INDEX_MASK);
+    }
+
 }
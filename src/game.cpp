@@ -1,11 +1,18 @@
 #include "game.h"
 
 #include "engine/engine.h"
+#include "engine/frame_pacer.h"
+#include "engine/game_state.h"
+#include "engine/idle_tasks.h"
+#include "engine/logger.h"
 #include "engine/typedefs.h"
 #include "scripting/luabind.h"
 #include "util/make_unique.h"
 
-#include <boost/thread.hpp>
+#include <algorithm>
+#include <iostream>
+#include <OgreRenderWindow.h>
+#include <sstream>
 #include <type_traits>
 #include <unordered_map>
 
@@ -14,8 +21,6 @@ using namespace thrive;
 
 struct Game::Implementation {
 
-    using Clock = boost::chrono::high_resolution_clock;
-
     Implementation()
     {
         m_targetFrameDuration = boost::chrono::microseconds(1000000 / m_targetFrameRate);
@@ -23,6 +28,11 @@ struct Game::Implementation {
 
     Engine m_engine;
 
+    LogChannel& m_frameLog = Logger::instance().channel("frames");
+
+    // How often to print the frame time statistics
+    boost::chrono::seconds m_reportInterval{5};
+
     boost::chrono::microseconds m_targetFrameDuration;
 
     unsigned short m_targetFrameRate = 60;
@@ -63,32 +73,77 @@ Game::quit() {
 void
 Game::run() {
     try {
-        unsigned int fpsCount = 0;
-        int fpsTime = 0;
-        auto lastUpdate = Implementation::Clock::now();
+        FramePacer pacer(m_impl->m_targetFrameDuration);
+        // Game time not yet passed on because it didn't add up to a 
+        // whole millisecond
+        boost::chrono::microseconds carriedTime(0);
         m_impl->m_engine.init();
+        pacer.setVSyncEnabled(m_impl->m_engine.renderWindow()->isVSyncEnabled());
+        Engine& engine = m_impl->m_engine;
+        pacer.setIdleCallback([&engine] (FramePacer::Clock::time_point until) {
+            engine.pollInput();
+            engine.idleTasks().run(until);
+        });
         // Start game loop
         m_impl->m_quit = false;
         while (not m_impl->m_quit) {
-            auto now = Implementation::Clock::now();
-            auto delta = now - lastUpdate;
-            int milliSeconds = boost::chrono::duration_cast<boost::chrono::milliseconds>(delta).count();
-            lastUpdate = now;
-            m_impl->m_engine.update(milliSeconds);
-            auto frameDuration = Implementation::Clock::now() - now;
-            auto sleepDuration = m_impl->m_targetFrameDuration - frameDuration;
-            if (sleepDuration.count() > 0) {
-                boost::this_thread::sleep_for(sleepDuration);
+            carriedTime += pacer.beginFrame();
+            auto milliSeconds = boost::chrono::duration_cast<boost::chrono::milliseconds>(carriedTime);
+            carriedTime -= milliSeconds;
+            m_impl->m_engine.update(milliSeconds.count());
+            pacer.waitForNextFrame();
+            FrameTimeHistogram& histogram = pacer.histogram();
+            if (histogram.totalTime() >= m_impl->m_reportInterval) {
+                std::ostringstream report;
+                histogram.print(report);
+                m_impl->m_frameLog.info(report.str());
+                histogram.clear();
+            }
+        }
+        m_impl->m_engine.shutdown();
+    }
+    catch (const luabind::error& e) {
+        printLuaError(e);
+    }
+}
+
+
+void
+Game::runHeadless(
+    unsigned long long ticks
+) {
+    using namespace boost::chrono;
+    try {
+        int frameMilliseconds = std::max<int>(
+            1,
+            duration_cast<milliseconds>(m_impl->m_targetFrameDuration).count()
+        );
+        m_impl->m_engine.init(true);
+        m_impl->m_quit = false;
+        unsigned long long ticksRun = 0;
+        auto start = steady_clock::now();
+        while (not m_impl->m_quit and ticksRun < ticks) {
+            GameState* gameState = m_impl->m_engine.currentGameState();
+            unsigned long long tickCount = gameState ? gameState->tickCount() : 0;
+            m_impl->m_engine.update(frameMilliseconds);
+            // The first game state is only activated by the first update,
+            // others may be switched to during any update
+            if (
+                gameState and
+                m_impl->m_engine.currentGameState() == gameState and
+                gameState->tickRate() > 0 and
+                gameState->tickCount() >= tickCount
+            ) {
+                ticksRun += gameState->tickCount() - tickCount;
             }
-            fpsCount += 1;
-            fpsTime += boost::chrono::duration_cast<boost::chrono::milliseconds>(frameDuration).count();
-            if (fpsTime >= 1000) {
-                float fps = 1000 * float(fpsCount) / float(fpsTime);
-                std::cout << "FPS: " << fps << std::endl;
-                fpsCount = 0;
-                fpsTime = 0;
+            else {
+                ticksRun += 1;
             }
         }
+        duration<double> elapsed = steady_clock::now() - start;
+        std::cout << "Ran " << ticksRun << " ticks in " << elapsed.count() 
+            << " s (" << ticksRun / std::max(elapsed.count(), 1e-9)
+            << " ticks per second)" << std::endl;
         m_impl->m_engine.shutdown();
     }
     catch (const luabind::error& e) {
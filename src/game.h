@@ -48,6 +48,24 @@ public:
     void
     run();
 
+    /**
+    * @brief Runs the game without graphics or input for a number of ticks
+    *
+    * Initializes a headless engine (see Engine::init()) and updates it as
+    * fast as possible, without waiting for the next frame. Each frame
+    * advances the game by targetFrameDuration(). Frames of game states
+    * without a tick rate count as one tick each.
+    *
+    * Prints the number of ticks run and the wall time they took.
+    *
+    * @param ticks
+    *   How many ticks to run before shutting down
+    */
+    void
+    runHeadless(
+        unsigned long long ticks
+    );
+
     /**
     * @brief The target frame duration
     */
@@ -3,22 +3,69 @@
 #include "bullet/collision_filter.h"
 #include "bullet/collision_system.h"
 #include "bullet/rigid_body_system.h"
+#include "engine/archetype.h"
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/engine.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
 #include "engine/game_state.h"
+#include "engine/reflection.h"
 #include "engine/serialization.h"
+#include "engine/state_hash.h"
+#include "engine/statistics.h"
 #include "engine/rng.h"
-#include "game.h"
+#include "engine/thread_pool.h"
+#include "microbe_stage/agent_field_system.h"
+#include "microbe_stage/agent_gpu_system.h"
+#include "microbe_stage/simulation_lod_system.h"
 #include "ogre/scene_node_system.h"
+#include "scripting/lua_include.h"
 #include "scripting/luabind.h"
+#include "util/half_float.h"
+#include <OgreBillboardSet.h>
 #include <OgreEntity.h>
+#include <OgreMeshManager.h>
 #include <OgreSceneManager.h>
+#include <OgreSubMesh.h>
 #include "util/make_unique.h"
 
+#include <algorithm>
+#include <btBulletCollisionCommon.h>
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
 using namespace thrive;
 
-REGISTER_COMPONENT(AgentComponent)
+// Edge length of the grid cells that AgentAbsorberSystem sorts particles into
+static const float PARTICLE_CELL_SIZE = 4.0f;
+
+// Packs grid cell coordinates into one sortable key
+static uint64_t
+cellKey(
+    int32_t x,
+    int32_t y
+) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+REGISTER_COMPONENT_WITH_STORAGE(
+    AgentComponent, 
+    ComponentCollection::Storage::SparseSet
+)
+
+
+static luabind::object
+AgentComponent_velocityData(
+    const AgentComponent* self,
+    lua_State* L
+) {
+    return lightUserdata(L, self->m_velocity.ptr());
+}
 
 
 luabind::scope
@@ -36,10 +83,22 @@ AgentComponent::luaBindings() {
         .def_readwrite("potency", &AgentComponent::m_potency)
         .def_readwrite("timeToLive", &AgentComponent::m_timeToLive)
         .def_readwrite("velocity", &AgentComponent::m_velocity)
+        .def("velocityData", AgentComponent_velocityData)
     ;
 }
 
 
+void
+AgentComponent::digest(
+    StateDigest& digest
+) const {
+    digest.add(m_agentId)
+        .add(m_potency)
+        .add(this->timeToLive())
+        .add(m_velocity);
+}
+
+
 void
 AgentComponent::load(
     const StorageContainer& storage
@@ -48,7 +107,13 @@ AgentComponent::load(
     m_agentId = storage.get<AgentId>("agentId", NULL_AGENT);
     m_potency = storage.get<float>("potency");
     m_timeToLive = storage.get<Milliseconds>("timeToLive");
-    m_velocity = storage.get<Ogre::Vector3>("velocity");
+    if (storage.contains<uint32_t>("planarVelocity")) {
+        uint32_t velocity = storage.get<uint32_t>("planarVelocity");
+        m_velocity = Ogre::Vector3(firstHalf(velocity), secondHalf(velocity), 0);
+    }
+    else {
+        m_velocity = storage.get<Ogre::Vector3>("velocity");
+    }
 }
 
 
@@ -57,19 +122,44 @@ AgentComponent::storage() const {
     StorageContainer storage = Component::storage();
     storage.set<AgentId>("agentId", m_agentId);
     storage.set<float>("potency", m_potency);
-    storage.set<Milliseconds>("timeToLive", m_timeToLive);
-    storage.set<Ogre::Vector3>("velocity", m_velocity);
+    storage.set<Milliseconds>("timeToLive", this->timeToLive());
+    // Particles move in the plane, half precision is plenty for their speed
+    if (m_velocity.z == 0.0f) {
+        storage.set<uint32_t>("planarVelocity", packHalves(m_velocity.x, m_velocity.y));
+    }
+    else {
+        storage.set<Ogre::Vector3>("velocity", m_velocity);
+    }
     return storage;
 }
 
+
+Milliseconds
+AgentComponent::timeToLive() const {
+    if (m_lifetimeTimers and m_timeToLive > 0) {
+        return m_lifetimeTimers->remaining(m_lifetimeTimer);
+    }
+    return m_timeToLive;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // AgentEmitterComponent
 ////////////////////////////////////////////////////////////////////////////////
 
+static const auto AGENT_EMITTER_FIELDS = fieldList<AgentEmitterComponent>(
+    field("emissionRadius", &AgentEmitterComponent::m_emissionRadius),
+    field("maxInitialSpeed", &AgentEmitterComponent::m_maxInitialSpeed),
+    field("minInitialSpeed", &AgentEmitterComponent::m_minInitialSpeed),
+    field("maxEmissionAngle", &AgentEmitterComponent::m_maxEmissionAngle),
+    field("minEmissionAngle", &AgentEmitterComponent::m_minEmissionAngle),
+    field("particleLifetime", &AgentEmitterComponent::m_particleLifetime)
+);
+
+
 luabind::scope
 AgentEmitterComponent::luaBindings() {
     using namespace luabind;
-    return class_<AgentEmitterComponent, Component>("AgentEmitterComponent")
+    return AGENT_EMITTER_FIELDS.bind(class_<AgentEmitterComponent, Component>("AgentEmitterComponent"))
         .enum_("ID") [
             value("TYPE_ID", AgentEmitterComponent::TYPE_ID)
         ]
@@ -77,13 +167,8 @@ AgentEmitterComponent::luaBindings() {
             def("TYPE_NAME", &AgentEmitterComponent::TYPE_NAME)
         ]
         .def(constructor<>())
+        .def("ejectAgent", &AgentEmitterComponent::ejectAgent)
         .def("emitAgent", &AgentEmitterComponent::emitAgent)
-        .def_readwrite("emissionRadius", &AgentEmitterComponent::m_emissionRadius)
-        .def_readwrite("maxInitialSpeed", &AgentEmitterComponent::m_maxInitialSpeed)
-        .def_readwrite("minInitialSpeed", &AgentEmitterComponent::m_minInitialSpeed)
-        .def_readwrite("minEmissionAngle", &AgentEmitterComponent::m_minEmissionAngle)
-        .def_readwrite("maxEmissionAngle", &AgentEmitterComponent::m_maxEmissionAngle)
-        .def_readwrite("particleLifetime", &AgentEmitterComponent::m_particleLifetime)
     ;
 }
 
@@ -97,29 +182,40 @@ AgentEmitterComponent::emitAgent(
 }
 
 
+void
+AgentEmitterComponent::ejectAgent(
+    AgentId agentId,
+    double amount,
+    const Ogre::Quaternion& orientation
+) {
+    Ogre::Vector3 yAxis = orientation.yAxis();
+    Ogre::Degree angle = Ogre::Math::ATan2(-yAxis.x, -yAxis.y);
+    if (angle < Ogre::Degree(0)) {
+        angle += Ogre::Degree(360);
+    }
+    // Over- and underflow of the angles is handled by the emitter
+    m_minEmissionAngle = angle - Ogre::Degree(30);
+    m_maxEmissionAngle = angle + Ogre::Degree(30);
+    unsigned int particleCount = amount >= 3.0 ? 3 : 1;
+    for (unsigned int i = 0; i < particleCount; ++i) {
+        this->emitAgent(agentId, amount / particleCount);
+    }
+}
+
+
 
 void
 AgentEmitterComponent::load(
     const StorageContainer& storage
 ) {
     Component::load(storage);
-    m_emissionRadius = storage.get<Ogre::Real>("emissionRadius", 0.0);
-    m_maxInitialSpeed = storage.get<Ogre::Real>("maxInitialSpeed", 0.0);
-    m_minInitialSpeed = storage.get<Ogre::Real>("minInitialSpeed", 0.0);
-    m_maxEmissionAngle = storage.get<Ogre::Degree>("maxEmissionAngle");
-    m_minEmissionAngle = storage.get<Ogre::Degree>("minEmissionAngle");
-    m_particleLifetime = storage.get<Milliseconds>("particleLifetime");
+    AGENT_EMITTER_FIELDS.load(*this, storage);
 }
 
 StorageContainer
 AgentEmitterComponent::storage() const {
     StorageContainer storage = Component::storage();
-    storage.set<Ogre::Real>("emissionRadius", m_emissionRadius);
-    storage.set<Ogre::Real>("maxInitialSpeed", m_maxInitialSpeed);
-    storage.set<Ogre::Real>("minInitialSpeed", m_minInitialSpeed);
-    storage.set<Ogre::Degree>("maxEmissionAngle", m_maxEmissionAngle);
-    storage.set<Ogre::Degree>("minEmissionAngle", m_minEmissionAngle);
-    storage.set<Milliseconds>("particleLifetime", m_particleLifetime);
+    AGENT_EMITTER_FIELDS.store(*this, storage);
     return storage;
 }
 
@@ -130,6 +226,14 @@ REGISTER_COMPONENT(AgentEmitterComponent)
 // TimedAgentEmitterComponent
 ////////////////////////////////////////////////////////////////////////////////
 
+static Milliseconds
+TimedAgentEmitterComponent_getEmitInterval(
+    const TimedAgentEmitterComponent* self
+) {
+    return self->m_emitInterval;
+}
+
+
 luabind::scope
 TimedAgentEmitterComponent::luaBindings() {
     using namespace luabind;
@@ -141,7 +245,7 @@ TimedAgentEmitterComponent::luaBindings() {
             def("TYPE_NAME", &TimedAgentEmitterComponent::TYPE_NAME)
         ]
         .def(constructor<>())
-        .def_readwrite("emitInterval", &TimedAgentEmitterComponent::m_emitInterval)
+        .property("emitInterval", &TimedAgentEmitterComponent_getEmitInterval, &TimedAgentEmitterComponent::setEmitInterval)
         .def_readwrite("agentId", &TimedAgentEmitterComponent::m_agentId)
         .def_readwrite("particlesPerEmission", &TimedAgentEmitterComponent::m_particlesPerEmission)
         .def_readwrite("potencyPerParticle", &TimedAgentEmitterComponent::m_potencyPerParticle)
@@ -162,6 +266,27 @@ TimedAgentEmitterComponent::load(
 }
 
 
+void
+TimedAgentEmitterComponent::setEmitInterval(
+    Milliseconds interval
+) {
+    m_timeSinceLastEmission = this->timeSinceLastEmission();
+    m_emitInterval = interval;
+    if (not m_emissionTimers) {
+        return;
+    }
+    m_emissionTimers->cancel(m_emissionTimer);
+    m_emissionTimer = NULL_TIMER;
+    if (interval > 0) {
+        m_emissionTimer = m_emissionTimers->schedulePeriodic(
+            interval - m_timeSinceLastEmission,
+            interval,
+            m_emissionCallback
+        );
+    }
+}
+
+
 StorageContainer
 TimedAgentEmitterComponent::storage() const {
     StorageContainer storage = Component::storage();
@@ -169,12 +294,46 @@ TimedAgentEmitterComponent::storage() const {
     storage.set<uint16_t>("particlesPerEmission", m_particlesPerEmission);
     storage.set<float>("potencyPerParticle", m_potencyPerParticle);
     storage.set<Milliseconds>("emitInterval", m_emitInterval);
-    storage.set<Milliseconds>("timeSinceLastEmission", m_timeSinceLastEmission);
+    storage.set<Milliseconds>("timeSinceLastEmission", this->timeSinceLastEmission());
     return storage;
 }
 
+
+Milliseconds
+TimedAgentEmitterComponent::timeSinceLastEmission() const {
+    if (m_emissionTimers and m_emissionTimers->isPending(m_emissionTimer)) {
+        return m_emitInterval - m_emissionTimers->remaining(m_emissionTimer);
+    }
+    return m_timeSinceLastEmission;
+}
+
 REGISTER_COMPONENT(TimedAgentEmitterComponent)
 
+////////////////////////////////////////////////////////////////////////////////
+// AgentAbsorbedEvent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+AgentAbsorbedEvent::luaBindings() {
+    using namespace luabind;
+    return class_<AgentAbsorbedEvent>("AgentAbsorbedEvent")
+        .scope [
+            def("channel", &AgentAbsorbedEvent::channel)
+        ]
+        .def_readonly("absorber", &AgentAbsorbedEvent::absorber)
+        .def_readonly("agentId", &AgentAbsorbedEvent::agentId)
+        .def_readonly("amount", &AgentAbsorbedEvent::amount)
+    ;
+}
+
+
+EventChannel<AgentAbsorbedEvent>&
+AgentAbsorbedEvent::channel(
+    GameState* gameState
+) {
+    return gameState->events().channel<AgentAbsorbedEvent>();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // AgentAbsorberComponent
 ////////////////////////////////////////////////////////////////////////////////
@@ -190,32 +349,17 @@ AgentAbsorberComponent::luaBindings() {
             def("TYPE_NAME", &AgentAbsorberComponent::TYPE_NAME)
         ]
         .def(constructor<>())
-        .def("absorbedAgentAmount", &AgentAbsorberComponent::absorbedAgentAmount)
-        .def("setAbsorbedAgentAmount", &AgentAbsorberComponent::setAbsorbedAgentAmount)
+        .def("canAbsorbAgent", &AgentAbsorberComponent::canAbsorbAgent)
         .def("setCanAbsorbAgent", &AgentAbsorberComponent::setCanAbsorbAgent)
     ;
 }
 
 
-float
-AgentAbsorberComponent::absorbedAgentAmount(
-    AgentId id
-) const {
-    const auto& iter = m_absorbedAgents.find(id);
-    if (iter != m_absorbedAgents.cend()) {
-        return iter->second;
-    }
-    else {
-        return 0.0f;
-    }
-}
-
-
 bool
 AgentAbsorberComponent::canAbsorbAgent(
     AgentId id
 ) const {
-    return m_canAbsorbAgent.find(id) != m_canAbsorbAgent.end();
+    return m_canAbsorbAgent.contains(id);
 }
 
 
@@ -226,23 +370,13 @@ AgentAbsorberComponent::load(
     Component::load(storage);
     StorageList agents = storage.get<StorageList>("agents");
     for (const StorageContainer& container : agents) {
-        AgentId agentId = container.get<AgentId>("agentId");
-        float amount = container.get<float>("amount");
-        m_absorbedAgents[agentId] = amount;
-        m_canAbsorbAgent.insert(agentId);
+        // Older savegames also have the "amount" absorbed in the last
+        // update, which is gone with the events
+        m_canAbsorbAgent.insert(container.get<AgentId>("agentId"));
     }
 }
 
 
-void
-AgentAbsorberComponent::setAbsorbedAgentAmount(
-    AgentId id,
-    float amount
-) {
-    m_absorbedAgents[id] = amount;
-}
-
-
 void
 AgentAbsorberComponent::setCanAbsorbAgent(
     AgentId id,
@@ -265,14 +399,16 @@ AgentAbsorberComponent::storage() const {
     for (AgentId agentId : m_canAbsorbAgent) {
         StorageContainer container;
         container.set<AgentId>("agentId", agentId);
-        container.set<float>("amount", this->absorbedAgentAmount(agentId));
         agents.append(container);
     }
     storage.set<StorageList>("agents", agents);
     return storage;
 }
 
-REGISTER_COMPONENT(AgentAbsorberComponent)
+REGISTER_COMPONENT_WITH_STORAGE(
+    AgentAbsorberComponent,
+    ComponentCollection::Storage::SparseSet
+)
 
 ////////////////////////////////////////////////////////////////////////////////
 // AgentLifetimeSystem
@@ -283,51 +419,221 @@ AgentLifetimeSystem::luaBindings() {
     using namespace luabind;
     return class_<AgentLifetimeSystem, System>("AgentLifetimeSystem")
         .def(constructor<>())
+        .def("setDefaultPoolSize", &AgentLifetimeSystem::setDefaultPoolSize)
+        .def("setPoolSize", &AgentLifetimeSystem::setPoolSize)
     ;
 }
 
 
 struct AgentLifetimeSystem::Implementation {
 
-    EntityFilter<
-        AgentComponent
-    > m_entities;
+    void
+    onAgentAdded(
+        AgentComponent& agent
+    ) {
+        agent.m_lifetimeTimers = &m_timers;
+        AgentComponent* agentPointer = &agent;
+        agent.m_lifetimeTimer = m_timers.schedule(agent.m_timeToLive, [this, agentPointer] () {
+            agentPointer->m_lifetimeTimer = NULL_TIMER;
+            agentPointer->m_timeToLive = 0;
+            m_expiredAgents.push_back(agentPointer->owner());
+        });
+    }
+
+    void
+    onAgentRemoved(
+        AgentComponent& agent
+    ) {
+        // Keep the time left for anyone still holding on to the component
+        agent.m_timeToLive = agent.timeToLive();
+        m_timers.cancel(agent.m_lifetimeTimer);
+        agent.m_lifetimeTimer = NULL_TIMER;
+        agent.m_lifetimeTimers = nullptr;
+    }
+
+    // Schedules and cancels the timers of the agents added and removed 
+    // since the last call
+    void
+    processChanges() {
+        m_agents->takeChanges(m_observer, m_changes);
+        for (const ComponentCollection::Change& change : m_changes) {
+            auto& agent = static_cast<AgentComponent&>(*change.component);
+            if (change.isAdded) {
+                this->onAgentAdded(agent);
+            }
+            else {
+                this->onAgentRemoved(agent);
+            }
+        }
+    }
+
+    unsigned int
+    poolSize(
+        AgentId agentId
+    ) const {
+        auto iter = m_poolSizes.find(agentId);
+        if (iter == m_poolSizes.end()) {
+            return m_defaultPoolSize;
+        }
+        return iter->second;
+    }
+
+    ComponentCollection* m_agents = nullptr;
+
+    std::vector<ComponentCollection::Change> m_changes;
+
+    unsigned int m_defaultPoolSize = 0;
+
+    // Particles whose timers have fired, despawned by the next update
+    std::vector<EntityId> m_expiredAgents;
+
+    unsigned int m_observer = 0;
+
+    std::unordered_map<AgentId, unsigned int> m_poolSizes;
+
+    std::unordered_map<AgentId, std::vector<EntityId>> m_pools;
+
+    // Expired particles that aren't pooled, removed in one batch
+    std::vector<EntityId> m_removedAgents;
+
+    TimerWheel m_timers;
 };
 
 
 AgentLifetimeSystem::AgentLifetimeSystem()
   : m_impl(new Implementation())
 {
+    this->declareWrite(AgentComponent::TYPE_ID);
+    this->declareWrite(OgreSceneNodeComponent::TYPE_ID);
+    this->setFixedRate(true);
 }
 
 
 AgentLifetimeSystem::~AgentLifetimeSystem() {}
 
 
+void
+AgentLifetimeSystem::expireAgent(
+    AgentComponent& agent
+) {
+    agent.m_timeToLive = 0;
+    if (not agent.m_lifetimeTimers) {
+        // Added since the last update, which schedules it to expire now
+        return;
+    }
+    m_impl->m_timers.cancel(agent.m_lifetimeTimer);
+    agent.m_lifetimeTimer = NULL_TIMER;
+    m_impl->m_expiredAgents.push_back(agent.owner());
+}
+
+
 void
 AgentLifetimeSystem::init(
     GameState* gameState
 ) {
     System::init(gameState);
-    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_agents = &gameState->entityManager().getComponentCollection(
+        AgentComponent::TYPE_ID
+    );
+    m_impl->m_observer = m_impl->m_agents->registerObserver();
+    for (const auto& component : m_impl->m_agents->components()) {
+        m_impl->onAgentAdded(static_cast<AgentComponent&>(*component));
+    }
+}
+
+
+void
+AgentLifetimeSystem::setDefaultPoolSize(
+    unsigned int size
+) {
+    m_impl->m_defaultPoolSize = size;
+}
+
+
+void
+AgentLifetimeSystem::setPoolSize(
+    AgentId agentId,
+    unsigned int size
+) {
+    m_impl->m_poolSizes[agentId] = size;
 }
 
 
 void
 AgentLifetimeSystem::shutdown() {
-    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->processChanges();
+    m_impl->m_agents->unregisterObserver(m_impl->m_observer);
+    for (const auto& component : m_impl->m_agents->components()) {
+        m_impl->onAgentRemoved(static_cast<AgentComponent&>(*component));
+    }
+    m_impl->m_agents = nullptr;
+    m_impl->m_changes.clear();
+    m_impl->m_expiredAgents.clear();
+    m_impl->m_pools.clear();
+    m_impl->m_timers.clear();
     System::shutdown();
 }
 
 
+EntityId
+AgentLifetimeSystem::takePooledAgent(
+    AgentId agentId
+) {
+    auto iter = m_impl->m_pools.find(agentId);
+    if (iter == m_impl->m_pools.end()) {
+        return NULL_ENTITY;
+    }
+    std::vector<EntityId>& pool = iter->second;
+    EntityManager* entityManager = this->entityManager();
+    while (not pool.empty()) {
+        EntityId entityId = pool.back();
+        pool.pop_back();
+        // The entity may have been removed in the meantime
+        if (entityManager->getComponent<OgreSceneNodeComponent>(entityId)) {
+            entityManager->setVolatile(entityId, false);
+            return entityId;
+        }
+    }
+    return NULL_ENTITY;
+}
+
+
 void
 AgentLifetimeSystem::update(int milliseconds) {
-    for (auto& value : m_impl->m_entities) {
-        AgentComponent* agentComponent = std::get<0>(value.second);
-        agentComponent->m_timeToLive -= milliseconds;
-        if (agentComponent->m_timeToLive <= 0) {
-            this->entityManager()->removeEntity(value.first);
+    // Collects the particles that are due into m_expiredAgents. The
+    // removals are deferred until processCommands(), so the components
+    // stay valid until the end of the update.
+    m_impl->processChanges();
+    m_impl->m_timers.advance(milliseconds);
+    EntityManager* entityManager = this->entityManager();
+    for (EntityId entityId : m_impl->m_expiredAgents) {
+        auto agentComponent = static_cast<AgentComponent*>(m_impl->m_agents->get(entityId));
+        if (not agentComponent or agentComponent->m_timeToLive > 0) {
+            continue;
+        }
+        std::vector<EntityId>& pool = m_impl->m_pools[agentComponent->m_agentId];
+        OgreSceneNodeComponent* sceneNodeComponent = nullptr;
+        if (
+            pool.size() < m_impl->poolSize(agentComponent->m_agentId) and
+            not entityManager->getComponent<RigidBodyComponent>(entityId)
+        ) {
+            sceneNodeComponent = entityManager->getComponent<OgreSceneNodeComponent>(entityId);
+        }
+        if (sceneNodeComponent) {
+            // Keep the entity with its scene node, only the agent goes
+            sceneNodeComponent->m_visible = false;
+            entityManager->removeComponent(entityId, AgentComponent::TYPE_ID);
+            entityManager->setVolatile(entityId, true);
+            pool.push_back(entityId);
         }
+        else {
+            m_impl->m_removedAgents.push_back(entityId);
+        }
+    }
+    m_impl->m_expiredAgents.clear();
+    if (not m_impl->m_removedAgents.empty()) {
+        entityManager->removeEntities(m_impl->m_removedAgents);
+        m_impl->m_removedAgents.clear();
     }
 }
 
@@ -347,16 +653,28 @@ AgentMovementSystem::luaBindings() {
 
 struct AgentMovementSystem::Implementation {
 
-    EntityFilter<
-        AgentComponent,
-        RigidBodyComponent
-    > m_entities;
+    struct Columns {
+
+        const std::vector<Component*>* agents;
+
+        const std::vector<Component*>* sceneNodes;
+
+        // Only agents from older savegames have a rigid body
+        const std::vector<Component*>* rigidBodies;
+
+    };
+
+    std::vector<Columns> m_columns;
 };
 
 
 AgentMovementSystem::AgentMovementSystem()
   : m_impl(new Implementation())
 {
+    this->declareRead(AgentComponent::TYPE_ID);
+    this->declareWrite(OgreSceneNodeComponent::TYPE_ID);
+    this->declareWrite(RigidBodyComponent::TYPE_ID);
+    this->setFixedRate(true);
 }
 
 
@@ -368,24 +686,70 @@ AgentMovementSystem::init(
     GameState* gameState
 ) {
     System::init(gameState);
-    m_impl->m_entities.setEntityManager(&gameState->entityManager());
 }
 
 
 void
 AgentMovementSystem::shutdown() {
-    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_columns.clear();
     System::shutdown();
 }
 
 
 void
 AgentMovementSystem::update(int milliseconds) {
-    for (auto& value : m_impl->m_entities) {
-        AgentComponent* agentComponent = std::get<0>(value.second);
-        RigidBodyComponent* rigidBodyComponent = std::get<1>(value.second);
-        Ogre::Vector3 delta = agentComponent->m_velocity * float(milliseconds) / 1000.0f;
-        rigidBodyComponent->m_dynamicProperties.position += delta;
+    bool isInterpolated = this->isFixedRate() and this->gameState()->tickRate() > 0;
+    float seconds = milliseconds / 1000.0f;
+    // Walk the archetype columns directly. Agents are created and
+    // destroyed all the time, so not having an entity filter saves its
+    // bookkeeping as well as the per-entity component lookups.
+    auto& columns = m_impl->m_columns;
+    columns.clear();
+    for (const auto& archetype : this->entityManager()->archetypes()) {
+        if (archetype->size() == 0) {
+            continue;
+        }
+        const auto* agents = archetype->componentColumn(AgentComponent::TYPE_ID);
+        const auto* sceneNodes = archetype->componentColumn(OgreSceneNodeComponent::TYPE_ID);
+        if (agents and sceneNodes) {
+            columns.push_back({
+                agents,
+                sceneNodes,
+                archetype->componentColumn(RigidBodyComponent::TYPE_ID)
+            });
+        }
+    }
+    for (const auto& column : columns) {
+        this->engine()->threadPool().parallelFor(column.agents->size(), 256,
+            [&column, seconds, isInterpolated] (size_t begin, size_t end) {
+                const auto& agents = *column.agents;
+                const auto& sceneNodes = *column.sceneNodes;
+                if (column.rigidBodies) {
+                    const auto& rigidBodies = *column.rigidBodies;
+                    for (size_t i = begin; i < end; ++i) {
+                        auto agentComponent = static_cast<AgentComponent*>(agents[i]);
+                        auto rigidBodyComponent = static_cast<RigidBodyComponent*>(rigidBodies[i]);
+                        rigidBodyComponent->m_dynamicProperties.position += agentComponent->m_velocity * seconds;
+                    }
+                    return;
+                }
+                // Particles have no rigid body, so drive the scene node
+                // like BulletToOgreSystem would
+                for (size_t i = begin; i < end; ++i) {
+                    auto agentComponent = static_cast<AgentComponent*>(agents[i]);
+                    auto sceneNodeComponent = static_cast<OgreSceneNodeComponent*>(sceneNodes[i]);
+                    auto& transform = sceneNodeComponent->m_transform;
+                    bool hasPreviousTick = isInterpolated and sceneNodeComponent->m_isInterpolated;
+                    Ogre::Vector3 delta = agentComponent->m_velocity * seconds;
+                    transform.position += delta;
+                    sceneNodeComponent->m_previousOrientation = transform.orientation;
+                    sceneNodeComponent->m_previousPosition = hasPreviousTick ?
+                        transform.position - delta : transform.position;
+                    sceneNodeComponent->m_isInterpolated = isInterpolated;
+                    transform.touch();
+                }
+            }
+        );
     }
 }
 
@@ -405,19 +769,138 @@ AgentEmitterSystem::luaBindings() {
 
 struct AgentEmitterSystem::Implementation {
 
+    void
+    onTimedEmitterAdded(
+        TimedAgentEmitterComponent& emitter
+    ) {
+        TimedAgentEmitterComponent* emitterPointer = &emitter;
+        emitter.m_emissionCallback = [this, emitterPointer] () {
+            m_dueEmitters.push_back(emitterPointer);
+        };
+        // Kept for setEmitInterval(), even if the interval disables the 
+        // emissions for now
+        emitter.m_emissionTimers = &m_timers;
+        if (emitter.m_emitInterval <= 0) {
+            return;
+        }
+        emitter.m_emissionTimer = m_timers.schedulePeriodic(
+            emitter.m_emitInterval - emitter.m_timeSinceLastEmission,
+            emitter.m_emitInterval,
+            emitter.m_emissionCallback
+        );
+    }
+
+    void
+    onTimedEmitterRemoved(
+        TimedAgentEmitterComponent& emitter
+    ) {
+        emitter.m_timeSinceLastEmission = emitter.timeSinceLastEmission();
+        m_timers.cancel(emitter.m_emissionTimer);
+        emitter.m_emissionTimer = NULL_TIMER;
+        emitter.m_emissionCallback = nullptr;
+        emitter.m_emissionTimers = nullptr;
+    }
+
+    // Schedules and cancels the timers of the timed emitters added and 
+    // removed since the last call
+    void
+    processChanges() {
+        m_timedEmitters->takeChanges(m_observer, m_changes);
+        for (const ComponentCollection::Change& change : m_changes) {
+            auto& emitter = static_cast<TimedAgentEmitterComponent&>(*change.component);
+            if (change.isAdded) {
+                this->onTimedEmitterAdded(emitter);
+            }
+            else {
+                this->onTimedEmitterRemoved(emitter);
+            }
+        }
+    }
+
+    // Draws the emission angles (in degrees) and speeds of the next count
+    // particles of an emitter into m_angles and m_speeds
+    void
+    drawEmissions(
+        RNG& rng,
+        const AgentEmitterComponent& emitter,
+        size_t count
+    ) {
+        m_angles.resize(count);
+        m_speeds.resize(count);
+        rng.fillFloats(
+            m_angles.data(),
+            count,
+            emitter.m_minEmissionAngle.valueDegrees(),
+            emitter.m_maxEmissionAngle.valueDegrees()
+        );
+        rng.fillFloats(
+            m_speeds.data(),
+            count,
+            emitter.m_minInitialSpeed,
+            emitter.m_maxInitialSpeed
+        );
+    }
+
+    // Merges the emissions of the same agent
+    static void
+    aggregateEmissions(
+        std::vector<std::pair<AgentId, int>>& emissions
+    ) {
+        std::sort(emissions.begin(), emissions.end());
+        auto merged = emissions.begin();
+        for (auto iter = emissions.begin() + 1; iter < emissions.end(); ++iter) {
+            if (iter->first == merged->first) {
+                merged->second += iter->second;
+            }
+            else {
+                ++merged;
+                *merged = *iter;
+            }
+        }
+        emissions.erase(merged + 1, emissions.end());
+    }
+
+    std::vector<float> m_angles;
+
+    std::vector<ComponentCollection::Change> m_changes;
+
+    // Timed emitters whose timers have fired during this update, once per
+    // emission
+    std::vector<TimedAgentEmitterComponent*> m_dueEmitters;
+
+    Statistics::Counter* m_emittedCounter = nullptr;
+
     EntityFilter<
         AgentEmitterComponent,
-        OgreSceneNodeComponent,
-        Optional<TimedAgentEmitterComponent>
+        OgreSceneNodeComponent
     > m_entities;
 
+    AgentFieldSystem* m_fieldSystem = nullptr;
+
+    AgentGpuSystem* m_gpuSystem = nullptr;
+
+    AgentLifetimeSystem* m_lifetimeSystem = nullptr;
+
+    unsigned int m_observer = 0;
+
+    AgentRenderSystem* m_renderSystem = nullptr;
+
     Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::vector<float> m_speeds;
+
+    SimulationLodSystem* m_simulationLodSystem = nullptr;
+
+    ComponentCollection* m_timedEmitters = nullptr;
+
+    TimerWheel m_timers;
 };
 
 
 AgentEmitterSystem::AgentEmitterSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -430,36 +913,70 @@ AgentEmitterSystem::init(
 ) {
     System::init(gameState);
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_fieldSystem = gameState->findSystem<AgentFieldSystem>();
+    m_impl->m_gpuSystem = gameState->findSystem<AgentGpuSystem>();
+    m_impl->m_lifetimeSystem = gameState->findSystem<AgentLifetimeSystem>();
+    m_impl->m_renderSystem = gameState->findSystem<AgentRenderSystem>();
     m_impl->m_sceneManager = gameState->sceneManager();
+    m_impl->m_simulationLodSystem = SimulationLodSystem::find(gameState);
+    m_impl->m_emittedCounter = &gameState->engine().statistics().counter("agents.emitted");
+    m_impl->m_timedEmitters = &gameState->entityManager().getComponentCollection(
+        TimedAgentEmitterComponent::TYPE_ID
+    );
+    m_impl->m_observer = m_impl->m_timedEmitters->registerObserver();
+    for (const auto& component : m_impl->m_timedEmitters->components()) {
+        m_impl->onTimedEmitterAdded(static_cast<TimedAgentEmitterComponent&>(*component));
+    }
 }
 
 
 void
 AgentEmitterSystem::shutdown() {
+    m_impl->processChanges();
+    m_impl->m_timedEmitters->unregisterObserver(m_impl->m_observer);
+    for (const auto& component : m_impl->m_timedEmitters->components()) {
+        m_impl->onTimedEmitterRemoved(static_cast<TimedAgentEmitterComponent&>(*component));
+    }
+    m_impl->m_changes.clear();
+    m_impl->m_timedEmitters = nullptr;
+    m_impl->m_timers.clear();
+    m_impl->m_emittedCounter = nullptr;
     m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_fieldSystem = nullptr;
+    m_impl->m_gpuSystem = nullptr;
+    m_impl->m_lifetimeSystem = nullptr;
+    m_impl->m_renderSystem = nullptr;
     m_impl->m_sceneManager = nullptr;
+    m_impl->m_simulationLodSystem = nullptr;
     System::shutdown();
 }
 
-// Helper function for AgentEmitterSystem to emit agents
+// Helper function for AgentEmitterSystem to create the components of an agent
+//
+// If the lifetime system has a pooled particle of the same agent, that 
+// particle is reused instead and nothing is added to newAgents. With
+// hasMesh set to false, new particles are left to AgentRenderSystem.
+// Agents of the field system are deposited into their field instead, and
+// agents of the GPU system become GPU particles.
+// The random angle and speed are drawn in batches, see drawEmissions().
 static void
-emitAgent(
+emitAgentParticle(
     AgentId agentId,
     double amount,
     Ogre::Vector3 emittorPosition,
-    AgentEmitterComponent* emitterComponent
+    AgentEmitterComponent* emitterComponent,
+    Ogre::Degree emissionAngle,
+    Ogre::Real emissionSpeed,
+    EntityManager& entityManager,
+    AgentFieldSystem* fieldSystem,
+    AgentGpuSystem* gpuSystem,
+    AgentLifetimeSystem* lifetimeSystem,
+    bool hasMesh,
+    std::vector<EntityManager::ComponentList>& newAgents
 ) {
 
     Ogre::Vector3 emissionOffset(0,0,0);
 
-    Ogre::Degree emissionAngle{static_cast<Ogre::Real>(Game::instance().engine().rng().getDouble(
-        emitterComponent->m_minEmissionAngle.valueDegrees(),
-        emitterComponent->m_maxEmissionAngle.valueDegrees()
-    ))};
-    Ogre::Real emissionSpeed = Game::instance().engine().rng().getDouble(
-        emitterComponent->m_minInitialSpeed,
-        emitterComponent->m_maxInitialSpeed
-    );
     Ogre::Vector3 emissionVelocity(
         emissionSpeed * Ogre::Math::Sin(emissionAngle),
         emissionSpeed * Ogre::Math::Cos(emissionAngle),
@@ -470,69 +987,115 @@ emitAgent(
         emitterComponent->m_emissionRadius * Ogre::Math::Cos(emissionAngle),
         0.0
     );
-    EntityId agentEntityId = Game::instance().engine().currentGameState()->entityManager().generateNewId();
-    // Scene Node
-    auto agentSceneNodeComponent = make_unique<OgreSceneNodeComponent>();
-    agentSceneNodeComponent->m_transform.scale = PARTICLE_SCALE;
-    agentSceneNodeComponent->m_meshName = AgentRegistry::getAgentMeshName(agentId);
-    // Collision Hull
-    auto agentRigidBodyComponent = make_unique<RigidBodyComponent>(
-        btBroadphaseProxy::SensorTrigger,
-        btBroadphaseProxy::AllFilter & (~ btBroadphaseProxy::SensorTrigger)
-    );
-    agentRigidBodyComponent->m_properties.shape = std::make_shared<SphereShape>(0.01);
-    agentRigidBodyComponent->m_properties.hasContactResponse = false;
-    agentRigidBodyComponent->m_properties.kinematic = true;
-    agentRigidBodyComponent->m_dynamicProperties.position = emittorPosition + emissionOffset;
+    if (fieldSystem and fieldSystem->hasAgent(agentId)) {
+        fieldSystem->deposit(agentId, emittorPosition + emissionOffset, amount);
+        return;
+    }
+    if (gpuSystem and gpuSystem->hasAgent(agentId)) {
+        gpuSystem->emit(
+            agentId,
+            emittorPosition + emissionOffset,
+            emissionVelocity,
+            amount,
+            emitterComponent->m_particleLifetime
+        );
+        return;
+    }
     // Agent Component
     auto agentComponent = make_unique<AgentComponent>();
     agentComponent->m_timeToLive = emitterComponent->m_particleLifetime;
     agentComponent->m_velocity = emissionVelocity;
     agentComponent->m_agentId = agentId;
     agentComponent->m_potency = amount;
-    auto collisionHandler = make_unique<CollisionComponent>();
-    collisionHandler->addCollisionGroup("agent");
+    EntityId pooledId = lifetimeSystem ? lifetimeSystem->takePooledAgent(agentId) : NULL_ENTITY;
+    if (pooledId != NULL_ENTITY) {
+        auto sceneNodeComponent = entityManager.getComponent<OgreSceneNodeComponent>(pooledId);
+        sceneNodeComponent->m_transform.position = emittorPosition + emissionOffset;
+        // The particle may have grown by merging, see AgentCoalescingSystem
+        sceneNodeComponent->m_transform.scale = PARTICLE_SCALE;
+        sceneNodeComponent->m_transform.touch();
+        // Don't blend from where the particle expired
+        sceneNodeComponent->m_isInterpolated = false;
+        sceneNodeComponent->m_visible = true;
+        entityManager.deferAddComponent(pooledId, std::move(agentComponent));
+        return;
+    }
+    // Scene Node. Agents are plain points without a rigid body, 
+    // AgentMovementSystem moves them and AgentAbsorberSystem tests them
+    // against the absorbers.
+    auto agentSceneNodeComponent = make_unique<OgreSceneNodeComponent>();
+    agentSceneNodeComponent->m_transform.position = emittorPosition + emissionOffset;
+    agentSceneNodeComponent->m_transform.scale = PARTICLE_SCALE;
+    agentSceneNodeComponent->m_isParticle = true;
+    if (hasMesh) {
+        const AgentRegistry::AgentType& agentType = AgentRegistry::getAgentType(agentId);
+        agentSceneNodeComponent->m_configuration->meshName = agentType.meshName;
+        agentSceneNodeComponent->m_configuration->mesh = agentType.mesh;
+    }
     // Build component list
-    std::list<std::unique_ptr<Component>> components;
+    EntityManager::ComponentList components;
+    components.reserve(2);
     components.emplace_back(std::move(agentSceneNodeComponent));
     components.emplace_back(std::move(agentComponent));
-    components.emplace_back(std::move(agentRigidBodyComponent));
-    components.emplace_back(std::move(collisionHandler));
-    for (auto& component : components) {
-        Game::instance().engine().currentGameState()->entityManager().addComponent(
-            agentEntityId,
-            std::move(component)
-        );
-    }
+    newAgents.push_back(std::move(components));
 }
 
 
 
 void
 AgentEmitterSystem::update(int milliseconds) {
+    // Collect all new agents to create them in one batch
+    std::vector<EntityManager::ComponentList> agents;
+    EntityManager& entityManager = *this->entityManager();
+    AgentFieldSystem* fieldSystem = m_impl->m_fieldSystem;
+    AgentGpuSystem* gpuSystem = m_impl->m_gpuSystem;
+    AgentLifetimeSystem* lifetimeSystem = m_impl->m_lifetimeSystem;
+    bool hasMesh = not m_impl->m_renderSystem;
+    RNG& rng = this->engine()->rng();
+    // Distant emitters emit fewer particles of higher potency
+    const SimulationLodSystem* lodSystem = m_impl->m_simulationLodSystem;
+    size_t emitted = 0;
     for (auto& value : m_impl->m_entities) {
         AgentEmitterComponent* emitterComponent = std::get<0>(value.second);
         OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(value.second);
-        TimedAgentEmitterComponent* timedEmitterComponent = std::get<2>(value.second);
-
-        for (auto emission : emitterComponent->m_compoundEmissions)
-        {
-            emitAgent(std::get<0>(emission), std::get<1>(emission), sceneNodeComponent->m_transform.position, emitterComponent);
+        auto& emissions = emitterComponent->m_compoundEmissions;
+        if (lodSystem and emissions.size() > 1 and lodSystem->aggregatesEmissions(value.first)) {
+            Implementation::aggregateEmissions(emissions);
+        }
+        m_impl->drawEmissions(rng, *emitterComponent, emissions.size());
+        for (size_t i = 0; i < emissions.size(); ++i) {
+            emitAgentParticle(std::get<0>(emissions[i]), std::get<1>(emissions[i]), sceneNodeComponent->m_transform.position, emitterComponent, Ogre::Degree(m_impl->m_angles[i]), m_impl->m_speeds[i], entityManager, fieldSystem, gpuSystem, lifetimeSystem, hasMesh, agents);
         }
+        emitted += emitterComponent->m_compoundEmissions.size();
         emitterComponent->m_compoundEmissions.clear();
-        if (timedEmitterComponent)
-        {
-            timedEmitterComponent->m_timeSinceLastEmission += milliseconds;
-            while (
-                timedEmitterComponent->m_emitInterval > 0 and
-                timedEmitterComponent->m_timeSinceLastEmission >= timedEmitterComponent->m_emitInterval
-            ) {
-                timedEmitterComponent->m_timeSinceLastEmission -= timedEmitterComponent->m_emitInterval;
-                for (unsigned int i = 0; i < timedEmitterComponent->m_particlesPerEmission; ++i) {
-                     emitAgent(timedEmitterComponent->m_agentId, timedEmitterComponent->m_potencyPerParticle, sceneNodeComponent->m_transform.position, emitterComponent);
-                }
-            }
+    }
+    // Timed emissions, only for the emitters that are due
+    m_impl->processChanges();
+    m_impl->m_timers.advance(milliseconds);
+    const auto& emitters = m_impl->m_entities.entities();
+    for (TimedAgentEmitterComponent* timedEmitterComponent : m_impl->m_dueEmitters) {
+        auto iter = emitters.find(timedEmitterComponent->owner());
+        if (iter == emitters.end()) {
+            continue;
+        }
+        AgentEmitterComponent* emitterComponent = std::get<0>(iter->second);
+        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(iter->second);
+        unsigned int particles = timedEmitterComponent->m_particlesPerEmission;
+        double potency = timedEmitterComponent->m_potencyPerParticle;
+        if (lodSystem and particles > 1 and lodSystem->aggregatesEmissions(iter->first)) {
+            potency *= particles;
+            particles = 1;
         }
+        m_impl->drawEmissions(rng, *emitterComponent, particles);
+        for (unsigned int i = 0; i < particles; ++i) {
+             emitAgentParticle(timedEmitterComponent->m_agentId, potency, sceneNodeComponent->m_transform.position, emitterComponent, Ogre::Degree(m_impl->m_angles[i]), m_impl->m_speeds[i], entityManager, fieldSystem, gpuSystem, lifetimeSystem, hasMesh, agents);
+        }
+        emitted += particles;
+    }
+    m_impl->m_dueEmitters.clear();
+    m_impl->m_emittedCounter->add(emitted);
+    if (not agents.empty()) {
+        entityManager.createEntities(std::move(agents));
     }
 }
 
@@ -551,29 +1114,131 @@ AgentAbsorberSystem::luaBindings() {
 
 struct AgentAbsorberSystem::Implementation {
 
+    // An agent particle, sorted into a grid cell
+    struct Particle {
+
+        uint64_t cell;
+
+        AgentComponent* agent;
+
+        Ogre::Vector3 position;
+
+        bool
+        operator< (
+            const Particle& other
+        ) const {
+            return cell < other.cell;
+        }
+
+    };
+
+    // Records whether the probe touches a body
+    struct ProbeResult : public btCollisionWorld::ContactResultCallback {
+
+        btScalar
+        addSingleResult(
+            btManifoldPoint&,
+            const btCollisionObjectWrapper*,
+            int,
+            int,
+            const btCollisionObjectWrapper*,
+            int,
+            int
+        ) override {
+            m_hasContact = true;
+            return 0;
+        }
+
+        bool m_hasContact = false;
+
+    };
+
     Implementation()
-      : m_agentCollisions("microbe", "agent")
+      : m_probeShape(0.01),
+        m_agentCollisions("microbe", "agent")
     {
+        m_probe.setCollisionShape(&m_probeShape);
+    }
+
+    static int32_t
+    cellIndex(
+        float coordinate
+    ) {
+        return static_cast<int32_t>(std::floor(coordinate / PARTICLE_CELL_SIZE));
     }
 
+    // Marks an absorbed particle as spent and has it despawned
+    void
+    expire(
+        AgentComponent& agent
+    ) {
+        m_absorbedCounter->add();
+        if (m_lifetimeSystem) {
+            m_lifetimeSystem->expireAgent(agent);
+        }
+        else {
+            agent.m_timeToLive = 0;
+        }
+    }
+
+    bool
+    touches(
+        btRigidBody* body,
+        const Ogre::Vector3& position
+    ) {
+        btTransform transform;
+        transform.setIdentity();
+        transform.setOrigin(btVector3(position.x, position.y, position.z));
+        m_probe.setWorldTransform(transform);
+        ProbeResult result;
+        m_world->contactPairTest(body, &m_probe, result);
+        return result.m_hasContact;
+    }
+
+    EventChannel<AgentAbsorbedEvent>* m_absorbedEvents = nullptr;
+
     EntityFilter<
-        AgentAbsorberComponent
-    > m_absorbers;
+        AgentAbsorberComponent,
+        RigidBodyComponent
+    > m_absorberBodies;
 
     EntityFilter<
-        AgentComponent
-    > m_agents;
+        AgentComponent,
+        OgreSceneNodeComponent,
+        Optional<RigidBodyComponent>
+    > m_particleAgents;
+
+    // Particles sorted by cell, reused between updates
+    std::vector<Particle> m_particles;
+
+    // Stands in for a particle in contact tests
+    btCollisionObject m_probe;
+
+    btSphereShape m_probeShape;
+
+    // Both collections are sparse sets, so collision partners are looked
+    // up without hashing
+    ComponentCollection* m_absorberComponents = nullptr;
+
+    ComponentCollection* m_agentComponents = nullptr;
 
     btDiscreteDynamicsWorld* m_world = nullptr;
 
+    Statistics::Counter* m_absorbedCounter = nullptr;
+
     CollisionFilter m_agentCollisions;
 
+    AgentFieldSystem* m_fieldSystem = nullptr;
+
+    AgentLifetimeSystem* m_lifetimeSystem = nullptr;
+
 };
 
 
 AgentAbsorberSystem::AgentAbsorberSystem()
   : m_impl(new Implementation())
 {
+    this->setFixedRate(true);
 }
 
 
@@ -585,64 +1250,523 @@ AgentAbsorberSystem::init(
     GameState* gameState
 ) {
     System::init(gameState);
-    m_impl->m_absorbers.setEntityManager(&gameState->entityManager());
-    m_impl->m_agents.setEntityManager(&gameState->entityManager());
+    m_impl->m_absorbedEvents = &AgentAbsorbedEvent::channel(gameState);
+    m_impl->m_absorberBodies.setEntityManager(&gameState->entityManager());
+    m_impl->m_absorberComponents = &gameState->entityManager().getComponentCollection(
+        AgentAbsorberComponent::TYPE_ID
+    );
+    m_impl->m_agentComponents = &gameState->entityManager().getComponentCollection(
+        AgentComponent::TYPE_ID
+    );
+    m_impl->m_particleAgents.setEntityManager(&gameState->entityManager());
     m_impl->m_world = gameState->physicsWorld();
     m_impl->m_agentCollisions.init(gameState);
+    m_impl->m_fieldSystem = gameState->findSystem<AgentFieldSystem>();
+    m_impl->m_lifetimeSystem = gameState->findSystem<AgentLifetimeSystem>();
+    m_impl->m_absorbedCounter = &gameState->engine().statistics().counter("agents.absorbed");
 }
 
 
 void
 AgentAbsorberSystem::shutdown() {
-    m_impl->m_absorbers.setEntityManager(nullptr);
-    m_impl->m_agents.setEntityManager(nullptr);
+    m_impl->m_absorbedEvents = nullptr;
+    m_impl->m_absorberBodies.setEntityManager(nullptr);
+    m_impl->m_absorberComponents = nullptr;
+    m_impl->m_agentComponents = nullptr;
+    m_impl->m_absorbedCounter = nullptr;
+    m_impl->m_particleAgents.setEntityManager(nullptr);
     m_impl->m_world = nullptr;
     m_impl->m_agentCollisions.shutdown();
+    m_impl->m_fieldSystem = nullptr;
+    m_impl->m_lifetimeSystem = nullptr;
     System::shutdown();
 }
 
 
 void
 AgentAbsorberSystem::update(int) {
-    for (const auto& entry : m_impl->m_absorbers) {
-        AgentAbsorberComponent* absorber = std::get<0>(entry.second);
-        absorber->m_absorbedAgents.clear();
+    EventChannel<AgentAbsorbedEvent>& absorbedEvents = *m_impl->m_absorbedEvents;
+    // Agent particles, tested in batch against the absorbers' shapes
+    auto& particles = m_impl->m_particles;
+    particles.clear();
+    for (const auto& entry : m_impl->m_particleAgents) {
+        AgentComponent* agent = std::get<0>(entry.second);
+        OgreSceneNodeComponent* sceneNode = std::get<1>(entry.second);
+        if (std::get<2>(entry.second) or agent->m_timeToLive <= 0) {
+            // Agents with a rigid body are reported as collisions below
+            continue;
+        }
+        const Ogre::Vector3& position = sceneNode->m_transform.position;
+        particles.push_back({
+            cellKey(
+                Implementation::cellIndex(position.x),
+                Implementation::cellIndex(position.y)
+            ),
+            agent,
+            position
+        });
+    }
+    std::sort(particles.begin(), particles.end());
+    for (const auto& entry : m_impl->m_absorberBodies) {
+        if (particles.empty()) {
+            break;
+        }
+        btRigidBody* body = std::get<1>(entry.second)->m_body;
+        if (not body) {
+            continue;
+        }
+        btVector3 aabbMin;
+        btVector3 aabbMax;
+        body->getAabb(aabbMin, aabbMax);
+        int32_t maxX = Implementation::cellIndex(aabbMax.x());
+        int32_t maxY = Implementation::cellIndex(aabbMax.y());
+        for (int32_t x = Implementation::cellIndex(aabbMin.x()); x <= maxX; ++x) {
+            for (int32_t y = Implementation::cellIndex(aabbMin.y()); y <= maxY; ++y) {
+                Implementation::Particle key;
+                key.cell = cellKey(x, y);
+                auto range = std::equal_range(particles.begin(), particles.end(), key);
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    AgentComponent* agent = iter->agent;
+                    const Ogre::Vector3& position = iter->position;
+                    if (
+                        agent->m_timeToLive <= 0 or
+                        position.x < aabbMin.x() or position.x > aabbMax.x() or
+                        position.y < aabbMin.y() or position.y > aabbMax.y() or
+                        position.z < aabbMin.z() or position.z > aabbMax.z() or
+                        not m_impl->touches(body, position)
+                    ) {
+                        continue;
+                    }
+                    absorbedEvents.publish({entry.first, agent->m_agentId, agent->m_potency});
+                    m_impl->expire(*agent);
+                }
+            }
+        }
     }
     for (Collision collision : m_impl->m_agentCollisions)
     {
         EntityId entityA = collision.entityId1;
         EntityId entityB = collision.entityId2;
 
-        AgentAbsorberComponent* absorber = nullptr;
-        AgentComponent* agent = nullptr;
-        if (
-            m_impl->m_agents.containsEntity(entityA) and
-            m_impl->m_absorbers.containsEntity(entityB)
-        ) {
-            agent = std::get<0>(
-                m_impl->m_agents.entities().at(entityA)
-            );
-            absorber = std::get<0>(
-                m_impl->m_absorbers.entities().at(entityB)
+        Component* agent = m_impl->m_agentComponents->get(entityA);
+        EntityId absorberId = entityB;
+        if (not agent) {
+            agent = m_impl->m_agentComponents->get(entityB);
+            absorberId = entityA;
+        }
+        if (not agent or not m_impl->m_absorberComponents->get(absorberId)) {
+            continue;
+        }
+        auto agentComponent = static_cast<AgentComponent*>(agent);
+        if (agentComponent->m_timeToLive > 0) {
+            absorbedEvents.publish({
+                absorberId,
+                agentComponent->m_agentId,
+                agentComponent->m_potency
+            });
+            m_impl->expire(*agentComponent);
+        }
+    }
+    m_impl->m_agentCollisions.clearCollisions();
+    // Field agents, taken from under the absorbers' bounding boxes
+    AgentFieldSystem* fieldSystem = m_impl->m_fieldSystem;
+    if (not fieldSystem) {
+        return;
+    }
+    for (const auto& entry : m_impl->m_absorberBodies) {
+        AgentAbsorberComponent* absorber = std::get<0>(entry.second);
+        btRigidBody* body = std::get<1>(entry.second)->m_body;
+        if (not body) {
+            continue;
+        }
+        btVector3 aabbMin;
+        btVector3 aabbMax;
+        body->getAabb(aabbMin, aabbMax);
+        for (AgentId agentId : absorber->m_canAbsorbAgent) {
+            if (not fieldSystem->hasAgent(agentId)) {
+                continue;
+            }
+            Ogre::Real amount = fieldSystem->take(
+                agentId,
+                Ogre::Vector3(aabbMin.x(), aabbMin.y(), aabbMin.z()),
+                Ogre::Vector3(aabbMax.x(), aabbMax.y(), aabbMax.z())
             );
+            if (amount > 0.0f) {
+                absorbedEvents.publish({entry.first, agentId, amount});
+            }
         }
-        else if (
-            m_impl->m_absorbers.containsEntity(entityA) and
-            m_impl->m_agents.containsEntity(entityB)
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// AgentCoalescingSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+AgentCoalescingSystem::luaBindings() {
+    using namespace luabind;
+    return class_<AgentCoalescingSystem, System>("AgentCoalescingSystem")
+        .def(constructor<>())
+        .def(constructor<Ogre::Real>())
+        .def(constructor<Ogre::Real, float>())
+        .def(constructor<Ogre::Real, float, Milliseconds>())
+    ;
+}
+
+
+struct AgentCoalescingSystem::Implementation {
+
+    // An agent particle, sorted by agent and grid cell
+    struct Particle {
+
+        AgentId agentId;
+
+        uint64_t cell;
+
+        AgentComponent* agent;
+
+        OgreSceneNodeComponent* sceneNode;
+
+        bool
+        operator< (
+            const Particle& other
+        ) const {
+            return std::tie(agentId, cell) < std::tie(other.agentId, other.cell);
+        }
+
+    };
+
+    Implementation(
+        Ogre::Real radius,
+        float maxPotency,
+        Milliseconds interval
+    ) : m_interval(interval),
+        m_maxPotency(maxPotency),
+        m_radius(radius)
+    {
+    }
+
+    // The cells are as large as the merge radius, so merge partners are
+    // at most one cell apart
+    int32_t
+    cellIndex(
+        float coordinate
+    ) const {
+        return static_cast<int32_t>(std::floor(coordinate / m_radius));
+    }
+
+    bool
+    canMerge(
+        const Particle& into,
+        const Particle& from
+    ) const {
+        if (from.agent == into.agent or from.agent->m_timeToLive <= 0) {
+            return false;
+        }
+        if (
+            m_maxPotency > 0.0f and
+            into.agent->m_potency + from.agent->m_potency > m_maxPotency
         ) {
-            absorber = std::get<0>(
-                m_impl->m_absorbers.entities().at(entityA)
-            );
-            agent = std::get<0>(
-                m_impl->m_agents.entities().at(entityB)
+            return false;
+        }
+        const Ogre::Vector3& position = into.sceneNode->m_transform.position;
+        return position.squaredDistance(from.sceneNode->m_transform.position) <= m_radius * m_radius;
+    }
+
+    // Moves the potency of one particle into another and despawns it
+    void
+    merge(
+        Particle& into,
+        Particle& from,
+        EntityManager& entityManager
+    ) {
+        AgentComponent* agent = into.agent;
+        AgentComponent* other = from.agent;
+        float potency = agent->m_potency + other->m_potency;
+        auto& transform = into.sceneNode->m_transform;
+        if (potency > 0.0f) {
+            float weight = other->m_potency / potency;
+            agent->m_velocity += (other->m_velocity - agent->m_velocity) * weight;
+            transform.position += (from.sceneNode->m_transform.position - transform.position) * weight;
+            if (into.sceneNode->m_entity and agent->m_potency > 0.0f) {
+                transform.scale *= std::cbrt(potency / agent->m_potency);
+            }
+            transform.touch();
+            // Don't blend from where the particle was before the merge
+            into.sceneNode->m_isInterpolated = false;
+        }
+        agent->m_potency = potency;
+        if (m_lifetimeSystem) {
+            m_lifetimeSystem->expireAgent(*other);
+        }
+        else {
+            other->m_timeToLive = 0;
+            entityManager.removeEntity(other->owner());
+        }
+    }
+
+    Statistics::Counter* m_coalescedCounter = nullptr;
+
+    Milliseconds m_interval;
+
+    AgentLifetimeSystem* m_lifetimeSystem = nullptr;
+
+    float m_maxPotency;
+
+    EntityFilter<
+        AgentComponent,
+        OgreSceneNodeComponent,
+        Optional<RigidBodyComponent>
+    > m_particleAgents;
+
+    Statistics::Gauge* m_particleGauge = nullptr;
+
+    // Particles sorted by agent and cell, reused between updates
+    std::vector<Particle> m_particles;
+
+    Ogre::Real m_radius;
+
+    Milliseconds m_timeSinceLastPass = 0;
+
+};
+
+
+AgentCoalescingSystem::AgentCoalescingSystem(
+    Ogre::Real radius,
+    float maxPotency,
+    Milliseconds interval
+) : m_impl(new Implementation(radius, maxPotency, interval))
+{
+    if (not (radius > 0.0f)) {
+        throw std::invalid_argument("Agent merge radius must be positive");
+    }
+    this->declareWrite(AgentComponent::TYPE_ID);
+    this->declareWrite(OgreSceneNodeComponent::TYPE_ID);
+    this->setFixedRate(true);
+}
+
+
+AgentCoalescingSystem::~AgentCoalescingSystem() {}
+
+
+void
+AgentCoalescingSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_particleAgents.setEntityManager(&gameState->entityManager());
+    m_impl->m_lifetimeSystem = gameState->findSystem<AgentLifetimeSystem>();
+    m_impl->m_coalescedCounter = &gameState->engine().statistics().counter("agents.coalesced");
+    m_impl->m_particleGauge = &gameState->engine().statistics().gauge("agents.particles");
+}
+
+
+void
+AgentCoalescingSystem::shutdown() {
+    m_impl->m_particleAgents.setEntityManager(nullptr);
+    m_impl->m_lifetimeSystem = nullptr;
+    m_impl->m_coalescedCounter = nullptr;
+    m_impl->m_particleGauge = nullptr;
+    m_impl->m_particles.clear();
+    m_impl->m_timeSinceLastPass = 0;
+    System::shutdown();
+}
+
+
+void
+AgentCoalescingSystem::update(int milliseconds) {
+    m_impl->m_timeSinceLastPass += milliseconds;
+    if (m_impl->m_timeSinceLastPass < m_impl->m_interval) {
+        return;
+    }
+    m_impl->m_timeSinceLastPass = 0;
+    auto& particles = m_impl->m_particles;
+    particles.clear();
+    for (const auto& entry : m_impl->m_particleAgents) {
+        AgentComponent* agent = std::get<0>(entry.second);
+        if (std::get<2>(entry.second) or agent->m_timeToLive <= 0) {
+            continue;
+        }
+        OgreSceneNodeComponent* sceneNode = std::get<1>(entry.second);
+        const Ogre::Vector3& position = sceneNode->m_transform.position;
+        particles.push_back({
+            agent->m_agentId,
+            cellKey(
+                m_impl->cellIndex(position.x),
+                m_impl->cellIndex(position.y)
+            ),
+            agent,
+            sceneNode
+        });
+    }
+    std::sort(particles.begin(), particles.end());
+    EntityManager& entityManager = *this->entityManager();
+    size_t merged = 0;
+    for (Implementation::Particle& particle : particles) {
+        if (particle.agent->m_timeToLive <= 0) {
+            // Already merged into another particle
+            continue;
+        }
+        const Ogre::Vector3& position = particle.sceneNode->m_transform.position;
+        int32_t cellX = m_impl->cellIndex(position.x);
+        int32_t cellY = m_impl->cellIndex(position.y);
+        for (int32_t x = cellX - 1; x <= cellX + 1; ++x) {
+            for (int32_t y = cellY - 1; y <= cellY + 1; ++y) {
+                Implementation::Particle key;
+                key.agentId = particle.agentId;
+                key.cell = cellKey(x, y);
+                auto range = std::equal_range(particles.begin(), particles.end(), key);
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (m_impl->canMerge(particle, *iter)) {
+                        m_impl->merge(particle, *iter, entityManager);
+                        merged += 1;
+                    }
+                }
+            }
+        }
+    }
+    m_impl->m_coalescedCounter->add(merged);
+    m_impl->m_particleGauge->set(particles.size() - merged);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// AgentRenderSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+AgentRenderSystem::luaBindings() {
+    using namespace luabind;
+    return class_<AgentRenderSystem, System>("AgentRenderSystem")
+        .def(constructor<>())
+        .def(constructor<Ogre::Real>())
+    ;
+}
+
+
+struct AgentRenderSystem::Implementation {
+
+    Implementation(
+        Ogre::Real particleSize
+    ) : m_particleSize(particleSize)
+    {
+    }
+
+    Ogre::BillboardSet*
+    billboardSet(
+        AgentId agentId
+    ) {
+        auto iter = m_billboardSets.find(agentId);
+        if (iter != m_billboardSets.end()) {
+            return iter->second;
+        }
+        Ogre::BillboardSet* billboardSet = m_sceneManager->createBillboardSet();
+        billboardSet->setBillboardsInWorldSpace(true);
+        billboardSet->setDefaultDimensions(m_particleSize, m_particleSize);
+        const AgentRegistry::AgentType& agentType = AgentRegistry::getAgentType(agentId);
+        if (agentType.mesh.isNull()) {
+            Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load(
+                agentType.meshName,
+                Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME
             );
+            if (mesh->getNumSubMeshes() > 0) {
+                billboardSet->setMaterialName(mesh->getSubMesh(0)->getMaterialName());
+            }
         }
-        if (agent and absorber and agent->m_timeToLive > 0) {
-            absorber->m_absorbedAgents[agent->m_agentId] += agent->m_potency;
-            agent->m_timeToLive = 0;
+        else if (not agentType.materialName.empty()) {
+            billboardSet->setMaterialName(agentType.materialName);
         }
+        m_sceneManager->getRootSceneNode()->attachObject(billboardSet);
+        m_billboardSets.emplace(agentId, billboardSet);
+        return billboardSet;
+    }
+
+    std::unordered_map<AgentId, Ogre::BillboardSet*> m_billboardSets;
+
+    Ogre::Real m_particleSize;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+};
+
+
+AgentRenderSystem::AgentRenderSystem(
+    Ogre::Real particleSize
+) : m_impl(new Implementation(particleSize))
+{
+    if (not (particleSize > 0.0f)) {
+        throw std::invalid_argument("Agent particle size must be positive");
+    }
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareRead(AgentComponent::TYPE_ID);
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+AgentRenderSystem::~AgentRenderSystem() {}
+
+
+void
+AgentRenderSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    assert(m_impl->m_sceneManager == nullptr && "Double init of system");
+    m_impl->m_sceneManager = gameState->sceneManager();
+}
+
+
+void
+AgentRenderSystem::shutdown() {
+    for (const auto& pair : m_impl->m_billboardSets) {
+        m_impl->m_sceneManager->destroyBillboardSet(pair.second);
+    }
+    m_impl->m_billboardSets.clear();
+    m_impl->m_sceneManager = nullptr;
+    System::shutdown();
+}
+
+
+void
+AgentRenderSystem::update(int) {
+    for (const auto& pair : m_impl->m_billboardSets) {
+        pair.second->clear();
+    }
+    float interpolation = this->gameState()->tickInterpolation();
+    // Like AgentMovementSystem, walk the archetype columns instead of
+    // keeping an entity filter
+    for (const auto& archetype : this->entityManager()->archetypes()) {
+        if (archetype->size() == 0) {
+            continue;
+        }
+        const auto* agents = archetype->componentColumn(AgentComponent::TYPE_ID);
+        const auto* sceneNodes = archetype->componentColumn(OgreSceneNodeComponent::TYPE_ID);
+        if (not agents or not sceneNodes) {
+            continue;
+        }
+        for (size_t i = 0; i < agents->size(); ++i) {
+            auto agentComponent = static_cast<AgentComponent*>((*agents)[i]);
+            auto sceneNodeComponent = static_cast<OgreSceneNodeComponent*>((*sceneNodes)[i]);
+            // Particles with a mesh are drawn by their scene node
+            if (sceneNodeComponent->m_entity or not sceneNodeComponent->m_visible) {
+                continue;
+            }
+            const Ogre::Vector3& position = sceneNodeComponent->m_transform.position;
+            Ogre::BillboardSet* billboardSet = m_impl->billboardSet(agentComponent->m_agentId);
+            if (sceneNodeComponent->m_isInterpolated) {
+                const Ogre::Vector3& previous = sceneNodeComponent->m_previousPosition;
+                billboardSet->createBillboard(previous + (position - previous) * interpolation);
+            }
+            else {
+                billboardSet->createBillboard(position);
+            }
+        }
+    }
+    for (const auto& pair : m_impl->m_billboardSets) {
+        pair.second->_updateBounds();
     }
-    m_impl->m_agentCollisions.clearCollisions();
 }
 
 
@@ -666,19 +1790,11 @@ AgentRegistry::luaBindings() {
 }
 
 
-namespace {
-    struct AgentRegistryEntry
-    {
-        std::string internalName;
-        std::string displayName;
-        std::string meshName;
-    };
-}
-
 //Hidden methods for acquiring global variable
-static std::vector<AgentRegistryEntry>&
+// A deque, so references to the entries stay valid
+static std::deque<AgentRegistry::AgentType>&
 agentRegistry() {
-    static std::vector<AgentRegistryEntry> agentRegistry;
+    static std::deque<AgentRegistry::AgentType> agentRegistry;
     return agentRegistry;
 }
 static std::unordered_map<std::string, AgentId>&
@@ -695,7 +1811,7 @@ AgentRegistry::registerAgentType(
 ) {
     if (agentRegistryMap().count(internalName) == 0)
     {
-        AgentRegistryEntry entry;
+        AgentType entry;
         entry.internalName = internalName;
         entry.displayName = displayName;
         entry.meshName = meshName;
@@ -709,22 +1825,23 @@ AgentRegistry::registerAgentType(
     }
 }
 
+size_t
+AgentRegistry::getAgentCount() {
+    return agentRegistry().size();
+}
+
 std::string
 AgentRegistry::getAgentDisplayName(
     AgentId id
 ) {
-    if (static_cast<std::size_t>(id) > agentRegistry().size())
-        throw std::out_of_range("Index of agent does not exist.");
-    return agentRegistry()[id-1].displayName;
+    return getAgentType(id).displayName;
 }
 
 std::string
 AgentRegistry::getAgentInternalName(
     AgentId id
 ) {
-    if (static_cast<std::size_t>(id) > agentRegistry().size())
-        throw std::out_of_range("Index of agent does not exist.");
-    return agentRegistry()[id-1].internalName;
+    return getAgentType(id).internalName;
 }
 
 AgentId
@@ -747,7 +1864,30 @@ std::string
 AgentRegistry::getAgentMeshName(
     AgentId id
 ) {
-    if (static_cast<std::size_t>(id) > agentRegistry().size())
+    return getAgentType(id).meshName;
+}
+
+const AgentRegistry::AgentType&
+AgentRegistry::getAgentType(
+    AgentId id
+) {
+    if (id == NULL_AGENT or static_cast<std::size_t>(id) > agentRegistry().size())
         throw std::out_of_range("Index of agent does not exist.");
-    return agentRegistry()[id-1].meshName;
+    return agentRegistry()[id-1];
+}
+
+void
+AgentRegistry::resolveResources() {
+    for (AgentType& agentType : agentRegistry()) {
+        if (not agentType.mesh.isNull() or agentType.meshName.empty()) {
+            continue;
+        }
+        agentType.mesh = Ogre::MeshManager::getSingleton().load(
+            agentType.meshName,
+            Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME
+        );
+        if (agentType.mesh->getNumSubMeshes() > 0) {
+            agentType.materialName = agentType.mesh->getSubMesh(0)->getMaterialName();
+        }
+    }
 }
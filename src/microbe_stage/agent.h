@@ -1,15 +1,20 @@
 #pragma once
 
 #include "engine/component.h"
+#include "engine/event_bus.h"
 #include "engine/system.h"
+#include "engine/timer_wheel.h"
 #include "engine/touchable.h"
 #include "scripting/luabind.h"
+#include "util/dense_id_map.h"
 
 #include <memory>
 #include <OgreCommon.h>
 #include <OgreMath.h>
+#include <OgreMesh.h>
+#include <OgreQuaternion.h>
 #include <OgreVector3.h>
-#include <unordered_set>
+#include <vector>
 
 namespace luabind {
 class scope;
@@ -18,6 +23,8 @@ class scope;
 
 namespace thrive {
 
+class GameState;
+
 using AgentId = uint16_t;
 
 static const AgentId NULL_AGENT = 0;
@@ -43,6 +50,8 @@ public:
     * - AgentComponent::m_potency
     * - AgentComponent::m_timeToLive
     * - AgentComponent::m_velocity
+    * - velocityData(): light userdata pointing at the velocity's three
+    *   floats, for the LuaJIT FFI
     *
     * @return
     */
@@ -61,6 +70,10 @@ public:
 
     /**
     * @brief The time until this particle despawns
+    *
+    * Only read when the particle is added to an entity. From then on,
+    * AgentLifetimeSystem keeps track of the time left with a timer, see
+    * timeToLive(). Zero or less means the particle is spent.
     */
     Milliseconds m_timeToLive = 0;
 
@@ -69,6 +82,27 @@ public:
     */
     Ogre::Vector3 m_velocity = Ogre::Vector3::ZERO;
 
+    /**
+    * @brief The expiry timer, for use by AgentLifetimeSystem
+    */
+    TimerId m_lifetimeTimer = NULL_TIMER;
+
+    /**
+    * @brief The wheel of m_lifetimeTimer, for use by AgentLifetimeSystem
+    */
+    const TimerWheel* m_lifetimeTimers = nullptr;
+
+    /**
+    * @brief Adds the agent, potency, velocity and remaining lifetime to a
+    * state digest
+    *
+    * @param digest
+    */
+    void
+    digest(
+        StateDigest& digest
+    ) const override;
+
     void
     load(
         const StorageContainer& storage
@@ -77,6 +111,12 @@ public:
     StorageContainer
     storage() const override;
 
+    /**
+    * @brief The time until this particle despawns
+    */
+    Milliseconds
+    timeToLive() const;
+
 };
 
 
@@ -93,6 +133,7 @@ public:
     *
     * Exposes:
     * - AgentEmitterComponent()
+    * - AgentEmitterComponent::ejectAgent
     * - AgentEmitterComponent::m_emissionRadius
     * - AgentEmitterComponent::m_maxInitialSpeed
     * - AgentEmitterComponent::m_minInitialSpeed
@@ -159,6 +200,27 @@ public:
         double amount
     );
 
+    /**
+    * @brief Emits an agent out of the back of an entity
+    *
+    * Sets the emission angles to a cone of 60 degrees opposite to the
+    * orientation's y axis, then emits the amount split into up to three
+    * particles.
+    *
+    * @param agentId
+    *   The agent type to emit
+    * @param amount
+    *   How much of the agent to emit
+    * @param orientation
+    *   The emitting entity's orientation
+    */
+    void
+    ejectAgent(
+        AgentId agentId,
+        double amount,
+        const Ogre::Quaternion& orientation
+    );
+
     void
     load(
         const StorageContainer& storage
@@ -191,7 +253,7 @@ public:
     * - AgentEmitterComponent::m_agentId
     * - AgentEmitterComponent::m_particlesPerEmission
     * - AgentEmitterComponent::m_potencyPerParticle
-    * - AgentEmitterComponent::m_emitInterval
+    * - AgentEmitterComponent::emitInterval (as property, see setEmitInterval())
     *
     * @return
     */
@@ -215,11 +277,32 @@ public:
 
     /**
     * @brief How often new particles are spawned
+    *
+    * Once the component is added to an entity, change it with 
+    * setEmitInterval(), which reschedules the emissions.
     */
     Milliseconds m_emitInterval = 1000;
 
     /**
-    * @brief For use by TimedAgentEmitterSystem
+    * @brief The emission timer, for use by AgentEmitterSystem
+    */
+    TimerId m_emissionTimer = NULL_TIMER;
+
+    /**
+    * @brief The callback of m_emissionTimer, for use by AgentEmitterSystem
+    */
+    TimerWheel::Callback m_emissionCallback;
+
+    /**
+    * @brief The wheel of m_emissionTimer, for use by AgentEmitterSystem
+    */
+    TimerWheel* m_emissionTimers = nullptr;
+
+    /**
+    * @brief Time since the last emission when the component was added
+    *
+    * From then on, AgentEmitterSystem schedules the emissions with a
+    * timer, see timeSinceLastEmission().
     */
     Milliseconds m_timeSinceLastEmission = 0;
 
@@ -228,27 +311,53 @@ public:
         const StorageContainer& storage
     ) override;
 
+    /**
+    * @brief Sets m_emitInterval
+    *
+    * If the component is added to an entity, the next emission is 
+    * scheduled \a interval after the last one. A non-positive interval 
+    * stops the emissions.
+    *
+    * @param interval
+    */
+    void
+    setEmitInterval(
+        Milliseconds interval
+    );
+
     StorageContainer
     storage() const override;
 
+    /**
+    * @brief Time since the last emission
+    */
+    Milliseconds
+    timeSinceLastEmission() const;
+
 };
 
 
 /**
-* @brief Absorbs agent particles
+* @brief Published by the AgentAbsorberSystem for each absorbed agent
+*
+* An absorber that takes up several particles of the same agent in one
+* update publishes one event per particle.
 */
-class AgentAbsorberComponent : public Component {
-    COMPONENT(AgentAbsorber)
-
-public:
+struct AgentAbsorbedEvent {
 
     /**
     * @brief Lua bindings
     *
     * Exposes:
-    * - AgentAbsorberComponent::absorbedAgentAmount
-    * - AgentAbsorberComponent::canAbsorbAgent
-    * - AgentAbsorberComponent::setCanAbsorbAgent
+    * - AgentAbsorbedEvent::absorber (read-only)
+    * - AgentAbsorbedEvent::agentId (read-only)
+    * - AgentAbsorbedEvent::amount (read-only)
+    * - AgentAbsorbedEvent::channel (static, with a GameState)
+    *
+    * Scripts read the events in batch:
+    * \code
+    * local events = AgentAbsorbedEvent.channel(gameState):read(self.cursor)
+    * \endcode
     *
     * @return
     */
@@ -256,27 +365,59 @@ public:
     luaBindings();
 
     /**
-    * @brief The agents absorbed in the last time step
+    * @brief The game state's channel for these events
+    *
+    * @param gameState
+    */
+    static EventChannel<AgentAbsorbedEvent>&
+    channel(
+        GameState* gameState
+    );
+
+    /**
+    * @brief The entity of the AgentAbsorberComponent
     */
-    std::unordered_map<AgentId, float> m_absorbedAgents;
+    EntityId absorber;
 
     /**
-    * @brief Whether a particular agent id can be absorbed
+    * @brief The absorbed agent
     */
-    std::unordered_set<AgentId> m_canAbsorbAgent;
+    AgentId agentId;
 
     /**
-    * @brief The absorbed amount in the last time step
+    * @brief The absorbed amount
+    */
+    float amount;
+
+};
+
+
+/**
+* @brief Absorbs agent particles
+*
+* The absorbed agents are published as AgentAbsorbedEvent.
+*/
+class AgentAbsorberComponent : public Component {
+    COMPONENT(AgentAbsorber)
+
+public:
+
+    /**
+    * @brief Lua bindings
     *
-    * @param id
-    *   The agent id to get the amount for
+    * Exposes:
+    * - AgentAbsorberComponent::canAbsorbAgent
+    * - AgentAbsorberComponent::setCanAbsorbAgent
     *
     * @return
     */
-    float
-    absorbedAgentAmount(
-        AgentId id
-    ) const;
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Whether a particular agent id can be absorbed
+    */
+    DenseIdSet<AgentId> m_canAbsorbAgent;
 
     /**
     * @brief Whether an agent can be absorbed
@@ -296,23 +437,6 @@ public:
         const StorageContainer& storage
     ) override;
 
-    /**
-    * @brief Sets the amount of absorbed agents
-    *
-    * Use this for e.g. resetting the absorbed amount down
-    * to zero.
-    *
-    * @param id
-    *   The agent id to change the amount for
-    * @param amount
-    *   The new amount
-    */
-    void
-    setAbsorbedAgentAmount(
-        AgentId id,
-        float amount
-    );
-
     /**
     * @brief Sets whether an agent can be absorbed
     *
@@ -335,6 +459,17 @@ public:
 
 /**
 * @brief Despawns agent particles after they've reached their lifetime
+*
+* Instead of being destroyed, expired particles can be kept in a pool per
+* agent id. A pooled particle loses its AgentComponent and its scene node
+* is hidden, but the entity, the scene node and its Ogre entity stay
+* around. AgentEmitterSystem reuses pooled particles before creating new
+* ones. Pooled particles are volatile, so they aren't saved.
+*
+* Pooling is off by default, see setDefaultPoolSize() and setPoolSize().
+*
+* Each particle's expiry is a timer, so an update only deals with the
+* particles that are actually due.
 */
 class AgentLifetimeSystem : public System {
 
@@ -345,6 +480,8 @@ public:
     *
     * Exposes:
     * - AgentLifetimeSystem()
+    * - AgentLifetimeSystem::setDefaultPoolSize
+    * - AgentLifetimeSystem::setPoolSize
     *
     * @return
     */
@@ -361,17 +498,75 @@ public:
     */
     ~AgentLifetimeSystem();
 
+    /**
+    * @brief Despawns a particle on the next update
+    *
+    * For particles that have been absorbed before their lifetime is up.
+    *
+    * @param agent
+    *   The particle's component, which must be part of an entity
+    */
+    void
+    expireAgent(
+        AgentComponent& agent
+    );
+
     /**
     * @brief Initializes the system
     *
     */
     void init(GameState* gameState) override;
 
+    /**
+    * @brief Sets the pool size for agents without their own pool size
+    *
+    * @param size
+    *   The maximum number of expired particles kept per agent id. 0
+    *   disables pooling.
+    */
+    void
+    setDefaultPoolSize(
+        unsigned int size
+    );
+
+    /**
+    * @brief Sets the pool size for one agent
+    *
+    * @param agentId
+    *   The agent whose pool to configure
+    * @param size
+    *   The maximum number of expired particles of this agent to keep. 0
+    *   disables pooling for this agent.
+    */
+    void
+    setPoolSize(
+        AgentId agentId,
+        unsigned int size
+    );
+
     /**
     * @brief Shuts the system down
     */
     void shutdown() override;
 
+    /**
+    * @brief Takes an expired particle out of the pool
+    *
+    * The particle still has its hidden OgreSceneNodeComponent. The caller
+    * is responsible for showing it again and for adding a new
+    * AgentComponent.
+    *
+    * @param agentId
+    *   The agent of the particle
+    *
+    * @return
+    *   The particle's entity or NULL_ENTITY if the pool is empty
+    */
+    EntityId
+    takePooledAgent(
+        AgentId agentId
+    );
+
     /**
     * @brief Updates the system
     */
@@ -437,6 +632,14 @@ private:
 
 /**
 * @brief Spawns agent particles for AgentEmitterComponent
+*
+* Particles only get a mesh if the game state has no AgentRenderSystem.
+* Emissions of agents simulated by an AgentFieldSystem are deposited into
+* their field instead, and those of agents simulated by an AgentGpuSystem
+* become GPU particles.
+*
+* The emissions of TimedAgentEmitterComponent are scheduled as periodic
+* timers, so emitters that aren't due cost nothing per update.
 */
 class AgentEmitterSystem : public System {
 
@@ -489,6 +692,14 @@ private:
 
 /**
 * @brief Despawns agents for AgentAbsorberComponent
+*
+* Agent particles are points without a rigid body. Each update sorts them
+* into a grid and tests the ones inside an absorber's bounding box against
+* its collision shape. Agents with a rigid body, e.g. from older savegames,
+* are still detected through a CollisionFilter.
+*
+* With an AgentFieldSystem, absorbers also take the field agents they can
+* absorb from under their bounding box.
 */
 class AgentAbsorberSystem : public System {
 
@@ -539,6 +750,150 @@ private:
 };
 
 
+/**
+* @brief Merges nearby agent particles of the same agent
+*
+* Every few updates, particles with the same agent id that are closer
+* than the merge radius are combined into one particle. It carries the
+* summed potency and moves with the potency weighted average velocity.
+* This keeps the number of particles bounded when many emitters fire in
+* the same place.
+*
+* A merge that would exceed the maximum potency is skipped. Particles
+* with their own mesh are scaled up to keep their volume plausible.
+* Particles with a rigid body, e.g. from older savegames, are left alone.
+*/
+class AgentCoalescingSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - AgentCoalescingSystem()
+    * - AgentCoalescingSystem(radius)
+    * - AgentCoalescingSystem(radius, maxPotency)
+    * - AgentCoalescingSystem(radius, maxPotency, interval)
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param radius
+    *   Particles closer than this are merged
+    * @param maxPotency
+    *   The highest potency a merged particle may have. Zero or less
+    *   means no limit.
+    * @param interval
+    *   Milliseconds between two merge passes
+    */
+    AgentCoalescingSystem(
+        Ogre::Real radius = 1.0f,
+        float maxPotency = 0.0f,
+        Milliseconds interval = 250
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~AgentCoalescingSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Merges particles if a pass is due
+    */
+    void update(int) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+
+/**
+* @brief Draws agent particles as billboards
+*
+* All particles of one agent id are drawn by a single Ogre::BillboardSet,
+* which costs one draw call per agent id instead of one per particle. The
+* billboards use the material of the agent's mesh (see
+* AgentRegistry::getAgentMeshName()).
+*
+* If a game state has this system, AgentEmitterSystem creates particles
+* without a mesh. Particles that still have their own Ogre entity, e.g.
+* from older savegames, are left to OgreUpdateSceneNodeSystem.
+*/
+class AgentRenderSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - AgentRenderSystem()
+    * - AgentRenderSystem(particleSize)
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param particleSize
+    *   The width and height of a particle's billboard
+    */
+    AgentRenderSystem(
+        Ogre::Real particleSize = 0.3f
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~AgentRenderSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Refills the billboard sets
+    */
+    void update(int) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+
 /**
 * @brief Static class keeping track of agents, their Id's, internal and displayed names
 */
@@ -560,6 +915,33 @@ public:
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief A registered agent and its resources
+    */
+    struct AgentType {
+
+        std::string internalName;
+
+        std::string displayName;
+
+        std::string meshName;
+
+        /**
+        * @brief The loaded mesh
+        *
+        * Null until resolveResources() has run.
+        */
+        Ogre::MeshPtr mesh;
+
+        /**
+        * @brief The material of the mesh's first submesh
+        *
+        * Empty until resolveResources() has run.
+        */
+        std::string materialName;
+
+    };
+
     /**
     * @brief Registers a new agent type
     *
@@ -582,6 +964,14 @@ public:
         const std::string& meshName
     );
 
+    /**
+    * @brief The number of registered agents
+    *
+    * Agent ids run from \c 1 to this number.
+    */
+    static size_t
+    getAgentCount();
+
     /**
     * @brief Obtains the display name of an agent
     *
@@ -639,6 +1029,34 @@ public:
         AgentId agentId
     );
 
+    /**
+    * @brief Obtains a registered agent
+    *
+    * The reference stays valid when more agents are registered. Prefer
+    * this over the other getters for every particle, it copies nothing.
+    *
+    * @param agentId
+    *   The id of the agent
+    *
+    * @return
+    *   The agent's names and resources.
+    *   If agent is not registered an out_of_range exception is thrown.
+    */
+    static const AgentType&
+    getAgentType(
+        AgentId agentId
+    );
+
+    /**
+    * @brief Loads the meshes of all registered agents
+    *
+    * Called by the engine on the main thread once the resource groups
+    * are initialised. Agents registered later are resolved by the next
+    * call. Until then, particles look their mesh up by name.
+    */
+    static void
+    resolveResources();
+
     AgentRegistry() = delete;
 
 };
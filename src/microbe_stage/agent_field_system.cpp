@@ -0,0 +1,317 @@
+#include "microbe_stage/agent_field_system.h"
+
+#include "engine/engine.h"
+#include "engine/thread_pool.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+// Explicit diffusion on a square grid is only stable up to this rate per
+// step
+const float MAX_DIFFUSION_PER_STEP = 0.25f;
+
+// Amounts below this are flushed to zero, so that decayed cells don't
+// turn into denormals
+const float MIN_AMOUNT = 1e-9f;
+
+// Rows of the grid per parallel chunk
+const size_t ROWS_PER_CHUNK = 16;
+
+// Diffuses and decays the rows [begin, end) from source into target
+//
+// Neighbours outside of the grid are replaced by the cell itself, so
+// nothing flows over the border. The inner loop only works on plain
+// arrays, which lets the compiler vectorize it.
+void
+diffuseRows(
+    const float* source,
+    float* target,
+    size_t width,
+    size_t height,
+    float rate,
+    float decay,
+    size_t begin,
+    size_t end
+) {
+    auto borderCell = [&](const float* row, const float* up, const float* down, size_t x) {
+        float value = row[x];
+        float left = x > 0 ? row[x - 1] : value;
+        float right = x + 1 < width ? row[x + 1] : value;
+        float result = (value + rate * (left + right + up[x] + down[x] - 4.0f * value)) * decay;
+        return result < MIN_AMOUNT ? 0.0f : result;
+    };
+    for (size_t y = begin; y < end; ++y) {
+        const float* row = source + y * width;
+        const float* up = y > 0 ? row - width : row;
+        const float* down = y + 1 < height ? row + width : row;
+        float* out = target + y * width;
+        out[0] = borderCell(row, up, down, 0);
+        for (size_t x = 1; x + 1 < width; ++x) {
+            float value = row[x];
+            float result = (value + rate * (row[x - 1] + row[x + 1] + up[x] + down[x] - 4.0f * value)) * decay;
+            out[x] = result < MIN_AMOUNT ? 0.0f : result;
+        }
+        if (width > 1) {
+            out[width - 1] = borderCell(row, up, down, width - 1);
+        }
+    }
+}
+
+} // namespace
+
+
+luabind::scope
+AgentFieldSystem::luaBindings() {
+    using namespace luabind;
+    return class_<AgentFieldSystem, System>("AgentFieldSystem")
+        .def(constructor<>())
+        .def(constructor<Ogre::Real, unsigned int, unsigned int>())
+        .def("addAgent", &AgentFieldSystem::addAgent)
+        .def("concentration", &AgentFieldSystem::concentration)
+        .def("deposit", &AgentFieldSystem::deposit)
+        .def("hasAgent", &AgentFieldSystem::hasAgent)
+    ;
+}
+
+
+struct AgentFieldSystem::Implementation {
+
+    struct Field {
+
+        Ogre::Real diffusionRate;
+
+        Ogre::Real decayRate;
+
+        // Amount per cell, row by row
+        std::vector<float> amounts;
+
+        // Target of the next diffusion step, swapped with amounts
+        std::vector<float> buffer;
+
+        bool isEmpty = true;
+
+    };
+
+    Implementation(
+        Ogre::Real cellSize,
+        unsigned int width,
+        unsigned int height
+    ) : m_cellSize(cellSize),
+        m_height(height),
+        m_width(width),
+        m_originX(-0.5f * width * cellSize),
+        m_originY(-0.5f * height * cellSize)
+    {
+    }
+
+    // Cell coordinate along one axis, not clamped to the grid
+    float
+    cellCoordinate(
+        Ogre::Real value,
+        Ogre::Real origin
+    ) const {
+        return (value - origin) / m_cellSize;
+    }
+
+    // Index of the cell containing a position or -1 if it's outside
+    long
+    cellIndex(
+        const Ogre::Vector3& position
+    ) const {
+        float x = std::floor(cellCoordinate(position.x, m_originX));
+        float y = std::floor(cellCoordinate(position.y, m_originY));
+        if (x < 0.0f or y < 0.0f or x >= m_width or y >= m_height) {
+            return -1;
+        }
+        return static_cast<long>(y) * m_width + static_cast<long>(x);
+    }
+
+    Field&
+    field(
+        AgentId agentId
+    ) {
+        auto iter = m_fields.find(agentId);
+        if (iter == m_fields.end()) {
+            throw std::invalid_argument("Agent is not simulated as a field");
+        }
+        return iter->second;
+    }
+
+    Ogre::Real m_cellSize;
+
+    std::unordered_map<AgentId, Field> m_fields;
+
+    unsigned int m_height;
+
+    unsigned int m_width;
+
+    Ogre::Real m_originX;
+
+    Ogre::Real m_originY;
+
+};
+
+
+AgentFieldSystem::AgentFieldSystem(
+    Ogre::Real cellSize,
+    unsigned int width,
+    unsigned int height
+) : m_impl(new Implementation(cellSize, width, height))
+{
+    if (not (cellSize > 0.0f) or width == 0 or height == 0) {
+        throw std::invalid_argument("Agent field cell size and dimensions must be positive");
+    }
+    this->setFixedRate(true);
+}
+
+
+AgentFieldSystem::~AgentFieldSystem() {}
+
+
+void
+AgentFieldSystem::addAgent(
+    AgentId agentId,
+    Ogre::Real diffusionRate,
+    Ogre::Real decayRate
+) {
+    if (diffusionRate < 0.0f or decayRate < 0.0f) {
+        throw std::invalid_argument("Agent field rates must not be negative");
+    }
+    auto& field = m_impl->m_fields[agentId];
+    field.diffusionRate = diffusionRate;
+    field.decayRate = decayRate;
+    if (field.amounts.empty()) {
+        size_t size = static_cast<size_t>(m_impl->m_width) * m_impl->m_height;
+        field.amounts.assign(size, 0.0f);
+        field.buffer.assign(size, 0.0f);
+    }
+}
+
+
+Ogre::Real
+AgentFieldSystem::concentration(
+    AgentId agentId,
+    const Ogre::Vector3& position
+) const {
+    auto iter = m_impl->m_fields.find(agentId);
+    long index = m_impl->cellIndex(position);
+    if (iter == m_impl->m_fields.end() or index < 0) {
+        return 0.0f;
+    }
+    return iter->second.amounts[index] / (m_impl->m_cellSize * m_impl->m_cellSize);
+}
+
+
+void
+AgentFieldSystem::deposit(
+    AgentId agentId,
+    const Ogre::Vector3& position,
+    Ogre::Real amount
+) {
+    auto& field = m_impl->field(agentId);
+    long index = m_impl->cellIndex(position);
+    if (index < 0 or not (amount > 0.0f)) {
+        return;
+    }
+    field.amounts[index] += amount;
+    field.isEmpty = false;
+}
+
+
+bool
+AgentFieldSystem::hasAgent(
+    AgentId agentId
+) const {
+    return m_impl->m_fields.count(agentId) > 0;
+}
+
+
+void
+AgentFieldSystem::shutdown() {
+    for (auto& pair : m_impl->m_fields) {
+        auto& field = pair.second;
+        std::fill(field.amounts.begin(), field.amounts.end(), 0.0f);
+        field.isEmpty = true;
+    }
+    System::shutdown();
+}
+
+
+Ogre::Real
+AgentFieldSystem::take(
+    AgentId agentId,
+    const Ogre::Vector3& minimum,
+    const Ogre::Vector3& maximum
+) {
+    auto& field = m_impl->field(agentId);
+    if (field.isEmpty) {
+        return 0.0f;
+    }
+    // Rectangle in cell coordinates, clamped to the grid
+    float minX = std::max(0.0f, m_impl->cellCoordinate(minimum.x, m_impl->m_originX));
+    float maxX = std::min<float>(m_impl->m_width, m_impl->cellCoordinate(maximum.x, m_impl->m_originX));
+    float minY = std::max(0.0f, m_impl->cellCoordinate(minimum.y, m_impl->m_originY));
+    float maxY = std::min<float>(m_impl->m_height, m_impl->cellCoordinate(maximum.y, m_impl->m_originY));
+    if (minX >= maxX or minY >= maxY) {
+        return 0.0f;
+    }
+    Ogre::Real taken = 0.0f;
+    unsigned int lastX = static_cast<unsigned int>(std::ceil(maxX));
+    unsigned int lastY = static_cast<unsigned int>(std::ceil(maxY));
+    for (unsigned int y = static_cast<unsigned int>(minY); y < lastY; ++y) {
+        float coverY = std::min<float>(y + 1, maxY) - std::max<float>(y, minY);
+        float* row = &field.amounts[static_cast<size_t>(y) * m_impl->m_width];
+        for (unsigned int x = static_cast<unsigned int>(minX); x < lastX; ++x) {
+            float cover = coverY * (std::min<float>(x + 1, maxX) - std::max<float>(x, minX));
+            float amount = row[x] * cover;
+            row[x] -= amount;
+            taken += amount;
+        }
+    }
+    return taken;
+}
+
+
+void
+AgentFieldSystem::update(int milliseconds) {
+    float seconds = milliseconds / 1000.0f;
+    size_t width = m_impl->m_width;
+    size_t height = m_impl->m_height;
+    ThreadPool& threadPool = this->engine()->threadPool();
+    for (auto& pair : m_impl->m_fields) {
+        auto& field = pair.second;
+        if (field.isEmpty) {
+            continue;
+        }
+        float rate = field.diffusionRate * seconds / (m_impl->m_cellSize * m_impl->m_cellSize);
+        // Split fast diffusion into several stable steps
+        unsigned int steps = std::max(1u, static_cast<unsigned int>(
+            std::ceil(rate / MAX_DIFFUSION_PER_STEP)
+        ));
+        rate /= steps;
+        float decay = std::exp(-field.decayRate * seconds / steps);
+        for (unsigned int step = 0; step < steps; ++step) {
+            const float* source = field.amounts.data();
+            float* target = field.buffer.data();
+            threadPool.parallelFor(height, ROWS_PER_CHUNK,
+                [=] (size_t begin, size_t end) {
+                    diffuseRows(source, target, width, height, rate, decay, begin, end);
+                }
+            );
+            field.amounts.swap(field.buffer);
+        }
+        field.isEmpty = std::all_of(
+            field.amounts.begin(),
+            field.amounts.end(),
+            [](float amount) { return amount == 0.0f; }
+        );
+    }
+}
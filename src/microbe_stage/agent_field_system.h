@@ -0,0 +1,179 @@
+#pragma once
+
+#include "engine/system.h"
+#include "microbe_stage/agent.h"
+
+#include <memory>
+#include <OgreVector3.h>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Simulates agents as concentration fields instead of particles
+*
+* Each agent added with addAgent() gets a grid of concentrations on the
+* x/y plane. Every update, the grid diffuses and decays, which costs the
+* same no matter how much of the agent is in the world.
+*
+* If a game state has this system, AgentEmitterSystem deposits emissions
+* of field agents into the grid instead of creating particles, and
+* AgentAbsorberSystem lets each absorber take the concentration under its
+* bounding box. It's published as AgentAbsorbedEvent, like an absorbed
+* particle. Agents that haven't been
+* added remain particles.
+*
+* The grid is centered on the origin. Deposits outside of it are lost and
+* the border doesn't let anything flow out. The fields are not saved.
+*/
+class AgentFieldSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - AgentFieldSystem()
+    * - AgentFieldSystem(cellSize, width, height)
+    * - AgentFieldSystem::addAgent
+    * - AgentFieldSystem::concentration
+    * - AgentFieldSystem::deposit
+    * - AgentFieldSystem::hasAgent
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param cellSize
+    *   The edge length of a grid cell
+    * @param width
+    *   The number of cells along the x axis
+    * @param height
+    *   The number of cells along the y axis
+    */
+    AgentFieldSystem(
+        Ogre::Real cellSize = 2.0f,
+        unsigned int width = 256,
+        unsigned int height = 256
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~AgentFieldSystem();
+
+    /**
+    * @brief Simulates an agent as a field
+    *
+    * Calling this again for the same agent only changes its rates.
+    *
+    * @param agentId
+    *   The agent to simulate
+    * @param diffusionRate
+    *   The diffusion coefficient in square units per second
+    * @param decayRate
+    *   The fraction of the agent that decays per second, as an
+    *   exponential rate
+    */
+    void
+    addAgent(
+        AgentId agentId,
+        Ogre::Real diffusionRate,
+        Ogre::Real decayRate
+    );
+
+    /**
+    * @brief The concentration of an agent at a position
+    *
+    * @param agentId
+    *   The agent to sample
+    * @param position
+    *   The position to sample at
+    *
+    * @return
+    *   The amount of the agent per square unit, 0 for positions outside
+    *   of the grid and for agents that aren't fields
+    */
+    Ogre::Real
+    concentration(
+        AgentId agentId,
+        const Ogre::Vector3& position
+    ) const;
+
+    /**
+    * @brief Adds an amount of an agent to the cell at a position
+    *
+    * @param agentId
+    *   The agent to deposit. Must have been added with addAgent().
+    * @param position
+    *   Where to deposit it
+    * @param amount
+    *   How much to deposit
+    */
+    void
+    deposit(
+        AgentId agentId,
+        const Ogre::Vector3& position,
+        Ogre::Real amount
+    );
+
+    /**
+    * @brief Whether an agent is simulated as a field
+    *
+    * @param agentId
+    */
+    bool
+    hasAgent(
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Removes an agent from a rectangle on the x/y plane
+    *
+    * Cells that are only partially inside the rectangle lose the
+    * corresponding fraction of their contents.
+    *
+    * @param agentId
+    *   The agent to take
+    * @param minimum
+    *   The corner with the smallest coordinates
+    * @param maximum
+    *   The corner with the largest coordinates
+    *
+    * @return
+    *   The amount removed from the field
+    */
+    Ogre::Real
+    take(
+        AgentId agentId,
+        const Ogre::Vector3& minimum,
+        const Ogre::Vector3& maximum
+    );
+
+    /**
+    * @brief Diffuses and decays the fields
+    *
+    * @param milliseconds
+    */
+    void update(int milliseconds) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
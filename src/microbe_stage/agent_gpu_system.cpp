@@ -0,0 +1,319 @@
+#include "microbe_stage/agent_gpu_system.h"
+
+#include "bullet/rigid_body_system.h"
+#include "engine/engine.h"
+#include "engine/entity_filter.h"
+#include "engine/event_bus.h"
+#include "engine/game_state.h"
+#include "engine/statistics.h"
+#include "ogre/gpu_particles.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <btBulletCollisionCommon.h>
+#include <iostream>
+#include <OgreCamera.h>
+#include <OgreRenderQueueListener.h>
+#include <OgreRenderSystem.h>
+#include <OgreRenderTarget.h>
+#include <OgreRoot.h>
+#include <OgreSceneManager.h>
+#include <OgreViewport.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace thrive;
+
+
+luabind::scope
+AgentGpuSystem::luaBindings() {
+    using namespace luabind;
+    return class_<AgentGpuSystem, System>("AgentGpuSystem")
+        .def(constructor<>())
+        .def(constructor<unsigned int>())
+        .def(constructor<unsigned int, Ogre::Real>())
+        .def("addAgent", &AgentGpuSystem::addAgent)
+        .def("hasAgent", &AgentGpuSystem::hasAgent)
+        .def("isAvailable", &AgentGpuSystem::isAvailable)
+    ;
+}
+
+
+struct AgentGpuSystem::Implementation : public Ogre::RenderQueueListener {
+
+    Implementation(
+        unsigned int capacity,
+        Ogre::Real particleSize
+    ) : m_capacity(capacity),
+        m_particleSize(particleSize)
+    {
+    }
+
+    void
+    initParticles() {
+        if (m_hasTriedInit) {
+            return;
+        }
+        m_hasTriedInit = true;
+        Ogre::RenderSystem* renderSystem = Ogre::Root::getSingleton().getRenderSystem();
+        if (
+            not renderSystem or
+            renderSystem->getName() != "OpenGL Rendering Subsystem" or
+            not m_particles.init(m_capacity)
+        ) {
+            std::cerr << "Warning: GPU agents need OpenGL 3.3, "
+                "they are simulated as entity particles" << std::endl;
+            return;
+        }
+        m_particles.setParticleSize(m_particleSize);
+        for (size_t type = 0; type < m_agentIds.size(); ++type) {
+            m_particles.setTypeColour(type, m_colours[type]);
+        }
+    }
+
+    void
+    renderQueueEnded(
+        Ogre::uint8 queueGroupId,
+        const Ogre::String&,
+        bool&
+    ) override {
+        if (
+            queueGroupId != Ogre::RENDER_QUEUE_MAIN or
+            not m_particles.isAvailable() or
+            m_sceneManager->_getCurrentRenderStage() == Ogre::SceneManager::IRS_RENDER_TO_TEXTURE
+        ) {
+            return;
+        }
+        // Step once per frame, before the first viewport draws
+        if (m_pendingMilliseconds > 0) {
+            m_particles.readAbsorbed(
+                [this] (uint32_t absorberId, uint32_t type, float amount) {
+                    m_absorbed.push_back({absorberId, m_agentIds[type], amount});
+                }
+            );
+            m_particles.step(m_pendingMilliseconds / 1000.0f);
+            m_pendingMilliseconds = 0;
+        }
+        Ogre::Viewport* viewport = m_sceneManager->getCurrentViewport();
+        Ogre::Camera* camera = viewport ? viewport->getCamera() : nullptr;
+        if (not camera) {
+            return;
+        }
+        Ogre::Matrix4 projection = camera->getProjectionMatrixRS();
+        // Like the render system does for render textures
+        if (viewport->getTarget()->requiresTextureFlipping()) {
+            for (size_t column = 0; column < 4; ++column) {
+                projection[1][column] = -projection[1][column];
+            }
+        }
+        m_particles.draw(
+            projection * camera->getViewMatrix(true),
+            camera->getDerivedRight(),
+            camera->getDerivedUp()
+        );
+        m_cameraPosition = camera->getDerivedPosition();
+    }
+
+    // Absorbers closest to the camera first, up to the maximum
+    void
+    updateAbsorbers() {
+        auto& absorbers = m_absorbers;
+        absorbers.clear();
+        for (const auto& entry : m_absorberBodies) {
+            btRigidBody* body = std::get<1>(entry.second)->m_body;
+            if (not body) {
+                continue;
+            }
+            btVector3 aabbMin;
+            btVector3 aabbMax;
+            body->getAabb(aabbMin, aabbMax);
+            absorbers.push_back({
+                entry.first,
+                Ogre::Vector2(aabbMin.x(), aabbMin.y()),
+                Ogre::Vector2(aabbMax.x(), aabbMax.y())
+            });
+        }
+        if (absorbers.size() > GpuParticles::MAX_ABSORBERS) {
+            Ogre::Vector2 camera(m_cameraPosition.x, m_cameraPosition.y);
+            auto distance = [&camera] (const GpuParticles::Absorber& absorber) {
+                return (0.5f * (absorber.minimum + absorber.maximum)).squaredDistance(camera);
+            };
+            std::nth_element(
+                absorbers.begin(),
+                absorbers.begin() + GpuParticles::MAX_ABSORBERS,
+                absorbers.end(),
+                [&distance] (const GpuParticles::Absorber& lhs, const GpuParticles::Absorber& rhs) {
+                    return distance(lhs) < distance(rhs);
+                }
+            );
+            absorbers.resize(GpuParticles::MAX_ABSORBERS);
+        }
+        m_particles.setAbsorbers(absorbers);
+    }
+
+    std::vector<AgentAbsorbedEvent> m_absorbed;
+
+    Statistics::Counter* m_absorbedCounter = nullptr;
+
+    EventChannel<AgentAbsorbedEvent>* m_absorbedEvents = nullptr;
+
+    EntityFilter<
+        AgentAbsorberComponent,
+        RigidBodyComponent
+    > m_absorberBodies;
+
+    std::vector<GpuParticles::Absorber> m_absorbers;
+
+    // Index is the particle type
+    std::vector<AgentId> m_agentIds;
+
+    Ogre::Vector3 m_cameraPosition = Ogre::Vector3::ZERO;
+
+    unsigned int m_capacity;
+
+    // Index is the particle type
+    std::vector<Ogre::ColourValue> m_colours;
+
+    bool m_hasTriedInit = false;
+
+    GpuParticles m_particles;
+
+    Ogre::Real m_particleSize;
+
+    Milliseconds m_pendingMilliseconds = 0;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::unordered_map<AgentId, uint32_t> m_types;
+
+};
+
+
+AgentGpuSystem::AgentGpuSystem(
+    unsigned int capacity,
+    Ogre::Real particleSize
+) : m_impl(new Implementation(capacity, particleSize))
+{
+    this->declareGraphical();
+    this->setFixedRate(true);
+}
+
+
+AgentGpuSystem::~AgentGpuSystem() {}
+
+
+void
+AgentGpuSystem::addAgent(
+    AgentId agentId,
+    const Ogre::ColourValue& colour
+) {
+    auto iter = m_impl->m_types.find(agentId);
+    uint32_t type = 0;
+    if (iter != m_impl->m_types.end()) {
+        type = iter->second;
+        m_impl->m_colours[type] = colour;
+    }
+    else {
+        if (m_impl->m_agentIds.size() >= GpuParticles::MAX_TYPES) {
+            throw std::invalid_argument("Too many agents to simulate on the GPU");
+        }
+        type = m_impl->m_agentIds.size();
+        m_impl->m_types.emplace(agentId, type);
+        m_impl->m_agentIds.push_back(agentId);
+        m_impl->m_colours.push_back(colour);
+    }
+    m_impl->m_particles.setTypeColour(type, colour);
+    if (m_impl->m_sceneManager) {
+        m_impl->initParticles();
+    }
+}
+
+
+void
+AgentGpuSystem::emit(
+    AgentId agentId,
+    const Ogre::Vector3& position,
+    const Ogre::Vector3& velocity,
+    float potency,
+    Milliseconds timeToLive
+) {
+    auto iter = m_impl->m_types.find(agentId);
+    if (iter == m_impl->m_types.end()) {
+        throw std::invalid_argument("Agent is not simulated on the GPU");
+    }
+    m_impl->m_particles.emit({
+        position,
+        velocity,
+        potency,
+        static_cast<float>(timeToLive),
+        iter->second
+    });
+}
+
+
+bool
+AgentGpuSystem::hasAgent(
+    AgentId agentId
+) const {
+    return m_impl->m_particles.isAvailable() and m_impl->m_types.count(agentId) > 0;
+}
+
+
+void
+AgentGpuSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_absorbedCounter = &gameState->engine().statistics().counter("agents.absorbed");
+    m_impl->m_absorbedEvents = &AgentAbsorbedEvent::channel(gameState);
+    m_impl->m_absorberBodies.setEntityManager(&gameState->entityManager());
+    m_impl->m_sceneManager = gameState->sceneManager();
+    if (not m_impl->m_sceneManager) {
+        // Headless, agents stay simulated on the CPU
+        return;
+    }
+    m_impl->m_sceneManager->addRenderQueueListener(m_impl.get());
+    if (not m_impl->m_agentIds.empty()) {
+        m_impl->initParticles();
+    }
+}
+
+
+bool
+AgentGpuSystem::isAvailable() const {
+    return m_impl->m_particles.isAvailable();
+}
+
+
+void
+AgentGpuSystem::shutdown() {
+    if (m_impl->m_sceneManager) {
+        m_impl->m_sceneManager->removeRenderQueueListener(m_impl.get());
+    }
+    m_impl->m_particles.shutdown();
+    m_impl->m_hasTriedInit = false;
+    m_impl->m_absorbed.clear();
+    m_impl->m_absorbedCounter = nullptr;
+    m_impl->m_absorbedEvents = nullptr;
+    m_impl->m_absorberBodies.setEntityManager(nullptr);
+    m_impl->m_sceneManager = nullptr;
+    System::shutdown();
+}
+
+
+void
+AgentGpuSystem::update(
+    int milliseconds
+) {
+    if (not m_impl->m_particles.isAvailable()) {
+        return;
+    }
+    m_impl->m_pendingMilliseconds += milliseconds;
+    for (const AgentAbsorbedEvent& event : m_impl->m_absorbed) {
+        m_impl->m_absorbedEvents->publish(event);
+    }
+    m_impl->m_absorbedCounter->add(m_impl->m_absorbed.size());
+    m_impl->m_absorbed.clear();
+    m_impl->updateAbsorbers();
+}
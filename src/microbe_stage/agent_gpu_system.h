@@ -0,0 +1,166 @@
+#pragma once
+
+#include "engine/system.h"
+#include "microbe_stage/agent.h"
+
+#include <memory>
+#include <OgreColourValue.h>
+#include <OgreVector3.h>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Simulates agent particles on the GPU
+*
+* Particles of the agents added with addAgent() aren't entities, but live
+* in GPU buffers (see GpuParticles). Once per frame, the GPU moves them,
+* counts down their lifetime and tests them against the bounding boxes of
+* the absorbers. What each absorber took up comes back a frame or two
+* later and is published as AgentAbsorbedEvent, like absorbed entity
+* particles. All particles are drawn in one instanced draw call after the
+* main render queue, so how many there can be is up to the GPU.
+*
+* If a game state has this system, AgentEmitterSystem hands emissions of
+* GPU agents to emit() instead of creating entities. Other agents remain
+* entity particles.
+*
+* Needs the OpenGL render system and OpenGL 3.3. Without them, or in a
+* headless game state, hasAgent() is \c false for all agents. The particles aren't saved, and once the
+* capacity is reached, new particles replace the oldest ones. Only the
+* absorbers closest to the camera are tested, up to
+* GpuParticles::MAX_ABSORBERS.
+*/
+class AgentGpuSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - AgentGpuSystem()
+    * - AgentGpuSystem(capacity)
+    * - AgentGpuSystem(capacity, particleSize)
+    * - AgentGpuSystem::addAgent
+    * - AgentGpuSystem::hasAgent
+    * - AgentGpuSystem::isAvailable
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param capacity
+    *   The number of particles that can be alive at once
+    * @param particleSize
+    *   The width and height of a particle
+    */
+    AgentGpuSystem(
+        unsigned int capacity = 65536,
+        Ogre::Real particleSize = 0.3f
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~AgentGpuSystem();
+
+    /**
+    * @brief Simulates an agent's particles on the GPU
+    *
+    * Calling this again for the same agent only changes its colour.
+    *
+    * @param agentId
+    *   The agent to simulate
+    * @param colour
+    *   The colour its particles are drawn with
+    *
+    * @throws std::invalid_argument
+    *   If there are GpuParticles::MAX_TYPES agents already
+    */
+    void
+    addAgent(
+        AgentId agentId,
+        const Ogre::ColourValue& colour
+    );
+
+    /**
+    * @brief Adds a particle
+    *
+    * @param agentId
+    *   The particle's agent, for which hasAgent() must be \c true
+    * @param position
+    * @param velocity
+    * @param potency
+    * @param timeToLive
+    */
+    void
+    emit(
+        AgentId agentId,
+        const Ogre::Vector3& position,
+        const Ogre::Vector3& velocity,
+        float potency,
+        Milliseconds timeToLive
+    );
+
+    /**
+    * @brief Whether an agent is simulated on the GPU
+    *
+    * @param agentId
+    */
+    bool
+    hasAgent(
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief Initializes the system
+    *
+    * Sets up the GPU buffers if any agents have been added.
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Whether the GPU can simulate particles
+    *
+    * Only known once agents have been added and the system is
+    * initialized.
+    */
+    bool
+    isAvailable() const;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Publishes absorbed agents and updates the absorbers
+    *
+    * @param milliseconds
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
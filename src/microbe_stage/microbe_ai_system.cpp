@@ -0,0 +1,389 @@
+#include "microbe_stage/microbe_ai_system.h"
+
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "engine/rng.h"
+#include "engine/serialization.h"
+#include "microbe_stage/process_system.h"
+#include "ogre/scene_node_system.h"
+#include "ogre/spatial_index_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <OgreMath.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+// Scripts store all numbers as double, so savegames written before the
+// component was native have them in that type
+template<typename T>
+static T
+loadNumber(
+    const StorageContainer& storage,
+    const std::string& key,
+    T defaultValue
+) {
+    if (storage.contains<double>(key)) {
+        return static_cast<T>(storage.get<double>(key));
+    }
+    return storage.get<T>(key, defaultValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MicrobeAIControllerComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+MicrobeAIControllerComponent::luaBindings() {
+    using namespace luabind;
+    return class_<MicrobeAIControllerComponent, Component>("MicrobeAIControllerComponent")
+        .enum_("ID") [
+            value("TYPE_ID", MicrobeAIControllerComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &MicrobeAIControllerComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("takeDecision", &MicrobeAIControllerComponent::takeDecision)
+        .def_readwrite("direction", &MicrobeAIControllerComponent::m_direction)
+        .def_readwrite("facingTargetPoint", &MicrobeAIControllerComponent::m_facingTargetPoint)
+        .def_readwrite("intervalRemaining", &MicrobeAIControllerComponent::m_intervalRemaining)
+        .def_readwrite("movementDirection", &MicrobeAIControllerComponent::m_movementDirection)
+        .def_readwrite("movementRadius", &MicrobeAIControllerComponent::m_movementRadius)
+        .def_readwrite("reevaluationInterval", &MicrobeAIControllerComponent::m_reevaluationInterval)
+    ;
+}
+
+
+void
+MicrobeAIControllerComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    // The misspelled key is kept for compatibility with older savegames
+    m_movementRadius = loadNumber<Ogre::Real>(storage, "movementRadius", 20.0f);
+    m_reevaluationInterval = loadNumber<Milliseconds>(storage, "reevalutationInterval", 1000);
+    m_intervalRemaining = loadNumber<Milliseconds>(storage, "intervalRemaining", m_reevaluationInterval);
+    m_direction = storage.get<Ogre::Vector3>("direction", Ogre::Vector3::ZERO);
+    m_hasTarget = storage.contains<Ogre::Vector3>("targetEmitterPosition");
+    m_targetPosition = storage.get<Ogre::Vector3>("targetEmitterPosition", Ogre::Vector3::ZERO);
+    m_searchedAgentId = loadNumber<AgentId>(storage, "searchedAgentId", NULL_AGENT);
+}
+
+
+StorageContainer
+MicrobeAIControllerComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    storage.set<Ogre::Real>("movementRadius", m_movementRadius);
+    storage.set<Milliseconds>("reevalutationInterval", m_reevaluationInterval);
+    storage.set<Milliseconds>("intervalRemaining", m_intervalRemaining);
+    storage.set<Ogre::Vector3>("direction", m_direction);
+    if (m_hasTarget) {
+        storage.set<Ogre::Vector3>("targetEmitterPosition", m_targetPosition);
+    }
+    storage.set<AgentId>("searchedAgentId", m_searchedAgentId);
+    return storage;
+}
+
+
+bool
+MicrobeAIControllerComponent::takeDecision() {
+    bool hasDecision = m_hasDecision;
+    m_hasDecision = false;
+    return hasDecision;
+}
+
+REGISTER_COMPONENT(MicrobeAIControllerComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MicrobeAISystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+MicrobeAISystem::luaBindings() {
+    using namespace luabind;
+    return class_<MicrobeAISystem, System>("MicrobeAISystem")
+        .def(constructor<>())
+        .def("addNeed", &MicrobeAISystem::addNeed)
+        .def("setLodDistance", &MicrobeAISystem::setLodDistance)
+        .def("setMovementSpeed", &MicrobeAISystem::setMovementSpeed)
+        .def("setPlayerEntity", &MicrobeAISystem::setPlayerEntity)
+        .def("setSearchCount", &MicrobeAISystem::setSearchCount)
+        .def("setSliceCount", &MicrobeAISystem::setSliceCount)
+    ;
+}
+
+
+struct MicrobeAISystem::Implementation {
+
+    // Picks the emitter of an agent a microbe should head for
+    //
+    // Prefers the nearest of the m_searchCount scene nodes around position
+    // that emits the agent. Falls back to a random emitter if none is close
+    // by or there is no spatial index.
+    bool
+    findEmitter(
+        AgentId agentId,
+        const Ogre::Vector3& position,
+        RNG& rng,
+        Ogre::Vector3& emitterPosition
+    ) {
+        const auto& emitters = m_emitters.entities();
+        if (m_spatialIndex) {
+            for (EntityId entityId : m_spatialIndex->queryNearest(position, m_searchCount)) {
+                auto iter = emitters.find(entityId);
+                if (iter != emitters.end() and std::get<0>(iter->second)->m_agentId == agentId) {
+                    emitterPosition = std::get<1>(iter->second)->m_transform.position;
+                    return true;
+                }
+            }
+        }
+        m_candidates.clear();
+        for (const auto& entry : emitters) {
+            if (std::get<0>(entry.second)->m_agentId == agentId) {
+                m_candidates.push_back(std::get<1>(entry.second));
+            }
+        }
+        if (m_candidates.empty()) {
+            return false;
+        }
+        int index = rng.getInt(0, static_cast<int>(m_candidates.size()) - 1);
+        emitterPosition = m_candidates[index]->m_transform.position;
+        return true;
+    }
+
+    // The interval multiplier for a microbe at position
+    unsigned int
+    lodFactor(
+        const Ogre::Vector3& position
+    ) const {
+        if (not m_hasPlayer or m_lodDistance <= 0.0f) {
+            return 1;
+        }
+        Ogre::Real steps = position.distance(m_playerPosition) / m_lodDistance;
+        return std::min(m_lodMaxFactor, 1 + static_cast<unsigned int>(steps));
+    }
+
+    // Makes a single decision for a microbe
+    void
+    think(
+        MicrobeAIControllerComponent* aiController,
+        VacuoleComponent* vacuole,
+        const Ogre::Vector3& position,
+        RNG& rng
+    ) {
+        AgentId neededAgentId = NULL_AGENT;
+        for (const auto& need : m_needs) {
+            float amount = vacuole ? vacuole->agentAmount(need.first) : 0.0f;
+            if (amount <= need.second) {
+                neededAgentId = need.first;
+                break;
+            }
+        }
+        Ogre::Vector3 targetPosition;
+        bool hasTarget = false;
+        if (neededAgentId != NULL_AGENT) {
+            // If we are NOT currently heading towards an emitter
+            if (not aiController->m_hasTarget or aiController->m_searchedAgentId != neededAgentId) {
+                aiController->m_searchedAgentId = neededAgentId;
+                Ogre::Vector3 emitterPosition;
+                if (this->findEmitter(neededAgentId, position, rng, emitterPosition)) {
+                    aiController->m_hasTarget = true;
+                    aiController->m_targetPosition = emitterPosition;
+                }
+            }
+            if (aiController->m_hasTarget) {
+                hasTarget = true;
+                targetPosition = aiController->m_targetPosition;
+                // Targets off the plane are only headed for once
+                if (targetPosition.z != 0.0f) {
+                    aiController->m_hasTarget = false;
+                }
+            }
+        }
+        else {
+            aiController->m_hasTarget = false;
+        }
+        if (not hasTarget) {
+            Ogre::Real angle = rng.getDouble(0.0, Ogre::Math::TWO_PI);
+            int maxDistance = std::max(10, static_cast<int>(aiController->m_movementRadius));
+            Ogre::Real distance = rng.getInt(10, maxDistance);
+            targetPosition = Ogre::Vector3(
+                distance * std::cos(angle),
+                distance * std::sin(angle),
+                0.0f
+            );
+        }
+        aiController->m_direction = (targetPosition - position).normalisedCopy();
+        aiController->m_facingTargetPoint = targetPosition;
+        aiController->m_movementDirection = Ogre::Vector3(0.0f, m_movementSpeed, 0.0f);
+        aiController->m_hasDecision = true;
+    }
+
+    std::vector<OgreSceneNodeComponent*> m_candidates;
+
+    EntityFilter<
+        TimedAgentEmitterComponent,
+        OgreSceneNodeComponent
+    > m_emitters;
+
+    EntityManager* m_entityManager = nullptr;
+
+    EntityFilter<
+        MicrobeAIControllerComponent,
+        OgreSceneNodeComponent,
+        Optional<VacuoleComponent>
+    > m_entities;
+
+    unsigned int m_frame = 0;
+
+    bool m_hasPlayer = false;
+
+    Ogre::Real m_lodDistance = 0.0f;
+
+    unsigned int m_lodMaxFactor = 1;
+
+    Ogre::Real m_movementSpeed = 0.5f;
+
+    std::vector<std::pair<AgentId, float>> m_needs;
+
+    EntityManager::NameId m_playerName = EntityManager::NULL_NAME;
+
+    Ogre::Vector3 m_playerPosition = Ogre::Vector3::ZERO;
+
+    unsigned int m_searchCount = 32;
+
+    unsigned int m_sliceCount = 1;
+
+    SpatialIndexSystem* m_spatialIndex = nullptr;
+
+};
+
+
+MicrobeAISystem::MicrobeAISystem()
+  : m_impl(new Implementation())
+{
+    this->registerFilter(&m_impl->m_emitters);
+    this->registerFilter(&m_impl->m_entities);
+}
+
+
+MicrobeAISystem::~MicrobeAISystem() {}
+
+
+void
+MicrobeAISystem::addNeed(
+    AgentId agentId,
+    float threshold
+) {
+    m_impl->m_needs.emplace_back(agentId, threshold);
+}
+
+
+void
+MicrobeAISystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entityManager = &gameState->entityManager();
+    m_impl->m_emitters.setEntityManager(m_impl->m_entityManager);
+    m_impl->m_entities.setEntityManager(m_impl->m_entityManager);
+    m_impl->m_spatialIndex = SpatialIndexSystem::find(gameState);
+}
+
+
+void
+MicrobeAISystem::setLodDistance(
+    Ogre::Real distance,
+    unsigned int maxFactor
+) {
+    m_impl->m_lodDistance = distance;
+    m_impl->m_lodMaxFactor = std::max(1u, maxFactor);
+}
+
+
+void
+MicrobeAISystem::setMovementSpeed(
+    Ogre::Real speed
+) {
+    m_impl->m_movementSpeed = speed;
+}
+
+
+void
+MicrobeAISystem::setPlayerEntity(
+    const std::string& name
+) {
+    m_impl->m_playerName = EntityManager::internName(name);
+}
+
+
+void
+MicrobeAISystem::setSearchCount(
+    unsigned int count
+) {
+    m_impl->m_searchCount = count;
+}
+
+
+void
+MicrobeAISystem::setSliceCount(
+    unsigned int count
+) {
+    if (count == 0) {
+        throw std::invalid_argument("AI slice count must be positive");
+    }
+    m_impl->m_sliceCount = count;
+}
+
+
+void
+MicrobeAISystem::shutdown() {
+    m_impl->m_emitters.setEntityManager(nullptr);
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_entityManager = nullptr;
+    m_impl->m_spatialIndex = nullptr;
+    System::shutdown();
+}
+
+
+void
+MicrobeAISystem::update(int milliseconds) {
+    RNG& rng = this->engine()->rng();
+    m_impl->m_hasPlayer = false;
+    if (m_impl->m_playerName != EntityManager::NULL_NAME) {
+        EntityId playerId = m_impl->m_entityManager->getNamedId(m_impl->m_playerName);
+        auto sceneNode = m_impl->m_entityManager->getComponent<OgreSceneNodeComponent>(playerId);
+        if (sceneNode) {
+            m_impl->m_hasPlayer = true;
+            m_impl->m_playerPosition = sceneNode->m_transform.position;
+        }
+    }
+    unsigned int slice = m_impl->m_frame % m_impl->m_sliceCount;
+    m_impl->m_frame += 1;
+    for (const auto& entry : m_impl->m_entities) {
+        MicrobeAIControllerComponent* aiController = std::get<0>(entry.second);
+        aiController->m_intervalRemaining += milliseconds;
+        if (entry.first % m_impl->m_sliceCount != slice) {
+            continue;
+        }
+        const Ogre::Vector3& position = std::get<1>(entry.second)->m_transform.position;
+        Milliseconds interval = aiController->m_reevaluationInterval * m_impl->lodFactor(position);
+        if (interval <= 0) {
+            continue;
+        }
+        // Skipped decisions are not worth catching up on, they would be
+        // overridden right away
+        if (aiController->m_intervalRemaining > interval) {
+            aiController->m_intervalRemaining %= interval;
+            m_impl->think(aiController, std::get<2>(entry.second), position, rng);
+        }
+    }
+}
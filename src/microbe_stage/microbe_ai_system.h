@@ -0,0 +1,264 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "engine/typedefs.h"
+#include "microbe_stage/agent.h"
+
+#include <memory>
+#include <OgreVector3.h>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Identifies a microbe as AI controlled and holds its AI state
+*
+* MicrobeAISystem writes its decisions into m_facingTargetPoint and
+* m_movementDirection. Scripts pick them up after takeDecision() returned
+* \c true.
+*/
+class MicrobeAIControllerComponent : public Component {
+    COMPONENT(MicrobeAIControllerComponent)
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MicrobeAIControllerComponent()
+    * - @link m_direction direction @endlink
+    * - @link m_facingTargetPoint facingTargetPoint @endlink
+    * - @link m_intervalRemaining intervalRemaining @endlink
+    * - @link m_movementDirection movementDirection @endlink
+    * - @link m_movementRadius movementRadius @endlink
+    * - @link m_reevaluationInterval reevaluationInterval @endlink
+    * - MicrobeAIControllerComponent::takeDecision
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief Checks and resets whether a new decision has been made
+    */
+    bool
+    takeDecision();
+
+    /**
+    * @brief Direction from the microbe towards its current target
+    */
+    Ogre::Vector3 m_direction = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief The point the microbe should turn towards
+    */
+    Ogre::Vector3 m_facingTargetPoint = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief Whether m_targetPosition is an emitter to head for
+    */
+    bool m_hasTarget = false;
+
+    /**
+    * @brief Whether a decision has been made since takeDecision()
+    */
+    bool m_hasDecision = false;
+
+    /**
+    * @brief Time accumulated towards the next decision
+    */
+    Milliseconds m_intervalRemaining = 1000;
+
+    /**
+    * @brief The movement the microbe should make, in its local space
+    */
+    Ogre::Vector3 m_movementDirection = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief Maximum distance of a random wandering target
+    */
+    Ogre::Real m_movementRadius = 20.0f;
+
+    /**
+    * @brief Time between two decisions
+    */
+    Milliseconds m_reevaluationInterval = 1000;
+
+    /**
+    * @brief The agent the current target was searched for
+    */
+    AgentId m_searchedAgentId = NULL_AGENT;
+
+    /**
+    * @brief Position of the emitter the microbe is heading for
+    */
+    Ogre::Vector3 m_targetPosition = Ogre::Vector3::ZERO;
+
+};
+
+
+/**
+* @brief Makes the decisions of AI controlled microbes
+*
+* Each decision checks the microbe's needs in the order they were added
+* with addNeed(). For the first agent that has dropped to its threshold,
+* the microbe heads for the nearest emitter of that agent. Without any
+* need, it wanders to a random point.
+*
+* To spread the cost evenly over frames, only one in setSliceCount()
+* microbes is considered per update. Time keeps accumulating for the
+* others, so their decision rate stays the same, the decisions are just
+* made a few frames late. Microbes far away from the player entity think
+* less often, see setLodDistance().
+*/
+class MicrobeAISystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MicrobeAISystem()
+    * - MicrobeAISystem::addNeed
+    * - MicrobeAISystem::setLodDistance
+    * - MicrobeAISystem::setMovementSpeed
+    * - MicrobeAISystem::setPlayerEntity
+    * - MicrobeAISystem::setSearchCount
+    * - MicrobeAISystem::setSliceCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    MicrobeAISystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~MicrobeAISystem();
+
+    /**
+    * @brief Adds an agent the microbes search for when they run low on it
+    *
+    * Needs added earlier take precedence.
+    *
+    * @param agentId
+    * @param threshold
+    *   The stored amount at or below which the microbe starts searching
+    */
+    void
+    addNeed(
+        AgentId agentId,
+        float threshold
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Sets how the decision rate drops with the distance to the player
+    *
+    * A microbe's reevaluation interval is multiplied by one plus the
+    * number of \a distance steps between it and the player, up to
+    * \a maxFactor.
+    *
+    * @param distance
+    *   The distance per step, 0 to disable
+    * @param maxFactor
+    *   The maximum factor
+    */
+    void
+    setLodDistance(
+        Ogre::Real distance,
+        unsigned int maxFactor
+    );
+
+    /**
+    * @brief Sets the forward movement of AI controlled microbes
+    *
+    * @param speed
+    */
+    void
+    setMovementSpeed(
+        Ogre::Real speed
+    );
+
+    /**
+    * @brief Sets the entity whose distance determines the decision rate
+    *
+    * @param name
+    *   The entity's name
+    */
+    void
+    setPlayerEntity(
+        const std::string& name
+    );
+
+    /**
+    * @brief Sets how many of the nearest scene nodes are searched for an emitter
+    *
+    * If none of them is a suitable emitter, a random one is picked.
+    *
+    * @param count
+    */
+    void
+    setSearchCount(
+        unsigned int count
+    );
+
+    /**
+    * @brief Sets into how many groups the microbes are split
+    *
+    * One group is considered per update.
+    *
+    * @param count
+    *   Must be positive
+    */
+    void
+    setSliceCount(
+        unsigned int count
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Updates the system
+    *
+    * @param milliseconds
+    */
+    void update(int milliseconds) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
@@ -0,0 +1,249 @@
+#include "microbe_stage/microbe_component.h"
+
+#include "engine/component_factory.h"
+
+#include <algorithm>
+#include <luabind/iterator_policy.hpp>
+#include <stdexcept>
+#include <utility>
+
+using namespace thrive;
+
+luabind::scope
+MicrobeComponent::luaBindings() {
+    using namespace luabind;
+    return class_<MicrobeComponent, Component>("MicrobeComponent")
+        .enum_("ID") [
+            value("TYPE_ID", MicrobeComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &MicrobeComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("addOrganelle", &MicrobeComponent::addOrganelle)
+        .def("addVacuole", &MicrobeComponent::addVacuole)
+        .def("getOrganelle", &MicrobeComponent::getOrganelle)
+        .def("organelleCount", &MicrobeComponent::organelleCount)
+        .def("organelles", &MicrobeComponent::organelleObjects, return_stl_iterator)
+        .def("removeOrganelle", &MicrobeComponent::removeOrganelle)
+        .def("removeVacuole", &MicrobeComponent::removeVacuole)
+        .def("setOrganelleStorage", &MicrobeComponent::setOrganelleStorage)
+        .def("takeLoadedOrganelles", &MicrobeComponent::takeLoadedOrganelles)
+        .def("vacuoleAgents", &MicrobeComponent::vacuoleAgents, return_stl_iterator)
+        .def("vacuoleCount", &MicrobeComponent::vacuoleCount)
+        .def_readwrite("facingTargetPoint", &MicrobeComponent::m_facingTargetPoint)
+        .def_readonly("hexGrid", &MicrobeComponent::m_hexGrid)
+        .def_readwrite("initialized", &MicrobeComponent::m_initialized)
+        .def_readwrite("movementDirection", &MicrobeComponent::m_movementDirection)
+    ;
+}
+
+
+bool
+MicrobeComponent::addOrganelle(
+    int32_t q,
+    int32_t r,
+    const luabind::object& organelle
+) {
+    if (this->findOrganelle(q, r) >= 0) {
+        return false;
+    }
+    Organelle entry;
+    entry.q = q;
+    entry.r = r;
+    m_organelles.push_back(std::move(entry));
+    m_organelleObjects.push_back(organelle);
+    return true;
+}
+
+
+void
+MicrobeComponent::addVacuole(
+    AgentId agentId,
+    float capacity
+) {
+    Vacuole vacuole;
+    vacuole.agentId = agentId;
+    vacuole.capacity = capacity;
+    m_vacuoles.push_back(vacuole);
+    if (std::find(m_vacuoleAgents.begin(), m_vacuoleAgents.end(), agentId) == m_vacuoleAgents.end()) {
+        m_vacuoleAgents.push_back(agentId);
+    }
+}
+
+
+int64_t
+MicrobeComponent::findOrganelle(
+    int32_t q,
+    int32_t r
+) const {
+    // Microbes have few organelles, a linear search over the compact
+    // array beats hashing
+    for (size_t i = 0; i < m_organelles.size(); ++i) {
+        if (m_organelles[i].q == q and m_organelles[i].r == r) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+luabind::object
+MicrobeComponent::getOrganelle(
+    int32_t q,
+    int32_t r
+) const {
+    int64_t index = this->findOrganelle(q, r);
+    if (index < 0) {
+        return luabind::object();
+    }
+    return m_organelleObjects[index];
+}
+
+
+void
+MicrobeComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_organelles.clear();
+    m_organelleObjects.clear();
+    StorageList organelles = storage.get<StorageList>("organelles");
+    m_organelles.reserve(organelles.size());
+    for (const StorageContainer& organelleStorage : organelles) {
+        Organelle entry;
+        // Scripts store all numbers as double
+        entry.q = static_cast<int32_t>(organelleStorage.get<double>("q", 0.0));
+        entry.r = static_cast<int32_t>(organelleStorage.get<double>("r", 0.0));
+        entry.storage = organelleStorage;
+        m_organelles.push_back(std::move(entry));
+    }
+    // No script objects until the scripts create them
+    m_organelleObjects.resize(m_organelles.size());
+}
+
+
+const std::vector<luabind::object>&
+MicrobeComponent::organelleObjects() const {
+    return m_organelleObjects;
+}
+
+
+size_t
+MicrobeComponent::organelleCount() const {
+    return m_organelles.size();
+}
+
+
+const std::vector<MicrobeComponent::Organelle>&
+MicrobeComponent::organelles() const {
+    return m_organelles;
+}
+
+
+bool
+MicrobeComponent::removeOrganelle(
+    int32_t q,
+    int32_t r
+) {
+    int64_t index = this->findOrganelle(q, r);
+    if (index < 0) {
+        return false;
+    }
+    // The order of organelles doesn't matter
+    std::swap(m_organelles[index], m_organelles.back());
+    m_organelles.pop_back();
+    std::swap(m_organelleObjects[index], m_organelleObjects.back());
+    m_organelleObjects.pop_back();
+    return true;
+}
+
+
+bool
+MicrobeComponent::removeVacuole(
+    AgentId agentId,
+    float capacity
+) {
+    auto iter = std::find_if(m_vacuoles.begin(), m_vacuoles.end(),
+        [agentId, capacity] (const Vacuole& vacuole) {
+            return vacuole.agentId == agentId and vacuole.capacity == capacity;
+        }
+    );
+    if (iter == m_vacuoles.end()) {
+        return false;
+    }
+    m_vacuoles.erase(iter);
+    bool hasAgent = std::any_of(m_vacuoles.begin(), m_vacuoles.end(),
+        [agentId] (const Vacuole& vacuole) {
+            return vacuole.agentId == agentId;
+        }
+    );
+    if (not hasAgent) {
+        m_vacuoleAgents.erase(
+            std::find(m_vacuoleAgents.begin(), m_vacuoleAgents.end(), agentId)
+        );
+    }
+    return true;
+}
+
+
+void
+MicrobeComponent::setOrganelleStorage(
+    int32_t q,
+    int32_t r,
+    StorageContainer storage
+) {
+    int64_t index = this->findOrganelle(q, r);
+    if (index < 0) {
+        throw std::invalid_argument("No organelle at these coordinates");
+    }
+    m_organelles[index].storage = std::move(storage);
+}
+
+
+StorageContainer
+MicrobeComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    StorageList organelles;
+    organelles.reserve(m_organelles.size());
+    for (const Organelle& entry : m_organelles) {
+        organelles.append(entry.storage);
+    }
+    storage.set<StorageList>("organelles", std::move(organelles));
+    return storage;
+}
+
+
+StorageList
+MicrobeComponent::takeLoadedOrganelles() {
+    StorageList loaded;
+    size_t kept = 0;
+    for (size_t i = 0; i < m_organelles.size(); ++i) {
+        if (not m_organelleObjects[i].is_valid()) {
+            loaded.append(m_organelles[i].storage);
+            continue;
+        }
+        if (kept != i) {
+            m_organelles[kept] = std::move(m_organelles[i]);
+            m_organelleObjects[kept] = std::move(m_organelleObjects[i]);
+        }
+        ++kept;
+    }
+    m_organelles.resize(kept);
+    m_organelleObjects.resize(kept);
+    return loaded;
+}
+
+
+const std::vector<AgentId>&
+MicrobeComponent::vacuoleAgents() const {
+    return m_vacuoleAgents;
+}
+
+
+size_t
+MicrobeComponent::vacuoleCount() const {
+    return m_vacuoles.size();
+}
+
+REGISTER_COMPONENT(MicrobeComponent)
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/hex_grid.h"
+#include "engine/serialization.h"
+#include "microbe_stage/agent.h"
+#include "scripting/luabind.h"
+
+#include <cstdint>
+#include <OgreVector3.h>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Holds data common to all microbes
+*
+* The organelles themselves are script objects, the component keeps them
+* in a compact array together with their position and their last
+* storage. Saving the microbe only copies those storages, so it never
+* has to call into the scripts. Scripts update an organelle's storage
+* with setOrganelleStorage() whenever it changed.
+*
+* Loaded organelles have no script object yet. The scripts create them
+* from takeLoadedOrganelles() and add them again with addOrganelle().
+*
+* Vacuoles are not saved, the storage organelles add them again when the
+* microbe is set up.
+*
+* Scripts should use the \c Microbe class instead of this component.
+*/
+class MicrobeComponent : public Component {
+    COMPONENT(MicrobeComponent)
+
+public:
+
+    /**
+    * @brief An organelle's position and its last storage
+    */
+    struct Organelle {
+
+        /**
+        * @brief Axial q coordinate of the organelle's center
+        */
+        int32_t q = 0;
+
+        /**
+        * @brief Axial r coordinate of the organelle's center
+        */
+        int32_t r = 0;
+
+        /**
+        * @brief The organelle's storage, as of the last
+        * setOrganelleStorage()
+        */
+        StorageContainer storage;
+
+    };
+
+    /**
+    * @brief A storage vacuole
+    */
+    struct Vacuole {
+
+        /**
+        * @brief The stored agent
+        */
+        AgentId agentId = NULL_AGENT;
+
+        /**
+        * @brief The space the vacuole adds
+        */
+        float capacity = 0.0f;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MicrobeComponent()
+    * - MicrobeComponent::addOrganelle
+    * - MicrobeComponent::addVacuole
+    * - MicrobeComponent::getOrganelle
+    * - @link m_facingTargetPoint facingTargetPoint @endlink
+    * - @link m_hexGrid hexGrid @endlink
+    * - @link m_initialized initialized @endlink
+    * - @link m_movementDirection movementDirection @endlink
+    * - MicrobeComponent::organelleCount
+    * - organelles(): iterates over the organelles' script objects
+    * - MicrobeComponent::removeOrganelle
+    * - MicrobeComponent::removeVacuole
+    * - MicrobeComponent::setOrganelleStorage
+    * - MicrobeComponent::takeLoadedOrganelles
+    * - vacuoleAgents(): iterates over the agents with at least one vacuole
+    * - MicrobeComponent::vacuoleCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Adds an organelle
+    *
+    * @param q
+    * @param r
+    *   Axial coordinates of the organelle's center
+    * @param organelle
+    *   The organelle's script object
+    *
+    * @return
+    *   \c false if there already is an organelle centered at (q, r)
+    */
+    bool
+    addOrganelle(
+        int32_t q,
+        int32_t r,
+        const luabind::object& organelle
+    );
+
+    /**
+    * @brief Adds a storage vacuole
+    *
+    * @param agentId
+    * @param capacity
+    */
+    void
+    addVacuole(
+        AgentId agentId,
+        float capacity
+    );
+
+    /**
+    * @brief The organelle centered at (q, r)
+    *
+    * @return
+    *   The organelle's script object or \c nil
+    */
+    luabind::object
+    getOrganelle(
+        int32_t q,
+        int32_t r
+    ) const;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief The script objects of the organelles, in the same order as
+    * organelles()
+    */
+    const std::vector<luabind::object>&
+    organelleObjects() const;
+
+    /**
+    * @brief The number of organelles, including loaded ones
+    */
+    size_t
+    organelleCount() const;
+
+    /**
+    * @brief The organelles
+    */
+    const std::vector<Organelle>&
+    organelles() const;
+
+    /**
+    * @brief Removes the organelle centered at (q, r)
+    *
+    * @return
+    *   \c false if there is no such organelle
+    */
+    bool
+    removeOrganelle(
+        int32_t q,
+        int32_t r
+    );
+
+    /**
+    * @brief Removes a storage vacuole
+    *
+    * @param agentId
+    * @param capacity
+    *
+    * @return
+    *   \c false if there is no vacuole of that agent and capacity
+    */
+    bool
+    removeVacuole(
+        AgentId agentId,
+        float capacity
+    );
+
+    /**
+    * @brief Sets the storage saved for an organelle
+    *
+    * @param q
+    * @param r
+    *   Axial coordinates of the organelle's center
+    * @param storage
+    *   The organelle's new storage
+    *
+    * @throw std::invalid_argument
+    *   If there is no organelle centered at (q, r)
+    */
+    void
+    setOrganelleStorage(
+        int32_t q,
+        int32_t r,
+        StorageContainer storage
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief Removes the organelles that don't have a script object yet
+    *
+    * @return
+    *   The removed organelles' storages
+    */
+    StorageList
+    takeLoadedOrganelles();
+
+    /**
+    * @brief The agents with at least one vacuole, each listed once
+    */
+    const std::vector<AgentId>&
+    vacuoleAgents() const;
+
+    /**
+    * @brief The number of vacuoles
+    */
+    size_t
+    vacuoleCount() const;
+
+    /**
+    * @brief The point the microbe should turn towards
+    */
+    Ogre::Vector3 m_facingTargetPoint = Ogre::Vector3::ZERO;
+
+    /**
+    * @brief Maps each hex cell to the key of the organelle occupying it
+    *
+    * Maintained by the scripts, which know the organelles' shapes.
+    */
+    HexGrid m_hexGrid;
+
+    /**
+    * @brief Whether the scripts have set up the microbe
+    */
+    bool m_initialized = false;
+
+    /**
+    * @brief The movement the microbe should make, in its local space
+    */
+    Ogre::Vector3 m_movementDirection = Ogre::Vector3::ZERO;
+
+private:
+
+    // Index into m_organelles or -1 if there's no organelle at (q, r)
+    int64_t
+    findOrganelle(
+        int32_t q,
+        int32_t r
+    ) const;
+
+    std::vector<luabind::object> m_organelleObjects;
+
+    std::vector<Organelle> m_organelles;
+
+    std::vector<AgentId> m_vacuoleAgents;
+
+    std::vector<Vacuole> m_vacuoles;
+
+};
+
+}
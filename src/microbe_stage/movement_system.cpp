@@ -0,0 +1,253 @@
+#include "microbe_stage/movement_system.h"
+
+#include "bullet/rigid_body_system.h"
+#include "engine/component_factory.h"
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "microbe_stage/microbe_component.h"
+#include "microbe_stage/process_system.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <OgreMath.h>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// MovementComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+MovementComponent::luaBindings() {
+    using namespace luabind;
+    return class_<MovementComponent, Component>("MovementComponent")
+        .enum_("ID") [
+            value("TYPE_ID", MovementComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &MovementComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("addThruster", &MovementComponent::addThruster)
+        .def("removeThruster", &MovementComponent::removeThruster)
+        .def("thrusterCount", &MovementComponent::thrusterCount)
+        .def_readwrite("energyAgent", &MovementComponent::m_energyAgent)
+    ;
+}
+
+
+void
+MovementComponent::addThruster(
+    int32_t q,
+    int32_t r,
+    const Ogre::Vector3& force,
+    float torque,
+    float energyMultiplier
+) {
+    Thruster thruster;
+    thruster.energyMultiplier = energyMultiplier;
+    thruster.force = force;
+    thruster.q = q;
+    thruster.r = r;
+    thruster.torque = torque;
+    m_thrusters.push_back(thruster);
+}
+
+
+void
+MovementComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_energyAgent = storage.get<AgentId>("energyAgent", NULL_AGENT);
+}
+
+
+bool
+MovementComponent::removeThruster(
+    int32_t q,
+    int32_t r
+) {
+    auto iter = std::find_if(m_thrusters.begin(), m_thrusters.end(),
+        [q, r] (const Thruster& thruster) {
+            return thruster.q == q and thruster.r == r;
+        }
+    );
+    if (iter == m_thrusters.end()) {
+        return false;
+    }
+    m_thrusters.erase(iter);
+    return true;
+}
+
+
+StorageContainer
+MovementComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    storage.set<AgentId>("energyAgent", m_energyAgent);
+    return storage;
+}
+
+
+size_t
+MovementComponent::thrusterCount() const {
+    return m_thrusters.size();
+}
+
+
+const std::vector<MovementComponent::Thruster>&
+MovementComponent::thrusters() const {
+    return m_thrusters;
+}
+
+REGISTER_COMPONENT(MovementComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MovementSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+MovementSystem::luaBindings() {
+    using namespace luabind;
+    return class_<MovementSystem, System>("MovementSystem")
+        .def(constructor<>())
+    ;
+}
+
+
+struct MovementSystem::Implementation {
+
+    // The forward impulse of all thrusters, taking their energy
+    static float
+    thrust(
+        const MovementComponent& movement,
+        const Ogre::Vector3& direction,
+        VacuoleComponent& vacuole,
+        int milliseconds
+    ) {
+        float seconds = milliseconds / 1000.0f;
+        float impulse = 0.0f;
+        for (const auto& thruster : movement.thrusters()) {
+            float forceMagnitude = thruster.force.dotProduct(direction);
+            if (forceMagnitude == 0.0f) {
+                continue;
+            }
+            float energy = std::abs(thruster.energyMultiplier * forceMagnitude * seconds);
+            float availableEnergy = movement.m_energyAgent == NULL_AGENT ?
+                0.0f : vacuole.takeAgent(movement.m_energyAgent, energy);
+            if (availableEnergy < energy) {
+                forceMagnitude = std::copysign(availableEnergy / seconds, forceMagnitude);
+            }
+            // Thrusters only push
+            if (forceMagnitude > 0.0f) {
+                impulse += forceMagnitude * seconds;
+            }
+        }
+        return impulse;
+    }
+
+    // The angle to turn by towards the target, around the z axis
+    static Ogre::Radian
+    turnAngle(
+        const OgreSceneNodeComponent::Transform& transform,
+        const Ogre::Vector3& targetPoint
+    ) {
+        Ogre::Vector3 targetDirection =
+            transform.orientation.Inverse() * (targetPoint - transform.position);
+        // Microbes move in the plane, but the target may be slightly off
+        return Ogre::Math::ATan2(-targetDirection.x, targetDirection.y);
+    }
+
+    EntityFilter<
+        MicrobeComponent,
+        MovementComponent,
+        OgreSceneNodeComponent,
+        RigidBodyComponent,
+        VacuoleComponent
+    > m_entities;
+
+};
+
+
+MovementSystem::MovementSystem()
+  : m_impl(new Implementation())
+{
+    this->setFixedRate(true);
+    this->declareRead(MicrobeComponent::TYPE_ID);
+    this->declareRead(MovementComponent::TYPE_ID);
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+    this->declareWrite(RigidBodyComponent::TYPE_ID);
+    this->declareWrite(VacuoleComponent::TYPE_ID);
+}
+
+
+MovementSystem::~MovementSystem() {}
+
+
+void
+MovementSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+void
+MovementSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    System::shutdown();
+}
+
+
+void
+MovementSystem::update(
+    int milliseconds
+) {
+    if (milliseconds <= 0) {
+        return;
+    }
+    for (const auto& entry : m_impl->m_entities) {
+        MicrobeComponent* microbe = std::get<0>(entry.second);
+        MovementComponent* movement = std::get<1>(entry.second);
+        OgreSceneNodeComponent* sceneNode = std::get<2>(entry.second);
+        RigidBodyComponent* rigidBody = std::get<3>(entry.second);
+        VacuoleComponent* vacuole = std::get<4>(entry.second);
+        if (movement->thrusterCount() == 0) {
+            continue;
+        }
+        const auto& transform = sceneNode->m_transform;
+        // Turn
+        float torque = 0.0f;
+        for (const auto& thruster : movement->thrusters()) {
+            torque += thruster.torque;
+        }
+        if (torque != 0.0f) {
+            Ogre::Radian alpha = Implementation::turnAngle(
+                transform,
+                microbe->m_facingTargetPoint
+            );
+            if (std::abs(alpha.valueDegrees()) > 1.0f) {
+                rigidBody->applyTorque(Ogre::Vector3(0, 0, torque * alpha.valueRadians()));
+            }
+        }
+        // Move
+        const Ogre::Vector3& direction = microbe->m_movementDirection;
+        if (direction.isZeroLength()) {
+            continue;
+        }
+        float impulse = Implementation::thrust(
+            *movement,
+            direction,
+            *vacuole,
+            milliseconds
+        );
+        if (impulse > 0.0f) {
+            rigidBody->applyCentralImpulse(transform.orientation * (direction * impulse));
+        }
+    }
+}
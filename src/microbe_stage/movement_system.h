@@ -0,0 +1,219 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "microbe_stage/agent.h"
+
+#include <cstdint>
+#include <memory>
+#include <OgreVector3.h>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief The thrusters of a microbe's movement organelles
+*
+* Each movement organelle adds one thruster, keyed by the organelle's
+* position. MovementSystem sums them up and drives the microbe's rigid body
+* towards MicrobeComponent::m_movementDirection and
+* MicrobeComponent::m_facingTargetPoint.
+*
+* Like the capacities of a VacuoleComponent, the thrusters are added by the
+* organelles whenever the microbe is set up and are not saved.
+*/
+class MovementComponent : public Component {
+    COMPONENT(Movement)
+
+public:
+
+    /**
+    * @brief A movement organelle's contribution
+    */
+    struct Thruster {
+
+        /**
+        * @brief The energy taken per unit of force and second
+        */
+        float energyMultiplier = 0.0f;
+
+        /**
+        * @brief The force the organelle can exert, in the microbe's space
+        */
+        Ogre::Vector3 force = Ogre::Vector3::ZERO;
+
+        /**
+        * @brief Axial q coordinate of the organelle's center
+        */
+        int32_t q = 0;
+
+        /**
+        * @brief Axial r coordinate of the organelle's center
+        */
+        int32_t r = 0;
+
+        /**
+        * @brief The torque the organelle can exert, around the z axis
+        */
+        float torque = 0.0f;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MovementComponent()
+    * - MovementComponent::addThruster
+    * - @link m_energyAgent energyAgent @endlink
+    * - MovementComponent::removeThruster
+    * - MovementComponent::thrusterCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Adds a movement organelle's thruster
+    *
+    * @param q
+    * @param r
+    *   Axial coordinates of the organelle's center
+    * @param force
+    *   The force the organelle can exert, in the microbe's space
+    * @param torque
+    *   The torque the organelle can exert
+    * @param energyMultiplier
+    *   The energy taken per unit of force and second
+    */
+    void
+    addThruster(
+        int32_t q,
+        int32_t r,
+        const Ogre::Vector3& force,
+        float torque,
+        float energyMultiplier
+    );
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief Removes the thruster of the organelle centered at (q, r)
+    *
+    * @return
+    *   \c false if there is no such thruster
+    */
+    bool
+    removeThruster(
+        int32_t q,
+        int32_t r
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief The number of thrusters
+    */
+    size_t
+    thrusterCount() const;
+
+    /**
+    * @brief The thrusters
+    */
+    const std::vector<Thruster>&
+    thrusters() const;
+
+    /**
+    * @brief The agent the thrusters take their energy from
+    *
+    * Without one, the microbe can turn but not move.
+    */
+    AgentId m_energyAgent = NULL_AGENT;
+
+private:
+
+    std::vector<Thruster> m_thrusters;
+
+};
+
+
+/**
+* @brief Moves and turns microbes with their movement organelles
+*
+* For each microbe, the thrusters of its MovementComponent are summed up
+* into one central impulse and one torque per tick:
+* - Each thruster pushes with the part of its force along the movement
+*   direction, taking the energy for it from the VacuoleComponent. Lacking
+*   energy, it pushes less.
+* - The thrusters' torques turn the microbe towards its facing target.
+*
+* Runs at the fixed rate, before the physics step.
+*/
+class MovementSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MovementSystem()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    MovementSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~MovementSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Applies the thrust of this tick
+    *
+    * @param milliseconds
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,567 @@
+#include "microbe_stage/process_system.h"
+
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "engine/rng.h"
+#include "engine/serialization.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+using namespace thrive;
+
+// Time between two distributions of stored agents to the processes
+static const Milliseconds DISTRIBUTION_INTERVAL = 100;
+
+// The amount of an agent a process receives per distribution
+static const float DISTRIBUTION_AMOUNT = 1.0f;
+
+////////////////////////////////////////////////////////////////////////////////
+// VacuoleComponent
+////////////////////////////////////////////////////////////////////////////////
+
+static unsigned int
+VacuoleComponent_agentAmountCount(
+    const VacuoleComponent* self
+) {
+    return self->amounts().values().size();
+}
+
+
+static luabind::object
+VacuoleComponent_agentAmountData(
+    const VacuoleComponent* self,
+    lua_State* L
+) {
+    return lightUserdata(L, self->amounts().values().data());
+}
+
+
+luabind::scope
+VacuoleComponent::luaBindings() {
+    using namespace luabind;
+    return class_<VacuoleComponent, Component>("VacuoleComponent")
+        .enum_("ID") [
+            value("TYPE_ID", VacuoleComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &VacuoleComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("addCapacity", &VacuoleComponent::addCapacity)
+        .def("agentAmount", &VacuoleComponent::agentAmount)
+        .def("agentAmountCount", VacuoleComponent_agentAmountCount)
+        .def("agentAmountData", VacuoleComponent_agentAmountData)
+        .def("canStoreAgent", &VacuoleComponent::canStoreAgent)
+        .def("capacity", &VacuoleComponent::capacity)
+        .def("removeCapacity", &VacuoleComponent::removeCapacity)
+        .def("storeAgent", &VacuoleComponent::storeAgent)
+        .def("takeAgent", &VacuoleComponent::takeAgent)
+    ;
+}
+
+
+void
+VacuoleComponent::addCapacity(
+    AgentId agentId,
+    float capacity
+) {
+    m_capacities[agentId] += capacity;
+    m_agents.insert(agentId);
+}
+
+
+float
+VacuoleComponent::agentAmount(
+    AgentId agentId
+) const {
+    return m_amounts.get(agentId);
+}
+
+
+const DenseIdSet<AgentId>&
+VacuoleComponent::agents() const {
+    return m_agents;
+}
+
+
+const DenseIdMap<AgentId, float>&
+VacuoleComponent::amounts() const {
+    return m_amounts;
+}
+
+
+bool
+VacuoleComponent::canStoreAgent(
+    AgentId agentId
+) const {
+    return m_amounts.get(agentId) < m_capacities.get(agentId);
+}
+
+
+float
+VacuoleComponent::capacity(
+    AgentId agentId
+) const {
+    return m_capacities.get(agentId);
+}
+
+
+void
+VacuoleComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    StorageList agents = storage.get<StorageList>("agents");
+    for (const StorageContainer& container : agents) {
+        AgentId agentId = container.get<AgentId>("agentId");
+        m_amounts[agentId] = container.get<float>("amount");
+        m_agents.insert(agentId);
+    }
+}
+
+
+void
+VacuoleComponent::removeCapacity(
+    AgentId agentId,
+    float capacity
+) {
+    float& remaining = m_capacities[agentId];
+    remaining = std::max(0.0f, remaining - capacity);
+    float& amount = m_amounts[agentId];
+    amount = std::min(amount, remaining);
+}
+
+
+StorageContainer
+VacuoleComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    StorageList agents;
+    agents.reserve(m_agents.size());
+    for (AgentId agentId : m_agents) {
+        StorageContainer container;
+        container.set<AgentId>("agentId", agentId);
+        container.set<float>("amount", m_amounts.get(agentId));
+        agents.append(container);
+    }
+    storage.set<StorageList>("agents", agents);
+    return storage;
+}
+
+
+float
+VacuoleComponent::storeAgent(
+    AgentId agentId,
+    float amount
+) {
+    float& stored = m_amounts[agentId];
+    float storedAmount = std::max(0.0f, std::min(amount, m_capacities.get(agentId) - stored));
+    stored += storedAmount;
+    return amount - storedAmount;
+}
+
+
+float
+VacuoleComponent::takeAgent(
+    AgentId agentId,
+    float maxAmount
+) {
+    float& stored = m_amounts[agentId];
+    float taken = std::max(0.0f, std::min(maxAmount, stored));
+    stored -= taken;
+    return taken;
+}
+
+REGISTER_COMPONENT(VacuoleComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+ProcessComponent::luaBindings() {
+    using namespace luabind;
+    return class_<ProcessComponent, Component>("ProcessComponent")
+        .enum_("ID") [
+            value("TYPE_ID", ProcessComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &ProcessComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("addInput", &ProcessComponent::addInput)
+        .def("addOutput", &ProcessComponent::addOutput)
+        .def("addProcess", &ProcessComponent::addProcess)
+        .def("bufferedAmount", &ProcessComponent::bufferedAmount)
+        .def("fillRatio", &ProcessComponent::fillRatio)
+        .def("remainingCooldown", &ProcessComponent::remainingCooldown)
+        .def("removeProcess", &ProcessComponent::removeProcess)
+        .def("setRemainingCooldown", &ProcessComponent::setRemainingCooldown)
+        .def("storeAgent", &ProcessComponent::storeAgent)
+        .def("takeChanges", &ProcessComponent::takeChanges)
+        .def("wantsAgent", &ProcessComponent::wantsAgent)
+    ;
+}
+
+
+void
+ProcessComponent::addInput(
+    unsigned int index,
+    AgentId agentId,
+    float amount
+) {
+    Process& process = this->process(index);
+    process.inputs.emplace_back(agentId, amount);
+    process.inputSum += amount;
+    process.hasChanges = true;
+}
+
+
+void
+ProcessComponent::addOutput(
+    unsigned int index,
+    AgentId agentId,
+    float amount
+) {
+    this->process(index).outputs.emplace_back(agentId, amount);
+}
+
+
+unsigned int
+ProcessComponent::addProcess(
+    Milliseconds cooldown
+) {
+    Process process;
+    process.cooldown = cooldown;
+    process.remainingCooldown = cooldown;
+    m_processes.push_back(std::move(process));
+    return m_processes.size() - 1;
+}
+
+
+float
+ProcessComponent::bufferedAmount(
+    unsigned int index,
+    AgentId agentId
+) const {
+    return this->process(index).buffers.get(agentId);
+}
+
+
+float
+ProcessComponent::fillRatio(
+    unsigned int index
+) const {
+    const Process& process = this->process(index);
+    if (not (process.inputSum > 0.0f)) {
+        return 1.0f;
+    }
+    return std::min(1.0f, process.bufferSum / process.inputSum);
+}
+
+
+void
+ProcessComponent::load(
+    const StorageContainer& storage
+) {
+    // The organelles restore the processes, see the class documentation
+    Component::load(storage);
+}
+
+
+ProcessComponent::Process&
+ProcessComponent::process(
+    unsigned int index
+) {
+    if (index >= m_processes.size() or m_processes[index].isRemoved) {
+        throw std::out_of_range("Process index does not exist");
+    }
+    return m_processes[index];
+}
+
+
+const ProcessComponent::Process&
+ProcessComponent::process(
+    unsigned int index
+) const {
+    if (index >= m_processes.size() or m_processes[index].isRemoved) {
+        throw std::out_of_range("Process index does not exist");
+    }
+    return m_processes[index];
+}
+
+
+Milliseconds
+ProcessComponent::remainingCooldown(
+    unsigned int index
+) const {
+    return this->process(index).remainingCooldown;
+}
+
+
+void
+ProcessComponent::removeProcess(
+    unsigned int index
+) {
+    Process& process = this->process(index);
+    process = Process();
+    process.isRemoved = true;
+}
+
+
+void
+ProcessComponent::setRemainingCooldown(
+    unsigned int index,
+    Milliseconds remainingCooldown
+) {
+    this->process(index).remainingCooldown = remainingCooldown;
+}
+
+
+StorageContainer
+ProcessComponent::storage() const {
+    return Component::storage();
+}
+
+
+void
+ProcessComponent::storeAgent(
+    unsigned int index,
+    AgentId agentId,
+    float amount
+) {
+    Process& process = this->process(index);
+    process.buffers[agentId] += amount;
+    process.bufferSum += amount;
+    process.hasChanges = true;
+}
+
+
+bool
+ProcessComponent::takeChanges(
+    unsigned int index
+) {
+    Process& process = this->process(index);
+    bool hasChanges = process.hasChanges;
+    process.hasChanges = false;
+    return hasChanges;
+}
+
+
+bool
+ProcessComponent::wantsAgent(
+    unsigned int index,
+    AgentId agentId
+) const {
+    const Process& process = this->process(index);
+    for (const auto& input : process.inputs) {
+        if (input.first != agentId) {
+            continue;
+        }
+        float missing = input.second - process.buffers.get(agentId);
+        // The buffer is fuller, relative to the recipe, than the cooldown
+        // has left to run
+        return missing > 0.0f and
+            process.remainingCooldown / missing < process.cooldown / input.second;
+    }
+    return false;
+}
+
+REGISTER_COMPONENT(ProcessComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+ProcessSystem::luaBindings() {
+    using namespace luabind;
+    return class_<ProcessSystem, System>("ProcessSystem")
+        .def(constructor<>())
+    ;
+}
+
+
+struct ProcessSystem::Implementation {
+
+    static void
+    storeAgent(
+        VacuoleComponent* vacuole,
+        AgentEmitterComponent* emitter,
+        OgreSceneNodeComponent* sceneNode,
+        AgentId agentId,
+        float amount
+    ) {
+        float excess = vacuole->storeAgent(agentId, amount);
+        if (excess > 0.0f and emitter and sceneNode) {
+            emitter->ejectAgent(agentId, excess, sceneNode->m_transform.orientation);
+        }
+    }
+
+    EntityFilter<
+        VacuoleComponent,
+        AgentAbsorberComponent,
+        Optional<ProcessComponent>,
+        Optional<AgentEmitterComponent>,
+        Optional<OgreSceneNodeComponent>
+    > m_entities;
+
+    // Absorbed agents since the last update, merged per absorber and agent
+    std::vector<AgentAbsorbedEvent> m_absorbed;
+
+    EventCursor m_absorbedCursor;
+
+    EventChannel<AgentAbsorbedEvent>* m_absorbedEvents = nullptr;
+
+    // Processes that want the agent being distributed, reused
+    std::vector<ProcessComponent::Process*> m_candidates;
+
+};
+
+
+ProcessSystem::ProcessSystem()
+  : m_impl(new Implementation())
+{
+    this->setFixedRate(true);
+}
+
+
+ProcessSystem::~ProcessSystem() {}
+
+
+void
+ProcessSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_absorbedEvents = &AgentAbsorbedEvent::channel(gameState);
+}
+
+
+void
+ProcessSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_absorbedEvents = nullptr;
+    System::shutdown();
+}
+
+
+void
+ProcessSystem::update(int milliseconds) {
+    RNG& rng = this->engine()->rng();
+    // Absorbed agents
+    auto& absorbed = m_impl->m_absorbed;
+    absorbed.clear();
+    m_impl->m_absorbedEvents->read(m_impl->m_absorbedCursor,
+        [&absorbed] (const AgentAbsorbedEvent& event) {
+            absorbed.push_back(event);
+        }
+    );
+    std::sort(absorbed.begin(), absorbed.end(),
+        [] (const AgentAbsorbedEvent& lhs, const AgentAbsorbedEvent& rhs) {
+            return std::tie(lhs.absorber, lhs.agentId) < std::tie(rhs.absorber, rhs.agentId);
+        }
+    );
+    const auto& entities = m_impl->m_entities.entities();
+    for (size_t i = 0; i < absorbed.size();) {
+        AgentAbsorbedEvent event = absorbed[i];
+        for (++i; i < absorbed.size(); ++i) {
+            if (absorbed[i].absorber != event.absorber or absorbed[i].agentId != event.agentId) {
+                break;
+            }
+            event.amount += absorbed[i].amount;
+        }
+        auto entry = entities.find(event.absorber);
+        if (entry == entities.end()) {
+            continue;
+        }
+        VacuoleComponent* vacuole = std::get<0>(entry->second);
+        if (vacuole->agents().contains(event.agentId)) {
+            Implementation::storeAgent(
+                vacuole,
+                std::get<3>(entry->second),
+                std::get<4>(entry->second),
+                event.agentId,
+                event.amount
+            );
+        }
+    }
+    auto& candidates = m_impl->m_candidates;
+    for (const auto& entry : m_impl->m_entities) {
+        VacuoleComponent* vacuole = std::get<0>(entry.second);
+        AgentAbsorberComponent* absorber = std::get<1>(entry.second);
+        ProcessComponent* processComponent = std::get<2>(entry.second);
+        AgentEmitterComponent* emitter = std::get<3>(entry.second);
+        OgreSceneNodeComponent* sceneNode = std::get<4>(entry.second);
+        if (processComponent) {
+            auto& processes = processComponent->m_processes;
+            // Distribute stored agents to the processes that want them
+            vacuole->m_timeSinceDistribution += milliseconds;
+            while (vacuole->m_timeSinceDistribution > DISTRIBUTION_INTERVAL) {
+                vacuole->m_timeSinceDistribution -= DISTRIBUTION_INTERVAL;
+                for (AgentId agentId : vacuole->agents()) {
+                    if (not (vacuole->agentAmount(agentId) > 0.0f)) {
+                        continue;
+                    }
+                    candidates.clear();
+                    for (unsigned int i = 0; i < processes.size(); ++i) {
+                        if (not processes[i].isRemoved and processComponent->wantsAgent(i, agentId)) {
+                            candidates.push_back(&processes[i]);
+                        }
+                    }
+                    if (candidates.empty()) {
+                        continue;
+                    }
+                    ProcessComponent::Process* process = candidates[
+                        rng.getInt(0, candidates.size() - 1)
+                    ];
+                    float amount = vacuole->takeAgent(agentId, DISTRIBUTION_AMOUNT);
+                    process->buffers[agentId] += amount;
+                    process->bufferSum += amount;
+                    process->hasChanges = true;
+                }
+            }
+            // Run the processes
+            for (auto& process : processes) {
+                if (process.isRemoved) {
+                    continue;
+                }
+                process.remainingCooldown = std::max(0, process.remainingCooldown - milliseconds);
+                if (process.remainingCooldown > 0) {
+                    continue;
+                }
+                bool hasInputs = std::all_of(
+                    process.inputs.begin(),
+                    process.inputs.end(),
+                    [&process] (const std::pair<AgentId, float>& input) {
+                        return process.buffers.get(input.first) >= input.second;
+                    }
+                );
+                if (not hasInputs) {
+                    continue;
+                }
+                process.remainingCooldown = process.cooldown;
+                for (const auto& input : process.inputs) {
+                    process.buffers[input.first] -= input.second;
+                    process.bufferSum -= input.second;
+                }
+                process.hasChanges = true;
+                for (const auto& output : process.outputs) {
+                    Implementation::storeAgent(vacuole, emitter, sceneNode, output.first, output.second);
+                }
+            }
+        }
+        for (AgentId agentId : vacuole->agents()) {
+            absorber->setCanAbsorbAgent(agentId, vacuole->canStoreAgent(agentId));
+        }
+    }
+}
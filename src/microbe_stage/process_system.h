@@ -0,0 +1,515 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "microbe_stage/agent.h"
+#include "util/dense_id_map.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Stores a microbe's agents
+*
+* Holds the total capacity and the stored amount of each agent. The
+* capacities are added by the microbe's storage organelles whenever the
+* microbe is set up, so only the amounts are saved.
+*/
+class VacuoleComponent : public Component {
+    COMPONENT(Vacuole)
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - VacuoleComponent()
+    * - VacuoleComponent::addCapacity
+    * - VacuoleComponent::agentAmount
+    * - agentAmountData(): light userdata pointing at the amounts as an
+    *   array of floats indexed by agent id, for the LuaJIT FFI. Only
+    *   valid until an agent id beyond the array is stored.
+    * - agentAmountCount(): the length of that array
+    * - VacuoleComponent::canStoreAgent
+    * - VacuoleComponent::capacity
+    * - VacuoleComponent::removeCapacity
+    * - VacuoleComponent::storeAgent
+    * - VacuoleComponent::takeAgent
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Adds storage space for an agent
+    *
+    * @param agentId
+    * @param capacity
+    */
+    void
+    addCapacity(
+        AgentId agentId,
+        float capacity
+    );
+
+    /**
+    * @brief The stored amount of an agent
+    *
+    * @param agentId
+    */
+    float
+    agentAmount(
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief The agents with storage space or a stored amount
+    */
+    const DenseIdSet<AgentId>&
+    agents() const;
+
+    /**
+    * @brief The stored amounts, indexed by agent id
+    */
+    const DenseIdMap<AgentId, float>&
+    amounts() const;
+
+    /**
+    * @brief Whether there's space left for an agent
+    *
+    * @param agentId
+    */
+    bool
+    canStoreAgent(
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief The storage space for an agent
+    *
+    * @param agentId
+    */
+    float
+    capacity(
+        AgentId agentId
+    ) const;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief Removes storage space for an agent
+    *
+    * A stored amount beyond the remaining capacity is discarded.
+    *
+    * @param agentId
+    * @param capacity
+    */
+    void
+    removeCapacity(
+        AgentId agentId,
+        float capacity
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief Stores as much of an agent as fits
+    *
+    * @param agentId
+    * @param amount
+    *
+    * @return
+    *   The amount that didn't fit
+    */
+    float
+    storeAgent(
+        AgentId agentId,
+        float amount
+    );
+
+    /**
+    * @brief Takes up to a maximum amount of an agent out of storage
+    *
+    * @param agentId
+    * @param maxAmount
+    *
+    * @return
+    *   The amount taken, between 0 and \a maxAmount
+    */
+    float
+    takeAgent(
+        AgentId agentId,
+        float maxAmount
+    );
+
+    /**
+    * @brief Time since the agents were last distributed to the processes
+    *
+    * For use by ProcessSystem
+    */
+    Milliseconds m_timeSinceDistribution = 0;
+
+private:
+
+    DenseIdSet<AgentId> m_agents;
+
+    DenseIdMap<AgentId, float> m_amounts;
+
+    DenseIdMap<AgentId, float> m_capacities;
+
+};
+
+
+/**
+* @brief The processes of a microbe's process organelles
+*
+* Each process has a recipe of input and output agents and a cooldown.
+* Once its input buffers hold a full recipe's worth and its cooldown has
+* passed, ProcessSystem turns the inputs into outputs in the microbe's
+* VacuoleComponent.
+*
+* Processes are identified by the index addProcess() returns. Like
+* capacities, they are added by the organelles whenever the microbe is set
+* up. The component saves none of their state, as the indices depend on
+* the order the organelles are set up in. Instead, each process organelle
+* saves its process' remaining cooldown and buffered inputs and restores
+* them when it adds the process again, see process_organelle.lua.
+*/
+class ProcessComponent : public Component {
+    COMPONENT(Process)
+
+public:
+
+    /**
+    * @brief A single process
+    */
+    struct Process {
+
+        /**
+        * @brief Buffered input agents
+        */
+        DenseIdMap<AgentId, float> buffers;
+
+        /**
+        * @brief Total amount in the buffers
+        */
+        float bufferSum = 0.0f;
+
+        /**
+        * @brief Minimum time between two productions
+        */
+        Milliseconds cooldown = 0;
+
+        /**
+        * @brief Whether the buffers have changed since takeChanges()
+        */
+        bool hasChanges = false;
+
+        /**
+        * @brief Input agents and the amount of each needed per production
+        */
+        std::vector<std::pair<AgentId, float>> inputs;
+
+        /**
+        * @brief Total amount of input agents needed per production
+        */
+        float inputSum = 0.0f;
+
+        /**
+        * @brief Whether the process has been removed
+        */
+        bool isRemoved = false;
+
+        /**
+        * @brief Output agents and the amount of each produced
+        */
+        std::vector<std::pair<AgentId, float>> outputs;
+
+        /**
+        * @brief Time left until the next production is possible
+        */
+        Milliseconds remainingCooldown = 0;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - ProcessComponent()
+    * - ProcessComponent::addInput
+    * - ProcessComponent::addOutput
+    * - ProcessComponent::addProcess
+    * - ProcessComponent::bufferedAmount
+    * - ProcessComponent::fillRatio
+    * - ProcessComponent::remainingCooldown
+    * - ProcessComponent::removeProcess
+    * - ProcessComponent::setRemainingCooldown
+    * - ProcessComponent::storeAgent
+    * - ProcessComponent::takeChanges
+    * - ProcessComponent::wantsAgent
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Adds an input agent to a process' recipe
+    *
+    * @param index
+    *   The process' index
+    * @param agentId
+    * @param amount
+    *   The amount needed per production
+    */
+    void
+    addInput(
+        unsigned int index,
+        AgentId agentId,
+        float amount
+    );
+
+    /**
+    * @brief Adds an output agent to a process' recipe
+    *
+    * @param index
+    *   The process' index
+    * @param agentId
+    * @param amount
+    *   The amount produced per production
+    */
+    void
+    addOutput(
+        unsigned int index,
+        AgentId agentId,
+        float amount
+    );
+
+    /**
+    * @brief Adds a process without any inputs or outputs
+    *
+    * @param cooldown
+    *   Minimum time between two productions
+    *
+    * @return
+    *   The new process' index
+    */
+    unsigned int
+    addProcess(
+        Milliseconds cooldown
+    );
+
+    /**
+    * @brief The amount of an agent in a process' input buffer
+    *
+    * @param index
+    *   The process' index
+    * @param agentId
+    */
+    float
+    bufferedAmount(
+        unsigned int index,
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief How close a process' buffers are to a full recipe
+    *
+    * @param index
+    *   The process' index
+    *
+    * @return
+    *   Between 0 and 1
+    */
+    float
+    fillRatio(
+        unsigned int index
+    ) const;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief Time left until a process can produce again
+    *
+    * @param index
+    *   The process' index
+    */
+    Milliseconds
+    remainingCooldown(
+        unsigned int index
+    ) const;
+
+    /**
+    * @brief Removes a process
+    *
+    * The indices of the other processes stay valid.
+    *
+    * @param index
+    *   The process' index
+    */
+    void
+    removeProcess(
+        unsigned int index
+    );
+
+    /**
+    * @brief Sets the time left until a process can produce again
+    *
+    * @param index
+    *   The process' index
+    * @param remainingCooldown
+    */
+    void
+    setRemainingCooldown(
+        unsigned int index,
+        Milliseconds remainingCooldown
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief Adds to a process' input buffer
+    *
+    * @param index
+    *   The process' index
+    * @param agentId
+    * @param amount
+    */
+    void
+    storeAgent(
+        unsigned int index,
+        AgentId agentId,
+        float amount
+    );
+
+    /**
+    * @brief Checks and resets whether a process' buffers have changed
+    *
+    * Lets scripts update the organelle's looks only when needed.
+    *
+    * @param index
+    *   The process' index
+    */
+    bool
+    takeChanges(
+        unsigned int index
+    );
+
+    /**
+    * @brief Whether a process wants more of an agent
+    *
+    * A process wants an input agent if its buffer is fuller, relative to
+    * the recipe, than its cooldown has left to run.
+    *
+    * @param index
+    *   The process' index
+    * @param agentId
+    */
+    bool
+    wantsAgent(
+        unsigned int index,
+        AgentId agentId
+    ) const;
+
+    /**
+    * @brief The processes, including removed ones
+    */
+    std::vector<Process> m_processes;
+
+private:
+
+    Process&
+    process(
+        unsigned int index
+    );
+
+    const Process&
+    process(
+        unsigned int index
+    ) const;
+
+};
+
+
+/**
+* @brief Does the agent accounting of microbes
+*
+* Every update, for each entity with a VacuoleComponent and an
+* AgentAbsorberComponent:
+* - stores the agents absorbed since the last update, see
+*   AgentAbsorbedEvent,
+* - moves stored agents into the input buffers of the ProcessComponent's
+*   processes,
+* - runs the processes whose buffers are full and cooldown is over,
+* - ejects whatever doesn't fit through the AgentEmitterComponent,
+* - tells the absorber which agents there's still space for.
+*/
+class ProcessSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - ProcessSystem()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    ProcessSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~ProcessSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Updates the system
+    *
+    * @param milliseconds
+    */
+    void update(int milliseconds) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
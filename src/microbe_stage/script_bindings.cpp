@@ -2,6 +2,15 @@
 
 #include "scripting/luabind.h"
 #include "microbe_stage/agent.h"
+#include "microbe_stage/agent_field_system.h"
+#include "microbe_stage/agent_gpu_system.h"
+#include "microbe_stage/microbe_ai_system.h"
+#include "microbe_stage/microbe_component.h"
+#include "microbe_stage/movement_system.h"
+#include "microbe_stage/process_system.h"
+#include "microbe_stage/shard_system.h"
+#include "microbe_stage/simulation_lod_system.h"
+#include "microbe_stage/spawn_system.h"
 
 luabind::scope
 thrive::MicrobeBindings::luaBindings() {
@@ -11,12 +20,30 @@ thrive::MicrobeBindings::luaBindings() {
         AgentAbsorberComponent::luaBindings(),
         AgentEmitterComponent::luaBindings(),
         TimedAgentEmitterComponent::luaBindings(),
+        MicrobeAIControllerComponent::luaBindings(),
+        MicrobeComponent::luaBindings(),
+        MovementComponent::luaBindings(),
+        ProcessComponent::luaBindings(),
+        SimulationLodComponent::luaBindings(),
+        VacuoleComponent::luaBindings(),
         // Systems
         AgentLifetimeSystem::luaBindings(),
         AgentMovementSystem::luaBindings(),
         AgentAbsorberSystem::luaBindings(),
+        AgentCoalescingSystem::luaBindings(),
         AgentEmitterSystem::luaBindings(),
+        AgentFieldSystem::luaBindings(),
+        AgentGpuSystem::luaBindings(),
+        AgentRenderSystem::luaBindings(),
+        MicrobeAISystem::luaBindings(),
+        MovementSystem::luaBindings(),
+        ProcessSystem::luaBindings(),
+        ShardSystem::luaBindings(),
+        SimulationLodSystem::luaBindings(),
+        SpawnSystem::luaBindings(),
         // Other
+        AgentAbsorbedEvent::luaBindings(),
+        EventChannel<AgentAbsorbedEvent>::luaBindings("AgentAbsorbedChannel"),
         AgentRegistry::luaBindings()
     );
 }
@@ -0,0 +1,510 @@
+#include "microbe_stage/shard_system.h"
+
+#include "bullet/rigid_body_system.h"
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/entity_prototype.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "ogre/scene_node_system.h"
+#include "ogre/world_sector_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <OgreQuaternion.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+luabind::scope
+ShardSystem::luaBindings() {
+    using namespace luabind;
+    return class_<ShardSystem, System>("ShardSystem")
+        .scope [
+            def("find", &ShardSystem::find)
+        ]
+        .def(constructor<int32_t>())
+        .def("addGhostType", &ShardSystem::addGhostType)
+        .def("assignSectors", &ShardSystem::assignSectors)
+        .def("isBarrierComplete", &ShardSystem::isBarrierComplete)
+        .def("isGhost", &ShardSystem::isGhost)
+        .def("isOwned", &ShardSystem::isOwned)
+        .def("receive", &ShardSystem::receive)
+        .def("setGhostMargin", &ShardSystem::setGhostMargin)
+        .def("takeMessages", &ShardSystem::takeMessages)
+        .def("tick", &ShardSystem::tick)
+    ;
+}
+
+
+struct ShardSystem::Implementation {
+
+    struct GhostType {
+
+        std::string m_name;
+
+        ComponentTypeId m_typeId = NULL_COMPONENT_TYPE;
+
+    };
+
+    struct Peer {
+
+        // Local ghosts of the peer's entities, by the peer's entity id
+        std::unordered_map<EntityId, EntityId> m_ghosts;
+
+        // Local entities the peer got a ghost of in the last update
+        std::unordered_set<EntityId> m_ghosted;
+
+        StorageList m_outgoing;
+
+        std::deque<StorageContainer> m_received;
+
+        int64_t m_receivedTick = 0;
+
+    };
+
+    struct Region {
+
+        int32_t m_minX;
+
+        int32_t m_minY;
+
+        int32_t m_maxX;
+
+        int32_t m_maxY;
+
+        int32_t m_node;
+
+    };
+
+    Implementation(
+        int32_t localNode
+    ) : m_localNode(localNode)
+    {
+    }
+
+    void
+    applyMessage(
+        Peer& peer,
+        const StorageContainer& message
+    ) {
+        EntityManager& entityManager = *m_system->entityManager();
+        const ComponentFactory& factory = m_system->engine()->componentFactory();
+        EntityPrototype prototype;
+        for (const StorageContainer& handoff : message.get<StorageList>("handoffs")) {
+            this->removeGhost(peer, handoff.get<EntityId>("entityId"));
+            prototype.load(handoff.get<StorageContainer>("prototype"));
+            prototype.deferInstantiate(entityManager, factory);
+        }
+        std::unordered_set<EntityId> seen;
+        for (const StorageContainer& ghost : message.get<StorageList>("ghosts")) {
+            EntityId remoteId = ghost.get<EntityId>("entityId");
+            seen.insert(remoteId);
+            auto iter = peer.m_ghosts.find(remoteId);
+            if (iter != peer.m_ghosts.end()) {
+                this->moveGhost(
+                    iter->second,
+                    ghost.get<Ogre::Vector3>("position"),
+                    ghost.get<Ogre::Quaternion>("orientation")
+                );
+            }
+            else if (ghost.contains<StorageContainer>("prototype")) {
+                prototype.load(ghost.get<StorageContainer>("prototype"));
+                EntityId ghostId = this->createGhost(prototype);
+                peer.m_ghosts[remoteId] = ghostId;
+                m_ghostIds.insert(ghostId);
+            }
+        }
+        for (auto iter = peer.m_ghosts.begin(); iter != peer.m_ghosts.end();) {
+            if (seen.count(iter->first)) {
+                ++iter;
+                continue;
+            }
+            entityManager.removeEntity(iter->second);
+            m_ghostIds.erase(iter->second);
+            iter = peer.m_ghosts.erase(iter);
+        }
+    }
+
+    EntityId
+    createGhost(
+        const EntityPrototype& prototype
+    ) {
+        EntityManager::ComponentList components = prototype.createComponents(
+            m_system->engine()->componentFactory()
+        );
+        for (const auto& component : components) {
+            component->setVolatile(true);
+            if (component->typeId() == RigidBodyComponent::TYPE_ID) {
+                auto rigidBodyComponent = static_cast<RigidBodyComponent*>(component.get());
+                rigidBodyComponent->m_properties->kinematic = true;
+                rigidBodyComponent->m_properties->touch();
+            }
+        }
+        return m_system->entityManager()->deferCreateEntity(std::move(components));
+    }
+
+    StorageContainer
+    ghostPrototype(
+        EntityId entityId
+    ) const {
+        EntityManager& entityManager = *m_system->entityManager();
+        EntityPrototype prototype;
+        for (const GhostType& type : m_ghostTypes) {
+            // Ghosts must not be handed off or ghosted back
+            if (type.m_typeId == WorldSectorComponent::TYPE_ID) {
+                continue;
+            }
+            Component* component = entityManager.getComponent(entityId, type.m_typeId);
+            if (component) {
+                prototype.addComponent(*component);
+            }
+        }
+        return prototype.storage();
+    }
+
+    void
+    moveGhost(
+        EntityId ghostId,
+        const Ogre::Vector3& position,
+        const Ogre::Quaternion& orientation
+    ) {
+        EntityManager& entityManager = *m_system->entityManager();
+        // Ghosts created last update may not exist yet
+        auto sceneNodeComponent = entityManager.getComponent<OgreSceneNodeComponent>(ghostId);
+        if (sceneNodeComponent) {
+            sceneNodeComponent->m_transform.position = position;
+            sceneNodeComponent->m_transform.orientation = orientation;
+            sceneNodeComponent->m_transform.touch();
+        }
+        auto rigidBodyComponent = entityManager.getComponent<RigidBodyComponent>(ghostId);
+        if (rigidBodyComponent) {
+            using DynamicProperties = RigidBodyComponent::DynamicProperties;
+            rigidBodyComponent->m_dynamicProperties.position = position;
+            rigidBodyComponent->m_dynamicProperties.rotation = orientation;
+            rigidBodyComponent->m_dynamicProperties.touchFields(
+                DynamicProperties::POSITION | DynamicProperties::ROTATION
+            );
+        }
+    }
+
+    int32_t
+    ownerAt(
+        const Ogre::Vector3& position
+    ) const {
+        int32_t x = static_cast<int32_t>(std::floor(position.x / m_sectorSize));
+        int32_t y = static_cast<int32_t>(std::floor(position.y / m_sectorSize));
+        for (auto iter = m_regions.rbegin(); iter != m_regions.rend(); ++iter) {
+            if (
+                x >= iter->m_minX and x <= iter->m_maxX and
+                y >= iter->m_minY and y <= iter->m_maxY
+            ) {
+                return iter->m_node;
+            }
+        }
+        return m_localNode;
+    }
+
+    void
+    removeGhost(
+        Peer& peer,
+        EntityId remoteId
+    ) {
+        auto iter = peer.m_ghosts.find(remoteId);
+        if (iter == peer.m_ghosts.end()) {
+            return;
+        }
+        m_system->entityManager()->removeEntity(iter->second);
+        m_ghostIds.erase(iter->second);
+        peer.m_ghosts.erase(iter);
+    }
+
+    void
+    sendMessages() {
+        EntityManager& entityManager = *m_system->entityManager();
+        Ogre::Real margin = std::min(m_ghostMargin, m_sectorSize);
+        std::map<int32_t, StorageList> handoffs;
+        std::map<int32_t, StorageList> ghosts;
+        std::map<int32_t, std::unordered_set<EntityId>> ghosted;
+        std::vector<EntityId> leaving;
+        for (const auto& item : m_entities) {
+            EntityId entityId = item.first;
+            // Children are removed and recreated with their parent
+            if (entityManager.parent(entityId) != NULL_ENTITY) {
+                continue;
+            }
+            const auto& transform = std::get<1>(item.second)->m_transform;
+            int32_t owner = this->ownerAt(transform.position);
+            if (owner != m_localNode) {
+                StorageContainer handoff;
+                handoff.set<EntityId>("entityId", entityId);
+                handoff.set<StorageContainer>(
+                    "prototype",
+                    EntityPrototype(entityManager, entityId).storage()
+                );
+                handoffs[owner].append(std::move(handoff));
+                leaving.push_back(entityId);
+                continue;
+            }
+            // Each node owning a sector within the margin gets a ghost
+            std::vector<int32_t> neighbours;
+            for (Ogre::Real dx : {-margin, 0.0f, margin}) {
+                for (Ogre::Real dy : {-margin, 0.0f, margin}) {
+                    int32_t node = this->ownerAt(
+                        transform.position + Ogre::Vector3(dx, dy, 0.0f)
+                    );
+                    if (
+                        node != m_localNode and
+                        std::find(neighbours.begin(), neighbours.end(), node) == neighbours.end()
+                    ) {
+                        neighbours.push_back(node);
+                    }
+                }
+            }
+            for (int32_t node : neighbours) {
+                StorageContainer ghost;
+                ghost.set<EntityId>("entityId", entityId);
+                ghost.set<Ogre::Vector3>("position", transform.position);
+                ghost.set<Ogre::Quaternion>("orientation", transform.orientation);
+                if (not m_peers[node].m_ghosted.count(entityId)) {
+                    ghost.set<StorageContainer>(
+                        "prototype",
+                        this->ghostPrototype(entityId)
+                    );
+                }
+                ghosts[node].append(std::move(ghost));
+                ghosted[node].insert(entityId);
+            }
+        }
+        for (EntityId entityId : leaving) {
+            entityManager.removeEntity(entityId);
+        }
+        for (auto& pair : m_peers) {
+            Peer& peer = pair.second;
+            StorageContainer message;
+            message.set<int32_t>("from", m_localNode);
+            message.set<int64_t>("tick", m_tick);
+            message.set<StorageList>("handoffs", std::move(handoffs[pair.first]));
+            message.set<StorageList>("ghosts", std::move(ghosts[pair.first]));
+            peer.m_outgoing.append(std::move(message));
+            peer.m_ghosted = std::move(ghosted[pair.first]);
+        }
+    }
+
+    EntityFilter<
+        WorldSectorComponent,
+        OgreSceneNodeComponent
+    > m_entities;
+
+    GameState* m_gameState = nullptr;
+
+    std::unordered_set<EntityId> m_ghostIds;
+
+    Ogre::Real m_ghostMargin = 10.0f;
+
+    std::vector<GhostType> m_ghostTypes;
+
+    int32_t m_localNode;
+
+    std::map<int32_t, Peer> m_peers;
+
+    std::vector<Region> m_regions;
+
+    Ogre::Real m_sectorSize = 100.0f;
+
+    ShardSystem* m_system = nullptr;
+
+    int64_t m_tick = 0;
+
+};
+
+
+ShardSystem*
+ShardSystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<ShardSystem>();
+}
+
+
+ShardSystem::ShardSystem(
+    int32_t localNode
+) : m_impl(new Implementation(localNode))
+{
+    m_impl->m_system = this;
+    // Copies and creates entities through the component factory, which may
+    // call into Lua
+    this->setMainThreadOnly();
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+    this->declareWrite(RigidBodyComponent::TYPE_ID);
+    this->declareWrite(WorldSectorComponent::TYPE_ID);
+}
+
+
+ShardSystem::~ShardSystem() {}
+
+
+void
+ShardSystem::addGhostType(
+    const std::string& typeName
+) {
+    Implementation::GhostType type;
+    type.m_name = typeName;
+    if (m_impl->m_gameState) {
+        type.m_typeId = m_impl->m_gameState->engine().componentFactory().getTypeId(typeName);
+    }
+    m_impl->m_ghostTypes.push_back(std::move(type));
+}
+
+
+void
+ShardSystem::assignSectors(
+    int32_t minX,
+    int32_t minY,
+    int32_t maxX,
+    int32_t maxY,
+    int32_t node
+) {
+    if (maxX < minX or maxY < minY) {
+        throw std::invalid_argument("Sector rectangle must not be empty");
+    }
+    m_impl->m_regions.push_back(Implementation::Region{minX, minY, maxX, maxY, node});
+    if (node != m_impl->m_localNode) {
+        m_impl->m_peers[node];
+    }
+}
+
+
+void
+ShardSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    WorldSectorSystem* worldSectors = WorldSectorSystem::find(gameState);
+    if (not worldSectors) {
+        throw std::runtime_error("ShardSystem needs a WorldSectorSystem");
+    }
+    m_impl->m_sectorSize = worldSectors->sectorSize();
+    m_impl->m_gameState = gameState;
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    const ComponentFactory& factory = gameState->engine().componentFactory();
+    for (Implementation::GhostType& type : m_impl->m_ghostTypes) {
+        type.m_typeId = factory.getTypeId(type.m_name);
+    }
+}
+
+
+bool
+ShardSystem::isBarrierComplete() const {
+    for (const auto& pair : m_impl->m_peers) {
+        if (pair.second.m_receivedTick < m_impl->m_tick) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool
+ShardSystem::isGhost(
+    EntityId entityId
+) const {
+    return m_impl->m_ghostIds.count(entityId) > 0;
+}
+
+
+bool
+ShardSystem::isOwned(
+    const Ogre::Vector3& position
+) const {
+    return m_impl->ownerAt(position) == m_impl->m_localNode;
+}
+
+
+void
+ShardSystem::receive(
+    const StorageContainer& message
+) {
+    auto iter = m_impl->m_peers.find(message.get<int32_t>("from"));
+    if (iter == m_impl->m_peers.end()) {
+        throw std::invalid_argument("Shard message from unknown node");
+    }
+    Implementation::Peer& peer = iter->second;
+    int64_t tick = message.get<int64_t>("tick");
+    if (tick != peer.m_receivedTick + 1) {
+        throw std::invalid_argument("Shard messages must be received in order");
+    }
+    peer.m_received.push_back(message);
+    peer.m_receivedTick = tick;
+}
+
+
+void
+ShardSystem::setGhostMargin(
+    Ogre::Real margin
+) {
+    if (margin < 0.0f) {
+        throw std::invalid_argument("Ghost margin must not be negative");
+    }
+    m_impl->m_ghostMargin = margin;
+}
+
+
+void
+ShardSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_gameState = nullptr;
+    // Ghosts are volatile, they are gone after reloading anyway
+    for (auto& pair : m_impl->m_peers) {
+        pair.second.m_ghosts.clear();
+        pair.second.m_ghosted.clear();
+    }
+    m_impl->m_ghostIds.clear();
+    System::shutdown();
+}
+
+
+StorageList
+ShardSystem::takeMessages(
+    int32_t node
+) {
+    auto iter = m_impl->m_peers.find(node);
+    if (iter == m_impl->m_peers.end()) {
+        throw std::invalid_argument("Unknown shard node");
+    }
+    StorageList messages;
+    messages.swap(iter->second.m_outgoing);
+    return messages;
+}
+
+
+int64_t
+ShardSystem::tick() const {
+    return m_impl->m_tick;
+}
+
+
+void
+ShardSystem::update(int) {
+    if (not this->isBarrierComplete()) {
+        throw std::logic_error("Shard update before all peers' messages were received");
+    }
+    for (auto& pair : m_impl->m_peers) {
+        Implementation::Peer& peer = pair.second;
+        while (not peer.m_received.empty()) {
+            m_impl->applyMessage(peer, peer.m_received.front());
+            peer.m_received.pop_front();
+        }
+    }
+    m_impl->m_tick += 1;
+    m_impl->sendMessages();
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <cstdint>
+#include <memory>
+#include <OgreVector3.h>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class StorageContainer;
+class StorageList;
+
+/**
+* @brief Splits the simulation of a world between several engine processes
+*
+* Each process (node) runs a shard system with its own node id. The world
+* sectors of the game state's WorldSectorSystem are assigned to nodes with
+* assignSectors(), sectors without an assignment belong to the local node.
+* All nodes must make the same assignments.
+*
+* Each update, the system:
+* - Hands off the entities with a WorldSectorComponent that have moved into
+*   another node's sector. They are copied like EntityPrototype does,
+*   removed locally and recreated by the owner. Children are not handed
+*   off, like with the world sector system.
+* - Sends ghosts of the entities within the ghost margin of another node's
+*   sector to that node. A ghost is a copy of the entity's components of the
+*   ghost types, see addGhostType(). Rigid bodies of ghosts are kinematic,
+*   so collisions with them push local entities, but the ghost only moves
+*   with its original. Ghosts are volatile, they are not saved.
+* - Applies the messages the other nodes sent for the previous update.
+*
+* The system doesn't do any networking itself. The host sends the messages
+* returned by takeMessages() over its transport and passes the ones it
+* receives to receive(). All nodes update in lockstep: an update needs the
+* previous update's messages of all peers, see isBarrierComplete(). Usually
+* the transport is a system updated just before this one, which waits for
+* the messages. The game state should have a tick rate, so that all nodes
+* advance by the same time per update.
+*
+* A message is a StorageContainer with:
+* - \c from: The sender's node id
+* - \c tick: The number of the sender's update, starting at 1
+* - \c handoffs: A StorageList with an entry per entity, with the sender's
+*   \c entityId and the entity's \c prototype
+* - \c ghosts: A StorageList with an entry per ghost, with the sender's
+*   \c entityId, its \c position and \c orientation. The first message
+*   with a ghost also holds its \c prototype. Ghosts missing from a message
+*   are removed.
+*
+* Nodes are meant to run headless (see Game::runHeadless()). A rendering
+* observer node can follow all shards through their ReplicationSystem.
+*/
+class ShardSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - ShardSystem(localNode)
+    * - ShardSystem::addGhostType
+    * - ShardSystem::assignSectors
+    * - ShardSystem::find
+    * - ShardSystem::isBarrierComplete
+    * - ShardSystem::isGhost
+    * - ShardSystem::isOwned
+    * - ShardSystem::receive
+    * - ShardSystem::setGhostMargin
+    * - ShardSystem::takeMessages
+    * - ShardSystem::tick
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Finds the shard system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's shard system or \c nullptr if it has none
+    */
+    static ShardSystem*
+    find(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param localNode
+    *   The id of this node
+    */
+    ShardSystem(
+        int32_t localNode
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~ShardSystem();
+
+    /**
+    * @brief Includes the components of a type in ghosts
+    *
+    * Usually the OgreSceneNodeComponent, the RigidBodyComponent and
+    * whatever AI queries look at.
+    *
+    * @param typeName
+    *   The component type name, as registered with the ComponentFactory
+    */
+    void
+    addGhostType(
+        const std::string& typeName
+    );
+
+    /**
+    * @brief Assigns a rectangle of sectors to a node
+    *
+    * Later assignments take precedence where they overlap.
+    *
+    * @param minX
+    * @param minY
+    * @param maxX
+    * @param maxY
+    *   The sector coordinates of the rectangle, inclusive
+    * @param node
+    *   The owning node
+    */
+    void
+    assignSectors(
+        int32_t minX,
+        int32_t minY,
+        int32_t maxX,
+        int32_t maxY,
+        int32_t node
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * The game state needs a WorldSectorSystem.
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Whether all peers' messages for the last update were received
+    *
+    * Until then, update() must not be called.
+    */
+    bool
+    isBarrierComplete() const;
+
+    /**
+    * @brief Whether an entity is a ghost of another node's entity
+    *
+    * @param entityId
+    */
+    bool
+    isGhost(
+        EntityId entityId
+    ) const;
+
+    /**
+    * @brief Whether a position's sector belongs to this node
+    *
+    * @param position
+    *   Any position in the sector
+    */
+    bool
+    isOwned(
+        const Ogre::Vector3& position
+    ) const;
+
+    /**
+    * @brief Queues a message from a peer
+    *
+    * The message is applied with the next update after the one of the
+    * same tick. Each peer's messages must be received in order.
+    *
+    * @param message
+    *   A message returned by a peer's takeMessages()
+    */
+    void
+    receive(
+        const StorageContainer& message
+    );
+
+    /**
+    * @brief Sets how close to another node's sector an entity is ghosted
+    *
+    * @param margin
+    *   The distance. Must not be negative, margins larger than the sector
+    *   size count as the sector size. Defaults to \c 10.
+    */
+    void
+    setGhostMargin(
+        Ogre::Real margin
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Returns and forgets the messages produced for a peer
+    *
+    * @param node
+    *   The peer's node id
+    *
+    * @return
+    *   The messages since the last call, oldest first
+    */
+    StorageList
+    takeMessages(
+        int32_t node
+    );
+
+    /**
+    * @brief The number of updates so far
+    */
+    int64_t
+    tick() const;
+
+    /**
+    * @brief Applies received messages, hands off entities and sends ghosts
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
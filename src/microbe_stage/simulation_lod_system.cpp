@@ -0,0 +1,353 @@
+#include "microbe_stage/simulation_lod_system.h"
+
+#include "bullet/rigid_body_system.h"
+#include "engine/component_factory.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <btBulletDynamicsCommon.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+// How far past a border an entity has to be to change tiers, relative to
+// the border's distance
+const Ogre::Real TIER_HYSTERESIS = 0.1f;
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// SimulationLodComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+SimulationLodComponent::luaBindings() {
+    using namespace luabind;
+    return class_<SimulationLodComponent, Component>("SimulationLodComponent")
+        .enum_("ID") [
+            value("TYPE_ID", SimulationLodComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &SimulationLodComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def_readonly("dueMilliseconds", &SimulationLodComponent::m_dueMilliseconds)
+        .def_readonly("isDue", &SimulationLodComponent::m_isDue)
+        .def_readonly("tier", &SimulationLodComponent::m_tier)
+    ;
+}
+
+void
+SimulationLodComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+}
+
+
+StorageContainer
+SimulationLodComponent::storage() const {
+    return Component::storage();
+}
+
+REGISTER_COMPONENT(SimulationLodComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// SimulationLodSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+SimulationLodSystem::luaBindings() {
+    using namespace luabind;
+    return class_<SimulationLodSystem, System>("SimulationLodSystem")
+        .scope [
+            def("find", &SimulationLodSystem::find),
+            def("tierTag", &SimulationLodSystem::tierTag)
+        ]
+        .def(constructor<>())
+        .def("addTier", &SimulationLodSystem::addTier)
+        .def("setCenterEntity", &SimulationLodSystem::setCenterEntity)
+    ;
+}
+
+
+struct SimulationLodSystem::Implementation {
+
+    struct Tier {
+
+        bool m_aggregatesEmissions;
+
+        Ogre::Real m_distance;
+
+        bool m_simplifiesShapes;
+
+        bool m_sleepsBodies;
+
+        unsigned int m_updateInterval;
+
+    };
+
+    // The first tier the distance is within, or the last
+    unsigned int
+    tierAt(
+        Ogre::Real distance
+    ) const {
+        for (unsigned int tier = 0; tier + 1 < m_tiers.size(); ++tier) {
+            if (distance < m_tiers[tier].m_distance) {
+                return tier;
+            }
+        }
+        return m_tiers.size() - 1;
+    }
+
+    unsigned int
+    nextTier(
+        unsigned int current,
+        Ogre::Real distance
+    ) const {
+        unsigned int further = this->tierAt(distance / (1.0f + TIER_HYSTERESIS));
+        if (further > current) {
+            return further;
+        }
+        unsigned int nearer = this->tierAt(distance * (1.0f + TIER_HYSTERESIS));
+        if (nearer < current) {
+            return nearer;
+        }
+        return current;
+    }
+
+    void
+    updateBody(
+        SimulationLodComponent* lodComponent,
+        RigidBodyComponent* rigidBodyComponent,
+        bool sleeps
+    ) {
+        btRigidBody* body = rigidBodyComponent ? rigidBodyComponent->m_body : nullptr;
+        if (not body or lodComponent->m_isAsleep == sleeps) {
+            return;
+        }
+        if (sleeps) {
+            // Unlike regular deactivation, forces don't wake the body
+            body->forceActivationState(DISABLE_SIMULATION);
+        }
+        else {
+            body->forceActivationState(ACTIVE_TAG);
+            body->activate(true);
+        }
+        lodComponent->m_isAsleep = sleeps;
+    }
+
+    void
+    updateShape(
+        RigidBodyComponent* rigidBodyComponent,
+        bool simplifies
+    ) {
+        if (not rigidBodyComponent) {
+            return;
+        }
+        auto& properties = *rigidBodyComponent->m_properties;
+        if (properties.isShapeSimplified != simplifies) {
+            properties.isShapeSimplified = simplifies;
+            properties.touchFields(RigidBodyComponent::Properties::SIMPLIFIED_SHAPE);
+        }
+    }
+
+    EntityManager::NameId m_centerName = EntityManager::NULL_NAME;
+
+    EntityFilter<
+        SimulationLodComponent,
+        OgreSceneNodeComponent,
+        Optional<RigidBodyComponent>
+    > m_entities;
+
+    unsigned int m_frame = 0;
+
+    // Pairs of entity and new tier, applied after iterating
+    std::vector<std::pair<EntityId, unsigned int>> m_tierChanges;
+
+    std::vector<Tier> m_tiers;
+
+};
+
+
+SimulationLodSystem*
+SimulationLodSystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<SimulationLodSystem>();
+}
+
+
+ComponentTypeId
+SimulationLodSystem::tierTag(
+    unsigned int tier
+) {
+    return ComponentFactory::registerTag("simulationTier" + std::to_string(tier));
+}
+
+
+SimulationLodSystem::SimulationLodSystem()
+  : m_impl(new Implementation())
+{
+    // Puts rigid bodies to sleep in the physics world
+    this->setMainThreadOnly();
+    this->declareBufferedRead(OgreSceneNodeComponent::TYPE_ID);
+    this->declareWrite(RigidBodyComponent::TYPE_ID);
+    this->declareWrite(SimulationLodComponent::TYPE_ID);
+}
+
+
+SimulationLodSystem::~SimulationLodSystem() {}
+
+
+void
+SimulationLodSystem::addTier(
+    Ogre::Real distance,
+    unsigned int updateInterval,
+    bool sleepsBodies,
+    bool aggregatesEmissions,
+    bool simplifiesShapes
+) {
+    if (updateInterval == 0) {
+        throw std::invalid_argument("Tier update interval must be positive");
+    }
+    if (not m_impl->m_tiers.empty() and not (distance > m_impl->m_tiers.back().m_distance)) {
+        throw std::invalid_argument("Tier distances must increase");
+    }
+    Implementation::Tier tier;
+    tier.m_aggregatesEmissions = aggregatesEmissions;
+    tier.m_distance = distance;
+    tier.m_simplifiesShapes = simplifiesShapes;
+    tier.m_sleepsBodies = sleepsBodies;
+    tier.m_updateInterval = updateInterval;
+    m_impl->m_tiers.push_back(tier);
+}
+
+
+bool
+SimulationLodSystem::aggregatesEmissions(
+    EntityId entityId
+) const {
+    const auto& entities = m_impl->m_entities.entities();
+    auto iter = entities.find(entityId);
+    if (iter == entities.end() or m_impl->m_tiers.empty()) {
+        return false;
+    }
+    unsigned int tier = std::min<unsigned int>(
+        std::get<0>(iter->second)->m_tier,
+        m_impl->m_tiers.size() - 1
+    );
+    return m_impl->m_tiers[tier].m_aggregatesEmissions;
+}
+
+
+void
+SimulationLodSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+void
+SimulationLodSystem::setCenterEntity(
+    const std::string& name
+) {
+    m_impl->m_centerName = EntityManager::internName(name);
+}
+
+
+void
+SimulationLodSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    System::shutdown();
+}
+
+
+void
+SimulationLodSystem::update(
+    int milliseconds
+) {
+    m_impl->m_frame += 1;
+    EntityManager& entityManager = *this->entityManager();
+    const OgreSceneNodeComponent* centerNode = nullptr;
+    if (m_impl->m_centerName != EntityManager::NULL_NAME) {
+        centerNode = entityManager.getComponent<OgreSceneNodeComponent>(
+            entityManager.getNamedId(m_impl->m_centerName)
+        );
+    }
+    const auto& tiers = m_impl->m_tiers;
+    for (const auto& item : m_impl->m_entities) {
+        EntityId entityId = item.first;
+        SimulationLodComponent* lodComponent = std::get<0>(item.second);
+        if (tiers.empty()) {
+            lodComponent->m_isDue = true;
+            lodComponent->m_dueMilliseconds = milliseconds;
+            continue;
+        }
+        unsigned int tier = lodComponent->m_tier;
+        if (tier >= tiers.size()) {
+            // Fewer tiers than when the entity was last updated
+            tier = tiers.size() - 1;
+        }
+        if (centerNode) {
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+            Ogre::Real distance = sceneNodeComponent->m_lastFrameTransform.previous().position.distance(
+                centerNode->m_lastFrameTransform.previous().position
+            );
+            tier = m_impl->nextTier(tier, distance);
+        }
+        if (tier != lodComponent->m_tier or not lodComponent->m_hasTierTag) {
+            m_impl->m_tierChanges.emplace_back(entityId, tier);
+        }
+        // Spread the entities of a tier over the interval's frames
+        unsigned int interval = tiers[tier].m_updateInterval;
+        lodComponent->m_pendingMilliseconds += milliseconds;
+        lodComponent->m_isDue = (m_impl->m_frame + entityIndex(entityId)) % interval == 0;
+        if (lodComponent->m_isDue) {
+            lodComponent->m_dueMilliseconds = lodComponent->m_pendingMilliseconds;
+            lodComponent->m_pendingMilliseconds = 0;
+        }
+        m_impl->updateBody(
+            lodComponent,
+            std::get<2>(item.second),
+            tiers[tier].m_sleepsBodies
+        );
+        m_impl->updateShape(
+            std::get<2>(item.second),
+            tiers[tier].m_simplifiesShapes
+        );
+    }
+    // Moving entities between archetypes while iterating the filter
+    // isn't safe
+    for (const auto& change : m_impl->m_tierChanges) {
+        EntityId entityId = change.first;
+        auto lodComponent = entityManager.getComponent<SimulationLodComponent>(entityId);
+        if (lodComponent->m_hasTierTag) {
+            entityManager.removeTag(entityId, tierTag(lodComponent->m_tier));
+        }
+        else {
+            // Loaded entities may still have the tag they were saved with
+            for (unsigned int tier = 0; tier < tiers.size(); ++tier) {
+                if (tier != change.second and entityManager.hasTag(entityId, tierTag(tier))) {
+                    entityManager.removeTag(entityId, tierTag(tier));
+                }
+            }
+        }
+        entityManager.addTag(entityId, tierTag(change.second));
+        lodComponent->m_tier = change.second;
+        lodComponent->m_hasTierTag = true;
+    }
+    m_impl->m_tierChanges.clear();
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <OgrePrerequisites.h>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Opts an entity into simulation level of detail
+*
+* SimulationLodSystem assigns the entity a tier from its distance to the
+* center entity. Systems and scripts use the tier to simulate distant
+* entities less often. Scripts check isDue before updating the entity and
+* pass it the dueMilliseconds:
+*
+* \code{.lua}
+* local lod = entity:getComponent(SimulationLodComponent.TYPE_ID)
+* if lod == nil or lod.isDue then
+*     microbe:update(lod and lod.dueMilliseconds or milliseconds)
+* end
+* \endcode
+*
+* The entity also carries the tag of its tier, see
+* SimulationLodSystem::tierTag(), so that entity filters can select tiers.
+*
+* Requires an OgreSceneNodeComponent. The tier is not saved, it's
+* recomputed after loading.
+*/
+class SimulationLodComponent : public Component {
+    COMPONENT(SimulationLod)
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SimulationLodComponent()
+    * - @link m_dueMilliseconds dueMilliseconds @endlink (read only)
+    * - @link m_isDue isDue @endlink (read only)
+    * - @link m_tier tier @endlink (read only)
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief The time since the entity was last due
+    *
+    * Only valid if m_isDue is set.
+    */
+    Milliseconds m_dueMilliseconds = 0;
+
+    /**
+    * @brief Whether the entity should be updated in this frame
+    */
+    bool m_isDue = true;
+
+    /**
+    * @brief The current tier, \c 0 is the nearest
+    */
+    unsigned int m_tier = 0;
+
+    /**
+    * @brief Internal state, don't use this directly
+    */
+    bool m_isAsleep = false;
+
+    /**
+    * @brief Internal state, don't use this directly
+    */
+    Milliseconds m_pendingMilliseconds = 0;
+
+    /**
+    * @brief Internal state, don't use this directly
+    *
+    * Whether the entity has the tag of m_tier yet.
+    */
+    bool m_hasTierTag = false;
+
+};
+
+
+/**
+* @brief Assigns simulation tiers by distance to a center entity
+*
+* Tiers are added nearest first with addTier(). An entity is in the first
+* tier whose distance it is within, or in the last one if it's beyond all
+* of them. An entity only changes tiers once it is clearly past the
+* border, so entities on a border don't switch tiers every frame.
+*
+* Each tier has:
+* - An update interval in frames. Entities are due every this many
+*   frames, see SimulationLodComponent::m_isDue. Entities of a tier are
+*   spread over the frames of the interval, so the work is spread, too.
+* - Whether rigid bodies sleep. The physics world then skips them until
+*   they return to a tier where they don't.
+* - Whether rigid bodies collide with a bounding shape instead of their
+*   compound shape, see RigidBodyComponent::Properties::isShapeSimplified.
+*   Each collision test and bounding box update then handles one shape
+*   instead of one per child.
+* - Whether agent emissions are aggregated. AgentEmitterSystem then emits
+*   each emission's particles as a single particle of the same total
+*   potency.
+*
+* Without tiers, all entities are in tier \c 0 and always due.
+*
+* Distances are measured between the scene node positions at the start of
+* the frame (OgreSceneNodeComponent::m_lastFrameTransform), so the system
+* doesn't wait for the systems moving scene nodes. Entities created during
+* the frame are measured from the origin until the next frame.
+*
+* Should run before the systems that use the tiers.
+*/
+class SimulationLodSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SimulationLodSystem()
+    * - SimulationLodSystem::find
+    * - SimulationLodSystem::addTier
+    * - SimulationLodSystem::setCenterEntity
+    * - SimulationLodSystem::tierTag
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Finds the simulation LOD system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's simulation LOD system or \c nullptr if it has
+    *   none
+    */
+    static SimulationLodSystem*
+    find(
+        GameState* gameState
+    );
+
+    /**
+    * @brief The tag of a tier's entities
+    *
+    * @param tier
+    *   The tier, \c 0 is the nearest
+    *
+    * @return
+    *   The tag, see ComponentFactory::registerTag()
+    */
+    static ComponentTypeId
+    tierTag(
+        unsigned int tier
+    );
+
+    /**
+    * @brief Constructor
+    */
+    SimulationLodSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~SimulationLodSystem();
+
+    /**
+    * @brief Adds a tier beyond the previous ones
+    *
+    * @param distance
+    *   The distance from the center entity up to which entities are in
+    *   this tier. Must be larger than that of the previous tier.
+    * @param updateInterval
+    *   Entities are due every this many frames. Must be positive.
+    * @param sleepsBodies
+    *   Whether rigid bodies in this tier sleep
+    * @param aggregatesEmissions
+    *   Whether agent emissions in this tier are aggregated
+    * @param simplifiesShapes
+    *   Whether rigid bodies in this tier collide with bounding shapes
+    */
+    void
+    addTier(
+        Ogre::Real distance,
+        unsigned int updateInterval,
+        bool sleepsBodies,
+        bool aggregatesEmissions,
+        bool simplifiesShapes
+    );
+
+    /**
+    * @brief Whether an entity's agent emissions are aggregated
+    *
+    * @param entityId
+    *   The entity to check
+    *
+    * @return
+    *   \c false if the entity has no SimulationLodComponent
+    */
+    bool
+    aggregatesEmissions(
+        EntityId entityId
+    ) const;
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Sets the entity whose distance determines the tiers
+    *
+    * Usually the player.
+    *
+    * @param name
+    *   The name of the entity
+    */
+    void
+    setCenterEntity(
+        const std::string& name
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Updates the tiers and whether entities are due
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,394 @@
+#include "microbe_stage/spawn_system.h"
+
+#include "bullet/rigid_body_system.h"
+#include "engine/component_factory.h"
+#include "engine/creation_queue.h"
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/entity_prototype.h"
+#include "engine/game_state.h"
+#include "engine/rng.h"
+#include "microbe_stage/shard_system.h"
+#include "ogre/scene_node_system.h"
+#include "ogre/spatial_index_system.h"
+#include "ogre/world_sector_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <OgreMath.h>
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace thrive;
+
+
+luabind::scope
+SpawnSystem::luaBindings() {
+    using namespace luabind;
+    return class_<SpawnSystem, System>("SpawnSystem")
+        .def(constructor<>())
+        .def("addSpawnPrototype", &SpawnSystem::addSpawnPrototype)
+        .def("addSpawnType", &SpawnSystem::addSpawnType)
+        .def("setCenterEntity", &SpawnSystem::setCenterEntity)
+        .def("setSpawnInterval", &SpawnSystem::setSpawnInterval)
+    ;
+}
+
+
+struct SpawnSystem::Implementation {
+
+    struct SpawnType {
+
+        std::unique_ptr<EntityPrototype> prototype;
+
+        // Expected number of spawns that pass the random chance in each
+        // cycle. The candidate positions are sampled from the square around
+        // the center, which has an area of 4 * radius^2.
+        Ogre::Real frequency;
+
+        Ogre::Real radius;
+
+        bool randomOrientation;
+
+    };
+
+    struct Spawned {
+
+        unsigned int spawnType;
+
+        unsigned int lastSeen;
+
+    };
+
+    Implementation(
+        SpawnSystem& system
+    ) : m_system(system)
+    {
+    }
+
+    unsigned int
+    addSpawnType(
+        std::unique_ptr<EntityPrototype> prototype,
+        Ogre::Real density,
+        Ogre::Real radius,
+        bool randomOrientation
+    ) {
+        if (not (radius > 0.0f) or density < 0.0f) {
+            throw std::invalid_argument("Spawn radius must be positive and density must not be negative");
+        }
+        if (prototype->componentCount() == 0) {
+            throw std::invalid_argument("Spawn prototype has no components");
+        }
+        SpawnType spawnType;
+        spawnType.prototype = std::move(prototype);
+        spawnType.frequency = density * radius * radius * 4;
+        spawnType.radius = radius;
+        spawnType.randomOrientation = randomOrientation;
+        m_spawnTypes.push_back(std::move(spawnType));
+        return m_spawnTypes.size() - 1;
+    }
+
+    // Run by the creation queue
+    void
+    create(
+        unsigned int spawnTypeIndex,
+        const Ogre::Vector3& position
+    ) {
+        EntityManager::ComponentList components = this->createComponents(
+            m_spawnTypes[spawnTypeIndex],
+            position
+        );
+        bool isSectorEntity = m_worldSectors and std::any_of(
+            components.begin(),
+            components.end(),
+            [] (const std::unique_ptr<Component>& component) {
+                return component->typeId() == WorldSectorComponent::TYPE_ID;
+            }
+        );
+        EntityId entityId = m_system.entityManager()->deferCreateEntity(std::move(components));
+        // The world sector system stores them instead of despawning
+        if (not isSectorEntity) {
+            m_spawned[entityId] = Spawned{spawnTypeIndex, m_cycle};
+        }
+    }
+
+    EntityManager::ComponentList
+    createComponents(
+        const SpawnType& spawnType,
+        const Ogre::Vector3& position
+    ) {
+        const ComponentFactory& factory = m_system.engine()->componentFactory();
+        Ogre::Quaternion orientation = Ogre::Quaternion::IDENTITY;
+        if (spawnType.randomOrientation) {
+            orientation.FromAngleAxis(
+                Ogre::Radian(m_system.engine()->rng().getDouble(0.0, Ogre::Math::TWO_PI)),
+                Ogre::Vector3::UNIT_Z
+            );
+        }
+        EntityManager::ComponentList components = spawnType.prototype->createComponents(factory);
+        for (const auto& component : components) {
+            if (component->typeId() == OgreSceneNodeComponent::TYPE_ID) {
+                auto sceneNode = static_cast<OgreSceneNodeComponent*>(component.get());
+                sceneNode->m_transform.position = position;
+                if (spawnType.randomOrientation) {
+                    sceneNode->m_transform.orientation = orientation;
+                }
+                sceneNode->m_transform.touch();
+            }
+            else if (component->typeId() == RigidBodyComponent::TYPE_ID) {
+                auto rigidBody = static_cast<RigidBodyComponent*>(component.get());
+                rigidBody->m_dynamicProperties.position = position;
+                if (spawnType.randomOrientation) {
+                    rigidBody->m_dynamicProperties.rotation = orientation;
+                }
+                rigidBody->m_dynamicProperties.touch();
+            }
+        }
+        return components;
+    }
+
+    void
+    despawn(
+        const Ogre::Vector3& center
+    ) {
+        EntityManager& entityManager = *m_system.entityManager();
+        m_cycle += 1;
+        if (m_spatialIndex) {
+            for (unsigned int i = 0; i < m_spawnTypes.size(); ++i) {
+                const auto& inRange = m_spatialIndex->queryRadius(
+                    center,
+                    m_spawnTypes[i].radius
+                );
+                for (EntityId entityId : inRange) {
+                    auto iter = m_spawned.find(entityId);
+                    if (iter != m_spawned.end() and iter->second.spawnType == i) {
+                        iter->second.lastSeen = m_cycle;
+                    }
+                }
+            }
+        }
+        else {
+            for (auto& pair : m_spawned) {
+                auto sceneNode = entityManager.getComponent<OgreSceneNodeComponent>(pair.first);
+                Ogre::Real radius = m_spawnTypes[pair.second.spawnType].radius;
+                if (
+                    sceneNode and
+                    center.squaredDistance(sceneNode->m_transform.position) < radius * radius
+                ) {
+                    pair.second.lastSeen = m_cycle;
+                }
+            }
+        }
+        for (auto iter = m_spawned.begin(); iter != m_spawned.end();) {
+            // Entities spawned during the previous cycle may not have
+            // reached the spatial index yet
+            if (iter->second.lastSeen + 1 >= m_cycle) {
+                ++iter;
+                continue;
+            }
+            if (entityManager.exists(iter->first)) {
+                entityManager.removeEntity(iter->first);
+            }
+            iter = m_spawned.erase(iter);
+        }
+    }
+
+    void
+    spawn(
+        const Ogre::Vector3& center
+    ) {
+        CreationQueue& queue = m_system.gameState()->creationQueue();
+        RNG& rng = m_system.engine()->rng();
+        Ogre::Vector3 movement = center - m_previousCenter;
+        for (unsigned int i = 0; i < m_spawnTypes.size(); ++i) {
+            const SpawnType& spawnType = m_spawnTypes[i];
+            Ogre::Real squaredRadius = spawnType.radius * spawnType.radius;
+            // Several attempts per cycle, so that more than one entity of
+            // each type can spawn
+            unsigned int attempts = std::max(1u, static_cast<unsigned int>(
+                std::ceil(spawnType.frequency * 2)
+            ));
+            Ogre::Real chance = spawnType.frequency / attempts;
+            for (unsigned int attempt = 0; attempt < attempts; ++attempt) {
+                if (rng.getDouble(0.0, 1.0) >= chance) {
+                    continue;
+                }
+                // A random point in the square around the center. Points in
+                // the corners are outside the radius and rejected below.
+                Ogre::Vector3 displacement(
+                    rng.getDouble(-1.0, 1.0) * spawnType.radius,
+                    rng.getDouble(-1.0, 1.0) * spawnType.radius,
+                    0.0f
+                );
+                // Only spawn in the ring that has just come into range
+                if (
+                    displacement.squaredLength() > squaredRadius or
+                    (displacement + movement).squaredLength() <= squaredRadius
+                ) {
+                    continue;
+                }
+                // Other shard nodes spawn in their own sectors
+                if (m_shards and not m_shards->isOwned(center + displacement)) {
+                    continue;
+                }
+                // Generated sectors restore their own entities
+                if (m_worldSectors and m_worldSectors->isSectorGenerated(center + displacement)) {
+                    continue;
+                }
+                Ogre::Vector3 position = center + displacement;
+                // Nearest first
+                queue.push(
+                    [this, i, position] () {
+                        this->create(i, position);
+                    },
+                    displacement.squaredLength()
+                );
+            }
+        }
+    }
+
+    // Interned, so updates don't hash the name
+    EntityManager::NameId m_centerName = EntityManager::NULL_NAME;
+
+    unsigned int m_cycle = 0;
+
+    bool m_hasPreviousCenter = false;
+
+    Ogre::Vector3 m_previousCenter = Ogre::Vector3::ZERO;
+
+    ShardSystem* m_shards = nullptr;
+
+    std::unordered_map<EntityId, Spawned> m_spawned;
+
+    Milliseconds m_spawnInterval = 100;
+
+    std::vector<SpawnType> m_spawnTypes;
+
+    SpatialIndexSystem* m_spatialIndex = nullptr;
+
+    SpawnSystem& m_system;
+
+    Milliseconds m_timeSinceCycle = 0;
+
+    WorldSectorSystem* m_worldSectors = nullptr;
+
+};
+
+
+SpawnSystem::SpawnSystem()
+  : m_impl(new Implementation(*this))
+{
+    // Loading components through the factory may call into Lua
+    this->setMainThreadOnly();
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+SpawnSystem::~SpawnSystem() {}
+
+
+unsigned int
+SpawnSystem::addSpawnPrototype(
+    const EntityPrototype& prototype,
+    Ogre::Real density,
+    Ogre::Real radius,
+    bool randomOrientation
+) {
+    std::unique_ptr<EntityPrototype> copy(new EntityPrototype());
+    copy->load(prototype.storage());
+    return m_impl->addSpawnType(std::move(copy), density, radius, randomOrientation);
+}
+
+
+unsigned int
+SpawnSystem::addSpawnType(
+    EntityId prototypeId,
+    Ogre::Real density,
+    Ogre::Real radius,
+    bool randomOrientation
+) {
+    EntityManager* entityManager = this->entityManager();
+    if (not entityManager) {
+        throw std::logic_error("SpawnSystem must be initialized before adding spawn types");
+    }
+    return m_impl->addSpawnType(
+        std::unique_ptr<EntityPrototype>(new EntityPrototype(*entityManager, prototypeId)),
+        density,
+        radius,
+        randomOrientation
+    );
+}
+
+
+void
+SpawnSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_spatialIndex = gameState->findSystem<SpatialIndexSystem>();
+    m_impl->m_worldSectors = WorldSectorSystem::find(gameState);
+    m_impl->m_shards = ShardSystem::find(gameState);
+}
+
+
+void
+SpawnSystem::setCenterEntity(
+    const std::string& name
+) {
+    m_impl->m_centerName = EntityManager::internName(name);
+}
+
+
+void
+SpawnSystem::setSpawnInterval(
+    Milliseconds interval
+) {
+    m_impl->m_spawnInterval = interval;
+}
+
+
+void
+SpawnSystem::shutdown() {
+    m_impl->m_spatialIndex = nullptr;
+    m_impl->m_worldSectors = nullptr;
+    m_impl->m_shards = nullptr;
+    m_impl->m_spawned.clear();
+    m_impl->m_hasPreviousCenter = false;
+    System::shutdown();
+}
+
+
+void
+SpawnSystem::update(int milliseconds) {
+    m_impl->m_timeSinceCycle += milliseconds;
+    if (m_impl->m_timeSinceCycle < m_impl->m_spawnInterval) {
+        return;
+    }
+    // The spawn logic doesn't depend on the interval, so at most one cycle
+    // is done per update
+    m_impl->m_timeSinceCycle -= m_impl->m_spawnInterval;
+    if (m_impl->m_timeSinceCycle >= m_impl->m_spawnInterval) {
+        m_impl->m_timeSinceCycle = 0;
+    }
+    if (m_impl->m_centerName == EntityManager::NULL_NAME) {
+        return;
+    }
+    EntityManager* entityManager = this->entityManager();
+    EntityId centerId = entityManager->getNamedId(m_impl->m_centerName);
+    auto centerNode = entityManager->getComponent<OgreSceneNodeComponent>(centerId);
+    if (not centerNode) {
+        return;
+    }
+    Ogre::Vector3 center = centerNode->m_transform.position;
+    if (not m_impl->m_hasPreviousCenter) {
+        m_impl->m_previousCenter = center;
+        m_impl->m_hasPreviousCenter = true;
+    }
+    m_impl->despawn(center);
+    m_impl->spawn(center);
+    m_impl->m_previousCenter = center;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <OgrePrerequisites.h>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class EntityPrototype;
+
+/**
+* @brief Spawns and despawns entities around a center entity
+*
+* Each spawn type is a copy of a prototype entity's components, a density
+* and a radius. Every spawn cycle, new entities are spawned in the region
+* that is inside the radius around the center entity's current position,
+* but was outside of it during the previous cycle. Spawned entities that
+* are no longer inside their type's radius are removed again.
+*
+* If the game state has a SpatialIndexSystem, it is used to find the
+* spawned entities that are still in range.
+*
+* If the game state has a WorldSectorSystem, nothing is spawned in sectors
+* that have been generated, their entities are restored from the store
+* instead. Spawned entities with a WorldSectorComponent are left to the
+* world sector system, which stores them when they are out of range rather
+* than removing them.
+*
+* With a ShardSystem, only the local node's sectors are spawned in.
+*
+* Spawns are queued in the game state's CreationQueue, those nearest to
+* the center first, so a large wave is spread over several frames. Each
+* one is created through EntityManager::deferCreateEntity() and batched
+* with the other creations of its frame.
+*/
+class SpawnSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SpawnSystem()
+    * - SpawnSystem::addSpawnPrototype
+    * - SpawnSystem::addSpawnType
+    * - SpawnSystem::setCenterEntity
+    * - SpawnSystem::setSpawnInterval
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    SpawnSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~SpawnSystem();
+
+    /**
+    * @brief Adds a new type of entity to spawn from a prototype
+    *
+    * Like addSpawnType(), for prototypes that don't exist as an entity,
+    * like those from Engine::loadSharedPrototype(). The prototype is
+    * copied.
+    *
+    * @param prototype
+    * @param density
+    * @param radius
+    * @param randomOrientation
+    *
+    * @return
+    *   The new spawn type's index
+    */
+    unsigned int
+    addSpawnPrototype(
+        const EntityPrototype& prototype,
+        Ogre::Real density,
+        Ogre::Real radius,
+        bool randomOrientation
+    );
+
+    /**
+    * @brief Adds a new type of entity to spawn
+    *
+    * The prototype's components are copied through their storage, so
+    * anything that survives a savegame survives spawning. The system only
+    * changes the position (and optionally the orientation) of the copy's
+    * OgreSceneNodeComponent and RigidBodyComponent. The prototype itself
+    * is left alone and can be removed afterwards.
+    *
+    * The system must be initialized before calling this.
+    *
+    * @param prototypeId
+    *   The entity to copy
+    * @param density
+    *   On average, the number of entities of this type per square unit
+    * @param radius
+    *   The distance from the center entity within which the entities
+    *   spawn and beyond which they despawn
+    * @param randomOrientation
+    *   If \c true, each spawned entity is rotated around the z axis by a
+    *   random angle. Otherwise, it keeps the prototype's orientation.
+    *
+    * @return
+    *   The new spawn type's index
+    */
+    unsigned int
+    addSpawnType(
+        EntityId prototypeId,
+        Ogre::Real density,
+        Ogre::Real radius,
+        bool randomOrientation
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Sets the named entity to spawn around
+    *
+    * Nothing is spawned until the entity exists and has an
+    * OgreSceneNodeComponent.
+    *
+    * @param name
+    *   The center entity's name
+    */
+    void
+    setCenterEntity(
+        const std::string& name
+    );
+
+    /**
+    * @brief Sets the time between two spawn cycles
+    *
+    * Defaults to 100 milliseconds.
+    *
+    * @param interval
+    */
+    void
+    setSpawnInterval(
+        Milliseconds interval
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Runs a spawn cycle if the spawn interval has passed
+    *
+    * @param milliseconds
+    */
+    void update(int milliseconds) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
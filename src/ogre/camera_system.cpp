@@ -3,6 +3,7 @@
 #include "engine/component_factory.h"
 #include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/reflection.h"
 #include "engine/serialization.h"
 #include "ogre/scene_node_system.h"
 #include "scripting/luabind.h"
@@ -17,6 +18,27 @@ using namespace thrive;
 // OgreCameraComponent
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+using Properties = OgreCameraComponent::Properties;
+
+const auto PROPERTY_FIELDS = fieldList<Properties>(
+    field("farClipDistance", &Properties::farClipDistance),
+    field("fovY", &Properties::fovY),
+    field("nearClipDistance", &Properties::nearClipDistance),
+    storedField<int16_t>("polygonMode", &Properties::polygonMode)
+);
+
+const Touchable::FieldMask FAR_CLIP_DISTANCE = PROPERTY_FIELDS.mask(&Properties::farClipDistance);
+
+const Touchable::FieldMask FOV_Y = PROPERTY_FIELDS.mask(&Properties::fovY);
+
+const Touchable::FieldMask NEAR_CLIP_DISTANCE = PROPERTY_FIELDS.mask(&Properties::nearClipDistance);
+
+const Touchable::FieldMask POLYGON_MODE = PROPERTY_FIELDS.mask(&Properties::polygonMode);
+
+} // namespace
+
 
 static Ogre::Ray
 OgreCameraComponent_getCameraToViewportRay(
@@ -41,11 +63,13 @@ OgreCameraComponent::luaBindings() {
         ]
         .scope [
             def("TYPE_NAME", &OgreCameraComponent::TYPE_NAME),
-            class_<Properties, Touchable>("Properties")
-                .def_readwrite("polygonMode", &Properties::polygonMode)
-                .def_readwrite("fovY", &Properties::fovY)
-                .def_readwrite("nearClipDistance", &Properties::nearClipDistance)
-                .def_readwrite("farClipDistance", &Properties::farClipDistance)
+            PROPERTY_FIELDS.bind(class_<Properties, Touchable>("Properties"))
+                .enum_("Field") [
+                    value("FAR_CLIP_DISTANCE", FAR_CLIP_DISTANCE),
+                    value("FOV_Y", FOV_Y),
+                    value("NEAR_CLIP_DISTANCE", NEAR_CLIP_DISTANCE),
+                    value("POLYGON_MODE", POLYGON_MODE)
+                ]
         ]
         .enum_("PolygonMode") [
             value("PM_POINTS", Ogre::PM_POINTS),
@@ -76,12 +100,7 @@ OgreCameraComponent::load(
 ) {
     Component::load(storage);
     m_name = storage.get<Ogre::String>("name");
-    m_properties.farClipDistance = storage.get<Ogre::Real>("farClipDistance", 10000.0f);
-    m_properties.fovY = storage.get<Ogre::Degree>("fovY", Ogre::Degree(45.0f));
-    m_properties.nearClipDistance = storage.get<Ogre::Real>("nearClipDistance", 100.0f);
-    m_properties.polygonMode = static_cast<Ogre::PolygonMode>(
-        storage.get<int16_t>("polygonMode", Ogre::PM_SOLID)
-    );
+    PROPERTY_FIELDS.load(m_properties, storage);
 }
 
 
@@ -95,10 +114,7 @@ StorageContainer
 OgreCameraComponent::storage() const {
     StorageContainer storage = Component::storage();
     storage.set("name", m_name);
-    storage.set<Ogre::Real>("farClipDistance", m_properties.farClipDistance);
-    storage.set<Ogre::Degree>("fovY", m_properties.fovY);
-    storage.set<Ogre::Real>("nearClipDistance", m_properties.nearClipDistance);
-    storage.set<int16_t>("polygonMode", m_properties.polygonMode);
+    PROPERTY_FIELDS.store(m_properties, storage);
     return storage;
 }
 
@@ -134,6 +150,7 @@ struct OgreCameraSystem::Implementation {
 OgreCameraSystem::OgreCameraSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
@@ -161,38 +178,47 @@ OgreCameraSystem::shutdown() {
 
 void
 OgreCameraSystem::update(int) {
-    for (EntityId entityId : m_impl->m_entities.removedEntities()) {
-        Ogre::Camera* camera = m_impl->m_cameras[entityId];
-        if (camera) {
-            Ogre::SceneNode* sceneNode = camera->getParentSceneNode();
-            sceneNode->detachObject(camera);
-            m_impl->m_sceneManager->destroyCamera(camera);
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreSceneNodeComponent*, OgreCameraComponent*>& group) {
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<0>(group);
+            OgreCameraComponent* cameraComponent = std::get<1>(group);
+            Ogre::Camera* camera = m_impl->m_sceneManager->createCamera(
+                cameraComponent->name()
+            );
+            camera->setAutoAspectRatio(true);
+            cameraComponent->m_camera = camera;
+            m_impl->m_cameras[entityId] = camera;
+            sceneNodeComponent->m_sceneNode->attachObject(camera);
+        },
+        [this] (EntityId entityId) {
+            Ogre::Camera* camera = m_impl->m_cameras[entityId];
+            if (camera) {
+                Ogre::SceneNode* sceneNode = camera->getParentSceneNode();
+                sceneNode->detachObject(camera);
+                m_impl->m_sceneManager->destroyCamera(camera);
+            }
+            m_impl->m_cameras.erase(entityId);
         }
-        m_impl->m_cameras.erase(entityId);
-    }
-    for (auto& value : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = value.first;
-        OgreSceneNodeComponent* sceneNodeComponent = std::get<0>(value.second);
-        OgreCameraComponent* cameraComponent = std::get<1>(value.second);
-        Ogre::Camera* camera = m_impl->m_sceneManager->createCamera(
-            cameraComponent->name()
-        );
-        camera->setAutoAspectRatio(true);
-        cameraComponent->m_camera = camera;
-        m_impl->m_cameras[entityId] = camera;
-        sceneNodeComponent->m_sceneNode->attachObject(camera);
-    }
-    m_impl->m_entities.clearChanges();
+    );
     for (auto& value : m_impl->m_entities) {
         OgreCameraComponent* cameraComponent = std::get<1>(value.second);
         auto& properties = cameraComponent->m_properties;
         if (properties.hasChanges()) {
             Ogre::Camera* camera = cameraComponent->m_camera;
+            Touchable::FieldMask changes = properties.changedFields();
             // Update camera
-            camera->setPolygonMode(properties.polygonMode);
-            camera->setFOVy(properties.fovY);
-            camera->setNearClipDistance(properties.nearClipDistance);
-            camera->setFarClipDistance(properties.farClipDistance);
+            if (changes & POLYGON_MODE) {
+                camera->setPolygonMode(properties.polygonMode);
+            }
+            if (changes & FOV_Y) {
+                camera->setFOVy(properties.fovY);
+            }
+            if (changes & NEAR_CLIP_DISTANCE) {
+                camera->setNearClipDistance(properties.nearClipDistance);
+            }
+            if (changes & FAR_CLIP_DISTANCE) {
+                camera->setFarClipDistance(properties.farClipDistance);
+            }
             // Untouch
             properties.untouch();
         }
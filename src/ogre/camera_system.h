@@ -64,6 +64,8 @@ public:
     *   - Properties::fovY
     *   - Properties::nearClipDistance
     *   - Properties::polygonMode
+    *   - Properties::Field: the change masks of the properties, for
+    *     Touchable::touchFields()
     *
     * @return 
     */
@@ -1,38 +1,159 @@
 #include "ogre/colour_material.h"
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <OgreColourValue.h>
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
+#include <OgrePass.h>
+#include <OgreTechnique.h>
 
+namespace {
 
-static Ogre::String
-getColourName(
-    const Ogre::ColourValue colour
+// Steps per colour channel, must not exceed 256
+const unsigned int COLOUR_LEVELS = 64;
+
+// Unused materials are only removed once the pool has grown beyond this
+const size_t MIN_COLLECTION_SIZE = 256;
+
+
+struct PooledMaterial {
+
+    Ogre::MaterialPtr material;
+
+    // The material's use count while nothing but the pool and Ogre hold it
+    unsigned int baseUseCount = 0;
+
+};
+
+
+struct ColourMaterialPool {
+
+    void
+    collect() {
+        Ogre::MaterialManager& manager = Ogre::MaterialManager::getSingleton();
+        for (auto iter = m_materials.begin(); iter != m_materials.end(); ) {
+            PooledMaterial& pooled = iter->second;
+            if (pooled.material.useCount() <= pooled.baseUseCount) {
+                manager.remove(pooled.material->getHandle());
+                iter = m_materials.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+        // Collecting again right away would mostly find used materials
+        m_nextCollection = std::max(MIN_COLLECTION_SIZE, 2 * m_materials.size());
+    }
+
+    std::unordered_map<uint32_t, PooledMaterial> m_materials;
+
+    size_t m_nextCollection = MIN_COLLECTION_SIZE;
+
+    Ogre::MaterialPtr m_vertexColourMaterial;
+
+};
+
+
+ColourMaterialPool&
+pool() {
+    static ColourMaterialPool pool;
+    return pool;
+}
+
+
+uint32_t
+channelLevel(
+    Ogre::Real channel
+) {
+    Ogre::Real clamped = std::min(std::max(channel, 0.0f), 1.0f);
+    return static_cast<uint32_t>(std::lround(clamped * (COLOUR_LEVELS - 1)));
+}
+
+
+Ogre::Real
+levelChannel(
+    uint32_t level
 ) {
-    std::ostringstream stream;
-    stream << colour;
-    return stream.str();
+    return static_cast<Ogre::Real>(level) / (COLOUR_LEVELS - 1);
 }
 
+}
 
 
 Ogre::MaterialPtr
 thrive::getColourMaterial(
     const Ogre::ColourValue& colour
 ) {
+    ColourMaterialPool& pool = ::pool();
+    uint32_t key = colourMaterialKey(colour);
+    auto iter = pool.m_materials.find(key);
+    if (iter != pool.m_materials.end()) {
+        return iter->second.material;
+    }
+    if (pool.m_materials.size() >= pool.m_nextCollection) {
+        pool.collect();
+    }
+    Ogre::ColourValue rounded(
+        levelChannel(key & 0xFF),
+        levelChannel((key >> 8) & 0xFF),
+        levelChannel((key >> 16) & 0xFF),
+        levelChannel((key >> 24) & 0xFF)
+    );
+    std::ostringstream name;
+    name << "ColourMaterial/" << std::hex << key;
     Ogre::MaterialManager& manager = Ogre::MaterialManager::getSingleton();
-    Ogre::String name = getColourName(colour);
-    Ogre::MaterialPtr material = manager.getByName(
-        name
+    PooledMaterial& pooled = pool.m_materials[key];
+    pooled.material = manager.getDefaultSettings()->clone(
+        name.str()
     );
-    if (material.isNull()) {
-        material = manager.getDefaultSettings()->clone(
-            name
+    pooled.material->setAmbient(0.3 * rounded);
+    pooled.material->setDiffuse(rounded);
+    pooled.baseUseCount = pooled.material.useCount();
+    return pooled.material;
+}
+
+
+size_t
+thrive::colourMaterialCount() {
+    return pool().m_materials.size();
+}
+
+
+uint32_t
+thrive::colourMaterialKey(
+    const Ogre::ColourValue& colour
+) {
+    return channelLevel(colour.r)
+        | channelLevel(colour.g) << 8
+        | channelLevel(colour.b) << 16
+        | channelLevel(colour.a) << 24;
+}
+
+
+Ogre::MaterialPtr
+thrive::getVertexColourMaterial() {
+    ColourMaterialPool& pool = ::pool();
+    if (pool.m_vertexColourMaterial.isNull()) {
+        Ogre::MaterialManager& manager = Ogre::MaterialManager::getSingleton();
+        pool.m_vertexColourMaterial = manager.getDefaultSettings()->clone(
+            "ColourMaterial/vertex"
         );
-        material->setAmbient(0.3 * colour);
-        material->setDiffuse(colour);
+        pool.m_vertexColourMaterial->setAmbient(0.3, 0.3, 0.3);
+        Ogre::Pass* pass = pool.m_vertexColourMaterial->getTechnique(0)->getPass(0);
+        pass->setVertexColourTracking(Ogre::TVC_DIFFUSE);
     }
-    return material;
+    return pool.m_vertexColourMaterial;
+}
+
+
+void
+thrive::releaseColourMaterials() {
+    ColourMaterialPool& pool = ::pool();
+    pool.m_materials.clear();
+    pool.m_vertexColourMaterial.setNull();
+    pool.m_nextCollection = MIN_COLLECTION_SIZE;
 }
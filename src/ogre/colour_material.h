@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace Ogre {
     class MaterialPtr;
     class ColourValue;
@@ -7,9 +10,61 @@ namespace Ogre {
 
 namespace thrive {
 
+/**
+* @brief Returns a material with the given colour
+*
+* The materials are pooled. Colours are rounded to steps that look the
+* same on screen, so slightly different colours, like those of organelles
+* that recolour with their contents, share a material and can be batched
+* together.
+*
+* Materials that no sub-entity uses anymore are removed from Ogre once the
+* pool has grown, so the number of materials stays bounded.
+*
+* @param colour
+*   The diffuse colour, the ambient colour is derived from it
+*/
 Ogre::MaterialPtr
 getColourMaterial(
     const Ogre::ColourValue& colour
 );
 
+/**
+* @brief The number of pooled colour materials
+*/
+size_t
+colourMaterialCount();
+
+/**
+* @brief The pool key of a colour
+*
+* Colours with the same key share a material.
+*
+* @param colour
+*   Channels are clamped to [0, 1]
+*/
+uint32_t
+colourMaterialKey(
+    const Ogre::ColourValue& colour
+);
+
+/**
+* @brief Returns the material for meshes with vertex colours
+*
+* Lit like the pooled colour materials, but the diffuse colour is taken
+* from each vertex. Created on first use.
+*/
+Ogre::MaterialPtr
+getVertexColourMaterial();
+
+/**
+* @brief Releases all pooled colour materials
+*
+* Also releases the getVertexColourMaterial().
+*
+* Must be called before Ogre shuts down.
+*/
+void
+releaseColourMaterials();
+
 }
@@ -0,0 +1,211 @@
+#include "ogre/colour_system.h"
+
+#include "engine/component_factory.h"
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "ogre/colour_material.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <OgreEntity.h>
+#include <OgreMaterial.h>
+#include <OgreSubEntity.h>
+#include <unordered_map>
+#include <utility>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreColourComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreColourComponent::luaBindings() {
+    using namespace luabind;
+    return class_<OgreColourComponent, Component>("OgreColourComponent")
+        .enum_("ID") [
+            value("TYPE_ID", OgreColourComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &OgreColourComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("setColour", &OgreColourComponent::setColour)
+    ;
+}
+
+
+OgreColourComponent::OgreColourComponent() {
+    m_colours.setComponent(this);
+}
+
+
+bool
+OgreColourComponent::isChangeTracked() const {
+    // Colours are only changed through setColour()
+    return true;
+}
+
+
+void
+OgreColourComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_colours.subEntities.clear();
+    StorageList colours = storage.get<StorageList>("colours");
+    for (const StorageContainer& colourStorage : colours) {
+        this->setColour(
+            colourStorage.get<std::string>("subEntityName"),
+            colourStorage.get<Ogre::ColourValue>("colour")
+        );
+    }
+}
+
+
+void
+OgreColourComponent::setColour(
+    const std::string& subEntityName,
+    const Ogre::ColourValue& colour
+) {
+    uint32_t key = colourMaterialKey(colour);
+    for (SubEntityColour& entry : m_colours.subEntities) {
+        if (entry.m_subEntityName != subEntityName) {
+            continue;
+        }
+        entry.m_colour = colour;
+        if (entry.m_key != key) {
+            entry.m_key = key;
+            entry.m_isApplied = false;
+            m_colours.touch();
+        }
+        return;
+    }
+    SubEntityColour entry;
+    entry.m_subEntityName = subEntityName;
+    entry.m_colour = colour;
+    entry.m_key = key;
+    m_colours.subEntities.push_back(std::move(entry));
+    m_colours.touch();
+}
+
+
+StorageContainer
+OgreColourComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    StorageList colours;
+    colours.reserve(m_colours.subEntities.size());
+    for (const SubEntityColour& entry : m_colours.subEntities) {
+        StorageContainer colourStorage;
+        colourStorage.set<std::string>("subEntityName", entry.m_subEntityName);
+        colourStorage.set<Ogre::ColourValue>("colour", entry.m_colour);
+        colours.append(std::move(colourStorage));
+    }
+    storage.set<StorageList>("colours", std::move(colours));
+    return storage;
+}
+
+REGISTER_COMPONENT(OgreColourComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreColourSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreColourSystem::luaBindings() {
+    using namespace luabind;
+    return class_<OgreColourSystem, System>("OgreColourSystem")
+        .def(constructor<>())
+    ;
+}
+
+
+struct OgreColourSystem::Implementation {
+
+    const Ogre::MaterialPtr&
+    material(
+        const OgreColourComponent::SubEntityColour& entry
+    ) {
+        auto iter = m_materials.find(entry.m_key);
+        if (iter == m_materials.end()) {
+            iter = m_materials.emplace(entry.m_key, getColourMaterial(entry.m_colour)).first;
+        }
+        return iter->second;
+    }
+
+    EntityFilter<
+        OgreColourComponent,
+        OgreSceneNodeComponent
+    > m_entities;
+
+    // The materials looked up in this frame, by colour key
+    std::unordered_map<uint32_t, Ogre::MaterialPtr> m_materials;
+
+};
+
+
+OgreColourSystem::OgreColourSystem()
+  : m_impl(new Implementation())
+{
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareWrite(OgreColourComponent::TYPE_ID);
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+OgreColourSystem::~OgreColourSystem() {}
+
+
+void
+OgreColourSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+void
+OgreColourSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_materials.clear();
+    System::shutdown();
+}
+
+
+void
+OgreColourSystem::update(int) {
+    for (const auto& item : m_impl->m_entities) {
+        OgreColourComponent* colourComponent = std::get<0>(item.second);
+        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+        Ogre::Entity* entity = sceneNodeComponent->m_entity;
+        if (not entity) {
+            continue;
+        }
+        auto& colours = colourComponent->m_colours;
+        bool isNewEntity = colourComponent->m_appliedRevision != sceneNodeComponent->m_entityRevision;
+        if (isNewEntity) {
+            for (auto& entry : colours.subEntities) {
+                entry.m_isApplied = false;
+            }
+        }
+        else if (not colours.hasChanges() or not sceneNodeComponent->m_isOnScreen) {
+            continue;
+        }
+        for (auto& entry : colours.subEntities) {
+            if (not entry.m_isApplied) {
+                entity->getSubEntity(entry.m_subEntityName)->setMaterial(
+                    m_impl->material(entry)
+                );
+                entry.m_isApplied = true;
+            }
+        }
+        colourComponent->m_appliedRevision = sceneNodeComponent->m_entityRevision;
+        colours.untouch();
+    }
+    // Holding on to the materials would keep the pool from collecting them
+    m_impl->m_materials.clear();
+}
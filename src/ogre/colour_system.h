@@ -0,0 +1,197 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "engine/touchable.h"
+
+#include <cstdint>
+#include <memory>
+#include <OgreColourValue.h>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Colours of an entity's sub-entities
+*
+* Setting a colour only records it, the OgreColourSystem applies all
+* changed colours once per frame through materials from
+* getColourMaterial(). Colours that get the same pooled material as the
+* one already applied are not changed again.
+*
+* Requires an OgreSceneNodeComponent with a mesh.
+*/
+class OgreColourComponent : public Component {
+    COMPONENT(OgreColour)
+
+public:
+
+    /**
+    * @brief The colour of a sub-entity
+    */
+    struct SubEntityColour {
+
+        /**
+        * @brief The name of the sub-entity
+        */
+        std::string m_subEntityName;
+
+        /**
+        * @brief The colour
+        */
+        Ogre::ColourValue m_colour;
+
+        /**
+        * @brief The colourMaterialKey() of m_colour
+        */
+        uint32_t m_key = 0;
+
+        /**
+        * @brief Whether m_key's material is set on the sub-entity
+        */
+        bool m_isApplied = false;
+
+    };
+
+    /**
+    * @brief The colours, in the order they were first set
+    */
+    struct Colours : public Touchable {
+
+        /**
+        * @brief One entry per sub-entity
+        */
+        std::vector<SubEntityColour> subEntities;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreColourComponent()
+    * - OgreColourComponent::setColour
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreColourComponent();
+
+    bool
+    isChangeTracked() const override;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief Sets the colour of a sub-entity
+    *
+    * @param subEntityName
+    *   The name of the sub-entity in the mesh
+    * @param colour
+    *   The new colour
+    */
+    void
+    setColour(
+        const std::string& subEntityName,
+        const Ogre::ColourValue& colour
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief The OgreSceneNodeComponent::m_entityRevision the colours
+    * were last applied to, don't use this directly
+    */
+    unsigned int m_appliedRevision = 0;
+
+    /**
+    * @brief The colours, touched whenever one needs to be applied
+    */
+    Colours m_colours;
+
+};
+
+
+/**
+* @brief Applies the colours of OgreColourComponents
+*
+* Changes to entities that are not on screen (see
+* OgreSceneNodeComponent::m_isOnScreen) wait until they are. New
+* entities get their colours right away, so they are never rendered
+* uncoloured. Each distinct colour is looked up in the material pool only
+* once per frame.
+*
+* Should run after the OgreUpdateSceneNodeSystem, which creates the
+* entities.
+*/
+class OgreColourSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreColourSystem()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreColourSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~OgreColourSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Applies changed colours
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
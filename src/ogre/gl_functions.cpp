@@ -0,0 +1,72 @@
+#include "ogre/gl_functions.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+#endif
+
+using namespace thrive;
+
+
+void*
+thrive::loadGlFunction(
+    const char* name
+) {
+#ifdef _WIN32
+    // Only OpenGL 1.1 functions are exported from opengl32.dll itself
+    HMODULE library = GetModuleHandleA("opengl32.dll");
+    if (not library) {
+        return nullptr;
+    }
+    void* function = reinterpret_cast<void*>(GetProcAddress(library, name));
+    if (function) {
+        return function;
+    }
+    typedef PROC (WINAPI *GetProcAddressFunction)(LPCSTR);
+    auto wglGetProcAddress = reinterpret_cast<GetProcAddressFunction>(
+        GetProcAddress(library, "wglGetProcAddress")
+    );
+    return wglGetProcAddress ? reinterpret_cast<void*>(wglGetProcAddress(name)) : nullptr;
+#elif defined(__APPLE__)
+    return dlsym(RTLD_DEFAULT, name);
+#else
+    // Ogre's render system has loaded libGL already
+    typedef void* (*GetProcAddressFunction)(const unsigned char*);
+    static auto glXGetProcAddress = reinterpret_cast<GetProcAddressFunction>(
+        dlsym(RTLD_DEFAULT, "glXGetProcAddressARB")
+    );
+    void* function = dlsym(RTLD_DEFAULT, name);
+    if (not function and glXGetProcAddress) {
+        function = glXGetProcAddress(reinterpret_cast<const unsigned char*>(name));
+    }
+    return function;
+#endif
+}
+
+
+bool
+thrive::hasGlFeature(
+    const unsigned char* (THRIVE_GL_APIENTRY *getString)(gl::GLenum),
+    long major,
+    long minor,
+    const char* extension
+) {
+    const char* version = reinterpret_cast<const char*>(getString(gl::GL_VERSION));
+    if (version) {
+        char* end = nullptr;
+        long versionMajor = std::strtol(version, &end, 10);
+        long versionMinor = *end == '.' ? std::strtol(end + 1, nullptr, 10) : 0;
+        if (versionMajor > major or (versionMajor == major and versionMinor >= minor)) {
+            return true;
+        }
+    }
+    if (not extension) {
+        return false;
+    }
+    const char* extensions = reinterpret_cast<const char*>(getString(gl::GL_EXTENSIONS));
+    return extensions and std::strstr(extensions, extension);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+    #define THRIVE_GL_APIENTRY __stdcall
+#else
+    #define THRIVE_GL_APIENTRY
+#endif
+
+namespace thrive {
+
+/**
+* @brief OpenGL types, from gl.h and glext.h
+*
+* Not every platform's OpenGL SDK has a glext.h recent enough, so code
+* that talks to OpenGL directly declares the functions and constants it
+* needs and loads the functions with loadGlFunction().
+*/
+namespace gl {
+
+typedef unsigned char GLboolean;
+typedef char GLchar;
+typedef unsigned int GLbitfield;
+typedef unsigned int GLenum;
+typedef float GLfloat;
+typedef int GLint;
+typedef std::ptrdiff_t GLintptr;
+typedef int GLsizei;
+typedef std::ptrdiff_t GLsizeiptr;
+typedef struct __GLsync* GLsync;
+typedef unsigned int GLuint;
+typedef uint64_t GLuint64;
+
+const GLenum GL_EXTENSIONS = 0x1F03;
+const GLenum GL_VERSION = 0x1F02;
+
+}
+
+/**
+* @brief Looks up an OpenGL function
+*
+* Must be called while the OpenGL context of Ogre's render system is
+* current.
+*
+* @param name
+*   The function's name, e.g. \c "glGenQueries"
+*
+* @return
+*   The function or \c nullptr if the context doesn't have it
+*/
+void*
+loadGlFunction(
+    const char* name
+);
+
+/**
+* @brief Looks up an OpenGL function and casts it
+*
+* @param[out] function
+*   The function, \c nullptr if the context doesn't have it
+* @param name
+*   The function's name
+*
+* @return
+*   \c false if the context doesn't have the function
+*/
+template<typename Function>
+bool
+loadGlFunction(
+    Function& function,
+    const char* name
+) {
+    function = reinterpret_cast<Function>(loadGlFunction(name));
+    return function != nullptr;
+}
+
+/**
+* @brief Whether the current OpenGL context has at least a version or an
+* extension
+*
+* @param getString
+*   The context's \c glGetString
+* @param major
+* @param minor
+*   The OpenGL version that has the feature built in
+* @param extension
+*   The extension that provides the feature otherwise, \c nullptr if there
+*   is none
+*/
+bool
+hasGlFeature(
+    const unsigned char* (THRIVE_GL_APIENTRY *getString)(gl::GLenum),
+    long major,
+    long minor,
+    const char* extension
+);
+
+}
@@ -0,0 +1,1025 @@
+#include "ogre/gpu_particles.h"
+
+#include "ogre/gl_functions.h"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <iostream>
+#include <string>
+
+using namespace thrive;
+using namespace thrive::gl;
+
+namespace {
+
+const GLenum GL_ALPHA_TEST = 0x0BC0;
+const GLenum GL_ALREADY_SIGNALED = 0x911A;
+const GLenum GL_ARRAY_BUFFER = 0x8892;
+const GLenum GL_ARRAY_BUFFER_BINDING = 0x8894;
+const GLenum GL_BLEND = 0x0BE2;
+const GLenum GL_BLEND_DST_ALPHA = 0x80CA;
+const GLenum GL_BLEND_DST_RGB = 0x80C8;
+const GLenum GL_BLEND_EQUATION_ALPHA = 0x883D;
+const GLenum GL_BLEND_EQUATION_RGB = 0x8009;
+const GLenum GL_BLEND_SRC_ALPHA = 0x80CB;
+const GLenum GL_BLEND_SRC_RGB = 0x80C9;
+const GLenum GL_COLOR = 0x1800;
+const GLenum GL_COLOR_ATTACHMENT0 = 0x8CE0;
+const GLenum GL_COLOR_WRITEMASK = 0x0C23;
+const GLenum GL_COMPILE_STATUS = 0x8B81;
+const GLenum GL_CONDITION_SATISFIED = 0x911C;
+const GLenum GL_CULL_FACE = 0x0B44;
+const GLenum GL_CURRENT_PROGRAM = 0x8B8D;
+const GLenum GL_DEPTH_TEST = 0x0B71;
+const GLenum GL_DEPTH_WRITEMASK = 0x0B72;
+const GLenum GL_DRAW_FRAMEBUFFER = 0x8CA9;
+const GLenum GL_DRAW_FRAMEBUFFER_BINDING = 0x8CA6;
+const GLenum GL_DYNAMIC_COPY = 0x88EA;
+const GLenum GL_FLOAT = 0x1406;
+const GLenum GL_FRAGMENT_SHADER = 0x8B30;
+const GLenum GL_FRAMEBUFFER = 0x8D40;
+const GLenum GL_FRAMEBUFFER_COMPLETE = 0x8CD5;
+const GLenum GL_FUNC_ADD = 0x8006;
+const GLenum GL_INFO_LOG_LENGTH = 0x8B84;
+const GLenum GL_INTERLEAVED_ATTRIBS = 0x8C8C;
+const GLenum GL_LINK_STATUS = 0x8B82;
+const GLbitfield GL_MAP_READ_BIT = 0x0001;
+const GLenum GL_ONE = 1;
+const GLenum GL_ONE_MINUS_SRC_ALPHA = 0x0303;
+const GLenum GL_PIXEL_PACK_BUFFER = 0x88EB;
+const GLenum GL_PIXEL_PACK_BUFFER_BINDING = 0x88ED;
+const GLenum GL_POINTS = 0x0000;
+const GLenum GL_PROGRAM_POINT_SIZE = 0x8642;
+const GLenum GL_R32F = 0x822E;
+const GLenum GL_RASTERIZER_DISCARD = 0x8C89;
+const GLenum GL_READ_FRAMEBUFFER = 0x8CA8;
+const GLenum GL_READ_FRAMEBUFFER_BINDING = 0x8CAA;
+const GLenum GL_RED = 0x1903;
+const GLenum GL_RENDERBUFFER = 0x8D41;
+const GLenum GL_RENDERBUFFER_BINDING = 0x8CA7;
+const GLenum GL_SCISSOR_TEST = 0x0C11;
+const GLenum GL_SRC_ALPHA = 0x0302;
+const GLenum GL_STATIC_DRAW = 0x88E4;
+const GLenum GL_STENCIL_TEST = 0x0B90;
+const GLenum GL_STREAM_READ = 0x88E1;
+const GLbitfield GL_SYNC_FLUSH_COMMANDS_BIT = 0x0001;
+const GLenum GL_SYNC_GPU_COMMANDS_COMPLETE = 0x9117;
+const GLenum GL_TRANSFORM_FEEDBACK_BUFFER = 0x8C8E;
+const GLenum GL_TRANSFORM_FEEDBACK_BUFFER_BINDING = 0x8C8F;
+const GLenum GL_TRIANGLE_STRIP = 0x0005;
+const GLenum GL_VERTEX_ARRAY_BINDING = 0x85B5;
+const GLenum GL_VERTEX_SHADER = 0x8B31;
+const GLenum GL_VIEWPORT = 0x0BA2;
+
+// Name, return type, parameters
+#define THRIVE_GL_PARTICLE_FUNCTIONS(F) \
+    F(glAttachShader, void, (GLuint, GLuint)) \
+    F(glBeginTransformFeedback, void, (GLenum)) \
+    F(glBindBuffer, void, (GLenum, GLuint)) \
+    F(glBindBufferBase, void, (GLenum, GLuint, GLuint)) \
+    F(glBindFramebuffer, void, (GLenum, GLuint)) \
+    F(glBindRenderbuffer, void, (GLenum, GLuint)) \
+    F(glBindVertexArray, void, (GLuint)) \
+    F(glBlendEquationSeparate, void, (GLenum, GLenum)) \
+    F(glBlendFuncSeparate, void, (GLenum, GLenum, GLenum, GLenum)) \
+    F(glBufferData, void, (GLenum, GLsizeiptr, const void*, GLenum)) \
+    F(glBufferSubData, void, (GLenum, GLintptr, GLsizeiptr, const void*)) \
+    F(glCheckFramebufferStatus, GLenum, (GLenum)) \
+    F(glClearBufferfv, void, (GLenum, GLint, const GLfloat*)) \
+    F(glClientWaitSync, GLenum, (GLsync, GLbitfield, GLuint64)) \
+    F(glColorMask, void, (GLboolean, GLboolean, GLboolean, GLboolean)) \
+    F(glCompileShader, void, (GLuint)) \
+    F(glCreateProgram, GLuint, ()) \
+    F(glCreateShader, GLuint, (GLenum)) \
+    F(glDeleteBuffers, void, (GLsizei, const GLuint*)) \
+    F(glDeleteFramebuffers, void, (GLsizei, const GLuint*)) \
+    F(glDeleteProgram, void, (GLuint)) \
+    F(glDeleteRenderbuffers, void, (GLsizei, const GLuint*)) \
+    F(glDeleteShader, void, (GLuint)) \
+    F(glDeleteSync, void, (GLsync)) \
+    F(glDeleteVertexArrays, void, (GLsizei, const GLuint*)) \
+    F(glDepthMask, void, (GLboolean)) \
+    F(glDisable, void, (GLenum)) \
+    F(glDrawArrays, void, (GLenum, GLint, GLsizei)) \
+    F(glDrawArraysInstanced, void, (GLenum, GLint, GLsizei, GLsizei)) \
+    F(glEnable, void, (GLenum)) \
+    F(glEnableVertexAttribArray, void, (GLuint)) \
+    F(glEndTransformFeedback, void, ()) \
+    F(glFenceSync, GLsync, (GLenum, GLbitfield)) \
+    F(glFramebufferRenderbuffer, void, (GLenum, GLenum, GLenum, GLuint)) \
+    F(glGenBuffers, void, (GLsizei, GLuint*)) \
+    F(glGenFramebuffers, void, (GLsizei, GLuint*)) \
+    F(glGenRenderbuffers, void, (GLsizei, GLuint*)) \
+    F(glGenVertexArrays, void, (GLsizei, GLuint*)) \
+    F(glGetBooleanv, void, (GLenum, GLboolean*)) \
+    F(glGetIntegerv, void, (GLenum, GLint*)) \
+    F(glGetProgramInfoLog, void, (GLuint, GLsizei, GLsizei*, GLchar*)) \
+    F(glGetProgramiv, void, (GLuint, GLenum, GLint*)) \
+    F(glGetShaderInfoLog, void, (GLuint, GLsizei, GLsizei*, GLchar*)) \
+    F(glGetShaderiv, void, (GLuint, GLenum, GLint*)) \
+    F(glGetString, const unsigned char*, (GLenum)) \
+    F(glGetUniformLocation, GLint, (GLuint, const GLchar*)) \
+    F(glIsEnabled, GLboolean, (GLenum)) \
+    F(glLinkProgram, void, (GLuint)) \
+    F(glMapBufferRange, void*, (GLenum, GLintptr, GLsizeiptr, GLbitfield)) \
+    F(glReadPixels, void, (GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*)) \
+    F(glRenderbufferStorage, void, (GLenum, GLenum, GLsizei, GLsizei)) \
+    F(glShaderSource, void, (GLuint, GLsizei, const GLchar* const*, const GLint*)) \
+    F(glTransformFeedbackVaryings, void, (GLuint, GLsizei, const GLchar* const*, GLenum)) \
+    F(glUniform1f, void, (GLint, GLfloat)) \
+    F(glUniform1i, void, (GLint, GLint)) \
+    F(glUniform2f, void, (GLint, GLfloat, GLfloat)) \
+    F(glUniform3f, void, (GLint, GLfloat, GLfloat, GLfloat)) \
+    F(glUniform4fv, void, (GLint, GLsizei, const GLfloat*)) \
+    F(glUniformMatrix4fv, void, (GLint, GLsizei, GLboolean, const GLfloat*)) \
+    F(glUnmapBuffer, GLboolean, (GLenum)) \
+    F(glUseProgram, void, (GLuint)) \
+    F(glVertexAttribDivisor, void, (GLuint, GLuint)) \
+    F(glVertexAttribPointer, void, (GLuint, GLint, GLenum, GLboolean, GLsizei, const void*)) \
+    F(glViewport, void, (GLint, GLint, GLsizei, GLsizei))
+
+struct Gl {
+
+#define THRIVE_DECLARE_GL_FUNCTION(name, result, parameters) \
+    result (THRIVE_GL_APIENTRY *name) parameters = nullptr;
+    THRIVE_GL_PARTICLE_FUNCTIONS(THRIVE_DECLARE_GL_FUNCTION)
+#undef THRIVE_DECLARE_GL_FUNCTION
+
+    bool
+    load() {
+        bool isLoaded = true;
+#define THRIVE_LOAD_GL_FUNCTION(name, result, parameters) \
+        isLoaded = loadGlFunction(name, #name) and isLoaded;
+        THRIVE_GL_PARTICLE_FUNCTIONS(THRIVE_LOAD_GL_FUNCTION)
+#undef THRIVE_LOAD_GL_FUNCTION
+        return isLoaded;
+    }
+
+};
+
+// Position, velocity and (potency, time to live, type, absorber), where
+// the absorber is its index plus one in the step that absorbed the
+// particle and zero otherwise
+const size_t PARTICLE_FLOATS = 10;
+
+const GLsizei PARTICLE_STRIDE = PARTICLE_FLOATS * sizeof(GLfloat);
+
+const size_t STATE_OFFSET = 6 * sizeof(GLfloat);
+
+// Pixel buffers in flight, before a step waits for the oldest
+const size_t READBACK_COUNT = 4;
+
+const char* const SIMULATION_SHADER =
+    "layout(location = 0) in vec3 position;\n"
+    "layout(location = 1) in vec3 velocity;\n"
+    "layout(location = 2) in vec4 state;\n"
+    "uniform float seconds;\n"
+    "uniform int absorberCount;\n"
+    "uniform vec4 absorbers[MAX_ABSORBERS];\n"
+    "out vec3 nextPosition;\n"
+    "out vec3 nextVelocity;\n"
+    "out vec4 nextState;\n"
+    "void main() {\n"
+    "    nextPosition = position;\n"
+    "    nextVelocity = velocity;\n"
+    "    nextState = vec4(state.xyz, 0.0);\n"
+    "    if (state.y <= 0.0) {\n"
+    "        return;\n"
+    "    }\n"
+    "    nextPosition += velocity * seconds;\n"
+    "    nextState.y -= seconds * 1000.0;\n"
+    "    for (int i = 0; i < absorberCount; ++i) {\n"
+    "        vec4 box = absorbers[i];\n"
+    "        if (all(greaterThanEqual(nextPosition.xy, box.xy)) && all(lessThanEqual(nextPosition.xy, box.zw))) {\n"
+    "            nextState.y = 0.0;\n"
+    "            nextState.w = float(i + 1);\n"
+    "            break;\n"
+    "        }\n"
+    "    }\n"
+    "}\n";
+
+// Draws each absorbed particle as a point onto the texel of its absorber
+// and type, where blending sums them up
+const char* const ABSORPTION_VERTEX_SHADER =
+    "layout(location = 0) in vec4 state;\n"
+    "uniform vec2 targetSize;\n"
+    "out float amount;\n"
+    "void main() {\n"
+    "    gl_PointSize = 1.0;\n"
+    "    amount = state.x;\n"
+    "    if (state.w == 0.0) {\n"
+    "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec2 texel = vec2(state.w - 1.0, state.z) + 0.5;\n"
+    "    gl_Position = vec4(texel / targetSize * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+const char* const ABSORPTION_FRAGMENT_SHADER =
+    "in float amount;\n"
+    "out vec4 fragment;\n"
+    "void main() {\n"
+    "    fragment = vec4(amount, 0.0, 0.0, 0.0);\n"
+    "}\n";
+
+const char* const DRAW_VERTEX_SHADER =
+    "layout(location = 0) in vec2 corner;\n"
+    "layout(location = 1) in vec3 position;\n"
+    "layout(location = 2) in vec4 state;\n"
+    "uniform mat4 viewProjection;\n"
+    "uniform vec3 right;\n"
+    "uniform vec3 up;\n"
+    "uniform vec4 colours[MAX_TYPES];\n"
+    "out vec2 offset;\n"
+    "out vec4 colour;\n"
+    "void main() {\n"
+    "    offset = corner;\n"
+    "    colour = colours[int(state.z)];\n"
+    "    if (state.y <= 0.0) {\n"
+    "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 world = position + corner.x * right + corner.y * up;\n"
+    "    gl_Position = viewProjection * vec4(world, 1.0);\n"
+    "}\n";
+
+const char* const DRAW_FRAGMENT_SHADER =
+    "in vec2 offset;\n"
+    "in vec4 colour;\n"
+    "out vec4 fragment;\n"
+    "void main() {\n"
+    "    float alpha = colour.a * (1.0 - smoothstep(0.6, 1.0, length(offset)));\n"
+    "    if (alpha <= 0.0) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    fragment = vec4(colour.rgb, alpha);\n"
+    "}\n";
+
+
+// Restores the state that Ogre's render system caches, however the
+// particles' passes change it
+class StateGuard {
+
+public:
+
+    StateGuard(
+        const Gl& gl
+    ) : m_gl(gl)
+    {
+        gl.glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &m_arrayBuffer);
+        gl.glGetIntegerv(GL_BLEND_DST_ALPHA, &m_blendDestinationAlpha);
+        gl.glGetIntegerv(GL_BLEND_DST_RGB, &m_blendDestinationRgb);
+        gl.glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &m_blendEquationAlpha);
+        gl.glGetIntegerv(GL_BLEND_EQUATION_RGB, &m_blendEquationRgb);
+        gl.glGetIntegerv(GL_BLEND_SRC_ALPHA, &m_blendSourceAlpha);
+        gl.glGetIntegerv(GL_BLEND_SRC_RGB, &m_blendSourceRgb);
+        gl.glGetBooleanv(GL_COLOR_WRITEMASK, m_colourMask.data());
+        gl.glGetBooleanv(GL_DEPTH_WRITEMASK, &m_depthMask);
+        gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_drawFramebuffer);
+        gl.glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &m_pixelPackBuffer);
+        gl.glGetIntegerv(GL_CURRENT_PROGRAM, &m_program);
+        gl.glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &m_readFramebuffer);
+        gl.glGetIntegerv(GL_RENDERBUFFER_BINDING, &m_renderbuffer);
+        gl.glGetIntegerv(GL_TRANSFORM_FEEDBACK_BUFFER_BINDING, &m_transformFeedbackBuffer);
+        gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &m_vertexArray);
+        gl.glGetIntegerv(GL_VIEWPORT, m_viewport.data());
+        for (size_t i = 0; i < CAPABILITIES.size(); ++i) {
+            m_isEnabled[i] = gl.glIsEnabled(CAPABILITIES[i]);
+        }
+    }
+
+    ~StateGuard() {
+        const Gl& gl = m_gl;
+        for (size_t i = 0; i < CAPABILITIES.size(); ++i) {
+            if (m_isEnabled[i]) {
+                gl.glEnable(CAPABILITIES[i]);
+            }
+            else {
+                gl.glDisable(CAPABILITIES[i]);
+            }
+        }
+        gl.glViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+        gl.glBindVertexArray(m_vertexArray);
+        gl.glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, m_transformFeedbackBuffer);
+        gl.glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffer);
+        gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+        gl.glUseProgram(m_program);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelPackBuffer);
+        gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_drawFramebuffer);
+        gl.glDepthMask(m_depthMask);
+        gl.glColorMask(m_colourMask[0], m_colourMask[1], m_colourMask[2], m_colourMask[3]);
+        gl.glBlendFuncSeparate(
+            m_blendSourceRgb,
+            m_blendDestinationRgb,
+            m_blendSourceAlpha,
+            m_blendDestinationAlpha
+        );
+        gl.glBlendEquationSeparate(m_blendEquationRgb, m_blendEquationAlpha);
+        gl.glBindBuffer(GL_ARRAY_BUFFER, m_arrayBuffer);
+    }
+
+private:
+
+    static const std::array<GLenum, 8> CAPABILITIES;
+
+    const Gl& m_gl;
+
+    GLint m_arrayBuffer = 0;
+
+    GLint m_blendDestinationAlpha = 0;
+
+    GLint m_blendDestinationRgb = 0;
+
+    GLint m_blendEquationAlpha = 0;
+
+    GLint m_blendEquationRgb = 0;
+
+    GLint m_blendSourceAlpha = 0;
+
+    GLint m_blendSourceRgb = 0;
+
+    std::array<GLboolean, 4> m_colourMask;
+
+    GLboolean m_depthMask = 0;
+
+    GLint m_drawFramebuffer = 0;
+
+    std::array<GLboolean, 8> m_isEnabled;
+
+    GLint m_pixelPackBuffer = 0;
+
+    GLint m_program = 0;
+
+    GLint m_readFramebuffer = 0;
+
+    GLint m_renderbuffer = 0;
+
+    GLint m_transformFeedbackBuffer = 0;
+
+    GLint m_vertexArray = 0;
+
+    std::array<GLint, 4> m_viewport;
+
+};
+
+// GL_ALPHA_TEST still applies to shaders in a compatibility context
+const std::array<GLenum, 8> StateGuard::CAPABILITIES = {{
+    GL_ALPHA_TEST,
+    GL_BLEND,
+    GL_CULL_FACE,
+    GL_DEPTH_TEST,
+    GL_PROGRAM_POINT_SIZE,
+    GL_RASTERIZER_DISCARD,
+    GL_SCISSOR_TEST,
+    GL_STENCIL_TEST
+}};
+
+} // namespace
+
+
+struct GpuParticles::Implementation {
+
+    struct Readback {
+
+        uint32_t absorberCount = 0;
+
+        std::vector<uint32_t> absorberIds;
+
+        GLuint buffer = 0;
+
+        GLsync sync = nullptr;
+
+        uint32_t typeCount = 0;
+
+    };
+
+    struct Absorbed {
+
+        uint32_t absorberId;
+
+        uint32_t type;
+
+        float amount;
+
+    };
+
+    GLuint
+    compile(
+        GLenum type,
+        const char* source
+    ) {
+        std::string header =
+            "#version 330\n"
+            "#define MAX_ABSORBERS " + std::to_string(MAX_ABSORBERS) + "\n"
+            "#define MAX_TYPES " + std::to_string(MAX_TYPES) + "\n";
+        const GLchar* sources[] = {header.c_str(), source};
+        GLuint shader = m_gl.glCreateShader(type);
+        m_gl.glShaderSource(shader, 2, sources, nullptr);
+        m_gl.glCompileShader(shader);
+        GLint isCompiled = 0;
+        m_gl.glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+        if (not isCompiled) {
+            GLint length = 0;
+            m_gl.glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            std::string log(std::max(length, 1), '\0');
+            m_gl.glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+            std::cerr << "Warning: Can't compile particle shader: " << log << std::endl;
+            m_gl.glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    // Collects the results of the oldest readback, waiting for them if
+    // isBlocking is set
+    bool
+    finishReadback(
+        bool isBlocking
+    ) {
+        Readback& readback = m_readbacks[m_pendingReadbacks.front()];
+        GLenum status = m_gl.glClientWaitSync(
+            readback.sync,
+            isBlocking ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+            isBlocking ? 1000000000 : 0
+        );
+        if (not isBlocking and status != GL_ALREADY_SIGNALED and status != GL_CONDITION_SATISFIED) {
+            return false;
+        }
+        // Blocking waits that time out, or fail, lose their results
+        if (status == GL_ALREADY_SIGNALED or status == GL_CONDITION_SATISFIED) {
+            size_t size = readback.absorberCount * readback.typeCount * sizeof(GLfloat);
+            m_gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            const GLfloat* amounts = static_cast<const GLfloat*>(
+                m_gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT)
+            );
+            if (amounts) {
+                for (uint32_t type = 0; type < readback.typeCount; ++type) {
+                    for (uint32_t absorber = 0; absorber < readback.absorberCount; ++absorber) {
+                        float amount = amounts[type * readback.absorberCount + absorber];
+                        if (amount > 0.0f) {
+                            m_absorbed.push_back({readback.absorberIds[absorber], type, amount});
+                        }
+                    }
+                }
+                m_gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+        }
+        m_gl.glDeleteSync(readback.sync);
+        readback.sync = nullptr;
+        m_pendingReadbacks.pop_front();
+        return true;
+    }
+
+    GLuint
+    link(
+        GLuint vertexShader,
+        GLuint fragmentShader,
+        const std::vector<const GLchar*>& varyings
+    ) {
+        if (not vertexShader) {
+            return 0;
+        }
+        GLuint program = m_gl.glCreateProgram();
+        m_gl.glAttachShader(program, vertexShader);
+        if (fragmentShader) {
+            m_gl.glAttachShader(program, fragmentShader);
+        }
+        if (not varyings.empty()) {
+            m_gl.glTransformFeedbackVaryings(
+                program,
+                static_cast<GLsizei>(varyings.size()),
+                varyings.data(),
+                GL_INTERLEAVED_ATTRIBS
+            );
+        }
+        m_gl.glLinkProgram(program);
+        m_gl.glDeleteShader(vertexShader);
+        if (fragmentShader) {
+            m_gl.glDeleteShader(fragmentShader);
+        }
+        GLint isLinked = 0;
+        m_gl.glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+        if (not isLinked) {
+            GLint length = 0;
+            m_gl.glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::string log(std::max(length, 1), '\0');
+            m_gl.glGetProgramInfoLog(program, length, nullptr, &log[0]);
+            std::cerr << "Warning: Can't link particle program: " << log << std::endl;
+            m_gl.glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    bool
+    createObjects() {
+        m_simulationProgram = this->link(
+            this->compile(GL_VERTEX_SHADER, SIMULATION_SHADER),
+            0,
+            {"nextPosition", "nextVelocity", "nextState"}
+        );
+        m_absorptionProgram = this->link(
+            this->compile(GL_VERTEX_SHADER, ABSORPTION_VERTEX_SHADER),
+            this->compile(GL_FRAGMENT_SHADER, ABSORPTION_FRAGMENT_SHADER),
+            {}
+        );
+        m_drawProgram = this->link(
+            this->compile(GL_VERTEX_SHADER, DRAW_VERTEX_SHADER),
+            this->compile(GL_FRAGMENT_SHADER, DRAW_FRAGMENT_SHADER),
+            {}
+        );
+        if (not m_simulationProgram or not m_absorptionProgram or not m_drawProgram) {
+            return false;
+        }
+        m_absorberCountLocation = m_gl.glGetUniformLocation(m_simulationProgram, "absorberCount");
+        m_absorbersLocation = m_gl.glGetUniformLocation(m_simulationProgram, "absorbers");
+        m_secondsLocation = m_gl.glGetUniformLocation(m_simulationProgram, "seconds");
+        m_targetSizeLocation = m_gl.glGetUniformLocation(m_absorptionProgram, "targetSize");
+        m_coloursLocation = m_gl.glGetUniformLocation(m_drawProgram, "colours");
+        m_rightLocation = m_gl.glGetUniformLocation(m_drawProgram, "right");
+        m_upLocation = m_gl.glGetUniformLocation(m_drawProgram, "up");
+        m_viewProjectionLocation = m_gl.glGetUniformLocation(m_drawProgram, "viewProjection");
+        // Particle buffers, all expired to start with
+        std::vector<GLfloat> zeros(m_capacity * PARTICLE_FLOATS, 0.0f);
+        m_gl.glGenBuffers(2, m_particleBuffers.data());
+        for (GLuint buffer : m_particleBuffers) {
+            m_gl.glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            m_gl.glBufferData(GL_ARRAY_BUFFER, zeros.size() * sizeof(GLfloat), zeros.data(), GL_DYNAMIC_COPY);
+        }
+        const GLfloat corners[] = {
+            -1.0f, -1.0f,
+             1.0f, -1.0f,
+            -1.0f,  1.0f,
+             1.0f,  1.0f
+        };
+        m_gl.glGenBuffers(1, &m_cornerBuffer);
+        m_gl.glBindBuffer(GL_ARRAY_BUFFER, m_cornerBuffer);
+        m_gl.glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        // One vertex array per pass and particle buffer, so that passes
+        // only bind them
+        auto offset = [] (size_t bytes) {
+            return reinterpret_cast<const void*>(bytes);
+        };
+        m_gl.glGenVertexArrays(2, m_simulationArrays.data());
+        m_gl.glGenVertexArrays(2, m_absorptionArrays.data());
+        m_gl.glGenVertexArrays(2, m_drawArrays.data());
+        for (size_t i = 0; i < 2; ++i) {
+            m_gl.glBindVertexArray(m_simulationArrays[i]);
+            m_gl.glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffers[i]);
+            for (GLuint location = 0; location < 3; ++location) {
+                m_gl.glEnableVertexAttribArray(location);
+            }
+            m_gl.glVertexAttribPointer(0, 3, GL_FLOAT, 0, PARTICLE_STRIDE, offset(0));
+            m_gl.glVertexAttribPointer(1, 3, GL_FLOAT, 0, PARTICLE_STRIDE, offset(3 * sizeof(GLfloat)));
+            m_gl.glVertexAttribPointer(2, 4, GL_FLOAT, 0, PARTICLE_STRIDE, offset(STATE_OFFSET));
+            m_gl.glBindVertexArray(m_absorptionArrays[i]);
+            m_gl.glEnableVertexAttribArray(0);
+            m_gl.glVertexAttribPointer(0, 4, GL_FLOAT, 0, PARTICLE_STRIDE, offset(STATE_OFFSET));
+            m_gl.glBindVertexArray(m_drawArrays[i]);
+            for (GLuint location = 0; location < 3; ++location) {
+                m_gl.glEnableVertexAttribArray(location);
+            }
+            m_gl.glVertexAttribPointer(1, 3, GL_FLOAT, 0, PARTICLE_STRIDE, offset(0));
+            m_gl.glVertexAttribPointer(2, 4, GL_FLOAT, 0, PARTICLE_STRIDE, offset(STATE_OFFSET));
+            m_gl.glVertexAttribDivisor(1, 1);
+            m_gl.glVertexAttribDivisor(2, 1);
+            m_gl.glBindBuffer(GL_ARRAY_BUFFER, m_cornerBuffer);
+            m_gl.glVertexAttribPointer(0, 2, GL_FLOAT, 0, 0, offset(0));
+        }
+        // One texel per absorber and type
+        m_gl.glGenRenderbuffers(1, &m_absorptionTarget);
+        m_gl.glBindRenderbuffer(GL_RENDERBUFFER, m_absorptionTarget);
+        m_gl.glRenderbufferStorage(GL_RENDERBUFFER, GL_R32F, MAX_ABSORBERS, MAX_TYPES);
+        m_gl.glGenFramebuffers(1, &m_absorptionFramebuffer);
+        m_gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_absorptionFramebuffer);
+        m_gl.glFramebufferRenderbuffer(
+            GL_DRAW_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER,
+            m_absorptionTarget
+        );
+        if (m_gl.glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Warning: Can't render particle absorption" << std::endl;
+            return false;
+        }
+        for (Readback& readback : m_readbacks) {
+            m_gl.glGenBuffers(1, &readback.buffer);
+            m_gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            m_gl.glBufferData(
+                GL_PIXEL_PACK_BUFFER,
+                MAX_ABSORBERS * MAX_TYPES * sizeof(GLfloat),
+                nullptr,
+                GL_STREAM_READ
+            );
+        }
+        return true;
+    }
+
+    void
+    deleteObjects() {
+        while (not m_pendingReadbacks.empty()) {
+            Readback& readback = m_readbacks[m_pendingReadbacks.front()];
+            m_gl.glDeleteSync(readback.sync);
+            readback.sync = nullptr;
+            m_pendingReadbacks.pop_front();
+        }
+        for (Readback& readback : m_readbacks) {
+            m_gl.glDeleteBuffers(1, &readback.buffer);
+            readback.buffer = 0;
+        }
+        m_gl.glDeleteFramebuffers(1, &m_absorptionFramebuffer);
+        m_gl.glDeleteRenderbuffers(1, &m_absorptionTarget);
+        m_gl.glDeleteVertexArrays(2, m_drawArrays.data());
+        m_gl.glDeleteVertexArrays(2, m_absorptionArrays.data());
+        m_gl.glDeleteVertexArrays(2, m_simulationArrays.data());
+        m_gl.glDeleteBuffers(1, &m_cornerBuffer);
+        m_gl.glDeleteBuffers(2, m_particleBuffers.data());
+        // Deleting zero is ignored
+        m_gl.glDeleteProgram(m_drawProgram);
+        m_gl.glDeleteProgram(m_absorptionProgram);
+        m_gl.glDeleteProgram(m_simulationProgram);
+        m_absorptionFramebuffer = 0;
+        m_absorptionTarget = 0;
+        m_drawArrays.fill(0);
+        m_absorptionArrays.fill(0);
+        m_simulationArrays.fill(0);
+        m_cornerBuffer = 0;
+        m_particleBuffers.fill(0);
+        m_drawProgram = 0;
+        m_absorptionProgram = 0;
+        m_simulationProgram = 0;
+    }
+
+    // Writes the emitted particles into the current buffer's ring
+    void
+    upload() {
+        size_t count = std::min(m_emitted.size(), m_capacity);
+        auto first = m_emitted.end() - count;
+        m_staging.clear();
+        for (auto iter = first; iter != m_emitted.end(); ++iter) {
+            const Particle& particle = *iter;
+            m_staging.insert(m_staging.end(), {
+                particle.position.x, particle.position.y, particle.position.z,
+                particle.velocity.x, particle.velocity.y, particle.velocity.z,
+                particle.potency,
+                particle.timeToLive,
+                static_cast<GLfloat>(particle.type),
+                0.0f
+            });
+        }
+        m_emitted.clear();
+        m_gl.glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffers[m_current]);
+        size_t written = 0;
+        while (written < count) {
+            size_t chunk = std::min(count - written, m_capacity - m_next);
+            m_gl.glBufferSubData(
+                GL_ARRAY_BUFFER,
+                m_next * PARTICLE_STRIDE,
+                chunk * PARTICLE_STRIDE,
+                &m_staging[written * PARTICLE_FLOATS]
+            );
+            written += chunk;
+            m_next = (m_next + chunk) % m_capacity;
+        }
+    }
+
+    std::deque<Absorbed> m_absorbed;
+
+    std::array<GLuint, 2> m_absorptionArrays = {{0, 0}};
+
+    GLuint m_absorptionFramebuffer = 0;
+
+    GLuint m_absorptionProgram = 0;
+
+    GLuint m_absorptionTarget = 0;
+
+    GLint m_absorberCountLocation = -1;
+
+    std::vector<uint32_t> m_absorberIds;
+
+    std::vector<GLfloat> m_absorberRectangles;
+
+    GLint m_absorbersLocation = -1;
+
+    size_t m_capacity = 0;
+
+    std::array<GLfloat, 4 * MAX_TYPES> m_colours;
+
+    GLint m_coloursLocation = -1;
+
+    GLuint m_cornerBuffer = 0;
+
+    // The particle buffer with the latest state
+    size_t m_current = 0;
+
+    std::array<GLuint, 2> m_drawArrays = {{0, 0}};
+
+    GLuint m_drawProgram = 0;
+
+    std::vector<Particle> m_emitted;
+
+    Gl m_gl;
+
+    bool m_hasParticles = false;
+
+    bool m_isAvailable = false;
+
+    // The ring slot for the next emitted particle
+    size_t m_next = 0;
+
+    std::array<GLuint, 2> m_particleBuffers = {{0, 0}};
+
+    float m_particleSize = 0.3f;
+
+    std::deque<size_t> m_pendingReadbacks;
+
+    std::array<Readback, READBACK_COUNT> m_readbacks;
+
+    GLint m_rightLocation = -1;
+
+    GLint m_secondsLocation = -1;
+
+    std::array<GLuint, 2> m_simulationArrays = {{0, 0}};
+
+    GLuint m_simulationProgram = 0;
+
+    std::vector<GLfloat> m_staging;
+
+    GLint m_targetSizeLocation = -1;
+
+    uint32_t m_typeCount = 0;
+
+    GLint m_upLocation = -1;
+
+    GLint m_viewProjectionLocation = -1;
+
+};
+
+
+const size_t GpuParticles::MAX_ABSORBERS;
+
+const uint32_t GpuParticles::MAX_TYPES;
+
+
+GpuParticles::GpuParticles()
+  : m_impl(new Implementation())
+{
+    m_impl->m_colours.fill(1.0f);
+}
+
+
+GpuParticles::~GpuParticles() {}
+
+
+void
+GpuParticles::draw(
+    const Ogre::Matrix4& viewProjection,
+    const Ogre::Vector3& right,
+    const Ogre::Vector3& up
+) {
+    if (not m_impl->m_isAvailable or not m_impl->m_hasParticles) {
+        return;
+    }
+    const Gl& gl = m_impl->m_gl;
+    StateGuard guard(gl);
+    GLfloat matrix[16];
+    for (size_t row = 0; row < 4; ++row) {
+        for (size_t column = 0; column < 4; ++column) {
+            matrix[row * 4 + column] = viewProjection[row][column];
+        }
+    }
+    float halfSize = 0.5f * m_impl->m_particleSize;
+    gl.glUseProgram(m_impl->m_drawProgram);
+    // Ogre's matrices are row major
+    gl.glUniformMatrix4fv(m_impl->m_viewProjectionLocation, 1, 1, matrix);
+    gl.glUniform3f(m_impl->m_rightLocation, right.x * halfSize, right.y * halfSize, right.z * halfSize);
+    gl.glUniform3f(m_impl->m_upLocation, up.x * halfSize, up.y * halfSize, up.z * halfSize);
+    gl.glUniform4fv(m_impl->m_coloursLocation, MAX_TYPES, m_impl->m_colours.data());
+    gl.glDisable(GL_ALPHA_TEST);
+    gl.glEnable(GL_BLEND);
+    gl.glDisable(GL_CULL_FACE);
+    gl.glEnable(GL_DEPTH_TEST);
+    gl.glDisable(GL_RASTERIZER_DISCARD);
+    gl.glDisable(GL_SCISSOR_TEST);
+    gl.glDisable(GL_STENCIL_TEST);
+    gl.glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    gl.glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+    gl.glColorMask(1, 1, 1, 1);
+    gl.glDepthMask(0);
+    gl.glBindVertexArray(m_impl->m_drawArrays[m_impl->m_current]);
+    gl.glDrawArraysInstanced(
+        GL_TRIANGLE_STRIP,
+        0,
+        4,
+        static_cast<GLsizei>(m_impl->m_capacity)
+    );
+}
+
+
+void
+GpuParticles::emit(
+    const Particle& particle
+) {
+    if (not m_impl->m_isAvailable or particle.type >= MAX_TYPES) {
+        return;
+    }
+    auto& emitted = m_impl->m_emitted;
+    // Without steps, e.g. while the window is minimized, only the latest
+    // particles would fit into the ring anyway
+    if (emitted.size() >= 2 * m_impl->m_capacity) {
+        emitted.erase(emitted.begin(), emitted.end() - m_impl->m_capacity);
+    }
+    emitted.push_back(particle);
+}
+
+
+bool
+GpuParticles::init(
+    size_t capacity
+) {
+    if (m_impl->m_isAvailable) {
+        return true;
+    }
+    Gl& gl = m_impl->m_gl;
+    if (
+        capacity == 0 or
+        not gl.load() or
+        not hasGlFeature(gl.glGetString, 3, 3, nullptr)
+    ) {
+        return false;
+    }
+    m_impl->m_capacity = capacity;
+    m_impl->m_current = 0;
+    m_impl->m_next = 0;
+    {
+        StateGuard guard(gl);
+        m_impl->m_isAvailable = m_impl->createObjects();
+        if (not m_impl->m_isAvailable) {
+            m_impl->deleteObjects();
+        }
+    }
+    return m_impl->m_isAvailable;
+}
+
+
+bool
+GpuParticles::isAvailable() const {
+    return m_impl->m_isAvailable;
+}
+
+
+void
+GpuParticles::readAbsorbed(
+    const AbsorbedCallback& callback
+) {
+    if (not m_impl->m_isAvailable) {
+        return;
+    }
+    if (not m_impl->m_pendingReadbacks.empty()) {
+        StateGuard guard(m_impl->m_gl);
+        while (not m_impl->m_pendingReadbacks.empty() and m_impl->finishReadback(false)) {}
+    }
+    for (const auto& absorbed : m_impl->m_absorbed) {
+        callback(absorbed.absorberId, absorbed.type, absorbed.amount);
+    }
+    m_impl->m_absorbed.clear();
+}
+
+
+void
+GpuParticles::setAbsorbers(
+    const std::vector<Absorber>& absorbers
+) {
+    size_t count = std::min(absorbers.size(), MAX_ABSORBERS);
+    m_impl->m_absorberIds.resize(count);
+    m_impl->m_absorberRectangles.resize(4 * count);
+    for (size_t i = 0; i < count; ++i) {
+        const Absorber& absorber = absorbers[i];
+        m_impl->m_absorberIds[i] = absorber.id;
+        m_impl->m_absorberRectangles[4 * i] = absorber.minimum.x;
+        m_impl->m_absorberRectangles[4 * i + 1] = absorber.minimum.y;
+        m_impl->m_absorberRectangles[4 * i + 2] = absorber.maximum.x;
+        m_impl->m_absorberRectangles[4 * i + 3] = absorber.maximum.y;
+    }
+}
+
+
+void
+GpuParticles::setParticleSize(
+    float size
+) {
+    m_impl->m_particleSize = size;
+}
+
+
+void
+GpuParticles::setTypeColour(
+    uint32_t type,
+    const Ogre::ColourValue& colour
+) {
+    if (type >= MAX_TYPES) {
+        return;
+    }
+    m_impl->m_colours[4 * type] = colour.r;
+    m_impl->m_colours[4 * type + 1] = colour.g;
+    m_impl->m_colours[4 * type + 2] = colour.b;
+    m_impl->m_colours[4 * type + 3] = colour.a;
+    m_impl->m_typeCount = std::max(m_impl->m_typeCount, type + 1);
+}
+
+
+void
+GpuParticles::shutdown() {
+    if (not m_impl->m_isAvailable) {
+        return;
+    }
+    {
+        StateGuard guard(m_impl->m_gl);
+        m_impl->deleteObjects();
+    }
+    m_impl->m_absorbed.clear();
+    m_impl->m_emitted.clear();
+    m_impl->m_hasParticles = false;
+    m_impl->m_isAvailable = false;
+}
+
+
+void
+GpuParticles::step(
+    float seconds
+) {
+    if (not m_impl->m_isAvailable) {
+        return;
+    }
+    if (not m_impl->m_emitted.empty()) {
+        m_impl->m_hasParticles = true;
+    }
+    if (not m_impl->m_hasParticles) {
+        return;
+    }
+    const Gl& gl = m_impl->m_gl;
+    StateGuard guard(gl);
+    if (not m_impl->m_emitted.empty()) {
+        m_impl->upload();
+    }
+    // Simulation, from the current buffer into the other one
+    size_t source = m_impl->m_current;
+    size_t target = 1 - source;
+    GLsizei count = static_cast<GLsizei>(m_impl->m_capacity);
+    GLint absorberCount = static_cast<GLint>(m_impl->m_absorberIds.size());
+    gl.glUseProgram(m_impl->m_simulationProgram);
+    gl.glUniform1f(m_impl->m_secondsLocation, seconds);
+    gl.glUniform1i(m_impl->m_absorberCountLocation, absorberCount);
+    if (absorberCount > 0) {
+        gl.glUniform4fv(m_impl->m_absorbersLocation, absorberCount, m_impl->m_absorberRectangles.data());
+    }
+    gl.glBindVertexArray(m_impl->m_simulationArrays[source]);
+    gl.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_impl->m_particleBuffers[target]);
+    gl.glEnable(GL_RASTERIZER_DISCARD);
+    gl.glBeginTransformFeedback(GL_POINTS);
+    gl.glDrawArrays(GL_POINTS, 0, count);
+    gl.glEndTransformFeedback();
+    gl.glDisable(GL_RASTERIZER_DISCARD);
+    gl.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    m_impl->m_current = target;
+    uint32_t typeCount = m_impl->m_typeCount;
+    if (absorberCount == 0 or typeCount == 0) {
+        return;
+    }
+    // Absorption, summed up per absorber and type
+    auto& pendingReadbacks = m_impl->m_pendingReadbacks;
+    if (pendingReadbacks.size() == READBACK_COUNT) {
+        m_impl->finishReadback(true);
+    }
+    size_t slot = pendingReadbacks.empty() ?
+        0 : (pendingReadbacks.back() + 1) % READBACK_COUNT;
+    Implementation::Readback& readback = m_impl->m_readbacks[slot];
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_impl->m_absorptionFramebuffer);
+    gl.glViewport(0, 0, MAX_ABSORBERS, MAX_TYPES);
+    gl.glDisable(GL_ALPHA_TEST);
+    gl.glDisable(GL_CULL_FACE);
+    gl.glDisable(GL_DEPTH_TEST);
+    gl.glDisable(GL_SCISSOR_TEST);
+    gl.glDisable(GL_STENCIL_TEST);
+    gl.glColorMask(1, 1, 1, 1);
+    gl.glClearBufferfv(GL_COLOR, 0, zero);
+    gl.glEnable(GL_BLEND);
+    gl.glEnable(GL_PROGRAM_POINT_SIZE);
+    gl.glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    gl.glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+    gl.glUseProgram(m_impl->m_absorptionProgram);
+    gl.glUniform2f(m_impl->m_targetSizeLocation, float(MAX_ABSORBERS), float(MAX_TYPES));
+    gl.glBindVertexArray(m_impl->m_absorptionArrays[target]);
+    gl.glDrawArrays(GL_POINTS, 0, count);
+    // Copied into the pixel buffer without waiting, mapped once done
+    gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, m_impl->m_absorptionFramebuffer);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    gl.glReadPixels(0, 0, absorberCount, typeCount, GL_RED, GL_FLOAT, nullptr);
+    readback.sync = gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.absorberCount = absorberCount;
+    readback.absorberIds = m_impl->m_absorberIds;
+    readback.typeCount = typeCount;
+    pendingReadbacks.push_back(slot);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <OgreColourValue.h>
+#include <OgreMatrix4.h>
+#include <OgreVector2.h>
+#include <OgreVector3.h>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief Point particles that live in GPU buffers
+*
+* The particles are simulated by a transform feedback pass: step() moves
+* them along their velocity, counts down their lifetime and tests them
+* against the bounding rectangles of the absorbers on the x/y plane. A
+* particle that ends up inside an absorber is used up.
+*
+* The amounts absorbed in a step are summed up per absorber and particle
+* type on the GPU and copied into a pixel buffer. readAbsorbed() reports
+* them once the GPU is done, usually a frame or two later, so the CPU never
+* waits for the results.
+*
+* All particles are drawn as camera facing quads in a single instanced
+* draw call. The CPU only ever touches newly emitted particles.
+*
+* The particles are kept in a ring of fixed capacity. Once it's full, new
+* particles replace the oldest ones.
+*
+* Requires Ogre's OpenGL render system and OpenGL 3.3, see init(). All
+* methods must be called while Ogre's OpenGL context is current. The
+* OpenGL state Ogre keeps track of is restored afterwards.
+*/
+class GpuParticles {
+
+public:
+
+    /**
+    * @brief The most absorbers a step tests against
+    */
+    static const size_t MAX_ABSORBERS = 128;
+
+    /**
+    * @brief The most particle types
+    */
+    static const uint32_t MAX_TYPES = 32;
+
+    /**
+    * @brief An absorber's bounding rectangle
+    */
+    struct Absorber {
+
+        /**
+        * @brief Passed back to the AbsorbedCallback
+        */
+        uint32_t id;
+
+        /**
+        * @brief The corner with the smallest coordinates
+        */
+        Ogre::Vector2 minimum;
+
+        /**
+        * @brief The corner with the largest coordinates
+        */
+        Ogre::Vector2 maximum;
+
+    };
+
+    /**
+    * @brief A new particle
+    */
+    struct Particle {
+
+        Ogre::Vector3 position;
+
+        /**
+        * @brief Units per second
+        */
+        Ogre::Vector3 velocity;
+
+        /**
+        * @brief The amount an absorber takes up
+        */
+        float potency;
+
+        /**
+        * @brief Milliseconds until the particle expires
+        */
+        float timeToLive;
+
+        /**
+        * @brief Less than MAX_TYPES
+        */
+        uint32_t type;
+
+    };
+
+    /**
+    * @brief Called with the amount of a particle type an absorber took up
+    */
+    using AbsorbedCallback = std::function<void(uint32_t absorberId, uint32_t type, float amount)>;
+
+    /**
+    * @brief Constructor
+    */
+    GpuParticles();
+
+    /**
+    * @brief Destructor
+    *
+    * Call shutdown() before, while the OpenGL context still exists.
+    */
+    ~GpuParticles();
+
+    /**
+    * @brief Draws the particles
+    *
+    * Meant to be called from a render queue listener, so that the
+    * particles are depth tested against the scene.
+    *
+    * @param viewProjection
+    *   The camera's view projection matrix, as passed to the render system
+    * @param right
+    * @param up
+    *   The camera's axes in world space
+    */
+    void
+    draw(
+        const Ogre::Matrix4& viewProjection,
+        const Ogre::Vector3& right,
+        const Ogre::Vector3& up
+    );
+
+    /**
+    * @brief Adds a particle on the next step()
+    *
+    * @param particle
+    */
+    void
+    emit(
+        const Particle& particle
+    );
+
+    /**
+    * @brief Creates the buffers and programs
+    *
+    * @param capacity
+    *   The number of particles that can be alive at once
+    *
+    * @return
+    *   \c false if the current OpenGL context can't simulate particles.
+    *   The other methods do nothing then.
+    */
+    bool
+    init(
+        size_t capacity
+    );
+
+    /**
+    * @brief Whether init() succeeded
+    */
+    bool
+    isAvailable() const;
+
+    /**
+    * @brief Reports the absorbed amounts the GPU has finished summing up
+    *
+    * @param callback
+    */
+    void
+    readAbsorbed(
+        const AbsorbedCallback& callback
+    );
+
+    /**
+    * @brief Sets the absorbers for the next steps
+    *
+    * Absorbers beyond MAX_ABSORBERS are ignored.
+    *
+    * @param absorbers
+    */
+    void
+    setAbsorbers(
+        const std::vector<Absorber>& absorbers
+    );
+
+    /**
+    * @brief Sets the width and height of the particles' quads
+    *
+    * @param size
+    */
+    void
+    setParticleSize(
+        float size
+    );
+
+    /**
+    * @brief Sets the colour particles of a type are drawn with
+    *
+    * @param type
+    *   Less than MAX_TYPES
+    * @param colour
+    */
+    void
+    setTypeColour(
+        uint32_t type,
+        const Ogre::ColourValue& colour
+    );
+
+    /**
+    * @brief Deletes the buffers and programs
+    */
+    void
+    shutdown();
+
+    /**
+    * @brief Adds the emitted particles and advances the simulation
+    *
+    * @param seconds
+    *   The time to advance by
+    */
+    void
+    step(
+        float seconds
+    );
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
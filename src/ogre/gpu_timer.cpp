@@ -0,0 +1,243 @@
+#include "ogre/gpu_timer.h"
+
+#include "ogre/gl_functions.h"
+
+#include <deque>
+#include <vector>
+
+using namespace thrive;
+using namespace thrive::gl;
+
+namespace {
+
+const GLenum GL_QUERY_RESULT = 0x8866;
+const GLenum GL_QUERY_RESULT_AVAILABLE = 0x8867;
+const GLenum GL_TIMESTAMP = 0x8E28;
+
+typedef void (THRIVE_GL_APIENTRY *DeleteQueries)(GLsizei, const GLuint*);
+typedef void (THRIVE_GL_APIENTRY *GenQueries)(GLsizei, GLuint*);
+typedef void (THRIVE_GL_APIENTRY *GetQueryObjectiv)(GLuint, GLenum, GLint*);
+typedef void (THRIVE_GL_APIENTRY *GetQueryObjectui64v)(GLuint, GLenum, GLuint64*);
+typedef const unsigned char* (THRIVE_GL_APIENTRY *GetString)(GLenum);
+typedef void (THRIVE_GL_APIENTRY *QueryCounter)(GLuint, GLenum);
+
+// Frames whose results are waited for, before the oldest is dropped
+const size_t MAX_PENDING_FRAMES = 4;
+
+}
+
+
+struct GpuTimer::Implementation {
+
+    struct Timestamp {
+
+        GLuint query;
+
+        size_t scope;
+
+        bool isEnd;
+
+    };
+
+    using Frame = std::vector<Timestamp>;
+
+    GLuint
+    acquireQuery() {
+        if (m_freeQueries.empty()) {
+            GLuint query = 0;
+            m_genQueries(1, &query);
+            return query;
+        }
+        GLuint query = m_freeQueries.back();
+        m_freeQueries.pop_back();
+        return query;
+    }
+
+    bool
+    isAvailable(
+        const Frame& frame
+    ) {
+        if (frame.empty()) {
+            return true;
+        }
+        // The GPU handles the queries in order
+        GLint isAvailable = 0;
+        m_getQueryObjectiv(frame.back().query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        return isAvailable != 0;
+    }
+
+    void
+    recycle(
+        Frame& frame
+    ) {
+        for (const Timestamp& timestamp : frame) {
+            m_freeQueries.push_back(timestamp.query);
+        }
+        frame.clear();
+    }
+
+    void
+    report(
+        Frame& frame,
+        const Callback& callback
+    ) {
+        // Scopes can be timed several times per frame, but don't nest
+        // with themselves
+        for (const Timestamp& timestamp : frame) {
+            if (timestamp.scope >= m_sums.size()) {
+                m_sums.resize(timestamp.scope + 1, 0);
+                m_begins.resize(timestamp.scope + 1, 0);
+            }
+            GLuint64 time = 0;
+            m_getQueryObjectui64v(timestamp.query, GL_QUERY_RESULT, &time);
+            if (not timestamp.isEnd) {
+                m_begins[timestamp.scope] = time;
+            }
+            else if (time > m_begins[timestamp.scope]) {
+                m_sums[timestamp.scope] += time - m_begins[timestamp.scope];
+            }
+        }
+        for (size_t scope = 0; scope < m_sums.size(); ++scope) {
+            if (m_sums[scope] > 0) {
+                callback(scope, static_cast<uint32_t>(m_sums[scope] / 1000));
+                m_sums[scope] = 0;
+            }
+        }
+        this->recycle(frame);
+    }
+
+    void
+    timestamp(
+        size_t scope,
+        bool isEnd
+    ) {
+        if (not m_isAvailable) {
+            return;
+        }
+        Timestamp timestamp;
+        timestamp.query = this->acquireQuery();
+        timestamp.scope = scope;
+        timestamp.isEnd = isEnd;
+        m_queryCounter(timestamp.query, GL_TIMESTAMP);
+        m_currentFrame.push_back(timestamp);
+    }
+
+    std::vector<GLuint64> m_begins;
+
+    Frame m_currentFrame;
+
+    std::vector<GLuint> m_freeQueries;
+
+    bool m_isAvailable = false;
+
+    std::deque<Frame> m_pendingFrames;
+
+    std::vector<GLuint64> m_sums;
+
+    DeleteQueries m_deleteQueries = nullptr;
+
+    GenQueries m_genQueries = nullptr;
+
+    GetQueryObjectiv m_getQueryObjectiv = nullptr;
+
+    GetQueryObjectui64v m_getQueryObjectui64v = nullptr;
+
+    QueryCounter m_queryCounter = nullptr;
+
+};
+
+
+GpuTimer::GpuTimer()
+  : m_impl(new Implementation())
+{
+}
+
+
+GpuTimer::~GpuTimer() {}
+
+
+void
+GpuTimer::begin(
+    size_t scope
+) {
+    m_impl->timestamp(scope, false);
+}
+
+
+void
+GpuTimer::beginFrame(
+    const Callback& callback
+) {
+    if (not m_impl->m_isAvailable) {
+        return;
+    }
+    auto& pendingFrames = m_impl->m_pendingFrames;
+    while (not pendingFrames.empty() and m_impl->isAvailable(pendingFrames.front())) {
+        m_impl->report(pendingFrames.front(), callback);
+        pendingFrames.pop_front();
+    }
+    while (pendingFrames.size() >= MAX_PENDING_FRAMES) {
+        // Reused queries are reset by the next glQueryCounter
+        m_impl->recycle(pendingFrames.front());
+        pendingFrames.pop_front();
+    }
+    // Left over if the last frame wasn't ended
+    m_impl->recycle(m_impl->m_currentFrame);
+}
+
+
+void
+GpuTimer::end(
+    size_t scope
+) {
+    m_impl->timestamp(scope, true);
+}
+
+
+void
+GpuTimer::endFrame() {
+    if (m_impl->m_isAvailable) {
+        m_impl->m_pendingFrames.push_back(std::move(m_impl->m_currentFrame));
+        m_impl->m_currentFrame.clear();
+    }
+}
+
+
+bool
+GpuTimer::init() {
+    GetString getString = nullptr;
+    m_impl->m_isAvailable =
+        loadGlFunction(getString, "glGetString") and
+        hasGlFeature(getString, 3, 3, "GL_ARB_timer_query") and
+        loadGlFunction(m_impl->m_deleteQueries, "glDeleteQueries") and
+        loadGlFunction(m_impl->m_genQueries, "glGenQueries") and
+        loadGlFunction(m_impl->m_getQueryObjectiv, "glGetQueryObjectiv") and
+        loadGlFunction(m_impl->m_getQueryObjectui64v, "glGetQueryObjectui64v") and
+        loadGlFunction(m_impl->m_queryCounter, "glQueryCounter");
+    return m_impl->m_isAvailable;
+}
+
+
+bool
+GpuTimer::isAvailable() const {
+    return m_impl->m_isAvailable;
+}
+
+
+void
+GpuTimer::shutdown() {
+    if (not m_impl->m_isAvailable) {
+        return;
+    }
+    for (auto& frame : m_impl->m_pendingFrames) {
+        m_impl->recycle(frame);
+    }
+    m_impl->m_pendingFrames.clear();
+    m_impl->recycle(m_impl->m_currentFrame);
+    auto& queries = m_impl->m_freeQueries;
+    if (not queries.empty()) {
+        m_impl->m_deleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+    queries.clear();
+    m_impl->m_isAvailable = false;
+}
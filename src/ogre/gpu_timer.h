@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace thrive {
+
+/**
+* @brief Measures how long the GPU takes for parts of a frame
+*
+* Wraps OpenGL timestamp queries (\c GL_ARB_timer_query, core since
+* OpenGL 3.3). begin() and end() place a timestamp in the command stream,
+* which the GPU fills in when it gets there. The results are read a few
+* frames later, so that waiting for them never stalls the CPU. Frames
+* whose results still aren't available by then are dropped.
+*
+* All methods must be called from the thread with Ogre's OpenGL context,
+* in between Ogre's rendering calls. Other render systems, and drivers
+* without timer queries, aren't supported, see init().
+*/
+class GpuTimer {
+
+public:
+
+    /**
+    * @brief Called with the GPU time a scope took in one frame
+    *
+    * Scopes timed several times in a frame are summed up.
+    */
+    using Callback = std::function<void(size_t scope, uint32_t microseconds)>;
+
+    /**
+    * @brief Constructor
+    */
+    GpuTimer();
+
+    /**
+    * @brief Destructor
+    *
+    * Call shutdown() before, while the OpenGL context still exists.
+    */
+    ~GpuTimer();
+
+    /**
+    * @brief Begins timing a scope
+    *
+    * @param scope
+    *   Any number the caller chooses, passed back to the Callback
+    */
+    void
+    begin(
+        size_t scope
+    );
+
+    /**
+    * @brief Begins a frame
+    *
+    * Reports the scopes of the oldest frames whose results are available.
+    *
+    * @param callback
+    */
+    void
+    beginFrame(
+        const Callback& callback
+    );
+
+    /**
+    * @brief Ends timing a scope
+    *
+    * @param scope
+    *   As passed to begin()
+    */
+    void
+    end(
+        size_t scope
+    );
+
+    /**
+    * @brief Ends a frame
+    */
+    void
+    endFrame();
+
+    /**
+    * @brief Loads the OpenGL functions
+    *
+    * @return
+    *   \c false if the current OpenGL context has no timer queries. The
+    *   other methods do nothing then.
+    */
+    bool
+    init();
+
+    /**
+    * @brief Whether init() succeeded
+    */
+    bool
+    isAvailable() const;
+
+    /**
+    * @brief Deletes the queries
+    */
+    void
+    shutdown();
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -1,18 +1,40 @@
 #include "ogre/keyboard.h"
 
+#include "engine/input_recording.h"
 #include "scripting/luabind.h"
 
 #include <array>
+#include <boost/chrono.hpp>
 #include <iostream>
 #include <OISInputManager.h>
 #include <OISKeyboard.h>
+#include <vector>
 
 using namespace thrive;
 
 struct Keyboard::Implementation : public OIS::KeyListener{
 
+    using Clock = boost::chrono::steady_clock;
+
     using KeyStates = std::array<char, 256>;
 
+    // An event waiting for the next update()
+    struct PendingEvent {
+
+        OIS::KeyCode key;
+
+        bool pressed;
+
+        bool alt;
+
+        bool ctrl;
+
+        bool shift;
+
+        Clock::time_point time;
+
+    };
+
     Implementation()
       : m_currentKeyStates(&m_bufferA),
         m_previousKeyStates(&m_bufferB)
@@ -45,8 +67,8 @@ struct Keyboard::Implementation : public OIS::KeyListener{
         bool alt = m_keyboard->isModifierDown(OIS::Keyboard::Alt);
         bool ctrl = m_keyboard->isModifierDown(OIS::Keyboard::Ctrl);
         bool shift = m_keyboard->isModifierDown(OIS::Keyboard::Shift);
-        KeyEvent keyEvent = {event.key, pressed, alt, ctrl, shift};
-        m_queue.push_back(keyEvent);
+        PendingEvent pendingEvent = {event.key, pressed, alt, ctrl, shift, Clock::now()};
+        m_pending.push_back(pendingEvent);
     }
 
     KeyStates m_bufferA;
@@ -59,6 +81,8 @@ struct Keyboard::Implementation : public OIS::KeyListener{
 
     OIS::Keyboard* m_keyboard = nullptr;
 
+    std::vector<PendingEvent> m_pending;
+
     KeyStates* m_previousKeyStates = nullptr;
 
     std::list<KeyEvent> m_queue;
@@ -78,6 +102,7 @@ Keyboard::luaBindings() {
                 .def_readonly("key", &Keyboard::KeyEvent::key)
                 .def_readonly("alt", &Keyboard::KeyEvent::alt)
                 .def_readonly("ctrl", &Keyboard::KeyEvent::ctrl)
+                .def_readonly("delay", &Keyboard::KeyEvent::delay)
                 .def_readonly("shift", &Keyboard::KeyEvent::shift)
                 .def_readonly("pressed", &Keyboard::KeyEvent::pressed)
         ]
@@ -193,6 +218,61 @@ Keyboard::isKeyDown(
 }
 
 
+void
+Keyboard::poll() {
+    if (m_impl->m_keyboard) {
+        m_impl->m_keyboard->capture();
+    }
+}
+
+
+void
+Keyboard::recordFrame(
+    InputFrame& frame
+) const {
+    const auto& keyStates = *m_impl->m_currentKeyStates;
+    for (size_t key = 0; key < keyStates.size(); ++key) {
+        if (keyStates[key]) {
+            frame.keysDown.push_back(static_cast<uint8_t>(key));
+        }
+    }
+    for (const KeyEvent& event : m_impl->m_queue) {
+        InputFrame::KeyEvent recordedEvent;
+        recordedEvent.key = static_cast<uint8_t>(event.key);
+        recordedEvent.pressed = event.pressed;
+        recordedEvent.alt = event.alt;
+        recordedEvent.ctrl = event.ctrl;
+        recordedEvent.shift = event.shift;
+        recordedEvent.delay = static_cast<uint32_t>(event.delay * 1000.0 + 0.5);
+        frame.keyEvents.push_back(recordedEvent);
+    }
+}
+
+
+void
+Keyboard::replayFrame(
+    const InputFrame& frame
+) {
+    m_impl->m_queue.clear();
+    for (const InputFrame::KeyEvent& event : frame.keyEvents) {
+        KeyEvent keyEvent = {
+            static_cast<OIS::KeyCode>(event.key),
+            event.pressed,
+            event.alt,
+            event.ctrl,
+            event.shift,
+            event.delay / 1000.0
+        };
+        m_impl->m_queue.push_back(keyEvent);
+    }
+    std::swap(m_impl->m_currentKeyStates, m_impl->m_previousKeyStates);
+    m_impl->m_currentKeyStates->fill('\0');
+    for (uint8_t key : frame.keysDown) {
+        (*m_impl->m_currentKeyStates)[key] = 1;
+    }
+}
+
+
 void
 Keyboard::shutdown() {
     m_impl->m_inputManager->destroyInputObject(m_impl->m_keyboard);
@@ -204,9 +284,29 @@ Keyboard::shutdown() {
 void
 Keyboard::update() {
     m_impl->m_queue.clear();
+    if (not m_impl->m_keyboard) {
+        return;
+    }
     m_impl->m_keyboard->capture();
     std::swap(m_impl->m_currentKeyStates, m_impl->m_previousKeyStates);
     m_impl->m_keyboard->copyKeyStates(m_impl->m_currentKeyStates->data());
+    auto now = Implementation::Clock::now();
+    for (const Implementation::PendingEvent& event : m_impl->m_pending) {
+        boost::chrono::duration<double, boost::milli> delay = now - event.time;
+        KeyEvent keyEvent = {
+            event.key,
+            event.pressed,
+            event.alt,
+            event.ctrl,
+            event.shift,
+            delay.count()
+        };
+        m_impl->m_queue.push_back(keyEvent);
+        if (event.pressed) {
+            (*m_impl->m_currentKeyStates)[event.key] = 1;
+        }
+    }
+    m_impl->m_pending.clear();
 }
 
 
@@ -14,8 +14,14 @@ class InputManager;
 
 namespace thrive {
 
+struct InputFrame;
+
 /**
 * @brief Handles keyboard events
+*
+* Until init() is called, e.g. in headless engines, no keys are pressed.
+* The keyboard is buffered, each event carries how long ago it happened,
+* see poll().
 */
 class Keyboard {
 
@@ -51,6 +57,14 @@ public:
         */
         const bool shift;
 
+        /**
+        * @brief Milliseconds between the event and the update() that 
+        * delivered it
+        *
+        * Non-zero for events taken by poll() between frames.
+        */
+        const double delay;
+
     };
 
     /**
@@ -62,6 +76,7 @@ public:
     *   - Keyboard::KeyEvent::key
     *   - Keyboard::KeyEvent::alt
     *   - Keyboard::KeyEvent::ctrl
+    *   - Keyboard::KeyEvent::delay
     *   - Keyboard::KeyEvent::shift
     *   - Keyboard::KeyEvent::pressed
     * - <a href="http://code.joyridelabs.de/ois_api/OISKeyboard_8h_source.html#l00031">KeyCode</a>
@@ -116,6 +131,40 @@ public:
         OIS::KeyCode key
     ) const;
 
+    /**
+    * @brief Takes pending events from the device
+    *
+    * Called between frames, so that events get the time they arrived at
+    * instead of the time of the next update(). The events and key states
+    * only change with the next update().
+    */
+    void
+    poll();
+
+    /**
+    * @brief Adds this frame's key states and events to a recording
+    *
+    * @param frame
+    *   The frame to add to, see InputRecorder
+    */
+    void
+    recordFrame(
+        InputFrame& frame
+    ) const;
+
+    /**
+    * @brief Takes the key states and events from a recording
+    *
+    * Replaces update() while replaying.
+    *
+    * @param frame
+    *   A frame previously filled by recordFrame()
+    */
+    void
+    replayFrame(
+        const InputFrame& frame
+    );
+
     /**
     * @brief Shuts down the keyboard
     */
@@ -124,6 +173,10 @@ public:
 
     /**
     * @brief Updates the queue with new events
+    *
+    * A key pressed since the last update counts as down for this frame,
+    * even if it has already been released again. Short taps between two
+    * frames are not lost that way.
     */
     void
     update();
@@ -0,0 +1,185 @@
+#include "ogre/light_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+using namespace thrive;
+
+namespace {
+
+// Lights covering more cells than this go into the global list
+const int64_t MAX_CELLS_PER_LIGHT = 64;
+
+}
+
+
+LightGrid::LightGrid(
+    Ogre::Real cellSize
+) : m_cellSize(cellSize)
+{
+    if (not (cellSize > 0.0f)) {
+        throw std::invalid_argument("Light grid cells must have a positive size");
+    }
+}
+
+
+Ogre::Real
+LightGrid::cellSize() const {
+    return m_cellSize;
+}
+
+
+int64_t
+LightGrid::cellIndex(
+    Ogre::Real coordinate
+) const {
+    return static_cast<int64_t>(std::floor(coordinate / m_cellSize));
+}
+
+
+uint64_t
+LightGrid::cellKey(
+    int64_t x,
+    int64_t y
+) {
+    return (static_cast<uint64_t>(x) << 32) ^ (static_cast<uint64_t>(y) & 0xFFFFFFFF);
+}
+
+
+void
+LightGrid::clear() {
+    // Keeps the cell vectors' capacity for the next frame
+    for (auto& item : m_cells) {
+        item.second.clear();
+    }
+    m_entries.clear();
+    m_global.clear();
+}
+
+
+void
+LightGrid::insert(
+    Ogre::Light* light,
+    const Ogre::Vector3& position,
+    Ogre::Real range
+) {
+    size_t index = m_entries.size();
+    m_entries.push_back(Entry{light, position, range, 0});
+    if (not std::isfinite(range) or range / m_cellSize > MAX_CELLS_PER_LIGHT) {
+        m_global.push_back(index);
+        return;
+    }
+    int64_t minX = this->cellIndex(position.x - range);
+    int64_t maxX = this->cellIndex(position.x + range);
+    int64_t minY = this->cellIndex(position.y - range);
+    int64_t maxY = this->cellIndex(position.y + range);
+    if ((maxX - minX + 1) * (maxY - minY + 1) > MAX_CELLS_PER_LIGHT) {
+        m_global.push_back(index);
+        return;
+    }
+    for (int64_t x = minX; x <= maxX; ++x) {
+        for (int64_t y = minY; y <= maxY; ++y) {
+            m_cells[cellKey(x, y)].push_back(index);
+        }
+    }
+}
+
+
+void
+LightGrid::query(
+    const Ogre::Vector3& center,
+    Ogre::Real radius,
+    std::vector<Ogre::Light*>& lights
+) const {
+    lights.clear();
+    m_queryStamp += 1;
+    if (m_queryStamp == 0) {
+        // Wrapped around, old stamps could match again
+        for (const Entry& entry : m_entries) {
+            entry.queryStamp = 0;
+        }
+        m_queryStamp = 1;
+    }
+    auto& found = m_found;
+    found.clear();
+    auto test = [&] (size_t index) {
+        const Entry& entry = m_entries[index];
+        if (entry.queryStamp == m_queryStamp) {
+            return;
+        }
+        entry.queryStamp = m_queryStamp;
+        Ogre::Real squaredDistance = entry.position.squaredDistance(center);
+        if (std::isfinite(entry.range)) {
+            Ogre::Real reach = entry.range + radius;
+            if (squaredDistance > reach * reach) {
+                return;
+            }
+        }
+        found.emplace_back(squaredDistance, entry.light);
+    };
+    bool isLarge = not std::isfinite(radius) or radius / m_cellSize > MAX_CELLS_PER_LIGHT;
+    int64_t minX = 0, maxX = 0, minY = 0, maxY = 0;
+    if (not isLarge) {
+        minX = this->cellIndex(center.x - radius);
+        maxX = this->cellIndex(center.x + radius);
+        minY = this->cellIndex(center.y - radius);
+        maxY = this->cellIndex(center.y + radius);
+        isLarge = (maxX - minX + 1) * (maxY - minY + 1) > static_cast<int64_t>(m_entries.size());
+    }
+    if (isLarge) {
+        // Large objects, like the background, are cheaper to test against
+        // every light
+        for (size_t index = 0; index < m_entries.size(); ++index) {
+            test(index);
+        }
+    }
+    else {
+        for (size_t index : m_global) {
+            test(index);
+        }
+        for (int64_t x = minX; x <= maxX; ++x) {
+            for (int64_t y = minY; y <= maxY; ++y) {
+                auto iter = m_cells.find(cellKey(x, y));
+                if (iter == m_cells.end()) {
+                    continue;
+                }
+                for (size_t index : iter->second) {
+                    test(index);
+                }
+            }
+        }
+    }
+    std::stable_sort(
+        found.begin(),
+        found.end(),
+        [] (const std::pair<Ogre::Real, Ogre::Light*>& a, const std::pair<Ogre::Real, Ogre::Light*>& b) {
+            return a.first < b.first;
+        }
+    );
+    lights.reserve(found.size());
+    for (const auto& item : found) {
+        lights.push_back(item.second);
+    }
+}
+
+
+void
+LightGrid::setCellSize(
+    Ogre::Real cellSize
+) {
+    if (not (cellSize > 0.0f)) {
+        throw std::invalid_argument("Light grid cells must have a positive size");
+    }
+    m_cellSize = cellSize;
+    m_cells.clear();
+    m_entries.clear();
+    m_global.clear();
+}
+
+
+size_t
+LightGrid::size() const {
+    return m_entries.size();
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <OgrePrerequisites.h>
+#include <OgreVector3.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief Assigns lights to the cells of a grid on the x/y plane
+*
+* Finding the lights that reach an object this way only looks at the lights
+* in the object's cells, instead of at every light in the scene like Ogre
+* does by default. The OgreLightSystem rebuilds the grid each frame and
+* hands the results to Ogre as the objects' light lists.
+*
+* Lights are treated as spheres of their range, z is ignored for the cells
+* but not for the range tests. Lights whose range would cover too many
+* cells, like directional lights with an infinite range, are kept in a
+* separate list and tested for every query.
+*/
+class LightGrid {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param cellSize
+    *   The edge length of a cell
+    *
+    * @throw std::invalid_argument
+    *   If \a cellSize is not positive
+    */
+    explicit LightGrid(
+        Ogre::Real cellSize
+    );
+
+    /**
+    * @brief The edge length of a cell
+    */
+    Ogre::Real
+    cellSize() const;
+
+    /**
+    * @brief Removes all lights
+    */
+    void
+    clear();
+
+    /**
+    * @brief Adds a light
+    *
+    * @param light
+    *   The light, only stored, never dereferenced
+    * @param position
+    *   The light's position in world space
+    * @param range
+    *   How far the light reaches. Infinite for lights that reach
+    *   everything.
+    */
+    void
+    insert(
+        Ogre::Light* light,
+        const Ogre::Vector3& position,
+        Ogre::Real range
+    );
+
+    /**
+    * @brief Finds the lights that reach a sphere
+    *
+    * @param center
+    * @param radius
+    * @param lights
+    *   Receives the lights, closest first. Cleared first.
+    */
+    void
+    query(
+        const Ogre::Vector3& center,
+        Ogre::Real radius,
+        std::vector<Ogre::Light*>& lights
+    ) const;
+
+    /**
+    * @brief Sets the edge length of a cell
+    *
+    * Removes all lights.
+    *
+    * @param cellSize
+    *
+    * @throw std::invalid_argument
+    *   If \a cellSize is not positive
+    */
+    void
+    setCellSize(
+        Ogre::Real cellSize
+    );
+
+    /**
+    * @brief The number of lights
+    */
+    size_t
+    size() const;
+
+private:
+
+    struct Entry {
+
+        Ogre::Light* light;
+
+        Ogre::Vector3 position;
+
+        Ogre::Real range;
+
+        // The query that last found the entry, against duplicates from
+        // neighbouring cells
+        mutable unsigned int queryStamp;
+
+    };
+
+    int64_t
+    cellIndex(
+        Ogre::Real coordinate
+    ) const;
+
+    static uint64_t
+    cellKey(
+        int64_t x,
+        int64_t y
+    );
+
+    std::unordered_map<uint64_t, std::vector<size_t>> m_cells;
+
+    Ogre::Real m_cellSize;
+
+    std::vector<Entry> m_entries;
+
+    // Scratch space for query()
+    mutable std::vector<std::pair<Ogre::Real, Ogre::Light*>> m_found;
+
+    // Indices of lights that are in no cell
+    std::vector<size_t> m_global;
+
+    mutable unsigned int m_queryStamp = 0;
+
+};
+
+}
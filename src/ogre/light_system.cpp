@@ -1,14 +1,22 @@
 #include "ogre/light_system.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
 #include "engine/serialization.h"
+#include "ogre/light_grid.h"
 #include "ogre/scene_node_system.h"
+#include "ogre/viewport_system.h"
 #include "scripting/luabind.h"
 
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <OgreEntity.h>
 #include <OgreSceneManager.h>
+#include <stdexcept>
 
 using namespace thrive;
 
@@ -63,6 +71,18 @@ OgreLightComponent::luaBindings() {
 }
 
 
+OgreLightComponent::OgreLightComponent() {
+    m_properties.setComponent(this);
+}
+
+
+bool
+OgreLightComponent::isChangeTracked() const {
+    // All properties are touchables
+    return true;
+}
+
+
 void
 OgreLightComponent::load(
     const StorageContainer& storage
@@ -113,33 +133,300 @@ OgreLightSystem::luaBindings() {
     using namespace luabind;
     return class_<OgreLightSystem, System>("OgreLightSystem")
         .def(constructor<>())
+        .def("activeLightCount", &OgreLightSystem::activeLightCount)
+        .def("setActivationDistance", &OgreLightSystem::setActivationDistance)
+        .def("setCellSize", &OgreLightSystem::setCellSize)
+        .def("setLightCulling", &OgreLightSystem::setLightCulling)
     ;
 }
 
 
+namespace {
+
+const Ogre::Real DEFAULT_CELL_SIZE = 16.0f;
+
+// Hands Ogre the light lists from the grid
+class LightQueryListener : public Ogre::MovableObject::Listener {
+
+public:
+
+    LightQueryListener(
+        const LightGrid& grid
+    ) : m_grid(grid)
+    {
+    }
+
+    ~LightQueryListener() {
+        this->removeAll();
+    }
+
+    void
+    add(
+        Ogre::MovableObject* object
+    ) {
+        object->setListener(this);
+        m_lightLists[object].frame = m_frame - 1;
+    }
+
+    void
+    nextFrame() {
+        m_frame += 1;
+    }
+
+    void
+    objectDestroyed(
+        Ogre::MovableObject* object
+    ) override {
+        m_lightLists.erase(object);
+    }
+
+    const Ogre::LightList*
+    objectQueryLights(
+        const Ogre::MovableObject* object
+    ) override {
+        auto iter = m_lightLists.find(object);
+        if (iter == m_lightLists.end()) {
+            return nullptr;
+        }
+        LightListEntry& entry = iter->second;
+        // Ogre asks once per renderable, but the lights only change per
+        // frame
+        if (entry.frame != m_frame) {
+            entry.frame = m_frame;
+            const Ogre::Sphere& bounds = object->getWorldBoundingSphere(true);
+            m_grid.query(bounds.getCenter(), bounds.getRadius(), m_found);
+            entry.lights.clear();
+            for (Ogre::Light* light : m_found) {
+                entry.lights.push_back(light);
+            }
+        }
+        return &entry.lights;
+    }
+
+    void
+    removeAll() {
+        for (const auto& item : m_lightLists) {
+            const_cast<Ogre::MovableObject*>(item.first)->setListener(nullptr);
+        }
+        m_lightLists.clear();
+    }
+
+private:
+
+    struct LightListEntry {
+
+        unsigned int frame = 0;
+
+        Ogre::LightList lights;
+
+    };
+
+    std::vector<Ogre::Light*> m_found;
+
+    unsigned int m_frame = 0;
+
+    const LightGrid& m_grid;
+
+    std::unordered_map<const Ogre::MovableObject*, LightListEntry> m_lightLists;
+
+};
+
+}
+
+
 struct OgreLightSystem::Implementation {
 
+    Implementation()
+      : m_grid(DEFAULT_CELL_SIZE),
+        m_listener(m_grid)
+    {
+    }
+
+    bool
+    findCameraPosition(
+        EntityManager& entityManager,
+        Ogre::Vector3& position
+    ) const {
+        const OgreViewportComponent* mainViewport = nullptr;
+        for (const auto& item : m_viewports) {
+            const OgreViewportComponent* viewport = std::get<0>(item.second);
+            if (not mainViewport or viewport->zOrder() < mainViewport->zOrder()) {
+                mainViewport = viewport;
+            }
+        }
+        if (not mainViewport) {
+            return false;
+        }
+        auto camera = entityManager.getComponent<OgreSceneNodeComponent>(
+            mainViewport->m_properties.cameraEntity
+        );
+        if (not camera) {
+            return false;
+        }
+        if (camera->m_sceneNode) {
+            position = camera->m_sceneNode->_getDerivedPosition();
+        }
+        else {
+            position = camera->m_transform.position;
+        }
+        return true;
+    }
+
+    // Enables the lights near the camera, and notes whether the grid is
+    // out of date
+    void
+    updateLightStates(
+        EntityManager& entityManager
+    ) {
+        Ogre::Vector3 cameraPosition;
+        bool isLimited = std::isfinite(m_activationDistance) and
+            this->findCameraPosition(entityManager, cameraPosition);
+        m_activeLightCount = 0;
+        for (auto& item : m_lights) {
+            LightState& state = item.second;
+            Ogre::Light* light = state.light;
+            Ogre::Real range = light->getAttenuationRange();
+            if (light->getType() == Ogre::Light::LT_DIRECTIONAL) {
+                range = std::numeric_limits<Ogre::Real>::infinity();
+            }
+            const Ogre::Vector3& position = light->getDerivedPosition();
+            bool isActive = true;
+            if (isLimited and std::isfinite(range)) {
+                Ogre::Real dx = position.x - cameraPosition.x;
+                Ogre::Real dy = position.y - cameraPosition.y;
+                Ogre::Real reach = m_activationDistance + range;
+                isActive = dx * dx + dy * dy <= reach * reach;
+            }
+            if (isActive != state.isActive) {
+                light->setVisible(isActive);
+                state.isActive = isActive;
+                m_isGridDirty = true;
+            }
+            if (isActive and (position != state.position or range != state.range)) {
+                m_isGridDirty = true;
+            }
+            state.position = position;
+            state.range = range;
+            if (isActive) {
+                m_activeLightCount += 1;
+            }
+        }
+    }
+
+    void
+    updateLightGrid() {
+        if (m_isGridDirty) {
+            m_grid.clear();
+            for (const auto& item : m_lights) {
+                const LightState& state = item.second;
+                if (state.isActive) {
+                    m_grid.insert(state.light, state.position, state.range);
+                }
+            }
+            m_isGridDirty = false;
+        }
+        m_listener.nextFrame();
+        // New entities start out with Ogre's own light search
+        for (const auto& item : m_sceneNodes) {
+            Ogre::Entity* entity = std::get<0>(item.second)->m_entity;
+            if (entity and not entity->getListener()) {
+                m_listener.add(entity);
+            }
+        }
+    }
+
+    void
+    applyProperties(
+        OgreLightComponent* lightComponent
+    ) {
+        auto& properties = lightComponent->m_properties;
+        Ogre::Light* light = lightComponent->m_light;
+        light->setType(properties.type);
+        light->setDiffuseColour(properties.diffuseColour);
+        light->setSpecularColour(properties.specularColour);
+        light->setAttenuation(
+            properties.attenuationRange,
+            properties.attenuationConstant,
+            properties.attenuationLinear,
+            properties.attenuationQuadratic
+        );
+        light->setSpotlightRange(
+            properties.spotlightInnerAngle,
+            properties.spotlightOuterAngle,
+            properties.spotlightFalloff
+        );
+        light->setSpotlightNearClipDistance(properties.spotlightNearClipDistance);
+        properties.untouch();
+    }
+
+    ComponentCollection* m_collection = nullptr;
+
     EntityFilter<
         OgreLightComponent,
         OgreSceneNodeComponent
     > m_entities = {true};
 
-    std::unordered_map<EntityId, Ogre::Light*> m_lights;
+    LightGrid m_grid;
+
+    Ogre::Real m_activationDistance = std::numeric_limits<Ogre::Real>::infinity();
+
+    size_t m_activeLightCount = 0;
+
+    bool m_isCulling = true;
+
+    // Whether the grid doesn't match the active lights' positions and
+    // ranges anymore
+    bool m_isGridDirty = true;
+
+    struct LightState {
+
+        bool isActive = true;
+
+        Ogre::Light* light = nullptr;
+
+        Ogre::Vector3 position = Ogre::Vector3::ZERO;
+
+        Ogre::Real range = 0.0f;
+
+    };
+
+    std::unordered_map<EntityId, LightState> m_lights;
+
+    LightQueryListener m_listener;
+
+    EntityFilter<
+        OgreSceneNodeComponent
+    > m_sceneNodes;
 
     Ogre::SceneManager* m_sceneManager = nullptr;
 
+    std::vector<Component*> m_touched;
+
+    EntityFilter<OgreViewportComponent> m_viewports;
+
 };
 
 
 OgreLightSystem::OgreLightSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+    this->declareRead(OgreViewportComponent::TYPE_ID);
+    this->declareWrite(OgreLightComponent::TYPE_ID);
 }
 
 
 OgreLightSystem::~OgreLightSystem() {}
 
 
+size_t
+OgreLightSystem::activeLightCount() const {
+    return m_impl->m_activeLightCount;
+}
+
+
 void
 OgreLightSystem::init(
     GameState* gameState
@@ -148,12 +435,56 @@ OgreLightSystem::init(
     assert(m_impl->m_sceneManager == nullptr && "Double init of system");
     m_impl->m_sceneManager = gameState->sceneManager();
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_sceneNodes.setEntityManager(&gameState->entityManager());
+    m_impl->m_viewports.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        OgreLightComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
+}
+
+
+void
+OgreLightSystem::setActivationDistance(
+    Ogre::Real distance
+) {
+    if (distance < 0.0f) {
+        throw std::invalid_argument("Activation distance must not be negative");
+    }
+    m_impl->m_activationDistance = distance;
+}
+
+
+void
+OgreLightSystem::setCellSize(
+    Ogre::Real cellSize
+) {
+    m_impl->m_grid.setCellSize(cellSize);
+    m_impl->m_isGridDirty = true;
+}
+
+
+void
+OgreLightSystem::setLightCulling(
+    bool enabled
+) {
+    m_impl->m_isCulling = enabled;
+    if (not enabled) {
+        m_impl->m_listener.removeAll();
+    }
+    m_impl->m_isGridDirty = true;
 }
 
 
 void
 OgreLightSystem::shutdown() {
+    m_impl->m_listener.removeAll();
+    m_impl->m_grid.clear();
+    m_impl->m_isGridDirty = true;
+    m_impl->m_collection = nullptr;
     m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_sceneNodes.setEntityManager(nullptr);
+    m_impl->m_viewports.setEntityManager(nullptr);
     m_impl->m_sceneManager = nullptr;
     System::shutdown();
 }
@@ -161,46 +492,40 @@ OgreLightSystem::shutdown() {
 
 void
 OgreLightSystem::update(int) {
-    for (EntityId entityId : m_impl->m_entities.removedEntities()) {
-        Ogre::Light* light = m_impl->m_lights[entityId];
-        if (light) {
-            m_impl->m_sceneManager->destroyLight(light);
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreLightComponent*, OgreSceneNodeComponent*>& group) {
+            OgreLightComponent* lightComponent = std::get<0>(group);
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(group);
+            Ogre::Light* light = m_impl->m_sceneManager->createLight();
+            lightComponent->m_light = light;
+            m_impl->m_lights[entityId].light = light;
+            m_impl->m_isGridDirty = true;
+            sceneNodeComponent->m_sceneNode->attachObject(light);
+            // A new light needs all properties, changed or not
+            m_impl->applyProperties(lightComponent);
+        },
+        [this] (EntityId entityId) {
+            auto iter = m_impl->m_lights.find(entityId);
+            if (iter == m_impl->m_lights.end()) {
+                return;
+            }
+            m_impl->m_sceneManager->destroyLight(iter->second.light);
+            m_impl->m_lights.erase(iter);
+            // The grid still holds the destroyed light
+            m_impl->m_isGridDirty = true;
         }
-        m_impl->m_lights.erase(entityId);
-    }
-    for (const auto& added : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = added.first;
-        OgreLightComponent* lightComponent = std::get<0>(added.second);
-        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(added.second);
-        Ogre::Light* light = m_impl->m_sceneManager->createLight();
-        lightComponent->m_light = light;
-        m_impl->m_lights[entityId] = light;
-        sceneNodeComponent->m_sceneNode->attachObject(light);
-    }
-    m_impl->m_entities.clearChanges();
-    for (const auto& value : m_impl->m_entities) {
-        OgreLightComponent* lightComponent = std::get<0>(value.second);
-        auto& properties = lightComponent->m_properties;
-        if (not properties.hasChanges()) {
-            continue;
+    );
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* component : m_impl->m_touched) {
+        auto lightComponent = static_cast<OgreLightComponent*>(component);
+        // Lights without a scene node are set up when they are added above
+        if (lightComponent->m_properties.hasChanges() and m_impl->m_entities.containsEntity(lightComponent->owner())) {
+            m_impl->applyProperties(lightComponent);
         }
-        Ogre::Light* light = lightComponent->m_light;
-        light->setType(properties.type);
-        light->setDiffuseColour(properties.diffuseColour);
-        light->setSpecularColour(properties.specularColour);
-        light->setAttenuation(
-            properties.attenuationRange,
-            properties.attenuationConstant,
-            properties.attenuationLinear,
-            properties.attenuationQuadratic
-        );
-        light->setSpotlightRange(
-            properties.spotlightInnerAngle,
-            properties.spotlightOuterAngle,
-            properties.spotlightFalloff
-        );
-        light->setSpotlightNearClipDistance(properties.spotlightNearClipDistance);
-        properties.untouch();
+    }
+    m_impl->updateLightStates(*this->entityManager());
+    if (m_impl->m_isCulling) {
+        m_impl->updateLightGrid();
     }
 }
 
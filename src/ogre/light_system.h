@@ -122,6 +122,14 @@ public:
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Constructor
+    */
+    OgreLightComponent();
+
+    bool
+    isChangeTracked() const override;
+
     void
     load(
         const StorageContainer& storage
@@ -160,6 +168,27 @@ public:
 
 /**
 * @brief Creates lights and updates their properties
+*
+* By default, Ogre finds the lights of each rendered object by testing
+* every light in the scene against it, which gets expensive with many
+* lights. Instead, this system assigns the lights to the cells of a 
+* LightGrid each frame and gives the entities of OgreSceneNodeComponent 
+* a MovableObject listener that takes their light lists from the grid.
+* Materials see the same lights as before, closest first, so the usual
+* per pass light iteration keeps working.
+*
+* The grid is only rebuilt in frames in which a light moved, changed its
+* range, or was added, removed, enabled or disabled, so static lights are
+* cheap. Only changed light properties are pushed to Ogre.
+*
+* Lights whose range doesn't reach within the activation distance of the
+* active camera are hidden, so neither the grid nor Ogre's own light 
+* search (without culling) looks at them. The active camera is the camera
+* of the viewport with the lowest z-order, distances are measured on the
+* x/y plane. Directional lights are always active.
+*
+* Should run after the OgreUpdateSceneNodeSystem, which creates the 
+* entities, and the OgreCameraSystem.
 */
 class OgreLightSystem : public System {
     
@@ -170,6 +199,10 @@ public:
     *
     * Exposes:
     * - OgreLightSystem()
+    * - OgreLightSystem::activeLightCount
+    * - OgreLightSystem::setActivationDistance
+    * - OgreLightSystem::setCellSize
+    * - OgreLightSystem::setLightCulling
     *
     * @return 
     */
@@ -186,12 +219,63 @@ public:
     */
     ~OgreLightSystem();
 
+    /**
+    * @brief The number of lights that were active in the last update
+    */
+    size_t
+    activeLightCount() const;
+
     /**
     * @brief Initializes the system
     *
     */
     void init(GameState* gameState) override;
 
+    /**
+    * @brief Sets how close to the camera a light's range must reach for
+    * the light to be active
+    *
+    * Should cover the visible part of the scene. Infinite by default,
+    * which keeps all lights active.
+    *
+    * @param distance
+    *
+    * @throw std::invalid_argument
+    *   If \a distance is negative
+    */
+    void
+    setActivationDistance(
+        Ogre::Real distance
+    );
+
+    /**
+    * @brief Sets the edge length of the light grid's cells
+    *
+    * Cells around the size of a typical light range work best.
+    *
+    * @param cellSize
+    *
+    * @throw std::invalid_argument
+    *   If \a cellSize is not positive
+    */
+    void
+    setCellSize(
+        Ogre::Real cellSize
+    );
+
+    /**
+    * @brief Whether to cull lights with the light grid
+    *
+    * When disabled, Ogre tests every light against every object again.
+    * Enabled by default.
+    *
+    * @param enabled
+    */
+    void
+    setLightCulling(
+        bool enabled
+    );
+
     /**
     * @brief Shuts the system down
     */
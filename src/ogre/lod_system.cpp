@@ -0,0 +1,265 @@
+#include "ogre/lod_system.h"
+
+#include "engine/component_factory.h"
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <iostream>
+#include <OgreEntity.h>
+#include <OgreLodStrategyManager.h>
+#include <OgreMesh.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreLodComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreLodComponent::luaBindings() {
+    using namespace luabind;
+    return class_<OgreLodComponent, Component>("OgreLodComponent")
+        .enum_("ID") [
+            value("TYPE_ID", OgreLodComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &OgreLodComponent::TYPE_NAME),
+            class_<Properties, Touchable>("Properties")
+                .def_readwrite("materialLodBias", &Properties::materialLodBias)
+                .def_readwrite("meshLodBias", &Properties::meshLodBias)
+                .def_readwrite("minPixelSize", &Properties::minPixelSize)
+                .def_readwrite("renderingDistance", &Properties::renderingDistance)
+        ]
+        .def(constructor<>())
+        .def_readonly("properties", &OgreLodComponent::m_properties)
+    ;
+}
+
+
+OgreLodComponent::OgreLodComponent() {
+    m_properties.setComponent(this);
+}
+
+
+bool
+OgreLodComponent::isChangeTracked() const {
+    // All properties are touchables
+    return true;
+}
+
+
+void
+OgreLodComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_properties.materialLodBias = storage.get<Ogre::Real>("materialLodBias", 1.0f);
+    m_properties.meshLodBias = storage.get<Ogre::Real>("meshLodBias", 1.0f);
+    m_properties.minPixelSize = storage.get<Ogre::Real>("minPixelSize", 0.0f);
+    m_properties.renderingDistance = storage.get<Ogre::Real>("renderingDistance", 0.0f);
+}
+
+
+StorageContainer
+OgreLodComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    storage.set<Ogre::Real>("materialLodBias", m_properties.materialLodBias);
+    storage.set<Ogre::Real>("meshLodBias", m_properties.meshLodBias);
+    storage.set<Ogre::Real>("minPixelSize", m_properties.minPixelSize);
+    storage.set<Ogre::Real>("renderingDistance", m_properties.renderingDistance);
+    return storage;
+}
+
+REGISTER_COMPONENT(OgreLodComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreLodSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreLodSystem::luaBindings() {
+    using namespace luabind;
+    return class_<OgreLodSystem, System>("OgreLodSystem")
+        .def(constructor<>())
+        .def("addMeshLodLevel", &OgreLodSystem::addMeshLodLevel)
+        .def("setMeshLodStrategy", &OgreLodSystem::setMeshLodStrategy)
+    ;
+}
+
+
+struct OgreLodSystem::Implementation {
+
+    struct MeshLod {
+
+        // Whether the levels have been set on the Ogre mesh
+        bool isApplied = false;
+
+        // Pairs of value and LOD mesh name
+        std::vector<std::pair<Ogre::Real, std::string>> levels;
+
+        Ogre::LodStrategy* strategy = nullptr;
+
+    };
+
+    void
+    applyMeshLod(
+        const std::string& meshName,
+        MeshLod& meshLod,
+        const Ogre::MeshPtr& mesh
+    ) {
+        meshLod.isApplied = true;
+        try {
+            mesh->removeLodLevels();
+            if (meshLod.strategy) {
+                mesh->setLodStrategy(meshLod.strategy);
+            }
+            for (const auto& level : meshLod.levels) {
+                mesh->createManualLodLevel(level.first, level.second);
+            }
+        }
+        catch (const Ogre::Exception& e) {
+            std::cerr << "Error setting up LOD levels of " << meshName << ": " << e.what() << std::endl;
+            return;
+        }
+        // Entities only pick up manual LOD levels when they are created
+        for (const auto& item : m_entities) {
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+            if (sceneNodeComponent->m_configuration->meshName.get() == meshName) {
+                sceneNodeComponent->m_configuration->meshName.touch();
+            }
+        }
+    }
+
+    void
+    applyProperties(
+        OgreLodComponent* lodComponent,
+        Ogre::Entity* entity
+    ) {
+        const auto& properties = lodComponent->m_properties;
+        entity->setMaterialLodBias(properties.materialLodBias);
+        entity->setMeshLodBias(properties.meshLodBias);
+        entity->setRenderingDistance(properties.renderingDistance);
+        entity->setRenderingMinPixelSize(properties.minPixelSize);
+    }
+
+    MeshLod&
+    meshLod(
+        const std::string& meshName
+    ) {
+        MeshLod& meshLod = m_meshLods[meshName];
+        if (meshLod.isApplied) {
+            // Set up again with the new configuration
+            meshLod.isApplied = false;
+            m_hasPendingMeshes = true;
+        }
+        return meshLod;
+    }
+
+    EntityFilter<
+        OgreLodComponent,
+        OgreSceneNodeComponent
+    > m_entities;
+
+    // Whether a mesh has been reconfigured after it was set up
+    bool m_hasPendingMeshes = false;
+
+    std::unordered_map<std::string, MeshLod> m_meshLods;
+
+};
+
+
+OgreLodSystem::OgreLodSystem()
+  : m_impl(new Implementation())
+{
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareWrite(OgreLodComponent::TYPE_ID);
+    this->declareWrite(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+OgreLodSystem::~OgreLodSystem() {}
+
+
+void
+OgreLodSystem::addMeshLodLevel(
+    const std::string& meshName,
+    Ogre::Real value,
+    const std::string& lodMeshName
+) {
+    m_impl->meshLod(meshName).levels.emplace_back(value, lodMeshName);
+}
+
+
+void
+OgreLodSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+void
+OgreLodSystem::setMeshLodStrategy(
+    const std::string& meshName,
+    const std::string& strategyName
+) {
+    Ogre::LodStrategy* strategy = Ogre::LodStrategyManager::getSingleton().getStrategy(
+        strategyName
+    );
+    if (not strategy) {
+        throw std::invalid_argument("Unknown LOD strategy: " + strategyName);
+    }
+    m_impl->meshLod(meshName).strategy = strategy;
+}
+
+
+void
+OgreLodSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    System::shutdown();
+}
+
+
+void
+OgreLodSystem::update(int) {
+    if (m_impl->m_hasPendingMeshes) {
+        m_impl->m_hasPendingMeshes = false;
+        for (const auto& item : m_impl->m_entities) {
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+            auto iter = m_impl->m_meshLods.find(sceneNodeComponent->m_configuration->meshName.get());
+            if (iter != m_impl->m_meshLods.end() and not iter->second.isApplied) {
+                // Forces a new entity, which sets the mesh up below
+                sceneNodeComponent->m_configuration->meshName.touch();
+            }
+        }
+    }
+    for (const auto& item : m_impl->m_entities) {
+        OgreLodComponent* lodComponent = std::get<0>(item.second);
+        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+        Ogre::Entity* entity = sceneNodeComponent->m_entity;
+        // A new entity needs all properties, changed or not
+        bool isNewEntity = lodComponent->m_appliedRevision != sceneNodeComponent->m_entityRevision;
+        if (not entity or not (isNewEntity or lodComponent->m_properties.hasChanges())) {
+            continue;
+        }
+        if (isNewEntity) {
+            auto iter = m_impl->m_meshLods.find(sceneNodeComponent->m_configuration->meshName.get());
+            if (iter != m_impl->m_meshLods.end() and not iter->second.isApplied) {
+                m_impl->applyMeshLod(iter->first, iter->second, entity->getMesh());
+            }
+        }
+        m_impl->applyProperties(lodComponent, entity);
+        lodComponent->m_appliedRevision = sceneNodeComponent->m_entityRevision;
+        lodComponent->m_properties.untouch();
+    }
+}
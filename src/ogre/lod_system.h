@@ -0,0 +1,234 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "engine/touchable.h"
+
+#include <memory>
+#include <OgrePrerequisites.h>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Level of detail settings for an entity's mesh
+*
+* Ogre picks the mesh and material LOD levels of each entity from its
+* distance to the camera being rendered, using the mesh's LOD strategy.
+* This component biases that choice and hides the entity when it is far
+* away or small on screen. The LOD levels themselves belong to the mesh
+* and are set up with OgreLodSystem::addMeshLodLevel().
+*
+* Requires an OgreSceneNodeComponent with a mesh.
+*/
+class OgreLodComponent : public Component {
+    COMPONENT(OgreLod)
+
+public:
+
+    /**
+    * @brief Properties
+    */
+    struct Properties : public Touchable {
+
+        /**
+        * @brief Scales the distance used for material LOD
+        *
+        * Values above \c 1 keep the detailed materials longer, values
+        * below switch to simpler ones sooner.
+        */
+        Ogre::Real materialLodBias = 1.0f;
+
+        /**
+        * @brief Scales the distance used for mesh LOD
+        *
+        * Like materialLodBias, but for the meshes.
+        */
+        Ogre::Real meshLodBias = 1.0f;
+
+        /**
+        * @brief The entity is not rendered if it covers fewer pixels
+        *
+        * \c 0 renders the entity at any size.
+        */
+        Ogre::Real minPixelSize = 0.0f;
+
+        /**
+        * @brief The entity is not rendered beyond this camera distance
+        *
+        * \c 0 renders the entity at any distance.
+        */
+        Ogre::Real renderingDistance = 0.0f;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreLodComponent()
+    * - @link m_properties properties @endlink
+    * - Properties
+    *   - Properties::materialLodBias
+    *   - Properties::meshLodBias
+    *   - Properties::minPixelSize
+    *   - Properties::renderingDistance
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreLodComponent();
+
+    bool
+    isChangeTracked() const override;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief Properties
+    */
+    Properties
+    m_properties;
+
+    /**
+    * @brief The OgreSceneNodeComponent::m_entityRevision the properties
+    * were last applied to, don't use this directly
+    */
+    unsigned int m_appliedRevision = 0;
+
+};
+
+
+/**
+* @brief Applies LOD settings to entities and sets up the LOD levels of
+* meshes
+*
+* The LOD levels of a mesh are set up from Lua:
+*
+* \code{.lua}
+* lodSystem = OgreLodSystem()
+* -- Values are pixel counts with this strategy, distances by default
+* lodSystem:setMeshLodStrategy("microbe.mesh", "PixelCount")
+* lodSystem:addMeshLodLevel("microbe.mesh", 2000, "microbe_low.mesh")
+* lodSystem:addMeshLodLevel("microbe.mesh", 200, "microbe_lowest.mesh")
+* \endcode
+*
+* A mesh is set up the first time an entity with an OgreLodComponent uses
+* it. All entities of that mesh are then recreated, because Ogre only picks
+* up manual LOD levels for new entities.
+*
+* Should run after the OgreUpdateSceneNodeSystem, which creates the
+* entities.
+*/
+class OgreLodSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreLodSystem()
+    * - OgreLodSystem::addMeshLodLevel
+    * - OgreLodSystem::setMeshLodStrategy
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreLodSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~OgreLodSystem();
+
+    /**
+    * @brief Adds a manual LOD level to a mesh
+    *
+    * @param meshName
+    *   The full detail mesh
+    * @param value
+    *   When to switch to \a lodMeshName, in the units of the mesh's LOD
+    *   strategy (see setMeshLodStrategy())
+    * @param lodMeshName
+    *   The simpler mesh to use from \a value on
+    */
+    void
+    addMeshLodLevel(
+        const std::string& meshName,
+        Ogre::Real value,
+        const std::string& lodMeshName
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Sets the Ogre LOD strategy of a mesh
+    *
+    * @param meshName
+    *   The full detail mesh
+    * @param strategyName
+    *   The name the strategy is registered with at the
+    *   Ogre::LodStrategyManager, like \c "Distance" (the default) or
+    *   \c "PixelCount"
+    *
+    * @throw std::invalid_argument
+    *   If there is no such strategy
+    */
+    void
+    setMeshLodStrategy(
+        const std::string& meshName,
+        const std::string& strategyName
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Applies changed LOD settings
+    *
+    * @param milliseconds
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
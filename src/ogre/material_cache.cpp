@@ -0,0 +1,204 @@
+#include "ogre/material_cache.h"
+
+#include "ogre/colour_material.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <OgreDataStream.h>
+#include <OgreGpuProgramManager.h>
+#include <OgreMaterialManager.h>
+#include <OgreMesh.h>
+#include <OgreMeshManager.h>
+#include <OgreRenderSystem.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreRoot.h>
+#include <OgreSubMesh.h>
+
+using namespace thrive;
+
+namespace {
+
+// Microcode only fits the render system that compiled it
+boost::filesystem::path
+cacheFile(
+    const boost::filesystem::path& directory
+) {
+    std::string name = Ogre::Root::getSingleton().getRenderSystem()->getName();
+    std::replace_if(name.begin(), name.end(),
+        [] (char c) {
+            return not std::isalnum(static_cast<unsigned char>(c));
+        },
+        '_'
+    );
+    return directory / (name + ".cache");
+}
+
+}
+
+
+void
+thrive::loadGpuProgramCache(
+    const boost::filesystem::path& directory
+) {
+    Ogre::GpuProgramManager& programs = Ogre::GpuProgramManager::getSingleton();
+    if (not programs.canGetCompiledShaderBuffer()) {
+        return;
+    }
+    programs.setSaveMicrocodesToCache(true);
+    boost::filesystem::path file = cacheFile(directory);
+    if (not boost::filesystem::exists(file)) {
+        return;
+    }
+    std::ifstream* stream = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(
+        file.string().c_str(),
+        std::ios::binary
+    );
+    // The data stream closes and frees the file stream
+    Ogre::DataStreamPtr data(OGRE_NEW Ogre::FileStreamDataStream(stream, true));
+    try {
+        programs.loadMicrocodeCache(data);
+    }
+    catch (const Ogre::Exception& e) {
+        std::cerr << "Warning: Skipping GPU program cache " << file.string()
+            << ": " << e.getDescription() << std::endl;
+    }
+}
+
+
+void
+thrive::saveGpuProgramCache(
+    const boost::filesystem::path& directory
+) {
+    Ogre::GpuProgramManager& programs = Ogre::GpuProgramManager::getSingleton();
+    if (not programs.getSaveMicrocodesToCache() or not programs.isCacheDirty()) {
+        return;
+    }
+    boost::system::error_code error;
+    boost::filesystem::create_directories(directory, error);
+    boost::filesystem::path file = cacheFile(directory);
+    std::fstream* stream = OGRE_NEW_T(std::fstream, Ogre::MEMCATEGORY_GENERAL)(
+        file.string().c_str(),
+        std::ios::out | std::ios::binary | std::ios::trunc
+    );
+    if (not *stream) {
+        OGRE_DELETE_T(stream, basic_fstream, Ogre::MEMCATEGORY_GENERAL);
+        std::cerr << "Warning: Can't write GPU program cache " << file.string() << std::endl;
+        return;
+    }
+    Ogre::DataStreamPtr data(OGRE_NEW Ogre::FileStreamDataStream(stream, true));
+    programs.saveMicrocodeCache(data);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MaterialWarmup
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+MaterialWarmup::luaBindings() {
+    using namespace luabind;
+    return class_<MaterialWarmup>("MaterialWarmup")
+        .def("addColour", &MaterialWarmup::addColour)
+        .def("addMaterial", &MaterialWarmup::addMaterial)
+        .def("addMesh", &MaterialWarmup::addMesh)
+    ;
+}
+
+
+void
+MaterialWarmup::addColour(
+    const Ogre::ColourValue& colour
+) {
+    m_colours.push_back(colour);
+}
+
+
+void
+MaterialWarmup::addMaterial(
+    const std::string& materialName
+) {
+    m_materials.insert(materialName);
+}
+
+
+void
+MaterialWarmup::addMesh(
+    const std::string& meshName
+) {
+    m_meshes.insert(meshName);
+}
+
+
+bool
+MaterialWarmup::hasPending() const {
+    return not (m_colours.empty() and m_materials.empty() and m_meshes.empty());
+}
+
+
+size_t
+MaterialWarmup::run() {
+    size_t count = 0;
+    while (this->hasPending()) {
+        count += this->warmUpNext();
+    }
+    return count;
+}
+
+
+bool
+MaterialWarmup::step() {
+    if (this->hasPending()) {
+        this->warmUpNext();
+    }
+    return this->hasPending();
+}
+
+
+size_t
+MaterialWarmup::warmUpNext() {
+    if (not m_meshes.empty()) {
+        std::string meshName = *m_meshes.begin();
+        m_meshes.erase(m_meshes.begin());
+        try {
+            Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load(
+                meshName,
+                Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME
+            );
+            for (unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i) {
+                const Ogre::SubMesh* subMesh = mesh->getSubMesh(i);
+                if (subMesh->isMatInitialised()) {
+                    m_materials.insert(subMesh->getMaterialName());
+                }
+            }
+        }
+        catch (const Ogre::Exception& e) {
+            std::cerr << "Warning: Can't warm up mesh " << meshName << ": "
+                << e.getDescription() << std::endl;
+        }
+        return 0;
+    }
+    if (not m_materials.empty()) {
+        std::string materialName = *m_materials.begin();
+        m_materials.erase(m_materials.begin());
+        Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().getByName(
+            materialName
+        );
+        if (material.isNull()) {
+            std::cerr << "Warning: Can't warm up unknown material " << materialName << std::endl;
+            return 0;
+        }
+        // Compiles the techniques and loads their GPU programs and textures
+        material->load();
+        return 1;
+    }
+    if (not m_colours.empty()) {
+        Ogre::ColourValue colour = m_colours.back();
+        m_colours.pop_back();
+        getColourMaterial(colour)->load();
+        return 1;
+    }
+    return 0;
+}
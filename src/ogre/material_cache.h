@@ -0,0 +1,158 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <OgreColourValue.h>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Loads the compiled GPU programs of earlier runs
+*
+* Enables Ogre's microcode cache, so programs compiled in this run are
+* kept for saveGpuProgramCache(). Each render system has its own cache
+* file in \a directory. Does nothing if the render system can't return
+* compiled programs.
+*
+* Must be called after the render system has been initialised. A cache
+* file that can't be read is skipped with a warning, the programs are
+* compiled from source then.
+*
+* @param directory
+*   The directory holding the cache files
+*/
+void
+loadGpuProgramCache(
+    const boost::filesystem::path& directory
+);
+
+/**
+* @brief Writes the compiled GPU programs for the next run
+*
+* Only writes if programs were compiled since loadGpuProgramCache().
+* Failing to write is not an error, the next run compiles the programs
+* again.
+*
+* Must be called before Ogre shuts down.
+*
+* @param directory
+*   The directory holding the cache files. Created on demand.
+*/
+void
+saveGpuProgramCache(
+    const boost::filesystem::path& directory
+);
+
+
+/**
+* @brief Compiles materials ahead of their first use
+*
+* Ogre compiles a material's techniques and loads its GPU programs when
+* the material is first rendered, which stalls that frame. The warm-up
+* does this for the materials it was given while the game is still
+* loading. The engine runs it once the background resource loading is
+* done (see Engine::materialWarmup()), because the materials can live in
+* any resource group.
+*
+* Colours stand for the colour materials of getColourMaterial().
+*/
+class MaterialWarmup {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - MaterialWarmup::addColour
+    * - MaterialWarmup::addMaterial
+    * - MaterialWarmup::addMesh
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Queues the colour material of a colour
+    *
+    * @param colour
+    */
+    void
+    addColour(
+        const Ogre::ColourValue& colour
+    );
+
+    /**
+    * @brief Queues a material
+    *
+    * @param materialName
+    */
+    void
+    addMaterial(
+        const std::string& materialName
+    );
+
+    /**
+    * @brief Queues a mesh and the materials of its sub-meshes
+    *
+    * The mesh is loaded by the warm-up, too.
+    *
+    * @param meshName
+    */
+    void
+    addMesh(
+        const std::string& meshName
+    );
+
+    /**
+    * @brief Whether anything is queued
+    */
+    bool
+    hasPending() const;
+
+    /**
+    * @brief Compiles the queued materials and empties the queue
+    *
+    * Meshes and materials that don't exist are skipped with a warning.
+    *
+    * @return
+    *   The number of materials compiled
+    */
+    size_t
+    run();
+
+    /**
+    * @brief Warms up a single queued mesh, material or colour
+    *
+    * Meshes come first, as they queue their materials. Lets the engine's
+    * IdleTasks spread the warm-up over idle time.
+    *
+    * @return
+    *   Whether anything is left in the queue
+    */
+    bool
+    step();
+
+private:
+
+    // Warms up the next queued item and returns the number of materials
+    // compiled
+    size_t
+    warmUpNext();
+
+    std::vector<Ogre::ColourValue> m_colours;
+
+    std::set<std::string> m_materials;
+
+    std::set<std::string> m_meshes;
+
+};
+
+}
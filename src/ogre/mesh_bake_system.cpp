@@ -0,0 +1,589 @@
+#include "ogre/mesh_bake_system.h"
+
+#include "engine/component_factory.h"
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "ogre/colour_material.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <OgreEntity.h>
+#include <OgreHardwareBufferManager.h>
+#include <OgreMaterial.h>
+#include <OgreMesh.h>
+#include <OgreMeshManager.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreSubMesh.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace thrive;
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreMeshBakeComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreMeshBakeComponent::luaBindings() {
+    using namespace luabind;
+    return class_<OgreMeshBakeComponent, Component>("OgreMeshBakeComponent")
+        .enum_("ID") [
+            value("TYPE_ID", OgreMeshBakeComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &OgreMeshBakeComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+        .def("clearParts", &OgreMeshBakeComponent::clearParts)
+        .def("partCount", &OgreMeshBakeComponent::partCount)
+        .def("removePart", &OgreMeshBakeComponent::removePart)
+        .def("setPart", &OgreMeshBakeComponent::setPart)
+        .def("setPartColour", &OgreMeshBakeComponent::setPartColour)
+        .def_readwrite("minPixelSize", &OgreMeshBakeComponent::m_minPixelSize)
+    ;
+}
+
+
+OgreMeshBakeComponent::OgreMeshBakeComponent() {
+    m_parts.setComponent(this);
+}
+
+
+void
+OgreMeshBakeComponent::clearParts() {
+    if (not m_parts.parts.empty()) {
+        m_parts.parts.clear();
+        m_parts.touchFields(Parts::LAYOUT);
+    }
+}
+
+
+OgreMeshBakeComponent::Part*
+OgreMeshBakeComponent::findPart(
+    uint32_t key
+) {
+    for (Part& part : m_parts.parts) {
+        if (part.m_key == key) {
+            return &part;
+        }
+    }
+    return nullptr;
+}
+
+
+bool
+OgreMeshBakeComponent::isChangeTracked() const {
+    // m_minPixelSize is only read when the parts change
+    return true;
+}
+
+
+void
+OgreMeshBakeComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_minPixelSize = storage.get<Ogre::Real>("minPixelSize", 0.0f);
+    m_parts.parts.clear();
+    StorageList parts = storage.get<StorageList>("parts");
+    for (const StorageContainer& partStorage : parts) {
+        Part part;
+        part.m_key = partStorage.get<uint32_t>("key");
+        part.m_meshName = partStorage.get<std::string>("meshName");
+        part.m_position = partStorage.get<Ogre::Vector3>("position", Ogre::Vector3::ZERO);
+        StorageList colours = partStorage.get<StorageList>("colours");
+        for (const StorageContainer& colourStorage : colours) {
+            part.m_colours.emplace_back(
+                colourStorage.get<std::string>("subMeshName"),
+                colourStorage.get<Ogre::ColourValue>("colour")
+            );
+        }
+        m_parts.parts.push_back(std::move(part));
+    }
+    m_parts.touch();
+}
+
+
+size_t
+OgreMeshBakeComponent::partCount() const {
+    return m_parts.parts.size();
+}
+
+
+bool
+OgreMeshBakeComponent::removePart(
+    uint32_t key
+) {
+    auto& parts = m_parts.parts;
+    auto iter = std::find_if(parts.begin(), parts.end(),
+        [key] (const Part& part) {
+            return part.m_key == key;
+        }
+    );
+    if (iter == parts.end()) {
+        return false;
+    }
+    parts.erase(iter);
+    m_parts.touchFields(Parts::LAYOUT);
+    return true;
+}
+
+
+void
+OgreMeshBakeComponent::setPart(
+    uint32_t key,
+    const std::string& meshName,
+    const Ogre::Vector3& position
+) {
+    Part* part = this->findPart(key);
+    if (not part) {
+        m_parts.parts.emplace_back();
+        part = &m_parts.parts.back();
+        part->m_key = key;
+    }
+    else if (part->m_meshName == meshName and part->m_position == position) {
+        return;
+    }
+    part->m_meshName = meshName;
+    part->m_position = position;
+    m_parts.touchFields(Parts::LAYOUT);
+}
+
+
+void
+OgreMeshBakeComponent::setPartColour(
+    uint32_t key,
+    const std::string& subMeshName,
+    const Ogre::ColourValue& colour
+) {
+    Part* part = this->findPart(key);
+    if (not part) {
+        return;
+    }
+    for (auto& entry : part->m_colours) {
+        if (entry.first == subMeshName) {
+            if (entry.second != colour) {
+                entry.second = colour;
+                m_parts.touchFields(Parts::COLOURS);
+            }
+            return;
+        }
+    }
+    part->m_colours.emplace_back(subMeshName, colour);
+    m_parts.touchFields(Parts::COLOURS);
+}
+
+
+StorageContainer
+OgreMeshBakeComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    storage.set<Ogre::Real>("minPixelSize", m_minPixelSize);
+    StorageList parts;
+    parts.reserve(m_parts.parts.size());
+    for (const Part& part : m_parts.parts) {
+        StorageContainer partStorage;
+        partStorage.set<uint32_t>("key", part.m_key);
+        partStorage.set<std::string>("meshName", part.m_meshName);
+        partStorage.set<Ogre::Vector3>("position", part.m_position);
+        StorageList colours;
+        colours.reserve(part.m_colours.size());
+        for (const auto& entry : part.m_colours) {
+            StorageContainer colourStorage;
+            colourStorage.set<std::string>("subMeshName", entry.first);
+            colourStorage.set<Ogre::ColourValue>("colour", entry.second);
+            colours.append(std::move(colourStorage));
+        }
+        partStorage.set<StorageList>("colours", std::move(colours));
+        parts.append(std::move(partStorage));
+    }
+    storage.set<StorageList>("parts", std::move(parts));
+    return storage;
+}
+
+REGISTER_COMPONENT(OgreMeshBakeComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OgreMeshBakeSystem
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+OgreMeshBakeSystem::luaBindings() {
+    using namespace luabind;
+    return class_<OgreMeshBakeSystem, System>("OgreMeshBakeSystem")
+        .def(constructor<>())
+    ;
+}
+
+
+namespace {
+
+// Vertex layout of the geometry buffer
+struct BakedVertex {
+
+    float position[3];
+
+    float normal[3];
+
+};
+
+
+// A part mesh, as read back from its hardware buffers
+struct SourceMesh {
+
+    struct SubMesh {
+
+        std::string name;
+
+        std::vector<BakedVertex> vertices;
+
+        std::vector<uint32_t> indices;
+
+    };
+
+    std::vector<SubMesh> subMeshes;
+
+};
+
+
+void
+readVector3(
+    const Ogre::VertexData* vertexData,
+    Ogre::VertexElementSemantic semantic,
+    std::vector<BakedVertex>& vertices,
+    float (BakedVertex::* member)[3]
+) {
+    const Ogre::VertexElement* element = vertexData->vertexDeclaration->findElementBySemantic(semantic);
+    if (not element) {
+        return;
+    }
+    Ogre::HardwareVertexBufferSharedPtr buffer = vertexData->vertexBufferBinding->getBuffer(
+        element->getSource()
+    );
+    size_t vertexSize = buffer->getVertexSize();
+    unsigned char* vertex = static_cast<unsigned char*>(
+        buffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY)
+    );
+    vertex += vertexData->vertexStart * vertexSize;
+    for (size_t i = 0; i < vertexData->vertexCount; ++i, vertex += vertexSize) {
+        float* value = nullptr;
+        element->baseVertexPointerToElement(vertex, &value);
+        std::copy(value, value + 3, vertices[i].*member);
+    }
+    buffer->unlock();
+}
+
+}
+
+
+struct OgreMeshBakeSystem::Implementation {
+
+    // The baked mesh of a component
+    struct Baked {
+
+        Ogre::HardwareVertexBufferSharedPtr colourBuffer;
+
+        Ogre::Entity* entity = nullptr;
+
+        Ogre::MeshPtr mesh;
+
+        // Vertex count of each part's sub-meshes, in the order of
+        // OgreMeshBakeComponent::Parts::parts
+        std::vector<std::vector<size_t>> vertexCounts;
+
+        // The scene node the entity is attached to
+        Ogre::SceneNode* sceneNode = nullptr;
+
+    };
+
+    void
+    bake(
+        OgreMeshBakeComponent* component,
+        OgreSceneNodeComponent* sceneNodeComponent,
+        Baked& baked
+    ) {
+        this->destroy(baked);
+        const auto& parts = component->m_parts.parts;
+        std::vector<BakedVertex> vertices;
+        std::vector<uint32_t> indices;
+        baked.vertexCounts.resize(parts.size());
+        Ogre::AxisAlignedBox bounds;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            const OgreMeshBakeComponent::Part& part = parts[i];
+            const SourceMesh& source = this->sourceMesh(part.m_meshName);
+            baked.vertexCounts[i].clear();
+            for (const SourceMesh::SubMesh& subMesh : source.subMeshes) {
+                uint32_t base = static_cast<uint32_t>(vertices.size());
+                for (BakedVertex vertex : subMesh.vertices) {
+                    vertex.position[0] += part.m_position.x;
+                    vertex.position[1] += part.m_position.y;
+                    vertex.position[2] += part.m_position.z;
+                    bounds.merge(Ogre::Vector3(vertex.position));
+                    vertices.push_back(vertex);
+                }
+                for (uint32_t index : subMesh.indices) {
+                    indices.push_back(base + index);
+                }
+                baked.vertexCounts[i].push_back(subMesh.vertices.size());
+            }
+        }
+        if (indices.empty()) {
+            return;
+        }
+        Ogre::HardwareBufferManager& bufferManager = Ogre::HardwareBufferManager::getSingleton();
+        baked.mesh = Ogre::MeshManager::getSingleton().createManual(
+            "MeshBake/" + std::to_string(m_nextMeshId++),
+            Ogre::ResourceGroupManager::INTERNAL_RESOURCE_GROUP_NAME
+        );
+        Ogre::SubMesh* subMesh = baked.mesh->createSubMesh();
+        subMesh->useSharedVertices = false;
+        subMesh->vertexData = new Ogre::VertexData();
+        subMesh->vertexData->vertexCount = vertices.size();
+        Ogre::VertexDeclaration* declaration = subMesh->vertexData->vertexDeclaration;
+        declaration->addElement(0, 0, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+        declaration->addElement(0, offsetof(BakedVertex, normal), Ogre::VET_FLOAT3, Ogre::VES_NORMAL);
+        declaration->addElement(1, 0, m_colourType, Ogre::VES_DIFFUSE);
+        Ogre::HardwareVertexBufferSharedPtr geometryBuffer = bufferManager.createVertexBuffer(
+            sizeof(BakedVertex),
+            vertices.size(),
+            Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY
+        );
+        geometryBuffer->writeData(0, geometryBuffer->getSizeInBytes(), vertices.data(), true);
+        // Rewritten on colour changes, the geometry isn't
+        baked.colourBuffer = bufferManager.createVertexBuffer(
+            declaration->getVertexSize(1),
+            vertices.size(),
+            Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE
+        );
+        subMesh->vertexData->vertexBufferBinding->setBinding(0, geometryBuffer);
+        subMesh->vertexData->vertexBufferBinding->setBinding(1, baked.colourBuffer);
+        bool isLarge = vertices.size() > 0xFFFF;
+        Ogre::HardwareIndexBufferSharedPtr indexBuffer = bufferManager.createIndexBuffer(
+            isLarge ? Ogre::HardwareIndexBuffer::IT_32BIT : Ogre::HardwareIndexBuffer::IT_16BIT,
+            indices.size(),
+            Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY
+        );
+        if (isLarge) {
+            indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), indices.data(), true);
+        }
+        else {
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), shortIndices.data(), true);
+        }
+        subMesh->indexData->indexBuffer = indexBuffer;
+        subMesh->indexData->indexStart = 0;
+        subMesh->indexData->indexCount = indices.size();
+        subMesh->setMaterialName(m_material->getName());
+        baked.mesh->_setBounds(bounds);
+        baked.mesh->_setBoundingSphereRadius(
+            std::max(bounds.getMinimum().length(), bounds.getMaximum().length())
+        );
+        baked.mesh->load();
+        this->writeColours(component, baked);
+        baked.entity = m_sceneManager->createEntity(baked.mesh);
+        baked.entity->setRenderingMinPixelSize(component->m_minPixelSize);
+        baked.entity->setVisible(sceneNodeComponent->m_visible.get());
+        baked.sceneNode = sceneNodeComponent->m_sceneNode;
+        baked.sceneNode->attachObject(baked.entity);
+    }
+
+    void
+    destroy(
+        Baked& baked
+    ) {
+        if (baked.entity) {
+            if (baked.entity->isAttached()) {
+                baked.entity->detachFromParent();
+            }
+            m_sceneManager->destroyEntity(baked.entity);
+            baked.entity = nullptr;
+        }
+        if (not baked.mesh.isNull()) {
+            Ogre::MeshManager::getSingleton().remove(baked.mesh->getHandle());
+            baked.mesh.setNull();
+        }
+        baked.colourBuffer.setNull();
+        baked.sceneNode = nullptr;
+    }
+
+    const SourceMesh&
+    sourceMesh(
+        const std::string& meshName
+    ) {
+        auto iter = m_sourceMeshes.find(meshName);
+        if (iter != m_sourceMeshes.end()) {
+            return iter->second;
+        }
+        SourceMesh& source = m_sourceMeshes[meshName];
+        Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load(
+            meshName,
+            Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME
+        );
+        std::vector<std::string> names(mesh->getNumSubMeshes());
+        for (const auto& item : mesh->getSubMeshNameMap()) {
+            names[item.second] = item.first;
+        }
+        // Reading back write-only buffers is slow, but only done once
+        for (unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i) {
+            Ogre::SubMesh* subMesh = mesh->getSubMesh(i);
+            const Ogre::VertexData* vertexData = subMesh->useSharedVertices ?
+                mesh->sharedVertexData : subMesh->vertexData;
+            const Ogre::IndexData* indexData = subMesh->indexData;
+            if (subMesh->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST) {
+                std::cerr << "Can't bake sub-mesh " << i << " of " << meshName
+                          << ", it is not a triangle list" << std::endl;
+                continue;
+            }
+            SourceMesh::SubMesh bakedSubMesh;
+            bakedSubMesh.name = names[i];
+            bakedSubMesh.vertices.resize(vertexData->vertexCount, BakedVertex{{0, 0, 0}, {0, 0, 1}});
+            readVector3(vertexData, Ogre::VES_POSITION, bakedSubMesh.vertices, &BakedVertex::position);
+            readVector3(vertexData, Ogre::VES_NORMAL, bakedSubMesh.vertices, &BakedVertex::normal);
+            Ogre::HardwareIndexBufferSharedPtr indexBuffer = indexData->indexBuffer;
+            bool is32Bit = indexBuffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT;
+            const void* data = indexBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY);
+            bakedSubMesh.indices.reserve(indexData->indexCount);
+            for (size_t k = indexData->indexStart; k < indexData->indexStart + indexData->indexCount; ++k) {
+                bakedSubMesh.indices.push_back(is32Bit ?
+                    static_cast<const uint32_t*>(data)[k] :
+                    static_cast<const uint16_t*>(data)[k]
+                );
+            }
+            indexBuffer->unlock();
+            source.subMeshes.push_back(std::move(bakedSubMesh));
+        }
+        return source;
+    }
+
+    void
+    writeColours(
+        OgreMeshBakeComponent* component,
+        Baked& baked
+    ) {
+        if (baked.colourBuffer.isNull()) {
+            return;
+        }
+        const auto& parts = component->m_parts.parts;
+        uint32_t* colour = static_cast<uint32_t*>(
+            baked.colourBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD)
+        );
+        uint32_t white = Ogre::VertexElement::convertColourValue(Ogre::ColourValue::White, m_colourType);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            const OgreMeshBakeComponent::Part& part = parts[i];
+            const SourceMesh& source = this->sourceMesh(part.m_meshName);
+            for (size_t k = 0; k < baked.vertexCounts[i].size(); ++k) {
+                uint32_t value = white;
+                for (const auto& entry : part.m_colours) {
+                    if (entry.first == source.subMeshes[k].name) {
+                        value = Ogre::VertexElement::convertColourValue(entry.second, m_colourType);
+                        break;
+                    }
+                }
+                colour = std::fill_n(colour, baked.vertexCounts[i][k], value);
+            }
+        }
+        baked.colourBuffer->unlock();
+    }
+
+    std::unordered_map<EntityId, Baked> m_baked;
+
+    Ogre::VertexElementType m_colourType = Ogre::VET_COLOUR;
+
+    EntityFilter<
+        OgreMeshBakeComponent,
+        OgreSceneNodeComponent
+    > m_entities = {true};
+
+    Ogre::MaterialPtr m_material;
+
+    unsigned int m_nextMeshId = 0;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::unordered_map<std::string, SourceMesh> m_sourceMeshes;
+
+};
+
+
+OgreMeshBakeSystem::OgreMeshBakeSystem()
+  : m_impl(new Implementation())
+{
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareWrite(OgreMeshBakeComponent::TYPE_ID);
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+OgreMeshBakeSystem::~OgreMeshBakeSystem() {}
+
+
+void
+OgreMeshBakeSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_sceneManager = gameState->sceneManager();
+    m_impl->m_colourType = Ogre::VertexElement::getBestColourVertexElementType();
+    m_impl->m_material = getVertexColourMaterial();
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+void
+OgreMeshBakeSystem::shutdown() {
+    for (auto& item : m_impl->m_baked) {
+        m_impl->destroy(item.second);
+    }
+    m_impl->m_baked.clear();
+    m_impl->m_sourceMeshes.clear();
+    m_impl->m_material.setNull();
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_sceneManager = nullptr;
+    System::shutdown();
+}
+
+
+void
+OgreMeshBakeSystem::update(int) {
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreMeshBakeComponent*, OgreSceneNodeComponent*>& group) {
+            // A new or replaced component is baked from scratch
+            std::get<0>(group)->m_parts.touchFields(OgreMeshBakeComponent::Parts::LAYOUT);
+            m_impl->m_baked[entityId];
+        },
+        [this] (EntityId entityId) {
+            auto iter = m_impl->m_baked.find(entityId);
+            if (iter != m_impl->m_baked.end()) {
+                m_impl->destroy(iter->second);
+                m_impl->m_baked.erase(iter);
+            }
+        }
+    );
+    for (const auto& item : m_impl->m_entities) {
+        OgreMeshBakeComponent* component = std::get<0>(item.second);
+        OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+        auto& parts = component->m_parts;
+        if (not sceneNodeComponent->m_sceneNode) {
+            continue;
+        }
+        Implementation::Baked& baked = m_impl->m_baked[item.first];
+        bool isNewSceneNode = baked.entity and baked.sceneNode != sceneNodeComponent->m_sceneNode;
+        if (isNewSceneNode or parts.changedFields() & OgreMeshBakeComponent::Parts::LAYOUT) {
+            m_impl->bake(component, sceneNodeComponent, baked);
+        }
+        else if (parts.hasChanges() and sceneNodeComponent->m_isOnScreen) {
+            m_impl->writeColours(component, baked);
+        }
+        else {
+            continue;
+        }
+        parts.untouch();
+    }
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/system.h"
+#include "engine/touchable.h"
+
+#include <cstdint>
+#include <memory>
+#include <OgreColourValue.h>
+#include <OgreVector3.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Meshes merged into a single mesh of the entity
+*
+* An entity made of many small meshes, like a microbe made of hexes,
+* would need a scene node and a draw call per mesh. Instead, the meshes
+* are added to this component as parts:
+*
+* \code{.lua}
+* meshBake:setPart(encodeAxial(q, r), "hex.mesh", Vector3(x, y, 0))
+* meshBake:setPartColour(encodeAxial(q, r), "center", colour)
+* \endcode
+*
+* The OgreMeshBakeSystem merges the parts into one mesh, attached to the
+* entity's scene node. The materials of the parts are replaced by vertex
+* colours, one per part and sub-mesh. Sub-meshes without a colour are
+* white.
+*
+* Requires an OgreSceneNodeComponent.
+*/
+class OgreMeshBakeComponent : public Component {
+    COMPONENT(OgreMeshBake)
+
+public:
+
+    /**
+    * @brief A mesh to merge
+    */
+    struct Part {
+
+        /**
+        * @brief Identifies the part for setPart() and removePart()
+        */
+        uint32_t m_key = 0;
+
+        /**
+        * @brief The name of the mesh
+        */
+        std::string m_meshName;
+
+        /**
+        * @brief Position of the mesh relative to the scene node
+        */
+        Ogre::Vector3 m_position = Ogre::Vector3::ZERO;
+
+        /**
+        * @brief Colours by sub-mesh name
+        */
+        std::vector<std::pair<std::string, Ogre::ColourValue>> m_colours;
+
+    };
+
+    /**
+    * @brief The parts, in the order they were added
+    */
+    struct Parts : public Touchable {
+
+        enum Field : FieldMask {
+            LAYOUT = 1 << 0,
+            COLOURS = 1 << 1
+        };
+
+        /**
+        * @brief All parts
+        */
+        std::vector<Part> parts;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreMeshBakeComponent()
+    * - OgreMeshBakeComponent::clearParts
+    * - OgreMeshBakeComponent::partCount
+    * - OgreMeshBakeComponent::removePart
+    * - OgreMeshBakeComponent::setPart
+    * - OgreMeshBakeComponent::setPartColour
+    * - OgreMeshBakeComponent::m_minPixelSize (as "minPixelSize")
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreMeshBakeComponent();
+
+    /**
+    * @brief Removes all parts
+    */
+    void
+    clearParts();
+
+    bool
+    isChangeTracked() const override;
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    /**
+    * @brief The number of parts
+    */
+    size_t
+    partCount() const;
+
+    /**
+    * @brief Removes a part
+    *
+    * @param key
+    *
+    * @return
+    *   \c true if there was a part with \a key
+    */
+    bool
+    removePart(
+        uint32_t key
+    );
+
+    /**
+    * @brief Adds a part or moves an existing one
+    *
+    * A part that is moved or gets a different mesh keeps its colours.
+    *
+    * @param key
+    *   Identifies the part
+    * @param meshName
+    *   The mesh to merge
+    * @param position
+    *   Position relative to the scene node
+    */
+    void
+    setPart(
+        uint32_t key,
+        const std::string& meshName,
+        const Ogre::Vector3& position
+    );
+
+    /**
+    * @brief Sets the colour of a part's sub-mesh
+    *
+    * Only the colours are updated in the baked mesh, it is not merged
+    * again.
+    *
+    * @param key
+    *   The part, does nothing if there is none with this key
+    * @param subMeshName
+    *   The name of the sub-mesh
+    * @param colour
+    */
+    void
+    setPartColour(
+        uint32_t key,
+        const std::string& subMeshName,
+        const Ogre::ColourValue& colour
+    );
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief The baked mesh is not rendered if it covers fewer pixels
+    *
+    * Applied when the mesh is baked. \c 0 renders it at any size.
+    */
+    Ogre::Real m_minPixelSize = 0.0f;
+
+    /**
+    * @brief The parts, the changed fields tell whether the layout or
+    * only the colours changed
+    */
+    Parts m_parts;
+
+private:
+
+    Part*
+    findPart(
+        uint32_t key
+    );
+
+};
+
+
+/**
+* @brief Merges the parts of OgreMeshBakeComponents into one mesh
+*
+* A component is baked again when its layout has changed, at most once
+* per frame. Colour changes only rewrite the vertex colours, and wait
+* while the entity is not on screen, like in the OgreColourSystem.
+*
+* The vertices of each part mesh are read back once and kept, so baking
+* doesn't touch the part meshes' hardware buffers.
+*
+* Should run after the OgreUpdateSceneNodeSystem, which creates the scene
+* nodes.
+*/
+class OgreMeshBakeSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreMeshBakeSystem()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    OgreMeshBakeSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~OgreMeshBakeSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Shuts the system down
+    *
+    * Destroys all baked meshes.
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Bakes changed components
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -1,5 +1,6 @@
 #include "ogre/mouse.h"
 
+#include "engine/input_recording.h"
 #include "scripting/luabind.h"
 
 #include <iostream>
@@ -11,10 +12,27 @@ using namespace thrive;
 
 struct Mouse::Implementation {
 
+    // The replayed state while replaying, otherwise the device's state,
+    // or null without a device
+    const OIS::MouseState*
+    state() const {
+        if (m_isReplaying) {
+            return &m_replayedState;
+        }
+        if (m_mouse) {
+            return &m_mouse->getMouseState();
+        }
+        return nullptr;
+    }
+
     OIS::InputManager* m_inputManager = nullptr;
 
+    bool m_isReplaying = false;
+
     OIS::Mouse* m_mouse = nullptr;
 
+    OIS::MouseState m_replayedState;
+
     int m_windowWidth = 0;
 
     int m_windowHeight = 0;
@@ -72,31 +90,81 @@ bool
 Mouse::isButtonDown(
     OIS::MouseButtonID button
 ) const {
-    return m_impl->m_mouse->getMouseState().buttonDown(button);
+    const OIS::MouseState* mouseState = m_impl->state();
+    if (not mouseState) {
+        return false;
+    }
+    return mouseState->buttonDown(button);
 }
 
 
 Ogre::Vector3
 Mouse::normalizedPosition() const {
-    const OIS::MouseState& mouseState = m_impl->m_mouse->getMouseState();
+    const OIS::MouseState* mouseState = m_impl->state();
+    if (not mouseState or mouseState->width == 0 or mouseState->height == 0) {
+        return Ogre::Vector3(0.5, 0.5, 0.0);
+    }
     return Ogre::Vector3(
-        double(mouseState.X.abs) / mouseState.width,
-        double(mouseState.Y.abs) / mouseState.height,
-        mouseState.Z.abs
+        double(mouseState->X.abs) / mouseState->width,
+        double(mouseState->Y.abs) / mouseState->height,
+        mouseState->Z.abs
     );
 }
 
 
 Ogre::Vector3
 Mouse::position() const {
+    const OIS::MouseState* mouseState = m_impl->state();
+    if (not mouseState) {
+        return Ogre::Vector3(
+            m_impl->m_windowWidth / 2,
+            m_impl->m_windowHeight / 2,
+            0
+        );
+    }
     return Ogre::Vector3(
-        m_impl->m_mouse->getMouseState().X.abs,
-        m_impl->m_mouse->getMouseState().Y.abs,
-        m_impl->m_mouse->getMouseState().Z.abs
+        mouseState->X.abs,
+        mouseState->Y.abs,
+        mouseState->Z.abs
     );
 }
 
 
+void
+Mouse::recordFrame(
+    InputFrame& frame
+) const {
+    const OIS::MouseState* mouseState = m_impl->state();
+    if (not mouseState) {
+        return;
+    }
+    frame.mouse.buttons = mouseState->buttons;
+    frame.mouse.width = mouseState->width;
+    frame.mouse.height = mouseState->height;
+    frame.mouse.x = mouseState->X.abs;
+    frame.mouse.y = mouseState->Y.abs;
+    frame.mouse.z = mouseState->Z.abs;
+}
+
+
+void
+Mouse::replayFrame(
+    const InputFrame& frame
+) {
+    OIS::MouseState& mouseState = m_impl->m_replayedState;
+    mouseState.buttons = frame.mouse.buttons;
+    mouseState.width = frame.mouse.width;
+    mouseState.height = frame.mouse.height;
+    mouseState.X.rel = frame.mouse.x - mouseState.X.abs;
+    mouseState.Y.rel = frame.mouse.y - mouseState.Y.abs;
+    mouseState.Z.rel = frame.mouse.z - mouseState.Z.abs;
+    mouseState.X.abs = frame.mouse.x;
+    mouseState.Y.abs = frame.mouse.y;
+    mouseState.Z.abs = frame.mouse.z;
+    m_impl->m_isReplaying = true;
+}
+
+
 void
 Mouse::setWindowSize(
     int width,
@@ -121,6 +189,9 @@ Mouse::shutdown() {
 
 void
 Mouse::update() {
+    if (not m_impl->m_mouse) {
+        return;
+    }
     m_impl->m_mouse->capture();
 }
 
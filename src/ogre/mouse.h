@@ -18,8 +18,14 @@ class InputManager;
 
 namespace thrive {
 
+struct InputFrame;
+
 /**
 * @brief Handles mouse events
+*
+* Until init() is called, e.g. in headless engines, the mouse rests in the
+* centre of the window and no buttons are pressed. Once replayFrame() has
+* been called, the mouse only reports replayed states.
 */
 class Mouse {
 
@@ -89,6 +95,30 @@ public:
     Ogre::Vector3
     position() const;
 
+    /**
+    * @brief Adds this frame's mouse state to a recording
+    *
+    * @param frame
+    *   The frame to add to, see InputRecorder
+    */
+    void
+    recordFrame(
+        InputFrame& frame
+    ) const;
+
+    /**
+    * @brief Takes the mouse state from a recording
+    *
+    * Replaces update() while replaying.
+    *
+    * @param frame
+    *   A frame previously filled by recordFrame()
+    */
+    void
+    replayFrame(
+        const InputFrame& frame
+    );
+
     /**
     * @brief Updates the window size
     *
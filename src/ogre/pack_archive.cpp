@@ -0,0 +1,266 @@
+#include "ogre/pack_archive.h"
+
+#include "engine/texture_compression.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <cstring>
+#include <OgreDataStream.h>
+#include <OgreException.h>
+#include <OgreString.h>
+
+using namespace thrive;
+
+namespace {
+
+Ogre::FileInfo
+fileInfo(
+    Ogre::Archive* archive,
+    const AssetPack::File& file
+) {
+    Ogre::FileInfo info;
+    info.archive = archive;
+    info.filename = file.name;
+    size_t separator = file.name.rfind('/');
+    if (separator == std::string::npos) {
+        info.basename = file.name;
+    }
+    else {
+        info.path = file.name.substr(0, separator + 1);
+        info.basename = file.name.substr(separator + 1);
+    }
+    info.compressedSize = file.size;
+    info.uncompressedSize = file.size;
+    return info;
+}
+
+
+// Same rules as Ogre's own archives: without recursion only the top
+// directory is searched, and patterns without a directory match the
+// files' base names.
+bool
+matches(
+    const AssetPack::File& file,
+    const Ogre::String& pattern,
+    bool recursive
+) {
+    bool isNested = file.name.find('/') != std::string::npos;
+    if (isNested and not recursive) {
+        return false;
+    }
+    if (pattern.find('/') != Ogre::String::npos) {
+        return Ogre::StringUtil::match(file.name, pattern, true);
+    }
+    std::string basename = file.name.substr(file.name.rfind('/') + 1);
+    return Ogre::StringUtil::match(basename, pattern, true);
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PackArchive
+////////////////////////////////////////////////////////////////////////////////
+
+struct PackArchive::Implementation {
+
+    Implementation(
+        unsigned int mipBias
+    ) : m_mipBias(mipBias)
+    {
+    }
+
+    unsigned int m_mipBias;
+
+    std::unique_ptr<AssetPack> m_pack;
+
+};
+
+
+PackArchive::PackArchive(
+    const Ogre::String& name,
+    const Ogre::String& archiveType,
+    unsigned int mipBias
+) : Ogre::Archive(name, archiveType),
+    m_impl(new Implementation(mipBias))
+{
+}
+
+
+PackArchive::~PackArchive() {
+    this->unload();
+}
+
+
+bool
+PackArchive::exists(
+    const Ogre::String& filename
+) {
+    return m_impl->m_pack and m_impl->m_pack->find(filename);
+}
+
+
+Ogre::StringVectorPtr
+PackArchive::find(
+    const Ogre::String& pattern,
+    bool recursive,
+    bool dirs
+) {
+    Ogre::StringVectorPtr names(OGRE_NEW_T(Ogre::StringVector, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+    if (dirs or not m_impl->m_pack) {
+        return names;
+    }
+    for (const auto& file : m_impl->m_pack->files()) {
+        if (matches(file, pattern, recursive)) {
+            names->push_back(file.name);
+        }
+    }
+    return names;
+}
+
+
+Ogre::FileInfoListPtr
+PackArchive::findFileInfo(
+    const Ogre::String& pattern,
+    bool recursive,
+    bool dirs
+) const {
+    Ogre::FileInfoListPtr infos(OGRE_NEW_T(Ogre::FileInfoList, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+    if (dirs or not m_impl->m_pack) {
+        return infos;
+    }
+    for (const auto& file : m_impl->m_pack->files()) {
+        if (matches(file, pattern, recursive)) {
+            infos->push_back(fileInfo(const_cast<PackArchive*>(this), file));
+        }
+    }
+    return infos;
+}
+
+
+time_t
+PackArchive::getModifiedTime(
+    const Ogre::String&
+) {
+    // The pack is written as a whole
+    boost::system::error_code error;
+    time_t time = boost::filesystem::last_write_time(mName, error);
+    return error ? 0 : time;
+}
+
+
+bool
+PackArchive::isCaseSensitive() const {
+    return true;
+}
+
+
+Ogre::StringVectorPtr
+PackArchive::list(
+    bool recursive,
+    bool dirs
+) {
+    return this->find("*", recursive, dirs);
+}
+
+
+Ogre::FileInfoListPtr
+PackArchive::listFileInfo(
+    bool recursive,
+    bool dirs
+) {
+    return this->findFileInfo("*", recursive, dirs);
+}
+
+
+void
+PackArchive::load() {
+    if (m_impl->m_pack) {
+        return;
+    }
+    try {
+        m_impl->m_pack.reset(new AssetPack(mName));
+    }
+    catch (const std::runtime_error& e) {
+        OGRE_EXCEPT(
+            Ogre::Exception::ERR_FILE_NOT_FOUND,
+            e.what(),
+            "PackArchive::load"
+        );
+    }
+}
+
+
+Ogre::DataStreamPtr
+PackArchive::open(
+    const Ogre::String& filename,
+    bool
+) const {
+    const AssetPack::File* file = m_impl->m_pack ? m_impl->m_pack->find(filename) : nullptr;
+    if (not file) {
+        OGRE_EXCEPT(
+            Ogre::Exception::ERR_FILE_NOT_FOUND,
+            "Not in asset pack " + mName + ": " + filename,
+            "PackArchive::open"
+        );
+    }
+    if (m_impl->m_mipBias > 0 and boost::algorithm::iends_with(filename, ".dds")) {
+        std::string reduced = skipDdsMipLevels(file->data, file->size, m_impl->m_mipBias);
+        if (not reduced.empty()) {
+            // The stream owns a copy, the mapped data stays untouched
+            auto stream = OGRE_NEW Ogre::MemoryDataStream(filename, reduced.size(), true, true);
+            std::memcpy(stream->getPtr(), reduced.data(), reduced.size());
+            return Ogre::DataStreamPtr(stream);
+        }
+    }
+    // Read in place from the mapping, which outlives the stream as long as
+    // the archive is loaded
+    return Ogre::DataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(
+        filename,
+        const_cast<char*>(file->data),
+        file->size,
+        false,
+        true
+    ));
+}
+
+
+void
+PackArchive::unload() {
+    m_impl->m_pack.reset();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// PackArchiveFactory
+////////////////////////////////////////////////////////////////////////////////
+
+const Ogre::String PackArchiveFactory::TYPE = "ThrivePack";
+
+
+Ogre::Archive*
+PackArchiveFactory::createInstance(
+    const Ogre::String& name
+) {
+    return OGRE_NEW PackArchive(name, TYPE, m_mipBias);
+}
+
+
+void
+PackArchiveFactory::destroyInstance(
+    Ogre::Archive* archive
+) {
+    OGRE_DELETE archive;
+}
+
+
+const Ogre::String&
+PackArchiveFactory::getType() const {
+    return TYPE;
+}
+
+
+void
+PackArchiveFactory::setMipBias(
+    unsigned int levels
+) {
+    m_mipBias = levels;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "engine/asset_pack.h"
+
+#include <OgreArchive.h>
+#include <OgreArchiveFactory.h>
+
+namespace thrive {
+
+/**
+* @brief An Ogre archive over an AssetPack
+*
+* Lets resources.cfg list packs written by the BuildAssets tool as
+* resource locations of type \c ThrivePack. Files are opened as streams
+* over the mapped pack, so loading one doesn't copy it.
+*
+* DDS textures can be opened at a lower resolution by dropping their
+* largest mip levels, see PackArchiveFactory::setMipBias().
+*/
+class PackArchive : public Ogre::Archive {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param name
+    *   The pack's path
+    * @param archiveType
+    *   The archive type, as registered by the factory
+    * @param mipBias
+    *   The number of mip levels to drop from DDS textures
+    */
+    PackArchive(
+        const Ogre::String& name,
+        const Ogre::String& archiveType,
+        unsigned int mipBias
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~PackArchive();
+
+    bool
+    exists(
+        const Ogre::String& filename
+    ) override;
+
+    Ogre::StringVectorPtr
+    find(
+        const Ogre::String& pattern,
+        bool recursive = true,
+        bool dirs = false
+    ) override;
+
+    Ogre::FileInfoListPtr
+    findFileInfo(
+        const Ogre::String& pattern,
+        bool recursive = true,
+        bool dirs = false
+    ) const override;
+
+    time_t
+    getModifiedTime(
+        const Ogre::String& filename
+    ) override;
+
+    bool
+    isCaseSensitive() const override;
+
+    Ogre::StringVectorPtr
+    list(
+        bool recursive = true,
+        bool dirs = false
+    ) override;
+
+    Ogre::FileInfoListPtr
+    listFileInfo(
+        bool recursive = true,
+        bool dirs = false
+    ) override;
+
+    /**
+    * @brief Maps the pack
+    *
+    * @throw Ogre::FileNotFoundException
+    *   If the pack can't be mapped or is corrupt
+    */
+    void
+    load() override;
+
+    Ogre::DataStreamPtr
+    open(
+        const Ogre::String& filename,
+        bool readOnly = true
+    ) const override;
+
+    void
+    unload() override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+
+/**
+* @brief Creates PackArchive instances for the \c ThrivePack type
+*
+* Must be registered with Ogre::ArchiveManager::addArchiveFactory()
+* before resource locations of that type are added, and outlive the
+* Ogre::Root.
+*/
+class PackArchiveFactory : public Ogre::ArchiveFactory {
+
+public:
+
+    /**
+    * @brief The archive type to use in resources.cfg
+    */
+    static const Ogre::String TYPE;
+
+    Ogre::Archive*
+    createInstance(
+        const Ogre::String& name
+    ) override;
+
+    void
+    destroyInstance(
+        Ogre::Archive* archive
+    ) override;
+
+    const Ogre::String&
+    getType() const override;
+
+    /**
+    * @brief Sets the number of mip levels to drop from DDS textures
+    *
+    * Only affects archives created afterwards. Each level quarters the
+    * texture's memory. Textures keep at least their smallest level.
+    *
+    * @param levels
+    */
+    void
+    setMipBias(
+        unsigned int levels
+    );
+
+private:
+
+    unsigned int m_mipBias = 0;
+
+};
+
+}
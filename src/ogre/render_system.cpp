@@ -2,9 +2,25 @@
 
 #include "engine/engine.h"
 #include "engine/game_state.h"
+#include "engine/system_profiler.h"
+#include "engine/tracer.h"
+#include "ogre/gpu_timer.h"
 #include "scripting/luabind.h"
 
+#include <algorithm>
+#include <array>
+#include <boost/chrono.hpp>
+#include <OgreCamera.h>
+#include <OgreRenderQueueListener.h>
+#include <OgreRenderSystem.h>
+#include <OgreRenderTargetListener.h>
+#include <OgreRenderWindow.h>
 #include <OgreRoot.h>
+#include <OgreSceneManager.h>
+#include <OgreViewport.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace thrive;
 
@@ -12,27 +28,353 @@ luabind::scope
 RenderSystem::luaBindings() {
     using namespace luabind;
     return class_<RenderSystem, System>("RenderSystem")
+        .scope [
+            def("find", &RenderSystem::find)
+        ]
         .def(constructor<>())
+        .def("isTimingFrameStages", &RenderSystem::isTimingFrameStages)
+        .def("isTimingGpu", &RenderSystem::isTimingGpu)
+        .def("setTimingFrameStages", &RenderSystem::setTimingFrameStages)
+        .def("setTimingGpu", &RenderSystem::setTimingGpu)
     ;
 }
 
 
-struct RenderSystem::Implementation {
+namespace {
 
-    Ogre::Root* m_root;
+using Clock = boost::chrono::steady_clock;
+
+// Queue groups that were never timed
+const size_t NO_SCOPE = static_cast<size_t>(-1);
+
+uint32_t
+toMicroseconds(
+    Clock::duration duration
+) {
+    return static_cast<uint32_t>(
+        boost::chrono::duration_cast<boost::chrono::microseconds>(duration).count()
+    );
+}
+
+}
+
+
+struct RenderSystem::Implementation : public Ogre::RenderTargetListener,
+                                      public Ogre::RenderQueueListener,
+                                      public Ogre::SceneManager::Listener {
+
+    // A viewport or queue group, timed on the CPU and the GPU
+    struct Scope {
+
+        size_t cpuSlot;
+
+        // Summed over the frame, a queue group can be rendered repeatedly
+        Clock::duration cpuTime = Clock::duration::zero();
+
+        size_t gpuSlot;
+
+        Clock::time_point start;
+
+    };
+
+    enum Stage {
+        SceneGraph,
+        Culling,
+        Submission,
+        StageCount
+    };
+
+    Implementation() {
+        m_queueScopes.fill(NO_SCOPE);
+    }
+
+    size_t
+    addScope(
+        const std::string& name
+    ) {
+        Scope scope;
+        scope.cpuSlot = m_profiler->addScope(name + ": cpu");
+        scope.gpuSlot = m_profiler->addScope(name + ": gpu");
+        m_scopes.push_back(scope);
+        return m_scopes.size() - 1;
+    }
+
+    void
+    beginScope(
+        size_t scope
+    ) {
+        m_scopes[scope].start = Clock::now();
+        m_gpuTimer.begin(scope);
+    }
+
+    void
+    beginStage(
+        Stage stage
+    ) {
+        m_stageStarts[stage] = Clock::now();
+    }
+
+    void
+    endScope(
+        size_t scope
+    ) {
+        m_gpuTimer.end(scope);
+        Scope& timedScope = m_scopes[scope];
+        timedScope.cpuTime += Clock::now() - timedScope.start;
+    }
+
+    void
+    endStage(
+        Stage stage
+    ) {
+        m_stageTimes[stage] += Clock::now() - m_stageStarts[stage];
+    }
+
+    // Ogre::RenderQueueListener
+
+    void
+    preRenderQueues() override {
+        if (m_isTimingStagesNow) {
+            this->beginStage(Submission);
+        }
+    }
+
+    void
+    postRenderQueues() override {
+        if (m_isTimingStagesNow) {
+            this->endStage(Submission);
+        }
+    }
+
+    void
+    renderQueueStarted(
+        Ogre::uint8 queueGroupId,
+        const Ogre::String&,
+        bool&
+    ) override {
+        if (not m_isTimingGpuNow) {
+            return;
+        }
+        size_t& scope = m_queueScopes[queueGroupId];
+        if (scope == NO_SCOPE) {
+            scope = this->addScope("queue " + std::to_string(queueGroupId));
+        }
+        this->beginScope(scope);
+    }
+
+    void
+    renderQueueEnded(
+        Ogre::uint8 queueGroupId,
+        const Ogre::String&,
+        bool&
+    ) override {
+        if (m_isTimingGpuNow and m_queueScopes[queueGroupId] != NO_SCOPE) {
+            this->endScope(m_queueScopes[queueGroupId]);
+        }
+    }
+
+    // Ogre::RenderTargetListener
+
+    void
+    preRenderTargetUpdate(
+        const Ogre::RenderTargetEvent&
+    ) override {
+        if (m_isTimingGpuNow) {
+            m_gpuTimer.begin(m_windowScope);
+        }
+    }
+
+    void
+    postRenderTargetUpdate(
+        const Ogre::RenderTargetEvent&
+    ) override {
+        if (m_isTimingGpuNow) {
+            m_gpuTimer.end(m_windowScope);
+        }
+    }
+
+    void
+    preViewportUpdate(
+        const Ogre::RenderTargetViewportEvent& event
+    ) override {
+        if (not m_isTimingGpuNow or not event.source->getCamera()) {
+            return;
+        }
+        const std::string& cameraName = event.source->getCamera()->getName();
+        auto iter = m_viewportScopes.find(cameraName);
+        if (iter == m_viewportScopes.end()) {
+            iter = m_viewportScopes.emplace(
+                cameraName,
+                this->addScope("viewport " + cameraName)
+            ).first;
+        }
+        this->beginScope(iter->second);
+    }
+
+    void
+    postViewportUpdate(
+        const Ogre::RenderTargetViewportEvent& event
+    ) override {
+        if (not m_isTimingGpuNow or not event.source->getCamera()) {
+            return;
+        }
+        auto iter = m_viewportScopes.find(event.source->getCamera()->getName());
+        if (iter != m_viewportScopes.end()) {
+            this->endScope(iter->second);
+        }
+    }
+
+    // Ogre::SceneManager::Listener
+
+    void
+    preUpdateSceneGraph(
+        Ogre::SceneManager*,
+        Ogre::Camera*
+    ) override {
+        if (m_isTimingStagesNow) {
+            this->beginStage(SceneGraph);
+        }
+    }
+
+    void
+    postUpdateSceneGraph(
+        Ogre::SceneManager*,
+        Ogre::Camera*
+    ) override {
+        if (m_isTimingStagesNow) {
+            this->endStage(SceneGraph);
+        }
+    }
+
+    void
+    preFindVisibleObjects(
+        Ogre::SceneManager*,
+        Ogre::SceneManager::IlluminationRenderStage,
+        Ogre::Viewport*
+    ) override {
+        if (m_isTimingStagesNow) {
+            this->beginStage(Culling);
+        }
+    }
+
+    void
+    postFindVisibleObjects(
+        Ogre::SceneManager*,
+        Ogre::SceneManager::IlluminationRenderStage,
+        Ogre::Viewport*
+    ) override {
+        if (m_isTimingStagesNow) {
+            this->endStage(Culling);
+        }
+    }
+
+    void
+    recordScopeCpuTimes() {
+        for (Scope& scope : m_scopes) {
+            if (scope.cpuTime > Clock::duration::zero()) {
+                m_profiler->record(scope.cpuSlot, toMicroseconds(scope.cpuTime));
+                scope.cpuTime = Clock::duration::zero();
+            }
+        }
+    }
+
+    void
+    recordStages(
+        Clock::duration frameTime
+    ) {
+        Clock::duration other = frameTime;
+        for (size_t stage = 0; stage < StageCount; ++stage) {
+            m_profiler->record(m_stageSlots[stage], toMicroseconds(m_stageTimes[stage]));
+            other -= m_stageTimes[stage];
+            m_stageTimes[stage] = Clock::duration::zero();
+        }
+        m_profiler->record(m_otherStageSlot, toMicroseconds(std::max(other, Clock::duration::zero())));
+    }
+
+    GpuTimer m_gpuTimer;
+
+    bool m_isListening = false;
+
+    bool m_isTimingGpu = false;
+
+    // Whether this frame is timed, set before rendering
+    bool m_isTimingGpuNow = false;
+
+    bool m_isTimingStages = false;
+
+    bool m_isTimingStagesNow = false;
+
+    size_t m_otherStageSlot = 0;
+
+    SystemProfiler* m_profiler = nullptr;
+
+    std::array<size_t, 256> m_queueScopes;
+
+    Ogre::RenderWindow* m_renderWindow = nullptr;
+
+    Ogre::Root* m_root = nullptr;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    // Indexed by the GpuTimer's scope
+    std::vector<Scope> m_scopes;
+
+    std::array<size_t, StageCount> m_stageSlots;
+
+    std::array<Clock::time_point, StageCount> m_stageStarts;
+
+    std::array<Clock::duration, StageCount> m_stageTimes;
+
+    std::unordered_map<std::string, size_t> m_viewportScopes;
+
+    // Only timed on the GPU
+    size_t m_windowScope = 0;
 
 };
 
 
+RenderSystem*
+RenderSystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<RenderSystem>();
+}
+
+
 RenderSystem::RenderSystem()
   : m_impl(new Implementation())
 {
+    this->declareRendering();
 }
 
 
 RenderSystem::~RenderSystem() {}
 
 
+void
+RenderSystem::activate() {
+    if (m_impl->m_isListening or not m_impl->m_root) {
+        return;
+    }
+    m_impl->m_renderWindow->addListener(m_impl.get());
+    m_impl->m_sceneManager->addRenderQueueListener(m_impl.get());
+    m_impl->m_sceneManager->addListener(m_impl.get());
+    m_impl->m_isListening = true;
+}
+
+
+void
+RenderSystem::deactivate() {
+    if (not m_impl->m_isListening) {
+        return;
+    }
+    m_impl->m_renderWindow->removeListener(m_impl.get());
+    m_impl->m_sceneManager->removeRenderQueueListener(m_impl.get());
+    m_impl->m_sceneManager->removeListener(m_impl.get());
+    m_impl->m_isListening = false;
+}
+
+
 void
 RenderSystem::init(
     GameState* gameState
@@ -40,11 +382,66 @@ RenderSystem::init(
     System::init(gameState);
     m_impl->m_root = this->engine()->ogreRoot();
     assert(m_impl->m_root != nullptr && "Root object is null. Initialize the Engine first.");
+    m_impl->m_renderWindow = this->engine()->renderWindow();
+    m_impl->m_sceneManager = gameState->sceneManager();
+    SystemProfiler& profiler = gameState->systemProfiler();
+    m_impl->m_profiler = &profiler;
+    m_impl->m_stageSlots[Implementation::SceneGraph] = profiler.addScope("frame: scene graph");
+    m_impl->m_stageSlots[Implementation::Culling] = profiler.addScope("frame: culling");
+    m_impl->m_stageSlots[Implementation::Submission] = profiler.addScope("frame: submission");
+    m_impl->m_otherStageSlot = profiler.addScope("frame: other");
+    m_impl->m_stageTimes.fill(Clock::duration::zero());
+    // The window is only timed on the GPU, its CPU time is RenderSystem's
+    Implementation::Scope windowScope;
+    windowScope.cpuSlot = profiler.addScope("gpu window");
+    windowScope.gpuSlot = windowScope.cpuSlot;
+    m_impl->m_scopes.push_back(windowScope);
+    m_impl->m_windowScope = m_impl->m_scopes.size() - 1;
+    Ogre::RenderSystem* renderSystem = m_impl->m_root->getRenderSystem();
+    if (renderSystem and renderSystem->getName() == "OpenGL Rendering Subsystem") {
+        m_impl->m_gpuTimer.init();
+    }
+}
+
+
+bool
+RenderSystem::isTimingFrameStages() const {
+    return m_impl->m_isTimingStages;
+}
+
+
+bool
+RenderSystem::isTimingGpu() const {
+    return m_impl->m_isTimingGpu and m_impl->m_gpuTimer.isAvailable();
+}
+
+
+void
+RenderSystem::setTimingFrameStages(
+    bool timing
+) {
+    m_impl->m_isTimingStages = timing;
+}
+
+
+void
+RenderSystem::setTimingGpu(
+    bool timing
+) {
+    m_impl->m_isTimingGpu = timing;
 }
 
 
 void
 RenderSystem::shutdown() {
+    this->deactivate();
+    m_impl->m_gpuTimer.shutdown();
+    m_impl->m_queueScopes.fill(NO_SCOPE);
+    m_impl->m_scopes.clear();
+    m_impl->m_viewportScopes.clear();
+    m_impl->m_profiler = nullptr;
+    m_impl->m_renderWindow = nullptr;
+    m_impl->m_sceneManager = nullptr;
     m_impl->m_root = nullptr;
     System::shutdown();
 }
@@ -55,7 +452,26 @@ RenderSystem::update(
     int milliSeconds
 ) {
     assert(m_impl->m_root != nullptr && "RenderSystem not initialized");
+    Tracer::Zone zone(&this->engine()->tracer(), "renderOneFrame");
+    bool isProfiling = m_impl->m_profiler->isEnabled();
+    m_impl->m_isTimingGpuNow = isProfiling and this->isTimingGpu();
+    m_impl->m_isTimingStagesNow = isProfiling and m_impl->m_isTimingStages;
+    if (m_impl->m_isTimingGpuNow) {
+        SystemProfiler* profiler = m_impl->m_profiler;
+        const std::vector<Implementation::Scope>& scopes = m_impl->m_scopes;
+        m_impl->m_gpuTimer.beginFrame(
+            [profiler, &scopes] (size_t scope, uint32_t microseconds) {
+                profiler->record(scopes[scope].gpuSlot, microseconds);
+            }
+        );
+    }
+    auto start = Clock::now();
     m_impl->m_root->renderOneFrame(float(milliSeconds) / 1000);
+    if (m_impl->m_isTimingStagesNow) {
+        m_impl->recordStages(Clock::now() - start);
+    }
+    if (m_impl->m_isTimingGpuNow) {
+        m_impl->m_gpuTimer.endFrame();
+        m_impl->recordScopeCpuTimes();
+    }
 }
-
-
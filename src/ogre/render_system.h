@@ -7,6 +7,24 @@ namespace thrive {
 /**
 * @brief System for rendering a single frame per update
 *
+* With pipelined rendering (see GameState::Options::pipelinedRendering),
+* the frame is rendered while the next frame's ticks are simulated.
+*
+* While the game state's SystemProfiler is enabled, the render system can
+* record where the frame's time goes, next to the systems' timings:
+* - With setTimingGpu(), how long the GPU takes for the whole window
+*   ("gpu window"), each viewport ("viewport CAMERA: gpu") and each render
+*   queue group ("queue ID: gpu"), along with the CPU time the same
+*   viewports and queue groups take ("viewport CAMERA: cpu", "queue ID:
+*   cpu"). Needs the OpenGL render system, see GpuTimer. The GPU times
+*   arrive a few frames late.
+* - With setTimingFrameStages(), the CPU time renderOneFrame() spends
+*   updating the scene graph ("frame: scene graph"), culling ("frame:
+*   culling") and submitting the render queues ("frame: submission"), and
+*   the rest, mostly waiting for the buffer swap ("frame: other").
+*
+* A GPU time above the CPU time of RenderSystem itself means the frame is
+* GPU bound.
 */
 class RenderSystem : public System {
 
@@ -17,12 +35,31 @@ public:
     *
     * Exposes:
     * - RenderSystem()
+    * - RenderSystem::find
+    * - RenderSystem::isTimingFrameStages
+    * - RenderSystem::isTimingGpu
+    * - RenderSystem::setTimingFrameStages
+    * - RenderSystem::setTimingGpu
     *
     * @return 
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Finds the render system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's render system or \c nullptr if it has none
+    */
+    static RenderSystem*
+    find(
+        GameState* gameState
+    );
+
     /**
     * @brief Constructor
     */
@@ -33,6 +70,18 @@ public:
     */
     ~RenderSystem();
 
+    /**
+    * @brief Registers the profiling listeners with Ogre
+    */
+    void
+    activate() override;
+
+    /**
+    * @brief Unregisters the profiling listeners
+    */
+    void
+    deactivate() override;
+
     /**
     * @brief Initializes the system
     *
@@ -42,6 +91,45 @@ public:
         GameState* gameState
     ) override;
 
+    /**
+    * @brief Whether the CPU time of the frame stages is recorded
+    */
+    bool
+    isTimingFrameStages() const;
+
+    /**
+    * @brief Whether the GPU time of viewports and queue groups is recorded
+    *
+    * Only ever \c true if the render system supports GPU timing.
+    */
+    bool
+    isTimingGpu() const;
+
+    /**
+    * @brief Enables or disables timing the frame stages
+    *
+    * Disabled by default.
+    *
+    * @param timing
+    */
+    void
+    setTimingFrameStages(
+        bool timing
+    );
+
+    /**
+    * @brief Enables or disables timing the GPU
+    *
+    * Disabled by default. Has no effect unless the render system supports
+    * GPU timing, which is only known after init().
+    *
+    * @param timing
+    */
+    void
+    setTimingGpu(
+        bool timing
+    );
+
     /**
     * @brief Shuts down the system
     */
@@ -0,0 +1,430 @@
+#include "ogre/replication_system.h"
+
+#include "engine/component.h"
+#include "engine/component_factory.h"
+#include "engine/engine.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "engine/serialization.h"
+#include "ogre/scene_node_system.h"
+#include "ogre/spatial_index_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <OgreQuaternion.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+// Snapshots kept for a client that doesn't take them, before they are
+// dropped and the client is reset
+const size_t MAX_QUEUED_SNAPSHOTS = 64;
+
+// Extra priority of entities the client doesn't know yet
+const Ogre::Real NEW_ENTITY_PRIORITY = 1.0f;
+
+Ogre::Real
+round(
+    Ogre::Real value,
+    Ogre::Real precision
+) {
+    return std::round(value / precision) * precision;
+}
+
+
+// Rounds all floating point values, including vectors, quaternions, float
+// arrays and those of nested containers, to multiples of precision
+void
+quantize(
+    StorageContainer& storage,
+    Ogre::Real precision
+) {
+    for (const std::string& key : storage.keys()) {
+        if (storage.contains<float>(key)) {
+            storage.set<float>(key, round(storage.get<float>(key), precision));
+        }
+        else if (storage.contains<double>(key)) {
+            double value = storage.get<double>(key);
+            storage.set<double>(key, std::round(value / precision) * precision);
+        }
+        else if (storage.contains<Ogre::Vector3>(key)) {
+            Ogre::Vector3 value = storage.get<Ogre::Vector3>(key);
+            storage.set<Ogre::Vector3>(key, Ogre::Vector3(
+                round(value.x, precision),
+                round(value.y, precision),
+                round(value.z, precision)
+            ));
+        }
+        else if (storage.contains<Ogre::Quaternion>(key)) {
+            Ogre::Quaternion value = storage.get<Ogre::Quaternion>(key);
+            storage.set<Ogre::Quaternion>(key, Ogre::Quaternion(
+                round(value.w, precision),
+                round(value.x, precision),
+                round(value.y, precision),
+                round(value.z, precision)
+            ));
+        }
+        else if (storage.contains<std::vector<float>>(key)) {
+            // Like the planar positions of particles
+            std::vector<float> values = storage.get<std::vector<float>>(key);
+            for (float& value : values) {
+                value = round(value, precision);
+            }
+            storage.set(key, std::move(values));
+        }
+        else if (storage.contains<StorageContainer>(key)) {
+            StorageContainer nested = storage.get<StorageContainer>(key);
+            quantize(nested, precision);
+            storage.set<StorageContainer>(key, std::move(nested));
+        }
+    }
+}
+
+} // namespace
+
+
+luabind::scope
+ReplicationSystem::luaBindings() {
+    using namespace luabind;
+    return class_<ReplicationSystem, System>("ReplicationSystem")
+        .def(constructor<>())
+        .def("addClient", &ReplicationSystem::addClient)
+        .def("addReplicatedType", &ReplicationSystem::addReplicatedType)
+        .def("removeClient", &ReplicationSystem::removeClient)
+        .def("setBudget", &ReplicationSystem::setBudget)
+        .def("setClientFocus", &ReplicationSystem::setClientFocus)
+        .def("takeSnapshots", &ReplicationSystem::takeSnapshots)
+    ;
+}
+
+
+struct ReplicationSystem::Implementation {
+
+    // What a client knows about an entity
+    struct ReplicatedEntity {
+
+        // The quantized storage last sent, by replicated type
+        std::unordered_map<ComponentTypeId, StorageContainer> m_sent;
+
+        // The update the entity was last seen in the client's radius
+        uint32_t m_lastSeen = 0;
+
+        Ogre::Real m_priority = 0.0f;
+
+    };
+
+    struct Client {
+
+        std::unordered_map<EntityId, ReplicatedEntity> m_entities;
+
+        // The entities of the current update by priority, reused
+        std::vector<std::pair<Ogre::Real, EntityId>> m_candidates;
+
+        Ogre::Vector3 m_focus = Ogre::Vector3::ZERO;
+
+        Ogre::Real m_radius = 100.0f;
+
+        bool m_needsReset = false;
+
+        StorageList m_snapshots;
+
+    };
+
+    struct ReplicatedType {
+
+        std::string m_name;
+
+        Ogre::Real m_precision;
+
+        ComponentTypeId m_typeId = NULL_COMPONENT_TYPE;
+
+    };
+
+    Client&
+    getClient(
+        unsigned int client
+    ) {
+        auto iter = m_clients.find(client);
+        if (iter == m_clients.end()) {
+            throw std::invalid_argument("Unknown replication client");
+        }
+        return iter->second;
+    }
+
+    // Adds the changed components of an entity to updates
+    void
+    replicate(
+        EntityId entityId,
+        ReplicatedEntity& replicated,
+        StorageList& updates,
+        StorageList& removedComponents
+    ) {
+        EntityManager& entityManager = m_gameState->entityManager();
+        StorageContainer components;
+        bool hasChanges = false;
+        for (const ReplicatedType& type : m_types) {
+            auto sent = replicated.m_sent.find(type.m_typeId);
+            Component* component = entityManager.getComponent(entityId, type.m_typeId);
+            if (not component) {
+                if (sent != replicated.m_sent.end()) {
+                    StorageContainer removal;
+                    removal.set<EntityId>("entityId", entityId);
+                    removal.set<std::string>("typeName", type.m_name);
+                    removedComponents.append(std::move(removal));
+                    replicated.m_sent.erase(sent);
+                }
+                continue;
+            }
+            StorageContainer storage = component->storage();
+            if (type.m_precision > 0.0f) {
+                quantize(storage, type.m_precision);
+            }
+            StorageContainer changes;
+            if (sent == replicated.m_sent.end()) {
+                changes = storage;
+                replicated.m_sent.emplace(type.m_typeId, std::move(storage));
+            }
+            else {
+                changes = storage.difference(sent->second);
+                if (changes.keys().empty()) {
+                    continue;
+                }
+                sent->second = std::move(storage);
+            }
+            components.set<StorageContainer>(type.m_name, std::move(changes));
+            hasChanges = true;
+        }
+        if (hasChanges) {
+            StorageContainer update;
+            update.set<EntityId>("entityId", entityId);
+            update.set<StorageContainer>("components", std::move(components));
+            updates.append(std::move(update));
+        }
+    }
+
+    // Builds the snapshot of the current update for a client
+    void
+    updateClient(
+        Client& client
+    ) {
+        if (client.m_snapshots.size() >= MAX_QUEUED_SNAPSHOTS) {
+            client.m_snapshots.clear();
+            client.m_entities.clear();
+            client.m_needsReset = true;
+        }
+        EntityManager& entityManager = m_gameState->entityManager();
+        const std::vector<EntityId>& nearby = m_spatialIndex->queryRadius(
+            client.m_focus,
+            client.m_radius
+        );
+        client.m_candidates.clear();
+        for (EntityId entityId : nearby) {
+            auto sceneNode = entityManager.getComponent<OgreSceneNodeComponent>(entityId);
+            if (not sceneNode) {
+                continue;
+            }
+            auto inserted = client.m_entities.emplace(entityId, ReplicatedEntity());
+            ReplicatedEntity& replicated = inserted.first->second;
+            if (inserted.second) {
+                replicated.m_priority = NEW_ENTITY_PRIORITY;
+            }
+            replicated.m_lastSeen = m_tick;
+            Ogre::Real distance = sceneNode->m_transform.position.distance(client.m_focus);
+            // Nearby entities gain up to twice as much as those at the edge
+            replicated.m_priority += 1.0f + std::max(
+                0.0f,
+                1.0f - distance / client.m_radius
+            );
+            client.m_candidates.emplace_back(replicated.m_priority, entityId);
+        }
+        // Only the highest priority entities are checked
+        auto& candidates = client.m_candidates;
+        if (candidates.size() > m_budget) {
+            std::nth_element(
+                candidates.begin(),
+                candidates.begin() + m_budget,
+                candidates.end(),
+                [] (const std::pair<Ogre::Real, EntityId>& a, const std::pair<Ogre::Real, EntityId>& b) {
+                    return a.first > b.first;
+                }
+            );
+            candidates.resize(m_budget);
+        }
+        StorageList updates;
+        StorageList removedComponents;
+        for (const auto& candidate : candidates) {
+            ReplicatedEntity& replicated = client.m_entities[candidate.second];
+            replicated.m_priority = 0.0f;
+            this->replicate(candidate.second, replicated, updates, removedComponents);
+        }
+        // Entities that were not seen this update left the radius
+        StorageList removed;
+        for (auto iter = client.m_entities.begin(); iter != client.m_entities.end(); ) {
+            if (iter->second.m_lastSeen == m_tick) {
+                ++iter;
+                continue;
+            }
+            if (not iter->second.m_sent.empty()) {
+                StorageContainer removal;
+                removal.set<EntityId>("entityId", iter->first);
+                removed.append(std::move(removal));
+            }
+            iter = client.m_entities.erase(iter);
+        }
+        if (
+            updates.empty() and
+            removedComponents.empty() and
+            removed.empty() and
+            not client.m_needsReset
+        ) {
+            return;
+        }
+        StorageContainer snapshot;
+        snapshot.set<uint32_t>("tick", m_tick);
+        snapshot.set<bool>("reset", client.m_needsReset);
+        snapshot.set<StorageList>("updates", std::move(updates));
+        snapshot.set<StorageList>("removedComponents", std::move(removedComponents));
+        snapshot.set<StorageList>("removed", std::move(removed));
+        client.m_snapshots.append(std::move(snapshot));
+        client.m_needsReset = false;
+    }
+
+    unsigned int m_budget = 64;
+
+    std::unordered_map<unsigned int, Client> m_clients;
+
+    GameState* m_gameState = nullptr;
+
+    unsigned int m_nextClientId = 0;
+
+    SpatialIndexSystem* m_spatialIndex = nullptr;
+
+    uint32_t m_tick = 0;
+
+    std::vector<ReplicatedType> m_types;
+
+};
+
+
+ReplicationSystem::ReplicationSystem()
+  : m_impl(new Implementation())
+{
+}
+
+
+ReplicationSystem::~ReplicationSystem() {}
+
+
+unsigned int
+ReplicationSystem::addClient() {
+    unsigned int client = m_impl->m_nextClientId++;
+    m_impl->m_clients[client];
+    return client;
+}
+
+
+void
+ReplicationSystem::addReplicatedType(
+    const std::string& typeName,
+    Ogre::Real precision
+) {
+    if (precision < 0.0f) {
+        throw std::invalid_argument("Replication precision must not be negative");
+    }
+    Implementation::ReplicatedType type;
+    type.m_name = typeName;
+    type.m_precision = precision;
+    if (m_impl->m_gameState) {
+        type.m_typeId = m_impl->m_gameState->engine().componentFactory().getTypeId(typeName);
+    }
+    m_impl->m_types.push_back(std::move(type));
+}
+
+
+void
+ReplicationSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_spatialIndex = SpatialIndexSystem::find(gameState);
+    if (not m_impl->m_spatialIndex) {
+        throw std::runtime_error("ReplicationSystem needs a SpatialIndexSystem");
+    }
+    m_impl->m_gameState = gameState;
+    const ComponentFactory& factory = gameState->engine().componentFactory();
+    for (Implementation::ReplicatedType& type : m_impl->m_types) {
+        type.m_typeId = factory.getTypeId(type.m_name);
+    }
+}
+
+
+void
+ReplicationSystem::removeClient(
+    unsigned int client
+) {
+    m_impl->m_clients.erase(client);
+}
+
+
+void
+ReplicationSystem::setBudget(
+    unsigned int entitiesPerUpdate
+) {
+    if (entitiesPerUpdate == 0) {
+        throw std::invalid_argument("Replication budget must be positive");
+    }
+    m_impl->m_budget = entitiesPerUpdate;
+}
+
+
+void
+ReplicationSystem::setClientFocus(
+    unsigned int client,
+    const Ogre::Vector3& position,
+    Ogre::Real radius
+) {
+    if (not (radius > 0.0f)) {
+        throw std::invalid_argument("Replication radius must be positive");
+    }
+    Implementation::Client& state = m_impl->getClient(client);
+    state.m_focus = position;
+    state.m_radius = radius;
+}
+
+
+void
+ReplicationSystem::shutdown() {
+    // Clients have to start over with the next game state
+    for (auto& pair : m_impl->m_clients) {
+        pair.second.m_entities.clear();
+        pair.second.m_needsReset = true;
+    }
+    m_impl->m_gameState = nullptr;
+    m_impl->m_spatialIndex = nullptr;
+    System::shutdown();
+}
+
+
+StorageList
+ReplicationSystem::takeSnapshots(
+    unsigned int client
+) {
+    StorageList snapshots;
+    snapshots.swap(m_impl->getClient(client).m_snapshots);
+    return snapshots;
+}
+
+
+void
+ReplicationSystem::update(int) {
+    m_impl->m_tick += 1;
+    for (auto& pair : m_impl->m_clients) {
+        m_impl->updateClient(pair.second);
+    }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <OgreVector3.h>
+#include <string>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+class StorageList;
+
+/**
+* @brief Produces per-tick delta snapshots of the world for observer clients
+*
+* A headless host adds one client per observer, keeps its focus up to date
+* and sends the snapshots returned by takeSnapshots() over its transport.
+* The system doesn't do any networking itself.
+*
+* Each update, the system picks the replicated entities within the radius
+* of a client's focus, using the game state's SpatialIndexSystem. Each
+* entity builds up priority every update, more the nearer it is. Only the
+* highest priority entities, up to the update budget, are checked for
+* changes. So the cost and the size of a snapshot are bounded by the budget,
+* not by the size of the world.
+*
+* A checked entity sends the components of the replicated types that
+* changed since they were last sent to this client. Floating point values,
+* vectors and quaternions are first rounded to the type's precision, so
+* jitter below the precision doesn't cause updates.
+*
+* A snapshot is a StorageContainer with:
+* - \c tick: The number of the update, starting at 1
+* - \c reset: \c true if the client has to discard everything it knows,
+*   because snapshots were dropped
+* - \c updates: A StorageList with an entry per entity, with the
+*   \c entityId and a \c components container. This holds, by type name,
+*   the entries of each component's storage that changed.
+* - \c removedComponents: The \c entityId and \c typeName of replicated
+*   components that the entity lost
+* - \c removed: The \c entityId of each entity that left the client's
+*   radius or was removed
+*
+* Deltas are relative to the previous snapshot. The transport has to
+* deliver every snapshot in order.
+*/
+class ReplicationSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - ReplicationSystem()
+    * - ReplicationSystem::addClient
+    * - ReplicationSystem::addReplicatedType
+    * - ReplicationSystem::removeClient
+    * - ReplicationSystem::setBudget
+    * - ReplicationSystem::setClientFocus
+    * - ReplicationSystem::takeSnapshots
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    */
+    ReplicationSystem();
+
+    /**
+    * @brief Destructor
+    */
+    ~ReplicationSystem();
+
+    /**
+    * @brief Adds a client
+    *
+    * The client's focus starts at the origin, see setClientFocus().
+    *
+    * @return
+    *   The client's id
+    */
+    unsigned int
+    addClient();
+
+    /**
+    * @brief Replicates the components of a type
+    *
+    * @param typeName
+    *   The component type name, as registered with the ComponentFactory
+    * @param precision
+    *   Floating point values are rounded to multiples of this. Values
+    *   aren't rounded if it is \c 0.
+    */
+    void
+    addReplicatedType(
+        const std::string& typeName,
+        Ogre::Real precision
+    );
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Removes a client
+    *
+    * @param client
+    *   The id returned by addClient()
+    */
+    void
+    removeClient(
+        unsigned int client
+    );
+
+    /**
+    * @brief Sets how many entities are checked per client and update
+    *
+    * @param entitiesPerUpdate
+    *   The maximum number of entities. Must be positive.
+    */
+    void
+    setBudget(
+        unsigned int entitiesPerUpdate
+    );
+
+    /**
+    * @brief Sets the area a client is interested in
+    *
+    * @param client
+    *   The id returned by addClient()
+    * @param position
+    *   The center of the area, usually the observer's camera
+    * @param radius
+    *   Entities further away are not replicated
+    */
+    void
+    setClientFocus(
+        unsigned int client,
+        const Ogre::Vector3& position,
+        Ogre::Real radius
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Returns and forgets the snapshots produced for a client
+    *
+    * Snapshots that are not taken for a while are dropped. The next
+    * snapshot then resends everything, with \c reset set.
+    *
+    * @param client
+    *   The id returned by addClient()
+    *
+    * @return
+    *   The snapshots since the last call, oldest first
+    */
+    StorageList
+    takeSnapshots(
+        unsigned int client
+    );
+
+    /**
+    * @brief Produces a snapshot for each client
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
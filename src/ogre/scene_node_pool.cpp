@@ -0,0 +1,218 @@
+#include "ogre/scene_node_pool.h"
+
+#include "scripting/luabind.h"
+
+#include <OgreEntity.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreSubEntity.h>
+#include <OgreSubMesh.h>
+
+using namespace thrive;
+
+
+luabind::scope
+SceneNodePool::luaBindings() {
+    using namespace luabind;
+    return class_<SceneNodePool>("SceneNodePool")
+        .def("clear", &SceneNodePool::clear)
+        .def("maxEntities", &SceneNodePool::maxEntities)
+        .def("maxSceneNodes", &SceneNodePool::maxSceneNodes)
+        .def("setDefaultMaxEntities", &SceneNodePool::setDefaultMaxEntities)
+        .def("setMaxEntities", &SceneNodePool::setMaxEntities)
+        .def("setMaxSceneNodes", &SceneNodePool::setMaxSceneNodes)
+    ;
+}
+
+
+void
+SceneNodePool::clear() {
+    for (auto& entry : m_entities) {
+        this->trimEntities(entry.second, 0);
+    }
+    m_entities.clear();
+    for (Ogre::SceneNode* sceneNode : m_sceneNodes) {
+        m_sceneManager->destroySceneNode(sceneNode);
+    }
+    m_sceneNodes.clear();
+}
+
+
+size_t
+SceneNodePool::maxEntities(
+    const Ogre::String& meshName
+) const {
+    auto iter = m_maxEntities.find(meshName);
+    if (iter == m_maxEntities.end()) {
+        return m_defaultMaxEntities;
+    }
+    return iter->second;
+}
+
+
+size_t
+SceneNodePool::maxSceneNodes() const {
+    return m_maxSceneNodes;
+}
+
+
+size_t
+SceneNodePool::pooledEntities(
+    const Ogre::String& meshName
+) const {
+    auto iter = m_entities.find(meshName);
+    if (iter == m_entities.end()) {
+        return 0;
+    }
+    return iter->second.size();
+}
+
+
+size_t
+SceneNodePool::pooledSceneNodes() const {
+    return m_sceneNodes.size();
+}
+
+
+void
+SceneNodePool::releaseEntity(
+    Ogre::Entity* entity
+) {
+    if (entity->isAttached()) {
+        entity->detachFromParent();
+    }
+    const Ogre::MeshPtr& mesh = entity->getMesh();
+    std::vector<Ogre::Entity*>& entities = m_entities[mesh->getName()];
+    if (entities.size() >= this->maxEntities(mesh->getName())) {
+        m_sceneManager->destroyEntity(entity);
+        return;
+    }
+    for (unsigned int i = 0; i < entity->getNumSubEntities(); ++i) {
+        Ogre::SubEntity* subEntity = entity->getSubEntity(i);
+        const Ogre::String& materialName = mesh->getSubMesh(i)->getMaterialName();
+        if (subEntity->getMaterialName() != materialName) {
+            subEntity->setMaterialName(materialName, mesh->getGroup());
+        }
+    }
+    entity->setVisible(true);
+    entities.push_back(entity);
+}
+
+
+void
+SceneNodePool::releaseSceneNode(
+    Ogre::SceneNode* sceneNode
+) {
+    sceneNode->detachAllObjects();
+    sceneNode->removeAllChildren();
+    if (sceneNode->getParent()) {
+        sceneNode->getParent()->removeChild(sceneNode);
+    }
+    if (m_sceneNodes.size() >= m_maxSceneNodes) {
+        m_sceneManager->destroySceneNode(sceneNode);
+        return;
+    }
+    sceneNode->setOrientation(Ogre::Quaternion::IDENTITY);
+    sceneNode->setPosition(Ogre::Vector3::ZERO);
+    sceneNode->setScale(Ogre::Vector3::UNIT_SCALE);
+    m_sceneNodes.push_back(sceneNode);
+}
+
+
+void
+SceneNodePool::setDefaultMaxEntities(
+    size_t count
+) {
+    m_defaultMaxEntities = count;
+    for (auto& entry : m_entities) {
+        this->trimEntities(entry.second, this->maxEntities(entry.first));
+    }
+}
+
+
+void
+SceneNodePool::setMaxEntities(
+    const Ogre::String& meshName,
+    size_t count
+) {
+    m_maxEntities[meshName] = count;
+    auto iter = m_entities.find(meshName);
+    if (iter != m_entities.end()) {
+        this->trimEntities(iter->second, count);
+    }
+}
+
+
+void
+SceneNodePool::setMaxSceneNodes(
+    size_t count
+) {
+    m_maxSceneNodes = count;
+    while (m_sceneNodes.size() > count) {
+        m_sceneManager->destroySceneNode(m_sceneNodes.back());
+        m_sceneNodes.pop_back();
+    }
+}
+
+
+void
+SceneNodePool::setSceneManager(
+    Ogre::SceneManager* sceneManager
+) {
+    this->clear();
+    m_sceneManager = sceneManager;
+}
+
+
+Ogre::Entity*
+SceneNodePool::takeEntity(
+    const Ogre::MeshPtr& mesh
+) {
+    auto iter = m_entities.find(mesh->getName());
+    if (iter == m_entities.end() or iter->second.empty()) {
+        return m_sceneManager->createEntity(mesh);
+    }
+    Ogre::Entity* entity = iter->second.back();
+    iter->second.pop_back();
+    return entity;
+}
+
+
+Ogre::Entity*
+SceneNodePool::takeEntity(
+    const Ogre::String& meshName
+) {
+    auto iter = m_entities.find(meshName);
+    if (iter == m_entities.end() or iter->second.empty()) {
+        return m_sceneManager->createEntity(meshName);
+    }
+    Ogre::Entity* entity = iter->second.back();
+    iter->second.pop_back();
+    return entity;
+}
+
+
+Ogre::SceneNode*
+SceneNodePool::takeSceneNode(
+    Ogre::SceneNode* parent
+) {
+    if (m_sceneNodes.empty()) {
+        return parent->createChildSceneNode();
+    }
+    Ogre::SceneNode* sceneNode = m_sceneNodes.back();
+    m_sceneNodes.pop_back();
+    parent->addChild(sceneNode);
+    return sceneNode;
+}
+
+
+void
+SceneNodePool::trimEntities(
+    std::vector<Ogre::Entity*>& entities,
+    size_t count
+) {
+    while (entities.size() > count) {
+        m_sceneManager->destroyEntity(entities.back());
+        entities.pop_back();
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <OgreMesh.h>
+#include <OgreString.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace Ogre {
+class Entity;
+class SceneManager;
+class SceneNode;
+}
+
+namespace thrive {
+
+/**
+* @brief Recycles scene nodes and Ogre entities
+*
+* Creating and destroying scene nodes and entities is expensive in Ogre,
+* and spawning or despawning entities does a lot of both. The pool keeps
+* released scene nodes and entities detached from the scene, so the next
+* take doesn't have to create them. Entities are pooled by mesh name, as
+* only entities of the same mesh can stand in for each other.
+*
+* Each mesh keeps at most maxEntities() of its entities, and the pool
+* keeps at most maxSceneNodes() scene nodes. Whatever is released beyond
+* that is destroyed. Whatever is still pooled when the scene manager goes
+* away is destroyed with it.
+*
+* The OgreRemoveSceneNodeSystem owns the pool of a game state, see
+* OgreRemoveSceneNodeSystem::sceneNodePool().
+*/
+class SceneNodePool {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SceneNodePool::clear
+    * - SceneNodePool::maxEntities
+    * - SceneNodePool::maxSceneNodes
+    * - SceneNodePool::setDefaultMaxEntities
+    * - SceneNodePool::setMaxEntities
+    * - SceneNodePool::setMaxSceneNodes
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Entities kept per mesh unless set otherwise
+    */
+    static const size_t DEFAULT_MAX_ENTITIES = 64;
+
+    /**
+    * @brief Scene nodes kept unless set otherwise
+    */
+    static const size_t DEFAULT_MAX_SCENE_NODES = 1024;
+
+    /**
+    * @brief Destroys all pooled scene nodes and entities
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of entities kept for a mesh
+    *
+    * @param meshName
+    */
+    size_t
+    maxEntities(
+        const Ogre::String& meshName
+    ) const;
+
+    /**
+    * @brief The number of scene nodes kept
+    */
+    size_t
+    maxSceneNodes() const;
+
+    /**
+    * @brief The number of pooled entities of a mesh
+    *
+    * @param meshName
+    */
+    size_t
+    pooledEntities(
+        const Ogre::String& meshName
+    ) const;
+
+    /**
+    * @brief The number of pooled scene nodes
+    */
+    size_t
+    pooledSceneNodes() const;
+
+    /**
+    * @brief Returns an entity to the pool
+    *
+    * Detaches the entity and restores the materials of its mesh, which
+    * other systems or scripts may have replaced.
+    *
+    * @param entity
+    *   The entity, created by the pool's scene manager
+    */
+    void
+    releaseEntity(
+        Ogre::Entity* entity
+    );
+
+    /**
+    * @brief Returns a scene node to the pool
+    *
+    * Detaches the scene node from its parent, its children and attached
+    * objects, just like destroying it would. Attached entities are not
+    * pooled by this, release them with releaseEntity().
+    *
+    * @param sceneNode
+    *   The scene node, created by the pool's scene manager
+    */
+    void
+    releaseSceneNode(
+        Ogre::SceneNode* sceneNode
+    );
+
+    /**
+    * @brief Sets the number of entities kept for meshes without their own
+    *
+    * @param count
+    */
+    void
+    setDefaultMaxEntities(
+        size_t count
+    );
+
+    /**
+    * @brief Sets the number of entities kept for a mesh
+    *
+    * Surplus entities already in the pool are destroyed.
+    *
+    * @param meshName
+    * @param count
+    */
+    void
+    setMaxEntities(
+        const Ogre::String& meshName,
+        size_t count
+    );
+
+    /**
+    * @brief Sets the number of scene nodes kept
+    *
+    * Surplus scene nodes already in the pool are destroyed.
+    *
+    * @param count
+    */
+    void
+    setMaxSceneNodes(
+        size_t count
+    );
+
+    /**
+    * @brief Sets the scene manager that creates and destroys
+    *
+    * Clears the pool first.
+    *
+    * @param sceneManager
+    */
+    void
+    setSceneManager(
+        Ogre::SceneManager* sceneManager
+    );
+
+    /**
+    * @brief Takes a pooled or new entity of a mesh
+    *
+    * @param mesh
+    *
+    * @return
+    *   A visible, detached entity
+    */
+    Ogre::Entity*
+    takeEntity(
+        const Ogre::MeshPtr& mesh
+    );
+
+    /**
+    * @brief Takes a pooled or new entity of a mesh
+    *
+    * @param meshName
+    *   The name of the mesh, loaded by the scene manager if necessary
+    *
+    * @return
+    *   A visible, detached entity
+    */
+    Ogre::Entity*
+    takeEntity(
+        const Ogre::String& meshName
+    );
+
+    /**
+    * @brief Takes a pooled or new scene node
+    *
+    * @param parent
+    *   The parent to attach the scene node to
+    *
+    * @return
+    *   A scene node with the identity transform and nothing attached
+    */
+    Ogre::SceneNode*
+    takeSceneNode(
+        Ogre::SceneNode* parent
+    );
+
+private:
+
+    // Destroys pooled entities of a mesh beyond count
+    void
+    trimEntities(
+        std::vector<Ogre::Entity*>& entities,
+        size_t count
+    );
+
+    size_t m_defaultMaxEntities = DEFAULT_MAX_ENTITIES;
+
+    std::unordered_map<Ogre::String, std::vector<Ogre::Entity*>> m_entities;
+
+    std::unordered_map<Ogre::String, size_t> m_maxEntities;
+
+    size_t m_maxSceneNodes = DEFAULT_MAX_SCENE_NODES;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::vector<Ogre::SceneNode*> m_sceneNodes;
+
+};
+
+}
@@ -1,24 +1,35 @@
 #include "ogre/scene_node_system.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/entity.h"
 #include "engine/entity_filter.h"
 #include "engine/entity_manager.h"
 #include "engine/game_state.h"
 #include "engine/serialization.h"
+#include "engine/state_hash.h"
+#include "scripting/lua_include.h"
 #include "scripting/luabind.h"
+#include "util/half_float.h"
 
+#include <algorithm>
 #include <OgreSceneManager.h>
 #include <OgreEntity.h>
+#include <unordered_set>
 
 using namespace thrive;
 
+static_assert(
+    sizeof(Ogre::Vector3) == 3 * sizeof(float),
+    "Scripts view vectors as three floats"
+);
+
 
 static Ogre::String
 OgreSceneNodeComponent_getMeshName(
     const OgreSceneNodeComponent* self
 ) {
-    return self->m_meshName.get();
+    return self->m_configuration->meshName.get();
 }
 
 
@@ -27,7 +38,7 @@ OgreSceneNodeComponent_setMeshName(
     OgreSceneNodeComponent* self,
     const Ogre::String& meshName
 ) {
-    self->m_meshName = meshName;
+    self->m_configuration->meshName = meshName;
 }
 
 
@@ -35,7 +46,7 @@ static Entity
 OgreSceneNodeComponent_getParent(
     const OgreSceneNodeComponent* self
 ) {
-    return Entity(self->m_parentId.get());
+    return Entity(self->m_configuration->parentId.get());
 }
 
 
@@ -44,8 +55,34 @@ OgreSceneNodeComponent_setParent(
     OgreSceneNodeComponent* self,
     const Entity& entity
 ) {
-    self->m_parentId = entity.id();
-    self->m_parentId.touch();
+    self->m_configuration->parentId = entity.id();
+    self->m_configuration->parentId.touch();
+}
+
+
+static bool
+OgreSceneNodeComponent_getVisible(
+    const OgreSceneNodeComponent* self
+) {
+    return self->m_visible.get();
+}
+
+
+static luabind::object
+OgreSceneNodeComponent_positionData(
+    const OgreSceneNodeComponent* self,
+    lua_State* L
+) {
+    return lightUserdata(L, self->m_transform.position.ptr());
+}
+
+
+static void
+OgreSceneNodeComponent_setVisible(
+    OgreSceneNodeComponent* self,
+    bool visible
+) {
+    self->m_visible = visible;
 }
 
 
@@ -56,6 +93,11 @@ OgreSceneNodeComponent::luaBindings() {
         .enum_("ID") [
             value("TYPE_ID", OgreSceneNodeComponent::TYPE_ID)
         ]
+        .enum_("StagedField") [
+            value("ORIENTATION_FIELD", OgreSceneNodeComponent::ORIENTATION_FIELD),
+            value("POSITION_FIELD", OgreSceneNodeComponent::POSITION_FIELD),
+            value("SCALE_FIELD", OgreSceneNodeComponent::SCALE_FIELD)
+        ]
         .scope [
             def("TYPE_NAME", &OgreSceneNodeComponent::TYPE_NAME),
             class_<Transform, Touchable>("Transform")
@@ -66,38 +108,180 @@ OgreSceneNodeComponent::luaBindings() {
         .def(constructor<>())
         .def_readonly("transform", &OgreSceneNodeComponent::m_transform)
         .def_readonly("entity", &OgreSceneNodeComponent::m_entity)
+        .def_readonly("onScreen", &OgreSceneNodeComponent::m_isOnScreen)
+        .def_readwrite("isParticle", &OgreSceneNodeComponent::m_isParticle)
+        .def_readwrite("isStatic", &OgreSceneNodeComponent::m_isStatic)
         .property("parent", OgreSceneNodeComponent_getParent, OgreSceneNodeComponent_setParent)
         .property("meshName", OgreSceneNodeComponent_getMeshName, OgreSceneNodeComponent_setMeshName)
+        .property("visible", OgreSceneNodeComponent_getVisible, OgreSceneNodeComponent_setVisible)
+        .def("positionData", OgreSceneNodeComponent_positionData)
     ;
 }
 
 
+OgreSceneNodeComponent::OgreSceneNodeComponent() {
+    m_configuration->meshName.setComponent(this);
+    m_configuration->parentId.setComponent(this);
+    m_transform.setComponent(this);
+    m_visible.setComponent(this);
+}
+
+
+namespace {
+
+const StorageKey MESH_NAME_KEY("meshName");
+const StorageKey ORIENTATION_KEY("orientation");
+const StorageKey PARENT_ID_KEY("parentId");
+// Particles that left the plane, turned or were scaled non-uniformly
+const StorageKey PARTICLE_KEY("particle");
+// Position in the x/y plane and half precision uniform scale of particles
+const StorageKey PARTICLE_POSITION_KEY("particlePosition");
+const StorageKey PARTICLE_SCALE_KEY("particleScale");
+const StorageKey POSITION_KEY("position");
+const StorageKey SCALE_KEY("scale");
+const StorageKey STATIC_KEY("static");
+const StorageKey VISIBLE_KEY("visible");
+
+}
+
+
+void
+OgreSceneNodeComponent::digest(
+    StateDigest& digest
+) const {
+    digest.add(m_transform.orientation)
+        .add(m_transform.position)
+        .add(m_transform.scale);
+}
+
+
 void
 OgreSceneNodeComponent::load(
     const StorageContainer& storage
 ) {
     Component::load(storage);
-    m_transform.orientation = storage.get<Ogre::Quaternion>("orientation", Ogre::Quaternion::IDENTITY);
-    m_transform.position = storage.get<Ogre::Vector3>("position", Ogre::Vector3(0,0,0));
-    m_transform.scale = storage.get<Ogre::Vector3>("scale", Ogre::Vector3(1,1,1));
-    m_meshName = storage.get<Ogre::String>("meshName");
-    m_parentId = storage.get<EntityId>("parentId", NULL_ENTITY);
+    bool isPlanar = storage.contains<std::vector<float>>(PARTICLE_POSITION_KEY);
+    m_isParticle = isPlanar or storage.get<bool>(PARTICLE_KEY, false);
+    if (isPlanar) {
+        auto position = storage.get<std::vector<float>>(PARTICLE_POSITION_KEY);
+        position.resize(2, 0.0f);
+        m_transform.orientation = Ogre::Quaternion::IDENTITY;
+        m_transform.position = Ogre::Vector3(position[0], position[1], 0);
+        m_transform.scale = Ogre::Vector3(floatFromHalf(
+            storage.get<uint16_t>(PARTICLE_SCALE_KEY, halfFromFloat(1.0f))
+        ));
+    }
+    else {
+        m_transform.orientation = storage.get<Ogre::Quaternion>(ORIENTATION_KEY, Ogre::Quaternion::IDENTITY);
+        m_transform.position = storage.get<Ogre::Vector3>(POSITION_KEY, Ogre::Vector3(0,0,0));
+        m_transform.scale = storage.get<Ogre::Vector3>(SCALE_KEY, Ogre::Vector3(1,1,1));
+    }
+    m_configuration->meshName = storage.get<Ogre::String>(MESH_NAME_KEY);
+    m_configuration->parentId = storage.get<EntityId>(PARENT_ID_KEY, NULL_ENTITY);
+    m_visible = storage.get<bool>(VISIBLE_KEY, true);
+    m_isStatic = storage.get<bool>(STATIC_KEY, false);
 }
 
 
 StorageContainer
 OgreSceneNodeComponent::storage() const {
     StorageContainer storage = Component::storage();
-    storage.set<Ogre::Quaternion>("orientation", m_transform.orientation);
-    storage.set<Ogre::Vector3>("position", m_transform.position);
-    storage.set<Ogre::Vector3>("scale", m_transform.scale);
-    storage.set<Ogre::String>("meshName", m_meshName);
-    storage.set<EntityId>("parentId", m_parentId);
+    const Ogre::Vector3& scale = m_transform.scale;
+    bool isPlanar = m_isParticle and
+        m_transform.position.z == 0.0f and
+        m_transform.orientation == Ogre::Quaternion::IDENTITY and
+        scale.x == scale.y and scale.x == scale.z;
+    if (isPlanar) {
+        storage.set(
+            PARTICLE_POSITION_KEY,
+            std::vector<float>{m_transform.position.x, m_transform.position.y}
+        );
+        storage.set<uint16_t>(PARTICLE_SCALE_KEY, halfFromFloat(m_transform.scale.x));
+    }
+    else {
+        storage.set<Ogre::Quaternion>(ORIENTATION_KEY, m_transform.orientation);
+        storage.set<Ogre::Vector3>(POSITION_KEY, m_transform.position);
+        storage.set<Ogre::Vector3>(SCALE_KEY, m_transform.scale);
+        if (m_isParticle) {
+            storage.set<bool>(PARTICLE_KEY, true);
+        }
+    }
+    storage.set<Ogre::String>(MESH_NAME_KEY, m_configuration->meshName);
+    storage.set<EntityId>(PARENT_ID_KEY, m_configuration->parentId);
+    storage.set<bool>(VISIBLE_KEY, m_visible);
+    storage.set<bool>(STATIC_KEY, m_isStatic);
     return storage;
 }
 
 REGISTER_COMPONENT(OgreSceneNodeComponent)
 
+const StagedWrites::FieldId OgreSceneNodeComponent::ORIENTATION_FIELD =
+    StagedWrites::registerField<OgreSceneNodeComponent, Ogre::Quaternion>(
+        "OgreSceneNode.orientation",
+        [] (OgreSceneNodeComponent& component, const Ogre::Quaternion& value) -> Touchable& {
+            component.m_transform.orientation = value;
+            return component.m_transform;
+        }
+    );
+
+const StagedWrites::FieldId OgreSceneNodeComponent::POSITION_FIELD =
+    StagedWrites::registerField<OgreSceneNodeComponent, Ogre::Vector3>(
+        "OgreSceneNode.position",
+        [] (OgreSceneNodeComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_transform.position = value;
+            return component.m_transform;
+        }
+    );
+
+const StagedWrites::FieldId OgreSceneNodeComponent::SCALE_FIELD =
+    StagedWrites::registerField<OgreSceneNodeComponent, Ogre::Vector3>(
+        "OgreSceneNode.scale",
+        [] (OgreSceneNodeComponent& component, const Ogre::Vector3& value) -> Touchable& {
+            component.m_transform.scale = value;
+            return component.m_transform;
+        }
+    );
+
+static const bool isSceneNodeDoubleBuffered =
+    DoubleBuffers::registerComponent<OgreSceneNodeComponent>(
+        [] (OgreSceneNodeComponent& component) {
+            component.m_lastFrameTransform.flip(component.m_transform);
+        }
+    );
+
+
+// Returns the scene node to attach a child of parentId to, or null if the
+// parent doesn't have one yet
+static Ogre::SceneNode*
+parentSceneNode(
+    EntityManager& entityManager,
+    Ogre::SceneManager* sceneManager,
+    EntityId parentId
+) {
+    if (parentId == NULL_ENTITY) {
+        return sceneManager->getRootSceneNode();
+    }
+    auto parentComponent = entityManager.getComponent<OgreSceneNodeComponent>(parentId);
+    if (parentComponent) {
+        return parentComponent->m_sceneNode;
+    }
+    return nullptr;
+}
+
+
+static void
+reparentSceneNode(
+    Ogre::SceneNode* sceneNode,
+    Ogre::SceneNode* newParentNode
+) {
+    Ogre::SceneNode* currentParentNode = sceneNode->getParentSceneNode();
+    if (currentParentNode != newParentNode) {
+        currentParentNode->removeChild(sceneNode);
+        newParentNode->addChild(sceneNode);
+    }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // OgreAddSceneNodeSystem
 ////////////////////////////////////////////////////////////////////////////////
@@ -113,15 +297,22 @@ OgreAddSceneNodeSystem::luaBindings() {
 
 struct OgreAddSceneNodeSystem::Implementation {
 
-    Ogre::SceneManager* m_sceneManager = nullptr;
+    // Scratch list for update(), with the hierarchy depth of each entry
+    std::vector<std::pair<unsigned int, OgreSceneNodeComponent*>> m_added;
 
     EntityFilter<OgreSceneNodeComponent> m_entities = {true};
+
+    // Of the OgreRemoveSceneNodeSystem, if there is one
+    SceneNodePool* m_pool = nullptr;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
 };
 
 
 OgreAddSceneNodeSystem::OgreAddSceneNodeSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
@@ -136,12 +327,15 @@ OgreAddSceneNodeSystem::init(
     assert(m_impl->m_sceneManager == nullptr && "Double init of system");
     m_impl->m_sceneManager = gameState->sceneManager();
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    auto removeSystem = gameState->findSystem<OgreRemoveSceneNodeSystem>();
+    m_impl->m_pool = removeSystem ? &removeSystem->sceneNodePool() : nullptr;
 }
 
 
 void
 OgreAddSceneNodeSystem::shutdown() {
     m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_pool = nullptr;
     m_impl->m_sceneManager = nullptr;
     System::shutdown();
 }
@@ -149,31 +343,60 @@ OgreAddSceneNodeSystem::shutdown() {
 
 void
 OgreAddSceneNodeSystem::update(int) {
-    auto& added = m_impl->m_entities.addedEntities();
+    EntityManager& entityManager = *this->entityManager();
+    auto& added = m_impl->m_added;
+    m_impl->m_entities.takeChanges(
+        [&entityManager, &added] (EntityId entityId, const std::tuple<OgreSceneNodeComponent*>& group) {
+            OgreSceneNodeComponent* component = std::get<0>(group);
+            if (not entityManager.setParent(entityId, component->m_configuration->parentId)) {
+                entityManager.setParent(entityId, NULL_ENTITY);
+            }
+            added.emplace_back(0, component);
+        },
+        [] (EntityId) {}
+    );
+    // Parents first
+    for (auto& entry : added) {
+        entry.first = entityManager.hierarchyDepth(entry.second->owner());
+    }
+    std::stable_sort(
+        added.begin(),
+        added.end(),
+        [] (
+            const std::pair<unsigned int, OgreSceneNodeComponent*>& lhs,
+            const std::pair<unsigned int, OgreSceneNodeComponent*>& rhs
+        ) {
+            return lhs.first < rhs.first;
+        }
+    );
     for (const auto& entry : added) {
-        OgreSceneNodeComponent* component = std::get<0>(entry.second);
-        Ogre::SceneNode* parentNode = nullptr;
-        EntityId parentId = component->m_parentId;
-        if (parentId == NULL_ENTITY) {
+        OgreSceneNodeComponent* component = entry.second;
+        EntityId entityId = component->owner();
+        Ogre::SceneNode* parentNode = parentSceneNode(
+            entityManager,
+            m_impl->m_sceneManager,
+            entityManager.parent(entityId)
+        );
+        if (not parentNode) {
+            // Attached to the parent once its scene node is created
             parentNode = m_impl->m_sceneManager->getRootSceneNode();
-            component->m_parentId.untouch();
         }
-        else {
-            auto parentComponent = this->entityManager()->getComponent<OgreSceneNodeComponent>(parentId);
-            if (parentComponent and parentComponent->m_sceneNode) {
-                parentNode = parentComponent->m_sceneNode;
-                component->m_parentId.untouch();
-            }
-            else {
-                parentNode = m_impl->m_sceneManager->getRootSceneNode();
-                // Mark component for later reparenting
-                component->m_parentId.touch();
+        component->m_configuration->parentId.untouch();
+        Ogre::SceneNode* node = m_impl->m_pool ?
+            m_impl->m_pool->takeSceneNode(parentNode) :
+            parentNode->createChildSceneNode();
+        component->m_sceneNode = node;
+        // Adopt children that were waiting for this scene node
+        for (EntityId childId : entityManager.children(entityId)) {
+            auto child = entityManager.getComponent<OgreSceneNodeComponent>(childId);
+            if (child and child->m_sceneNode) {
+                reparentSceneNode(child->m_sceneNode, node);
             }
         }
-        Ogre::SceneNode* node = parentNode->createChildSceneNode();
-        component->m_sceneNode = node;
+        // Have the OgreUpdateSceneNodeSystem apply its properties
+        component->touched();
     }
-    m_impl->m_entities.clearChanges();
+    added.clear();
 }
 
 
@@ -186,25 +409,34 @@ OgreRemoveSceneNodeSystem::luaBindings() {
     using namespace luabind;
     return class_<OgreRemoveSceneNodeSystem, System>("OgreRemoveSceneNodeSystem")
         .def(constructor<>())
+        .def("sceneNodePool", &OgreRemoveSceneNodeSystem::sceneNodePool)
     ;
 }
 
 
 struct OgreRemoveSceneNodeSystem::Implementation {
 
-    std::unordered_map<EntityId, Ogre::Entity*> m_ogreEntities;
+    std::vector<ComponentCollection::Change> m_changes;
 
-    Ogre::SceneManager* m_sceneManager = nullptr;
+    ComponentCollection* m_collection = nullptr;
 
-    std::unordered_map<EntityId, Ogre::SceneNode*> m_sceneNodes;
+    unsigned int m_observer = 0;
 
-    EntityFilter<OgreSceneNodeComponent> m_entities = {true};
+    // Taken from removed components, released in update()
+    std::vector<Ogre::Entity*> m_ogreEntities;
+
+    SceneNodePool m_pool;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::vector<Ogre::SceneNode*> m_sceneNodes;
 };
 
 
 OgreRemoveSceneNodeSystem::OgreRemoveSceneNodeSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
@@ -218,13 +450,26 @@ OgreRemoveSceneNodeSystem::init(
     System::init(gameState);
     assert(m_impl->m_sceneManager == nullptr && "Double init of system");
     m_impl->m_sceneManager = gameState->sceneManager();
-    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_pool.setSceneManager(m_impl->m_sceneManager);
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        OgreSceneNodeComponent::TYPE_ID
+    );
+    m_impl->m_observer = m_impl->m_collection->registerObserver();
+}
+
+
+SceneNodePool&
+OgreRemoveSceneNodeSystem::sceneNodePool() {
+    return m_impl->m_pool;
 }
 
 
 void
 OgreRemoveSceneNodeSystem::shutdown() {
-    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_collection->unregisterObserver(m_impl->m_observer);
+    m_impl->m_changes.clear();
+    m_impl->m_collection = nullptr;
+    m_impl->m_pool.setSceneManager(nullptr);
     m_impl->m_sceneManager = nullptr;
     System::shutdown();
 }
@@ -232,28 +477,29 @@ OgreRemoveSceneNodeSystem::shutdown() {
 
 void
 OgreRemoveSceneNodeSystem::update(int) {
-    for (EntityId entityId : m_impl->m_entities.removedEntities()) {
-        // Scene node
-        Ogre::SceneNode* node = m_impl->m_sceneNodes[entityId];
-        if (node) {
-            node->detachAllObjects();
-            m_impl->m_sceneManager->destroySceneNode(node);
+    m_impl->m_collection->takeChanges(m_impl->m_observer, m_impl->m_changes);
+    for (const ComponentCollection::Change& change : m_impl->m_changes) {
+        if (change.isAdded) {
+            continue;
         }
-        m_impl->m_sceneNodes.erase(entityId);
-        // Ogre Entity
-        Ogre::Entity* entity = m_impl->m_ogreEntities[entityId];
-        if (entity) {
-            m_impl->m_sceneManager->destroyEntity(entity);
+        // The scene node and mesh may have changed since the component
+        // was added, e.g. by streaming, so take them now
+        auto component = static_cast<OgreSceneNodeComponent*>(change.component);
+        if (component->m_sceneNode) {
+            m_impl->m_sceneNodes.push_back(component->m_sceneNode);
         }
-        m_impl->m_ogreEntities.erase(entityId);
+        if (component->m_entity) {
+            m_impl->m_ogreEntities.push_back(component->m_entity);
+        }
+    }
+    for (Ogre::SceneNode* node : m_impl->m_sceneNodes) {
+        m_impl->m_pool.releaseSceneNode(node);
     }
-    for (auto& value : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = value.first;
-        OgreSceneNodeComponent* sceneNodeComponent = std::get<0>(value.second);
-        m_impl->m_ogreEntities[entityId] = sceneNodeComponent->m_entity;
-        m_impl->m_sceneNodes[entityId] = sceneNodeComponent->m_sceneNode;
+    m_impl->m_sceneNodes.clear();
+    for (Ogre::Entity* entity : m_impl->m_ogreEntities) {
+        m_impl->m_pool.releaseEntity(entity);
     }
-    m_impl->m_entities.clearChanges();
+    m_impl->m_ogreEntities.clear();
 }
 
 
@@ -272,18 +518,136 @@ OgreUpdateSceneNodeSystem::luaBindings() {
 
 struct OgreUpdateSceneNodeSystem::Implementation {
 
-    EntityFilter<
-        OgreSceneNodeComponent
-    > m_entities;
+    void
+    applyInterpolation(
+        OgreSceneNodeComponent* component,
+        float interpolation
+    ) {
+        Ogre::SceneNode* sceneNode = component->m_sceneNode;
+        auto& transform = component->m_transform;
+        sceneNode->setOrientation(Ogre::Quaternion::nlerp(
+            interpolation,
+            component->m_previousOrientation,
+            transform.orientation,
+            true
+        ));
+        sceneNode->setPosition(
+            component->m_previousPosition + 
+            (transform.position - component->m_previousPosition) * interpolation
+        );
+        sceneNode->setScale(
+            transform.scale
+        );
+        transform.untouch();
+    }
+
+    void
+    applyChanges(
+        OgreSceneNodeComponent* component,
+        EntityManager* entityManager
+    ) {
+        Ogre::SceneNode* sceneNode = component->m_sceneNode;
+        auto& transform = component->m_transform;
+        // Blending of buffered transforms is applied afterwards
+        if (transform.hasChanges() and not component->m_isInterpolated) {
+            sceneNode->setOrientation(
+                transform.orientation
+            );
+            sceneNode->setPosition(
+                transform.position
+            );
+            sceneNode->setScale(
+                transform.scale
+            );
+            transform.untouch();
+        }
+        if (component->m_configuration->parentId.hasChanges()) {
+            EntityId entityId = component->owner();
+            if (not entityManager->setParent(entityId, component->m_configuration->parentId)) {
+                // Stale parent or a cycle
+                entityManager->setParent(entityId, NULL_ENTITY);
+            }
+            Ogre::SceneNode* newParentNode = parentSceneNode(
+                *entityManager,
+                m_sceneManager,
+                entityManager->parent(entityId)
+            );
+            if (not newParentNode) {
+                // The OgreAddSceneNodeSystem attaches it once the parent's
+                // scene node exists
+                newParentNode = m_sceneManager->getRootSceneNode();
+            }
+            reparentSceneNode(sceneNode, newParentNode);
+            component->m_configuration->parentId.untouch();
+        }
+        if (component->m_configuration->meshName.hasChanges()) {
+            if (component->m_entity) {
+                sceneNode->detachObject(component->m_entity);
+                this->releaseEntity(component->m_entity);
+                component->m_entity = nullptr;
+            }
+            const Ogre::MeshPtr& mesh = component->m_configuration->mesh;
+            if (not mesh.isNull() and mesh->getName() == component->m_configuration->meshName.get()) {
+                component->m_entity = m_pool ?
+                    m_pool->takeEntity(mesh) :
+                    m_sceneManager->createEntity(mesh);
+            }
+            else if (component->m_configuration->meshName.get().size() > 0) {
+                const Ogre::String& meshName = component->m_configuration->meshName.get();
+                component->m_entity = m_pool ?
+                    m_pool->takeEntity(meshName) :
+                    m_sceneManager->createEntity(meshName);
+            }
+            if (component->m_entity) {
+                component->m_entity->setVisible(component->m_visible);
+                sceneNode->attachObject(component->m_entity);
+                component->m_entityRevision += 1;
+            }
+            component->m_configuration->meshName.untouch();
+        }
+        if (component->m_visible.hasChanges()) {
+            sceneNode->setVisible(component->m_visible);
+            component->m_visible.untouch();
+        }
+    }
+
+    void
+    releaseEntity(
+        Ogre::Entity* entity
+    ) {
+        if (m_pool) {
+            m_pool->releaseEntity(entity);
+        }
+        else {
+            m_sceneManager->destroyEntity(entity);
+        }
+    }
+
+    std::vector<ComponentCollection::Change> m_changes;
+
+    ComponentCollection* m_collection = nullptr;
+
+    // Interpolated scene nodes move every frame, even without a touch
+    std::unordered_set<EntityId> m_interpolated;
+
+    unsigned int m_observer = 0;
+
+    // Of the OgreRemoveSceneNodeSystem, if there is one
+    SceneNodePool* m_pool = nullptr;
 
     Ogre::SceneManager* m_sceneManager = nullptr;
 
+    std::vector<Component*> m_touched;
+
+    TransformBuffer m_transformBuffer;
+
 };
 
 
 OgreUpdateSceneNodeSystem::OgreUpdateSceneNodeSystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
@@ -296,76 +660,77 @@ OgreUpdateSceneNodeSystem::init(
 ) {
     System::init(gameState);
     m_impl->m_sceneManager = gameState->sceneManager();
-    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        OgreSceneNodeComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
+    m_impl->m_observer = m_impl->m_collection->registerObserver();
+    auto removeSystem = gameState->findSystem<OgreRemoveSceneNodeSystem>();
+    m_impl->m_pool = removeSystem ? &removeSystem->sceneNodePool() : nullptr;
 }
 
 
 void
 OgreUpdateSceneNodeSystem::shutdown() {
-    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_collection->unregisterObserver(m_impl->m_observer);
+    m_impl->m_changes.clear();
+    m_impl->m_transformBuffer.clear();
+    m_impl->m_collection = nullptr;
+    m_impl->m_interpolated.clear();
+    m_impl->m_pool = nullptr;
     m_impl->m_sceneManager = nullptr;
     System::shutdown();
 }
 
 
+TransformBuffer&
+OgreUpdateSceneNodeSystem::transformBuffer() {
+    return m_impl->m_transformBuffer;
+}
+
+
 void
 OgreUpdateSceneNodeSystem::update(int) {
-    for (const auto& entry : m_impl->m_entities) {
-        OgreSceneNodeComponent* component = std::get<0>(entry.second);
-        Ogre::SceneNode* sceneNode = component->m_sceneNode;
-        auto& transform = component->m_transform;
-        if (transform.hasChanges()) {
-            sceneNode->setOrientation(
-                transform.orientation
-            );
-            sceneNode->setPosition(
-                transform.position
-            );
-            sceneNode->setScale(
-                transform.scale
-            );
-            transform.untouch();
+    this->entityManager()->stagedWrites().flush(
+        *this->entityManager(),
+        OgreSceneNodeComponent::TYPE_ID
+    );
+    // Free the slots of removed components before the buffer is applied
+    m_impl->m_collection->takeChanges(m_impl->m_observer, m_impl->m_changes);
+    for (const ComponentCollection::Change& change : m_impl->m_changes) {
+        size_t slot = static_cast<OgreSceneNodeComponent*>(change.component)->m_transformSlot;
+        if (not change.isAdded and slot != TransformBuffer::NO_SLOT) {
+            m_impl->m_transformBuffer.remove(slot);
         }
-        if (component->m_parentId.hasChanges()) {
-            EntityId parentId = component->m_parentId;
-            Ogre::SceneNode* newParentNode = nullptr;
-            if (parentId == NULL_ENTITY) {
-                newParentNode = m_impl->m_sceneManager->getRootSceneNode();
-                component->m_parentId.untouch();
-            }
-            else {
-                auto parentComponent = this->entityManager()->getComponent<OgreSceneNodeComponent>(
-                    parentId
-                );
-                if (parentComponent and parentComponent->m_sceneNode) {
-                    newParentNode = parentComponent->m_sceneNode;
-                    component->m_parentId.untouch();
-                }
-                else {
-                    newParentNode = m_impl->m_sceneManager->getRootSceneNode();
-                    // Mark component for later reparenting
-                    component->m_parentId.touch();
-                }
-            }
-            Ogre::SceneNode* currentParentNode = sceneNode->getParentSceneNode();
-            currentParentNode->removeChild(sceneNode);
-            newParentNode->addChild(sceneNode);
+    }
+    float interpolation = this->gameState()->tickInterpolation();
+    for (auto iter = m_impl->m_interpolated.begin(); iter != m_impl->m_interpolated.end(); ) {
+        auto component = static_cast<OgreSceneNodeComponent*>(
+            m_impl->m_collection->get(*iter)
+        );
+        if (component and component->m_sceneNode and component->m_isInterpolated) {
+            m_impl->applyInterpolation(component, interpolation);
+            ++iter;
         }
-        if (component->m_meshName.hasChanges()) {
-            if (component->m_entity) {
-                sceneNode->detachObject(component->m_entity);
-                m_impl->m_sceneManager->destroyEntity(component->m_entity);
-                component->m_entity = nullptr;
-            }
-            if (component->m_meshName.get().size() > 0) {
-                component->m_entity = m_impl->m_sceneManager->createEntity(
-                    component->m_meshName
-                );
-                sceneNode->attachObject(component->m_entity);
+        else {
+            if (component) {
+                // Settle on the latest tick's transform below
+                component->m_transform.touch();
             }
-            component->m_meshName.untouch();
+            iter = m_impl->m_interpolated.erase(iter);
         }
     }
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* touched : m_impl->m_touched) {
+        auto component = static_cast<OgreSceneNodeComponent*>(touched);
+        if (not component->m_sceneNode) {
+            // Queued again once its scene node is created
+            continue;
+        }
+        if (component->m_isInterpolated and m_impl->m_interpolated.insert(component->owner()).second) {
+            m_impl->applyInterpolation(component, interpolation);
+        }
+        m_impl->applyChanges(component, this->entityManager());
+    }
+    m_impl->m_transformBuffer.apply(interpolation);
 }
-
-
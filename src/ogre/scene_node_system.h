@@ -1,10 +1,16 @@
 #pragma once
 
+#include "engine/cold_data.h"
 #include "engine/component.h"
+#include "engine/double_buffer.h"
+#include "engine/staged_writes.h"
 #include "engine/system.h"
 #include "engine/touchable.h"
+#include "ogre/scene_node_pool.h"
+#include "ogre/transform_buffer.h"
 
 #include <memory>
+#include <OgreMesh.h>
 #include <OgreVector3.h>
 #include <OgreQuaternion.h>
 
@@ -24,6 +30,9 @@ namespace thrive {
 /**
 * @brief A component for a Ogre scene nodes
 *
+* The mesh and the parent are only read when they change and live in a
+* ColdData block, the members that the per-frame systems read stay in the
+* component.
 */
 class OgreSceneNodeComponent : public Component {
     COMPONENT(OgreSceneNode)
@@ -58,11 +67,45 @@ public:
 
     };
 
+    /**
+    * @brief Settings that rarely change
+    */
+    struct Configuration {
+
+        /**
+        * @brief The name of the mesh to attach to this scene node
+        */
+        TouchableValue<Ogre::String> meshName;
+
+        /**
+        * @brief The loaded mesh of meshName, if the creator has it at hand
+        *
+        * Saves the lookup by name when the entity is created. Ignored if 
+        * it is not the mesh named by meshName. Not saved.
+        */
+        Ogre::MeshPtr mesh;
+
+        /**
+        * @brief The entity id of the parent scene node
+        *
+        * Mirrored into the EntityManager's hierarchy by the scene node 
+        * systems, so the entity is removed together with its parent. Until
+        * the parent has a scene node, this one is attached to the root 
+        * scene node.
+        */
+        TouchableValue<EntityId> parentId = NULL_ENTITY;
+
+    };
+
     /**
     * @brief Lua bindings
     *
     * Exposes:
     * - OgreSceneNodeComponent()
+    * - OgreSceneNodeComponent.StagedField
+    *   - ORIENTATION_FIELD
+    *   - POSITION_FIELD
+    *   - SCALE_FIELD
     * - @link m_transform transform @endlink
     * - Transform
     *   - Transform::orientation
@@ -70,13 +113,53 @@ public:
     *   - Transform::scale
     * - OgreSceneNodeComponent::attachObject
     * - OgreSceneNodeComponent::detachObject
-    * - OgreSceneNodeComponent::m_parentId (as "parent")
+    * - Configuration::meshName (as "meshName")
+    * - Configuration::parentId (as "parent")
+    * - OgreSceneNodeComponent::m_visible (as "visible")
+    * - OgreSceneNodeComponent::m_isParticle (as "isParticle")
+    * - OgreSceneNodeComponent::m_isStatic (as "isStatic")
+    * - OgreSceneNodeComponent::m_isOnScreen (as "onScreen", read-only)
+    * - positionData(): light userdata pointing at the position's three
+    *   floats, for reading through the LuaJIT FFI. Writes through it
+    *   bypass Transform::touch().
     *
     * @return
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief The StagedWrites field for Transform::orientation
+    *
+    * Staged writes are applied by the OgreUpdateSceneNodeSystem.
+    */
+    static const StagedWrites::FieldId ORIENTATION_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Transform::position
+    */
+    static const StagedWrites::FieldId POSITION_FIELD;
+
+    /**
+    * @brief The StagedWrites field for Transform::scale
+    */
+    static const StagedWrites::FieldId SCALE_FIELD;
+
+    /**
+    * @brief Constructor
+    */
+    OgreSceneNodeComponent();
+
+    /**
+    * @brief Adds the transform to a state digest
+    *
+    * @param digest
+    */
+    void
+    digest(
+        StateDigest& digest
+    ) const override;
+
     void
     load(
         const StorageContainer& storage
@@ -86,14 +169,49 @@ public:
     storage() const override;
 
     /**
-    * @brief The name of the mesh to attach to this scene node
+    * @brief Whether the scene node is interpolated between two ticks
+    *
+    * If set, OgreUpdateSceneNodeSystem blends from m_previousOrientation
+    * and m_previousPosition to the m_transform of the latest tick, see 
+    * GameState::tickInterpolation(). Set by the system that drives the
+    * transform at the game state's tick rate, like BulletToOgreSystem.
+    */
+    bool m_isInterpolated = false;
+
+    /**
+    * @brief Whether the scene node belongs to a particle, like an agent
+    *
+    * Particles are the most numerous entities. They move in the x/y plane,
+    * never rotate and are scaled uniformly, so storage() keeps only the
+    * position's x and y and the scale in half precision. That is what
+    * savegames and replicated snapshots hold for them. A particle with a
+    * z coordinate, an orientation or a non-uniform scale is stored with 
+    * its full transform instead.
     */
-    TouchableValue<Ogre::String> m_meshName;
+    bool m_isParticle = false;
 
     /**
-    * @brief The entity id of the parent scene node
+    * @brief Whether the scene node never moves
+    *
+    * Static scene nodes are drawn by the OgreStaticGeometrySystem. Set it 
+    * before the component is added, later changes are ignored.
     */
-    TouchableValue<EntityId> m_parentId = NULL_ENTITY;
+    bool m_isStatic = false;
+
+    /**
+    * @brief Mesh and parent
+    */
+    ColdData<Configuration> m_configuration;
+
+    /**
+    * @brief Orientation at the tick before the latest one
+    */
+    Ogre::Quaternion m_previousOrientation = Ogre::Quaternion::IDENTITY;
+
+    /**
+    * @brief Position at the tick before the latest one
+    */
+    Ogre::Vector3 m_previousPosition = {0, 0, 0};
 
     /**
     * @brief Transform
@@ -101,6 +219,19 @@ public:
     Transform
     m_transform;
 
+    /**
+    * @brief m_transform as of the start of the frame
+    *
+    * For systems that declare a buffered read of the component, see
+    * DoubleBuffer. This includes the positions of agent particles.
+    */
+    DoubleBuffer<Transform> m_lastFrameTransform;
+
+    /**
+    * @brief Whether the scene node and its children are shown
+    */
+    TouchableValue<bool> m_visible = true;
+
     /**
     * @brief Pointer to the underlying Ogre::SceneNode
     *
@@ -112,11 +243,43 @@ public:
     */
     Ogre::Entity* m_entity = nullptr;
 
+    /**
+    * @brief Incremented whenever m_entity is recreated
+    *
+    * Lets other systems notice a new entity that needs their settings.
+    */
+    unsigned int m_entityRevision = 0;
+
+    /**
+    * @brief Whether the scene node was in view in the last frame
+    *
+    * Set once per frame by the OgreViewportSystem. Systems that only
+    * change the looks of an entity can skip it while this is \c false.
+    * Not saved, and \c false until the scene node has been rendered.
+    */
+    bool m_isOnScreen = false;
+
+    /**
+    * @brief The component's slot in the TransformBuffer of the
+    * OgreUpdateSceneNodeSystem
+    *
+    * If set, the buffer drives the scene node's orientation and position
+    * while the entity moves. Touching m_transform still applies all of it.
+    * Assigned by the system that drives the transform, like 
+    * BulletToOgreSystem.
+    */
+    size_t m_transformSlot = TransformBuffer::NO_SLOT;
+
 };
 
 
 /**
 * @brief Creates scene nodes for new OgreSceneNodeComponents
+*
+* New components are handled in order of their hierarchy depth, so a 
+* parent created in the same frame gets its scene node before its 
+* children. Children that were waiting for a parent are attached to it 
+* as soon as its scene node exists.
 */
 class OgreAddSceneNodeSystem : public System {
     
@@ -168,9 +331,13 @@ private:
 
 /**
 * @brief Removes scene nodes for removed OgreSceneNodeComponents
+*
+* The scene nodes and entities of removed components go back to the
+* sceneNodePool(), where the OgreAddSceneNodeSystem and the
+* OgreUpdateSceneNodeSystem take them for new components.
 */
 class OgreRemoveSceneNodeSystem : public System {
-    
+
 public:
 
     /**
@@ -178,6 +345,7 @@ public:
     *
     * Exposes:
     * - OgreRemoveSceneNodeSystem()
+    * - OgreRemoveSceneNodeSystem::sceneNodePool
     *
     * @return 
     */
@@ -205,6 +373,14 @@ public:
     */
     void shutdown() override;
 
+    /**
+    * @brief The pool of the game state's scene nodes and entities
+    *
+    * Cleared on shutdown().
+    */
+    SceneNodePool&
+    sceneNodePool();
+
     /**
     * @brief Removes stale scene nodes
     */
@@ -218,6 +394,10 @@ private:
 
 /**
 * @brief Updates scene node transformations
+*
+* Only scene node components that have been touched are updated, plus the
+* interpolated ones and the moving slots of the transformBuffer(). The
+* transforms staged in the entity manager's StagedWrites are applied first.
 */
 class OgreUpdateSceneNodeSystem : public System {
     
@@ -255,6 +435,12 @@ public:
     */
     void shutdown() override;
 
+    /**
+    * @brief The buffer for transforms driven by other systems
+    */
+    TransformBuffer&
+    transformBuffer();
+
     /**
     * @brief Updates the scene nodes
     */
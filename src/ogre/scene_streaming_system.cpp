@@ -0,0 +1,341 @@
+#include "ogre/scene_streaming_system.h"
+
+#include "engine/component_collection.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/game_state.h"
+#include "ogre/scene_node_system.h"
+#include "ogre/viewport_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <OgreEntity.h>
+#include <OgreSceneManager.h>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace thrive;
+
+namespace {
+
+// Guards against cycles in the parent chain
+const int MAX_PARENT_DEPTH = 16;
+
+} // namespace
+
+
+luabind::scope
+SceneStreamingSystem::luaBindings() {
+    using namespace luabind;
+    return class_<SceneStreamingSystem, System>("SceneStreamingSystem")
+        .def(constructor<>())
+        .def(constructor<Ogre::Real, Ogre::Real>())
+        .def("loadDistance", &SceneStreamingSystem::loadDistance)
+        .def("setBudget", &SceneStreamingSystem::setBudget)
+        .def("streamedOutCount", &SceneStreamingSystem::streamedOutCount)
+        .def("unloadDistance", &SceneStreamingSystem::unloadDistance)
+    ;
+}
+
+
+struct SceneStreamingSystem::Implementation {
+
+    Implementation(
+        Ogre::Real loadDistance,
+        Ogre::Real unloadDistance
+    ) : m_loadDistance(loadDistance),
+        m_unloadDistance(unloadDistance)
+    {
+    }
+
+    bool
+    findCameraPosition(
+        EntityManager& entityManager,
+        Ogre::Vector3& position
+    ) const {
+        const OgreViewportComponent* mainViewport = nullptr;
+        for (const auto& item : m_viewports) {
+            const OgreViewportComponent* viewport = std::get<0>(item.second);
+            if (not mainViewport or viewport->zOrder() < mainViewport->zOrder()) {
+                mainViewport = viewport;
+            }
+        }
+        if (not mainViewport) {
+            return false;
+        }
+        auto camera = entityManager.getComponent<OgreSceneNodeComponent>(
+            mainViewport->m_properties.cameraEntity
+        );
+        if (not camera) {
+            return false;
+        }
+        if (camera->m_sceneNode) {
+            position = camera->m_sceneNode->_getDerivedPosition();
+        }
+        else {
+            position = camera->m_transform.position;
+        }
+        return true;
+    }
+
+    OgreSceneNodeComponent*
+    parentOf(
+        const OgreSceneNodeComponent* component
+    ) const {
+        EntityId parentId = component->m_configuration->parentId;
+        if (parentId == NULL_ENTITY) {
+            return nullptr;
+        }
+        return static_cast<OgreSceneNodeComponent*>(m_collection->get(parentId));
+    }
+
+    Ogre::Vector3
+    rootPosition(
+        const OgreSceneNodeComponent* component
+    ) const {
+        for (int depth = 0; depth < MAX_PARENT_DEPTH; ++depth) {
+            const OgreSceneNodeComponent* parent = this->parentOf(component);
+            if (not parent) {
+                break;
+            }
+            component = parent;
+        }
+        return component->m_transform.position;
+    }
+
+    void
+    streamOut(
+        OgreSceneNodeComponent* component
+    ) {
+        Ogre::SceneNode* sceneNode = component->m_sceneNode;
+        if (component->m_entity) {
+            sceneNode->detachObject(component->m_entity);
+            if (m_pool) {
+                m_pool->releaseEntity(component->m_entity);
+            }
+            else {
+                m_sceneManager->destroyEntity(component->m_entity);
+            }
+            component->m_entity = nullptr;
+        }
+        if (m_pool) {
+            m_pool->releaseSceneNode(sceneNode);
+        }
+        else {
+            m_sceneManager->destroySceneNode(sceneNode);
+        }
+        component->m_sceneNode = nullptr;
+        m_streamedOut.insert(component->owner());
+    }
+
+    // Drops removed components from m_streamedOut
+    void
+    forgetRemoved() {
+        m_collection->takeChanges(m_observer, m_changes);
+        for (const ComponentCollection::Change& change : m_changes) {
+            if (not change.isAdded) {
+                m_streamedOut.erase(change.entityId);
+            }
+        }
+    }
+
+    bool
+    streamIn(
+        OgreSceneNodeComponent* component
+    ) {
+        Ogre::SceneNode* parentNode = m_sceneManager->getRootSceneNode();
+        OgreSceneNodeComponent* parent = this->parentOf(component);
+        if (parent) {
+            if (not parent->m_sceneNode) {
+                // Wait for the parent
+                return false;
+            }
+            parentNode = parent->m_sceneNode;
+        }
+        component->m_sceneNode = m_pool ?
+            m_pool->takeSceneNode(parentNode) :
+            parentNode->createChildSceneNode();
+        // The OgreUpdateSceneNodeSystem applies everything to the new node
+        if (not component->m_configuration->meshName.get().empty()) {
+            component->m_configuration->meshName.touch();
+        }
+        component->m_transform.touch();
+        component->m_visible.touch();
+        m_streamedOut.erase(component->owner());
+        return true;
+    }
+
+    bool
+    canStreamOut(
+        const OgreSceneNodeComponent* component
+    ) const {
+        Ogre::SceneNode* sceneNode = component->m_sceneNode;
+        if (not sceneNode or sceneNode->numChildren() > 0) {
+            return false;
+        }
+        unsigned short ownObjects = component->m_entity ? 1 : 0;
+        return sceneNode->numAttachedObjects() == ownObjects;
+    }
+
+    std::vector<ComponentCollection::Change> m_changes;
+
+    unsigned int m_checksPerFrame = 256;
+
+    ComponentCollection* m_collection = nullptr;
+
+    // Index of the next component to check
+    size_t m_cursor = 0;
+
+    Ogre::Real m_loadDistance;
+
+    unsigned int m_loadsPerFrame = 32;
+
+    unsigned int m_observer = 0;
+
+    // Of the OgreRemoveSceneNodeSystem, if there is one
+    SceneNodePool* m_pool = nullptr;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+    std::unordered_set<EntityId> m_streamedOut;
+
+    Ogre::Real m_unloadDistance;
+
+    EntityFilter<OgreViewportComponent> m_viewports;
+
+};
+
+
+SceneStreamingSystem::SceneStreamingSystem(
+    Ogre::Real loadDistance,
+    Ogre::Real unloadDistance
+) : m_impl(new Implementation(loadDistance, unloadDistance))
+{
+    if (loadDistance > unloadDistance) {
+        throw std::invalid_argument("Load distance must not be greater than unload distance");
+    }
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareRead(OgreViewportComponent::TYPE_ID);
+    this->declareWrite(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+SceneStreamingSystem::~SceneStreamingSystem() {}
+
+
+void
+SceneStreamingSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_sceneManager = gameState->sceneManager();
+    m_impl->m_viewports.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        OgreSceneNodeComponent::TYPE_ID
+    );
+    m_impl->m_observer = m_impl->m_collection->registerObserver();
+    auto removeSystem = gameState->findSystem<OgreRemoveSceneNodeSystem>();
+    m_impl->m_pool = removeSystem ? &removeSystem->sceneNodePool() : nullptr;
+}
+
+
+Ogre::Real
+SceneStreamingSystem::loadDistance() const {
+    return m_impl->m_loadDistance;
+}
+
+
+void
+SceneStreamingSystem::setBudget(
+    unsigned int checksPerFrame,
+    unsigned int loadsPerFrame
+) {
+    if (checksPerFrame == 0 or loadsPerFrame == 0) {
+        throw std::invalid_argument("Streaming budget must be positive");
+    }
+    m_impl->m_checksPerFrame = checksPerFrame;
+    m_impl->m_loadsPerFrame = loadsPerFrame;
+}
+
+
+void
+SceneStreamingSystem::shutdown() {
+    m_impl->forgetRemoved();
+    // Parents first, so that every pass makes progress
+    for (int depth = 0; depth < MAX_PARENT_DEPTH and not m_impl->m_streamedOut.empty(); ++depth) {
+        std::vector<EntityId> streamedOut(
+            m_impl->m_streamedOut.begin(),
+            m_impl->m_streamedOut.end()
+        );
+        for (EntityId entityId : streamedOut) {
+            auto component = static_cast<OgreSceneNodeComponent*>(
+                m_impl->m_collection->get(entityId)
+            );
+            m_impl->streamIn(component);
+        }
+    }
+    m_impl->m_collection->unregisterObserver(m_impl->m_observer);
+    m_impl->m_changes.clear();
+    m_impl->m_collection = nullptr;
+    m_impl->m_cursor = 0;
+    m_impl->m_pool = nullptr;
+    m_impl->m_sceneManager = nullptr;
+    m_impl->m_streamedOut.clear();
+    m_impl->m_viewports.setEntityManager(nullptr);
+    System::shutdown();
+}
+
+
+size_t
+SceneStreamingSystem::streamedOutCount() const {
+    return m_impl->m_streamedOut.size();
+}
+
+
+Ogre::Real
+SceneStreamingSystem::unloadDistance() const {
+    return m_impl->m_unloadDistance;
+}
+
+
+void
+SceneStreamingSystem::update(int) {
+    m_impl->forgetRemoved();
+    Ogre::Vector3 cameraPosition;
+    if (not m_impl->findCameraPosition(*this->entityManager(), cameraPosition)) {
+        return;
+    }
+    const Ogre::Real loadDistanceSquared = m_impl->m_loadDistance * m_impl->m_loadDistance;
+    const Ogre::Real unloadDistanceSquared = m_impl->m_unloadDistance * m_impl->m_unloadDistance;
+    const auto& components = m_impl->m_collection->components();
+    size_t checks = std::min<size_t>(m_impl->m_checksPerFrame, components.size());
+    unsigned int loads = 0;
+    for (size_t i = 0; i < checks; ++i) {
+        if (m_impl->m_cursor >= components.size()) {
+            m_impl->m_cursor = 0;
+        }
+        auto component = static_cast<OgreSceneNodeComponent*>(
+            components[m_impl->m_cursor].get()
+        );
+        m_impl->m_cursor += 1;
+        Ogre::Vector3 position = m_impl->rootPosition(component);
+        Ogre::Real dx = position.x - cameraPosition.x;
+        Ogre::Real dy = position.y - cameraPosition.y;
+        Ogre::Real distanceSquared = dx * dx + dy * dy;
+        if (component->m_sceneNode) {
+            if (distanceSquared > unloadDistanceSquared and m_impl->canStreamOut(component)) {
+                m_impl->streamOut(component);
+            }
+        }
+        else if (
+            distanceSquared < loadDistanceSquared and
+            loads < m_impl->m_loadsPerFrame and
+            m_impl->m_streamedOut.count(component->owner()) > 0
+        ) {
+            if (m_impl->streamIn(component)) {
+                loads += 1;
+            }
+        }
+    }
+}
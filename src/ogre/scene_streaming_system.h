@@ -0,0 +1,154 @@
+#pragma once
+
+#include "engine/system.h"
+
+#include <memory>
+#include <OgrePrerequisites.h>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Drops the Ogre scene nodes of entities far from the camera
+*
+* Entities keep all their components, including the OgreSceneNodeComponent,
+* but their Ogre::SceneNode and Ogre::Entity are destroyed while they are
+* farther than the unload distance from the active camera. Once they come
+* within the load distance again, the scene node is recreated and all its
+* properties are applied again by the OgreUpdateSceneNodeSystem. The gap
+* between the two distances keeps entities at the border from streaming
+* in and out every frame.
+*
+* The active camera is the camera of the viewport with the lowest z-order.
+* Distances are measured on the x/y plane, the plane of the microbe stage.
+* The position of a child scene node is that of its root parent.
+*
+* Only scene nodes that have no child nodes and no attached objects
+* besides their mesh are dropped, so lights, cameras and parents of
+* resident nodes stay in the scene. A parent is dropped after its
+* children, and recreated before them.
+*
+* To keep each frame's cost bounded, the system checks a fixed number of
+* scene node components per frame, going round the whole collection over
+* several frames, and recreates a limited number of scene nodes per frame.
+*
+* Should run after the systems that attach objects to scene nodes, like
+* the OgreLightSystem and OgreCameraSystem, and after the
+* OgreAddSceneNodeSystem.
+*/
+class SceneStreamingSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SceneStreamingSystem()
+    * - SceneStreamingSystem(loadDistance, unloadDistance)
+    * - SceneStreamingSystem::loadDistance
+    * - SceneStreamingSystem::setBudget
+    * - SceneStreamingSystem::streamedOutCount
+    * - SceneStreamingSystem::unloadDistance
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param loadDistance
+    *   Scene nodes closer than this to the camera are recreated
+    * @param unloadDistance
+    *   Scene nodes farther than this from the camera are dropped
+    *
+    * @throw std::invalid_argument
+    *   If \a loadDistance is greater than \a unloadDistance
+    */
+    SceneStreamingSystem(
+        Ogre::Real loadDistance = 400.0f,
+        Ogre::Real unloadDistance = 500.0f
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~SceneStreamingSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief The distance within which scene nodes are recreated
+    */
+    Ogre::Real
+    loadDistance() const;
+
+    /**
+    * @brief Sets how much work the system does per frame
+    *
+    * @param checksPerFrame
+    *   The number of scene node components to check per frame
+    * @param loadsPerFrame
+    *   The maximum number of scene nodes to recreate per frame
+    *
+    * @throw std::invalid_argument
+    *   If either is zero
+    */
+    void
+    setBudget(
+        unsigned int checksPerFrame,
+        unsigned int loadsPerFrame
+    );
+
+    /**
+    * @brief Shuts the system down
+    *
+    * Recreates all dropped scene nodes, so that other systems find them
+    * as usual.
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief The number of scene node components without a scene node
+    * because of streaming
+    */
+    size_t
+    streamedOutCount() const;
+
+    /**
+    * @brief The distance beyond which scene nodes are dropped
+    */
+    Ogre::Real
+    unloadDistance() const;
+
+    /**
+    * @brief Checks the next batch of scene node components
+    *
+    * @param milliseconds
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
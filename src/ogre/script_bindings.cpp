@@ -3,15 +3,25 @@
 #include "scripting/luabind.h"
 #include "ogre/camera_system.h"
 #include "ogre/colour_material.h"
+#include "ogre/colour_system.h"
 #include "ogre/keyboard.h"
 #include "ogre/light_system.h"
+#include "ogre/lod_system.h"
+#include "ogre/material_cache.h"
+#include "ogre/mesh_bake_system.h"
 #include "ogre/mouse.h"
 #include "ogre/render_system.h"
+#include "ogre/replication_system.h"
+#include "ogre/scene_node_pool.h"
 #include "ogre/scene_node_system.h"
+#include "ogre/scene_streaming_system.h"
 #include "ogre/script_bindings.h"
 #include "ogre/sky_system.h"
+#include "ogre/spatial_index_system.h"
+#include "ogre/static_geometry_system.h"
 #include "ogre/text_overlay.h"
 #include "ogre/viewport_system.h"
+#include "ogre/world_sector_system.h"
 #include "scripting/luabind.h"
 
 #include <luabind/operator.hpp>
@@ -447,6 +457,118 @@ sphereBindings() {
 }
 
 
+// In-place operations for Vector3. They write to an existing vector instead
+// of returning a new one, which would be a new userdata for Lua to collect.
+// Hot script paths keep a few scratch vectors around and reuse them.
+
+static void
+Vector3_set(
+    Vector3* self,
+    Real x,
+    Real y,
+    Real z
+) {
+    self->x = x;
+    self->y = y;
+    self->z = z;
+}
+
+
+static void
+Vector3_assign(
+    Vector3* self,
+    const Vector3& other
+) {
+    *self = other;
+}
+
+
+static void
+Vector3_addInPlace(
+    Vector3* self,
+    const Vector3& other
+) {
+    *self += other;
+}
+
+
+static void
+Vector3_addScaledInPlace(
+    Vector3* self,
+    const Vector3& other,
+    Real scale
+) {
+    *self += other * scale;
+}
+
+
+static void
+Vector3_inverseRotateInPlace(
+    Vector3* self,
+    const Quaternion& rotation
+) {
+    *self = rotation.Inverse() * *self;
+}
+
+
+static void
+Vector3_rotateInPlace(
+    Vector3* self,
+    const Quaternion& rotation
+) {
+    *self = rotation * *self;
+}
+
+
+static void
+Vector3_scaleInPlace(
+    Vector3* self,
+    Real scale
+) {
+    *self *= scale;
+}
+
+
+static void
+Vector3_setDifference(
+    Vector3* self,
+    const Vector3& lhs,
+    const Vector3& rhs
+) {
+    *self = lhs - rhs;
+}
+
+
+static void
+Vector3_setSum(
+    Vector3* self,
+    const Vector3& lhs,
+    const Vector3& rhs
+) {
+    *self = lhs + rhs;
+}
+
+
+static Real
+Vector3_squaredDistanceXY(
+    const Vector3* self,
+    const Vector3& other
+) {
+    Real dx = self->x - other.x;
+    Real dy = self->y - other.y;
+    return dx * dx + dy * dy;
+}
+
+
+static void
+Vector3_subtractInPlace(
+    Vector3* self,
+    const Vector3& other
+) {
+    *self -= other;
+}
+
+
 static luabind::scope
 vector3Bindings() {
     return class_<Vector3>("Vector3")
@@ -488,13 +610,24 @@ vector3Bindings() {
         .def("directionEquals", &Vector3::directionEquals)
         .def("isNaN", &Vector3::isNaN)
         .def("primaryAxis", &Vector3::primaryAxis)
+        // In-place
+        .def("addInPlace", &Vector3_addInPlace)
+        .def("addScaledInPlace", &Vector3_addScaledInPlace)
+        .def("assign", &Vector3_assign)
+        .def("inverseRotateInPlace", &Vector3_inverseRotateInPlace)
+        .def("rotateInPlace", &Vector3_rotateInPlace)
+        .def("scaleInPlace", &Vector3_scaleInPlace)
+        .def("set", &Vector3_set)
+        .def("setDifference", &Vector3_setDifference)
+        .def("setSum", &Vector3_setSum)
+        .def("squaredDistanceXY", &Vector3_squaredDistanceXY)
+        .def("subtractInPlace", &Vector3_subtractInPlace)
     ;
 }
 
 luabind::scope
-thrive::OgreBindings::luaBindings() {
+thrive::OgreBindings::mathBindings() {
     return (
-        // Math
         axisAlignedBoxBindings(),
         colourValueBindings(),
         degreeBindings(),
@@ -504,30 +637,53 @@ thrive::OgreBindings::luaBindings() {
         radianBindings(),
         rayBindings(),
         sphereBindings(),
-        vector3Bindings(),
+        vector3Bindings()
+    );
+}
+
+
+luabind::scope
+thrive::OgreBindings::luaBindings() {
+    return (
+        mathBindings(),
         // Scene Manager
         sceneManagerBindings(),
         movableObjectBindings(),
         entityBindings(),
         // Components
         OgreCameraComponent::luaBindings(),
+        OgreColourComponent::luaBindings(),
         OgreLightComponent::luaBindings(),
+        OgreLodComponent::luaBindings(),
+        OgreMeshBakeComponent::luaBindings(),
         OgreSceneNodeComponent::luaBindings(),
         OgreViewportComponent::luaBindings(),
         SkyPlaneComponent::luaBindings(),
         TextOverlayComponent::luaBindings(),
+        WorldSectorComponent::luaBindings(),
+        WorldSectorStoreComponent::luaBindings(),
         // Systems
         OgreAddSceneNodeSystem::luaBindings(),
         OgreCameraSystem::luaBindings(),
+        OgreColourSystem::luaBindings(),
         OgreLightSystem::luaBindings(),
+        OgreLodSystem::luaBindings(),
+        OgreMeshBakeSystem::luaBindings(),
         OgreRemoveSceneNodeSystem::luaBindings(),
         OgreUpdateSceneNodeSystem::luaBindings(),
         OgreViewportSystem::luaBindings(),
         thrive::RenderSystem::luaBindings(), // Fully qualified because of Ogre::RenderSystem
+        ReplicationSystem::luaBindings(),
+        SceneStreamingSystem::luaBindings(),
         SkySystem::luaBindings(),
+        SpatialIndexSystem::luaBindings(),
+        OgreStaticGeometrySystem::luaBindings(),
         TextOverlaySystem::luaBindings(),
+        WorldSectorSystem::luaBindings(),
         // Other
         Keyboard::luaBindings(),
-        Mouse::luaBindings()
+        MaterialWarmup::luaBindings(),
+        Mouse::luaBindings(),
+        SceneNodePool::luaBindings()
     );
 }
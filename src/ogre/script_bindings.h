@@ -26,10 +26,26 @@ struct OgreBindings {
     *   - <a href="http://www.ogre3d.org/docs/api/html/classOgre_1_1Radian.html">Radian</a>
     *   - <a href="http://www.ogre3d.org/docs/api/html/classOgre_1_1Sphere.html">Sphere</a>
     *   - <a href="http://www.ogre3d.org/docs/api/html/classOgre_1_1Vector3.html">Vector3</a>
+    *
+    * Vector3 additionally has in-place operations that reuse an existing
+    * vector instead of allocating a new one: \c addInPlace,
+    * \c addScaledInPlace, \c assign, \c inverseRotateInPlace,
+    * \c rotateInPlace, \c scaleInPlace, \c set, \c setDifference, \c setSum,
+    * \c subtractInPlace, plus \c squaredDistanceXY, which ignores z.
     */
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Lua bindings for the OGRE math classes only
+    *
+    * Part of luaBindings(). The math classes are plain values that don't
+    * touch the scene, so they are safe to use in worker Lua states, see
+    * ScriptWorkerSystem.
+    */
+    static luabind::scope
+    mathBindings();
+
 };
 
 }
@@ -1,8 +1,10 @@
 #include "ogre/sky_system.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
 #include "engine/serialization.h"
 #include "scripting/luabind.h"
 
@@ -43,6 +45,18 @@ SkyPlaneComponent::luaBindings() {
 }
 
 
+SkyPlaneComponent::SkyPlaneComponent() {
+    m_properties.setComponent(this);
+}
+
+
+bool
+SkyPlaneComponent::isChangeTracked() const {
+    // All properties are touchables
+    return true;
+}
+
+
 void
 SkyPlaneComponent::load(
     const StorageContainer& storage
@@ -95,17 +109,22 @@ SkySystem::luaBindings() {
 
 struct SkySystem::Implementation {
 
+    ComponentCollection* m_collection = nullptr;
+
     Ogre::SceneManager* m_sceneManager = nullptr;
 
     EntityFilter<
         SkyPlaneComponent
     > m_skyPlanes = {true};
+
+    std::vector<Component*> m_touched;
 };
 
 
 SkySystem::SkySystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
 }
 
 
@@ -120,11 +139,16 @@ SkySystem::init(
     assert(m_impl->m_sceneManager == nullptr && "Double init of system");
     m_impl->m_sceneManager = gameState->sceneManager();
     m_impl->m_skyPlanes.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        SkyPlaneComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
 }
 
 
 void
 SkySystem::shutdown() {
+    m_impl->m_collection = nullptr;
     m_impl->m_skyPlanes.setEntityManager(nullptr);
     m_impl->m_sceneManager->setSkyBoxEnabled(false);
     m_impl->m_sceneManager->setSkyDomeEnabled(false);
@@ -136,16 +160,25 @@ SkySystem::shutdown() {
 
 void
 SkySystem::update(int) {
-    for (EntityId id : m_impl->m_skyPlanes.removedEntities()) {
-        (void) id;
+    bool hasRemovedPlanes = false;
+    m_impl->m_skyPlanes.takeChanges(
+        [] (EntityId, const std::tuple<SkyPlaneComponent*>&) {},
+        [&hasRemovedPlanes] (EntityId) {
+            hasRemovedPlanes = true;
+        }
+    );
+    if (hasRemovedPlanes) {
         m_impl->m_sceneManager->setSkyPlaneEnabled(false);
+        // Let the remaining sky planes, if any, take over again
+        for (auto& item : m_impl->m_skyPlanes) {
+            std::get<0>(item.second)->m_properties.touch();
+        }
     }
-    m_impl->m_skyPlanes.clearChanges();
-    for (auto& item : m_impl->m_skyPlanes) {
-        m_impl->m_sceneManager->setSkyPlaneEnabled(true);
-        SkyPlaneComponent* plane = std::get<0>(item.second);
-        if (plane->m_properties.hasChanges()) {
-            auto& properties = plane->m_properties;
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* component : m_impl->m_touched) {
+        SkyPlaneComponent* plane = static_cast<SkyPlaneComponent*>(component);
+        auto& properties = plane->m_properties;
+        if (properties.hasChanges()) {
             m_impl->m_sceneManager->setSkyPlane(
                 properties.enabled,
                 properties.plane,
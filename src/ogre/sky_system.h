@@ -105,6 +105,14 @@ public:
     static luabind::scope
     luaBindings();
 
+    /**
+    * @brief Constructor
+    */
+    SkyPlaneComponent();
+
+    bool
+    isChangeTracked() const override;
+
     void
     load(
         const StorageContainer& storage
@@ -0,0 +1,438 @@
+#include "ogre/spatial_index_system.h"
+
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <luabind/iterator_policy.hpp>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace thrive;
+
+namespace {
+
+using CellKey = uint64_t;
+
+CellKey
+cellKey(
+    int32_t x,
+    int32_t y
+) {
+    return (static_cast<CellKey>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+} // namespace
+
+
+luabind::scope
+SpatialIndexSystem::luaBindings() {
+    using namespace luabind;
+    return class_<SpatialIndexSystem, System>("SpatialIndexSystem")
+        .scope [
+            def("find", &SpatialIndexSystem::find)
+        ]
+        .def(constructor<>())
+        .def(constructor<Ogre::Real>())
+        .def("cellSize", &SpatialIndexSystem::cellSize)
+        .def("queryNearest", &SpatialIndexSystem::queryNearest, return_stl_iterator)
+        .def("queryRadius", &SpatialIndexSystem::queryRadius, return_stl_iterator)
+        .def("queryRectangle", &SpatialIndexSystem::queryRectangle, return_stl_iterator)
+    ;
+}
+
+
+struct SpatialIndexSystem::Implementation {
+
+    struct Item {
+
+        EntityId entityId;
+
+        Ogre::Vector3 position;
+
+    };
+
+    struct Entry {
+
+        int32_t x;
+
+        int32_t y;
+
+        Ogre::Vector3 position;
+
+        // Of the transform the position was taken from
+        Touchable::Version version;
+
+    };
+
+    Implementation(
+        Ogre::Real cellSize
+    ) : m_cellSize(cellSize)
+    {
+    }
+
+    int32_t
+    cellCoordinate(
+        Ogre::Real value
+    ) const {
+        return static_cast<int32_t>(std::floor(value / m_cellSize));
+    }
+
+    void
+    expandBounds(
+        int32_t x,
+        int32_t y
+    ) {
+        if (m_cells.empty()) {
+            m_minX = m_maxX = x;
+            m_minY = m_maxY = y;
+        }
+        else {
+            m_minX = std::min(m_minX, x);
+            m_maxX = std::max(m_maxX, x);
+            m_minY = std::min(m_minY, y);
+            m_maxY = std::max(m_maxY, y);
+        }
+    }
+
+    void
+    insertIntoCell(
+        EntityId entityId,
+        const Entry& entry
+    ) {
+        expandBounds(entry.x, entry.y);
+        m_cells[cellKey(entry.x, entry.y)].push_back({entityId, entry.position});
+    }
+
+    void
+    removeFromCell(
+        EntityId entityId,
+        const Entry& entry
+    ) {
+        auto cellIter = m_cells.find(cellKey(entry.x, entry.y));
+        if (cellIter == m_cells.end()) {
+            return;
+        }
+        std::vector<Item>& items = cellIter->second;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (items[i].entityId == entityId) {
+                items[i] = items.back();
+                items.pop_back();
+                break;
+            }
+        }
+        if (items.empty()) {
+            m_cells.erase(cellIter);
+        }
+    }
+
+    void
+    add(
+        EntityId entityId,
+        const OgreSceneNodeComponent::Transform& transform
+    ) {
+        this->remove(entityId);
+        const Ogre::Vector3& position = transform.position;
+        Entry entry {
+            cellCoordinate(position.x),
+            cellCoordinate(position.y),
+            position,
+            transform.version()
+        };
+        this->insertIntoCell(entityId, entry);
+        m_entries.emplace(entityId, entry);
+    }
+
+    void
+    remove(
+        EntityId entityId
+    ) {
+        auto iter = m_entries.find(entityId);
+        if (iter == m_entries.end()) {
+            return;
+        }
+        this->removeFromCell(entityId, iter->second);
+        m_entries.erase(iter);
+    }
+
+    void
+    move(
+        EntityId entityId,
+        Entry& entry,
+        const Ogre::Vector3& position
+    ) {
+        int32_t x = cellCoordinate(position.x);
+        int32_t y = cellCoordinate(position.y);
+        if (x == entry.x and y == entry.y) {
+            for (Item& item : m_cells[cellKey(x, y)]) {
+                if (item.entityId == entityId) {
+                    item.position = position;
+                    break;
+                }
+            }
+            entry.position = position;
+        }
+        else {
+            this->removeFromCell(entityId, entry);
+            entry.x = x;
+            entry.y = y;
+            entry.position = position;
+            this->insertIntoCell(entityId, entry);
+        }
+    }
+
+    const std::vector<Item>*
+    cell(
+        int32_t x,
+        int32_t y
+    ) const {
+        if (x < m_minX or x > m_maxX or y < m_minY or y > m_maxY) {
+            return nullptr;
+        }
+        auto iter = m_cells.find(cellKey(x, y));
+        if (iter == m_cells.end()) {
+            return nullptr;
+        }
+        return &iter->second;
+    }
+
+    std::vector<std::pair<Ogre::Real, EntityId>> m_candidates;
+
+    // Cell coordinates ever occupied. Only grows, which at worst costs a
+    // few lookups of empty cells.
+    int32_t m_minX = 0;
+
+    int32_t m_maxX = -1;
+
+    int32_t m_minY = 0;
+
+    int32_t m_maxY = -1;
+
+    std::unordered_map<CellKey, std::vector<Item>> m_cells;
+
+    Ogre::Real m_cellSize;
+
+    EntityFilter<
+        OgreSceneNodeComponent
+    > m_entities = {true};
+
+    std::unordered_map<EntityId, Entry> m_entries;
+
+    std::vector<EntityId> m_result;
+
+};
+
+
+SpatialIndexSystem*
+SpatialIndexSystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<SpatialIndexSystem>();
+}
+
+
+SpatialIndexSystem::SpatialIndexSystem(
+    Ogre::Real cellSize
+) : m_impl(new Implementation(cellSize))
+{
+    if (not (cellSize > 0.0f)) {
+        throw std::invalid_argument("Spatial index cell size must be positive");
+    }
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+SpatialIndexSystem::~SpatialIndexSystem() {}
+
+
+Ogre::Real
+SpatialIndexSystem::cellSize() const {
+    return m_impl->m_cellSize;
+}
+
+
+void
+SpatialIndexSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+const std::vector<EntityId>&
+SpatialIndexSystem::queryNearest(
+    const Ogre::Vector3& center,
+    unsigned int count
+) {
+    m_impl->m_result.clear();
+    auto& candidates = m_impl->m_candidates;
+    candidates.clear();
+    if (count == 0 or m_impl->m_entries.empty()) {
+        return m_impl->m_result;
+    }
+    int32_t centerX = m_impl->cellCoordinate(center.x);
+    int32_t centerY = m_impl->cellCoordinate(center.y);
+    // No occupied cell is further away than this many rings
+    int32_t maxRing = std::max(
+        std::max(centerX - m_impl->m_minX, m_impl->m_maxX - centerX),
+        std::max(centerY - m_impl->m_minY, m_impl->m_maxY - centerY)
+    );
+    auto visit = [&](int32_t x, int32_t y) {
+        const auto* items = m_impl->cell(x, y);
+        if (items) {
+            for (const auto& item : *items) {
+                candidates.emplace_back(
+                    center.squaredDistance(item.position),
+                    item.entityId
+                );
+            }
+        }
+    };
+    for (int32_t ring = 0; ring <= maxRing; ++ring) {
+        if (ring == 0) {
+            visit(centerX, centerY);
+        }
+        else {
+            for (int32_t x = centerX - ring; x <= centerX + ring; ++x) {
+                visit(x, centerY - ring);
+                visit(x, centerY + ring);
+            }
+            for (int32_t y = centerY - ring + 1; y < centerY + ring; ++y) {
+                visit(centerX - ring, y);
+                visit(centerX + ring, y);
+            }
+        }
+        if (candidates.size() == m_impl->m_entries.size()) {
+            break;
+        }
+        if (candidates.size() >= count) {
+            // Anything in the next ring is at least ring * cellSize away
+            std::nth_element(
+                candidates.begin(),
+                candidates.begin() + (count - 1),
+                candidates.end()
+            );
+            Ogre::Real bound = ring * m_impl->m_cellSize;
+            if (candidates[count - 1].first <= bound * bound) {
+                break;
+            }
+        }
+    }
+    size_t resultSize = std::min<size_t>(count, candidates.size());
+    std::partial_sort(
+        candidates.begin(),
+        candidates.begin() + resultSize,
+        candidates.end()
+    );
+    for (size_t i = 0; i < resultSize; ++i) {
+        m_impl->m_result.push_back(candidates[i].second);
+    }
+    return m_impl->m_result;
+}
+
+
+const std::vector<EntityId>&
+SpatialIndexSystem::queryRadius(
+    const Ogre::Vector3& center,
+    Ogre::Real radius
+) {
+    m_impl->m_result.clear();
+    if (m_impl->m_entries.empty()) {
+        return m_impl->m_result;
+    }
+    int32_t minX = std::max(m_impl->cellCoordinate(center.x - radius), m_impl->m_minX);
+    int32_t maxX = std::min(m_impl->cellCoordinate(center.x + radius), m_impl->m_maxX);
+    int32_t minY = std::max(m_impl->cellCoordinate(center.y - radius), m_impl->m_minY);
+    int32_t maxY = std::min(m_impl->cellCoordinate(center.y + radius), m_impl->m_maxY);
+    Ogre::Real squaredRadius = radius * radius;
+    for (int32_t x = minX; x <= maxX; ++x) {
+        for (int32_t y = minY; y <= maxY; ++y) {
+            const auto* items = m_impl->cell(x, y);
+            if (not items) {
+                continue;
+            }
+            for (const auto& item : *items) {
+                if (center.squaredDistance(item.position) <= squaredRadius) {
+                    m_impl->m_result.push_back(item.entityId);
+                }
+            }
+        }
+    }
+    return m_impl->m_result;
+}
+
+
+const std::vector<EntityId>&
+SpatialIndexSystem::queryRectangle(
+    const Ogre::Vector3& minimum,
+    const Ogre::Vector3& maximum
+) {
+    m_impl->m_result.clear();
+    if (m_impl->m_entries.empty()) {
+        return m_impl->m_result;
+    }
+    int32_t minX = std::max(m_impl->cellCoordinate(minimum.x), m_impl->m_minX);
+    int32_t maxX = std::min(m_impl->cellCoordinate(maximum.x), m_impl->m_maxX);
+    int32_t minY = std::max(m_impl->cellCoordinate(minimum.y), m_impl->m_minY);
+    int32_t maxY = std::min(m_impl->cellCoordinate(maximum.y), m_impl->m_maxY);
+    for (int32_t x = minX; x <= maxX; ++x) {
+        for (int32_t y = minY; y <= maxY; ++y) {
+            const auto* items = m_impl->cell(x, y);
+            if (not items) {
+                continue;
+            }
+            for (const auto& item : *items) {
+                const Ogre::Vector3& position = item.position;
+                if (
+                    position.x >= minimum.x and position.x <= maximum.x and
+                    position.y >= minimum.y and position.y <= maximum.y
+                ) {
+                    m_impl->m_result.push_back(item.entityId);
+                }
+            }
+        }
+    }
+    return m_impl->m_result;
+}
+
+
+void
+SpatialIndexSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_entries.clear();
+    m_impl->m_cells.clear();
+    System::shutdown();
+}
+
+
+void
+SpatialIndexSystem::update(int) {
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreSceneNodeComponent*>& group) {
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<0>(group);
+            m_impl->add(entityId, sceneNodeComponent->m_transform);
+        },
+        [this] (EntityId entityId) {
+            m_impl->remove(entityId);
+        }
+    );
+    // The transform's version counts its changes whether or not
+    // OgreUpdateSceneNodeSystem has applied them yet
+    for (const auto& value : m_impl->m_entities) {
+        const auto& transform = std::get<0>(value.second)->m_transform;
+        auto iter = m_impl->m_entries.find(value.first);
+        if (iter == m_impl->m_entries.end()) {
+            m_impl->add(value.first, transform);
+        }
+        else if (transform.hasChangesSince(iter->second.version)) {
+            iter->second.version = transform.version();
+            if (iter->second.position != transform.position) {
+                m_impl->move(value.first, iter->second, transform.position);
+            }
+        }
+    }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <memory>
+#include <OgreVector3.h>
+#include <vector>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Maintains a uniform grid over the positions of scene nodes
+*
+* The grid is laid out on the x/y plane, which is the plane of the
+* microbe stage. Each OgreSceneNodeComponent is bucketed into the cell
+* containing its transform's position. Entities are only moved between
+* cells when their position crosses a cell border, so an update costs
+* little more than comparing each position against the cached one.
+*
+* Queries return entities in no particular order, except for
+* queryNearest(), which returns them nearest first. The returned
+* collection is reused by the next query, so copy it if you need to keep
+* it around.
+*/
+class SpatialIndexSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - SpatialIndexSystem()
+    * - SpatialIndexSystem(cellSize)
+    * - SpatialIndexSystem::find
+    * - SpatialIndexSystem::cellSize
+    * - SpatialIndexSystem::queryNearest
+    * - SpatialIndexSystem::queryRadius
+    * - SpatialIndexSystem::queryRectangle
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Finds the spatial index system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's spatial index or \c nullptr if it has none
+    */
+    static SpatialIndexSystem*
+    find(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param cellSize
+    *   The edge length of a grid cell. Ideally about the size of the
+    *   most common query radius.
+    */
+    SpatialIndexSystem(
+        Ogre::Real cellSize = 16.0f
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~SpatialIndexSystem();
+
+    /**
+    * @brief The edge length of a grid cell
+    */
+    Ogre::Real
+    cellSize() const;
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief Finds the \a count entities nearest to a point
+    *
+    * @param center
+    *   The point to search around
+    * @param count
+    *   The maximum number of entities to return
+    *
+    * @return
+    *   Up to \a count entities, nearest first
+    */
+    const std::vector<EntityId>&
+    queryNearest(
+        const Ogre::Vector3& center,
+        unsigned int count
+    );
+
+    /**
+    * @brief Finds all entities within a radius around a point
+    *
+    * @param center
+    *   The center of the search sphere
+    * @param radius
+    *   The radius of the search sphere
+    *
+    * @return
+    *   The entities whose position is within \a radius of \a center
+    */
+    const std::vector<EntityId>&
+    queryRadius(
+        const Ogre::Vector3& center,
+        Ogre::Real radius
+    );
+
+    /**
+    * @brief Finds all entities within a rectangle on the x/y plane
+    *
+    * The z coordinates of the corners are ignored.
+    *
+    * @param minimum
+    *   The corner with the smallest coordinates
+    * @param maximum
+    *   The corner with the largest coordinates
+    *
+    * @return
+    *   The entities inside the rectangle
+    */
+    const std::vector<EntityId>&
+    queryRectangle(
+        const Ogre::Vector3& minimum,
+        const Ogre::Vector3& maximum
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Moves entities to their current cells
+    *
+    * @param milliseconds
+    */
+    void update(int milliseconds) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
@@ -0,0 +1,311 @@
+#include "ogre/static_geometry_system.h"
+
+#include "engine/entity_filter.h"
+#include "engine/game_state.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <OgreEntity.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreStaticGeometry.h>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace thrive;
+
+
+luabind::scope
+OgreStaticGeometrySystem::luaBindings() {
+    using namespace luabind;
+    return class_<OgreStaticGeometrySystem, System>("OgreStaticGeometrySystem")
+        .def(constructor<>())
+        .def(constructor<Ogre::Real>())
+        .def(constructor<Ogre::Real, unsigned int>())
+        .def("regionCount", &OgreStaticGeometrySystem::regionCount)
+    ;
+}
+
+
+struct OgreStaticGeometrySystem::Implementation {
+
+    // A static entity, as it was last baked
+    struct Member {
+
+        uint64_t region;
+
+        Ogre::Entity* entity;
+
+        bool isVisible;
+
+    };
+
+    struct Region {
+
+        Ogre::StaticGeometry* geometry = nullptr;
+
+        std::unordered_set<EntityId> members;
+
+    };
+
+    Implementation(
+        Ogre::Real regionSize,
+        unsigned int maxRebuildsPerUpdate
+    ) : m_maxRebuildsPerUpdate(maxRebuildsPerUpdate),
+        m_regionSize(regionSize)
+    {
+    }
+
+    int32_t
+    regionIndex(
+        Ogre::Real coordinate
+    ) const {
+        return static_cast<int32_t>(std::floor(coordinate / m_regionSize));
+    }
+
+    uint64_t
+    regionKey(
+        const Ogre::Vector3& position
+    ) const {
+        int32_t x = this->regionIndex(position.x);
+        int32_t y = this->regionIndex(position.y);
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    void
+    markDirty(
+        uint64_t region
+    ) {
+        if (m_dirtyRegionSet.insert(region).second) {
+            m_dirtyRegions.push_back(region);
+        }
+    }
+
+    // Takes a static entity into a region once its mesh exists
+    void
+    addMember(
+        EntityId entityId,
+        OgreSceneNodeComponent* component
+    ) {
+        uint64_t region = this->regionKey(component->m_sceneNode->_getDerivedPosition());
+        m_members[entityId] = Member{region, nullptr, false};
+        m_regions[region].members.insert(entityId);
+        this->markDirty(region);
+    }
+
+    void
+    removeMember(
+        EntityId entityId
+    ) {
+        auto iter = m_members.find(entityId);
+        if (iter == m_members.end()) {
+            m_pending.erase(entityId);
+            return;
+        }
+        uint64_t region = iter->second.region;
+        m_regions[region].members.erase(entityId);
+        m_members.erase(iter);
+        this->markDirty(region);
+    }
+
+    void
+    rebuild(
+        uint64_t key
+    ) {
+        auto iter = m_regions.find(key);
+        if (iter == m_regions.end()) {
+            return;
+        }
+        Region& region = iter->second;
+        if (region.members.empty()) {
+            if (region.geometry) {
+                m_sceneManager->destroyStaticGeometry(region.geometry);
+            }
+            m_regions.erase(iter);
+            return;
+        }
+        if (not region.geometry) {
+            region.geometry = m_sceneManager->createStaticGeometry(
+                "thrive.static." + std::to_string(key)
+            );
+            int32_t x = static_cast<int32_t>(key >> 32);
+            int32_t y = static_cast<int32_t>(key & 0xFFFFFFFF);
+            region.geometry->setOrigin(Ogre::Vector3(x * m_regionSize, y * m_regionSize, -0.5f * m_regionSize));
+            region.geometry->setRegionDimensions(Ogre::Vector3(m_regionSize));
+        }
+        else {
+            region.geometry->reset();
+        }
+        bool isEmpty = true;
+        for (EntityId entityId : region.members) {
+            auto entry = m_entities.entities().find(entityId);
+            if (entry == m_entities.entities().end()) {
+                continue;
+            }
+            OgreSceneNodeComponent* component = std::get<0>(entry->second);
+            Member& member = m_members[entityId];
+            member.entity = component->m_entity;
+            member.isVisible = component->m_visible.get();
+            if (not member.entity) {
+                continue;
+            }
+            if (member.isVisible) {
+                Ogre::SceneNode* sceneNode = component->m_sceneNode;
+                region.geometry->addEntity(
+                    member.entity,
+                    sceneNode->_getDerivedPosition(),
+                    sceneNode->_getDerivedOrientation(),
+                    sceneNode->_getDerivedScale()
+                );
+                isEmpty = false;
+            }
+            member.entity->setVisible(false);
+        }
+        // Ogre refuses to build static geometry without entities
+        if (not isEmpty) {
+            region.geometry->build();
+        }
+    }
+
+    std::vector<uint64_t> m_dirtyRegions;
+
+    std::unordered_set<uint64_t> m_dirtyRegionSet;
+
+    EntityFilter<OgreSceneNodeComponent> m_entities = {true};
+
+    unsigned int m_maxRebuildsPerUpdate;
+
+    std::unordered_map<EntityId, Member> m_members;
+
+    // Static entities that have no scene node or mesh yet
+    std::unordered_set<EntityId> m_pending;
+
+    std::unordered_map<uint64_t, Region> m_regions;
+
+    Ogre::Real m_regionSize;
+
+    Ogre::SceneManager* m_sceneManager = nullptr;
+
+};
+
+
+OgreStaticGeometrySystem::OgreStaticGeometrySystem(
+    Ogre::Real regionSize,
+    unsigned int maxRebuildsPerUpdate
+) : m_impl(new Implementation(regionSize, maxRebuildsPerUpdate))
+{
+    if (not (regionSize > 0.0f)) {
+        throw std::invalid_argument("Static geometry region size must be positive");
+    }
+    if (maxRebuildsPerUpdate == 0) {
+        throw std::invalid_argument("Static geometry needs at least one rebuild per update");
+    }
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+}
+
+
+OgreStaticGeometrySystem::~OgreStaticGeometrySystem() {}
+
+
+void
+OgreStaticGeometrySystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    assert(m_impl->m_sceneManager == nullptr && "Double init of system");
+    m_impl->m_sceneManager = gameState->sceneManager();
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+}
+
+
+size_t
+OgreStaticGeometrySystem::regionCount() const {
+    return m_impl->m_regions.size();
+}
+
+
+void
+OgreStaticGeometrySystem::shutdown() {
+    for (const auto& item : m_impl->m_members) {
+        const auto& entities = m_impl->m_entities.entities();
+        auto entry = entities.find(item.first);
+        if (entry == entities.end()) {
+            continue;
+        }
+        OgreSceneNodeComponent* component = std::get<0>(entry->second);
+        if (component->m_entity) {
+            component->m_entity->setVisible(component->m_visible.get());
+        }
+    }
+    for (const auto& item : m_impl->m_regions) {
+        if (item.second.geometry) {
+            m_impl->m_sceneManager->destroyStaticGeometry(item.second.geometry);
+        }
+    }
+    m_impl->m_dirtyRegions.clear();
+    m_impl->m_dirtyRegionSet.clear();
+    m_impl->m_members.clear();
+    m_impl->m_pending.clear();
+    m_impl->m_regions.clear();
+    m_impl->m_entities.setEntityManager(nullptr);
+    m_impl->m_sceneManager = nullptr;
+    System::shutdown();
+}
+
+
+void
+OgreStaticGeometrySystem::update(int) {
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreSceneNodeComponent*>& group) {
+            if (std::get<0>(group)->m_isStatic) {
+                m_impl->m_pending.insert(entityId);
+            }
+        },
+        [this] (EntityId entityId) {
+            m_impl->removeMember(entityId);
+        }
+    );
+    const auto& entities = m_impl->m_entities.entities();
+    for (auto iter = m_impl->m_pending.begin(); iter != m_impl->m_pending.end(); ) {
+        auto entry = entities.find(*iter);
+        OgreSceneNodeComponent* component = entry == entities.end() ? nullptr : std::get<0>(entry->second);
+        if (component and component->m_sceneNode and component->m_entity) {
+            m_impl->addMember(*iter, component);
+            iter = m_impl->m_pending.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+    // Recreated, streamed out or shown again by other systems
+    for (const auto& item : m_impl->m_members) {
+        const Implementation::Member& member = item.second;
+        auto entry = entities.find(item.first);
+        if (entry == entities.end()) {
+            continue;
+        }
+        OgreSceneNodeComponent* component = std::get<0>(entry->second);
+        if (component->m_entity != member.entity or component->m_visible.get() != member.isVisible) {
+            m_impl->markDirty(member.region);
+        }
+        else if (member.entity and member.entity->getVisible()) {
+            member.entity->setVisible(false);
+        }
+    }
+    auto& dirtyRegions = m_impl->m_dirtyRegions;
+    size_t rebuilds = std::min<size_t>(dirtyRegions.size(), m_impl->m_maxRebuildsPerUpdate);
+    for (size_t i = 0; i < rebuilds; ++i) {
+        m_impl->m_dirtyRegionSet.erase(dirtyRegions[i]);
+        m_impl->rebuild(dirtyRegions[i]);
+    }
+    dirtyRegions.erase(dirtyRegions.begin(), dirtyRegions.begin() + rebuilds);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "engine/system.h"
+
+#include <memory>
+#include <OgrePrerequisites.h>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Bakes the meshes of static scene nodes into Ogre::StaticGeometry
+*
+* Scenery that never moves, like background decorations, doesn't need a
+* draw call per entity. Its OgreSceneNodeComponent is marked as static:
+*
+* \code{.lua}
+* local sceneNode = OgreSceneNodeComponent()
+* sceneNode.meshName = "rock.mesh"
+* sceneNode.isStatic = true
+* entity:addComponent(sceneNode)
+* \endcode
+*
+* The world is divided into square regions on the xy plane. Each region
+* with static entities has its own Ogre::StaticGeometry, which draws all of
+* them in one batch per material. The entities themselves are hidden.
+*
+* A region is rebuilt when a static entity in it is added, removed,
+* shown, hidden or gets a new mesh. Rebuilds are deferred to the end of the
+* update and limited per update, so loading a lot of scenery is spread
+* over a few frames. Moving a static scene node doesn't update the baked
+* geometry.
+*
+* Should run after the OgreUpdateSceneNodeSystem and the OgreLodSystem,
+* which create the entities.
+*/
+class OgreStaticGeometrySystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - OgreStaticGeometrySystem()
+    * - OgreStaticGeometrySystem(regionSize)
+    * - OgreStaticGeometrySystem(regionSize, maxRebuildsPerUpdate)
+    * - OgreStaticGeometrySystem::regionCount()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param regionSize
+    *   The edge length of a region
+    * @param maxRebuildsPerUpdate
+    *   The most regions rebuilt in one update
+    */
+    OgreStaticGeometrySystem(
+        Ogre::Real regionSize = 200.0f,
+        unsigned int maxRebuildsPerUpdate = 4
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~OgreStaticGeometrySystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void init(GameState* gameState) override;
+
+    /**
+    * @brief The number of regions with static entities
+    */
+    size_t
+    regionCount() const;
+
+    /**
+    * @brief Shuts the system down
+    *
+    * Shows the static entities again.
+    */
+    void shutdown() override;
+
+    /**
+    * @brief Bakes the changed regions
+    */
+    void update(int) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+};
+
+}
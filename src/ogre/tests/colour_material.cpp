@@ -0,0 +1,30 @@
+#include "ogre/colour_material.h"
+
+#include <gtest/gtest.h>
+#include <OgreColourValue.h>
+
+using namespace thrive;
+
+
+TEST(ColourMaterial, SimilarColoursShareKey) {
+    Ogre::ColourValue colour(0.6f, 0.3f, 0.9f, 1.0f);
+    Ogre::ColourValue similar(0.601f, 0.299f, 0.9005f, 1.0f);
+    EXPECT_EQ(colourMaterialKey(colour), colourMaterialKey(similar));
+}
+
+
+TEST(ColourMaterial, DifferentColoursHaveDifferentKeys) {
+    Ogre::ColourValue colour(0.6f, 0.3f, 0.9f, 1.0f);
+    EXPECT_NE(colourMaterialKey(colour), colourMaterialKey(Ogre::ColourValue(0.7f, 0.3f, 0.9f, 1.0f)));
+    EXPECT_NE(colourMaterialKey(colour), colourMaterialKey(Ogre::ColourValue(0.6f, 0.4f, 0.9f, 1.0f)));
+    EXPECT_NE(colourMaterialKey(colour), colourMaterialKey(Ogre::ColourValue(0.6f, 0.3f, 0.8f, 1.0f)));
+    EXPECT_NE(colourMaterialKey(colour), colourMaterialKey(Ogre::ColourValue(0.6f, 0.3f, 0.9f, 0.0f)));
+}
+
+
+TEST(ColourMaterial, ClampsChannels) {
+    EXPECT_EQ(
+        colourMaterialKey(Ogre::ColourValue(1.0f, 0.0f, 1.0f, 1.0f)),
+        colourMaterialKey(Ogre::ColourValue(2.0f, -1.0f, 1.5f, 3.0f))
+    );
+}
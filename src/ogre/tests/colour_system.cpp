@@ -0,0 +1,43 @@
+#include "ogre/colour_system.h"
+
+#include "engine/serialization.h"
+#include "ogre/colour_material.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(OgreColourComponent, SkipsColoursWithTheSameMaterial) {
+    OgreColourComponent component;
+    component.setColour("center", Ogre::ColourValue(1, 0, 0, 1));
+    ASSERT_EQ(1u, component.m_colours.subEntities.size());
+    EXPECT_TRUE(component.m_colours.hasChanges());
+    component.m_colours.subEntities[0].m_isApplied = true;
+    component.m_colours.untouch();
+    // Rounds to the same pooled material
+    component.setColour("center", Ogre::ColourValue(0.999f, 0, 0, 1));
+    EXPECT_FALSE(component.m_colours.hasChanges());
+    EXPECT_TRUE(component.m_colours.subEntities[0].m_isApplied);
+    component.setColour("center", Ogre::ColourValue(0, 1, 0, 1));
+    EXPECT_TRUE(component.m_colours.hasChanges());
+    EXPECT_FALSE(component.m_colours.subEntities[0].m_isApplied);
+    EXPECT_EQ(
+        colourMaterialKey(Ogre::ColourValue(0, 1, 0, 1)),
+        component.m_colours.subEntities[0].m_key
+    );
+}
+
+
+TEST(OgreColourComponent, Storage) {
+    OgreColourComponent original;
+    original.setColour("center", Ogre::ColourValue(1, 0, 0, 1));
+    original.setColour("top", Ogre::ColourValue(0, 0, 1, 1));
+    OgreColourComponent restored;
+    restored.load(original.storage());
+    ASSERT_EQ(2u, restored.m_colours.subEntities.size());
+    EXPECT_EQ("center", restored.m_colours.subEntities[0].m_subEntityName);
+    EXPECT_EQ(Ogre::ColourValue(1, 0, 0, 1), restored.m_colours.subEntities[0].m_colour);
+    EXPECT_EQ("top", restored.m_colours.subEntities[1].m_subEntityName);
+    EXPECT_FALSE(restored.m_colours.subEntities[1].m_isApplied);
+}
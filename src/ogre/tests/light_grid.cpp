@@ -0,0 +1,84 @@
+#include "ogre/light_grid.h"
+
+#include <gtest/gtest.h>
+#include <limits>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// The grid never dereferences the lights
+Ogre::Light*
+fakeLight(
+    uintptr_t id
+) {
+    return reinterpret_cast<Ogre::Light*>(id);
+}
+
+}
+
+
+TEST(LightGrid, FindsLightsInRange) {
+    LightGrid grid(10.0f);
+    grid.insert(fakeLight(1), Ogre::Vector3(0, 0, 0), 5.0f);
+    grid.insert(fakeLight(2), Ogre::Vector3(100, 0, 0), 5.0f);
+    grid.insert(fakeLight(3), Ogre::Vector3(-8, 0, 0), 5.0f);
+    std::vector<Ogre::Light*> lights;
+    grid.query(Ogre::Vector3(-2, 0, 0), 1.0f, lights);
+    ASSERT_EQ(2u, lights.size());
+    EXPECT_EQ(fakeLight(1), lights[0]);
+    EXPECT_EQ(fakeLight(3), lights[1]);
+    grid.query(Ogre::Vector3(50, 0, 0), 1.0f, lights);
+    EXPECT_TRUE(lights.empty());
+}
+
+
+TEST(LightGrid, ChecksRangeInZ) {
+    LightGrid grid(10.0f);
+    grid.insert(fakeLight(1), Ogre::Vector3(0, 0, 20), 5.0f);
+    std::vector<Ogre::Light*> lights;
+    grid.query(Ogre::Vector3(0, 0, 0), 1.0f, lights);
+    EXPECT_TRUE(lights.empty());
+}
+
+
+TEST(LightGrid, NoDuplicatesAcrossCells) {
+    LightGrid grid(1.0f);
+    grid.insert(fakeLight(1), Ogre::Vector3(0, 0, 0), 3.0f);
+    std::vector<Ogre::Light*> lights;
+    grid.query(Ogre::Vector3(0.5f, 0.5f, 0), 2.0f, lights);
+    ASSERT_EQ(1u, lights.size());
+    EXPECT_EQ(fakeLight(1), lights[0]);
+}
+
+
+TEST(LightGrid, InfiniteRange) {
+    LightGrid grid(10.0f);
+    grid.insert(fakeLight(1), Ogre::Vector3(0, 0, 0), std::numeric_limits<Ogre::Real>::infinity());
+    grid.insert(fakeLight(2), Ogre::Vector3(0, 0, 0), 1000.0f);
+    std::vector<Ogre::Light*> lights;
+    grid.query(Ogre::Vector3(500, -500, 0), 1.0f, lights);
+    ASSERT_EQ(2u, lights.size());
+    // Large objects see the same lights
+    grid.query(Ogre::Vector3(0, 0, 0), 10000.0f, lights);
+    EXPECT_EQ(2u, lights.size());
+}
+
+
+TEST(LightGrid, Clear) {
+    LightGrid grid(10.0f);
+    grid.insert(fakeLight(1), Ogre::Vector3(0, 0, 0), 5.0f);
+    grid.clear();
+    EXPECT_EQ(0u, grid.size());
+    std::vector<Ogre::Light*> lights;
+    grid.query(Ogre::Vector3(0, 0, 0), 1.0f, lights);
+    EXPECT_TRUE(lights.empty());
+}
+
+
+TEST(LightGrid, RejectsInvalidCellSize) {
+    EXPECT_THROW(LightGrid(0.0f), std::invalid_argument);
+    LightGrid grid(1.0f);
+    EXPECT_THROW(grid.setCellSize(-1.0f), std::invalid_argument);
+}
@@ -0,0 +1,43 @@
+#include "ogre/lod_system.h"
+
+#include "engine/serialization.h"
+#include "ogre/script_bindings.h"
+#include "scripting/lua_state.h"
+#include "scripting/tests/do_string_assertion.h"
+#include "scripting/script_initializer.h"
+#include "util/make_unique.h"
+
+#include <gtest/gtest.h>
+#include <luabind/luabind.hpp>
+
+using namespace thrive;
+
+
+TEST(OgreLodComponent, ScriptBindings) {
+    LuaState L;
+    initializeLua(L);
+    luabind::object globals = luabind::globals(L);
+    auto lod = make_unique<OgreLodComponent>();
+    globals["lod"] = lod.get();
+    EXPECT_TRUE(LuaSuccess(L,
+        "lod.properties.meshLodBias = 0.5"
+    ));
+    EXPECT_EQ(0.5f, lod->m_properties.meshLodBias);
+    EXPECT_TRUE(LuaSuccess(L,
+        "lod.properties.renderingDistance = 100"
+    ));
+    EXPECT_EQ(100.0f, lod->m_properties.renderingDistance);
+}
+
+
+TEST(OgreLodComponent, Storage) {
+    OgreLodComponent original;
+    original.m_properties.materialLodBias = 2.0f;
+    original.m_properties.minPixelSize = 3.0f;
+    OgreLodComponent restored;
+    restored.load(original.storage());
+    EXPECT_EQ(2.0f, restored.m_properties.materialLodBias);
+    EXPECT_EQ(1.0f, restored.m_properties.meshLodBias);
+    EXPECT_EQ(3.0f, restored.m_properties.minPixelSize);
+    EXPECT_EQ(0.0f, restored.m_properties.renderingDistance);
+}
@@ -0,0 +1,52 @@
+#include "ogre/mesh_bake_system.h"
+
+#include "engine/serialization.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(OgreMeshBakeComponent, SeparatesLayoutAndColourChanges) {
+    OgreMeshBakeComponent component;
+    component.setPart(1, "hex.mesh", Ogre::Vector3(1, 0, 0));
+    EXPECT_EQ(1u, component.partCount());
+    EXPECT_EQ(OgreMeshBakeComponent::Parts::LAYOUT, component.m_parts.changedFields());
+    component.m_parts.untouch();
+    // Same mesh at the same position
+    component.setPart(1, "hex.mesh", Ogre::Vector3(1, 0, 0));
+    EXPECT_FALSE(component.m_parts.hasChanges());
+    component.setPartColour(1, "center", Ogre::ColourValue(1, 0, 0, 1));
+    EXPECT_EQ(OgreMeshBakeComponent::Parts::COLOURS, component.m_parts.changedFields());
+    component.m_parts.untouch();
+    component.setPartColour(1, "center", Ogre::ColourValue(1, 0, 0, 1));
+    component.setPartColour(2, "center", Ogre::ColourValue(1, 0, 0, 1));
+    EXPECT_FALSE(component.m_parts.hasChanges());
+    // Moving keeps the colours
+    component.setPart(1, "hex.mesh", Ogre::Vector3(2, 0, 0));
+    EXPECT_EQ(OgreMeshBakeComponent::Parts::LAYOUT, component.m_parts.changedFields());
+    EXPECT_EQ(1u, component.m_parts.parts[0].m_colours.size());
+    EXPECT_FALSE(component.removePart(2));
+    EXPECT_TRUE(component.removePart(1));
+    EXPECT_EQ(0u, component.partCount());
+}
+
+
+TEST(OgreMeshBakeComponent, Storage) {
+    OgreMeshBakeComponent original;
+    original.m_minPixelSize = 3.0f;
+    original.setPart(7, "hex.mesh", Ogre::Vector3(1, 2, 0));
+    original.setPartColour(7, "top", Ogre::ColourValue(0, 0, 1, 1));
+    OgreMeshBakeComponent restored;
+    restored.load(original.storage());
+    EXPECT_EQ(3.0f, restored.m_minPixelSize);
+    ASSERT_EQ(1u, restored.partCount());
+    const OgreMeshBakeComponent::Part& part = restored.m_parts.parts[0];
+    EXPECT_EQ(7u, part.m_key);
+    EXPECT_EQ("hex.mesh", part.m_meshName);
+    EXPECT_EQ(Ogre::Vector3(1, 2, 0), part.m_position);
+    ASSERT_EQ(1u, part.m_colours.size());
+    EXPECT_EQ("top", part.m_colours[0].first);
+    EXPECT_EQ(Ogre::ColourValue(0, 0, 1, 1), part.m_colours[0].second);
+    EXPECT_TRUE(restored.m_parts.hasChanges());
+}
@@ -0,0 +1,48 @@
+#include "ogre/scene_node_system.h"
+
+#include "engine/serialization.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(OgreSceneNodeComponent, StoresParticlesCompactly) {
+    OgreSceneNodeComponent particle;
+    particle.m_isParticle = true;
+    particle.m_transform.position = Ogre::Vector3(1234.5f, -6.25f, 0.0f);
+    particle.m_transform.scale = Ogre::Vector3(0.5f);
+    StorageContainer storage = particle.storage();
+    EXPECT_FALSE(storage.contains("orientation"));
+    EXPECT_FALSE(storage.contains("position"));
+    EXPECT_FALSE(storage.contains("scale"));
+    EXPECT_TRUE(storage.contains<std::vector<float>>("particlePosition"));
+    OgreSceneNodeComponent loaded;
+    loaded.load(storage);
+    EXPECT_TRUE(loaded.m_isParticle);
+    EXPECT_EQ(particle.m_transform.position, loaded.m_transform.position);
+    EXPECT_EQ(particle.m_transform.scale, loaded.m_transform.scale);
+    EXPECT_EQ(Ogre::Quaternion::IDENTITY, loaded.m_transform.orientation);
+    // Particles out of the plane keep their full transform
+    OgreSceneNodeComponent turned;
+    turned.m_isParticle = true;
+    turned.m_transform.position = Ogre::Vector3(1.0f, 2.0f, 3.0f);
+    turned.m_transform.orientation = Ogre::Quaternion(Ogre::Radian(1.0f), Ogre::Vector3::UNIT_Z);
+    turned.m_transform.scale = Ogre::Vector3(1.0f, 2.0f, 1.0f);
+    StorageContainer turnedStorage = turned.storage();
+    EXPECT_FALSE(turnedStorage.contains("particlePosition"));
+    OgreSceneNodeComponent loadedTurned;
+    loadedTurned.load(turnedStorage);
+    EXPECT_TRUE(loadedTurned.m_isParticle);
+    EXPECT_EQ(turned.m_transform.position, loadedTurned.m_transform.position);
+    EXPECT_EQ(turned.m_transform.orientation, loadedTurned.m_transform.orientation);
+    EXPECT_EQ(turned.m_transform.scale, loadedTurned.m_transform.scale);
+    // Other scene nodes keep their full transform
+    OgreSceneNodeComponent sceneNode;
+    sceneNode.m_transform.position = Ogre::Vector3(1.0f, 2.0f, 3.0f);
+    OgreSceneNodeComponent loadedSceneNode;
+    loadedSceneNode.load(sceneNode.storage());
+    EXPECT_FALSE(loadedSceneNode.m_isParticle);
+    EXPECT_EQ(sceneNode.m_transform.position, loadedSceneNode.m_transform.position);
+}
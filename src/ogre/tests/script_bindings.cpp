@@ -26,3 +26,27 @@ TEST(OgreVector3, Lua) {
     EXPECT_EQ(Vector3(11, 22, 33), sum);
     EXPECT_EQ(140, dot);
 }
+
+
+TEST(OgreVector3, LuaInPlace) {
+    LuaState L;
+    initializeLua(L);
+    object globals = luabind::globals(L);
+    L.doString(
+        "a = Vector3(1, 2, 3)\n"
+        "b = Vector3(10, 20, 30)\n"
+        "c = Vector3()\n"
+        "c:setSum(a, b)\n"
+        "c:addScaledInPlace(a, 2)\n"
+        "c:subtractInPlace(b)\n"
+        "c:scaleInPlace(0.5)\n"
+        "a:set(4, 6, 8)\n"
+        "distance = a:squaredDistanceXY(Vector3(1, 2, 100))\n"
+        "b:rotateInPlace(Quaternion(Radian(Degree(90)), Vector3(0, 0, 1)))\n"
+    );
+    EXPECT_EQ(Vector3(1.5f, 3.0f, 4.5f), object_cast<Vector3>(globals["c"]));
+    EXPECT_EQ(Vector3(4, 6, 8), object_cast<Vector3>(globals["a"]));
+    EXPECT_EQ(25, object_cast<Real>(globals["distance"]));
+    Vector3 rotated = object_cast<Vector3>(globals["b"]);
+    EXPECT_TRUE(rotated.positionEquals(Vector3(-20, 10, 30), 0.001f));
+}
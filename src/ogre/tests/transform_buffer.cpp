@@ -0,0 +1,58 @@
+#include "ogre/transform_buffer.h"
+
+#include "ogre/scene_node_system.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+
+TEST(TransformBuffer, Slots) {
+    TransformBuffer buffer;
+    OgreSceneNodeComponent first;
+    first.setOwner(1);
+    OgreSceneNodeComponent second;
+    second.setOwner(2);
+    size_t firstSlot = buffer.add(&first);
+    size_t secondSlot = buffer.add(&second);
+    EXPECT_EQ(firstSlot, first.m_transformSlot);
+    EXPECT_EQ(secondSlot, second.m_transformSlot);
+    EXPECT_EQ(2u, buffer.size());
+    buffer.remove(firstSlot);
+    EXPECT_EQ(TransformBuffer::NO_SLOT, first.m_transformSlot);
+    EXPECT_EQ(1u, buffer.size());
+    // A freed slot doesn't take transforms for its old entity
+    EXPECT_FALSE(buffer.set(firstSlot, 1, Ogre::Quaternion::IDENTITY, Ogre::Vector3::ZERO));
+    // Slots are reused
+    OgreSceneNodeComponent third;
+    third.setOwner(3);
+    EXPECT_EQ(firstSlot, buffer.add(&third));
+    EXPECT_FALSE(buffer.set(firstSlot, 1, Ogre::Quaternion::IDENTITY, Ogre::Vector3::ZERO));
+    EXPECT_TRUE(buffer.set(firstSlot, 3, Ogre::Quaternion::IDENTITY, Ogre::Vector3::ZERO));
+}
+
+
+TEST(TransformBuffer, Settling) {
+    TransformBuffer buffer;
+    OgreSceneNodeComponent component;
+    component.setOwner(1);
+    component.m_transform.untouch();
+    size_t slot = buffer.add(&component);
+    // Scene nodes that don't exist yet stay in the buffer
+    buffer.apply(0.5f);
+    EXPECT_EQ(1u, buffer.movingCount());
+    Ogre::Vector3 position(1, 2, 3);
+    Touchable::Version version = component.m_transform.version();
+    EXPECT_TRUE(buffer.set(slot, 1, Ogre::Quaternion::IDENTITY, position));
+    // Scripts see the latest tick
+    EXPECT_EQ(position, component.m_transform.position);
+    EXPECT_FALSE(component.m_transform.hasChanges());
+    EXPECT_TRUE(component.m_transform.hasChangesSince(version));
+    buffer.endTick();
+    EXPECT_EQ(1u, buffer.movingCount());
+    // Not set in this tick
+    buffer.endTick();
+    EXPECT_EQ(1u, buffer.movingCount());
+    buffer.remove(slot);
+    EXPECT_EQ(0u, buffer.movingCount());
+}
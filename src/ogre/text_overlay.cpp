@@ -1,13 +1,17 @@
 #include "ogre/text_overlay.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/game_state.h"
 #include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
 #include "engine/serialization.h"
 #include "scripting/luabind.h"
 
 #include <iostream>
+#include <OgreFontManager.h>
 #include <OgreOverlayManager.h>
+#include <unordered_set>
 
 using namespace thrive;
 
@@ -57,10 +61,13 @@ TextOverlayComponent::TextOverlayComponent(
     Ogre::String name
 ) : m_name(name)
 {
+    m_properties.setComponent(this);
 }
 
 
-TextOverlayComponent::TextOverlayComponent() {}
+TextOverlayComponent::TextOverlayComponent() {
+    m_properties.setComponent(this);
+}
 
 
 void
@@ -122,6 +129,44 @@ TextOverlaySystem::luaBindings() {
 
 struct TextOverlaySystem::Implementation {
 
+    // The properties last passed to an overlay element. Setting any of
+    // them makes the element rebuild its geometry, so only the ones that
+    // differ are set.
+    struct AppliedProperties {
+
+        Ogre::Real charHeight = 0.0f;
+
+        Ogre::ColourValue colour;
+
+        Ogre::String fontName;
+
+        Ogre::Real height = 0.0f;
+
+        Ogre::GuiHorizontalAlignment horizontalAlignment = Ogre::GHA_LEFT;
+
+        Ogre::Real left = 0.0f;
+
+        Ogre::String text;
+
+        Ogre::Real top = 0.0f;
+
+        Ogre::GuiVerticalAlignment verticalAlignment = Ogre::GVA_TOP;
+
+        Ogre::Real width = 0.0f;
+
+    };
+
+    struct TextOverlay {
+
+        AppliedProperties applied;
+
+        Ogre::TextAreaOverlayElement* element = nullptr;
+
+        // Whether all properties have to be set
+        bool isNew = true;
+
+    };
+
     Implementation() {
         m_overlayManager = Ogre::OverlayManager::getSingletonPtr();
         Ogre::Overlay* overlay = m_overlayManager->getByName("text_overlay");
@@ -142,12 +187,87 @@ struct TextOverlaySystem::Implementation {
         m_overlay->add2D(m_panel);
     }
 
+    void
+    applyProperties(
+        TextOverlay& textOverlay,
+        const TextOverlayComponent::Properties& properties
+    ) {
+        Ogre::TextAreaOverlayElement* element = textOverlay.element;
+        AppliedProperties& applied = textOverlay.applied;
+        bool isNew = textOverlay.isNew;
+        textOverlay.isNew = false;
+        if (isNew or applied.left != properties.left or applied.top != properties.top) {
+            element->setPosition(properties.left, properties.top);
+            applied.left = properties.left;
+            applied.top = properties.top;
+        }
+        if (isNew or applied.width != properties.width or applied.height != properties.height) {
+            element->setDimensions(properties.width, properties.height);
+            applied.width = properties.width;
+            applied.height = properties.height;
+        }
+        if (isNew or applied.charHeight != properties.charHeight) {
+            element->setCharHeight(properties.charHeight);
+            applied.charHeight = properties.charHeight;
+        }
+        if (isNew or applied.colour != properties.colour) {
+            element->setColour(properties.colour);
+            applied.colour = properties.colour;
+        }
+        if (isNew or applied.fontName != properties.fontName) {
+            this->loadFont(properties.fontName);
+            element->setFontName(properties.fontName);
+            applied.fontName = properties.fontName;
+        }
+        if (isNew or applied.text != properties.text) {
+            element->setCaption(properties.text);
+            applied.text = properties.text;
+        }
+        if (isNew or applied.horizontalAlignment != properties.horizontalAlignment) {
+            element->setHorizontalAlignment(properties.horizontalAlignment);
+            applied.horizontalAlignment = properties.horizontalAlignment;
+        }
+        if (isNew or applied.verticalAlignment != properties.verticalAlignment) {
+            element->setVerticalAlignment(properties.verticalAlignment);
+            applied.verticalAlignment = properties.verticalAlignment;
+        }
+    }
+
+    // Renders a font's glyph texture once, before its first use, instead
+    // of on the first frame that shows it
+    void
+    loadFont(
+        const Ogre::String& fontName
+    ) {
+        if (m_loadedFonts.count(fontName) > 0) {
+            return;
+        }
+        Ogre::FontPtr font = Ogre::FontManager::getSingleton().getByName(fontName);
+        if (font.isNull()) {
+            // The overlay element reports the missing font
+            return;
+        }
+        font->load();
+        m_loadedFonts.insert(fontName);
+    }
+
+    // Element names are unique across game states, so that resident game
+    // states can keep overlays of the same name
+    Ogre::String
+    elementName(
+        const TextOverlayComponent* component
+    ) const {
+        return m_elementPrefix + component->name();
+    }
+
     void
     removeAllOverlays() {
         for (const auto& item : m_entities) {
             TextOverlayComponent* component = std::get<0>(item.second);
-            this->removeOverlayElement(component->name());
-            component->m_overlayElement = nullptr;
+            if (component->m_overlayElement) {
+                this->removeOverlayElement(component->m_overlayElement->getName());
+                component->m_overlayElement = nullptr;
+            }
         }
         m_textOverlays.clear();
     }
@@ -181,15 +301,37 @@ struct TextOverlaySystem::Implementation {
         auto textOverlayElement = static_cast<Ogre::TextAreaOverlayElement*>(
             m_overlayManager->createOverlayElement(
                 "TextArea",
-                component->name()
+                this->elementName(component)
             )
         );
         component->m_overlayElement = textOverlayElement;
-        m_textOverlays[entityId] = textOverlayElement;
+        TextOverlay& textOverlay = m_textOverlays[entityId];
+        textOverlay.element = textOverlayElement;
+        textOverlay.isNew = true;
         m_panel->addChild(textOverlayElement);
         textOverlayElement->setMetricsMode(Ogre::GMM_PIXELS);
+        // The new element needs all properties
+        component->m_properties.touch();
     }
 
+    void
+    setOverlaysVisible(
+        bool visible
+    ) {
+        for (const auto& pair : m_textOverlays) {
+            if (visible) {
+                pair.second.element->show();
+            }
+            else {
+                pair.second.element->hide();
+            }
+        }
+    }
+
+    ComponentCollection* m_collection = nullptr;
+
+    Ogre::String m_elementPrefix;
+
     EntityFilter<
         TextOverlayComponent
     > m_entities = {true};
@@ -200,13 +342,20 @@ struct TextOverlaySystem::Implementation {
 
     Ogre::OverlayContainer* m_panel = nullptr;
 
-    std::unordered_map<EntityId, Ogre::TextAreaOverlayElement*> m_textOverlays;
+    std::unordered_set<Ogre::String> m_loadedFonts;
+
+    std::unordered_map<EntityId, TextOverlay> m_textOverlays;
+
+    std::vector<Component*> m_touched;
 };
 
 
 TextOverlaySystem::TextOverlaySystem()
   : m_impl(new Implementation())
 {
+    this->declareGraphical();
+    this->setMainThreadOnly();
+    this->declareWrite(TextOverlayComponent::TYPE_ID);
 }
 
 
@@ -226,12 +375,30 @@ TextOverlaySystem::deactivate() {
 }
 
 
+void
+TextOverlaySystem::resume() {
+    m_impl->setOverlaysVisible(true);
+}
+
+
+void
+TextOverlaySystem::suspend() {
+    // The elements are shared by all game states, so only hide ours
+    m_impl->setOverlaysVisible(false);
+}
+
+
 void
 TextOverlaySystem::init(
     GameState* gameState
 ) {
     System::init(gameState);
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        TextOverlayComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
+    m_impl->m_elementPrefix = gameState->name() + "/";
     m_impl->m_overlay->show();
 }
 
@@ -239,6 +406,7 @@ TextOverlaySystem::init(
 void
 TextOverlaySystem::shutdown() {
     m_impl->m_overlay->hide();
+    m_impl->m_collection = nullptr;
     m_impl->m_entities.setEntityManager(nullptr);
     System::shutdown();
 }
@@ -246,40 +414,29 @@ TextOverlaySystem::shutdown() {
 
 void
 TextOverlaySystem::update(int) {
-    for (EntityId entityId : m_impl->m_entities.removedEntities()) {
-        Ogre::OverlayElement* textOverlay = m_impl->m_textOverlays[entityId];
-        m_impl->removeOverlayElement(textOverlay->getName());
-        m_impl->m_textOverlays.erase(entityId);
-    }
-    for (auto& value : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = value.first;
-        TextOverlayComponent* component = std::get<0>(value.second);
-        m_impl->restoreOverlayElement(
-            entityId,
-            component
-        );
-    }
-    m_impl->m_entities.clearChanges();
-    for (auto& value : m_impl->m_entities) {
-        TextOverlayComponent* textOverlayComponent = std::get<0>(value.second);
-        auto& properties = textOverlayComponent->m_properties;
-        if (properties.hasChanges()) {
-            Ogre::TextAreaOverlayElement* textOverlay = textOverlayComponent->m_overlayElement;
-            textOverlay->setPosition(
-                properties.left,
-                properties.top
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<TextOverlayComponent*>& group) {
+            TextOverlayComponent* component = std::get<0>(group);
+            m_impl->restoreOverlayElement(
+                entityId,
+                component
             );
-            textOverlay->setDimensions(
-                properties.width,
-                properties.height
+        },
+        [this] (EntityId entityId) {
+            Ogre::OverlayElement* textOverlay = m_impl->m_textOverlays[entityId].element;
+            m_impl->removeOverlayElement(textOverlay->getName());
+            m_impl->m_textOverlays.erase(entityId);
+        }
+    );
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* component : m_impl->m_touched) {
+        auto textOverlayComponent = static_cast<TextOverlayComponent*>(component);
+        auto& properties = textOverlayComponent->m_properties;
+        if (textOverlayComponent->m_overlayElement and properties.hasChanges()) {
+            m_impl->applyProperties(
+                m_impl->m_textOverlays[textOverlayComponent->owner()],
+                properties
             );
-            textOverlay->setCharHeight(properties.charHeight);
-            textOverlay->setColour(properties.colour);
-            textOverlay->setFontName(properties.fontName);
-            textOverlay->setCaption(properties.text);
-            textOverlay->setHorizontalAlignment(properties.horizontalAlignment);
-            textOverlay->setVerticalAlignment(properties.verticalAlignment);
-            // Untouch
             properties.untouch();
         }
     }
@@ -150,6 +150,11 @@ private:
 
 /**
 * @brief Creates, updates and removes text overlays
+*
+* Touching a component's properties only sets those on the overlay 
+* element that differ from the last values set, because every setter 
+* makes the element rebuild its geometry. Setting the same text again is
+* free. Fonts are loaded the first time an overlay uses them.
 */
 class TextOverlaySystem : public System {
     
@@ -180,6 +185,16 @@ public:
 
     void deactivate() override;
 
+    /**
+    * @brief Shows the overlays hidden by suspend()
+    */
+    void resume() override;
+
+    /**
+    * @brief Hides the overlays instead of destroying them
+    */
+    void suspend() override;
+
     /**
     * @brief Initializes the system
     *
@@ -0,0 +1,179 @@
+#include "ogre/transform_buffer.h"
+
+#include "ogre/scene_node_system.h"
+
+#include <OgreSceneNode.h>
+
+using namespace thrive;
+
+const size_t TransformBuffer::NO_SLOT;
+
+
+size_t
+TransformBuffer::add(
+    OgreSceneNodeComponent* component
+) {
+    size_t slot = 0;
+    if (m_freeSlots.empty()) {
+        slot = m_slots.size();
+        m_slots.emplace_back();
+    }
+    else {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_slots[slot] = Slot();
+    }
+    Slot& entry = m_slots[slot];
+    entry.component = component;
+    entry.orientation = component->m_transform.orientation;
+    entry.position = component->m_transform.position;
+    entry.previousOrientation = entry.orientation;
+    entry.previousPosition = entry.position;
+    // Apply the initial transform once
+    entry.isSettling = true;
+    this->startMoving(slot);
+    component->m_transformSlot = slot;
+    return slot;
+}
+
+
+void
+TransformBuffer::apply(
+    float interpolation
+) {
+    // Backwards, so that stopMoving() only swaps in processed slots
+    for (size_t i = m_moving.size(); i-- > 0; ) {
+        size_t slot = m_moving[i];
+        Slot& entry = m_slots[slot];
+        Ogre::SceneNode* sceneNode = entry.component->m_sceneNode;
+        if (not sceneNode) {
+            // Whoever creates the scene node applies the latest transform
+            if (entry.isSettling) {
+                this->stopMoving(slot);
+            }
+            continue;
+        }
+        sceneNode->setOrientation(Ogre::Quaternion::nlerp(
+            interpolation,
+            entry.previousOrientation,
+            entry.orientation,
+            true
+        ));
+        sceneNode->setPosition(
+            entry.previousPosition + 
+            (entry.position - entry.previousPosition) * interpolation
+        );
+        if (entry.isSettling) {
+            this->stopMoving(slot);
+        }
+    }
+}
+
+
+void
+TransformBuffer::clear() {
+    for (Slot& entry : m_slots) {
+        if (entry.component) {
+            entry.component->m_transformSlot = NO_SLOT;
+        }
+    }
+    m_freeSlots.clear();
+    m_moving.clear();
+    m_slots.clear();
+}
+
+
+void
+TransformBuffer::endTick() {
+    for (size_t slot : m_moving) {
+        Slot& entry = m_slots[slot];
+        if (entry.isSet) {
+            entry.isSet = false;
+        }
+        else {
+            // Nothing to blend anymore
+            entry.previousOrientation = entry.orientation;
+            entry.previousPosition = entry.position;
+            entry.isSettling = true;
+        }
+    }
+}
+
+
+size_t
+TransformBuffer::movingCount() const {
+    return m_moving.size();
+}
+
+
+void
+TransformBuffer::remove(
+    size_t slot
+) {
+    Slot& entry = m_slots[slot];
+    if (entry.movingIndex != NO_SLOT) {
+        this->stopMoving(slot);
+    }
+    entry.component->m_transformSlot = NO_SLOT;
+    entry.component = nullptr;
+    m_freeSlots.push_back(slot);
+}
+
+
+bool
+TransformBuffer::set(
+    size_t slot,
+    EntityId entityId,
+    const Ogre::Quaternion& orientation,
+    const Ogre::Vector3& position
+) {
+    Slot& entry = m_slots[slot];
+    if (not entry.component or entry.component->owner() != entityId) {
+        return false;
+    }
+    if (not entry.isSet) {
+        entry.previousOrientation = entry.orientation;
+        entry.previousPosition = entry.position;
+        entry.isSet = true;
+    }
+    entry.orientation = orientation;
+    entry.position = position;
+    entry.isSettling = false;
+    if (entry.movingIndex == NO_SLOT) {
+        this->startMoving(slot);
+    }
+    // Keep the component up to date for scripts, without queueing it
+    auto& transform = entry.component->m_transform;
+    transform.orientation = orientation;
+    transform.position = position;
+    transform.bumpVersion();
+    return true;
+}
+
+
+size_t
+TransformBuffer::size() const {
+    return m_slots.size() - m_freeSlots.size();
+}
+
+
+void
+TransformBuffer::startMoving(
+    size_t slot
+) {
+    m_slots[slot].movingIndex = m_moving.size();
+    m_moving.push_back(slot);
+}
+
+
+void
+TransformBuffer::stopMoving(
+    size_t slot
+) {
+    size_t index = m_slots[slot].movingIndex;
+    size_t lastSlot = m_moving.back();
+    m_moving[index] = lastSlot;
+    m_slots[lastSlot].movingIndex = index;
+    m_moving.pop_back();
+    m_slots[slot].movingIndex = NO_SLOT;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "engine/typedefs.h"
+
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+
+#include <limits>
+#include <vector>
+
+namespace thrive {
+
+class OgreSceneNodeComponent;
+
+/**
+* @brief Compact buffer of scene node transforms driven by another system
+*
+* A system that computes transforms at the game state's tick rate, like
+* the physics, can write them into slots of this buffer instead of
+* touching the OgreSceneNodeComponent::m_transform of each scene node. The
+* OgreUpdateSceneNodeSystem applies all moving slots to their scene nodes
+* in one pass each frame, blending between the last two ticks.
+*
+* The buffer also writes the latest orientation and position into the
+* component's \c m_transform, without touching it, so that scripts see
+* the same values as before. The scale is not handled by the buffer.
+*
+* Slots that have not been set during a tick are applied one last time
+* and then left alone until they are set again.
+*/
+class TransformBuffer {
+
+public:
+
+    /**
+    * @brief Marks a component without a slot
+    */
+    static const size_t NO_SLOT = std::numeric_limits<size_t>::max();
+
+    /**
+    * @brief Assigns a slot to a scene node component
+    *
+    * The slot starts out with the component's current transform and is
+    * applied in the next apply(). The slot is stored in the component's
+    * \c m_transformSlot.
+    *
+    * @param component
+    *   The component whose scene node the slot drives
+    *
+    * @return
+    *   The slot
+    */
+    size_t
+    add(
+        OgreSceneNodeComponent* component
+    );
+
+    /**
+    * @brief Blends the moving slots and applies them to their scene nodes
+    *
+    * Slots without a scene node are skipped. Whoever creates the scene
+    * node is expected to touch the component's \c m_transform, which has
+    * the latest transform.
+    *
+    * @param interpolation
+    *   How far the game state is between the last and the next tick, see
+    *   GameState::tickInterpolation()
+    */
+    void
+    apply(
+        float interpolation
+    );
+
+    /**
+    * @brief Frees all slots
+    */
+    void
+    clear();
+
+    /**
+    * @brief Ends the current tick
+    *
+    * Slots that have not been set since the last call stop blending and
+    * settle on their latest transform.
+    */
+    void
+    endTick();
+
+    /**
+    * @brief The number of slots that will be applied in the next frame
+    */
+    size_t
+    movingCount() const;
+
+    /**
+    * @brief Frees a slot
+    *
+    * Resets the component's \c m_transformSlot. The slot may be reused by
+    * the next add().
+    *
+    * @param slot
+    *   A slot returned by add()
+    */
+    void
+    remove(
+        size_t slot
+    );
+
+    /**
+    * @brief Sets the transform of the current tick
+    *
+    * Setting a slot several times in one tick keeps the transform of the
+    * last tick as the one to blend from.
+    *
+    * @param slot
+    *   A slot returned by add()
+    * @param entityId
+    *   The entity the slot was assigned for. If the slot has been freed
+    *   or reassigned since, nothing is set.
+    * @param orientation
+    * @param position
+    *
+    * @return
+    *   \c true if the slot still belongs to \a entityId, \c false otherwise
+    */
+    bool
+    set(
+        size_t slot,
+        EntityId entityId,
+        const Ogre::Quaternion& orientation,
+        const Ogre::Vector3& position
+    );
+
+    /**
+    * @brief The number of assigned slots
+    */
+    size_t
+    size() const;
+
+private:
+
+    struct Slot {
+
+        // Index in m_moving, or NO_SLOT
+        size_t movingIndex = NO_SLOT;
+
+        Ogre::Quaternion orientation = Ogre::Quaternion::IDENTITY;
+
+        Ogre::Vector3 position = Ogre::Vector3::ZERO;
+
+        Ogre::Quaternion previousOrientation = Ogre::Quaternion::IDENTITY;
+
+        Ogre::Vector3 previousPosition = Ogre::Vector3::ZERO;
+
+        // nullptr if the slot is free
+        OgreSceneNodeComponent* component = nullptr;
+
+        // Whether the slot has been set in the current tick
+        bool isSet = false;
+
+        // Whether the slot gets applied one last time
+        bool isSettling = false;
+
+    };
+
+    void
+    startMoving(
+        size_t slot
+    );
+
+    void
+    stopMoving(
+        size_t slot
+    );
+
+    std::vector<size_t> m_freeSlots;
+
+    // Slots to apply in the next frame
+    std::vector<size_t> m_moving;
+
+    std::vector<Slot> m_slots;
+
+};
+
+}
@@ -1,5 +1,6 @@
 #include "ogre/viewport_system.h"
 
+#include "engine/component_collection.h"
 #include "engine/component_factory.h"
 #include "engine/engine.h"
 #include "engine/entity.h"
@@ -9,10 +10,13 @@
 #include "engine/serialization.h"
 #include "game.h"
 #include "ogre/camera_system.h"
+#include "ogre/scene_node_system.h"
 #include "scripting/luabind.h"
 
 #include <luabind/adopt_policy.hpp>
+#include <OgreCamera.h>
 #include <OgreRenderWindow.h>
+#include <OgreSceneNode.h>
 #include <OgreViewport.h>
 
 #include <iostream>
@@ -63,6 +67,7 @@ OgreViewportComponent::OgreViewportComponent(
     int zOrder
 ) : m_zOrder(zOrder)
 {
+    m_properties.setComponent(this);
 }
 
 
@@ -125,6 +130,33 @@ struct OgreViewportSystem::Implementation {
     }
 
 
+    void
+    updateOnScreen() {
+        m_cameras.clear();
+        for (const auto& pair : m_viewports) {
+            Ogre::Camera* camera = pair.second->getCamera();
+            if (camera) {
+                m_cameras.push_back(camera);
+            }
+        }
+        for (const auto& component : m_sceneNodes->components()) {
+            auto sceneNodeComponent = static_cast<OgreSceneNodeComponent*>(component.get());
+            Ogre::SceneNode* sceneNode = sceneNodeComponent->m_sceneNode;
+            bool isOnScreen = false;
+            if (sceneNode) {
+                // Includes the children's bounds
+                const Ogre::AxisAlignedBox& bounds = sceneNode->_getWorldAABB();
+                for (Ogre::Camera* camera : m_cameras) {
+                    if (camera->isVisible(bounds)) {
+                        isOnScreen = true;
+                        break;
+                    }
+                }
+            }
+            sceneNodeComponent->m_isOnScreen = isOnScreen;
+        }
+    }
+
     void
     removeAllViewports() {
         for (const auto& item : m_entities) {
@@ -183,14 +215,25 @@ struct OgreViewportSystem::Implementation {
             entityId,
             viewport
         );
+        // The new viewport needs all properties
+        component->m_properties.touch();
     }
 
+    // Scratch space for updateOnScreen()
+    std::vector<Ogre::Camera*> m_cameras;
+
+    ComponentCollection* m_collection = nullptr;
+
     EntityFilter<OgreViewportComponent> m_entities = {true};
 
     Ogre::RenderWindow* m_renderWindow = nullptr;
 
+    ComponentCollection* m_sceneNodes = nullptr;
+
     OgreViewportSystem& m_system;
 
+    std::vector<Component*> m_touched;
+
     std::unordered_map<EntityId, Ogre::Viewport*> m_viewports;
 
 };
@@ -199,6 +242,7 @@ struct OgreViewportSystem::Implementation {
 OgreViewportSystem::OgreViewportSystem()
   : m_impl(new Implementation(*this))
 {
+    this->declareGraphical();
 }
 
 
@@ -225,6 +269,13 @@ OgreViewportSystem::init(
     System::init(gameState);
     m_impl->m_renderWindow = this->engine()->renderWindow();
     m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    m_impl->m_collection = &gameState->entityManager().getComponentCollection(
+        OgreViewportComponent::TYPE_ID
+    );
+    m_impl->m_collection->trackTouched();
+    m_impl->m_sceneNodes = &gameState->entityManager().getComponentCollection(
+        OgreSceneNodeComponent::TYPE_ID
+    );
 }
 
 
@@ -232,29 +283,32 @@ OgreViewportSystem::init(
 
 void
 OgreViewportSystem::shutdown() {
+    m_impl->m_collection = nullptr;
     m_impl->m_entities.setEntityManager(nullptr);
     m_impl->m_renderWindow = nullptr;
+    m_impl->m_sceneNodes = nullptr;
     System::shutdown();
 }
 
 
 void
 OgreViewportSystem::update(int) {
-    for (EntityId id : m_impl->m_entities.removedEntities()) {
-        Ogre::Viewport* viewport = m_impl->m_viewports[id];
-        m_impl->removeViewport(viewport);
-    }
-    for (const auto& item : m_impl->m_entities.addedEntities()) {
-        EntityId entityId = item.first;
-        OgreViewportComponent* component = std::get<0>(item.second);
-        m_impl->restoreViewport(entityId, component);
-    }
-    m_impl->m_entities.clearChanges();
-    for (const auto& item : m_impl->m_entities) {
-        OgreViewportComponent* viewportComponent = std::get<0>(item.second);
+    m_impl->m_entities.takeChanges(
+        [this] (EntityId entityId, const std::tuple<OgreViewportComponent*>& group) {
+            OgreViewportComponent* component = std::get<0>(group);
+            m_impl->restoreViewport(entityId, component);
+        },
+        [this] (EntityId entityId) {
+            Ogre::Viewport* viewport = m_impl->m_viewports[entityId];
+            m_impl->removeViewport(viewport);
+        }
+    );
+    m_impl->m_collection->takeTouched(m_impl->m_touched);
+    for (Component* component : m_impl->m_touched) {
+        auto viewportComponent = static_cast<OgreViewportComponent*>(component);
         auto& properties = viewportComponent->m_properties;
-        if (properties.hasChanges()) {
-            Ogre::Viewport* viewport = viewportComponent->m_viewport;
+        Ogre::Viewport* viewport = viewportComponent->m_viewport;
+        if (viewport and properties.hasChanges()) {
             auto cameraComponent = this->entityManager()->getComponent<OgreCameraComponent>(
                 properties.cameraEntity
             );
@@ -276,6 +330,7 @@ OgreViewportSystem::update(int) {
             properties.untouch();
         }
     }
+    m_impl->updateOnScreen();
 }
 
 
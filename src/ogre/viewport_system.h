@@ -150,6 +150,11 @@ private:
 
 /**
 * @brief Creates, updates and removes viewports
+*
+* Also sets OgreSceneNodeComponent::m_isOnScreen of every scene node to 
+* whether its bounding box is in the view frustum of a viewport's camera.
+* Occlusion is not considered. The bounding boxes are those Ogre computed
+* when it last rendered, so the result lags one frame behind.
 */
 class OgreViewportSystem : public System {
     
@@ -0,0 +1,557 @@
+#include "ogre/world_sector_system.h"
+
+#include "engine/compression.h"
+#include "engine/component_factory.h"
+#include "engine/creation_queue.h"
+#include "engine/engine.h"
+#include "engine/entity_filter.h"
+#include "engine/entity_manager.h"
+#include "engine/entity_prototype.h"
+#include "engine/game_state.h"
+#include "engine/idle_tasks.h"
+#include "engine/serialization.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+struct SectorCoordinates {
+
+    int32_t x;
+
+    int32_t y;
+
+};
+
+
+int64_t
+sectorKey(
+    SectorCoordinates sector
+) {
+    return (static_cast<int64_t>(sector.x) << 32) | static_cast<uint32_t>(sector.y);
+}
+
+
+// The larger of the distances along the axes, in sectors
+int64_t
+sectorDistance(
+    SectorCoordinates lhs,
+    SectorCoordinates rhs
+) {
+    return std::max(
+        std::abs(static_cast<int64_t>(lhs.x) - rhs.x),
+        std::abs(static_cast<int64_t>(lhs.y) - rhs.y)
+    );
+}
+
+
+std::string
+encodeEntities(
+    const StorageList& entities
+) {
+    StorageContainer storage;
+    storage.set<StorageList>("entities", entities);
+    std::ostringstream raw(std::ios::binary);
+    saveStorage(raw, storage);
+    std::ostringstream compressed(std::ios::binary);
+    writeCompressed(compressed, raw.str(), CompressionLevel::Fast);
+    return compressed.str();
+}
+
+
+StorageList
+decodeEntities(
+    const std::string& data
+) {
+    std::istringstream source(data, std::ios::binary);
+    CompressedInputStream stream(source);
+    StorageContainer storage;
+    loadStorage(stream, storage);
+    return storage.get<StorageList>("entities");
+}
+
+
+// The compressed and the pending entities of a sector
+StorageList
+sectorEntities(
+    const WorldSectorStoreComponent::Sector& sector
+) {
+    StorageList entities;
+    if (not sector.m_data.empty()) {
+        entities = decodeEntities(sector.m_data);
+    }
+    for (const StorageContainer& entity : sector.m_pendingEntities) {
+        entities.append(entity);
+    }
+    return entities;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// WorldSectorComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+WorldSectorComponent::luaBindings() {
+    using namespace luabind;
+    return class_<WorldSectorComponent, Component>("WorldSectorComponent")
+        .enum_("ID") [
+            value("TYPE_ID", WorldSectorComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &WorldSectorComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+    ;
+}
+
+void
+WorldSectorComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+}
+
+
+StorageContainer
+WorldSectorComponent::storage() const {
+    return Component::storage();
+}
+
+REGISTER_COMPONENT(WorldSectorComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// WorldSectorStoreComponent
+////////////////////////////////////////////////////////////////////////////////
+
+luabind::scope
+WorldSectorStoreComponent::luaBindings() {
+    using namespace luabind;
+    return class_<WorldSectorStoreComponent, Component>("WorldSectorStoreComponent")
+        .enum_("ID") [
+            value("TYPE_ID", WorldSectorStoreComponent::TYPE_ID)
+        ]
+        .scope [
+            def("TYPE_NAME", &WorldSectorStoreComponent::TYPE_NAME)
+        ]
+        .def(constructor<>())
+    ;
+}
+
+
+void
+WorldSectorStoreComponent::load(
+    const StorageContainer& storage
+) {
+    Component::load(storage);
+    m_sectors.clear();
+    StorageList sectors = storage.get<StorageList>("sectors");
+    for (const StorageContainer& sectorStorage : sectors) {
+        Sector sector;
+        sector.m_data = sectorStorage.get<std::string>("data");
+        sector.m_entityCount = sectorStorage.get<int32_t>("entityCount");
+        m_sectors[sectorStorage.get<int64_t>("key")] = std::move(sector);
+    }
+}
+
+
+StorageContainer
+WorldSectorStoreComponent::storage() const {
+    StorageContainer storage = Component::storage();
+    StorageList sectors;
+    sectors.reserve(m_sectors.size());
+    for (const auto& pair : m_sectors) {
+        StorageContainer sectorStorage;
+        sectorStorage.set<int64_t>("key", pair.first);
+        if (pair.second.m_pendingEntities.empty()) {
+            sectorStorage.set<std::string>("data", pair.second.m_data);
+        }
+        else {
+            sectorStorage.set<std::string>("data", encodeEntities(sectorEntities(pair.second)));
+        }
+        sectorStorage.set<int32_t>("entityCount", pair.second.m_entityCount);
+        sectors.append(std::move(sectorStorage));
+    }
+    storage.set<StorageList>("sectors", std::move(sectors));
+    return storage;
+}
+
+REGISTER_COMPONENT(WorldSectorStoreComponent)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// WorldSectorSystem
+////////////////////////////////////////////////////////////////////////////////
+
+const std::string WorldSectorSystem::STORE_ENTITY_NAME = "worldSectorStore";
+
+
+luabind::scope
+WorldSectorSystem::luaBindings() {
+    using namespace luabind;
+    return class_<WorldSectorSystem, System>("WorldSectorSystem")
+        .scope [
+            def("find", &WorldSectorSystem::find)
+        ]
+        .def(constructor<>())
+        .def(constructor<Ogre::Real>())
+        .def("isSectorGenerated", &WorldSectorSystem::isSectorGenerated)
+        .def("sectorSize", &WorldSectorSystem::sectorSize)
+        .def("setCenterEntity", &WorldSectorSystem::setCenterEntity)
+        .def("setRadii", &WorldSectorSystem::setRadii)
+        .def("storedEntityCount", &WorldSectorSystem::storedEntityCount)
+    ;
+}
+
+
+struct WorldSectorSystem::Implementation {
+
+    Implementation(
+        Ogre::Real sectorSize
+    ) : m_sectorSize(sectorSize)
+    {
+    }
+
+    SectorCoordinates
+    sectorOf(
+        const Ogre::Vector3& position
+    ) const {
+        return SectorCoordinates{
+            static_cast<int32_t>(std::floor(position.x / m_sectorSize)),
+            static_cast<int32_t>(std::floor(position.y / m_sectorSize))
+        };
+    }
+
+    // Run by the idle tasks
+    bool
+    compressNextSector() {
+        if (not m_store or m_pendingSectors.empty()) {
+            return false;
+        }
+        int64_t key = m_pendingSectors.back();
+        m_pendingSectors.pop_back();
+        auto iter = m_store->m_sectors.find(key);
+        // Restored since it was stored
+        if (iter != m_store->m_sectors.end() and not iter->second.m_pendingEntities.empty()) {
+            WorldSectorStoreComponent::Sector& sector = iter->second;
+            sector.m_data = encodeEntities(sectorEntities(sector));
+            sector.m_pendingEntities = StorageList();
+        }
+        return not m_pendingSectors.empty();
+    }
+
+    // Sectors that were active around the previous center but aren't
+    // anymore become generated, even if they hold no entities
+    void
+    markGenerated(
+        SectorCoordinates center
+    ) {
+        if (not m_hasPreviousCenter) {
+            return;
+        }
+        int64_t radius = m_unloadRadius;
+        SectorCoordinates previous = m_previousCenter;
+        for (int64_t x = previous.x - radius; x <= previous.x + radius; ++x) {
+            for (int64_t y = previous.y - radius; y <= previous.y + radius; ++y) {
+                SectorCoordinates sector{
+                    static_cast<int32_t>(x),
+                    static_cast<int32_t>(y)
+                };
+                if (sectorDistance(sector, center) > radius) {
+                    // Leaves stored sectors alone
+                    m_store->m_sectors[sectorKey(sector)];
+                }
+            }
+        }
+    }
+
+    // Run by the creation queue
+    void
+    restoreSector(
+        SectorCoordinates sector
+    ) {
+        int64_t key = sectorKey(sector);
+        m_queuedSectors.erase(key);
+        // Out of range again while it was queued
+        if (
+            not m_store or
+            not m_hasPreviousCenter or
+            sectorDistance(sector, m_previousCenter) > m_loadRadius
+        ) {
+            return;
+        }
+        auto iter = m_store->m_sectors.find(key);
+        if (iter == m_store->m_sectors.end() or iter->second.m_entityCount == 0) {
+            return;
+        }
+        EntityManager& entityManager = *m_system->entityManager();
+        const ComponentFactory& factory = m_system->engine()->componentFactory();
+        EntityPrototype prototype;
+        for (const StorageContainer& entity : sectorEntities(iter->second)) {
+            prototype.load(entity);
+            prototype.deferInstantiate(entityManager, factory);
+        }
+        m_storedEntityCount -= iter->second.m_entityCount;
+        iter->second.m_data.clear();
+        iter->second.m_entityCount = 0;
+        iter->second.m_pendingEntities = StorageList();
+    }
+
+    // Queues the stored sectors in range, nearest to the center entity 
+    // first
+    void
+    restoreSectors(
+        SectorCoordinates center,
+        const Ogre::Vector3& position
+    ) {
+        CreationQueue& queue = m_system->gameState()->creationQueue();
+        int64_t radius = m_loadRadius;
+        for (int64_t x = center.x - radius; x <= center.x + radius; ++x) {
+            for (int64_t y = center.y - radius; y <= center.y + radius; ++y) {
+                SectorCoordinates sector{
+                    static_cast<int32_t>(x),
+                    static_cast<int32_t>(y)
+                };
+                int64_t key = sectorKey(sector);
+                auto iter = m_store->m_sectors.find(key);
+                if (iter == m_store->m_sectors.end() or iter->second.m_entityCount == 0) {
+                    continue;
+                }
+                if (not m_queuedSectors.insert(key).second) {
+                    continue;
+                }
+                Ogre::Vector3 sectorCenter(
+                    (sector.x + 0.5f) * m_sectorSize,
+                    (sector.y + 0.5f) * m_sectorSize,
+                    position.z
+                );
+                queue.push(
+                    [this, sector] () {
+                        this->restoreSector(sector);
+                    },
+                    sectorCenter.squaredDistance(position)
+                );
+            }
+        }
+    }
+
+    void
+    storeSectors(
+        SectorCoordinates center
+    ) {
+        EntityManager& entityManager = *m_system->entityManager();
+        for (const auto& item : m_entities) {
+            EntityId entityId = item.first;
+            // Children are removed and restored with their parent
+            if (entityManager.parent(entityId) != NULL_ENTITY) {
+                continue;
+            }
+            OgreSceneNodeComponent* sceneNodeComponent = std::get<1>(item.second);
+            SectorCoordinates sector = this->sectorOf(sceneNodeComponent->m_transform.position);
+            if (sectorDistance(sector, center) > m_unloadRadius) {
+                m_leaving[sectorKey(sector)].push_back(entityId);
+            }
+        }
+        for (auto& pair : m_leaving) {
+            WorldSectorStoreComponent::Sector& sector = m_store->m_sectors[pair.first];
+            // Entities can wander into sectors that are already stored
+            if (sector.m_pendingEntities.empty()) {
+                m_pendingSectors.push_back(pair.first);
+            }
+            for (EntityId entityId : pair.second) {
+                sector.m_pendingEntities.append(EntityPrototype(entityManager, entityId).storage());
+                entityManager.removeEntity(entityId);
+            }
+            sector.m_entityCount += pair.second.size();
+            m_storedEntityCount += pair.second.size();
+        }
+        m_leaving.clear();
+    }
+
+    void
+    updateStore() {
+        EntityManager& entityManager = *m_system->entityManager();
+        auto store = entityManager.getOrCreateComponent<WorldSectorStoreComponent>(
+            entityManager.getNamedId(STORE_ENTITY_NAME)
+        );
+        if (store != m_store) {
+            // First update or a loaded game state
+            m_pendingSectors.clear();
+            m_queuedSectors.clear();
+            m_store = store;
+            m_storedEntityCount = 0;
+            for (const auto& pair : m_store->m_sectors) {
+                m_storedEntityCount += pair.second.m_entityCount;
+            }
+        }
+    }
+
+    EntityManager::NameId m_centerName = EntityManager::NULL_NAME;
+
+    EntityFilter<
+        WorldSectorComponent,
+        OgreSceneNodeComponent
+    > m_entities;
+
+    bool m_hasPreviousCenter = false;
+
+    IdleTasks::TaskId m_idleTask = 0;
+
+    // The entities to store in this update, by sector key
+    std::unordered_map<int64_t, std::vector<EntityId>> m_leaving;
+
+    unsigned int m_loadRadius = 1;
+
+    // Sectors with entities waiting to be compressed, by sector key
+    std::vector<int64_t> m_pendingSectors;
+
+    SectorCoordinates m_previousCenter = {0, 0};
+
+    // Sectors waiting in the creation queue, by sector key
+    std::unordered_set<int64_t> m_queuedSectors;
+
+    Ogre::Real m_sectorSize;
+
+    WorldSectorStoreComponent* m_store = nullptr;
+
+    size_t m_storedEntityCount = 0;
+
+    WorldSectorSystem* m_system = nullptr;
+
+    unsigned int m_unloadRadius = 2;
+
+};
+
+
+WorldSectorSystem*
+WorldSectorSystem::find(
+    GameState* gameState
+) {
+    return gameState->findSystem<WorldSectorSystem>();
+}
+
+
+WorldSectorSystem::WorldSectorSystem(
+    Ogre::Real sectorSize
+) : m_impl(new Implementation(sectorSize))
+{
+    if (not (sectorSize > 0.0f)) {
+        throw std::invalid_argument("Sector size must be positive");
+    }
+    m_impl->m_system = this;
+    // Copies and creates entities through the component factory, which may
+    // call into Lua
+    this->setMainThreadOnly();
+    this->declareRead(OgreSceneNodeComponent::TYPE_ID);
+    this->declareWrite(WorldSectorComponent::TYPE_ID);
+    this->declareWrite(WorldSectorStoreComponent::TYPE_ID);
+}
+
+
+WorldSectorSystem::~WorldSectorSystem() {}
+
+
+void
+WorldSectorSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_entities.setEntityManager(&gameState->entityManager());
+    Implementation* impl = m_impl.get();
+    m_impl->m_idleTask = this->engine()->idleTasks().add([impl] () {
+        return impl->compressNextSector();
+    });
+}
+
+
+bool
+WorldSectorSystem::isSectorGenerated(
+    const Ogre::Vector3& position
+) const {
+    if (not m_impl->m_store) {
+        return false;
+    }
+    int64_t key = sectorKey(m_impl->sectorOf(position));
+    return m_impl->m_store->m_sectors.count(key) > 0;
+}
+
+
+Ogre::Real
+WorldSectorSystem::sectorSize() const {
+    return m_impl->m_sectorSize;
+}
+
+
+void
+WorldSectorSystem::setCenterEntity(
+    const std::string& name
+) {
+    m_impl->m_centerName = EntityManager::internName(name);
+}
+
+
+void
+WorldSectorSystem::setRadii(
+    unsigned int loadRadius,
+    unsigned int unloadRadius
+) {
+    if (unloadRadius < loadRadius) {
+        throw std::invalid_argument("Unload radius must not be smaller than load radius");
+    }
+    m_impl->m_loadRadius = loadRadius;
+    m_impl->m_unloadRadius = unloadRadius;
+}
+
+
+void
+WorldSectorSystem::shutdown() {
+    m_impl->m_entities.setEntityManager(nullptr);
+    this->engine()->idleTasks().remove(m_impl->m_idleTask);
+    m_impl->m_idleTask = 0;
+    m_impl->m_pendingSectors.clear();
+    m_impl->m_queuedSectors.clear();
+    m_impl->m_store = nullptr;
+    m_impl->m_storedEntityCount = 0;
+    m_impl->m_hasPreviousCenter = false;
+    System::shutdown();
+}
+
+
+size_t
+WorldSectorSystem::storedEntityCount() const {
+    return m_impl->m_storedEntityCount;
+}
+
+
+void
+WorldSectorSystem::update(int) {
+    if (m_impl->m_centerName == EntityManager::NULL_NAME) {
+        return;
+    }
+    EntityManager& entityManager = *this->entityManager();
+    auto centerNode = entityManager.getComponent<OgreSceneNodeComponent>(
+        entityManager.getNamedId(m_impl->m_centerName)
+    );
+    if (not centerNode) {
+        return;
+    }
+    m_impl->updateStore();
+    SectorCoordinates center = m_impl->sectorOf(centerNode->m_transform.position);
+    m_impl->markGenerated(center);
+    m_impl->storeSectors(center);
+    m_impl->restoreSectors(center, centerNode->m_transform.position);
+    m_impl->m_previousCenter = center;
+    m_impl->m_hasPreviousCenter = true;
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "engine/component.h"
+#include "engine/serialization.h"
+#include "engine/system.h"
+#include "engine/typedefs.h"
+
+#include <cstdint>
+#include <memory>
+#include <OgreVector3.h>
+#include <string>
+#include <unordered_map>
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Lets the WorldSectorSystem store an entity with its sector
+*
+* Requires an OgreSceneNodeComponent without a parent, its position
+* determines the sector.
+*/
+class WorldSectorComponent : public Component {
+    COMPONENT(WorldSector)
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - WorldSectorComponent()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    StorageContainer
+    storage() const override;
+
+};
+
+
+/**
+* @brief Holds the stored sectors of a WorldSectorSystem
+*
+* Lives on an entity of its own, so that stored sectors are saved with the
+* game state like any other component. Don't use this directly.
+*/
+class WorldSectorStoreComponent : public Component {
+    COMPONENT(WorldSectorStore)
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - WorldSectorStoreComponent()
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    void
+    load(
+        const StorageContainer& storage
+    ) override;
+
+    StorageContainer
+    storage() const override;
+
+    /**
+    * @brief The stored entities of a sector
+    */
+    struct Sector {
+
+        /**
+        * @brief The entities' prototypes, compressed
+        */
+        std::string m_data;
+
+        /**
+        * @brief The number of entities in m_data and m_pendingEntities
+        */
+        uint32_t m_entityCount = 0;
+
+        /**
+        * @brief Entities stored since m_data was last compressed
+        *
+        * Compressed into m_data in idle time, or when the store is 
+        * saved.
+        */
+        StorageList m_pendingEntities;
+
+    };
+
+    /**
+    * @brief The stored sectors, by sector key
+    *
+    * Sectors whose entities have been restored keep an empty entry, it
+    * marks them as generated.
+    */
+    std::unordered_map<int64_t, Sector> m_sectors;
+
+};
+
+
+/**
+* @brief Partitions the world into sectors and stores those out of range
+*
+* The x/y plane is divided into square sectors. Sectors within the load
+* radius around the center entity's sector are active. Once a sector is
+* beyond the unload radius, its entities with a WorldSectorComponent are
+* serialized and removed. They are restored when the sector comes within
+* the load radius again. The gap between the two radii keeps sectors at
+* the border from being stored and restored every frame. Stored entities
+* are compressed later, one sector per step of the engine's IdleTasks.
+*
+* Restoring a sector is a job of the game state's CreationQueue, so
+* several sectors coming into range are restored over a few frames,
+* nearest first. A sector that leaves the load radius before its job runs
+* stays stored.
+*
+* Stored sectors are frozen, nothing about them is simulated. Active
+* sectors far from the center can be simulated at a coarser rate with the
+* SimulationLodSystem.
+*
+* Entities are copied like EntityPrototype does, through their
+* components' storage. Children are not stored, they are removed with
+* their parent and have to be recreated when it is restored, like
+* organelles are.
+*
+* A sector is generated once it has left the unload radius for the first
+* time. From then on its contents come from the store, so the SpawnSystem
+* no longer spawns entities in it, see isSectorGenerated().
+*/
+class WorldSectorSystem : public System {
+
+public:
+
+    /**
+    * @brief The name of the entity holding the stored sectors
+    */
+    static const std::string STORE_ENTITY_NAME;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - WorldSectorSystem()
+    * - WorldSectorSystem(sectorSize)
+    * - WorldSectorSystem::find
+    * - WorldSectorSystem::isSectorGenerated
+    * - WorldSectorSystem::sectorSize
+    * - WorldSectorSystem::setCenterEntity
+    * - WorldSectorSystem::setRadii
+    * - WorldSectorSystem::storedEntityCount
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Finds the world sector system of a game state
+    *
+    * @param gameState
+    *   The game state to search
+    *
+    * @return
+    *   The game state's world sector system or \c nullptr if it has none
+    */
+    static WorldSectorSystem*
+    find(
+        GameState* gameState
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param sectorSize
+    *   The edge length of a sector. Must be positive.
+    */
+    WorldSectorSystem(
+        Ogre::Real sectorSize = 100.0f
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~WorldSectorSystem();
+
+    /**
+    * @brief Initializes the system
+    *
+    * @param gameState
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief Whether the contents of a position's sector come from the store
+    *
+    * @param position
+    *   Any position in the sector
+    */
+    bool
+    isSectorGenerated(
+        const Ogre::Vector3& position
+    ) const;
+
+    /**
+    * @brief The edge length of a sector
+    */
+    Ogre::Real
+    sectorSize() const;
+
+    /**
+    * @brief Sets the entity whose sector is the center of the active ones
+    *
+    * Usually the player.
+    *
+    * @param name
+    *   The name of the entity
+    */
+    void
+    setCenterEntity(
+        const std::string& name
+    );
+
+    /**
+    * @brief Sets the radii of the active sectors, in sectors
+    *
+    * The radii are measured along the axes, so the active sectors form a
+    * square. The defaults are \c 1 and \c 2.
+    *
+    * @param loadRadius
+    *   Stored sectors within this radius are restored
+    * @param unloadRadius
+    *   Sectors beyond this radius are stored. Must not be smaller than
+    *   \a loadRadius.
+    */
+    void
+    setRadii(
+        unsigned int loadRadius,
+        unsigned int unloadRadius
+    );
+
+    /**
+    * @brief Shuts the system down
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief The number of entities in stored sectors
+    */
+    size_t
+    storedEntityCount() const;
+
+    /**
+    * @brief Stores and restores sectors
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
@@ -0,0 +1,252 @@
+#include "scripting/lua_allocator.h"
+
+#include "engine/allocation_tracker.h"
+#include "engine/pool_allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace thrive;
+
+namespace {
+
+// Blocks a thread keeps per size class before it returns some
+const size_t CACHE_CAPACITY = 64;
+
+// Blocks moved between a thread cache and a pool at once
+const size_t CACHE_BATCH = 32;
+
+// Blocks per pool chunk
+const size_t BLOCKS_PER_CHUNK = 256;
+
+enum class CacheState {
+    Unused,
+    Open,
+    Closed
+};
+
+}
+
+
+struct LuaAllocator::ThreadCache {
+
+    void* blocks[CLASS_COUNT][CACHE_CAPACITY];
+
+    size_t counts[CLASS_COUNT];
+
+    CacheState state;
+
+};
+
+
+struct LuaAllocator::CacheFlusher {
+
+    ~CacheFlusher() {
+        LuaAllocator::instance().flushCache();
+    }
+
+};
+
+
+// Trivially destructible, so that it is zero initialized and still usable
+// while other thread locals are destroyed
+thread_local LuaAllocator::ThreadCache LuaAllocator::t_cache;
+
+thread_local LuaAllocator::CacheFlusher LuaAllocator::t_flusher;
+
+
+static size_t
+sizeClass(
+    size_t size
+) {
+    return (size - 1) / LuaAllocator::SIZE_CLASS_STEP;
+}
+
+
+void*
+LuaAllocator::allocate(
+    void* userData,
+    void* pointer,
+    size_t oldSize,
+    size_t newSize
+) {
+    LuaAllocator* self = static_cast<LuaAllocator*>(userData);
+    if (newSize == 0) {
+        if (pointer) {
+            self->freeBlock(pointer, oldSize);
+        }
+        return nullptr;
+    }
+    try {
+        if (not pointer) {
+            // oldSize is the object type or 0 here
+#ifdef THRIVE_TRACK_ALLOCATIONS
+            AllocationTracker::record(newSize);
+#endif
+            return self->allocateBlock(newSize);
+        }
+#ifdef THRIVE_TRACK_ALLOCATIONS
+        if (newSize > oldSize) {
+            AllocationTracker::record(newSize - oldSize);
+        }
+#endif
+        return self->reallocateBlock(pointer, oldSize, newSize);
+    }
+    catch (const std::bad_alloc&) {
+        // Lua raises a memory error
+        return nullptr;
+    }
+}
+
+
+LuaAllocator&
+LuaAllocator::instance() {
+    static LuaAllocator* allocator = new LuaAllocator();
+    return *allocator;
+}
+
+
+LuaAllocator::LuaAllocator()
+  : m_largeBytes(0),
+    m_requestedBytes(0)
+{
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        m_pools.emplace_back(new PoolAllocator(
+            (i + 1) * SIZE_CLASS_STEP,
+            BLOCKS_PER_CHUNK
+        ));
+    }
+}
+
+
+LuaAllocator::~LuaAllocator() = default;
+
+
+void*
+LuaAllocator::allocateBlock(
+    size_t size
+) {
+    if (size > MAX_POOLED_SIZE) {
+        void* block = std::malloc(size);
+        if (not block) {
+            throw std::bad_alloc();
+        }
+        m_largeBytes.fetch_add(size, std::memory_order_relaxed);
+        m_requestedBytes.fetch_add(size, std::memory_order_relaxed);
+        return block;
+    }
+    size_t index = sizeClass(size);
+    ThreadCache& cache = this->threadCache();
+    void* block = nullptr;
+    if (cache.state != CacheState::Open) {
+        block = m_pools[index]->allocate();
+    }
+    else {
+        size_t& count = cache.counts[index];
+        if (count == 0) {
+            m_pools[index]->allocateBatch(cache.blocks[index], CACHE_BATCH);
+            count = CACHE_BATCH;
+        }
+        count -= 1;
+        block = cache.blocks[index][count];
+    }
+    m_requestedBytes.fetch_add(size, std::memory_order_relaxed);
+    return block;
+}
+
+
+void
+LuaAllocator::flushCache() {
+    ThreadCache& cache = t_cache;
+    if (cache.state == CacheState::Open) {
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            m_pools[i]->deallocateBatch(cache.blocks[i], cache.counts[i]);
+            cache.counts[i] = 0;
+        }
+    }
+    cache.state = CacheState::Closed;
+}
+
+
+void
+LuaAllocator::freeBlock(
+    void* block,
+    size_t size
+) {
+    m_requestedBytes.fetch_sub(size, std::memory_order_relaxed);
+    if (size > MAX_POOLED_SIZE) {
+        m_largeBytes.fetch_sub(size, std::memory_order_relaxed);
+        std::free(block);
+        return;
+    }
+    size_t index = sizeClass(size);
+    ThreadCache& cache = this->threadCache();
+    if (cache.state != CacheState::Open) {
+        m_pools[index]->deallocate(block);
+        return;
+    }
+    size_t& count = cache.counts[index];
+    if (count == CACHE_CAPACITY) {
+        count -= CACHE_BATCH;
+        m_pools[index]->deallocateBatch(cache.blocks[index] + count, CACHE_BATCH);
+    }
+    cache.blocks[index][count] = block;
+    count += 1;
+}
+
+
+void*
+LuaAllocator::reallocateBlock(
+    void* block,
+    size_t oldSize,
+    size_t newSize
+) {
+    if (oldSize > MAX_POOLED_SIZE and newSize > MAX_POOLED_SIZE) {
+        void* newBlock = std::realloc(block, newSize);
+        if (not newBlock) {
+            throw std::bad_alloc();
+        }
+        m_largeBytes.fetch_add(newSize - oldSize, std::memory_order_relaxed);
+        m_requestedBytes.fetch_add(newSize - oldSize, std::memory_order_relaxed);
+        return newBlock;
+    }
+    if (
+        oldSize <= MAX_POOLED_SIZE and
+        newSize <= MAX_POOLED_SIZE and
+        sizeClass(oldSize) == sizeClass(newSize)
+    ) {
+        m_requestedBytes.fetch_add(newSize - oldSize, std::memory_order_relaxed);
+        return block;
+    }
+    void* newBlock = this->allocateBlock(newSize);
+    std::memcpy(newBlock, block, std::min(oldSize, newSize));
+    this->freeBlock(block, oldSize);
+    return newBlock;
+}
+
+
+LuaAllocator::Statistics
+LuaAllocator::statistics() const {
+    Statistics statistics;
+    statistics.largeBytes = m_largeBytes.load(std::memory_order_relaxed);
+    statistics.requestedBytes = m_requestedBytes.load(std::memory_order_relaxed);
+    for (const auto& pool : m_pools) {
+        statistics.pooledBytes += pool->allocatedBlocks() * pool->blockSize();
+        statistics.reservedBytes += pool->reservedBytes();
+    }
+    return statistics;
+}
+
+
+LuaAllocator::ThreadCache&
+LuaAllocator::threadCache() {
+    ThreadCache& cache = t_cache;
+    if (cache.state == CacheState::Unused) {
+        // Registers the flusher's destructor for this thread
+        (void) &t_flusher;
+        cache.state = CacheState::Open;
+    }
+    return cache;
+}
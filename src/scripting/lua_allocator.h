@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace thrive {
+
+class PoolAllocator;
+
+/**
+* @brief The allocator of all Lua states
+*
+* Most of what scripts allocate, like tables, closures, strings and
+* luabind userdata, is small and short-lived. The allocator rounds small
+* blocks up to one of a few size classes and takes them from a
+* PoolAllocator per class. Each thread keeps a few free blocks of each
+* class, so the main Lua state and the script workers' states (see
+* ScriptWorkerSystem) rarely touch the shared pools. Larger blocks go to
+* \c malloc.
+*
+* Pooled memory is only returned to the pools, never to the system, so
+* the reserved bytes stay at the peak of the session.
+*
+* LuaState creates every state with allocate() as its \c lua_Alloc.
+*/
+class LuaAllocator {
+
+public:
+
+    /**
+    * @brief Heap statistics, summed over all Lua states
+    */
+    struct Statistics {
+
+        /**
+        * @brief Bytes of the blocks too large for the pools
+        */
+        size_t largeBytes = 0;
+
+        /**
+        * @brief Bytes of the pool blocks taken, including those cached by
+        * threads
+        */
+        size_t pooledBytes = 0;
+
+        /**
+        * @brief Bytes Lua currently has allocated
+        */
+        size_t requestedBytes = 0;
+
+        /**
+        * @brief Bytes reserved by the pools
+        */
+        size_t reservedBytes = 0;
+
+    };
+
+    /**
+    * @brief Blocks up to this size are pooled
+    */
+    static const size_t MAX_POOLED_SIZE = 256;
+
+    /**
+    * @brief The difference between two size classes
+    */
+    static const size_t SIZE_CLASS_STEP = 16;
+
+    /**
+    * @brief The \c lua_Alloc function
+    *
+    * @param userData
+    *   The allocator, see instance()
+    * @param pointer
+    *   The block to reallocate or free, or \c null
+    * @param oldSize
+    *   The size of \a pointer. Only the object type if \a pointer is
+    *   \c null.
+    * @param newSize
+    *   The new size, \c 0 to free the block
+    *
+    * @return
+    *   The new block, \c null if \a newSize is \c 0 or the allocation
+    *   failed
+    */
+    static void*
+    allocate(
+        void* userData,
+        void* pointer,
+        size_t oldSize,
+        size_t newSize
+    );
+
+    /**
+    * @brief The allocator shared by all Lua states
+    *
+    * Never destroyed, so that states closed during static destruction can
+    * still free their memory.
+    */
+    static LuaAllocator&
+    instance();
+
+    LuaAllocator(const LuaAllocator&) = delete;
+
+    LuaAllocator& operator= (const LuaAllocator&) = delete;
+
+    /**
+    * @brief The current heap statistics
+    */
+    Statistics
+    statistics() const;
+
+private:
+
+    static const size_t CLASS_COUNT = MAX_POOLED_SIZE / SIZE_CLASS_STEP;
+
+    struct CacheFlusher;
+
+    struct ThreadCache;
+
+    static thread_local ThreadCache t_cache;
+
+    static thread_local CacheFlusher t_flusher;
+
+    LuaAllocator();
+
+    ~LuaAllocator();
+
+    void*
+    allocateBlock(
+        size_t size
+    );
+
+    // Returns the blocks of the current thread's cache to the pools and
+    // stops caching on this thread
+    void
+    flushCache();
+
+    void
+    freeBlock(
+        void* block,
+        size_t size
+    );
+
+    void*
+    reallocateBlock(
+        void* block,
+        size_t oldSize,
+        size_t newSize
+    );
+
+    ThreadCache&
+    threadCache();
+
+    std::atomic<size_t> m_largeBytes;
+
+    std::vector<std::unique_ptr<PoolAllocator>> m_pools;
+
+    std::atomic<size_t> m_requestedBytes;
+
+};
+
+}
@@ -0,0 +1,166 @@
+#include "scripting/lua_garbage_collector.h"
+
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+
+#include <boost/chrono.hpp>
+
+using namespace thrive;
+
+
+luabind::scope
+LuaGarbageCollector::luaBindings() {
+    using namespace luabind;
+    return class_<LuaGarbageCollector>("LuaGarbageCollector")
+        .def("cycleCount", &LuaGarbageCollector::cycleCount)
+        .def("heapSize", &LuaGarbageCollector::heapSize)
+        .def("lastStepTime", &LuaGarbageCollector::lastStepTime)
+        .def("setGenerational", &LuaGarbageCollector::setGenerational)
+        .def("setMaxHeapGrowth", &LuaGarbageCollector::setMaxHeapGrowth)
+        .def("setPause", &LuaGarbageCollector::setPause)
+        .def("setStepBudget", &LuaGarbageCollector::setStepBudget)
+        .def("setStepMultiplier", &LuaGarbageCollector::setStepMultiplier)
+        .def("setStepSize", &LuaGarbageCollector::setStepSize)
+    ;
+}
+
+
+LuaGarbageCollector::LuaGarbageCollector(
+    lua_State* L
+) : m_luaState(L)
+{
+}
+
+
+unsigned int
+LuaGarbageCollector::cycleCount() const {
+    return m_cycleCount;
+}
+
+
+float
+LuaGarbageCollector::heapSize() const {
+    return lua_gc(m_luaState, LUA_GCCOUNT, 0) +
+        lua_gc(m_luaState, LUA_GCCOUNTB, 0) / 1024.0f;
+}
+
+
+bool
+LuaGarbageCollector::idleStep() {
+    if (m_stepBudget == 0 or m_isGenerational) {
+        return false;
+    }
+    if (not m_isCycleRunning and this->heapSize() <= m_heapAfterCycle) {
+        return false;
+    }
+    if (lua_gc(m_luaState, LUA_GCSTEP, m_stepSize) != 0) {
+        m_cycleCount += 1;
+        m_heapAfterCycle = this->heapSize();
+        m_isCycleRunning = false;
+    }
+    else {
+        m_isCycleRunning = true;
+    }
+    return m_isCycleRunning;
+}
+
+
+unsigned int
+LuaGarbageCollector::lastStepTime() const {
+    return m_lastStepTime;
+}
+
+
+bool
+LuaGarbageCollector::setGenerational(
+    bool generational
+) {
+#ifdef LUA_GCGEN
+    lua_gc(m_luaState, generational ? LUA_GCGEN : LUA_GCINC, 0);
+    m_isGenerational = generational;
+    return true;
+#else
+    return not generational;
+#endif
+}
+
+
+void
+LuaGarbageCollector::setMaxHeapGrowth(
+    float factor
+) {
+    m_maxHeapGrowth = factor;
+}
+
+
+void
+LuaGarbageCollector::setPause(
+    int pause
+) {
+    lua_gc(m_luaState, LUA_GCSETPAUSE, pause);
+}
+
+
+void
+LuaGarbageCollector::setStepBudget(
+    unsigned int microseconds
+) {
+    if (microseconds > 0 and m_stepBudget == 0) {
+        lua_gc(m_luaState, LUA_GCSTOP, 0);
+        m_heapAfterCycle = this->heapSize();
+    }
+    else if (microseconds == 0 and m_stepBudget > 0) {
+        lua_gc(m_luaState, LUA_GCRESTART, 0);
+    }
+    m_stepBudget = microseconds;
+}
+
+
+void
+LuaGarbageCollector::setStepMultiplier(
+    int stepMultiplier
+) {
+    lua_gc(m_luaState, LUA_GCSETSTEPMUL, stepMultiplier);
+}
+
+
+void
+LuaGarbageCollector::setStepSize(
+    int kilobytes
+) {
+    m_stepSize = kilobytes;
+}
+
+
+void
+LuaGarbageCollector::step() {
+    if (m_stepBudget == 0) {
+        m_lastStepTime = 0;
+        return;
+    }
+    using namespace boost::chrono;
+    auto start = steady_clock::now();
+    auto budget = microseconds(m_stepBudget);
+    bool isOverLimit = not m_isGenerational and
+        this->heapSize() > m_heapAfterCycle * m_maxHeapGrowth;
+    // Always take at least one step, so that collection makes progress
+    // even if the budget is smaller than a single step
+    while (true) {
+        bool finishedCycle = lua_gc(m_luaState, LUA_GCSTEP, m_stepSize) != 0;
+        if (m_isGenerational) {
+            // Each step is a whole minor collection
+            break;
+        }
+        if (finishedCycle) {
+            m_cycleCount += 1;
+            m_heapAfterCycle = this->heapSize();
+            m_isCycleRunning = false;
+            break;
+        }
+        m_isCycleRunning = true;
+        if (not isOverLimit and steady_clock::now() - start >= budget) {
+            break;
+        }
+    }
+    m_lastStepTime = duration_cast<microseconds>(steady_clock::now() - start).count();
+}
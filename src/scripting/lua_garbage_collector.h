@@ -0,0 +1,196 @@
+#pragma once
+
+class lua_State;
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Controls when Lua collects garbage
+*
+* By default, Lua's incremental collector runs whenever scripts allocate,
+* so a burst of temporary objects can turn into a noticeable pause in the
+* middle of a frame. With a step budget, the automatic collector is
+* stopped and step() collects for at most the budget at the end of each
+* frame instead.
+*
+* If the budget is too small for the rate at which scripts produce
+* garbage, the heap keeps growing. Once it exceeds setMaxHeapGrowth()
+* times its size after the last completed cycle, step() ignores the
+* budget and finishes the current cycle.
+*/
+class LuaGarbageCollector {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - LuaGarbageCollector::cycleCount
+    * - LuaGarbageCollector::heapSize
+    * - LuaGarbageCollector::lastStepTime
+    * - LuaGarbageCollector::setGenerational
+    * - LuaGarbageCollector::setMaxHeapGrowth
+    * - LuaGarbageCollector::setPause
+    * - LuaGarbageCollector::setStepBudget
+    * - LuaGarbageCollector::setStepMultiplier
+    * - LuaGarbageCollector::setStepSize
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param L
+    *   The Lua state to collect. Must outlive the collector.
+    */
+    LuaGarbageCollector(
+        lua_State* L
+    );
+
+    /**
+    * @brief The number of collection cycles completed by step()
+    */
+    unsigned int
+    cycleCount() const;
+
+    /**
+    * @brief The memory used by the Lua state, in kilobytes
+    */
+    float
+    heapSize() const;
+
+    /**
+    * @brief Takes a single incremental step in idle time
+    *
+    * Registered with the engine's IdleTasks, so frames with time to spare
+    * get ahead on collection and leave less for step(). Only collects
+    * with a step budget and the incremental collector, and only while a
+    * cycle is unfinished or garbage has accumulated since the last one.
+    *
+    * @return
+    *   Whether the current cycle is still unfinished
+    */
+    bool
+    idleStep();
+
+    /**
+    * @brief The time spent in the last call to step(), in microseconds
+    */
+    unsigned int
+    lastStepTime() const;
+
+    /**
+    * @brief Switches between the generational and the incremental collector
+    *
+    * With a step budget, the generational collector does one minor
+    * collection per step(). LuaJIT only has the incremental collector.
+    *
+    * @param generational
+    *
+    * @return
+    *   \c false if the requested mode is not available
+    */
+    bool
+    setGenerational(
+        bool generational
+    );
+
+    /**
+    * @brief Sets how far the heap may outgrow the step budget
+    *
+    * Only applies to the incremental collector.
+    *
+    * @param factor
+    *   Relative to the heap size after the last completed cycle
+    */
+    void
+    setMaxHeapGrowth(
+        float factor
+    );
+
+    /**
+    * @brief Sets Lua's \c setpause parameter
+    *
+    * @param pause
+    *   How far the heap grows before a new cycle starts, in percent
+    */
+    void
+    setPause(
+        int pause
+    );
+
+    /**
+    * @brief Sets the time step() may spend per frame
+    *
+    * @param microseconds
+    *   The budget, or 0 to let Lua collect automatically
+    */
+    void
+    setStepBudget(
+        unsigned int microseconds
+    );
+
+    /**
+    * @brief Sets Lua's \c setstepmul parameter
+    *
+    * @param stepMultiplier
+    *   The speed of the incremental collector relative to allocation, in
+    *   percent
+    */
+    void
+    setStepMultiplier(
+        int stepMultiplier
+    );
+
+    /**
+    * @brief Sets the amount of work per incremental step
+    *
+    * Smaller steps keep step() closer to its budget, larger steps have
+    * less overhead.
+    *
+    * @param kilobytes
+    */
+    void
+    setStepSize(
+        int kilobytes
+    );
+
+    /**
+    * @brief Collects garbage for up to the step budget
+    *
+    * Called once per frame by the engine. Does nothing without a budget.
+    */
+    void
+    step();
+
+private:
+
+    unsigned int m_cycleCount = 0;
+
+    float m_heapAfterCycle = 0.0f;
+
+    bool m_isCycleRunning = false;
+
+    bool m_isGenerational = false;
+
+    unsigned int m_lastStepTime = 0;
+
+    lua_State* m_luaState;
+
+    float m_maxHeapGrowth = 2.0f;
+
+    unsigned int m_stepBudget = 0;
+
+    int m_stepSize = 4;
+
+};
+
+}
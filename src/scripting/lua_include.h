@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+* @file
+* @brief Includes the Lua C API of the configured Lua implementation
+*
+* The bundled Lua is compiled as C++, LuaJIT is a C library. Include this
+* instead of the Lua headers so that either links.
+*/
+
+#ifdef THRIVE_USE_LUAJIT
+// Wraps lua.h, lualib.h, lauxlib.h and luajit.h in extern "C"
+#include <lua.hpp>
+#else
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+#endif
+
+namespace luabind {
+class object;
+}
+
+namespace thrive {
+
+/**
+* @brief Wraps a raw pointer as a Lua light userdata
+*
+* Lets scripts running on LuaJIT read and write native data through
+* \c ffi.cast without a luabind call per access. The pointer is only valid
+* as long as the data it points to.
+*
+* @param L
+* @param pointer
+*
+* @return
+*/
+luabind::object
+lightUserdata(
+    lua_State* L,
+    const void* pointer
+);
+
+}
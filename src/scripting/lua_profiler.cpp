@@ -0,0 +1,498 @@
+#include "scripting/lua_profiler.h"
+
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+// Its address identifies the running profiler in the registry
+const char REGISTRY_KEY = 0;
+
+// Deeper frames are cut off, e.g. in runaway recursion
+const int MAX_STACK_DEPTH = 64;
+
+
+std::string
+functionName(
+    const lua_Debug& debug
+) {
+    // Functions called from native code have no name
+    std::string name = debug.name ? debug.name : "function";
+    if (debug.what[0] == 'C') {
+        name += " [C]";
+    }
+    else {
+        name += " (" + std::string(debug.short_src) + ":" + std::to_string(debug.linedefined) + ")";
+    }
+    // Semicolons separate the frames in folded stacks
+    std::replace(name.begin(), name.end(), ';', ',');
+    return name;
+}
+
+
+void
+appendTop(
+    std::ostream& stream,
+    const char* title,
+    const std::unordered_map<std::string, uint64_t>& times,
+    uint64_t total,
+    unsigned int count
+) {
+    std::vector<std::pair<uint64_t, const std::string*>> entries;
+    entries.reserve(times.size());
+    for (const auto& pair : times) {
+        entries.emplace_back(pair.second, &pair.first);
+    }
+    count = std::min<size_t>(count, entries.size());
+    std::partial_sort(
+        entries.begin(),
+        entries.begin() + count,
+        entries.end(),
+        [] (const std::pair<uint64_t, const std::string*>& a, const std::pair<uint64_t, const std::string*>& b) {
+            return a.first > b.first;
+        }
+    );
+    stream << title << ":\n";
+    for (unsigned int i = 0; i < count; ++i) {
+        stream << std::setw(6) << 100.0 * entries[i].first / total << "%  " << *entries[i].second << "\n";
+    }
+}
+
+
+// Lists the systems' boundary crossings per update and the native
+// functions by their time
+void
+appendCalls(
+    std::ostream& stream,
+    const std::unordered_map<std::string, LuaProfiler::CallCounts>& systems,
+    const std::unordered_map<std::string, LuaProfiler::CallCounts>& functions,
+    unsigned int count
+) {
+    using Entry = std::pair<const std::string*, const LuaProfiler::CallCounts*>;
+    auto top = [count] (const std::unordered_map<std::string, LuaProfiler::CallCounts>& calls) {
+        std::vector<Entry> entries;
+        entries.reserve(calls.size());
+        for (const auto& pair : calls) {
+            entries.emplace_back(&pair.first, &pair.second);
+        }
+        size_t size = std::min<size_t>(count, entries.size());
+        std::partial_sort(
+            entries.begin(),
+            entries.begin() + size,
+            entries.end(),
+            [] (const Entry& a, const Entry& b) {
+                return a.second->nativeTime > b.second->nativeTime;
+            }
+        );
+        entries.resize(size);
+        return entries;
+    };
+    stream << "Boundary crossings per update (native calls, native us, script calls):\n";
+    for (const Entry& entry : top(systems)) {
+        double updates = std::max<uint64_t>(entry.second->updates, 1);
+        stream << std::setw(10) << entry.second->nativeCalls / updates
+            << std::setw(10) << entry.second->nativeTime / updates / 1000.0
+            << std::setw(10) << entry.second->scriptCalls / updates
+            << "  " << *entry.first << "\n";
+    }
+    stream << "Native functions (calls, us):\n";
+    for (const Entry& entry : top(functions)) {
+        stream << std::setw(10) << entry.second->nativeCalls
+            << std::setw(10) << entry.second->nativeTime / 1000.0
+            << "  " << *entry.first << "\n";
+    }
+}
+
+
+double
+LuaProfiler_sampledTime(
+    const LuaProfiler* self
+) {
+    return static_cast<double>(self->sampledTime());
+}
+
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// LuaProfiler::SystemScope
+////////////////////////////////////////////////////////////////////////////////
+
+
+LuaProfiler::SystemScope::SystemScope(
+    LuaProfiler* profiler,
+    const std::string& name
+) : m_profiler(profiler)
+{
+    if (m_profiler) {
+        m_profiler->beginSystem(name);
+    }
+}
+
+
+LuaProfiler::SystemScope::~SystemScope() {
+    if (m_profiler) {
+        m_profiler->endSystem();
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// LuaProfiler
+////////////////////////////////////////////////////////////////////////////////
+
+
+luabind::scope
+LuaProfiler::luaBindings() {
+    using namespace luabind;
+    return class_<LuaProfiler>("LuaProfiler")
+        .def("isCountingCalls", &LuaProfiler::isCountingCalls)
+        .def("isRunning", &LuaProfiler::isRunning)
+        .def("report", &LuaProfiler::report)
+        .def("reset", &LuaProfiler::reset)
+        .def("sampledTime", LuaProfiler_sampledTime)
+        .def("setCountingCalls", &LuaProfiler::setCountingCalls)
+        .def("start", &LuaProfiler::start)
+        .def("stop", &LuaProfiler::stop)
+        .def("writeFlameGraph", &LuaProfiler::writeFlameGraph)
+    ;
+}
+
+
+void
+LuaProfiler::countScriptCall(
+    lua_State* L,
+    const char* name
+) {
+    LuaProfiler* profiler = LuaProfiler::running(L);
+    if (not profiler or not profiler->m_isCountingCalls) {
+        return;
+    }
+    profiler->m_callbacks[name] += 1;
+    if (profiler->m_currentSystemCalls) {
+        profiler->m_currentSystemCalls->scriptCalls += 1;
+    }
+}
+
+
+LuaProfiler*
+LuaProfiler::running(
+    lua_State* L
+) {
+    if (lua_gethook(L) != &LuaProfiler::hook) {
+        return nullptr;
+    }
+    lua_pushlightuserdata(L, const_cast<char*>(&REGISTRY_KEY));
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    LuaProfiler* profiler = static_cast<LuaProfiler*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return profiler;
+}
+
+
+LuaProfiler::LuaProfiler(
+    lua_State* L
+) : m_luaState(L)
+{
+}
+
+
+LuaProfiler::~LuaProfiler() {
+    this->stop();
+}
+
+
+void
+LuaProfiler::beginSystem(
+    const std::string& name
+) {
+    m_currentSystem = &name;
+    if (m_isCountingCalls) {
+        m_currentSystemCalls = &m_systemCalls[name];
+        m_currentSystemCalls->updates += 1;
+    }
+    m_lastFunction = name;
+    m_lastStack = name;
+    m_lastSample = boost::chrono::steady_clock::now();
+}
+
+
+LuaProfiler::CallCounts
+LuaProfiler::callCounts(
+    const std::string& systemName
+) const {
+    auto iter = m_systemCalls.find(systemName);
+    return iter != m_systemCalls.end() ? iter->second : CallCounts();
+}
+
+
+void
+LuaProfiler::countNativeCall(
+    lua_State* L,
+    lua_Debug* debug
+) {
+    if (not m_currentSystemCalls) {
+        return;
+    }
+    bool isReturn = debug->event == LUA_HOOKRET;
+    lua_getinfo(L, "Sn", debug);
+    if (debug->what[0] != 'C') {
+        return;
+    }
+    auto now = boost::chrono::steady_clock::now();
+    if (not isReturn) {
+        std::string name = debug->name ? debug->name : "function";
+        m_nativeFunctionCalls[name].nativeCalls += 1;
+        m_currentSystemCalls->nativeCalls += 1;
+        m_nativeCalls.push_back({std::move(name), now});
+        return;
+    }
+    if (m_nativeCalls.empty()) {
+        // Called before the system's update began
+        return;
+    }
+    uint64_t elapsed = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+        now - m_nativeCalls.back().start
+    ).count();
+    m_nativeFunctionCalls[m_nativeCalls.back().name].nativeTime += elapsed;
+    m_nativeCalls.pop_back();
+    if (m_nativeCalls.empty()) {
+        m_currentSystemCalls->nativeTime += elapsed;
+    }
+}
+
+
+void
+LuaProfiler::endSystem() {
+    if (m_isRunning and m_currentSystem) {
+        // The time since the last sample most likely belongs to its stack
+        auto now = boost::chrono::steady_clock::now();
+        this->record(
+            boost::chrono::duration_cast<boost::chrono::microseconds>(now - m_lastSample).count()
+        );
+    }
+    m_currentSystem = nullptr;
+    m_currentSystemCalls = nullptr;
+    // Left over by errors, which skip the return hooks
+    m_nativeCalls.clear();
+}
+
+
+void
+LuaProfiler::hook(
+    lua_State* L,
+    lua_Debug* debug
+) {
+    LuaProfiler* profiler = LuaProfiler::running(L);
+    if (not profiler) {
+        return;
+    }
+    if (debug->event == LUA_HOOKCOUNT) {
+        profiler->sample(L);
+    }
+#ifdef LUA_HOOKTAILCALL
+    else if (debug->event == LUA_HOOKCALL or debug->event == LUA_HOOKTAILCALL or debug->event == LUA_HOOKRET) {
+#else
+    else if (debug->event == LUA_HOOKCALL or debug->event == LUA_HOOKRET) {
+#endif
+        profiler->countNativeCall(L, debug);
+    }
+}
+
+
+int
+LuaProfiler::hookMask() const {
+    return m_isCountingCalls ? LUA_MASKCOUNT | LUA_MASKCALL | LUA_MASKRET : LUA_MASKCOUNT;
+}
+
+
+bool
+LuaProfiler::isCountingCalls() const {
+    return m_isCountingCalls;
+}
+
+
+bool
+LuaProfiler::isRunning() const {
+    return m_isRunning;
+}
+
+
+void
+LuaProfiler::record(
+    uint64_t elapsed
+) {
+    m_stackTimes[m_lastStack] += elapsed;
+    m_functionTimes[m_lastFunction] += elapsed;
+    m_systemTimes[*m_currentSystem] += elapsed;
+    m_sampledTime += elapsed;
+}
+
+
+LuaProfiler::CallCounts
+LuaProfiler::nativeCallCounts(
+    const std::string& functionName
+) const {
+    auto iter = m_nativeFunctionCalls.find(functionName);
+    return iter != m_nativeFunctionCalls.end() ? iter->second : CallCounts();
+}
+
+
+std::string
+LuaProfiler::report(
+    unsigned int count
+) const {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    stream << "Lua profile: " << m_sampledTime / 1000.0 << " ms\n";
+    if (m_sampledTime > 0) {
+        appendTop(stream, "Systems", m_systemTimes, m_sampledTime, count);
+        appendTop(stream, "Functions", m_functionTimes, m_sampledTime, count);
+    }
+    if (not m_systemCalls.empty()) {
+        appendCalls(stream, m_systemCalls, m_nativeFunctionCalls, count);
+    }
+    if (not m_callbacks.empty()) {
+        stream << "Calls into Lua:\n";
+        for (const auto& pair : m_callbacks) {
+            stream << std::setw(10) << pair.second << "  " << pair.first << "\n";
+        }
+    }
+    return stream.str();
+}
+
+
+void
+LuaProfiler::reset() {
+    m_callbacks.clear();
+    m_functionTimes.clear();
+    m_nativeFunctionCalls.clear();
+    m_sampledTime = 0;
+    m_stackTimes.clear();
+    m_systemCalls.clear();
+    m_systemTimes.clear();
+    // The current update's counts were just cleared
+    if (m_currentSystem and m_isCountingCalls) {
+        m_currentSystemCalls = &m_systemCalls[*m_currentSystem];
+    }
+}
+
+
+void
+LuaProfiler::sample(
+    lua_State* L
+) {
+    auto now = boost::chrono::steady_clock::now();
+    if (not m_currentSystem) {
+        m_lastSample = now;
+        return;
+    }
+    uint64_t elapsed = boost::chrono::duration_cast<boost::chrono::microseconds>(now - m_lastSample).count();
+    m_lastSample = now;
+    std::string frames[MAX_STACK_DEPTH];
+    int depth = 0;
+    lua_Debug debug;
+    while (depth < MAX_STACK_DEPTH and lua_getstack(L, depth, &debug)) {
+        lua_getinfo(L, "Sn", &debug);
+        frames[depth] = functionName(debug);
+        depth += 1;
+    }
+    m_lastStack = *m_currentSystem;
+    for (int i = depth - 1; i >= 0; --i) {
+        m_lastStack += ';';
+        m_lastStack += frames[i];
+    }
+    m_lastFunction = depth > 0 ? frames[0] : *m_currentSystem;
+    this->record(elapsed);
+}
+
+
+uint64_t
+LuaProfiler::sampledTime() const {
+    return m_sampledTime;
+}
+
+
+void
+LuaProfiler::setCountingCalls(
+    bool countingCalls
+) {
+    m_isCountingCalls = countingCalls;
+    if (not countingCalls) {
+        m_currentSystemCalls = nullptr;
+        m_nativeCalls.clear();
+    }
+    if (m_isRunning) {
+        lua_sethook(m_luaState, &LuaProfiler::hook, this->hookMask(), m_instructionInterval);
+    }
+}
+
+
+void
+LuaProfiler::start(
+    int instructionInterval
+) {
+    if (instructionInterval <= 0) {
+        throw std::invalid_argument("Instruction interval must be positive");
+    }
+    lua_pushlightuserdata(m_luaState, const_cast<char*>(&REGISTRY_KEY));
+    lua_pushlightuserdata(m_luaState, this);
+    lua_rawset(m_luaState, LUA_REGISTRYINDEX);
+    m_instructionInterval = instructionInterval;
+    lua_sethook(m_luaState, &LuaProfiler::hook, this->hookMask(), instructionInterval);
+    m_isRunning = true;
+}
+
+
+void
+LuaProfiler::stop() {
+    if (not m_isRunning) {
+        return;
+    }
+    lua_sethook(m_luaState, nullptr, 0, 0);
+    lua_pushlightuserdata(m_luaState, const_cast<char*>(&REGISTRY_KEY));
+    lua_pushnil(m_luaState);
+    lua_rawset(m_luaState, LUA_REGISTRYINDEX);
+    m_currentSystem = nullptr;
+    m_currentSystemCalls = nullptr;
+    m_nativeCalls.clear();
+    m_isRunning = false;
+}
+
+
+void
+LuaProfiler::writeFlameGraph(
+    const std::string& filename
+) const {
+    std::ofstream file(filename);
+    if (not file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    std::vector<std::pair<const std::string*, uint64_t>> stacks;
+    stacks.reserve(m_stackTimes.size());
+    for (const auto& pair : m_stackTimes) {
+        stacks.emplace_back(&pair.first, pair.second);
+    }
+    std::sort(
+        stacks.begin(),
+        stacks.end(),
+        [] (const std::pair<const std::string*, uint64_t>& a, const std::pair<const std::string*, uint64_t>& b) {
+            return *a.first < *b.first;
+        }
+    );
+    for (const auto& stack : stacks) {
+        file << *stack.first << " " << stack.second << "\n";
+    }
+    if (not file) {
+        throw std::runtime_error("Could not write file: " + filename);
+    }
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class lua_State;
+struct lua_Debug;
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Samples where Lua spends its time
+*
+* While running, a count hook interrupts the Lua VM every few hundred
+* instructions and records the current call stack. The time since the
+* previous sample is attributed to that stack, including time spent in
+* native functions called from Lua.
+*
+* Only time spent while a Lua System subclass is being updated is
+* recorded. The update is marked with a SystemScope, so each stack starts
+* with the system's class name. Code that runs outside of a system update
+* is not sampled.
+*
+* With setCountingCalls(), the profiler also counts the crossings of the
+* Lua/C++ boundary: calls from Lua into native functions, which are
+* mostly luabind bindings, and the time spent in them, as well as calls
+* from C++ into Lua, see countScriptCall(). A call and a return hook then
+* run for every function call, so the sampled times grow, too.
+*
+* Hooks are set per coroutine. Coroutines created before start() are not
+* sampled. LuaJIT does not call hooks from compiled traces, so the profile
+* is only meaningful with the JIT compiler disabled.
+*/
+class LuaProfiler {
+
+public:
+
+    /**
+    * @brief Boundary crossings of a system or native function
+    */
+    struct CallCounts {
+
+        /**
+        * @brief Calls from Lua into native functions
+        */
+        uint64_t nativeCalls = 0;
+
+        /**
+        * @brief Nanoseconds spent in native functions
+        *
+        * Covers luabind's conversion of arguments and results as well as
+        * the bound C++ code. For a system, nested native calls are only
+        * counted once.
+        */
+        uint64_t nativeTime = 0;
+
+        /**
+        * @brief Calls from C++ into Lua, besides the updates
+        */
+        uint64_t scriptCalls = 0;
+
+        /**
+        * @brief The number of system updates
+        */
+        uint64_t updates = 0;
+
+    };
+
+    /**
+    * @brief Marks the update of a Lua system
+    *
+    * Does nothing if \a profiler is \c null.
+    */
+    class SystemScope {
+
+    public:
+
+        /**
+        * @brief Constructor
+        *
+        * @param profiler
+        *   The running profiler, see LuaProfiler::running()
+        * @param name
+        *   The name of the system's class. Must outlive the scope.
+        */
+        SystemScope(
+            LuaProfiler* profiler,
+            const std::string& name
+        );
+
+        /**
+        * @brief Destructor
+        */
+        ~SystemScope();
+
+        SystemScope(const SystemScope&) = delete;
+
+        SystemScope& operator= (const SystemScope&) = delete;
+
+    private:
+
+        LuaProfiler* m_profiler;
+
+    };
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - LuaProfiler::isCountingCalls
+    * - LuaProfiler::isRunning
+    * - LuaProfiler::report
+    * - LuaProfiler::reset
+    * - LuaProfiler::sampledTime
+    * - LuaProfiler::setCountingCalls
+    * - LuaProfiler::start
+    * - LuaProfiler::stop
+    * - LuaProfiler::writeFlameGraph
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Counts a call from C++ into Lua, like a component callback
+    *
+    * System updates are counted by their SystemScope. Does nothing unless
+    * a profiler counting calls is running on \a L.
+    *
+    * @param L
+    * @param name
+    *   What is called, e.g. \c "Component.load"
+    */
+    static void
+    countScriptCall(
+        lua_State* L,
+        const char* name
+    );
+
+    /**
+    * @brief The profiler running on \a L
+    *
+    * Cheap enough to call for every system update.
+    *
+    * @param L
+    *
+    * @return
+    *   The profiler or \c null if none is running
+    */
+    static LuaProfiler*
+    running(
+        lua_State* L
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param L
+    *   The Lua state to profile. Must outlive the profiler.
+    */
+    LuaProfiler(
+        lua_State* L
+    );
+
+    /**
+    * @brief Destructor
+    *
+    * Stops the profiler
+    */
+    ~LuaProfiler();
+
+    LuaProfiler(const LuaProfiler&) = delete;
+
+    LuaProfiler& operator= (const LuaProfiler&) = delete;
+
+    /**
+    * @brief The boundary crossings during a system's updates
+    *
+    * @param systemName
+    *   The name of the system's class
+    */
+    CallCounts
+    callCounts(
+        const std::string& systemName
+    ) const;
+
+    /**
+    * @brief Whether boundary crossings are counted
+    */
+    bool
+    isCountingCalls() const;
+
+    /**
+    * @brief Whether the profiler is sampling
+    */
+    bool
+    isRunning() const;
+
+    /**
+    * @brief The calls of a native function and the time spent in it
+    *
+    * Only calls during system updates are counted.
+    *
+    * @param functionName
+    *   The name Lua calls the function by, e.g. \c "getComponent"
+    */
+    CallCounts
+    nativeCallCounts(
+        const std::string& functionName
+    ) const;
+
+    /**
+    * @brief Summarizes the samples as text
+    *
+    * Lists the systems by total time and the functions by the time spent
+    * in their own code, slowest first. When counting calls, also lists the
+    * boundary crossings per system update, the native functions by their
+    * time and the calls from C++ into Lua.
+    *
+    * @param count
+    *   The maximum number of systems and functions to list
+    *
+    * @return
+    */
+    std::string
+    report(
+        unsigned int count
+    ) const;
+
+    /**
+    * @brief Discards all samples
+    */
+    void
+    reset();
+
+    /**
+    * @brief The total time attributed to samples, in microseconds
+    */
+    uint64_t
+    sampledTime() const;
+
+    /**
+    * @brief Sets whether boundary crossings are counted
+    *
+    * Takes effect right away if the profiler is running.
+    */
+    void
+    setCountingCalls(
+        bool countingCalls
+    );
+
+    /**
+    * @brief Starts sampling
+    *
+    * Keeps the samples of previous runs, see reset().
+    *
+    * @param instructionInterval
+    *   The number of VM instructions between samples. Smaller intervals
+    *   give more precise profiles with more overhead.
+    */
+    void
+    start(
+        int instructionInterval
+    );
+
+    /**
+    * @brief Stops sampling
+    */
+    void
+    stop();
+
+    /**
+    * @brief Writes the samples as folded stacks
+    *
+    * Each line holds a call stack, outermost first and separated by
+    * semicolons, and the microseconds spent in it. This is the input
+    * format of \c flamegraph.pl and compatible viewers.
+    *
+    * @param filename
+    *
+    * @throw std::runtime_error
+    *   If the file can't be written
+    */
+    void
+    writeFlameGraph(
+        const std::string& filename
+    ) const;
+
+private:
+
+    static void
+    hook(
+        lua_State* L,
+        lua_Debug* debug
+    );
+
+    // A native function that hasn't returned yet
+    struct NativeCall {
+
+        std::string name;
+
+        boost::chrono::steady_clock::time_point start;
+
+    };
+
+    void
+    beginSystem(
+        const std::string& name
+    );
+
+    void
+    countNativeCall(
+        lua_State* L,
+        lua_Debug* debug
+    );
+
+    void
+    endSystem();
+
+    int
+    hookMask() const;
+
+    void
+    record(
+        uint64_t elapsed
+    );
+
+    void
+    sample(
+        lua_State* L
+    );
+
+    std::unordered_map<std::string, uint64_t> m_callbacks;
+
+    const std::string* m_currentSystem = nullptr;
+
+    CallCounts* m_currentSystemCalls = nullptr;
+
+    std::unordered_map<std::string, uint64_t> m_functionTimes;
+
+    int m_instructionInterval = 0;
+
+    bool m_isCountingCalls = false;
+
+    bool m_isRunning = false;
+
+    // The innermost function of the last sample
+    std::string m_lastFunction;
+
+    boost::chrono::steady_clock::time_point m_lastSample;
+
+    // The stack of the last sample in the current system update
+    std::string m_lastStack;
+
+    lua_State* m_luaState;
+
+    std::unordered_map<std::string, CallCounts> m_nativeFunctionCalls;
+
+    // Innermost last
+    std::vector<NativeCall> m_nativeCalls;
+
+    uint64_t m_sampledTime = 0;
+
+    std::unordered_map<std::string, CallCounts> m_systemCalls;
+
+    std::unordered_map<std::string, uint64_t> m_stackTimes;
+
+    std::unordered_map<std::string, uint64_t> m_systemTimes;
+
+};
+
+}
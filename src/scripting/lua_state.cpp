@@ -1,16 +1,69 @@
 #include "scripting/lua_state.h"
 
-#include <assert.h>
+#include "scripting/lua_allocator.h"
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
 
-#include "lauxlib.h"
-#include "lualib.h"
+#include <assert.h>
+#include <iostream>
 
 using namespace thrive;
 
+luabind::object
+thrive::lightUserdata(
+    lua_State* L,
+    const void* pointer
+) {
+    lua_pushlightuserdata(L, const_cast<void*>(pointer));
+    luabind::object object(luabind::from_stack(L, -1));
+    lua_pop(L, 1);
+    return object;
+}
+
+
+#ifndef THRIVE_USE_LUAJIT
+
+static int
+luaPanic(
+    lua_State* L
+) {
+    std::cerr << "PANIC: unprotected error in call to Lua API ("
+        << lua_tostring(L, -1) << ")" << std::endl;
+    return 0;
+}
+
+
+static lua_State*
+newLuaState() {
+    lua_State* L = lua_newstate(
+        &LuaAllocator::allocate,
+        &LuaAllocator::instance()
+    );
+    if (L) {
+        lua_atpanic(L, &luaPanic);
+    }
+    return L;
+}
+
+#else
+
+static lua_State*
+newLuaState() {
+    return luaL_newstate();
+}
+
+#endif
+
+
 LuaState::LuaState()
-  : m_state(luaL_newstate())
+  : m_state(newLuaState())
 {
     luaL_openlibs(m_state);
+#ifdef THRIVE_USE_LUAJIT
+    // On by default, but make sure a system-wide setting doesn't leave us
+    // with the interpreter only
+    luaJIT_setmode(m_state, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+#endif
 }
 
 
@@ -16,7 +16,10 @@ public:
     /**
     * @brief Constructor
     *
-    * Calls \c luaL_newstate and \c luaL_openlibs.
+    * Creates the state with the LuaAllocator and calls \c luaL_openlibs.
+    * LuaJIT only supports its own allocator on 64 bit, so with LuaJIT,
+    * calls \c luaL_newstate instead and makes sure the JIT compiler is
+    * enabled.
     */
     LuaState();
 
@@ -0,0 +1,299 @@
+#include "scripting/lua_tasks.h"
+
+#include "scripting/lua_include.h"
+#include "scripting/luabind.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace thrive;
+
+
+luabind::scope
+LuaTasks::luaBindings() {
+    using namespace luabind;
+    return class_<LuaTasks>("LuaTasks")
+        .def("budget", &LuaTasks::budget)
+        .def("cancel", &LuaTasks::cancel)
+        .def("count", &LuaTasks::count)
+        .def("isRunning", &LuaTasks::isRunning)
+        .def("setBudget", &LuaTasks::setBudget)
+    ;
+}
+
+
+struct LuaTasks::Implementation {
+
+    struct Entry {
+
+        // Arguments on the thread's stack before the first resume
+        int argumentCount;
+
+        TaskId id;
+
+        bool isCancelled;
+
+        bool isStarted;
+
+        // Registry reference that keeps the thread alive
+        int reference;
+
+        uint64_t resumeFrame;
+
+        lua_State* thread;
+
+    };
+
+    Implementation(
+        lua_State* L
+    ) : m_luaState(L)
+    {
+    }
+
+    // spawnTask(fn, ...)
+    static int
+    spawnTask(
+        lua_State* L
+    ) {
+        Implementation* self = static_cast<Implementation*>(
+            lua_touserdata(L, lua_upvalueindex(1))
+        );
+        luaL_checktype(L, 1, LUA_TFUNCTION);
+        int valueCount = lua_gettop(L);
+        lua_State* thread = lua_newthread(L);
+        int reference = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_xmove(L, thread, valueCount);
+        Entry entry{
+            valueCount - 1,
+            self->m_nextId++,
+            false,
+            false,
+            reference,
+            self->m_isRunning ? self->m_frame + 1 : self->m_frame,
+            thread
+        };
+        if (self->m_isRunning) {
+            self->m_incoming.push_back(entry);
+        }
+        else {
+            self->m_tasks.push_back(entry);
+        }
+        lua_pushinteger(L, entry.id);
+        return 1;
+    }
+
+    // waitFrames(n)
+    static int
+    waitFrames(
+        lua_State* L
+    ) {
+        lua_Integer frames = luaL_checkinteger(L, 1);
+        lua_settop(L, 0);
+        lua_pushinteger(L, std::max<lua_Integer>(frames, 1));
+        return lua_yield(L, 1);
+    }
+
+    // yield()
+    static int
+    yield(
+        lua_State* L
+    ) {
+        lua_settop(L, 0);
+        lua_pushinteger(L, 1);
+        return lua_yield(L, 1);
+    }
+
+    // Drops finished and cancelled tasks, puts the tasks from \a next on
+    // first and appends the ones spawned during update()
+    void
+    compact(
+        size_t next
+    ) {
+        std::rotate(m_tasks.begin(), m_tasks.begin() + next, m_tasks.end());
+        auto end = std::remove_if(m_tasks.begin(), m_tasks.end(), [this] (const Entry& entry) {
+            if (entry.isCancelled) {
+                luaL_unref(m_luaState, LUA_REGISTRYINDEX, entry.reference);
+            }
+            return entry.isCancelled;
+        });
+        m_tasks.erase(end, m_tasks.end());
+        m_tasks.insert(m_tasks.end(), m_incoming.begin(), m_incoming.end());
+        m_incoming.clear();
+    }
+
+    // Resumes a task once, returns whether it has finished
+    bool
+    resume(
+        Entry& entry
+    ) {
+        lua_State* thread = entry.thread;
+        int argumentCount = entry.isStarted ? 0 : entry.argumentCount;
+        entry.isStarted = true;
+#if LUA_VERSION_NUM >= 502
+        int status = lua_resume(thread, nullptr, argumentCount);
+#else
+        int status = lua_resume(thread, argumentCount);
+#endif
+        if (status == LUA_YIELD) {
+            lua_Integer frames = 1;
+            // coroutine.yield() may pass anything
+            if (lua_gettop(thread) > 0 and lua_isnumber(thread, -1)) {
+                frames = std::max<lua_Integer>(lua_tointeger(thread, -1), 1);
+            }
+            lua_settop(thread, 0);
+            entry.resumeFrame = m_frame + frames;
+            return false;
+        }
+        if (status != 0) {
+            const char* message = lua_tostring(thread, -1);
+            luaL_traceback(m_luaState, thread, message ? message : "(no message)", 0);
+            std::cerr << "Lua task failed: id=" << entry.id << "\n"
+                << lua_tostring(m_luaState, -1) << std::endl;
+            lua_pop(m_luaState, 1);
+        }
+        return true;
+    }
+
+    unsigned int m_budget = 2000;
+
+    uint64_t m_frame = 0;
+
+    std::vector<Entry> m_incoming;
+
+    bool m_isRunning = false;
+
+    lua_State* m_luaState;
+
+    TaskId m_nextId = 1;
+
+    std::vector<Entry> m_tasks;
+
+};
+
+
+LuaTasks::LuaTasks(
+    lua_State* L
+) : m_impl(new Implementation(L))
+{
+    lua_pushlightuserdata(L, m_impl.get());
+    lua_pushcclosure(L, &Implementation::spawnTask, 1);
+    lua_setglobal(L, "spawnTask");
+    lua_pushcfunction(L, &Implementation::waitFrames);
+    lua_setglobal(L, "waitFrames");
+    lua_pushcfunction(L, &Implementation::yield);
+    lua_setglobal(L, "yield");
+}
+
+
+LuaTasks::~LuaTasks() {
+    this->clear();
+    // Scripts may still hold on to spawnTask
+    lua_State* L = m_impl->m_luaState;
+    lua_pushnil(L);
+    lua_setglobal(L, "spawnTask");
+}
+
+
+unsigned int
+LuaTasks::budget() const {
+    return m_impl->m_budget;
+}
+
+
+void
+LuaTasks::cancel(
+    TaskId id
+) {
+    auto isTask = [id] (const Implementation::Entry& entry) {
+        return entry.id == id;
+    };
+    for (auto* tasks : {&m_impl->m_tasks, &m_impl->m_incoming}) {
+        auto iter = std::find_if(tasks->begin(), tasks->end(), isTask);
+        if (iter != tasks->end()) {
+            iter->isCancelled = true;
+        }
+    }
+    if (not m_impl->m_isRunning) {
+        m_impl->compact(0);
+    }
+}
+
+
+void
+LuaTasks::clear() {
+    for (auto* tasks : {&m_impl->m_tasks, &m_impl->m_incoming}) {
+        for (Implementation::Entry& entry : *tasks) {
+            entry.isCancelled = true;
+        }
+    }
+    if (not m_impl->m_isRunning) {
+        m_impl->compact(0);
+    }
+}
+
+
+size_t
+LuaTasks::count() const {
+    size_t count = 0;
+    for (auto* tasks : {&m_impl->m_tasks, &m_impl->m_incoming}) {
+        for (const Implementation::Entry& entry : *tasks) {
+            if (not entry.isCancelled) {
+                count += 1;
+            }
+        }
+    }
+    return count;
+}
+
+
+bool
+LuaTasks::isRunning(
+    TaskId id
+) const {
+    for (auto* tasks : {&m_impl->m_tasks, &m_impl->m_incoming}) {
+        for (const Implementation::Entry& entry : *tasks) {
+            if (entry.id == id) {
+                return not entry.isCancelled;
+            }
+        }
+    }
+    return false;
+}
+
+
+void
+LuaTasks::setBudget(
+    unsigned int microseconds
+) {
+    m_impl->m_budget = microseconds;
+}
+
+
+unsigned int
+LuaTasks::update() {
+    Implementation& impl = *m_impl;
+    impl.m_frame += 1;
+    const auto deadline = Clock::now() + boost::chrono::microseconds(impl.m_budget);
+    // Compaction is done by hand below, before anything can throw
+    impl.m_isRunning = true;
+    unsigned int resumed = 0;
+    size_t index = 0;
+    for (; index < impl.m_tasks.size(); ++index) {
+        if (resumed > 0 and Clock::now() >= deadline) {
+            break;
+        }
+        Implementation::Entry& entry = impl.m_tasks[index];
+        if (entry.isCancelled or entry.resumeFrame > impl.m_frame) {
+            continue;
+        }
+        resumed += 1;
+        if (impl.resume(entry)) {
+            entry.isCancelled = true;
+        }
+    }
+    impl.m_isRunning = false;
+    impl.compact(index);
+    return resumed;
+}
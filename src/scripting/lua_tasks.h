@@ -0,0 +1,167 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <memory>
+
+class lua_State;
+
+namespace luabind {
+class scope;
+}
+
+namespace thrive {
+
+/**
+* @brief Runs Lua functions as coroutines that span several frames
+*
+* Scripts with work too long for a single frame, like building a large
+* microbe, planning for AI or recomputing the HUD, hand it to a task and
+* give up control in between:
+* \code
+* spawnTask(function(microbe)
+*     for _, organelle in ipairs(organelles) do
+*         microbe:addOrganelle(organelle)
+*         yield()
+*     end
+*     waitFrames(30)
+*     microbe:flashMembraneColour(...)
+* end, microbe)
+* \endcode
+*
+* The constructor registers three global functions:
+* - \c spawnTask(fn, ...) creates a task that calls \c fn with the other
+*   arguments and returns the task's id
+* - \c yield() suspends the current task until the next frame
+* - \c waitFrames(n) suspends the current task for \a n frames
+*
+* The engine calls update() once per frame, after the game state's
+* update. Each due task is resumed once, until the budget is used up.
+* Tasks that didn't get their turn go first in the next frame. Tasks keep
+* running when the current game state changes, they are only cancelled
+* when the scripts are reloaded or the engine shuts down.
+*
+* A task can only yield from its own Lua code, not from Lua functions
+* that C++ calls, like component callbacks. An error ends the task and
+* is written to \c std::cerr with a traceback.
+*/
+class LuaTasks {
+
+public:
+
+    using Clock = boost::chrono::steady_clock;
+
+    /**
+    * @brief Identifies a task for cancel()
+    */
+    using TaskId = unsigned int;
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - LuaTasks::budget
+    * - LuaTasks::cancel
+    * - LuaTasks::count
+    * - LuaTasks::isRunning
+    * - LuaTasks::setBudget
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * Registers the global Lua functions.
+    *
+    * @param L
+    *   The Lua state to run tasks in. Must outlive this object.
+    */
+    explicit LuaTasks(
+        lua_State* L
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~LuaTasks();
+
+    LuaTasks(const LuaTasks&) = delete;
+
+    LuaTasks& operator= (const LuaTasks&) = delete;
+
+    /**
+    * @brief The time update() may spend per frame, in microseconds
+    */
+    unsigned int
+    budget() const;
+
+    /**
+    * @brief Cancels a task
+    *
+    * May be called from a task, also for the task itself, which then
+    * ends at its next yield. Does nothing if there is no task with \a id.
+    *
+    * @param id
+    */
+    void
+    cancel(
+        TaskId id
+    );
+
+    /**
+    * @brief Cancels all tasks
+    */
+    void
+    clear();
+
+    /**
+    * @brief The number of tasks that haven't finished
+    */
+    size_t
+    count() const;
+
+    /**
+    * @brief Whether a task hasn't finished yet
+    *
+    * @param id
+    */
+    bool
+    isRunning(
+        TaskId id
+    ) const;
+
+    /**
+    * @brief Sets the time update() may spend per frame
+    *
+    * The budget is checked before each resume, except for the first one
+    * of a frame, so every frame makes progress and the budget is overrun
+    * by at most one step of a task. Defaults to 2000.
+    *
+    * @param microseconds
+    */
+    void
+    setBudget(
+        unsigned int microseconds
+    );
+
+    /**
+    * @brief Starts a frame and resumes the tasks due in it
+    *
+    * Tasks spawned during update() are first resumed in the next frame.
+    *
+    * @return
+    *   The number of tasks resumed
+    */
+    unsigned int
+    update();
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
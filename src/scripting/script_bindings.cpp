@@ -1,12 +1,20 @@
 #include "scripting/script_bindings.h"
 
+#include "scripting/lua_garbage_collector.h"
+#include "scripting/lua_profiler.h"
+#include "scripting/lua_tasks.h"
 #include "scripting/luabind.h"
 #include "scripting/script_entity_filter.h"
+#include "scripting/script_worker_system.h"
 
 luabind::scope
 thrive::ScriptBindings::luaBindings() {
     return (
-        ScriptEntityFilter::luaBindings()
+        LuaGarbageCollector::luaBindings(),
+        LuaProfiler::luaBindings(),
+        LuaTasks::luaBindings(),
+        ScriptEntityFilter::luaBindings(),
+        ScriptWorkerSystem::luaBindings()
     );
 }
 
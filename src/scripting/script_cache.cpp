@@ -0,0 +1,511 @@
+#include "scripting/script_cache.h"
+
+#include "engine/shared_data.h"
+#include "scripting/lua_include.h"
+#include "util/memory_buffer.h"
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+using namespace thrive;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'T', 'H', 'R', 'V', 'L', 'U', 'A', 'C'};
+
+// Increment when the layout of the cache files changes
+const uint32_t CACHE_FORMAT = 1;
+
+// Bytecode is specific to the Lua implementation and version
+#ifdef THRIVE_USE_LUAJIT
+const std::string LUA_IMPLEMENTATION = LUAJIT_VERSION;
+#else
+const std::string LUA_IMPLEMENTATION = LUA_RELEASE;
+#endif
+
+struct SourceInfo {
+
+    uint64_t hash = 0;
+
+    int64_t modificationTime = 0;
+
+    uint64_t size = 0;
+
+};
+
+
+// FNV-1a
+uint64_t
+hashSource(
+    const std::string& source
+) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+int
+dumpWriter(
+    lua_State*,
+    const void* data,
+    size_t size,
+    void* userData
+) {
+    static_cast<std::string*>(userData)->append(
+        static_cast<const char*>(data),
+        size
+    );
+    return 0;
+}
+
+
+template<typename T>
+bool
+readValue(
+    std::istream& stream,
+    T& value
+) {
+    return static_cast<bool>(
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T))
+    );
+}
+
+
+template<typename T>
+void
+writeValue(
+    std::ostream& stream,
+    const T& value
+) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+bool
+readFile(
+    const fs::path& path,
+    std::string& contents
+) {
+    std::ifstream file(path.string(), std::ios::binary);
+    if (not file.is_open()) {
+        return false;
+    }
+    contents.assign(
+        std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>()
+    );
+    return not file.bad();
+}
+
+
+// Reads everything before the bytecode
+bool
+readCacheHeader(
+    std::istream& file,
+    SourceInfo& info
+) {
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t format = 0;
+    uint32_t implementationLength = 0;
+    if (
+        not file.read(magic, sizeof(magic)) or
+        not std::equal(magic, magic + sizeof(magic), CACHE_MAGIC) or
+        not readValue(file, format) or
+        format != CACHE_FORMAT or
+        not readValue(file, implementationLength) or
+        implementationLength != LUA_IMPLEMENTATION.size()
+    ) {
+        return false;
+    }
+    std::string implementation(implementationLength, '\0');
+    if (
+        not file.read(&implementation[0], implementationLength) or
+        implementation != LUA_IMPLEMENTATION or
+        not readValue(file, info.modificationTime) or
+        not readValue(file, info.size) or
+        not readValue(file, info.hash)
+    ) {
+        return false;
+    }
+    return true;
+}
+
+
+bool
+readCache(
+    const fs::path& path,
+    SourceInfo& info,
+    std::string& bytecode
+) {
+    std::ifstream file(path.string(), std::ios::binary);
+    if (not file.is_open() or not readCacheHeader(file, info)) {
+        return false;
+    }
+    bytecode.assign(
+        std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>()
+    );
+    return not file.bad() and not bytecode.empty();
+}
+
+
+// A cache file's header and bytecode in memory, like that of SharedData
+struct Chunk {
+
+    const char* bytecode = nullptr;
+
+    SourceInfo info;
+
+    size_t size = 0;
+
+};
+
+
+bool
+readChunk(
+    const char* data,
+    size_t size,
+    Chunk& chunk
+) {
+    MemoryBuffer buffer(data, data + size);
+    std::istream stream(&buffer);
+    if (not readCacheHeader(stream, chunk.info)) {
+        return false;
+    }
+    size_t headerSize = static_cast<size_t>(stream.tellg());
+    chunk.bytecode = data + headerSize;
+    chunk.size = size - headerSize;
+    return chunk.size > 0;
+}
+
+
+// Only the time stamp and size, the hash needs the source's contents
+bool
+readSourceInfo(
+    const fs::path& sourcePath,
+    SourceInfo& info
+) {
+    boost::system::error_code error;
+    info.modificationTime = fs::last_write_time(sourcePath, error);
+    if (not error) {
+        info.size = fs::file_size(sourcePath, error);
+    }
+    return not error;
+}
+
+
+bool
+matchesSource(
+    const SourceInfo& cached,
+    const SourceInfo& current
+) {
+    return
+        cached.modificationTime == current.modificationTime and
+        cached.size == current.size
+    ;
+}
+
+
+void
+writeCache(
+    const fs::path& path,
+    const SourceInfo& info,
+    const std::string& bytecode
+) {
+    boost::system::error_code error;
+    fs::create_directories(path.parent_path(), error);
+    // Write to a temporary file first, so that an interrupted write
+    // doesn't leave a truncated cache file behind
+    fs::path temporaryPath = path.string() + ".tmp";
+    {
+        std::ofstream file(temporaryPath.string(), std::ios::binary | std::ios::trunc);
+        if (file.is_open()) {
+            file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            writeValue(file, CACHE_FORMAT);
+            writeValue(file, static_cast<uint32_t>(LUA_IMPLEMENTATION.size()));
+            file.write(LUA_IMPLEMENTATION.data(), LUA_IMPLEMENTATION.size());
+            writeValue(file, info.modificationTime);
+            writeValue(file, info.size);
+            writeValue(file, info.hash);
+            file.write(bytecode.data(), bytecode.size());
+        }
+        if (not file) {
+            std::cerr << "Warning: Could not write script cache " << path.string() << std::endl;
+            fs::remove(temporaryPath, error);
+            return;
+        }
+    }
+    fs::rename(temporaryPath, path, error);
+    if (error) {
+        std::cerr << "Warning: Could not write script cache " << path.string() << std::endl;
+        fs::remove(temporaryPath, error);
+    }
+}
+
+
+// Pushes the compiled chunk onto the stack, unless pushFunction is false.
+// The shared chunk, if any, is preferred over the cache file.
+int
+loadScript(
+    lua_State* L,
+    const fs::path& sourcePath,
+    const fs::path& cachePath,
+    const AssetPack::File* sharedFile,
+    bool pushFunction
+) {
+    std::string chunkName = "@" + sourcePath.string();
+    SourceInfo current;
+    if (not readSourceInfo(sourcePath, current)) {
+        lua_pushstring(L, ("cannot open " + sourcePath.string()).c_str());
+        return LUA_ERRFILE;
+    }
+    Chunk shared;
+    bool hasShared = sharedFile and readChunk(sharedFile->data, sharedFile->size, shared);
+    if (hasShared and matchesSource(shared.info, current)) {
+        if (not pushFunction) {
+            return 0;
+        }
+        if (luaL_loadbuffer(L, shared.bytecode, shared.size, chunkName.c_str()) == 0) {
+            return 0;
+        }
+        lua_pop(L, 1);
+        hasShared = false;
+    }
+    SourceInfo cached;
+    std::string bytecode;
+    bool hasCache = readCache(cachePath, cached, bytecode);
+    if (hasCache and matchesSource(cached, current)) {
+        if (not pushFunction) {
+            return 0;
+        }
+        if (luaL_loadbuffer(L, bytecode.data(), bytecode.size(), chunkName.c_str()) == 0) {
+            return 0;
+        }
+        // Unusable bytecode, compile from source instead
+        lua_pop(L, 1);
+        hasCache = false;
+    }
+    std::string source;
+    if (not readFile(sourcePath, source)) {
+        lua_pushstring(L, ("cannot read " + sourcePath.string()).c_str());
+        return LUA_ERRFILE;
+    }
+    current.hash = hashSource(source);
+    current.size = source.size();
+    if (hasShared and shared.info.hash == current.hash and shared.info.size == current.size) {
+        // Same content with a new time stamp, e.g. after an install
+        if (
+            not pushFunction or
+            luaL_loadbuffer(L, shared.bytecode, shared.size, chunkName.c_str()) == 0
+        ) {
+            return 0;
+        }
+        lua_pop(L, 1);
+    }
+    if (hasCache and cached.hash == current.hash and cached.size == current.size) {
+        // Same content with a new time stamp
+        if (
+            not pushFunction or
+            luaL_loadbuffer(L, bytecode.data(), bytecode.size(), chunkName.c_str()) == 0
+        ) {
+            writeCache(cachePath, current, bytecode);
+            return 0;
+        }
+        lua_pop(L, 1);
+    }
+    int status = luaL_loadbuffer(L, source.data(), source.size(), chunkName.c_str());
+    if (status != 0) {
+        return status;
+    }
+    bytecode.clear();
+    lua_dump(L, dumpWriter, &bytecode);
+    writeCache(cachePath, current, bytecode);
+    if (not pushFunction) {
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+
+void
+addManifestScripts(
+    const fs::path& directory,
+    const fs::path& prefix,
+    std::vector<fs::path>& scripts
+) {
+    fs::path manifestPath = directory / "manifest.txt";
+    if (not fs::exists(manifestPath)) {
+        return;
+    }
+    std::ifstream manifest(manifestPath.string());
+    if (not manifest.is_open()) {
+        throw std::runtime_error("Could not open manifest file: " + manifestPath.string());
+    }
+    std::string line;
+    while(not manifest.eof()) {
+        std::getline(manifest, line);
+        boost::algorithm::trim(line);
+        if (line.empty() or line.find("//") == 0) {
+            continue;
+        }
+        fs::path manifestEntryPath = directory / line;
+        if (not fs::exists(manifestEntryPath)) {
+            std::cerr << "Warning: Could not find file " << manifestEntryPath.string() << std::endl;
+            continue;
+        }
+        else if (fs::is_directory(manifestEntryPath)) {
+            addManifestScripts(manifestEntryPath, prefix / line, scripts);
+        }
+        else {
+            scripts.push_back(prefix / line);
+        }
+    }
+}
+
+}
+
+
+std::vector<fs::path>
+ScriptCache::manifestScripts(
+    const fs::path& directory
+) {
+    std::vector<fs::path> scripts;
+    addManifestScripts(directory, fs::path(), scripts);
+    return scripts;
+}
+
+
+ScriptCache::ScriptCache(
+    fs::path scriptDirectory,
+    fs::path cacheDirectory
+) : m_cacheDirectory(std::move(cacheDirectory)),
+    m_scriptDirectory(std::move(scriptDirectory))
+{
+}
+
+
+int
+ScriptCache::compile(
+    lua_State* L,
+    const fs::path& script
+) {
+    return loadScript(
+        L,
+        m_scriptDirectory / script,
+        m_cacheDirectory / (script.string() + ".luac"),
+        m_sharedData ? m_sharedData->compiledScript(script) : nullptr,
+        false
+    );
+}
+
+
+bool
+ScriptCache::compiledScript(
+    const fs::path& script,
+    std::string& cacheFile
+) const {
+    SourceInfo current;
+    if (not readSourceInfo(m_scriptDirectory / script, current)) {
+        return false;
+    }
+    const AssetPack::File* sharedFile = m_sharedData ? m_sharedData->compiledScript(script) : nullptr;
+    Chunk shared;
+    if (
+        sharedFile and
+        readChunk(sharedFile->data, sharedFile->size, shared) and
+        matchesSource(shared.info, current)
+    ) {
+        cacheFile.assign(sharedFile->data, sharedFile->size);
+        return true;
+    }
+    std::string contents;
+    if (not readFile(m_cacheDirectory / (script.string() + ".luac"), contents)) {
+        return false;
+    }
+    Chunk cached;
+    if (
+        not readChunk(contents.data(), contents.size(), cached) or
+        not matchesSource(cached.info, current)
+    ) {
+        return false;
+    }
+    cacheFile = std::move(contents);
+    return true;
+}
+
+
+bool
+ScriptCache::isShared(
+    const fs::path& script
+) const {
+    const AssetPack::File* sharedFile = m_sharedData ? m_sharedData->compiledScript(script) : nullptr;
+    SourceInfo current;
+    Chunk shared;
+    return
+        sharedFile and
+        readSourceInfo(m_scriptDirectory / script, current) and
+        readChunk(sharedFile->data, sharedFile->size, shared) and
+        matchesSource(shared.info, current)
+    ;
+}
+
+
+bool
+ScriptCache::isUpToDate(
+    const fs::path& script
+) const {
+    SourceInfo current;
+    if (not readSourceInfo(m_scriptDirectory / script, current)) {
+        return false;
+    }
+    if (this->isShared(script)) {
+        return true;
+    }
+    std::ifstream file(
+        (m_cacheDirectory / (script.string() + ".luac")).string(),
+        std::ios::binary
+    );
+    SourceInfo cached;
+    return
+        file.is_open() and
+        readCacheHeader(file, cached) and
+        matchesSource(cached, current)
+    ;
+}
+
+
+int
+ScriptCache::load(
+    lua_State* L,
+    const fs::path& script
+) {
+    return loadScript(
+        L,
+        m_scriptDirectory / script,
+        m_cacheDirectory / (script.string() + ".luac"),
+        m_sharedData ? m_sharedData->compiledScript(script) : nullptr,
+        true
+    );
+}
+
+
+void
+ScriptCache::setSharedData(
+    const SharedData* sharedData
+) {
+    m_sharedData = sharedData;
+}
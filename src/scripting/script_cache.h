@@ -0,0 +1,191 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <string>
+#include <vector>
+
+class lua_State;
+
+namespace thrive {
+
+class SharedData;
+
+/**
+* @brief Caches compiled Lua chunks
+*
+* Loading a script through the cache skips the parser when the cache
+* already holds its bytecode. Each script has one cache file, at the same
+* relative path below the cache directory as the script below the script
+* directory, with a \c .luac suffix.
+*
+* A cache file records the modification time, size and hash of the source
+* it was compiled from. If the time and size still match, the bytecode is
+* loaded without reading the source. Otherwise, the source is hashed, so
+* that scripts that were only touched, e.g. by an installer, don't need to
+* be recompiled. Cache files written by a different Lua implementation or
+* version are ignored.
+*
+* Failing to write a cache file is not an error, the script is still
+* loaded from source.
+*
+* With SharedData, its compiled scripts take precedence over the cache
+* files, see setSharedData().
+*/
+class ScriptCache {
+
+public:
+
+    /**
+    * @brief Lists the scripts of a directory in load order
+    *
+    * Reads \c manifest.txt in \a directory. Each line names a script or a
+    * subdirectory with its own manifest. Empty lines and lines starting
+    * with \c // are skipped.
+    *
+    * @param directory
+    *   The directory to list the scripts of
+    *
+    * @return
+    *   The scripts' paths, relative to \a directory. Empty if there is no
+    *   manifest.
+    *
+    * @throw std::runtime_error
+    *   If a manifest exists, but can't be read
+    */
+    static std::vector<boost::filesystem::path>
+    manifestScripts(
+        const boost::filesystem::path& directory
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param scriptDirectory
+    *   The directory the scripts are loaded from
+    * @param cacheDirectory
+    *   The directory the compiled chunks are stored in. Created on demand.
+    */
+    ScriptCache(
+        boost::filesystem::path scriptDirectory,
+        boost::filesystem::path cacheDirectory
+    );
+
+    /**
+    * @brief Compiles a script into the cache, unless it's up to date
+    *
+    * Used for precompiling scripts for a release, or on worker threads 
+    * before the scripts are loaded. Calls for different scripts may run in
+    * parallel with separate Lua states. The stack is left unchanged on 
+    * success.
+    *
+    * @param L
+    * @param script
+    *   The script's path, relative to the script directory
+    *
+    * @return
+    *   \c 0 on success or the error code of luaL_loadbuffer. On error, the
+    *   message is pushed onto the stack.
+    */
+    int
+    compile(
+        lua_State* L,
+        const boost::filesystem::path& script
+    );
+
+    /**
+    * @brief Reads a script's compiled chunk
+    *
+    * For building SharedData. Only chunks that match the script's source
+    * are read, see isUpToDate().
+    *
+    * @param script
+    *   The script's path, relative to the script directory
+    * @param cacheFile
+    *   Receives the chunk in the format of the cache files
+    *
+    * @return
+    *   \c false if there is no up to date chunk
+    */
+    bool
+    compiledScript(
+        const boost::filesystem::path& script,
+        std::string& cacheFile
+    ) const;
+
+    /**
+    * @brief Whether the shared data holds a script's current chunk
+    *
+    * Like isUpToDate(), but only for the shared data.
+    *
+    * @param script
+    *   The script's path, relative to the script directory
+    */
+    bool
+    isShared(
+        const boost::filesystem::path& script
+    ) const;
+
+    /**
+    * @brief Whether a script's cache file matches its source
+    *
+    * Also \c true if the shared data holds the current chunk. Only reads
+    * the cache file's header, so it's cheap enough to decide
+    * which scripts to compile() ahead of loading them. Scripts that were
+    * only touched count as out of date.
+    *
+    * Safe to call from several threads at once.
+    *
+    * @param script
+    *   The script's path, relative to the script directory
+    */
+    bool
+    isUpToDate(
+        const boost::filesystem::path& script
+    ) const;
+
+    /**
+    * @brief Loads a script as a Lua function
+    *
+    * Works like \c luaL_loadfile, but goes through the cache.
+    *
+    * @param L
+    * @param script
+    *   The script's path, relative to the script directory
+    *
+    * @return
+    *   \c 0 on success or the error code of luaL_loadbuffer. Pushes the
+    *   function or the error message onto the stack.
+    */
+    int
+    load(
+        lua_State* L,
+        const boost::filesystem::path& script
+    );
+
+    /**
+    * @brief Sets the shared data to load compiled scripts from
+    *
+    * Scripts whose chunks in \a sharedData match their source are loaded
+    * in place from its mapped memory, without reading their cache file.
+    * Their cache files are neither read nor written then. All other
+    * scripts go through the cache directory as usual.
+    *
+    * @param sharedData
+    *   Must outlive the cache. \c null stops using shared data.
+    */
+    void
+    setSharedData(
+        const SharedData* sharedData
+    );
+
+private:
+
+    boost::filesystem::path m_cacheDirectory;
+
+    boost::filesystem::path m_scriptDirectory;
+
+    const SharedData* m_sharedData = nullptr;
+
+};
+
+}
@@ -1,17 +1,97 @@
 #include "scripting/script_entity_filter.h"
 
+#include "engine/archetype.h"
 #include "engine/component.h"
-#include "engine/component_collection.h"
 #include "engine/entity_manager.h"
 #include "engine/game_state.h"
 #include "game.h"
+#include "ogre/scene_node_system.h"
+#include "scripting/lua_include.h"
 #include "scripting/luabind.h"
 
+#include <algorithm>
 #include <luabind/iterator_policy.hpp>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
 using namespace thrive;
 
-struct ScriptEntityFilter::Implementation {
+namespace {
+
+// Entity ids in a contiguous array, with constant time lookup and removal.
+// Removal moves the last id into the gap, so the order is arbitrary.
+class EntityList {
+
+public:
+
+    void
+    clear() {
+        m_ids.clear();
+        m_indices.clear();
+    }
+
+    bool
+    contains(
+        EntityId id
+    ) const {
+        return m_indices.count(id) > 0;
+    }
+
+    bool
+    erase(
+        EntityId id
+    ) {
+        auto iter = m_indices.find(id);
+        if (iter == m_indices.end()) {
+            return false;
+        }
+        size_t index = iter->second;
+        m_indices.erase(iter);
+        if (index + 1 < m_ids.size()) {
+            m_ids[index] = m_ids.back();
+            m_indices[m_ids[index]] = index;
+        }
+        m_ids.pop_back();
+        return true;
+    }
+
+    const std::vector<EntityId>&
+    ids() const {
+        return m_ids;
+    }
+
+    size_t
+    indexOf(
+        EntityId id
+    ) const {
+        return m_indices.at(id);
+    }
+
+    // Returns the index of the id, which is appended if it's not contained
+    size_t
+    insert(
+        EntityId id
+    ) {
+        auto result = m_indices.emplace(id, m_ids.size());
+        if (result.second) {
+            m_ids.push_back(id);
+        }
+        return result.first->second;
+    }
+
+private:
+
+    std::vector<EntityId> m_ids;
+
+    std::unordered_map<EntityId, size_t> m_indices;
+
+};
+
+}
+
+
+struct ScriptEntityFilter::Implementation : public ArchetypeListener {
 
     Implementation(
         luabind::object componentTypes,
@@ -25,115 +105,275 @@ struct ScriptEntityFilter::Implementation {
         for (luabind::iterator iter(componentTypes), end; iter != end; ++iter) {
             luabind::object ret = (*iter)["TYPE_ID"];
             ComponentTypeId typeId = luabind::object_cast<ComponentTypeId>(ret);
-            m_requiredComponents.insert(typeId);
+            if (this->column(typeId) < 0) {
+                m_typeIds.push_back(typeId);
+                m_mask.set(typeId);
+            }
+        }
+    }
+
+    // Index of a component type in m_typeIds or -1
+    int
+    column(
+        ComponentTypeId typeId
+    ) const {
+        for (size_t i = 0; i < m_typeIds.size(); ++i) {
+            if (m_typeIds[i] == typeId) {
+                return i;
+            }
         }
+        return -1;
+    }
+
+    Component*
+    component(
+        size_t index,
+        int column
+    ) const {
+        return m_components[index * m_typeIds.size() + column];
     }
 
+    // Records the differences between the entities before suspend() and
+    // now, like the listener callbacks would have
     void
-    addEntity(
-        EntityId id
-    ) {
+    compareSuspendedEntities() {
+        size_t columnCount = m_typeIds.size();
+        const auto& suspendedIds = m_suspendedEntities.ids();
+        for (size_t i = 0; i < suspendedIds.size(); ++i) {
+            EntityId entityId = suspendedIds[i];
+            if (not m_entities.contains(entityId)) {
+                if (not m_addedEntities.erase(entityId)) {
+                    m_removedEntities.insert(entityId);
+                }
+                continue;
+            }
+            auto before = m_suspendedComponents.begin() + i * columnCount;
+            auto now = m_components.begin() + m_entities.indexOf(entityId) * columnCount;
+            if (
+                not std::equal(before, before + columnCount, now) and
+                not m_addedEntities.contains(entityId)
+            ) {
+                m_removedEntities.insert(entityId);
+                m_addedEntities.insert(entityId);
+            }
+        }
+        for (EntityId entityId : m_entities.ids()) {
+            if (not m_suspendedEntities.contains(entityId)) {
+                m_addedEntities.insert(entityId);
+            }
+        }
+    }
+
+    void
+    initEntities() {
+        this->insertAllEntities();
         if (m_recordChanges) {
-            m_addedEntities.insert(id);
+            for (EntityId entityId : m_entities.ids()) {
+                m_addedEntities.insert(entityId);
+            }
         }
-        m_entities.insert(id);
     }
 
     void
-    initialize() {
-        for (EntityId id : m_entityManager->entities()) {
-            if (this->isEligible(id)) {
-                this->addEntity(id);
+    insertAllEntities() {
+        for (const auto& archetype : m_entityManager->archetypes()) {
+            if (not this->listensTo(*archetype)) {
+                continue;
             }
+            const auto& entities = archetype->entities();
+            for (size_t row = 0; row < entities.size(); ++row) {
+                this->insertEntity(entities[row], *archetype, row);
+            }
+        }
+    }
+
+    void
+    insertEntity(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row
+    ) {
+        size_t index = m_entities.insert(entityId);
+        if (index * m_typeIds.size() == m_components.size()) {
+            m_components.resize(m_components.size() + m_typeIds.size());
         }
+        this->updateComponents(index, archetype, row);
     }
 
     bool
-    isEligible(
-        EntityId id
-    ) const {
-        if (not m_entityManager or m_requiredComponents.empty()) {
-            return false;
+    listensTo(
+        const Archetype& archetype
+    ) const override {
+        return not m_mask.empty() and archetype.mask().containsAll(m_mask);
+    }
+
+    void
+    onEntityAdded(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row
+    ) override {
+        this->insertEntity(entityId, archetype, row);
+        if (m_recordChanges) {
+            m_addedEntities.insert(entityId);
         }
-        for (ComponentTypeId typeId : m_requiredComponents) {
-            if (not m_entityManager->getComponent(id, typeId)) {
-                return false;
-            }
+    }
+
+    void
+    onEntityChanged(
+        EntityId entityId,
+        const Archetype& archetype,
+        size_t row,
+        ComponentTypeId typeId,
+        Change change
+    ) override {
+        size_t index = m_entities.indexOf(entityId);
+        this->updateComponents(index, archetype, row);
+        if (
+            m_recordChanges and
+            change == Change::Replaced and
+            this->column(typeId) >= 0 and
+            not m_addedEntities.contains(entityId)
+        ) {
+            // A replaced component counts as remove + add
+            m_removedEntities.insert(entityId);
+            m_addedEntities.insert(entityId);
         }
-        return true;
     }
 
     void
-    registerCallbacks() {
-        for (ComponentTypeId typeId : m_requiredComponents) {
-            auto& collection = m_entityManager->getComponentCollection(typeId);
-            auto onAdded = [this] (EntityId id, Component&) {
-                if (this->isEligible(id)) {
-                    this->addEntity(id);
-                }
-            };
-            auto onRemoved = [this] (EntityId id, Component&) {
-                this->removeEntity(id);
-            };
-            unsigned int handle = collection.registerChangeCallbacks(
-                onAdded, 
-                onRemoved
+    onEntityRemoved(
+        EntityId entityId
+    ) override {
+        if (not m_entities.contains(entityId)) {
+            return;
+        }
+        // Mirror the swap in m_entities
+        size_t index = m_entities.indexOf(entityId);
+        size_t last = m_entities.ids().size() - 1;
+        size_t columnCount = m_typeIds.size();
+        std::copy(
+            m_components.begin() + last * columnCount,
+            m_components.begin() + (last + 1) * columnCount,
+            m_components.begin() + index * columnCount
+        );
+        m_components.resize(last * columnCount);
+        m_entities.erase(entityId);
+        if (m_recordChanges and not m_addedEntities.erase(entityId)) {
+            // If entityId already was in addedEntities, the entity was
+            // added, then removed in the same frame.
+            m_removedEntities.insert(entityId);
+        }
+    }
+
+    void
+    resume() {
+        if (m_entityManager) {
+            m_entityManager->addArchetypeListener(this);
+            this->insertAllEntities();
+            if (m_recordChanges) {
+                this->compareSuspendedEntities();
+            }
+        }
+        m_suspendedComponents.clear();
+        m_suspendedEntities.clear();
+    }
+
+    // The scene node of the entity at index, looked up if the filter
+    // doesn't prefetch it
+    const OgreSceneNodeComponent*
+    sceneNode(
+        size_t index
+    ) const {
+        int column = this->column(OgreSceneNodeComponent::TYPE_ID);
+        if (column >= 0) {
+            return static_cast<const OgreSceneNodeComponent*>(
+                this->component(index, column)
             );
-            m_registeredCallbacks[typeId] = handle;
         }
+        return static_cast<const OgreSceneNodeComponent*>(
+            m_entityManager->getComponent(
+                m_entities.ids()[index],
+                OgreSceneNodeComponent::TYPE_ID
+            )
+        );
     }
 
     void
     setEntityManager(
         EntityManager* entityManager
     ) {
-        if (m_entityManager) {
-            this->unregisterCallbacks();
+        if (m_entityManager and not m_isSuspended) {
+            m_entityManager->removeArchetypeListener(this);
         }
         m_entityManager = entityManager;
         m_addedEntities.clear();
-        m_removedEntities.clear();
+        m_components.clear();
         m_entities.clear();
-        if (entityManager) {
-            this->initialize();
-            this->registerCallbacks();
+        m_removedEntities.clear();
+        m_suspendedComponents.clear();
+        m_suspendedEntities.clear();
+        // A suspended filter finds the entities when resumed
+        if (entityManager and not m_isSuspended) {
+            entityManager->addArchetypeListener(this);
+            this->initEntities();
         }
     }
 
     void
-    removeEntity(
-        EntityId id
-    ) {
-        if (m_recordChanges) {
-            m_removedEntities.insert(id);
+    suspend() {
+        if (m_entityManager) {
+            m_entityManager->removeArchetypeListener(this);
         }
-        m_entities.erase(id);
+        std::swap(m_components, m_suspendedComponents);
+        std::swap(m_entities, m_suspendedEntities);
+        m_components.clear();
+        m_entities.clear();
     }
 
     void
-    unregisterCallbacks() {
-        for (const auto& pair : m_registeredCallbacks) {
-            auto& collection = m_entityManager->getComponentCollection(
-                pair.first
+    updateComponents(
+        size_t index,
+        const Archetype& archetype,
+        size_t row
+    ) {
+        for (size_t i = 0; i < m_typeIds.size(); ++i) {
+            m_components[index * m_typeIds.size() + i] = archetype.component(
+                m_typeIds[i],
+                row
             );
-            collection.unregisterChangeCallbacks(pair.second);
         }
-        m_registeredCallbacks.clear();
     }
 
-    std::unordered_set<EntityId> m_addedEntities;
+    EntityList m_addedEntities;
 
-    std::unordered_set<EntityId> m_entities;
+    // m_typeIds.size() pointers per entity, in the order of m_entities
+    std::vector<Component*> m_components;
+
+    EntityList m_entities;
 
     EntityManager* m_entityManager = nullptr;
 
+    // Filled by fillPositionBuffer()
+    std::vector<EntityId> m_entityBuffer;
+
+    bool m_isSuspended = false;
+
+    // The types of m_typeIds
+    ComponentMask m_mask;
+
+    std::vector<float> m_positionBuffer;
+
     bool m_recordChanges = false;
 
-    std::unordered_map<ComponentTypeId, unsigned int> m_registeredCallbacks;
+    EntityList m_removedEntities;
+
+    // m_components and m_entities when the filter was suspended
+    std::vector<Component*> m_suspendedComponents;
 
-    std::unordered_set<EntityId> m_removedEntities;
+    EntityList m_suspendedEntities;
 
-    std::unordered_set<ComponentTypeId> m_requiredComponents;
+    std::vector<ComponentTypeId> m_typeIds;
 
 };
 
@@ -148,8 +388,15 @@ ScriptEntityFilter::luaBindings() {
         .def("clearChanges", &ScriptEntityFilter::clearChanges)
         .def("containsEntity", &ScriptEntityFilter::containsEntity)
         .def("entities", &ScriptEntityFilter::entities, return_stl_iterator)
+        .def("entityBufferData", &ScriptEntityFilter::entityBufferData)
+        .def("fillComponents", &ScriptEntityFilter::fillComponents)
+        .def("fillPositionBuffer", &ScriptEntityFilter::fillPositionBuffer)
+        .def("fillPositions", &ScriptEntityFilter::fillPositions)
         .def("init", &ScriptEntityFilter::init)
+        .def("isSuspended", &ScriptEntityFilter::isSuspended)
+        .def("positionBufferData", &ScriptEntityFilter::positionBufferData)
         .def("removedEntities", &ScriptEntityFilter::removedEntities, return_stl_iterator)
+        .def("setSuspended", &ScriptEntityFilter::setSuspended)
         .def("shutdown", &ScriptEntityFilter::shutdown)
     ;
 }
@@ -178,9 +425,9 @@ ScriptEntityFilter::~ScriptEntityFilter() {
 }
 
 
-const std::unordered_set<EntityId>&
+const std::vector<EntityId>&
 ScriptEntityFilter::addedEntities() {
-    return m_impl->m_addedEntities;
+    return m_impl->m_addedEntities.ids();
 }
 
 
@@ -195,16 +442,104 @@ bool
 ScriptEntityFilter::containsEntity(
     EntityId id
 ) const {
-    return m_impl->m_entities.count(id) > 0;
+    return m_impl->m_entities.contains(id);
 }
 
 
-const std::unordered_set<EntityId>&
+const std::vector<EntityId>&
 ScriptEntityFilter::entities() {
     if (not m_impl->m_entityManager) {
         throw std::runtime_error("Entity filter is not initialized. Call init() on it.");
     }
-    return m_impl->m_entities;
+    return m_impl->m_entities.ids();
+}
+
+
+luabind::object
+ScriptEntityFilter::entityBufferData(
+    lua_State* L
+) const {
+    return lightUserdata(L, m_impl->m_entityBuffer.data());
+}
+
+
+unsigned int
+ScriptEntityFilter::fillComponents(
+    luabind::object componentType,
+    luabind::object components
+) {
+    if (luabind::type(components) != LUA_TTABLE) {
+        throw std::runtime_error("fillComponents expects a table");
+    }
+    luabind::object typeIdObject = componentType["TYPE_ID"];
+    ComponentTypeId typeId = luabind::object_cast<ComponentTypeId>(typeIdObject);
+    int column = m_impl->column(typeId);
+    if (column < 0) {
+        throw std::invalid_argument("Component type is not part of this entity filter");
+    }
+    const auto& entities = this->entities();
+    for (size_t i = 0; i < entities.size(); ++i) {
+        components[i + 1] = m_impl->component(i, column);
+    }
+    return entities.size();
+}
+
+
+unsigned int
+ScriptEntityFilter::fillPositionBuffer() {
+    const auto& entities = this->entities();
+    auto& entityBuffer = m_impl->m_entityBuffer;
+    auto& positionBuffer = m_impl->m_positionBuffer;
+    entityBuffer.clear();
+    positionBuffer.clear();
+    for (size_t i = 0; i < entities.size(); ++i) {
+        EntityId id = entities[i];
+        const OgreSceneNodeComponent* sceneNode = m_impl->sceneNode(i);
+        if (not sceneNode) {
+            continue;
+        }
+        const Ogre::Vector3& position = sceneNode->m_transform.position;
+        entityBuffer.push_back(id);
+        positionBuffer.push_back(position.x);
+        positionBuffer.push_back(position.y);
+        positionBuffer.push_back(position.z);
+    }
+    return entityBuffer.size();
+}
+
+
+unsigned int
+ScriptEntityFilter::fillPositions(
+    lua_State* L,
+    luabind::object ids,
+    luabind::object positions
+) {
+    if (luabind::type(ids) != LUA_TTABLE or luabind::type(positions) != LUA_TTABLE) {
+        throw std::runtime_error("fillPositions expects two tables");
+    }
+    const auto& entities = this->entities();
+    ids.push(L);
+    positions.push(L);
+    int count = 0;
+    for (size_t i = 0; i < entities.size(); ++i) {
+        EntityId id = entities[i];
+        const OgreSceneNodeComponent* sceneNode = m_impl->sceneNode(i);
+        if (not sceneNode) {
+            continue;
+        }
+        const Ogre::Vector3& position = sceneNode->m_transform.position;
+        lua_pushnumber(L, id);
+        lua_rawseti(L, -3, count + 1);
+        lua_pushnumber(L, position.x);
+        lua_rawseti(L, -2, 3 * count + 1);
+        lua_pushnumber(L, position.y);
+        lua_rawseti(L, -2, 3 * count + 2);
+        lua_pushnumber(L, position.z);
+        lua_rawseti(L, -2, 3 * count + 3);
+        count += 1;
+    }
+    lua_pop(L, 2);
+    return count;
 }
 
 
@@ -218,9 +553,49 @@ ScriptEntityFilter::init(
 }
 
 
-const std::unordered_set<EntityId>&
+bool
+ScriptEntityFilter::isSuspended() const {
+    return m_impl->m_isSuspended;
+}
+
+
+luabind::object
+ScriptEntityFilter::positionBufferData(
+    lua_State* L
+) const {
+    return lightUserdata(L, m_impl->m_positionBuffer.data());
+}
+
+
+const std::vector<EntityId>&
 ScriptEntityFilter::removedEntities() {
-    return m_impl->m_removedEntities;
+    return m_impl->m_removedEntities.ids();
+}
+
+
+void
+ScriptEntityFilter::setEntityManager(
+    EntityManager* entityManager
+) {
+    m_impl->setEntityManager(entityManager);
+}
+
+
+void
+ScriptEntityFilter::setSuspended(
+    bool suspended
+) {
+    if (suspended == m_impl->m_isSuspended) {
+        return;
+    }
+    if (suspended) {
+        m_impl->suspend();
+        m_impl->m_isSuspended = true;
+    }
+    else {
+        m_impl->m_isSuspended = false;
+        m_impl->resume();
+    }
 }
 
 
@@ -1,20 +1,38 @@
 #pragma once
 
+#include "engine/suspendable_filter.h"
 #include "engine/typedefs.h"
 #include "scripting/luabind.h"
 
 #include <luabind/object.hpp>
 #include <memory>
-#include <unordered_set>
+#include <vector>
 
 namespace thrive {
 
+class EntityManager;
 class GameState;
 
 /**
 * @brief Script version of the EntityFilter
+*
+* Like EntityFilter, this listens to the EntityManager's archetypes, so
+* entities are only checked when they move into or out of an archetype
+* with the filtered component types. The ids are kept in contiguous arrays
+* and the filtered components of each entity are fetched when it is added,
+* see fillComponents().
+*
+* Besides iterating over the entity ids, scripts can fetch the positions of
+* all entities in bulk, with fillPositions() or, on LuaJIT, through the
+* buffers filled by fillPositionBuffer(). That's a single call into C++
+* instead of several per entity.
+*
+* A suspended filter (see SuspendableFilter) has no entities. After it is
+* resumed, the entities that were added, removed or had a filtered 
+* component replaced in the meantime show up in addedEntities() and 
+* removedEntities().
 */
-class ScriptEntityFilter {
+class ScriptEntityFilter : public SuspendableFilter {
 
 public:
 
@@ -25,8 +43,15 @@ public:
     * - ScriptEntityFilter::clearChanges
     * - ScriptEntityFilter::containsEntity
     * - ScriptEntityFilter::entities
+    * - ScriptEntityFilter::entityBufferData
+    * - ScriptEntityFilter::fillComponents
+    * - ScriptEntityFilter::fillPositionBuffer
+    * - ScriptEntityFilter::fillPositions
     * - ScriptEntityFilter::init
+    * - ScriptEntityFilter::isSuspended
+    * - ScriptEntityFilter::positionBufferData
     * - ScriptEntityFilter::removedEntities
+    * - ScriptEntityFilter::setSuspended
     * - ScriptEntityFilter::shutdown
     *
     */
@@ -68,13 +93,13 @@ public:
     ~ScriptEntityFilter();
 
     /**
-    * @brief Returns the set of added entities
+    * @brief Returns the added entities
     *
     * Be sure to call clearChanges() once you have processed all added and
     * removed entities.
     *
     */
-    const std::unordered_set<EntityId>&
+    const std::vector<EntityId>&
     addedEntities();
 
     /**
@@ -98,12 +123,90 @@ public:
     ) const;
 
     /**
-    * @brief The set of entities that are contained in this filter
+    * @brief The entities that are contained in this filter
     *
+    * The order is arbitrary and changes when entities are removed.
     */
-    const std::unordered_set<EntityId>&
+    const std::vector<EntityId>&
     entities();
 
+    /**
+    * @brief The entity ids written by fillPositionBuffer()
+    *
+    * @param L
+    *
+    * @return
+    *   Light userdata pointing at an array of \c uint32_t, valid until
+    *   the next call to fillPositionBuffer()
+    */
+    luabind::object
+    entityBufferData(
+        lua_State* L
+    ) const;
+
+    /**
+    * @brief Writes one of the filtered components of all entities into a
+    *   Lua array
+    *
+    * Component \c i belongs to the entity at <tt>entities()[i]</tt>, as
+    * long as the filter doesn't change in between. The components are
+    * fetched when an entity enters the filter, so this doesn't look up
+    * anything per entity.
+    *
+    * @param componentType
+    *   The Lua class of the component, must be one of the types passed to
+    *   the constructor
+    * @param components
+    *   The table to write into. Entries beyond the returned count are left
+    *   as they were.
+    *
+    * @return
+    *   The number of entities written
+    */
+    unsigned int
+    fillComponents(
+        luabind::object componentType,
+        luabind::object components
+    );
+
+    /**
+    * @brief Writes the ids and positions of all entities with a scene node
+    *   into native buffers
+    *
+    * For use with the LuaJIT FFI, see entityBufferData() and
+    * positionBufferData().
+    *
+    * @return
+    *   The number of entities written
+    */
+    unsigned int
+    fillPositionBuffer();
+
+    /**
+    * @brief Writes the ids and positions of all entities with a scene node
+    *   into Lua arrays
+    *
+    * Entity \c i gets its id at <tt>ids[i]</tt> and its position at
+    * <tt>positions[3*i-2]</tt> to <tt>positions[3*i]</tt>. Entries beyond
+    * the returned count are left as they were, so the same tables can be
+    * reused every frame without reallocation.
+    *
+    * @param L
+    * @param ids
+    *   The table to write the entity ids into
+    * @param positions
+    *   The table to write the x, y and z coordinates into
+    *
+    * @return
+    *   The number of entities written
+    */
+    unsigned int
+    fillPositions(
+        lua_State* L,
+        luabind::object ids,
+        luabind::object positions
+    );
+
     /**
     * @brief Initializes this filter
     */
@@ -112,15 +215,51 @@ public:
         GameState* gameState
     );
 
+    bool
+    isSuspended() const override;
+
     /**
-    * @brief The set of removed entities
+    * @brief The positions written by fillPositionBuffer()
+    *
+    * @param L
+    *
+    * @return
+    *   Light userdata pointing at an array of \c float, three per entity,
+    *   valid until the next call to fillPositionBuffer()
+    */
+    luabind::object
+    positionBufferData(
+        lua_State* L
+    ) const;
+
+    /**
+    * @brief The removed entities
     *
     * Be sure to call clearChanges() once you have processed all added and
     * removed entities.
     */
-    const std::unordered_set<EntityId>&
+    const std::vector<EntityId>&
     removedEntities();
 
+    /**
+    * @brief Sets the entity manager this filter applies to
+    *
+    * Usually called through init() and shutdown().
+    *
+    * @param entityManager
+    *   The new entity manager to listen to. If \c nullptr, the filter
+    *   stays empty.
+    */
+    void
+    setEntityManager(
+        EntityManager* entityManager
+    );
+
+    void
+    setSuspended(
+        bool suspended
+    ) override;
+
     /**
     * @brief Shuts this filter down
     */
@@ -2,8 +2,10 @@
 
 #include "bullet/script_bindings.h"
 #include "engine/engine.h"
+#include "engine/logger.h"
 #include "engine/rng.h"
 #include "engine/script_bindings.h"
+#include "engine/serialization.h"
 #include "game.h"
 #include "microbe_stage/script_bindings.h"
 #include "ogre/script_bindings.h"
@@ -18,7 +20,8 @@ static void
 debug(
     const std::string& msg
 ) {
-    std::cout << msg << std::endl;
+    static LogChannel& log = Logger::instance().channel("scripts");
+    log.info(msg);
 }
 
 static int
@@ -65,6 +68,22 @@ thrive::initializeLua(
     luabind::object globals = luabind::globals(L);
     globals["Engine"] = &(Game::instance().engine());
     globals["rng"] = &(Game::instance().engine().rng());
+    globals["logger"] = &Logger::instance();
+}
+
+
+void
+thrive::initializeWorkerLua(
+    lua_State* L
+) {
+    luabind::open(L);
+    luabind::module(L) [
+        luabind::def("debug", debug),
+        StorageContainer::luaBindings(),
+        StorageList::luaBindings(),
+        StorageSchema::luaBindings(),
+        OgreBindings::mathBindings()
+    ];
 }
 
 
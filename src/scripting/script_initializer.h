@@ -17,4 +17,19 @@ initializeLua(
     lua_State* L
 );
 
+/**
+* @brief Initializes a worker Lua state, see ScriptWorkerSystem
+*
+* Only registers classes that are plain data, i.e. StorageContainer,
+* StorageList and the OGRE math classes. Entities, components and the
+* engine are not available.
+*
+* @param L
+*   The state to initialize
+*/
+void
+initializeWorkerLua(
+    lua_State* L
+);
+
 }
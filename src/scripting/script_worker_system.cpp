@@ -0,0 +1,277 @@
+#include "scripting/script_worker_system.h"
+
+#include "engine/engine.h"
+#include "engine/serialization.h"
+#include "scripting/lua_include.h"
+#include "scripting/lua_state.h"
+#include "scripting/luabind.h"
+#include "scripting/script_cache.h"
+#include "scripting/script_initializer.h"
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <luabind/iterator_policy.hpp>
+#include <stdexcept>
+
+using namespace thrive;
+
+namespace {
+
+// The worker state's view of its ScriptWorkerSystem, bound as the global
+// Worker
+class WorkerInterface {
+
+public:
+
+    static luabind::scope
+    luaBindings() {
+        using namespace luabind;
+        return class_<WorkerInterface>("WorkerInterface")
+            .def("addSystem", &WorkerInterface::addSystem)
+            .def("receive", &WorkerInterface::receive)
+            .def("send", &WorkerInterface::send)
+        ;
+    }
+
+    void
+    addSystem(
+        luabind::object system
+    ) {
+        if (luabind::type(system) != LUA_TTABLE) {
+            throw std::invalid_argument("Worker systems must be tables");
+        }
+        m_systems.push_back(system);
+    }
+
+    StorageList
+    receive() {
+        StorageList messages;
+        messages.swap(m_received);
+        return messages;
+    }
+
+    void
+    send(
+        const StorageContainer& message
+    ) {
+        m_sent.push_back(message);
+    }
+
+    // Delivered to the worker before its current update
+    StorageList m_received;
+
+    // Sent by the worker during its current update
+    StorageList m_sent;
+
+    std::vector<luabind::object> m_systems;
+
+};
+
+
+// Calls a method of each system that has it
+void
+callSystems(
+    const std::string& workerName,
+    const std::vector<luabind::object>& systems,
+    const char* method
+) {
+    for (const auto& system : systems) {
+        luabind::object function = system[method];
+        if (not function.is_valid() or luabind::type(function) == LUA_TNIL) {
+            continue;
+        }
+        try {
+            function(system);
+        }
+        catch (const luabind::error& e) {
+            std::string message = lua_tostring(e.state(), -1);
+            lua_pop(e.state(), 1);
+            throw std::runtime_error("Error in script worker " + workerName + ": " + message);
+        }
+    }
+}
+
+
+void
+updateSystems(
+    const std::string& workerName,
+    const std::vector<luabind::object>& systems,
+    int milliseconds
+) {
+    for (const auto& system : systems) {
+        try {
+            system["update"](system, milliseconds);
+        }
+        catch (const luabind::error& e) {
+            std::string message = lua_tostring(e.state(), -1);
+            lua_pop(e.state(), 1);
+            throw std::runtime_error("Error in script worker " + workerName + ": " + message);
+        }
+    }
+}
+
+}
+
+
+luabind::scope
+ScriptWorkerSystem::luaBindings() {
+    using namespace luabind;
+    return class_<ScriptWorkerSystem, System>("ScriptWorkerSystem")
+        .def(constructor<std::string, luabind::object>())
+        .def("name", &ScriptWorkerSystem::name)
+        .def("receive", &ScriptWorkerSystem::receive)
+        .def("send", &ScriptWorkerSystem::send)
+    ;
+}
+
+
+struct ScriptWorkerSystem::Implementation {
+
+    Implementation(
+        std::string name,
+        std::vector<std::string> scripts
+    ) : m_name(std::move(name)),
+        m_scripts(std::move(scripts))
+    {
+    }
+
+    void
+    closeLuaState() {
+        // The Lua objects have to go before their state
+        m_worker.m_systems.clear();
+        m_worker.m_received.clear();
+        m_worker.m_sent.clear();
+        m_luaState.reset();
+    }
+
+    // Messages from the main state, not yet delivered
+    StorageList m_inbox;
+
+    std::unique_ptr<LuaState> m_luaState;
+
+    boost::mutex m_mutex;
+
+    std::string m_name;
+
+    // Messages from the worker, not yet received by the main state
+    StorageList m_outbox;
+
+    std::vector<std::string> m_scripts;
+
+    WorkerInterface m_worker;
+
+};
+
+
+ScriptWorkerSystem::ScriptWorkerSystem(
+    std::string name,
+    std::vector<std::string> scripts
+) : m_impl(new Implementation(std::move(name), std::move(scripts)))
+{
+    this->declareIsolated();
+}
+
+
+ScriptWorkerSystem::ScriptWorkerSystem(
+    std::string name,
+    luabind::object scripts
+) : ScriptWorkerSystem(std::move(name), std::vector<std::string>())
+{
+    for (luabind::iterator iter(scripts), end; iter != end; ++iter) {
+        m_impl->m_scripts.push_back(luabind::object_cast<std::string>(*iter));
+    }
+}
+
+
+ScriptWorkerSystem::~ScriptWorkerSystem() {
+    m_impl->closeLuaState();
+}
+
+
+void
+ScriptWorkerSystem::init(
+    GameState* gameState
+) {
+    System::init(gameState);
+    m_impl->m_luaState.reset(new LuaState());
+    lua_State* L = *m_impl->m_luaState;
+    initializeWorkerLua(L);
+    luabind::module(L) [
+        WorkerInterface::luaBindings()
+    ];
+    luabind::globals(L)["Worker"] = &m_impl->m_worker;
+    Engine* engine = this->engine();
+    ScriptCache cache(engine->scriptDirectory(), engine->scriptCacheDirectory());
+    for (const auto& script : m_impl->m_scripts) {
+        int error = cache.load(L, script);
+        error = error or luabind::detail::pcall(L, 0, 0);
+        if (error) {
+            std::string message = lua_tostring(L, -1);
+            lua_pop(L, 1);
+            m_impl->closeLuaState();
+            throw std::runtime_error("Error in script worker " + m_impl->m_name + ": " + message);
+        }
+    }
+    callSystems(m_impl->m_name, m_impl->m_worker.m_systems, "init");
+}
+
+
+const std::string&
+ScriptWorkerSystem::name() const {
+    return m_impl->m_name;
+}
+
+
+StorageList
+ScriptWorkerSystem::receive() {
+    StorageList messages;
+    boost::lock_guard<boost::mutex> lock(m_impl->m_mutex);
+    messages.swap(m_impl->m_outbox);
+    return messages;
+}
+
+
+void
+ScriptWorkerSystem::send(
+    const StorageContainer& message
+) {
+    boost::lock_guard<boost::mutex> lock(m_impl->m_mutex);
+    m_impl->m_inbox.push_back(message);
+}
+
+
+void
+ScriptWorkerSystem::shutdown() {
+    if (m_impl->m_luaState) {
+        callSystems(m_impl->m_name, m_impl->m_worker.m_systems, "shutdown");
+    }
+    m_impl->closeLuaState();
+    System::shutdown();
+}
+
+
+void
+ScriptWorkerSystem::update(
+    int milliseconds
+) {
+    WorkerInterface& worker = m_impl->m_worker;
+    {
+        boost::lock_guard<boost::mutex> lock(m_impl->m_mutex);
+        worker.m_received.insert(
+            worker.m_received.end(),
+            m_impl->m_inbox.begin(),
+            m_impl->m_inbox.end()
+        );
+        m_impl->m_inbox.clear();
+    }
+    updateSystems(m_impl->m_name, worker.m_systems, milliseconds);
+    // Messages not taken by any system are dropped
+    worker.m_received.clear();
+    boost::lock_guard<boost::mutex> lock(m_impl->m_mutex);
+    m_impl->m_outbox.insert(
+        m_impl->m_outbox.end(),
+        worker.m_sent.begin(),
+        worker.m_sent.end()
+    );
+    worker.m_sent.clear();
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "engine/system.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace luabind {
+class object;
+class scope;
+}
+
+namespace thrive {
+
+class StorageContainer;
+class StorageList;
+
+/**
+* @brief Runs Lua systems in a Lua state of their own
+*
+* All regular Lua systems share the engine's Lua state and have to be
+* updated one after another on the main thread. A script worker has a
+* separate worker Lua state (see initializeWorkerLua()) and runs the
+* systems defined by its scripts there. The worker is isolated (see
+* System::declareIsolated()), so the SystemScheduler may update it on a
+* worker thread while the main state's systems are running.
+*
+* A worker script declares a system as parallel safe by adding it with
+* \c Worker:addSystem(). Such a system is a plain Lua table with an
+* \c update(self, milliseconds) method and optional \c init(self) and
+* \c shutdown(self) methods. The worker state has no access to entities,
+* components or the engine. Instead, the worker and the main state
+* exchange StorageContainer messages:
+*
+* - In the main state, send() queues a message for the worker and
+*   receive() returns the messages the worker has sent.
+* - In the worker state, \c Worker:send() queues a message for the main
+*   state and \c Worker:receive() takes the messages that were sent to
+*   the worker before its current update. Messages no system takes are
+*   dropped after the update.
+*
+* Messages are copied, so neither side can see the other's objects.
+* Messages sent by the worker become visible to the main state when the
+* worker's update is done, which may be in the same or the next frame.
+*
+* Example:
+* \code{.lua}
+* -- In setup.lua
+* local pathWorker = ScriptWorkerSystem("pathfinding", {
+*     "microbe_stage/workers/pathfinding.lua"
+* })
+*
+* -- In microbe_stage/workers/pathfinding.lua
+* PathfindingSystem = {}
+*
+* function PathfindingSystem:update(milliseconds)
+*     local requests = Worker:receive()
+*     for i = 1, requests:size() do
+*         Worker:send(findPath(requests:get(i)))
+*     end
+* end
+*
+* Worker:addSystem(PathfindingSystem)
+* \endcode
+*/
+class ScriptWorkerSystem : public System {
+
+public:
+
+    /**
+    * @brief Lua bindings
+    *
+    * Exposes:
+    * - ScriptWorkerSystem(name, scripts)
+    * - ScriptWorkerSystem::name
+    * - ScriptWorkerSystem::receive
+    * - ScriptWorkerSystem::send
+    *
+    * @return
+    */
+    static luabind::scope
+    luaBindings();
+
+    /**
+    * @brief Constructor
+    *
+    * @param name
+    *   The worker's name, for error messages
+    * @param scripts
+    *   The scripts to run in the worker state, relative to the script
+    *   directory (see Engine::scriptDirectory()). They are loaded in
+    *   init().
+    */
+    ScriptWorkerSystem(
+        std::string name,
+        std::vector<std::string> scripts
+    );
+
+    /**
+    * @brief Constructor
+    *
+    * @param name
+    *   The worker's name, for error messages
+    * @param scripts
+    *   A Lua table with the paths of the scripts
+    */
+    ScriptWorkerSystem(
+        std::string name,
+        luabind::object scripts
+    );
+
+    /**
+    * @brief Destructor
+    */
+    ~ScriptWorkerSystem();
+
+    /**
+    * @brief Creates the worker state and runs the scripts
+    *
+    * Calls the \c init method of each worker system.
+    *
+    * @throw std::runtime_error
+    *   If a script fails
+    */
+    void
+    init(
+        GameState* gameState
+    ) override;
+
+    /**
+    * @brief The worker's name
+    */
+    const std::string&
+    name() const;
+
+    /**
+    * @brief Takes the messages the worker has sent
+    *
+    * Thread safe.
+    *
+    * @return
+    *   The messages, in the order they were sent
+    */
+    StorageList
+    receive();
+
+    /**
+    * @brief Queues a message for the worker
+    *
+    * Thread safe. The worker receives it at the start of its next update.
+    *
+    * @param message
+    */
+    void
+    send(
+        const StorageContainer& message
+    );
+
+    /**
+    * @brief Calls the \c shutdown method of each worker system and closes
+    * the worker state
+    */
+    void
+    shutdown() override;
+
+    /**
+    * @brief Updates the worker systems in the order they were added
+    *
+    * @throw std::runtime_error
+    *   If a worker system fails
+    */
+    void
+    update(
+        int milliseconds
+    ) override;
+
+private:
+
+    struct Implementation;
+    std::unique_ptr<Implementation> m_impl;
+
+};
+
+}
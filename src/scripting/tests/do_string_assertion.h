@@ -1,9 +1,9 @@
 #pragma once
 
+#include "scripting/lua_include.h"
+
 #include <gtest/gtest.h>
 #include <luabind/luabind.hpp>
-#include <lualib.h>
-#include <lauxlib.h>
 
 static ::testing::AssertionResult 
 LuaSuccess(
@@ -0,0 +1,98 @@
+#include "scripting/lua_allocator.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace thrive;
+
+namespace {
+
+void*
+luaAlloc(
+    void* pointer,
+    size_t oldSize,
+    size_t newSize
+) {
+    return LuaAllocator::allocate(
+        &LuaAllocator::instance(),
+        pointer,
+        oldSize,
+        newSize
+    );
+}
+
+}
+
+
+TEST(LuaAllocator, AllocatesAndFrees) {
+    LuaAllocator::Statistics before = LuaAllocator::instance().statistics();
+    void* small = luaAlloc(nullptr, 0, 24);
+    void* large = luaAlloc(nullptr, 0, 1000);
+    ASSERT_NE(nullptr, small);
+    ASSERT_NE(nullptr, large);
+    std::memset(small, 1, 24);
+    std::memset(large, 2, 1000);
+    LuaAllocator::Statistics during = LuaAllocator::instance().statistics();
+    EXPECT_EQ(before.requestedBytes + 1024, during.requestedBytes);
+    EXPECT_EQ(before.largeBytes + 1000, during.largeBytes);
+    EXPECT_LE(during.pooledBytes, during.reservedBytes);
+    EXPECT_EQ(nullptr, luaAlloc(small, 24, 0));
+    EXPECT_EQ(nullptr, luaAlloc(large, 1000, 0));
+    LuaAllocator::Statistics after = LuaAllocator::instance().statistics();
+    EXPECT_EQ(before.requestedBytes, after.requestedBytes);
+    EXPECT_EQ(before.largeBytes, after.largeBytes);
+}
+
+
+TEST(LuaAllocator, Reallocates) {
+    LuaAllocator::Statistics before = LuaAllocator::instance().statistics();
+    char* block = static_cast<char*>(luaAlloc(nullptr, 0, 20));
+    for (int i = 0; i < 20; ++i) {
+        block[i] = char(i);
+    }
+    // Same size class
+    EXPECT_EQ(block, luaAlloc(block, 20, 30));
+    // Into a larger class, then past the pools
+    block = static_cast<char*>(luaAlloc(block, 30, 100));
+    block = static_cast<char*>(luaAlloc(block, 100, 600));
+    block = static_cast<char*>(luaAlloc(block, 600, 800));
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(char(i), block[i]);
+    }
+    // And back
+    block = static_cast<char*>(luaAlloc(block, 800, 40));
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(char(i), block[i]);
+    }
+    EXPECT_EQ(before.requestedBytes + 40, LuaAllocator::instance().statistics().requestedBytes);
+    luaAlloc(block, 40, 0);
+    LuaAllocator::Statistics after = LuaAllocator::instance().statistics();
+    EXPECT_EQ(before.requestedBytes, after.requestedBytes);
+    EXPECT_EQ(before.largeBytes, after.largeBytes);
+}
+
+
+TEST(LuaAllocator, ReturnsThreadCachesWhenThreadsEnd) {
+    LuaAllocator::Statistics before = LuaAllocator::instance().statistics();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] () {
+            std::vector<void*> blocks;
+            for (int i = 0; i < 1000; ++i) {
+                blocks.push_back(luaAlloc(nullptr, 0, 16 + i % 200));
+            }
+            for (int i = 0; i < 1000; ++i) {
+                luaAlloc(blocks[i], 16 + i % 200, 0);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    LuaAllocator::Statistics after = LuaAllocator::instance().statistics();
+    EXPECT_EQ(before.requestedBytes, after.requestedBytes);
+    EXPECT_EQ(before.pooledBytes, after.pooledBytes);
+    EXPECT_LT(before.reservedBytes, after.reservedBytes);
+}
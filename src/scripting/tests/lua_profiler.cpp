@@ -0,0 +1,138 @@
+#include "scripting/lua_profiler.h"
+
+#include "scripting/lua_include.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace {
+
+class LuaProfilerTest : public ::testing::Test {
+
+protected:
+
+    void
+    SetUp() override {
+        L = luaL_newstate();
+        luaL_openlibs(L);
+        ASSERT_EQ(0, luaL_dostring(L,
+            "function busy()\n"
+            "    local sum = 0\n"
+            "    for i = 1, 200000 do\n"
+            "        sum = sum + math.sqrt(i)\n"
+            "    end\n"
+            "    return sum\n"
+            "end\n"
+        ));
+    }
+
+    void
+    TearDown() override {
+        lua_close(L);
+    }
+
+    void
+    callBusy() {
+        lua_getglobal(L, "busy");
+        ASSERT_EQ(0, lua_pcall(L, 0, 0, 0));
+    }
+
+    lua_State* L = nullptr;
+
+};
+
+}
+
+
+TEST_F(LuaProfilerTest, Running) {
+    LuaProfiler profiler(L);
+    EXPECT_EQ(nullptr, LuaProfiler::running(L));
+    profiler.start(100);
+    EXPECT_EQ(&profiler, LuaProfiler::running(L));
+    profiler.stop();
+    EXPECT_FALSE(profiler.isRunning());
+    EXPECT_EQ(nullptr, LuaProfiler::running(L));
+}
+
+
+TEST_F(LuaProfilerTest, OnlySamplesSystems) {
+    LuaProfiler profiler(L);
+    profiler.start(100);
+    this->callBusy();
+    EXPECT_EQ(0u, profiler.sampledTime());
+    std::string name = "TestSystem";
+    {
+        LuaProfiler::SystemScope scope(LuaProfiler::running(L), name);
+        this->callBusy();
+    }
+    EXPECT_LT(0u, profiler.sampledTime());
+    std::string report = profiler.report(5);
+    EXPECT_NE(std::string::npos, report.find("TestSystem"));
+    EXPECT_NE(std::string::npos, report.find("busy"));
+    profiler.reset();
+    EXPECT_EQ(0u, profiler.sampledTime());
+}
+
+
+TEST_F(LuaProfilerTest, FlameGraph) {
+    LuaProfiler profiler(L);
+    profiler.start(100);
+    std::string name = "TestSystem";
+    {
+        LuaProfiler::SystemScope scope(&profiler, name);
+        this->callBusy();
+    }
+    profiler.stop();
+    auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    profiler.writeFlameGraph(path.string());
+    std::ifstream file(path.string());
+    std::string line;
+    bool hasBusy = false;
+    while (std::getline(file, line)) {
+        EXPECT_EQ(0u, line.find("TestSystem")) << line;
+        EXPECT_NE(std::string::npos, line.rfind(' ')) << line;
+        // The chunk name holds the start of the source
+        hasBusy = hasBusy or line.find(";function ([string \"function busy()") != std::string::npos;
+    }
+    EXPECT_TRUE(hasBusy);
+    file.close();
+    boost::filesystem::remove(path);
+}
+
+
+TEST_F(LuaProfilerTest, CountsCalls) {
+    LuaProfiler profiler(L);
+    profiler.setCountingCalls(true);
+    profiler.start(100000);
+    // Outside of systems, nothing is counted
+    this->callBusy();
+    EXPECT_EQ(0u, profiler.nativeCallCounts("sqrt").nativeCalls);
+    std::string name = "TestSystem";
+    {
+        LuaProfiler::SystemScope scope(&profiler, name);
+        this->callBusy();
+        LuaProfiler::countScriptCall(L, "callback");
+    }
+    LuaProfiler::CallCounts counts = profiler.callCounts("TestSystem");
+    EXPECT_EQ(1u, counts.updates);
+    EXPECT_EQ(1u, counts.scriptCalls);
+    EXPECT_EQ(200000u, counts.nativeCalls);
+    EXPECT_LT(0u, counts.nativeTime);
+    LuaProfiler::CallCounts sqrt = profiler.nativeCallCounts("sqrt");
+    EXPECT_EQ(200000u, sqrt.nativeCalls);
+    EXPECT_EQ(counts.nativeTime, sqrt.nativeTime);
+    std::string report = profiler.report(5);
+    EXPECT_NE(std::string::npos, report.find("sqrt"));
+    EXPECT_NE(std::string::npos, report.find("callback"));
+    profiler.setCountingCalls(false);
+    {
+        LuaProfiler::SystemScope scope(&profiler, name);
+        this->callBusy();
+    }
+    EXPECT_EQ(1u, profiler.callCounts("TestSystem").updates);
+    profiler.reset();
+    EXPECT_EQ(0u, profiler.callCounts("TestSystem").updates);
+}
@@ -0,0 +1,170 @@
+#include "scripting/lua_tasks.h"
+
+#include "scripting/lua_include.h"
+
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace {
+
+class LuaTasksTest : public ::testing::Test {
+
+protected:
+
+    void
+    SetUp() override {
+        L = luaL_newstate();
+        luaL_openlibs(L);
+    }
+
+    void
+    TearDown() override {
+        lua_close(L);
+    }
+
+    void
+    run(
+        const char* script
+    ) {
+        ASSERT_EQ(0, luaL_dostring(L, script)) << lua_tostring(L, -1);
+    }
+
+    lua_Integer
+    global(
+        const char* name
+    ) {
+        lua_getglobal(L, name);
+        lua_Integer value = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        return value;
+    }
+
+    lua_State* L = nullptr;
+
+};
+
+}
+
+
+TEST_F(LuaTasksTest, YieldsUntilNextFrame) {
+    LuaTasks tasks(L);
+    run(
+        "steps = 0\n"
+        "id = spawnTask(function(count)\n"
+        "    for i = 1, count do\n"
+        "        steps = steps + 1\n"
+        "        yield()\n"
+        "    end\n"
+        "end, 3)\n"
+    );
+    EXPECT_EQ(1u, tasks.count());
+    EXPECT_TRUE(tasks.isRunning(global("id")));
+    EXPECT_EQ(0, global("steps"));
+    for (int frame = 1; frame <= 3; ++frame) {
+        EXPECT_EQ(1u, tasks.update());
+        EXPECT_EQ(frame, global("steps"));
+    }
+    // The last resume returns from the loop
+    EXPECT_EQ(1u, tasks.update());
+    EXPECT_EQ(0u, tasks.count());
+    EXPECT_FALSE(tasks.isRunning(global("id")));
+    EXPECT_EQ(0u, tasks.update());
+}
+
+
+TEST_F(LuaTasksTest, WaitsFrames) {
+    LuaTasks tasks(L);
+    run(
+        "done = 0\n"
+        "spawnTask(function()\n"
+        "    waitFrames(3)\n"
+        "    done = 1\n"
+        "end)\n"
+    );
+    tasks.update();
+    tasks.update();
+    tasks.update();
+    EXPECT_EQ(0, global("done"));
+    tasks.update();
+    EXPECT_EQ(1, global("done"));
+    EXPECT_EQ(0u, tasks.count());
+}
+
+
+TEST_F(LuaTasksTest, SpawnsFromTasksForNextFrame) {
+    LuaTasks tasks(L);
+    run(
+        "inner = 0\n"
+        "spawnTask(function()\n"
+        "    spawnTask(function() inner = inner + 1 end)\n"
+        "end)\n"
+    );
+    EXPECT_EQ(1u, tasks.update());
+    EXPECT_EQ(0, global("inner"));
+    EXPECT_EQ(1u, tasks.count());
+    EXPECT_EQ(1u, tasks.update());
+    EXPECT_EQ(1, global("inner"));
+}
+
+
+TEST_F(LuaTasksTest, Cancels) {
+    LuaTasks tasks(L);
+    run(
+        "steps = 0\n"
+        "local function loop()\n"
+        "    while true do\n"
+        "        steps = steps + 1\n"
+        "        yield()\n"
+        "    end\n"
+        "end\n"
+        "first = spawnTask(loop)\n"
+        "second = spawnTask(loop)\n"
+    );
+    tasks.update();
+    EXPECT_EQ(2, global("steps"));
+    tasks.cancel(global("first"));
+    EXPECT_EQ(1u, tasks.count());
+    tasks.update();
+    EXPECT_EQ(3, global("steps"));
+    tasks.clear();
+    EXPECT_EQ(0u, tasks.count());
+}
+
+
+TEST_F(LuaTasksTest, EndsTasksOnError) {
+    LuaTasks tasks(L);
+    run(
+        "after = 0\n"
+        "spawnTask(function() error('broken') end)\n"
+        "spawnTask(function() after = 1 end)\n"
+    );
+    EXPECT_EQ(2u, tasks.update());
+    EXPECT_EQ(1, global("after"));
+    EXPECT_EQ(0u, tasks.count());
+    EXPECT_EQ(0, lua_gettop(L));
+}
+
+
+TEST_F(LuaTasksTest, ContinuesAfterBudget) {
+    LuaTasks tasks(L);
+    tasks.setBudget(0);
+    run(
+        "order = ''\n"
+        "for _, name in ipairs({'a', 'b', 'c'}) do\n"
+        "    spawnTask(function()\n"
+        "        while true do\n"
+        "            order = order .. name\n"
+        "            yield()\n"
+        "        end\n"
+        "    end)\n"
+        "end\n"
+    );
+    // One resume per frame, taking turns
+    for (int frame = 0; frame < 4; ++frame) {
+        EXPECT_EQ(1u, tasks.update());
+    }
+    lua_getglobal(L, "order");
+    EXPECT_STREQ("abca", lua_tostring(L, -1));
+    lua_pop(L, 1);
+}
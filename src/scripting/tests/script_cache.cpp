@@ -0,0 +1,139 @@
+#include "scripting/script_cache.h"
+
+#include "scripting/lua_include.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace thrive;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+class ScriptCacheTest : public ::testing::Test {
+
+protected:
+
+    void
+    SetUp() override {
+        m_directory = fs::temp_directory_path() / fs::unique_path();
+        fs::create_directories(m_directory / "scripts" / "sub");
+        L = luaL_newstate();
+    }
+
+    void
+    TearDown() override {
+        lua_close(L);
+        fs::remove_all(m_directory);
+    }
+
+    lua_Number
+    run(
+        ScriptCache& cache,
+        const fs::path& script
+    ) {
+        EXPECT_EQ(0, cache.load(L, script));
+        EXPECT_EQ(0, lua_pcall(L, 0, 1, 0));
+        lua_Number result = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        return result;
+    }
+
+    void
+    write(
+        const fs::path& path,
+        const std::string& contents
+    ) {
+        std::ofstream file((m_directory / "scripts" / path).string());
+        file << contents;
+    }
+
+    fs::path m_directory;
+
+    lua_State* L = nullptr;
+
+};
+
+}
+
+
+TEST_F(ScriptCacheTest, ManifestOrder) {
+    this->write("manifest.txt", "// Comment\nb.lua\n\nsub\na.lua\nmissing.lua\n");
+    this->write("sub/manifest.txt", "c.lua\n");
+    this->write("a.lua", "");
+    this->write("b.lua", "");
+    this->write("sub/c.lua", "");
+    auto scripts = ScriptCache::manifestScripts(m_directory / "scripts");
+    std::vector<fs::path> expected = {
+        "b.lua",
+        fs::path("sub") / "c.lua",
+        "a.lua"
+    };
+    EXPECT_EQ(expected, scripts);
+}
+
+
+TEST_F(ScriptCacheTest, LoadsFromCache) {
+    this->write("a.lua", "return 1");
+    ScriptCache cache(m_directory / "scripts", m_directory / "cache");
+    EXPECT_EQ(1, this->run(cache, "a.lua"));
+    fs::path cachePath = m_directory / "cache" / "a.lua.luac";
+    ASSERT_TRUE(fs::exists(cachePath));
+    // Same size and time stamp, so the stale source is not read
+    std::time_t time = fs::last_write_time(m_directory / "scripts" / "a.lua");
+    this->write("a.lua", "return 2");
+    fs::last_write_time(m_directory / "scripts" / "a.lua", time);
+    EXPECT_EQ(1, this->run(cache, "a.lua"));
+}
+
+
+TEST_F(ScriptCacheTest, RecompilesChangedScripts) {
+    this->write("a.lua", "return 1");
+    ScriptCache cache(m_directory / "scripts", m_directory / "cache");
+    EXPECT_EQ(1, this->run(cache, "a.lua"));
+    this->write("a.lua", "return 20");
+    EXPECT_EQ(20, this->run(cache, "a.lua"));
+    // Touched, but unchanged
+    fs::path sourcePath = m_directory / "scripts" / "a.lua";
+    fs::last_write_time(sourcePath, fs::last_write_time(sourcePath) + 10);
+    EXPECT_EQ(20, this->run(cache, "a.lua"));
+}
+
+
+TEST_F(ScriptCacheTest, IsUpToDate) {
+    this->write("a.lua", "return 1");
+    ScriptCache cache(m_directory / "scripts", m_directory / "cache");
+    EXPECT_FALSE(cache.isUpToDate("a.lua"));
+    EXPECT_EQ(0, cache.compile(L, "a.lua"));
+    EXPECT_TRUE(cache.isUpToDate("a.lua"));
+    this->write("a.lua", "return 20");
+    EXPECT_FALSE(cache.isUpToDate("a.lua"));
+    EXPECT_FALSE(cache.isUpToDate("missing.lua"));
+}
+
+
+TEST_F(ScriptCacheTest, IgnoresCorruptCache) {
+    this->write("a.lua", "return 1");
+    ScriptCache cache(m_directory / "scripts", m_directory / "cache");
+    EXPECT_EQ(0, cache.compile(L, "a.lua"));
+    EXPECT_EQ(0, lua_gettop(L));
+    {
+        std::ofstream file((m_directory / "cache" / "a.lua.luac").string());
+        file << "garbage";
+    }
+    EXPECT_EQ(1, this->run(cache, "a.lua"));
+}
+
+
+TEST_F(ScriptCacheTest, Errors) {
+    this->write("a.lua", "return (");
+    ScriptCache cache(m_directory / "scripts", m_directory / "cache");
+    EXPECT_EQ(LUA_ERRSYNTAX, cache.load(L, "a.lua"));
+    EXPECT_EQ(1, lua_gettop(L));
+    lua_pop(L, 1);
+    EXPECT_FALSE(fs::exists(m_directory / "cache" / "a.lua.luac"));
+    EXPECT_EQ(LUA_ERRFILE, cache.load(L, "missing.lua"));
+    lua_pop(L, 1);
+}
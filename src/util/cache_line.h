@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+namespace thrive {
+
+/**
+* @brief The size of a cache line on the platforms we target
+*
+* Data written by different threads is aligned to this, so that the
+* threads don't invalidate each other's cache lines (false sharing).
+*/
+static const size_t CACHE_LINE_SIZE = 64;
+
+/**
+* @brief Rounds up to the next power of two
+*
+* @param value
+*   Must be greater than 0
+*/
+inline size_t
+nextPowerOfTwo(
+    size_t value
+) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
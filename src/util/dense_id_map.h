@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief Maps small, contiguous ids to values through a flat array
+*
+* Meant for ids that are handed out by a counter, like agent ids. Lookups
+* are plain array accesses. Memory usage is proportional to the largest id
+* that has been written to, not to the number of entries.
+*
+* @tparam Id
+*   An unsigned integer type
+* @tparam T
+*   The value type. Ids without a value read as \c T().
+*/
+template<typename Id, typename T>
+class DenseIdMap {
+
+public:
+
+    /**
+    * @brief Returns the value for an id, growing the array if necessary
+    *
+    * @param id
+    */
+    T&
+    operator[] (
+        Id id
+    ) {
+        if (id >= m_values.size()) {
+            m_values.resize(static_cast<size_t>(id) + 1, T());
+        }
+        return m_values[id];
+    }
+
+    /**
+    * @brief Resets all values to \c T()
+    *
+    * Keeps the array, so refilling the map doesn't allocate.
+    */
+    void
+    clear() {
+        std::fill(m_values.begin(), m_values.end(), T());
+    }
+
+    /**
+    * @brief Returns the value for an id
+    *
+    * @param id
+    *
+    * @return
+    *   The value or \c T() if none has been set
+    */
+    T
+    get(
+        Id id
+    ) const {
+        if (id < m_values.size()) {
+            return m_values[id];
+        }
+        return T();
+    }
+
+    /**
+    * @brief The values, indexed by id
+    */
+    const std::vector<T>&
+    values() const {
+        return m_values;
+    }
+
+private:
+
+    std::vector<T> m_values;
+
+};
+
+
+/**
+* @brief A set of small, contiguous ids
+*
+* Membership tests are a bit lookup. The ids are also kept in a sorted
+* list for iteration, so inserting and erasing cost a bit more and should
+* be comparatively rare.
+*
+* @tparam Id
+*   An unsigned integer type
+*/
+template<typename Id>
+class DenseIdSet {
+
+public:
+
+    using const_iterator = typename std::vector<Id>::const_iterator;
+
+    /**
+    * @brief Iterator to the smallest id
+    */
+    const_iterator
+    begin() const {
+        return m_ids.begin();
+    }
+
+    /**
+    * @brief Removes all ids
+    */
+    void
+    clear() {
+        m_bits.clear();
+        m_ids.clear();
+    }
+
+    /**
+    * @brief Whether the set contains an id
+    *
+    * @param id
+    */
+    bool
+    contains(
+        Id id
+    ) const {
+        return id < m_bits.size() and m_bits[id];
+    }
+
+    /**
+    * @brief Whether the set is empty
+    */
+    bool
+    empty() const {
+        return m_ids.empty();
+    }
+
+    /**
+    * @brief Iterator past the largest id
+    */
+    const_iterator
+    end() const {
+        return m_ids.end();
+    }
+
+    /**
+    * @brief Removes an id
+    *
+    * @param id
+    *
+    * @return
+    *   \c true if the id was in the set
+    */
+    bool
+    erase(
+        Id id
+    ) {
+        if (not this->contains(id)) {
+            return false;
+        }
+        m_bits[id] = false;
+        m_ids.erase(std::lower_bound(m_ids.begin(), m_ids.end(), id));
+        return true;
+    }
+
+    /**
+    * @brief Adds an id
+    *
+    * @param id
+    *
+    * @return
+    *   \c true if the id wasn't in the set yet
+    */
+    bool
+    insert(
+        Id id
+    ) {
+        if (this->contains(id)) {
+            return false;
+        }
+        if (id >= m_bits.size()) {
+            m_bits.resize(static_cast<size_t>(id) + 1, false);
+        }
+        m_bits[id] = true;
+        m_ids.insert(std::lower_bound(m_ids.begin(), m_ids.end(), id), id);
+        return true;
+    }
+
+    /**
+    * @brief The number of ids in the set
+    */
+    size_t
+    size() const {
+        return m_ids.size();
+    }
+
+private:
+
+    std::vector<bool> m_bits;
+
+    std::vector<Id> m_ids;
+
+};
+
+}
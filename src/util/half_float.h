@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace thrive {
+
+/**
+* @brief Converts a float to IEEE 754 half precision
+*
+* Rounds to the nearest representable value, ties to even. Values beyond
+* the half range become infinity, tiny ones subnormals or zero. NaN stays
+* NaN.
+*
+* @param value
+*
+* @return
+*   The bits of the half precision value
+*/
+inline uint16_t
+halfFromFloat(
+    float value
+) {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent == 0xff) {
+        // Infinity, or NaN with its quiet bit set
+        return sign | 0x7c00 | (mantissa ? 0x0200 : 0);
+    }
+    int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (halfExponent >= 0x1f) {
+        return sign | 0x7c00;
+    }
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) {
+            return sign;
+        }
+        // Subnormal, the implicit leading bit becomes explicit
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway or (remainder == halfway and (half & 1))) {
+            half += 1;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 or (remainder == 0x1000 and (half & 1))) {
+        // May carry into the exponent, up to infinity, which is right
+        half += 1;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+
+
+/**
+* @brief Converts IEEE 754 half precision to a float
+*
+* Exact, every half precision value is a float.
+*
+* @param half
+*   The bits of the half precision value
+*/
+inline float
+floatFromHalf(
+    uint16_t half
+) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits = 0;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else if (mantissa != 0) {
+        // Subnormal, normalized for the float's wider exponent
+        exponent = 127 - 15 + 1;
+        while (not (mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent -= 1;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    else {
+        bits = sign;
+    }
+    float value = 0.0f;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+/**
+* @brief Packs two floats as half precision into 32 bits
+*
+* @param first
+*   Goes into the low 16 bits
+* @param second
+*   Goes into the high 16 bits
+*/
+inline uint32_t
+packHalves(
+    float first,
+    float second
+) {
+    return static_cast<uint32_t>(halfFromFloat(first)) |
+        (static_cast<uint32_t>(halfFromFloat(second)) << 16);
+}
+
+
+/**
+* @brief The first float packed by packHalves()
+*
+* @param packed
+*/
+inline float
+firstHalf(
+    uint32_t packed
+) {
+    return floatFromHalf(static_cast<uint16_t>(packed & 0xffff));
+}
+
+
+/**
+* @brief The second float packed by packHalves()
+*
+* @param packed
+*/
+inline float
+secondHalf(
+    uint32_t packed
+) {
+    return floatFromHalf(static_cast<uint16_t>(packed >> 16));
+}
+
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief Writes compact JSON to a stream
+*
+* Keeps track of the open objects and arrays to place the commas, so
+* callers only list keys and values:
+* \code
+* JsonWriter writer(stream);
+* writer.beginObject();
+* writer.key("fps").value(60);
+* writer.key("systems").beginArray();
+* writer.value("RenderSystem");
+* writer.endArray();
+* writer.endObject();
+* \endcode
+* writes <tt>{"fps":60,"systems":["RenderSystem"]}</tt>. Numbers that JSON
+* can't represent, like NaN, are written as \c null.
+*/
+class JsonWriter {
+
+public:
+
+    /**
+    * @brief Writes \a string as a quoted JSON string
+    */
+    static void
+    writeString(
+        std::ostream& stream,
+        const std::string& string
+    ) {
+        stream << '"';
+        for (char character : string) {
+            switch (character) {
+                case '"':
+                    stream << "\\\"";
+                    break;
+                case '\\':
+                    stream << "\\\\";
+                    break;
+                case '\n':
+                    stream << "\\n";
+                    break;
+                default:
+                    if (static_cast<unsigned char>(character) < 0x20) {
+                        stream << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                            << static_cast<int>(character) << std::dec << std::setfill(' ');
+                    }
+                    else {
+                        stream << character;
+                    }
+            }
+        }
+        stream << '"';
+    }
+
+    /**
+    * @brief Constructor
+    *
+    * @param stream
+    *   The stream to write to
+    */
+    explicit JsonWriter(
+        std::ostream& stream
+    ) : m_stream(stream)
+    {
+        m_stream << std::setprecision(std::numeric_limits<double>::digits10);
+    }
+
+    JsonWriter(const JsonWriter&) = delete;
+
+    JsonWriter& operator= (const JsonWriter&) = delete;
+
+    /**
+    * @brief Opens an array
+    */
+    JsonWriter&
+    beginArray() {
+        this->beginValue();
+        m_stream << '[';
+        m_isEmpty.push_back(true);
+        return *this;
+    }
+
+    /**
+    * @brief Opens an object
+    */
+    JsonWriter&
+    beginObject() {
+        this->beginValue();
+        m_stream << '{';
+        m_isEmpty.push_back(true);
+        return *this;
+    }
+
+    /**
+    * @brief Closes the innermost array
+    */
+    JsonWriter&
+    endArray() {
+        this->end();
+        m_stream << ']';
+        return *this;
+    }
+
+    /**
+    * @brief Closes the innermost object
+    */
+    JsonWriter&
+    endObject() {
+        this->end();
+        m_stream << '}';
+        return *this;
+    }
+
+    /**
+    * @brief Writes an object key, the next call writes its value
+    */
+    JsonWriter&
+    key(
+        const std::string& name
+    ) {
+        this->beginValue();
+        writeString(m_stream, name);
+        m_stream << ':';
+        m_isAfterKey = true;
+        return *this;
+    }
+
+    /**
+    * @brief Writes a string
+    */
+    JsonWriter&
+    value(
+        const std::string& string
+    ) {
+        this->beginValue();
+        writeString(m_stream, string);
+        return *this;
+    }
+
+    /**
+    * @brief Writes a string
+    */
+    JsonWriter&
+    value(
+        const char* string
+    ) {
+        return this->value(std::string(string));
+    }
+
+    /**
+    * @brief Writes \c true or \c false
+    */
+    JsonWriter&
+    value(
+        bool boolean
+    ) {
+        this->beginValue();
+        m_stream << (boolean ? "true" : "false");
+        return *this;
+    }
+
+    /**
+    * @brief Writes a number, or \c null if it isn't finite
+    */
+    JsonWriter&
+    value(
+        double number
+    ) {
+        this->beginValue();
+        if (std::isfinite(number)) {
+            m_stream << number;
+        }
+        else {
+            m_stream << "null";
+        }
+        return *this;
+    }
+
+    /**
+    * @brief Writes an integer
+    */
+    JsonWriter&
+    value(
+        int64_t number
+    ) {
+        this->beginValue();
+        m_stream << number;
+        return *this;
+    }
+
+    /**
+    * @brief Writes an integer
+    */
+    JsonWriter&
+    value(
+        uint64_t number
+    ) {
+        this->beginValue();
+        m_stream << number;
+        return *this;
+    }
+
+    /**
+    * @brief Writes an integer
+    */
+    JsonWriter&
+    value(
+        int number
+    ) {
+        return this->value(static_cast<int64_t>(number));
+    }
+
+    /**
+    * @brief Writes an integer
+    */
+    JsonWriter&
+    value(
+        unsigned int number
+    ) {
+        return this->value(static_cast<uint64_t>(number));
+    }
+
+private:
+
+    // Writes the comma before a value or key, if it needs one
+    void
+    beginValue() {
+        if (m_isAfterKey) {
+            m_isAfterKey = false;
+            return;
+        }
+        if (not m_isEmpty.empty()) {
+            if (not m_isEmpty.back()) {
+                m_stream << ',';
+            }
+            m_isEmpty.back() = false;
+        }
+    }
+
+    void
+    end() {
+        if (m_isEmpty.empty() or m_isAfterKey) {
+            throw std::logic_error("JsonWriter: nothing to close");
+        }
+        m_isEmpty.pop_back();
+    }
+
+    // Per open object or array, whether it has no elements yet
+    std::vector<bool> m_isEmpty;
+
+    bool m_isAfterKey = false;
+
+    std::ostream& m_stream;
+
+};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <streambuf>
+
+namespace thrive {
+
+/**
+* @brief A read-only stream buffer over memory that is not copied
+*
+* For reading with std::istream from memory mapped files. The memory must
+* outlive the buffer.
+*
+* Usage:
+* \code
+* MemoryBuffer buffer(file.data, file.data + file.size);
+* std::istream stream(&buffer);
+* \endcode
+*/
+class MemoryBuffer : public std::streambuf {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param begin
+    * @param end
+    */
+    MemoryBuffer(
+        const char* begin,
+        const char* end
+    ) {
+        // The get area is never written to
+        char* data = const_cast<char*>(begin);
+        this->setg(data, data, const_cast<char*>(end));
+    }
+
+protected:
+
+    pos_type
+    seekoff(
+        off_type offset,
+        std::ios_base::seekdir direction,
+        std::ios_base::openmode
+    ) override {
+        char* position = nullptr;
+        if (direction == std::ios_base::beg) {
+            position = this->eback() + offset;
+        }
+        else if (direction == std::ios_base::cur) {
+            position = this->gptr() + offset;
+        }
+        else {
+            position = this->egptr() + offset;
+        }
+        if (position < this->eback() or position > this->egptr()) {
+            return pos_type(off_type(-1));
+        }
+        this->setg(this->eback(), position, this->egptr());
+        return pos_type(position - this->eback());
+    }
+
+    pos_type
+    seekpos(
+        pos_type position,
+        std::ios_base::openmode mode
+    ) override {
+        return this->seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+
+};
+
+}
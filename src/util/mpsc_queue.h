@@ -0,0 +1,180 @@
+#pragma once
+
+#include "util/cache_line.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace thrive {
+
+/**
+* @brief A bounded queue for many producer threads and one consumer thread
+*
+* A ring buffer of a fixed size, where each cell carries a sequence number
+* that tells whether it is free for the producer at its position or holds
+* a value for the consumer. Producers claim cells with a compare-and-swap
+* on the tail, the consumer takes them in order without any atomic
+* read-modify-write. No side takes a lock, a full queue makes tryPush()
+* fail and an empty one makes tryPop() fail. Use it for events that
+* several threads report to the main thread, like input events or
+* finished jobs.
+*
+* A producer that is preempted between claiming a cell and filling it
+* holds up the consumer at that cell, values behind it are only popped
+* once it is done. Producers never wait for each other.
+*
+* @tparam T
+*   A default constructible, movable type
+*/
+template<typename T>
+class MpscQueue {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param capacity
+    *   The most values the queue holds. Rounded up to a power of two.
+    *
+    * @throws std::invalid_argument
+    *   If \a capacity is 0
+    */
+    explicit MpscQueue(
+        size_t capacity
+    ) : m_capacity(capacity > 0 ? nextPowerOfTwo(capacity) : 0),
+        m_mask(m_capacity - 1),
+        m_cells(new Cell[m_capacity])
+    {
+        if (capacity == 0) {
+            throw std::invalid_argument("Queue capacity must not be 0");
+        }
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+
+    MpscQueue& operator= (const MpscQueue&) = delete;
+
+    /**
+    * @brief The most values the queue holds
+    */
+    size_t
+    capacity() const {
+        return m_capacity;
+    }
+
+    /**
+    * @brief Takes the oldest value
+    *
+    * Consumer thread only.
+    *
+    * @param value
+    *   Receives the value. Left alone if the queue is empty.
+    *
+    * @return
+    *   \c false if the queue was empty, or the oldest value isn't written
+    *   completely yet
+    */
+    bool
+    tryPop(
+        T& value
+    ) {
+        Cell& cell = m_cells[m_head & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != m_head + 1) {
+            return false;
+        }
+        value = std::move(cell.value);
+        // Free for the producer one lap later
+        cell.sequence.store(m_head + m_capacity, std::memory_order_release);
+        m_head += 1;
+        return true;
+    }
+
+    /**
+    * @brief Appends a value
+    *
+    * Thread safe.
+    *
+    * @param value
+    *   The value. Left alone if the queue is full.
+    *
+    * @return
+    *   \c false if the queue was full
+    */
+    bool
+    tryPush(
+        T&& value
+    ) {
+        size_t position = m_tail.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &m_cells[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference =
+                static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                // Updates position on failure
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) {
+                // The consumer hasn't taken the value of the last lap
+                return false;
+            }
+            else {
+                // Another producer claimed the cell
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * @brief Appends a copy of a value
+    *
+    * @see tryPush(T&&)
+    */
+    bool
+    tryPush(
+        const T& value
+    ) {
+        T copy(value);
+        return this->tryPush(std::move(copy));
+    }
+
+private:
+
+    struct Cell {
+
+        // position: free for the producer at position
+        // position + 1: holds the value for the consumer
+        std::atomic<size_t> sequence;
+
+        T value;
+
+    };
+
+    const size_t m_capacity;
+
+    const size_t m_mask;
+
+    std::unique_ptr<Cell[]> m_cells;
+
+    // Only used by the consumer
+    alignas(CACHE_LINE_SIZE) size_t m_head = 0;
+
+    // Claimed by the producers
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail = {0};
+
+};
+
+}
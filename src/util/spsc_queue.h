@@ -0,0 +1,181 @@
+#pragma once
+
+#include "util/cache_line.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace thrive {
+
+/**
+* @brief A bounded, lock-free queue for one producer and one consumer thread
+*
+* The queue is a ring buffer of a fixed size. The producer only writes the
+* tail, the consumer only writes the head, and each side caches the last
+* position it has seen of the other one, so a push or pop usually touches
+* no cache line that the other thread is writing. Neither side ever waits
+* for the other, a full queue makes tryPush() fail and an empty one makes
+* tryPop() fail. Use it for handing results from a worker to the main
+* thread, like finished physics steps or chunks of a savegame.
+*
+* Exactly one thread may push and exactly one thread may pop at a time.
+* For several producers, see MpscQueue.
+*
+* @tparam T
+*   A default constructible, movable type. Popped values are moved out of
+*   the buffer, the moved-from objects stay in it until overwritten.
+*/
+template<typename T>
+class SpscQueue {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param capacity
+    *   The most values the queue holds. Rounded up to a power of two.
+    *
+    * @throws std::invalid_argument
+    *   If \a capacity is 0
+    */
+    explicit SpscQueue(
+        size_t capacity
+    ) : m_capacity(capacity > 0 ? nextPowerOfTwo(capacity) : 0),
+        m_mask(m_capacity - 1),
+        m_buffer(m_capacity)
+    {
+        if (capacity == 0) {
+            throw std::invalid_argument("Queue capacity must not be 0");
+        }
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+
+    SpscQueue& operator= (const SpscQueue&) = delete;
+
+    /**
+    * @brief The most values the queue holds
+    */
+    size_t
+    capacity() const {
+        return m_capacity;
+    }
+
+    /**
+    * @brief Whether the queue was empty at some point during the call
+    *
+    * Exact only on the consumer thread.
+    */
+    bool
+    empty() const {
+        return this->size() == 0;
+    }
+
+    /**
+    * @brief The number of values in the queue at some point during the
+    * call
+    *
+    * Only a lower bound on the consumer thread and an upper bound on the
+    * producer thread.
+    */
+    size_t
+    size() const {
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    /**
+    * @brief Takes the oldest value
+    *
+    * Consumer thread only.
+    *
+    * @param value
+    *   Receives the value. Left alone if the queue is empty.
+    *
+    * @return
+    *   \c false if the queue was empty
+    */
+    bool
+    tryPop(
+        T& value
+    ) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        value = std::move(m_buffer[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * @brief Appends a value
+    *
+    * Producer thread only.
+    *
+    * @param value
+    *   The value. Left alone if the queue is full.
+    *
+    * @return
+    *   \c false if the queue was full
+    */
+    bool
+    tryPush(
+        T&& value
+    ) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead == m_capacity) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead == m_capacity) {
+                return false;
+            }
+        }
+        m_buffer[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * @brief Appends a copy of a value
+    *
+    * @see tryPush(T&&)
+    */
+    bool
+    tryPush(
+        const T& value
+    ) {
+        T copy(value);
+        return this->tryPush(std::move(copy));
+    }
+
+private:
+
+    const size_t m_capacity;
+
+    const size_t m_mask;
+
+    std::vector<T> m_buffer;
+
+    // Positions only ever grow, the index is the position & m_mask
+
+    // Written by the consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head = {0};
+
+    // The consumer's copy of m_tail
+    size_t m_cachedTail = 0;
+
+    // Written by the producer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail = {0};
+
+    // The producer's copy of m_head
+    size_t m_cachedHead = 0;
+
+};
+
+}
@@ -0,0 +1,49 @@
+#include "util/half_float.h"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+
+using namespace thrive;
+
+
+TEST(HalfFloat, RoundTrips) {
+    // Exactly representable
+    for (float value : {0.0f, 1.0f, -2.5f, 0.3125f, 1024.0f, 65504.0f, 6.1035156e-05f}) {
+        EXPECT_EQ(value, floatFromHalf(halfFromFloat(value))) << value;
+    }
+    EXPECT_EQ(0x3c00, halfFromFloat(1.0f));
+    EXPECT_EQ(0xc000, halfFromFloat(-2.0f));
+    // Negative zero keeps its sign
+    EXPECT_EQ(0x8000, halfFromFloat(-0.0f));
+    // Smallest subnormal
+    EXPECT_EQ(0x0001, halfFromFloat(5.9604645e-08f));
+    EXPECT_EQ(5.9604645e-08f, floatFromHalf(0x0001));
+    for (uint32_t half = 0; half <= 0xffff; ++half) {
+        float value = floatFromHalf(static_cast<uint16_t>(half));
+        if (not std::isnan(value)) {
+            EXPECT_EQ(half, halfFromFloat(value));
+        }
+    }
+}
+
+
+TEST(HalfFloat, Rounds) {
+    // Half precision has 11 significant bits
+    EXPECT_NEAR(0.3f, floatFromHalf(halfFromFloat(0.3f)), 0.3f / 2048);
+    EXPECT_NEAR(123.456f, floatFromHalf(halfFromFloat(123.456f)), 123.456f / 2048);
+    // Ties go to the even mantissa
+    EXPECT_EQ(2048.0f, floatFromHalf(halfFromFloat(2049.0f)));
+    EXPECT_EQ(2052.0f, floatFromHalf(halfFromFloat(2051.0f)));
+    // Out of range
+    EXPECT_EQ(std::numeric_limits<float>::infinity(), floatFromHalf(halfFromFloat(1.0e6f)));
+    EXPECT_EQ(0.0f, floatFromHalf(halfFromFloat(1.0e-10f)));
+    EXPECT_TRUE(std::isnan(floatFromHalf(halfFromFloat(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+
+TEST(HalfFloat, PacksPairs) {
+    uint32_t packed = packHalves(1.5f, -0.25f);
+    EXPECT_EQ(1.5f, firstHalf(packed));
+    EXPECT_EQ(-0.25f, secondHalf(packed));
+}
@@ -0,0 +1,57 @@
+#include "util/json_writer.h"
+
+#include <gtest/gtest.h>
+#include <limits>
+#include <sstream>
+
+using namespace thrive;
+
+
+TEST(JsonWriter, Nesting) {
+    std::ostringstream stream;
+    JsonWriter writer(stream);
+    writer.beginObject();
+    writer.key("fps").value(60);
+    writer.key("systems").beginArray();
+    writer.value("RenderSystem");
+    writer.value("PhysicsSystem");
+    writer.endArray();
+    writer.key("empty").beginObject().endObject();
+    writer.key("visible").value(true);
+    writer.endObject();
+    EXPECT_EQ(
+        "{\"fps\":60,\"systems\":[\"RenderSystem\",\"PhysicsSystem\"],\"empty\":{},\"visible\":true}",
+        stream.str()
+    );
+}
+
+
+TEST(JsonWriter, Numbers) {
+    std::ostringstream stream;
+    JsonWriter writer(stream);
+    writer.beginArray();
+    writer.value(0.25);
+    writer.value(std::numeric_limits<double>::quiet_NaN());
+    writer.value(std::numeric_limits<double>::infinity());
+    writer.value(static_cast<uint64_t>(18446744073709551615ULL));
+    writer.value(-3);
+    writer.endArray();
+    EXPECT_EQ("[0.25,null,null,18446744073709551615,-3]", stream.str());
+}
+
+
+TEST(JsonWriter, EscapesStrings) {
+    std::ostringstream stream;
+    JsonWriter::writeString(stream, "a \"b\"\\\n\t");
+    EXPECT_EQ("\"a \\\"b\\\"\\\\\\n\\u0009\"", stream.str());
+}
+
+
+TEST(JsonWriter, UnbalancedEnd) {
+    std::ostringstream stream;
+    JsonWriter writer(stream);
+    EXPECT_THROW(writer.endObject(), std::logic_error);
+    writer.beginObject();
+    writer.key("dangling");
+    EXPECT_THROW(writer.endObject(), std::logic_error);
+}
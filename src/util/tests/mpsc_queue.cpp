@@ -0,0 +1,67 @@
+#include "util/mpsc_queue.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(MpscQueue, PushesAndPopsInOrder) {
+    EXPECT_THROW(MpscQueue<int>(0), std::invalid_argument);
+    MpscQueue<int> queue(3);
+    EXPECT_EQ(4u, queue.capacity());
+    int value = 0;
+    EXPECT_FALSE(queue.tryPop(value));
+    for (int i = 1; i <= 4; ++i) {
+        EXPECT_TRUE(queue.tryPush(i));
+    }
+    EXPECT_FALSE(queue.tryPush(5));
+    EXPECT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(1, value);
+    // The freed cell is reused one lap later
+    EXPECT_TRUE(queue.tryPush(5));
+    for (int expected = 2; expected <= 5; ++expected) {
+        EXPECT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(expected, value);
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+}
+
+
+TEST(MpscQueue, CollectsFromSeveralThreads) {
+    const int PRODUCERS = 4;
+    const int COUNT = 5000;
+    MpscQueue<int> queue(128);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&queue, p] () {
+            for (int i = 0; i < COUNT; ++i) {
+                while (not queue.tryPush(p * COUNT + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    // Each producer's values arrive in the order it pushed them
+    std::vector<int> next(PRODUCERS, 0);
+    int received = 0;
+    while (received < PRODUCERS * COUNT) {
+        int value = -1;
+        if (queue.tryPop(value)) {
+            int producer = value / COUNT;
+            ASSERT_EQ(next[producer], value % COUNT);
+            next[producer] += 1;
+            received += 1;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    int value = 0;
+    EXPECT_FALSE(queue.tryPop(value));
+}
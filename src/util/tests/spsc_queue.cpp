@@ -0,0 +1,74 @@
+#include "util/spsc_queue.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace thrive;
+
+
+TEST(SpscQueue, RoundsUpCapacity) {
+    EXPECT_EQ(8u, SpscQueue<int>(5).capacity());
+    EXPECT_EQ(1u, SpscQueue<int>(1).capacity());
+    EXPECT_THROW(SpscQueue<int>(0), std::invalid_argument);
+}
+
+
+TEST(SpscQueue, PushesAndPopsInOrder) {
+    SpscQueue<int> queue(4);
+    int value = 0;
+    EXPECT_FALSE(queue.tryPop(value));
+    for (int i = 1; i <= 4; ++i) {
+        EXPECT_TRUE(queue.tryPush(i));
+    }
+    EXPECT_FALSE(queue.tryPush(5));
+    EXPECT_EQ(4u, queue.size());
+    // Wraps around the buffer
+    for (int round = 0; round < 3; ++round) {
+        EXPECT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(1 + round, value);
+        EXPECT_TRUE(queue.tryPush(5 + round));
+    }
+    for (int expected = 4; expected <= 7; ++expected) {
+        EXPECT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(expected, value);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+
+TEST(SpscQueue, MovesValues) {
+    SpscQueue<std::unique_ptr<int>> queue(2);
+    EXPECT_TRUE(queue.tryPush(std::unique_ptr<int>(new int(3))));
+    std::unique_ptr<int> value;
+    EXPECT_TRUE(queue.tryPop(value));
+    ASSERT_TRUE(value != nullptr);
+    EXPECT_EQ(3, *value);
+}
+
+
+TEST(SpscQueue, HandsOffBetweenThreads) {
+    const int COUNT = 20000;
+    SpscQueue<int> queue(64);
+    std::thread producer([&queue] () {
+        for (int i = 0; i < COUNT; ++i) {
+            while (not queue.tryPush(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int expected = 0;
+    while (expected < COUNT) {
+        int value = -1;
+        if (queue.tryPop(value)) {
+            ASSERT_EQ(expected, value);
+            expected += 1;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
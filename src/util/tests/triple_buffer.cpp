@@ -0,0 +1,59 @@
+#include "util/triple_buffer.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace thrive;
+
+
+TEST(TripleBuffer, KeepsLatestSnapshot) {
+    TripleBuffer<int> buffer(-1);
+    EXPECT_FALSE(buffer.update());
+    EXPECT_EQ(-1, buffer.readBuffer());
+    buffer.writeBuffer() = 1;
+    buffer.publish();
+    buffer.writeBuffer() = 2;
+    buffer.publish();
+    // The first snapshot was never read
+    EXPECT_TRUE(buffer.update());
+    EXPECT_EQ(2, buffer.readBuffer());
+    EXPECT_FALSE(buffer.update());
+    EXPECT_EQ(2, buffer.readBuffer());
+    buffer.writeBuffer() = 3;
+    buffer.publish();
+    EXPECT_TRUE(buffer.update());
+    EXPECT_EQ(3, buffer.readBuffer());
+}
+
+
+TEST(TripleBuffer, NeverTearsSnapshots) {
+    const int SNAPSHOTS = 20000;
+    TripleBuffer<std::vector<int>> buffer(std::vector<int>(16, 0));
+    std::atomic<bool> isDone(false);
+    std::thread writer([&buffer, &isDone] () {
+        for (int i = 1; i <= SNAPSHOTS; ++i) {
+            for (int& value : buffer.writeBuffer()) {
+                value = i;
+            }
+            buffer.publish();
+        }
+        isDone = true;
+    });
+    int last = 0;
+    while (not isDone or buffer.update()) {
+        if (not buffer.update()) {
+            continue;
+        }
+        const std::vector<int>& snapshot = buffer.readBuffer();
+        for (int value : snapshot) {
+            ASSERT_EQ(snapshot.front(), value);
+        }
+        ASSERT_GT(snapshot.front(), last);
+        last = snapshot.front();
+    }
+    writer.join();
+    buffer.update();
+    EXPECT_EQ(SNAPSHOTS, buffer.readBuffer().front());
+}
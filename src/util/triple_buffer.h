@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+
+namespace thrive {
+
+/**
+* @brief Hands the latest snapshot from one writer thread to one reader
+* thread without waiting
+*
+* Of three buffers, the writer owns one to fill, the reader owns one to
+* read from and the third holds the latest published snapshot. publish()
+* and update() swap their own buffer with the third one in a single atomic
+* exchange, so neither thread ever waits for the other or sees a snapshot
+* in the middle of being written. Snapshots that the reader doesn't pick
+* up before the next publish() are skipped. Use it where only the newest
+* state matters, like the transforms a simulation thread hands to the
+* renderer.
+*
+* Usage:
+* \code
+* // Writer
+* Snapshot& snapshot = buffer.writeBuffer();
+* fill(snapshot);
+* buffer.publish();
+* // Reader
+* if (buffer.update()) {
+*     draw(buffer.readBuffer());
+* }
+* \endcode
+*
+* @tparam T
+*   A copyable type
+*/
+template<typename T>
+class TripleBuffer {
+
+public:
+
+    /**
+    * @brief Constructor
+    *
+    * @param initial
+    *   The value of all three buffers. The reader sees it until the first
+    *   update().
+    */
+    explicit TripleBuffer(
+        const T& initial = T()
+    ) : m_buffers{initial, initial, initial}
+    {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+
+    TripleBuffer& operator= (const TripleBuffer&) = delete;
+
+    /**
+    * @brief Publishes the write buffer as the latest snapshot
+    *
+    * Writer thread only. Afterwards, writeBuffer() is another buffer that
+    * still holds an older snapshot, so the writer has to overwrite all of
+    * it.
+    */
+    void
+    publish() {
+        unsigned int previous = m_latest.exchange(
+            m_writeIndex | HAS_NEW_SNAPSHOT,
+            std::memory_order_acq_rel
+        );
+        m_writeIndex = previous & INDEX_MASK;
+    }
+
+    /**
+    * @brief The snapshot the reader currently holds
+    *
+    * Reader thread only. Stays the same until the next update().
+    */
+    const T&
+    readBuffer() const {
+        return m_buffers[m_readIndex];
+    }
+
+    /**
+    * @brief Switches the read buffer to the latest snapshot, if there is
+    * a new one
+    *
+    * Reader thread only.
+    *
+    * @return
+    *   \c true if a snapshot was published since the last update()
+    */
+    bool
+    update() {
+        if (not (m_latest.load(std::memory_order_relaxed) & HAS_NEW_SNAPSHOT)) {
+            return false;
+        }
+        unsigned int previous = m_latest.exchange(
+            m_readIndex,
+            std::memory_order_acq_rel
+        );
+        m_readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    /**
+    * @brief The buffer to write the next snapshot to
+    *
+    * Writer thread only.
+    */
+    T&
+    writeBuffer() {
+        return m_buffers[m_writeIndex];
+    }
+
+private:
+
+    static const unsigned int HAS_NEW_SNAPSHOT = 4;
+
+    static const unsigned int INDEX_MASK = 3;
+
+    T m_buffers[3];
+
+    // The index of the latest snapshot, with HAS_NEW_SNAPSHOT set until
+    // the reader takes it
+    std::atomic<unsigned int> m_latest = {2};
+
+    // Only used by the reader
+    unsigned int m_readIndex = 1;
+
+    // Only used by the writer
+    unsigned int m_writeIndex = 0;
+
+};
+
+}